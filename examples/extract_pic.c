@@ -23,6 +23,21 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+/** @file
+ * @short Upipe example extracting pictures from a transport stream
+ *
+ * In its simple form, this example decodes the first picture of a file:
+ *   ./extract_pic foo.ts foo.jpg
+ *
+ * With -i, the pictures are extracted from a multicat archive at the given
+ * system dates (in 27 MHz units), using its index to start reading at the
+ * last random access point before each date instead of decoding from the
+ * beginning of the archive:
+ *   ./extract_pic -i foo/index foo/ .ts 27000000000 a.jpg 27270000000 b.jpg
+ * The extractions are spread over several threads (see -t), each running
+ * its own event loop and managers, and share the opened index.
+ */
+
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_stdio.h>
 #include <upipe/uprobe_prefix.h>
@@ -49,6 +64,7 @@
 #include <upump-ev/upump_ev.h>
 #include <upipe-modules/upipe_file_sink.h>
 #include <upipe-modules/upipe_file_source.h>
+#include <upipe-modules/upipe_multicat_index.h>
 #include <upipe-modules/upipe_probe_uref.h>
 #include <upipe-modules/upipe_null.h>
 #include <upipe-av/upipe_av.h>
@@ -66,12 +82,12 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <fcntl.h>
 #include <sys/param.h>
 #include <signal.h>
 #include <pthread.h>
 
 #include <ev.h>
-#include <pthread.h>
 
 #define UDICT_POOL_DEPTH    50
 #define UREF_POOL_DEPTH     50
@@ -87,30 +103,72 @@
 
 #define UPROBE_LOG_LEVEL UPROBE_LOG_NOTICE
 
+/** description of a thread running an event loop */
+struct worker {
+    /** thread */
+    pthread_t thread;
+    /** index of the first extraction */
+    unsigned int first;
+    /** stride between extractions of this thread */
+    unsigned int stride;
+
+    /** probe hierarchy of the thread */
+    struct uprobe *logger;
+    /** pipe managers of the thread */
+    struct upipe_mgr *upipe_avcdec_mgr;
+    struct upipe_mgr *upipe_avcenc_mgr;
+    struct upipe_mgr *upipe_filter_blend_mgr;
+    struct upipe_mgr *upipe_sws_mgr;
+    struct upipe_mgr *upipe_fsink_mgr;
+    struct upipe_mgr *upipe_probe_uref_mgr;
+    /** null pipe, receiving the remaining data */
+    struct upipe *upipe_null;
+};
+
+/** description of an extracted picture */
+struct extraction {
+    /** system date of the picture, if extracted from an archive */
+    uint64_t date;
+    /** destination path */
+    const char *dstpath;
+    /** thread running the extraction */
+    struct worker *worker;
+
+    /** file source */
+    struct upipe *upipe_source;
+    /** selected output of the demux */
+    struct upipe *upipe_split_output;
+    /** probe catching the demux outputs */
+    struct uprobe uprobe_catch;
+    /** probe catching the decoder outputs */
+    struct uprobe uprobe_avcdec;
+    /** probe catching the encoded picture */
+    struct uprobe uprobe_uref;
+};
+
 enum uprobe_log_level loglevel = UPROBE_LOG_LEVEL;
 
 FILE *logstream;
-struct uprobe *logger;
-struct uprobe uprobe_uref;
-struct uprobe uprobe_avcdec;
-struct upipe_mgr *upipe_avcdec_mgr;
-struct upipe_mgr *upipe_avcenc_mgr;
-struct upipe_mgr *upipe_filter_blend_mgr;
-struct upipe_mgr *upipe_sws_mgr;
-struct upipe_mgr *upipe_fsink_mgr;
-struct upipe_mgr *upipe_probe_uref_mgr;
-struct uref_mgr *uref_mgr;
-
-const char *srcpath, *dstpath;
-
-struct upipe *upipe_source;
-struct upipe *upipe_split_output = NULL;
-struct upipe *upipe_null;
+
+/** source file, or archive directory/prefix */
+const char *srcpath;
+/** archive suffix */
+const char *suffix;
+/** file descriptor of the archive index, or -1 */
+int index_fd = -1;
+
+/** extractions */
+struct extraction *extractions;
+/** number of extractions */
+unsigned int nb_extractions = 0;
 
 static void usage(const char *argv0) {
     fprintf(stderr, "Usage: %s [-d] [-q] <source> <destination>\n", argv0);
+    fprintf(stderr, "       %s [-d] [-q] [-t <threads>] -i <index> <archive dir/prefix> <suffix> <date> <destination> [<date> <destination>...]\n", argv0);
     fprintf(stderr, "   -d: force debug log level\n");
     fprintf(stderr, "   -q: quieter log\n");
+    fprintf(stderr, "   -t: number of threads (default: number of processors)\n");
+    fprintf(stderr, "   -i: index of a multicat archive, dates in 27MHz units\n");
     exit(EXIT_FAILURE);
 }
 
@@ -118,6 +176,8 @@ static void usage(const char *argv0) {
 static int uref_catch(struct uprobe *uprobe, struct upipe *upipe,
                       int event, va_list args)
 {
+    struct extraction *extraction =
+        container_of(uprobe, struct extraction, uprobe_uref);
     if (event != UPROBE_PROBE_UREF)
         return uprobe_throw_next(uprobe, upipe, event, args);
 
@@ -128,17 +188,18 @@ static int uref_catch(struct uprobe *uprobe, struct upipe *upipe,
     if (signature != UPIPE_PROBE_UREF_SIGNATURE)
         return uprobe_throw_next(uprobe, upipe, event, args);
 
-    if (upipe_source != NULL) {
+    if (extraction->upipe_source != NULL) {
         /* release the source to exit */
-        upipe_release(upipe_source);
-        upipe_source = NULL;
+        upipe_release(extraction->upipe_source);
+        extraction->upipe_source = NULL;
         /* send demux output to /dev/null */
-        upipe_set_output(upipe_split_output, upipe_null);
-        upipe_release(upipe_split_output);
-        upipe_split_output = NULL;
+        upipe_set_output(extraction->upipe_split_output,
+                         extraction->worker->upipe_null);
+        upipe_release(extraction->upipe_split_output);
+        extraction->upipe_split_output = NULL;
     } else {
         /* second (or after) frame, do not output them */
-        upipe_set_output(upipe, upipe_null);
+        upipe_set_output(upipe, extraction->worker->upipe_null);
     }
     return UBASE_ERR_NONE;
 }
@@ -147,6 +208,9 @@ static int uref_catch(struct uprobe *uprobe, struct upipe *upipe,
 static int avcdec_catch(struct uprobe *uprobe, struct upipe *upipe,
                         int event, va_list args)
 {
+    struct extraction *extraction =
+        container_of(uprobe, struct extraction, uprobe_avcdec);
+    struct worker *worker = extraction->worker;
     if (event != UPROBE_NEED_OUTPUT)
         return uprobe_throw_next(uprobe, upipe, event, args);
 
@@ -159,7 +223,8 @@ static int avcdec_catch(struct uprobe *uprobe, struct upipe *upipe,
                  !ubase_check(uref_pic_flow_get_vsize(flow_def, &vsize)) ||
                  !ubase_check(uref_pic_flow_get_sar(flow_def, &sar)))) {
         upipe_err_va(upipe, "incompatible flow def");
-        upipe_release(upipe_source);
+        upipe_release(extraction->upipe_source);
+        extraction->upipe_source = NULL;
         return UBASE_ERR_UNHANDLED;
     }
     wanted_hsize = (hsize * sar.num / sar.den / 2) * 2;
@@ -171,8 +236,8 @@ static int avcdec_catch(struct uprobe *uprobe, struct upipe *upipe,
     if (!progressive) {
         uref_pic_set_progressive(flow_def2);
         struct upipe *deint = upipe_void_alloc_output(upipe,
-                upipe_filter_blend_mgr,
-                uprobe_pfx_alloc(uprobe_use(logger),
+                worker->upipe_filter_blend_mgr,
+                uprobe_pfx_alloc(uprobe_use(worker->logger),
                                  loglevel, "deint"));
         assert(deint != NULL);
         upipe_release(upipe);
@@ -181,15 +246,17 @@ static int avcdec_catch(struct uprobe *uprobe, struct upipe *upipe,
 
     if (wanted_hsize != hsize) {
         uref_pic_flow_set_hsize(flow_def2, wanted_hsize);
-        struct upipe *sws = upipe_flow_alloc_output(upipe, upipe_sws_mgr,
-                uprobe_pfx_alloc_va(uprobe_use(logger),
+        struct upipe *sws = upipe_flow_alloc_output(upipe,
+                worker->upipe_sws_mgr,
+                uprobe_pfx_alloc_va(uprobe_use(worker->logger),
                                     loglevel, "sws"), flow_def2);
         assert(sws != NULL);
         upipe_release(upipe);
         if (sws == NULL) {
             upipe_err_va(upipe, "incompatible flow def");
             uref_free(flow_def2);
-            upipe_release(upipe_source);
+            upipe_release(extraction->upipe_source);
+            extraction->upipe_source = NULL;
             return true;
         }
         upipe = sws;
@@ -197,8 +264,9 @@ static int avcdec_catch(struct uprobe *uprobe, struct upipe *upipe,
 
     uref_pic_flow_clear_format(flow_def2);
     uref_flow_set_def(flow_def2, "block.mjpeg.pic.");
-    struct upipe *jpegenc = upipe_flow_alloc_output(upipe, upipe_avcenc_mgr,
-            uprobe_pfx_alloc_va(uprobe_use(logger),
+    struct upipe *jpegenc = upipe_flow_alloc_output(upipe,
+            worker->upipe_avcenc_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(worker->logger),
                                 loglevel, "jpeg"), flow_def2);
     assert(jpegenc != NULL);
     upipe_release(upipe);
@@ -206,20 +274,21 @@ static int avcdec_catch(struct uprobe *uprobe, struct upipe *upipe,
     upipe = jpegenc;
 
     struct upipe *urefprobe = upipe_void_alloc_output(upipe,
-            upipe_probe_uref_mgr,
-            uprobe_pfx_alloc_va(uprobe_use(&uprobe_uref),
+            worker->upipe_probe_uref_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(&extraction->uprobe_uref),
                                 loglevel, "urefprobe"));
     assert(urefprobe != NULL);
     upipe_release(upipe);
     upipe = urefprobe;
 
-    struct upipe *fsink = upipe_void_alloc_output(upipe, upipe_fsink_mgr,
-            uprobe_pfx_alloc_va(uprobe_use(logger),
+    struct upipe *fsink = upipe_void_alloc_output(upipe,
+            worker->upipe_fsink_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(worker->logger),
             ((loglevel > UPROBE_LOG_DEBUG) ? UPROBE_LOG_WARNING : loglevel),
             "jpegsink"));
     assert(fsink != NULL);
     upipe_release(upipe);
-    upipe_fsink_set_path(fsink, dstpath, UPIPE_FSINK_OVERWRITE);
+    upipe_fsink_set_path(fsink, extraction->dstpath, UPIPE_FSINK_OVERWRITE);
     upipe = fsink;
 
     uref_free(flow_def2);
@@ -231,63 +300,119 @@ static int avcdec_catch(struct uprobe *uprobe, struct upipe *upipe,
 static int split_catch(struct uprobe *uprobe, struct upipe *upipe,
                        int event, va_list args)
 {
+    struct extraction *extraction =
+        container_of(uprobe, struct extraction, uprobe_catch);
     if (event != UPROBE_NEED_OUTPUT)
         return uprobe_throw_next(uprobe, upipe, event, args);
 
-    upipe_release(upipe_split_output);
-    upipe_split_output = upipe_use(upipe);
+    upipe_release(extraction->upipe_split_output);
+    extraction->upipe_split_output = upipe_use(upipe);
 
-    struct upipe *avcdec = upipe_void_alloc_output(upipe, upipe_avcdec_mgr,
-            uprobe_pfx_alloc_va(uprobe_use(&uprobe_avcdec),
+    struct upipe *avcdec = upipe_void_alloc_output(upipe,
+            extraction->worker->upipe_avcdec_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(&extraction->uprobe_avcdec),
                                 loglevel, "avcdec"));
     if (avcdec == NULL) {
         upipe_err_va(upipe, "incompatible flow def");
-        upipe_release(upipe_source);
+        upipe_release(extraction->upipe_source);
+        extraction->upipe_source = NULL;
         return UBASE_ERR_UNHANDLED;
     }
     upipe_release(avcdec);
     return UBASE_ERR_NONE;
 }
 
-int main(int argc, char **argv)
+/** opens the source of an extraction, from the last random access point
+ * before its date if it is extracted from an archive */
+static int open_source(struct extraction *extraction)
 {
-    int opt;
-
-    /* parse options */
-    while ((opt = getopt(argc, argv, "dq")) != -1) {
-        switch (opt) {
-            case 'd':
-                if (loglevel > 0) loglevel--;
-                break;
-            case 'q':
-                if (loglevel < UPROBE_LOG_ERROR) loglevel++;
-                break;
-            default:
-                usage(argv[0]);
-        }
+    struct upipe *upipe_source = extraction->upipe_source;
+    if (index_fd == -1)
+        return upipe_set_uri(upipe_source, srcpath);
+
+    /* the index is shared by all threads, and only read with pread() */
+    struct upipe_multicat_index_entry entry;
+    if (!ubase_check(upipe_multicat_index_lookup(index_fd, extraction->date,
+                                                 true, &entry))) {
+        upipe_err_va(upipe_source, "date %"PRIu64" not found in index",
+                     extraction->date);
+        return UBASE_ERR_INVALID;
     }
-    if (optind >= argc - 1) {
-        usage(argv[0]);
+
+    char path[MAXPATHLEN];
+    snprintf(path, MAXPATHLEN, "%s%"PRId64"%s", srcpath, entry.fileidx,
+             suffix);
+    UBASE_RETURN(upipe_set_uri(upipe_source, path))
+    return upipe_fsrc_set_position(upipe_source, entry.offset);
+}
+
+/** starts the pipes of an extraction */
+static void start_extraction(struct extraction *extraction)
+{
+    struct worker *worker = extraction->worker;
+
+    /* split probe */
+    uprobe_init(&extraction->uprobe_catch, split_catch,
+                uprobe_use(worker->logger));
+
+    /* other probes */
+    uprobe_init(&extraction->uprobe_avcdec, avcdec_catch,
+                uprobe_use(worker->logger));
+    uprobe_init(&extraction->uprobe_uref, uref_catch,
+                uprobe_use(worker->logger));
+
+    /* file source */
+    struct upipe_mgr *upipe_fsrc_mgr = upipe_fsrc_mgr_alloc();
+    extraction->upipe_source = upipe_void_alloc(upipe_fsrc_mgr,
+            uprobe_pfx_alloc(uprobe_use(worker->logger), loglevel, "fsrc"));
+    assert(extraction->upipe_source != NULL);
+    upipe_mgr_release(upipe_fsrc_mgr);
+    if (!ubase_check(open_source(extraction))) {
+        upipe_release(extraction->upipe_source);
+        extraction->upipe_source = NULL;
+        return;
     }
-    srcpath = argv[optind++];
-    dstpath = argv[optind++];
 
-    /* choose log fd */
-    logstream = stderr;
+    /* upipe-ts */
+    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
+    struct upipe_mgr *upipe_mpgvf_mgr = upipe_mpgvf_mgr_alloc();
+    upipe_ts_demux_mgr_set_mpgvf_mgr(upipe_ts_demux_mgr, upipe_mpgvf_mgr);
+    upipe_mgr_release(upipe_mpgvf_mgr);
+    struct upipe_mgr *upipe_h264f_mgr = upipe_h264f_mgr_alloc();
+    upipe_ts_demux_mgr_set_h264f_mgr(upipe_ts_demux_mgr, upipe_h264f_mgr);
+    upipe_mgr_release(upipe_h264f_mgr);
+    struct upipe *ts_demux = upipe_void_alloc_output(extraction->upipe_source,
+            upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(
+                uprobe_selflow_alloc(uprobe_use(worker->logger),
+                    uprobe_selflow_alloc(uprobe_use(worker->logger),
+                        uprobe_use(&extraction->uprobe_catch),
+                        UPROBE_SELFLOW_PIC, "auto"),
+                    UPROBE_SELFLOW_VOID, "auto"),
+                 loglevel, "tsdemux"));
+    assert(ts_demux != NULL);
+    upipe_mgr_release(upipe_ts_demux_mgr);
+    upipe_release(ts_demux);
+}
 
-    /* setup environnement */
-    struct ev_loop *loop = ev_default_loop(0);
+/** runs the event loop of a thread and all its extractions */
+static void *run_worker(void *opaque)
+{
+    struct worker *worker = opaque;
+
+    /* setup environnement, private to the thread */
+    struct ev_loop *loop = ev_loop_new(0);
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
     struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
                                                          umem_mgr, -1, -1);
-    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
                                                    0);
 
     struct upump_mgr *upump_mgr = upump_ev_mgr_alloc(loop,
                             UPUMP_POOL, UPUMP_BLOCKER_POOL);
 
     /* default probe */
-    logger = uprobe_stdio_alloc(NULL, logstream, loglevel);
+    struct uprobe *logger = uprobe_stdio_alloc(NULL, logstream, loglevel);
     assert(logger != NULL);
     logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
     assert(logger != NULL);
@@ -298,85 +423,148 @@ int main(int argc, char **argv)
     assert(logger != NULL);
     uref_mgr_release(uref_mgr);
     upump_mgr_release(upump_mgr);
+    worker->logger = logger;
 
-    /* split probe */
-    struct uprobe uprobe_catch;
-    uprobe_init(&uprobe_catch, split_catch, uprobe_use(logger));
-
-    /* other probes */
-    uprobe_init(&uprobe_avcdec, avcdec_catch, uprobe_use(logger));
-    uprobe_init(&uprobe_uref, uref_catch, uprobe_use(logger));
-
-    /* upipe-av */
-    upipe_av_init(true, uprobe_use(logger));
-
-    /* global pipe managers */
-    upipe_avcdec_mgr = upipe_avcdec_mgr_alloc();
-    upipe_avcenc_mgr = upipe_avcenc_mgr_alloc();
-    upipe_sws_mgr = upipe_sws_mgr_alloc();
-    upipe_filter_blend_mgr = upipe_filter_blend_mgr_alloc();
-    upipe_fsink_mgr = upipe_fsink_mgr_alloc();
-    upipe_probe_uref_mgr = upipe_probe_uref_mgr_alloc();
+    /* pipe managers */
+    worker->upipe_avcdec_mgr = upipe_avcdec_mgr_alloc();
+    worker->upipe_avcenc_mgr = upipe_avcenc_mgr_alloc();
+    worker->upipe_sws_mgr = upipe_sws_mgr_alloc();
+    worker->upipe_filter_blend_mgr = upipe_filter_blend_mgr_alloc();
+    worker->upipe_fsink_mgr = upipe_fsink_mgr_alloc();
+    worker->upipe_probe_uref_mgr = upipe_probe_uref_mgr_alloc();
 
     /* null */
     struct upipe_mgr *upipe_null_mgr = upipe_null_mgr_alloc();
-    upipe_null = upipe_void_alloc(upipe_null_mgr,
+    worker->upipe_null = upipe_void_alloc(upipe_null_mgr,
             uprobe_pfx_alloc(uprobe_use(logger), loglevel, "null"));
-    assert(upipe_null != NULL);
+    assert(worker->upipe_null != NULL);
     upipe_mgr_release(upipe_null_mgr);
 
-    /* file source */
-    struct upipe_mgr *upipe_fsrc_mgr = upipe_fsrc_mgr_alloc();
-    upipe_source = upipe_void_alloc(upipe_fsrc_mgr,
-            uprobe_pfx_alloc(uprobe_use(logger), loglevel, "fsrc"));
-    assert(upipe_source != NULL);
-    upipe_mgr_release(upipe_fsrc_mgr);
-    if (!ubase_check(upipe_set_uri(upipe_source, srcpath)))
-        exit(EXIT_FAILURE);
-
-    /* upipe-ts */
-    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
-    struct upipe_mgr *upipe_mpgvf_mgr = upipe_mpgvf_mgr_alloc();
-    upipe_ts_demux_mgr_set_mpgvf_mgr(upipe_ts_demux_mgr, upipe_mpgvf_mgr);
-    upipe_mgr_release(upipe_mpgvf_mgr);
-    struct upipe_mgr *upipe_h264f_mgr = upipe_h264f_mgr_alloc();
-    upipe_ts_demux_mgr_set_h264f_mgr(upipe_ts_demux_mgr, upipe_h264f_mgr);
-    upipe_mgr_release(upipe_h264f_mgr);
-    struct upipe *ts_demux = upipe_void_alloc_output(upipe_source,
-            upipe_ts_demux_mgr,
-            uprobe_pfx_alloc(
-                uprobe_selflow_alloc(uprobe_use(logger),
-                    uprobe_selflow_alloc(uprobe_use(logger), &uprobe_catch,
-                        UPROBE_SELFLOW_PIC, "auto"),
-                    UPROBE_SELFLOW_VOID, "auto"),
-                 loglevel, "tsdemux"));
-    assert(ts_demux != NULL);
-    upipe_mgr_release(upipe_ts_demux_mgr);
-    upipe_release(ts_demux);
+    for (unsigned int i = worker->first; i < nb_extractions;
+         i += worker->stride) {
+        extractions[i].worker = worker;
+        start_extraction(&extractions[i]);
+    }
 
     /* fire loop ! */
     ev_loop(loop, 0);
 
     /* release everyhing */
-    upipe_release(upipe_source);
-    upipe_release(upipe_split_output);
-    upipe_release(upipe_null);
+    for (unsigned int i = worker->first; i < nb_extractions;
+         i += worker->stride) {
+        struct extraction *extraction = &extractions[i];
+        upipe_release(extraction->upipe_source);
+        upipe_release(extraction->upipe_split_output);
+        uprobe_clean(&extraction->uprobe_catch);
+        uprobe_clean(&extraction->uprobe_avcdec);
+        uprobe_clean(&extraction->uprobe_uref);
+    }
+    upipe_release(worker->upipe_null);
     uprobe_release(logger);
-    uprobe_clean(&uprobe_catch);
-    uprobe_clean(&uprobe_avcdec);
-    uprobe_clean(&uprobe_uref);
 
-    upipe_mgr_release(upipe_avcdec_mgr);
-    upipe_mgr_release(upipe_avcenc_mgr);
-    upipe_mgr_release(upipe_sws_mgr);
-    upipe_mgr_release(upipe_filter_blend_mgr);
-    upipe_mgr_release(upipe_fsink_mgr);
-    upipe_mgr_release(upipe_probe_uref_mgr);
+    upipe_mgr_release(worker->upipe_avcdec_mgr);
+    upipe_mgr_release(worker->upipe_avcenc_mgr);
+    upipe_mgr_release(worker->upipe_sws_mgr);
+    upipe_mgr_release(worker->upipe_filter_blend_mgr);
+    upipe_mgr_release(worker->upipe_fsink_mgr);
+    upipe_mgr_release(worker->upipe_probe_uref_mgr);
 
     udict_mgr_release(udict_mgr);
     umem_mgr_release(umem_mgr);
 
-    ev_default_destroy();
+    ev_loop_destroy(loop);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *index_path = NULL;
+    long nb_threads = 0;
+    int opt;
+
+    /* parse options */
+    while ((opt = getopt(argc, argv, "dqt:i:")) != -1) {
+        switch (opt) {
+            case 'd':
+                if (loglevel > 0) loglevel--;
+                break;
+            case 'q':
+                if (loglevel < UPROBE_LOG_ERROR) loglevel++;
+                break;
+            case 't':
+                nb_threads = strtol(optarg, NULL, 0);
+                break;
+            case 'i':
+                index_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc - 1) {
+        usage(argv[0]);
+    }
+    srcpath = argv[optind++];
+    if (index_path != NULL) {
+        suffix = argv[optind++];
+        if (optind >= argc || (argc - optind) % 2)
+            usage(argv[0]);
+        nb_extractions = (argc - optind) / 2;
+    } else {
+        if (optind != argc - 1)
+            usage(argv[0]);
+        nb_extractions = 1;
+    }
+
+    extractions = calloc(nb_extractions, sizeof(struct extraction));
+    assert(extractions != NULL);
+    for (unsigned int i = 0; i < nb_extractions; i++) {
+        if (index_path != NULL)
+            extractions[i].date = strtoull(argv[optind++], NULL, 0);
+        extractions[i].dstpath = argv[optind++];
+    }
+
+    if (index_path != NULL) {
+        index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+        if (index_fd == -1) {
+            fprintf(stderr, "can't open index %s (%m)\n", index_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (nb_threads <= 0)
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_threads <= 0)
+        nb_threads = 1;
+    if (nb_threads > nb_extractions)
+        nb_threads = nb_extractions;
+
+    /* choose log fd */
+    logstream = stderr;
+
+    /* upipe-av */
+    struct uprobe *logger = uprobe_stdio_alloc(NULL, logstream, loglevel);
+    assert(logger != NULL);
+    upipe_av_init(true, logger);
+
+    /* one event loop per thread, extractions spread in round robin */
+    struct worker workers[nb_threads];
+    for (long i = 0; i < nb_threads; i++) {
+        workers[i].first = i;
+        workers[i].stride = nb_threads;
+        if (i && pthread_create(&workers[i].thread, NULL, run_worker,
+                                &workers[i]) != 0) {
+            fprintf(stderr, "unable to create thread (%m)\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    run_worker(&workers[0]);
+    for (long i = 1; i < nb_threads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    if (index_fd != -1)
+        close(index_fd);
+    free(extractions);
     upipe_av_clean();
 
     return 0;
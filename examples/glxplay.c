@@ -430,29 +430,39 @@ static int upipe_glxplayer_catch_avcdec(struct uprobe *uprobe,
             if (unlikely(deint == NULL))
                 return UBASE_ERR_ALLOC;
 
-            struct uref *output_flow = uref_dup(flow_def);
-            if (unlikely(output_flow == NULL))
-                return UBASE_ERR_ALLOC;
-            uref_pic_flow_clear_format(output_flow);
-            if (unlikely(!ubase_check(uref_pic_flow_set_macropixel(output_flow, 1)) ||
-                         !ubase_check(uref_pic_flow_set_planes(output_flow, 0)) ||
-                         !ubase_check(uref_pic_flow_add_plane(output_flow, 1, 1, 3,
-                                                  "r8g8b8")))) {
+            struct upipe *yuvrgb = deint;
+            uint8_t plane;
+            /* 8-bit planar yuv is converted to rgb by the GL shader */
+            if (!ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 1,
+                                                        "y8")) ||
+                !ubase_check(uref_pic_flow_find_chroma(flow_def, "u8",
+                                                       &plane)) ||
+                !ubase_check(uref_pic_flow_find_chroma(flow_def, "v8",
+                                                       &plane))) {
+                struct uref *output_flow = uref_dup(flow_def);
+                if (unlikely(output_flow == NULL))
+                    return UBASE_ERR_ALLOC;
+                uref_pic_flow_clear_format(output_flow);
+                if (unlikely(!ubase_check(uref_pic_flow_set_macropixel(output_flow, 1)) ||
+                             !ubase_check(uref_pic_flow_set_planes(output_flow, 0)) ||
+                             !ubase_check(uref_pic_flow_add_plane(output_flow, 1, 1, 3,
+                                                      "r8g8b8")))) {
+                    uref_free(output_flow);
+                    return UBASE_ERR_ALLOC;
+                }
+
+                yuvrgb = upipe_flow_alloc_output(deint,
+                        glxplayer->upipe_sws_mgr,
+                        uprobe_pfx_alloc_va(uprobe_use(glxplayer->uprobe_logger),
+                                            glxplayer->loglevel, "rgb"),
+                        output_flow);
+                assert(yuvrgb != NULL);
                 uref_free(output_flow);
-                return UBASE_ERR_ALLOC;
+                upipe_release(deint);
+                if (unlikely(yuvrgb == NULL))
+                    return UBASE_ERR_ALLOC;
             }
 
-            struct upipe *yuvrgb = upipe_flow_alloc_output(deint,
-                    glxplayer->upipe_sws_mgr,
-                    uprobe_pfx_alloc_va(uprobe_use(glxplayer->uprobe_logger),
-                                        glxplayer->loglevel, "rgb"),
-                    output_flow);
-            assert(yuvrgb != NULL);
-            uref_free(output_flow);
-            upipe_release(deint);
-            if (unlikely(yuvrgb == NULL))
-                return UBASE_ERR_ALLOC;
-
             glxplayer->upipe_glx_qsink =
                 upipe_qsink_alloc(glxplayer->upipe_qsink_mgr,
                     uprobe_pfx_alloc(uprobe_use(glxplayer->uprobe_logger),
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short benchmarks TS pipelines running as fast as possible on a file
+ *
+ * The file is read without a clock, so that the pumps of the source are
+ * not paced, and demultiplexed with the framers. By default the elementary
+ * streams are then remultiplexed into a TS, whereas with -d they are only
+ * demultiplexed. All outputs end up in null sinks. The throughput, the CPU
+ * consumption and the peak memory usage are printed at the end.
+ */
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_flow.h>
+#include <upipe/upipe.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe-modules/upipe_file_source.h>
+#include <upipe-modules/upipe_null.h>
+#include <upipe-modules/upipe_noclock.h>
+#include <upipe-ts/upipe_ts_demux.h>
+#include <upipe-ts/upipe_ts_mux.h>
+#include <upipe-framers/upipe_mpgv_framer.h>
+#include <upipe-framers/upipe_h264_framer.h>
+#include <upipe-framers/upipe_h265_framer.h>
+#include <upipe-framers/upipe_mpga_framer.h>
+#include <upipe-framers/upipe_a52_framer.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <ev.h>
+
+#define UPROBE_LOG_LEVEL UPROBE_LOG_WARNING
+#define UMEM_POOL 512
+#define UDICT_POOL_DEPTH 500
+#define UREF_POOL_DEPTH 500
+#define UBUF_POOL_DEPTH 3000
+#define UBUF_SHARED_POOL_DEPTH 50
+#define UPUMP_POOL 10
+#define UPUMP_BLOCKER_POOL 10
+#define READ_SIZE (188 * 7 * 64)
+#define TS_SIZE 188
+
+/** true if the elementary streams are remultiplexed */
+static bool remux = true;
+/** probe hierarchy shared by all pipes */
+static struct uprobe *logger;
+/** probe catching events from the demux outputs */
+static struct uprobe uprobe_demux_output_s;
+/** probe catching events from the demux programs */
+static struct uprobe uprobe_demux_program_s;
+/** manager of null sinks */
+static struct upipe_mgr *upipe_null_mgr;
+/** manager of noclock pipes */
+static struct upipe_mgr *upipe_noclock_mgr;
+
+/** returns the monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** returns the CPU time consumed by the process in seconds */
+static double cpu_time(void)
+{
+    struct rusage rusage;
+    getrusage(RUSAGE_SELF, &rusage);
+    return rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec / 1e6 +
+           rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec / 1e6;
+}
+
+/** returns true if the split pipe already has an output for the flow */
+static bool has_output(struct upipe *upipe, uint64_t flow_id)
+{
+    struct upipe *output = NULL;
+    while (ubase_check(upipe_iterate_sub(upipe, &output)) && output != NULL) {
+        struct uref *flow_def;
+        uint64_t id;
+        if (ubase_check(upipe_get_flow_def(output, &flow_def)) &&
+            ubase_check(uref_flow_get_id(flow_def, &id)) && id == flow_id)
+            return true;
+    }
+    return false;
+}
+
+/** probe to catch events from the TS demux outputs */
+static int catch_ts_demux_output(struct uprobe *uprobe, struct upipe *upipe,
+                                 int event, va_list args)
+{
+    if (event == UPROBE_SOURCE_END) {
+        upipe_release(upipe);
+        return UBASE_ERR_NONE;
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** probe to catch events from the TS demux programs */
+static int catch_ts_demux_program(struct uprobe *uprobe, struct upipe *upipe,
+                                  int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_SOURCE_END:
+            upipe_release(upipe);
+            return UBASE_ERR_NONE;
+
+        case UPROBE_NEED_OUTPUT: {
+            if (!remux)
+                return UBASE_ERR_NONE;
+            struct uref *flow_def = va_arg(args, struct uref *);
+            struct upipe *upipe_ts_demux, *upipe_ts_mux;
+            uint64_t flow_id;
+            if (unlikely(!ubase_check(upipe_sub_get_super(upipe,
+                                                          &upipe_ts_demux)) ||
+                         !ubase_check(upipe_get_output(upipe_ts_demux,
+                                                       &upipe_ts_mux)) ||
+                         !ubase_check(uref_flow_get_id(flow_def, &flow_id))))
+                return UBASE_ERR_INVALID;
+
+            struct upipe *mux_program = upipe_void_alloc_output_sub(upipe,
+                    upipe_ts_mux,
+                    uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                        "ts mux program %"PRIu64, flow_id));
+            if (unlikely(mux_program == NULL))
+                return UBASE_ERR_ALLOC;
+            upipe_release(mux_program);
+            return UBASE_ERR_NONE;
+        }
+
+        case UPROBE_SPLIT_UPDATE: {
+            struct uref *flow_def = NULL;
+            while (ubase_check(upipe_split_iterate(upipe, &flow_def)) &&
+                   flow_def != NULL) {
+                uint64_t flow_id;
+                if (!ubase_check(uref_flow_get_id(flow_def, &flow_id)) ||
+                    has_output(upipe, flow_id))
+                    continue;
+
+                struct upipe *output = upipe_flow_alloc_sub(upipe,
+                    uprobe_pfx_alloc_va(uprobe_use(&uprobe_demux_output_s),
+                                        UPROBE_LOG_LEVEL,
+                                        "ts demux output %"PRIu64, flow_id),
+                    flow_def);
+                if (unlikely(output == NULL))
+                    return UBASE_ERR_ALLOC;
+
+                if (!remux) {
+                    struct upipe *null = upipe_void_alloc_output(output,
+                        upipe_null_mgr,
+                        uprobe_pfx_alloc_va(uprobe_use(logger),
+                                            UPROBE_LOG_LEVEL,
+                                            "null %"PRIu64, flow_id));
+                    if (unlikely(null == NULL))
+                        return UBASE_ERR_ALLOC;
+                    upipe_release(null);
+                    continue;
+                }
+
+                struct upipe *noclock = upipe_void_alloc_output(output,
+                    upipe_noclock_mgr,
+                    uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                        "noclock %"PRIu64, flow_id));
+                if (unlikely(noclock == NULL))
+                    return UBASE_ERR_ALLOC;
+
+                struct upipe *mux_program;
+                if (ubase_check(upipe_get_output(upipe, &mux_program))) {
+                    struct upipe *mux_input = upipe_void_alloc_output_sub(
+                            noclock, mux_program,
+                            uprobe_pfx_alloc_va(uprobe_use(logger),
+                                                UPROBE_LOG_LEVEL,
+                                                "mux input %"PRIu64, flow_id));
+                    upipe_release(mux_input);
+                }
+                upipe_release(noclock);
+            }
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return uprobe_throw_next(uprobe, upipe, event, args);
+    }
+}
+
+/** probe to catch events from the TS demux */
+static int catch_ts_demux(struct uprobe *uprobe, struct upipe *upipe,
+                          int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_NEED_OUTPUT: {
+            if (!remux)
+                return UBASE_ERR_NONE;
+            struct upipe_mgr *upipe_ts_mux_mgr = upipe_ts_mux_mgr_alloc();
+            struct upipe *upipe_ts_mux = upipe_void_alloc_output(upipe,
+                    upipe_ts_mux_mgr,
+                    uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                     "ts mux"));
+            upipe_mgr_release(upipe_ts_mux_mgr);
+            if (unlikely(upipe_ts_mux == NULL))
+                return UBASE_ERR_ALLOC;
+
+            struct upipe *null = upipe_void_alloc_output(upipe_ts_mux,
+                    upipe_null_mgr,
+                    uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                     "null"));
+            upipe_release(null);
+            upipe_release(upipe_ts_mux);
+            return UBASE_ERR_NONE;
+        }
+
+        case UPROBE_SPLIT_UPDATE: {
+            struct uref *flow_def = NULL;
+            while (ubase_check(upipe_split_iterate(upipe, &flow_def)) &&
+                   flow_def != NULL) {
+                uint64_t flow_id;
+                if (!ubase_check(uref_flow_get_id(flow_def, &flow_id)) ||
+                    has_output(upipe, flow_id))
+                    continue;
+
+                struct upipe *program = upipe_flow_alloc_sub(upipe,
+                    uprobe_pfx_alloc_va(uprobe_use(&uprobe_demux_program_s),
+                                        UPROBE_LOG_LEVEL,
+                                        "ts demux program %"PRIu64, flow_id),
+                    flow_def);
+                if (unlikely(program == NULL))
+                    return UBASE_ERR_ALLOC;
+            }
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return uprobe_throw_next(uprobe, upipe, event, args);
+    }
+}
+
+/** runs the pipeline once on the file, and returns its size */
+static uint64_t run(struct ev_loop *loop, const char *file)
+{
+    struct upipe_mgr *upipe_fsrc_mgr = upipe_fsrc_mgr_alloc();
+    struct upipe *upipe_fsrc = upipe_void_alloc(upipe_fsrc_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "fsrc"));
+    upipe_mgr_release(upipe_fsrc_mgr);
+    assert(upipe_fsrc != NULL);
+    uint64_t size;
+    if (!ubase_check(upipe_source_set_read_size(upipe_fsrc, READ_SIZE)) ||
+        !ubase_check(upipe_set_uri(upipe_fsrc, file)) ||
+        !ubase_check(upipe_fsrc_get_size(upipe_fsrc, &size))) {
+        fprintf(stderr, "invalid file %s\n", file);
+        exit(EXIT_FAILURE);
+    }
+
+    struct uprobe uprobe_ts_demux_s;
+    uprobe_init(&uprobe_ts_demux_s, catch_ts_demux, uprobe_use(logger));
+
+    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
+    struct upipe_mgr *upipe_mpgvf_mgr = upipe_mpgvf_mgr_alloc();
+    upipe_ts_demux_mgr_set_mpgvf_mgr(upipe_ts_demux_mgr, upipe_mpgvf_mgr);
+    upipe_mgr_release(upipe_mpgvf_mgr);
+    struct upipe_mgr *upipe_h264f_mgr = upipe_h264f_mgr_alloc();
+    upipe_ts_demux_mgr_set_h264f_mgr(upipe_ts_demux_mgr, upipe_h264f_mgr);
+    upipe_mgr_release(upipe_h264f_mgr);
+    struct upipe_mgr *upipe_h265f_mgr = upipe_h265f_mgr_alloc();
+    upipe_ts_demux_mgr_set_h265f_mgr(upipe_ts_demux_mgr, upipe_h265f_mgr);
+    upipe_mgr_release(upipe_h265f_mgr);
+    struct upipe_mgr *upipe_mpgaf_mgr = upipe_mpgaf_mgr_alloc();
+    upipe_ts_demux_mgr_set_mpgaf_mgr(upipe_ts_demux_mgr, upipe_mpgaf_mgr);
+    upipe_mgr_release(upipe_mpgaf_mgr);
+    struct upipe_mgr *upipe_a52f_mgr = upipe_a52f_mgr_alloc();
+    upipe_ts_demux_mgr_set_a52f_mgr(upipe_ts_demux_mgr, upipe_a52f_mgr);
+    upipe_mgr_release(upipe_a52f_mgr);
+
+    struct upipe *upipe_ts_demux = upipe_void_alloc_output(upipe_fsrc,
+            upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(uprobe_use(&uprobe_ts_demux_s), UPROBE_LOG_LEVEL,
+                             "ts demux"));
+    upipe_mgr_release(upipe_ts_demux_mgr);
+    assert(upipe_ts_demux != NULL);
+    upipe_release(upipe_ts_demux);
+
+    ev_loop(loop, 0);
+
+    upipe_release(upipe_fsrc);
+    uprobe_clean(&uprobe_ts_demux_s);
+    return size;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-d] [-n <loops>] <file.ts>\n", argv0);
+    fprintf(stderr, "   -d: only demultiplex, do not remultiplex\n");
+    fprintf(stderr, "   -n: number of times the file is processed\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int loops = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "dn:")) != -1) {
+        switch (opt) {
+            case 'd':
+                remux = false;
+                break;
+            case 'n':
+                loops = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc || !loops)
+        usage(argv[0]);
+    const char *file = argv[optind];
+
+    /* structures managers */
+    struct ev_loop *loop = ev_default_loop(0);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc(loop, UPUMP_POOL,
+                                                     UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    struct umem_mgr *umem_mgr = umem_pool_mgr_alloc_simple(UMEM_POOL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    udict_mgr_release(udict_mgr);
+
+    /* probes */
+    logger = uprobe_stdio_alloc(NULL, stderr, UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_SHARED_POOL_DEPTH);
+    assert(logger != NULL);
+    uref_mgr_release(uref_mgr);
+    upump_mgr_release(upump_mgr);
+    umem_mgr_release(umem_mgr);
+
+    uprobe_init(&uprobe_demux_output_s, catch_ts_demux_output,
+                uprobe_use(logger));
+    uprobe_init(&uprobe_demux_program_s, catch_ts_demux_program,
+                uprobe_use(logger));
+    upipe_null_mgr = upipe_null_mgr_alloc();
+    upipe_noclock_mgr = upipe_noclock_mgr_alloc();
+
+    double wall_begin = now();
+    double cpu_begin = cpu_time();
+    uint64_t octets = 0;
+    for (unsigned int i = 0; i < loops; i++)
+        octets += run(loop, file);
+    double wall = now() - wall_begin;
+    double cpu = cpu_time() - cpu_begin;
+
+    struct rusage rusage;
+    getrusage(RUSAGE_SELF, &rusage);
+    double mbits = (double)octets * 8 / 1e6;
+    printf("mode: %s, loops: %u\n", remux ? "remux" : "demux", loops);
+    printf("packets/s: %.0f\n", (double)(octets / TS_SIZE) / wall);
+    printf("throughput: %.1f Mbps\n", mbits / wall);
+    printf("cpu: %.3f s for %.3f s (%.1f %% of a core)\n", cpu, wall,
+           100 * cpu / wall);
+    printf("cpu per Mbps: %.4f %% of a core\n", 100 * cpu / mbits);
+    printf("peak rss: %ld kB\n", rusage.ru_maxrss);
+
+    upipe_mgr_release(upipe_null_mgr);
+    upipe_mgr_release(upipe_noclock_mgr);
+    uprobe_clean(&uprobe_demux_output_s);
+    uprobe_clean(&uprobe_demux_program_s);
+    uprobe_release(logger);
+
+    ev_default_destroy();
+    return 0;
+}
@@ -47,6 +47,15 @@
  * The rotate interval is 10sec (10sec at 27MHz gives 27000000).
  * Please pay attention to the trailing slash in "foo/".
  * If no suffix is specified, udpmulticat will send data to a udp socket.
+ *
+ * Several channels may be recorded by the same process with -f, giving a
+ * file with one channel per line, in the same format as the command line:
+ *   @239.255.42.77:1234 foo/ .ts
+ *   @239.255.42.78:1234 bar/ .ts
+ * The channels are spread over several threads (one per online processor
+ * by default, see -t), each running its own event loop and managers for
+ * all its channels. Datagrams are read by batches (see -b), and data files
+ * are written in large aligned blocks (see -w).
  */
 
 #undef NDEBUG
@@ -82,9 +91,11 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include <ev.h>
 
@@ -94,12 +105,56 @@
 #define UPUMP_POOL 10
 #define UPUMP_BLOCKER_POOL 10
 #define READ_SIZE 4096
+#define AUX_BATCH_SIZE 4096
+#define DEF_BATCH 32
+#define DEF_WRITE_SIZE (256 * 1024)
+#define MAX_LINE 4096
 #define UPROBE_LOG_LEVEL UPROBE_LOG_WARNING
 
+/** description of a recorded channel */
+struct channel {
+    /** udp source */
+    char *srcpath;
+    /** dest dir/prefix, or udp destination */
+    char *dirpath;
+    /** suffix of the data files, or NULL to send to udp */
+    char *suffix;
+};
+
+/** description of a thread running an event loop */
+struct worker {
+    /** thread */
+    pthread_t thread;
+    /** index of the first channel */
+    unsigned int first;
+    /** stride between channels of this thread */
+    unsigned int stride;
+};
+
+/** channels */
+static struct channel *channels = NULL;
+/** number of channels */
+static unsigned int nb_channels = 0;
+/** rotate interval */
+static uint64_t rotate = 0;
+/** number of datagrams read at once */
+static unsigned int batch = DEF_BATCH;
+/** size of the aligned writes of data files */
+static unsigned int write_size = DEF_WRITE_SIZE;
+/** log level */
+static enum uprobe_log_level loglevel = UPROBE_LOG_LEVEL;
+
 static void usage(const char *argv0) {
-    fprintf(stdout, "Usage: %s [-d] [-r <rotate>] <udp source> <dest dir/prefix> [<suffix>]\n", argv0);
+    fprintf(stdout, "Usage: %s [-d] [-r <rotate>] [-t <threads>] [-b <batch>] [-w <write size>] <udp source> <dest dir/prefix> [<suffix>]\n", argv0);
+    fprintf(stdout, "       %s [-d] [-r <rotate>] [-t <threads>] [-b <batch>] [-w <write size>] -f <channels file>\n", argv0);
     fprintf(stdout, "   -d: force debug log level\n");
     fprintf(stdout, "   -r: rotate interval in 27MHz unit\n");
+    fprintf(stdout, "   -t: number of threads (default: number of processors)\n");
+    fprintf(stdout, "   -b: number of datagrams read at once (default: %u)\n",
+            DEF_BATCH);
+    fprintf(stdout, "   -w: size of aligned data file writes, 0 to disable (default: %u)\n",
+            DEF_WRITE_SIZE);
+    fprintf(stdout, "   -f: file with one \"<udp source> <dest dir/prefix> [<suffix>]\" per line\n");
     fprintf(stdout, "If no <suffix> specified, udpmulticat sends data to a udp socket\n");
     exit(EXIT_FAILURE);
 }
@@ -118,40 +173,166 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
-int main(int argc, char *argv[])
+/** adds a channel to the list */
+static void add_channel(const char *srcpath, const char *dirpath,
+                        const char *suffix)
 {
-    const char *srcpath, *dirpath, *suffix = NULL;
-    bool udp = false;
-    uint64_t rotate = 0;
-    int opt;
-    enum uprobe_log_level loglevel = UPROBE_LOG_LEVEL;
+    channels = realloc(channels, sizeof(struct channel) * (nb_channels + 1));
+    assert(channels != NULL);
+    struct channel *channel = &channels[nb_channels++];
+    channel->srcpath = strdup(srcpath);
+    channel->dirpath = strdup(dirpath);
+    channel->suffix = suffix != NULL ? strdup(suffix) : NULL;
+}
 
-    /* parse options */
-    while ((opt = getopt(argc, argv, "r:d")) != -1) {
-        switch (opt) {
-            case 'r':
-                rotate = strtoull(optarg, NULL, 0);
-                break;
-            case 'd':
-                loglevel = UPROBE_LOG_DEBUG;
-                break;
-            default:
-                usage(argv[0]);
+/** reads the list of channels */
+static bool read_channels(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open %s (%m)\n", path);
+        return false;
+    }
+
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *saveptr;
+        char *srcpath = strtok_r(line, " \t\r\n", &saveptr);
+        if (srcpath == NULL || srcpath[0] == '#')
+            continue;
+        char *dirpath = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (dirpath == NULL) {
+            fprintf(stderr, "missing destination for %s\n", srcpath);
+            fclose(file);
+            return false;
         }
+        add_channel(srcpath, dirpath, strtok_r(NULL, " \t\r\n", &saveptr));
     }
-    if (argc - optind < 2) {
-        usage(argv[0]);
+    fclose(file);
+    return true;
+}
+
+/** allocates the pipes of a channel */
+static bool start_channel(struct channel *channel, unsigned int id,
+                          struct uprobe *logger)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "udp source %u", id);
+
+    /* udp source */
+    struct upipe_mgr *upipe_udpsrc_mgr = upipe_udpsrc_mgr_alloc();
+    struct upipe *upipe_udpsrc = upipe_void_alloc(upipe_udpsrc_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger),
+                             loglevel, name));
+    upipe_mgr_release(upipe_udpsrc_mgr);
+    if (upipe_udpsrc == NULL)
+        return false;
+    upipe_source_set_read_size(upipe_udpsrc, READ_SIZE);
+    if (batch > 1)
+        upipe_udpsrc_set_batch(upipe_udpsrc, batch);
+    upipe_attach_uclock(upipe_udpsrc);
+    if (!ubase_check(upipe_set_uri(upipe_udpsrc, channel->srcpath))) {
+        upipe_release(upipe_udpsrc);
+        return false;
     }
-    srcpath = argv[optind++];
-    dirpath = argv[optind++];
-    if (argc - optind >= 1) {
-        suffix = argv[optind++];
-    } else {
-        udp = true;
+
+    if (channel->suffix == NULL) {
+        /* send to udp */
+        struct upipe_mgr *upipe_udpsink_mgr = upipe_udpsink_mgr_alloc();
+        snprintf(name, sizeof(name), "udpsink %u", id);
+        struct upipe *upipe_sink = upipe_void_alloc_output(upipe_udpsrc,
+                upipe_udpsink_mgr,
+                uprobe_pfx_alloc(uprobe_use(logger),
+                                 loglevel, name));
+        upipe_mgr_release(upipe_udpsink_mgr);
+        if (upipe_sink == NULL ||
+            !ubase_check(upipe_udpsink_set_uri(upipe_sink,
+                                               channel->dirpath, 0))) {
+            upipe_release(upipe_sink);
+            upipe_release(upipe_udpsrc);
+            return false;
+        }
+        upipe_release(upipe_sink);
+        return true;
     }
 
-    /* setup environnement */
-    struct ev_loop *loop = ev_default_loop(0);
+    struct upipe_mgr *upipe_multicat_sink_mgr = upipe_multicat_sink_mgr_alloc();
+    struct upipe_mgr *upipe_fsink_mgr = upipe_fsink_mgr_alloc();
+
+    /* dup */
+    struct upipe_mgr *upipe_dup_mgr = upipe_dup_mgr_alloc();
+    snprintf(name, sizeof(name), "dup %u", id);
+    struct upipe *upipe_dup = upipe_void_alloc_output(upipe_udpsrc,
+            upipe_dup_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), loglevel, name));
+    upipe_mgr_release(upipe_dup_mgr);
+    assert(upipe_dup != NULL);
+
+    snprintf(name, sizeof(name), "dupdata %u", id);
+    struct upipe *upipe_dup_data = upipe_void_alloc_sub(upipe_dup,
+                uprobe_pfx_alloc(uprobe_use(logger),
+                                 loglevel, name));
+    snprintf(name, sizeof(name), "dupaux %u", id);
+    struct upipe *upipe_dup_aux = upipe_void_alloc_sub(upipe_dup,
+                uprobe_pfx_alloc(uprobe_use(logger),
+                                 loglevel, name));
+
+    /* data files (multicat sink) */
+    snprintf(name, sizeof(name), "datasink %u", id);
+    struct upipe *datasink = upipe_void_alloc_output(upipe_dup_data,
+            upipe_multicat_sink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger),
+                             loglevel, name));
+    upipe_multicat_sink_set_fsink_mgr(datasink, upipe_fsink_mgr);
+    if (rotate) {
+        upipe_multicat_sink_set_rotate(datasink, rotate);
+    }
+    /* stage the data in aligned blocks, forwarded to the file sink */
+    if (write_size) {
+        upipe_fsink_set_direct(datasink, write_size);
+    }
+    upipe_multicat_sink_set_path(datasink, channel->dirpath, channel->suffix);
+    upipe_release(datasink);
+
+    /* aux block generation pipe */
+    struct upipe_mgr *upipe_genaux_mgr = upipe_genaux_mgr_alloc();
+    snprintf(name, sizeof(name), "genaux %u", id);
+    struct upipe *genaux = upipe_void_alloc_output(upipe_dup_aux,
+            upipe_genaux_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger),
+                             loglevel, name));
+    upipe_mgr_release(upipe_genaux_mgr);
+    /* write the aux files in chunks which never span two files */
+    upipe_genaux_set_batch(genaux, AUX_BATCH_SIZE,
+            rotate ? rotate : UPIPE_MULTICAT_SINK_DEF_ROTATE);
+
+    /* aux files (multicat sink) */
+    snprintf(name, sizeof(name), "auxsink %u", id);
+    struct upipe *auxsink = upipe_void_alloc_output(genaux,
+            upipe_multicat_sink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger),
+                             loglevel, name));
+    upipe_multicat_sink_set_fsink_mgr(auxsink, upipe_fsink_mgr);
+    if (rotate) {
+        upipe_multicat_sink_set_rotate(auxsink, rotate);
+    }
+    upipe_multicat_sink_set_path(auxsink, channel->dirpath, ".aux");
+    upipe_release(genaux);
+    upipe_release(auxsink);
+    upipe_release(upipe_dup);
+
+    upipe_mgr_release(upipe_fsink_mgr);
+    upipe_mgr_release(upipe_multicat_sink_mgr);
+    return true;
+}
+
+/** runs the event loop of a thread and all its channels */
+static void *run_worker(void *opaque)
+{
+    struct worker *worker = opaque;
+
+    /* setup environnement, private to the thread */
+    struct ev_loop *loop = ev_loop_new(0);
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
     struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
                                                          umem_mgr, -1, -1);
@@ -174,87 +355,15 @@ int main(int argc, char *argv[])
                                    UBUF_POOL_DEPTH);
     assert(logger != NULL);
 
-    struct upipe_mgr *upipe_multicat_sink_mgr = upipe_multicat_sink_mgr_alloc();
-    struct upipe_mgr *upipe_fsink_mgr = upipe_fsink_mgr_alloc();
-
-
-    /* udp source */
-    struct upipe_mgr *upipe_udpsrc_mgr = upipe_udpsrc_mgr_alloc();
-    struct upipe *upipe_udpsrc = upipe_void_alloc(upipe_udpsrc_mgr,
-            uprobe_pfx_alloc(uprobe_use(logger),
-                             loglevel, "udp source"));
-    upipe_source_set_read_size(upipe_udpsrc, READ_SIZE);
-    upipe_attach_uclock(upipe_udpsrc);
-    if (!ubase_check(upipe_set_uri(upipe_udpsrc, srcpath))) {
-        return EXIT_FAILURE;
-    }
-
-    if (udp) {
-        /* send to udp */
-        struct upipe_mgr *upipe_udpsink_mgr = upipe_udpsink_mgr_alloc();
-        struct upipe *upipe_sink = upipe_void_alloc_output(upipe_udpsrc,
-                upipe_udpsink_mgr,
-                uprobe_pfx_alloc(uprobe_use(logger),
-                                 loglevel, "udpsink"));
-        if (!ubase_check(upipe_udpsink_set_uri(upipe_sink, dirpath, 0))) {
-            return EXIT_FAILURE;
-        }
-        upipe_release(upipe_sink);
-    }
-    else 
-    {
-        /* dup */
-        struct upipe_mgr *upipe_dup_mgr = upipe_dup_mgr_alloc();
-        struct upipe *upipe_dup = upipe_void_alloc_output(upipe_udpsrc,
-                upipe_dup_mgr,
-                uprobe_pfx_alloc(uprobe_use(logger), loglevel, "dup"));
-
-        struct upipe *upipe_dup_data = upipe_void_alloc_sub(upipe_dup,
-                    uprobe_pfx_alloc(uprobe_use(logger),
-                                     loglevel, "dupdata"));
-        struct upipe *upipe_dup_aux = upipe_void_alloc_sub(upipe_dup,
-                    uprobe_pfx_alloc(uprobe_use(logger),
-                                     loglevel, "dupaux"));
-
-        /* data files (multicat sink) */
-        struct upipe *datasink = upipe_void_alloc_output(upipe_dup_data,
-                upipe_multicat_sink_mgr,
-                uprobe_pfx_alloc(uprobe_use(logger),
-                                 loglevel, "datasink"));
-        upipe_multicat_sink_set_fsink_mgr(datasink, upipe_fsink_mgr);
-        if (rotate) {
-            upipe_multicat_sink_set_rotate(datasink, rotate);
-        }
-        upipe_multicat_sink_set_path(datasink, dirpath, suffix);
-        upipe_release(datasink);
-
-        /* aux block generation pipe */
-        struct upipe_mgr *upipe_genaux_mgr = upipe_genaux_mgr_alloc();
-        struct upipe *genaux = upipe_void_alloc_output(upipe_dup_aux,
-                upipe_genaux_mgr,
-                uprobe_pfx_alloc(uprobe_use(logger),
-                                 loglevel, "genaux"));
-
-        /* aux files (multicat sink) */
-        struct upipe *auxsink = upipe_void_alloc_output(genaux,
-                upipe_multicat_sink_mgr,
-                uprobe_pfx_alloc(uprobe_use(logger),
-                                 loglevel, "auxsink"));
-        upipe_multicat_sink_set_fsink_mgr(auxsink, upipe_fsink_mgr);
-        if (rotate) {
-            upipe_multicat_sink_set_rotate(auxsink, rotate);
-        }
-        upipe_multicat_sink_set_path(auxsink, dirpath, ".aux");
-        upipe_release(genaux);
-        upipe_release(auxsink);
-        upipe_release(upipe_dup);
-    }
+    for (unsigned int i = worker->first; i < nb_channels; i += worker->stride)
+        if (!start_channel(&channels[i], i, logger))
+            fprintf(stderr, "unable to start channel %s\n",
+                    channels[i].srcpath);
 
     /* fire loop ! */
     ev_loop(loop, 0);
 
-    /* should never be here for the moment. todo: sighandler.
-     * release everything */
+    /* release everything */
     uprobe_release(logger);
     uprobe_clean(&uprobe);
 
@@ -264,6 +373,85 @@ int main(int argc, char *argv[])
     umem_mgr_release(umem_mgr);
     uclock_release(uclock);
 
-    ev_default_destroy();
+    ev_loop_destroy(loop);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *channels_path = NULL;
+    long nb_threads = 0;
+    int opt;
+
+    /* parse options */
+    while ((opt = getopt(argc, argv, "r:dt:b:w:f:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rotate = strtoull(optarg, NULL, 0);
+                break;
+            case 'd':
+                loglevel = UPROBE_LOG_DEBUG;
+                break;
+            case 't':
+                nb_threads = strtol(optarg, NULL, 0);
+                break;
+            case 'b':
+                batch = strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                write_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                channels_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (channels_path != NULL) {
+        if (argc - optind > 0 || !read_channels(channels_path))
+            usage(argv[0]);
+    } else {
+        if (argc - optind < 2) {
+            usage(argv[0]);
+        }
+        const char *srcpath = argv[optind++];
+        const char *dirpath = argv[optind++];
+        add_channel(srcpath, dirpath,
+                    argc - optind >= 1 ? argv[optind++] : NULL);
+    }
+    if (!nb_channels)
+        usage(argv[0]);
+
+    if (nb_threads <= 0)
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_threads <= 0)
+        nb_threads = 1;
+    if (nb_threads > nb_channels)
+        nb_threads = nb_channels;
+
+    /* one event loop per thread, channels spread in round robin */
+    struct worker workers[nb_threads];
+    for (long i = 0; i < nb_threads; i++) {
+        workers[i].first = i;
+        workers[i].stride = nb_threads;
+        if (i && pthread_create(&workers[i].thread, NULL, run_worker,
+                                &workers[i]) != 0) {
+            fprintf(stderr, "unable to create thread (%m)\n");
+            return EXIT_FAILURE;
+        }
+    }
+    run_worker(&workers[0]);
+
+    /* should never be here for the moment. todo: sighandler. */
+    for (long i = 1; i < nb_threads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    for (unsigned int i = 0; i < nb_channels; i++) {
+        free(channels[i].srcpath);
+        free(channels[i].dirpath);
+        free(channels[i].suffix);
+    }
+    free(channels);
     return 0;
 }
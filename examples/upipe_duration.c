@@ -26,11 +26,20 @@
 
 /** @file
  * @short prints the duration of a TS file, derived from the number of pics
+ *
+ * Unless -f is given, the duration is first computed from the PCRs found in
+ * the first and last few megabytes of the file, which doesn't require to
+ * read the whole file. This falls back to the full demux of the file if the
+ * PCRs are discontinuous, or not consistent with the size of the file.
  */
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_stdio.h>
@@ -59,6 +68,9 @@
 #include <upipe-ts/upipe_ts_demux.h>
 #include <upipe-framers/upipe_mpgv_framer.h>
 #include <upipe-framers/upipe_h264_framer.h>
+#include <upipe-framers/upipe_h265_framer.h>
+
+#include <bitstream/mpeg/ts.h>
 
 #include <ev.h>
 
@@ -70,6 +82,15 @@
 #define UBUF_SHARED_POOL_DEPTH 50
 #define UPUMP_POOL 10
 #define UPUMP_BLOCKER_POOL 10
+/** size of the windows read at both ends of the file */
+#define FAST_WINDOW (4 * 1024 * 1024)
+/** maximum interval between consecutive PCRs (27 MHz) */
+#define FAST_MAX_PCR_GAP (UCLOCK_FREQ * 2)
+/** maximum deviation between the PCR duration and the duration estimated
+ * from the bitrate at the start of the file, in percent */
+#define FAST_MAX_DEVIATION 20
+/** PCR wrap-around (27 MHz) */
+#define PCR_WRAP (UINT64_C(300) << 33)
 
 static uint64_t duration = 0;
 static struct upipe *sink;
@@ -121,6 +142,123 @@ static struct upipe_mgr count_mgr = {
     .upipe_control = count_control
 };
 
+/** PCRs found in a window of the file */
+struct pcr_window {
+    /** first PCR */
+    uint64_t first;
+    /** position of the first PCR */
+    uint64_t first_pos;
+    /** last PCR */
+    uint64_t last;
+    /** position of the last PCR */
+    uint64_t last_pos;
+    /** number of PCRs */
+    unsigned int nb;
+};
+
+/** scans the PCRs of the given PID (or of the first PID carrying PCRs if
+ * *pid_p is 8192) in a window of the file, and returns false if they are
+ * discontinuous */
+static bool scan_pcrs(int fd, uint64_t offset, size_t len, uint16_t *pid_p,
+                      struct pcr_window *window)
+{
+    uint8_t *buffer = malloc(len);
+    assert(buffer != NULL);
+    ssize_t ret = pread(fd, buffer, len, offset);
+    if (ret < 3 * TS_SIZE) {
+        free(buffer);
+        return false;
+    }
+    len = ret;
+
+    /* synchronize on three consecutive packets */
+    size_t i;
+    for (i = 0; i + 3 * TS_SIZE <= len; i++)
+        if (ts_validate(buffer + i) && ts_validate(buffer + i + TS_SIZE) &&
+            ts_validate(buffer + i + 2 * TS_SIZE))
+            break;
+
+    window->nb = 0;
+    bool ok = true;
+    for ( ; ok && i + TS_SIZE <= len; i += TS_SIZE) {
+        const uint8_t *ts = buffer + i;
+        if (!ts_validate(ts)) {
+            ok = false;
+            break;
+        }
+        if (!ts_has_adaptation(ts) || !ts_get_adaptation(ts) ||
+            (*pid_p != 8192 && ts_get_pid(ts) != *pid_p))
+            continue;
+        if (!tsaf_has_pcr(ts)) {
+            if (tsaf_has_discontinuity(ts) && *pid_p != 8192)
+                ok = false;
+            continue;
+        }
+        if (tsaf_has_discontinuity(ts) && window->nb)
+            ok = false;
+
+        *pid_p = ts_get_pid(ts);
+        uint64_t pcr = tsaf_get_pcr(ts) * 300 + tsaf_get_pcrext(ts);
+        if (window->nb) {
+            uint64_t gap = (pcr + PCR_WRAP - window->last) % PCR_WRAP;
+            if (gap > FAST_MAX_PCR_GAP)
+                ok = false;
+        } else {
+            window->first = pcr;
+            window->first_pos = offset + i;
+        }
+        window->last = pcr;
+        window->last_pos = offset + i;
+        window->nb++;
+    }
+    free(buffer);
+    return ok && window->nb >= 2;
+}
+
+/** computes the duration from the PCRs at both ends of the file, and
+ * returns false if it can't be trusted */
+static bool fast_duration(const char *file, uint64_t *duration_p)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < 4 * FAST_WINDOW) {
+        /* small files are quickly demuxed anyway */
+        close(fd);
+        return false;
+    }
+
+    uint16_t pid = 8192;
+    struct pcr_window head, tail;
+    bool ok = scan_pcrs(fd, 0, FAST_WINDOW, &pid, &head) &&
+              scan_pcrs(fd, st.st_size - FAST_WINDOW, FAST_WINDOW, &pid,
+                        &tail);
+    close(fd);
+    if (!ok || head.last == head.first)
+        return false;
+
+    /* compare with the duration expected from the bitrate of the head, to
+     * detect discontinuities in the middle of the file */
+    uint64_t duration = (tail.last + PCR_WRAP - head.first) % PCR_WRAP;
+    uint64_t head_duration = (head.last + PCR_WRAP - head.first) % PCR_WRAP;
+    double expected = (double)(tail.last_pos - head.first_pos) *
+                      head_duration / (head.last_pos - head.first_pos);
+    if (expected * (100 - FAST_MAX_DEVIATION) > duration * 100. ||
+        expected * (100 + FAST_MAX_DEVIATION) < duration * 100.)
+        return false;
+
+    *duration_p = duration;
+    return true;
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [-f] <filename>\n", argv0);
+    printf("   -f: always demux the whole file\n");
+    exit(-1);
+}
+
 /** catch callback (demux subpipes for flows) */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
@@ -136,12 +274,25 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
 
 int main(int argc, char **argv)
 {
-    if (argc < 2) {
-        printf("Usage: %s <filename>\n", argv[0]);
-        exit(-1);
+    bool full = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "f")) != -1) {
+        switch (opt) {
+            case 'f':
+                full = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
     }
+    if (optind != argc - 1)
+        usage(argv[0]);
 
-    const char *file = argv[1];
+    const char *file = argv[optind];
+    if (!full && fast_duration(file, &duration)) {
+        printf("%.2f\n", (double)duration / UCLOCK_FREQ);
+        return 0;
+    }
 
     /* structures managers */
     struct ev_loop *loop = ev_default_loop(0);
@@ -197,6 +348,9 @@ int main(int argc, char **argv)
     struct upipe_mgr *upipe_h264f_mgr = upipe_h264f_mgr_alloc();
     upipe_ts_demux_mgr_set_h264f_mgr(upipe_ts_demux_mgr, upipe_h264f_mgr);
     upipe_mgr_release(upipe_h264f_mgr);
+    struct upipe_mgr *upipe_h265f_mgr = upipe_h265f_mgr_alloc();
+    upipe_ts_demux_mgr_set_h265f_mgr(upipe_ts_demux_mgr, upipe_h265f_mgr);
+    upipe_mgr_release(upipe_h265f_mgr);
     struct upipe *ts_demux = upipe_void_alloc_output(upipe_src,
             upipe_ts_demux_mgr,
             uprobe_pfx_alloc(
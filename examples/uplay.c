@@ -56,6 +56,7 @@
 #include <upipe/upipe.h>
 #include <upipe/upump.h>
 #include <upipe-pthread/upipe_pthread_transfer.h>
+#include <upipe-pthread/upipe_pthread_numa.h>
 #include <upipe-pthread/uprobe_pthread_upump_mgr.h>
 #include <upump-ev/upump_ev.h>
 #include <upipe-modules/upipe_file_source.h>
@@ -107,6 +108,8 @@
 
 /* true if we receive raw udp */
 static bool udp = false;
+/* NUMA node of the worker threads */
+static int numa_node = -1;
 /** selflow string for video */
 static const char *select_video = "auto";
 /** selflow string for audio */
@@ -527,7 +530,7 @@ static void upump_mgr_free(struct upump_mgr *upump_mgr)
 }
 
 static void usage(const char *argv0) {
-    fprintf(stderr, "Usage: %s [-d] [-q] [-u] [-A <audio>] [-V <video>] [-P <program>] <source>\n", argv0);
+    fprintf(stderr, "Usage: %s [-d] [-q] [-u] [-n <node>|-I <interface>] [-A <audio>] [-V <video>] [-P <program>] <source>\n", argv0);
     exit(EXIT_FAILURE);
 }
 
@@ -535,11 +538,19 @@ int main(int argc, char **argv)
 {
     enum uprobe_log_level loglevel = UPROBE_LOG_LEVEL;
     int opt;
-    while ((opt = getopt(argc, argv, "udqA:V:P:")) != -1) {
+    while ((opt = getopt(argc, argv, "udqn:I:A:V:P:")) != -1) {
         switch (opt) {
             case 'u':
                 udp = true;
                 break;
+            case 'n':
+                numa_node = atoi(optarg);
+                break;
+            case 'I':
+                if (!ubase_check(upipe_pthread_numa_get_if_node(optarg,
+                                                                &numa_node)))
+                    fprintf(stderr, "unknown NUMA node for %s\n", optarg);
+                break;
             case 'd':
                 loglevel--;
                 break;
@@ -609,30 +620,23 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    /* worker threads */
-    struct upipe_mgr *src_xfer_mgr = upipe_pthread_xfer_mgr_alloc(XFER_QUEUE,
-            XFER_POOL, uprobe_use(uprobe_main), upump_mgr_alloc,
-            upump_mgr_work, upump_mgr_free, NULL, NULL);
-    assert(src_xfer_mgr != NULL);
-    upipe_wsrc_mgr = upipe_wsrc_mgr_alloc(src_xfer_mgr);
+    /* worker threads, one per stage, pinned to the CPUs of the node */
+    struct upipe_pthread_xfer_pool *xfer_pool =
+        upipe_pthread_xfer_pool_alloc_numa(numa_node,
+            UPIPE_PTHREAD_STAGE_MAX, XFER_QUEUE, XFER_POOL,
+            uprobe_use(uprobe_main), upump_mgr_alloc, upump_mgr_work,
+            upump_mgr_free);
+    assert(xfer_pool != NULL);
+    upipe_wsrc_mgr = upipe_wsrc_mgr_alloc(upipe_pthread_xfer_pool_get_mgr(
+                xfer_pool, UPIPE_PTHREAD_STAGE_SOURCE));
     assert(upipe_wsrc_mgr != NULL);
-    upipe_mgr_release(src_xfer_mgr);
-
-    struct upipe_mgr *dec_xfer_mgr = upipe_pthread_xfer_mgr_alloc(XFER_QUEUE,
-            XFER_POOL, uprobe_use(uprobe_main), upump_mgr_alloc,
-            upump_mgr_work, upump_mgr_free, NULL, NULL);
-    assert(dec_xfer_mgr != NULL);
-    upipe_wlin_mgr = upipe_wlin_mgr_alloc(dec_xfer_mgr);
+    upipe_wlin_mgr = upipe_wlin_mgr_alloc(upipe_pthread_xfer_pool_get_mgr(
+                xfer_pool, UPIPE_PTHREAD_STAGE_DECODE));
     assert(upipe_wlin_mgr != NULL);
-    upipe_mgr_release(dec_xfer_mgr);
-
-    struct upipe_mgr *sink_xfer_mgr = upipe_pthread_xfer_mgr_alloc(XFER_QUEUE,
-            XFER_POOL, uprobe_use(uprobe_main), upump_mgr_alloc,
-            upump_mgr_work, upump_mgr_free, NULL, NULL);
-    assert(sink_xfer_mgr != NULL);
-    upipe_wsink_mgr = upipe_wsink_mgr_alloc(sink_xfer_mgr);
+    upipe_wsink_mgr = upipe_wsink_mgr_alloc(upipe_pthread_xfer_pool_get_mgr(
+                xfer_pool, UPIPE_PTHREAD_STAGE_SINK));
     assert(upipe_wsink_mgr != NULL);
-    upipe_mgr_release(sink_xfer_mgr);
+    upipe_pthread_xfer_pool_free(xfer_pool);
 
     /* start */
     struct upump *idler_start = upump_alloc_idler(main_upump_mgr, uplay_start,
@@ -38,12 +38,53 @@ extern "C" {
 
 #define UPIPE_ALSINK_SIGNATURE UBASE_FOURCC('a', 'l', 's', 's')
 
+/** @This extends upipe_command with specific commands for alsa sink. */
+enum upipe_alsink_command {
+    UPIPE_ALSINK_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the requested period duration (uint64_t *) */
+    UPIPE_ALSINK_GET_PERIOD,
+    /** sets the requested period duration (uint64_t) */
+    UPIPE_ALSINK_SET_PERIOD
+};
+
 /** @This returns the management structure for all alsa sinks.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_alsink_mgr_alloc(void);
 
+/** @This returns the requested duration of a period of the device.
+ *
+ * @param upipe description structure of the pipe
+ * @param period_p filled in with the duration, in clock units
+ * @return an error code
+ */
+static inline int upipe_alsink_get_period(struct upipe *upipe,
+                                          uint64_t *period_p)
+{
+    return upipe_control(upipe, UPIPE_ALSINK_GET_PERIOD,
+                         UPIPE_ALSINK_SIGNATURE, period_p);
+}
+
+/** @This sets the requested duration of a period of the device, which is
+ * also the interval at which the pipe writes to it. The device latency is
+ * twice the period. Short periods require the pipe to run in a thread
+ * that is not delayed by other pipes, for instance in a worker sink with
+ * a real-time scheduling policy. It only takes effect when the device is
+ * next opened.
+ *
+ * @param upipe description structure of the pipe
+ * @param period duration, in clock units (default 40 ms)
+ * @return an error code
+ */
+static inline int upipe_alsink_set_period(struct upipe *upipe,
+                                          uint64_t period)
+{
+    return upipe_control(upipe, UPIPE_ALSINK_SET_PERIOD,
+                         UPIPE_ALSINK_SIGNATURE, period);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,6 +38,16 @@ extern "C" {
 
 #define UPIPE_AMTSRC_SIGNATURE UBASE_FOURCC('a','m','t','c')
 
+/** @This extends upipe_command with specific commands for amt source. */
+enum upipe_amtsrc_command {
+    UPIPE_AMTSRC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of datagrams read per wake-up (unsigned int *) */
+    UPIPE_AMTSRC_GET_BATCH,
+    /** sets the number of datagrams read per wake-up (unsigned int) */
+    UPIPE_AMTSRC_SET_BATCH
+};
+
 /** @This returns the management structure for all amtsrc pipes.
  *
  * @param amt_relay IP of the AMT relay
@@ -45,6 +55,34 @@ extern "C" {
  */
 struct upipe_mgr *upipe_amtsrc_mgr_alloc(const char *amt_relay);
 
+/** @This returns the number of datagrams read per wake-up.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch_p filled in with the number of datagrams
+ * @return an error code
+ */
+static inline int upipe_amtsrc_get_batch(struct upipe *upipe,
+                                         unsigned int *batch_p)
+{
+    return upipe_control(upipe, UPIPE_AMTSRC_GET_BATCH, UPIPE_AMTSRC_SIGNATURE,
+                         batch_p);
+}
+
+/** @This sets the number of datagrams read per wake-up. The datagrams are
+ * read into buffers allocated in advance, as long as the tunnel has data
+ * pending, and output in a row. The default is 1.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch number of datagrams
+ * @return an error code
+ */
+static inline int upipe_amtsrc_set_batch(struct upipe *upipe,
+                                         unsigned int batch)
+{
+    return upipe_control(upipe, UPIPE_AMTSRC_SET_BATCH, UPIPE_AMTSRC_SIGNATURE,
+                         batch);
+}
+
 /** @This extends upipe_mgr_command with specific commands for amtsrc. */
 enum upipe_amtsrc_mgr_command {
     UPIPE_AMTSRC_MGR_SENTINEL = UPIPE_MGR_CONTROL_LOCAL,
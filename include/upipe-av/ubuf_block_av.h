@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ubuf manager for block formats wrapping libavcodec packets
+ * Blocks point straight into the payload of an AVPacket, which is freed when
+ * the last reference to it is released, so that encoded packets may be
+ * output without a copy.
+ */
+
+#ifndef _UPIPE_AV_UBUF_BLOCK_AV_H_
+/** @hidden */
+#define _UPIPE_AV_UBUF_BLOCK_AV_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+
+#include <stdint.h>
+
+#include <libavcodec/avcodec.h>
+
+/** @This is a simple signature to allocate a block wrapping an AVPacket. */
+#define UBUF_ALLOC_BLOCK_AV UBASE_FOURCC('b','a','v','p')
+
+/** @This returns a new ubuf pointing to the payload of an AVPacket. The
+ * packet is made standalone if it points to codec buffers, and its
+ * ownership is transferred to the ubuf; the caller's structure is reset
+ * in all cases.
+ *
+ * @param mgr management structure for this ubuf type
+ * @param pkt packet to wrap
+ * @return pointer to ubuf or NULL in case of failure
+ */
+static inline struct ubuf *ubuf_block_av_alloc(struct ubuf_mgr *mgr,
+                                               AVPacket *pkt)
+{
+    return ubuf_alloc(mgr, UBUF_ALLOC_BLOCK_AV, pkt);
+}
+
+/** @This allocates a new instance of the ubuf manager for block formats
+ * wrapping AVPackets. Blocks allocated with @ref ubuf_block_alloc are
+ * backed by new packets.
+ *
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param shared_pool_depth maximum number of shared structures in the pool
+ * @return pointer to manager, or NULL in case of error
+ */
+struct ubuf_mgr *ubuf_block_av_mgr_alloc(uint16_t ubuf_pool_depth,
+                                         uint16_t shared_pool_depth);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -49,6 +49,16 @@ bool upipe_av_init(bool init_avcodec_only, struct uprobe *uprobe);
  */
 void upipe_av_clean(void);
 
+/** @This sets the number of threads of the worker pool shared by the
+ * avcodec pipes on which it was enabled. The pool is started when the first
+ * job is queued, with by default one thread per online CPU; it must be
+ * called before.
+ *
+ * @param nb_workers number of threads (0 for one per online CPU)
+ * @return false if the pool is already started
+ */
+bool upipe_av_set_workers(unsigned int nb_workers);
+
 #ifdef __cplusplus
 }
 #endif
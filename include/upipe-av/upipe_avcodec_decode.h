@@ -39,12 +39,177 @@ extern "C" {
 
 #define UPIPE_AVCDEC_SIGNATURE UBASE_FOURCC('a', 'v', 'c', 'd')
 
+/** @This defines the types of threading used by the decoder. */
+enum upipe_avcdec_thread_type {
+    /** several frames are decoded in parallel, adding one frame of latency
+     * per thread */
+    UPIPE_AVCDEC_THREAD_FRAME = 0x1,
+    /** several slices of a frame are decoded in parallel */
+    UPIPE_AVCDEC_THREAD_SLICE = 0x2
+};
+
+/** @This extends upipe_command with specific commands for avcodec decode. */
+enum upipe_avcdec_command {
+    UPIPE_AVCDEC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of decoding threads (unsigned int *) */
+    UPIPE_AVCDEC_GET_THREAD_COUNT,
+    /** sets the number of decoding threads (unsigned int) */
+    UPIPE_AVCDEC_SET_THREAD_COUNT,
+    /** returns the allowed types of threading (int *) */
+    UPIPE_AVCDEC_GET_THREAD_TYPE,
+    /** sets the allowed types of threading (int) */
+    UPIPE_AVCDEC_SET_THREAD_TYPE,
+    /** returns the use of the shared worker pool (int *) */
+    UPIPE_AVCDEC_GET_WORKER_POOL,
+    /** sets the use of the shared worker pool (int) */
+    UPIPE_AVCDEC_SET_WORKER_POOL
+};
+
+/** @This extends upipe_mgr_command with specific commands for avcodec
+ * decode. */
+enum upipe_avcdec_mgr_command {
+    UPIPE_AVCDEC_MGR_SENTINEL = UPIPE_MGR_CONTROL_LOCAL,
+
+    /** returns the maximum number of open contexts kept (unsigned int *) */
+    UPIPE_AVCDEC_MGR_GET_POOL_DEPTH,
+    /** sets the maximum number of open contexts kept (unsigned int) */
+    UPIPE_AVCDEC_MGR_SET_POOL_DEPTH
+};
+
 /** @This returns the management structure for all avcodec decode pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_avcdec_mgr_alloc(void);
 
+/** @This returns the maximum number of open decoder contexts kept by the
+ * manager.
+ *
+ * @param mgr pointer to manager
+ * @param pool_depth_p filled in with the maximum number of contexts
+ * @return an error code
+ */
+static inline int upipe_avcdec_mgr_get_pool_depth(struct upipe_mgr *mgr,
+                                                  unsigned int *pool_depth_p)
+{
+    return upipe_mgr_control(mgr, UPIPE_AVCDEC_MGR_GET_POOL_DEPTH,
+                             UPIPE_AVCDEC_SIGNATURE, pool_depth_p);
+}
+
+/** @This sets the maximum number of open decoder contexts kept by the
+ * manager. When a pipe closes its codec, the context is flushed and kept
+ * open instead, so that a later pipe of the same manager decoding the same
+ * codec, with the same extradata and threading parameters, may reuse it
+ * without the cost of opening a codec, which helps channel zapping. Pipes
+ * on which avcodec options were set never share their context. The default
+ * of 0 closes all contexts. It must be called before any pipe is allocated.
+ *
+ * @param mgr pointer to manager
+ * @param pool_depth maximum number of contexts
+ * @return an error code
+ */
+static inline int upipe_avcdec_mgr_set_pool_depth(struct upipe_mgr *mgr,
+                                                  unsigned int pool_depth)
+{
+    return upipe_mgr_control(mgr, UPIPE_AVCDEC_MGR_SET_POOL_DEPTH,
+                             UPIPE_AVCDEC_SIGNATURE, pool_depth);
+}
+
+/** @This returns the number of decoding threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count_p filled in with the number of threads (0 for
+ * automatic)
+ * @return an error code
+ */
+static inline int upipe_avcdec_get_thread_count(struct upipe *upipe,
+                                                unsigned int *thread_count_p)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_GET_THREAD_COUNT,
+                         UPIPE_AVCDEC_SIGNATURE, thread_count_p);
+}
+
+/** @This sets the number of decoding threads. It must be called after the
+ * flow definition is set, and before the codec is opened by the first
+ * packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count number of threads (0 for automatic)
+ * @return an error code
+ */
+static inline int upipe_avcdec_set_thread_count(struct upipe *upipe,
+                                                unsigned int thread_count)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_SET_THREAD_COUNT,
+                         UPIPE_AVCDEC_SIGNATURE, thread_count);
+}
+
+/** @This returns the allowed types of threading.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type_p filled in with a mask of
+ * @ref upipe_avcdec_thread_type
+ * @return an error code
+ */
+static inline int upipe_avcdec_get_thread_type(struct upipe *upipe,
+                                               int *thread_type_p)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_GET_THREAD_TYPE,
+                         UPIPE_AVCDEC_SIGNATURE, thread_type_p);
+}
+
+/** @This sets the allowed types of threading. The decoder picks one of them
+ * depending on the capabilities of the codec. It must be called after the
+ * flow definition is set, and before the codec is opened by the first
+ * packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type mask of @ref upipe_avcdec_thread_type
+ * @return an error code
+ */
+static inline int upipe_avcdec_set_thread_type(struct upipe *upipe,
+                                               int thread_type)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_SET_THREAD_TYPE,
+                         UPIPE_AVCDEC_SIGNATURE, thread_type);
+}
+
+/** @This returns whether the shared worker pool is used.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static inline int upipe_avcdec_get_worker_pool(struct upipe *upipe,
+                                               bool *val_p)
+{
+    int val;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_AVCDEC_GET_WORKER_POOL,
+                               UPIPE_AVCDEC_SIGNATURE, &val))
+    *val_p = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This enables or disables the use of the shared worker pool. When
+ * enabled, the audio frames are decoded by the worker pool shared by all
+ * avcodec pipes (see @ref upipe_av_set_workers) instead of the thread of the
+ * pipe, so that many audio streams are decoded in parallel without a
+ * dedicated thread each. Frames of a pipe are still decoded one at a time
+ * and output in order by the thread of the pipe, which copies the samples to
+ * its own buffers. Video decoding is not affected. It must be called before
+ * the codec is opened by the first packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true to use the worker pool
+ * @return an error code
+ */
+static inline int upipe_avcdec_set_worker_pool(struct upipe *upipe, bool val)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_SET_WORKER_POOL,
+                         UPIPE_AVCDEC_SIGNATURE, val ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
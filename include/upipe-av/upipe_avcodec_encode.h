@@ -42,6 +42,37 @@ extern "C" {
 
 UREF_ATTR_STRING(avcenc, codec_name, "avcenc.name", avcenc codec name)
 
+/** @This defines the types of threading used by the encoder. */
+enum upipe_avcenc_thread_type {
+    /** several frames are encoded in parallel, adding one frame of latency
+     * per thread */
+    UPIPE_AVCENC_THREAD_FRAME = 0x1,
+    /** several slices of a frame are encoded in parallel */
+    UPIPE_AVCENC_THREAD_SLICE = 0x2
+};
+
+/** @This extends upipe_command with specific commands for avcodec encode. */
+enum upipe_avcenc_command {
+    UPIPE_AVCENC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of encoding threads (unsigned int *) */
+    UPIPE_AVCENC_GET_THREAD_COUNT,
+    /** sets the number of encoding threads (unsigned int) */
+    UPIPE_AVCENC_SET_THREAD_COUNT,
+    /** returns the allowed types of threading (int *) */
+    UPIPE_AVCENC_GET_THREAD_TYPE,
+    /** sets the allowed types of threading (int) */
+    UPIPE_AVCENC_SET_THREAD_TYPE,
+    /** returns the low-delay mode (int *) */
+    UPIPE_AVCENC_GET_LOW_DELAY,
+    /** sets the low-delay mode (int) */
+    UPIPE_AVCENC_SET_LOW_DELAY,
+    /** returns the use of the shared worker pool (int *) */
+    UPIPE_AVCENC_GET_WORKER_POOL,
+    /** sets the use of the shared worker pool (int) */
+    UPIPE_AVCENC_SET_WORKER_POOL
+};
+
 /** @This returns the management structure for avcodec encoders.
  *
  * @return pointer to manager
@@ -73,6 +104,130 @@ static inline int upipe_avcenc_mgr_set_flow_def_from_name(
                              UPIPE_AVCENC_SIGNATURE, flow_def, name);
 }
 
+/** @This returns the number of encoding threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count_p filled in with the number of threads (0 for
+ * automatic)
+ * @return an error code
+ */
+static inline int upipe_avcenc_get_thread_count(struct upipe *upipe,
+                                                unsigned int *thread_count_p)
+{
+    return upipe_control(upipe, UPIPE_AVCENC_GET_THREAD_COUNT,
+                         UPIPE_AVCENC_SIGNATURE, thread_count_p);
+}
+
+/** @This sets the number of encoding threads. It must be called before the
+ * codec is opened by the first frame.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count number of threads (0 for automatic)
+ * @return an error code
+ */
+static inline int upipe_avcenc_set_thread_count(struct upipe *upipe,
+                                                unsigned int thread_count)
+{
+    return upipe_control(upipe, UPIPE_AVCENC_SET_THREAD_COUNT,
+                         UPIPE_AVCENC_SIGNATURE, thread_count);
+}
+
+/** @This returns the allowed types of threading.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type_p filled in with a mask of
+ * @ref upipe_avcenc_thread_type
+ * @return an error code
+ */
+static inline int upipe_avcenc_get_thread_type(struct upipe *upipe,
+                                               int *thread_type_p)
+{
+    return upipe_control(upipe, UPIPE_AVCENC_GET_THREAD_TYPE,
+                         UPIPE_AVCENC_SIGNATURE, thread_type_p);
+}
+
+/** @This sets the allowed types of threading. The encoder picks one of them
+ * depending on the capabilities of the codec. It must be called before the
+ * codec is opened by the first frame.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type mask of @ref upipe_avcenc_thread_type
+ * @return an error code
+ */
+static inline int upipe_avcenc_set_thread_type(struct upipe *upipe,
+                                               int thread_type)
+{
+    return upipe_control(upipe, UPIPE_AVCENC_SET_THREAD_TYPE,
+                         UPIPE_AVCENC_SIGNATURE, thread_type);
+}
+
+/** @This returns the current setting for the low-delay mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static inline int upipe_avcenc_get_low_delay(struct upipe *upipe,
+                                             bool *val_p)
+{
+    int val;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_AVCENC_GET_LOW_DELAY,
+                               UPIPE_AVCENC_SIGNATURE, &val))
+    *val_p = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets the low-delay mode. In this mode, the encoder
+ * outputs each frame as soon as it is encoded: B-frames and frame
+ * threading are disabled, and encoders supporting it (such as libx264) are
+ * tuned for zero latency. It must be called before the codec is opened by
+ * the first frame. The resulting delay is advertised in the latency of the
+ * output flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true for low-delay mode
+ * @return an error code
+ */
+static inline int upipe_avcenc_set_low_delay(struct upipe *upipe, bool val)
+{
+    return upipe_control(upipe, UPIPE_AVCENC_SET_LOW_DELAY,
+                         UPIPE_AVCENC_SIGNATURE, val ? 1 : 0);
+}
+
+/** @This returns whether the shared worker pool is used.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static inline int upipe_avcenc_get_worker_pool(struct upipe *upipe,
+                                               bool *val_p)
+{
+    int val;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_AVCENC_GET_WORKER_POOL,
+                               UPIPE_AVCENC_SIGNATURE, &val))
+    *val_p = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This enables or disables the use of the shared worker pool. When
+ * enabled, the audio frames are encoded by the worker pool shared by all
+ * avcodec pipes (see @ref upipe_av_set_workers) instead of the thread of the
+ * pipe, so that many audio streams are encoded in parallel without a
+ * dedicated thread each. Frames of a pipe are still encoded one at a time
+ * and output in order by the thread of the pipe. Video encoding is not
+ * affected. It must be called before the codec is opened by the first frame.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true to use the worker pool
+ * @return an error code
+ */
+static inline int upipe_avcenc_set_worker_pool(struct upipe *upipe, bool val)
+{
+    return upipe_control(upipe, UPIPE_AVCENC_SET_WORKER_POOL,
+                         UPIPE_AVCENC_SIGNATURE, val ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
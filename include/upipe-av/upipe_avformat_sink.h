@@ -53,6 +53,10 @@ enum upipe_avfsink_command {
     UPIPE_AVFSINK_SET_FORMAT,
     /** returns the current duration (uint64_t *) */
     UPIPE_AVFSINK_GET_DURATION,
+    /** returns the size of the write queue (uint64_t *) */
+    UPIPE_AVFSINK_GET_WRITE_QUEUE,
+    /** sets the size of the write queue (uint64_t) */
+    UPIPE_AVFSINK_SET_WRITE_QUEUE,
 };
 
 /** @This returns the management structure for all avformat sinks.
@@ -127,6 +131,35 @@ static inline int upipe_avfsink_get_duration(struct upipe *upipe,
                          UPIPE_AVFSINK_SIGNATURE, duration_p);
 }
 
+/** @This returns the size of the write queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets_p filled in with the maximum number of octets
+ * @return an error code
+ */
+static inline int upipe_avfsink_get_write_queue(struct upipe *upipe,
+                                                uint64_t *octets_p)
+{
+    return upipe_control(upipe, UPIPE_AVFSINK_GET_WRITE_QUEUE,
+                         UPIPE_AVFSINK_SIGNATURE, octets_p);
+}
+
+/** @This sets the size of the write queue. If it is not 0, the output is
+ * opened and packets are muxed and written on a helper thread, and the
+ * pipeline only waits when the queue holds the given number of octets.
+ * It only takes effect after the next call to @ref upipe_set_uri.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets maximum number of octets (0 = write on the pipeline thread)
+ * @return an error code
+ */
+static inline int upipe_avfsink_set_write_queue(struct upipe *upipe,
+                                                uint64_t octets)
+{
+    return upipe_control(upipe, UPIPE_AVFSINK_SET_WRITE_QUEUE,
+                         UPIPE_AVFSINK_SIGNATURE, octets);
+}
+
 #ifdef __cplusplus
 }
 #endif
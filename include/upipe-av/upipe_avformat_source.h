@@ -47,7 +47,11 @@ enum upipe_avfsrc_command {
      * (uint64_t *) */
     UPIPE_AVFSRC_GET_TIME,
     /** asks to read at the given time (uint64_t) */
-    UPIPE_AVFSRC_SET_TIME
+    UPIPE_AVFSRC_SET_TIME,
+    /** returns the prefetch limits (uint64_t *, uint64_t *) */
+    UPIPE_AVFSRC_GET_PREFETCH,
+    /** sets the prefetch limits (uint64_t, uint64_t) */
+    UPIPE_AVFSRC_SET_PREFETCH
 };
 
 /** @This returns the management structure for all avformat sources.
@@ -109,6 +113,38 @@ static inline int upipe_avfsrc_set_time(struct upipe *upipe, uint64_t time)
                          time);
 }
 
+/** @This returns the limits of the prefetch queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets_p filled in with the maximum number of octets
+ * @param duration_p filled in with the maximum duration, in clock units
+ * @return an error code
+ */
+static inline int upipe_avfsrc_get_prefetch(struct upipe *upipe,
+                                            uint64_t *octets_p,
+                                            uint64_t *duration_p)
+{
+    return upipe_control(upipe, UPIPE_AVFSRC_GET_PREFETCH,
+                         UPIPE_AVFSRC_SIGNATURE, octets_p, duration_p);
+}
+
+/** @This sets the limits of the prefetch queue. If any of them is not 0,
+ * packets are demuxed on a helper thread, which reads ahead of the pipeline
+ * until the queue holds the given number of octets or the given duration.
+ * It only takes effect after the next call to @ref upipe_set_uri.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets maximum number of octets (0 = unlimited)
+ * @param duration maximum duration, in clock units (0 = unlimited)
+ * @return an error code
+ */
+static inline int upipe_avfsrc_set_prefetch(struct upipe *upipe,
+                                            uint64_t octets, uint64_t duration)
+{
+    return upipe_control(upipe, UPIPE_AVFSRC_SET_PREFETCH,
+                         UPIPE_AVFSRC_SIGNATURE, octets, duration);
+}
+
 #ifdef __cplusplus
 }
 #endif
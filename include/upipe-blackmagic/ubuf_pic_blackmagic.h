@@ -45,6 +45,18 @@ extern "C" {
  * is used properly. */
 #define UBUF_BMD_ALLOC_PICTURE UBASE_FOURCC('b','m','d','p')
 
+/** @This extends ubuf_mgr_command with specific commands for blackmagic
+ * pictures. */
+enum ubuf_pic_bmd_mgr_command {
+    UBUF_PIC_BMD_MGR_SENTINEL = UBUF_MGR_CONTROL_LOCAL,
+
+    /** returns the number of frames held from the driver (unsigned int *) */
+    UBUF_PIC_BMD_MGR_GET_HELD,
+    /** sets the maximum number of frames held from the driver
+     * (unsigned int) */
+    UBUF_PIC_BMD_MGR_SET_MAX_HELD
+};
+
 /** @This returns a new ubuf from a blackmagic picture allocator.
  *
  * @param mgr management structure for this ubuf type
@@ -57,6 +69,34 @@ static inline struct ubuf *ubuf_pic_bmd_alloc(struct ubuf_mgr *mgr,
     return ubuf_alloc(mgr, UBUF_BMD_ALLOC_PICTURE, VideoFrame);
 }
 
+/** @This returns the number of frames currently held from the driver.
+ *
+ * @param mgr management structure for this ubuf type
+ * @param held_p filled in with the number of frames
+ * @return an error code
+ */
+static inline int ubuf_pic_bmd_mgr_get_held(struct ubuf_mgr *mgr,
+                                            unsigned int *held_p)
+{
+    return ubuf_mgr_control(mgr, UBUF_PIC_BMD_MGR_GET_HELD,
+                            UBUF_BMD_ALLOC_PICTURE, held_p);
+}
+
+/** @This sets the maximum number of frames held from the driver. Past this
+ * limit, @ref ubuf_pic_bmd_alloc fails and the frame is left to the driver,
+ * so that a slow consumer doesn't exhaust the frame pool of the card.
+ *
+ * @param mgr management structure for this ubuf type
+ * @param max_held maximum number of frames (0 = unlimited)
+ * @return an error code
+ */
+static inline int ubuf_pic_bmd_mgr_set_max_held(struct ubuf_mgr *mgr,
+                                                unsigned int max_held)
+{
+    return ubuf_mgr_control(mgr, UBUF_PIC_BMD_MGR_SET_MAX_HELD,
+                            UBUF_BMD_ALLOC_PICTURE, max_held);
+}
+
 /** @This allocates a new instance of the ubuf manager for picture formats
  * using blackmagic.
  *
@@ -50,7 +50,11 @@ enum upipe_bmd_src_command {
     /** returns the sound subpipe (struct upipe **) */
     UPIPE_BMD_SRC_GET_SOUND_SUB,
     /** returns the subpic subpipe (struct upipe **) */
-    UPIPE_BMD_SRC_GET_SUBPIC_SUB
+    UPIPE_BMD_SRC_GET_SUBPIC_SUB,
+    /** returns the maximum number of frames held (unsigned int *) */
+    UPIPE_BMD_SRC_GET_MAX_FRAMES,
+    /** sets the maximum number of frames held (unsigned int) */
+    UPIPE_BMD_SRC_SET_MAX_FRAMES
 };
 
 /** @This returns the management structure for all bmd sources.
@@ -109,6 +113,35 @@ UPIPE_HELPER_ALLOC(bmd_src, UPIPE_BMD_SRC_SIGNATURE)
 #undef ARGS
 #undef ARGS_DECL
 
+/** @This returns the maximum number of video frames held from the driver.
+ *
+ * @param upipe description structure of the super pipe
+ * @param max_frames_p filled in with the maximum number of frames
+ * @return an error code
+ */
+static inline int upipe_bmd_src_get_max_frames(struct upipe *upipe,
+                                               unsigned int *max_frames_p)
+{
+    return upipe_control(upipe, UPIPE_BMD_SRC_GET_MAX_FRAMES,
+                         UPIPE_BMD_SRC_SIGNATURE, max_frames_p);
+}
+
+/** @This sets the maximum number of video frames held from the driver,
+ * either in the queue to the pipeline or downstream. Past this limit, new
+ * frames are dropped and left to the driver, so that a slow consumer
+ * doesn't exhaust the frame pool shared by the inputs of the card.
+ *
+ * @param upipe description structure of the super pipe
+ * @param max_frames maximum number of frames (0 = unlimited, default 16)
+ * @return an error code
+ */
+static inline int upipe_bmd_src_set_max_frames(struct upipe *upipe,
+                                               unsigned int max_frames)
+{
+    return upipe_control(upipe, UPIPE_BMD_SRC_SET_MAX_FRAMES,
+                         UPIPE_BMD_SRC_SIGNATURE, max_frames);
+}
+
 #ifdef __cplusplus
 }
 #endif
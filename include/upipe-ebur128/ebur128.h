@@ -60,8 +60,11 @@ enum mode {
   /** can call ebur128_true_peak */
   EBUR128_MODE_TRUE_PEAK   = (1 << 5) | EBUR128_MODE_M
                                       | EBUR128_MODE_SAMPLE_PEAK,
-  /** uses histogram algorithm to calculate loudness */
-  EBUR128_MODE_HISTOGRAM   = (1 << 6)
+  /** uses histogram algorithm to calculate loudness (default) */
+  EBUR128_MODE_HISTOGRAM   = (1 << 6),
+  /** keeps all block energies to calculate loudness exactly, with memory
+   *  growing with the duration of the measurement */
+  EBUR128_MODE_QUEUE       = (1 << 7)
 };
 
 /** forward declaration of ebur128_state_internal */
@@ -33,6 +33,83 @@ extern "C" {
 
 #define UPIPE_FILTER_BLEND_SIGNATURE UBASE_FOURCC('b', 'l', 'e', 'n')
 
+/** @This defines the deinterlacing modes of blend pipes. */
+enum upipe_filter_blend_mode {
+    /** blend each line with the next one */
+    UPIPE_FILTER_BLEND_MODE_BLEND,
+    /** keep the lines of the second field where the picture is static
+     * compared to the previous one, and interpolate them elsewhere */
+    UPIPE_FILTER_BLEND_MODE_ADAPTIVE
+};
+
+/** @This extends upipe_command with specific commands for blend pipes. */
+enum upipe_filter_blend_command {
+    UPIPE_FILTER_BLEND_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** get the deinterlacing mode (int *) */
+    UPIPE_FILTER_BLEND_GET_MODE,
+    /** set the deinterlacing mode (int) */
+    UPIPE_FILTER_BLEND_SET_MODE,
+    /** get the number of bands processed in parallel (unsigned int *) */
+    UPIPE_FILTER_BLEND_GET_BANDS,
+    /** set the number of bands processed in parallel (unsigned int) */
+    UPIPE_FILTER_BLEND_SET_BANDS
+};
+
+/** @This gets the deinterlacing mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param mode_p filled in with the mode (@see upipe_filter_blend_mode)
+ * @return an error code
+ */
+static inline int upipe_filter_blend_get_mode(struct upipe *upipe,
+                                              int *mode_p)
+{
+    return upipe_control(upipe, UPIPE_FILTER_BLEND_GET_MODE,
+                         UPIPE_FILTER_BLEND_SIGNATURE, mode_p);
+}
+
+/** @This sets the deinterlacing mode. The default is
+ * @ref UPIPE_FILTER_BLEND_MODE_BLEND.
+ *
+ * @param upipe description structure of the pipe
+ * @param mode deinterlacing mode (@see upipe_filter_blend_mode)
+ * @return an error code
+ */
+static inline int upipe_filter_blend_set_mode(struct upipe *upipe, int mode)
+{
+    return upipe_control(upipe, UPIPE_FILTER_BLEND_SET_MODE,
+                         UPIPE_FILTER_BLEND_SIGNATURE, mode);
+}
+
+/** @This gets the number of bands processed in parallel.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands_p filled in with the number of bands
+ * @return an error code
+ */
+static inline int upipe_filter_blend_get_bands(struct upipe *upipe,
+                                               unsigned int *nb_bands_p)
+{
+    return upipe_control(upipe, UPIPE_FILTER_BLEND_GET_BANDS,
+                         UPIPE_FILTER_BLEND_SIGNATURE, nb_bands_p);
+}
+
+/** @This sets the number of horizontal bands processed in parallel. Each band
+ * but the first is processed by a thread of the pipe, writing in place into
+ * the same output picture. The default is 1.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands number of bands
+ * @return an error code
+ */
+static inline int upipe_filter_blend_set_bands(struct upipe *upipe,
+                                               unsigned int nb_bands)
+{
+    return upipe_control(upipe, UPIPE_FILTER_BLEND_SET_BANDS,
+                         UPIPE_FILTER_BLEND_SIGNATURE, nb_bands);
+}
+
 /** @This returns the management structure for all avformat sources.
  *
  * @return pointer to manager
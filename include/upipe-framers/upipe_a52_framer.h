@@ -32,8 +32,56 @@ extern "C" {
 
 #include <upipe/upipe.h>
 
+#include <stdint.h>
+
 #define UPIPE_A52F_SIGNATURE UBASE_FOURCC('a','5','2','f')
 
+/** @This extends upipe_command with specific commands for A/52 framers. */
+enum upipe_a52f_command {
+    UPIPE_A52F_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the limits of the groups of frames (unsigned int *,
+     * uint64_t *) */
+    UPIPE_A52F_GET_BATCH,
+    /** sets the limits of the groups of frames (unsigned int, uint64_t) */
+    UPIPE_A52F_SET_BATCH
+};
+
+/** @This returns the limits of the groups of output frames.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames_p filled in with the maximum number of frames
+ * @param max_duration_p filled in with the maximum duration
+ * @return an error code
+ */
+static inline int upipe_a52f_get_batch(struct upipe *upipe,
+                                       unsigned int *max_frames_p,
+                                       uint64_t *max_duration_p)
+{
+    return upipe_control(upipe, UPIPE_A52F_GET_BATCH, UPIPE_A52F_SIGNATURE,
+                         max_frames_p, max_duration_p);
+}
+
+/** @This sets the limits of the groups of output frames. Consecutive frames
+ * are then output in a single uref, carrying a table of frames (see
+ * @ref uref_frames_extract), until it contains max_frames frames or lasts
+ * max_duration; this divides the number of urefs per second. Grouping is
+ * disabled by default, and when both limits are 0. Groups lasting longer
+ * than the PES duration of a TS mux increase the T-STD buffer occupancy.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames maximum number of frames in a group, or 0
+ * @param max_duration maximum duration of a group in 27 MHz units, or 0
+ * @return an error code
+ */
+static inline int upipe_a52f_set_batch(struct upipe *upipe,
+                                       unsigned int max_frames,
+                                       uint64_t max_duration)
+{
+    return upipe_control(upipe, UPIPE_A52F_SET_BATCH, UPIPE_A52F_SIGNATURE,
+                         max_frames, max_duration);
+}
+
 /** @This returns the management structure for all a52f pipes.
  *
  * @return pointer to manager
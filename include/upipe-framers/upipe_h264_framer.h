@@ -35,12 +35,91 @@ extern "C" {
 /** We only accept the ISO 14496-10 annex B elementary stream. */
 #define UPIPE_H264F_EXPECTED_FLOW_DEF "block.h264."
 
+/** @This extends upipe_command with specific commands for h264 framer. */
+enum upipe_h264f_command {
+    UPIPE_H264F_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the current setting for boundaries-only parsing (int *) */
+    UPIPE_H264F_GET_BOUNDARIES_ONLY,
+    /** sets or unsets boundaries-only parsing (int) */
+    UPIPE_H264F_SET_BOUNDARIES_ONLY,
+    /** returns the current setting for non-reference pictures (int *) */
+    UPIPE_H264F_GET_DROP_NONREF,
+    /** sets or unsets the dropping of non-reference pictures (int) */
+    UPIPE_H264F_SET_DROP_NONREF
+};
+
 /** @This returns the management structure for all h264f pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_h264f_mgr_alloc(void);
 
+/** @This returns the current setting for boundaries-only parsing.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static inline int upipe_h264f_get_boundaries_only(struct upipe *upipe,
+                                                  bool *val_p)
+{
+    int val;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_H264F_GET_BOUNDARIES_ONLY,
+                               UPIPE_H264F_SIGNATURE, &val))
+    *val_p = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets boundaries-only parsing, for remultiplexing
+ * applications which only need access unit boundaries and random access
+ * points. Slice headers are then only parsed up to the PPS ID, so that
+ * picture numbers are assigned in decoding order, and the field structure
+ * only comes from picture timing SEI. Streams using arbitrary slice order
+ * are not supported in this mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true for boundaries-only parsing
+ * @return an error code
+ */
+static inline int upipe_h264f_set_boundaries_only(struct upipe *upipe,
+                                                  bool val)
+{
+    return upipe_control(upipe, UPIPE_H264F_SET_BOUNDARIES_ONLY,
+                         UPIPE_H264F_SIGNATURE, val ? 1 : 0);
+}
+
+/** @This returns the current setting for the dropping of non-reference
+ * pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static inline int upipe_h264f_get_drop_nonref(struct upipe *upipe,
+                                              bool *val_p)
+{
+    int val;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_H264F_GET_DROP_NONREF,
+                               UPIPE_H264F_SIGNATURE, &val))
+    *val_p = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets the dropping of non-reference pictures (nal_ref_idc
+ * equal to 0), for instance for fast-forward or thumbnail generation, so
+ * that decoders only receive pictures needed to decode the next ones.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true to drop non-reference pictures
+ * @return an error code
+ */
+static inline int upipe_h264f_set_drop_nonref(struct upipe *upipe, bool val)
+{
+    return upipe_control(upipe, UPIPE_H264F_SET_DROP_NONREF,
+                         UPIPE_H264F_SIGNATURE, val ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -42,7 +42,11 @@ enum upipe_mpgvf_command {
     /** returns the current setting for sequence header insertion (int *) */
     UPIPE_MPGVF_GET_SEQUENCE_INSERTION,
     /** sets or unsets the sequence header insertion (int) */
-    UPIPE_MPGVF_SET_SEQUENCE_INSERTION
+    UPIPE_MPGVF_SET_SEQUENCE_INSERTION,
+    /** returns the current setting for non-reference pictures (int *) */
+    UPIPE_MPGVF_GET_DROP_NONREF,
+    /** sets or unsets the dropping of non-reference pictures (int) */
+    UPIPE_MPGVF_SET_DROP_NONREF
 };
 
 /** @This returns the management structure for all mpgvf pipes.
@@ -82,6 +86,37 @@ static inline bool upipe_mpgvf_set_sequence_insertion(struct upipe *upipe,
                          UPIPE_MPGVF_SIGNATURE, val ? 1 : 0);
 }
 
+/** @This returns the current setting for the dropping of non-reference
+ * pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static inline int upipe_mpgvf_get_drop_nonref(struct upipe *upipe,
+                                              bool *val_p)
+{
+    int val;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_MPGVF_GET_DROP_NONREF,
+                               UPIPE_MPGVF_SIGNATURE, &val))
+    *val_p = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets the dropping of non-reference (B) pictures, for
+ * instance for fast-forward or thumbnail generation, so that decoders only
+ * receive pictures needed to decode the next ones.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true to drop B pictures
+ * @return an error code
+ */
+static inline int upipe_mpgvf_set_drop_nonref(struct upipe *upipe, bool val)
+{
+    return upipe_control(upipe, UPIPE_MPGVF_SET_DROP_NONREF,
+                         UPIPE_MPGVF_SIGNATURE, val ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe attributes for groups of frames
+ * Framers may output several consecutive frames of an elementary stream in
+ * a single uref, along with a packed array describing the position, DTS
+ * and duration of each frame, so that the number of urefs per second is
+ * divided accordingly. The dates and duration of the uref itself are those
+ * of the whole group.
+ */
+
+#ifndef _UPIPE_FRAMERS_UREF_FRAMES_H_
+/** @hidden */
+#define _UPIPE_FRAMERS_UREF_FRAMES_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/uref.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+
+#include <string.h>
+#include <stdint.h>
+
+/** maximum number of frames in a group */
+#define UREF_FRAMES_MAX (UINT16_MAX / sizeof(struct uref_frames_frame))
+
+/** @This describes a frame of a group. */
+struct uref_frames_frame {
+    /** DTS of the frame, relative to the DTS of the group */
+    uint64_t dts_delay;
+    /** duration of the frame */
+    uint64_t duration;
+    /** offset of the frame in the group */
+    uint32_t offset;
+    /** size of the frame */
+    uint32_t size;
+};
+
+UREF_ATTR_OPAQUE(frames, table_internal, "b.frames", table of frames)
+
+/** @This returns the number of frames described in a group.
+ *
+ * @param uref pointer to the uref
+ * @param nb_p filled in with the number of frames
+ * @return an error code
+ */
+static inline int uref_frames_get_nb(struct uref *uref, unsigned int *nb_p)
+{
+    const uint8_t *attr;
+    size_t size;
+    UBASE_RETURN(uref_frames_get_table_internal(uref, &attr, &size))
+    if (unlikely(size % sizeof(struct uref_frames_frame)))
+        return UBASE_ERR_INVALID;
+    *nb_p = size / sizeof(struct uref_frames_frame);
+    return UBASE_ERR_NONE;
+}
+
+/** @This copies the descriptions of frames of a group. As attributes are
+ * not aligned, they can't be accessed in place.
+ *
+ * @param uref pointer to the uref
+ * @param first index of the first frame to copy
+ * @param nb number of frames to copy
+ * @param frames caller-allocated array of nb descriptions
+ * @return an error code
+ */
+static inline int uref_frames_read(struct uref *uref, unsigned int first,
+                                   unsigned int nb,
+                                   struct uref_frames_frame *frames)
+{
+    const uint8_t *attr;
+    size_t size;
+    UBASE_RETURN(uref_frames_get_table_internal(uref, &attr, &size))
+    if (unlikely((first + nb) * sizeof(struct uref_frames_frame) > size))
+        return UBASE_ERR_INVALID;
+    memcpy(frames, attr + first * sizeof(struct uref_frames_frame),
+           nb * sizeof(struct uref_frames_frame));
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets the descriptions of the frames of a group.
+ *
+ * @param uref pointer to the uref
+ * @param frames array of nb descriptions
+ * @param nb number of frames in the uref
+ * @return an error code
+ */
+static inline int uref_frames_set(struct uref *uref,
+                                  const struct uref_frames_frame *frames,
+                                  unsigned int nb)
+{
+    if (unlikely(nb > UREF_FRAMES_MAX))
+        return UBASE_ERR_INVALID;
+    return uref_frames_set_table_internal(uref, (const uint8_t *)frames,
+            nb * sizeof(struct uref_frames_frame));
+}
+
+/** @This deletes the descriptions of the frames of a group.
+ *
+ * @param uref pointer to the uref
+ * @return an error code
+ */
+static inline int uref_frames_delete(struct uref *uref)
+{
+    return uref_frames_delete_table_internal(uref);
+}
+
+/** @This allocates a new uref containing a single frame of a group,
+ * sharing the buffer of the original uref, with the dates and duration of
+ * the frame.
+ *
+ * @param uref pointer to the group
+ * @param index index of the frame
+ * @return pointer to the new uref, or NULL in case of error
+ */
+static inline struct uref *uref_frames_extract(struct uref *uref,
+                                               unsigned int index)
+{
+    struct uref_frames_frame frame;
+    if (unlikely(!ubase_check(uref_frames_read(uref, index, 1, &frame))))
+        return NULL;
+
+    struct uref *new_uref = uref_block_splice(uref, frame.offset, frame.size);
+    if (unlikely(new_uref == NULL))
+        return NULL;
+    uref_frames_delete(new_uref);
+
+    uint64_t date;
+#define SET_DATE(dv)                                                        \
+    if (ubase_check(uref_clock_get_dts_##dv(uref, &date)))                  \
+        uref_clock_set_dts_##dv(new_uref, date + frame.dts_delay);
+    SET_DATE(sys)
+    SET_DATE(prog)
+    SET_DATE(orig)
+#undef SET_DATE
+    if (unlikely(!ubase_check(uref_clock_set_duration(new_uref,
+                                                      frame.duration)))) {
+        uref_free(new_uref);
+        return NULL;
+    }
+    if (index)
+        uref_flow_delete_discontinuity(new_uref);
+    return new_uref;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -36,6 +36,9 @@ extern "C" {
 
 #include <upipe/upipe.h>
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #define UPIPE_GL_SINK_SIGNATURE UBASE_FOURCC('g', 'l', 's', 'k')
 
 /** @This extends uprobe_event with specific events for gl sink. */
@@ -66,6 +69,69 @@ enum upipe_gl_sink_command {
  */
 bool upipe_gl_texture_load_uref(struct uref *uref, unsigned int texture);
 
+/** maximum number of planes of a picture loaded into GL textures */
+#define UPIPE_GL_TEXTURE_PLANES 3
+/** number of pixel buffer objects used in turn to upload a plane */
+#define UPIPE_GL_TEXTURE_PBOS 2
+
+/** @This describes a set of persistent GL textures receiving pictures,
+ * either a single r8g8b8 plane, or y8, u8 and v8 planes converted to RGB
+ * by a fragment shader when drawing. */
+struct upipe_gl_texture {
+    /** texture objects, one per plane */
+    unsigned int textures[UPIPE_GL_TEXTURE_PLANES];
+    /** allocated width of the textures */
+    size_t widths[UPIPE_GL_TEXTURE_PLANES];
+    /** allocated height of the textures */
+    size_t heights[UPIPE_GL_TEXTURE_PLANES];
+    /** pixel buffer objects, one ring per plane, or 0 if unavailable */
+    unsigned int pbos[UPIPE_GL_TEXTURE_PLANES][UPIPE_GL_TEXTURE_PBOS];
+    /** next pixel buffer object to use in the ring */
+    unsigned int pbo;
+    /** fragment shader program converting YUV planes, or 0 if unavailable */
+    unsigned int program;
+    /** true if the last loaded picture was YUV */
+    bool yuv;
+};
+
+/** @This initializes the textures, pixel buffer objects and shader. It must
+ * be called with the GL context current.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_init(struct upipe_gl_texture *texture);
+
+/** @This releases the GL objects. It must be called with the GL context
+ * current.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_clean(struct upipe_gl_texture *texture);
+
+/** @This uploads a r8g8b8 or y8/u8/v8 picture into the textures, through
+ * the pixel buffer objects if available. The textures are only reallocated
+ * when the picture size changes.
+ *
+ * @param texture pointer to the texture structure
+ * @param uref uref structure describing the picture
+ * @return false in case of error
+ */
+bool upipe_gl_texture_load(struct upipe_gl_texture *texture,
+                           struct uref *uref);
+
+/** @This binds the textures, and the conversion shader if the last loaded
+ * picture was YUV, for drawing with texture unit 0 coordinates.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_bind(struct upipe_gl_texture *texture);
+
+/** @This unbinds what was bound by @ref upipe_gl_texture_bind.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_unbind(struct upipe_gl_texture *texture);
+
 #ifdef __cplusplus
 }
 #endif
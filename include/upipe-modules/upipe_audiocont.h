@@ -55,6 +55,10 @@ enum upipe_audiocont_command {
     UPIPE_AUDIOCONT_GET_LATENCY,
     /** sets the pts latency (uint64_t) */
     UPIPE_AUDIOCONT_SET_LATENCY,
+    /** returns the crossfade duration (uint64_t *) */
+    UPIPE_AUDIOCONT_GET_CROSSFADE,
+    /** sets the crossfade duration (uint64_t) */
+    UPIPE_AUDIOCONT_SET_CROSSFADE,
 };
 
 /** @This extends upipe_command with specific commands for upipe_audiocont
@@ -131,6 +135,34 @@ static inline int upipe_audiocont_set_latency(struct upipe *upipe,
                          UPIPE_AUDIOCONT_SIGNATURE, latency);
 }
 
+/** @This returns the crossfade duration.
+ *
+ * @param upipe description structure of the pipe
+ * @param crossfade_p filled with the crossfade duration, in 27 MHz units
+ * @return an error code
+ */
+static inline int upipe_audiocont_get_crossfade(struct upipe *upipe,
+                                                uint64_t *crossfade_p)
+{
+    return upipe_control(upipe, UPIPE_AUDIOCONT_GET_CROSSFADE,
+                         UPIPE_AUDIOCONT_SIGNATURE, crossfade_p);
+}
+
+/** @This sets the duration of the crossfade between the previous and the new
+ * input on input switches, or 0 to switch immediately (default). Only s16,
+ * s32 and f32 inputs with the same format are crossfaded.
+ *
+ * @param upipe description structure of the pipe
+ * @param crossfade crossfade duration, in 27 MHz units
+ * @return an error code
+ */
+static inline int upipe_audiocont_set_crossfade(struct upipe *upipe,
+                                                uint64_t crossfade)
+{
+    return upipe_control(upipe, UPIPE_AUDIOCONT_SET_CROSSFADE,
+                         UPIPE_AUDIOCONT_SIGNATURE, crossfade);
+}
+
 /** @This sets a audiocont subpipe as its grandpipe input.
  *
  * @param upipe description structure of the (sub)pipe
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module - generates capture records from urefs
+ * This linear module converts urefs to capture records, which store the
+ * system date, the flags and the payload of each uref, so that the exact
+ * arrival pattern of a flow may be replayed later with
+ * @ref upipe_replaysrc_mgr_alloc.
+ *
+ * Like @ref upipe_genaux_mgr_alloc, it is typically placed on an output of
+ * a dup pipe, and followed by fsink or multicat sink to store the records.
+ * A record is made of a header of @ref UPIPE_CAPTURE_HEADER_SIZE octets
+ * (the aux entry of the system date, then the size of the payload and the
+ * flags, in network byte order) followed by the payload. The payload of
+ * the input uref is not copied. A record with @ref UPIPE_CAPTURE_FLOW_DEF
+ * carrying the flow definition string is written before the first uref of
+ * each flow definition.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_CAPTURE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_CAPTURE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_genaux.h>
+
+#include <stdint.h>
+
+#define UPIPE_CAPTURE_SIGNATURE UBASE_FOURCC('c','a','p','t')
+
+/** size of the header of a capture record, in octets */
+#define UPIPE_CAPTURE_HEADER_SIZE 16
+/** system date of a record for urefs without k.systime */
+#define UPIPE_CAPTURE_NO_DATE UINT64_MAX
+
+/** @This defines the flags of a capture record. */
+enum upipe_capture_flag {
+    /** the payload is the flow definition string of the next records */
+    UPIPE_CAPTURE_FLOW_DEF = 0x1,
+    /** the uref is a random access point */
+    UPIPE_CAPTURE_RANDOM = 0x2,
+    /** the uref follows a discontinuity */
+    UPIPE_CAPTURE_DISCONTINUITY = 0x4,
+    /** the uref is flagged as erroneous */
+    UPIPE_CAPTURE_ERROR = 0x8,
+    /** the uref starts a block */
+    UPIPE_CAPTURE_START = 0x10,
+    /** the uref ends a block */
+    UPIPE_CAPTURE_END = 0x20
+};
+
+/** @This describes the header of a capture record. */
+struct upipe_capture_record {
+    /** system date, or @ref UPIPE_CAPTURE_NO_DATE */
+    uint64_t date;
+    /** size of the payload following the header, in octets */
+    uint32_t size;
+    /** flags (see @ref upipe_capture_flag) */
+    uint32_t flags;
+};
+
+/** @This returns the management structure for capture pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_capture_mgr_alloc(void);
+
+/** @This writes the header of a capture record.
+ *
+ * @param buf destination buffer, of @ref UPIPE_CAPTURE_HEADER_SIZE octets
+ * @param record header to write
+ */
+static inline void upipe_capture_write_header(uint8_t *buf,
+        const struct upipe_capture_record *record)
+{
+    upipe_genaux_hton64(buf, record->date);
+    upipe_genaux_hton64(buf + 8,
+                        ((uint64_t)record->size << 32) | record->flags);
+}
+
+/** @This reads the header of a capture record.
+ *
+ * @param buf source buffer, of @ref UPIPE_CAPTURE_HEADER_SIZE octets
+ * @param record filled in with the header
+ */
+static inline void upipe_capture_read_header(const uint8_t *buf,
+        struct upipe_capture_record *record)
+{
+    record->date = upipe_genaux_ntoh64(buf);
+    uint64_t word = upipe_genaux_ntoh64(buf + 8);
+    record->size = word >> 32;
+    record->flags = word & UINT32_MAX;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
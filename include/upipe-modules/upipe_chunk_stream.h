@@ -47,6 +47,10 @@ enum upipe_chunk_stream_command {
     UPIPE_CHUNK_STREAM_SET_MTU,
     /** set chunk size (unsigned int*, unsigned int*) */
     UPIPE_CHUNK_STREAM_GET_MTU,
+    /** set number of chunks per output block (unsigned int) */
+    UPIPE_CHUNK_STREAM_SET_SEGMENTS,
+    /** get number of chunks per output block (unsigned int*) */
+    UPIPE_CHUNK_STREAM_GET_SEGMENTS,
 };
 
 /** @This returns the configured mtu of TS packets.
@@ -76,6 +80,36 @@ static inline int upipe_chunk_stream_set_mtu(struct upipe *upipe,
                          UPIPE_CHUNK_STREAM_SIGNATURE, mtu, align);
 }
 
+/** @This returns the configured number of chunks per output block.
+ *
+ * @param upipe description structure of the pipe
+ * @param segments_p filled in with the number of chunks
+ * @return an error code
+ */
+static inline int upipe_chunk_stream_get_segments(struct upipe *upipe,
+                                                  unsigned int *segments_p)
+{
+    return upipe_control(upipe, UPIPE_CHUNK_STREAM_GET_SEGMENTS,
+                         UPIPE_CHUNK_STREAM_SIGNATURE, segments_p);
+}
+
+/** @This sets the number of chunks per output block. With more than one
+ * chunk, the pipe outputs super-chunks of several chunks, with the size of
+ * a chunk in the segment_size attribute, so that a sink supporting
+ * segmentation offload (for instance udpsink) sends the datagrams with a
+ * single system call. The default is 1.
+ *
+ * @param upipe description structure of the pipe
+ * @param segments number of chunks per output block, at most 64 and 64 kB
+ * @return an error code
+ */
+static inline int upipe_chunk_stream_set_segments(struct upipe *upipe,
+                                                  unsigned int segments)
+{
+    return upipe_control(upipe, UPIPE_CHUNK_STREAM_SET_SEGMENTS,
+                         UPIPE_CHUNK_STREAM_SIGNATURE, segments);
+}
+
 /** @This returns the management structure for chunk_stream pipes.
  *
  * @return pointer to manager
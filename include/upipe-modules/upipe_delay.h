@@ -46,7 +46,12 @@ enum upipe_delay_command {
     /** returns the current delay being set into urefs (uint64_t **) */
     UPIPE_DELAY_GET_DELAY,
     /** sets the delay to set into urefs (uint64_t *) */
-    UPIPE_DELAY_SET_DELAY
+    UPIPE_DELAY_SET_DELAY,
+    /** returns the max octets of held urefs (uint64_t *) */
+    UPIPE_DELAY_GET_BUFFER,
+    /** sets the max octets of held urefs and the spill file
+     * (uint64_t, const char *) */
+    UPIPE_DELAY_SET_BUFFER
 };
 
 /** @This returns the management structure for all delay pipes.
@@ -79,6 +84,44 @@ static inline int upipe_delay_set_delay(struct upipe *upipe, uint64_t delay)
                          UPIPE_DELAY_SIGNATURE, delay);
 }
 
+/** @This returns the max octets of urefs held by the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer_p filled with the max octets, or 0 if urefs are not held
+ * @return an error code
+ */
+static inline int upipe_delay_get_buffer(struct upipe *upipe,
+                                         uint64_t *buffer_p)
+{
+    return upipe_control(upipe, UPIPE_DELAY_GET_BUFFER,
+                         UPIPE_DELAY_SIGNATURE, buffer_p);
+}
+
+/** @This sets the max octets of urefs held by the pipe. If not 0, the urefs
+ * are output when a uref received delay later (according to its clock
+ * reference in system time) is input, or earlier if the buffer is full,
+ * instead of being held by the sinks. Only the payloads of blocks are
+ * accounted.
+ *
+ * If a spill file is given, it is mapped with the size of the buffer, and
+ * the payloads of blocks are copied to it while they are held, so that only
+ * the attributes remain in memory. The payloads are copied back to new
+ * ubufs when they are output.
+ *
+ * The urefs currently held are output first.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer max octets of held urefs, or 0 to only shift dates
+ * @param path path of the spill file, or NULL to keep payloads in memory
+ * @return an error code
+ */
+static inline int upipe_delay_set_buffer(struct upipe *upipe, uint64_t buffer,
+                                         const char *path)
+{
+    return upipe_control(upipe, UPIPE_DELAY_SET_BUFFER,
+                         UPIPE_DELAY_SIGNATURE, buffer, path);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,6 +39,54 @@ extern "C" {
 #define UPIPE_DUP_SIGNATURE UBASE_FOURCC('d','u','p',' ')
 #define UPIPE_DUP_OUTPUT_SIGNATURE UBASE_FOURCC('d','u','p','o')
 
+/** @This extends upipe_command with specific commands for dup pipes. */
+enum upipe_dup_command {
+    UPIPE_DUP_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the shared mode (bool) */
+    UPIPE_DUP_SET_SHARED
+};
+
+/** @This extends upipe_command with specific commands for dup outputs. */
+enum upipe_dup_output_command {
+    UPIPE_DUP_OUTPUT_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** declares that the output writes to the buffers (bool) */
+    UPIPE_DUP_OUTPUT_SET_WRITER
+};
+
+/** @This sets the shared mode of a dup pipe. In shared mode, the structures
+ * of the duplicates given to the outputs come from a pool of the dup pipe
+ * instead of the uref manager. Each duplicate holds its own references to
+ * the udict and ubuf, which are copied on write, so that the receivers may
+ * modify them as usual. It is disabled by default.
+ *
+ * @param upipe description structure of the pipe
+ * @param shared true if the outputs share the incoming urefs
+ * @return an error code
+ */
+static inline int upipe_dup_set_shared(struct upipe *upipe, bool shared)
+{
+    return upipe_control(upipe, UPIPE_DUP_SET_SHARED, UPIPE_DUP_SIGNATURE,
+                         shared ? 1 : 0);
+}
+
+/** @This declares that an output of a dup pipe writes to the buffers. The
+ * first such output is given the incoming uref after the other outputs, so
+ * that it holds the only reference to the buffer if they have released
+ * theirs, and does not copy it on write. It is disabled by default.
+ *
+ * @param upipe description structure of the output subpipe
+ * @param writer true if the output writes to the buffers
+ * @return an error code
+ */
+static inline int upipe_dup_output_set_writer(struct upipe *upipe,
+                                              bool writer)
+{
+    return upipe_control(upipe, UPIPE_DUP_OUTPUT_SET_WRITER,
+                         UPIPE_DUP_OUTPUT_SIGNATURE, writer ? 1 : 0);
+}
+
 /** @This returns the management structure for all dup pipes.
  *
  * @return pointer to manager
@@ -58,7 +58,22 @@ enum upipe_fsink_command {
     /** returns the path of the currently opened file (const char **) */
     UPIPE_FSINK_GET_PATH,
     /** asks to open the given path (const char *, enum upipe_fsink_mode) */
-    UPIPE_FSINK_SET_PATH
+    UPIPE_FSINK_SET_PATH,
+    /** returns the size of the O_DIRECT staging buffer (unsigned int *) */
+    UPIPE_FSINK_GET_DIRECT,
+    /** sets the size of the O_DIRECT staging buffer (unsigned int) */
+    UPIPE_FSINK_SET_DIRECT,
+    /** returns the size of the chunks of preallocated space (uint64_t *) */
+    UPIPE_FSINK_GET_PREALLOC,
+    /** sets the size of the chunks of preallocated space (uint64_t) */
+    UPIPE_FSINK_SET_PREALLOC,
+    /** returns the number of octets between two syncs (uint64_t *) */
+    UPIPE_FSINK_GET_SYNC,
+    /** sets the number of octets between two syncs (uint64_t) */
+    UPIPE_FSINK_SET_SYNC,
+    /** asks to open the given path ahead of time (const char *,
+     * enum upipe_fsink_mode) */
+    UPIPE_FSINK_PREPARE_PATH
 };
 
 /** @This returns the management structure for all file sinks.
@@ -95,6 +110,107 @@ static inline int upipe_fsink_set_path(struct upipe *upipe,
                          path, mode);
 }
 
+/** @This asks to open the given file on a helper thread, ahead of a call
+ * to @ref upipe_fsink_set_path with the same arguments, which then doesn't
+ * block. Once this has been called, files are also closed on the helper
+ * thread. Note that the file is created at the time it is prepared.
+ *
+ * @param upipe description structure of the pipe
+ * @param path relative or absolute path of the file
+ * @param mode mode of opening the file
+ * @return an error code
+ */
+static inline int upipe_fsink_prepare_path(struct upipe *upipe,
+                                           const char *path,
+                                           enum upipe_fsink_mode mode)
+{
+    return upipe_control(upipe, UPIPE_FSINK_PREPARE_PATH,
+                         UPIPE_FSINK_SIGNATURE, path, mode);
+}
+
+/** @This returns the size of the O_DIRECT staging buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the buffer, or 0
+ * @return an error code
+ */
+static inline int upipe_fsink_get_direct(struct upipe *upipe,
+                                         unsigned int *size_p)
+{
+    return upipe_control(upipe, UPIPE_FSINK_GET_DIRECT, UPIPE_FSINK_SIGNATURE,
+                         size_p);
+}
+
+/** @This sets the size of the O_DIRECT staging buffer. When it is not 0,
+ * files are opened with O_DIRECT, bypassing the page cache, and data is
+ * written by whole aligned buffers of this size. It only takes effect
+ * after the next call to @ref upipe_fsink_set_path.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the buffer, in octets, or 0 to disable O_DIRECT
+ * @return an error code
+ */
+static inline int upipe_fsink_set_direct(struct upipe *upipe,
+                                         unsigned int size)
+{
+    return upipe_control(upipe, UPIPE_FSINK_SET_DIRECT, UPIPE_FSINK_SIGNATURE,
+                         size);
+}
+
+/** @This returns the size of the chunks of preallocated space.
+ *
+ * @param upipe description structure of the pipe
+ * @param prealloc_p filled in with the size of the chunks, or 0
+ * @return an error code
+ */
+static inline int upipe_fsink_get_prealloc(struct upipe *upipe,
+                                           uint64_t *prealloc_p)
+{
+    return upipe_control(upipe, UPIPE_FSINK_GET_PREALLOC,
+                         UPIPE_FSINK_SIGNATURE, prealloc_p);
+}
+
+/** @This sets the size of the chunks of space preallocated ahead of the
+ * writes with fallocate(), without changing the size of the file.
+ *
+ * @param upipe description structure of the pipe
+ * @param prealloc size of the chunks, in octets, or 0 to disable
+ * @return an error code
+ */
+static inline int upipe_fsink_set_prealloc(struct upipe *upipe,
+                                           uint64_t prealloc)
+{
+    return upipe_control(upipe, UPIPE_FSINK_SET_PREALLOC,
+                         UPIPE_FSINK_SIGNATURE, prealloc);
+}
+
+/** @This returns the number of octets between two syncs.
+ *
+ * @param upipe description structure of the pipe
+ * @param period_p filled in with the number of octets, or 0
+ * @return an error code
+ */
+static inline int upipe_fsink_get_sync(struct upipe *upipe,
+                                       uint64_t *period_p)
+{
+    return upipe_control(upipe, UPIPE_FSINK_GET_SYNC, UPIPE_FSINK_SIGNATURE,
+                         period_p);
+}
+
+/** @This sets the number of octets between two syncs. Every period, the
+ * writeback of the last period is started, and the previous period is
+ * waited for and dropped from the page cache.
+ *
+ * @param upipe description structure of the pipe
+ * @param period number of octets, or 0 to let the kernel write back data
+ * @return an error code
+ */
+static inline int upipe_fsink_set_sync(struct upipe *upipe, uint64_t period)
+{
+    return upipe_control(upipe, UPIPE_FSINK_SET_SYNC, UPIPE_FSINK_SIGNATURE,
+                         period);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -48,7 +48,22 @@ enum upipe_fsrc_command {
      * (uint64_t *) */
     UPIPE_FSRC_GET_POSITION,
     /** asks to read at the given position (uint64_t) */
-    UPIPE_FSRC_SET_POSITION
+    UPIPE_FSRC_SET_POSITION,
+    /** returns the size of the mapped windows, in octets (uint64_t *) */
+    UPIPE_FSRC_GET_MMAP,
+    /** sets the size of the mapped windows, in octets, or 0 to read()
+     * (uint64_t) */
+    UPIPE_FSRC_SET_MMAP,
+    /** returns the size and number of the chunks read ahead
+     * (uint64_t *, unsigned int *) */
+    UPIPE_FSRC_GET_READ_AHEAD,
+    /** sets the size and number of the chunks read ahead, or 0 to read()
+     * (uint64_t, unsigned int) */
+    UPIPE_FSRC_SET_READ_AHEAD,
+    /** returns true if the chunks are read with O_DIRECT (bool *) */
+    UPIPE_FSRC_GET_DIRECT,
+    /** asks to read the chunks with O_DIRECT (bool) */
+    UPIPE_FSRC_SET_DIRECT
 };
 
 /** @This returns the management structure for all file sources.
@@ -96,6 +111,92 @@ static inline int upipe_fsrc_set_position(struct upipe *upipe,
                          position);
 }
 
+/** @This returns the size of the windows of the file mapped in memory.
+ *
+ * @param upipe description structure of the pipe
+ * @param window_p filled in with the size of the windows, in octets
+ * @return an error code
+ */
+static inline int upipe_fsrc_get_mmap(struct upipe *upipe, uint64_t *window_p)
+{
+    return upipe_control(upipe, UPIPE_FSRC_GET_MMAP, UPIPE_FSRC_SIGNATURE,
+                         window_p);
+}
+
+/** @This sets the size of the windows of the file mapped in memory. When
+ * it is not 0, regular files are mapped window by window instead of being
+ * read, and the output buffers point straight into the mapping.
+ *
+ * @param upipe description structure of the pipe
+ * @param window size of the windows, in octets, or 0 to use read()
+ * @return an error code
+ */
+static inline int upipe_fsrc_set_mmap(struct upipe *upipe, uint64_t window)
+{
+    return upipe_control(upipe, UPIPE_FSRC_SET_MMAP, UPIPE_FSRC_SIGNATURE,
+                         window);
+}
+
+/** @This returns the size and number of the chunks read ahead.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the chunks, in octets, or 0
+ * @param depth_p filled in with the number of chunks in flight
+ * @return an error code
+ */
+static inline int upipe_fsrc_get_read_ahead(struct upipe *upipe,
+                                            uint64_t *size_p,
+                                            unsigned int *depth_p)
+{
+    return upipe_control(upipe, UPIPE_FSRC_GET_READ_AHEAD,
+                         UPIPE_FSRC_SIGNATURE, size_p, depth_p);
+}
+
+/** @This sets the size and number of the chunks read ahead. When the size
+ * is not 0 and the file is not mapped, regular files are read by a helper
+ * thread in chunks of this size (rounded down to a multiple of 188 octets),
+ * up to depth chunks ahead of the pipeline, and the output buffers point
+ * straight into the chunks.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the chunks, in octets, or 0 to read() on the pipeline
+ * thread
+ * @param depth number of chunks in flight
+ * @return an error code
+ */
+static inline int upipe_fsrc_set_read_ahead(struct upipe *upipe,
+                                            uint64_t size, unsigned int depth)
+{
+    return upipe_control(upipe, UPIPE_FSRC_SET_READ_AHEAD,
+                         UPIPE_FSRC_SIGNATURE, size, depth);
+}
+
+/** @This returns whether chunks read ahead bypass the page cache.
+ *
+ * @param upipe description structure of the pipe
+ * @param direct_p filled in with true if the file is read with O_DIRECT
+ * @return an error code
+ */
+static inline int upipe_fsrc_get_direct(struct upipe *upipe, bool *direct_p)
+{
+    return upipe_control(upipe, UPIPE_FSRC_GET_DIRECT, UPIPE_FSRC_SIGNATURE,
+                         direct_p);
+}
+
+/** @This asks to read the chunks read ahead with O_DIRECT, bypassing the
+ * page cache. The chunks are then also aligned on 4096 octets. It falls
+ * back to buffered reads if the file system doesn't support O_DIRECT.
+ *
+ * @param upipe description structure of the pipe
+ * @param direct true to use O_DIRECT
+ * @return an error code
+ */
+static inline int upipe_fsrc_set_direct(struct upipe *upipe, bool direct)
+{
+    return upipe_control(upipe, UPIPE_FSRC_SET_DIRECT, UPIPE_FSRC_SIGNATURE,
+                         direct ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
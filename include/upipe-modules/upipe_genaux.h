@@ -29,6 +29,10 @@
  * k.systime value from the input uref.
  * This is typically used as an input for fsink (or any fsink-like
  * pipe) to store multicat auxiliary files.
+ *
+ * In batch mode, the records of consecutive urefs are appended to a single
+ * larger block, which is output with the attributes of its first uref, so
+ * that the sink writes the aux file in big sequential chunks.
  */
 
 #ifndef _UPIPE_MODULES_UPIPE_GENAUX_H_
@@ -53,6 +57,12 @@ enum upipe_genaux_command {
 
     /** get getter (int (*)(struct uref*, uint64_t*)) */
     UPIPE_GENAUX_GET_GETATTR,
+
+    /** set batch thresholds (unsigned int, uint64_t) */
+    UPIPE_GENAUX_SET_BATCH,
+
+    /** get batch thresholds (unsigned int *, uint64_t *) */
+    UPIPE_GENAUX_GET_BATCH,
 };
 
 /** @This sets the get callback to fetch the u64 opaque with.
@@ -81,6 +91,43 @@ static inline int upipe_genaux_get_getattr(struct upipe *upipe,
                          UPIPE_GENAUX_SIGNATURE, get);
 }
 
+/** @This sets the batch thresholds. A batch is output when it holds size
+ * octets of records, when the next record falls in another window of
+ * duration (windows are aligned on multiples of duration, so that a
+ * duration dividing the multicat rotate interval never makes a batch span
+ * two files), when the dates go backwards, and when the flow definition
+ * changes or the pipe is released. Setting the thresholds outputs the
+ * pending batch.
+ *
+ * @param upipe description structure of the pipe
+ * @param size maximum size of a batch in octets, rounded down to a
+ * multiple of 8, or 0 to output one block per uref (default)
+ * @param duration duration of the batch windows in 27 MHz units, or 0
+ * for no time threshold
+ * @return an error code
+ */
+static inline int upipe_genaux_set_batch(struct upipe *upipe,
+                                         unsigned int size, uint64_t duration)
+{
+    return upipe_control(upipe, UPIPE_GENAUX_SET_BATCH,
+                         UPIPE_GENAUX_SIGNATURE, size, duration);
+}
+
+/** @This gets the batch thresholds.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the maximum size of a batch in octets
+ * @param duration_p filled in with the duration of the batch windows
+ * @return an error code
+ */
+static inline int upipe_genaux_get_batch(struct upipe *upipe,
+                                         unsigned int *size_p,
+                                         uint64_t *duration_p)
+{
+    return upipe_control(upipe, UPIPE_GENAUX_GET_BATCH,
+                         UPIPE_GENAUX_SIGNATURE, size_p, duration_p);
+}
+
 /** @This returns the management structure for genaux pipes.
  *
  * @return pointer to manager
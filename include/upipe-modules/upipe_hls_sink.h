@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module - HLS segmenter sink
+ * This sink module owns an embedded file sink and cuts the incoming
+ * transport stream into segments at random access points, once the target
+ * duration is reached. A live playlist describing the last segments is
+ * rewritten after each segment by a helper thread, so that the pipeline
+ * thread never waits for file system metadata operations.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_HLS_SINK_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_HLS_SINK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <upipe/ubase.h>
+#include <upipe/upipe.h>
+
+#define UPIPE_HLS_SINK_SIGNATURE UBASE_FOURCC('h','s','n','k')
+/** default target duration of segments (6 s) */
+#define UPIPE_HLS_SINK_DEF_DURATION UINT64_C(162000000)
+/** default number of segments in the playlist */
+#define UPIPE_HLS_SINK_DEF_WINDOW 5
+
+/** @This extends upipe_command with specific commands for HLS sink. */
+enum upipe_hls_sink_command {
+    UPIPE_HLS_SINK_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the playlist path and the segment prefix and suffix
+     * (const char *, const char *, const char *) */
+    UPIPE_HLS_SINK_SET_PATH,
+    /** get target duration of segments (uint64_t *) */
+    UPIPE_HLS_SINK_GET_DURATION,
+    /** change target duration of segments (uint64_t) */
+    UPIPE_HLS_SINK_SET_DURATION,
+    /** get number of segments in the playlist (unsigned int *) */
+    UPIPE_HLS_SINK_GET_WINDOW,
+    /** change number of segments in the playlist (unsigned int) */
+    UPIPE_HLS_SINK_SET_WINDOW,
+    /** sets fsink manager (struct upipe_mgr *) */
+    UPIPE_HLS_SINK_SET_FSINK_MGR
+};
+
+/** @This returns the management structure for hls_sink pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_hls_sink_mgr_alloc(void);
+
+/** @This sets the paths of the playlist and of the segments. Segments are
+ * written to prefix, followed by the sequence number and suffix, and are
+ * referenced in the playlist by their file name. Commands which are not
+ * handled by the HLS sink are forwarded to the embedded file sink, for
+ * instance @ref upipe_fsink_set_direct.
+ *
+ * @param upipe description structure of the pipe
+ * @param playlist path of the playlist, or NULL to close everything
+ * @param prefix path of the segments before the sequence number
+ * @param suffix path of the segments after the sequence number
+ * @return an error code
+ */
+static inline int upipe_hls_sink_set_path(struct upipe *upipe,
+                                          const char *playlist,
+                                          const char *prefix,
+                                          const char *suffix)
+{
+    return upipe_control(upipe, UPIPE_HLS_SINK_SET_PATH,
+                         UPIPE_HLS_SINK_SIGNATURE, playlist, prefix, suffix);
+}
+
+/** @This returns the target duration of segments (in 27MHz unit).
+ *
+ * @param upipe description structure of the pipe
+ * @param duration_p filled in with the target duration
+ * @return an error code
+ */
+static inline int upipe_hls_sink_get_duration(struct upipe *upipe,
+                                              uint64_t *duration_p)
+{
+    return upipe_control(upipe, UPIPE_HLS_SINK_GET_DURATION,
+                         UPIPE_HLS_SINK_SIGNATURE, duration_p);
+}
+
+/** @This changes the target duration of segments (in 27MHz unit)
+ * (default: UPIPE_HLS_SINK_DEF_DURATION). Segments are cut at the first
+ * random access point after the target duration.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration target duration
+ * @return an error code
+ */
+static inline int upipe_hls_sink_set_duration(struct upipe *upipe,
+                                              uint64_t duration)
+{
+    return upipe_control(upipe, UPIPE_HLS_SINK_SET_DURATION,
+                         UPIPE_HLS_SINK_SIGNATURE, duration);
+}
+
+/** @This returns the number of segments in the playlist.
+ *
+ * @param upipe description structure of the pipe
+ * @param window_p filled in with the number of segments
+ * @return an error code
+ */
+static inline int upipe_hls_sink_get_window(struct upipe *upipe,
+                                            unsigned int *window_p)
+{
+    return upipe_control(upipe, UPIPE_HLS_SINK_GET_WINDOW,
+                         UPIPE_HLS_SINK_SIGNATURE, window_p);
+}
+
+/** @This changes the number of segments in the playlist
+ * (default: UPIPE_HLS_SINK_DEF_WINDOW). Older segments are deleted. With 0,
+ * all segments are kept in the playlist.
+ *
+ * @param upipe description structure of the pipe
+ * @param window number of segments
+ * @return an error code
+ */
+static inline int upipe_hls_sink_set_window(struct upipe *upipe,
+                                            unsigned int window)
+{
+    return upipe_control(upipe, UPIPE_HLS_SINK_SET_WINDOW,
+                         UPIPE_HLS_SINK_SIGNATURE, window);
+}
+
+/** @This sets the fsink manager.
+ *
+ * @param upipe description structure of the pipe
+ * @param fsink_mgr fsink manager
+ * @return an error code
+ */
+static inline int upipe_hls_sink_set_fsink_mgr(struct upipe *upipe,
+                                               struct upipe_mgr *fsink_mgr)
+{
+    return upipe_control(upipe, UPIPE_HLS_SINK_SET_FSINK_MGR,
+                         UPIPE_HLS_SINK_SIGNATURE, fsink_mgr);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -37,6 +37,9 @@ extern "C" {
 
 #include <upipe/upipe.h>
 #include <upipe/uref.h>
+#include <upipe/udict.h>
+
+#include <stdint.h>
 
 #define UPIPE_MATCH_ATTR_SIGNATURE UBASE_FOURCC('m','a','t','t')
 
@@ -50,6 +53,42 @@ enum upipe_match_attr_command {
     UPIPE_MATCH_ATTR_SET_UINT64_T,
     /** set boundaries (uint64_t, uint64_t) */
     UPIPE_MATCH_ATTR_SET_BOUNDARIES,
+    /** match random access points spaced by an interval (uint64_t) */
+    UPIPE_MATCH_ATTR_SET_KEY_INTERVAL,
+    /** match a list of predicates
+     * (const struct upipe_match_attr_predicate *, unsigned int) */
+    UPIPE_MATCH_ATTR_SET_PREDICATES,
+};
+
+/** @This defines the types of values compared by predicates. */
+enum upipe_match_attr_value {
+    /** the attribute must be present, whatever its value */
+    UPIPE_MATCH_ATTR_VALUE_VOID,
+    /** bool attribute, compared as 0 or 1 */
+    UPIPE_MATCH_ATTR_VALUE_BOOL,
+    /** small unsigned attribute */
+    UPIPE_MATCH_ATTR_VALUE_SMALL_UNSIGNED,
+    /** small int attribute, compared as signed */
+    UPIPE_MATCH_ATTR_VALUE_SMALL_INT,
+    /** unsigned attribute */
+    UPIPE_MATCH_ATTR_VALUE_UNSIGNED,
+    /** int attribute, compared as signed */
+    UPIPE_MATCH_ATTR_VALUE_INT,
+};
+
+/** @This describes a predicate on an attribute of the incoming urefs. */
+struct upipe_match_attr_predicate {
+    /** type of value */
+    enum upipe_match_attr_value value;
+    /** type of the attribute, as given to uref_attr_get_* (potentially a
+     * shorthand or a registered key) */
+    enum udict_type type;
+    /** name of the attribute, or NULL for shorthands and registered keys */
+    const char *name;
+    /** minimum value (cast to int64_t for signed values) */
+    uint64_t min;
+    /** maximum value (cast to int64_t for signed values) */
+    uint64_t max;
 };
 
 /** @This sets the match callback to check uint8_t attribute with.
@@ -93,6 +132,41 @@ static inline int
                          UPIPE_MATCH_ATTR_SIGNATURE, min, max);
 }
 
+/** @This sets the pipe to only forward random access points (typically
+ * I-frames flagged by the framers), with program dates spaced by at least
+ * the given interval. Placed between a framer and a decoder, it allows to
+ * decode only one picture per interval, for instance to generate thumbnails.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval minimum interval between two forwarded urefs, in 27 MHz
+ * units (0 forwards all random access points)
+ * @return an error code
+ */
+static inline int upipe_match_attr_set_key_interval(struct upipe *upipe,
+                                                    uint64_t interval)
+{
+    return upipe_control(upipe, UPIPE_MATCH_ATTR_SET_KEY_INTERVAL,
+                         UPIPE_MATCH_ATTR_SIGNATURE, interval);
+}
+
+/** @This sets the pipe to only forward urefs matching all given
+ * predicates, each checking that an attribute is present and within
+ * [min, max]. The predicates are copied and prepared once, and are
+ * evaluated in order, stopping at the first failure, so the most
+ * selective ones should come first. This replaces any match callback.
+ *
+ * @param upipe description structure of the pipe
+ * @param predicates array of predicates
+ * @param nb number of predicates in the array (0 forwards all urefs)
+ * @return an error code
+ */
+static inline int upipe_match_attr_set_predicates(struct upipe *upipe,
+        const struct upipe_match_attr_predicate *predicates, unsigned int nb)
+{
+    return upipe_control(upipe, UPIPE_MATCH_ATTR_SET_PREDICATES,
+                         UPIPE_MATCH_ATTR_SIGNATURE, predicates, nb);
+}
+
 /** @This returns the management structure for all match_attr pipes.
  *
  * @return pointer to manager
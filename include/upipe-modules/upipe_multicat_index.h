@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe index of multicat archives
+ * A multicat index is a file of fixed-size entries, in increasing order of
+ * system dates, each giving the file index and the offset of a uref written
+ * by @ref upipe_multicat_sink. It allows to find the position of a date in
+ * an archive with a binary search, without reading the archive itself.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_MULTICAT_INDEX_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_MULTICAT_INDEX_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** size of an entry in the index file, in octets */
+#define UPIPE_MULTICAT_INDEX_SIZE 24
+
+/** @This describes an entry of a multicat index. */
+struct upipe_multicat_index_entry {
+    /** system date of the indexed uref */
+    uint64_t date;
+    /** index of the file containing the uref */
+    int64_t fileidx;
+    /** offset of the uref in the file, in octets */
+    uint64_t offset;
+    /** true if the uref is a random access point */
+    bool random;
+};
+
+/** @This appends an entry to an index file.
+ *
+ * @param fd file descriptor of the index, opened for writing
+ * @param entry entry to write
+ * @return an error code
+ */
+int upipe_multicat_index_write(int fd,
+                               const struct upipe_multicat_index_entry *entry);
+
+/** @This looks up the last entry of an index file dated before or at the
+ * given date, with a binary search.
+ *
+ * @param fd file descriptor of the index, opened for reading
+ * @param date system date to look up
+ * @param random if true, only return random access points
+ * @param entry_p filled in with the entry found
+ * @return an error code, UBASE_ERR_INVALID if no entry matches
+ */
+int upipe_multicat_index_lookup(int fd, uint64_t date, bool random,
+                                struct upipe_multicat_index_entry *entry_p);
+
+/** @This opens in a file source the file of a multicat archive containing
+ * the given date, and sets the reading position to the last random access
+ * point before it.
+ *
+ * @param fsrc description structure of the file source pipe
+ * @param index path of the index file
+ * @param dirpath directory path (or prefix) of the archive
+ * @param suffix file suffix of the archive
+ * @param date system date to seek to
+ * @return an error code
+ */
+int upipe_multicat_index_seek(struct upipe *fsrc, const char *index,
+                              const char *dirpath, const char *suffix,
+                              uint64_t date);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -26,7 +26,8 @@
 /** @file
  * @short Upipe module - multicat file sink
  * This sink module owns an embedded file sink and changes its path
- * depending on the uref k.systime attribute.
+ * depending on the uref k.systime attribute. Commands it doesn't handle,
+ * for instance @ref upipe_fsink_set_direct, are forwarded to the file sink.
  */
 
 #ifndef _UPIPE_MODULES_UPIPE_MULTICAT_SINK_H_
@@ -64,7 +65,9 @@ enum upipe_multicat_sink_command {
     /** sets fsink manager (struct upipe_fsink_mgr *) */
     UPIPE_MULTICAT_SINK_SET_FSINK_MGR,
     /** gets fsink manager (struct upipe_fsink_mgr **) */
-    UPIPE_MULTICAT_SINK_GET_FSINK_MGR
+    UPIPE_MULTICAT_SINK_GET_FSINK_MGR,
+    /** sets the index file (const char *, uint64_t) */
+    UPIPE_MULTICAT_SINK_SET_INDEX
 };
 
 /** @This returns the management structure for multicat_sink pipes.
@@ -172,6 +175,24 @@ static inline int
                                 UPIPE_MULTICAT_SINK_SIGNATURE, fsink_mgr);
 }
 
+/** @This sets the index file, where an entry is written for the first uref
+ * of each file, for each random access point, and at least every interval
+ * (in 27MHz units, 0 for none). The index is truncated if the mode is
+ * UPIPE_FSINK_OVERWRITE. @see upipe_multicat_index_lookup
+ *
+ * @param upipe description structure of the pipe
+ * @param path path of the index file, or NULL to disable the index
+ * @param interval maximum interval between two entries, or 0
+ * @return an error code
+ */
+static inline int
+    upipe_multicat_sink_set_index(struct upipe *upipe,
+                                  const char *path, uint64_t interval)
+{
+    return upipe_control(upipe, UPIPE_MULTICAT_SINK_SET_INDEX,
+                                UPIPE_MULTICAT_SINK_SIGNATURE, path, interval);
+}
+
 #ifdef __cplusplus
 }
 #endif
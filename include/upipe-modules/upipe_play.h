@@ -39,12 +39,65 @@ extern "C" {
 #define UPIPE_PLAY_SIGNATURE UBASE_FOURCC('p','l','a','y')
 #define UPIPE_PLAY_SUB_SIGNATURE UBASE_FOURCC('p','l','a','s')
 
+/** @This extends upipe_command with specific commands for play pipes. */
+enum upipe_play_command {
+    UPIPE_PLAY_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the current setting for low-latency mode (int *) */
+    UPIPE_PLAY_GET_LOW_LATENCY,
+    /** sets or unsets low-latency mode (int) */
+    UPIPE_PLAY_SET_LOW_LATENCY
+};
+
+/** @This extends uprobe_event with specific events for play pipes. */
+enum uprobe_play_event {
+    UPROBE_PLAY_SENTINEL = UPROBE_LOCAL,
+
+    /** the latency applied to all subpipes changed (uint64_t latency,
+     * uint64_t input latency, uint64_t sink latency, struct upipe *sub
+     * imposing the latency or NULL) */
+    UPROBE_PLAY_LATENCY
+};
+
 /** @This returns the management structure for all play pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_play_mgr_alloc(void);
 
+/** @This returns the current setting for low-latency mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static inline int upipe_play_get_low_latency(struct upipe *upipe, bool *val_p)
+{
+    int val;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_PLAY_GET_LOW_LATENCY,
+                               UPIPE_PLAY_SIGNATURE, &val))
+    *val_p = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets low-latency mode. By default, the latency of all
+ * subpipes is the maximum input latency plus the maximum sink latency, and
+ * is never lowered. In low-latency mode, the input and sink latencies of each
+ * subpipe are kept separate, and the latency is the maximum of their sums,
+ * following them when they are lowered. The margin of clock recovery is
+ * already part of the system dates, so that lip-sync only requires the
+ * largest budget of the subpipes.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true for low-latency mode
+ * @return an error code
+ */
+static inline int upipe_play_set_low_latency(struct upipe *upipe, bool val)
+{
+    return upipe_control(upipe, UPIPE_PLAY_SET_LOW_LATENCY,
+                         UPIPE_PLAY_SIGNATURE, val ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -55,12 +55,62 @@ extern "C" {
 
 #define UPIPE_QSINK_SIGNATURE UBASE_FOURCC('q','s','n','k')
 
+/** @This extends upipe_command with specific commands for queue sink. */
+enum upipe_qsink_command {
+    UPIPE_QSINK_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the overload policy (unsigned int *, uint64_t *) */
+    UPIPE_QSINK_GET_OVERLOAD,
+    /** sets the overload policy (unsigned int, uint64_t) */
+    UPIPE_QSINK_SET_OVERLOAD
+};
+
 /** @This returns the management structure for all queue sinks.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_qsink_mgr_alloc(void);
 
+/** @This returns the overload policy of the queue sink.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth_p filled in with the maximum number of held urefs
+ * @param deadline_p filled in with the maximum age of held urefs
+ * @return an error code
+ */
+static inline int upipe_qsink_get_overload(struct upipe *upipe,
+                                           unsigned int *depth_p,
+                                           uint64_t *deadline_p)
+{
+    return upipe_control(upipe, UPIPE_QSINK_GET_OVERLOAD,
+                         UPIPE_QSINK_SIGNATURE, depth_p, deadline_p);
+}
+
+/** @This sets the overload policy of the queue sink. By default (depth 0)
+ * the source pumps are blocked while the queue is full. Otherwise they are
+ * never blocked, and urefs are held until the queue can be written again;
+ * when more than depth urefs are held, or when the oldest held uref was
+ * received (according to its cr_sys date and the clock of the queue source)
+ * more than deadline ago, the held urefs are dropped by increasing priority
+ * (see @ref uref_priority_classify), and an @ref UPROBE_OVERLOAD_DROP event
+ * is thrown for each of them. Critical urefs are never dropped.
+ *
+ * This command may also be sent to a worker bin, which forwards it to its
+ * input queue sink.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth maximum number of held urefs, or 0 to block the sources
+ * @param deadline maximum age of held urefs in 27 MHz units, or 0
+ * @return an error code
+ */
+static inline int upipe_qsink_set_overload(struct upipe *upipe,
+                                           unsigned int depth,
+                                           uint64_t deadline)
+{
+    return upipe_control(upipe, UPIPE_QSINK_SET_OVERLOAD,
+                         UPIPE_QSINK_SIGNATURE, depth, deadline);
+}
+
 /** @hidden */
 #define ARGS_DECL , struct upipe *qsrc
 /** @hidden */
@@ -30,6 +30,12 @@
  * @table 2
  * @item queue_length @item maximum length of the queue (<= 255)
  * @end table
+ *
+ * The queue may additionally be limited in octets of block urefs; bursts
+ * exceeding the queue are then held by the queue sink, up to its own
+ * maximum length (see @ref upipe_set_max_length). With a clock, the queue
+ * source also measures the time spent in the queue by urefs, which allows to
+ * tell which thread boundary adds latency.
  */
 
 #ifndef _UPIPE_MODULES_UPIPE_QUEUE_SOURCE_H_
@@ -43,10 +49,14 @@ extern "C" {
 #include <upipe/uqueue.h>
 #include <upipe/upipe.h>
 
+#include <stdint.h>
 #include <assert.h>
 
 #define UPIPE_QSRC_SIGNATURE UBASE_FOURCC('q','s','r','c')
 
+/** @hidden */
+struct uclock;
+
 /** @This extends upipe_command with specific commands for queue source. */
 enum upipe_qsrc_command {
     UPIPE_QSRC_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -54,7 +64,27 @@ enum upipe_qsrc_command {
     /** returns the maximum length of the queue (unsigned int *) */
     UPIPE_QSRC_GET_MAX_LENGTH,
     /** returns the current length of the queue (unsigned int *) */
-    UPIPE_QSRC_GET_LENGTH
+    UPIPE_QSRC_GET_LENGTH,
+    /** returns the highest length of the queue (unsigned int *) */
+    UPIPE_QSRC_GET_HIGH_WATER,
+    /** returns the current number of octets in the queue (unsigned int *) */
+    UPIPE_QSRC_GET_OCTETS,
+    /** returns the maximum number of octets in the queue (unsigned int *) */
+    UPIPE_QSRC_GET_MAX_OCTETS,
+    /** sets the maximum number of octets in the queue (unsigned int) */
+    UPIPE_QSRC_SET_MAX_OCTETS,
+    /** sets the clock measuring the time spent in the queue
+     * (struct uclock *) */
+    UPIPE_QSRC_SET_UCLOCK,
+    /** returns the time spent in the queue by the last uref, and the highest
+     * time spent (uint64_t *, uint64_t *) */
+    UPIPE_QSRC_GET_QUEUED,
+    /** returns the length under which the queue sink is unblocked
+     * (unsigned int *) */
+    UPIPE_QSRC_GET_THRESHOLD,
+    /** sets the length under which the queue sink is unblocked
+     * (unsigned int) */
+    UPIPE_QSRC_SET_THRESHOLD
 };
 
 /** @This returns the management structure for all queue sources.
@@ -92,6 +122,127 @@ static inline int upipe_qsrc_get_length(struct upipe *upipe,
                          UPIPE_QSRC_SIGNATURE, length_p);
 }
 
+/** @This returns the highest number of urefs seen in the queue since it was
+ * allocated. It may only be called from the thread which runs the queue
+ * source pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param high_water_p filled in with the highest length of the queue
+ * @return an error code
+ */
+static inline int upipe_qsrc_get_high_water(struct upipe *upipe,
+                                            unsigned int *high_water_p)
+{
+    return upipe_control(upipe, UPIPE_QSRC_GET_HIGH_WATER,
+                         UPIPE_QSRC_SIGNATURE, high_water_p);
+}
+
+/** @This returns the current number of octets of block urefs in the queue.
+ * The value returned may no longer be valid.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets_p filled in with the current number of octets
+ * @return an error code
+ */
+static inline int upipe_qsrc_get_octets(struct upipe *upipe,
+                                        unsigned int *octets_p)
+{
+    return upipe_control(upipe, UPIPE_QSRC_GET_OCTETS,
+                         UPIPE_QSRC_SIGNATURE, octets_p);
+}
+
+/** @This returns the maximum number of octets of block urefs in the queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_octets_p filled in with the maximum number of octets, or 0
+ * @return an error code
+ */
+static inline int upipe_qsrc_get_max_octets(struct upipe *upipe,
+                                            unsigned int *max_octets_p)
+{
+    return upipe_control(upipe, UPIPE_QSRC_GET_MAX_OCTETS,
+                         UPIPE_QSRC_SIGNATURE, max_octets_p);
+}
+
+/** @This sets the maximum number of octets of block urefs in the queue, in
+ * addition to the maximum length. The queue sink is blocked when the limit
+ * is reached, whatever the number of urefs. This may only be called before
+ * the queue sink starts feeding the queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_octets maximum number of octets, or 0 for no limit
+ * @return an error code
+ */
+static inline int upipe_qsrc_set_max_octets(struct upipe *upipe,
+                                            unsigned int max_octets)
+{
+    return upipe_control(upipe, UPIPE_QSRC_SET_MAX_OCTETS,
+                         UPIPE_QSRC_SIGNATURE, max_octets);
+}
+
+/** @This sets the clock measuring the time spent in the queue by urefs. The
+ * clock must be thread-safe, as it is also read by the queue sink. This may
+ * only be called before the queue sink starts feeding the queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param uclock pointer to uclock, or NULL to disable the measure
+ * @return an error code
+ */
+static inline int upipe_qsrc_set_uclock(struct upipe *upipe,
+                                        struct uclock *uclock)
+{
+    return upipe_control(upipe, UPIPE_QSRC_SET_UCLOCK,
+                         UPIPE_QSRC_SIGNATURE, uclock);
+}
+
+/** @This returns the time spent in the queue by the last uref output, and
+ * the highest time spent by a uref, in 27 MHz units. A clock must have been
+ * set with @ref upipe_qsrc_set_uclock.
+ *
+ * @param upipe description structure of the pipe
+ * @param queued_p filled in with the time spent by the last uref (may be NULL)
+ * @param max_queued_p filled in with the highest time spent (may be NULL)
+ * @return an error code
+ */
+static inline int upipe_qsrc_get_queued(struct upipe *upipe,
+                                        uint64_t *queued_p,
+                                        uint64_t *max_queued_p)
+{
+    return upipe_control(upipe, UPIPE_QSRC_GET_QUEUED,
+                         UPIPE_QSRC_SIGNATURE, queued_p, max_queued_p);
+}
+
+/** @This returns the length under which the queue must drain before a
+ * blocked queue sink is unblocked.
+ *
+ * @param upipe description structure of the pipe
+ * @param threshold_p filled in with the threshold
+ * @return an error code
+ */
+static inline int upipe_qsrc_get_threshold(struct upipe *upipe,
+                                           unsigned int *threshold_p)
+{
+    return upipe_control(upipe, UPIPE_QSRC_GET_THRESHOLD,
+                         UPIPE_QSRC_SIGNATURE, threshold_p);
+}
+
+/** @This sets the length under which the queue must drain before a blocked
+ * queue sink is unblocked. It defaults to the maximum length of the queue;
+ * a lower value prevents the source pumps of the queue sink from being
+ * stopped and restarted for every uref, under sustained backpressure. This
+ * may only be called before the queue sink starts feeding the queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param threshold threshold, between 1 and the maximum length of the queue
+ * @return an error code
+ */
+static inline int upipe_qsrc_set_threshold(struct upipe *upipe,
+                                           unsigned int threshold)
+{
+    return upipe_control(upipe, UPIPE_QSRC_SET_THRESHOLD,
+                         UPIPE_QSRC_SIGNATURE, threshold);
+}
+
 /** @hidden */
 #define ARGS_DECL , unsigned int queue_length
 /** @hidden */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module replaying capture files
+ * This source reads a file of records written by @ref upipe_capture_mgr_alloc
+ * and outputs the urefs with their flags and payload, at the pace of their
+ * original system dates, optionally accelerated. The system date of the
+ * output urefs is the date at which they are output. Only the flow
+ * definition strings are recorded, so the other attributes of the flow
+ * definitions are not restored.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_REPLAY_SOURCE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_REPLAY_SOURCE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_REPLAYSRC_SIGNATURE UBASE_FOURCC('r','p','l','s')
+
+/** @This extends upipe_command with specific commands for replay source. */
+enum upipe_replaysrc_command {
+    UPIPE_REPLAYSRC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the replay speed (struct urational *) */
+    UPIPE_REPLAYSRC_GET_SPEED,
+    /** sets the replay speed (struct urational) */
+    UPIPE_REPLAYSRC_SET_SPEED
+};
+
+/** @This returns the management structure for all replay sources.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_replaysrc_mgr_alloc(void);
+
+/** @This returns the replay speed.
+ *
+ * @param upipe description structure of the pipe
+ * @param speed_p filled in with the speed
+ * @return an error code
+ */
+static inline int upipe_replaysrc_get_speed(struct upipe *upipe,
+                                            struct urational *speed_p)
+{
+    return upipe_control(upipe, UPIPE_REPLAYSRC_GET_SPEED,
+                         UPIPE_REPLAYSRC_SIGNATURE, speed_p);
+}
+
+/** @This sets the replay speed. The intervals between the original system
+ * dates are divided by the speed.
+ *
+ * @param upipe description structure of the pipe
+ * @param speed new speed (1/1 = original timing, default, 0 = as fast as
+ * possible)
+ * @return an error code
+ */
+static inline int upipe_replaysrc_set_speed(struct upipe *upipe,
+                                            struct urational speed)
+{
+    return upipe_control(upipe, UPIPE_REPLAYSRC_SET_SPEED,
+                         UPIPE_REPLAYSRC_SIGNATURE, speed);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
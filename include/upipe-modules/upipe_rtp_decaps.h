@@ -25,6 +25,12 @@
 
 /** @file
  * @short Upipe module decapsulating RTP header from blocks
+ *
+ * When a reorder window is set, out-of-order packets are put back in
+ * sequence, and lost packets may be recovered from SMPTE 2022-1 FEC packets
+ * (column or row streams) fed to subpipes allocated with
+ * @ref upipe_void_alloc_sub. FEC recovery requires a reorder window at least
+ * as large as the FEC matrix.
  */
 
 #ifndef _UPIPE_MODULES_UPIPE_RTP_DECAPS_H_
@@ -37,6 +43,48 @@ extern "C" {
 #include <upipe/upipe.h>
 
 #define UPIPE_RTPD_SIGNATURE UBASE_FOURCC('r','t','p','d')
+#define UPIPE_RTPD_FEC_SIGNATURE UBASE_FOURCC('r','t','p','f')
+
+/** maximum reorder window, in packets */
+#define UPIPE_RTPD_MAX_REORDER 256
+
+/** @This extends upipe_command with specific commands for rtpd pipes. */
+enum upipe_rtpd_command {
+    UPIPE_RTPD_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the reorder window (unsigned int *) */
+    UPIPE_RTPD_GET_REORDER,
+    /** sets the reorder window (unsigned int) */
+    UPIPE_RTPD_SET_REORDER,
+};
+
+/** @This returns the reorder window.
+ *
+ * @param upipe description structure of the pipe
+ * @param reorder_p filled in with the reorder window, in packets
+ * @return an error code
+ */
+static inline int upipe_rtpd_get_reorder(struct upipe *upipe,
+                                         unsigned int *reorder_p)
+{
+    return upipe_control(upipe, UPIPE_RTPD_GET_REORDER, UPIPE_RTPD_SIGNATURE,
+                         reorder_p);
+}
+
+/** @This sets the reorder window. A packet is considered lost when
+ * this number of packets following it were received. 0 disables
+ * reordering (default).
+ *
+ * @param upipe description structure of the pipe
+ * @param reorder reorder window, in packets
+ * @return an error code
+ */
+static inline int upipe_rtpd_set_reorder(struct upipe *upipe,
+                                         unsigned int reorder)
+{
+    return upipe_control(upipe, UPIPE_RTPD_SET_REORDER, UPIPE_RTPD_SIGNATURE,
+                         reorder);
+}
 
 /** @This returns the management structure for rtpd pipes.
  *
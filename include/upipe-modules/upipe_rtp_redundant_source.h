@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Bin pipe merging redundant RTP streams (SMPTE 2022-7)
+ * Each copy of the stream is received by a leg subpipe, typically fed by a
+ * UDP source allocated with @ref upipe_rtpr_add_uri. Packets of all legs are
+ * merged by sequence number in an inner rtpd pipe, which keeps the first copy
+ * of each packet. The dedup window is the reorder window of the rtpd pipe,
+ * which may be changed with @ref upipe_rtpd_set_reorder on the bin pipe, and
+ * must cover the maximum differential delay between legs.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_RTP_REDUNDANT_SOURCE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_RTP_REDUNDANT_SOURCE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_RTPR_SIGNATURE UBASE_FOURCC('r','t','p','r')
+#define UPIPE_RTPR_LEG_SIGNATURE UBASE_FOURCC('r','t','p','l')
+
+/** default dedup window, in packets */
+#define UPIPE_RTPR_DEF_WINDOW 64
+
+/** @This extends upipe_command with specific commands for rtpr pipes. */
+enum upipe_rtpr_command {
+    UPIPE_RTPR_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** adds a leg receiving from the given URI (const char *) */
+    UPIPE_RTPR_ADD_URI,
+};
+
+/** @This extends upipe_command with specific commands for rtpr legs. */
+enum upipe_rtpr_leg_command {
+    UPIPE_RTPR_LEG_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the counters of the leg (uint64_t *, uint64_t *) */
+    UPIPE_RTPR_LEG_GET_STATS,
+};
+
+/** @This extends uprobe_event with specific events for rtpr legs. */
+enum uprobe_rtpr_event {
+    UPROBE_RTPR_SENTINEL = UPROBE_LOCAL,
+
+    /** packets were lost on a leg (uint64_t lost, uint64_t total lost) */
+    UPROBE_RTPR_LEG_LOSS,
+};
+
+/** @This returns the management structure for all rtpr pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtpr_mgr_alloc(void);
+
+/** @This adds a leg receiving the stream from the given URI, with a UDP
+ * source. @ref upipe_set_uri may also be used to replace all such legs
+ * with a single one.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri URI of the UDP source
+ * @return an error code
+ */
+static inline int upipe_rtpr_add_uri(struct upipe *upipe, const char *uri)
+{
+    return upipe_control(upipe, UPIPE_RTPR_ADD_URI, UPIPE_RTPR_SIGNATURE, uri);
+}
+
+/** @This returns the counters of a leg.
+ *
+ * @param upipe description structure of the leg
+ * @param received_p filled in with the number of packets received
+ * @param lost_p filled in with the number of packets lost
+ * @return an error code
+ */
+static inline int upipe_rtpr_leg_get_stats(struct upipe *upipe,
+                                           uint64_t *received_p,
+                                           uint64_t *lost_p)
+{
+    return upipe_control(upipe, UPIPE_RTPR_LEG_GET_STATS,
+                         UPIPE_RTPR_LEG_SIGNATURE, received_p, lost_p);
+}
+
+/** @This extends upipe_mgr_command with specific commands for rtpr. */
+enum upipe_rtpr_mgr_command {
+    UPIPE_RTPR_MGR_SENTINEL = UPIPE_MGR_CONTROL_LOCAL,
+
+/** @hidden */
+#define UPIPE_RTPR_MGR_GET_SET_MGR(name, NAME)                              \
+    /** returns the current manager for name inner pipes                    \
+     * (struct upipe_mgr **) */                                             \
+    UPIPE_RTPR_MGR_GET_##NAME##_MGR,                                        \
+    /** sets the manager for name inner pipes (struct upipe_mgr *) */       \
+    UPIPE_RTPR_MGR_SET_##NAME##_MGR,
+
+    UPIPE_RTPR_MGR_GET_SET_MGR(udpsrc, UDPSRC)
+    UPIPE_RTPR_MGR_GET_SET_MGR(rtpd, RTPD)
+#undef UPIPE_RTPR_MGR_GET_SET_MGR
+};
+
+/** @hidden */
+#define UPIPE_RTPR_MGR_GET_SET_MGR2(name, NAME)                             \
+/** @This returns the current manager for name inner pipes.                 \
+ *                                                                          \
+ * @param mgr pointer to manager                                            \
+ * @param p filled in with the name manager                                 \
+ * @return an error code                                                    \
+ */                                                                         \
+static inline int                                                           \
+    upipe_rtpr_mgr_get_##name##_mgr(struct upipe_mgr *mgr,                  \
+                                    struct upipe_mgr **p)                   \
+{                                                                           \
+    return upipe_mgr_control(mgr, UPIPE_RTPR_MGR_GET_##NAME##_MGR,          \
+                             UPIPE_RTPR_SIGNATURE, p);                      \
+}                                                                           \
+/** @This sets the manager for name inner pipes. This may only be called    \
+ * before any pipe has been allocated.                                      \
+ *                                                                          \
+ * @param mgr pointer to manager                                            \
+ * @param m pointer to name manager                                         \
+ * @return an error code                                                    \
+ */                                                                         \
+static inline int                                                           \
+    upipe_rtpr_mgr_set_##name##_mgr(struct upipe_mgr *mgr,                  \
+                                    struct upipe_mgr *m)                    \
+{                                                                           \
+    return upipe_mgr_control(mgr, UPIPE_RTPR_MGR_SET_##NAME##_MGR,          \
+                             UPIPE_RTPR_SIGNATURE, m);                      \
+}
+
+UPIPE_RTPR_MGR_GET_SET_MGR2(udpsrc, UDPSRC)
+UPIPE_RTPR_MGR_GET_SET_MGR2(rtpd, RTPD)
+#undef UPIPE_RTPR_MGR_GET_SET_MGR2
+
+#ifdef __cplusplus
+}
+#endif
+#endif
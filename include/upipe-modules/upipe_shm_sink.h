@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe sink module passing urefs to another process through shared
+ * memory
+ *
+ * The sink passes block and picture urefs to a @ref upipe_shmsrc_alloc pipe
+ * in another process, over a connected SOCK_SEQPACKET unix socket. Buffers
+ * allocated in the arena of the umem shm manager are passed by reference,
+ * without copy; the sink answers ubuf manager requests with managers
+ * allocating from the arena, so that upstream pipes directly write into
+ * shared memory. Other buffers, and buffers which are also used elsewhere in
+ * the process, are copied into the arena.
+ *
+ * References held by messages which are never received, or by a process
+ * which dies, are lost for the lifetime of the arena.
+ *
+ * Note that the allocator requires additional parameters:
+ * @table 2
+ * @item umem_mgr @item pointer to a umem shm manager
+ * (@ref umem_shm_mgr_alloc)
+ * @item fd @item connected SOCK_SEQPACKET socket, which belongs to the pipe
+ * afterwards
+ * @end table
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_SHM_SINK_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_SHM_SINK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_SHMSINK_SIGNATURE UBASE_FOURCC('s','h','m','k')
+
+/** @hidden */
+struct umem_mgr;
+
+/** @This returns the management structure for all shared memory sinks.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_shmsink_mgr_alloc(void);
+
+/** @hidden */
+#define ARGS_DECL , struct umem_mgr *umem_mgr, int fd
+/** @hidden */
+#define ARGS , umem_mgr, fd
+UPIPE_HELPER_ALLOC(shmsink, UPIPE_SHMSINK_SIGNATURE)
+#undef ARGS
+#undef ARGS_DECL
+
+#ifdef __cplusplus
+}
+#endif
+#endif
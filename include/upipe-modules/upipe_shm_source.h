@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module receiving urefs from another process through
+ * shared memory
+ *
+ * The source receives the urefs sent by a @ref upipe_shmsink_alloc pipe in
+ * another process, over a connected SOCK_SEQPACKET unix socket, and
+ * attaches to the arena announced by the sink. Output buffers point to the
+ * shared memory, and are released to the arena when they are freed.
+ *
+ * Note that the allocator requires an additional parameter:
+ * @table 2
+ * @item fd @item connected SOCK_SEQPACKET socket, which belongs to the pipe
+ * afterwards
+ * @end table
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_SHM_SOURCE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_SHM_SOURCE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_SHMSRC_SIGNATURE UBASE_FOURCC('s','h','m','s')
+
+/** @This returns the management structure for all shared memory sources.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_shmsrc_mgr_alloc(void);
+
+/** @hidden */
+#define ARGS_DECL , int fd
+/** @hidden */
+#define ARGS , fd
+UPIPE_HELPER_ALLOC(shmsrc, UPIPE_SHMSRC_SIGNATURE)
+#undef ARGS
+#undef ARGS_DECL
+
+#ifdef __cplusplus
+}
+#endif
+#endif
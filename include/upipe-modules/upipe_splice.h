@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module splicing coded elementary streams
+ *
+ * This pipe switches its output between several inputs carrying the same
+ * elementary stream of different sources, for instance a program and an ad,
+ * without decoding them. It is placed between the framers (for instance the
+ * outputs of a ts_demux) and an encapsulation (for instance an input of a
+ * ts_mux), one pipe per elementary stream.
+ *
+ * A splice is scheduled on the input which is to become current, with the
+ * splice time of the current input, in the same unit as its original
+ * timestamps (for the transport stream, the PTS of a SCTE-35 splice_insert,
+ * with the pts_adjustment, in 27 MHz units). The current input is output
+ * until its first random access point whose original PTS reaches the splice
+ * time, then the next input is output from its next random access point.
+ * The program timestamps of the next input are shifted so that they follow
+ * those of the previous input, and the encapsulation generates the clock
+ * references accordingly; system timestamps are left untouched.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_SPLICE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_SPLICE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_SPLICE_SIGNATURE UBASE_FOURCC('s','p','l','c')
+#define UPIPE_SPLICE_SUB_SIGNATURE UBASE_FOURCC('s','p','l','i')
+
+/** @This extends upipe_command with specific commands for splice pipes. */
+enum upipe_splice_command {
+    UPIPE_SPLICE_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the current input subpipe (struct upipe **) */
+    UPIPE_SPLICE_GET_CURRENT_INPUT
+};
+
+/** @This extends upipe_command with specific commands for splice subpipes. */
+enum upipe_splice_sub_command {
+    UPIPE_SPLICE_SUB_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** schedules the subpipe as the next input (uint64_t) */
+    UPIPE_SPLICE_SUB_SET_INPUT
+};
+
+/** @This returns the current input subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param input_p filled in with the current input, or NULL
+ * @return an error code
+ */
+static inline int upipe_splice_get_current_input(struct upipe *upipe,
+                                                 struct upipe **input_p)
+{
+    return upipe_control(upipe, UPIPE_SPLICE_GET_CURRENT_INPUT,
+                         UPIPE_SPLICE_SIGNATURE, input_p);
+}
+
+/** @This schedules a splice to the given subpipe. If there is no current
+ * input, the subpipe becomes current at its next random access point.
+ * Scheduling another input cancels the pending splice.
+ *
+ * @param upipe description structure of the subpipe
+ * @param splice_pts splice time in the original PTS of the current input,
+ * or 0 to splice at the next random access point
+ * @return an error code
+ */
+static inline int upipe_splice_sub_set_input(struct upipe *upipe,
+                                             uint64_t splice_pts)
+{
+    return upipe_control(upipe, UPIPE_SPLICE_SUB_SET_INPUT,
+                         UPIPE_SPLICE_SUB_SIGNATURE, splice_pts);
+}
+
+/** @This returns the management structure for all splice pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_splice_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
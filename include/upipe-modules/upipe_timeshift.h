@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module keeping a time-shift window of a block flow
+ *
+ * The last octets of the flow are kept in a contiguous ring in RAM, and each
+ * completed chunk of the ring is written to a second, larger ring on disk,
+ * with O_DIRECT when the file system supports it. An index of the system
+ * dates of the received urefs allows readers (subpipes) to seek back to any
+ * point of the window; they are served from RAM if the data is still there,
+ * and otherwise from a read-only mapping of the disk ring.
+ *
+ * Readers are clocked by the input: on each incoming uref, they output the
+ * urefs whose date plus their delay is in the past, with their system
+ * dates shifted by the delay. A reader with no delay is handed the incoming
+ * uref itself, without any copy.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_TIMESHIFT_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_TIMESHIFT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_TIMESHIFT_SIGNATURE UBASE_FOURCC('t','s','h','f')
+#define UPIPE_TIMESHIFT_SUB_SIGNATURE UBASE_FOURCC('t','s','h','s')
+
+/** @This extends upipe_command with specific commands for timeshift pipes. */
+enum upipe_timeshift_command {
+    UPIPE_TIMESHIFT_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** opens the buffers (const char *, uint64_t, uint64_t, uint64_t) */
+    UPIPE_TIMESHIFT_OPEN,
+    /** returns the dates of the window (uint64_t *, uint64_t *) */
+    UPIPE_TIMESHIFT_GET_RANGE
+};
+
+/** @This opens the buffers of a timeshift pipe, discarding the current
+ * window if any. Readers are moved back to live.
+ *
+ * @param upipe description structure of the pipe
+ * @param path path of the disk ring, created or truncated (the index is
+ * kept in RAM)
+ * @param ram_size size of the ring in RAM, in octets, rounded up to a
+ * multiple of 64 KiB, and at least 128 KiB
+ * @param disk_size size of the ring on disk, in octets, rounded up to a
+ * multiple of 64 KiB, and at least ram_size
+ * @param nb_entries number of urefs in the index, which bounds the window
+ * @return an error code
+ */
+static inline int upipe_timeshift_open(struct upipe *upipe, const char *path,
+                                       uint64_t ram_size, uint64_t disk_size,
+                                       uint64_t nb_entries)
+{
+    return upipe_control(upipe, UPIPE_TIMESHIFT_OPEN,
+                         UPIPE_TIMESHIFT_SIGNATURE, path, ram_size, disk_size,
+                         nb_entries);
+}
+
+/** @This returns the system dates of the oldest uref still in the window,
+ * and of the last received uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param start_p filled in with the date of the oldest uref
+ * @param end_p filled in with the date of the last uref
+ * @return an error code, UBASE_ERR_INVALID if the window is empty
+ */
+static inline int upipe_timeshift_get_range(struct upipe *upipe,
+                                            uint64_t *start_p,
+                                            uint64_t *end_p)
+{
+    return upipe_control(upipe, UPIPE_TIMESHIFT_GET_RANGE,
+                         UPIPE_TIMESHIFT_SIGNATURE, start_p, end_p);
+}
+
+/** @This extends upipe_command with specific commands for timeshift
+ * readers. */
+enum upipe_timeshift_sub_command {
+    UPIPE_TIMESHIFT_SUB_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** seeks to the given system date (uint64_t) */
+    UPIPE_TIMESHIFT_SUB_SEEK,
+    /** returns the current delay (uint64_t *) */
+    UPIPE_TIMESHIFT_SUB_GET_DELAY
+};
+
+/** @This moves a reader to the given system date of the window: the next
+ * output uref is the last random access point dated at or before it if
+ * random access flags are available, or the first uref dated at or after
+ * it otherwise. Dates outside of the window are clamped to it, and
+ * UINT64_MAX goes back to live.
+ *
+ * @param upipe description structure of the subpipe
+ * @param date system date to seek to
+ * @return an error code
+ */
+static inline int upipe_timeshift_sub_seek(struct upipe *upipe, uint64_t date)
+{
+    return upipe_control(upipe, UPIPE_TIMESHIFT_SUB_SEEK,
+                         UPIPE_TIMESHIFT_SUB_SIGNATURE, date);
+}
+
+/** @This returns the delay of a reader relative to the live flow.
+ *
+ * @param upipe description structure of the subpipe
+ * @param delay_p filled in with the delay, in 27 MHz units
+ * @return an error code
+ */
+static inline int upipe_timeshift_sub_get_delay(struct upipe *upipe,
+                                                uint64_t *delay_p)
+{
+    return upipe_control(upipe, UPIPE_TIMESHIFT_SUB_GET_DELAY,
+                         UPIPE_TIMESHIFT_SUB_SIGNATURE, delay_p);
+}
+
+/** @This returns the management structure for all timeshift pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_timeshift_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -46,7 +46,15 @@ enum upipe_trickp_command {
     /** returns the current playing rate (struct urational *) */
     UPIPE_TRICKP_GET_RATE,
     /** sets the playing rate (struct urational) */
-    UPIPE_TRICKP_SET_RATE
+    UPIPE_TRICKP_SET_RATE,
+    /** returns true if the pipe is unpaced (int *) */
+    UPIPE_TRICKP_GET_UNPACED,
+    /** sets the pipe unpaced (int) */
+    UPIPE_TRICKP_SET_UNPACED,
+    /** returns the program of a subpipe (uint64_t *) */
+    UPIPE_TRICKP_SUB_GET_PROGRAM,
+    /** sets the program of a subpipe (uint64_t) */
+    UPIPE_TRICKP_SUB_SET_PROGRAM
 };
 
 /** @This returns the management structure for all trickp pipes.
@@ -81,6 +89,64 @@ static inline int upipe_trickp_set_rate(struct upipe *upipe,
                          UPIPE_TRICKP_SIGNATURE, rate);
 }
 
+/** @This returns whether the pipe is unpaced.
+ *
+ * @param upipe description structure of the pipe
+ * @param unpaced_p filled with true if the pipe is unpaced
+ * @return an error code
+ */
+static inline int upipe_trickp_get_unpaced(struct upipe *upipe,
+                                           int *unpaced_p)
+{
+    return upipe_control(upipe, UPIPE_TRICKP_GET_UNPACED,
+                         UPIPE_TRICKP_SIGNATURE, unpaced_p);
+}
+
+/** @This sets the pipe unpaced. In this mode, buffers are forwarded as soon
+ * as they are received, with their system dates set to the current time if
+ * a uclock is available, so that processing is only limited by the
+ * throughput of the pipeline and its flow control, as is suitable for file
+ * transcoding. Pause (rate 0) is still honoured.
+ *
+ * @param upipe description structure of the pipe
+ * @param unpaced true to forward buffers without pacing
+ * @return an error code
+ */
+static inline int upipe_trickp_set_unpaced(struct upipe *upipe, int unpaced)
+{
+    return upipe_control(upipe, UPIPE_TRICKP_SET_UNPACED,
+                         UPIPE_TRICKP_SIGNATURE, unpaced);
+}
+
+/** @This returns the program of a subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ * @param program_p filled with the program
+ * @return an error code
+ */
+static inline int upipe_trickp_sub_get_program(struct upipe *upipe,
+                                               uint64_t *program_p)
+{
+    return upipe_control(upipe, UPIPE_TRICKP_SUB_GET_PROGRAM,
+                         UPIPE_TRICKP_SUB_SIGNATURE, program_p);
+}
+
+/** @This sets the program of a subpipe. Subpipes of the same program share
+ * the same mapping between timestamps and system dates, while each program
+ * gets its own mapping, started as soon as all its subpipes have received
+ * data (default 0).
+ *
+ * @param upipe description structure of the subpipe
+ * @param program program of the subpipe
+ * @return an error code
+ */
+static inline int upipe_trickp_sub_set_program(struct upipe *upipe,
+                                               uint64_t program)
+{
+    return upipe_control(upipe, UPIPE_TRICKP_SUB_SET_PROGRAM,
+                         UPIPE_TRICKP_SUB_SIGNATURE, program);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module receiving udp datagrams from a packet ring
+ *
+ * This source reads all IPv4 traffic of a network interface from a
+ * memory-mapped TPACKET_V3 ring of a packet socket, and demultiplexes the
+ * udp datagrams by destination address and port to its output subpipes.
+ * It replaces one udp source per multicast group when receiving hundreds
+ * of them: the kernel fills whole blocks of datagrams, which are read with
+ * one wake-up and no system call, and the payloads are not copied but
+ * handed to the outputs as block ubufs pointing to the ring.
+ *
+ * The uri of the pipe is the name of the interface, optionally followed by
+ * options separated by slashes, as in
+ * "eth0/blocks=64/block_size=1048576/timeout=10/fanout=1":
+ * @list
+ * @item blocks: number of blocks of the ring (default 64)
+ * @item block_size: size of a block in octets, a multiple of the page size
+ * (default 1 MiB)
+ * @item timeout: time in milliseconds after which a block which is not full
+ * is handed to the pipe (default 10)
+ * @item fanout: identifier of a fanout group spreading the traffic between
+ * the pipes joining it by receive queue of the interface, so that each
+ * queue is read by a pipe in its own thread (default none)
+ * @end list
+ *
+ * The uri of each output subpipe uses the syntax of @ref upipe_udpsrc, for
+ * instance "@239.1.1.1:1234/ifname=eth0". A udp socket is opened with it,
+ * so that the group is joined, but it never queues datagrams. The output
+ * receives the datagrams sent to its bound address and port, or to its port
+ * on any address if it is bound to the wildcard address.
+ *
+ * A ring block is given back to the kernel when all ubufs pointing to it
+ * are released, so the urefs should not be kept for long: the kernel drops
+ * the datagrams when it finds the next block still in use. IP fragments,
+ * IPv6 and outgoing packets are ignored, and udp checksums are not
+ * verified.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_UDP_RING_SOURCE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_UDP_RING_SOURCE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_RINGSRC_SIGNATURE UBASE_FOURCC('r','s','r','c')
+#define UPIPE_RINGSRC_OUTPUT_SIGNATURE UBASE_FOURCC('r','s','r','o')
+
+/** @This returns the management structure for all udp ring sources.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ringsrc_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
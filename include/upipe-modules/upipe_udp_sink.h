@@ -26,6 +26,12 @@
 
 /** @file
  * @short Upipe sink module for udp
+ *
+ * Blocks carrying the segment_size attribute (see
+ * @ref upipe_chunk_stream_set_segments) are sent as one message with UDP
+ * segmentation offload when the socket supports it, and there is no
+ * batching, additional destination or launch time. Otherwise they are
+ * split into datagrams of segment_size octets.
  */
 
 #ifndef _UPIPE_MODULES_UPIPE_UDP_SINK_H_
@@ -37,6 +43,8 @@ extern "C" {
 
 #include <upipe/upipe.h>
 
+#include <time.h>
+
 #define UPIPE_UDPSINK_SIGNATURE UBASE_FOURCC('u','s','n','k')
 
 /** @This defines udp opening modes. */
@@ -45,6 +53,18 @@ enum upipe_udpsink_mode {
     UPIPE_UDPSINK_NONE = 0,
 };
 
+/** @This defines the ways datagrams are paced in live mode. */
+enum upipe_udpsink_pacing {
+    /** wait for the date of each datagram with a timer of the event loop */
+    UPIPE_UDPSINK_PACING_TIMER = 0,
+    /** wake up a margin before the date of each datagram, and busy-wait
+     * until the date */
+    UPIPE_UDPSINK_PACING_SPIN,
+    /** hand datagrams to the kernel in advance with their launch time
+     * (SO_TXTIME), to be sent by the qdisc or network interface */
+    UPIPE_UDPSINK_PACING_TXTIME
+};
+
 /** @This extends upipe_command with specific commands for udp sink. */
 enum upipe_udpsink_command {
     UPIPE_UDPSINK_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -52,7 +72,29 @@ enum upipe_udpsink_command {
     /** returns the uri of the currently opened udp (const char **) */
     UPIPE_UDPSINK_GET_URI,
     /** asks to open the given uri (const char *, enum upipe_udpsink_mode) */
-    UPIPE_UDPSINK_SET_URI
+    UPIPE_UDPSINK_SET_URI,
+    /** returns the batching parameters (unsigned int *, uint64_t *) */
+    UPIPE_UDPSINK_GET_BATCH,
+    /** sets the batching parameters (unsigned int, uint64_t) */
+    UPIPE_UDPSINK_SET_BATCH,
+    /** returns the pacing mode (enum upipe_udpsink_pacing *, uint64_t *) */
+    UPIPE_UDPSINK_GET_PACING,
+    /** sets the pacing mode (enum upipe_udpsink_pacing, uint64_t) */
+    UPIPE_UDPSINK_SET_PACING,
+    /** returns and resets the inter-packet jitter (uint64_t *, uint64_t *) */
+    UPIPE_UDPSINK_GET_JITTER,
+    /** adds a destination to the datagrams (const char *) */
+    UPIPE_UDPSINK_ADD_DESTINATION,
+    /** removes a destination of the datagrams (const char *) */
+    UPIPE_UDPSINK_DEL_DESTINATION,
+    /** returns the overload policy (unsigned int *, uint64_t *) */
+    UPIPE_UDPSINK_GET_OVERLOAD,
+    /** sets the overload policy (unsigned int, uint64_t) */
+    UPIPE_UDPSINK_SET_OVERLOAD,
+    /** returns the clock of the launch times (clockid_t *) */
+    UPIPE_UDPSINK_GET_TXTIME_CLOCK,
+    /** sets the clock of the launch times (clockid_t) */
+    UPIPE_UDPSINK_SET_TXTIME_CLOCK
 };
 
 /** @This returns the management structure for all udp sinks.
@@ -89,6 +131,201 @@ static inline int upipe_udpsink_set_uri(struct upipe *upipe,
                          uri, mode);
 }
 
+/** @This returns the batching parameters.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch_p filled in with the maximum number of datagrams per system
+ * call
+ * @param tolerance_p filled in with the maximum advance of a datagram on its
+ * date, in units of clock ticks
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_batch(struct upipe *upipe,
+                                          unsigned int *batch_p,
+                                          uint64_t *tolerance_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_GET_BATCH,
+                         UPIPE_UDPSINK_SIGNATURE, batch_p, tolerance_p);
+}
+
+/** @This sets the batching parameters. With a batch greater than 1, datagrams
+ * are queued and sent with a single sendmmsg() call, either when the queue is
+ * full, when the sink has to wait for the date of the next datagram, or on
+ * the next iteration of the event loop. In live mode, a datagram may be sent
+ * up to tolerance ticks before its date so that it joins the current burst;
+ * a tolerance of 0 keeps the timing precision of the unbatched mode.
+ * The default is a batch of 1, which does one writev() per datagram.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch maximum number of datagrams per system call
+ * @param tolerance maximum advance of a datagram on its date, in units of
+ * clock ticks
+ * @return an error code
+ */
+static inline int upipe_udpsink_set_batch(struct upipe *upipe,
+                                          unsigned int batch,
+                                          uint64_t tolerance)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_SET_BATCH,
+                         UPIPE_UDPSINK_SIGNATURE, batch, tolerance);
+}
+
+/** @This returns the pacing mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param pacing_p filled in with the pacing mode
+ * @param advance_p filled in with the spin margin or the launch time
+ * horizon, in units of clock ticks
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_pacing(struct upipe *upipe,
+                                           enum upipe_udpsink_pacing *pacing_p,
+                                           uint64_t *advance_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_GET_PACING,
+                         UPIPE_UDPSINK_SIGNATURE, pacing_p, advance_p);
+}
+
+/** @This sets the pacing mode, used in live mode. In spin mode, the sink
+ * wakes up advance ticks before the date of a datagram, waits again with
+ * the timer until 50 us before the date, and busy-waits until the date,
+ * which bypasses batching; it is best used with the sink running in its own
+ * thread (see upipe_wsink). In txtime mode, datagrams are handed to the
+ * kernel up to advance ticks before their date, with a launch time derived
+ * from the date in the clock set by @ref upipe_udpsink_set_txtime_clock,
+ * and a qdisc supporting it (fq or etf).
+ *
+ * @param upipe description structure of the pipe
+ * @param pacing pacing mode
+ * @param advance spin margin or launch time horizon, in units of clock ticks
+ * @return an error code
+ */
+static inline int upipe_udpsink_set_pacing(struct upipe *upipe,
+                                           enum upipe_udpsink_pacing pacing,
+                                           uint64_t advance)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_SET_PACING,
+                         UPIPE_UDPSINK_SIGNATURE, pacing, advance);
+}
+
+/** @This returns the clock of the launch times.
+ *
+ * @param upipe description structure of the pipe
+ * @param clock_p filled in with the clock of the launch times
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_txtime_clock(struct upipe *upipe,
+                                                 clockid_t *clock_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_GET_TXTIME_CLOCK,
+                         UPIPE_UDPSINK_SIGNATURE, clock_p);
+}
+
+/** @This sets the clock of the launch times in txtime mode. The dates of
+ * the datagrams are converted from the uclock to this clock when they are
+ * handed to the kernel. The fq qdisc expects CLOCK_MONOTONIC, which is the
+ * default, and the etf qdisc the clock it was configured with, usually
+ * CLOCK_TAI.
+ *
+ * @param upipe description structure of the pipe
+ * @param clock clock of the launch times
+ * @return an error code
+ */
+static inline int upipe_udpsink_set_txtime_clock(struct upipe *upipe,
+                                                 clockid_t clock)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_SET_TXTIME_CLOCK,
+                         UPIPE_UDPSINK_SIGNATURE, clock);
+}
+
+/** @This returns the inter-packet jitter achieved since the last call, that
+ * is the difference between the interval separating two consecutive
+ * datagrams when they were sent and the interval between their dates, and
+ * resets it. It is only measured in live mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param mean_p filled in with the mean jitter, in units of clock ticks
+ * @param max_p filled in with the maximum jitter, in units of clock ticks
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_jitter(struct upipe *upipe,
+                                           uint64_t *mean_p, uint64_t *max_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_GET_JITTER,
+                         UPIPE_UDPSINK_SIGNATURE, mean_p, max_p);
+}
+
+/** @This adds a destination to which all datagrams are also sent, on the
+ * socket opened with @ref upipe_udpsink_set_uri, which must not be a RAW
+ * socket. The datagrams are sent to all destinations with a single
+ * sendmmsg() call, and with the pacing and batching of the pipe, so that
+ * fanning out a flow to many receivers costs neither one pipe, socket and
+ * timer per receiver, nor one system call per receiver and datagram.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination uri, of the form host:port
+ * @return an error code
+ */
+static inline int upipe_udpsink_add_destination(struct upipe *upipe,
+                                                const char *uri)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_ADD_DESTINATION,
+                         UPIPE_UDPSINK_SIGNATURE, uri);
+}
+
+/** @This removes a destination previously added with
+ * @ref upipe_udpsink_add_destination.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination uri, as given when it was added
+ * @return an error code
+ */
+static inline int upipe_udpsink_del_destination(struct upipe *upipe,
+                                                const char *uri)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_DEL_DESTINATION,
+                         UPIPE_UDPSINK_SIGNATURE, uri);
+}
+
+/** @This returns the overload policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth_p filled in with the maximum number of held datagrams
+ * @param deadline_p filled in with the maximum lateness of held datagrams
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_overload(struct upipe *upipe,
+                                             unsigned int *depth_p,
+                                             uint64_t *deadline_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_GET_OVERLOAD,
+                         UPIPE_UDPSINK_SIGNATURE, depth_p, deadline_p);
+}
+
+/** @This sets the overload policy. By default (depth 0) the source pumps
+ * are blocked while datagrams wait for their date or for the socket.
+ * Otherwise they are never blocked, which is only suitable for live
+ * sources, and when more than depth datagrams are held, or when the oldest
+ * held datagram is late by more than deadline (in live mode), the held
+ * datagrams are dropped by increasing priority (see
+ * @ref uref_priority_classify), and an @ref UPROBE_OVERLOAD_DROP event is
+ * thrown for each of them. The datagrams are classified by their own
+ * attributes only.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth maximum number of held datagrams, or 0 to block the sources
+ * @param deadline maximum lateness of held datagrams, in units of clock
+ * ticks, or 0
+ * @return an error code
+ */
+static inline int upipe_udpsink_set_overload(struct upipe *upipe,
+                                             unsigned int depth,
+                                             uint64_t deadline)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_SET_OVERLOAD,
+                         UPIPE_UDPSINK_SIGNATURE, depth, deadline);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,10 @@
 
 /** @file
  * @short Upipe source module for udp sockets
+ *
+ * In live mode, datagrams also carry their ingress date, so that the
+ * end-to-end latency of the pipeline may be measured downstream with
+ * @ref upipe_stats_enable, provided the uclock is the monotonic system clock.
  */
 
 #ifndef _UPIPE_MODULES_UPIPE_UDP_SOURCE_H_
@@ -39,12 +43,167 @@ extern "C" {
 
 #define UPIPE_UDPSRC_SIGNATURE UBASE_FOURCC('u','s','r','c')
 
+/** @This defines the sources of receive timestamps. */
+enum upipe_udpsrc_timestamp {
+    /** date datagrams with the time at which they are read */
+    UPIPE_UDPSRC_TIMESTAMP_NONE = 0,
+    /** date datagrams with the kernel receive time (SO_TIMESTAMPNS) */
+    UPIPE_UDPSRC_TIMESTAMP_SOFTWARE,
+    /** date datagrams with the network interface receive time, falling back
+     * to the kernel receive time (SO_TIMESTAMPING) */
+    UPIPE_UDPSRC_TIMESTAMP_HARDWARE
+};
+
+/** @This extends upipe_command with specific commands for udp source. */
+enum upipe_udpsrc_command {
+    UPIPE_UDPSRC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of datagrams read per wake-up (unsigned int *) */
+    UPIPE_UDPSRC_GET_BATCH,
+    /** sets the number of datagrams read per wake-up (unsigned int) */
+    UPIPE_UDPSRC_SET_BATCH,
+    /** returns the source of receive timestamps
+     * (enum upipe_udpsrc_timestamp *) */
+    UPIPE_UDPSRC_GET_TIMESTAMP,
+    /** sets the source of receive timestamps (enum upipe_udpsrc_timestamp) */
+    UPIPE_UDPSRC_SET_TIMESTAMP,
+    /** returns the shared mode (bool *) */
+    UPIPE_UDPSRC_GET_SHARED,
+    /** sets the shared mode (bool) */
+    UPIPE_UDPSRC_SET_SHARED,
+    /** returns the idle timeout (uint64_t *) */
+    UPIPE_UDPSRC_GET_IDLE_TIMEOUT,
+    /** sets the idle timeout (uint64_t) */
+    UPIPE_UDPSRC_SET_IDLE_TIMEOUT
+};
+
 /** @This returns the management structure for all udp socket sources.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_udpsrc_mgr_alloc(void);
 
+/** @This returns the number of datagrams read per wake-up.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch_p filled in with the number of datagrams
+ * @return an error code
+ */
+static inline int upipe_udpsrc_get_batch(struct upipe *upipe,
+                                         unsigned int *batch_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_GET_BATCH, UPIPE_UDPSRC_SIGNATURE,
+                         batch_p);
+}
+
+/** @This sets the number of datagrams read per wake-up. With a value
+ * greater than 1, the datagrams are read with a single recvmmsg() call into
+ * buffers allocated in advance, and output in a row. The default is 1, which
+ * does one read() per wake-up.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch number of datagrams
+ * @return an error code
+ */
+static inline int upipe_udpsrc_set_batch(struct upipe *upipe,
+                                         unsigned int batch)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_SET_BATCH, UPIPE_UDPSRC_SIGNATURE,
+                         batch);
+}
+
+/** @This returns the source of receive timestamps.
+ *
+ * @param upipe description structure of the pipe
+ * @param timestamp_p filled in with the source of receive timestamps
+ * @return an error code
+ */
+static inline int upipe_udpsrc_get_timestamp(struct upipe *upipe,
+                                enum upipe_udpsrc_timestamp *timestamp_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_GET_TIMESTAMP,
+                         UPIPE_UDPSRC_SIGNATURE, timestamp_p);
+}
+
+/** @This sets the source of receive timestamps. In live mode, the kernel (or
+ * network interface) receive time is converted to the uclock and used as
+ * cr_sys date, so that the dates do not depend on the latency of the event
+ * loop. Hardware timestamps require the interface to be configured for
+ * receive timestamping, and its clock to be synchronized with the system
+ * real-time clock.
+ *
+ * @param upipe description structure of the pipe
+ * @param timestamp source of receive timestamps
+ * @return an error code
+ */
+static inline int upipe_udpsrc_set_timestamp(struct upipe *upipe,
+                                enum upipe_udpsrc_timestamp timestamp)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_SET_TIMESTAMP,
+                         UPIPE_UDPSRC_SIGNATURE, timestamp);
+}
+
+/** @This returns the shared mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param shared_p filled in with true if the socket may be shared
+ * @return an error code
+ */
+static inline int upipe_udpsrc_get_shared(struct upipe *upipe, bool *shared_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_GET_SHARED,
+                         UPIPE_UDPSRC_SIGNATURE, shared_p);
+}
+
+/** @This sets the shared mode. In shared mode, the udp sources of an event
+ * loop opened with the same uri use a single socket, so that the kernel
+ * delivers each datagram once: the first source reads it, and the others
+ * receive duplicates of its urefs, sharing the same buffers. The read size
+ * and batch of the reading source apply to all of them. A source asking for
+ * different receive timestamps keeps its own socket, and the command opening
+ * it returns an error; the receive timestamps of a shared socket can't be
+ * changed. It is disabled by default.
+ *
+ * @param upipe description structure of the pipe
+ * @param shared true if the socket may be shared with other sources
+ * @return an error code
+ */
+static inline int upipe_udpsrc_set_shared(struct upipe *upipe, bool shared)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_SET_SHARED,
+                         UPIPE_UDPSRC_SIGNATURE, shared ? 1 : 0);
+}
+
+/** @This returns the idle timeout.
+ *
+ * @param upipe description structure of the pipe
+ * @param timeout_p filled in with the idle timeout (in 27 MHz ticks)
+ * @return an error code
+ */
+static inline int upipe_udpsrc_get_idle_timeout(struct upipe *upipe,
+                                                uint64_t *timeout_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_GET_IDLE_TIMEOUT,
+                         UPIPE_UDPSRC_SIGNATURE, timeout_p);
+}
+
+/** @This sets the idle timeout. When no datagram has been received for this
+ * duration, the pipe hibernates: it frees the buffers allocated in advance,
+ * vacuums its managers, and sends @ref UPIPE_HIBERNATE downstream, so that
+ * standby channels do not hold memory. The first datagram wakes it up again.
+ * It is disabled (0) by default.
+ *
+ * @param upipe description structure of the pipe
+ * @param timeout idle timeout (in 27 MHz ticks), or 0 to disable
+ * @return an error code
+ */
+static inline int upipe_udpsrc_set_idle_timeout(struct upipe *upipe,
+                                                uint64_t timeout)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_SET_IDLE_TIMEOUT,
+                         UPIPE_UDPSRC_SIGNATURE, timeout);
+}
+
 #ifdef __cplusplus
 }
 #endif
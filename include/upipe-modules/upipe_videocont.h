@@ -59,6 +59,10 @@ enum upipe_videocont_command {
     UPIPE_VIDEOCONT_GET_LATENCY,
     /** sets the pts latency (uint64_t) */
     UPIPE_VIDEOCONT_SET_LATENCY,
+    /** returns true if the last picture is repeated on input loss (int *) */
+    UPIPE_VIDEOCONT_GET_FREEZE,
+    /** sets whether the last picture is repeated on input loss (int) */
+    UPIPE_VIDEOCONT_SET_FREEZE,
 };
 
 /** @This extends upipe_command with specific commands for upipe_videocont
@@ -161,6 +165,33 @@ static inline int upipe_videocont_set_latency(struct upipe *upipe,
                          UPIPE_VIDEOCONT_SIGNATURE, latency);
 }
 
+/** @This returns whether the last picture is repeated on input loss.
+ *
+ * @param upipe description structure of the pipe
+ * @param freeze_p filled with true if the last picture is repeated
+ * @return an error code
+ */
+static inline int upipe_videocont_get_freeze(struct upipe *upipe,
+                                             int *freeze_p)
+{
+    return upipe_control(upipe, UPIPE_VIDEOCONT_GET_FREEZE,
+                         UPIPE_VIDEOCONT_SIGNATURE, freeze_p);
+}
+
+/** @This sets whether the last picture of the current input is repeated,
+ * instead of outputting the reference packet without a picture, when the
+ * input is late. The repeated picture shares the buffer of the original.
+ *
+ * @param upipe description structure of the pipe
+ * @param freeze true to repeat the last picture
+ * @return an error code
+ */
+static inline int upipe_videocont_set_freeze(struct upipe *upipe, int freeze)
+{
+    return upipe_control(upipe, UPIPE_VIDEOCONT_SET_FREEZE,
+                         UPIPE_VIDEOCONT_SIGNATURE, freeze);
+}
+
 /** @This sets a videocont subpipe as its grandpipe input.
  *
  * @param upipe description structure of the (sub)pipe
@@ -80,6 +80,9 @@ enum upipe_wlin_mgr_command {
     UPIPE_WLIN_MGR_GET_SET_MGR(qsrc, QSRC)
     UPIPE_WLIN_MGR_GET_SET_MGR(qsink, QSINK)
 #undef UPIPE_WLIN_MGR_GET_SET_MGR
+
+    /** adds a remote thread to run bins (struct upipe_mgr *) */
+    UPIPE_WLIN_MGR_ADD_XFER_MGR
 };
 
 /** @hidden */
@@ -116,6 +119,22 @@ UPIPE_WLIN_MGR_GET_SET_MGR2(qsrc, QSRC)
 UPIPE_WLIN_MGR_GET_SET_MGR2(qsink, QSINK)
 #undef UPIPE_WLIN_MGR_GET_SET_MGR2
 
+/** @This adds a remote thread to run bins, in addition to the one given to
+ * @ref upipe_wlin_mgr_alloc. Each new bin is run in the remote thread
+ * that currently runs the fewest bins, and stays there for its whole life.
+ * This may only be called before any pipe has been allocated.
+ *
+ * @param mgr pointer to manager
+ * @param xfer_mgr manager to transfer pipes to the new remote thread
+ * @return an error code
+ */
+static inline int upipe_wlin_mgr_add_xfer_mgr(struct upipe_mgr *mgr,
+                                              struct upipe_mgr *xfer_mgr)
+{
+    return upipe_mgr_control(mgr, UPIPE_WLIN_MGR_ADD_XFER_MGR,
+                             UPIPE_WLIN_SIGNATURE, xfer_mgr);
+}
+
 /** @hidden */
 #define ARGS_DECL , struct upipe *upipe_remote, struct uprobe *uprobe_remote, unsigned int input_queue_length, unsigned int output_queue_length
 /** @hidden */
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ubuf manager for picture formats with NaCl image data storage
+ *
+ * Pictures are allocated directly inside PPB_ImageData resources, so that
+ * they may be handed to a graphics 2D context without a copy. Released
+ * images are kept in a pool and reused for pictures of the same size.
+ */
+
+#ifndef _UPIPE_NACL_UBUF_PIC_NACL_H_
+/** @hidden */
+#define _UPIPE_NACL_UBUF_PIC_NACL_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+
+#include <stdint.h>
+
+#include <ppapi/c/pp_resource.h>
+#include <ppapi/c/ppb_image_data.h>
+
+/** @This is a simple signature to make sure the ubuf_control internal API
+ * is used properly. */
+#define UBUF_PIC_NACL_SIGNATURE UBASE_FOURCC('n','c','l','p')
+
+/** @This extends ubuf_command with specific commands for NaCl pictures. */
+enum ubuf_pic_nacl_command {
+    UBUF_PIC_NACL_SENTINEL = UBUF_CONTROL_LOCAL,
+
+    /** returns the image data resource backing the whole picture
+     * (PP_Resource *) */
+    UBUF_PIC_NACL_GET_IMAGE
+};
+
+/** @This returns the image data resource backing a picture. It fails if the
+ * ubuf was not allocated by a NaCl picture manager, or if it was resized and
+ * no longer covers the whole image. The resource belongs to the ubuf and
+ * stays valid as long as the ubuf is not freed.
+ *
+ * @param ubuf pointer to ubuf
+ * @param image_p filled in with the image data resource
+ * @return an error code
+ */
+static inline int ubuf_pic_nacl_get_image(struct ubuf *ubuf,
+                                          PP_Resource *image_p)
+{
+    return ubuf_control(ubuf, UBUF_PIC_NACL_GET_IMAGE,
+                        UBUF_PIC_NACL_SIGNATURE, image_p);
+}
+
+/** @This allocates a new instance of the ubuf manager for picture formats
+ * using NaCl image data. The manager has a single packed plane, "b8g8r8a8"
+ * or "r8g8b8a8" depending on the image data format.
+ *
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param image_pool_depth maximum number of released images kept for reuse
+ * @param format image data format (normally the native format)
+ * @return pointer to manager, or NULL in case of error
+ */
+struct ubuf_mgr *ubuf_pic_nacl_mgr_alloc(uint16_t ubuf_pool_depth,
+                                         uint16_t image_pool_depth,
+                                         PP_ImageDataFormat format);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe helpers placing worker threads by NUMA locality
+ *
+ * A pipeline is cut into stages (source, demux, decoders, encoders, mux,
+ * sink), each of them running in worker pipes (wsrc, wlin, wsink) of its own
+ * thread. The threads of a pool allocated with
+ * @ref upipe_pthread_xfer_pool_alloc_numa are each pinned to one CPU of a
+ * NUMA node, typically the node of the network interface receiving or
+ * sending the stream, so that the buffers allocated by the event loop of a
+ * stage stay local to the node and the stages don't compete for a core.
+ */
+
+#ifndef _UPIPE_PTHREAD_UPIPE_PTHREAD_NUMA_H_
+/** @hidden */
+#define _UPIPE_PTHREAD_UPIPE_PTHREAD_NUMA_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe-pthread/upipe_pthread_transfer.h>
+
+#include <stdint.h>
+
+/** @This enumerates the usual stages of a pipeline, to be used as affinity
+ * keys of a pool (see @ref upipe_pthread_xfer_pool_get_mgr). If the pool
+ * has fewer threads than stages, several stages share a thread. */
+enum upipe_pthread_stage {
+    /** source and its framers */
+    UPIPE_PTHREAD_STAGE_SOURCE = 0,
+    /** demultiplexer */
+    UPIPE_PTHREAD_STAGE_DEMUX,
+    /** decoders */
+    UPIPE_PTHREAD_STAGE_DECODE,
+    /** encoders */
+    UPIPE_PTHREAD_STAGE_ENCODE,
+    /** multiplexer */
+    UPIPE_PTHREAD_STAGE_MUX,
+    /** sink */
+    UPIPE_PTHREAD_STAGE_SINK,
+
+    /** number of stages */
+    UPIPE_PTHREAD_STAGE_MAX
+};
+
+/** @This returns the number of NUMA nodes of the system.
+ *
+ * @param nb_nodes_p filled in with the number of nodes (1 on systems
+ * without NUMA information)
+ * @return an error code
+ */
+int upipe_pthread_numa_get_nb_nodes(unsigned int *nb_nodes_p);
+
+/** @This returns the CPUs of a NUMA node that the process may run on.
+ *
+ * @param node NUMA node, or -1 for all the CPUs
+ * @param cpus array filled in with the CPU numbers
+ * @param nb_cpus_p reference to the size of the array, filled in with the
+ * number of CPUs
+ * @return an error code
+ */
+int upipe_pthread_numa_get_cpus(int node, unsigned int *cpus,
+                                unsigned int *nb_cpus_p);
+
+/** @This returns the NUMA node a network interface is attached to.
+ *
+ * @param ifname name of the interface, for instance "eth0"
+ * @param node_p filled in with the node, or -1 if unknown
+ * @return an error code
+ */
+int upipe_pthread_numa_get_if_node(const char *ifname, int *node_p);
+
+/** @This allocates a pool of threads like @ref upipe_pthread_xfer_pool_alloc,
+ * with the threads pinned to distinct CPUs of a NUMA node, in order. If the
+ * node has fewer CPUs than threads, the CPUs are reused from the first one.
+ * If CPU affinity isn't supported, the threads are not pinned.
+ *
+ * @param node NUMA node, or -1 to use all the CPUs of the process
+ * @param nb_threads number of threads to create, for instance
+ * UPIPE_PTHREAD_STAGE_MAX
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr in each thread
+ * @param upump_mgr_alloc callback creating the event loop in a new thread
+ * @param upump_mgr_work callback running the event loop in a new thread
+ * @param upump_mgr_free callback freeing the event loop in a new thread
+ * @return pointer to pool, or NULL in case of error
+ */
+struct upipe_pthread_xfer_pool *upipe_pthread_xfer_pool_alloc_numa(int node,
+        unsigned int nb_threads, uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upipe_pthread_upump_mgr_alloc upump_mgr_alloc,
+        upipe_pthread_upump_mgr_work upump_mgr_work,
+        upipe_pthread_upump_mgr_free upump_mgr_free);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
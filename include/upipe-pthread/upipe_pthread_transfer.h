@@ -36,9 +36,23 @@ extern "C" {
 #endif
 
 #include <upipe/upipe.h>
+#include <upipe-modules/upipe_transfer.h>
 
+#include <stdint.h>
 #include <pthread.h>
 
+#define UPIPE_PTHREAD_XFER_SIGNATURE UBASE_FOURCC('p','x','f','r')
+
+/** @This extends uprobe_event with specific events for pthread xfer. */
+enum uprobe_pthread_xfer_event {
+    UPROBE_PTHREAD_XFER_SENTINEL = UPROBE_LOCAL,
+
+    /** a thread terminated, after consuming the given CPU time in 27 MHz
+     * units; thrown in the thread which allocated the xfer manager, on the
+     * uprobe_pthread_upump_mgr probe (pthread_t, uint64_t) */
+    UPROBE_PTHREAD_CPU_TIME
+};
+
 /** @This represents the application call-back that is supposed to create the
  * event loop in the new thread. */
 typedef struct upump_mgr *
@@ -52,9 +66,29 @@ typedef void (*upipe_pthread_upump_mgr_work)(struct upump_mgr *);
  * event loop in the new thread. */
 typedef void (*upipe_pthread_upump_mgr_free)(struct upump_mgr *);
 
+/** @This represents the application call-back that is supposed to set the
+ * attributes of the thread of the given index in a pool. */
+typedef int (*upipe_pthread_attr_cb)(void *, unsigned int, pthread_attr_t *);
+
+/** @This returns the CPU time consumed so far by a thread. The thread must
+ * not have been joined yet.
+ *
+ * @param pthread_id thread ID
+ * @param cpu_time_p filled in with the CPU time, in 27 MHz units
+ * @return an error code
+ */
+int upipe_pthread_get_cpu_time(pthread_t pthread_id, uint64_t *cpu_time_p);
+
 /** @This returns a management structure for transfer pipes, using a new
  * pthread. You would need one management structure per target thread.
  *
+ * The attributes may pin the thread to a set of CPUs, for instance the CPUs
+ * of the NUMA node of a network interface, or away from the CPUs handling
+ * interrupts (pthread_attr_setaffinity_np), and give it a real-time
+ * scheduling policy such as SCHED_FIFO (pthread_attr_setschedpolicy and
+ * pthread_attr_setschedparam, along with PTHREAD_EXPLICIT_SCHED). Memory
+ * allocated by the event loop of a pinned thread is then local to its node.
+ *
  * @param queue_length maximum length of the internal queue of commands
  * @param msg_pool_depth maximum number of messages in the pool
  * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
@@ -73,6 +107,111 @@ struct upipe_mgr *upipe_pthread_xfer_mgr_alloc(uint8_t queue_length,
         upipe_pthread_upump_mgr_free upump_mgr_free,
         pthread_t *pthread_id_p, const pthread_attr_t *restrict attr);
 
+/** @This is an opaque pool of threads, each running its own event loop and
+ * receiving transferred pipes. */
+struct upipe_pthread_xfer_pool;
+
+/** @This allocates a pool of threads, each running its own event loop, and
+ * the matching management structures for transfer pipes. Pipes are then
+ * assigned to a thread by an affinity key, so that pipes sharing the same
+ * key run in the same thread.
+ *
+ * @param nb_threads number of threads to create
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr in each thread
+ * @param upump_mgr_alloc callback creating the event loop in a new thread
+ * @param upump_mgr_work callback running the event loop in a new thread
+ * @param upump_mgr_free callback freeing the event loop in a new thread
+ * @param attr pthread attributes
+ * @return pointer to pool, or NULL in case of error
+ */
+struct upipe_pthread_xfer_pool *upipe_pthread_xfer_pool_alloc(
+        unsigned int nb_threads, uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upipe_pthread_upump_mgr_alloc upump_mgr_alloc,
+        upipe_pthread_upump_mgr_work upump_mgr_work,
+        upipe_pthread_upump_mgr_free upump_mgr_free,
+        const pthread_attr_t *restrict attr);
+
+/** @This allocates a pool of threads like @ref upipe_pthread_xfer_pool_alloc,
+ * with a callback setting the attributes of each thread, for instance to
+ * give each thread its own CPU.
+ *
+ * @param nb_threads number of threads to create
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr in each thread
+ * @param upump_mgr_alloc callback creating the event loop in a new thread
+ * @param upump_mgr_work callback running the event loop in a new thread
+ * @param upump_mgr_free callback freeing the event loop in a new thread
+ * @param attr_cb callback setting the attributes of each thread
+ * @param opaque opaque passed to attr_cb
+ * @return pointer to pool, or NULL in case of error
+ */
+struct upipe_pthread_xfer_pool *upipe_pthread_xfer_pool_alloc_attrs(
+        unsigned int nb_threads, uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upipe_pthread_upump_mgr_alloc upump_mgr_alloc,
+        upipe_pthread_upump_mgr_work upump_mgr_work,
+        upipe_pthread_upump_mgr_free upump_mgr_free,
+        upipe_pthread_attr_cb attr_cb, void *opaque);
+
+/** @This returns the number of threads of a pool.
+ *
+ * @param pool pointer to pool
+ * @return number of threads
+ */
+unsigned int upipe_pthread_xfer_pool_size(
+        struct upipe_pthread_xfer_pool *pool);
+
+/** @This returns the management structure for transfer pipes of the thread
+ * associated with an affinity key. The structure belongs to the pool, and
+ * must be used by the caller to be kept beyond the life of the pool.
+ *
+ * @param pool pointer to pool
+ * @param key affinity key
+ * @return pointer to xfer manager
+ */
+struct upipe_mgr *upipe_pthread_xfer_pool_get_mgr(
+        struct upipe_pthread_xfer_pool *pool, uint64_t key);
+
+/** @This returns the CPU time consumed so far by a thread of a pool.
+ *
+ * @param pool pointer to pool
+ * @param index index of the thread in the pool
+ * @param cpu_time_p filled in with the CPU time, in 27 MHz units
+ * @return an error code
+ */
+int upipe_pthread_xfer_pool_get_cpu_time(struct upipe_pthread_xfer_pool *pool,
+                                         unsigned int index,
+                                         uint64_t *cpu_time_p);
+
+/** @This transfers a pipe to the thread associated with an affinity key.
+ *
+ * @param pool pointer to pool
+ * @param key affinity key
+ * @param uprobe structure used to raise events (belongs to the callee)
+ * @param upipe_remote pipe to transfer (belongs to the callee)
+ * @return pointer to the local xfer pipe, or NULL in case of error
+ */
+static inline struct upipe *upipe_pthread_xfer_pool_alloc_xfer(
+        struct upipe_pthread_xfer_pool *pool, uint64_t key,
+        struct uprobe *uprobe, struct upipe *upipe_remote)
+{
+    return upipe_xfer_alloc(upipe_pthread_xfer_pool_get_mgr(pool, key),
+                            uprobe, upipe_remote);
+}
+
+/** @This releases the pool. Each thread terminates when its last transfer
+ * pipe has been released.
+ *
+ * @param pool pointer to pool
+ */
+void upipe_pthread_xfer_pool_free(struct upipe_pthread_xfer_pool *pool);
+
 #ifdef __cplusplus
 }
 #endif
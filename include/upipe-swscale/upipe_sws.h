@@ -45,7 +45,11 @@ enum upipe_sws_command {
     /** set flags (int) */
     UPIPE_SWS_SET_FLAGS,
     /** get flags (int *) */
-    UPIPE_SWS_GET_FLAGS
+    UPIPE_SWS_GET_FLAGS,
+    /** get the number of bands scaled in parallel (unsigned int *) */
+    UPIPE_SWS_GET_BANDS,
+    /** set the number of bands scaled in parallel (unsigned int) */
+    UPIPE_SWS_SET_BANDS
 };
 
 /** @This gets the swscale flags.
@@ -72,6 +76,36 @@ static inline bool upipe_sws_set_flags(struct upipe *upipe, int flags)
                          flags);
 }
 
+/** @This gets the number of bands scaled in parallel.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands_p filled in with the number of bands
+ * @return an error code
+ */
+static inline int upipe_sws_get_bands(struct upipe *upipe,
+                                      unsigned int *nb_bands_p)
+{
+    return upipe_control(upipe, UPIPE_SWS_GET_BANDS, UPIPE_SWS_SIGNATURE,
+                         nb_bands_p);
+}
+
+/** @This sets the number of horizontal bands scaled in parallel. Each band
+ * but the first is scaled in its own thread, into the same output picture.
+ * Bands are scaled independently, so filters with a wide support may show
+ * seams at band boundaries. Interlaced pictures are always scaled in a
+ * single band. The default is 1.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands number of bands
+ * @return an error code
+ */
+static inline int upipe_sws_set_bands(struct upipe *upipe,
+                                      unsigned int nb_bands)
+{
+    return upipe_control(upipe, UPIPE_SWS_SET_BANDS, UPIPE_SWS_SIGNATURE,
+                         nb_bands);
+}
+
 /** @This returns the management structure for sws pipes.
  *
  * @return pointer to manager
@@ -34,12 +34,86 @@ extern "C" {
 
 #define UPIPE_TS_AGG_SIGNATURE UBASE_FOURCC('t','s','a','g')
 
+/** @This extends upipe_command with specific commands for ts agg. */
+enum upipe_ts_agg_command {
+    UPIPE_TS_AGG_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the number of aggregates output at once (unsigned int *) */
+    UPIPE_TS_AGG_GET_BURST,
+    /** sets the number of aggregates output at once (unsigned int) */
+    UPIPE_TS_AGG_SET_BURST,
+    /** returns whether packets may be sent ahead of time (bool *) */
+    UPIPE_TS_AGG_GET_TSTD,
+    /** sets whether packets may be sent ahead of time (bool) */
+    UPIPE_TS_AGG_SET_TSTD
+};
+
 /** @This returns the management structure for all ts_agg pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_ts_agg_mgr_alloc(void);
 
+/** @This returns the number of aggregates output at once.
+ *
+ * @param upipe description structure of the pipe
+ * @param burst_p filled in with the number of aggregates
+ * @return an error code
+ */
+static inline int upipe_ts_agg_get_burst(struct upipe *upipe,
+                                         unsigned int *burst_p)
+{
+    return upipe_control(upipe, UPIPE_TS_AGG_GET_BURST,
+                         UPIPE_TS_AGG_SIGNATURE, burst_p);
+}
+
+/** @This sets the number of aggregates output at once (default 1). With a
+ * value greater than 1, completed aggregates are kept until that many are
+ * ready, and then output in a row, with their own dates. This adds
+ * (burst - 1) aggregate intervals to the latency.
+ *
+ * @param upipe description structure of the pipe
+ * @param burst number of aggregates
+ * @return an error code
+ */
+static inline int upipe_ts_agg_set_burst(struct upipe *upipe,
+                                         unsigned int burst)
+{
+    return upipe_control(upipe, UPIPE_TS_AGG_SET_BURST,
+                         UPIPE_TS_AGG_SIGNATURE, burst);
+}
+
+/** @This returns whether packets may be sent ahead of time.
+ *
+ * @param upipe description structure of the pipe
+ * @param tstd_p filled in with true if packets may be sent ahead of time
+ * @return an error code
+ */
+static inline int upipe_ts_agg_get_tstd(struct upipe *upipe, bool *tstd_p)
+{
+    return upipe_control(upipe, UPIPE_TS_AGG_GET_TSTD,
+                         UPIPE_TS_AGG_SIGNATURE, tstd_p);
+}
+
+/** @This sets whether packets may be sent ahead of time (default false).
+ * In CBR and capped VBR modes, instead of padding, the aggregate is then
+ * filled with the next packets whose elementary stream has room for them
+ * in the T-STD model (see @ref upipe_ts_tstd_mgr_alloc), as long as the
+ * transport buffer of their PID, which is modelled here on each packet,
+ * does not overflow. Packets carrying a PCR are never moved. This smoothes
+ * the peaks of the elementary streams into the spare capacity of the
+ * multiplex. It may also be called on a ts_mux pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param tstd true if packets may be sent ahead of time
+ * @return an error code
+ */
+static inline int upipe_ts_agg_set_tstd(struct upipe *upipe, bool tstd)
+{
+    return upipe_control(upipe, UPIPE_TS_AGG_SET_TSTD,
+                         UPIPE_TS_AGG_SIGNATURE, tstd ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
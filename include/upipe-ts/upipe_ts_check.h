@@ -41,7 +41,13 @@ enum upipe_ts_check_command {
     /** returns the configured size of TS packets (int *) */
     UPIPE_TS_CHECK_GET_SIZE,
     /** sets the configured size of TS packets (int) */
-    UPIPE_TS_CHECK_SET_SIZE
+    UPIPE_TS_CHECK_SET_SIZE,
+    /** returns true if TS bundles are output (bool *) */
+    UPIPE_TS_CHECK_GET_BUNDLE,
+    /** sets whether TS bundles are output (bool) */
+    UPIPE_TS_CHECK_SET_BUNDLE,
+    /** returns the error counters (uint64_t *, uint64_t *, uint64_t *) */
+    UPIPE_TS_CHECK_GET_STATS
 };
 
 /** @This returns the management structure for all ts_check pipes.
@@ -80,6 +86,58 @@ static inline bool upipe_ts_check_set_size(struct upipe *upipe, int size)
                          UPIPE_TS_CHECK_SIGNATURE, size);
 }
 
+/** @This returns whether the pipe outputs TS bundles.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle_p filled in with true if TS bundles are output
+ * @return an error code
+ */
+static inline int upipe_ts_check_get_bundle(struct upipe *upipe,
+                                            bool *bundle_p)
+{
+    return upipe_control(upipe, UPIPE_TS_CHECK_GET_BUNDLE,
+                         UPIPE_TS_CHECK_SIGNATURE, bundle_p);
+}
+
+/** @This sets whether the pipe outputs TS bundles. When enabled, each input
+ * uref is output as one uref carrying all its valid 188-octet packets, along
+ * with a description of their headers (see @ref uref_ts_bundle_set), instead
+ * of one uref per packet. The continuity counters are then checked in the
+ * same pass (see @ref upipe_ts_check_get_stats).
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle true to output TS bundles
+ * @return an error code
+ */
+static inline int upipe_ts_check_set_bundle(struct upipe *upipe, bool bundle)
+{
+    return upipe_control(upipe, UPIPE_TS_CHECK_SET_BUNDLE,
+                         UPIPE_TS_CHECK_SIGNATURE, bundle ? 1 : 0);
+}
+
+/** @This returns the error counters of the pipe. Invalid packets are
+ * always counted; continuity errors and transport errors are only checked
+ * in bundle mode, where they are not logged individually.
+ *
+ * @param upipe description structure of the pipe
+ * @param invalid_p filled in with the number of packets dropped because of
+ * an invalid sync word or adaptation field (may be NULL)
+ * @param cc_errors_p filled in with the number of continuity errors (may be
+ * NULL)
+ * @param tei_errors_p filled in with the number of packets with the
+ * transport error indicator (may be NULL)
+ * @return an error code
+ */
+static inline int upipe_ts_check_get_stats(struct upipe *upipe,
+                                           uint64_t *invalid_p,
+                                           uint64_t *cc_errors_p,
+                                           uint64_t *tei_errors_p)
+{
+    return upipe_control(upipe, UPIPE_TS_CHECK_GET_STATS,
+                         UPIPE_TS_CHECK_SIGNATURE, invalid_p, cc_errors_p,
+                         tei_errors_p);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,12 @@ extern "C" {
 enum uprobe_ts_demux_event {
     UPROBE_TS_DEMUX_SENTINEL = UPROBE_LOCAL,
 
+    /** an output is about to allocate its framer, which may run in a
+     * worker thread; fill in the wlin manager bound to the thread, and the
+     * probe hierarchy to use on the thread, which belongs to the callee
+     * (struct upipe_mgr **, struct uprobe **) */
+    UPROBE_TS_DEMUX_NEED_WORKER,
+
     /** ts_split events begin here */
     UPROBE_TS_DEMUX_SPLIT = UPROBE_LOCAL + 0x1000,
 };
@@ -51,7 +57,20 @@ enum upipe_ts_demux_command {
     /** returns the currently detected conformance (int *) */
     UPIPE_TS_DEMUX_GET_CONFORMANCE,
     /** sets the conformance (int) */
-    UPIPE_TS_DEMUX_SET_CONFORMANCE
+    UPIPE_TS_DEMUX_SET_CONFORMANCE,
+    /** returns a snapshot of the PAT and PMTs (struct uref **) */
+    UPIPE_TS_DEMUX_GET_PSI,
+    /** feeds a snapshot of the PAT and PMTs (struct uref *) */
+    UPIPE_TS_DEMUX_SET_PSI,
+    /** returns the output of the passthrough PSI (struct upipe **) */
+    UPIPE_TS_DEMUX_GET_PASSTHROUGH,
+    /** sets the passthrough mode and the output of its PSI
+     * (struct upipe *) */
+    UPIPE_TS_DEMUX_SET_PASSTHROUGH,
+    /** returns true if the input is checked into TS bundles (bool *) */
+    UPIPE_TS_DEMUX_GET_BUNDLE,
+    /** sets whether the input is checked into TS bundles (bool) */
+    UPIPE_TS_DEMUX_SET_BUNDLE
 };
 
 /** @This returns the currently detected conformance mode. It cannot return
@@ -83,6 +102,108 @@ static inline int
                          UPIPE_TS_DEMUX_SIGNATURE, conformance);
 }
 
+/** @This returns a snapshot of the PSI currently in effect, to be saved by
+ * the application and fed to @ref upipe_ts_demux_set_psi on the next start.
+ * The snapshot is a uref containing the sections of the PAT, followed by the
+ * sections of the PMTs of the allocated programs, and belongs to the caller.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref_p filled in with the snapshot
+ * @return an error code
+ */
+static inline int upipe_ts_demux_get_psi(struct upipe *upipe,
+                                         struct uref **uref_p)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_GET_PSI,
+                         UPIPE_TS_DEMUX_SIGNATURE, uref_p);
+}
+
+/** @This feeds a snapshot of the PSI returned by a previous run of
+ * @ref upipe_ts_demux_get_psi, so that the programs and their elementary
+ * streams are announced and may be allocated without waiting for the
+ * tables to be received. The sections are processed as if they had been
+ * received: the PMT sections are only parsed for the programs allocated
+ * while the PAT sections are processed. When the actual tables are received,
+ * they are found identical and dropped, or they replace the snapshot with
+ * the usual split_update events. This must be called after the flow
+ * definition is set, and the snapshot is not consumed.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref snapshot of the PSI
+ * @return an error code
+ */
+static inline int upipe_ts_demux_set_psi(struct upipe *upipe,
+                                         struct uref *uref)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_SET_PSI,
+                         UPIPE_TS_DEMUX_SIGNATURE, uref);
+}
+
+/** @This returns the output of the PSI in passthrough mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param output_p filled in with the output, or NULL if the passthrough mode
+ * is disabled
+ * @return an error code
+ */
+static inline int upipe_ts_demux_get_passthrough(struct upipe *upipe,
+                                                 struct upipe **output_p)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_GET_PASSTHROUGH,
+                         UPIPE_TS_DEMUX_SIGNATURE, output_p);
+}
+
+/** @This enables the passthrough mode, to record a subset of the programs of
+ * a transport stream without decoding it. The outputs allocated afterwards
+ * skip the PES decapsulation and the framers, and output the TS packets of
+ * their PID as they are received. A PAT listing the allocated programs, and
+ * the PMT sections of these programs, are packetized and sent to the given
+ * output along with the received tables, so that the outputs and the PSI
+ * output make up a valid partial transport stream. Typically all of them are
+ * linked to the same sink. The PCR PIDs are decapsulated only to throw the
+ * clock_ref events of the programs.
+ *
+ * @param upipe description structure of the pipe
+ * @param output output of the PSI, or NULL to disable the passthrough mode
+ * @return an error code
+ */
+static inline int upipe_ts_demux_set_passthrough(struct upipe *upipe,
+                                                 struct upipe *output)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_SET_PASSTHROUGH,
+                         UPIPE_TS_DEMUX_SIGNATURE, output);
+}
+
+/** @This returns whether the input is checked into TS bundles.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle_p filled in with true if TS bundles are used
+ * @return an error code
+ */
+static inline int upipe_ts_demux_get_bundle(struct upipe *upipe,
+                                            bool *bundle_p)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_GET_BUNDLE,
+                         UPIPE_TS_DEMUX_SIGNATURE, bundle_p);
+}
+
+/** @This sets whether the input is checked into TS bundles (see
+ * @ref upipe_ts_check_set_bundle), so that runs of packets go through
+ * ts_split and ts_decaps as a single uref. It only applies to input flows
+ * of aligned packets (block.mpegtsaligned.), which are processed by
+ * ts_check; it is disabled by default. Outputs in passthrough mode then
+ * output bundles of packets instead of single packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle true to use TS bundles
+ * @return an error code
+ */
+static inline int upipe_ts_demux_set_bundle(struct upipe *upipe, bool bundle)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_SET_BUNDLE,
+                         UPIPE_TS_DEMUX_SIGNATURE, bundle ? 1 : 0);
+}
+
 /** @This returns the management structure for all ts_demux pipes.
  *
  * @return pointer to manager
@@ -116,6 +237,7 @@ enum upipe_ts_demux_mgr_command {
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(a52f, A52F)
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(mpgvf, MPGVF)
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(h264f, H264F)
+    UPIPE_TS_DEMUX_MGR_GET_SET_MGR(h265f, H265F)
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(telxf, TELXF)
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(dvbsubf, DVBSUBF)
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(opusf, OPUSF)
@@ -167,6 +289,7 @@ UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(mpgaf, MPGAF)
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(a52f, A52F)
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(mpgvf, MPGVF)
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(h264f, H264F)
+UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(h265f, H265F)
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(telxf, TELXF)
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(dvbsubf, DVBSUBF)
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(opusf, OPUSF)
@@ -33,12 +33,51 @@ extern "C" {
 
 #define UPIPE_TS_ENCAPS_SIGNATURE UBASE_FOURCC('t','s','e','c')
 
+/** @This extends upipe_command with specific commands for ts encaps. */
+enum upipe_ts_encaps_command {
+    UPIPE_TS_ENCAPS_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns true if TS bundles are output (bool *) */
+    UPIPE_TS_ENCAPS_GET_BUNDLE,
+    /** sets whether TS bundles are output (bool) */
+    UPIPE_TS_ENCAPS_SET_BUNDLE
+};
+
 /** @This returns the management structure for all ts_encaps pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_ts_encaps_mgr_alloc(void);
 
+/** @This returns whether the pipe outputs TS bundles.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle_p filled in with true if TS bundles are output
+ * @return an error code
+ */
+static inline int upipe_ts_encaps_get_bundle(struct upipe *upipe,
+                                             bool *bundle_p)
+{
+    return upipe_control(upipe, UPIPE_TS_ENCAPS_GET_BUNDLE,
+                         UPIPE_TS_ENCAPS_SIGNATURE, bundle_p);
+}
+
+/** @This sets whether the pipe outputs TS bundles. When enabled, the TS
+ * packets of an access unit are output in a single uref, chaining the TS
+ * headers and the spliced payloads, along with the description and the
+ * dates of each packet (see @ref uref_ts_bundle_set_dates). PCR-only
+ * packets are still output separately.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle true to output TS bundles
+ * @return an error code
+ */
+static inline int upipe_ts_encaps_set_bundle(struct upipe *upipe, bool bundle)
+{
+    return upipe_control(upipe, UPIPE_TS_ENCAPS_SET_BUNDLE,
+                         UPIPE_TS_ENCAPS_SIGNATURE, bundle ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,18 @@ enum upipe_ts_mux_mode {
     UPIPE_TS_MUX_MODE_CBR
 };
 
+/** @This extends uprobe_event with specific events for ts mux. */
+enum uprobe_ts_mux_event {
+    UPROBE_TS_MUX_SENTINEL = UPROBE_LOCAL,
+
+    /** an input is about to allocate its PES and TS encapsulation, which may
+     * run in a worker thread; fill in the wlin manager bound to the thread,
+     * and the probe hierarchy to use on the thread, which belongs to the
+     * callee and must provide ubuf and uref managers
+     * (struct upipe_mgr **, struct uprobe **) */
+    UPROBE_TS_MUX_NEED_WORKER
+};
+
 /** @This extends upipe_command with specific commands for ts mux. */
 enum upipe_ts_mux_command {
     UPIPE_TS_MUX_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -85,7 +97,13 @@ enum upipe_ts_mux_command {
     /** returns the current version number of the table (unsigned int *) */
     UPIPE_TS_MUX_GET_VERSION,
     /** sets the version number of the table (unsigned int) */
-    UPIPE_TS_MUX_SET_VERSION
+    UPIPE_TS_MUX_SET_VERSION,
+    /** returns the length of the FIFO of a remote input, or 0
+     * (unsigned int *) */
+    UPIPE_TS_MUX_GET_REMOTE,
+    /** lets an input be fed from other threads through a FIFO of the given
+     * length, or 0 (unsigned int) */
+    UPIPE_TS_MUX_SET_REMOTE
 };
 
 /** @This returns the current conformance mode. It cannot return
@@ -171,7 +189,8 @@ static inline int upipe_ts_mux_set_pmt_interval(struct upipe *upipe,
                          UPIPE_TS_MUX_SIGNATURE, interval);
 }
 
-/** @This returns the current PCR interval.
+/** @This returns the current PCR interval. It may also be called on
+ * upipe_ts_synth.
  *
  * @param upipe description structure of the pipe
  * @param interval_p filled in with the interval
@@ -184,7 +203,8 @@ static inline int upipe_ts_mux_get_pcr_interval(struct upipe *upipe,
                          UPIPE_TS_MUX_SIGNATURE, interval_p);
 }
 
-/** @This sets the PCR interval. It may also be called on a program subpipe.
+/** @This sets the PCR interval. It may also be called on a program subpipe
+ * and on upipe_ts_synth.
  *
  * @param upipe description structure of the pipe
  * @param interval new interval
@@ -198,7 +218,7 @@ static inline int upipe_ts_mux_set_pcr_interval(struct upipe *upipe,
 }
 
 /** @This returns the current mux octetrate. It may also be called on
- * upipe_ts_aggregate.
+ * upipe_ts_aggregate and upipe_ts_synth.
  *
  * @param upipe description structure of the pipe
  * @param octetrate_p filled in with the octetrate
@@ -211,7 +231,8 @@ static inline int upipe_ts_mux_get_octetrate(struct upipe *upipe,
                          UPIPE_TS_MUX_SIGNATURE, octetrate_p);
 }
 
-/** @This sets the mux octetrate. It may also be called on upipe_ts_aggregate.
+/** @This sets the mux octetrate. It may also be called on upipe_ts_aggregate
+ * and upipe_ts_synth.
  *
  * @param upipe description structure of the pipe
  * @param octetrate new octetrate
@@ -279,7 +300,7 @@ static inline int upipe_ts_mux_set_mode(struct upipe *upipe,
 }
 
 /** @This returns the configured mtu of TS packets. It may also be called on
- * upipe_ts_aggregate.
+ * upipe_ts_aggregate and upipe_ts_synth.
  *
  * @param upipe description structure of the pipe
  * @param mtu_p filled in with the configured mtu, in octets
@@ -292,7 +313,7 @@ static inline int upipe_ts_mux_get_mtu(struct upipe *upipe, unsigned int *mtu_p)
 }
 
 /** @This sets the configured mtu of TS packets. It may also be called on
- * upipe_ts_aggregate.
+ * upipe_ts_aggregate and upipe_ts_synth.
  *
  * @param upipe description structure of the pipe
  * @param mtu configured mtu, in octets
@@ -332,6 +353,44 @@ static inline int upipe_ts_mux_set_version(struct upipe *upipe,
                          UPIPE_TS_MUX_SIGNATURE, version);
 }
 
+/** @This returns the length of the FIFO of a remote input. It must be
+ * called on an input subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param length_p filled in with the length, or 0 if the input is fed from
+ * the thread of the mux
+ * @return an error code
+ */
+static inline int upipe_ts_mux_get_remote(struct upipe *upipe,
+                                          unsigned int *length_p)
+{
+    return upipe_control(upipe, UPIPE_TS_MUX_GET_REMOTE,
+                         UPIPE_TS_MUX_SIGNATURE, length_p);
+}
+
+/** @This lets an input subpipe be fed from any thread. The urefs are then
+ * pushed into a lock-free FIFO of the given length, which the thread of the
+ * mux drains; a single event is shared by all remote inputs of the mux,
+ * which requires a upump manager. When the FIFO is full, the feeding thread
+ * waits up to 100 ms for the mux to drain it, and then drops the uref; the
+ * mux reports the drops with a warning from its own thread.
+ *
+ * It must be called from the thread of the mux before the input is handed
+ * to other threads, which may then only call @ref upipe_input on it. Control
+ * commands and the last release of the input stay on the thread of the mux.
+ *
+ * @param upipe description structure of the pipe
+ * @param length length of the FIFO (max 255), or 0 to only feed the input
+ * from the thread of the mux
+ * @return an error code
+ */
+static inline int upipe_ts_mux_set_remote(struct upipe *upipe,
+                                          unsigned int length)
+{
+    return upipe_control(upipe, UPIPE_TS_MUX_SET_REMOTE,
+                         UPIPE_TS_MUX_SIGNATURE, length);
+}
+
 /** @This returns the management structure for all ts_mux pipes.
  *
  * @return pointer to manager
@@ -354,6 +413,7 @@ enum upipe_ts_mux_mgr_command {
     UPIPE_TS_MUX_MGR_GET_SET_MGR(ts_pese, TS_PESE)
     UPIPE_TS_MUX_MGR_GET_SET_MGR(ts_psig, TS_PSIG)
     UPIPE_TS_MUX_MGR_GET_SET_MGR(ts_psii, TS_PSII)
+    UPIPE_TS_MUX_MGR_GET_SET_MGR(ts_sig, TS_SIG)
 #undef UPIPE_TS_MUX_MGR_GET_SET_MGR
 };
 
@@ -393,6 +453,7 @@ UPIPE_TS_MUX_MGR_GET_SET_MGR2(ts_encaps, TS_ENCAPS)
 UPIPE_TS_MUX_MGR_GET_SET_MGR2(ts_pese, TS_PESE)
 UPIPE_TS_MUX_MGR_GET_SET_MGR2(ts_psig, TS_PSIG)
 UPIPE_TS_MUX_MGR_GET_SET_MGR2(ts_psii, TS_PSII)
+UPIPE_TS_MUX_MGR_GET_SET_MGR2(ts_sig, TS_SIG)
 #undef UPIPE_TS_MUX_MGR_GET_SET_MGR2
 
 #ifdef __cplusplus
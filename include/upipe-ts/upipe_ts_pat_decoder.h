@@ -39,7 +39,12 @@ enum upipe_ts_patd_command {
     UPIPE_TS_PATD_SENTINEL = UPIPE_CONTROL_LOCAL,
 
     /** returns the flow definition of the NIT (struct uref **) */
-    UPIPE_TS_PATD_GET_NIT
+    UPIPE_TS_PATD_GET_NIT,
+    /** returns the statistics of the section cache (uint64_t *,
+     * uint64_t *) */
+    UPIPE_TS_PATD_GET_CACHE_STATS,
+    /** returns the sections of the current PAT (struct uref **) */
+    UPIPE_TS_PATD_GET_TABLE
 };
 
 /** @This returns the flow definition of the NIT.
@@ -55,6 +60,38 @@ static inline bool upipe_ts_patd_get_nit(struct upipe *upipe,
                          UPIPE_TS_PATD_SIGNATURE, flow_def_p);
 }
 
+/** @This returns the statistics of the cache of PAT sections. Identical
+ * repetitions of the sections of the current PAT are found in the cache and
+ * dropped without being parsed.
+ *
+ * @param upipe description structure of the pipe
+ * @param hits_p filled in with the number of sections found in the cache
+ * @param misses_p filled in with the number of sections not found in the
+ * cache
+ * @return an error code
+ */
+static inline int upipe_ts_patd_get_cache_stats(struct upipe *upipe,
+                                                uint64_t *hits_p,
+                                                uint64_t *misses_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PATD_GET_CACHE_STATS,
+                         UPIPE_TS_PATD_SIGNATURE, hits_p, misses_p);
+}
+
+/** @This returns the sections of the current PAT, one after the other in
+ * a new uref belonging to the caller.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref_p filled in with the sections
+ * @return an error code
+ */
+static inline int upipe_ts_patd_get_table(struct upipe *upipe,
+                                          struct uref **uref_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PATD_GET_TABLE,
+                         UPIPE_TS_PATD_SIGNATURE, uref_p);
+}
+
 /** @This returns the management structure for all ts_patd pipes.
  *
  * @return pointer to manager
@@ -33,12 +33,52 @@ extern "C" {
 
 #define UPIPE_TS_PESD_SIGNATURE UBASE_FOURCC('t','s','p','d')
 
+/** @This extends upipe_command with specific commands for ts pesd. */
+enum upipe_ts_pesd_command {
+    UPIPE_TS_PESD_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns true if PES are reassembled (bool *) */
+    UPIPE_TS_PESD_GET_REASSEMBLE,
+    /** sets whether PES are reassembled (bool) */
+    UPIPE_TS_PESD_SET_REASSEMBLE
+};
+
 /** @This returns the management structure for all ts_pesd pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_ts_pesd_mgr_alloc(void);
 
+/** @This returns whether the pipe reassembles PES.
+ *
+ * @param upipe description structure of the pipe
+ * @param reassemble_p filled in with true if PES are reassembled
+ * @return an error code
+ */
+static inline int upipe_ts_pesd_get_reassemble(struct upipe *upipe,
+                                               bool *reassemble_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PESD_GET_REASSEMBLE,
+                         UPIPE_TS_PESD_SIGNATURE, reassemble_p);
+}
+
+/** @This sets whether the pipe reassembles PES. When enabled, the payloads
+ * of a PES whose length is given in the PES header are copied into a single
+ * buffer, allocated once from the size of the PES, and output in a single
+ * uref carrying both the start and end flags. PES of unbounded length are
+ * still output chunk by chunk.
+ *
+ * @param upipe description structure of the pipe
+ * @param reassemble true to reassemble PES
+ * @return an error code
+ */
+static inline int upipe_ts_pesd_set_reassemble(struct upipe *upipe,
+                                               bool reassemble)
+{
+    return upipe_control(upipe, UPIPE_TS_PESD_SET_REASSEMBLE,
+                         UPIPE_TS_PESD_SIGNATURE, reassemble ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,49 @@ extern "C" {
 
 #define UPIPE_TS_PMTD_SIGNATURE UBASE_FOURCC('t','s','2','d')
 
+/** @This extends upipe_command with specific commands for ts pmtd. */
+enum upipe_ts_pmtd_command {
+    UPIPE_TS_PMTD_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the statistics of the section cache (uint64_t *,
+     * uint64_t *) */
+    UPIPE_TS_PMTD_GET_CACHE_STATS,
+    /** returns the section of the current PMT (struct uref **) */
+    UPIPE_TS_PMTD_GET_TABLE
+};
+
+/** @This returns the statistics of the cache of PMT sections. Identical
+ * repetitions of the current PMT are found in the cache and dropped without
+ * being parsed.
+ *
+ * @param upipe description structure of the pipe
+ * @param hits_p filled in with the number of sections found in the cache
+ * @param misses_p filled in with the number of sections not found in the
+ * cache
+ * @return an error code
+ */
+static inline int upipe_ts_pmtd_get_cache_stats(struct upipe *upipe,
+                                                uint64_t *hits_p,
+                                                uint64_t *misses_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PMTD_GET_CACHE_STATS,
+                         UPIPE_TS_PMTD_SIGNATURE, hits_p, misses_p);
+}
+
+/** @This returns the section of the current PMT, in a new uref belonging
+ * to the caller.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref_p filled in with the section
+ * @return an error code
+ */
+static inline int upipe_ts_pmtd_get_table(struct upipe *upipe,
+                                          struct uref **uref_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PMTD_GET_TABLE,
+                         UPIPE_TS_PMTD_SIGNATURE, uref_p);
+}
+
 /** @This returns the management structure for all ts_pmtd pipes.
  *
  * @return pointer to manager
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module generating DVB SI tables (NIT, SDT, EIT p/f)
+ *
+ * The pipe is configured with a "void." flow definition carrying the TSID,
+ * and optionally the network ID, original network ID and network name.
+ * Services are subpipes configured with a "void." flow definition carrying
+ * the service ID, and optionally the name, provider, service type and
+ * present/following events.
+ *
+ * Tables are delivered to output subpipes, allocated from the manager
+ * returned by @ref upipe_ts_sig_get_output_mgr with a "void." flow
+ * definition whose PID selects the table (16 for the NIT, 17 for the SDT
+ * and 18 for the EIT). The sections are built once per version, and shared
+ * by all the output subpipes carrying the same table, so that several
+ * multiplexes with the same SI only pay for one generation. Each input
+ * packet triggers the output of the tables which changed since the last
+ * time to the output subpipes.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_SI_GENERATOR_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_SI_GENERATOR_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_TS_SIG_SIGNATURE UBASE_FOURCC('t','S','g',' ')
+#define UPIPE_TS_SIG_SERVICE_SIGNATURE UBASE_FOURCC('t','S','g','s')
+#define UPIPE_TS_SIG_OUTPUT_SIGNATURE UBASE_FOURCC('t','S','g','o')
+
+/** @This extends upipe_command with specific commands for ts_sig. */
+enum upipe_ts_sig_command {
+    UPIPE_TS_SIG_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the manager of output subpipes (struct upipe_mgr **) */
+    UPIPE_TS_SIG_GET_OUTPUT_MGR
+};
+
+/** @This returns the manager of output subpipes.
+ *
+ * @param upipe description structure of the pipe
+ * @param mgr_p filled in with the output manager
+ * @return an error code
+ */
+static inline int upipe_ts_sig_get_output_mgr(struct upipe *upipe,
+                                              struct upipe_mgr **mgr_p)
+{
+    return upipe_control(upipe, UPIPE_TS_SIG_GET_OUTPUT_MGR,
+                         UPIPE_TS_SIG_SIGNATURE, mgr_p);
+}
+
+/** @This allocates an output subpipe of a ts_sig pipe.
+ *
+ * @param upipe description structure of the super pipe
+ * @param uprobe structure used to raise events
+ * @param flow_def flow definition carrying the PID of the table
+ * @return pointer to allocated subpipe, or NULL in case of failure
+ */
+static inline struct upipe *upipe_ts_sig_alloc_output(struct upipe *upipe,
+                                                      struct uprobe *uprobe,
+                                                      struct uref *flow_def)
+{
+    struct upipe_mgr *output_mgr;
+    if (unlikely(!ubase_check(upipe_ts_sig_get_output_mgr(upipe,
+                                                          &output_mgr)))) {
+        uprobe_release(uprobe);
+        return NULL;
+    }
+    return upipe_flow_alloc(output_mgr, uprobe, flow_def);
+}
+
+/** @This returns the management structure for all ts_sig pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_sig_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -46,6 +46,10 @@ enum uprobe_ts_split_event {
 };
 
 /** @This returns the management structure for all ts_split pipes.
+ *
+ * Input urefs normally contain one TS packet. They may also aggregate
+ * several packets, in which case each run of consecutive packets of the same
+ * PID is output as one uref sharing the input buffer.
  *
  * @return pointer to manager
  */
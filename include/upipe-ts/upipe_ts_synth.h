@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module generating a synthetic TS or ES at a given
+ * octetrate, for load testing
+ *
+ * When allocated with a "block.mpegts." flow definition, the pipe outputs
+ * a valid transport stream made of a PAT, a PMT and a configurable number
+ * of elementary streams carrying PES of private data, the first of which
+ * also carries the PCR, padded with null packets to the octetrate. With
+ * any other block flow definition, it repeats the last uref it received
+ * in input (or zeroed MTU-sized blocks) at the octetrate.
+ *
+ * All packets are built once and shared between the output urefs, so that
+ * generating the stream has a negligible cost. The pipe runs as fast as
+ * possible unless @ref upipe_attach_uclock is called, in which case it is
+ * paced by the clock.
+ *
+ * The octetrate, MTU and PCR interval are set with the commands of
+ * @ref upipe_ts_mux_set_octetrate, @ref upipe_ts_mux_set_mtu and
+ * @ref upipe_ts_mux_set_pcr_interval.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_SYNTH_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_SYNTH_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_TS_SYNTH_SIGNATURE UBASE_FOURCC('t','s','s','n')
+/** maximum number of elementary streams fitting in a one-packet PMT */
+#define UPIPE_TS_SYNTH_MAX_PIDS 32
+
+/** @This extends upipe_command with specific commands for ts synth. */
+enum upipe_ts_synth_command {
+    UPIPE_TS_SYNTH_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the PID layout (uint16_t, unsigned int, const uint16_t *) */
+    UPIPE_TS_SYNTH_SET_PIDS
+};
+
+/** @This returns the management structure for all ts_synth pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_synth_mgr_alloc(void);
+
+/** @This sets the PID layout of the generated TS. The default is a PMT on
+ * PID 256 and a single elementary stream on PID 257.
+ *
+ * @param upipe description structure of the pipe
+ * @param pmt_pid PID of the PMT
+ * @param nb number of elementary streams, at most UPIPE_TS_SYNTH_MAX_PIDS
+ * @param pids array of nb PIDs of the elementary streams, the first carrying
+ * the PCR
+ * @return an error code
+ */
+static inline int upipe_ts_synth_set_pids(struct upipe *upipe,
+                                          uint16_t pmt_pid, unsigned int nb,
+                                          const uint16_t *pids)
+{
+    return upipe_control(upipe, UPIPE_TS_SYNTH_SET_PIDS,
+                         UPIPE_TS_SYNTH_SIGNATURE, (unsigned int)pmt_pid, nb,
+                         pids);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
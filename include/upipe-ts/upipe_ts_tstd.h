@@ -19,8 +19,15 @@
  */
 
 /** @file
- * @short Upipe module tstding that a buffer contains a given number of
- * aligned TS packets
+ * @short Upipe module calculating the T-STD buffering latency
+ *
+ * Along with the buffering delay, the module tags each access unit with
+ * the earliest date at which it may enter the T-STD without overflowing
+ * the elementary stream buffer, assuming the previous access units
+ * entered at their own earliest dates. Since the buffer is only emptied
+ * at decoding times, the data may be sent at any date between its
+ * earliest date and its DTS, which the mux uses to fill the multiplex
+ * ahead of time (see @ref upipe_ts_agg_set_tstd).
  */
 
 #ifndef _UPIPE_TS_UPIPE_TS_TSTD_H_
@@ -30,10 +37,130 @@
 extern "C" {
 #endif
 
+#include <upipe/uclock.h>
+#include <upipe/uref_attr.h>
 #include <upipe/upipe.h>
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
 #define UPIPE_TS_TSTD_SIGNATURE UBASE_FOURCC('t','s','t','d')
 
+/** size of the transport buffer TB of the T-STD, in octets */
+#define UPIPE_TS_TSTD_TB_SIZE 512
+
+UREF_ATTR_UNSIGNED(ts_tstd, early_sys, "t.tstd_early",
+        earliest system date at which the data may enter the T-STD)
+UREF_ATTR_UNSIGNED(ts_tstd, tb_rate, "t.tstd_tbrate", leak rate of TB)
+
+/** @This describes a buffer of the T-STD model emptied at a constant rate,
+ * such as the transport buffer TB of an elementary stream. All operations
+ * are O(1), so that the model may be updated on each TS packet. */
+struct upipe_ts_tstd_buffer {
+    /** size of the buffer, in octets */
+    uint64_t size;
+    /** leak rate, in octets per second */
+    uint64_t rate;
+    /** occupancy at the date of the last update, in octets */
+    uint64_t fullness;
+    /** date of the last update, or UINT64_MAX */
+    uint64_t date;
+    /** fraction of octet already leaked, in 1/UCLOCK_FREQ octets */
+    uint64_t remainder;
+};
+
+/** @This initializes an empty buffer.
+ *
+ * @param buffer pointer to the buffer
+ * @param size size of the buffer, in octets
+ * @param rate leak rate, in octets per second
+ */
+static inline void upipe_ts_tstd_buffer_init(struct upipe_ts_tstd_buffer *buffer,
+                                             uint64_t size, uint64_t rate)
+{
+    buffer->size = size;
+    buffer->rate = rate;
+    buffer->fullness = 0;
+    buffer->date = UINT64_MAX;
+    buffer->remainder = 0;
+}
+
+/** @This empties the buffer at its leak rate up to the given date. Dates
+ * before the last update are ignored.
+ *
+ * @param buffer pointer to the buffer
+ * @param date system date
+ */
+static inline void upipe_ts_tstd_buffer_leak(struct upipe_ts_tstd_buffer *buffer,
+                                             uint64_t date)
+{
+    if (buffer->date == UINT64_MAX || !buffer->fullness) {
+        if (buffer->date == UINT64_MAX || date > buffer->date)
+            buffer->date = date;
+        return;
+    }
+    if (date <= buffer->date)
+        return;
+    uint64_t duration = date - buffer->date;
+    buffer->date = date;
+
+    uint64_t leaked = buffer->fullness;
+    /* no T-STD buffer holds more than a few seconds */
+    if (duration < UCLOCK_FREQ * 60) {
+        lldiv_t q = lldiv(duration * buffer->rate + buffer->remainder,
+                          UCLOCK_FREQ);
+        leaked = q.quot;
+        buffer->remainder = q.rem;
+    }
+    if (leaked >= buffer->fullness) {
+        buffer->fullness = 0;
+        buffer->remainder = 0;
+    } else
+        buffer->fullness -= leaked;
+}
+
+/** @This returns the first date, at or after the given date, at which the
+ * given number of octets fit in the buffer.
+ *
+ * @param buffer pointer to the buffer
+ * @param date system date
+ * @param octets number of octets to enter the buffer
+ * @return system date, or UINT64_MAX if the octets never fit
+ */
+static inline uint64_t
+    upipe_ts_tstd_buffer_next(const struct upipe_ts_tstd_buffer *buffer,
+                              uint64_t date, uint64_t octets)
+{
+    if (octets > buffer->size)
+        return UINT64_MAX;
+    struct upipe_ts_tstd_buffer leaked = *buffer;
+    upipe_ts_tstd_buffer_leak(&leaked, date);
+    if (leaked.fullness + octets <= leaked.size)
+        return leaked.date;
+    if (!leaked.rate)
+        return UINT64_MAX;
+    uint64_t excess = leaked.fullness + octets - leaked.size;
+    return leaked.date + (excess * UCLOCK_FREQ - leaked.remainder +
+                          leaked.rate - 1) / leaked.rate;
+}
+
+/** @This adds octets to the buffer, at the date of the last update.
+ *
+ * @param buffer pointer to the buffer
+ * @param octets number of octets entering the buffer
+ * @return false if the buffer overflowed, in which case it is left full
+ */
+static inline bool upipe_ts_tstd_buffer_fill(struct upipe_ts_tstd_buffer *buffer,
+                                             uint64_t octets)
+{
+    buffer->fullness += octets;
+    if (buffer->fullness <= buffer->size)
+        return true;
+    buffer->fullness = buffer->size;
+    return false;
+}
+
 /** @This returns the management structure for all ts_tstd pipes.
  *
  * @return pointer to manager
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe attributes for TS bundles
+ * A TS bundle is a uref carrying several consecutive 188-octet TS packets,
+ * along with a packed array describing the header of each packet, so that
+ * pipes may process the packets without parsing them again.
+ */
+
+#ifndef _UPIPE_UREF_TS_BUNDLE_H_
+/** @hidden */
+#define _UPIPE_UREF_TS_BUNDLE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/uref.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+
+#include <string.h>
+#include <stdint.h>
+
+/** size of a TS packet in a bundle */
+#define UREF_TS_BUNDLE_PKT_SIZE 188
+/** maximum number of packets in a bundle */
+#define UREF_TS_BUNDLE_MAX_PKTS \
+    (UINT16_MAX / sizeof(struct uref_ts_bundle_pkt))
+
+/** @This defines the flags describing a packet of a bundle. */
+enum uref_ts_bundle_flag {
+    /** payload unit start indicator */
+    UREF_TS_BUNDLE_UNITSTART = 0x1,
+    /** packet has a payload */
+    UREF_TS_BUNDLE_PAYLOAD = 0x2,
+    /** packet has an adaptation field */
+    UREF_TS_BUNDLE_ADAPTATION = 0x4,
+    /** adaptation field carries a PCR */
+    UREF_TS_BUNDLE_PCR = 0x8,
+    /** adaptation field flags a discontinuity */
+    UREF_TS_BUNDLE_DISCONTINUITY = 0x10,
+    /** transport error indicator */
+    UREF_TS_BUNDLE_ERROR = 0x20
+};
+
+/** @This describes a packet of a bundle. */
+struct uref_ts_bundle_pkt {
+    /** PCR in 27 MHz units, if UREF_TS_BUNDLE_PCR is set */
+    uint64_t pcr;
+    /** PID */
+    uint16_t pid;
+    /** continuity counter */
+    uint8_t cc;
+    /** flags (@see uref_ts_bundle_flag) */
+    uint8_t flags;
+    /** offset of the payload in the packet */
+    uint8_t payload;
+};
+
+/** @This describes the dates of a packet of a bundle, when the packets
+ * are not to be output at the same time. */
+struct uref_ts_bundle_date {
+    /** clock reference in system time */
+    uint64_t cr_sys;
+    /** delay between clock reference and DTS */
+    uint64_t cr_dts_delay;
+};
+
+UREF_ATTR_OPAQUE(ts_bundle, pkts_internal, "t.bundle", bundle description)
+UREF_ATTR_OPAQUE(ts_bundle, dates_internal, "t.bundle_dates", bundle dates)
+
+/** @This returns the number of packets described in a bundle.
+ *
+ * @param uref pointer to the uref
+ * @param nb_p filled in with the number of packets
+ * @return an error code
+ */
+static inline int uref_ts_bundle_get_nb(struct uref *uref, unsigned int *nb_p)
+{
+    const uint8_t *attr;
+    size_t size;
+    UBASE_RETURN(uref_ts_bundle_get_pkts_internal(uref, &attr, &size))
+    if (unlikely(size % sizeof(struct uref_ts_bundle_pkt)))
+        return UBASE_ERR_INVALID;
+    *nb_p = size / sizeof(struct uref_ts_bundle_pkt);
+    return UBASE_ERR_NONE;
+}
+
+/** @This copies the descriptions of packets of a bundle. As attributes are
+ * not aligned, they can't be accessed in place.
+ *
+ * @param uref pointer to the uref
+ * @param first index of the first packet to copy
+ * @param nb number of packets to copy
+ * @param pkts caller-allocated array of nb descriptions
+ * @return an error code
+ */
+static inline int uref_ts_bundle_read(struct uref *uref, unsigned int first,
+                                      unsigned int nb,
+                                      struct uref_ts_bundle_pkt *pkts)
+{
+    const uint8_t *attr;
+    size_t size;
+    UBASE_RETURN(uref_ts_bundle_get_pkts_internal(uref, &attr, &size))
+    if (unlikely((first + nb) * sizeof(struct uref_ts_bundle_pkt) > size))
+        return UBASE_ERR_INVALID;
+    memcpy(pkts, attr + first * sizeof(struct uref_ts_bundle_pkt),
+           nb * sizeof(struct uref_ts_bundle_pkt));
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets the descriptions of the packets of a bundle.
+ *
+ * @param uref pointer to the uref
+ * @param pkts array of nb descriptions
+ * @param nb number of packets in the uref
+ * @return an error code
+ */
+static inline int uref_ts_bundle_set(struct uref *uref,
+                                     const struct uref_ts_bundle_pkt *pkts,
+                                     unsigned int nb)
+{
+    if (unlikely(nb > UREF_TS_BUNDLE_MAX_PKTS))
+        return UBASE_ERR_INVALID;
+    return uref_ts_bundle_set_pkts_internal(uref, (const uint8_t *)pkts,
+            nb * sizeof(struct uref_ts_bundle_pkt));
+}
+
+/** @This copies the dates of packets of a bundle.
+ *
+ * @param uref pointer to the uref
+ * @param first index of the first packet to copy
+ * @param nb number of packets to copy
+ * @param dates caller-allocated array of nb dates
+ * @return an error code
+ */
+static inline int uref_ts_bundle_read_dates(struct uref *uref,
+                                            unsigned int first,
+                                            unsigned int nb,
+                                            struct uref_ts_bundle_date *dates)
+{
+    const uint8_t *attr;
+    size_t size;
+    UBASE_RETURN(uref_ts_bundle_get_dates_internal(uref, &attr, &size))
+    if (unlikely((first + nb) * sizeof(struct uref_ts_bundle_date) > size))
+        return UBASE_ERR_INVALID;
+    memcpy(dates, attr + first * sizeof(struct uref_ts_bundle_date),
+           nb * sizeof(struct uref_ts_bundle_date));
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets the dates of the packets of a bundle. The dates of the uref
+ * itself are those of the first packet.
+ *
+ * @param uref pointer to the uref
+ * @param dates array of nb dates
+ * @param nb number of packets in the uref
+ * @return an error code
+ */
+static inline int uref_ts_bundle_set_dates(struct uref *uref,
+                                      const struct uref_ts_bundle_date *dates,
+                                      unsigned int nb)
+{
+    if (unlikely(nb > UREF_TS_BUNDLE_MAX_PKTS))
+        return UBASE_ERR_INVALID;
+    return uref_ts_bundle_set_dates_internal(uref, (const uint8_t *)dates,
+            nb * sizeof(struct uref_ts_bundle_date));
+}
+
+/** @This deletes the descriptions of the packets of a bundle.
+ *
+ * @param uref pointer to the uref
+ * @return an error code
+ */
+static inline int uref_ts_bundle_delete(struct uref *uref)
+{
+    uref_ts_bundle_delete_dates_internal(uref);
+    return uref_ts_bundle_delete_pkts_internal(uref);
+}
+
+/** @internal @This moves the dates of a uref to the given packet dates,
+ * keeping the offsets between system, program and original dates.
+ *
+ * @param uref pointer to the uref
+ * @param date dates of the packet
+ */
+static inline void uref_ts_bundle_rebase(struct uref *uref,
+                                         const struct uref_ts_bundle_date *date)
+{
+    uint64_t cr_sys, cr;
+    if (ubase_check(uref_clock_get_cr_sys(uref, &cr_sys))) {
+        uint64_t offset = date->cr_sys - cr_sys;
+        if (ubase_check(uref_clock_get_cr_prog(uref, &cr)))
+            uref_clock_set_cr_prog(uref, cr + offset);
+        if (ubase_check(uref_clock_get_cr_orig(uref, &cr)))
+            uref_clock_set_cr_orig(uref, cr + offset);
+    }
+    uref_clock_set_cr_sys(uref, date->cr_sys);
+    uref_clock_set_cr_dts_delay(uref, date->cr_dts_delay);
+}
+
+/** @This allocates a new uref containing a single packet of a bundle,
+ * sharing the buffer of the original uref. If the bundle carries dates,
+ * the dates of the packet are restored, and the clock reference flag is set
+ * on packets carrying a PCR.
+ *
+ * @param uref pointer to the bundle
+ * @param index index of the packet
+ * @return pointer to the new uref, or NULL in case of error
+ */
+static inline struct uref *uref_ts_bundle_extract(struct uref *uref,
+                                                  unsigned int index)
+{
+    struct uref_ts_bundle_pkt pkt;
+    struct uref_ts_bundle_date date;
+    if (unlikely(!ubase_check(uref_ts_bundle_read(uref, index, 1, &pkt))))
+        return NULL;
+    bool dated = ubase_check(uref_ts_bundle_read_dates(uref, index, 1, &date));
+
+    struct uref *new_uref = uref_block_splice(uref,
+            index * UREF_TS_BUNDLE_PKT_SIZE, UREF_TS_BUNDLE_PKT_SIZE);
+    if (unlikely(new_uref == NULL))
+        return NULL;
+    uref_ts_bundle_delete(new_uref);
+    if (!dated)
+        return new_uref;
+
+    uref_ts_bundle_rebase(new_uref, &date);
+    if (pkt.flags & UREF_TS_BUNDLE_PCR)
+        uref_clock_set_ref(new_uref);
+    else
+        uref_clock_delete_ref(new_uref);
+    return new_uref;
+}
+
+/** @This allocates a new uref pointing to a run of packets of a bundle,
+ * sharing the buffer of the original uref.
+ *
+ * @param uref pointer to the bundle
+ * @param first index of the first packet of the run
+ * @param nb number of packets in the run
+ * @return pointer to the new bundle, or NULL in case of error
+ */
+static inline struct uref *uref_ts_bundle_splice(struct uref *uref,
+                                                 unsigned int first,
+                                                 unsigned int nb)
+{
+    struct uref_ts_bundle_pkt pkts[nb];
+    if (unlikely(!ubase_check(uref_ts_bundle_read(uref, first, nb, pkts))))
+        return NULL;
+    struct uref *new_uref = uref_block_splice(uref,
+            first * UREF_TS_BUNDLE_PKT_SIZE, nb * UREF_TS_BUNDLE_PKT_SIZE);
+    if (unlikely(new_uref == NULL))
+        return NULL;
+    if (unlikely(!ubase_check(uref_ts_bundle_set(new_uref, pkts, nb)))) {
+        uref_free(new_uref);
+        return NULL;
+    }
+
+    struct uref_ts_bundle_date dates[nb];
+    if (ubase_check(uref_ts_bundle_read_dates(uref, first, nb, dates))) {
+        if (unlikely(!ubase_check(uref_ts_bundle_set_dates(new_uref, dates,
+                                                           nb)))) {
+            uref_free(new_uref);
+            return NULL;
+        }
+        uref_ts_bundle_rebase(new_uref, &dates[0]);
+    }
+    return new_uref;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
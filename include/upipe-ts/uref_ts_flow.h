@@ -44,6 +44,7 @@ UREF_ATTR_UNSIGNED(ts_flow, pid, "t.pid", PID)
 UREF_ATTR_UNSIGNED(ts_flow, pcr_pid, "t.pcr_pid", PCR PID)
 UREF_ATTR_UNSIGNED(ts_flow, ts_delay, "t.ts_delay", T-STD TS delay (TB buffer))
 UREF_ATTR_UNSIGNED(ts_flow, max_delay, "t.maxdelay", maximum retention time)
+UREF_ATTR_UNSIGNED(ts_flow, pcr_interval, "t.pcrinterval", PCR interval)
 UREF_ATTR_UNSIGNED(ts_flow, tb_rate, "t.tbrate", T-STD TB emptying rate)
 UREF_ATTR_OPAQUE(ts_flow, psi_filter_internal, "t.psi.filter", PSI filter)
 UREF_ATTR_SMALL_UNSIGNED(ts_flow, pes_id, "t.pes_id", PES stream ID)
@@ -67,6 +68,22 @@ UREF_ATTR_SMALL_UNSIGNED_VA(ts_flow, sub_composition, "t.subcomp[%"PRIu8"]",
         subtitling composition page according to EN 300 468, uint8_t nb, nb)
 UREF_ATTR_SMALL_UNSIGNED_VA(ts_flow, sub_ancillary, "t.subanc[%"PRIu8"]",
         subtitling ancillary page according to EN 300 468, uint8_t nb, nb)
+UREF_ATTR_UNSIGNED(ts_flow, nid, "t.nid", network ID)
+UREF_ATTR_UNSIGNED(ts_flow, onid, "t.onid", original network ID)
+UREF_ATTR_STRING(ts_flow, network_name, "t.netname", network name)
+UREF_ATTR_STRING(ts_flow, provider_name, "t.provname", service provider name)
+UREF_ATTR_SMALL_UNSIGNED(ts_flow, service_type, "t.servtype",
+        service type according to EN 300 468)
+UREF_ATTR_SMALL_UNSIGNED(ts_flow, events, "t.events",
+        number of events (present and following))
+UREF_ATTR_UNSIGNED_VA(ts_flow, event_id, "t.evid[%"PRIu8"]", event ID,
+        uint8_t nb, nb)
+UREF_ATTR_UNSIGNED_VA(ts_flow, event_start, "t.evstart[%"PRIu8"]",
+        event start time in seconds since the Epoch (UTC), uint8_t nb, nb)
+UREF_ATTR_UNSIGNED_VA(ts_flow, event_duration, "t.evdur[%"PRIu8"]",
+        event duration in seconds, uint8_t nb, nb)
+UREF_ATTR_STRING_VA(ts_flow, event_name, "t.evname[%"PRIu8"]", event name,
+        uint8_t nb, nb)
 
 /** @This returns the value of a PSI section filter.
  *
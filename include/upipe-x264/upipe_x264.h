@@ -27,6 +27,10 @@
 
 /** @file
  * @short Upipe x264 module
+ *
+ * The pipe answers @ref upipe_encoder_set_octetrate in ABR mode, and
+ * reports the complexity of each group of pictures for statistical
+ * multiplexing (see @ref uprobe_statmux).
  */
 
 #ifndef _UPIPE_MODULES_UPIPE_X264_H_
@@ -40,6 +44,16 @@ extern "C" {
 
 #define UPIPE_X264_SIGNATURE UBASE_FOURCC('x','2','6','4')
 
+/** @This defines the latency modes of the encoder. */
+enum upipe_x264_latency_mode {
+    /** maximum throughput: frame threads and lookahead (reported latency
+     * includes the delayed frames) */
+    UPIPE_X264_LATENCY_THROUGHPUT,
+    /** low latency: sliced threads, no lookahead, no B frames and periodic
+     * intra refresh instead of IDR frames */
+    UPIPE_X264_LATENCY_LOW
+};
+
 /** @This extends upipe_command with specific commands for x264. */
 enum upipe_x264_command {
     UPIPE_X264_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -60,7 +74,14 @@ enum upipe_x264_command {
     UPIPE_X264_SET_PROFILE,
 
     /** switches to speedcontrol mode with the given latency (uint64_t) */
-    UPIPE_X264_SET_SC_LATENCY
+    UPIPE_X264_SET_SC_LATENCY,
+
+    /** sets the number of threads and sliced threads mode
+     * (unsigned int, bool) */
+    UPIPE_X264_SET_THREADS,
+
+    /** sets the latency mode (int) */
+    UPIPE_X264_SET_LATENCY_MODE
 };
 
 /** @This reconfigures encoder with updated parameters.
@@ -134,6 +155,38 @@ static inline bool upipe_x264_set_sc_latency(struct upipe *upipe,
                          sc_latency);
 }
 
+/** @This sets the number of threads, and whether they encode slices of the
+ * same frame (sliced threads, without added latency) or several frames
+ * (frame threads, adding one frame of latency per thread). It must be called
+ * before the encoder is opened.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads, or 0 for automatic
+ * @param sliced true for sliced threads
+ * @return an error code
+ */
+static inline int upipe_x264_set_threads(struct upipe *upipe,
+                                         unsigned int threads, bool sliced)
+{
+    return upipe_control(upipe, UPIPE_X264_SET_THREADS, UPIPE_X264_SIGNATURE,
+                         threads, sliced ? 1 : 0);
+}
+
+/** @This sets the latency mode, on top of the current preset. It must be
+ * called before the encoder is opened. The resulting latency is reported in
+ * the output flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param mode latency mode (@see upipe_x264_latency_mode)
+ * @return an error code
+ */
+static inline int upipe_x264_set_latency_mode(struct upipe *upipe,
+                                        enum upipe_x264_latency_mode mode)
+{
+    return upipe_control(upipe, UPIPE_X264_SET_LATENCY_MODE,
+                         UPIPE_X264_SIGNATURE, mode);
+}
+
 /** @This returns the management structure for x264 pipes.
  *
  * @return pointer to manager
@@ -56,6 +56,15 @@ typedef volatile uint32_t uatomic_uint32_t;
 /** @This defines an atomic pointer. */
 typedef void * volatile uatomic_ptr_t;
 
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+/** @This is defined if 64-bits atomic operations are available. */
+#define UATOMIC_HAVE_64
+
+/** @This defines an atomic 64-bits unsigned integer, only available with
+ * @ref UATOMIC_HAVE_64. */
+typedef volatile uint64_t uatomic_uint64_t;
+#endif
+
 /** @This defines a set of functions to manipulate atomic variables. */
 #define UATOMIC_TEMPLATE(type, ctype, atomictype)                           \
 /** @This initializes a uatomic variable. It must be executed before any    \
@@ -116,6 +125,9 @@ static inline void type##_clean(atomictype *obj)                            \
 }
 UATOMIC_TEMPLATE(uatomic, uint32_t, uatomic_uint32_t)
 UATOMIC_TEMPLATE(uatomic_ptr, void *, uatomic_ptr_t)
+#ifdef UATOMIC_HAVE_64
+UATOMIC_TEMPLATE(uatomic64, uint64_t, uatomic_uint64_t)
+#endif
 #undef UATOMIC_TEMPLATE
 
 /** @This increments a uatomic variable.
@@ -142,6 +154,20 @@ static inline uint32_t uatomic_fetch_sub(uatomic_uint32_t *obj,
     return __sync_fetch_and_sub(obj, operand);
 }
 
+#ifdef UATOMIC_HAVE_64
+/** @This increments a 64-bits uatomic variable.
+ *
+ * @param obj pointer to a uatomic variable
+ * @param operand value to add
+ * @return value before the operation
+ */
+static inline uint64_t uatomic64_fetch_add(uatomic_uint64_t *obj,
+                                           uint64_t operand)
+{
+    return __sync_fetch_and_add(obj, operand);
+}
+#endif
+
 
 #elif defined(UPIPE_HAVE_SEMAPHORE_H) /* mkdoc:skip */
 
@@ -195,6 +221,8 @@ static inline void type##_clean(atomictype *obj)                            \
 }
 UATOMIC_TEMPLATE(uatomic, uint32_t, uatomic_uint32_t)
 UATOMIC_TEMPLATE(uatomic_ptr, void *, uatomic_ptr_t)
+#define UATOMIC_HAVE_64
+UATOMIC_TEMPLATE(uatomic64, uint64_t, uatomic_uint64_t)
 #undef UATOMIC_TEMPLATE
 
 static inline uint32_t uatomic_fetch_add(uatomic_uint32_t *obj,
@@ -219,6 +247,17 @@ static inline uint32_t uatomic_fetch_sub(uatomic_uint32_t *obj,
     return ret;
 }
 
+static inline uint64_t uatomic64_fetch_add(uatomic_uint64_t *obj,
+                                           uint64_t operand)
+{
+    uint64_t ret;
+    while (sem_wait(&obj->lock) == -1);
+    ret = obj->value;
+    obj->value += operand;
+    sem_post(&obj->lock);
+    return ret;
+}
+
 
 
 #else /* mkdoc:skip */
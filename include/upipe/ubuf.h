@@ -47,6 +47,8 @@ extern "C" {
 struct ubuf_mgr;
 /** @hidden */
 struct uref;
+/** @hidden */
+struct upool_stats;
 
 /** @This is allocated by a manager and eventually points to a buffer
  * containing data. */
@@ -138,6 +140,12 @@ enum ubuf_mgr_command {
     UBUF_MGR_CHECK,
     /** release all buffers kept in pools (void) */
     UBUF_MGR_VACUUM,
+    /** get the statistics of the ubuf and shared pools
+     * (struct upool_stats *, struct upool_stats *) */
+    UBUF_MGR_GET_POOL_STATS,
+    /** change the depths of the ubuf and shared pools
+     * (unsigned int, unsigned int) */
+    UBUF_MGR_RESIZE_POOL,
 
     /** non-standard commands implemented by a ubuf manager can start from
      * there */
@@ -324,6 +332,39 @@ static inline int ubuf_mgr_vacuum(struct ubuf_mgr *mgr)
     return ubuf_mgr_control(mgr, UBUF_MGR_VACUUM);
 }
 
+/** @This returns the statistics of the pools of an existing ubuf manager.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param ubuf_stats_p filled in with the statistics of the ubuf pool
+ * @param shared_stats_p filled in with the statistics of the shared pool
+ * @return an error code
+ */
+static inline int ubuf_mgr_get_pool_stats(struct ubuf_mgr *mgr,
+                                          struct upool_stats *ubuf_stats_p,
+                                          struct upool_stats *shared_stats_p)
+{
+    return ubuf_mgr_control(mgr, UBUF_MGR_GET_POOL_STATS, ubuf_stats_p,
+                            shared_stats_p);
+}
+
+/** @This changes the depths of the pools of an existing ubuf manager, within
+ * the depths given at allocation. Structures in excess are released.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param ubuf_pool_depth new maximum number of ubuf structures in the pool
+ * @param shared_pool_depth new maximum number of shared structures in the
+ * pool
+ * @return an error code
+ */
+static inline int ubuf_mgr_resize_pool(struct ubuf_mgr *mgr,
+                                       uint16_t ubuf_pool_depth,
+                                       uint16_t shared_pool_depth)
+{
+    return ubuf_mgr_control(mgr, UBUF_MGR_RESIZE_POOL,
+                            (unsigned int)ubuf_pool_depth,
+                            (unsigned int)shared_pool_depth);
+}
+
 #ifdef __cplusplus
 }
 #endif
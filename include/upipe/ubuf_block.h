@@ -72,6 +72,18 @@ struct ubuf_block {
     struct ubuf *cached_ubuf;
     /** cached last offset */
     size_t cached_offset;
+    /** previously cached ubuf */
+    struct ubuf *prev_cached_ubuf;
+    /** previously cached offset */
+    size_t prev_cached_offset;
+
+    /** number of segments in the chain (only valid in the first segment) */
+    unsigned int segments;
+    /** number of segments past which appended segments are coalesced,
+     * or 0 */
+    unsigned int max_segments;
+    /** maximum size of coalesced segments */
+    unsigned int coalesce_size;
 
     /** common structure */
     struct ubuf ubuf;
@@ -130,9 +142,16 @@ static inline struct ubuf *ubuf_block_get(struct ubuf *ubuf, int *offset_p,
     if (size_p != NULL && *size_p == -1)
         *size_p = block->total_size - *offset_p;
 
-    if (block->cached_offset <= *offset_p) {
-        *offset_p -= block->cached_offset;
-        ubuf = block->cached_ubuf;
+    /* start from the closest cached segment, so that both sequential
+     * accesses and accesses alternating between two areas (typically the
+     * beginning of a frame and a scan position) don't walk the chain */
+    if (head_block->cached_offset <= *offset_p) {
+        *offset_p -= head_block->cached_offset;
+        ubuf = head_block->cached_ubuf;
+        block = ubuf_block_from_ubuf(ubuf);
+    } else if (head_block->prev_cached_offset <= *offset_p) {
+        *offset_p -= head_block->prev_cached_offset;
+        ubuf = head_block->prev_cached_ubuf;
         block = ubuf_block_from_ubuf(ubuf);
     }
 
@@ -144,8 +163,12 @@ static inline struct ubuf *ubuf_block_get(struct ubuf *ubuf, int *offset_p,
         block = ubuf_block_from_ubuf(ubuf);
     }
 
-    head_block->cached_ubuf = ubuf;
-    head_block->cached_offset = saved_offset - *offset_p;
+    if (ubuf != head_block->cached_ubuf) {
+        head_block->prev_cached_ubuf = head_block->cached_ubuf;
+        head_block->prev_cached_offset = head_block->cached_offset;
+        head_block->cached_ubuf = ubuf;
+        head_block->cached_offset = saved_offset - *offset_p;
+    }
     return ubuf;
 }
 
@@ -262,7 +285,40 @@ static inline int ubuf_block_unmap(struct ubuf *ubuf, int offset)
     return UBASE_ERR_NONE;
 }
 
+/** @hidden */
+static inline int ubuf_block_coalesce(struct ubuf *ubuf, size_t coalesce_size);
+
+/** @internal @This resets the cached segments of a block ubuf, after the
+ * chain has been modified.
+ *
+ * @param ubuf pointer to head ubuf
+ */
+static inline void ubuf_block_reset_cache(struct ubuf *ubuf)
+{
+    struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
+    block->cached_ubuf = block->prev_cached_ubuf = ubuf;
+    block->cached_offset = block->prev_cached_offset = 0;
+}
+
+/** @internal @This counts the segments of a block ubuf, and stores the
+ * result in the first segment.
+ *
+ * @param ubuf pointer to ubuf
+ */
+static inline void ubuf_block_count(struct ubuf *ubuf)
+{
+    struct ubuf_block *head_block = ubuf_block_from_ubuf(ubuf);
+    struct ubuf_block *block = head_block;
+    head_block->segments = 1;
+    while (block->next_ubuf != NULL) {
+        block = ubuf_block_from_ubuf(block->next_ubuf);
+        head_block->segments++;
+    }
+}
+
 /** @This appends a new ubuf at the end of a segmented-to-be block ubuf.
+ * If the ubuf then has more segments than allowed by its manager, adjacent
+ * small segments are coalesced (see @ref ubuf_block_coalesce).
  *
  * @param ubuf pointer to ubuf
  * @param append pointer to ubuf to be appended; it must no longer be used
@@ -275,9 +331,12 @@ static inline int ubuf_block_append(struct ubuf *ubuf, struct ubuf *append)
                  append->mgr->signature != UBUF_ALLOC_BLOCK))
         return UBASE_ERR_INVALID;
 
-    struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
+    struct ubuf *head = ubuf;
+    struct ubuf_block *head_block = ubuf_block_from_ubuf(ubuf);
+    struct ubuf_block *block = head_block;
     struct ubuf_block *append_block = ubuf_block_from_ubuf(append);
     block->total_size += append_block->total_size;
+    block->segments += append_block->segments;
 
     if (block->cached_ubuf != NULL) {
         ubuf = block->cached_ubuf;
@@ -288,6 +347,15 @@ static inline int ubuf_block_append(struct ubuf *ubuf, struct ubuf *append)
         block = ubuf_block_from_ubuf(ubuf);
     }
     block->next_ubuf = append;
+
+    if (unlikely(head_block->max_segments &&
+                 head_block->segments > head_block->max_segments)) {
+        ubuf_block_coalesce(head, head_block->coalesce_size);
+        /* segments too large to be coalesced: do not walk them again
+         * at each append */
+        if (head_block->segments > head_block->max_segments / 2)
+            head_block->max_segments = head_block->segments * 2;
+    }
     return UBASE_ERR_NONE;
 }
 
@@ -347,9 +415,15 @@ static inline int ubuf_block_insert(struct ubuf *ubuf, int offset,
     struct ubuf_block *insert_block = ubuf_block_from_ubuf(insert);
     head_block->total_size += insert_block->total_size;
 
-    if (block->next_ubuf != NULL)
-        ubuf_block_append(insert, block->next_ubuf);
+    struct ubuf_block *last_block = insert_block;
+    while (last_block->next_ubuf != NULL)
+        last_block = ubuf_block_from_ubuf(last_block->next_ubuf);
+    last_block->next_ubuf = block->next_ubuf;
     block->next_ubuf = insert;
+    ubuf_block_count(ubuf_block_to_ubuf(head_block));
+    /* the cached segment contains the offset and hasn't moved */
+    head_block->prev_cached_ubuf = ubuf_block_to_ubuf(head_block);
+    head_block->prev_cached_offset = 0;
     return UBASE_ERR_NONE;
 }
 
@@ -386,6 +460,7 @@ static inline int ubuf_block_delete(struct ubuf *ubuf, int offset, int size)
                 if (unlikely(!ubuf_block_split(ubuf, offset + size)))
                     return UBASE_ERR_INVALID;
 
+                head_block->segments++;
                 block->size = offset;
                 goto ubuf_block_delete_done;
             }
@@ -402,6 +477,9 @@ static inline int ubuf_block_delete(struct ubuf *ubuf, int offset, int size)
 
 ubuf_block_delete_done:
     head_block->total_size -= delete_size;
+    /* the cached segment contains the offset and hasn't moved */
+    head_block->prev_cached_ubuf = ubuf_block_to_ubuf(head_block);
+    head_block->prev_cached_offset = 0;
     return UBASE_ERR_NONE;
 }
 
@@ -424,8 +502,8 @@ static inline int ubuf_block_truncate(struct ubuf *ubuf, int offset)
         }
         head_block->size = 0;
         head_block->total_size = 0;
-        head_block->cached_ubuf = &head_block->ubuf;
-        head_block->cached_offset = 0;
+        ubuf_block_reset_cache(&head_block->ubuf);
+        head_block->segments = 1;
         return UBASE_ERR_NONE;
     }
 
@@ -441,8 +519,8 @@ static inline int ubuf_block_truncate(struct ubuf *ubuf, int offset)
     }
     block->size = offset + 1;
     head_block->total_size = saved_size;
-    head_block->cached_ubuf = &head_block->ubuf;
-    head_block->cached_offset = 0;
+    ubuf_block_reset_cache(&head_block->ubuf);
+    ubuf_block_count(&head_block->ubuf);
     return UBASE_ERR_NONE;
 }
 
@@ -812,6 +890,78 @@ static inline int ubuf_block_merge(struct ubuf_mgr *mgr, struct ubuf **ubuf_p,
     return UBASE_ERR_NONE;
 }
 
+/** @This merges runs of adjacent segments of a block ubuf into newly
+ * allocated segments of at most coalesce_size octets, so that the chain
+ * stays short enough to be walked and written with a few iovecs. The first
+ * segment and the segments larger than coalesce_size are kept. The ubuf
+ * must not be mapped.
+ *
+ * @param ubuf pointer to ubuf
+ * @param coalesce_size maximum size of coalesced segments
+ * @return an error code
+ */
+static inline int ubuf_block_coalesce(struct ubuf *ubuf, size_t coalesce_size)
+{
+    if (unlikely(ubuf->mgr->signature != UBUF_ALLOC_BLOCK))
+        return UBASE_ERR_INVALID;
+
+    struct ubuf_block *head_block = ubuf_block_from_ubuf(ubuf);
+    struct ubuf_block *prev_block = head_block;
+    size_t offset = head_block->size;
+    int err = UBASE_ERR_NONE;
+    while (prev_block->next_ubuf != NULL) {
+        struct ubuf *first = prev_block->next_ubuf;
+        struct ubuf_block *last_block = ubuf_block_from_ubuf(first);
+        size_t run_size = last_block->size;
+        unsigned int run = 1;
+        while (last_block->next_ubuf != NULL) {
+            struct ubuf_block *next_block =
+                ubuf_block_from_ubuf(last_block->next_ubuf);
+            if (run_size + next_block->size > coalesce_size)
+                break;
+            run_size += next_block->size;
+            last_block = next_block;
+            run++;
+        }
+
+        if (run > 1) {
+            struct ubuf *merged = ubuf_block_alloc(ubuf->mgr, run_size);
+            if (unlikely(merged == NULL)) {
+                err = UBASE_ERR_ALLOC;
+                break;
+            }
+            if (run_size) {
+                int size = run_size;
+                uint8_t *buffer;
+                if (likely(ubase_check(err = ubuf_block_write(merged, 0, &size,
+                                                              &buffer)))) {
+                    err = ubuf_block_extract(ubuf, offset, run_size, buffer);
+                    ubuf_block_unmap(merged, 0);
+                }
+                if (unlikely(!ubase_check(err))) {
+                    ubuf_free(merged);
+                    break;
+                }
+            }
+
+            struct ubuf_block *merged_block = ubuf_block_from_ubuf(merged);
+            merged_block->next_ubuf = last_block->next_ubuf;
+            last_block->next_ubuf = NULL;
+            prev_block->next_ubuf = merged;
+            ubuf_free(first);
+            last_block = merged_block;
+            /* the cache may point to a released segment */
+            ubuf_block_reset_cache(ubuf);
+            head_block->cached_ubuf = merged;
+            head_block->cached_offset = offset;
+        }
+        offset += run_size;
+        prev_block = last_block;
+    }
+    ubuf_block_count(ubuf);
+    return err;
+}
+
 /** @This compares the content of a block ubuf in a larger ubuf.
  *
  * @param ubuf pointer to large ubuf
@@ -60,6 +60,12 @@ static inline void ubuf_block_common_init(struct ubuf *ubuf, bool map)
 
     block->cached_ubuf = ubuf;
     block->cached_offset = 0;
+    block->prev_cached_ubuf = ubuf;
+    block->prev_cached_offset = 0;
+
+    block->segments = 1;
+    block->max_segments = 0;
+    block->coalesce_size = 0;
     uchain_init(&ubuf->uchain);
 }
 
@@ -108,6 +114,10 @@ static inline int ubuf_block_common_dup(struct ubuf *ubuf,
     new_block->buffer = block->buffer;
     new_block->cached_ubuf = new_ubuf;
     new_block->cached_offset = 0;
+    new_block->prev_cached_ubuf = new_ubuf;
+    new_block->prev_cached_offset = 0;
+    new_block->max_segments = block->max_segments;
+    new_block->coalesce_size = block->coalesce_size;
 
     struct ubuf *next_ubuf = block->next_ubuf;
     while (next_ubuf != NULL) {
@@ -121,6 +131,7 @@ static inline int ubuf_block_common_dup(struct ubuf *ubuf,
         new_block = ubuf_block_from_ubuf(new_block->next_ubuf);
         next_ubuf = saved_ubuf;
     }
+    ubuf_block_count(new_ubuf);
     return UBASE_ERR_NONE;
 }
 
@@ -149,6 +160,10 @@ static inline int ubuf_block_common_splice(struct ubuf *ubuf,
     size -= new_block->size;
     new_block->cached_ubuf = new_ubuf;
     new_block->cached_offset = 0;
+    new_block->prev_cached_ubuf = new_ubuf;
+    new_block->prev_cached_offset = 0;
+    new_block->max_segments = block->max_segments;
+    new_block->coalesce_size = block->coalesce_size;
 
     if (size > 0) {
         struct ubuf *next_ubuf = block->next_ubuf;
@@ -173,6 +188,7 @@ static inline int ubuf_block_common_splice(struct ubuf *ubuf,
                                                              0, size)) == NULL))
             return UBASE_ERR_ALLOC;
     }
+    ubuf_block_count(new_ubuf);
     return UBASE_ERR_NONE;
 }
 
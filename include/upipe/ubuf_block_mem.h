@@ -42,6 +42,66 @@ extern "C" {
 
 /** @hidden */
 struct umem_mgr;
+/** @hidden */
+struct umem;
+
+/** @This is a simple signature to allocate a block around an existing
+ * umem. */
+#define UBUF_ALLOC_BLOCK_UMEM UBASE_FOURCC('b','u','m','m')
+
+/** default number of segments past which appended segments are coalesced */
+#define UBUF_BLOCK_MEM_DEF_MAX_SEGMENTS 128
+/** default maximum size of coalesced segments */
+#define UBUF_BLOCK_MEM_DEF_COALESCE_SIZE 4096
+
+/** @This extends ubuf_mgr_command with specific commands for block
+ * managers using umem. */
+enum ubuf_block_mem_mgr_command {
+    UBUF_BLOCK_MEM_MGR_SENTINEL = UBUF_MGR_CONTROL_LOCAL,
+
+    /** sets the coalescing policy of block ubufs (unsigned int,
+     * unsigned int) */
+    UBUF_BLOCK_MEM_MGR_SET_COALESCE
+};
+
+/** @This returns a new ubuf pointing to a part of an existing umem, which
+ * is typically an imported shared-memory buffer. The ubuf takes over the
+ * umem, which is freed with the last reference to the ubuf.
+ *
+ * @param mgr management structure for this ubuf type
+ * @param umem pointer to the umem, released by the ubuf (left untouched in
+ * case of failure)
+ * @param offset offset of the data in the umem, in octets
+ * @param size size of the data, in octets
+ * @return pointer to ubuf or NULL in case of failure
+ */
+static inline struct ubuf *ubuf_block_mem_alloc_umem(struct ubuf_mgr *mgr,
+                                                     struct umem *umem,
+                                                     int offset, int size)
+{
+    return ubuf_alloc(mgr, UBUF_ALLOC_BLOCK_UMEM, umem, offset, size);
+}
+
+/** @This sets the coalescing policy of the block ubufs allocated by the
+ * manager afterwards. When a segment is appended to a ubuf which then has
+ * more than max_segments segments, runs of adjacent segments are copied
+ * into segments of at most coalesce_size octets (see
+ * @ref ubuf_block_coalesce). This bounds the length of the chains built
+ * from small input packets, for instance the TS payloads of a large frame.
+ *
+ * @param mgr management structure for this ubuf type
+ * @param max_segments number of segments past which appended segments are
+ * coalesced (0 = never coalesce)
+ * @param coalesce_size maximum size of coalesced segments, in octets
+ * @return an error code
+ */
+static inline int ubuf_block_mem_mgr_set_coalesce(struct ubuf_mgr *mgr,
+                                                  unsigned int max_segments,
+                                                  unsigned int coalesce_size)
+{
+    return ubuf_mgr_control(mgr, UBUF_BLOCK_MEM_MGR_SET_COALESCE,
+                            UBUF_ALLOC_BLOCK, max_segments, coalesce_size);
+}
 
 /** @This allocates a new instance of the ubuf manager for block formats
  * using umem.
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ubuf manager for block formats mapping files in memory
+ * Blocks point straight into a read-only private mapping of a file region,
+ * which is unmapped when the last reference to it is released.
+ */
+
+#ifndef _UPIPE_UBUF_BLOCK_MMAP_H_
+/** @hidden */
+#define _UPIPE_UBUF_BLOCK_MMAP_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+
+#include <stdint.h>
+
+/** @This is a simple signature to allocate a block mapping a file region. */
+#define UBUF_ALLOC_BLOCK_MMAP UBASE_FOURCC('b','m','a','p')
+
+/** @This returns a new ubuf pointing to a region of a file mapped in memory.
+ * The file is advised for sequential access, and the region is read ahead.
+ * The mapping is private, so writing to the block does not alter the file.
+ *
+ * @param mgr management structure for this ubuf type
+ * @param fd file descriptor opened for reading
+ * @param offset offset of the region in the file, in octets
+ * @param size size of the region, in octets
+ * @return pointer to ubuf or NULL in case of failure
+ */
+static inline struct ubuf *ubuf_block_mmap_alloc(struct ubuf_mgr *mgr, int fd,
+                                                 uint64_t offset, int size)
+{
+    return ubuf_alloc(mgr, UBUF_ALLOC_BLOCK_MMAP, fd, offset, size);
+}
+
+/** @This allocates a new instance of the ubuf manager for block formats
+ * mapping files in memory. Blocks allocated with @ref ubuf_block_alloc are
+ * backed by anonymous mappings.
+ *
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param shared_pool_depth maximum number of shared structures in the pool
+ * @return pointer to manager, or NULL in case of error
+ */
+struct ubuf_mgr *ubuf_block_mmap_mgr_alloc(uint16_t ubuf_pool_depth,
+                                           uint16_t shared_pool_depth);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
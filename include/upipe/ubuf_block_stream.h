@@ -56,8 +56,9 @@ struct ubuf_block_stream {
     /** size of the block section */
     int size;
 
-    /** bits cache */
-    uint32_t bits;
+    /** bits cache, with the next bit in the most significant position and
+     * all bits past the cached ones set to 0 */
+    uint64_t bits;
     /** number of cached bits */
     uint32_t available;
     /** true if the bit stream cache overflows */
@@ -124,12 +125,64 @@ static inline int ubuf_block_stream_get(struct ubuf_block_stream *s,
     return UBASE_ERR_NONE;
 }
 
+/** @This reads the next 8 octets of the current block section, without
+ * consuming them.
+ *
+ * @param s helper structure
+ * @param word_p filled in with the octets, in big-endian order
+ * @return false if fewer than 8 octets are left in the block section
+ */
+static inline bool ubuf_block_stream_peek_word(struct ubuf_block_stream *s,
+                                               uint64_t *word_p)
+{
+    if (s->ubuf == NULL || s->end - s->buffer < 8)
+        return false;
+    const uint8_t *p = s->buffer;
+    *word_p = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+              ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+              ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+              ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+    return true;
+}
+
+/** @This tells if any of the 8 octets of a word is 0.
+ *
+ * @param word octets, as returned by @ref ubuf_block_stream_peek_word
+ * @return true if the word contains a nul octet
+ */
+static inline bool ubuf_block_stream_word_has_zero(uint64_t word)
+{
+    return ((word - UINT64_C(0x0101010101010101)) & ~word &
+            UINT64_C(0x8080808080808080)) != 0;
+}
+
+/** @This moves as many whole octets of a word returned by
+ * @ref ubuf_block_stream_peek_word as possible to the bit stream cache.
+ *
+ * @param s helper structure
+ * @param word octets read by @ref ubuf_block_stream_peek_word
+ * @return number of octets consumed
+ */
+static inline unsigned int
+    ubuf_block_stream_load_word(struct ubuf_block_stream *s, uint64_t word)
+{
+    unsigned int nb = (64 - s->available) / 8;
+    if (unlikely(!nb))
+        return 0;
+    word >>= s->available;
+    word &= ~UINT64_C(0) << (64 - s->available - nb * 8);
+    s->bits += word;
+    s->available += nb * 8;
+    s->buffer += nb;
+    return nb;
+}
+
 /** @This fills the bit stream cache with at least the given number of bits,
  * with a custom function to pop octets.
  *
  * @param s helper structure
  * @param get_octet function to get extra octets
- * @param nb number of bits to ensure
+ * @param nb number of bits to ensure, at most 57
  */
 #define ubuf_block_stream_fill_bits_inner(s, get_octet, nb)                 \
     while ((s)->available < (nb)) {                                         \
@@ -138,27 +191,46 @@ static inline int ubuf_block_stream_get(struct ubuf_block_stream *s,
             octet = 0;                                                      \
             (s)->overflow = true;                                           \
         }                                                                   \
-        (s)->bits += (uint32_t)octet << (24 - (s)->available);              \
+        (s)->bits += (uint64_t)octet << (56 - (s)->available);              \
         (s)->available += 8;                                                \
-        assert((s)->available <= 32);                                       \
+        assert((s)->available <= 64);                                       \
     }
 
 /** @This fills the bit stream cache with at least the given number of bits.
+ * When the block section allows it, the cache is filled a word at a time.
  *
  * @param s helper structure
- * @param nb number of bits to ensure
+ * @param nb number of bits to ensure, at most 57
  */
 #define ubuf_block_stream_fill_bits(s, nb)                                  \
-    ubuf_block_stream_fill_bits_inner(s, ubuf_block_stream_get, nb)
+    do {                                                                    \
+        uint64_t word;                                                      \
+        if ((s)->available < (nb) &&                                        \
+            ubuf_block_stream_peek_word(s, &word))                          \
+            ubuf_block_stream_load_word(s, word);                           \
+        ubuf_block_stream_fill_bits_inner(s, ubuf_block_stream_get, nb)     \
+    } while (0)
 
 /** @This returns the given number of bits from the cache.
  *
  * @param s helper structure
- * @param nb number of bits to return
+ * @param nb number of bits to return, between 1 and 32
  * @return bits from the cache
  */
 #define ubuf_block_stream_show_bits(s, nb)                                  \
-    ((s)->bits >> (32 - (nb)))
+    ((uint32_t)((s)->bits >> (64 - (nb))))
+
+/** @This returns the number of leading zero bits in the cache.
+ *
+ * @param s helper structure
+ * @return number of zero bits before the first bit set, or 64 if the cache
+ * is empty
+ */
+static inline unsigned int
+    ubuf_block_stream_show_zeros(struct ubuf_block_stream *s)
+{
+    return s->bits ? __builtin_clzll(s->bits) : 64;
+}
 
 /** @This discards the given number of bits from the cache.
  *
@@ -114,15 +114,20 @@ void *ubuf_mem_shared_alloc_inner(struct upool *upool);
  */
 void ubuf_mem_shared_free_inner(struct upool *upool, void *_shared);
 
-/** @This declares eight functions dealing with the structure pools of
+/** @This declares ten functions dealing with the structure pools of
  * ubuf managers using umem storage.
  *
- * You must add two members to your private ubuf_mgr structure, for instance:
+ * You must add four members to your private ubuf_mgr structure, for instance:
  * @code
- *  struct upool *ubuf_pool;
- *  struct upool *shared_pool
+ *  struct upool ubuf_pool;
+ *  struct upool shared_pool;
+ *  struct upool_cache ubuf_cache;
+ *  struct upool_cache shared_cache;
  * @end code
  *
+ * The caches serve the thread which allocated the manager, other threads
+ * use the pools directly.
+ *
  * And one member to your private ubuf structure, for instance:
  * @code
  *  struct ubuf_mem_shared *shared;
@@ -157,6 +162,18 @@ void ubuf_mem_shared_free_inner(struct upool *upool, void *_shared);
  * Releases all structures kept in pools.
  *
  * @item @code
+ *  void ubuf_foo_mgr_stats_pool(struct ubuf_mgr *, struct upool_stats *,
+ *  struct upool_stats *)
+ * @end code
+ * Returns the statistics of the pools.
+ *
+ * @item @code
+ *  void ubuf_foo_mgr_resize_pool(struct ubuf_mgr *, uint16_t ubuf_pool_depth,
+ *  uint16_t shared_pool_depth)
+ * @end code
+ * Changes the depths of the pools.
+ *
+ * @item @code
  *  void ubuf_foo_mgr_clean_pool(struct ubuf_mgr *)
  * @end code
  * Called before deallocation of the manager.
@@ -182,10 +199,15 @@ void ubuf_mem_shared_free_inner(struct upool *upool, void *_shared);
  * @param STRUCTURE name of your private ubuf structure
  * @param UBUF_POOL name of the ubuf pool in your private ubuf_mgr structure
  * @param SHARED_POOL name of the shared pool in your private ubuf_mgr structure
+ * @param UBUF_CACHE name of the cache of the ubuf pool in your private
+ * ubuf_mgr structure
+ * @param SHARED_CACHE name of the cache of the shared pool in your private
+ * ubuf_mgr structure
  * @param SHARED name of the @tt{struct ubuf_mem_shared} field of your private
  * ubuf structure
  */
-#define UBUF_MEM_MGR_HELPER_POOL(STRUCTURE, UBUF_POOL, SHARED_POOL, SHARED) \
+#define UBUF_MEM_MGR_HELPER_POOL(STRUCTURE, UBUF_POOL, SHARED_POOL,          \
+                                 UBUF_CACHE, SHARED_CACHE, SHARED)          \
 /** @internal @This allocates the data structure or fetches it from the     \
  * pool.                                                                    \
  *                                                                          \
@@ -195,8 +217,8 @@ void ubuf_mem_shared_free_inner(struct upool *upool, void *_shared);
 static struct STRUCTURE *STRUCTURE##_alloc_pool(struct ubuf_mgr *mgr)       \
 {                                                                           \
     struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
-    struct STRUCTURE *mem = upool_alloc(&mem_mgr->UBUF_POOL,                \
-                                        struct STRUCTURE *);                \
+    struct STRUCTURE *mem = upool_cache_alloc(&mem_mgr->UBUF_CACHE,         \
+                                              struct STRUCTURE *);          \
     if (unlikely(mem == NULL))                                              \
         return NULL;                                                        \
     mem->SHARED = NULL;                                                     \
@@ -212,8 +234,8 @@ static struct ubuf_mem_shared                                               \
     *STRUCTURE##_shared_alloc_pool(struct ubuf_mgr *mgr)                    \
 {                                                                           \
     struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
-    struct ubuf_mem_shared *shared = upool_alloc(&mem_mgr->SHARED_POOL,     \
-                                                 struct ubuf_mem_shared *); \
+    struct ubuf_mem_shared *shared =                                        \
+        upool_cache_alloc(&mem_mgr->SHARED_CACHE, struct ubuf_mem_shared *);\
     if (unlikely(shared == NULL))                                           \
         return NULL;                                                        \
     uatomic_store(&shared->refcount, 1);                                    \
@@ -229,7 +251,7 @@ static void STRUCTURE##_free_pool(struct ubuf_mgr *mgr,                     \
                                   struct STRUCTURE *mem)                    \
 {                                                                           \
     struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
-    upool_free(&mem_mgr->UBUF_POOL, mem);                                   \
+    upool_cache_free(&mem_mgr->UBUF_CACHE, mem);                            \
 }                                                                           \
 /** @internal @This deallocates a shared data structure or places it back   \
  * into the pool.                                                           \
@@ -241,7 +263,7 @@ static void STRUCTURE##_shared_free_pool(struct ubuf_mgr *mgr,              \
                                          struct ubuf_mem_shared *shared)    \
 {                                                                           \
     struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
-    upool_free(&mem_mgr->SHARED_POOL, shared);                              \
+    upool_cache_free(&mem_mgr->SHARED_CACHE, shared);                       \
 }                                                                           \
 /** @internal @This instructs an existing manager to release all structures \
  * currently kept in pools. It is intended as a debug tool only.            \
@@ -251,9 +273,42 @@ static void STRUCTURE##_shared_free_pool(struct ubuf_mgr *mgr,              \
 static void STRUCTURE##_mgr_vacuum_pool(struct ubuf_mgr *mgr)               \
 {                                                                           \
     struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
+    upool_cache_vacuum(&mem_mgr->UBUF_CACHE);                               \
+    upool_cache_vacuum(&mem_mgr->SHARED_CACHE);                             \
     upool_vacuum(&mem_mgr->UBUF_POOL);                                      \
     upool_vacuum(&mem_mgr->SHARED_POOL);                                    \
 }                                                                           \
+/** @internal @This returns the statistics of the pools.                    \
+ *                                                                          \
+ * @param mgr pointer to a ubuf manager                                     \
+ * @param ubuf_stats_p filled in with the statistics of the ubuf pool       \
+ * @param shared_stats_p filled in with the statistics of the shared pool   \
+ */                                                                         \
+static void STRUCTURE##_mgr_stats_pool(struct ubuf_mgr *mgr,                \
+                                       struct upool_stats *ubuf_stats_p,    \
+                                       struct upool_stats *shared_stats_p)  \
+{                                                                           \
+    struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
+    upool_get_stats(&mem_mgr->UBUF_POOL, ubuf_stats_p);                     \
+    upool_get_stats(&mem_mgr->SHARED_POOL, shared_stats_p);                 \
+}                                                                           \
+/** @internal @This changes the depths of the pools, within the depths      \
+ * given at allocation.                                                     \
+ *                                                                          \
+ * @param mgr pointer to a ubuf manager                                     \
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool     \
+ * @param shared_pool_depth maximum number of shared structures in the pool \
+ */                                                                         \
+static void STRUCTURE##_mgr_resize_pool(struct ubuf_mgr *mgr,               \
+                                        uint16_t ubuf_pool_depth,           \
+                                        uint16_t shared_pool_depth)         \
+{                                                                           \
+    struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
+    upool_cache_vacuum(&mem_mgr->UBUF_CACHE);                               \
+    upool_cache_vacuum(&mem_mgr->SHARED_CACHE);                             \
+    upool_resize(&mem_mgr->UBUF_POOL, ubuf_pool_depth);                     \
+    upool_resize(&mem_mgr->SHARED_POOL, shared_pool_depth);                 \
+}                                                                           \
 /** @internal @This is called on deallocation of the manager.               \
  *                                                                          \
  * @param mgr pointer to a ubuf manager                                     \
@@ -261,6 +316,8 @@ static void STRUCTURE##_mgr_vacuum_pool(struct ubuf_mgr *mgr)               \
 static void STRUCTURE##_mgr_clean_pool(struct ubuf_mgr *mgr)                \
 {                                                                           \
     struct STRUCTURE##_mgr *mem_mgr = STRUCTURE##_mgr_from_ubuf_mgr(mgr);   \
+    upool_cache_clean(&mem_mgr->UBUF_CACHE);                                \
+    upool_cache_clean(&mem_mgr->SHARED_CACHE);                              \
     upool_clean(&mem_mgr->UBUF_POOL);                                       \
     upool_clean(&mem_mgr->SHARED_POOL);                                     \
 }                                                                           \
@@ -273,7 +330,9 @@ static void STRUCTURE##_mgr_clean_pool(struct ubuf_mgr *mgr)                \
 static size_t STRUCTURE##_mgr_sizeof_pool(uint16_t ubuf_pool_depth,         \
                                           uint16_t shared_pool_depth)       \
 {                                                                           \
-    return upool_sizeof(ubuf_pool_depth) + upool_sizeof(shared_pool_depth); \
+    return upool_sizeof(ubuf_pool_depth) + upool_sizeof(shared_pool_depth) +\
+           upool_cache_sizeof(upool_cache_length(ubuf_pool_depth)) +        \
+           upool_cache_sizeof(upool_cache_length(shared_pool_depth));       \
 }                                                                           \
 /** @internal @This is called on allocation of the manager.                 \
  *                                                                          \
@@ -293,6 +352,12 @@ static void STRUCTURE##_mgr_init_pool(struct ubuf_mgr *mgr,                 \
     upool_init(&mem_mgr->SHARED_POOL, shared_pool_depth,                    \
                extra + upool_sizeof(ubuf_pool_depth),                       \
                ubuf_mem_shared_alloc_inner, ubuf_mem_shared_free_inner);    \
+    extra += upool_sizeof(ubuf_pool_depth) + upool_sizeof(shared_pool_depth);\
+    upool_cache_init(&mem_mgr->UBUF_CACHE, &mem_mgr->UBUF_POOL,             \
+                     upool_cache_length(ubuf_pool_depth), extra);           \
+    extra += upool_cache_sizeof(upool_cache_length(ubuf_pool_depth));       \
+    upool_cache_init(&mem_mgr->SHARED_CACHE, &mem_mgr->SHARED_POOL,         \
+                     upool_cache_length(shared_pool_depth), extra);         \
 }
 
 #ifdef __cplusplus
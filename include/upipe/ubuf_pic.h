@@ -324,6 +324,43 @@ static inline int ubuf_pic_resize(struct ubuf *ubuf, int hskip, int vskip,
                         new_hsize, new_vsize);
 }
 
+/** @This allocates a new ubuf which is a view of a rectangular region of a
+ * picture ubuf, sharing the same buffer space without any copy. The buffer
+ * space is released when both ubufs are freed. As the buffer is shared,
+ * writing to either ubuf fails while the other exists.
+ *
+ * @param ubuf pointer to ubuf
+ * @param hoffset horizontal offset of the region, in pixels
+ * @param voffset vertical offset of the region, in lines
+ * @param hsize horizontal size of the region, in pixels (if set to -1, up to
+ * the end of the lines)
+ * @param vsize vertical size of the region, in lines (if set to -1, up to
+ * the last line)
+ * @return pointer to newly allocated ubuf or NULL in case of error
+ */
+static inline struct ubuf *ubuf_pic_splice(struct ubuf *ubuf,
+                                           int hoffset, int voffset,
+                                           int hsize, int vsize)
+{
+    size_t ubuf_hsize, ubuf_vsize;
+    if (unlikely(hoffset < 0 || voffset < 0 ||
+                 !ubase_check(ubuf_pic_check_resize(ubuf, &hoffset, &voffset,
+                         &hsize, &vsize, &ubuf_hsize, &ubuf_vsize, NULL)) ||
+                 hoffset + hsize > (int)ubuf_hsize ||
+                 voffset + vsize > (int)ubuf_vsize))
+        return NULL;
+
+    struct ubuf *new_ubuf = ubuf_dup(ubuf);
+    if (unlikely(new_ubuf == NULL))
+        return NULL;
+    if (unlikely(!ubase_check(ubuf_pic_resize(new_ubuf, hoffset, voffset,
+                                              hsize, vsize)))) {
+        ubuf_free(new_ubuf);
+        return NULL;
+    }
+    return new_ubuf;
+}
+
 /** @This copies a picture ubuf to a newly allocated ubuf, and doesn't deal
  * with the old ubuf or a dictionary.
  *
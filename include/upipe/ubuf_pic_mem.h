@@ -41,6 +41,40 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+/** @hidden */
+struct umem;
+
+/** @This is a simple signature to allocate a picture around an existing
+ * umem. */
+#define UBUF_ALLOC_PICTURE_UMEM UBASE_FOURCC('p','u','m','m')
+
+/** @This returns a new ubuf pointing to planes laid out in an existing umem,
+ * which is typically an imported shared-memory buffer, without margins.
+ * The ubuf takes over the umem, which is freed with the last reference to
+ * the ubuf.
+ *
+ * @param mgr management structure for this ubuf type
+ * @param umem pointer to the umem, released by the ubuf (left untouched in
+ * case of failure)
+ * @param hsize horizontal size in pixels
+ * @param vsize vertical size in lines
+ * @param nb_planes number of planes described, which must be all the planes
+ * of the manager, in any order
+ * @param chromas chroma type of each plane
+ * @param offsets offset of the first pixel of each plane in the umem, in
+ * octets
+ * @param strides stride of each plane, in octets
+ * @return pointer to ubuf or NULL in case of failure
+ */
+static inline struct ubuf *ubuf_pic_mem_alloc_umem(struct ubuf_mgr *mgr,
+        struct umem *umem, int hsize, int vsize, unsigned int nb_planes,
+        const char * const *chromas, const size_t *offsets,
+        const size_t *strides)
+{
+    return ubuf_alloc(mgr, UBUF_ALLOC_PICTURE_UMEM, umem, hsize, vsize,
+                      nb_planes, chromas, offsets, strides);
+}
+
 /** @This allocates a new instance of the ubuf manager for picture formats
  * using umem.
  *
@@ -85,6 +119,21 @@ int ubuf_pic_mem_mgr_add_plane(struct ubuf_mgr *mgr, const char *chroma,
                                uint8_t hsub, uint8_t vsub,
                                uint8_t macropixel_size);
 
+/** @This switches a ubuf manager for picture formats using umem to a
+ * cache-aligned layout: the alignment is raised to a multiple of 64 octets
+ * (the size of a cache line and of an AVX-512 vector) and the first
+ * macropixel of every line is aligned, the strides are multiples of the
+ * alignment, and non-zero horizontal margins are rounded up to whole
+ * multiples of the alignment in every plane. Lines, including their margins,
+ * may then be processed with aligned loads and stores, and the margins used
+ * as guards instead of emulating edges. It may only be called on
+ * initializing the manager, before any ubuf is allocated.
+ *
+ * @param mgr pointer to a ubuf_mgr structure
+ * @return an error code
+ */
+int ubuf_pic_mem_mgr_set_cache_aligned(struct ubuf_mgr *mgr);
+
 /** @This allocates a new instance of the ubuf manager for picture formats
  * using umem, from a fourcc image format.
  *
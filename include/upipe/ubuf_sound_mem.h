@@ -66,6 +66,45 @@ struct ubuf_mgr *ubuf_sound_mem_mgr_alloc(uint16_t ubuf_pool_depth,
  */
 int ubuf_sound_mem_mgr_add_plane(struct ubuf_mgr *mgr, const char *channel);
 
+/** @This sets the size of the SIMD vectors used to process the planes
+ * allocated by a ubuf manager for sound formats using umem. The alignment is
+ * raised to a multiple of the vector size, and planes are padded with zeros
+ * up to a multiple of the vector size, so that vector kernels may load the
+ * last samples of a plane without remainder loops. Planes are no longer
+ * aligned after a resize skipping samples which are not a whole number of
+ * vectors. It may only be called on initializing the manager, before any
+ * ubuf is allocated.
+ *
+ * Use a umem_pool manager to back the buffers with hugepages on the local
+ * NUMA node.
+ *
+ * @param mgr pointer to a ubuf_mgr structure
+ * @param vector_size size of SIMD vectors in octets, typically 32 for AVX2
+ * or 64 for AVX-512
+ * @return an error code
+ */
+int ubuf_sound_mem_mgr_set_vector_size(struct ubuf_mgr *mgr,
+                                       uint64_t vector_size);
+
+/** @This allocates a ubuf from the given manager whose planes point to
+ * planes of an existing ubuf, without copying them. Writing to either ubuf
+ * afterwards triggers the usual copy-on-write checks. It fails if both
+ * managers are not sound managers using umem with the same umem allocator
+ * and sample size, if a channel is missing, or if alignment constraints
+ * are not met.
+ *
+ * @param mgr management structure of the new ubuf
+ * @param ubuf pointer to the ubuf holding the buffer space
+ * @param channels array with, for each plane of mgr, the channel type of the
+ * plane of ubuf to point to
+ * @param nb_channels number of elements in channels, which must match the
+ * number of planes of mgr
+ * @return pointer to ubuf or NULL if the planes cannot be shared
+ */
+struct ubuf *ubuf_sound_mem_alias(struct ubuf_mgr *mgr, struct ubuf *ubuf,
+                                  const char *const *channels,
+                                  uint8_t nb_channels);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short uclock implementation reading a PTP hardware clock
+ *
+ * The PTP hardware clock (PHC) of a network interface, disciplined by a PTP
+ * daemon, provides the same time on all nodes of a facility. As reading a
+ * PHC is a system call, and sometimes a PCIe transaction, the time is
+ * interpolated from a faster local uclock and periodically resynchronized
+ * with the PHC.
+ */
+
+#ifndef _UPIPE_UCLOCK_PTP_H_
+/** @hidden */
+#define _UPIPE_UCLOCK_PTP_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/uclock.h>
+
+/** @This allocates a new uclock structure reading a PTP hardware clock.
+ * The returned dates are those of the PHC (usually TAI, as set by the PTP
+ * daemon), in 27 MHz ticks.
+ *
+ * @param local local uclock used to interpolate between two reads of the PHC,
+ * typically allocated with @ref uclock_std_alloc and UCLOCK_FLAG_TSC
+ * @param device path to the PHC device (/dev/ptpN)
+ * @return pointer to uclock, or NULL in case of error
+ */
+struct uclock *uclock_ptp_alloc(struct uclock *local, const char *device);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
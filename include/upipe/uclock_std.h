@@ -37,7 +37,12 @@ extern "C" {
 /** flags for the creation of a uclock_t structure */
 enum uclock_std_flags {
     /** force using a real-time clock even if a monotonic clock is available */
-    UCLOCK_FLAG_REALTIME = 0x1
+    UCLOCK_FLAG_REALTIME = 0x1,
+    /** read the time-stamp counter of the CPU, calibrated against the system
+     * clock, instead of calling the system clock for each date; this is only
+     * enabled if the CPU has an invariant TSC, and silently falls back to the
+     * system clock otherwise */
+    UCLOCK_FLAG_TSC = 0x2
 };
 
 /** @This allocates a new uclock_t structure.
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe runtime detection of CPU features and dispatch of kernels
+ *
+ * Pipes having optimized versions of a function (a kernel) describe them in
+ * a table of @ref ucpu_kernel, from the most to the least specific, ending
+ * with the portable C version which requires no feature. The table is
+ * resolved once, typically when the manager is allocated, with
+ * @ref ucpu_select, and the resulting function pointer is then called
+ * without further checks.
+ *
+ * Kernels for a given instruction set are compiled in the same translation
+ * unit with @ref UCPU_TARGET, so that no special compiler flag is needed.
+ */
+
+#ifndef _UPIPE_UCPU_H_
+/** @hidden */
+#define _UPIPE_UCPU_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+
+/** @This defines the CPU features which may be detected. */
+enum ucpu_flag {
+    /** x86 SSE2 */
+    UCPU_X86_SSE2 = 0x1,
+    /** x86 SSSE3 */
+    UCPU_X86_SSSE3 = 0x2,
+    /** x86 SSE4.1 */
+    UCPU_X86_SSE4_1 = 0x4,
+    /** x86 SSE4.2 */
+    UCPU_X86_SSE4_2 = 0x8,
+    /** x86 AVX */
+    UCPU_X86_AVX = 0x10,
+    /** x86 AVX2 */
+    UCPU_X86_AVX2 = 0x20,
+    /** x86 AVX-512 foundation */
+    UCPU_X86_AVX512F = 0x40,
+    /** x86 AVX-512 byte and word instructions */
+    UCPU_X86_AVX512BW = 0x80,
+
+    /** ARM NEON (Advanced SIMD) */
+    UCPU_ARM_NEON = 0x10000,
+    /** ARM SVE */
+    UCPU_ARM_SVE = 0x20000
+};
+
+/** @This describes a version of a kernel. */
+struct ucpu_kernel {
+    /** features required by this version (ORed @ref ucpu_flag), 0 for the
+     * portable version which ends the table */
+    uint32_t flags;
+    /** pointer to the function */
+    void *function;
+};
+
+/** @This compiles the following function for the given target (for
+ * instance "avx2"), whatever the compiler flags. The function must only be
+ * called if the CPU supports it. */
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#define UCPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define UCPU_TARGET(isa)
+#endif
+
+/** @This returns the features of the CPU, detected on the first call and
+ * restricted by @ref ucpu_set_mask.
+ *
+ * If the environment variable UPIPE_CPU_MASK is set, it is read as the
+ * initial mask, which allows to test the portable versions without
+ * rebuilding.
+ *
+ * @return ORed @ref ucpu_flag
+ */
+uint32_t ucpu_get_flags(void);
+
+/** @This restricts the features returned by @ref ucpu_get_flags to the
+ * given mask. It only affects the kernels selected afterwards, and is
+ * mainly useful for unit tests and benchmarks.
+ *
+ * @param mask ORed @ref ucpu_flag, or UINT32_MAX for all features
+ */
+void ucpu_set_mask(uint32_t mask);
+
+/** @This returns the first version of a kernel whose required features are
+ * all supported by the CPU.
+ *
+ * @param kernels table of versions, ending with a version requiring no
+ * feature
+ * @return pointer to the function
+ */
+void *ucpu_select(const struct ucpu_kernel *kernels);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
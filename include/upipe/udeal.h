@@ -27,7 +27,9 @@
  * @short Upipe exclusive access to non-reentrant resource
  * Primitives in this file allow to run a call-back when an exclusive access
  * to a non-reentrant resource is granted, in an asynchronous, upump-aware
- * way.
+ * way. Threads without event loop may also block until the access is
+ * granted, with @ref udeal_wait; on Linux they sleep on a futex rather than
+ * polling the ueventfd.
  */
 
 #ifndef _UPIPE_UDEAL_H_
@@ -45,6 +47,17 @@ extern "C" {
 
 #include <assert.h>
 
+#if defined(UPIPE_HAVE_FUTEX) && defined(UPIPE_HAVE_ATOMIC_OPS)
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+/** @hidden */
+#define UDEAL_FUTEX
+#else
+#include <poll.h>
+#endif
+
 /** @This is the implementation of a structure that deals access to a
  * non-reentrant resource. */
 struct udeal {
@@ -54,6 +67,10 @@ struct udeal {
     uatomic_uint32_t access;
     /** ueventfd triggered when a waiter may be unblocked */
     struct ueventfd event;
+    /** incremented each time the resource is yielded */
+    uatomic_uint32_t sequence;
+    /** number of threads blocked in @ref udeal_wait */
+    uatomic_uint32_t sleepers;
 };
 
 /** @This initializes a udeal.
@@ -68,6 +85,8 @@ static inline bool udeal_init(struct udeal *udeal)
 
     uatomic_init(&udeal->waiters, 0);
     uatomic_init(&udeal->access, 0);
+    uatomic_init(&udeal->sequence, 0);
+    uatomic_init(&udeal->sleepers, 0);
     return true;
 }
 
@@ -122,17 +141,63 @@ static inline bool udeal_grab(struct udeal *udeal)
     return true;
 }
 
+/** @This waits until the resource may be exclusively used, from a thread
+ * without event loop. It must be released with @ref udeal_release.
+ *
+ * @param udeal pointer to a udeal structure
+ */
+static inline void udeal_wait(struct udeal *udeal)
+{
+    uatomic_fetch_add(&udeal->waiters, 1);
+    for ( ; ; ) {
+#ifdef UDEAL_FUTEX
+        /* read before trying, so that a yield in between is not missed */
+        uint32_t sequence = uatomic_load(&udeal->sequence);
+#endif
+        if (likely(udeal_grab(udeal)))
+            return;
+
+        uatomic_fetch_add(&udeal->sleepers, 1);
+#ifdef UDEAL_FUTEX
+        syscall(SYS_futex, &udeal->sequence, FUTEX_WAIT_PRIVATE, sequence,
+                NULL, NULL, 0);
+#else
+        struct pollfd pollfd;
+        pollfd.fd = ueventfd_get_fd(&udeal->event);
+        pollfd.events = POLLIN;
+        poll(&pollfd, 1, -1);
+#endif
+        uatomic_fetch_sub(&udeal->sleepers, 1);
+    }
+}
+
 /** @This yields access to an exclusive resource previously acquired from
- * @ref udeal_grab, and stops the watcher.
+ * @ref udeal_wait, or from @ref udeal_grab without stopping the watcher.
  *
  * @param udeal pointer to a udeal structure
- * @param upump watcher allocated by @ref udeal_upump_alloc
  */
-static inline void udeal_yield(struct udeal *udeal, struct upump *upump)
+static inline void udeal_release(struct udeal *udeal)
 {
     uatomic_fetch_sub(&udeal->access, 1);
+    uatomic_fetch_add(&udeal->sequence, 1);
     if (uatomic_fetch_sub(&udeal->waiters, 1) > 1)
         ueventfd_write(&udeal->event);
+#ifdef UDEAL_FUTEX
+    if (unlikely(uatomic_load(&udeal->sleepers)))
+        syscall(SYS_futex, &udeal->sequence, FUTEX_WAKE_PRIVATE, INT_MAX,
+                NULL, NULL, 0);
+#endif
+}
+
+/** @This yields access to an exclusive resource previously acquired from
+ * @ref udeal_grab, and stops the watcher.
+ *
+ * @param udeal pointer to a udeal structure
+ * @param upump watcher allocated by @ref udeal_upump_alloc
+ */
+static inline void udeal_yield(struct udeal *udeal, struct upump *upump)
+{
+    udeal_release(udeal);
     upump_stop(upump);
 }
 
@@ -157,6 +222,8 @@ static inline void udeal_clean(struct udeal *udeal)
 {
     uatomic_clean(&udeal->waiters);
     uatomic_clean(&udeal->access);
+    uatomic_clean(&udeal->sequence);
+    uatomic_clean(&udeal->sleepers);
     ueventfd_clean(&udeal->event);
 }
 
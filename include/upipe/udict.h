@@ -118,9 +118,15 @@ enum udict_type {
     /** p.bf */
     UDICT_TYPE_PIC_BF,
     /** p.tff */
-    UDICT_TYPE_PIC_TFF
+    UDICT_TYPE_PIC_TFF,
+
+    /* registered keys (@see udict_key_register) */
+    UDICT_TYPE_KEY = 0x80
 };
 
+/** maximum number of registered keys */
+#define UDICT_KEY_MAX (0x100 - UDICT_TYPE_KEY)
+
 /** @This defines standard commands which udict modules may implement. */
 enum udict_command {
     /** duplicate a given udict (struct udict **) */
@@ -161,6 +167,9 @@ struct udict_mgr;
 struct udict {
     /** pointer to the entity responsible for the management */
     struct udict_mgr *mgr;
+    /** hash of the attributes, or 0 if it has not been computed since the
+     * last change */
+    uint64_t hash;
 };
 
 /** @This defines standard commands which udict managers may implement. */
@@ -216,6 +225,17 @@ static inline int udict_control_va(struct udict *udict,
     if (udict->mgr->udict_mgr_control == NULL)
         return UBASE_ERR_UNHANDLED;
 
+    switch (command) {
+        case UDICT_DUP:
+        case UDICT_ITERATE:
+        case UDICT_GET:
+        case UDICT_NAME:
+            break;
+        default:
+            /* the attributes may change */
+            udict->hash = 0;
+            break;
+    }
     return udict->mgr->udict_control(udict, command, args);
 }
 
@@ -766,6 +786,50 @@ static inline int udict_name(struct udict *udict, enum udict_type type,
     return udict_control(udict, UDICT_NAME, type, name_p, base_type_p);
 }
 
+/** @This registers an attribute name, and returns a key that may be used
+ * instead of it in all udict and uref_attr calls, with a NULL name, in the
+ * same way as shorthand types. Looking up a key doesn't involve any string
+ * comparison. Registering the same name and base type again returns the same
+ * key, so that modules may register their attributes independently, typically
+ * once at initialization.
+ *
+ * A registered attribute is the same whether it is accessed by its name or
+ * by its key: dictionaries store it under its key, and an entry set by name
+ * before the registration is still found by the key.
+ *
+ * Keys are local to the process and are assigned in registration order, so
+ * they must not be used in dictionaries transmitted to another process.
+ *
+ * @param name name of the attribute, which must remain valid for the whole
+ * life of the program
+ * @param base_type base type of the attribute
+ * @param type_p filled in with the key of the attribute
+ * @return an error code
+ */
+int udict_key_register(const char *name, enum udict_type base_type,
+                       enum udict_type *type_p);
+
+/** @This finds the key of an already registered attribute name. It is
+ * lock-free and cheap when no key is registered.
+ *
+ * @param name name of the attribute
+ * @param base_type base type of the attribute
+ * @param type_p filled in with the key of the attribute
+ * @return an error code, UBASE_ERR_INVALID if the name is not registered
+ */
+int udict_key_find(const char *name, enum udict_type base_type,
+                   enum udict_type *type_p);
+
+/** @This returns the name and base type of a registered key.
+ *
+ * @param type registered key
+ * @param name_p filled in with the name of the attribute
+ * @param base_type_p filled in with the base type of the attribute
+ * @return an error code
+ */
+int udict_key_name(enum udict_type type, const char **name_p,
+                   enum udict_type *base_type_p);
+
 /** @This frees a udict.
  *
  * @param udict structure to free
@@ -821,7 +885,74 @@ static inline struct udict *udict_copy(struct udict_mgr *mgr,
     return new_udict;
 }
 
-/** @This compares two udicts.
+/** @internal @This hashes a buffer with the 64-bit FNV-1a function.
+ *
+ * @param hash hash of the previous buffers
+ * @param p pointer to the buffer
+ * @param size size of the buffer
+ * @return updated hash
+ */
+static inline uint64_t udict_hash_buffer(uint64_t hash, const uint8_t *p,
+                                         size_t size)
+{
+    while (size--) {
+        hash ^= *p++;
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+/** @This returns a hash of the attributes of a udict, which does not depend
+ * on their order. It is computed on first use and kept until the udict is
+ * modified, and it is inherited by duplicates, so that comparing flow
+ * definitions which are resent along a pipeline doesn't need to walk their
+ * attributes.
+ *
+ * @param udict pointer to the udict
+ * @return hash of the attributes, or 0 if it could not be computed
+ */
+static inline uint64_t udict_hash(struct udict *udict)
+{
+    if (likely(udict->hash))
+        return udict->hash;
+
+    uint64_t hash = 0;
+    const char *name = NULL;
+    enum udict_type type = UDICT_TYPE_END;
+    for ( ; ; ) {
+        udict_iterate(udict, &name, &type);
+        if (unlikely(type == UDICT_TYPE_END))
+            break;
+
+        size_t attr_size;
+        const uint8_t *attr;
+        if (!ubase_check(udict_get(udict, name, type, &attr_size, &attr)))
+            return 0;
+
+        uint8_t header[1 + sizeof(size_t)];
+        header[0] = type;
+        memcpy(header + 1, &attr_size, sizeof(size_t));
+        uint64_t attr_hash = udict_hash_buffer(UINT64_C(0xcbf29ce484222325),
+                                               header, sizeof(header));
+        if (name != NULL)
+            attr_hash = udict_hash_buffer(attr_hash, (const uint8_t *)name,
+                                          strlen(name) + 1);
+        attr_hash = udict_hash_buffer(attr_hash, attr, attr_size);
+        /* spread the bits before summing, so that the order is irrelevant */
+        attr_hash ^= attr_hash >> 33;
+        attr_hash *= UINT64_C(0xff51afd7ed558ccd);
+        attr_hash ^= attr_hash >> 33;
+        hash += attr_hash;
+    }
+    if (unlikely(!hash))
+        hash = 1;
+    udict->hash = hash;
+    return hash;
+}
+
+/** @This compares two udicts. The hashes of the attributes (see
+ * @ref udict_hash) quickly tell different udicts apart; when they are equal
+ * or unavailable, the udicts are compared attribute per attribute.
  *
  * @param udict1 first udict
  * @param udict2 second udict
@@ -829,6 +960,13 @@ static inline struct udict *udict_copy(struct udict_mgr *mgr,
  */
 static inline int udict_cmp(struct udict *udict1, struct udict *udict2)
 {
+    if (udict1 == udict2)
+        return 0;
+    uint64_t hash1 = udict_hash(udict1);
+    uint64_t hash2 = udict_hash(udict2);
+    if (likely(hash1 && hash2 && hash1 != hash2))
+        return 1;
+
     const char *name = NULL;
     enum udict_type type = UDICT_TYPE_END;
     for ( ; ; ) {
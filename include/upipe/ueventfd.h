@@ -46,12 +46,19 @@ extern "C" {
 #include <sys/eventfd.h>
 #endif
 
+#ifdef UPIPE_HAVE_KQUEUE
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 
 /* Test whether ueventfd can be implemented */
-#if !(defined(UPIPE_HAVE_EVENTFD) || defined(UPIPE_HAVE_PIPE))
+#if !(defined(UPIPE_HAVE_EVENTFD) || defined(UPIPE_HAVE_KQUEUE) || \
+      defined(UPIPE_HAVE_PIPE))
     #error no ueventfd implementation 
 #endif
 
@@ -65,6 +72,8 @@ enum ueventfd_mode {
     UEVENTFD_MODE_EVENTFD,
     /** uses the pipe() system call */
     UEVENTFD_MODE_PIPE,
+    /** uses a kqueue() with an EVFILT_USER event */
+    UEVENTFD_MODE_KQUEUE,
 };
 
 /** @This allows to wait on a condition in a upump event loop. */
@@ -76,6 +85,8 @@ struct ueventfd {
         int event_fd;
         /** used when pipe() is available */
         int pipe_fds[2];
+        /** used when kqueue() is available */
+        int kqueue_fd;
     };
 };
 
@@ -95,6 +106,12 @@ static inline struct upump *ueventfd_upump_alloc(struct ueventfd *fd,
     if (likely(fd->mode == UEVENTFD_MODE_EVENTFD)) {
         return upump_alloc_fd_read(upump_mgr, cb, opaque, fd->event_fd);
     } else
+#endif
+#ifdef UPIPE_HAVE_KQUEUE
+    if (likely(fd->mode == UEVENTFD_MODE_KQUEUE)) {
+        /* a kqueue is readable when one of its events is pending */
+        return upump_alloc_fd_read(upump_mgr, cb, opaque, fd->kqueue_fd);
+    } else
 #endif
     if (likely(fd->mode == UEVENTFD_MODE_PIPE)) {
         return upump_alloc_fd_read(upump_mgr, cb, opaque, (fd->pipe_fds)[0]);
@@ -103,6 +120,25 @@ static inline struct upump *ueventfd_upump_alloc(struct ueventfd *fd,
     }
 }
 
+/** @This returns the file descriptor which becomes readable when the
+ * ueventfd is triggered, so that a thread without event loop may poll it.
+ *
+ * @param fd pointer to a ueventfd
+ * @return file descriptor
+ */
+static inline int ueventfd_get_fd(struct ueventfd *fd)
+{
+#ifdef UPIPE_HAVE_EVENTFD
+    if (likely(fd->mode == UEVENTFD_MODE_EVENTFD))
+        return fd->event_fd;
+#endif
+#ifdef UPIPE_HAVE_KQUEUE
+    if (likely(fd->mode == UEVENTFD_MODE_KQUEUE))
+        return fd->kqueue_fd;
+#endif
+    return (fd->pipe_fds)[0];
+}
+
 /** @This reads from a ueventfd and makes it non-readable.
  *
  * @param fd pointer to a ueventfd
@@ -130,6 +166,20 @@ static inline bool ueventfd_read(struct ueventfd *fd)
             }
         }
     } else 
+#endif
+#ifdef UPIPE_HAVE_KQUEUE
+    if (likely(fd->mode == UEVENTFD_MODE_KQUEUE)) {
+        /* retrieving the event clears it (EV_CLEAR) */
+        struct timespec timeout = { 0, 0 };
+        for ( ; ; ) {
+            struct kevent event;
+            if (likely(kevent(fd->kqueue_fd, NULL, 0, &event, 1,
+                              &timeout) != -1))
+                return true;
+            if (errno != EINTR)
+                return false;
+        }
+    } else
 #endif
     if (likely(fd->mode == UEVENTFD_MODE_PIPE)) {
         for ( ; ; ) {
@@ -181,6 +231,19 @@ static inline bool ueventfd_write(struct ueventfd *fd)
             }
         }
     } else
+#endif
+#ifdef UPIPE_HAVE_KQUEUE
+    if (likely(fd->mode == UEVENTFD_MODE_KQUEUE)) {
+        struct kevent event;
+        EV_SET(&event, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+        for ( ; ; ) {
+            if (likely(kevent(fd->kqueue_fd, &event, 1, NULL, 0,
+                              NULL) != -1))
+                return true;
+            if (errno != EINTR)
+                return false;
+        }
+    } else
 #endif
     if (likely(fd->mode == UEVENTFD_MODE_PIPE)) {
         for ( ; ; ) {
@@ -224,6 +287,23 @@ static inline bool ueventfd_init(struct ueventfd *fd, bool readable)
         fcntl((fd->event_fd), F_SETFL, fcntl((fd->event_fd), F_GETFL) | O_NONBLOCK);
 
         if (unlikely(fd->event_fd == -1)) { // eventfd() fails, fallback to pipe()
+#endif
+#ifdef UPIPE_HAVE_KQUEUE
+            fd->mode = UEVENTFD_MODE_KQUEUE;
+            fd->kqueue_fd = kqueue();
+            if (likely(fd->kqueue_fd != -1)) {
+                struct kevent event;
+                EV_SET(&event, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, NULL);
+                if (likely(kevent(fd->kqueue_fd, &event, 1, NULL, 0,
+                                  NULL) != -1)) {
+                    fcntl(fd->kqueue_fd, F_SETFD,
+                          fcntl(fd->kqueue_fd, F_GETFD) | FD_CLOEXEC);
+                    if (likely(readable))
+                        ueventfd_write(fd);
+                    return true;
+                }
+                close(fd->kqueue_fd);
+            }
 #endif
             fd->mode = UEVENTFD_MODE_PIPE;
 #ifdef UPIPE_HAVE_PIPE
@@ -257,6 +337,11 @@ static inline void ueventfd_clean(struct ueventfd *fd)
     if (likely(fd->mode == UEVENTFD_MODE_EVENTFD)) {
         close(fd->event_fd);
     } else
+#endif
+#ifdef UPIPE_HAVE_KQUEUE
+    if (likely(fd->mode == UEVENTFD_MODE_KQUEUE)) {
+        close(fd->kqueue_fd);
+    } else
 #endif
     if (likely(fd->mode == UEVENTFD_MODE_PIPE)) {
         close((fd->pipe_fds)[0]);
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe binary min-heap of intrusive nodes sorted by a 64-bit key
+ * This is typically used to find which of many elements has the earliest
+ * date in O(log n) instead of walking all of them. It is not thread-safe.
+ */
+
+#ifndef _UPIPE_UHEAP_H_
+/** @hidden */
+#define _UPIPE_UHEAP_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <assert.h>
+
+/** position of a node that is not in a heap */
+#define UHEAP_NONE UINT_MAX
+
+/** @This is the structure to include in the elements of a heap. */
+struct uheap_node {
+    /** key of the node */
+    uint64_t key;
+    /** position of the node in the heap, or UHEAP_NONE */
+    unsigned int pos;
+};
+
+/** @This is the implementation of a heap. */
+struct uheap {
+    /** array of pointers to the nodes */
+    struct uheap_node **nodes;
+    /** number of nodes in the heap */
+    unsigned int count;
+    /** maximum number of nodes in the heap */
+    unsigned int length;
+};
+
+/** @This returns the required size of extra data space for uheap.
+ *
+ * @param length maximum number of elements in the heap
+ * @return size in octets to allocate
+ */
+#define uheap_sizeof(length) ((length) * sizeof(struct uheap_node *))
+
+/** @This initializes a node, which is not in a heap.
+ *
+ * @param node pointer to a node
+ */
+static inline void uheap_node_init(struct uheap_node *node)
+{
+    node->key = UINT64_MAX;
+    node->pos = UHEAP_NONE;
+}
+
+/** @This returns true if the node is in a heap.
+ *
+ * @param node pointer to a node
+ * @return true if the node is in a heap
+ */
+static inline bool uheap_node_queued(const struct uheap_node *node)
+{
+    return node->pos != UHEAP_NONE;
+}
+
+/** @This initializes a heap.
+ *
+ * @param uheap pointer to a heap
+ * @param length maximum number of elements in the heap
+ * @param extra mandatory extra space allocated by the caller, with the size
+ * returned by @ref #uheap_sizeof
+ */
+static inline void uheap_init(struct uheap *uheap, unsigned int length,
+                              void *extra)
+{
+    uheap->nodes = (struct uheap_node **)extra;
+    uheap->count = 0;
+    uheap->length = length;
+}
+
+/** @This changes the extra space of a heap, for instance after it was
+ * reallocated to a bigger size. The contents of the previous extra space
+ * must have been copied.
+ *
+ * @param uheap pointer to a heap
+ * @param length new maximum number of elements in the heap
+ * @param extra new extra space, with the size returned by
+ * @ref #uheap_sizeof
+ */
+static inline void uheap_resize(struct uheap *uheap, unsigned int length,
+                                void *extra)
+{
+    assert(length >= uheap->count);
+    uheap->nodes = (struct uheap_node **)extra;
+    uheap->length = length;
+}
+
+/** @This returns the number of nodes in a heap.
+ *
+ * @param uheap pointer to a heap
+ * @return number of nodes
+ */
+static inline unsigned int uheap_count(const struct uheap *uheap)
+{
+    return uheap->count;
+}
+
+/** @internal @This places a node at a given position.
+ *
+ * @param uheap pointer to a heap
+ * @param pos position in the heap
+ * @param node pointer to the node
+ */
+static inline void uheap_place(struct uheap *uheap, unsigned int pos,
+                               struct uheap_node *node)
+{
+    uheap->nodes[pos] = node;
+    node->pos = pos;
+}
+
+/** @internal @This moves a node up until its parent has a lower key.
+ *
+ * @param uheap pointer to a heap
+ * @param node pointer to the node
+ */
+static inline void uheap_sift_up(struct uheap *uheap, struct uheap_node *node)
+{
+    unsigned int pos = node->pos;
+    while (pos > 0) {
+        unsigned int parent = (pos - 1) / 2;
+        if (uheap->nodes[parent]->key <= node->key)
+            break;
+        uheap_place(uheap, pos, uheap->nodes[parent]);
+        pos = parent;
+    }
+    uheap_place(uheap, pos, node);
+}
+
+/** @internal @This moves a node down until its children have higher keys.
+ *
+ * @param uheap pointer to a heap
+ * @param node pointer to the node
+ */
+static inline void uheap_sift_down(struct uheap *uheap,
+                                   struct uheap_node *node)
+{
+    unsigned int pos = node->pos;
+    for ( ; ; ) {
+        unsigned int child = 2 * pos + 1;
+        if (child >= uheap->count)
+            break;
+        if (child + 1 < uheap->count &&
+            uheap->nodes[child + 1]->key < uheap->nodes[child]->key)
+            child++;
+        if (node->key <= uheap->nodes[child]->key)
+            break;
+        uheap_place(uheap, pos, uheap->nodes[child]);
+        pos = child;
+    }
+    uheap_place(uheap, pos, node);
+}
+
+/** @This adds a node to a heap.
+ *
+ * @param uheap pointer to a heap
+ * @param node pointer to a node which is not in a heap
+ * @param key key of the node
+ * @return false if the maximum number of elements was reached
+ */
+static inline bool uheap_push(struct uheap *uheap, struct uheap_node *node,
+                              uint64_t key)
+{
+    assert(!uheap_node_queued(node));
+    if (unlikely(uheap->count >= uheap->length))
+        return false;
+    node->key = key;
+    uheap_place(uheap, uheap->count++, node);
+    uheap_sift_up(uheap, node);
+    return true;
+}
+
+/** @This returns the node with the lowest key, without removing it.
+ *
+ * @param uheap pointer to a heap
+ * @return pointer to the node, or NULL if the heap is empty
+ */
+static inline struct uheap_node *uheap_peek(const struct uheap *uheap)
+{
+    return uheap->count ? uheap->nodes[0] : NULL;
+}
+
+/** @This removes a node from a heap.
+ *
+ * @param uheap pointer to a heap
+ * @param node pointer to a node in the heap
+ */
+static inline void uheap_remove(struct uheap *uheap, struct uheap_node *node)
+{
+    assert(uheap_node_queued(node));
+    assert(uheap->nodes[node->pos] == node);
+    unsigned int pos = node->pos;
+    struct uheap_node *last = uheap->nodes[--uheap->count];
+    node->pos = UHEAP_NONE;
+    if (last == node)
+        return;
+
+    uheap_place(uheap, pos, last);
+    if (pos > 0 && uheap->nodes[(pos - 1) / 2]->key > last->key)
+        uheap_sift_up(uheap, last);
+    else
+        uheap_sift_down(uheap, last);
+}
+
+/** @This removes and returns the node with the lowest key.
+ *
+ * @param uheap pointer to a heap
+ * @return pointer to the node, or NULL if the heap is empty
+ */
+static inline struct uheap_node *uheap_pop(struct uheap *uheap)
+{
+    struct uheap_node *node = uheap_peek(uheap);
+    if (node != NULL)
+        uheap_remove(uheap, node);
+    return node;
+}
+
+/** @This changes the key of a node in a heap.
+ *
+ * @param uheap pointer to a heap
+ * @param node pointer to a node in the heap
+ * @param key new key of the node
+ */
+static inline void uheap_update(struct uheap *uheap, struct uheap_node *node,
+                                uint64_t key)
+{
+    assert(uheap_node_queued(node));
+    uint64_t old_key = node->key;
+    node->key = key;
+    if (key < old_key)
+        uheap_sift_up(uheap, node);
+    else
+        uheap_sift_down(uheap, node);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
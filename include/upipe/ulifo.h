@@ -45,6 +45,8 @@ struct ulifo {
     uring_lifo lifo_carrier;
     /** uring LIFO of elements not carrying a uchain */
     uring_lifo lifo_empty;
+    /** uring LIFO of elements removed from the LIFO by @ref ulifo_shrink */
+    uring_lifo lifo_parked;
 };
 
 /** @This returns the required size of extra data space for ulifo.
@@ -66,6 +68,7 @@ static inline void ulifo_init(struct ulifo *ulifo, uint16_t length, void *extra)
     uring_lifo_init(&ulifo->uring, &ulifo->lifo_empty,
                     uring_init(&ulifo->uring, length, extra));
     uring_lifo_init(&ulifo->uring, &ulifo->lifo_carrier, URING_LIFO_NULL);
+    uring_lifo_init(&ulifo->uring, &ulifo->lifo_parked, URING_LIFO_NULL);
 }
 
 /** @This pushes a new element.
@@ -111,6 +114,37 @@ static inline void *ulifo_pop_internal(struct ulifo *ulifo)
  */
 #define ulifo_pop(ulifo, type) (type)ulifo_pop_internal(ulifo)
 
+/** @This decreases by one the maximum number of elements of the LIFO, by
+ * parking an element not carrying an opaque.
+ *
+ * @param ulifo pointer to a ulifo structure
+ * @return false if all elements carry an opaque, in which case the caller
+ * should pop one and retry
+ */
+static inline bool ulifo_shrink(struct ulifo *ulifo)
+{
+    uring_index index = uring_lifo_pop(&ulifo->uring, &ulifo->lifo_empty);
+    if (index == URING_INDEX_NULL)
+        return false;
+    uring_lifo_push(&ulifo->uring, &ulifo->lifo_parked, index);
+    return true;
+}
+
+/** @This increases by one the maximum number of elements of the LIFO,
+ * within the length given to @ref ulifo_init.
+ *
+ * @param ulifo pointer to a ulifo structure
+ * @return false if no element was parked by @ref ulifo_shrink
+ */
+static inline bool ulifo_grow(struct ulifo *ulifo)
+{
+    uring_index index = uring_lifo_pop(&ulifo->uring, &ulifo->lifo_parked);
+    if (index == URING_INDEX_NULL)
+        return false;
+    uring_lifo_push(&ulifo->uring, &ulifo->lifo_empty, index);
+    return true;
+}
+
 /** @This cleans up the ulifo data structure. Please note that it is the
  * caller's responsibility to empty the LIFO first, and to release the
  * extra data passed to @ref ulifo_init.
@@ -121,6 +155,7 @@ static inline void ulifo_clean(struct ulifo *ulifo)
 {
     uring_lifo_clean(&ulifo->uring, &ulifo->lifo_empty);
     uring_lifo_clean(&ulifo->uring, &ulifo->lifo_carrier);
+    uring_lifo_clean(&ulifo->uring, &ulifo->lifo_parked);
 }
 
 #ifdef __cplusplus
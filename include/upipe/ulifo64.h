@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe thread-safe last-in first-out data structure for large depths
+ * This is the same structure as @ref ulifo, based on @ref uring64 so that
+ * its depth is not limited to UINT16_MAX. It also counts the operations
+ * and their failures. Each thread registers once to own a set of counters,
+ * alone in its cache line, and updates it without atomic read-modify-write
+ * operations; threads beyond @ref ULIFO64_THREADS share an extra set,
+ * updated atomically.
+ */
+
+#ifndef _UPIPE_ULIFO64_H_
+/** @hidden */
+#define _UPIPE_ULIFO64_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/uring64.h>
+
+#include <string.h>
+
+#ifdef UATOMIC_HAVE_64
+
+/** @This is the number of sets of counters owned by a thread, not including
+ * the shared set. */
+#define ULIFO64_THREADS 32
+/** @This is the assumed size of a cache line. */
+#define ULIFO64_CACHE_LINE 64
+
+/** @This stores the statistics of a ulifo64. */
+struct ulifo64_stats {
+    /** number of elements pushed */
+    uint64_t pushes;
+    /** number of elements popped */
+    uint64_t pops;
+    /** number of pops on an empty LIFO */
+    uint64_t misses;
+    /** number of pushes on a full LIFO */
+    uint64_t overflows;
+};
+
+/** @internal @This is a set of counters, alone in its cache line. */
+struct ulifo64_counters {
+    /** number of elements pushed */
+    uint64_t pushes;
+    /** number of elements popped */
+    uint64_t pops;
+    /** number of pops on an empty LIFO */
+    uint64_t misses;
+    /** number of pushes on a full LIFO */
+    uint64_t overflows;
+} __attribute__ ((aligned (ULIFO64_CACHE_LINE)));
+
+/** @This is the implementation of last-in first-out data structure. */
+struct ulifo64 {
+    /** ring structure */
+    struct uring64 uring;
+    /** uring64 LIFO of elements carrying a uchain */
+    uring64_lifo lifo_carrier;
+    /** uring64 LIFO of elements not carrying a uchain */
+    uring64_lifo lifo_empty;
+    /** uring64 LIFO of elements removed from the LIFO by
+     * @ref ulifo64_shrink */
+    uring64_lifo lifo_parked;
+    /** sets of counters, followed by the shared set, in the extra space */
+    struct ulifo64_counters *counters;
+};
+
+/** @This returns the required size of extra data space for ulifo64.
+ *
+ * @param length maximum number of elements in the LIFO
+ * @return size in octets to allocate
+ */
+#define ulifo64_sizeof(length)                                              \
+    (ULIFO64_CACHE_LINE - 1 +                                               \
+     (ULIFO64_THREADS + 1) * sizeof(struct ulifo64_counters) +              \
+     uring64_sizeof(length))
+
+/** @internal set of counters of the calling thread plus one, or 0 if the
+ * thread is not registered yet */
+extern __thread unsigned int ulifo64_thread;
+
+/** @internal @This registers the calling thread, by giving it a set of
+ * counters that no other running thread owns, or the shared set.
+ *
+ * @return set of counters of the thread
+ */
+unsigned int ulifo64_thread_register(void);
+
+/** @internal @This returns the set of counters of the calling thread,
+ * registering it on its first call.
+ *
+ * @return set of counters of the thread
+ */
+static inline unsigned int ulifo64_thread_set(void)
+{
+    unsigned int set = ulifo64_thread;
+    if (unlikely(!set))
+        return ulifo64_thread_register();
+    return set - 1;
+}
+
+/** @internal @This increments a counter of the calling thread. Only the
+ * owner writes to its set, so a relaxed load and store are enough; readers
+ * only need the value not to be torn.
+ *
+ * @param set set of counters of the thread
+ * @param counter pointer to the counter
+ */
+static inline void ulifo64_count(unsigned int set, uint64_t *counter)
+{
+    if (likely(set != ULIFO64_THREADS))
+        __atomic_store_n(counter,
+                         __atomic_load_n(counter, __ATOMIC_RELAXED) + 1,
+                         __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+/** @This initializes a ulifo64.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ * @param length maximum number of elements in the LIFO
+ * @param extra mandatory extra space allocated by the caller, with the size
+ * returned by @ref #ulifo64_sizeof
+ */
+static inline void ulifo64_init(struct ulifo64 *ulifo, uint32_t length,
+                                void *extra)
+{
+    uintptr_t aligned = ((uintptr_t)extra + ULIFO64_CACHE_LINE - 1) &
+                        ~(uintptr_t)(ULIFO64_CACHE_LINE - 1);
+    ulifo->counters = (struct ulifo64_counters *)aligned;
+    memset(ulifo->counters, 0,
+           (ULIFO64_THREADS + 1) * sizeof(struct ulifo64_counters));
+
+    uring64_lifo_init(&ulifo->uring, &ulifo->lifo_empty,
+                      uring64_init(&ulifo->uring, length,
+                                   ulifo->counters + ULIFO64_THREADS + 1));
+    uring64_lifo_init(&ulifo->uring, &ulifo->lifo_carrier,
+                      URING64_LIFO_NULL);
+    uring64_lifo_init(&ulifo->uring, &ulifo->lifo_parked, URING64_LIFO_NULL);
+}
+
+/** @This pushes a new element.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ * @param opaque opaque to associate with element (not NULL)
+ * @return false if the maximum number of elements was reached and the
+ * element couldn't be queued
+ */
+static inline bool ulifo64_push(struct ulifo64 *ulifo, void *opaque)
+{
+    assert(opaque != NULL);
+    unsigned int set = ulifo64_thread_set();
+    uring64_index index = uring64_lifo_pop(&ulifo->uring, &ulifo->lifo_empty);
+    if (index == URING64_INDEX_NULL) {
+        ulifo64_count(set, &ulifo->counters[set].overflows);
+        return false;
+    }
+    uring64_elem_set(&ulifo->uring, index, opaque);
+    uring64_lifo_push(&ulifo->uring, &ulifo->lifo_carrier, index);
+    ulifo64_count(set, &ulifo->counters[set].pushes);
+    return true;
+}
+
+/** @internal @This pops an element.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ * @return pointer to opaque, or NULL if the LIFO is empty
+ */
+static inline void *ulifo64_pop_internal(struct ulifo64 *ulifo)
+{
+    void *opaque;
+    unsigned int set = ulifo64_thread_set();
+    uring64_index index = uring64_lifo_pop(&ulifo->uring,
+                                           &ulifo->lifo_carrier);
+    if (index == URING64_INDEX_NULL) {
+        ulifo64_count(set, &ulifo->counters[set].misses);
+        return NULL;
+    }
+    opaque = uring64_elem_get(&ulifo->uring, index);
+    uring64_elem_set(&ulifo->uring, index, NULL);
+    uring64_lifo_push(&ulifo->uring, &ulifo->lifo_empty, index);
+    ulifo64_count(set, &ulifo->counters[set].pops);
+    return opaque;
+}
+
+/** @This pops an element with type checking.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ * @param type type of the opaque pointer
+ * @return pointer to opaque, or NULL if the LIFO is empty
+ */
+#define ulifo64_pop(ulifo, type) (type)ulifo64_pop_internal(ulifo)
+
+/** @This decreases by one the maximum number of elements of the LIFO, by
+ * parking an element not carrying an opaque.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ * @return false if all elements carry an opaque, in which case the caller
+ * should pop one and retry
+ */
+static inline bool ulifo64_shrink(struct ulifo64 *ulifo)
+{
+    uring64_index index = uring64_lifo_pop(&ulifo->uring, &ulifo->lifo_empty);
+    if (index == URING64_INDEX_NULL)
+        return false;
+    uring64_lifo_push(&ulifo->uring, &ulifo->lifo_parked, index);
+    return true;
+}
+
+/** @This increases by one the maximum number of elements of the LIFO,
+ * within the length given to @ref ulifo64_init.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ * @return false if no element was parked by @ref ulifo64_shrink
+ */
+static inline bool ulifo64_grow(struct ulifo64 *ulifo)
+{
+    uring64_index index = uring64_lifo_pop(&ulifo->uring,
+                                           &ulifo->lifo_parked);
+    if (index == URING64_INDEX_NULL)
+        return false;
+    uring64_lifo_push(&ulifo->uring, &ulifo->lifo_empty, index);
+    return true;
+}
+
+/** @This returns the statistics of the LIFO, summed over all threads. As
+ * the counters are not read atomically together, they may be slightly
+ * inconsistent while other threads use the LIFO.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ * @param stats filled in with the statistics
+ */
+static inline void ulifo64_get_stats(struct ulifo64 *ulifo,
+                                     struct ulifo64_stats *stats)
+{
+    memset(stats, 0, sizeof(struct ulifo64_stats));
+    for (unsigned int i = 0; i <= ULIFO64_THREADS; i++) {
+        struct ulifo64_counters *counters = &ulifo->counters[i];
+        stats->pushes += __atomic_load_n(&counters->pushes, __ATOMIC_RELAXED);
+        stats->pops += __atomic_load_n(&counters->pops, __ATOMIC_RELAXED);
+        stats->misses += __atomic_load_n(&counters->misses, __ATOMIC_RELAXED);
+        stats->overflows += __atomic_load_n(&counters->overflows,
+                                            __ATOMIC_RELAXED);
+    }
+}
+
+/** @This cleans up the ulifo64 data structure. Please note that it is the
+ * caller's responsibility to empty the LIFO first, and to release the
+ * extra data passed to @ref ulifo64_init.
+ *
+ * @param ulifo pointer to a ulifo64 structure
+ */
+static inline void ulifo64_clean(struct ulifo64 *ulifo)
+{
+    uring64_lifo_clean(&ulifo->uring, &ulifo->lifo_empty);
+    uring64_lifo_clean(&ulifo->uring, &ulifo->lifo_carrier);
+    uring64_lifo_clean(&ulifo->uring, &ulifo->lifo_parked);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -80,6 +80,27 @@ static inline size_t umem_size(struct umem *umem)
     return umem->size;
 }
 
+/** @This describes the memory usage of a umem manager, in octets. */
+struct umem_usage {
+    /** octets currently allocated and not yet freed */
+    uint64_t live;
+    /** octets kept in pools for future allocations */
+    uint64_t pooled;
+    /** maximum number of octets allocated at the same time */
+    uint64_t peak;
+};
+
+/** @This defines standard manager commands which umem managers may
+ * implement. */
+enum umem_mgr_command {
+    /** returns the memory usage (struct umem_usage *) */
+    UMEM_MGR_GET_USAGE,
+
+    /** non-standard commands implemented by a umem manager can start from
+     * there */
+    UMEM_MGR_CONTROL_LOCAL = 0x8000
+};
+
 /** @This defines a memory allocator management structure.
  */
 struct umem_mgr {
@@ -95,6 +116,8 @@ struct umem_mgr {
 
     /** function to release all buffers kept in pools */
     void (*umem_mgr_vacuum)(struct umem_mgr *);
+    /** manager control function for standard or local commands */
+    int (*umem_mgr_control)(struct umem_mgr *, int, va_list);
 };
 
 /** @This allocates a new umem buffer space.
@@ -151,6 +174,54 @@ static inline void umem_mgr_vacuum(struct umem_mgr *mgr)
         mgr->umem_mgr_vacuum(mgr);
 }
 
+/** @internal @This sends a control command to the umem manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param command manager control command to send
+ * @param args optional read or write parameters
+ * @return an error code
+ */
+static inline int umem_mgr_control_va(struct umem_mgr *mgr,
+                                      int command, va_list args)
+{
+    assert(mgr != NULL);
+    if (mgr->umem_mgr_control == NULL)
+        return UBASE_ERR_UNHANDLED;
+
+    return mgr->umem_mgr_control(mgr, command, args);
+}
+
+/** @internal @This sends a control command to the umem manager. Note that all
+ * arguments are owned by the caller.
+ *
+ * @param mgr pointer to umem manager
+ * @param command manager control command to send, followed by optional read
+ * or write parameters
+ * @return an error code
+ */
+static inline int umem_mgr_control(struct umem_mgr *mgr, int command, ...)
+{
+    int err;
+    va_list args;
+    va_start(args, command);
+    err = umem_mgr_control_va(mgr, command, args);
+    va_end(args);
+    return err;
+}
+
+/** @This returns the memory usage of a umem manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param usage_p filled in with the memory usage
+ * @return an error code, UBASE_ERR_UNHANDLED if the manager doesn't keep
+ * track of its usage
+ */
+static inline int umem_mgr_get_usage(struct umem_mgr *mgr,
+                                     struct umem_usage *usage_p)
+{
+    return umem_mgr_control(mgr, UMEM_MGR_GET_USAGE, usage_p);
+}
+
 /** @This increments the reference count of a umem manager.
  *
  * @param mgr pointer to umem manager
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe umem manager accounting the memory of another manager
+ *
+ * This manager forwards all allocations to a parent umem manager, and
+ * counts the octets allocated through it. Giving each pipeline its own
+ * accounting manager, for instance in its @ref uprobe_ubuf_mem and in the
+ * udict manager of its uref manager, attributes the buffers of the
+ * pipeline to it, while the pools of the parent manager stay shared:
+ *
+ * @code
+ * struct umem_mgr *acct = umem_acct_mgr_alloc(umem_mgr);
+ * struct uprobe *uprobe = uprobe_ubuf_mem_alloc(uprobe_use(logger), acct,
+ *                                               UBUF_POOL_DEPTH,
+ *                                               UBUF_POOL_DEPTH);
+ * uprobe_metrics_add_umem_mgr(metrics, "channel1", acct);
+ * @endcode
+ *
+ * The memory usage is then returned by @ref umem_mgr_get_usage. Counters
+ * are 32 bits wide, so the usage of a single accounting manager is only
+ * correct below 4 GiB.
+ */
+
+#ifndef _UPIPE_UMEM_ACCT_H_
+/** @hidden */
+#define _UPIPE_UMEM_ACCT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/umem.h>
+
+/** @This allocates a new instance of the umem accounting manager.
+ *
+ * @param parent umem manager actually allocating the buffers
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_acct_mgr_alloc(struct umem_mgr *parent);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
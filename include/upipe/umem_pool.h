@@ -39,6 +39,105 @@ extern "C" {
 
 #include <upipe/umem.h>
 
+#define UMEM_POOL_SIGNATURE UBASE_FOURCC('p','o','o','l')
+
+/** @This is a snapshot of the statistics of one pool of a umem pool
+ * manager. */
+struct umem_pool_stats {
+    /** size (in octets) of the buffers of the pool */
+    size_t size;
+    /** maximum number of buffers kept in the pool */
+    unsigned int depth;
+    /** number of allocations */
+    uint32_t allocs;
+    /** number of allocations served from the pool */
+    uint32_t hits;
+    /** number of allocations which had to fall back to the system */
+    uint32_t fallbacks;
+    /** number of buffers currently allocated */
+    uint32_t in_use;
+    /** maximum number of buffers allocated at the same time */
+    uint32_t high_water;
+    /** number of buffers currently kept in the pool */
+    uint32_t pooled;
+};
+
+/** @This extends umem_mgr_command with specific commands for umem pool. */
+enum umem_pool_mgr_command {
+    UMEM_POOL_MGR_SENTINEL = UMEM_MGR_CONTROL_LOCAL,
+
+    /** fills each pool with up to the given number of buffers
+     * (unsigned int) */
+    UMEM_POOL_MGR_PREALLOC,
+    /** returns the number of pools (unsigned int *) */
+    UMEM_POOL_MGR_GET_NB_POOLS,
+    /** returns the statistics of a pool
+     * (unsigned int, struct umem_pool_stats *) */
+    UMEM_POOL_MGR_GET_STATS,
+    /** enables or disables the statistics of the pools (bool) */
+    UMEM_POOL_MGR_SET_STATS
+};
+
+/** @This fills each pool of the manager with up to nb buffers, so that the
+ * first allocations don't go through the system allocator.
+ *
+ * @param mgr pointer to umem manager
+ * @param nb number of buffers to allocate in each pool (capped to the depth
+ * of the pool)
+ * @return an error code
+ */
+static inline int umem_pool_mgr_prealloc(struct umem_mgr *mgr,
+                                         unsigned int nb)
+{
+    return umem_mgr_control(mgr, UMEM_POOL_MGR_PREALLOC, UMEM_POOL_SIGNATURE,
+                            nb);
+}
+
+/** @This returns the number of pools of the manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param nb_pools_p filled in with the number of pools
+ * @return an error code
+ */
+static inline int umem_pool_mgr_get_nb_pools(struct umem_mgr *mgr,
+                                             unsigned int *nb_pools_p)
+{
+    return umem_mgr_control(mgr, UMEM_POOL_MGR_GET_NB_POOLS,
+                            UMEM_POOL_SIGNATURE, nb_pools_p);
+}
+
+/** @This returns the statistics of a pool of the manager. They are only
+ * available if enabled with @ref umem_pool_mgr_set_stats.
+ *
+ * @param mgr pointer to umem manager
+ * @param pool index of the pool
+ * @param stats_p filled in with the statistics of the pool
+ * @return an error code
+ */
+static inline int umem_pool_mgr_get_stats(struct umem_mgr *mgr,
+                                          unsigned int pool,
+                                          struct umem_pool_stats *stats_p)
+{
+    return umem_mgr_control(mgr, UMEM_POOL_MGR_GET_STATS, UMEM_POOL_SIGNATURE,
+                            pool, stats_p);
+}
+
+/** @This enables or disables the statistics of the pools, which are also
+ * needed by @ref umem_mgr_get_usage. They are disabled by default, since
+ * they add several atomic operations on shared counters to each allocation
+ * and release. They may only be enabled before the first buffer is
+ * allocated, so that the counters are consistent.
+ *
+ * @param mgr pointer to umem manager
+ * @param enable true to enable the statistics
+ * @return an error code, UBASE_ERR_BUSY if buffers were already allocated
+ */
+static inline int umem_pool_mgr_set_stats(struct umem_mgr *mgr, bool enable)
+{
+    return umem_mgr_control(mgr, UMEM_POOL_MGR_SET_STATS, UMEM_POOL_SIGNATURE,
+                            enable ? 1 : 0);
+}
+
 /** @This allocates a new instance of the umem pool manager allocating buffers
  * from application memory, using pools in power of 2's.
  *
@@ -62,6 +161,35 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...);
  */
 struct umem_mgr *umem_pool_mgr_alloc_simple(uint16_t base_pools_depth);
 
+/** @This allocates a new instance of the umem pool manager allocating buffers
+ * of one page or more from anonymous mappings, backed by hugepages for
+ * buffers of 2 MiB or more, and optionally bound to a NUMA node. Smaller
+ * buffers are allocated with malloc().
+ *
+ * @param pool0_size size (in octets) of the smallest allocatable buffer; it
+ * must be a power of 2
+ * @param numa_node NUMA node to allocate buffers on, or -1
+ * @param nb_pools number of buffer pools to maintain, with sizes in power of
+ * 2's increments, followed, for each pool, by the maximum number of buffers
+ * to keep in the pool (unsigned int)
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_pool_mgr_alloc_huge(size_t pool0_size, int numa_node,
+                                          size_t nb_pools, ...);
+
+/** @This allocates a new instance of the umem pool manager allocating buffers
+ * of one page or more from anonymous mappings, backed by hugepages for
+ * buffers of 2 MiB or more, and optionally bound to a NUMA node, with a
+ * simpler API.
+ *
+ * @param base_pools_depth number of buffers to keep in the pool for the smaller
+ * buffers; for larger buffers the same number is used, divided by 2, 4, or 8
+ * @param numa_node NUMA node to allocate buffers on, or -1
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_pool_mgr_alloc_huge_simple(uint16_t base_pools_depth,
+                                                 int numa_node);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe shared-memory allocator
+ * This memory allocator carves buffers out of an arena of shared memory,
+ * organized in pools of chunks of power of 2's sizes. The arena may be
+ * mapped by several processes, so that buffers are passed between them
+ * without being copied. The reference count of each chunk lives in the
+ * arena: a process exporting a buffer takes a reference on behalf of the
+ * process it is sent to, which releases it when it frees the buffer.
+ *
+ * The allocator never falls back to the system: allocations fail when a
+ * pool is exhausted. References held by a process which dies without
+ * releasing them are lost.
+ */
+
+#ifndef _UPIPE_UMEM_SHM_H_
+/** @hidden */
+#define _UPIPE_UMEM_SHM_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/umem.h>
+
+#include <stdint.h>
+
+#define UMEM_SHM_SIGNATURE UBASE_FOURCC('s','h','m','m')
+
+/** @This extends umem_mgr_command with specific commands for umem shm. */
+enum umem_shm_mgr_command {
+    UMEM_SHM_MGR_SENTINEL = UMEM_MGR_CONTROL_LOCAL,
+
+    /** returns the file descriptor of the arena (int *) */
+    UMEM_SHM_MGR_GET_FD,
+    /** takes a reference to the chunk containing a buffer and returns the
+     * offset of the buffer in the arena (const uint8_t *, uint64_t *) */
+    UMEM_SHM_MGR_EXPORT,
+    /** fills in a umem with the chunk containing an offset of the arena,
+     * taking over an exported reference
+     * (uint64_t, struct umem *, size_t *) */
+    UMEM_SHM_MGR_IMPORT
+};
+
+/** @This returns the file descriptor of the arena, which may be passed to
+ * another process to attach to the arena. The file descriptor belongs to
+ * the manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param fd_p filled in with the file descriptor
+ * @return an error code
+ */
+static inline int umem_shm_mgr_get_fd(struct umem_mgr *mgr, int *fd_p)
+{
+    return umem_mgr_control(mgr, UMEM_SHM_MGR_GET_FD, UMEM_SHM_SIGNATURE,
+                            fd_p);
+}
+
+/** @This takes a reference to the chunk containing the given buffer, and
+ * returns the offset of the buffer in the arena, to be passed to another
+ * process attached to the same arena. The reference is released when the
+ * other process frees the umem imported with @ref umem_shm_mgr_import.
+ *
+ * @param mgr pointer to umem manager
+ * @param buffer pointer to a buffer belonging to a chunk of the arena
+ * @param offset_p filled in with the offset of the buffer in the arena
+ * @return an error code, UBASE_ERR_INVALID if the buffer doesn't belong to
+ * the arena
+ */
+static inline int umem_shm_mgr_export(struct umem_mgr *mgr,
+                                      const uint8_t *buffer,
+                                      uint64_t *offset_p)
+{
+    return umem_mgr_control(mgr, UMEM_SHM_MGR_EXPORT, UMEM_SHM_SIGNATURE,
+                            buffer, offset_p);
+}
+
+/** @This fills in a umem with the chunk containing the given offset of the
+ * arena, taking over the reference of an exported buffer. The umem must be
+ * released with @ref umem_free.
+ *
+ * @param mgr pointer to umem manager
+ * @param offset offset of the buffer in the arena, as returned by
+ * @ref umem_shm_mgr_export
+ * @param umem caller-allocated structure, filled in with the chunk
+ * @param skip_p filled in with the offset of the buffer in the umem
+ * @return an error code
+ */
+static inline int umem_shm_mgr_import(struct umem_mgr *mgr, uint64_t offset,
+                                      struct umem *umem, size_t *skip_p)
+{
+    return umem_mgr_control(mgr, UMEM_SHM_MGR_IMPORT, UMEM_SHM_SIGNATURE,
+                            offset, umem, skip_p);
+}
+
+/** @This allocates a new instance of the umem shm manager, creating an
+ * arena of shared memory.
+ *
+ * @param pool0_size size (in octets) of the smallest allocatable buffer; it
+ * must be a power of 2
+ * @param nb_pools number of buffer pools in the arena, with sizes in power of
+ * 2's increments, followed, for each pool, by the number of chunks of the
+ * pool (unsigned int, at most 4294967294)
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_shm_mgr_alloc(size_t pool0_size, size_t nb_pools, ...);
+
+/** @This allocates a new instance of the umem shm manager, attaching to the
+ * arena of another manager, typically in another process.
+ *
+ * @param fd file descriptor of the arena, as returned by
+ * @ref umem_shm_mgr_get_fd; it belongs to the manager afterwards, even in
+ * case of error
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_shm_mgr_attach(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
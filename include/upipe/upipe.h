@@ -36,9 +36,12 @@ extern "C" {
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/ulist.h>
+#include <upipe/uref.h>
 #include <upipe/uprobe.h>
 #include <upipe/urequest.h>
 #include <upipe/udict_dump.h>
+#include <upipe/utrace.h>
 
 #include <stdint.h>
 #include <stdarg.h>
@@ -143,11 +146,62 @@ enum upipe_command {
     /** returns the super-pipe associated with a subpipe (struct upipe **) */
     UPIPE_SUB_GET_SUPER,
 
+    /*
+     * Encoder elements commands
+     */
+    /** gets the target octetrate of the rate control (uint64_t *) */
+    UPIPE_ENCODER_GET_OCTETRATE,
+    /** sets the target octetrate of the rate control (uint64_t) */
+    UPIPE_ENCODER_SET_OCTETRATE,
+
+    /*
+     * Resource management commands
+     */
+    /** releases the state and buffers which are only needed while data
+     * flows, and propagates the command downstream (void) */
+    UPIPE_HIBERNATE,
+
     /** non-standard commands implemented by a module type can start from
      * there (first arg = signature) */
     UPIPE_CONTROL_LOCAL = 0x8000
 };
 
+/** number of buckets of the end-to-end latency histogram; bucket i counts
+ * latencies of up to 2^i milliseconds, and the last one longer latencies */
+#define UPIPE_STATS_LATENCY_BUCKETS 13
+
+/** @This stores the throughput and latency counters of a pipe, when they
+ * have been enabled with @ref upipe_stats_enable. Times are expressed in
+ * units of a 27 MHz clock, and the counters are reset after each report. */
+struct upipe_stats {
+    /** number of urefs received on the input */
+    uint64_t inputs;
+    /** number of octets of block urefs received on the input */
+    uint64_t octets;
+    /** number of urefs sent to the output */
+    uint64_t outputs;
+    /** cumulative time spent in the input function */
+    uint64_t time;
+    /** cumulative time spent in the input function, less the time spent in
+     * the input of downstream pipes which also have statistics enabled */
+    uint64_t self_time;
+    /** maximum time spent in a single call to the input function */
+    uint64_t max_time;
+    /** histogram of the end-to-end latencies of the urefs received, from
+     * their ingress date (see @ref uref_clock_get_ingress) to their
+     * arrival in this pipe, measured with the monotonic system clock */
+    uint64_t latency[UPIPE_STATS_LATENCY_BUCKETS];
+    /** sum of the latencies counted in the histogram */
+    uint64_t latency_sum;
+    /** duration of the period covered by a report */
+    uint64_t duration;
+
+    /** period between automatic reports, or 0 */
+    uint64_t period;
+    /** date of the start of the current reporting period */
+    uint64_t start;
+};
+
 /** @This stores common parameters for upipe structures. */
 struct upipe {
     /** pointer to refcount management structure */
@@ -159,12 +213,57 @@ struct upipe {
 
     /** pointer to the uprobe hierarchy passed on initialization */
     struct uprobe *uprobe;
+    /** cached mask of standard events caught by no probe of the hierarchy,
+     * only valid for the hierarchy @tt{uprobe_ignored_probe} and the
+     * generation @tt{uprobe_ignored_generation} (see
+     * @ref upipe_uprobe_ignored) */
+    uint64_t uprobe_ignored;
+    /** probe hierarchy for which the cached mask was computed, or NULL */
+    struct uprobe *uprobe_ignored_probe;
+    /** value of @ref uprobe_events_generation when the mask was computed */
+    uint32_t uprobe_ignored_generation;
     /** pointer to the manager for this pipe type */
     struct upipe_mgr *mgr;
+    /** pointer to the optional statistics of the pipe */
+    struct upipe_stats *stats;
 };
 
 UBASE_FROM_TO(upipe, uchain, uchain, uchain)
 
+/** @This enables the collection of statistics on a pipe. The counters are
+ * reported with an @ref UPROBE_STATS event every period, if period is not 0,
+ * or when @ref upipe_stats_report is called.
+ *
+ * @param upipe description structure of the pipe
+ * @param period period between automatic reports in 27 MHz units, or 0
+ * @return an error code
+ */
+int upipe_stats_enable(struct upipe *upipe, uint64_t period);
+
+/** @This disables the collection of statistics on a pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+void upipe_stats_disable(struct upipe *upipe);
+
+/** @This throws an @ref UPROBE_STATS event with the current counters of a
+ * pipe, and resets them.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+int upipe_stats_report(struct upipe *upipe);
+
+/** @internal @This sends an input buffer into a pipe, updating its
+ * statistics.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_stats_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p);
+
 /** @This defines standard commands which upipe managers may implement. */
 enum upipe_mgr_command {
     /** release all buffers kept in pools (void) */
@@ -195,6 +294,12 @@ struct upipe_mgr {
     /** control function for standard or local manager commands - all parameters
      * belong to the caller */
     int (*upipe_mgr_control)(struct upipe_mgr *, int, va_list);
+
+    /** optional function to send a list of urefs to an input in a single
+     * call - the urefs are removed from the list and then belong to the
+     * callee */
+    void (*upipe_input_list)(struct upipe *, struct uchain *,
+                             struct upump **);
 };
 
 /** @This increments the reference count of a upipe manager.
@@ -328,8 +433,12 @@ static inline void upipe_init(struct upipe *upipe, struct upipe_mgr *mgr,
     uchain_init(&upipe->uchain);
     upipe->opaque = NULL;
     upipe->uprobe = uprobe;
+    upipe->uprobe_ignored = 0;
+    upipe->uprobe_ignored_probe = NULL;
+    upipe->uprobe_ignored_generation = 0;
     upipe->refcount = NULL;
     upipe->mgr = mgr;
+    upipe->stats = NULL;
     upipe_mgr_use(mgr);
 }
 
@@ -436,10 +545,39 @@ static inline struct uprobe *upipe_pop_probe(struct upipe *upipe)
 static inline void upipe_clean(struct upipe *upipe)
 {
     assert(upipe != NULL);
+    if (unlikely(upipe->stats != NULL))
+        upipe_stats_disable(upipe);
     uprobe_release(upipe->uprobe);
     upipe_mgr_release(upipe->mgr);
 }
 
+/** @internal @This returns the mask of standard events caught by no probe of
+ * the hierarchy of a pipe. The mask is computed lazily and cached in the
+ * pipe, and recomputed when the hierarchy is changed by
+ * @ref upipe_push_probe or @ref upipe_pop_probe, or when the events of a
+ * probe are changed by @ref uprobe_set_events.
+ *
+ * The cache is only trusted if it was computed for the current hierarchy,
+ * so pipes which don't go through @ref upipe_init, such as phony pipes built
+ * by tests, must at least be zeroed: a zeroed pipe computes its mask on its
+ * first event.
+ *
+ * @param upipe description structure of the pipe
+ * @return mask of ignored events
+ */
+static inline uint64_t upipe_uprobe_ignored(struct upipe *upipe)
+{
+    uint32_t generation = uprobe_events_generation;
+    if (unlikely(upipe->uprobe_ignored_probe != upipe->uprobe ||
+                 upipe->uprobe_ignored_generation != generation)) {
+        __sync_synchronize();
+        upipe->uprobe_ignored = ~uprobe_chain_events(upipe->uprobe);
+        upipe->uprobe_ignored_probe = upipe->uprobe;
+        upipe->uprobe_ignored_generation = generation;
+    }
+    return upipe->uprobe_ignored;
+}
+
 /** @internal @This throws generic events with optional arguments.
  *
  * @param upipe description structure of the pipe
@@ -449,6 +587,8 @@ static inline void upipe_clean(struct upipe *upipe)
  */
 static inline int upipe_throw_va(struct upipe *upipe, int event, va_list args)
 {
+    if (!uprobe_events_match(~upipe_uprobe_ignored(upipe), event))
+        return UBASE_ERR_UNHANDLED;
     return uprobe_throw_va(upipe->uprobe, upipe, event, args);
 }
 
@@ -487,7 +627,9 @@ static inline void upipe_log_va(struct upipe *upipe,
                                 enum uprobe_log_level level,
                                 const char *format, ...)
 {
-    UBASE_VARARG(upipe_log(upipe, level, string))
+    if (unlikely(!uprobe_log_filter(upipe->uprobe, upipe, level, format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(upipe->uprobe, upipe, level, string))
 }
 
 /** @This throws an error event. This event is thrown whenever a pipe wants
@@ -505,7 +647,11 @@ static inline void upipe_log_va(struct upipe *upipe,
  */
 static inline void upipe_err_va(struct upipe *upipe, const char *format, ...)
 {
-    UBASE_VARARG(upipe_err(upipe, string))
+    if (unlikely(!uprobe_log_filter(upipe->uprobe, upipe,
+                                    UPROBE_LOG_ERROR, format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(upipe->uprobe, upipe,
+                                     UPROBE_LOG_ERROR, string))
 }
 
 /** @This throws a warning event. This event is thrown whenever a pipe wants
@@ -523,7 +669,11 @@ static inline void upipe_err_va(struct upipe *upipe, const char *format, ...)
  */
 static inline void upipe_warn_va(struct upipe *upipe, const char *format, ...)
 {
-    UBASE_VARARG(upipe_warn(upipe, string))
+    if (unlikely(!uprobe_log_filter(upipe->uprobe, upipe,
+                                    UPROBE_LOG_WARNING, format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(upipe->uprobe, upipe,
+                                     UPROBE_LOG_WARNING, string))
 }
 
 /** @This throws a notice statement event. This event is thrown whenever a pipe
@@ -541,7 +691,11 @@ static inline void upipe_warn_va(struct upipe *upipe, const char *format, ...)
  */
 static inline void upipe_notice_va(struct upipe *upipe, const char *format, ...)
 {
-    UBASE_VARARG(upipe_notice(upipe, string))
+    if (unlikely(!uprobe_log_filter(upipe->uprobe, upipe,
+                                    UPROBE_LOG_NOTICE, format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(upipe->uprobe, upipe,
+                                     UPROBE_LOG_NOTICE, string))
 }
 
 /** @This throws a debug statement event. This event is thrown whenever a pipe
@@ -559,7 +713,11 @@ static inline void upipe_notice_va(struct upipe *upipe, const char *format, ...)
  */
 static inline void upipe_dbg_va(struct upipe *upipe, const char *format, ...)
 {
-    UBASE_VARARG(upipe_dbg(upipe, string))
+    if (unlikely(!uprobe_log_filter(upipe->uprobe, upipe,
+                                    UPROBE_LOG_DEBUG, format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(upipe->uprobe, upipe,
+                                     UPROBE_LOG_DEBUG, string))
 }
 
 /** @This throws a verbose statement event. This event is thrown whenever a pipe
@@ -579,7 +737,11 @@ static inline void upipe_dbg_va(struct upipe *upipe, const char *format, ...)
 static inline void upipe_verbose_va(struct upipe *upipe,
                                     const char *format, ...)
 {
-    UBASE_VARARG(upipe_verbose(upipe, string))
+    if (unlikely(!uprobe_log_filter(upipe->uprobe, upipe,
+                                    UPROBE_LOG_VERBOSE, format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(upipe->uprobe, upipe,
+                                     UPROBE_LOG_VERBOSE, string))
 }
 
 /** @This throws a fatal error event. After this event, the behaviour
@@ -824,6 +986,38 @@ static inline int upipe_throw_clock_ts(struct upipe *upipe, struct uref *uref)
     return upipe_throw(upipe, UPROBE_CLOCK_TS, uref);
 }
 
+/** @This throws an event telling the complexity of the last group of
+ * pictures coded by an encoder. The complexity is the average product of
+ * the coded size, in octets per second, by the quantizer step relative to
+ * the finest step of the codec, so that it estimates the octetrate needed
+ * to code the same content at the finest quality. It is only meant to be
+ * compared between encoders of the same codec.
+ *
+ * @param upipe description structure of the encoder
+ * @param complexity complexity of the last group of pictures
+ * @return an error code
+ */
+static inline int upipe_throw_encoder_complexity(struct upipe *upipe,
+                                                 uint64_t complexity)
+{
+    return upipe_throw(upipe, UPROBE_ENCODER_COMPLEXITY, complexity);
+}
+
+/** @This throws an event telling that a uref is about to be dropped to
+ * recover from an overload. The uref is freed by the pipe afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref being dropped
+ * @param priority drop priority of the uref (see @ref uref_priority)
+ * @return an error code
+ */
+static inline int upipe_throw_overload_drop(struct upipe *upipe,
+                                            struct uref *uref,
+                                            unsigned int priority)
+{
+    return upipe_throw(upipe, UPROBE_OVERLOAD_DROP, uref, priority);
+}
+
 /** @This catches an event coming from an inner pipe, and rethrows is as if
  * it were sent by the outermost pipe.
  *
@@ -856,7 +1050,39 @@ static inline void upipe_input(struct upipe *upipe, struct uref *uref,
     assert(upipe != NULL);
     assert(upipe->mgr->upipe_input != NULL);
     upipe_use(upipe);
-    upipe->mgr->upipe_input(upipe, uref, upump_p);
+    utrace(upipe, uref, UTRACE_INPUT);
+    if (unlikely(upipe->stats != NULL))
+        upipe_stats_input(upipe, uref, upump_p);
+    else
+        upipe->mgr->upipe_input(upipe, uref, upump_p);
+    upipe_release(upipe);
+}
+
+/** @This sends a list of urefs to the input of a pipe in a single call,
+ * if the pipe implements it, or else one by one. The urefs are removed
+ * from the list and then belong to the callee.
+ *
+ * @param upipe description structure of the pipe
+ * @param urefs list of urefs to send
+ * @param upump_p reference to pump that generated the buffers
+ */
+static inline void upipe_input_list(struct upipe *upipe, struct uchain *urefs,
+                                    struct upump **upump_p)
+{
+    assert(upipe != NULL);
+    struct uchain *uchain;
+    upipe_use(upipe);
+    if (upipe->mgr->upipe_input_list == NULL ||
+        unlikely(upipe->stats != NULL)) {
+        while ((uchain = ulist_pop(urefs)) != NULL)
+            upipe_input(upipe, uref_from_uchain(uchain), upump_p);
+    } else {
+        if (unlikely(utrace_enabled))
+            ulist_foreach (urefs, uchain)
+                utrace(upipe, uref_from_uchain(uchain), UTRACE_INPUT);
+        upipe->mgr->upipe_input_list(upipe, urefs, upump_p);
+        assert(ulist_empty(urefs));
+    }
     upipe_release(upipe);
 }
 
@@ -1055,6 +1281,21 @@ static inline int upipe_flush(struct upipe *upipe)
     return upipe_control(upipe, UPIPE_FLUSH);
 }
 
+/** @This asks a pipe which has not received data for a while to release
+ * the state and buffers it only needs while data flows (pools, pending
+ * partial frames, oversized tables). The pipe rebuilds them when data
+ * comes again, without reconfiguration. Pipes handling this command
+ * propagate it to their output(s); the propagation stops at the first pipe
+ * which does not handle it.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static inline int upipe_hibernate(struct upipe *upipe)
+{
+    return upipe_control(upipe, UPIPE_HIBERNATE);
+}
+
 /** @deprecated @see upipe_flush */
 static inline UBASE_DEPRECATED int upipe_sink_flush(struct upipe *upipe)
 {
@@ -1105,6 +1346,34 @@ static inline int upipe_sub_get_super(struct upipe *upipe, struct upipe **p)
     return upipe_control(upipe, UPIPE_SUB_GET_SUPER, p);
 }
 
+/** @This returns the target octetrate of the rate control of an encoder.
+ *
+ * @param upipe description structure of the encoder
+ * @param octetrate_p filled in with the octetrate, in octets per second
+ * @return an error code
+ */
+static inline int upipe_encoder_get_octetrate(struct upipe *upipe,
+                                              uint64_t *octetrate_p)
+{
+    return upipe_control(upipe, UPIPE_ENCODER_GET_OCTETRATE, octetrate_p);
+}
+
+/** @This changes the target octetrate of the rate control of an encoder.
+ * Contrary to options set before the encoder is opened, it may be called
+ * while encoding, and applies from the next coded picture without
+ * changing the output flow definition, so that a downstream mux keeps its
+ * configuration.
+ *
+ * @param upipe description structure of the encoder
+ * @param octetrate octetrate, in octets per second
+ * @return an error code
+ */
+static inline int upipe_encoder_set_octetrate(struct upipe *upipe,
+                                              uint64_t octetrate)
+{
+    return upipe_control(upipe, UPIPE_ENCODER_SET_OCTETRATE, octetrate);
+}
+
 /** @This declares ten functions to allocate pipes with a certain pipe
  * allocator.
  *
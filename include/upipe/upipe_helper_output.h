@@ -83,6 +83,13 @@ enum upipe_helper_output_state {
  * of sending the flow definition if necessary.
  *
  * @item @code
+ *  void upipe_foo_output_list(struct upipe *upipe, struct uchain *urefs,
+ *                             struct upump **upump_p)
+ * @end code
+ * Called whenever you need to send a list of packets to your output in a
+ * single call (@see upipe_input_list). The list is emptied.
+ *
+ * @item @code
  *  int upipe_foo_register_output_request(struct upipe *upipe,
  *                                        struct urequest *urequest)
  * @end code
@@ -221,8 +228,12 @@ static UBASE_UNUSED void STRUCTURE##_output(struct upipe *upipe,            \
             }                                                               \
                                                                             \
             case UPIPE_HELPER_OUTPUT_VALID:                                 \
-                if (uref != NULL)                                           \
-                    upipe_input(s->OUTPUT, uref, upump_p);                  \
+                if (uref == NULL)                                           \
+                    return;                                                 \
+                if (unlikely(upipe->stats != NULL))                         \
+                    upipe->stats->outputs++;                                \
+                utrace(upipe, uref, UTRACE_OUTPUT);                         \
+                upipe_input(s->OUTPUT, uref, upump_p);                      \
                 return;                                                     \
                                                                             \
             case UPIPE_HELPER_OUTPUT_INVALID:                               \
@@ -232,6 +243,37 @@ static UBASE_UNUSED void STRUCTURE##_output(struct upipe *upipe,            \
         }                                                                   \
     }                                                                       \
 }                                                                           \
+/** @internal @This sends a list of urefs to the output. Note that the      \
+ * urefs are removed from the list, and are then owned by the callee.       \
+ *                                                                          \
+ * @param upipe description structure of the pipe                           \
+ * @param urefs list of urefs to send                                       \
+ * @param upump_p reference to pump that generated the buffers              \
+ */                                                                         \
+static UBASE_UNUSED void STRUCTURE##_output_list(struct upipe *upipe,       \
+                                                 struct uchain *urefs,      \
+                                                 struct upump **upump_p)    \
+{                                                                           \
+    struct STRUCTURE *s = STRUCTURE##_from_upipe(upipe);                    \
+    struct uchain *uchain;                                                  \
+    if (unlikely(ulist_empty(urefs)))                                       \
+        return;                                                             \
+    STRUCTURE##_output(upipe, NULL, upump_p);                               \
+    if (unlikely(s->OUTPUT == NULL ||                                       \
+                 s->OUTPUT_STATE != UPIPE_HELPER_OUTPUT_VALID)) {           \
+        while ((uchain = ulist_pop(urefs)) != NULL)                         \
+            uref_free(uref_from_uchain(uchain));                            \
+        return;                                                             \
+    }                                                                       \
+                                                                            \
+    if (unlikely(upipe->stats != NULL || utrace_enabled))                   \
+        ulist_foreach (urefs, uchain) {                                     \
+            if (upipe->stats != NULL)                                       \
+                upipe->stats->outputs++;                                    \
+            utrace(upipe, uref_from_uchain(uchain), UTRACE_OUTPUT);         \
+        }                                                                   \
+    upipe_input_list(s->OUTPUT, urefs, upump_p);                            \
+}                                                                           \
 /** @internal @This registers a request to be forwarded downstream. The     \
  * request will be replayed if the output changes. If there is no output,   \
  * the request will be sent via a probe.                                    \
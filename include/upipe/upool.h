@@ -35,6 +35,7 @@ extern "C" {
 #endif
 
 #include <upipe/ubase.h>
+#include <upipe/uatomic.h>
 #include <upipe/ulifo.h>
 
 /** @hidden */
@@ -53,6 +54,34 @@ struct upool {
     upool_alloc_cb alloc_cb;
     /** call-back to release unused elements */
     upool_free_cb free_cb;
+
+    /** maximum number of elements in the LIFO given at init */
+    uint16_t length;
+    /** current maximum number of elements in the LIFO */
+    uint16_t depth;
+    /** number of elements allocated with alloc_cb */
+    uatomic_uint32_t created;
+    /** number of elements released with free_cb */
+    uatomic_uint32_t destroyed;
+    /** number of elements released because the LIFO was full */
+    uatomic_uint32_t overflows;
+};
+
+/** @This is a snapshot of the statistics of a upool. As the counters are
+ * only updated when the pool is empty or full, the number of elements
+ * currently allocated (either in use or kept in the pool) is the difference
+ * between created and destroyed. */
+struct upool_stats {
+    /** maximum number of elements in the pool given at init */
+    uint16_t length;
+    /** current maximum number of elements in the pool */
+    uint16_t depth;
+    /** number of elements allocated because the pool was empty */
+    uint32_t created;
+    /** number of elements released */
+    uint32_t destroyed;
+    /** number of elements released because the pool was full */
+    uint32_t overflows;
 };
 
 /** @This returns the required size of extra data space for upool.
@@ -75,6 +104,32 @@ static inline void upool_init(struct upool *upool, uint16_t length, void *extra,
     ulifo_init(&upool->lifo, length, extra);
     upool->alloc_cb = alloc_cb;
     upool->free_cb = free_cb;
+    upool->length = upool->depth = length;
+    uatomic_init(&upool->created, 0);
+    uatomic_init(&upool->destroyed, 0);
+    uatomic_init(&upool->overflows, 0);
+}
+
+/** @internal @This allocates a new element with the call-back.
+ *
+ * @param upool pointer to a upool structure
+ * @return allocated element, or NULL in case of allocation error
+ */
+static inline void *upool_create_internal(struct upool *upool)
+{
+    uatomic_fetch_add(&upool->created, 1);
+    return upool->alloc_cb(upool);
+}
+
+/** @internal @This releases an element with the call-back.
+ *
+ * @param upool pointer to a upool structure
+ * @param obj element to release
+ */
+static inline void upool_destroy_internal(struct upool *upool, void *obj)
+{
+    uatomic_fetch_add(&upool->destroyed, 1);
+    upool->free_cb(upool, obj);
 }
 
 /** @internal @This allocates an elements from the upool.
@@ -87,7 +142,7 @@ static inline void *upool_alloc_internal(struct upool *upool)
     void *obj = ulifo_pop(&upool->lifo, void *);
     if (likely(obj != NULL))
         return obj;
-    return upool->alloc_cb(upool);
+    return upool_create_internal(upool);
 }
 
 /** @This allocates an elements from the upool.
@@ -107,7 +162,8 @@ static inline void upool_free(struct upool *upool, void *obj)
 {
     if (likely(ulifo_push(&upool->lifo, obj)))
         return;
-    upool->free_cb(upool, obj);
+    uatomic_fetch_add(&upool->overflows, 1);
+    upool_destroy_internal(upool, obj);
 }
 
 /** @This empties a upool.
@@ -118,7 +174,47 @@ static inline void upool_vacuum(struct upool *upool)
 {
     void *obj;
     while ((obj = ulifo_pop(&upool->lifo, void *)) != NULL)
-        upool->free_cb(upool, obj);
+        upool_destroy_internal(upool, obj);
+}
+
+/** @This changes the maximum number of elements in a upool, within the
+ * length given to @ref upool_init. Elements in excess are released. It may
+ * be called while other threads allocate from the pool, but not from two
+ * threads at the same time.
+ *
+ * @param upool pointer to a upool structure
+ * @param depth new maximum number of elements (capped to the length)
+ */
+static inline void upool_resize(struct upool *upool, uint16_t depth)
+{
+    if (depth > upool->length)
+        depth = upool->length;
+    while (upool->depth > depth) {
+        if (ulifo_shrink(&upool->lifo)) {
+            upool->depth--;
+            continue;
+        }
+        void *obj = ulifo_pop(&upool->lifo, void *);
+        if (obj != NULL)
+            upool_destroy_internal(upool, obj);
+    }
+    while (upool->depth < depth && ulifo_grow(&upool->lifo))
+        upool->depth++;
+}
+
+/** @This returns a snapshot of the statistics of a upool.
+ *
+ * @param upool pointer to a upool structure
+ * @param stats_p filled in with the statistics
+ */
+static inline void upool_get_stats(struct upool *upool,
+                                   struct upool_stats *stats_p)
+{
+    stats_p->length = upool->length;
+    stats_p->depth = upool->depth;
+    stats_p->created = uatomic_load(&upool->created);
+    stats_p->destroyed = uatomic_load(&upool->destroyed);
+    stats_p->overflows = uatomic_load(&upool->overflows);
 }
 
 /** @This empties and cleans up a upool.
@@ -129,6 +225,200 @@ static inline void upool_clean(struct upool *upool)
 {
     upool_vacuum(upool);
     ulifo_clean(&upool->lifo);
+    uatomic_clean(&upool->created);
+    uatomic_clean(&upool->destroyed);
+    uatomic_clean(&upool->overflows);
+}
+
+/** @internal @This is a thread-local variable whose address identifies the
+ * calling thread, defined in libupipe. */
+extern __thread uint8_t upool_cache_anchor;
+
+/** @This is the maximum length of the caches embedded in managers. */
+#define UPOOL_CACHE_MAX_LENGTH 32
+
+/** @This is the implementation of a per-thread cache (magazine) sitting in
+ * front of a @ref upool. It belongs to the thread which initialized it;
+ * elements are exchanged with the shared pool in batches of half the size
+ * of the cache, so that most allocations and releases don't touch the
+ * atomic LIFO. Other threads transparently use the shared pool, so that a
+ * manager may embed a cache and still be called from any thread.
+ *
+ * The cache never retains more than half the current depth of the shared
+ * pool, so that it follows @ref upool_resize, and it is bypassed when the
+ * pool is shallower than 4 elements. */
+struct upool_cache {
+    /** pointer to the shared pool */
+    struct upool *upool;
+    /** identity of the owning thread */
+    const void *owner;
+    /** maximum number of elements in the cache */
+    uint16_t length;
+    /** number of elements currently in the cache */
+    uint16_t count;
+    /** array of cached elements */
+    void **elems;
+};
+
+/** @This returns the required size of extra data space for upool_cache.
+ *
+ * @param length maximum number of elements in the cache
+ * @return size in octets to allocate
+ */
+#define upool_cache_sizeof(length) ((length) * sizeof(void *))
+
+/** @This returns the length of the cache a manager puts in front of a pool
+ * of the given length.
+ *
+ * @param length maximum number of elements in the shared pool
+ * @return maximum number of elements in the cache
+ */
+#define upool_cache_length(length)                                          \
+    ((length) / 2 < UPOOL_CACHE_MAX_LENGTH ? (length) / 2 :                 \
+     UPOOL_CACHE_MAX_LENGTH)
+
+/** @This initializes a upool_cache, owned by the calling thread.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @param upool pointer to the shared upool
+ * @param length maximum number of elements in the cache (below 2, the cache
+ * is disabled and all operations use the shared pool)
+ * @param extra mandatory extra space allocated by the caller, with the size
+ * returned by @ref #upool_cache_sizeof
+ */
+static inline void upool_cache_init(struct upool_cache *cache,
+                                    struct upool *upool, uint16_t length,
+                                    void *extra)
+{
+    cache->upool = upool;
+    cache->owner = &upool_cache_anchor;
+    cache->length = length;
+    cache->count = 0;
+    cache->elems = (void **)extra;
+}
+
+/** @internal @This checks if the calling thread owns the cache.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @return true if the cache is owned by the calling thread
+ */
+static inline bool upool_cache_owned(const struct upool_cache *cache)
+{
+    return cache->owner == &upool_cache_anchor;
+}
+
+/** @internal @This returns the current maximum number of elements in the
+ * cache, from the depth of the shared pool.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @return maximum number of elements, or 0 if the cache is bypassed
+ */
+static inline uint16_t upool_cache_limit(const struct upool_cache *cache)
+{
+    uint16_t limit = cache->upool->depth / 2;
+    if (limit > cache->length)
+        limit = cache->length;
+    return limit >= 2 ? limit : 0;
+}
+
+/** @internal @This refills an empty cache from the shared pool.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @param count number of elements to fetch
+ */
+static inline void upool_cache_refill(struct upool_cache *cache,
+                                      uint16_t count)
+{
+    while (cache->count < count) {
+        void *obj = ulifo_pop(&cache->upool->lifo, void *);
+        if (obj == NULL)
+            break;
+        cache->elems[cache->count++] = obj;
+    }
+}
+
+/** @internal @This drains a cache to the shared pool.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @param count number of elements to keep
+ */
+static inline void upool_cache_drain(struct upool_cache *cache,
+                                     uint16_t count)
+{
+    while (cache->count > count)
+        upool_free(cache->upool, cache->elems[--cache->count]);
+}
+
+/** @internal @This allocates an element from the cache, refilling it with
+ * half its size of elements from the shared pool if it is empty.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @return allocated element, or NULL in case of allocation error
+ */
+static inline void *upool_cache_alloc_internal(struct upool_cache *cache)
+{
+    if (unlikely(!upool_cache_owned(cache)))
+        return upool_alloc_internal(cache->upool);
+    if (unlikely(!cache->count)) {
+        upool_cache_refill(cache, upool_cache_limit(cache) / 2);
+        if (unlikely(!cache->count))
+            return upool_alloc_internal(cache->upool);
+    }
+    return cache->elems[--cache->count];
+}
+
+/** @This allocates an element from the cache.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @param type type of the opaque pointer
+ * @return allocated element, or NULL in case of allocation error
+ */
+#define upool_cache_alloc(cache, type) (type)upool_cache_alloc_internal(cache)
+
+/** @This releases an element to the cache, draining half of it to the
+ * shared pool if it is full.
+ *
+ * @param cache pointer to a upool_cache structure
+ * @param obj element to free
+ */
+static inline void upool_cache_free(struct upool_cache *cache, void *obj)
+{
+    if (unlikely(!upool_cache_owned(cache))) {
+        upool_free(cache->upool, obj);
+        return;
+    }
+    uint16_t limit = upool_cache_limit(cache);
+    if (unlikely(cache->count >= limit)) {
+        upool_cache_drain(cache, limit / 2);
+        if (unlikely(!limit)) {
+            upool_free(cache->upool, obj);
+            return;
+        }
+    }
+    cache->elems[cache->count++] = obj;
+}
+
+/** @This returns all cached elements to the shared pool. It must only be
+ * called when no thread uses the cache anymore, typically before the shared
+ * pool is cleaned.
+ *
+ * @param cache pointer to a upool_cache structure
+ */
+static inline void upool_cache_clean(struct upool_cache *cache)
+{
+    upool_cache_drain(cache, 0);
+}
+
+/** @This returns all cached elements to the shared pool if called by the
+ * owning thread, and does nothing otherwise. Contrary to
+ * @ref upool_cache_clean, it may be called while the cache is in use.
+ *
+ * @param cache pointer to a upool_cache structure
+ */
+static inline void upool_cache_vacuum(struct upool_cache *cache)
+{
+    if (upool_cache_owned(cache))
+        upool_cache_clean(cache);
 }
 
 #ifdef __cplusplus
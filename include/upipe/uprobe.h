@@ -38,6 +38,7 @@ extern "C" {
 #include <upipe/uref_flow.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <assert.h>
 
@@ -98,6 +99,15 @@ enum uprobe_event {
     /** a pipe signals that a uref carries a presentation and/or a
      * decoding timestamp (struct uref *) */
     UPROBE_CLOCK_TS,
+    /** a pipe reports its throughput and latency counters
+     * (const struct upipe_stats *) */
+    UPROBE_STATS,
+    /** an encoder reports the complexity of the last coded group of
+     * pictures (uint64_t) */
+    UPROBE_ENCODER_COMPLEXITY,
+    /** a pipe signals that it dropped a uref to recover from an overload,
+     * according to its drop priority (struct uref *, unsigned int) */
+    UPROBE_OVERLOAD_DROP,
 
     /** non-standard events implemented by a module type can start from
      * there (first arg = signature) */
@@ -119,6 +129,23 @@ enum uprobe_log_level {
     UPROBE_LOG_ERROR
 };
 
+/** @This returns the bit of a standard event in a mask of events. */
+#define UPROBE_EVENT_MASK(event) (UINT64_C(1) << (event))
+/** @This is a mask of events matching all events. */
+#define UPROBE_EVENTS_ALL UINT64_MAX
+
+/** @This checks if an event belongs to a mask of events. Local events are
+ * always supposed to be part of the mask.
+ *
+ * @param events mask of events
+ * @param event event to check
+ * @return true if the event is part of the mask
+ */
+static inline bool uprobe_events_match(uint64_t events, int event)
+{
+    return event >= 64 || (events & UPROBE_EVENT_MASK(event));
+}
+
 /** @This is the call-back type for uprobe events. */
 typedef int (*uprobe_throw_func)(struct uprobe *, struct upipe *, int, va_list);
 
@@ -131,6 +158,9 @@ struct uprobe {
     uprobe_throw_func uprobe_throw;
     /** pointer to next probe, to be used by the uprobe_throw function */
     struct uprobe *next;
+    /** mask of standard events caught by uprobe_throw, the others being
+     * directly passed to the next probe */
+    uint64_t events;
 };
 
 /** @This increments the reference count of a uprobe.
@@ -197,6 +227,40 @@ static inline void uprobe_init(struct uprobe *uprobe,
     uprobe->refcount = NULL;
     uprobe->uprobe_throw = uprobe_throw;
     uprobe->next = next;
+    uprobe->events = UPROBE_EVENTS_ALL;
+}
+
+/** @internal @This is incremented each time the events of a probe change,
+ * so that pipes recompute the events of their probe hierarchy. */
+extern volatile uint32_t uprobe_events_generation;
+
+/** @This restricts the standard events caught by a probe, so that the others
+ * are passed to the next probe without calling the throw function. It may be
+ * called while pipes use the probe: they notice the change on their next
+ * event.
+ *
+ * @param uprobe pointer to probe
+ * @param events mask of caught events, built with @ref UPROBE_EVENT_MASK
+ */
+static inline void uprobe_set_events(struct uprobe *uprobe, uint64_t events)
+{
+    assert(uprobe != NULL);
+    uprobe->events = events;
+    __sync_synchronize();
+    uprobe_events_generation++;
+}
+
+/** @This returns the mask of standard events caught by a probe hierarchy.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @return mask of events
+ */
+static inline uint64_t uprobe_chain_events(struct uprobe *uprobe)
+{
+    uint64_t events = 0;
+    for ( ; uprobe != NULL; uprobe = uprobe->next)
+        events |= uprobe->events;
+    return events;
 }
 
 /** @This cleans up a uprobe structure. It is typically called by the
@@ -224,6 +288,8 @@ static inline void uprobe_clean(struct uprobe *uprobe)
 static inline int uprobe_throw_va(struct uprobe *uprobe, struct upipe *upipe,
                                   int event, va_list args)
 {
+    while (uprobe != NULL && !uprobe_events_match(uprobe->events, event))
+        uprobe = uprobe->next;
     if (unlikely(uprobe == NULL))
         return UBASE_ERR_UNHANDLED;
     return uprobe->uprobe_throw(uprobe, upipe, event, args);
@@ -274,6 +340,30 @@ static inline void uprobe_log(struct uprobe *uprobe, struct upipe *upipe,
     uprobe_throw(uprobe, upipe, UPROBE_LOG, level, msg);
 }
 
+/** @internal @This asks the rate-limiting probes of a hierarchy whether a
+ * log message should be thrown, before its arguments are formatted.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @param upipe description structure of the pipe
+ * @param level level of importance of the message
+ * @param format format of the textual message
+ * @return false if the message is suppressed
+ */
+bool uprobe_log_filter(struct uprobe *uprobe, struct upipe *upipe,
+                       enum uprobe_log_level level, const char *format);
+
+/** @internal @This throws a log event whose format was accepted by
+ * @ref uprobe_log_filter, and then ends the filtering of the message, even
+ * if a probe of the hierarchy did not forward it.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @param upipe description structure of the pipe
+ * @param level level of importance of the message
+ * @param msg textual message
+ */
+void uprobe_log_filtered(struct uprobe *uprobe, struct upipe *upipe,
+                         enum uprobe_log_level level, const char *msg);
+
 /** @internal @This throws a log event, with printf-style message generation.
  *
  * @param uprobe pointer to probe hierarchy
@@ -285,7 +375,9 @@ static inline void uprobe_log_va(struct uprobe *uprobe, struct upipe *upipe,
                                 enum uprobe_log_level level,
                                 const char *format, ...)
 {
-    UBASE_VARARG(uprobe_log(uprobe, upipe, level, string))
+    if (unlikely(!uprobe_log_filter(uprobe, upipe, level, format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(uprobe, upipe, level, string))
 }
 
 /** @This throws an error event. This event is thrown whenever a pipe wants
@@ -307,7 +399,11 @@ static inline void uprobe_log_va(struct uprobe *uprobe, struct upipe *upipe,
 static inline void uprobe_err_va(struct uprobe *uprobe, struct upipe *upipe,
                                  const char *format, ...)
 {
-    UBASE_VARARG(uprobe_err(uprobe, upipe, string))
+    if (unlikely(!uprobe_log_filter(uprobe, upipe, UPROBE_LOG_ERROR,
+                                    format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(uprobe, upipe, UPROBE_LOG_ERROR,
+                                     string))
 }
 
 /** @This throws a warning event. This event is thrown whenever a pipe wants
@@ -329,7 +425,11 @@ static inline void uprobe_err_va(struct uprobe *uprobe, struct upipe *upipe,
 static inline void uprobe_warn_va(struct uprobe *uprobe, struct upipe *upipe,
                                   const char *format, ...)
 {
-    UBASE_VARARG(uprobe_warn(uprobe, upipe, string))
+    if (unlikely(!uprobe_log_filter(uprobe, upipe, UPROBE_LOG_WARNING,
+                                    format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(uprobe, upipe, UPROBE_LOG_WARNING,
+                                     string))
 }
 
 /** @This throws a notice statement event. This event is thrown whenever a pipe
@@ -351,7 +451,11 @@ static inline void uprobe_warn_va(struct uprobe *uprobe, struct upipe *upipe,
 static inline void uprobe_notice_va(struct uprobe *uprobe, struct upipe *upipe,
                                     const char *format, ...)
 {
-    UBASE_VARARG(uprobe_notice(uprobe, upipe, string))
+    if (unlikely(!uprobe_log_filter(uprobe, upipe, UPROBE_LOG_NOTICE,
+                                    format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(uprobe, upipe, UPROBE_LOG_NOTICE,
+                                     string))
 }
 
 /** @This throws a debug statement event. This event is thrown whenever a pipe
@@ -373,7 +477,11 @@ static inline void uprobe_notice_va(struct uprobe *uprobe, struct upipe *upipe,
 static inline void uprobe_dbg_va(struct uprobe *uprobe, struct upipe *upipe,
                                  const char *format, ...)
 {
-    UBASE_VARARG(uprobe_dbg(uprobe, upipe, string))
+    if (unlikely(!uprobe_log_filter(uprobe, upipe, UPROBE_LOG_DEBUG,
+                                    format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(uprobe, upipe, UPROBE_LOG_DEBUG,
+                                     string))
 }
 
 /** @This throws a verbose statement event. This event is thrown whenever a
@@ -396,7 +504,11 @@ static inline void uprobe_dbg_va(struct uprobe *uprobe, struct upipe *upipe,
 static inline void uprobe_verbose_va(struct uprobe *uprobe, struct upipe *upipe,
                                  const char *format, ...)
 {
-    UBASE_VARARG(uprobe_verbose(uprobe, upipe, string))
+    if (unlikely(!uprobe_log_filter(uprobe, upipe, UPROBE_LOG_VERBOSE,
+                                    format)))
+        return;
+    UBASE_VARARG(uprobe_log_filtered(uprobe, upipe, UPROBE_LOG_VERBOSE,
+                                     string))
 }
 
 /** @This throws a fatal error event. After this event, the behaviour
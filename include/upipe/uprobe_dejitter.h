@@ -40,17 +40,29 @@ extern "C" {
 #include <stdint.h>
 
 /** @This is a super-set of the uprobe structure with additional local
- * members. */
+ * members.
+ *
+ * The offset between the stream clock and the system clock is estimated by a
+ * linear regression over the clock references, which also tracks the drift
+ * between both clocks. It uses a growing memory after a discontinuity, so that
+ * it converges quickly, and then a fading memory of divider references, where
+ * it behaves as a second-order phase-locked loop. References deviating too
+ * much from the prediction are rejected, unless they persist.
+ */
 struct uprobe_dejitter {
     /** number of references to average */
     unsigned int divider;
 
     /** number of references received for offset calculaton */
     unsigned int offset_count;
-    /** offset between stream clock and system clock */
+    /** offset between stream clock and system clock at the last reference */
     int64_t offset;
-    /** residue */
-    int64_t offset_residue;
+    /** last reference, in stream clock */
+    uint64_t last_cr;
+    /** drift of the system clock relative to the stream clock */
+    double drift;
+    /** number of consecutive rejected references */
+    unsigned int outliers;
 
     /** number of references received for deviation calculaton */
     unsigned int deviation_count;
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe collecting metrics of pipes and exporting them over HTTP
+ *
+ * This probe catches @ref UPROBE_STATS events, and counts warnings, errors,
+ * synchronization losses and clock discontinuities of the pipes below it.
+ * Gauges (memory pools, dejitter, or anything the application reads with a
+ * callback, such as queue depths) may be registered as well. The metrics
+ * are formatted in the Prometheus text exposition format, and served by a
+ * non-blocking HTTP endpoint driven by the given upump manager.
+ *
+ * The probe must only catch events from pipes running in the thread of the
+ * upump manager.
+ */
+
+#ifndef _UPIPE_UPROBE_METRICS_H_
+/** @hidden */
+#define _UPIPE_UPROBE_METRICS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+
+#include <stdint.h>
+
+/** @hidden */
+struct upump_mgr;
+/** @hidden */
+struct upump;
+/** @hidden */
+struct umem_mgr;
+/** @hidden */
+struct uprobe_dejitter;
+
+/** maximum number of simultaneous HTTP clients */
+#define UPROBE_METRICS_MAX_CLIENTS 8
+
+/** @This is the type of the callback reading the value of a gauge.
+ *
+ * @param opaque opaque given to @ref uprobe_metrics_add_gauge
+ * @param value_p filled in with the value of the gauge
+ * @return an error code
+ */
+typedef int (*uprobe_metrics_cb)(void *opaque, int64_t *value_p);
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_metrics {
+    /** upump manager driving the HTTP endpoint */
+    struct upump_mgr *upump_mgr;
+    /** listening socket, or -1 */
+    int fd;
+    /** pump accepting connections */
+    struct upump *upump;
+    /** list of connected clients */
+    struct uchain clients;
+    /** number of connected clients */
+    unsigned int nb_clients;
+
+    /** list of pipes having thrown events */
+    struct uchain pipes;
+    /** identifier of the next pipe */
+    uint64_t next_id;
+    /** list of registered gauges */
+    struct uchain gauges;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_metrics, uprobe)
+
+/** @This initializes an already allocated uprobe_metrics structure.
+ *
+ * @param uprobe_metrics pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param upump_mgr upump manager driving the HTTP endpoint, or NULL
+ * @param addr address to listen to, or NULL for all addresses
+ * @param port TCP port to listen to, or 0 for no HTTP endpoint
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_metrics_init(struct uprobe_metrics *uprobe_metrics,
+                                   struct uprobe *next,
+                                   struct upump_mgr *upump_mgr,
+                                   const char *addr, unsigned int port);
+
+/** @This cleans a uprobe_metrics structure.
+ *
+ * @param uprobe_metrics structure to clean
+ */
+void uprobe_metrics_clean(struct uprobe_metrics *uprobe_metrics);
+
+/** @This allocates a new uprobe_metrics structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param upump_mgr upump manager driving the HTTP endpoint, or NULL
+ * @param addr address to listen to, or NULL for all addresses
+ * @param port TCP port to listen to, or 0 for no HTTP endpoint
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_metrics_alloc(struct uprobe *next,
+                                    struct upump_mgr *upump_mgr,
+                                    const char *addr, unsigned int port);
+
+/** @This registers a gauge read by a callback when the metrics are
+ * formatted.
+ *
+ * @param uprobe pointer to probe
+ * @param name name of the metric
+ * @param labels Prometheus labels of the metric (such as "queue=\"in\""),
+ * or NULL
+ * @param cb callback reading the value of the gauge
+ * @param opaque opaque passed to the callback
+ * @return an error code
+ */
+int uprobe_metrics_add_gauge(struct uprobe *uprobe, const char *name,
+                             const char *labels, uprobe_metrics_cb cb,
+                             void *opaque);
+
+/** @This registers the statistics of a umem pool manager, and the memory
+ * usage of any umem manager supporting @ref umem_mgr_get_usage (for instance
+ * a @ref umem_acct_mgr_alloc manager per pipeline). The statistics of a umem
+ * pool manager must have been enabled with @ref umem_pool_mgr_set_stats.
+ *
+ * @param uprobe pointer to probe
+ * @param name name of the manager, used as label
+ * @param umem_mgr pointer to umem manager
+ * @return an error code
+ */
+int uprobe_metrics_add_umem_mgr(struct uprobe *uprobe, const char *name,
+                                struct umem_mgr *umem_mgr);
+
+/** @This registers the offset and deviation of a dejitter probe.
+ *
+ * @param uprobe pointer to probe
+ * @param name name of the dejitter probe, used as label
+ * @param uprobe_dejitter pointer to dejitter probe
+ * @return an error code
+ */
+int uprobe_metrics_add_dejitter(struct uprobe *uprobe, const char *name,
+                                struct uprobe_dejitter *uprobe_dejitter);
+
+/** @This formats the metrics in the Prometheus text exposition format.
+ *
+ * @param uprobe pointer to probe
+ * @param buffer_p filled in with a pointer to a buffer to free() by the
+ * caller
+ * @param size_p filled in with the size of the text
+ * @return an error code
+ */
+int uprobe_metrics_format(struct uprobe *uprobe, char **buffer_p,
+                          size_t *size_p);
+
+/** @This returns the TCP port the HTTP endpoint listens to.
+ *
+ * @param uprobe pointer to probe
+ * @param port_p filled in with the port
+ * @return an error code
+ */
+int uprobe_metrics_get_port(struct uprobe *uprobe, unsigned int *port_p);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -72,6 +72,14 @@ struct uprobe *uprobe_pfx_init(struct uprobe_pfx *uprobe_pfx,
  */
 void uprobe_pfx_clean(struct uprobe_pfx *uprobe_pfx);
 
+/** @This returns the name of the first prefix probe found in a probe
+ * hierarchy.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @return name of the probe, or NULL if there is no named prefix probe
+ */
+const char *uprobe_pfx_get_name(struct uprobe *uprobe);
+
 /** @This allocates a new uprobe pfx structure.
  *
  * @param next next probe to test if this one doesn't catch the event
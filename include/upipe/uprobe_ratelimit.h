@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe suppressing repeated log messages
+ *
+ * This probe lets at most a given number of identical messages from the
+ * same pipe through per period, and suppresses the others. When the
+ * period of a suppressed message has elapsed, a summary telling how many
+ * times it was repeated is thrown with the next occurrence, or when the
+ * pipe dies. Messages generated with printf-style functions are checked
+ * by their format, before their arguments are expanded, so that a
+ * suppressed message costs almost nothing.
+ *
+ * Probes placed before this one in the hierarchy (closer to the pipe)
+ * still see all messages.
+ */
+
+#ifndef _UPIPE_UPROBE_RATELIMIT_H_
+/** @hidden */
+#define _UPIPE_UPROBE_RATELIMIT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** number of buckets of the hash table of messages */
+#define UPROBE_RATELIMIT_BUCKETS 64
+/** maximum number of messages tracked at the same time */
+#define UPROBE_RATELIMIT_MAX_ENTRIES 256
+
+/** @hidden */
+struct uclock;
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_ratelimit {
+    /** clock giving the current date */
+    struct uclock *uclock;
+    /** period in 27 MHz units */
+    uint64_t period;
+    /** number of identical messages let through per period */
+    unsigned int burst;
+
+    /** pipe whose next message was already accounted by its format */
+    struct upipe *bypass;
+    /** true if bypass is valid */
+    bool bypassed;
+    /** number of tracked messages */
+    unsigned int nb_entries;
+    /** hash table of tracked messages */
+    struct uchain buckets[UPROBE_RATELIMIT_BUCKETS];
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_ratelimit, uprobe)
+
+/** @This initializes an already allocated uprobe_ratelimit structure.
+ *
+ * @param uprobe_ratelimit pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock clock giving the current date, or NULL for the system clock
+ * @param period period in 27 MHz units
+ * @param burst number of identical messages let through per period
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ratelimit_init(struct uprobe_ratelimit *uprobe_ratelimit,
+                                     struct uprobe *next, struct uclock *uclock,
+                                     uint64_t period, unsigned int burst);
+
+/** @This cleans a uprobe_ratelimit structure.
+ *
+ * @param uprobe_ratelimit structure to clean
+ */
+void uprobe_ratelimit_clean(struct uprobe_ratelimit *uprobe_ratelimit);
+
+/** @This allocates a new uprobe_ratelimit structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock clock giving the current date, or NULL for the system clock
+ * @param period period in 27 MHz units
+ * @param burst number of identical messages let through per period
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ratelimit_alloc(struct uprobe *next,
+                                      struct uclock *uclock,
+                                      uint64_t period, unsigned int burst);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
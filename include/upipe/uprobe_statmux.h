@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe sharing an octetrate between encoders by their complexity
+ *
+ * This probe catches the @ref UPROBE_ENCODER_COMPLEXITY events thrown by
+ * encoders at the end of each group of pictures, and reallocates a fixed
+ * budget between all encoders having reported, in proportion to their
+ * complexities, with @ref upipe_encoder_set_octetrate. It is typically
+ * placed in the probe hierarchy of the video encoders of all programs of
+ * a constant-rate multiplex, with a budget equal to the elementary stream
+ * octetrate left for video by the mux, once audio, tables and overhead
+ * are accounted for.
+ *
+ * Encoders are detected when they are ready, as the pipes answering
+ * @ref upipe_encoder_get_octetrate. Until they report their first
+ * complexity, their current octetrate is kept out of the budget. The
+ * encoders should use the same codec so that their complexities compare.
+ * Commands are sent to the encoders from the thread throwing the events.
+ */
+
+#ifndef _UPIPE_UPROBE_STATMUX_H_
+/** @hidden */
+#define _UPIPE_UPROBE_STATMUX_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+
+#include <stdint.h>
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_statmux {
+    /** octetrate shared between the encoders */
+    uint64_t octetrate;
+    /** minimum octetrate of an encoder */
+    uint64_t min_octetrate;
+    /** maximum octetrate of an encoder, or 0 */
+    uint64_t max_octetrate;
+
+    /** list of encoders */
+    struct uchain encoders;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_statmux, uprobe)
+
+/** @This initializes an already allocated uprobe_statmux structure.
+ *
+ * @param uprobe_statmux pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param octetrate octetrate shared between the encoders
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_statmux_init(struct uprobe_statmux *uprobe_statmux,
+                                   struct uprobe *next, uint64_t octetrate);
+
+/** @This cleans a uprobe_statmux structure.
+ *
+ * @param uprobe_statmux structure to clean
+ */
+void uprobe_statmux_clean(struct uprobe_statmux *uprobe_statmux);
+
+/** @This allocates a new uprobe_statmux structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param octetrate octetrate shared between the encoders
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_statmux_alloc(struct uprobe *next, uint64_t octetrate);
+
+/** @This changes the octetrate shared between the encoders, and
+ * reallocates it immediately.
+ *
+ * @param uprobe pointer to probe
+ * @param octetrate octetrate shared between the encoders
+ */
+void uprobe_statmux_set_octetrate(struct uprobe *uprobe, uint64_t octetrate);
+
+/** @This sets the bounds of the octetrate of each encoder, and reallocates
+ * the budget immediately.
+ *
+ * @param uprobe pointer to probe
+ * @param min_octetrate minimum octetrate of an encoder
+ * @param max_octetrate maximum octetrate of an encoder, or 0 for no bound
+ */
+void uprobe_statmux_set_limits(struct uprobe *uprobe, uint64_t min_octetrate,
+                               uint64_t max_octetrate);
+
+/** @This returns the octetrate currently allocated to an encoder.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe description structure of the encoder
+ * @param octetrate_p filled in with the octetrate
+ * @return an error code
+ */
+int uprobe_statmux_get_octetrate(struct uprobe *uprobe, struct upipe *upipe,
+                                 uint64_t *octetrate_p);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
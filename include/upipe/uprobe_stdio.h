@@ -37,6 +37,16 @@ extern "C" {
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_helper_uprobe.h>
 
+#include <stdio.h>
+#include <stdint.h>
+
+/** size of the message of an asynchronous log record, including the final
+ * NUL character; longer messages are truncated */
+#define UPROBE_STDIO_RECORD_SIZE 512
+
+/** @hidden */
+struct uprobe_stdio_async;
+
 /** @This is a super-set of the uprobe structure with additional local
  * members. */
 struct uprobe_stdio {
@@ -44,6 +54,8 @@ struct uprobe_stdio {
     FILE *stream;
     /** minimum level of printed messages */
     enum uprobe_log_level min_level;
+    /** asynchronous logging, or NULL */
+    struct uprobe_stdio_async *async;
 
     /** structure exported to modules */
     struct uprobe uprobe;
@@ -79,6 +91,29 @@ void uprobe_stdio_clean(struct uprobe_stdio *uprobe_stdio);
 struct uprobe *uprobe_stdio_alloc(struct uprobe *next, FILE *stream,
                                   enum uprobe_log_level min_level);
 
+/** @This switches a uprobe_stdio to asynchronous logging. Messages are
+ * copied to one of depth preallocated records and queued to a background
+ * thread, which formats and writes them to the stream. If no record is
+ * available, the message is dropped and an overflow counter is incremented,
+ * so that the thread throwing the event never blocks. Once it is set, the
+ * stream must not be written to by other means until the probe is cleaned.
+ *
+ * @param uprobe pointer to probe
+ * @param depth number of records, between 1 and 255
+ * @return an error code
+ */
+int uprobe_stdio_set_async(struct uprobe *uprobe, unsigned int depth);
+
+/** @This returns the number of messages dropped because the asynchronous
+ * queue was full.
+ *
+ * @param uprobe pointer to probe
+ * @param overflows_p filled in with the number of dropped messages
+ * @return an error code
+ */
+int uprobe_stdio_get_overflows(struct uprobe *uprobe,
+                               uint32_t *overflows_p);
+
 #ifdef __cplusplus
 }
 #endif
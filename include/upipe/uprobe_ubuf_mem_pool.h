@@ -25,6 +25,10 @@
 
 /** @file
  * @short probe catching provide_request events asking for a ubuf manager, and keeping the managers in a pool
+ *
+ * The depths of the pools of the managers may be adapted to the observed
+ * usage by calling @ref uprobe_ubuf_mem_pool_tune periodically, after
+ * having set maximum depths with @ref uprobe_ubuf_mem_pool_set_max_depth.
  */
 
 #ifndef _UPIPE_UPROBE_UBUF_MEM_POOL_H_
@@ -47,6 +51,10 @@ struct uprobe_ubuf_mem_pool {
     uint16_t ubuf_pool_depth;
     /** depth of the shared object pool */
     uint16_t shared_pool_depth;
+    /** maximum depth of the ubuf pool when tuned */
+    uint16_t ubuf_max_depth;
+    /** maximum depth of the shared object pool when tuned */
+    uint16_t shared_max_depth;
 
     /** chained list of ubuf managers, elements are never removed */
     uatomic_ptr_t first;
@@ -80,6 +88,21 @@ struct uprobe *
  */
 void uprobe_ubuf_mem_pool_vacuum(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool);
 
+/** @This adapts the depths of the pools of the managers to the usage
+ * observed since the last call. A pool which had to release structures
+ * because it was full, and to allocate new ones because it was empty, is
+ * deepened by the number of such round-trips, up to the maximum depth.
+ * Managers which are no longer used by any pipe have their pools vacuumed,
+ * but keep their depth for the next pipe requesting them.
+ *
+ * It is meant to be called periodically (typically every second) from a
+ * timer. Please note that this function is not thread-safe, and mustn't be
+ * called at the same time as @ref uprobe_ubuf_mem_pool_vacuum.
+ *
+ * @param uprobe_ubuf_mem_pool structure to tune
+ */
+void uprobe_ubuf_mem_pool_tune(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool);
+
 /** @This cleans a uprobe_ubuf_mem_pool structure.
  *
  * @param uprobe_ubuf_mem_pool structure to clean
@@ -106,4 +129,16 @@ struct uprobe *uprobe_ubuf_mem_pool_alloc(struct uprobe *next,
  */
 void uprobe_ubuf_mem_pool_set(struct uprobe *uprobe, struct umem_mgr *umem_mgr);
 
+/** @This sets the depths up to which @ref uprobe_ubuf_mem_pool_tune may
+ * deepen the pools of the managers allocated afterwards. By default, they
+ * are the depths given at allocation, and pools are not deepened.
+ *
+ * @param uprobe pointer to probe
+ * @param ubuf_max_depth maximum number of ubuf structures in the pool
+ * @param shared_max_depth maximum number of shared structures in the pool
+ */
+void uprobe_ubuf_mem_pool_set_max_depth(struct uprobe *uprobe,
+                                        uint16_t ubuf_max_depth,
+                                        uint16_t shared_max_depth);
+
 #endif
@@ -110,6 +110,8 @@ struct upump_common_mgr {
     struct upool upump_pool;
     /** upump_blocker_pool */
     struct upool upump_blocker_pool;
+    /** cache of the upump_blocker pool */
+    struct upool_cache upump_blocker_cache;
 
     /** function to really start a watcher */
     void (*upump_real_start)(struct upump *);
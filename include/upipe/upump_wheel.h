@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short declarations for a upump manager multiplexing timers on a wheel
+ *
+ * The wheel manager wraps another upump manager. Timers allocated from it
+ * are not given to the underlying event loop, but sorted into a two-level
+ * timer wheel driven by a single periodic timer of the underlying manager,
+ * so that arming and stopping a timer is O(1) and all timers expiring in
+ * the same tick are dispatched by the same wake-up. Their timeouts are
+ * rounded up to the next tick. Other pumps are allocated directly from the
+ * underlying manager.
+ */
+
+#ifndef _UPIPE_UPUMP_WHEEL_H_
+/** @hidden */
+#define _UPIPE_UPUMP_WHEEL_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upump.h>
+
+#include <stdint.h>
+
+/** @This allocates and initializes a upump_mgr structure multiplexing timers
+ * on a wheel.
+ *
+ * @param upump_mgr underlying upump manager, used for the driving timer and
+ * non-timer pumps
+ * @param tick resolution of the wheel, in 27 MHz units
+ * @param upump_pool_depth maximum number of upump structures in the pool
+ * @param upump_blocker_pool_depth maximum number of upump_blocker structures in
+ * the pool
+ * @return pointer to the wrapped upump_mgr structure
+ */
+struct upump_mgr *upump_wheel_mgr_alloc(struct upump_mgr *upump_mgr,
+                                        uint64_t tick,
+                                        uint16_t upump_pool_depth,
+                                        uint16_t upump_blocker_pool_depth);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -44,7 +44,15 @@ extern "C" {
 #include <stdint.h>
 #include <assert.h>
 
-/** @This is the implementation of a queue. */
+/** @This is the implementation of a queue. It is lock-free and may be fed by
+ * several producer threads, and emptied by several consumer threads.
+ * The ueventfds are only touched on transitions: the pop event is
+ * signaled when the queue goes from empty to non-empty, and cleared when a
+ * consumer finds it empty; the push event is signaled when the queue goes
+ * from full to non-full, and cleared when a producer finds it full. Batch
+ * operations account for the whole batch at once, so that producers and
+ * consumers avoid one atomic operation and possibly one system call per
+ * element. */
 struct uqueue {
     /** FIFO */
     struct ufifo fifo;
@@ -52,6 +60,8 @@ struct uqueue {
     uatomic_uint32_t counter;
     /** maximum number of elements in the queue */
     uint32_t length;
+    /** number of elements under which pushers are woken up */
+    uint32_t threshold;
     /** ueventfd triggered when data can be pushed */
     struct ueventfd event_push;
     /** ueventfd triggered when data can be popped */
@@ -86,9 +96,26 @@ static inline bool uqueue_init(struct uqueue *uqueue, uint8_t length,
     ufifo_init(&uqueue->fifo, length, extra);
     uatomic_init(&uqueue->counter, 0);
     uqueue->length = length;
+    uqueue->threshold = length;
     return true;
 }
 
+/** @This sets the number of elements under which the queue must drain before
+ * the push watcher is triggered again, once the queue has been full. A
+ * threshold lower than the length gives some hysteresis, so that blocked
+ * pushers are not woken up for every single element popped. It may only be
+ * called from the thread popping elements, before elements are pushed.
+ *
+ * @param uqueue pointer to a uqueue structure
+ * @param threshold number of elements, between 1 and the length of the queue
+ */
+static inline void uqueue_set_threshold(struct uqueue *uqueue,
+                                        unsigned int threshold)
+{
+    assert(threshold && threshold <= uqueue->length);
+    uqueue->threshold = threshold;
+}
+
 /** @This allocates a watcher triggering when data is ready to be pushed.
  *
  * @param uqueue pointer to a uqueue structure
@@ -144,6 +171,45 @@ static inline bool uqueue_push(struct uqueue *uqueue, void *element)
     return true;
 }
 
+/** @This pushes several elements into the queue, in order. The elements that
+ * could not be queued because the queue is full are left untouched, and the
+ * caller is expected to retry them later.
+ *
+ * @param uqueue pointer to a uqueue structure
+ * @param elements array of pointers to elements to push
+ * @param nb number of elements in the array
+ * @return number of elements actually pushed
+ */
+static inline unsigned int uqueue_push_batch(struct uqueue *uqueue,
+                                             void **elements, unsigned int nb)
+{
+    unsigned int i = 0;
+    while (i < nb && ufifo_push(&uqueue->fifo, elements[i]))
+        i++;
+
+    if (unlikely(i < nb)) {
+        /* signal that we are full */
+        ueventfd_read(&uqueue->event_push);
+
+        /* double-check */
+        while (i < nb && ufifo_push(&uqueue->fifo, elements[i]))
+            i++;
+
+        if (i == nb)
+            /* signal that we're alright again */
+            ueventfd_write(&uqueue->event_push);
+    }
+
+    if (likely(i)) {
+        /* The counter may be transiently negative if consumers popped
+         * elements not yet accounted by their producers. */
+        int32_t counter = uatomic_fetch_add(&uqueue->counter, i);
+        if (unlikely(counter <= 0 && counter + (int32_t)i > 0))
+            ueventfd_write(&uqueue->event_pop);
+    }
+    return i;
+}
+
 /** @internal @This pops an element from the queue.
  *
  * @param uqueue pointer to a uqueue structure
@@ -165,7 +231,7 @@ static inline void *uqueue_pop_internal(struct uqueue *uqueue)
         ueventfd_write(&uqueue->event_pop);
     }
 
-    if (unlikely(uatomic_fetch_sub(&uqueue->counter, 1) == uqueue->length))
+    if (unlikely(uatomic_fetch_sub(&uqueue->counter, 1) == uqueue->threshold))
         ueventfd_write(&uqueue->event_push);
     return element;
 }
@@ -178,6 +244,45 @@ static inline void *uqueue_pop_internal(struct uqueue *uqueue)
  */
 #define uqueue_pop(uqueue, type) (type)uqueue_pop_internal(uqueue)
 
+/** @This pops several elements from the queue, in order.
+ *
+ * @param uqueue pointer to a uqueue structure
+ * @param elements array filled in with pointers to popped elements
+ * @param nb maximum number of elements to pop
+ * @return number of elements actually popped
+ */
+static inline unsigned int uqueue_pop_batch(struct uqueue *uqueue,
+                                            void **elements, unsigned int nb)
+{
+    unsigned int i = 0;
+    while (i < nb &&
+           (elements[i] = ufifo_pop(&uqueue->fifo, void *)) != NULL)
+        i++;
+
+    if (unlikely(i < nb)) {
+        /* signal that we starve */
+        ueventfd_read(&uqueue->event_pop);
+
+        /* double-check */
+        unsigned int j = i;
+        while (i < nb &&
+               (elements[i] = ufifo_pop(&uqueue->fifo, void *)) != NULL)
+            i++;
+
+        if (i > j)
+            /* signal that we're alright again */
+            ueventfd_write(&uqueue->event_pop);
+    }
+
+    if (likely(i)) {
+        int32_t counter = uatomic_fetch_sub(&uqueue->counter, i);
+        if (unlikely(counter >= (int32_t)uqueue->threshold &&
+                     counter - (int32_t)i < (int32_t)uqueue->threshold))
+            ueventfd_write(&uqueue->event_push);
+    }
+    return i;
+}
+
 /** @This returns the number of elements in the queue.
  *
  * @param uqueue pointer to a uqueue structure
@@ -109,6 +109,8 @@ struct uref {
     uint64_t cr_dts_delay;
     /** duration between RAP and CR */
     uint64_t rap_cr_delay;
+    /** date of arrival in the pipeline, in system time */
+    uint64_t date_ingress;
     /** private for local pipe user */
     uint64_t priv;
 };
@@ -139,6 +141,10 @@ struct uref_mgr {
     struct uref *(*uref_alloc)(struct uref_mgr *);
     /** function to free a uref */
     void (*uref_free)(struct uref *);
+    /** optional function to allocate a uref with a block ubuf in a single
+     * operation (@see uref_block_alloc), or NULL */
+    struct uref *(*uref_alloc_block)(struct uref_mgr *, struct ubuf_mgr *,
+                                     int);
 
     /** control function for standard or local manager commands - all parameters
      * belong to the caller */
@@ -176,6 +182,7 @@ static inline void uref_init(struct uref *uref)
     uref->dts_pts_delay = UINT64_MAX;
     uref->cr_dts_delay = UINT64_MAX;
     uref->rap_cr_delay = UINT64_MAX;
+    uref->date_ingress = UINT64_MAX;
     uref->priv = UINT64_MAX;
 }
 
@@ -267,6 +274,7 @@ static inline struct uref *uref_dup_inner(struct uref *uref)
     new_uref->dts_pts_delay = uref->dts_pts_delay;
     new_uref->cr_dts_delay = uref->cr_dts_delay;
     new_uref->rap_cr_delay = uref->rap_cr_delay;
+    new_uref->date_ingress = uref->date_ingress;
     new_uref->priv = uref->priv;
 
     return new_uref;
@@ -25,6 +25,11 @@
 
 /** @file
  * @short Upipe uref attributes handling
+ *
+ * Custom attributes are looked up by name. Modules accessing them often may
+ * register the name with @ref udict_key_register at initialization, and pass
+ * the returned key with a NULL name, or as the type of the _SH macros below,
+ * so that lookups don't compare strings anymore.
  */
 
 #ifndef _UPIPE_UREF_ATTR_H_
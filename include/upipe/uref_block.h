@@ -46,9 +46,12 @@ extern "C" {
 UREF_ATTR_VOID_UREF(block, start, UREF_FLAG_BLOCK_START, start of logical block)
 UREF_ATTR_VOID_UREF(block, end, UREF_FLAG_BLOCK_END, end of logical block)
 UREF_ATTR_UNSIGNED(block, header_size, "b.header", global headers size)
+UREF_ATTR_UNSIGNED(block, segment_size, "b.segsize", size of the datagrams
+        the block is to be split into)
 
 /** @This returns a new uref pointing to a new ubuf pointing to a block.
  * This is equivalent to the two operations sequentially, and is a shortcut.
+ * Some uref managers perform both in a single allocation.
  *
  * @param uref_mgr management structure for this uref type
  * @param ubuf_mgr management structure for this ubuf type
@@ -59,6 +62,9 @@ static inline struct uref *uref_block_alloc(struct uref_mgr *uref_mgr,
                                             struct ubuf_mgr *ubuf_mgr,
                                             int size)
 {
+    if (uref_mgr->uref_alloc_block != NULL)
+        return uref_mgr->uref_alloc_block(uref_mgr, ubuf_mgr, size);
+
     struct uref *uref = uref_alloc(uref_mgr);
     if (unlikely(uref == NULL))
         return NULL;
@@ -34,6 +34,7 @@
 extern "C" {
 #endif
 
+#include <upipe/ulist.h>
 #include <upipe/uref.h>
 #include <upipe/uref_attr.h>
 
@@ -47,6 +48,8 @@ UREF_ATTR_UNSIGNED_UREF(clock, cr_dts_delay, cr_dts_delay,
         delay between CR and DTS)
 UREF_ATTR_UNSIGNED_UREF(clock, rap_cr_delay, rap_cr_delay,
         delay between RAP and CR)
+UREF_ATTR_UNSIGNED_UREF(clock, ingress, date_ingress,
+        date of arrival in the pipeline in system time)
 UREF_ATTR_UNSIGNED_SH(clock, duration, UDICT_TYPE_CLOCK_DURATION, duration)
 UREF_ATTR_SMALL_UNSIGNED(clock, index_rap, "k.index_rap",
                     frame offset from last random access point)
@@ -111,6 +114,18 @@ static inline void uref_clock_delete_date_##dv(struct uref *uref)           \
 {                                                                           \
     uref->date_##dv = UINT64_MAX;                                           \
     uref->flags &= ~(UINT64_C(0x3) << UREF_FLAG_DATE_##DV##_SHIFT);         \
+}                                                                           \
+/** @This adds an offset to the dv date, if any. The type of the date and   \
+ * the delays are kept, so all the dv dates are shifted.                    \
+ *                                                                          \
+ * @param uref uref structure                                               \
+ * @param offset offset in #UCLOCK_FREQ units                               \
+ */                                                                         \
+static inline void uref_clock_add_date_##dv(struct uref *uref,              \
+                                            int64_t offset)                 \
+{                                                                           \
+    if (uref->flags & (UINT64_C(0x3) << UREF_FLAG_DATE_##DV##_SHIFT))       \
+        uref->date_##dv += offset;                                          \
 }
 
 UREF_CLOCK_TEMPLATE(sys, SYS)
@@ -350,6 +365,94 @@ UREF_CLOCK_REBASE(prog, pts)
 UREF_CLOCK_REBASE(orig, pts)
 #undef UREF_CLOCK_REBASE
 
+/** @hidden */
+#define UREF_CLOCK_GET_DATES(dv, DV)                                        \
+/** @This gets the dv date as a CR, a DTS and a PTS at once. Dates which    \
+ * cannot be derived for lack of a delay are set to UINT64_MAX.             \
+ *                                                                          \
+ * @param uref uref structure                                               \
+ * @param cr_p filled in with the CR (may be NULL)                          \
+ * @param dts_p filled in with the DTS (may be NULL)                        \
+ * @param pts_p filled in with the PTS (may be NULL)                        \
+ * @return an error code if there is no dv date                             \
+ */                                                                         \
+static inline int uref_clock_get_dates_##dv(const struct uref *uref,        \
+                                            uint64_t *cr_p, uint64_t *dts_p,\
+                                            uint64_t *pts_p)                \
+{                                                                           \
+    uint64_t date = uref->date_##dv;                                        \
+    uint64_t cr_dts = uref->cr_dts_delay, dts_pts = uref->dts_pts_delay;    \
+    uint64_t cr = UINT64_MAX, dts = UINT64_MAX, pts = UINT64_MAX;           \
+    switch ((uref->flags >> UREF_FLAG_DATE_##DV##_SHIFT) & 0x3) {           \
+        default:                                                            \
+        case UREF_DATE_NONE:                                                \
+            return UBASE_ERR_INVALID;                                       \
+        case UREF_DATE_CR:                                                  \
+            cr = date;                                                      \
+            if (cr_dts != UINT64_MAX)                                       \
+                dts = cr + cr_dts;                                          \
+            if (dts != UINT64_MAX && dts_pts != UINT64_MAX)                 \
+                pts = dts + dts_pts;                                        \
+            break;                                                          \
+        case UREF_DATE_DTS:                                                 \
+            dts = date;                                                     \
+            if (cr_dts != UINT64_MAX)                                       \
+                cr = dts - cr_dts;                                          \
+            if (dts_pts != UINT64_MAX)                                      \
+                pts = dts + dts_pts;                                        \
+            break;                                                          \
+        case UREF_DATE_PTS:                                                 \
+            pts = date;                                                     \
+            if (dts_pts != UINT64_MAX)                                      \
+                dts = pts - dts_pts;                                        \
+            if (dts != UINT64_MAX && cr_dts != UINT64_MAX)                  \
+                cr = dts - cr_dts;                                          \
+            break;                                                          \
+    }                                                                       \
+    if (cr_p != NULL)                                                       \
+        *cr_p = cr;                                                         \
+    if (dts_p != NULL)                                                      \
+        *dts_p = dts;                                                       \
+    if (pts_p != NULL)                                                      \
+        *pts_p = pts;                                                       \
+    return UBASE_ERR_NONE;                                                  \
+}
+
+UREF_CLOCK_GET_DATES(sys, SYS)
+UREF_CLOCK_GET_DATES(prog, PROG)
+UREF_CLOCK_GET_DATES(orig, ORIG)
+#undef UREF_CLOCK_GET_DATES
+
+/** @This adds an offset to all the dates of a uref, in the sys, prog and
+ * orig domains. The types of dates and the delays are kept.
+ *
+ * @param uref uref structure
+ * @param offset offset in #UCLOCK_FREQ units
+ */
+static inline void uref_clock_add_dates(struct uref *uref, int64_t offset)
+{
+    uint64_t flags = uref->flags;
+    if (flags & (UINT64_C(0x3) << UREF_FLAG_DATE_SYS_SHIFT))
+        uref->date_sys += offset;
+    if (flags & (UINT64_C(0x3) << UREF_FLAG_DATE_PROG_SHIFT))
+        uref->date_prog += offset;
+    if (flags & (UINT64_C(0x3) << UREF_FLAG_DATE_ORIG_SHIFT))
+        uref->date_orig += offset;
+}
+
+/** @This adds an offset to all the dates of a list of urefs.
+ *
+ * @param urefs list of urefs
+ * @param offset offset in #UCLOCK_FREQ units
+ */
+static inline void uref_clock_add_dates_list(struct uchain *urefs,
+                                             int64_t offset)
+{
+    struct uchain *uchain;
+    ulist_foreach (urefs, uchain)
+        uref_clock_add_dates(uref_from_uchain(uchain), offset);
+}
+
 #ifdef __cplusplus
 }
 #endif
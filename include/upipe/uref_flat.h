@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe flat manager of urefs carrying small block buffers
+ *
+ * This manager carves a uref, a block ubuf and its data from a single
+ * pooled slab, so that allocating a small packet (typically a TS or RTP
+ * packet) with @ref uref_block_alloc and releasing it only cost one pool
+ * operation, instead of one for each of the uref, the ubuf, its shared
+ * structure and the umem. Attributes are still allocated by the udict
+ * manager, on first use.
+ */
+
+#ifndef _UPIPE_UREF_FLAT_H_
+/** @hidden */
+#define _UPIPE_UREF_FLAT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/uref.h>
+#include <upipe/ubuf.h>
+
+#define UREF_FLAT_SIGNATURE UBASE_FOURCC('f','l','a','t')
+
+/** @This extends uref_mgr_command with specific commands for the flat
+ * manager. */
+enum uref_flat_mgr_command {
+    UREF_FLAT_MGR_SENTINEL = UREF_MGR_CONTROL_LOCAL,
+
+    /** returns the block ubuf manager (struct ubuf_mgr **) */
+    UREF_FLAT_MGR_GET_UBUF_MGR
+};
+
+/** @This returns the ubuf manager for block formats sharing the slabs of a
+ * flat uref manager. Block urefs allocated with both managers are carved
+ * from a single slab; ubufs larger than a slab are allocated by the
+ * fallback manager. The ubuf manager is not referenced.
+ *
+ * @param mgr pointer to a uref_mgr structure wrapped into a uref_flat_mgr
+ * structure
+ * @param ubuf_mgr_p filled in with a pointer to the ubuf manager
+ * @return an error code
+ */
+static inline int uref_flat_mgr_get_ubuf_mgr(struct uref_mgr *mgr,
+                                             struct ubuf_mgr **ubuf_mgr_p)
+{
+    return uref_mgr_control(mgr, UREF_FLAT_MGR_GET_UBUF_MGR,
+                            UREF_FLAT_SIGNATURE, ubuf_mgr_p);
+}
+
+/** @This allocates a new instance of the flat uref manager.
+ *
+ * @param slab_pool_depth maximum number of slabs in the pool
+ * @param udict_mgr udict manager to use to allocate udict structures
+ * @param control_attr_size extra attributes space for control packets
+ * @param data_size size of the data carried by a slab, in octets
+ * @param fallback_mgr block ubuf manager used for larger buffers
+ * @return pointer to manager, or NULL in case of error
+ */
+struct uref_mgr *uref_flat_mgr_alloc(uint16_t slab_pool_depth,
+                                     struct udict_mgr *udict_mgr,
+                                     int control_attr_size,
+                                     unsigned int data_size,
+                                     struct ubuf_mgr *fallback_mgr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
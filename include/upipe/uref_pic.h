@@ -160,6 +160,25 @@ static inline int uref_pic_resize(struct uref *uref,
     return ubuf_pic_resize(uref->ubuf, hskip, vskip, new_hsize, new_vsize);
 }
 
+/** @see ubuf_pic_splice */
+static inline struct uref *uref_pic_splice(struct uref *uref,
+        int hoffset, int voffset, int hsize, int vsize)
+{
+    if (uref->ubuf == NULL)
+        return NULL;
+    struct uref *new_uref = uref_dup_inner(uref);
+    if (unlikely(new_uref == NULL))
+        return NULL;
+
+    new_uref->ubuf = ubuf_pic_splice(uref->ubuf, hoffset, voffset,
+                                     hsize, vsize);
+    if (unlikely(new_uref->ubuf == NULL)) {
+        uref_free(new_uref);
+        return NULL;
+    }
+    return new_uref;
+}
+
 /** @see ubuf_pic_clear */
 static inline int uref_pic_clear(struct uref *uref,
         int hoffset, int voffset, int hsize, int vsize)
@@ -71,6 +71,8 @@ UREF_ATTR_SMALL_UNSIGNED(pic_flow, vappend, "p.vappend",
 UREF_ATTR_UNSIGNED(pic_flow, align, "p.align", alignment in octets)
 UREF_ATTR_INT(pic_flow, align_hmoffset, "p.align_hmoffset",
         horizontal offset of the aligned macropixel)
+UREF_ATTR_VOID(pic_flow, cache_aligned, "p.cache_aligned",
+        lines and margins aligned on cache lines)
 
 UREF_ATTR_RATIONAL_SH(pic_flow, sar, UDICT_TYPE_PIC_SAR, sample aspect ratio)
 UREF_ATTR_VOID_SH(pic_flow, overscan, UDICT_TYPE_PIC_OVERSCAN, overscan)
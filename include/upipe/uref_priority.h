@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe drop priorities of urefs, used by sinks on overload
+ * Sinks configured with an overload policy drop the held urefs of lowest
+ * priority first. The priority is deduced from the flow definition and from
+ * the attributes set by the framers, unless explicitly set with
+ * @ref uref_flow_set_priority by an upstream pipe (for instance on the
+ * packets carrying a PCR).
+ */
+
+#ifndef _UPIPE_UREF_PRIORITY_H_
+/** @hidden */
+#define _UPIPE_UREF_PRIORITY_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uref.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/** @This defines the drop priorities of urefs, from the first dropped to
+ * the never dropped. */
+enum uref_priority {
+    /** non-reference pictures */
+    UREF_PRIORITY_DISPOSABLE = 0,
+    /** reference pictures, and urefs which couldn't be classified */
+    UREF_PRIORITY_NORMAL,
+    /** random access points of video flows */
+    UREF_PRIORITY_RANDOM,
+    /** audio, subpictures and other non-video elementary streams */
+    UREF_PRIORITY_HIGH,
+    /** flow definitions, PSI sections and PCR, never dropped */
+    UREF_PRIORITY_CRITICAL
+};
+
+UREF_ATTR_SMALL_UNSIGNED(flow, priority, "f.priority",
+        drop priority overriding the classification)
+
+/** @This returns a string describing a drop priority.
+ *
+ * @param priority drop priority
+ * @return pointer to a string
+ */
+static inline const char *uref_priority_name(enum uref_priority priority)
+{
+    switch (priority) {
+        case UREF_PRIORITY_DISPOSABLE: return "disposable";
+        case UREF_PRIORITY_NORMAL: return "normal";
+        case UREF_PRIORITY_RANDOM: return "random";
+        case UREF_PRIORITY_HIGH: return "high";
+        case UREF_PRIORITY_CRITICAL: return "critical";
+    }
+    return "unknown";
+}
+
+/** @This classifies a uref according to its attributes and to the flow
+ * definition of the flow it belongs to.
+ *
+ * @param uref uref structure
+ * @param def flow definition string of the flow, or NULL if unknown
+ * @return drop priority of the uref
+ */
+static inline enum uref_priority uref_priority_classify(struct uref *uref,
+                                                        const char *def)
+{
+    uint8_t priority;
+    const char *uref_def;
+    if (ubase_check(uref_flow_get_priority(uref, &priority)))
+        return priority > UREF_PRIORITY_CRITICAL ? UREF_PRIORITY_CRITICAL :
+               priority;
+    if (ubase_check(uref_flow_get_def(uref, &uref_def)))
+        return UREF_PRIORITY_CRITICAL;
+    if (def == NULL)
+        return ubase_check(uref_flow_get_random(uref)) ?
+               UREF_PRIORITY_RANDOM : UREF_PRIORITY_NORMAL;
+
+    if (strstr(def, ".mpegtspsi.") != NULL)
+        return UREF_PRIORITY_CRITICAL;
+    if (strstr(def, "pic.sub.") != NULL || !ubase_ncmp(def, "sound.") ||
+        strstr(def, ".sound.") != NULL)
+        return UREF_PRIORITY_HIGH;
+    if (!ubase_ncmp(def, "pic.") || strstr(def, ".pic.") != NULL) {
+        if (ubase_check(uref_flow_get_random(uref)) ||
+            ubase_check(uref_pic_get_key(uref)))
+            return UREF_PRIORITY_RANDOM;
+        return UREF_PRIORITY_NORMAL;
+    }
+    return ubase_check(uref_flow_get_random(uref)) ?
+           UREF_PRIORITY_RANDOM : UREF_PRIORITY_NORMAL;
+}
+
+/** @This finds the uref of lowest priority in a list of held urefs, whose
+ * priorities were stored in their priv member. Among urefs of the same
+ * priority the oldest one is returned, and critical urefs are never
+ * returned.
+ *
+ * @param urefs list of urefs
+ * @return pointer to the uref to drop first, or NULL if there is none
+ */
+static inline struct uref *uref_priority_find_lowest(struct uchain *urefs)
+{
+    struct uref *lowest = NULL;
+    struct uchain *uchain;
+    ulist_foreach (urefs, uchain) {
+        struct uref *uref = uref_from_uchain(uchain);
+        if (uref->priv >= UREF_PRIORITY_CRITICAL)
+            continue;
+        if (lowest == NULL || uref->priv < lowest->priv)
+            lowest = uref;
+        if (lowest->priv == UREF_PRIORITY_DISPOSABLE)
+            break;
+    }
+    return lowest;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
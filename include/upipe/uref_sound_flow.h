@@ -53,6 +53,8 @@ UREF_ATTR_SMALL_UNSIGNED(sound_flow, sample_size, "s.sample_size",
 UREF_ATTR_UNSIGNED(sound_flow, rate, "s.rate", samples per second)
 UREF_ATTR_UNSIGNED(sound_flow, samples, "s.samples", number of samples)
 UREF_ATTR_UNSIGNED(sound_flow, align, "s.align", alignment in octets)
+UREF_ATTR_UNSIGNED(sound_flow, vector_size, "s.vector_size",
+        size of SIMD vectors in octets)
 
 /** @This allocates a control packet to define a new sound flow.
  *
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ring of buffers with 32-bits indexes
+ * This API defines rings of structures for use in LIFOs, like @ref uring,
+ * but the LIFO descriptors are 64-bits wide, allowing rings of up to
+ * UINT32_MAX elements and 32-bits tags. It is only available on platforms
+ * supporting 64-bits atomic operations (@ref UATOMIC_HAVE_64).
+ */
+
+#ifndef _UPIPE_URING64_H_
+/** @hidden */
+#define _UPIPE_URING64_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifdef UATOMIC_HAVE_64
+
+/** @This defines the position of an element in the uring64 array. */
+typedef uint32_t uring64_index;
+
+/** @This represents a NULL index position. */
+#define URING64_INDEX_NULL 0
+
+/** @This defines an element in the ring. */
+struct uring64_elem {
+    /** tag incremented at each use */
+    uint32_t tag;
+    /** index of the next element */
+    uring64_index next;
+    /** pointer to opaque structure */
+    void *opaque;
+};
+
+/** @This defines a ring of elements. */
+struct uring64 {
+    /** number of elements in the ring */
+    uint32_t length;
+    /** array of elements */
+    struct uring64_elem *elems;
+};
+
+/** @This returns the required size of extra data space for uring64.
+ *
+ * @param length number of elements in the ring
+ * @return size in octets to allocate
+ */
+#define uring64_sizeof(length) ((size_t)(length) * sizeof(struct uring64_elem))
+
+/** @internal @This returns a pointer to an element from an index.
+ *
+ * @param index of the element in the ring
+ * @return pointer to the element in the ring
+ */
+static inline struct uring64_elem *
+    uring64_elem_from_index(struct uring64 *uring, uring64_index index)
+{
+    assert(index != URING64_INDEX_NULL);
+    assert(index <= uring->length);
+    return &uring->elems[index - 1];
+}
+
+/** @This sets the opaque of a uring64 element.
+ *
+ * @param uring pointer to uring64 structure
+ * @param index index of the element in the ring
+ * @param opaque opaque to associate with the element
+ */
+static inline void uring64_elem_set(struct uring64 *uring,
+                                    uring64_index index, void *opaque)
+{
+    struct uring64_elem *elem = uring64_elem_from_index(uring, index);
+    elem->tag++;
+    elem->opaque = opaque;
+}
+
+/** @This gets the opaque of a uring64 element.
+ *
+ * @param uring pointer to uring64 structure
+ * @param index index of the element in the ring
+ * @return opaque associated with the element, or NULL
+ */
+static inline void *uring64_elem_get(struct uring64 *uring,
+                                     uring64_index index)
+{
+    struct uring64_elem *elem = uring64_elem_from_index(uring, index);
+    return elem->opaque;
+}
+
+/** @This defines a multiplexed structure from an element index (top)
+ * and a tag incremented at each use of the element, to avoid the ABA
+ * problem in concurrent operations. The bit-field definition is:
+ * @table 2
+ * @item bits @item description
+ * @item 32 @item tag
+ * @item 32 @item index
+ * @end table
+ */
+typedef uint64_t uring64_lifo_val;
+
+/** @This defines an atomic structure describing a LIFO, based on @ref
+ * uring64_lifo_val.
+ */
+typedef uatomic_uint64_t uring64_lifo;
+
+/** @This represents a NULL LIFO descriptor. */
+#define URING64_LIFO_NULL 0
+
+/** @internal @This returns the index of an element from a LIFO value.
+ *
+ * @param lifo uring64 LIFO multiplexed structure
+ * @return index of the element in the ring
+ */
+static inline uring64_index uring64_lifo_to_index(struct uring64 *uring,
+                                                  uring64_lifo_val lifo)
+{
+    if (unlikely(lifo == URING64_LIFO_NULL))
+        return URING64_INDEX_NULL;
+
+    uring64_index index = lifo & UINT32_MAX;
+    assert(index <= uring->length);
+    return index;
+}
+
+/** @internal @This returns a LIFO value (multiplexed tag and index)
+ * for a given element index. There is no memory barrier in this function
+ * because we assume it's been done by the caller.
+ *
+ * @param uring pointer to uring64 structure
+ * @param index index of the element in the ring
+ * @return uring64 LIFO multiplexed structure
+ */
+static inline uring64_lifo_val uring64_lifo_from_index(struct uring64 *uring,
+                                                       uring64_index index)
+{
+    if (unlikely(index == URING64_INDEX_NULL))
+        return URING64_LIFO_NULL;
+
+    assert(index <= uring->length);
+    return ((uring64_lifo_val)uring->elems[index - 1].tag << 32) |
+           (uring64_lifo_val)index;
+}
+
+/** @This initializes a LIFO.
+ *
+ * @param uring pointer to uring64 structure
+ * @param lifo_p pointer to the LIFO descriptor
+ * @param lifo LIFO value returned by @ref uring64_init, or URING64_LIFO_NULL
+ */
+static inline void uring64_lifo_init(struct uring64 *uring,
+                                     uring64_lifo *lifo_p,
+                                     uring64_lifo_val lifo)
+{
+    uatomic64_init(lifo_p, lifo);
+}
+
+/** @This cleans up a LIFO.
+ *
+ * @param uring pointer to uring64 structure
+ * @param lifo_p pointer to the LIFO descriptor
+ */
+static inline void uring64_lifo_clean(struct uring64 *uring,
+                                      uring64_lifo *lifo_p)
+{
+    uatomic64_clean(lifo_p);
+}
+
+/** @This pops an element from a LIFO.
+ *
+ * @param uring pointer to uring64 structure
+ * @param lifo_p pointer to the LIFO descriptor
+ * @return index of the first LIFO element, or URING64_INDEX_NULL
+ */
+static inline uring64_index uring64_lifo_pop(struct uring64 *uring,
+                                             uring64_lifo *lifo_p)
+{
+    uring64_lifo_val old_lifo = uatomic64_load(lifo_p);
+    uring64_lifo_val new_lifo;
+    uring64_index index;
+
+    do {
+        if (old_lifo == URING64_LIFO_NULL)
+            return URING64_INDEX_NULL;
+
+        index = uring64_lifo_to_index(uring, old_lifo);
+        struct uring64_elem *elem = uring64_elem_from_index(uring, index);
+        new_lifo = uring64_lifo_from_index(uring, elem->next);
+    } while (unlikely(!uatomic64_compare_exchange(lifo_p, &old_lifo,
+                                                  new_lifo)));
+
+    return index;
+}
+
+/** @This pushes an element into a LIFO.
+ *
+ * @param uring pointer to uring64 structure
+ * @param lifo_p pointer to the LIFO descriptor
+ * @param index index of the element to push
+ */
+static inline void uring64_lifo_push(struct uring64 *uring,
+                                     uring64_lifo *lifo_p,
+                                     uring64_index index)
+{
+    struct uring64_elem *elem = uring64_elem_from_index(uring, index);
+    uring64_lifo_val new_lifo = uring64_lifo_from_index(uring, index);
+    uring64_lifo_val old_lifo = uatomic64_load(lifo_p);
+
+    do {
+        elem->next = uring64_lifo_to_index(uring, old_lifo);
+    } while (unlikely(!uatomic64_compare_exchange(lifo_p, &old_lifo,
+                                                  new_lifo)));
+}
+
+/** @This initializes a ring. By default all elements are chained, and the
+ * first element is the head of the chain.
+ *
+ * @param uring pointer to uring64 structure
+ * @param length number of elements in the ring
+ * @param extra mandatory extra space allocated by the caller, with the size
+ * returned by @ref #uring64_sizeof
+ * @return uring64 LIFO descriptor of the first element, for use in @ref
+ * uring64_lifo_init
+ */
+static inline uring64_lifo_val uring64_init(struct uring64 *uring,
+                                            uint32_t length, void *extra)
+{
+    assert(extra != NULL);
+    uring->length = length;
+    uring->elems = (struct uring64_elem *)extra;
+    if (length == 0)
+        return URING64_LIFO_NULL;
+    /* indexes start at 1 */
+    for (uint32_t i = 1; i < length; i++) {
+        uring->elems[i - 1].tag = 0;
+        uring->elems[i - 1].next = i + 1;
+        uring->elems[i - 1].opaque = NULL;
+    }
+    uring->elems[length - 1].tag = 0;
+    uring->elems[length - 1].next = URING64_INDEX_NULL;
+    uring->elems[length - 1].opaque = NULL;
+    return uring64_lifo_from_index(uring, 1);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe low-overhead binary tracing of the flow of urefs
+ *
+ * When enabled, the input of every pipe, and the output of pipes using
+ * @ref UPIPE_HELPER_OUTPUT, are recorded as fixed-size binary records into
+ * a ring buffer per thread, without any locking or formatting. The recorded
+ * events may later be exported in the Chrome trace format, which can be
+ * loaded into chrome://tracing or Perfetto to follow urefs across threads.
+ *
+ * If the system supports it, every event also fires the upipe:input and
+ * upipe:output USDT probes (arguments: pipe, uref, size, date_sys), so that
+ * perf, bpftrace or SystemTap can attach to them.
+ */
+
+#ifndef _UPIPE_UTRACE_H_
+/** @hidden */
+#define _UPIPE_UTRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/** @hidden */
+struct upipe;
+/** @hidden */
+struct uref;
+
+/** @This defines the events recorded by the tracer. */
+enum utrace_event {
+    /** uref received on the input of a pipe */
+    UTRACE_INPUT,
+    /** uref sent to the output of a pipe */
+    UTRACE_OUTPUT
+};
+
+/** @This describes a recorded event. */
+struct utrace_record {
+    /** date of the event in 27 MHz units of the monotonic clock */
+    uint64_t date;
+    /** pipe receiving or sending the uref */
+    uint64_t upipe;
+    /** uref */
+    uint64_t uref;
+    /** date of the uref in system time, or UINT64_MAX */
+    uint64_t date_sys;
+    /** void flags of the uref */
+    uint64_t flags;
+    /** signature of the manager of the pipe */
+    uint32_t signature;
+    /** size of the block, or UINT32_MAX for non-block urefs */
+    uint32_t size;
+    /** event (@see utrace_event) */
+    uint32_t event;
+    /** index of the thread */
+    uint32_t thread;
+};
+
+/** @internal true if tracing is enabled */
+extern bool utrace_enabled;
+
+/** @This enables tracing. Each thread allocates its ring buffer the first
+ * time it records an event. Events recorded with a former depth are
+ * discarded.
+ *
+ * @param depth number of records kept per thread, rounded up to a power
+ * of 2, or 0 to only fire the USDT probes
+ * @return an error code
+ */
+int utrace_enable(unsigned int depth);
+
+/** @This disables tracing. The recorded events are kept until
+ * @ref utrace_clean is called.
+ */
+void utrace_disable(void);
+
+/** @This frees the ring buffers of all threads. It must not be called while
+ * other threads may be recording events.
+ */
+void utrace_clean(void);
+
+/** @This calls a function on each recorded event, thread by thread, from
+ * the oldest to the most recent. It should be called while no other
+ * thread is recording events, otherwise some records may be torn.
+ *
+ * @param cb function called for each record
+ * @param opaque opaque passed to cb
+ */
+void utrace_iterate(void (*cb)(void *, const struct utrace_record *),
+                    void *opaque);
+
+/** @This writes the recorded events in the Chrome trace event format. It
+ * should be called while no other thread is recording events.
+ *
+ * @param file stream to write to
+ * @return an error code
+ */
+int utrace_dump_chrome(FILE *file);
+
+/** @internal @This records an event.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref received or sent
+ * @param event event to record
+ */
+void utrace_record(struct upipe *upipe, struct uref *uref,
+                   enum utrace_event event);
+
+/** @This records an event if tracing is enabled.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref received or sent
+ * @param event event to record
+ */
+static inline void utrace(struct upipe *upipe, struct uref *uref,
+                          enum utrace_event event)
+{
+    if (unlikely(utrace_enabled))
+        utrace_record(upipe, uref, event);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -26,6 +26,17 @@
 
 /** &file
  * @short declarations for a Upipe main loop using Ecore
+ *
+ * In a graphical application, media pipelines should not run in the Ecore
+ * main loop, where they would compete with the rendering. They are rather
+ * run in a separate thread with their own event loop (see
+ * @ref upipe_wsrc_alloc and @ref upipe_wsink_alloc), and the urefs bound
+ * for the user interface are handed over through a lock-free queue, whose
+ * source (@ref upipe_qsrc_alloc) is the only pipe using the Ecore manager.
+ *
+ * In frame sync mode, the read events of the Ecore manager are not
+ * dispatched as they come, but coalesced and dispatched once per frame by
+ * an Ecore_Animator, at the display refresh rate, in a single batch.
  */
 
 #ifndef _UPIPE_ECORE_UPUMP_ECORE_H_
@@ -34,6 +45,51 @@
 
 #include <upipe/upump.h>
 
+#include <stdbool.h>
+
+#define UPUMP_ECORE_SIGNATURE UBASE_FOURCC('e','c','o','r')
+
+/** @This extends upump_mgr_command with specific commands for Ecore. */
+enum upump_ecore_mgr_command {
+    UPUMP_ECORE_MGR_SENTINEL = UPUMP_MGR_CONTROL_LOCAL,
+
+    /** returns the frame sync mode (bool *) */
+    UPUMP_ECORE_MGR_GET_FRAME_SYNC,
+    /** sets the frame sync mode (bool) */
+    UPUMP_ECORE_MGR_SET_FRAME_SYNC
+};
+
+/** @This returns the frame sync mode of an Ecore manager.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_ecore_mgr structure
+ * @param frame_sync_p filled in with true if the frame sync mode is enabled
+ * @return an error code
+ */
+static inline int upump_ecore_mgr_get_frame_sync(struct upump_mgr *mgr,
+                                                 bool *frame_sync_p)
+{
+    return upump_mgr_control(mgr, UPUMP_ECORE_MGR_GET_FRAME_SYNC,
+                             UPUMP_ECORE_SIGNATURE, frame_sync_p);
+}
+
+/** @This enables or disables the frame sync mode of an Ecore manager. When
+ * enabled, the read pumps that are ready are dispatched together on the next
+ * tick of an Ecore_Animator, so that the user interface is refreshed at most
+ * once per frame; idlers, timers and write pumps are not affected.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_ecore_mgr structure
+ * @param frame_sync true to enable frame sync mode
+ * @return an error code
+ */
+static inline int upump_ecore_mgr_set_frame_sync(struct upump_mgr *mgr,
+                                                 bool frame_sync)
+{
+    return upump_mgr_control(mgr, UPUMP_ECORE_MGR_SET_FRAME_SYNC,
+                             UPUMP_ECORE_SIGNATURE, frame_sync ? 1 : 0);
+}
+
 /** @This allocates and initializes a upump_ecore_mgr structure.
  *
  * @param upump_pool_depth maximum number of upump structures in the pool
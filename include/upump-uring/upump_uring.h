@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short declarations for a Upipe main loop using Linux io_uring
+ *
+ * Contrary to other upump managers, this one owns its event loop, which is
+ * run by @ref upump_uring_mgr_run. Pumps are armed, rearmed and disarmed
+ * with submission entries that are only flushed to the kernel when the
+ * loop waits for events, so that stopping and restarting pumps (typically
+ * when sinks block their sources) costs no extra system call.
+ *
+ * For links with a latency budget smaller than the wake-up latency of the
+ * scheduler, the loop may run on a dedicated core in busy-poll mode: it then
+ * spins over the completion ring, which requires no system call, and only
+ * sleeps when no event was received for a configurable time.
+ */
+
+#ifndef _UPUMP_URING_UPUMP_URING_H_
+/** @hidden */
+#define _UPUMP_URING_UPUMP_URING_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upump.h>
+
+#include <stdint.h>
+
+#define UPUMP_URING_SIGNATURE UBASE_FOURCC('u','r','n','g')
+
+/** @This extends upump_mgr_command with specific commands for io_uring. */
+enum upump_uring_mgr_command {
+    UPUMP_URING_MGR_SENTINEL = UPUMP_MGR_CONTROL_LOCAL,
+
+    /** returns the busy-poll duration (uint64_t *) */
+    UPUMP_URING_MGR_GET_BUSY_POLL,
+    /** sets the busy-poll duration (uint64_t) */
+    UPUMP_URING_MGR_SET_BUSY_POLL
+};
+
+/** @This returns the busy-poll duration of the event loop.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_uring_mgr structure
+ * @param busy_poll_p filled in with the duration, in 27 MHz units
+ * @return an error code
+ */
+static inline int upump_uring_mgr_get_busy_poll(struct upump_mgr *mgr,
+                                                uint64_t *busy_poll_p)
+{
+    return upump_mgr_control(mgr, UPUMP_URING_MGR_GET_BUSY_POLL,
+                             UPUMP_URING_SIGNATURE, busy_poll_p);
+}
+
+/** @This sets the busy-poll duration of the event loop. When no event is
+ * pending, the loop keeps spinning for this duration after the last event,
+ * before sleeping in the kernel. The default of 0 never spins, and
+ * UINT64_MAX spins forever, dedicating a core to the loop.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_uring_mgr structure
+ * @param busy_poll duration, in 27 MHz units
+ * @return an error code
+ */
+static inline int upump_uring_mgr_set_busy_poll(struct upump_mgr *mgr,
+                                                uint64_t busy_poll)
+{
+    return upump_mgr_control(mgr, UPUMP_URING_MGR_SET_BUSY_POLL,
+                             UPUMP_URING_SIGNATURE, busy_poll);
+}
+
+/** @This allocates and initializes a upump_mgr structure with io_uring
+ * support.
+ *
+ * @param entries number of entries of the submission ring (rounded up to
+ * a power of 2 by the kernel)
+ * @param upump_pool_depth maximum number of upump structures in the pool
+ * @param upump_blocker_pool_depth maximum number of upump_blocker structures in
+ * the pool
+ * @return pointer to the wrapped upump_mgr structure, or NULL if io_uring is
+ * not supported by the kernel
+ */
+struct upump_mgr *upump_uring_mgr_alloc(unsigned int entries,
+                                        uint16_t upump_pool_depth,
+                                        uint16_t upump_blocker_pool_depth);
+
+/** @This runs the event loop of a upump_uring_mgr, until no pump is
+ * active anymore.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_uring_mgr structure
+ * @return an error code
+ */
+int upump_uring_mgr_run(struct upump_mgr *mgr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
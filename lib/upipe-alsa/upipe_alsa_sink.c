@@ -115,8 +115,14 @@ struct upipe_alsink {
     snd_pcm_format_t format;
     /** number of planes (1 for planar formats) */
     uint8_t planes;
+    /** requested duration of a period, for the next device */
+    uint64_t period;
     /** duration of a period */
     uint64_t period_duration;
+    /** number of frames to buffer before starting the device */
+    snd_pcm_uframes_t start_threshold;
+    /** true if the device is written in mmap mode */
+    bool mmap;
     /** remainder of the number of frames to output per period */
     long long frames_remainder;
 
@@ -174,6 +180,7 @@ static struct upipe *upipe_alsink_alloc(struct upipe_mgr *mgr,
     upipe_alsink_init_uclock(upipe);
     upipe_alsink->latency = 0;
     upipe_alsink->rate = 0;
+    upipe_alsink->period = DEFAULT_PERIOD_DURATION;
     upipe_alsink->uri = strdup(DEFAULT_DEVICE);
     upipe_alsink->handle = NULL;
     upipe_alsink->max_urefs = BUFFER_UREFS;
@@ -238,12 +245,21 @@ static bool upipe_alsink_open(struct upipe *upipe)
         goto open_error;
     }
 
+    /* Prefer mmap mode, where samples are copied from the planes of the
+     * ubuf straight to the buffer of the device. */
+    upipe_alsink->mmap = true;
     if (snd_pcm_hw_params_set_access(upipe_alsink->handle, hwparams,
                                      upipe_alsink->planes == 1 ?
-                                     SND_PCM_ACCESS_RW_INTERLEAVED :
-                                     SND_PCM_ACCESS_RW_NONINTERLEAVED) < 0) {
-        upipe_err_va(upipe, "can't set interleaved mode (%s)", uri);
-        goto open_error;
+                                     SND_PCM_ACCESS_MMAP_INTERLEAVED :
+                                     SND_PCM_ACCESS_MMAP_NONINTERLEAVED) < 0) {
+        upipe_alsink->mmap = false;
+        if (snd_pcm_hw_params_set_access(upipe_alsink->handle, hwparams,
+                                         upipe_alsink->planes == 1 ?
+                                         SND_PCM_ACCESS_RW_INTERLEAVED :
+                                         SND_PCM_ACCESS_RW_NONINTERLEAVED) < 0) {
+            upipe_err_va(upipe, "can't set interleaved mode (%s)", uri);
+            goto open_error;
+        }
     }
 
     if (snd_pcm_hw_params_set_format(upipe_alsink->handle, hwparams,
@@ -265,8 +281,10 @@ static bool upipe_alsink_open(struct upipe *upipe)
     }
 
     upipe_alsink->frames_remainder = 0;
-    snd_pcm_uframes_t frames_in_period = (uint64_t)DEFAULT_PERIOD_DURATION *
+    snd_pcm_uframes_t frames_in_period = (uint64_t)upipe_alsink->period *
                                          upipe_alsink->rate / UCLOCK_FREQ;
+    if (unlikely(!frames_in_period))
+        frames_in_period = 1;
     if (snd_pcm_hw_params_set_period_size_near(upipe_alsink->handle, hwparams,
                                                &frames_in_period, NULL) < 0) {
         upipe_err_va(upipe, "error setting period size on device %s", uri);
@@ -296,8 +314,9 @@ static bool upipe_alsink_open(struct upipe *upipe)
     snd_pcm_sw_params_current(upipe_alsink->handle, swparams);
 
     /* Start when the buffer is full enough. */
+    upipe_alsink->start_threshold = frames_in_period * 2;
     if (snd_pcm_sw_params_set_start_threshold(upipe_alsink->handle, swparams,
-                                              frames_in_period * 2) < 0) {
+                                        upipe_alsink->start_threshold) < 0) {
         upipe_err_va(upipe, "error setting threshold on device %s", uri);
         goto open_error;
     }
@@ -325,7 +344,9 @@ static bool upipe_alsink_open(struct upipe *upipe)
 
     if (!upipe_alsink_check_input(upipe))
         upipe_use(upipe);
-    upipe_notice_va(upipe, "opened device %s", uri);
+    upipe_notice_va(upipe, "opened device %s (%s mode, %lu frames per period)",
+                    uri, upipe_alsink->mmap ? "mmap" : "rw",
+                    (unsigned long)frames_in_period);
     return true;
 
 open_error:
@@ -376,6 +397,93 @@ static bool upipe_alsink_recover(struct upipe *upipe, int err)
     return true;
 }
 
+/** @internal @This is called to output raw data to alsa in mmap mode. The
+ * samples are copied from the buffers to the areas of the device, or the
+ * areas are silenced if buffers is NULL.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffers pointer to array of buffers, or NULL for silence
+ * @param buffer_frames number of frames in buffer
+ * @return the number of frames effectively written, or -1 in case of error
+ */
+static snd_pcm_sframes_t upipe_alsink_mmap_frames(struct upipe *upipe,
+        const void **buffers, snd_pcm_uframes_t buffer_frames)
+{
+    struct upipe_alsink *upipe_alsink = upipe_alsink_from_upipe(upipe);
+    unsigned int channels = upipe_alsink->channels;
+    unsigned int width = snd_pcm_format_physical_width(upipe_alsink->format);
+    snd_pcm_channel_area_t src_areas[channels];
+    unsigned int i;
+    if (buffers != NULL) {
+        for (i = 0; i < channels; i++) {
+            if (upipe_alsink->planes == 1) {
+                src_areas[i].addr = (void *)buffers[0];
+                src_areas[i].first = i * width;
+                src_areas[i].step = channels * width;
+            } else {
+                src_areas[i].addr = (void *)buffers[i];
+                src_areas[i].first = 0;
+                src_areas[i].step = width;
+            }
+        }
+    }
+
+    snd_pcm_uframes_t written = 0;
+    while (written < buffer_frames) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(upipe_alsink->handle);
+        if (unlikely(avail < 0)) {
+            if (unlikely(!upipe_alsink_recover(upipe, avail)))
+                return -1;
+            continue;
+        }
+        if (!avail) {
+            if (!written)
+                upipe_warn_va(upipe, "ALSA FIFO full, skipping tick");
+            break;
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = buffer_frames - written;
+        int err = snd_pcm_mmap_begin(upipe_alsink->handle, &areas, &offset,
+                                     &frames);
+        if (unlikely(err < 0)) {
+            if (unlikely(!upipe_alsink_recover(upipe, err)))
+                return -1;
+            continue;
+        }
+
+        if (buffers != NULL)
+            snd_pcm_areas_copy(areas, offset, src_areas, written, channels,
+                               frames, upipe_alsink->format);
+        else
+            snd_pcm_areas_silence(areas, offset, channels, frames,
+                                  upipe_alsink->format);
+
+        snd_pcm_sframes_t committed =
+            snd_pcm_mmap_commit(upipe_alsink->handle, offset, frames);
+        if (unlikely(committed < 0 || (snd_pcm_uframes_t)committed != frames)) {
+            if (unlikely(!upipe_alsink_recover(upipe,
+                            committed < 0 ? committed : -EPIPE)))
+                return -1;
+            continue;
+        }
+        written += frames;
+    }
+
+    /* Contrary to the rw functions, commits don't start the device. */
+    if (snd_pcm_state(upipe_alsink->handle) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(upipe_alsink->handle);
+        snd_pcm_uframes_t buffer_size, period_size;
+        if (avail >= 0 &&
+            snd_pcm_get_params(upipe_alsink->handle, &buffer_size,
+                               &period_size) >= 0 &&
+            buffer_size - avail >= upipe_alsink->start_threshold)
+            snd_pcm_start(upipe_alsink->handle);
+    }
+    return written;
+}
+
 /** @internal @This is called to output raw data to alsa.
  *
  * @param upipe description structure of the pipe
@@ -387,6 +495,9 @@ static snd_pcm_sframes_t upipe_alsink_output_frames(struct upipe *upipe,
         const void **buffers, snd_pcm_uframes_t buffer_frames)
 {
     struct upipe_alsink *upipe_alsink = upipe_alsink_from_upipe(upipe);
+    if (upipe_alsink->mmap)
+        return upipe_alsink_mmap_frames(upipe, buffers, buffer_frames);
+
     snd_pcm_sframes_t frames;
     for ( ; ; ) {
         if (upipe_alsink->planes == 1)
@@ -444,6 +555,10 @@ static snd_pcm_sframes_t upipe_alsink_silence(struct upipe *upipe,
                                               snd_pcm_uframes_t silence_frames)
 {
     struct upipe_alsink *upipe_alsink = upipe_alsink_from_upipe(upipe);
+    if (upipe_alsink->mmap)
+        /* silence the areas of the device in place */
+        return upipe_alsink_mmap_frames(upipe, NULL, silence_frames);
+
     if (upipe_alsink->planes == 1) {
         uint8_t buffer[snd_pcm_frames_to_bytes(upipe_alsink->handle,
                                                silence_frames)];
@@ -817,6 +932,36 @@ static int upipe_alsink_set_uri(struct upipe *upipe, const char *uri)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the requested duration of a period.
+ *
+ * @param upipe description structure of the pipe
+ * @param period_p filled in with the duration, in clock units
+ * @return an error code
+ */
+static int _upipe_alsink_get_period(struct upipe *upipe, uint64_t *period_p)
+{
+    struct upipe_alsink *upipe_alsink = upipe_alsink_from_upipe(upipe);
+    assert(period_p != NULL);
+    *period_p = upipe_alsink->period;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the requested duration of a period. It only takes
+ * effect when the device is next opened.
+ *
+ * @param upipe description structure of the pipe
+ * @param period duration, in clock units
+ * @return an error code
+ */
+static int _upipe_alsink_set_period(struct upipe *upipe, uint64_t period)
+{
+    struct upipe_alsink *upipe_alsink = upipe_alsink_from_upipe(upipe);
+    if (unlikely(!period))
+        return UBASE_ERR_INVALID;
+    upipe_alsink->period = period;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This flushes all currently held buffers, and unblocks the
  * sources.
  *
@@ -923,6 +1068,16 @@ static int upipe_alsink_control(struct upipe *upipe, int command, va_list args)
         }
         case UPIPE_FLUSH:
             return upipe_alsink_flush(upipe);
+        case UPIPE_ALSINK_GET_PERIOD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_ALSINK_SIGNATURE)
+            uint64_t *period_p = va_arg(args, uint64_t *);
+            return _upipe_alsink_get_period(upipe, period_p);
+        }
+        case UPIPE_ALSINK_SET_PERIOD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_ALSINK_SIGNATURE)
+            uint64_t period = va_arg(args, uint64_t);
+            return _upipe_alsink_set_period(upipe, period);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -36,6 +36,7 @@
 #include <upipe/uref_clock.h>
 #include <upipe/upump.h>
 #include <upipe/ubuf.h>
+#include <upipe/ueventfd.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -64,11 +65,14 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <pthread.h>
 
 #include <amt.h>
 
 /** default size of buffers when unspecified */
 #define UBUF_DEFAULT_SIZE       4096
+/** maximum number of datagrams read per wake-up */
+#define AMT_MAX_BATCH           1024
 
 /** @hidden */
 static int upipe_amtsrc_check(struct upipe *upipe, struct uref *flow_format);
@@ -88,6 +92,31 @@ struct upipe_amtsrc_mgr {
 UBASE_FROM_TO(upipe_amtsrc_mgr, upipe_mgr, upipe_mgr, mgr)
 UBASE_FROM_TO(upipe_amtsrc_mgr, urefcount, urefcount, urefcount)
 
+/** @internal @This is the context of the opening of a channel, shared
+ * between the pipe and the opener thread. */
+struct upipe_amtsrc_opener {
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** number of references (pipe and thread) */
+    unsigned int refcount;
+    /** manager, holding the AMT library */
+    struct upipe_mgr *mgr;
+    /** AMT relay address */
+    uint32_t relay;
+    /** multicast group address */
+    uint32_t group;
+    /** source address */
+    uint32_t source;
+    /** port number */
+    uint16_t port;
+    /** connection mode */
+    amt_connect_req_e mode;
+    /** opened AMT handle, or NULL */
+    amt_handle_t handle;
+    /** event signalling the end of the opening */
+    struct ueventfd event;
+};
+
 /** @internal @This is the private context of a amtsrc pipe. */
 struct upipe_amtsrc {
     /** refcount management structure */
@@ -128,6 +157,14 @@ struct upipe_amtsrc {
 
     /** AMT handle */
     amt_handle_t handle;
+    /** pending opening of the channel, or NULL */
+    struct upipe_amtsrc_opener *opener;
+    /** number of datagrams read per wake-up */
+    unsigned int batch;
+    /** urefs allocated in advance */
+    struct uref **batch_urefs;
+    /** mapped buffers of the urefs allocated in advance */
+    uint8_t **batch_buffers;
     /** udp socket uri */
     char *uri;
 
@@ -179,13 +216,175 @@ static struct upipe *upipe_amtsrc_alloc(struct upipe_mgr *mgr,
     upipe_amtsrc_init_uclock(upipe);
     upipe_amtsrc_init_read_size(upipe, UBUF_DEFAULT_SIZE);
     upipe_amtsrc->handle = NULL;
+    upipe_amtsrc->opener = NULL;
     upipe_amtsrc->uri = NULL;
+    upipe_amtsrc->batch = 1;
+    upipe_amtsrc->batch_urefs = calloc(1, sizeof(struct uref *));
+    upipe_amtsrc->batch_buffers = calloc(1, sizeof(uint8_t *));
     upipe_throw_ready(upipe);
 
+    if (unlikely(upipe_amtsrc->batch_urefs == NULL ||
+                 upipe_amtsrc->batch_buffers == NULL))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
     upipe_dbg_va(upipe, "using amt library version %x", amt_getVer());
     return upipe;
 }
 
+/** @internal @This frees the urefs allocated in advance.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_amtsrc_flush_batch(struct upipe *upipe)
+{
+    struct upipe_amtsrc *upipe_amtsrc = upipe_amtsrc_from_upipe(upipe);
+    if (upipe_amtsrc->batch_urefs == NULL)
+        return;
+
+    for (unsigned int i = 0; i < upipe_amtsrc->batch; i++) {
+        if (upipe_amtsrc->batch_urefs[i] != NULL) {
+            uref_block_unmap(upipe_amtsrc->batch_urefs[i], 0);
+            uref_free(upipe_amtsrc->batch_urefs[i]);
+            upipe_amtsrc->batch_urefs[i] = NULL;
+        }
+    }
+}
+
+/** @internal @This releases the structures used for batched reads.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_amtsrc_clean_batch(struct upipe *upipe)
+{
+    struct upipe_amtsrc *upipe_amtsrc = upipe_amtsrc_from_upipe(upipe);
+    upipe_amtsrc_flush_batch(upipe);
+    free(upipe_amtsrc->batch_urefs);
+    free(upipe_amtsrc->batch_buffers);
+    upipe_amtsrc->batch_urefs = NULL;
+    upipe_amtsrc->batch_buffers = NULL;
+}
+
+/** @internal @This sets the number of datagrams read per wake-up.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch number of datagrams
+ * @return an error code
+ */
+static int _upipe_amtsrc_set_batch(struct upipe *upipe, unsigned int batch)
+{
+    struct upipe_amtsrc *upipe_amtsrc = upipe_amtsrc_from_upipe(upipe);
+    if (unlikely(batch == 0 || batch > AMT_MAX_BATCH))
+        return UBASE_ERR_INVALID;
+
+    /* the watcher is allocated again by the check afterwards */
+    upipe_amtsrc_set_upump(upipe, NULL);
+    upipe_amtsrc_clean_batch(upipe);
+    upipe_amtsrc->batch = batch;
+    upipe_amtsrc->batch_urefs = calloc(batch, sizeof(struct uref *));
+    upipe_amtsrc->batch_buffers = calloc(batch, sizeof(uint8_t *));
+    if (unlikely(upipe_amtsrc->batch_urefs == NULL ||
+                 upipe_amtsrc->batch_buffers == NULL)) {
+        upipe_amtsrc_clean_batch(upipe);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This releases the context of the opening of a channel. The
+ * last of the pipe and the thread to release it closes the channel if it
+ * was not taken by the pipe.
+ *
+ * @param opener pointer to the opening context
+ */
+static void upipe_amtsrc_opener_release(struct upipe_amtsrc_opener *opener)
+{
+    pthread_mutex_lock(&opener->mutex);
+    bool last = !--opener->refcount;
+    pthread_mutex_unlock(&opener->mutex);
+    if (!last)
+        return;
+
+    if (opener->handle != NULL)
+        amt_closeChannel(opener->handle);
+    ueventfd_clean(&opener->event);
+    pthread_mutex_destroy(&opener->mutex);
+    upipe_mgr_release(opener->mgr);
+    free(opener);
+}
+
+/** @internal @This is the main function of the opener thread. The relay
+ * discovery and the gateway handshake are blocking in libamt, so they are
+ * run out of the pipeline thread. The thread is detached, so that the pipe
+ * never waits for the opening.
+ *
+ * @param _opener pointer to the opening context
+ * @return NULL
+ */
+static void *upipe_amtsrc_opener_thread(void *_opener)
+{
+    struct upipe_amtsrc_opener *opener =
+        (struct upipe_amtsrc_opener *)_opener;
+    amt_handle_t handle = amt_openChannel(opener->relay, opener->group,
+                                          opener->source, opener->port,
+                                          opener->mode);
+
+    pthread_mutex_lock(&opener->mutex);
+    opener->handle = handle;
+    pthread_mutex_unlock(&opener->mutex);
+    ueventfd_write(&opener->event);
+    upipe_amtsrc_opener_release(opener);
+    return NULL;
+}
+
+/** @internal @This closes the channel and cancels any pending opening.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_amtsrc_close(struct upipe *upipe)
+{
+    struct upipe_amtsrc *upipe_amtsrc = upipe_amtsrc_from_upipe(upipe);
+    upipe_amtsrc_set_upump(upipe, NULL);
+    if (upipe_amtsrc->opener != NULL) {
+        upipe_amtsrc_opener_release(upipe_amtsrc->opener);
+        upipe_amtsrc->opener = NULL;
+    }
+    if (unlikely(upipe_amtsrc->handle != NULL)) {
+        if (likely(upipe_amtsrc->uri != NULL))
+            upipe_notice_va(upipe, "closing %s", upipe_amtsrc->uri);
+        amt_closeChannel(upipe_amtsrc->handle);
+        upipe_amtsrc->handle = NULL;
+    }
+    upipe_amtsrc_flush_batch(upipe);
+}
+
+/** @internal @This is called when the opener thread is done.
+ *
+ * @param upump description structure of the event watcher
+ */
+static void upipe_amtsrc_opened(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_amtsrc *upipe_amtsrc = upipe_amtsrc_from_upipe(upipe);
+    struct upipe_amtsrc_opener *opener = upipe_amtsrc->opener;
+    ueventfd_read(&opener->event);
+
+    pthread_mutex_lock(&opener->mutex);
+    upipe_amtsrc->handle = opener->handle;
+    opener->handle = NULL;
+    pthread_mutex_unlock(&opener->mutex);
+    upipe_amtsrc_opener_release(opener);
+    upipe_amtsrc->opener = NULL;
+    upipe_amtsrc_set_upump(upipe, NULL);
+
+    if (unlikely(upipe_amtsrc->handle == NULL)) {
+        upipe_err_va(upipe, "can't open %s", upipe_amtsrc->uri);
+        upipe_throw_source_end(upipe);
+        return;
+    }
+    upipe_notice_va(upipe, "opened %s", upipe_amtsrc->uri);
+    upipe_amtsrc_check(upipe, NULL);
+}
+
 /** @internal @This reads data from the source and outputs it.
  * It is called either when the idler triggers (permanent storage mode) or
  * when data is available on the udp socket descriptor (live stream mode).
@@ -224,41 +423,83 @@ static void upipe_amtsrc_worker(struct upump *upump)
     if (unlikely(upipe_amtsrc->uclock != NULL))
         systime = uclock_now(upipe_amtsrc->uclock);
 
-    struct uref *uref = uref_block_alloc(upipe_amtsrc->uref_mgr,
-                                         upipe_amtsrc->ubuf_mgr,
-                                         upipe_amtsrc->read_size);
-    if (unlikely(uref == NULL)) {
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
-    }
+    /* urefs and buffers left over by the previous wake-up are reused */
+    unsigned int batch = upipe_amtsrc->batch;
+    for (unsigned int i = 0; i < batch; i++) {
+        if (upipe_amtsrc->batch_urefs[i] != NULL)
+            continue;
 
-    uint8_t *buffer;
-    int read_size = -1;
-    if (unlikely(!ubase_check(uref_block_write(uref, 0, &read_size,
-                                               &buffer)))) {
-        uref_free(uref);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
+        struct uref *uref = uref_block_alloc(upipe_amtsrc->uref_mgr,
+                                             upipe_amtsrc->ubuf_mgr,
+                                             upipe_amtsrc->read_size);
+        if (unlikely(uref == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+
+        uint8_t *buffer;
+        int read_size = -1;
+        if (unlikely(!ubase_check(uref_block_write(uref, 0, &read_size,
+                                                   &buffer)))) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        assert(read_size == upipe_amtsrc->read_size);
+        upipe_amtsrc->batch_urefs[i] = uref;
+        upipe_amtsrc->batch_buffers[i] = buffer;
     }
-    assert(read_size == upipe_amtsrc->read_size);
 
-    int ret = amt_recvfrom(upipe_amtsrc->handle, buffer,
-                           upipe_amtsrc->read_size);
-    uref_block_unmap(uref, 0);
+    /* read as long as the tunnel has data pending, without blocking */
+    int sizes[batch];
+    unsigned int nb = 0;
+    bool error = false;
+    for ( ; ; ) {
+        int ret = amt_recvfrom(upipe_amtsrc->handle,
+                               upipe_amtsrc->batch_buffers[nb],
+                               upipe_amtsrc->read_size);
+        if (unlikely(ret == 0)) {
+            error = true;
+            break;
+        }
+        sizes[nb++] = ret;
+        if (nb >= batch)
+            break;
+
+        ars[0].rstate = AMT_READ_NONE;
+        if (amt_poll(ars, 1, 0) <= 0 || !(ars[0].rstate & AMT_READ_IN))
+            break;
+    }
 
-    if (unlikely(ret == 0)) {
-        uref_free(uref);
+    /* detach the received urefs first, as outputting may reenter the pipe */
+    struct uref *urefs[batch];
+    for (unsigned int i = 0; i < nb; i++) {
+        urefs[i] = upipe_amtsrc->batch_urefs[i];
+        uref_block_unmap(urefs[i], 0);
+    }
+    memmove(upipe_amtsrc->batch_urefs, upipe_amtsrc->batch_urefs + nb,
+            (batch - nb) * sizeof(struct uref *));
+    memmove(upipe_amtsrc->batch_buffers, upipe_amtsrc->batch_buffers + nb,
+            (batch - nb) * sizeof(uint8_t *));
+    for (unsigned int i = batch - nb; i < batch; i++)
+        upipe_amtsrc->batch_urefs[i] = NULL;
+
+    if (unlikely(error)) {
         upipe_err_va(upipe, "read error from %s", upipe_amtsrc->uri);
         upipe_amtsrc_set_upump(upipe, NULL);
-        upipe_throw_source_end(upipe);
-        return;
     }
-    if (unlikely(upipe_amtsrc->uclock != NULL))
-        uref_clock_set_cr_sys(uref, systime);
-    if (unlikely(ret != upipe_amtsrc->read_size))
-        uref_block_resize(uref, 0, ret);
+
     upipe_use(upipe);
-    upipe_amtsrc_output(upipe, uref, &upipe_amtsrc->upump);
+    for (unsigned int i = 0; i < nb; i++) {
+        struct uref *uref = urefs[i];
+        if (unlikely(upipe_amtsrc->uclock != NULL))
+            uref_clock_set_cr_sys(uref, systime);
+        if (unlikely(sizes[i] != upipe_amtsrc->read_size))
+            uref_block_resize(uref, 0, sizes[i]);
+        upipe_amtsrc_output(upipe, uref, &upipe_amtsrc->upump);
+    }
+    if (unlikely(error))
+        upipe_throw_source_end(upipe);
     upipe_release(upipe);
 }
 
@@ -299,7 +540,21 @@ static int upipe_amtsrc_check(struct upipe *upipe, struct uref *flow_format)
             != NULL)
         return UBASE_ERR_NONE;
 
-    if (upipe_amtsrc->handle != NULL && upipe_amtsrc->upump == NULL) {
+    if (upipe_amtsrc->opener != NULL && upipe_amtsrc->upump == NULL) {
+        struct upump *upump =
+            ueventfd_upump_alloc(&upipe_amtsrc->opener->event,
+                                 upipe_amtsrc->upump_mgr,
+                                 upipe_amtsrc_opened, upipe);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_amtsrc_set_upump(upipe, upump);
+        upump_start(upump);
+    }
+
+    if (upipe_amtsrc->handle != NULL && upipe_amtsrc->upump == NULL &&
+        upipe_amtsrc->batch_urefs != NULL) {
         struct upump *upump = upump_alloc_idler(upipe_amtsrc->upump_mgr,
                                                 upipe_amtsrc_worker, upipe);
         if (unlikely(upump == NULL)) {
@@ -338,16 +593,9 @@ static int upipe_amtsrc_set_uri(struct upipe *upipe, const char *uri)
     struct upipe_amtsrc_mgr *amtsrc_mgr =
         upipe_amtsrc_mgr_from_upipe_mgr(upipe->mgr);
 
-    if (unlikely(upipe_amtsrc->handle != NULL)) {
-        if (likely(upipe_amtsrc->uri != NULL)) {
-            upipe_notice_va(upipe, "closing %s", upipe_amtsrc->uri);
-        }
-        amt_closeChannel(upipe_amtsrc->handle);
-        upipe_amtsrc->handle = NULL;
-    }
+    upipe_amtsrc_close(upipe);
     free(upipe_amtsrc->uri);
     upipe_amtsrc->uri = NULL;
-    upipe_amtsrc_set_upump(upipe, NULL);
 
     if (unlikely(uri == NULL))
         return UBASE_ERR_NONE;
@@ -397,14 +645,38 @@ static int upipe_amtsrc_set_uri(struct upipe *upipe, const char *uri)
     }
     free(string);
 
-    upipe_amtsrc->handle = amt_openChannel(htonl(amtsrc_mgr->amt_addr.s_addr),
-            htonl(multicast_addr.s_addr), htonl(source_addr.s_addr),
-            port_number, mode);
-    if (unlikely(upipe_amtsrc->handle == NULL)) {
-        upipe_err_va(upipe, "can't open %s", uri);
+    struct upipe_amtsrc_opener *opener =
+        malloc(sizeof(struct upipe_amtsrc_opener));
+    UBASE_ALLOC_RETURN(opener)
+    if (unlikely(!ueventfd_init(&opener->event, false))) {
+        free(opener);
+        return UBASE_ERR_ALLOC;
+    }
+    pthread_mutex_init(&opener->mutex, NULL);
+    opener->refcount = 2;
+    opener->mgr = upipe_mgr_use(upipe->mgr);
+    opener->relay = htonl(amtsrc_mgr->amt_addr.s_addr);
+    opener->group = htonl(multicast_addr.s_addr);
+    opener->source = htonl(source_addr.s_addr);
+    opener->port = port_number;
+    opener->mode = mode;
+    opener->handle = NULL;
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&thread, &attr, upipe_amtsrc_opener_thread,
+                             opener);
+    pthread_attr_destroy(&attr);
+    if (unlikely(ret != 0)) {
+        opener->refcount = 1;
+        upipe_amtsrc_opener_release(opener);
+        upipe_err(upipe, "can't create opener thread");
         return UBASE_ERR_EXTERNAL;
     }
 
+    upipe_amtsrc->opener = opener;
     upipe_amtsrc->uri = strdup(uri);
     upipe_notice_va(upipe, "opening %s", uri);
     return UBASE_ERR_NONE;
@@ -452,8 +724,20 @@ static int _upipe_amtsrc_control(struct upipe *upipe,
         }
         case UPIPE_SOURCE_SET_READ_SIZE: {
             unsigned int read_size = va_arg(args, unsigned int);
+            upipe_amtsrc_flush_batch(upipe);
             return upipe_amtsrc_set_read_size(upipe, read_size);
         }
+        case UPIPE_AMTSRC_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AMTSRC_SIGNATURE)
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = upipe_amtsrc_from_upipe(upipe)->batch;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_AMTSRC_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AMTSRC_SIGNATURE)
+            unsigned int batch = va_arg(args, unsigned int);
+            return _upipe_amtsrc_set_batch(upipe, batch);
+        }
 
         case UPIPE_GET_URI: {
             const char **uri_p = va_arg(args, const char **);
@@ -491,14 +775,11 @@ static void upipe_amtsrc_free(struct upipe *upipe)
 {
     struct upipe_amtsrc *upipe_amtsrc = upipe_amtsrc_from_upipe(upipe);
 
-    if (likely(upipe_amtsrc->handle != NULL)) {
-        if (likely(upipe_amtsrc->uri != NULL))
-            upipe_notice_va(upipe, "closing %s", upipe_amtsrc->uri);
-        amt_closeChannel(upipe_amtsrc->handle);
-    }
+    upipe_amtsrc_close(upipe);
 
     upipe_throw_dead(upipe);
 
+    upipe_amtsrc_clean_batch(upipe);
     free(upipe_amtsrc->uri);
     upipe_amtsrc_clean_read_size(upipe);
     upipe_amtsrc_clean_uclock(upipe);
@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ubuf manager for block formats wrapping libavcodec packets
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/urefcount.h>
+#include <upipe/upool.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_common.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe-av/ubuf_block_av.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <libavcodec/avcodec.h>
+
+/** @internal @This is the structure shared by all blocks pointing to the
+ * same packet. */
+struct ubuf_block_av_shared {
+    /** number of blocks pointing to the packet */
+    uatomic_uint32_t refcount;
+    /** wrapped packet */
+    AVPacket pkt;
+};
+
+/** @This is a super-set of the @ref ubuf (and @ref ubuf_block)
+ * structure with private fields pointing to shared data. */
+struct ubuf_block_av {
+    /** pointer to shared structure */
+    struct ubuf_block_av_shared *shared;
+
+    /** block structure */
+    struct ubuf_block ubuf_block;
+};
+
+UBASE_FROM_TO(ubuf_block_av, ubuf, ubuf, ubuf_block.ubuf)
+
+/** @This is a super-set of the ubuf_mgr structure with additional local
+ * members. */
+struct ubuf_block_av_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf pool */
+    struct upool ubuf_pool;
+    /** ubuf shared pool */
+    struct upool shared_pool;
+
+    /** common management structure */
+    struct ubuf_mgr mgr;
+
+    /** extra space for upool */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(ubuf_block_av_mgr, ubuf_mgr, ubuf_mgr, mgr)
+UBASE_FROM_TO(ubuf_block_av_mgr, urefcount, urefcount, urefcount)
+UBASE_FROM_TO(ubuf_block_av_mgr, upool, ubuf_pool, ubuf_pool)
+UBASE_FROM_TO(ubuf_block_av_mgr, upool, shared_pool, shared_pool)
+
+/** @internal @This allocates a ubuf structure from the pool, pointing to
+ * the given shared structure.
+ *
+ * @param mgr common management structure
+ * @param shared pointer to shared structure
+ * @return pointer to ubuf or NULL in case of allocation error
+ */
+static struct ubuf *ubuf_block_av_alloc_pool(struct ubuf_mgr *mgr,
+                                             struct ubuf_block_av_shared *shared)
+{
+    struct ubuf_block_av_mgr *block_av_mgr =
+        ubuf_block_av_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_block_av *block_av =
+        upool_alloc(&block_av_mgr->ubuf_pool, struct ubuf_block_av *);
+    if (unlikely(block_av == NULL))
+        return NULL;
+
+    struct ubuf *ubuf = ubuf_block_av_to_ubuf(block_av);
+    ubuf_block_common_init(ubuf, false);
+    block_av->shared = shared;
+    ubuf_mgr_use(mgr);
+    return ubuf;
+}
+
+/** @This allocates a ubuf and a shared structure wrapping a packet.
+ *
+ * @param mgr common management structure
+ * @param signature UBUF_ALLOC_BLOCK_AV or UBUF_ALLOC_BLOCK (sentinel)
+ * @param args optional arguments (AVPacket *, or only size)
+ * @return pointer to ubuf or NULL in case of allocation error
+ */
+static struct ubuf *ubuf_block_av_alloc_ubuf(struct ubuf_mgr *mgr,
+                                             uint32_t signature,
+                                             va_list args)
+{
+    struct ubuf_block_av_mgr *block_av_mgr =
+        ubuf_block_av_mgr_from_ubuf_mgr(mgr);
+    AVPacket pkt;
+    switch (signature) {
+        case UBUF_ALLOC_BLOCK_AV: {
+            AVPacket *pkt_p = va_arg(args, AVPacket *);
+            pkt = *pkt_p;
+            av_init_packet(pkt_p);
+            pkt_p->data = NULL;
+            pkt_p->size = 0;
+            /* the payload may belong to the codec */
+            if (unlikely(av_dup_packet(&pkt) < 0)) {
+                av_free_packet(&pkt);
+                return NULL;
+            }
+            break;
+        }
+        case UBUF_ALLOC_BLOCK: {
+            int size = va_arg(args, int);
+            assert(size >= 0);
+            if (unlikely(av_new_packet(&pkt, size) < 0))
+                return NULL;
+            break;
+        }
+        default:
+            return NULL;
+    }
+
+    struct ubuf_block_av_shared *shared =
+        upool_alloc(&block_av_mgr->shared_pool,
+                    struct ubuf_block_av_shared *);
+    if (unlikely(shared == NULL)) {
+        av_free_packet(&pkt);
+        return NULL;
+    }
+    uatomic_store(&shared->refcount, 1);
+    shared->pkt = pkt;
+
+    struct ubuf *ubuf = ubuf_block_av_alloc_pool(mgr, shared);
+    if (unlikely(ubuf == NULL)) {
+        av_free_packet(&shared->pkt);
+        upool_free(&block_av_mgr->shared_pool, shared);
+        return NULL;
+    }
+
+    ubuf_block_common_set(ubuf, 0, shared->pkt.size);
+    ubuf_block_common_set_buffer(ubuf, shared->pkt.data);
+    return ubuf;
+}
+
+/** @This asks for the creation of a new reference to the same buffer space.
+ *
+ * @param ubuf pointer to ubuf
+ * @param new_ubuf_p reference written with a pointer to the newly allocated
+ * ubuf
+ * @return an error code
+ */
+static int ubuf_block_av_dup(struct ubuf *ubuf, struct ubuf **new_ubuf_p)
+{
+    assert(new_ubuf_p != NULL);
+    struct ubuf_block_av *block_av = ubuf_block_av_from_ubuf(ubuf);
+    struct ubuf *new_ubuf = ubuf_block_av_alloc_pool(ubuf->mgr,
+                                                     block_av->shared);
+    if (unlikely(new_ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+
+    uatomic_fetch_add(&block_av->shared->refcount, 1);
+    if (unlikely(!ubase_check(ubuf_block_common_dup(ubuf, new_ubuf)))) {
+        ubuf_free(new_ubuf);
+        return UBASE_ERR_INVALID;
+    }
+    *new_ubuf_p = new_ubuf;
+    return UBASE_ERR_NONE;
+}
+
+/** @This checks whether there is only one reference to the shared buffer.
+ *
+ * @param ubuf pointer to ubuf
+ * @return an error code
+ */
+static int ubuf_block_av_single(struct ubuf *ubuf)
+{
+    struct ubuf_block_av *block_av = ubuf_block_av_from_ubuf(ubuf);
+    return uatomic_load(&block_av->shared->refcount) == 1 ?
+           UBASE_ERR_NONE : UBASE_ERR_BUSY;
+}
+
+/** @This asks for the creation of a new reference to the same buffer space.
+ *
+ * @param ubuf pointer to ubuf
+ * @param new_ubuf_p reference written with a pointer to the newly allocated
+ * ubuf
+ * @param offset offset in the buffer
+ * @param size final size of the buffer
+ * @return an error code
+ */
+static int ubuf_block_av_splice(struct ubuf *ubuf, struct ubuf **new_ubuf_p,
+                                int offset, int size)
+{
+    assert(new_ubuf_p != NULL);
+    struct ubuf_block_av *block_av = ubuf_block_av_from_ubuf(ubuf);
+    struct ubuf *new_ubuf = ubuf_block_av_alloc_pool(ubuf->mgr,
+                                                     block_av->shared);
+    if (unlikely(new_ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+
+    uatomic_fetch_add(&block_av->shared->refcount, 1);
+    if (unlikely(!ubase_check(ubuf_block_common_splice(ubuf, new_ubuf,
+                                                       offset, size)))) {
+        ubuf_free(new_ubuf);
+        return UBASE_ERR_INVALID;
+    }
+    *new_ubuf_p = new_ubuf;
+    return UBASE_ERR_NONE;
+}
+
+/** @This handles control commands.
+ *
+ * @param ubuf pointer to ubuf
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int ubuf_block_av_control(struct ubuf *ubuf, int command, va_list args)
+{
+    switch (command) {
+        case UBUF_DUP: {
+            struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
+            return ubuf_block_av_dup(ubuf, new_ubuf_p);
+        }
+        case UBUF_SINGLE:
+            return ubuf_block_av_single(ubuf);
+
+        case UBUF_SPLICE_BLOCK: {
+            struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
+            int offset = va_arg(args, int);
+            int size = va_arg(args, int);
+            return ubuf_block_av_splice(ubuf, new_ubuf_p, offset, size);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This recycles or frees a ubuf, and frees the packet when the last
+ * reference is released.
+ *
+ * @param ubuf pointer to a ubuf structure
+ */
+static void ubuf_block_av_free(struct ubuf *ubuf)
+{
+    struct ubuf_mgr *mgr = ubuf->mgr;
+    struct ubuf_block_av_mgr *block_av_mgr =
+        ubuf_block_av_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_block_av *block_av = ubuf_block_av_from_ubuf(ubuf);
+
+    ubuf_block_common_clean(ubuf);
+
+    if (unlikely(uatomic_fetch_sub(&block_av->shared->refcount, 1) == 1)) {
+        av_free_packet(&block_av->shared->pkt);
+        upool_free(&block_av_mgr->shared_pool, block_av->shared);
+    }
+    upool_free(&block_av_mgr->ubuf_pool, block_av);
+    ubuf_mgr_release(mgr);
+}
+
+/** @internal @This allocates the data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to ubuf_block_av or NULL in case of allocation error
+ */
+static void *ubuf_block_av_alloc_inner(struct upool *upool)
+{
+    struct ubuf_block_av_mgr *block_av_mgr =
+        ubuf_block_av_mgr_from_ubuf_pool(upool);
+    struct ubuf_block_av *block_av = malloc(sizeof(struct ubuf_block_av));
+    struct ubuf_mgr *mgr = ubuf_block_av_mgr_to_ubuf_mgr(block_av_mgr);
+    if (unlikely(block_av == NULL))
+        return NULL;
+    struct ubuf *ubuf = ubuf_block_av_to_ubuf(block_av);
+    ubuf->mgr = mgr;
+    return block_av;
+}
+
+/** @internal @This frees a ubuf_block_av.
+ *
+ * @param upool pointer to upool
+ * @param _block_av pointer to a ubuf_block_av structure to free
+ */
+static void ubuf_block_av_free_inner(struct upool *upool, void *_block_av)
+{
+    free(_block_av);
+}
+
+/** @internal @This allocates a shared structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to ubuf_block_av_shared or NULL in case of allocation error
+ */
+static void *ubuf_block_av_shared_alloc_inner(struct upool *upool)
+{
+    struct ubuf_block_av_shared *shared =
+        malloc(sizeof(struct ubuf_block_av_shared));
+    if (unlikely(shared == NULL))
+        return NULL;
+    uatomic_init(&shared->refcount, 0);
+    return shared;
+}
+
+/** @internal @This frees a shared structure.
+ *
+ * @param upool pointer to upool
+ * @param _shared pointer to a ubuf_block_av_shared structure to free
+ */
+static void ubuf_block_av_shared_free_inner(struct upool *upool, void *_shared)
+{
+    struct ubuf_block_av_shared *shared =
+        (struct ubuf_block_av_shared *)_shared;
+    uatomic_clean(&shared->refcount);
+    free(shared);
+}
+
+/** @This checks if the given flow format can be allocated with the manager.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param flow_format flow format to check
+ * @return an error code
+ */
+static int ubuf_block_av_mgr_check(struct ubuf_mgr *mgr,
+                                   struct uref *flow_format)
+{
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_format, &def))
+    if (ubase_ncmp(def, "block."))
+        return UBASE_ERR_INVALID;
+
+    /* the alignment of the payload is decided by libavcodec */
+    uint64_t align = 0;
+    uref_block_flow_get_align(flow_format, &align);
+    if (align > 1)
+        return UBASE_ERR_INVALID;
+    return UBASE_ERR_NONE;
+}
+
+/** @This handles manager control commands.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int ubuf_block_av_mgr_control(struct ubuf_mgr *mgr,
+                                     int command, va_list args)
+{
+    struct ubuf_block_av_mgr *block_av_mgr =
+        ubuf_block_av_mgr_from_ubuf_mgr(mgr);
+    switch (command) {
+        case UBUF_MGR_CHECK: {
+            struct uref *flow_format = va_arg(args, struct uref *);
+            return ubuf_block_av_mgr_check(mgr, flow_format);
+        }
+        case UBUF_MGR_VACUUM: {
+            upool_vacuum(&block_av_mgr->ubuf_pool);
+            upool_vacuum(&block_av_mgr->shared_pool);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a ubuf manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void ubuf_block_av_mgr_free(struct urefcount *urefcount)
+{
+    struct ubuf_block_av_mgr *block_av_mgr =
+        ubuf_block_av_mgr_from_urefcount(urefcount);
+    upool_clean(&block_av_mgr->ubuf_pool);
+    upool_clean(&block_av_mgr->shared_pool);
+
+    urefcount_clean(urefcount);
+    free(block_av_mgr);
+}
+
+/** @This allocates a new instance of the ubuf manager for block formats
+ * wrapping AVPackets.
+ *
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param shared_pool_depth maximum number of shared structures in the pool
+ * @return pointer to manager, or NULL in case of error
+ */
+struct ubuf_mgr *ubuf_block_av_mgr_alloc(uint16_t ubuf_pool_depth,
+                                         uint16_t shared_pool_depth)
+{
+    struct ubuf_block_av_mgr *block_av_mgr =
+        malloc(sizeof(struct ubuf_block_av_mgr) +
+               upool_sizeof(ubuf_pool_depth) +
+               upool_sizeof(shared_pool_depth));
+    if (unlikely(block_av_mgr == NULL))
+        return NULL;
+
+    upool_init(&block_av_mgr->ubuf_pool, ubuf_pool_depth,
+               block_av_mgr->upool_extra,
+               ubuf_block_av_alloc_inner, ubuf_block_av_free_inner);
+    upool_init(&block_av_mgr->shared_pool, shared_pool_depth,
+               block_av_mgr->upool_extra + upool_sizeof(ubuf_pool_depth),
+               ubuf_block_av_shared_alloc_inner,
+               ubuf_block_av_shared_free_inner);
+
+    urefcount_init(ubuf_block_av_mgr_to_urefcount(block_av_mgr),
+                   ubuf_block_av_mgr_free);
+    block_av_mgr->mgr.refcount = ubuf_block_av_mgr_to_urefcount(block_av_mgr);
+    block_av_mgr->mgr.signature = UBUF_ALLOC_BLOCK;
+    block_av_mgr->mgr.ubuf_alloc = ubuf_block_av_alloc_ubuf;
+    block_av_mgr->mgr.ubuf_control = ubuf_block_av_control;
+    block_av_mgr->mgr.ubuf_free = ubuf_block_av_free;
+    block_av_mgr->mgr.ubuf_mgr_control = ubuf_block_av_mgr_control;
+
+    return ubuf_block_av_mgr_to_ubuf_mgr(block_av_mgr);
+}
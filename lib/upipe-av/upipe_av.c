@@ -37,10 +37,43 @@
 #include "upipe_av_internal.h"
 
 #include <stdbool.h>
+#include <assert.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/** @internal maximum number of threads in the worker pool */
+#define UPIPE_AV_MAX_WORKERS 64
 
 /** structure to protect exclusive access to avcodec_open() */
 struct udeal upipe_av_deal;
+/** @internal helper thread running jobs with exclusive access to
+ * avcodec_open() */
+static pthread_t upipe_av_thread;
+/** @internal mutex protecting the job queue */
+static pthread_mutex_t upipe_av_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** @internal condition signalled when a job is queued or done */
+static pthread_cond_t upipe_av_cond = PTHREAD_COND_INITIALIZER;
+/** @internal list of queued jobs */
+static struct uchain upipe_av_jobs;
+/** @internal job being run by the helper thread, or NULL */
+static struct upipe_av_job *upipe_av_running = NULL;
+/** @internal set to true to ask the helper thread to exit */
+static bool upipe_av_exit = false;
+/** @internal threads of the worker pool */
+static pthread_t upipe_av_workers[UPIPE_AV_MAX_WORKERS];
+/** @internal number of started threads of the worker pool */
+static unsigned int upipe_av_nb_workers = 0;
+/** @internal requested number of threads of the worker pool (0 for auto) */
+static unsigned int upipe_av_req_workers = 0;
+/** @internal mutex protecting the queue of the worker pool */
+static pthread_mutex_t upipe_av_work_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** @internal condition signalled when a job is queued or done in the pool */
+static pthread_cond_t upipe_av_work_cond = PTHREAD_COND_INITIALIZER;
+/** @internal list of jobs queued to the worker pool */
+static struct uchain upipe_av_works;
+/** @internal set to true to ask the worker pool to exit */
+static bool upipe_av_work_exit = false;
 /** @internal true if only avcodec was initialized */
 static bool avcodec_only = false;
 /** @internal probe used by upipe_av_vlog, defined in upipe_av_init() */
@@ -96,6 +129,240 @@ static void upipe_av_vlog(void *avcl, int level,
     }
 }
 
+/** @This waits for exclusive access to avcodec_open() from a thread without
+ * event loop, following the same protocol as the watchers allocated by
+ * @ref upipe_av_deal_upump_alloc.
+ */
+void upipe_av_deal_wait(void)
+{
+    udeal_wait(&upipe_av_deal);
+}
+
+/** @This yields exclusive access to avcodec_open() acquired by
+ * @ref upipe_av_deal_wait.
+ */
+void upipe_av_deal_release(void)
+{
+    udeal_release(&upipe_av_deal);
+}
+
+/** @internal @This is the main function of the helper thread. It runs the
+ * queued jobs one at a time, so that the event loops of the pipes are not
+ * stalled by avcodec_open() and avcodec_close().
+ *
+ * @param unused unused argument
+ * @return NULL
+ */
+static void *upipe_av_thread_main(void *unused)
+{
+    pthread_mutex_lock(&upipe_av_mutex);
+    for ( ; ; ) {
+        while (!upipe_av_exit && ulist_empty(&upipe_av_jobs))
+            pthread_cond_wait(&upipe_av_cond, &upipe_av_mutex);
+        if (upipe_av_exit)
+            break;
+
+        struct upipe_av_job *job =
+            container_of(ulist_pop(&upipe_av_jobs), struct upipe_av_job,
+                         uchain);
+        upipe_av_running = job;
+        pthread_mutex_unlock(&upipe_av_mutex);
+
+        upipe_av_deal_wait();
+        job->run(job);
+        upipe_av_deal_release();
+
+        pthread_mutex_lock(&upipe_av_mutex);
+        upipe_av_running = NULL;
+        job->pending = false;
+        ueventfd_write(&job->event);
+        pthread_cond_broadcast(&upipe_av_cond);
+    }
+    pthread_mutex_unlock(&upipe_av_mutex);
+    return NULL;
+}
+
+/** @This queues a job to the helper thread.
+ *
+ * @param job pointer to the job, which must not be pending
+ */
+void upipe_av_job_start(struct upipe_av_job *job)
+{
+    pthread_mutex_lock(&upipe_av_mutex);
+    assert(!job->pending);
+    job->pending = true;
+    ulist_add(&upipe_av_jobs, &job->uchain);
+    pthread_cond_broadcast(&upipe_av_cond);
+    pthread_mutex_unlock(&upipe_av_mutex);
+}
+
+/** @This checks if a job is done, after its watcher triggered.
+ *
+ * @param job pointer to the job
+ * @return true if the job is done
+ */
+bool upipe_av_job_done(struct upipe_av_job *job)
+{
+    pthread_mutex_lock(&upipe_av_mutex);
+    bool done = !job->pending;
+    if (done)
+        ueventfd_read(&job->event);
+    pthread_mutex_unlock(&upipe_av_mutex);
+    return done;
+}
+
+/** @This cancels a job. If the helper thread is already running it, this
+ * function waits until it is done.
+ *
+ * @param job pointer to the job
+ * @return true if the job was run
+ */
+bool upipe_av_job_cancel(struct upipe_av_job *job)
+{
+    bool run = true;
+    pthread_mutex_lock(&upipe_av_mutex);
+    if (job->pending && upipe_av_running != job) {
+        ulist_delete(&job->uchain);
+        job->pending = false;
+        run = false;
+    }
+    while (job->pending)
+        pthread_cond_wait(&upipe_av_cond, &upipe_av_mutex);
+    ueventfd_read(&job->event);
+    pthread_mutex_unlock(&upipe_av_mutex);
+    return run;
+}
+
+/** @internal @This is the main function of the threads of the worker pool.
+ * Each thread runs the queued jobs in turn, without access to
+ * avcodec_open().
+ *
+ * @param unused unused argument
+ * @return NULL
+ */
+static void *upipe_av_worker_main(void *unused)
+{
+    pthread_mutex_lock(&upipe_av_work_mutex);
+    for ( ; ; ) {
+        while (!upipe_av_work_exit && ulist_empty(&upipe_av_works))
+            pthread_cond_wait(&upipe_av_work_cond, &upipe_av_work_mutex);
+        if (upipe_av_work_exit)
+            break;
+
+        struct upipe_av_job *job =
+            container_of(ulist_pop(&upipe_av_works), struct upipe_av_job,
+                         uchain);
+        job->running = true;
+        pthread_mutex_unlock(&upipe_av_work_mutex);
+
+        job->run(job);
+
+        pthread_mutex_lock(&upipe_av_work_mutex);
+        job->running = false;
+        job->pending = false;
+        ueventfd_write(&job->event);
+        pthread_cond_broadcast(&upipe_av_work_cond);
+    }
+    pthread_mutex_unlock(&upipe_av_work_mutex);
+    return NULL;
+}
+
+/** @This sets the number of threads of the worker pool.
+ *
+ * @param nb_workers number of threads (0 for one per online CPU)
+ * @return false if the pool is already started
+ */
+bool upipe_av_set_workers(unsigned int nb_workers)
+{
+    pthread_mutex_lock(&upipe_av_work_mutex);
+    bool ret = !upipe_av_nb_workers;
+    if (ret)
+        upipe_av_req_workers = nb_workers;
+    pthread_mutex_unlock(&upipe_av_work_mutex);
+    return ret;
+}
+
+/** @internal @This starts the threads of the worker pool, with the mutex
+ * held.
+ *
+ * @return false if no thread could be started
+ */
+static bool upipe_av_work_init(void)
+{
+    unsigned int nb_workers = upipe_av_req_workers;
+    if (!nb_workers) {
+        long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nb_workers = nb_cpus > 0 ? nb_cpus : 1;
+    }
+    if (nb_workers > UPIPE_AV_MAX_WORKERS)
+        nb_workers = UPIPE_AV_MAX_WORKERS;
+
+    upipe_av_work_exit = false;
+    while (upipe_av_nb_workers < nb_workers &&
+           pthread_create(&upipe_av_workers[upipe_av_nb_workers], NULL,
+                          upipe_av_worker_main, NULL) == 0)
+        upipe_av_nb_workers++;
+    return upipe_av_nb_workers > 0;
+}
+
+/** @This queues a job to the worker pool.
+ *
+ * @param job pointer to the job, which must not be pending
+ * @return false if the worker pool could not be started
+ */
+bool upipe_av_work_start(struct upipe_av_job *job)
+{
+    pthread_mutex_lock(&upipe_av_work_mutex);
+    assert(!job->pending);
+    if (unlikely(!upipe_av_nb_workers && !upipe_av_work_init())) {
+        pthread_mutex_unlock(&upipe_av_work_mutex);
+        return false;
+    }
+    job->pending = true;
+    ulist_add(&upipe_av_works, &job->uchain);
+    pthread_cond_signal(&upipe_av_work_cond);
+    pthread_mutex_unlock(&upipe_av_work_mutex);
+    return true;
+}
+
+/** @This checks if a job queued to the worker pool is done, after its
+ * watcher triggered.
+ *
+ * @param job pointer to the job
+ * @return true if the job is done
+ */
+bool upipe_av_work_done(struct upipe_av_job *job)
+{
+    pthread_mutex_lock(&upipe_av_work_mutex);
+    bool done = !job->pending;
+    if (done)
+        ueventfd_read(&job->event);
+    pthread_mutex_unlock(&upipe_av_work_mutex);
+    return done;
+}
+
+/** @This cancels a job queued to the worker pool. If a worker is already
+ * running it, this function waits until it is done.
+ *
+ * @param job pointer to the job
+ * @return true if the job was run
+ */
+bool upipe_av_work_cancel(struct upipe_av_job *job)
+{
+    bool run = true;
+    pthread_mutex_lock(&upipe_av_work_mutex);
+    if (job->pending && !job->running) {
+        ulist_delete(&job->uchain);
+        job->pending = false;
+        run = false;
+    }
+    while (job->pending)
+        pthread_cond_wait(&upipe_av_work_cond, &upipe_av_work_mutex);
+    ueventfd_read(&job->event);
+    pthread_mutex_unlock(&upipe_av_work_mutex);
+    return run;
+}
+
 /** @This initializes non-reentrant parts of avcodec and avformat. Call it
  * before allocating managers from this library.
  *
@@ -113,6 +380,16 @@ bool upipe_av_init(bool init_avcodec_only, struct uprobe *uprobe)
         return false;
     }
 
+    ulist_init(&upipe_av_jobs);
+    ulist_init(&upipe_av_works);
+    upipe_av_exit = false;
+    if (unlikely(pthread_create(&upipe_av_thread, NULL,
+                                upipe_av_thread_main, NULL) != 0)) {
+        udeal_clean(&upipe_av_deal);
+        uprobe_release(uprobe);
+        return false;
+    }
+
     if (unlikely(avcodec_only)) {
         avcodec_register_all();
     } else {
@@ -132,6 +409,19 @@ bool upipe_av_init(bool init_avcodec_only, struct uprobe *uprobe)
  */
 void upipe_av_clean(void)
 {
+    pthread_mutex_lock(&upipe_av_mutex);
+    upipe_av_exit = true;
+    pthread_cond_broadcast(&upipe_av_cond);
+    pthread_mutex_unlock(&upipe_av_mutex);
+    pthread_join(upipe_av_thread, NULL);
+
+    pthread_mutex_lock(&upipe_av_work_mutex);
+    upipe_av_work_exit = true;
+    pthread_cond_broadcast(&upipe_av_work_cond);
+    pthread_mutex_unlock(&upipe_av_work_mutex);
+    while (upipe_av_nb_workers)
+        pthread_join(upipe_av_workers[--upipe_av_nb_workers], NULL);
+
     if (likely(!avcodec_only))
         avformat_network_deinit();
     udeal_clean(&upipe_av_deal);
@@ -28,6 +28,8 @@
  */
 
 #include <upipe/udeal.h>
+#include <upipe/ueventfd.h>
+#include <upipe/ulist.h>
 #include <upipe/upump.h>
 
 #include <stdbool.h>
@@ -103,6 +105,117 @@ static inline void upipe_av_deal_abort(struct upump *upump)
     udeal_abort(&upipe_av_deal, upump);
 }
 
+/** @This waits for exclusive access to avcodec_open() from a thread without
+ * event loop, blocking the thread.
+ */
+void upipe_av_deal_wait(void);
+
+/** @This yields exclusive access to avcodec_open() acquired by
+ * @ref upipe_av_deal_wait.
+ */
+void upipe_av_deal_release(void);
+
+/** @This describes a job run by the helper thread, with exclusive access to
+ * avcodec_open(), or by the worker pool. */
+struct upipe_av_job {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** function run by the helper thread */
+    void (*run)(struct upipe_av_job *);
+    /** event triggered when the job is done */
+    struct ueventfd event;
+    /** true while the job is queued or running */
+    bool pending;
+    /** true while a thread of the worker pool is running the job */
+    bool running;
+};
+
+/** @This initializes a job.
+ *
+ * @param job pointer to the job
+ * @param run function to run in the helper thread
+ * @return false in case of error
+ */
+static inline bool upipe_av_job_init(struct upipe_av_job *job,
+                                     void (*run)(struct upipe_av_job *))
+{
+    uchain_init(&job->uchain);
+    job->run = run;
+    job->pending = false;
+    job->running = false;
+    return ueventfd_init(&job->event, false);
+}
+
+/** @This allocates a watcher triggering when a job is done.
+ *
+ * @param job pointer to the job
+ * @param upump_mgr management structure for this event loop
+ * @param cb function to call when the watcher triggers
+ * @param opaque pointer to the module's internal structure
+ * @return pointer to allocated watcher, or NULL in case of failure
+ */
+static inline struct upump *upipe_av_job_upump_alloc(struct upipe_av_job *job,
+        struct upump_mgr *upump_mgr, upump_cb cb, void *opaque)
+{
+    return ueventfd_upump_alloc(&job->event, upump_mgr, cb, opaque);
+}
+
+/** @This cleans up a job, which must not be pending.
+ *
+ * @param job pointer to the job
+ */
+static inline void upipe_av_job_clean(struct upipe_av_job *job)
+{
+    ueventfd_clean(&job->event);
+}
+
+/** @This queues a job to the helper thread.
+ *
+ * @param job pointer to the job, which must not be pending
+ */
+void upipe_av_job_start(struct upipe_av_job *job);
+
+/** @This checks if a job is done, after its watcher triggered.
+ *
+ * @param job pointer to the job
+ * @return true if the job is done
+ */
+bool upipe_av_job_done(struct upipe_av_job *job);
+
+/** @This cancels a job. If the helper thread is already running it, this
+ * function waits until it is done.
+ *
+ * @param job pointer to the job
+ * @return true if the job was run
+ */
+bool upipe_av_job_cancel(struct upipe_av_job *job);
+
+/** @This queues a job to the worker pool shared by all avcodec pipes, which
+ * runs jobs of different pipes in parallel, without access to
+ * avcodec_open(). A pipe must only have one job queued at a time, so that
+ * its jobs complete in order. The pool is started on the first call.
+ *
+ * @param job pointer to the job, which must not be pending
+ * @return false if the worker pool could not be started
+ */
+bool upipe_av_work_start(struct upipe_av_job *job);
+
+/** @This checks if a job queued with @ref upipe_av_work_start is done,
+ * after its watcher triggered.
+ *
+ * @param job pointer to the job
+ * @return true if the job is done
+ */
+bool upipe_av_work_done(struct upipe_av_job *job);
+
+/** @This cancels a job queued with @ref upipe_av_work_start. If a worker
+ * is already running it, this function waits until it is done.
+ *
+ * @param job pointer to the job
+ * @return true if the job was run
+ */
+bool upipe_av_work_cancel(struct upipe_av_job *job);
+
 /** @This wraps around av_strerror() using ulog storage.
  *
  * @param ulog utility structure passed to the module
@@ -29,6 +29,8 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/urefcount.h>
 #include <upipe/uprobe.h>
 #include <upipe/uclock.h>
 #include <upipe/ubuf.h>
@@ -53,6 +55,7 @@
 #include <upipe/upipe_helper_upump_mgr.h>
 #include <upipe/upipe_helper_upump.h>
 #include <upipe/upipe_helper_input.h>
+#include <upipe-framers/uref_frames.h>
 #include <upipe-av/upipe_avcodec_decode.h>
 
 #include <stdlib.h>
@@ -60,6 +63,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
@@ -83,6 +87,56 @@ static bool upipe_avcdec_decode_avpkt(struct upipe *upipe, AVPacket *avpkt,
 static bool upipe_avcdec_decode(struct upipe *upipe, struct uref *uref,
                                 struct upump **upump_p);
 
+/** @internal @This is a decoder context kept open in the pool of the
+ * manager. */
+struct upipe_avcdec_warm {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** opened avcodec context */
+    AVCodecContext *context;
+    /** number of threads requested when the context was opened */
+    int thread_count;
+    /** types of threading requested when the context was opened */
+    int thread_type;
+};
+
+UBASE_FROM_TO(upipe_avcdec_warm, uchain, uchain, uchain)
+
+/** @internal @This is the private context of an avcdec manager. */
+struct upipe_avcdec_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** maximum number of contexts in the pool */
+    unsigned int pool_depth;
+    /** number of contexts in the pool */
+    unsigned int nb_warm;
+    /** list of opened contexts, most recent first */
+    struct uchain warm;
+
+    /** public upipe_mgr structure */
+    struct upipe_mgr mgr;
+};
+
+UBASE_FROM_TO(upipe_avcdec_mgr, upipe_mgr, upipe_mgr, mgr)
+UBASE_FROM_TO(upipe_avcdec_mgr, urefcount, urefcount, urefcount)
+
+/** @internal @This defines the outcomes of a job accessing avcodec_open(). */
+enum upipe_avcdec_av_deal {
+    /** a new context was opened */
+    UPIPE_AVCDEC_DEAL_OPENED,
+    /** a context from the pool was reused */
+    UPIPE_AVCDEC_DEAL_REUSED,
+    /** the context was given back to the pool */
+    UPIPE_AVCDEC_DEAL_KEPT,
+    /** the context was closed */
+    UPIPE_AVCDEC_DEAL_CLOSED,
+    /** the media type is not supported */
+    UPIPE_AVCDEC_DEAL_UNSUPPORTED,
+    /** avcodec_open2 failed */
+    UPIPE_AVCDEC_DEAL_ERROR
+};
+
 /** upipe_avcdec structure with avcdec parameters */ 
 struct upipe_avcdec {
     /** refcount management structure */
@@ -121,8 +175,28 @@ struct upipe_avcdec {
     /** sample format used for the ubuf manager */
     enum AVSampleFormat sample_fmt;
 
-    /** avcodec_open watcher */
+    /** job running avcodec_open in the helper thread */
+    struct upipe_av_job av_job;
+    /** watcher on the completion of the job */
     struct upump *upump_av_deal;
+    /** outcome of the job */
+    enum upipe_avcdec_av_deal av_deal;
+    /** error returned by avcodec_open2 */
+    int av_deal_err;
+    /** codec opened or closed by the job */
+    const AVCodec *av_deal_codec;
+    /** true if audio packets are decoded by the worker pool */
+    bool worker;
+    /** job decoding a packet in the worker pool */
+    struct upipe_av_job av_work;
+    /** watcher on the completion of the decoding job */
+    struct upump *upump_av_work;
+    /** packet decoded by the job */
+    AVPacket work_avpkt;
+    /** set by the job if a frame was decoded */
+    int work_gotframe;
+    /** value returned by avcodec_decode_audio4() in the job */
+    int work_len;
     /** temporary uref storage (used during udeal) */
     struct uchain urefs;
     /** nb urefs in storage */
@@ -157,12 +231,21 @@ struct upipe_avcdec {
     AVFrame *frame;
     /** true if the context will be closed */
     bool close;
+    /** true if avcodec options were set on the context, which then cannot
+     * be shared with other pipes */
+    bool options;
+    /** number of threads requested when the context was opened */
+    int thread_count;
+    /** types of threading requested when the context was opened */
+    int thread_type;
 
     /** public upipe structure */
     struct upipe upipe;
 };
 
 UPIPE_HELPER_UPIPE(upipe_avcdec, upipe, UPIPE_AVCDEC_SIGNATURE);
+UBASE_FROM_TO(upipe_avcdec, upipe_av_job, av_job, av_job)
+UBASE_FROM_TO(upipe_avcdec, upipe_av_job, av_work, av_work)
 UPIPE_HELPER_UREFCOUNT(upipe_avcdec, urefcount, upipe_avcdec_close)
 UPIPE_HELPER_VOID(upipe_avcdec)
 UPIPE_HELPER_OUTPUT(upipe_avcdec, output, flow_def, output_state, request_list)
@@ -175,6 +258,7 @@ UPIPE_HELPER_UBUF_MGR(upipe_avcdec, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_avcdec_unregister_output_request)
 UPIPE_HELPER_UPUMP_MGR(upipe_avcdec, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_avcdec, upump_av_deal, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_avcdec, upump_av_work, upump_mgr)
 UPIPE_HELPER_INPUT(upipe_avcdec, urefs, nb_urefs, max_urefs, blockers, upipe_avcdec_decode)
 
 /** @hidden */
@@ -414,20 +498,20 @@ static void upipe_avcdec_release_buffer_pic(struct AVCodecContext *context,
     uref_free(uref);
 }
 
-/** @internal @This is called by avcodec when allocating a new audio buffer.
- * Used with audio decoders.
+/** @internal @This attaches a buffer for the given audio frame to the
+ * current uref, and chains the flow definition attributes to the uref.
  *
- * @param context current avcodec context
- * @param frame avframe handler entering avcodec black magic box
+ * @param upipe description structure of the pipe
+ * @param frame audio frame
+ * @return false in case of error
  */
-static int upipe_avcdec_get_buffer_sound(struct AVCodecContext *context,
-                                         AVFrame *frame)
+static bool upipe_avcdec_alloc_sound(struct upipe *upipe, AVFrame *frame)
 {
-    struct upipe *upipe = context->opaque;
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcdec->context;
 
     if (unlikely(upipe_avcdec->uref == NULL))
-        return -1;
+        return false;
 
     struct uref *uref = upipe_avcdec->uref;
     upipe_avcdec->uref = NULL;
@@ -451,7 +535,7 @@ static int upipe_avcdec_get_buffer_sound(struct AVCodecContext *context,
     if (unlikely(flow_def_attr == NULL)) {
         uref_free(uref);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return -1;
+        return false;
     }
     UBASE_FATAL(upipe, upipe_av_samplefmt_to_flow_def(flow_def_attr,
                                                upipe_avcdec->sample_fmt,
@@ -469,7 +553,7 @@ static int upipe_avcdec_get_buffer_sound(struct AVCodecContext *context,
     if (unlikely(upipe_avcdec->ubuf_mgr == NULL)) {
         if (unlikely(!upipe_avcdec_demand_ubuf_mgr(upipe, flow_def_attr))) {
             uref_free(uref);
-            return -1;
+            return false;
         }
     } else
         uref_free(flow_def_attr);
@@ -482,20 +566,38 @@ static int upipe_avcdec_get_buffer_sound(struct AVCodecContext *context,
         uref_free(uref);
         uref_free(flow_def_attr);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return -1;
+        return false;
     }
     uref_attach_ubuf(uref, ubuf);
 
     /* Chain the new flow def attributes to the uref so we can apply them
      * later. */
     uref->uchain.next = uref_to_uchain(flow_def_attr);
+    return true;
+}
+
+/** @internal @This is called by avcodec when allocating a new audio buffer.
+ * Used with audio decoders.
+ *
+ * @param context current avcodec context
+ * @param frame avframe handler entering avcodec black magic box
+ */
+static int upipe_avcdec_get_buffer_sound(struct AVCodecContext *context,
+                                         AVFrame *frame)
+{
+    struct upipe *upipe = context->opaque;
+    if (unlikely(!upipe_avcdec_alloc_sound(upipe, frame)))
+        return -1;
 
     if (!(context->codec->capabilities & CODEC_CAP_DR1))
         return avcodec_default_get_buffer(context, frame);
 
     /* Direct rendering */
-    if (unlikely(!ubase_check(ubuf_sound_write_uint8_t(ubuf, 0, -1, frame->data,
-                                                 AV_NUM_DATA_POINTERS)))) {
+    struct uref *uref = frame->opaque;
+    struct uref *flow_def_attr = uref_from_uchain(uref->uchain.next);
+    if (unlikely(!ubase_check(uref_sound_write_uint8_t(uref, 0, -1,
+                                    frame->data, AV_NUM_DATA_POINTERS)))) {
+        uref->uchain.next = NULL;
         uref_free(uref);
         uref_free(flow_def_attr);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
@@ -511,8 +613,88 @@ static int upipe_avcdec_get_buffer_sound(struct AVCodecContext *context,
     return 0; /* success */
 }
 
-/** @This aborts and frees an existing upump watching for exclusive access to
- * avcodec_open().
+/** @internal @This replaces the unopened context of the pipe with a matching
+ * context from the pool of the manager, if any. A context matches if it
+ * was opened for the same codec and extradata, with the same threading
+ * parameters. It may only be called by one thread at a time, normally the
+ * helper thread.
+ *
+ * @param upipe description structure of the pipe
+ * @return true if a context was borrowed
+ */
+static bool upipe_avcdec_borrow_context(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_upipe_mgr(upipe->mgr);
+    AVCodecContext *context = upipe_avcdec->context;
+    if (upipe_avcdec->options)
+        return false;
+
+    struct uchain *uchain;
+    ulist_foreach (&avcdec_mgr->warm, uchain) {
+        struct upipe_avcdec_warm *warm =
+            upipe_avcdec_warm_from_uchain(uchain);
+        AVCodecContext *warm_context = warm->context;
+        if (warm_context->codec != context->codec ||
+            warm->thread_count != context->thread_count ||
+            warm->thread_type != context->thread_type ||
+            warm_context->extradata_size != context->extradata_size ||
+            (context->extradata_size &&
+             memcmp(warm_context->extradata, context->extradata,
+                    context->extradata_size)))
+            continue;
+
+        ulist_delete(uchain);
+        avcdec_mgr->nb_warm--;
+        upipe_avcdec->thread_count = warm->thread_count;
+        upipe_avcdec->thread_type = warm->thread_type;
+        free(warm);
+
+        free(context->extradata);
+        av_free(context);
+        warm_context->opaque = upipe;
+        upipe_avcdec->context = warm_context;
+        return true;
+    }
+    return false;
+}
+
+/** @internal @This gives the opened context of the pipe back to the pool of
+ * the manager, after flushing it, if the pool is not full. It may only be
+ * called by one thread at a time.
+ *
+ * @param upipe description structure of the pipe
+ * @return true if the context was given back
+ */
+static bool upipe_avcdec_give_context(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_upipe_mgr(upipe->mgr);
+    AVCodecContext *context = upipe_avcdec->context;
+    if (upipe_avcdec->options || !avcodec_is_open(context) ||
+        avcdec_mgr->nb_warm >= avcdec_mgr->pool_depth)
+        return false;
+
+    struct upipe_avcdec_warm *warm = malloc(sizeof(struct upipe_avcdec_warm));
+    if (unlikely(warm == NULL))
+        return false;
+    avcodec_flush_buffers(context);
+    context->opaque = NULL;
+    warm->context = context;
+    warm->thread_count = upipe_avcdec->thread_count;
+    warm->thread_type = upipe_avcdec->thread_type;
+    uchain_init(&warm->uchain);
+    ulist_unshift(&avcdec_mgr->warm, upipe_avcdec_warm_to_uchain(warm));
+    avcdec_mgr->nb_warm++;
+    upipe_avcdec->context = NULL;
+    return true;
+}
+
+/** @This aborts and frees an existing upump watching for the completion of
+ * avcodec_open() or avcodec_close(). If the helper thread is already
+ * running the job, it waits until it is done.
  *
  * @param upipe description structure of the pipe
  */
@@ -520,66 +702,150 @@ static void upipe_avcdec_abort_av_deal(struct upipe *upipe)
 {
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
     if (unlikely(upipe_avcdec->upump_av_deal != NULL)) {
-        upipe_av_deal_abort(upipe_avcdec->upump_av_deal);
+        upipe_av_job_cancel(&upipe_avcdec->av_job);
         upump_free(upipe_avcdec->upump_av_deal);
         upipe_avcdec->upump_av_deal = NULL;
     }
 }
 
-/** @internal @This actually calls avcodec_open(). It may only be called by
- * one thread at a time.
+/** @internal @This sets the buffer allocation callbacks of the context.
  *
  * @param upipe description structure of the pipe
- * @return false if the buffers mustn't be dequeued
+ * @return false if the media type is not supported
  */
-static bool upipe_avcdec_do_av_deal(struct upipe *upipe)
+static bool upipe_avcdec_set_get_buffer(struct upipe *upipe)
 {
-    assert(upipe);
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
     AVCodecContext *context = upipe_avcdec->context;
 
-    if (upipe_avcdec->close) {
-        upipe_notice_va(upipe, "codec %s (%s) %d closed", context->codec->name, 
-                        context->codec->long_name, context->codec->id);
-        avcodec_close(context);
-        return false;
-    }
-
     switch (context->codec->type) {
         case AVMEDIA_TYPE_VIDEO:
             context->get_buffer = upipe_avcdec_get_buffer_pic;
             context->release_buffer = upipe_avcdec_release_buffer_pic;
             /* otherwise we need specific prepend/append/align */
             context->flags |= CODEC_FLAG_EMU_EDGE;
-            break;
+            return true;
         case AVMEDIA_TYPE_AUDIO:
+            if (upipe_avcdec->worker) {
+                /* the worker pool may not use the ubuf manager, the
+                 * samples are copied by the thread of the pipe */
+                context->get_buffer = avcodec_default_get_buffer;
+                context->release_buffer = avcodec_default_release_buffer;
+                return true;
+            }
             context->get_buffer = upipe_avcdec_get_buffer_sound;
             context->release_buffer = NULL;
             /* release_buffer is not called for audio */
-            break;
+            return true;
         default:
-            /* This should not happen */
-            upipe_err_va(upipe, "Unsupported media type (%d)",
-                         context->codec->type);
             return false;
     }
+}
 
-    /* open new context */
-    int err;
-    if (unlikely((err = avcodec_open2(context, context->codec, NULL)) < 0)) {
-        upipe_av_strerror(err, buf);
-        upipe_warn_va(upipe, "could not open codec (%s)", buf);
-        upipe_throw_fatal(upipe, UBASE_ERR_EXTERNAL);
-        return false;
+/** @internal @This actually calls avcodec_open() or avcodec_close(). It may
+ * only be called by one thread at a time, and runs in the helper thread
+ * unless no upump manager is present, so it must not throw events; the
+ * outcome is reported by @ref upipe_avcdec_report_av_deal.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avcdec_do_av_deal(struct upipe *upipe)
+{
+    assert(upipe);
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcdec->context;
+    upipe_avcdec->av_deal_codec = context->codec;
+
+    if (upipe_avcdec->close) {
+        if (upipe_avcdec_give_context(upipe)) {
+            upipe_avcdec->av_deal = UPIPE_AVCDEC_DEAL_KEPT;
+            return;
+        }
+        avcodec_close(context);
+        upipe_avcdec->av_deal = UPIPE_AVCDEC_DEAL_CLOSED;
+        return;
     }
-    upipe_notice_va(upipe, "codec %s (%s) %d opened", context->codec->name, 
-                    context->codec->long_name, context->codec->id);
 
-    return true;
+    if (upipe_avcdec_borrow_context(upipe)) {
+        /* the previous owner may have used the worker pool or not */
+        upipe_avcdec_set_get_buffer(upipe);
+        upipe_avcdec->av_deal = UPIPE_AVCDEC_DEAL_REUSED;
+        return;
+    }
+
+    if (unlikely(!upipe_avcdec_set_get_buffer(upipe))) {
+        /* This should not happen */
+        upipe_avcdec->av_deal = UPIPE_AVCDEC_DEAL_UNSUPPORTED;
+        return;
+    }
+
+    /* with frame threading, have libavcodec forward get_buffer and
+     * release_buffer to the thread calling avcodec_decode_video2(), since
+     * neither the ubuf manager nor the uref storage are thread-safe */
+    context->thread_safe_callbacks = 0;
+
+    /* open new context */
+    upipe_avcdec->thread_count = context->thread_count;
+    upipe_avcdec->thread_type = context->thread_type;
+    upipe_avcdec->av_deal_err = avcodec_open2(context, context->codec, NULL);
+    upipe_avcdec->av_deal = upipe_avcdec->av_deal_err < 0 ?
+                            UPIPE_AVCDEC_DEAL_ERROR : UPIPE_AVCDEC_DEAL_OPENED;
+}
+
+/** @internal @This is called by the helper thread to run
+ * @ref upipe_avcdec_do_av_deal.
+ *
+ * @param job description structure of the job
+ */
+static void upipe_avcdec_run_av_deal(struct upipe_av_job *job)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_av_job(job);
+    upipe_avcdec_do_av_deal(upipe_avcdec_to_upipe(upipe_avcdec));
 }
 
-/** @internal @This is called to try an exclusive access on avcodec_open() or
- * avcodec_close().
+/** @internal @This reports the outcome of @ref upipe_avcdec_do_av_deal, in
+ * the thread of the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @return false if the buffers mustn't be dequeued
+ */
+static bool upipe_avcdec_report_av_deal(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    const AVCodec *codec = upipe_avcdec->av_deal_codec;
+
+    switch (upipe_avcdec->av_deal) {
+        case UPIPE_AVCDEC_DEAL_OPENED:
+            upipe_notice_va(upipe, "codec %s (%s) %d opened", codec->name, 
+                            codec->long_name, codec->id);
+            return true;
+        case UPIPE_AVCDEC_DEAL_REUSED:
+            upipe_notice_va(upipe, "codec %s (%s) %d reused", codec->name,
+                            codec->long_name, codec->id);
+            return true;
+        case UPIPE_AVCDEC_DEAL_KEPT:
+            upipe_notice_va(upipe, "codec %s (%s) %d kept open", codec->name,
+                            codec->long_name, codec->id);
+            return false;
+        case UPIPE_AVCDEC_DEAL_CLOSED:
+            upipe_notice_va(upipe, "codec %s (%s) %d closed", codec->name, 
+                            codec->long_name, codec->id);
+            return false;
+        case UPIPE_AVCDEC_DEAL_UNSUPPORTED:
+            upipe_err_va(upipe, "Unsupported media type (%d)", codec->type);
+            return false;
+        case UPIPE_AVCDEC_DEAL_ERROR:
+        default: {
+            upipe_av_strerror(upipe_avcdec->av_deal_err, buf);
+            upipe_warn_va(upipe, "could not open codec (%s)", buf);
+            upipe_throw_fatal(upipe, UBASE_ERR_EXTERNAL);
+            return false;
+        }
+    }
+}
+
+/** @internal @This is called when the helper thread is done with
+ * avcodec_open() or avcodec_close().
  *
  * @param upump description structure of the pump
  */
@@ -589,18 +855,13 @@ static void upipe_avcdec_cb_av_deal(struct upump *upump)
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
 
-    /* check udeal */
-    if (unlikely(!upipe_av_deal_grab()))
+    if (unlikely(!upipe_av_job_done(&upipe_avcdec->av_job)))
         return;
 
-    /* real open_codec function */
-    bool ret = upipe_avcdec_do_av_deal(upipe);
-
-    /* clean dealer */
-    upipe_av_deal_yield(upump);
     upump_free(upipe_avcdec->upump_av_deal);
     upipe_avcdec->upump_av_deal = NULL;
 
+    bool ret = upipe_avcdec_report_av_deal(upipe);
     if (upipe_avcdec->close) {
         upipe_avcdec_free(upipe);
         return;
@@ -626,20 +887,22 @@ static void upipe_avcdec_start_av_deal(struct upipe *upipe)
     /* abort a pending open request */
     upipe_avcdec_abort_av_deal(upipe);
  
-    /* use udeal/upump callback if available */
+    /* use the helper thread if possible */
     upipe_avcdec_check_upump_mgr(upipe);
     if (upipe_avcdec->upump_mgr == NULL) {
         upipe_dbg(upipe, "no upump_mgr present, direct call to avcodec_open");
         upipe_avcdec_do_av_deal(upipe);
+        upipe_avcdec_report_av_deal(upipe);
         if (upipe_avcdec->close)
             upipe_avcdec_free(upipe);
         return;
     }
 
-    upipe_dbg(upipe, "upump_mgr present, using udeal");
+    upipe_dbg(upipe, "upump_mgr present, using helper thread");
     struct upump *upump_av_deal =
-        upipe_av_deal_upump_alloc(upipe_avcdec->upump_mgr,
-                                  upipe_avcdec_cb_av_deal, upipe);
+        upipe_av_job_upump_alloc(&upipe_avcdec->av_job,
+                                 upipe_avcdec->upump_mgr,
+                                 upipe_avcdec_cb_av_deal, upipe);
     if (unlikely(!upump_av_deal)) {
         upipe_err(upipe, "can't create dealer");
         upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
@@ -649,7 +912,8 @@ static void upipe_avcdec_start_av_deal(struct upipe *upipe)
     /* Increment upipe refcount to avoid disappearing before all packets
      * have been sent. */
     upipe_use(upipe);
-    upipe_av_deal_start(upump_av_deal);
+    upump_start(upump_av_deal);
+    upipe_av_job_start(&upipe_avcdec->av_job);
 }
 
 /** @internal @This is called to trigger avcodec_open().
@@ -793,33 +1057,48 @@ static void upipe_avcdec_output_pic(struct upipe *upipe, struct upump **upump_p)
     if (!(upipe_avcdec->context->codec->capabilities & CODEC_CAP_DR1)) {
         /* Not direct rendering, copy data. */
         uint8_t planes;
-        if (unlikely(!ubase_check(uref_pic_flow_get_planes(flow_def_attr, &planes)))) {
+        size_t hsize;
+        uint8_t macropixel;
+        if (unlikely(!ubase_check(uref_pic_flow_get_planes(flow_def_attr, &planes)) ||
+                     !ubase_check(ubuf_pic_size(uref->ubuf, &hsize, NULL,
+                                                &macropixel)))) {
             uref_free(uref);
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             return;
         }
 
         for (uint8_t plane = 0; plane < planes; plane++) {
-            uint8_t *dst, *src, hsub, vsub;
-            size_t sstride, dstride, stride;
+            uint8_t *dst, *src, hsub, vsub, macropixel_size;
+            size_t sstride, dstride;
             const char *chroma;
             if (unlikely(!ubase_check(uref_pic_flow_get_chroma(flow_def_attr, &chroma,
                                                    plane)) ||
                          !ubase_check(ubuf_pic_plane_write(uref->ubuf, chroma,
                                                0, 0, -1, -1, &dst)) ||
                          !ubase_check(ubuf_pic_plane_size(uref->ubuf, chroma, &dstride,
-                                              &hsub, &vsub, NULL)))) {
+                                              &hsub, &vsub, &macropixel_size)))) {
                 uref_free(uref);
                 upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
                 return;
             }
             src = frame->data[plane];
             sstride = frame->linesize[plane];
-            stride = sstride < dstride ? sstride : dstride;
-            for (int j = 0; j < frame->height / vsub; j++) {
-                memcpy(dst, src, stride);
-                dst += dstride;
-                src += sstride;
+            int lines = frame->height / vsub;
+            /* only copy the visible part of the lines, not the padding */
+            size_t width = hsize / hsub / macropixel * macropixel_size;
+            if (width > sstride)
+                width = sstride;
+            if (width > dstride)
+                width = dstride;
+            if (sstride == dstride && lines > 0) {
+                /* contiguous planes, copy in one go */
+                memcpy(dst, src, sstride * (lines - 1) + width);
+            } else {
+                for (int j = 0; j < lines; j++) {
+                    memcpy(dst, src, width);
+                    dst += dstride;
+                    src += sstride;
+                }
             }
             ubuf_pic_plane_unmap(uref->ubuf, chroma, 0, 0, -1, -1);
         }
@@ -889,7 +1168,8 @@ static void upipe_avcdec_output_sound(struct upipe *upipe,
     /* In case it has been reduced. */
     UBASE_ERROR(upipe, uref_sound_resize(uref, 0, frame->nb_samples))
 
-    if (!(context->codec->capabilities & CODEC_CAP_DR1)) {
+    if (upipe_avcdec->worker ||
+        !(context->codec->capabilities & CODEC_CAP_DR1)) {
         /* Not direct rendering, copy data. */
         uint8_t *buffers[AV_NUM_DATA_POINTERS];
         if (unlikely(!ubase_check(uref_sound_write_uint8_t(uref, 0, -1,
@@ -935,6 +1215,117 @@ static void upipe_avcdec_output_sound(struct upipe *upipe,
     upipe_avcdec_output(upipe, uref, upump_p);
 }
 
+/** @internal @This is called by the worker pool to decode the packet of
+ * the job. It must not throw events.
+ *
+ * @param job description structure of the job
+ */
+static void upipe_avcdec_run_av_work(struct upipe_av_job *job)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_av_work(job);
+    upipe_avcdec->work_gotframe = 0;
+    upipe_avcdec->work_len = avcodec_decode_audio4(upipe_avcdec->context,
+                                                   upipe_avcdec->frame,
+                                                   &upipe_avcdec->work_gotframe,
+                                                   &upipe_avcdec->work_avpkt);
+}
+
+/** @internal @This outputs the frame decoded by the job, in the thread of
+ * the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to upump structure
+ */
+static void upipe_avcdec_output_av_work(struct upipe *upipe,
+                                        struct upump **upump_p)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    free(upipe_avcdec->work_avpkt.data);
+    upipe_avcdec->work_avpkt.data = NULL;
+
+    if (upipe_avcdec->work_len < 0)
+        upipe_warn(upipe, "Error while decoding frame");
+
+    /* output samples if any has been decoded */
+    if (upipe_avcdec->work_gotframe &&
+        upipe_avcdec_alloc_sound(upipe, upipe_avcdec->frame))
+        upipe_avcdec_output_sound(upipe, upump_p);
+}
+
+/** @internal @This is called when the worker pool is done with a packet.
+ *
+ * @param upump description structure of the pump
+ */
+static void upipe_avcdec_cb_av_work(struct upump *upump)
+{
+    assert(upump);
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+
+    if (unlikely(!upipe_av_work_done(&upipe_avcdec->av_work)))
+        return;
+
+    upump_free(upipe_avcdec->upump_av_work);
+    upipe_avcdec->upump_av_work = NULL;
+
+    upipe_avcdec_output_av_work(upipe, NULL);
+    upipe_avcdec_output_input(upipe);
+    upipe_avcdec_unblock_input(upipe);
+    /* Release the pipe used in @ref upipe_avcdec_start_av_work. */
+    upipe_release(upipe);
+}
+
+/** @internal @This queues the decoding of the packet of the job to the
+ * worker pool.
+ *
+ * @param upipe description structure of the pipe
+ * @return false if the packet must be decoded in place
+ */
+static bool upipe_avcdec_start_av_work(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    upipe_avcdec_check_upump_mgr(upipe);
+    if (upipe_avcdec->upump_mgr == NULL)
+        return false;
+
+    struct upump *upump_av_work =
+        upipe_av_job_upump_alloc(&upipe_avcdec->av_work,
+                                 upipe_avcdec->upump_mgr,
+                                 upipe_avcdec_cb_av_work, upipe);
+    if (unlikely(upump_av_work == NULL))
+        return false;
+    upump_start(upump_av_work);
+    if (unlikely(!upipe_av_work_start(&upipe_avcdec->av_work))) {
+        upump_free(upump_av_work);
+        return false;
+    }
+    upipe_avcdec->upump_av_work = upump_av_work;
+    /* Increment upipe refcount to avoid disappearing before the frame
+     * has been output. */
+    upipe_use(upipe);
+    return true;
+}
+
+/** @internal @This waits for the job of the worker pool, if any, and
+ * outputs its frame.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avcdec_finish_av_work(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (likely(upipe_avcdec->upump_av_work == NULL))
+        return;
+
+    if (!upipe_av_work_cancel(&upipe_avcdec->av_work))
+        upipe_avcdec_run_av_work(&upipe_avcdec->av_work);
+    upump_free(upipe_avcdec->upump_av_work);
+    upipe_avcdec->upump_av_work = NULL;
+
+    upipe_avcdec_output_av_work(upipe, NULL);
+    upipe_release(upipe);
+}
+
 /** @internal @This decodes av packets.
  *
  * @param upipe description structure of the pipe
@@ -991,15 +1382,51 @@ static bool upipe_avcdec_decode_avpkt(struct upipe *upipe, AVPacket *avpkt,
  * @param upipe description structure of the pipe
  * @param uref uref structure
  * @param upump_p reference to upump structure
- * @return always true
+ * @return false if the uref must be held until the worker pool is done with
+ * the previous packet
  */
 static bool upipe_avcdec_decode(struct upipe *upipe, struct uref *uref,
                                 struct upump **upump_p)
 {
     assert(upipe);
     assert(uref);
-
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (upipe_avcdec->upump_av_work != NULL)
+        return false;
+    bool worker = upipe_avcdec->worker &&
+                  upipe_avcdec->context->codec->type == AVMEDIA_TYPE_AUDIO;
+
+    unsigned int nb_frames;
+    if (unlikely(worker && ubase_check(uref_frames_get_nb(uref, &nb_frames)))) {
+        /* group of frames from a framer: queue them in front of the held
+         * urefs, to be decoded one by one by the worker pool */
+        for (unsigned int i = nb_frames; i > 0; i--) {
+            struct uref *frame = uref_frames_extract(uref, i - 1);
+            if (unlikely(frame == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                continue;
+            }
+            ulist_unshift(&upipe_avcdec->urefs, uref_to_uchain(frame));
+            upipe_avcdec->nb_urefs++;
+        }
+        uref_free(uref);
+        return true;
+    }
+
+    if (unlikely(ubase_check(uref_frames_get_nb(uref, &nb_frames)))) {
+        /* group of frames from a framer: decode them one by one */
+        for (unsigned int i = 0; i < nb_frames; i++) {
+            struct uref *frame = uref_frames_extract(uref, i);
+            if (unlikely(frame == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                break;
+            }
+            upipe_avcdec_decode(upipe, frame, upump_p);
+        }
+        uref_free(uref);
+        return true;
+    }
+
     AVPacket avpkt;
     memset(&avpkt, 0, sizeof(AVPacket));
     av_init_packet(&avpkt);
@@ -1037,6 +1464,16 @@ static bool upipe_avcdec_decode(struct upipe *upipe, struct uref *uref,
     uref_free(upipe_avcdec->uref);
     upipe_avcdec->uref = uref;
 
+    if (worker) {
+        upipe_avcdec->work_avpkt = avpkt;
+        if (!upipe_avcdec_start_av_work(upipe)) {
+            /* no event loop or no worker, decode in place */
+            upipe_avcdec_run_av_work(&upipe_avcdec->av_work);
+            upipe_avcdec_output_av_work(upipe, upump_p);
+        }
+        return true;
+    }
+
     upipe_avcdec_decode_avpkt(upipe, &avpkt, upump_p);
 
     free(avpkt.data);
@@ -1064,7 +1501,18 @@ static void upipe_avcdec_input(struct upipe *upipe, struct uref *uref,
         upipe_avcdec_open(upipe);
     }
 
+    if (upipe_avcdec->upump_av_work != NULL) {
+        upipe_avcdec_hold_input(upipe, uref);
+        upipe_avcdec_block_input(upipe, upump_p);
+        return;
+    }
+
     upipe_avcdec_decode(upipe, uref, upump_p);
+    if (unlikely(!upipe_avcdec_check_input(upipe))) {
+        /* frames of a group queued for the worker pool */
+        upipe_avcdec_output_input(upipe);
+        upipe_avcdec_block_input(upipe, upump_p);
+    }
 }
 
 /** @internal @This sets the input flow definition.
@@ -1203,7 +1651,8 @@ static int upipe_avcdec_set_option(struct upipe *upipe,
                                    const char *option, const char *content)
 {
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
-    if (upipe_avcdec->context == NULL || avcodec_is_open(upipe_avcdec->context))
+    if (upipe_avcdec->context == NULL || upipe_avcdec->upump_av_deal != NULL ||
+        avcodec_is_open(upipe_avcdec->context))
         return UBASE_ERR_BUSY;
     assert(option != NULL);
     if (unlikely(!upipe_avcdec_check_option(upipe, option, content))) {
@@ -1218,6 +1667,118 @@ static int upipe_avcdec_set_option(struct upipe *upipe,
                      buf);
         return UBASE_ERR_EXTERNAL;
     }
+    upipe_avcdec->options = true;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the number of decoding threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count_p filled in with the number of threads
+ * @return an error code
+ */
+static int _upipe_avcdec_get_thread_count(struct upipe *upipe,
+                                          unsigned int *thread_count_p)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    assert(thread_count_p != NULL);
+    if (upipe_avcdec->context == NULL)
+        return UBASE_ERR_INVALID;
+    *thread_count_p = upipe_avcdec->context->thread_count;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of decoding threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count number of threads (0 for automatic)
+ * @return an error code
+ */
+static int _upipe_avcdec_set_thread_count(struct upipe *upipe,
+                                          unsigned int thread_count)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (upipe_avcdec->context == NULL || upipe_avcdec->upump_av_deal != NULL ||
+        avcodec_is_open(upipe_avcdec->context))
+        return UBASE_ERR_BUSY;
+    if (unlikely(thread_count > INT_MAX))
+        return UBASE_ERR_INVALID;
+    upipe_avcdec->context->thread_count = thread_count;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the allowed types of threading.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type_p filled in with a mask of upipe_avcdec_thread_type
+ * @return an error code
+ */
+static int _upipe_avcdec_get_thread_type(struct upipe *upipe,
+                                         int *thread_type_p)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    assert(thread_type_p != NULL);
+    if (upipe_avcdec->context == NULL)
+        return UBASE_ERR_INVALID;
+    int thread_type = upipe_avcdec->context->thread_type;
+    *thread_type_p = 0;
+    if (thread_type & FF_THREAD_FRAME)
+        *thread_type_p |= UPIPE_AVCDEC_THREAD_FRAME;
+    if (thread_type & FF_THREAD_SLICE)
+        *thread_type_p |= UPIPE_AVCDEC_THREAD_SLICE;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the allowed types of threading.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type mask of upipe_avcdec_thread_type
+ * @return an error code
+ */
+static int _upipe_avcdec_set_thread_type(struct upipe *upipe, int thread_type)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (upipe_avcdec->context == NULL || upipe_avcdec->upump_av_deal != NULL ||
+        avcodec_is_open(upipe_avcdec->context))
+        return UBASE_ERR_BUSY;
+    if (unlikely(thread_type & ~(UPIPE_AVCDEC_THREAD_FRAME |
+                                 UPIPE_AVCDEC_THREAD_SLICE)))
+        return UBASE_ERR_INVALID;
+    upipe_avcdec->context->thread_type =
+        (thread_type & UPIPE_AVCDEC_THREAD_FRAME ? FF_THREAD_FRAME : 0) |
+        (thread_type & UPIPE_AVCDEC_THREAD_SLICE ? FF_THREAD_SLICE : 0);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns whether the worker pool is used.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled in with 1 if the worker pool is used
+ * @return an error code
+ */
+static int _upipe_avcdec_get_worker_pool(struct upipe *upipe, int *val_p)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    assert(val_p != NULL);
+    *val_p = upipe_avcdec->worker ? 1 : 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets whether audio packets are decoded by the worker
+ * pool.
+ *
+ * @param upipe description structure of the pipe
+ * @param worker true to use the worker pool
+ * @return an error code
+ */
+static int _upipe_avcdec_set_worker_pool(struct upipe *upipe, bool worker)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (upipe_avcdec->upump_av_deal != NULL ||
+        (upipe_avcdec->context != NULL &&
+         avcodec_is_open(upipe_avcdec->context)))
+        return UBASE_ERR_BUSY;
+    upipe_avcdec->worker = worker;
     return UBASE_ERR_NONE;
 }
 
@@ -1247,8 +1808,8 @@ static int upipe_avcdec_control(struct upipe *upipe, int command, va_list args)
             return upipe_avcdec_free_output_proxy(upipe, request);
         }
         case UPIPE_ATTACH_UPUMP_MGR:
-            upipe_avcdec_set_upump_av_deal(upipe, NULL);
             upipe_avcdec_abort_av_deal(upipe);
+            upipe_avcdec_finish_av_work(upipe);
             return upipe_avcdec_attach_upump_mgr(upipe);
 
         case UPIPE_GET_FLOW_DEF: {
@@ -1273,6 +1834,36 @@ static int upipe_avcdec_control(struct upipe *upipe, int command, va_list args)
             const char *content = va_arg(args, const char *);
             return upipe_avcdec_set_option(upipe, option, content);
         }
+        case UPIPE_AVCDEC_GET_THREAD_COUNT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            unsigned int *thread_count_p = va_arg(args, unsigned int *);
+            return _upipe_avcdec_get_thread_count(upipe, thread_count_p);
+        }
+        case UPIPE_AVCDEC_SET_THREAD_COUNT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            unsigned int thread_count = va_arg(args, unsigned int);
+            return _upipe_avcdec_set_thread_count(upipe, thread_count);
+        }
+        case UPIPE_AVCDEC_GET_THREAD_TYPE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int *thread_type_p = va_arg(args, int *);
+            return _upipe_avcdec_get_thread_type(upipe, thread_type_p);
+        }
+        case UPIPE_AVCDEC_SET_THREAD_TYPE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int thread_type = va_arg(args, int);
+            return _upipe_avcdec_set_thread_type(upipe, thread_type);
+        }
+        case UPIPE_AVCDEC_GET_WORKER_POOL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int *val_p = va_arg(args, int *);
+            return _upipe_avcdec_get_worker_pool(upipe, val_p);
+        }
+        case UPIPE_AVCDEC_SET_WORKER_POOL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int val = va_arg(args, int);
+            return _upipe_avcdec_set_worker_pool(upipe, !!val);
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -1303,6 +1894,9 @@ static void upipe_avcdec_free(struct upipe *upipe)
     upipe_avcdec_clean_flow_def_check(upipe);
     upipe_avcdec_clean_ubuf_mgr(upipe);
     upipe_avcdec_clean_upump_av_deal(upipe);
+    upipe_avcdec_clean_upump_av_work(upipe);
+    upipe_av_job_clean(&upipe_avcdec->av_job);
+    upipe_av_job_clean(&upipe_avcdec->av_work);
     upipe_avcdec_clean_upump_mgr(upipe);
     upipe_avcdec_clean_urefcount(upipe);
     upipe_avcdec_free_void(upipe);
@@ -1329,20 +1923,41 @@ static struct upipe *upipe_avcdec_alloc(struct upipe_mgr *mgr,
         av_free(frame);
         return NULL;
     }
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (unlikely(!upipe_av_job_init(&upipe_avcdec->av_job,
+                                    upipe_avcdec_run_av_deal))) {
+        upipe_avcdec_free_void(upipe);
+        av_free(frame);
+        return NULL;
+    }
+    if (unlikely(!upipe_av_job_init(&upipe_avcdec->av_work,
+                                    upipe_avcdec_run_av_work))) {
+        upipe_av_job_clean(&upipe_avcdec->av_job);
+        upipe_avcdec_free_void(upipe);
+        av_free(frame);
+        return NULL;
+    }
     upipe_avcdec_init_urefcount(upipe);
     upipe_avcdec_init_ubuf_mgr(upipe);
     upipe_avcdec_init_upump_mgr(upipe);
     upipe_avcdec_init_upump_av_deal(upipe);
+    upipe_avcdec_init_upump_av_work(upipe);
     upipe_avcdec_init_output(upipe);
     upipe_avcdec_init_flow_def(upipe);
     upipe_avcdec_init_flow_def_check(upipe);
     upipe_avcdec_init_input(upipe);
 
-    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
     upipe_avcdec->context = NULL;
     upipe_avcdec->frame = frame;
     upipe_avcdec->counter = 0;
     upipe_avcdec->close = false;
+    upipe_avcdec->options = false;
+    upipe_avcdec->thread_count = 0;
+    upipe_avcdec->thread_type = 0;
+    upipe_avcdec->worker = false;
+    memset(&upipe_avcdec->work_avpkt, 0, sizeof(AVPacket));
+    upipe_avcdec->work_gotframe = 0;
+    upipe_avcdec->work_len = 0;
     upipe_avcdec->pix_fmt = PIX_FMT_NONE;
     upipe_avcdec->sample_fmt = AV_SAMPLE_FMT_NONE;
     upipe_avcdec->uref = NULL;
@@ -1360,17 +1975,77 @@ static struct upipe *upipe_avcdec_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** module manager static descriptor */
-static struct upipe_mgr upipe_avcdec_mgr = {
-    .refcount = NULL,
-    .signature = UPIPE_AVCDEC_SIGNATURE,
+/** @internal @This closes the contexts of the pool in excess of the given
+ * number.
+ *
+ * @param avcdec_mgr pointer to the avcdec manager
+ * @param nb number of contexts to keep
+ */
+static void upipe_avcdec_mgr_trim(struct upipe_avcdec_mgr *avcdec_mgr,
+                                  unsigned int nb)
+{
+    while (avcdec_mgr->nb_warm > nb) {
+        struct uchain *uchain = avcdec_mgr->warm.prev;
+        ulist_delete(uchain);
+        struct upipe_avcdec_warm *warm =
+            upipe_avcdec_warm_from_uchain(uchain);
+        upipe_av_deal_wait();
+        avcodec_close(warm->context);
+        upipe_av_deal_release();
+        free(warm->context->extradata);
+        av_free(warm->context);
+        free(warm);
+        avcdec_mgr->nb_warm--;
+    }
+}
 
-    .upipe_alloc = upipe_avcdec_alloc,
-    .upipe_input = upipe_avcdec_input,
-    .upipe_control = upipe_avcdec_control,
+/** @This frees a upipe manager.
+ *
+ * @param urefcount pointer to urefcount structure
+ */
+static void upipe_avcdec_mgr_free(struct urefcount *urefcount)
+{
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_urefcount(urefcount);
+    upipe_avcdec_mgr_trim(avcdec_mgr, 0);
 
-    .upipe_mgr_control = NULL
-};
+    urefcount_clean(urefcount);
+    free(avcdec_mgr);
+}
+
+/** @This processes control commands on an avcdec manager.
+ *
+ * @param mgr pointer to manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_avcdec_mgr_control(struct upipe_mgr *mgr,
+                                    int command, va_list args)
+{
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_upipe_mgr(mgr);
+
+    switch (command) {
+        case UPIPE_AVCDEC_MGR_GET_POOL_DEPTH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            unsigned int *pool_depth_p = va_arg(args, unsigned int *);
+            *pool_depth_p = avcdec_mgr->pool_depth;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_AVCDEC_MGR_SET_POOL_DEPTH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            if (!urefcount_single(&avcdec_mgr->urefcount))
+                return UBASE_ERR_BUSY;
+            avcdec_mgr->pool_depth = va_arg(args, unsigned int);
+            upipe_avcdec_mgr_trim(avcdec_mgr, avcdec_mgr->pool_depth);
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
 
 /** @This returns the management structure for avcodec decoders.
  *
@@ -1378,5 +2053,22 @@ static struct upipe_mgr upipe_avcdec_mgr = {
  */
 struct upipe_mgr *upipe_avcdec_mgr_alloc(void)
 {
-    return &upipe_avcdec_mgr;
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        malloc(sizeof(struct upipe_avcdec_mgr));
+    if (unlikely(avcdec_mgr == NULL))
+        return NULL;
+
+    avcdec_mgr->pool_depth = 0;
+    avcdec_mgr->nb_warm = 0;
+    ulist_init(&avcdec_mgr->warm);
+
+    urefcount_init(upipe_avcdec_mgr_to_urefcount(avcdec_mgr),
+                   upipe_avcdec_mgr_free);
+    avcdec_mgr->mgr.refcount = upipe_avcdec_mgr_to_urefcount(avcdec_mgr);
+    avcdec_mgr->mgr.signature = UPIPE_AVCDEC_SIGNATURE;
+    avcdec_mgr->mgr.upipe_alloc = upipe_avcdec_alloc;
+    avcdec_mgr->mgr.upipe_input = upipe_avcdec_input;
+    avcdec_mgr->mgr.upipe_control = upipe_avcdec_control;
+    avcdec_mgr->mgr.upipe_mgr_control = upipe_avcdec_mgr_control;
+    return upipe_avcdec_mgr_to_upipe_mgr(avcdec_mgr);
 }
@@ -62,8 +62,10 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <errno.h>
+#include <math.h>
 #include <assert.h>
 
 #include <libavcodec/avcodec.h>
@@ -72,9 +74,12 @@
 #include <libavutil/opt.h>
 #include <upipe-av/upipe_av_pixfmt.h>
 #include <upipe-av/upipe_av_samplefmt.h>
+#include <upipe-av/ubuf_block_av.h>
 #include "upipe_av_internal.h"
 
 #define PREFIX_FLOW "block."
+/** depth of the pools of the manager wrapping encoded packets */
+#define UBUF_AV_POOL_DEPTH 8
 
 UREF_ATTR_INT(avcenc, priv, "x.avcenc_priv", avcenc private pts)
 
@@ -122,6 +127,8 @@ struct upipe_avcenc {
     struct uref *flow_format;
     /** ubuf manager request */
     struct urequest ubuf_mgr_request;
+    /** ubuf manager wrapping encoded packets */
+    struct ubuf_mgr *ubuf_av_mgr;
 
     /** upump mgr */
     struct upump_mgr *upump_mgr;
@@ -137,6 +144,21 @@ struct upipe_avcenc {
     /** list of blockers (used during udeal) */
     struct uchain blockers;
 
+    /** true if audio frames are encoded by the worker pool */
+    bool worker;
+    /** job encoding a frame in the worker pool */
+    struct upipe_av_job av_work;
+    /** watcher on the completion of the encoding job */
+    struct upump *upump_av_work;
+    /** packet returned by the encoder in the job */
+    AVPacket work_avpkt;
+    /** samples of the frame encoded by the job */
+    uint8_t *work_buf;
+    /** set by the job if a packet was returned */
+    int work_gotframe;
+    /** value returned by avcodec_encode_audio2() in the job */
+    int work_err;
+
     /** temporary uref storage (used for sound processing) */
     struct uchain sound_urefs;
     /** nb samples in storage */
@@ -160,12 +182,20 @@ struct upipe_avcenc {
     AVFrame *frame;
     /** true if the context will be closed */
     bool close;
+    /** true if the encoder is tuned for low delay */
+    bool low_delay;
+    /** sum of the products of the frame sizes by the quantizer steps in the
+     * current group of pictures */
+    double gop_complexity;
+    /** number of frames in the current group of pictures */
+    unsigned int gop_frames;
 
     /** public upipe structure */
     struct upipe upipe;
 };
 
 UPIPE_HELPER_UPIPE(upipe_avcenc, upipe, UPIPE_AVCENC_SIGNATURE);
+UBASE_FROM_TO(upipe_avcenc, upipe_av_job, av_work, av_work)
 UPIPE_HELPER_UREFCOUNT(upipe_avcenc, urefcount, upipe_avcenc_close)
 UPIPE_HELPER_FLOW(upipe_avcenc, "block.")
 UPIPE_HELPER_OUTPUT(upipe_avcenc, output, flow_def, output_state, request_list)
@@ -178,6 +208,7 @@ UPIPE_HELPER_UBUF_MGR(upipe_avcenc, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_avcenc_unregister_output_request)
 UPIPE_HELPER_UPUMP_MGR(upipe_avcenc, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_avcenc, upump_av_deal, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_avcenc, upump_av_work, upump_mgr)
 UPIPE_HELPER_INPUT(upipe_avcenc, urefs, nb_urefs, max_urefs, blockers, upipe_avcenc_encode)
 
 /** @hidden */
@@ -349,6 +380,8 @@ static void upipe_avcenc_close(struct upipe *upipe)
     }
 
     if (avcodec_is_open(context)) {
+        /* the remaining frames are encoded in place */
+        upipe_avcenc->worker = false;
         if (!ulist_empty(&upipe_avcenc->sound_urefs))
             /* Feed avcodec with the last incomplete uref (sound only). */
             upipe_avcenc_encode_audio(upipe, NULL);
@@ -362,58 +395,79 @@ static void upipe_avcenc_close(struct upipe *upipe)
     upipe_avcenc_start_av_deal(upipe);
 }
 
-/** @internal @This encodes av frames.
+/** @internal @This accounts for a coded picture in the complexity of the
+ * current group of pictures, after reporting the complexity of the previous
+ * group on random access points.
  *
  * @param upipe description structure of the pipe
- * @param frame frame
+ * @param avpkt coded picture
+ */
+static void upipe_avcenc_update_complexity(struct upipe *upipe,
+                                           const AVPacket *avpkt)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcenc->context;
+
+    if ((avpkt->flags & AV_PKT_FLAG_KEY) ||
+        (context->gop_size > 0 &&
+         upipe_avcenc->gop_frames >= (unsigned int)context->gop_size)) {
+        struct urational fps;
+        if (upipe_avcenc->gop_frames &&
+            ubase_check(uref_pic_flow_get_fps(upipe_avcenc->flow_def_input,
+                                              &fps)) && fps.den)
+            upipe_throw_encoder_complexity(upipe,
+                    upipe_avcenc->gop_complexity * fps.num /
+                    (fps.den * upipe_avcenc->gop_frames));
+        upipe_avcenc->gop_complexity = 0;
+        upipe_avcenc->gop_frames = 0;
+    }
+
+    double qstep = 1.;
+    if (context->coded_frame != NULL && context->coded_frame->quality > 0) {
+        double qp = (double)context->coded_frame->quality / FF_QP2LAMBDA;
+        /* H.264 and HEVC quantizers are logarithmic, with a unit step at
+         * QP 4, the others are linear */
+        if (context->codec_id == AV_CODEC_ID_H264 ||
+            context->codec_id == AV_CODEC_ID_HEVC)
+            qstep = exp2((qp - 4) / 6);
+        else
+            qstep = qp;
+    }
+    upipe_avcenc->gop_complexity += avpkt->size * qstep;
+    upipe_avcenc->gop_frames++;
+}
+
+/** @internal @This outputs a packet returned by the encoder.
+ *
+ * @param upipe description structure of the pipe
+ * @param avpkt encoded packet
+ * @param err value returned by the encoder
+ * @param gotframe set by the encoder if a packet was returned
  * @param upump_p reference to upump structure
  * @return true when a packet has been output
  */
-static bool upipe_avcenc_encode_frame(struct upipe *upipe,
-                                      struct AVFrame *frame,
+static bool upipe_avcenc_output_avpkt(struct upipe *upipe, AVPacket *avpkt,
+                                      int err, int gotframe,
                                       struct upump **upump_p)
 {
     struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
     AVCodecContext *context = upipe_avcenc->context;
     const AVCodec *codec = context->codec;
 
-    if (unlikely(frame == NULL))
-        upipe_dbg(upipe, "received null frame");
-
-    /* encode frame */
-    AVPacket avpkt;
-    av_init_packet(&avpkt);
-    avpkt.data = NULL;
-    avpkt.size = 0;
-    int gotframe = 0;
-    int err;
-    switch (codec->type) {
-        case AVMEDIA_TYPE_VIDEO: {
-            err = avcodec_encode_video2(context, &avpkt, frame, &gotframe);
-            break;
-        }
-        case AVMEDIA_TYPE_AUDIO: {
-            err = avcodec_encode_audio2(context, &avpkt, frame, &gotframe);
-            break;
-        }
-        default: /* should never be there */
-            return false;
-    }
-
     if (err < 0) {
         upipe_av_strerror(err, buf);
         upipe_warn_va(upipe, "error while encoding frame (%s)", buf);
         return false;
     }
     /* output encoded frame if available */
-    if (!(gotframe && avpkt.data)) {
+    if (!(gotframe && avpkt->data)) {
         return false;
     }
 
     /* flow definition */
     struct uref *flow_def_attr = upipe_avcenc_alloc_flow_def_attr(upipe);
     if (unlikely(flow_def_attr == NULL)) {
-        av_free_packet(&avpkt);
+        av_free_packet(avpkt);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return false;
     }
@@ -436,25 +490,30 @@ static bool upipe_avcenc_encode_frame(struct upipe *upipe,
             uref_sound_flow_set_samples(flow_def_attr, context->frame_size);
         }
     }
-    if (context->delay) {
+    /* frame threads each hold one more frame */
+    uint64_t delay = context->delay;
+    if ((context->active_thread_type & FF_THREAD_FRAME) &&
+        context->thread_count > 1)
+        delay += context->thread_count - 1;
+    if (delay) {
         struct urational fps;
         uint64_t rate;
         if (ubase_check(uref_pic_flow_get_fps(upipe_avcenc->flow_def_input,
                                               &fps))) {
             UBASE_FATAL(upipe, uref_clock_set_latency(flow_def_attr,
                     upipe_avcenc->input_latency +
-                    context->delay * UCLOCK_FREQ * fps.den / fps.num));
+                    delay * UCLOCK_FREQ * fps.den / fps.num));
         } else if (ubase_check(uref_sound_flow_get_rate(
                         upipe_avcenc->flow_def_input, &rate))) {
             UBASE_FATAL(upipe, uref_clock_set_latency(flow_def_attr,
                     upipe_avcenc->input_latency +
-                    context->delay * UCLOCK_FREQ / rate));
+                    delay * UCLOCK_FREQ / rate));
         }
     }
 
     if (unlikely(upipe_avcenc->ubuf_mgr == NULL)) {
         if (unlikely(!upipe_avcenc_demand_ubuf_mgr(upipe, flow_def_attr))) {
-            av_free_packet(&avpkt);
+            av_free_packet(avpkt);
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             return false;
         }
@@ -474,34 +533,31 @@ static bool upipe_avcenc_encode_frame(struct upipe *upipe,
     } else
         uref_free(flow_def_attr);
 
-    struct ubuf *ubuf = ubuf_block_alloc(upipe_avcenc->ubuf_mgr, avpkt.size);
-    if (unlikely(ubuf == NULL)) {
-        av_free_packet(&avpkt);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return false;
-    }
+    if (codec->type == AVMEDIA_TYPE_VIDEO)
+        upipe_avcenc_update_complexity(upipe, avpkt);
 
-    int size = -1;
-    uint8_t *buf;
-    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &size, &buf)))) {
-        ubuf_free(ubuf);
-        av_free_packet(&avpkt);
+    /* wrap the packet, the fields used below remain valid */
+    int64_t pts = avpkt->pts, dts = avpkt->dts;
+    int flags = avpkt->flags;
+    struct ubuf *ubuf = ubuf_block_av_alloc(upipe_avcenc->ubuf_av_mgr, avpkt);
+    if (unlikely(ubuf == NULL)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return false;
     }
-    memcpy(buf, avpkt.data, size);
-    ubuf_block_unmap(ubuf, 0);
-    av_free_packet(&avpkt);
+    avpkt->pts = pts;
+    avpkt->dts = dts;
+    avpkt->flags = flags;
 
     /* find uref corresponding to avpkt */
-    upipe_verbose_va(upipe, "output pts %"PRId64, avpkt.pts);
+    upipe_verbose_va(upipe, "output pts %"PRId64, avpkt->pts);
     struct uchain *uchain;
     struct uchain *uchain_tmp;
     struct uref *uref = NULL;
     ulist_delete_foreach (&upipe_avcenc->urefs_in_use, uchain, uchain_tmp) {
         struct uref *uref_chain = uref_from_uchain(uchain);
         int64_t priv = 0;
-        if (ubase_check(uref_avcenc_get_priv(uref_chain, &priv)) && priv == avpkt.pts) {
+        if (ubase_check(uref_avcenc_get_priv(uref_chain, &priv)) &&
+            priv == avpkt->pts) {
             uref = uref_chain;
             ulist_delete(uchain);
             break;
@@ -509,7 +565,7 @@ static bool upipe_avcenc_encode_frame(struct upipe *upipe,
     }
     if (unlikely(uref == NULL)) {
         upipe_warn_va(upipe, "could not find pts %"PRId64" in urefs in use",
-                      avpkt.pts);
+                      avpkt->pts);
         ubuf_free(ubuf);
         return false;
     }
@@ -535,7 +591,7 @@ static bool upipe_avcenc_encode_frame(struct upipe *upipe,
     uref_avcenc_delete_priv(uref);
 
     /* set dts */
-    uint64_t dts_pts_delay = (uint64_t)(avpkt.pts - avpkt.dts) * UCLOCK_FREQ
+    uint64_t dts_pts_delay = (uint64_t)(avpkt->pts - avpkt->dts) * UCLOCK_FREQ
                               * context->time_base.num
                               / context->time_base.den;
     uref_clock_set_dts_pts_delay(uref, dts_pts_delay);
@@ -546,13 +602,167 @@ static bool upipe_avcenc_encode_frame(struct upipe *upipe,
     uref_clock_rebase_dts_prog(uref);
     uref_clock_rebase_dts_orig(uref);
 
-    if (avpkt.flags & AV_PKT_FLAG_KEY)
+    if (avpkt->flags & AV_PKT_FLAG_KEY)
         uref_flow_set_random(uref);
 
     upipe_avcenc_output(upipe, uref, upump_p);
     return true;
 }
 
+/** @internal @This encodes av frames.
+ *
+ * @param upipe description structure of the pipe
+ * @param frame frame
+ * @param upump_p reference to upump structure
+ * @return true when a packet has been output
+ */
+static bool upipe_avcenc_encode_frame(struct upipe *upipe,
+                                      struct AVFrame *frame,
+                                      struct upump **upump_p)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcenc->context;
+    const AVCodec *codec = context->codec;
+
+    if (unlikely(frame == NULL))
+        upipe_dbg(upipe, "received null frame");
+
+    /* encode frame */
+    AVPacket avpkt;
+    av_init_packet(&avpkt);
+    avpkt.data = NULL;
+    avpkt.size = 0;
+    int gotframe = 0;
+    int err;
+    switch (codec->type) {
+        case AVMEDIA_TYPE_VIDEO: {
+            err = avcodec_encode_video2(context, &avpkt, frame, &gotframe);
+            break;
+        }
+        case AVMEDIA_TYPE_AUDIO: {
+            err = avcodec_encode_audio2(context, &avpkt, frame, &gotframe);
+            break;
+        }
+        default: /* should never be there */
+            return false;
+    }
+
+    return upipe_avcenc_output_avpkt(upipe, &avpkt, err, gotframe, upump_p);
+}
+
+/** @internal @This is called by the worker pool to encode the frame of the
+ * job. It must not throw events.
+ *
+ * @param job description structure of the job
+ */
+static void upipe_avcenc_run_av_work(struct upipe_av_job *job)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_av_work(job);
+    AVPacket *avpkt = &upipe_avcenc->work_avpkt;
+    av_init_packet(avpkt);
+    avpkt->data = NULL;
+    avpkt->size = 0;
+    upipe_avcenc->work_gotframe = 0;
+    upipe_avcenc->work_err = avcodec_encode_audio2(upipe_avcenc->context,
+            avpkt, upipe_avcenc->frame, &upipe_avcenc->work_gotframe);
+}
+
+/** @internal @This outputs the packet encoded by the job, in the thread of
+ * the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to upump structure
+ */
+static void upipe_avcenc_output_av_work(struct upipe *upipe,
+                                        struct upump **upump_p)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    free(upipe_avcenc->work_buf);
+    upipe_avcenc->work_buf = NULL;
+    upipe_avcenc_output_avpkt(upipe, &upipe_avcenc->work_avpkt,
+                              upipe_avcenc->work_err,
+                              upipe_avcenc->work_gotframe, upump_p);
+}
+
+/** @internal @This is called when the worker pool is done with a frame.
+ *
+ * @param upump description structure of the pump
+ */
+static void upipe_avcenc_cb_av_work(struct upump *upump)
+{
+    assert(upump);
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+
+    if (unlikely(!upipe_av_work_done(&upipe_avcenc->av_work)))
+        return;
+
+    upump_free(upipe_avcenc->upump_av_work);
+    upipe_avcenc->upump_av_work = NULL;
+
+    upipe_avcenc_output_av_work(upipe, NULL);
+    while (upipe_avcenc->upump_av_work == NULL &&
+           upipe_avcenc->nb_samples >= upipe_avcenc->context->frame_size)
+        upipe_avcenc_encode_audio(upipe, NULL);
+    upipe_avcenc_output_input(upipe);
+    upipe_avcenc_unblock_input(upipe);
+    /* Release the pipe used in @ref upipe_avcenc_start_av_work. */
+    upipe_release(upipe);
+}
+
+/** @internal @This queues the encoding of the current frame to the worker
+ * pool.
+ *
+ * @param upipe description structure of the pipe
+ * @param buf samples of the frame, freed when the job is done
+ * @return false if the frame must be encoded in place
+ */
+static bool upipe_avcenc_start_av_work(struct upipe *upipe, uint8_t *buf)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    upipe_avcenc_check_upump_mgr(upipe);
+    if (upipe_avcenc->upump_mgr == NULL)
+        return false;
+
+    struct upump *upump_av_work =
+        upipe_av_job_upump_alloc(&upipe_avcenc->av_work,
+                                 upipe_avcenc->upump_mgr,
+                                 upipe_avcenc_cb_av_work, upipe);
+    if (unlikely(upump_av_work == NULL))
+        return false;
+    upump_start(upump_av_work);
+    if (unlikely(!upipe_av_work_start(&upipe_avcenc->av_work))) {
+        upump_free(upump_av_work);
+        return false;
+    }
+    upipe_avcenc->upump_av_work = upump_av_work;
+    upipe_avcenc->work_buf = buf;
+    /* Increment upipe refcount to avoid disappearing before the packet
+     * has been output. */
+    upipe_use(upipe);
+    return true;
+}
+
+/** @internal @This waits for the job of the worker pool, if any, and
+ * outputs its packet.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avcenc_finish_av_work(struct upipe *upipe)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    if (likely(upipe_avcenc->upump_av_work == NULL))
+        return;
+
+    if (!upipe_av_work_cancel(&upipe_avcenc->av_work))
+        upipe_avcenc_run_av_work(&upipe_avcenc->av_work);
+    upump_free(upipe_avcenc->upump_av_work);
+    upipe_avcenc->upump_av_work = NULL;
+
+    upipe_avcenc_output_av_work(upipe, NULL);
+    upipe_release(upipe);
+}
+
 /** @internal @This encodes video frames.
  *
  * @param upipe description structure of the pipe
@@ -710,6 +920,8 @@ static void upipe_avcenc_encode_audio(struct upipe *upipe,
 
     /* store uref in mapping list */
     ulist_add(&upipe_avcenc->urefs_in_use, uref_to_uchain(main_uref));
+    if (upipe_avcenc->worker && upipe_avcenc_start_av_work(upipe, buf))
+        return;
     upipe_avcenc_encode_frame(upipe, frame, upump_p);
     free(buf);
 }
@@ -719,13 +931,16 @@ static void upipe_avcenc_encode_audio(struct upipe *upipe,
  * @param upipe description structure of the pipe
  * @param uref uref structure
  * @param upump_p reference to upump structure
- * @return always true
+ * @return false if the uref must be held until the worker pool is done with
+ * the previous frame
  */
 static bool upipe_avcenc_encode(struct upipe *upipe,
                                 struct uref *uref, struct upump **upump_p)
 {
     struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
     AVCodecContext *context = upipe_avcenc->context;
+    if (upipe_avcenc->upump_av_work != NULL)
+        return false;
 
     /* map input */
     switch (context->codec->type) {
@@ -744,7 +959,8 @@ static bool upipe_avcenc_encode(struct upipe *upipe,
             ulist_add(&upipe_avcenc->sound_urefs, uref_to_uchain(uref));
             upipe_avcenc->nb_samples += size;
 
-            while (upipe_avcenc->nb_samples >= context->frame_size)
+            while (upipe_avcenc->upump_av_work == NULL &&
+                   upipe_avcenc->nb_samples >= context->frame_size)
                 upipe_avcenc_encode_audio(upipe, upump_p);
             break;
         }
@@ -776,6 +992,12 @@ static void upipe_avcenc_input(struct upipe *upipe, struct uref *uref,
         upipe_avcenc_open(upipe);
     }
 
+    if (upipe_avcenc->upump_av_work != NULL) {
+        upipe_avcenc_hold_input(upipe, uref);
+        upipe_avcenc_block_input(upipe, upump_p);
+        return;
+    }
+
     upipe_avcenc_encode(upipe, uref, upump_p);
 }
 
@@ -1167,6 +1389,200 @@ static int upipe_avcenc_set_option(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the number of encoding threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count_p filled in with the number of threads
+ * @return an error code
+ */
+static int _upipe_avcenc_get_thread_count(struct upipe *upipe,
+                                          unsigned int *thread_count_p)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    assert(thread_count_p != NULL);
+    *thread_count_p = upipe_avcenc->context->thread_count;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of encoding threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_count number of threads (0 for automatic)
+ * @return an error code
+ */
+static int _upipe_avcenc_set_thread_count(struct upipe *upipe,
+                                          unsigned int thread_count)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    if (upipe_avcenc->upump_av_deal != NULL ||
+        avcodec_is_open(upipe_avcenc->context))
+        return UBASE_ERR_BUSY;
+    if (unlikely(thread_count > INT_MAX))
+        return UBASE_ERR_INVALID;
+    upipe_avcenc->context->thread_count = thread_count;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the allowed types of threading.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type_p filled in with a mask of upipe_avcenc_thread_type
+ * @return an error code
+ */
+static int _upipe_avcenc_get_thread_type(struct upipe *upipe,
+                                         int *thread_type_p)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    assert(thread_type_p != NULL);
+    int thread_type = upipe_avcenc->context->thread_type;
+    *thread_type_p = 0;
+    if (thread_type & FF_THREAD_FRAME)
+        *thread_type_p |= UPIPE_AVCENC_THREAD_FRAME;
+    if (thread_type & FF_THREAD_SLICE)
+        *thread_type_p |= UPIPE_AVCENC_THREAD_SLICE;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the allowed types of threading.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type mask of upipe_avcenc_thread_type
+ * @return an error code
+ */
+static int _upipe_avcenc_set_thread_type(struct upipe *upipe, int thread_type)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    if (upipe_avcenc->upump_av_deal != NULL ||
+        avcodec_is_open(upipe_avcenc->context))
+        return UBASE_ERR_BUSY;
+    if (unlikely(thread_type & ~(UPIPE_AVCENC_THREAD_FRAME |
+                                 UPIPE_AVCENC_THREAD_SLICE)))
+        return UBASE_ERR_INVALID;
+    upipe_avcenc->context->thread_type =
+        (thread_type & UPIPE_AVCENC_THREAD_FRAME ? FF_THREAD_FRAME : 0) |
+        (thread_type & UPIPE_AVCENC_THREAD_SLICE ? FF_THREAD_SLICE : 0);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the low-delay mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled in with 1 if the mode is enabled
+ * @return an error code
+ */
+static int _upipe_avcenc_get_low_delay(struct upipe *upipe, int *val_p)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    assert(val_p != NULL);
+    *val_p = upipe_avcenc->low_delay ? 1 : 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the low-delay mode. B-frames and frame threading
+ * are disabled, and the private options of encoders supporting it are
+ * tuned for zero latency.
+ *
+ * @param upipe description structure of the pipe
+ * @param low_delay true for low-delay mode
+ * @return an error code
+ */
+static int _upipe_avcenc_set_low_delay(struct upipe *upipe, bool low_delay)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcenc->context;
+    if (upipe_avcenc->upump_av_deal != NULL || avcodec_is_open(context))
+        return UBASE_ERR_BUSY;
+    upipe_avcenc->low_delay = low_delay;
+    if (!low_delay) {
+        context->flags &= ~CODEC_FLAG_LOW_DELAY;
+        return UBASE_ERR_NONE;
+    }
+
+    context->flags |= CODEC_FLAG_LOW_DELAY;
+    context->max_b_frames = 0;
+    context->thread_type &= ~FF_THREAD_FRAME;
+    if (!context->thread_type)
+        context->thread_type = FF_THREAD_SLICE;
+    /* these are private options, not all encoders have them */
+    av_opt_set(context, "tune", "zerolatency", AV_OPT_SEARCH_CHILDREN);
+    av_opt_set(context, "rc-lookahead", "0", AV_OPT_SEARCH_CHILDREN);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns whether the worker pool is used.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled in with 1 if the worker pool is used
+ * @return an error code
+ */
+static int _upipe_avcenc_get_worker_pool(struct upipe *upipe, int *val_p)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    assert(val_p != NULL);
+    *val_p = upipe_avcenc->worker ? 1 : 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets whether audio frames are encoded by the worker pool.
+ *
+ * @param upipe description structure of the pipe
+ * @param worker true to use the worker pool
+ * @return an error code
+ */
+static int _upipe_avcenc_set_worker_pool(struct upipe *upipe, bool worker)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    if (upipe_avcenc->upump_av_deal != NULL ||
+        avcodec_is_open(upipe_avcenc->context))
+        return UBASE_ERR_BUSY;
+    upipe_avcenc->worker = worker &&
+        upipe_avcenc->context->codec->type == AVMEDIA_TYPE_AUDIO;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the target octetrate of the rate control.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate_p filled in with the octetrate
+ * @return an error code
+ */
+static int upipe_avcenc_get_octetrate(struct upipe *upipe,
+                                      uint64_t *octetrate_p)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    assert(octetrate_p != NULL);
+    *octetrate_p = upipe_avcenc->context->bit_rate / 8;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This changes the target octetrate of the rate control. In CBR
+ * mode, the max and min rates follow; otherwise the max rate caps the
+ * target. It applies while encoding to the codecs reading the rate control
+ * parameters of the context on each frame, such as libx264, and the output
+ * flow definition keeps the octetrate of the first frame.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate new octetrate
+ * @return an error code
+ */
+static int upipe_avcenc_set_octetrate(struct upipe *upipe, uint64_t octetrate)
+{
+    struct upipe_avcenc *upipe_avcenc = upipe_avcenc_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcenc->context;
+    if (unlikely(!octetrate || octetrate > INT_MAX / 8))
+        return UBASE_ERR_INVALID;
+
+    int bit_rate = octetrate * 8;
+    if (context->rc_max_rate == context->bit_rate) {
+        context->rc_max_rate = bit_rate;
+        if (context->rc_min_rate == context->bit_rate)
+            context->rc_min_rate = bit_rate;
+    } else if (context->rc_max_rate && bit_rate > context->rc_max_rate)
+        bit_rate = context->rc_max_rate;
+    context->bit_rate = bit_rate;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a file source pipe, and
  * checks the status of the pipe afterwards.
  *
@@ -1197,6 +1613,7 @@ static int upipe_avcenc_control(struct upipe *upipe,
         case UPIPE_ATTACH_UPUMP_MGR:
             upipe_avcenc_set_upump_av_deal(upipe, NULL);
             upipe_avcenc_abort_av_deal(upipe);
+            upipe_avcenc_finish_av_work(upipe);
             return upipe_avcenc_attach_upump_mgr(upipe);
 
         case UPIPE_GET_FLOW_DEF: {
@@ -1221,6 +1638,54 @@ static int upipe_avcenc_control(struct upipe *upipe,
             const char *content = va_arg(args, const char *);
             return upipe_avcenc_set_option(upipe, option, content);
         }
+        case UPIPE_AVCENC_GET_THREAD_COUNT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            unsigned int *thread_count_p = va_arg(args, unsigned int *);
+            return _upipe_avcenc_get_thread_count(upipe, thread_count_p);
+        }
+        case UPIPE_AVCENC_SET_THREAD_COUNT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            unsigned int thread_count = va_arg(args, unsigned int);
+            return _upipe_avcenc_set_thread_count(upipe, thread_count);
+        }
+        case UPIPE_AVCENC_GET_THREAD_TYPE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            int *thread_type_p = va_arg(args, int *);
+            return _upipe_avcenc_get_thread_type(upipe, thread_type_p);
+        }
+        case UPIPE_AVCENC_SET_THREAD_TYPE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            int thread_type = va_arg(args, int);
+            return _upipe_avcenc_set_thread_type(upipe, thread_type);
+        }
+        case UPIPE_AVCENC_GET_LOW_DELAY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            int *val_p = va_arg(args, int *);
+            return _upipe_avcenc_get_low_delay(upipe, val_p);
+        }
+        case UPIPE_AVCENC_SET_LOW_DELAY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            int val = va_arg(args, int);
+            return _upipe_avcenc_set_low_delay(upipe, !!val);
+        }
+        case UPIPE_AVCENC_GET_WORKER_POOL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            int *val_p = va_arg(args, int *);
+            return _upipe_avcenc_get_worker_pool(upipe, val_p);
+        }
+        case UPIPE_AVCENC_SET_WORKER_POOL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCENC_SIGNATURE)
+            int val = va_arg(args, int);
+            return _upipe_avcenc_set_worker_pool(upipe, !!val);
+        }
+        case UPIPE_ENCODER_GET_OCTETRATE: {
+            uint64_t *octetrate_p = va_arg(args, uint64_t *);
+            return upipe_avcenc_get_octetrate(upipe, octetrate_p);
+        }
+        case UPIPE_ENCODER_SET_OCTETRATE: {
+            uint64_t octetrate = va_arg(args, uint64_t);
+            return upipe_avcenc_set_octetrate(upipe, octetrate);
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -1254,7 +1719,10 @@ static void upipe_avcenc_free(struct upipe *upipe)
     upipe_avcenc_abort_av_deal(upipe);
     upipe_avcenc_clean_input(upipe);
     upipe_avcenc_clean_ubuf_mgr(upipe);
+    ubuf_mgr_release(upipe_avcenc->ubuf_av_mgr);
     upipe_avcenc_clean_upump_av_deal(upipe);
+    upipe_avcenc_clean_upump_av_work(upipe);
+    upipe_av_job_clean(&upipe_avcenc->av_work);
     upipe_avcenc_clean_upump_mgr(upipe);
     upipe_avcenc_clean_output(upipe);
     upipe_avcenc_clean_flow_def(upipe);
@@ -1308,6 +1776,26 @@ static struct upipe *upipe_avcenc_alloc(struct upipe_mgr *mgr,
         return NULL;
     }
 
+    upipe_avcenc->ubuf_av_mgr = ubuf_block_av_mgr_alloc(UBUF_AV_POOL_DEPTH,
+                                                        UBUF_AV_POOL_DEPTH);
+    if (unlikely(upipe_avcenc->ubuf_av_mgr == NULL)) {
+        av_free(upipe_avcenc->context);
+        uref_free(flow_def);
+        av_free(frame);
+        upipe_avcenc_free_flow(upipe);
+        return NULL;
+    }
+
+    if (unlikely(!upipe_av_job_init(&upipe_avcenc->av_work,
+                                    upipe_avcenc_run_av_work))) {
+        ubuf_mgr_release(upipe_avcenc->ubuf_av_mgr);
+        av_free(upipe_avcenc->context);
+        uref_free(flow_def);
+        av_free(frame);
+        upipe_avcenc_free_flow(upipe);
+        return NULL;
+    }
+
     uref_free(flow_def);
     upipe_avcenc->frame = frame;
     upipe_avcenc->context->codec = codec;
@@ -1317,12 +1805,20 @@ static struct upipe *upipe_avcenc_alloc(struct upipe_mgr *mgr,
     upipe_avcenc_init_ubuf_mgr(upipe);
     upipe_avcenc_init_upump_mgr(upipe);
     upipe_avcenc_init_upump_av_deal(upipe);
+    upipe_avcenc_init_upump_av_work(upipe);
     upipe_avcenc_init_output(upipe);
     upipe_avcenc_init_flow_def(upipe);
     upipe_avcenc_init_flow_def_check(upipe);
     upipe_avcenc_init_input(upipe);
 
     upipe_avcenc->flow_def_provided = NULL;
+    upipe_avcenc->low_delay = false;
+    upipe_avcenc->worker = false;
+    upipe_avcenc->work_buf = NULL;
+    upipe_avcenc->work_gotframe = 0;
+    upipe_avcenc->work_err = 0;
+    upipe_avcenc->gop_complexity = 0;
+    upipe_avcenc->gop_frames = 0;
     ulist_init(&upipe_avcenc->sound_urefs);
     upipe_avcenc->nb_samples = 0;
 
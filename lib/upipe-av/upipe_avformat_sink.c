@@ -29,6 +29,7 @@
 
 #include <upipe/ubase.h>
 #include <upipe/ulist.h>
+#include <upipe/upool.h>
 #include <upipe/uprobe.h>
 #include <upipe/uclock.h>
 #include <upipe/uref.h>
@@ -61,10 +62,64 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/dict.h>
 #include <libavformat/avformat.h>
 
+/** depth of the pool of packets waiting to be written */
+#define UPIPE_AVFSINK_PKT_POOL_DEPTH 32
+
+/** @internal @This is a packet waiting to be written. */
+struct upipe_avfsink_pkt {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** uref mapped by the packet, or NULL if the data was copied */
+    struct uref *uref;
+    /** libavformat packet */
+    AVPacket avpkt;
+};
+
+UBASE_FROM_TO(upipe_avfsink_pkt, uchain, uchain, uchain)
+
+/** @internal @This is the context of the thread writing packets behind the
+ * pipeline. */
+struct upipe_avfsink_writer {
+    /** avformat context the thread writes to */
+    AVFormatContext *context;
+    /** options given to the muxer, then options it didn't recognize */
+    AVDictionary *options;
+    /** helper thread */
+    pthread_t thread;
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** condition signalled when packets are queued or on exit */
+    pthread_cond_t cond;
+    /** condition signalled when the queue drains or on error */
+    pthread_cond_t drained;
+    /** list of packets to write */
+    struct uchain packets;
+    /** octets currently in the queue */
+    uint64_t octets;
+    /** maximum number of octets in the queue */
+    uint64_t max_octets;
+    /** true if the header was written */
+    bool opened;
+    /** error returned by avformat, or 0 */
+    int error;
+    /** set to true to ask the thread to exit */
+    bool exit;
+    /** true if the error was already reported (pipeline thread only) */
+    bool reported;
+
+    /** pool of packet structures */
+    struct upool pkt_pool;
+    /** extra space for upool */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(upipe_avfsink_writer, upool, pkt_pool, pkt_pool)
+
 /** @internal @This is the private context of an avformat source pipe. */
 struct upipe_avfsink {
     /** refcount management structure */
@@ -92,6 +147,10 @@ struct upipe_avfsink {
     uint64_t first_dts;
     /** highest DTS */
     uint64_t highest_next_dts;
+    /** maximum number of octets queued to the writer, for the next URI */
+    uint64_t write_queue;
+    /** writer thread context, or NULL if writing on the pipeline thread */
+    struct upipe_avfsink_writer *writer;
 
     /** manager to create subs */
     struct upipe_mgr sub_mgr;
@@ -469,6 +528,8 @@ static struct upipe *upipe_avfsink_alloc(struct upipe_mgr *mgr,
     upipe_avfsink->ts_offset = 0;
     upipe_avfsink->first_dts = 0;
     upipe_avfsink->highest_next_dts = 0;
+    upipe_avfsink->write_queue = 0;
+    upipe_avfsink->writer = NULL;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -501,6 +562,311 @@ static struct upipe_avfsink_sub *upipe_avfsink_find_input(struct upipe *upipe)
     return earliest_input;
 }
 
+/** @internal @This opens the output and writes the header.
+ *
+ * @param context avformat context
+ * @param options_p pointer to the options given to the muxer, filled in with
+ * the options it didn't recognize
+ * @return an avformat error code
+ */
+static int upipe_avfsink_open_context(AVFormatContext *context,
+                                      AVDictionary **options_p)
+{
+    if (!(context->oformat->flags & AVFMT_NOFILE)) {
+        int error = avio_open(&context->pb, context->filename,
+                              AVIO_FLAG_WRITE);
+        if (error < 0)
+            return error;
+    }
+
+    int error = avformat_write_header(context, options_p);
+    if (unlikely(error < 0) && !(context->oformat->flags & AVFMT_NOFILE))
+        avio_close(context->pb);
+    return error;
+}
+
+/** @internal @This writes the trailer and closes the output.
+ *
+ * @param context avformat context
+ */
+static void upipe_avfsink_close_context(AVFormatContext *context)
+{
+    av_write_trailer(context);
+    if (!(context->oformat->flags & AVFMT_NOFILE))
+        avio_close(context->pb);
+}
+
+/** @internal @This points the data of a packet to the block of a uref.
+ * The block is mapped in place if it is contiguous, in which case the packet
+ * keeps the uref until it is written; otherwise it is copied and the uref is
+ * freed.
+ *
+ * @param pkt packet to fill
+ * @param uref uref carrying the block
+ * @param size size of the block
+ * @return false in case of allocation error
+ */
+static bool upipe_avfsink_pkt_fill(struct upipe_avfsink_pkt *pkt,
+                                   struct uref *uref, size_t size)
+{
+    int read_size = size;
+    const uint8_t *buffer;
+    if (ubase_check(uref_block_read(uref, 0, &read_size, &buffer))) {
+        if (read_size == size) {
+            pkt->uref = uref;
+            pkt->avpkt.data = (uint8_t *)buffer;
+            pkt->avpkt.size = size;
+            return true;
+        }
+        uref_block_unmap(uref, 0);
+    }
+
+    pkt->uref = NULL;
+    pkt->avpkt.data = malloc(size);
+    if (unlikely(pkt->avpkt.data == NULL)) {
+        uref_free(uref);
+        return false;
+    }
+    uref_block_extract(uref, 0, size, pkt->avpkt.data);
+    pkt->avpkt.size = size;
+    uref_free(uref);
+    return true;
+}
+
+/** @internal @This releases the data of a packet.
+ *
+ * @param pkt written packet
+ */
+static void upipe_avfsink_pkt_clean(struct upipe_avfsink_pkt *pkt)
+{
+    if (pkt->uref != NULL) {
+        uref_block_unmap(pkt->uref, 0);
+        uref_free(pkt->uref);
+    } else
+        free(pkt->avpkt.data);
+}
+
+/** @internal @This allocates a packet structure for the pool.
+ *
+ * @param upool pointer to upool
+ * @return pointer to upipe_avfsink_pkt or NULL in case of allocation error
+ */
+static void *upipe_avfsink_pkt_alloc_inner(struct upool *upool)
+{
+    return malloc(sizeof(struct upipe_avfsink_pkt));
+}
+
+/** @internal @This frees a packet structure from the pool.
+ *
+ * @param upool pointer to upool
+ * @param pkt pointer to upipe_avfsink_pkt structure to free
+ */
+static void upipe_avfsink_pkt_free_inner(struct upool *upool, void *pkt)
+{
+    free(pkt);
+}
+
+/** @internal @This is the main function of the writer thread. It opens the
+ * output, then writes the queued packets in batches until asked to exit,
+ * and writes the trailer.
+ *
+ * @param _writer pointer to the writer thread context
+ * @return NULL
+ */
+static void *upipe_avfsink_writer_thread(void *_writer)
+{
+    struct upipe_avfsink_writer *writer =
+        (struct upipe_avfsink_writer *)_writer;
+    int error = upipe_avfsink_open_context(writer->context, &writer->options);
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->opened = error >= 0;
+    writer->error = error < 0 ? error : 0;
+    pthread_cond_signal(&writer->drained);
+    pthread_mutex_unlock(&writer->mutex);
+
+    while (error >= 0) {
+        struct uchain batch;
+        ulist_init(&batch);
+
+        pthread_mutex_lock(&writer->mutex);
+        while (!writer->exit && ulist_empty(&writer->packets))
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        struct uchain *uchain;
+        while ((uchain = ulist_pop(&writer->packets)) != NULL)
+            ulist_add(&batch, uchain);
+        pthread_mutex_unlock(&writer->mutex);
+        if (ulist_empty(&batch))
+            break;
+
+        uint64_t octets = 0;
+        while ((uchain = ulist_pop(&batch)) != NULL) {
+            struct upipe_avfsink_pkt *pkt =
+                upipe_avfsink_pkt_from_uchain(uchain);
+            if (likely(error >= 0))
+                error = av_write_frame(writer->context, &pkt->avpkt);
+            octets += pkt->avpkt.size;
+            upipe_avfsink_pkt_clean(pkt);
+            upool_free(&writer->pkt_pool, pkt);
+        }
+
+        pthread_mutex_lock(&writer->mutex);
+        writer->octets -= octets;
+        if (unlikely(error < 0))
+            writer->error = error;
+        pthread_cond_signal(&writer->drained);
+        pthread_mutex_unlock(&writer->mutex);
+    }
+
+    if (writer->opened)
+        upipe_avfsink_close_context(writer->context);
+    return NULL;
+}
+
+/** @internal @This starts the writer thread on the current URI.
+ *
+ * @param upipe description structure of the pipe
+ * @return false in case of error
+ */
+static bool upipe_avfsink_start_writer(struct upipe *upipe)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    struct upipe_avfsink_writer *writer =
+        malloc(sizeof(struct upipe_avfsink_writer) +
+               upool_sizeof(UPIPE_AVFSINK_PKT_POOL_DEPTH));
+    if (unlikely(writer == NULL))
+        return false;
+
+    writer->context = upipe_avfsink->context;
+    writer->options = NULL;
+    av_dict_copy(&writer->options, upipe_avfsink->options, 0);
+    ulist_init(&writer->packets);
+    writer->octets = 0;
+    writer->max_octets = upipe_avfsink->write_queue;
+    writer->opened = false;
+    writer->error = 0;
+    writer->exit = false;
+    writer->reported = false;
+    upool_init(&writer->pkt_pool, UPIPE_AVFSINK_PKT_POOL_DEPTH,
+               writer->upool_extra,
+               upipe_avfsink_pkt_alloc_inner, upipe_avfsink_pkt_free_inner);
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    pthread_cond_init(&writer->drained, NULL);
+    if (unlikely(pthread_create(&writer->thread, NULL,
+                                upipe_avfsink_writer_thread, writer) != 0)) {
+        pthread_cond_destroy(&writer->drained);
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->mutex);
+        upool_clean(&writer->pkt_pool);
+        av_dict_free(&writer->options);
+        free(writer);
+        return false;
+    }
+    upipe_avfsink->writer = writer;
+    return true;
+}
+
+/** @internal @This stops the writer thread, if any, after it has written
+ * the queued packets and the trailer. It must be called before freeing the
+ * avformat context.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avfsink_stop_writer(struct upipe *upipe)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    struct upipe_avfsink_writer *writer = upipe_avfsink->writer;
+    if (writer == NULL)
+        return;
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->exit = true;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&writer->packets)) != NULL) {
+        struct upipe_avfsink_pkt *pkt = upipe_avfsink_pkt_from_uchain(uchain);
+        upipe_avfsink_pkt_clean(pkt);
+        upool_free(&writer->pkt_pool, pkt);
+    }
+    if (unlikely(writer->error < 0 && !writer->reported)) {
+        upipe_av_strerror(writer->error, buf);
+        upipe_err_va(upipe, "write error to %s (%s)", upipe_avfsink->uri, buf);
+    }
+    av_dict_free(&writer->options);
+    pthread_cond_destroy(&writer->drained);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    upool_clean(&writer->pkt_pool);
+    free(writer);
+    upipe_avfsink->writer = NULL;
+}
+
+/** @internal @This waits for the writer thread to write the header.
+ *
+ * @param upipe description structure of the pipe
+ * @param options_p filled in with the options the muxer didn't recognize
+ * @return an avformat error code
+ */
+static int upipe_avfsink_wait_writer(struct upipe *upipe,
+                                     AVDictionary **options_p)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    struct upipe_avfsink_writer *writer = upipe_avfsink->writer;
+
+    pthread_mutex_lock(&writer->mutex);
+    while (!writer->opened && !writer->error)
+        pthread_cond_wait(&writer->drained, &writer->mutex);
+    int error = writer->error;
+    *options_p = writer->options;
+    writer->options = NULL;
+    if (unlikely(error < 0))
+        writer->reported = true;
+    pthread_mutex_unlock(&writer->mutex);
+    return error;
+}
+
+/** @internal @This queues a packet to the writer thread, waiting for the
+ * queue to drain if it is full.
+ *
+ * @param upipe description structure of the pipe
+ * @param pkt packet to write
+ * @return false if the writer failed, in which case the packet is released
+ */
+static bool upipe_avfsink_queue(struct upipe *upipe,
+                                struct upipe_avfsink_pkt *pkt)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    struct upipe_avfsink_writer *writer = upipe_avfsink->writer;
+
+    pthread_mutex_lock(&writer->mutex);
+    while (!writer->error && writer->max_octets &&
+           writer->octets >= writer->max_octets)
+        pthread_cond_wait(&writer->drained, &writer->mutex);
+    int error = writer->error;
+    if (likely(!error)) {
+        ulist_add(&writer->packets, upipe_avfsink_pkt_to_uchain(pkt));
+        writer->octets += pkt->avpkt.size;
+        pthread_cond_signal(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    if (likely(!error))
+        return true;
+
+    upipe_avfsink_pkt_clean(pkt);
+    upool_free(&writer->pkt_pool, pkt);
+    if (!writer->reported) {
+        writer->reported = true;
+        upipe_av_strerror(error, buf);
+        upipe_err_va(upipe, "write error to %s (%s)", upipe_avfsink->uri, buf);
+        upipe_throw_sink_end(upipe);
+    }
+    return false;
+}
+
 /** @internal @This asks avformat to multiplex some data.
  *
  * @param upipe description structure of the pipe
@@ -518,29 +884,32 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
                 upipe_avfsink->ts_offset = input->next_dts;
             }
             upipe_avfsink->first_dts = input->next_dts;
-            if (!(upipe_avfsink->context->oformat->flags & AVFMT_NOFILE)) {
-                int error = avio_open(&upipe_avfsink->context->pb,
-                                      upipe_avfsink->context->filename,
-                                      AVIO_FLAG_WRITE);
-                if (error < 0) {
-                    upipe_av_strerror(error, buf);
-                    upipe_err_va(upipe, "couldn't open file %s (%s)",
-                                 upipe_avfsink->context->filename, buf);
-                    upipe_throw_fatal(upipe, UBASE_ERR_EXTERNAL);
+
+            AVDictionary *options = NULL;
+            int error;
+            if (upipe_avfsink->write_queue) {
+                if (unlikely(!upipe_avfsink_start_writer(upipe))) {
+                    upipe_err(upipe, "can't start writer thread");
+                    upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
                     while (!ulist_empty(&input->urefs)) {
                         uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
                     }
                     upipe_release(upipe_avfsink_sub_to_upipe(input));
                     return;
                 }
+                /* the header may change the time bases of the streams */
+                error = upipe_avfsink_wait_writer(upipe, &options);
+            } else {
+                av_dict_copy(&options, upipe_avfsink->options, 0);
+                error = upipe_avfsink_open_context(upipe_avfsink->context,
+                                                   &options);
             }
-
-            AVDictionary *options = NULL;
-            av_dict_copy(&options, upipe_avfsink->options, 0);
-            int error = avformat_write_header(upipe_avfsink->context, &options);
             if (unlikely(error < 0)) {
+                upipe_avfsink_stop_writer(upipe);
+                av_dict_free(&options);
                 upipe_av_strerror(error, buf);
-                upipe_err_va(upipe, "couldn't write header (%s)", buf);
+                upipe_err_va(upipe, "couldn't open %s (%s)",
+                             upipe_avfsink->context->filename, buf);
                 upipe_throw_fatal(upipe, UBASE_ERR_EXTERNAL);
                 while (!ulist_empty(&input->urefs)) {
                     uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
@@ -573,24 +942,6 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
             uref_clock_get_dts_prog(next_uref, &input->next_dts);
         }
 
-        AVPacket avpkt;
-        memset(&avpkt, 0, sizeof(AVPacket));
-        av_init_packet(&avpkt);
-        avpkt.stream_index = input->id;
-        if (ubase_check(uref_flow_get_random(uref)))
-            avpkt.flags |= AV_PKT_FLAG_KEY;
-
-        uint64_t dts;
-        if (ubase_check(uref_clock_get_dts_prog(uref, &dts)))
-            avpkt.dts = ((dts - upipe_avfsink->ts_offset) *
-                         stream->time_base.den + UCLOCK_FREQ / 2) /
-                        UCLOCK_FREQ / stream->time_base.num;
-        uint64_t pts;
-        if (ubase_check(uref_clock_get_pts_prog(uref, &pts)))
-            avpkt.pts = ((pts - upipe_avfsink->ts_offset) *
-                         stream->time_base.den + UCLOCK_FREQ / 2) /
-                        UCLOCK_FREQ / stream->time_base.num;
-
         size_t size = 0;
         uref_block_size(uref, &size);
         if (unlikely(!size)) {
@@ -599,18 +950,44 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
             upipe_release(upipe_avfsink_sub_to_upipe(input));
             continue;
         }
-        avpkt.size = size;
 
-        /* TODO replace with umem */
-        avpkt.data = malloc(avpkt.size);
-        if (unlikely(avpkt.data == NULL)) {
+        struct upipe_avfsink_writer *writer = upipe_avfsink->writer;
+        struct upipe_avfsink_pkt sync_pkt;
+        struct upipe_avfsink_pkt *pkt = &sync_pkt;
+        if (writer != NULL &&
+            unlikely((pkt = upool_alloc(&writer->pkt_pool,
+                                        struct upipe_avfsink_pkt *)) == NULL)) {
             uref_free(uref);
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             upipe_release(upipe_avfsink_sub_to_upipe(input));
             return;
         }
-        uref_block_extract(uref, 0, avpkt.size, avpkt.data); 
-        uref_free(uref);
+
+        AVPacket *avpkt = &pkt->avpkt;
+        memset(avpkt, 0, sizeof(AVPacket));
+        av_init_packet(avpkt);
+        avpkt->stream_index = input->id;
+        if (ubase_check(uref_flow_get_random(uref)))
+            avpkt->flags |= AV_PKT_FLAG_KEY;
+
+        uint64_t dts;
+        if (ubase_check(uref_clock_get_dts_prog(uref, &dts)))
+            avpkt->dts = ((dts - upipe_avfsink->ts_offset) *
+                          stream->time_base.den + UCLOCK_FREQ / 2) /
+                         UCLOCK_FREQ / stream->time_base.num;
+        uint64_t pts;
+        if (ubase_check(uref_clock_get_pts_prog(uref, &pts)))
+            avpkt->pts = ((pts - upipe_avfsink->ts_offset) *
+                          stream->time_base.den + UCLOCK_FREQ / 2) /
+                         UCLOCK_FREQ / stream->time_base.num;
+
+        if (unlikely(!upipe_avfsink_pkt_fill(pkt, uref, size))) {
+            if (writer != NULL)
+                upool_free(&writer->pkt_pool, pkt);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            upipe_release(upipe_avfsink_sub_to_upipe(input));
+            return;
+        }
 
         if (input->next_dts > upipe_avfsink->highest_next_dts) {
             upipe_avfsink->highest_next_dts = input->next_dts;
@@ -618,8 +995,14 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
 
         upipe_release(upipe_avfsink_sub_to_upipe(input));
 
-        int error = av_write_frame(upipe_avfsink->context, &avpkt);
-        free(avpkt.data);
+        if (writer != NULL) {
+            if (unlikely(!upipe_avfsink_queue(upipe, pkt)))
+                return;
+            continue;
+        }
+
+        int error = av_write_frame(upipe_avfsink->context, avpkt);
+        upipe_avfsink_pkt_clean(pkt);
         if (unlikely(error < 0)) {
             upipe_av_strerror(error, buf);
             upipe_err_va(upipe, "write error to %s (%s)", upipe_avfsink->uri, buf);
@@ -765,6 +1148,36 @@ static int _upipe_avfsink_get_duration(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the size of the write queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets_p filled in with the maximum number of octets
+ * @return an error code
+ */
+static int _upipe_avfsink_get_write_queue(struct upipe *upipe,
+                                          uint64_t *octets_p)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    assert(octets_p != NULL);
+    *octets_p = upipe_avfsink->write_queue;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the write queue. It only takes effect
+ * after the next call to @ref upipe_set_uri.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets maximum number of octets (0 = write on the pipeline thread)
+ * @return an error code
+ */
+static int _upipe_avfsink_set_write_queue(struct upipe *upipe,
+                                          uint64_t octets)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    upipe_avfsink->write_queue = octets;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This returns the currently opened URI.
  *
  * @param upipe description structure of the pipe
@@ -794,9 +1207,10 @@ static int upipe_avfsink_set_uri(struct upipe *upipe, const char *uri)
             upipe_notice_va(upipe, "closing URI %s", upipe_avfsink->uri);
         if (upipe_avfsink->opened) {
             upipe_dbg(upipe, "writing trailer");
-            av_write_trailer(upipe_avfsink->context);
-            if (!(upipe_avfsink->context->oformat->flags & AVFMT_NOFILE))
-                avio_close(upipe_avfsink->context->pb);
+            if (upipe_avfsink->writer != NULL)
+                upipe_avfsink_stop_writer(upipe);
+            else
+                upipe_avfsink_close_context(upipe_avfsink->context);
         }
         avformat_free_context(upipe_avfsink->context);
     }
@@ -880,6 +1294,16 @@ static int upipe_avfsink_control(struct upipe *upipe, int command, va_list args)
             uint64_t *duration_p = va_arg(args, uint64_t *);
             return _upipe_avfsink_get_duration(upipe, duration_p);
         }
+        case UPIPE_AVFSINK_GET_WRITE_QUEUE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSINK_SIGNATURE)
+            uint64_t *octets_p = va_arg(args, uint64_t *);
+            return _upipe_avfsink_get_write_queue(upipe, octets_p);
+        }
+        case UPIPE_AVFSINK_SET_WRITE_QUEUE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSINK_SIGNATURE)
+            uint64_t octets = va_arg(args, uint64_t);
+            return _upipe_avfsink_set_write_queue(upipe, octets);
+        }
 
         case UPIPE_REGISTER_REQUEST: {
             struct urequest *request = va_arg(args, struct urequest *);
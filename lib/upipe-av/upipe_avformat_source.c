@@ -40,6 +40,7 @@
 #include <upipe/uref_sound_flow.h>
 #include <upipe/uref_clock.h>
 #include <upipe/upump.h>
+#include <upipe/ueventfd.h>
 #include <upipe/ubuf.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
@@ -70,6 +71,7 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/dict.h>
 #include <libavformat/avformat.h>
@@ -79,6 +81,47 @@
 /** offset between DTS and (artificial) clock references */
 #define PCR_OFFSET UCLOCK_FREQ
 
+/** @internal @This is a packet read by the prefetch thread. */
+struct upipe_avfsrc_pkt {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** duration of the packet, in clock units */
+    uint64_t duration;
+    /** libavformat packet */
+    AVPacket pkt;
+};
+
+UBASE_FROM_TO(upipe_avfsrc_pkt, uchain, uchain, uchain)
+
+/** @internal @This is the context of the thread demuxing ahead of the
+ * pipeline. */
+struct upipe_avfsrc_prefetch {
+    /** avformat context the thread reads from */
+    AVFormatContext *context;
+    /** helper thread */
+    pthread_t thread;
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** condition signalled when the queue drains or on exit */
+    pthread_cond_t cond;
+    /** list of prefetched packets */
+    struct uchain packets;
+    /** octets currently in the queue */
+    uint64_t octets;
+    /** duration currently in the queue, in clock units */
+    uint64_t duration;
+    /** maximum number of octets in the queue (0 = unlimited) */
+    uint64_t max_octets;
+    /** maximum duration in the queue, in clock units (0 = unlimited) */
+    uint64_t max_duration;
+    /** error returned by av_read_frame, or 0 */
+    int error;
+    /** set to true to ask the thread to exit */
+    bool exit;
+    /** event triggered when packets become available */
+    struct ueventfd event;
+};
+
 /** @internal @This is the private context of an avformat source pipe. */
 struct upipe_avfsrc {
     /** real refcount management structure */
@@ -121,6 +164,12 @@ struct upipe_avfsrc {
     AVFormatContext *context;
     /** true if the URL has already been probed by avformat */
     bool probed;
+    /** maximum number of octets to prefetch, for the next URL */
+    uint64_t prefetch_octets;
+    /** maximum duration to prefetch, for the next URL */
+    uint64_t prefetch_duration;
+    /** prefetch thread context, or NULL if demuxing on the pipeline thread */
+    struct upipe_avfsrc_prefetch *prefetch;
 
     /** manager to create subs */
     struct upipe_mgr sub_mgr;
@@ -370,6 +419,9 @@ static struct upipe *upipe_avfsrc_alloc(struct upipe_mgr *mgr,
     upipe_avfsrc->options = NULL;
     upipe_avfsrc->context = NULL;
     upipe_avfsrc->probed = false;
+    upipe_avfsrc->prefetch_octets = 0;
+    upipe_avfsrc->prefetch_duration = 0;
+    upipe_avfsrc->prefetch = NULL;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -408,26 +460,28 @@ static struct upipe_avfsrc_sub *upipe_avfsrc_find_output(struct upipe *upipe,
     return NULL;
 }
 
-/** @internal @This reads data from the source and outputs it.
- * It is called either when the idler triggers (permanent storage mode) or
- * when data is available on the file descriptor (live stream mode).
+/** @internal @This converts a duration in stream units to clock units.
  *
- * @param upump description structure of the read watcher
+ * @param stream avformat stream
+ * @param duration duration in stream time base
+ * @return duration in clock units
  */
-static void upipe_avfsrc_worker(struct upump *upump)
+static inline uint64_t upipe_avfsrc_duration(AVStream *stream,
+                                             int64_t duration)
 {
-    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
-    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
-    AVPacket pkt;
+    return duration * stream->time_base.num * UCLOCK_FREQ /
+           stream->time_base.den;
+}
 
-    int error = av_read_frame(upipe_avfsrc->context, &pkt);
-    if (unlikely(error < 0)) {
-        upipe_av_strerror(error, buf);
-        upipe_err_va(upipe, "read error from %s (%s)", upipe_avfsrc->url, buf);
-        upipe_avfsrc_set_upump(upipe, NULL);
-        upipe_throw_source_end(upipe);
-        return;
-    }
+/** @internal @This outputs a packet read by avformat, and frees it.
+ *
+ * @param upipe description structure of the pipe
+ * @param pkt_p pointer to the avformat packet
+ */
+static void upipe_avfsrc_output_pkt(struct upipe *upipe, AVPacket *pkt_p)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    AVPacket pkt = *pkt_p;
 
     struct upipe_avfsrc_sub *output =
         upipe_avfsrc_find_output(upipe, pkt.stream_index);
@@ -504,8 +558,7 @@ static void upipe_avfsrc_worker(struct upump *upump)
                               0);
     }
     if (pkt.duration > 0) {
-        uint64_t duration = pkt.duration * stream->time_base.num * UCLOCK_FREQ /
-                            stream->time_base.den;
+        uint64_t duration = upipe_avfsrc_duration(stream, pkt.duration);
         UBASE_FATAL(upipe, uref_clock_set_duration(uref, duration))
     } else
         upipe_warn(upipe, "packet without duration");
@@ -521,6 +574,214 @@ static void upipe_avfsrc_worker(struct upump *upump)
     upipe_release(upipe);
 }
 
+/** @internal @This reads data from the source and outputs it.
+ * It is called either when the idler triggers (permanent storage mode) or
+ * when data is available on the file descriptor (live stream mode).
+ *
+ * @param upump description structure of the read watcher
+ */
+static void upipe_avfsrc_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    AVPacket pkt;
+
+    int error = av_read_frame(upipe_avfsrc->context, &pkt);
+    if (unlikely(error < 0)) {
+        upipe_av_strerror(error, buf);
+        upipe_err_va(upipe, "read error from %s (%s)", upipe_avfsrc->url, buf);
+        upipe_avfsrc_set_upump(upipe, NULL);
+        upipe_throw_source_end(upipe);
+        return;
+    }
+    upipe_avfsrc_output_pkt(upipe, &pkt);
+}
+
+/** @internal @This checks if the prefetch queue is full. It must be called
+ * with the mutex held.
+ *
+ * @param prefetch prefetch thread context
+ * @return true if the queue is full
+ */
+static inline bool
+    upipe_avfsrc_prefetch_full(struct upipe_avfsrc_prefetch *prefetch)
+{
+    return (prefetch->max_octets && prefetch->octets >= prefetch->max_octets) ||
+           (prefetch->max_duration &&
+            prefetch->duration >= prefetch->max_duration);
+}
+
+/** @internal @This is the main function of the prefetch thread. It reads
+ * packets from avformat until an error or the end of the stream, and
+ * sleeps whenever the queue is full.
+ *
+ * @param _prefetch pointer to the prefetch thread context
+ * @return NULL
+ */
+static void *upipe_avfsrc_prefetch_thread(void *_prefetch)
+{
+    struct upipe_avfsrc_prefetch *prefetch =
+        (struct upipe_avfsrc_prefetch *)_prefetch;
+
+    for ( ; ; ) {
+        pthread_mutex_lock(&prefetch->mutex);
+        while (!prefetch->exit && upipe_avfsrc_prefetch_full(prefetch))
+            pthread_cond_wait(&prefetch->cond, &prefetch->mutex);
+        bool stop = prefetch->exit;
+        pthread_mutex_unlock(&prefetch->mutex);
+        if (stop)
+            break;
+
+        struct upipe_avfsrc_pkt *pkt = malloc(sizeof(struct upipe_avfsrc_pkt));
+        int error = AVERROR(ENOMEM);
+        if (likely(pkt != NULL)) {
+            error = av_read_frame(prefetch->context, &pkt->pkt);
+            /* the packet may point to demuxer buffers, make it standalone */
+            if (likely(error >= 0) &&
+                unlikely((error = av_dup_packet(&pkt->pkt)) < 0))
+                av_free_packet(&pkt->pkt);
+        }
+        if (unlikely(error < 0)) {
+            free(pkt);
+            pthread_mutex_lock(&prefetch->mutex);
+            prefetch->error = error;
+            pthread_mutex_unlock(&prefetch->mutex);
+            ueventfd_write(&prefetch->event);
+            break;
+        }
+
+        uchain_init(&pkt->uchain);
+        pkt->duration = 0;
+        if (pkt->pkt.duration > 0)
+            pkt->duration = upipe_avfsrc_duration(
+                    prefetch->context->streams[pkt->pkt.stream_index],
+                    pkt->pkt.duration);
+
+        pthread_mutex_lock(&prefetch->mutex);
+        bool was_empty = ulist_empty(&prefetch->packets);
+        ulist_add(&prefetch->packets, upipe_avfsrc_pkt_to_uchain(pkt));
+        prefetch->octets += pkt->pkt.size;
+        prefetch->duration += pkt->duration;
+        pthread_mutex_unlock(&prefetch->mutex);
+        if (was_empty)
+            ueventfd_write(&prefetch->event);
+    }
+    return NULL;
+}
+
+/** @internal @This outputs a packet from the prefetch queue. It is called
+ * when the prefetch event triggers, and keeps the event readable as long
+ * as the queue is not empty.
+ *
+ * @param upump description structure of the event watcher
+ */
+static void upipe_avfsrc_prefetch_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    struct upipe_avfsrc_prefetch *prefetch = upipe_avfsrc->prefetch;
+
+    pthread_mutex_lock(&prefetch->mutex);
+    struct uchain *uchain = ulist_pop(&prefetch->packets);
+    struct upipe_avfsrc_pkt *pkt = NULL;
+    if (uchain != NULL) {
+        pkt = upipe_avfsrc_pkt_from_uchain(uchain);
+        prefetch->octets -= pkt->pkt.size;
+        prefetch->duration -= pkt->duration;
+        pthread_cond_signal(&prefetch->cond);
+    }
+    if (ulist_empty(&prefetch->packets))
+        ueventfd_read(&prefetch->event);
+    int error = prefetch->error;
+    pthread_mutex_unlock(&prefetch->mutex);
+
+    if (pkt != NULL) {
+        upipe_avfsrc_output_pkt(upipe, &pkt->pkt);
+        free(pkt);
+        return;
+    }
+
+    if (unlikely(error < 0)) {
+        upipe_av_strerror(error, buf);
+        upipe_err_va(upipe, "read error from %s (%s)", upipe_avfsrc->url, buf);
+        upipe_avfsrc_set_upump(upipe, NULL);
+        upipe_throw_source_end(upipe);
+    }
+}
+
+/** @internal @This starts the prefetch thread on the current URL.
+ *
+ * @param upipe description structure of the pipe
+ * @return false in case of error
+ */
+static bool upipe_avfsrc_start_prefetch(struct upipe *upipe)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    struct upipe_avfsrc_prefetch *prefetch =
+        malloc(sizeof(struct upipe_avfsrc_prefetch));
+    if (unlikely(prefetch == NULL))
+        return false;
+
+    prefetch->context = upipe_avfsrc->context;
+    ulist_init(&prefetch->packets);
+    prefetch->octets = 0;
+    prefetch->duration = 0;
+    prefetch->max_octets = upipe_avfsrc->prefetch_octets;
+    prefetch->max_duration = upipe_avfsrc->prefetch_duration;
+    prefetch->error = 0;
+    prefetch->exit = false;
+    if (unlikely(!ueventfd_init(&prefetch->event, false))) {
+        free(prefetch);
+        return false;
+    }
+    pthread_mutex_init(&prefetch->mutex, NULL);
+    pthread_cond_init(&prefetch->cond, NULL);
+    if (unlikely(pthread_create(&prefetch->thread, NULL,
+                                upipe_avfsrc_prefetch_thread, prefetch) != 0)) {
+        pthread_cond_destroy(&prefetch->cond);
+        pthread_mutex_destroy(&prefetch->mutex);
+        ueventfd_clean(&prefetch->event);
+        free(prefetch);
+        return false;
+    }
+    upipe_avfsrc->prefetch = prefetch;
+    return true;
+}
+
+/** @internal @This stops the prefetch thread, if any, and flushes the
+ * prefetched packets. It must be called before closing the avformat
+ * context.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avfsrc_stop_prefetch(struct upipe *upipe)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    struct upipe_avfsrc_prefetch *prefetch = upipe_avfsrc->prefetch;
+    if (prefetch == NULL)
+        return;
+
+    upipe_avfsrc_set_upump(upipe, NULL);
+    pthread_mutex_lock(&prefetch->mutex);
+    prefetch->exit = true;
+    pthread_cond_signal(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->mutex);
+    pthread_join(prefetch->thread, NULL);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&prefetch->packets, uchain, uchain_tmp) {
+        struct upipe_avfsrc_pkt *pkt = upipe_avfsrc_pkt_from_uchain(uchain);
+        ulist_delete(uchain);
+        av_free_packet(&pkt->pkt);
+        free(pkt);
+    }
+    pthread_cond_destroy(&prefetch->cond);
+    pthread_mutex_destroy(&prefetch->mutex);
+    ueventfd_clean(&prefetch->event);
+    free(prefetch);
+    upipe_avfsrc->prefetch = NULL;
+}
+
 /** @internal @This starts the worker.
  *
  * @param upipe description structure of the pipe
@@ -528,8 +789,22 @@ static void upipe_avfsrc_worker(struct upump *upump)
 static bool upipe_avfsrc_start(struct upipe *upipe)
 {
     struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
-    struct upump *upump = upump_alloc_idler(upipe_avfsrc->upump_mgr,
-                                            upipe_avfsrc_worker, upipe);
+    if (upipe_avfsrc->prefetch == NULL &&
+        (upipe_avfsrc->prefetch_octets || upipe_avfsrc->prefetch_duration) &&
+        unlikely(!upipe_avfsrc_start_prefetch(upipe))) {
+        upipe_err(upipe, "can't start prefetch thread");
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+
+    struct upump *upump;
+    if (upipe_avfsrc->prefetch != NULL)
+        upump = ueventfd_upump_alloc(&upipe_avfsrc->prefetch->event,
+                                     upipe_avfsrc->upump_mgr,
+                                     upipe_avfsrc_prefetch_worker, upipe);
+    else
+        upump = upump_alloc_idler(upipe_avfsrc->upump_mgr,
+                                  upipe_avfsrc_worker, upipe);
     if (unlikely(upump == NULL)) {
         upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
         return false;
@@ -887,6 +1162,7 @@ static int upipe_avfsrc_set_uri(struct upipe *upipe, const char *url)
     if (unlikely(upipe_avfsrc->context != NULL)) {
         if (likely(upipe_avfsrc->url != NULL))
             upipe_notice_va(upipe, "closing URL %s", upipe_avfsrc->url);
+        upipe_avfsrc_stop_prefetch(upipe);
         avformat_close_input(&upipe_avfsrc->context);
         upipe_avfsrc->context = NULL;
         upipe_avfsrc_set_upump(upipe, NULL);
@@ -951,6 +1227,41 @@ static int _upipe_avfsrc_set_time(struct upipe *upipe, uint64_t time)
     return UBASE_ERR_UNHANDLED;
 }
 
+/** @internal @This returns the prefetch limits.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets_p filled in with the maximum number of octets
+ * @param duration_p filled in with the maximum duration, in clock units
+ * @return an error code
+ */
+static int _upipe_avfsrc_get_prefetch(struct upipe *upipe,
+                                      uint64_t *octets_p,
+                                      uint64_t *duration_p)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    if (octets_p != NULL)
+        *octets_p = upipe_avfsrc->prefetch_octets;
+    if (duration_p != NULL)
+        *duration_p = upipe_avfsrc->prefetch_duration;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the prefetch limits.
+ *
+ * @param upipe description structure of the pipe
+ * @param octets maximum number of octets (0 = unlimited)
+ * @param duration maximum duration, in clock units (0 = unlimited)
+ * @return an error code
+ */
+static int _upipe_avfsrc_set_prefetch(struct upipe *upipe,
+                                      uint64_t octets, uint64_t duration)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    upipe_avfsrc->prefetch_octets = octets;
+    upipe_avfsrc->prefetch_duration = duration;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on an avformat source pipe.
  *
  * @param upipe description structure of the pipe
@@ -1012,6 +1323,18 @@ static int _upipe_avfsrc_control(struct upipe *upipe,
             uint64_t time = va_arg(args, uint64_t);
             return _upipe_avfsrc_set_time(upipe, time);
         }
+        case UPIPE_AVFSRC_GET_PREFETCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSRC_SIGNATURE)
+            uint64_t *octets_p = va_arg(args, uint64_t *);
+            uint64_t *duration_p = va_arg(args, uint64_t *);
+            return _upipe_avfsrc_get_prefetch(upipe, octets_p, duration_p);
+        }
+        case UPIPE_AVFSRC_SET_PREFETCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSRC_SIGNATURE)
+            uint64_t octets = va_arg(args, uint64_t);
+            uint64_t duration = va_arg(args, uint64_t);
+            return _upipe_avfsrc_set_prefetch(upipe, octets, duration);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -1069,7 +1392,8 @@ static void upipe_avfsrc_free(struct urefcount *urefcount_real)
     if (likely(upipe_avfsrc->context != NULL)) {
         if (likely(upipe_avfsrc->url != NULL))
             upipe_notice_va(upipe, "closing URL %s", upipe_avfsrc->url);
-        
+        upipe_avfsrc_stop_prefetch(upipe);
+
         for (int i = 0; i < upipe_avfsrc->context->nb_streams; i++)
             if (upipe_avfsrc->context->streams[i]->codec->opaque != NULL)
                 uref_free((struct uref *)upipe_avfsrc->context->streams[i]->codec->opaque);
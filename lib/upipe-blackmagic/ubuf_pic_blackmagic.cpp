@@ -53,6 +53,8 @@
 struct ubuf_pic_bmd {
     /** pointer to shared structure */
     IDeckLinkVideoFrame *shared;
+    /** true if the ubuf counts in the frames held from the driver */
+    bool held;
 
     /** common picture structure */
     struct ubuf_pic_common ubuf_pic_common;
@@ -71,6 +73,10 @@ struct ubuf_pic_bmd_mgr {
 
     /** blackmagic pixel format */
     BMDPixelFormat PixelFormat;
+    /** number of frames currently held from the driver */
+    uatomic_uint32_t held;
+    /** maximum number of frames held from the driver (0 = unlimited) */
+    uatomic_uint32_t max_held;
 
     /** common picture management structure */
     struct ubuf_pic_common_mgr common_mgr;
@@ -104,14 +110,26 @@ static struct ubuf *ubuf_pic_bmd_alloc(struct ubuf_mgr *mgr,
     if (unlikely(PixelFormat != pic_mgr->PixelFormat))
         return NULL;
 
+    /* Give the frame back to the driver right away rather than starving
+     * its pool if too many frames are already held downstream. */
+    uint32_t held = uatomic_fetch_add(&pic_mgr->held, 1);
+    uint32_t max_held = uatomic_load(&pic_mgr->max_held);
+    if (unlikely(max_held && held >= max_held)) {
+        uatomic_fetch_sub(&pic_mgr->held, 1);
+        return NULL;
+    }
+
     struct ubuf_pic_bmd *pic_bmd = upool_alloc(&pic_mgr->ubuf_pool,
                                                struct ubuf_pic_bmd *);
-    if (unlikely(pic_bmd == NULL))
+    if (unlikely(pic_bmd == NULL)) {
+        uatomic_fetch_sub(&pic_mgr->held, 1);
         return NULL;
+    }
 
     struct ubuf *ubuf = ubuf_pic_bmd_to_ubuf(pic_bmd);
 
     pic_bmd->shared = VideoFrame;
+    pic_bmd->held = true;
     VideoFrame->AddRef();
     ubuf_pic_common_init(ubuf,
             0, 0, VideoFrame->GetWidth() / pic_mgr->common_mgr.macropixel,
@@ -142,6 +160,7 @@ static int ubuf_pic_bmd_dup(struct ubuf *ubuf, struct ubuf **new_ubuf_p)
                                                struct ubuf_pic_bmd *);
     if (unlikely(new_pic == NULL))
         return UBASE_ERR_ALLOC;
+    new_pic->held = false;
 
     struct ubuf *new_ubuf = ubuf_pic_bmd_to_ubuf(new_pic);
     if (unlikely(!ubase_check(ubuf_pic_common_dup(ubuf, new_ubuf)))) {
@@ -259,6 +278,8 @@ static void ubuf_pic_bmd_free(struct ubuf *ubuf)
         ubuf_pic_common_plane_clean(ubuf, plane);
 
     pic_bmd->shared->Release();
+    if (pic_bmd->held)
+        uatomic_fetch_sub(&pic_mgr->held, 1);
     upool_free(&pic_mgr->ubuf_pool, pic_bmd);
     ubuf_mgr_release(mgr);
 }
@@ -311,6 +332,22 @@ static int ubuf_pic_bmd_mgr_control(struct ubuf_mgr *mgr,
             upool_clean(&pic_mgr->ubuf_pool);
             return UBASE_ERR_NONE;
         }
+        case UBUF_PIC_BMD_MGR_GET_HELD: {
+            UBASE_SIGNATURE_CHECK(args, UBUF_BMD_ALLOC_PICTURE)
+            struct ubuf_pic_bmd_mgr *pic_mgr =
+                ubuf_pic_bmd_mgr_from_ubuf_mgr(mgr);
+            unsigned int *held_p = va_arg(args, unsigned int *);
+            *held_p = uatomic_load(&pic_mgr->held);
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_PIC_BMD_MGR_SET_MAX_HELD: {
+            UBASE_SIGNATURE_CHECK(args, UBUF_BMD_ALLOC_PICTURE)
+            struct ubuf_pic_bmd_mgr *pic_mgr =
+                ubuf_pic_bmd_mgr_from_ubuf_mgr(mgr);
+            unsigned int max_held = va_arg(args, unsigned int);
+            uatomic_store(&pic_mgr->max_held, max_held);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -326,6 +363,8 @@ static void ubuf_pic_bmd_mgr_free(struct urefcount *urefcount)
         ubuf_pic_bmd_mgr_from_urefcount(urefcount);
     struct ubuf_mgr *mgr = ubuf_pic_bmd_mgr_to_ubuf_mgr(pic_mgr);
     upool_clean(&pic_mgr->ubuf_pool);
+    uatomic_clean(&pic_mgr->held);
+    uatomic_clean(&pic_mgr->max_held);
 
     ubuf_pic_common_mgr_clean(mgr);
 
@@ -363,6 +402,8 @@ struct ubuf_mgr *ubuf_pic_bmd_mgr_alloc(uint16_t ubuf_pool_depth,
         return NULL;
 
     pic_mgr->PixelFormat = PixelFormat;
+    uatomic_init(&pic_mgr->held, 0);
+    uatomic_init(&pic_mgr->max_held, 0);
     upool_init(&pic_mgr->ubuf_pool, ubuf_pool_depth, pic_mgr->upool_extra,
                ubuf_pic_bmd_alloc_inner, ubuf_pic_bmd_free_inner);
 
@@ -72,6 +72,8 @@
 #define MAX_QUEUE_LENGTH 255
 /** ubuf pool depth */
 #define UBUF_POOL_DEPTH 25
+/** default maximum number of video frames held from the driver */
+#define DEFAULT_MAX_FRAMES 16
 /** lowest possible prog PTS (just an arbitrarily high time) */
 #define BMD_CLOCK_MIN UINT32_MAX
 /** fixed sample rate FIXME */
@@ -215,6 +217,11 @@ struct upipe_bmd_src {
     bool progressive;
     /** true for top field first - for use by the private thread */
     bool tff;
+    /** maximum number of video frames held from the driver */
+    unsigned int max_frames;
+    /** number of frames given back to the driver because too many were
+     * held - incremented by the private thread */
+    uatomic_uint32_t dropped;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -326,7 +333,9 @@ HRESULT DeckLinkCaptureDelegate::VideoInputFrameArrived(
     if (VideoFrame && !(VideoFrame->GetFlags() & bmdFrameHasNoInputSource)) {
         struct ubuf *ubuf =
             ubuf_pic_bmd_alloc(upipe_bmd_src->pic_subpipe.ubuf_mgr, VideoFrame);
-        if (likely(ubuf != NULL)) {
+        if (unlikely(ubuf == NULL))
+            uatomic_fetch_add(&upipe_bmd_src->dropped, 1);
+        else {
             /* TODO subpic */
             struct uref *uref = uref_alloc(upipe_bmd_src->uref_mgr);
             uref_attach_ubuf(uref, ubuf);
@@ -512,12 +521,17 @@ static struct upipe *_upipe_bmd_src_alloc(struct upipe_mgr *mgr,
 
     uqueue_init(&upipe_bmd_src->uqueue, MAX_QUEUE_LENGTH,
                 upipe_bmd_src->uqueue_extra);
+    upipe_bmd_src->pic_subpipe.ubuf_mgr = NULL;
+    upipe_bmd_src->sound_subpipe.ubuf_mgr = NULL;
+    upipe_bmd_src->subpic_subpipe.ubuf_mgr = NULL;
     upipe_bmd_src->deckLink = NULL;
     upipe_bmd_src->deckLinkInput = NULL;
     upipe_bmd_src->deckLinkConfiguration = NULL;
     upipe_bmd_src->deckLinkCaptureDelegate = NULL;
     upipe_bmd_src->progressive = false;
     upipe_bmd_src->tff = true;
+    upipe_bmd_src->max_frames = DEFAULT_MAX_FRAMES;
+    uatomic_init(&upipe_bmd_src->dropped, 0);
 
     upipe_throw_ready(upipe);
     return upipe;
@@ -533,6 +547,13 @@ void upipe_bmd_src_work(struct upipe *upipe, struct upump *upump)
     struct upipe_bmd_src *upipe_bmd_src = upipe_bmd_src_from_upipe(upipe);
     struct uref *uref;
 
+    uint32_t dropped = uatomic_load(&upipe_bmd_src->dropped);
+    if (unlikely(dropped)) {
+        uatomic_fetch_sub(&upipe_bmd_src->dropped, dropped);
+        upipe_warn_va(upipe, "%" PRIu32 " frames dropped (%u frames held)",
+                      dropped, upipe_bmd_src->max_frames);
+    }
+
     /* unqueue urefs */
     while ((uref = uqueue_pop(&upipe_bmd_src->uqueue, struct uref *))) {
         uint64_t type;
@@ -766,6 +787,9 @@ static int upipe_bmd_src_set_uri(struct upipe *upipe, const char *uri)
     upipe_bmd_src->sound_subpipe.ubuf_mgr =
         ubuf_sound_bmd_mgr_alloc(UBUF_POOL_DEPTH,
                                  bmdAudioSampleType16bitInteger, CHANS, "ALL");
+    if (upipe_bmd_src->pic_subpipe.ubuf_mgr != NULL)
+        ubuf_pic_bmd_mgr_set_max_held(upipe_bmd_src->pic_subpipe.ubuf_mgr,
+                                      upipe_bmd_src->max_frames);
     /* TODO subpic */
     if (unlikely(upipe_bmd_src->pic_subpipe.ubuf_mgr == NULL ||
                  upipe_bmd_src->sound_subpipe.ubuf_mgr == NULL)) {
@@ -819,6 +843,40 @@ static int upipe_bmd_src_set_uri(struct upipe *upipe, const char *uri)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the maximum number of video frames held from
+ * the driver.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames_p filled in with the maximum number of frames
+ * @return an error code
+ */
+static int _upipe_bmd_src_get_max_frames(struct upipe *upipe,
+                                         unsigned int *max_frames_p)
+{
+    struct upipe_bmd_src *upipe_bmd_src = upipe_bmd_src_from_upipe(upipe);
+    assert(max_frames_p != NULL);
+    *max_frames_p = upipe_bmd_src->max_frames;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the maximum number of video frames held from the
+ * driver.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames maximum number of frames (0 = unlimited)
+ * @return an error code
+ */
+static int _upipe_bmd_src_set_max_frames(struct upipe *upipe,
+                                         unsigned int max_frames)
+{
+    struct upipe_bmd_src *upipe_bmd_src = upipe_bmd_src_from_upipe(upipe);
+    upipe_bmd_src->max_frames = max_frames;
+    if (upipe_bmd_src->pic_subpipe.ubuf_mgr != NULL)
+        return ubuf_pic_bmd_mgr_set_max_held(
+                upipe_bmd_src->pic_subpipe.ubuf_mgr, max_frames);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a blackmagic source pipe.
  *
  * @param upipe description structure of the pipe
@@ -880,6 +938,16 @@ static int _upipe_bmd_src_control(struct upipe *upipe,
                         upipe_bmd_src_from_upipe(upipe)));
             return UBASE_ERR_NONE;
         }
+        case UPIPE_BMD_SRC_GET_MAX_FRAMES: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_BMD_SRC_SIGNATURE)
+            unsigned int *max_frames_p = va_arg(args, unsigned int *);
+            return _upipe_bmd_src_get_max_frames(upipe, max_frames_p);
+        }
+        case UPIPE_BMD_SRC_SET_MAX_FRAMES: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_BMD_SRC_SIGNATURE)
+            unsigned int max_frames = va_arg(args, unsigned int);
+            return _upipe_bmd_src_set_max_frames(upipe, max_frames);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -924,6 +992,14 @@ static void upipe_bmd_src_free(struct upipe *upipe)
 {
     struct upipe_bmd_src *upipe_bmd_src = upipe_bmd_src_from_upipe(upipe);
 
+    /* Stop the private thread before draining the queue, as other cards
+     * of the process may still be capturing. */
+    if (upipe_bmd_src->deckLinkInput) {
+        upipe_bmd_src->deckLinkInput->StopStreams();
+        upipe_bmd_src->deckLinkInput->SetCallback(NULL);
+        upipe_bmd_src->deckLinkInput->DisableVideoInput();
+        upipe_bmd_src->deckLinkInput->DisableAudioInput();
+    }
     upipe_bmd_src_work(upipe, NULL);
     if (upipe_bmd_src->deckLinkConfiguration)
         upipe_bmd_src->deckLinkConfiguration->Release();
@@ -934,6 +1010,11 @@ static void upipe_bmd_src_free(struct upipe *upipe)
     if (upipe_bmd_src->deckLinkCaptureDelegate)
         upipe_bmd_src->deckLinkCaptureDelegate->Release();
     uqueue_clean(&upipe_bmd_src->uqueue);
+    uatomic_clean(&upipe_bmd_src->dropped);
+    if (upipe_bmd_src->pic_subpipe.ubuf_mgr)
+        ubuf_mgr_release(upipe_bmd_src->pic_subpipe.ubuf_mgr);
+    if (upipe_bmd_src->sound_subpipe.ubuf_mgr)
+        ubuf_mgr_release(upipe_bmd_src->sound_subpipe.ubuf_mgr);
 
     upipe_bmd_src_output_clean(upipe_bmd_src_output_to_upipe(
                 upipe_bmd_src_to_pic_subpipe(upipe_bmd_src)));
@@ -15,6 +15,10 @@
   #include <speex/speex_resampler.h>
 #endif
 
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
 #define CHECK_ERROR(condition, errorcode, goto_point)                          \
   if ((condition)) {                                                           \
     errcode = (errorcode);                                                     \
@@ -46,8 +50,8 @@ struct ebur128_state_internal {
   double b[5];
   /** BS.1770 filter coefficients (denominator). */
   double a[5];
-  /** BS.1770 filter state. */
-  double v[5][5];
+  /** BS.1770 filter state, one per channel. */
+  double (*v)[5];
   /** Linked list of block energies. */
   struct ebur128_double_queue block_list;
   /** Linked list of 3s-block energies, used to calculate LRA. */
@@ -126,7 +130,7 @@ static void ebur128_init_filter(ebur128_state* st) {
   st->d->a[3] = pa[1] * ra[2] + pa[2] * ra[1];
   st->d->a[4] = pa[2] * ra[2];
 
-  for (i = 0; i < 5; ++i) {
+  for (i = 0; i < (int) st->channels; ++i) {
     for (j = 0; j < 5; ++j) {
       st->d->v[i][j] = 0.0;
     }
@@ -254,6 +258,11 @@ ebur128_state* ebur128_init(unsigned int channels,
     st->d->true_peak[i] = 0.0;
   }
 
+  /* the histogram keeps memory bounded over long measurements, so it is
+   * used unless exact results are requested */
+  if (!(mode & EBUR128_MODE_QUEUE)) {
+    mode |= EBUR128_MODE_HISTOGRAM;
+  }
   st->d->use_histogram = mode & EBUR128_MODE_HISTOGRAM ? 1 : 0;
 
   st->samplerate = samplerate;
@@ -270,11 +279,13 @@ ebur128_state* ebur128_init(unsigned int channels,
                                        st->channels *
                                        sizeof(double));
   CHECK_ERROR(!st->d->audio_data, 0, free_true_peak)
+  st->d->v = malloc(channels * sizeof(*st->d->v));
+  CHECK_ERROR(!st->d->v, 0, free_audio_data)
   ebur128_init_filter(st);
 
   if (st->d->use_histogram) {
     st->d->block_energy_histogram = malloc(1000 * sizeof(unsigned long));
-    CHECK_ERROR(!st->d->block_energy_histogram, 0, free_audio_data)
+    CHECK_ERROR(!st->d->block_energy_histogram, 0, free_filter)
     for (i = 0; i < 1000; ++i) {
       st->d->block_energy_histogram[i] = 0;
     }
@@ -323,6 +334,8 @@ free_short_term_block_energy_histogram:
   free(st->d->short_term_block_energy_histogram);
 free_block_energy_histogram:
   free(st->d->block_energy_histogram);
+free_filter:
+  free(st->d->v);
 free_audio_data:
   free(st->d->audio_data);
 free_true_peak:
@@ -344,6 +357,7 @@ void ebur128_destroy(ebur128_state** st) {
   free((*st)->d->block_energy_histogram);
   free((*st)->d->short_term_block_energy_histogram);
   free((*st)->d->audio_data);
+  free((*st)->d->v);
   free((*st)->d->channel_map);
   free((*st)->d->sample_peak);
   free((*st)->d->true_peak);
@@ -408,19 +422,78 @@ static void ebur128_check_true_peak(ebur128_state* st, size_t frames) {
         unsigned int mxcsr = _mm_getcsr(); \
         _mm_setcsr(mxcsr | _MM_FLUSH_ZERO_ON);
 #define TURN_OFF_FTZ _mm_setcsr(mxcsr);
-#define FLUSH_MANUALLY
+#define FLUSH_MANUALLY(v)
 #else
 #warning "manual FTZ is being used, please enable SSE2 (-msse2 -mfpmath=sse)"
 #define TURN_ON_FTZ
 #define TURN_OFF_FTZ
-#define FLUSH_MANUALLY \
-    st->d->v[ci][4] = fabs(st->d->v[ci][4]) < DBL_MIN ? 0.0 : st->d->v[ci][4]; \
-    st->d->v[ci][3] = fabs(st->d->v[ci][3]) < DBL_MIN ? 0.0 : st->d->v[ci][3]; \
-    st->d->v[ci][2] = fabs(st->d->v[ci][2]) < DBL_MIN ? 0.0 : st->d->v[ci][2]; \
-    st->d->v[ci][1] = fabs(st->d->v[ci][1]) < DBL_MIN ? 0.0 : st->d->v[ci][1];
+#define FLUSH_MANUALLY(v) \
+    v[4] = fabs(v[4]) < DBL_MIN ? 0.0 : v[4]; \
+    v[3] = fabs(v[3]) < DBL_MIN ? 0.0 : v[3]; \
+    v[2] = fabs(v[2]) < DBL_MIN ? 0.0 : v[2]; \
+    v[1] = fabs(v[1]) < DBL_MIN ? 0.0 : v[1];
+#endif
+
+#ifdef __SSE2__
+/* Filters two adjacent channels at once, keeping the filter states in
+ * registers. The results are identical to the scalar filter. */
+#define EBUR128_FILTER_PAIR(type)                                              \
+static void ebur128_filter_pair_##type(ebur128_state* st, const type* src,     \
+                                       double* audio_data, size_t frames,      \
+                                       size_t c, double scaling_factor) {      \
+  double* v0 = st->d->v[c];                                                    \
+  double* v1 = st->d->v[c + 1];                                                \
+  const __m128d scale = _mm_set1_pd(scaling_factor);                           \
+  const __m128d a1 = _mm_set1_pd(st->d->a[1]), a2 = _mm_set1_pd(st->d->a[2]);  \
+  const __m128d a3 = _mm_set1_pd(st->d->a[3]), a4 = _mm_set1_pd(st->d->a[4]);  \
+  const __m128d b0 = _mm_set1_pd(st->d->b[0]), b1 = _mm_set1_pd(st->d->b[1]);  \
+  const __m128d b2 = _mm_set1_pd(st->d->b[2]), b3 = _mm_set1_pd(st->d->b[3]);  \
+  const __m128d b4 = _mm_set1_pd(st->d->b[4]);                                 \
+  __m128d s0 = _mm_set_pd(v1[0], v0[0]);                                       \
+  __m128d s1 = _mm_set_pd(v1[1], v0[1]);                                       \
+  __m128d s2 = _mm_set_pd(v1[2], v0[2]);                                       \
+  __m128d s3 = _mm_set_pd(v1[3], v0[3]);                                       \
+  __m128d s4 = _mm_set_pd(v1[4], v0[4]);                                       \
+  size_t i;                                                                    \
+                                                                               \
+  for (i = 0; i < frames; ++i) {                                               \
+    const type* in = src + i * st->channels + c;                               \
+    __m128d x = _mm_div_pd(_mm_set_pd((double) in[1], (double) in[0]), scale); \
+    s0 = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(_mm_sub_pd(x,                        \
+                _mm_mul_pd(a1, s1)), _mm_mul_pd(a2, s2)),                      \
+                _mm_mul_pd(a3, s3)), _mm_mul_pd(a4, s4));                      \
+    _mm_storeu_pd(audio_data + i * st->channels + c,                           \
+                  _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_add_pd(                 \
+                      _mm_mul_pd(b0, s0), _mm_mul_pd(b1, s1)),                 \
+                      _mm_mul_pd(b2, s2)), _mm_mul_pd(b3, s3)),                \
+                      _mm_mul_pd(b4, s4)));                                    \
+    s4 = s3;                                                                   \
+    s3 = s2;                                                                   \
+    s2 = s1;                                                                   \
+    s1 = s0;                                                                   \
+  }                                                                            \
+  _mm_storel_pd(&v0[0], s0); _mm_storeh_pd(&v1[0], s0);                        \
+  _mm_storel_pd(&v0[1], s1); _mm_storeh_pd(&v1[1], s1);                        \
+  _mm_storel_pd(&v0[2], s2); _mm_storeh_pd(&v1[2], s2);                        \
+  _mm_storel_pd(&v0[3], s3); _mm_storeh_pd(&v1[3], s3);                        \
+  _mm_storel_pd(&v0[4], s4); _mm_storeh_pd(&v1[4], s4);                        \
+  FLUSH_MANUALLY(v0)                                                           \
+  FLUSH_MANUALLY(v1)                                                           \
+}
+#define EBUR128_FILTER_PAIRS(type)                                             \
+  for (; c + 1 < st->channels &&                                              \
+         st->d->channel_map[c] != EBUR128_UNUSED &&                            \
+         st->d->channel_map[c + 1] != EBUR128_UNUSED; c += 2) {                \
+    ebur128_filter_pair_##type(st, src, audio_data, frames, c,                 \
+                               scaling_factor);                                \
+  }
+#else
+#define EBUR128_FILTER_PAIR(type)
+#define EBUR128_FILTER_PAIRS(type)
 #endif
 
 #define EBUR128_FILTER(type, min_scale, max_scale)                             \
+EBUR128_FILTER_PAIR(type)                                                      \
 static void ebur128_filter_##type(ebur128_state* st, const type* src,          \
                                   size_t frames) {                             \
   static double scaling_factor = -((double) min_scale) > (double) max_scale ?  \
@@ -454,27 +527,29 @@ static void ebur128_filter_##type(ebur128_state* st, const type* src,          \
     ebur128_check_true_peak(st, frames);                                       \
   }                                                                            \
   for (c = 0; c < st->channels; ++c) {                                         \
-    int ci = st->d->channel_map[c] - 1;                                        \
-    if (ci < 0) continue;                                                      \
-    else if (ci > 4) ci = 0; /* dual mono */                                   \
+    double* v;                                                                 \
+    EBUR128_FILTER_PAIRS(type)                                                 \
+    if (c >= st->channels) break;                                              \
+    v = st->d->v[c];                                                           \
+    if (st->d->channel_map[c] == EBUR128_UNUSED) continue;                     \
     for (i = 0; i < frames; ++i) {                                             \
-      st->d->v[ci][0] = (double) (src[i * st->channels + c] / scaling_factor)  \
-                   - st->d->a[1] * st->d->v[ci][1]                             \
-                   - st->d->a[2] * st->d->v[ci][2]                             \
-                   - st->d->a[3] * st->d->v[ci][3]                             \
-                   - st->d->a[4] * st->d->v[ci][4];                            \
+      v[0] = (double) (src[i * st->channels + c] / scaling_factor)             \
+                   - st->d->a[1] * v[1]                                        \
+                   - st->d->a[2] * v[2]                                        \
+                   - st->d->a[3] * v[3]                                        \
+                   - st->d->a[4] * v[4];                                       \
       audio_data[i * st->channels + c] =                                       \
-                     st->d->b[0] * st->d->v[ci][0]                             \
-                   + st->d->b[1] * st->d->v[ci][1]                             \
-                   + st->d->b[2] * st->d->v[ci][2]                             \
-                   + st->d->b[3] * st->d->v[ci][3]                             \
-                   + st->d->b[4] * st->d->v[ci][4];                            \
-      st->d->v[ci][4] = st->d->v[ci][3];                                       \
-      st->d->v[ci][3] = st->d->v[ci][2];                                       \
-      st->d->v[ci][2] = st->d->v[ci][1];                                       \
-      st->d->v[ci][1] = st->d->v[ci][0];                                       \
+                     st->d->b[0] * v[0]                                        \
+                   + st->d->b[1] * v[1]                                        \
+                   + st->d->b[2] * v[2]                                        \
+                   + st->d->b[3] * v[3]                                        \
+                   + st->d->b[4] * v[4];                                       \
+      v[4] = v[3];                                                             \
+      v[3] = v[2];                                                             \
+      v[2] = v[1];                                                             \
+      v[1] = v[0];                                                             \
     }                                                                          \
-    FLUSH_MANUALLY                                                             \
+    FLUSH_MANUALLY(v)                                                          \
   }                                                                            \
   TURN_OFF_FTZ                                                                 \
 }
@@ -590,6 +665,7 @@ int ebur128_change_parameters(ebur128_state* st,
     unsigned int i;
 
     free(st->d->channel_map); st->d->channel_map = NULL;
+    free(st->d->v);           st->d->v = NULL;
     free(st->d->sample_peak); st->d->sample_peak = NULL;
     free(st->d->true_peak);   st->d->true_peak = NULL;
     st->channels = channels;
@@ -602,6 +678,8 @@ int ebur128_change_parameters(ebur128_state* st,
     errcode = ebur128_init_channel_map(st);
     CHECK_ERROR(errcode, EBUR128_ERROR_NOMEM, exit)
 
+    st->d->v = malloc(channels * sizeof(*st->d->v));
+    CHECK_ERROR(!st->d->v, EBUR128_ERROR_NOMEM, exit)
     st->d->sample_peak = (double*) malloc(channels * sizeof(double));
     CHECK_ERROR(!st->d->sample_peak, EBUR128_ERROR_NOMEM, exit)
     st->d->true_peak = (double*) malloc(channels * sizeof(double));
@@ -610,6 +688,7 @@ int ebur128_change_parameters(ebur128_state* st,
       st->d->sample_peak[i] = 0.0;
       st->d->true_peak[i] = 0.0;
     }
+    ebur128_init_filter(st);
   }
   if (samplerate != st->samplerate) {
     st->samplerate = samplerate;
@@ -50,6 +50,68 @@
 #include <strings.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/** threshold below which a pixel is considered static, for 8-bit samples */
+#define ADAPTIVE_THRESHOLD 10
+
+/** @internal @This defines the sample layouts of picture planes. */
+enum upipe_filter_blend_depth {
+    /** 8-bit samples */
+    UPIPE_FILTER_BLEND_DEPTH_8,
+    /** 16-bit samples in native endianness */
+    UPIPE_FILTER_BLEND_DEPTH_16,
+    /** 16-bit samples in swapped endianness */
+    UPIPE_FILTER_BLEND_DEPTH_16_SWAP
+};
+
+/** maximum number of planes in a picture */
+#define UPIPE_FILTER_BLEND_MAX_PLANES 8
+
+/** @internal @This describes a plane of the picture being processed. */
+struct upipe_filter_blend_job {
+    /** input plane */
+    const uint8_t *in;
+    /** plane of the previous picture, or NULL */
+    const uint8_t *prev;
+    /** output plane */
+    uint8_t *out;
+    /** stride of the input plane */
+    size_t stride_in;
+    /** stride of the plane of the previous picture */
+    size_t stride_prev;
+    /** stride of the output plane */
+    size_t stride_out;
+    /** number of lines of the plane */
+    size_t height;
+    /** sample layout of the plane */
+    enum upipe_filter_blend_depth depth;
+    /** number of significant bits per sample */
+    unsigned int bits;
+};
+
+/** @internal @This describes a thread processing a band of the pictures. */
+struct upipe_filter_blend_band {
+    /** pointer to the private structure of the pipe */
+    struct upipe_filter_blend *upipe_filter_blend;
+    /** index of the band */
+    unsigned int index;
+    /** thread processing the band */
+    pthread_t thread;
+    /** last picture counter seen by the thread */
+    unsigned int generation;
+};
 
 /** @hidden */
 static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
@@ -88,6 +150,32 @@ struct upipe_filter_blend {
     /** list of blockers (used during udeal) */
     struct uchain blockers;
 
+    /** deinterlacing mode */
+    enum upipe_filter_blend_mode mode;
+    /** previous input picture, in adaptive mode */
+    struct ubuf *prev;
+
+    /** planes of the picture being processed */
+    struct upipe_filter_blend_job jobs[UPIPE_FILTER_BLEND_MAX_PLANES];
+    /** number of planes of the picture being processed */
+    unsigned int nb_jobs;
+    /** number of bands processed in parallel */
+    unsigned int nb_bands;
+    /** array of nb_bands - 1 band threads, or NULL */
+    struct upipe_filter_blend_band *bands;
+    /** mutex protecting the band counters */
+    pthread_mutex_t band_mutex;
+    /** signals the band threads that a new picture is available */
+    pthread_cond_t band_start;
+    /** signals the pipe that a band thread has finished */
+    pthread_cond_t band_done;
+    /** picture counter, incremented for each picture given to the threads */
+    unsigned int band_generation;
+    /** number of band threads that haven't finished the current picture */
+    unsigned int band_pending;
+    /** true if the band threads must exit */
+    bool band_exit;
+
     /** public structure */
     struct upipe upipe;
 };
@@ -119,6 +207,20 @@ static struct upipe *upipe_filter_blend_alloc(struct upipe_mgr *mgr,
     if (unlikely(upipe == NULL))
         return NULL;
 
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    upipe_filter_blend->mode = UPIPE_FILTER_BLEND_MODE_BLEND;
+    upipe_filter_blend->prev = NULL;
+    upipe_filter_blend->nb_jobs = 0;
+    upipe_filter_blend->nb_bands = 1;
+    upipe_filter_blend->bands = NULL;
+    pthread_mutex_init(&upipe_filter_blend->band_mutex, NULL);
+    pthread_cond_init(&upipe_filter_blend->band_start, NULL);
+    pthread_cond_init(&upipe_filter_blend->band_done, NULL);
+    upipe_filter_blend->band_generation = 0;
+    upipe_filter_blend->band_pending = 0;
+    upipe_filter_blend->band_exit = false;
+
     upipe_filter_blend_init_urefcount(upipe);
     upipe_filter_blend_init_ubuf_mgr(upipe);
     upipe_filter_blend_init_output(upipe);
@@ -143,40 +245,522 @@ static void upipe_filter_merge8bit( void *_dest, const void *_s1,
     const uint8_t *s1 = _s1;
     const uint8_t *s2 = _s2;
 
+#ifdef __AVX2__
+    for( ; bytes >= 32; bytes -= 32, dest += 32, s1 += 32, s2 += 32 ) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s1);
+        __m256i b = _mm256_loadu_si256((const __m256i *)s2);
+        /* avg rounds up, remove the carry of odd sums */
+        __m256i m = _mm256_sub_epi8(_mm256_avg_epu8(a, b),
+                _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+        _mm256_storeu_si256((__m256i *)dest, m);
+    }
+#endif
+#if defined(__SSE2__)
+    for( ; bytes >= 16; bytes -= 16, dest += 16, s1 += 16, s2 += 16 ) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s1);
+        __m128i b = _mm_loadu_si128((const __m128i *)s2);
+        __m128i m = _mm_sub_epi8(_mm_avg_epu8(a, b),
+                _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+        _mm_storeu_si128((__m128i *)dest, m);
+    }
+#elif defined(__ARM_NEON)
+    for( ; bytes >= 16; bytes -= 16, dest += 16, s1 += 16, s2 += 16 )
+        vst1q_u8(dest, vhaddq_u8(vld1q_u8(s1), vld1q_u8(s2)));
+#endif
+
     for( ; bytes > 0; bytes-- )
         *dest++ = ( *s1++ + *s2++ ) >> 1;
 }
 
-/** @internal @This processes a picture plane
+/** @internal @This computes the per-pixel mean of two lines of 16-bit
+ * samples in native endianness.
+ *
+ * @param dest dest line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param samples length in samples
+ */
+static void upipe_filter_merge16bit(uint16_t *dest, const uint16_t *s1,
+                                    const uint16_t *s2, size_t samples)
+{
+#if defined(__SSE2__)
+    for ( ; samples >= 8; samples -= 8, dest += 8, s1 += 8, s2 += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s1);
+        __m128i b = _mm_loadu_si128((const __m128i *)s2);
+        __m128i m = _mm_sub_epi16(_mm_avg_epu16(a, b),
+                _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi16(1)));
+        _mm_storeu_si128((__m128i *)dest, m);
+    }
+#elif defined(__ARM_NEON)
+    for ( ; samples >= 8; samples -= 8, dest += 8, s1 += 8, s2 += 8)
+        vst1q_u16(dest, vhaddq_u16(vld1q_u16(s1), vld1q_u16(s2)));
+#endif
+
+    for ( ; samples > 0; samples--)
+        *dest++ = (*s1++ + *s2++) >> 1;
+}
+
+/** @internal @This computes a line of the second field in adaptive mode: each
+ * pixel is kept where it has not changed since the previous picture, and is
+ * otherwise interpolated from the lines above and below.
+ *
+ * @param dest dest line
+ * @param above line above, from the first field
+ * @param cur current line, from the second field
+ * @param below line below, from the first field
+ * @param prev same line in the previous picture
+ * @param bytes length in bytes
+ * @param threshold maximum difference of a static pixel
+ */
+static void upipe_filter_adaptive8bit(uint8_t *dest, const uint8_t *above,
+                                      const uint8_t *cur, const uint8_t *below,
+                                      const uint8_t *prev, size_t bytes,
+                                      uint8_t threshold)
+{
+#if defined(__SSE2__)
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i th = _mm_set1_epi8(threshold);
+    for ( ; bytes >= 16; bytes -= 16, dest += 16, above += 16, cur += 16,
+                         below += 16, prev += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)above);
+        __m128i b = _mm_loadu_si128((const __m128i *)below);
+        __m128i c = _mm_loadu_si128((const __m128i *)cur);
+        __m128i p = _mm_loadu_si128((const __m128i *)prev);
+        __m128i spatial = _mm_sub_epi8(_mm_avg_epu8(a, b),
+                _mm_and_si128(_mm_xor_si128(a, b), one));
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(c, p), _mm_subs_epu8(p, c));
+        __m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(diff, th),
+                                       _mm_setzero_si128());
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_or_si128(_mm_and_si128(still, c),
+                                      _mm_andnot_si128(still, spatial)));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t th = vdupq_n_u8(threshold);
+    for ( ; bytes >= 16; bytes -= 16, dest += 16, above += 16, cur += 16,
+                         below += 16, prev += 16) {
+        uint8x16_t c = vld1q_u8(cur);
+        uint8x16_t spatial = vhaddq_u8(vld1q_u8(above), vld1q_u8(below));
+        uint8x16_t still = vcleq_u8(vabdq_u8(c, vld1q_u8(prev)), th);
+        vst1q_u8(dest, vbslq_u8(still, c, spatial));
+    }
+#endif
+
+    for ( ; bytes > 0; bytes--) {
+        int diff = *cur - *prev++;
+        if (diff <= threshold && diff >= -threshold)
+            *dest = *cur;
+        else
+            *dest = (*above + *below) >> 1;
+        dest++; above++; cur++; below++;
+    }
+}
+
+/** @internal @This computes a line of the second field in adaptive mode,
+ * with 16-bit samples in native endianness.
+ *
+ * @param dest dest line
+ * @param above line above, from the first field
+ * @param cur current line, from the second field
+ * @param below line below, from the first field
+ * @param prev same line in the previous picture
+ * @param samples length in samples
+ * @param threshold maximum difference of a static pixel
+ */
+static void upipe_filter_adaptive16bit(uint16_t *dest, const uint16_t *above,
+                                       const uint16_t *cur,
+                                       const uint16_t *below,
+                                       const uint16_t *prev, size_t samples,
+                                       uint16_t threshold)
+{
+#if defined(__SSE2__)
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i th = _mm_set1_epi16(threshold);
+    for ( ; samples >= 8; samples -= 8, dest += 8, above += 8, cur += 8,
+                          below += 8, prev += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)above);
+        __m128i b = _mm_loadu_si128((const __m128i *)below);
+        __m128i c = _mm_loadu_si128((const __m128i *)cur);
+        __m128i p = _mm_loadu_si128((const __m128i *)prev);
+        __m128i spatial = _mm_sub_epi16(_mm_avg_epu16(a, b),
+                _mm_and_si128(_mm_xor_si128(a, b), one));
+        __m128i diff = _mm_or_si128(_mm_subs_epu16(c, p),
+                                    _mm_subs_epu16(p, c));
+        __m128i still = _mm_cmpeq_epi16(_mm_subs_epu16(diff, th),
+                                        _mm_setzero_si128());
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_or_si128(_mm_and_si128(still, c),
+                                      _mm_andnot_si128(still, spatial)));
+    }
+#elif defined(__ARM_NEON)
+    const uint16x8_t th = vdupq_n_u16(threshold);
+    for ( ; samples >= 8; samples -= 8, dest += 8, above += 8, cur += 8,
+                          below += 8, prev += 8) {
+        uint16x8_t c = vld1q_u16(cur);
+        uint16x8_t spatial = vhaddq_u16(vld1q_u16(above), vld1q_u16(below));
+        uint16x8_t still = vcleq_u16(vabdq_u16(c, vld1q_u16(prev)), th);
+        vst1q_u16(dest, vbslq_u16(still, c, spatial));
+    }
+#endif
+
+    for ( ; samples > 0; samples--) {
+        int diff = *cur - *prev++;
+        if (diff <= threshold && diff >= -threshold)
+            *dest = *cur;
+        else
+            *dest = (*above + *below) >> 1;
+        dest++; above++; cur++; below++;
+    }
+}
+
+/** @internal @This swaps the octets of 16-bit samples, for planes which are
+ * not in native endianness.
+ *
+ * @param line line of samples
+ * @param samples length in samples
+ */
+static void upipe_filter_blend_swap16(uint16_t *line, size_t samples)
+{
+    for ( ; samples > 0; samples--, line++)
+        *line = (*line << 8) | (*line >> 8);
+}
+
+/** @internal @This returns the sample layout of a plane, from its chroma
+ * name: names ending with a bit depth and an endianness, such as "y10l",
+ * have 16-bit samples.
+ *
+ * @param chroma chroma type
+ * @param bits_p filled in with the number of significant bits per sample
+ * @return sample layout of the plane
+ */
+static enum upipe_filter_blend_depth
+    upipe_filter_blend_get_depth(const char *chroma, unsigned int *bits_p)
+{
+    size_t len = strlen(chroma);
+    *bits_p = 8;
+    if (len < 3 || (chroma[len - 1] != 'l' && chroma[len - 1] != 'b') ||
+        chroma[len - 2] < '0' || chroma[len - 2] > '9')
+        return UPIPE_FILTER_BLEND_DEPTH_8;
+
+    size_t start = len - 2;
+    while (start > 0 && chroma[start - 1] >= '0' && chroma[start - 1] <= '9')
+        start--;
+    *bits_p = atoi(chroma + start);
+    if (*bits_p <= 8 || *bits_p > 16) {
+        *bits_p = 8;
+        return UPIPE_FILTER_BLEND_DEPTH_8;
+    }
+#ifdef UPIPE_WORDS_BIGENDIAN
+    return chroma[len - 1] == 'b' ? UPIPE_FILTER_BLEND_DEPTH_16 :
+                                    UPIPE_FILTER_BLEND_DEPTH_16_SWAP;
+#else
+    return chroma[len - 1] == 'l' ? UPIPE_FILTER_BLEND_DEPTH_16 :
+                                    UPIPE_FILTER_BLEND_DEPTH_16_SWAP;
+#endif
+}
+
+/** @internal @This computes the mean of two lines of any sample layout.
+ *
+ * @param out output line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param bytes length in bytes
+ * @param depth sample layout
+ */
+static void upipe_filter_blend_line(uint8_t *out, const uint8_t *s1,
+                                    const uint8_t *s2, size_t bytes,
+                                    enum upipe_filter_blend_depth depth)
+{
+    if (depth == UPIPE_FILTER_BLEND_DEPTH_8) {
+        upipe_filter_merge8bit(out, s1, s2, bytes);
+        return;
+    }
+
+    size_t samples = bytes / 2;
+    if (depth == UPIPE_FILTER_BLEND_DEPTH_16) {
+        upipe_filter_merge16bit((uint16_t *)out, (const uint16_t *)s1,
+                                (const uint16_t *)s2, samples);
+        return;
+    }
+
+    /* swap the sources once in the output line, then merge in place */
+    uint16_t tmp[samples];
+    memcpy(tmp, s2, samples * 2);
+    memcpy(out, s1, samples * 2);
+    upipe_filter_blend_swap16((uint16_t *)out, samples);
+    upipe_filter_blend_swap16(tmp, samples);
+    upipe_filter_merge16bit((uint16_t *)out, (const uint16_t *)out, tmp,
+                            samples);
+    upipe_filter_blend_swap16((uint16_t *)out, samples);
+}
+
+/** @internal @This processes lines of a picture plane
  * Adapted from VLC.
  * - modules/video_filter/deinterlace/algo_basic.c 
  *
- * @param in input buffer
- * @param out output buffer
- * @param stride_in stride length of input buffer
- * @param stride_out stride length of output buffer
- * @param height picture height
+ * @param job description of the plane
+ * @param start first line to process
+ * @param end line following the last line to process
  */
-static void upipe_filter_blend_plane(const uint8_t *in, uint8_t *out,
-                                     size_t stride_in, size_t stride_out,
-                                     size_t height)
+static void upipe_filter_blend_plane(const struct upipe_filter_blend_job *job,
+                                     size_t start, size_t end)
 {
-    uint8_t *out_end = out + stride_out * height;
+    size_t bytes = job->stride_in < job->stride_out ?
+                   job->stride_in : job->stride_out;
+    const uint8_t *in = job->in + job->stride_in * start;
+    uint8_t *out = job->out + job->stride_out * start;
+    uint8_t *out_end = job->out + job->stride_out * end;
 
     // Copy first line
-    memcpy(out, in, stride_in);
-    out += stride_out;
+    if (start == 0 && out < out_end) {
+        memcpy(out, in, bytes);
+        out += job->stride_out;
+    } else
+        in -= job->stride_in;
 
     // Compute mean value for remaining lines
     while (out < out_end) {
-        upipe_filter_merge8bit(out, in, in+stride_in,
-           (stride_in < stride_out) ? stride_in : stride_out);
+        upipe_filter_blend_line(out, in, in + job->stride_in, bytes,
+                                job->depth);
+
+        out += job->stride_out;
+        in += job->stride_in;
+    }
+}
+
+/** @internal @This processes lines of a picture plane in adaptive mode. The
+ * lines of the first field are copied, and the lines of the second field are
+ * compared to the previous picture.
+ *
+ * @param job description of the plane
+ * @param start first line to process
+ * @param end line following the last line to process
+ */
+static void upipe_filter_adaptive_plane(
+        const struct upipe_filter_blend_job *job, size_t start, size_t end)
+{
+    const uint8_t *in = job->in, *prev = job->prev;
+    uint8_t *out = job->out;
+    size_t stride_in = job->stride_in, stride_prev = job->stride_prev;
+    size_t stride_out = job->stride_out, height = job->height;
+    enum upipe_filter_blend_depth depth = job->depth;
+    size_t bytes = stride_in < stride_out ? stride_in : stride_out;
+    if (stride_prev < bytes)
+        bytes = stride_prev;
+    unsigned int threshold = ADAPTIVE_THRESHOLD << (job->bits - 8);
+
+    size_t y;
+    for (y = start; y < end; y++) {
+        const uint8_t *cur = in + y * stride_in;
+        uint8_t *dest = out + y * stride_out;
+        if (!(y & 1) || y + 1 >= height) {
+            memcpy(dest, cur, bytes);
+            continue;
+        }
 
-        out += stride_out;
-        in += stride_in;
+        const uint8_t *above = cur - stride_in;
+        const uint8_t *below = cur + stride_in;
+        const uint8_t *last = prev + y * stride_prev;
+        if (depth == UPIPE_FILTER_BLEND_DEPTH_8) {
+            upipe_filter_adaptive8bit(dest, above, cur, below, last, bytes,
+                                      threshold);
+            continue;
+        }
+
+        size_t samples = bytes / 2;
+        if (depth == UPIPE_FILTER_BLEND_DEPTH_16) {
+            upipe_filter_adaptive16bit((uint16_t *)dest,
+                    (const uint16_t *)above, (const uint16_t *)cur,
+                    (const uint16_t *)below, (const uint16_t *)last,
+                    samples, threshold);
+            continue;
+        }
+
+        uint16_t lines[4][samples];
+        memcpy(lines[0], above, samples * 2);
+        memcpy(lines[1], cur, samples * 2);
+        memcpy(lines[2], below, samples * 2);
+        memcpy(lines[3], last, samples * 2);
+        for (int i = 0; i < 4; i++)
+            upipe_filter_blend_swap16(lines[i], samples);
+        upipe_filter_adaptive16bit((uint16_t *)dest, lines[0], lines[1],
+                                   lines[2], lines[3], samples, threshold);
+        upipe_filter_blend_swap16((uint16_t *)dest, samples);
+    }
+}
+
+/** @internal @This processes a band of all the planes of the current picture.
+ *
+ * @param upipe_filter_blend private structure of the pipe
+ * @param band index of the band
+ */
+static void upipe_filter_blend_process_band(
+        struct upipe_filter_blend *upipe_filter_blend, unsigned int band)
+{
+    unsigned int nb_bands = upipe_filter_blend->nb_bands;
+    for (unsigned int i = 0; i < upipe_filter_blend->nb_jobs; i++) {
+        const struct upipe_filter_blend_job *job =
+            &upipe_filter_blend->jobs[i];
+        size_t start = job->height * band / nb_bands;
+        size_t end = job->height * (band + 1) / nb_bands;
+        if (job->prev != NULL)
+            upipe_filter_adaptive_plane(job, start, end);
+        else
+            upipe_filter_blend_plane(job, start, end);
     }
 }
 
+/** @internal @This is the main loop of the threads processing bands.
+ *
+ * @param opaque description structure of the band
+ * @return NULL
+ */
+static void *upipe_filter_blend_band_thread(void *opaque)
+{
+    struct upipe_filter_blend_band *band = opaque;
+    struct upipe_filter_blend *upipe_filter_blend = band->upipe_filter_blend;
+
+    pthread_mutex_lock(&upipe_filter_blend->band_mutex);
+    for ( ; ; ) {
+        while (!upipe_filter_blend->band_exit &&
+               upipe_filter_blend->band_generation == band->generation)
+            pthread_cond_wait(&upipe_filter_blend->band_start,
+                              &upipe_filter_blend->band_mutex);
+        if (upipe_filter_blend->band_exit)
+            break;
+        band->generation = upipe_filter_blend->band_generation;
+        pthread_mutex_unlock(&upipe_filter_blend->band_mutex);
+
+        upipe_filter_blend_process_band(upipe_filter_blend, band->index);
+
+        pthread_mutex_lock(&upipe_filter_blend->band_mutex);
+        if (!--upipe_filter_blend->band_pending)
+            pthread_cond_signal(&upipe_filter_blend->band_done);
+    }
+    pthread_mutex_unlock(&upipe_filter_blend->band_mutex);
+    return NULL;
+}
+
+/** @internal @This processes all the planes of the current picture, in
+ * parallel bands if configured.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_filter_blend_process(struct upipe *upipe)
+{
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    if (upipe_filter_blend->bands == NULL) {
+        upipe_filter_blend_process_band(upipe_filter_blend, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&upipe_filter_blend->band_mutex);
+    upipe_filter_blend->band_pending = upipe_filter_blend->nb_bands - 1;
+    upipe_filter_blend->band_generation++;
+    pthread_cond_broadcast(&upipe_filter_blend->band_start);
+    pthread_mutex_unlock(&upipe_filter_blend->band_mutex);
+
+    upipe_filter_blend_process_band(upipe_filter_blend, 0);
+
+    pthread_mutex_lock(&upipe_filter_blend->band_mutex);
+    while (upipe_filter_blend->band_pending)
+        pthread_cond_wait(&upipe_filter_blend->band_done,
+                          &upipe_filter_blend->band_mutex);
+    pthread_mutex_unlock(&upipe_filter_blend->band_mutex);
+}
+
+/** @internal @This stops the band threads.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_filter_blend_clean_bands(struct upipe *upipe)
+{
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    if (upipe_filter_blend->bands == NULL)
+        return;
+
+    pthread_mutex_lock(&upipe_filter_blend->band_mutex);
+    upipe_filter_blend->band_exit = true;
+    pthread_cond_broadcast(&upipe_filter_blend->band_start);
+    pthread_mutex_unlock(&upipe_filter_blend->band_mutex);
+
+    for (unsigned int i = 1; i < upipe_filter_blend->nb_bands; i++)
+        pthread_join(upipe_filter_blend->bands[i - 1].thread, NULL);
+    free(upipe_filter_blend->bands);
+    upipe_filter_blend->bands = NULL;
+    upipe_filter_blend->band_exit = false;
+    upipe_filter_blend->nb_bands = 1;
+}
+
+/** @internal @This sets the number of bands processed in parallel, starting
+ * a thread for each band but the first one.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands number of bands
+ * @return an error code
+ */
+static int _upipe_filter_blend_set_bands(struct upipe *upipe,
+                                         unsigned int nb_bands)
+{
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    if (unlikely(!nb_bands))
+        return UBASE_ERR_INVALID;
+    if (nb_bands == upipe_filter_blend->nb_bands)
+        return UBASE_ERR_NONE;
+    upipe_filter_blend_clean_bands(upipe);
+    if (nb_bands == 1)
+        return UBASE_ERR_NONE;
+
+    upipe_filter_blend->bands =
+        calloc(nb_bands - 1, sizeof(struct upipe_filter_blend_band));
+    UBASE_ALLOC_RETURN(upipe_filter_blend->bands)
+    for (unsigned int i = 1; i < nb_bands; i++) {
+        struct upipe_filter_blend_band *band = &upipe_filter_blend->bands[i - 1];
+        band->upipe_filter_blend = upipe_filter_blend;
+        band->index = i;
+        band->generation = upipe_filter_blend->band_generation;
+        if (unlikely(pthread_create(&band->thread, NULL,
+                                    upipe_filter_blend_band_thread,
+                                    band) != 0)) {
+            upipe_err_va(upipe, "unable to create band thread (%m)");
+            upipe_filter_blend_clean_bands(upipe);
+            return UBASE_ERR_EXTERNAL;
+        }
+        upipe_filter_blend->nb_bands = i + 1;
+    }
+    upipe_dbg_va(upipe, "processing in %u bands", nb_bands);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This unmaps the planes mapped for the current picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref input picture
+ * @param ubuf_deint output picture
+ * @param ubuf_prev previous picture, or NULL
+ */
+static void upipe_filter_blend_unmap(struct upipe *upipe, struct uref *uref,
+                                     struct ubuf *ubuf_deint,
+                                     struct ubuf *ubuf_prev)
+{
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    const char *chroma = NULL;
+    unsigned int i = 0;
+    while (i < upipe_filter_blend->nb_jobs &&
+           ubase_check(uref_pic_plane_iterate(uref, &chroma)) && chroma) {
+        uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+        ubuf_pic_plane_unmap(ubuf_deint, chroma, 0, 0, -1, -1);
+        if (upipe_filter_blend->jobs[i].prev != NULL)
+            ubuf_pic_plane_unmap(ubuf_prev, chroma, 0, 0, -1, -1);
+        i++;
+    }
+    upipe_filter_blend->nb_jobs = 0;
+}
+
 /** @internal @This handles input.
  *
  * @param upipe description structure of the pipe
@@ -190,6 +774,10 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     struct upipe_filter_blend *upipe_filter_blend = upipe_filter_blend_from_upipe(upipe);
     const char *def;
     if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        if (upipe_filter_blend->prev != NULL) {
+            ubuf_free(upipe_filter_blend->prev);
+            upipe_filter_blend->prev = NULL;
+        }
         upipe_filter_blend_store_flow_def(upipe, NULL);
         upipe_filter_blend_require_ubuf_mgr(upipe, uref);
         return true;
@@ -198,12 +786,10 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     if (upipe_filter_blend->flow_def == NULL)
         return false;
 
-    const uint8_t *in;
-    uint8_t *out;
     uint8_t hsub, vsub;
-    size_t stride_in = 0, stride_out = 0, width, height;
+    size_t width, height;
     const char *chroma = NULL;
-    struct ubuf *ubuf_deint = NULL;
+    struct ubuf *ubuf_deint = NULL, *ubuf_prev = NULL;
 
     // Now process frames
     uref_pic_size(uref, &width, &height, NULL);
@@ -216,28 +802,69 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
         goto error;
     }
 
-    // Iterate planes
+    /* the previous picture is only usable if it has the same size */
+    ubuf_prev = NULL;
+    if (upipe_filter_blend->mode == UPIPE_FILTER_BLEND_MODE_ADAPTIVE &&
+        upipe_filter_blend->prev != NULL) {
+        size_t prev_width, prev_height;
+        if (ubase_check(ubuf_pic_size(upipe_filter_blend->prev,
+                                      &prev_width, &prev_height, NULL)) &&
+            prev_width == width && prev_height == height)
+            ubuf_prev = upipe_filter_blend->prev;
+    }
+
+    // Map all planes
+    upipe_filter_blend->nb_jobs = 0;
     while (ubase_check(uref_pic_plane_iterate(uref, &chroma)) && chroma) {
-        // map all
-        if (unlikely(!ubase_check(uref_pic_plane_size(uref, chroma, &stride_in,
-                                                &hsub, &vsub, NULL)))) {
+        struct upipe_filter_blend_job *job =
+            &upipe_filter_blend->jobs[upipe_filter_blend->nb_jobs];
+        if (unlikely(upipe_filter_blend->nb_jobs >=
+                     UPIPE_FILTER_BLEND_MAX_PLANES)) {
+            upipe_err(upipe, "too many planes");
+            goto error;
+        }
+        if (unlikely(!ubase_check(uref_pic_plane_size(uref, chroma,
+                                    &job->stride_in, &hsub, &vsub, NULL)))) {
             upipe_err_va(upipe, "Could not read origin chroma %s", chroma);
             goto error;
         }
-        if (unlikely(!ubase_check(ubuf_pic_plane_size(ubuf_deint, chroma, &stride_out,
-                                                  NULL, NULL, NULL)))) {
+        if (unlikely(!ubase_check(ubuf_pic_plane_size(ubuf_deint, chroma,
+                                    &job->stride_out, NULL, NULL, NULL)))) {
             upipe_err_va(upipe, "Could not read dest chroma %s", chroma);
             goto error;
         }
-        uref_pic_plane_read(uref, chroma, 0, 0, -1, -1, &in);
-        ubuf_pic_plane_write(ubuf_deint, chroma, 0, 0, -1, -1, &out);
+        if (unlikely(!ubase_check(uref_pic_plane_read(uref, chroma,
+                                    0, 0, -1, -1, &job->in)))) {
+            upipe_err_va(upipe, "Could not map origin chroma %s", chroma);
+            goto error;
+        }
+        if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf_deint, chroma,
+                                    0, 0, -1, -1, &job->out)))) {
+            uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+            upipe_err_va(upipe, "Could not map dest chroma %s", chroma);
+            goto error;
+        }
+        job->prev = NULL;
+        if (ubuf_prev != NULL &&
+            (!ubase_check(ubuf_pic_plane_size(ubuf_prev, chroma,
+                                    &job->stride_prev, NULL, NULL, NULL)) ||
+             !ubase_check(ubuf_pic_plane_read(ubuf_prev, chroma,
+                                    0, 0, -1, -1, &job->prev))))
+            job->prev = NULL;
+        job->height = height / vsub;
+        job->depth = upipe_filter_blend_get_depth(chroma, &job->bits);
+        upipe_filter_blend->nb_jobs++;
+    }
 
-        // process plane
-        upipe_filter_blend_plane(in, out, stride_in, stride_out, (size_t) height/vsub);
+    // Process planes
+    upipe_filter_blend_process(upipe);
+    upipe_filter_blend_unmap(upipe, uref, ubuf_deint, ubuf_prev);
 
-        // unmap all
-        uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
-        ubuf_pic_plane_unmap(ubuf_deint, chroma, 0, 0, -1, -1);
+    // Keep the input picture as reference for the next one
+    if (upipe_filter_blend->mode == UPIPE_FILTER_BLEND_MODE_ADAPTIVE) {
+        if (upipe_filter_blend->prev != NULL)
+            ubuf_free(upipe_filter_blend->prev);
+        upipe_filter_blend->prev = uref_detach_ubuf(uref);
     }
 
     // Attach new ubuf and output frame
@@ -249,10 +876,11 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     return true;
 
 error:
-    uref_free(uref);
     if (ubuf_deint) {
+        upipe_filter_blend_unmap(upipe, uref, ubuf_deint, ubuf_prev);
         ubuf_free(ubuf_deint);
     }
+    uref_free(uref);
     return true;
 }
 
@@ -337,6 +965,8 @@ static int upipe_filter_blend_set_flow_def(struct upipe *upipe,
 static int upipe_filter_blend_control(struct upipe *upipe,
                                       int command, va_list args)
 {
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
     switch (command) {
         case UPIPE_REGISTER_REQUEST: {
             struct urequest *request = va_arg(args, struct urequest *);
@@ -368,6 +998,38 @@ static int upipe_filter_blend_control(struct upipe *upipe,
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_filter_blend_set_output(upipe, output);
         }
+
+        case UPIPE_FILTER_BLEND_GET_MODE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_BLEND_SIGNATURE)
+            int *mode_p = va_arg(args, int *);
+            *mode_p = upipe_filter_blend->mode;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_FILTER_BLEND_GET_BANDS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_BLEND_SIGNATURE)
+            unsigned int *nb_bands_p = va_arg(args, unsigned int *);
+            *nb_bands_p = upipe_filter_blend->nb_bands;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_FILTER_BLEND_SET_BANDS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_BLEND_SIGNATURE)
+            unsigned int nb_bands = va_arg(args, unsigned int);
+            return _upipe_filter_blend_set_bands(upipe, nb_bands);
+        }
+        case UPIPE_FILTER_BLEND_SET_MODE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_BLEND_SIGNATURE)
+            int mode = va_arg(args, int);
+            if (mode != UPIPE_FILTER_BLEND_MODE_BLEND &&
+                mode != UPIPE_FILTER_BLEND_MODE_ADAPTIVE)
+                return UBASE_ERR_INVALID;
+            upipe_filter_blend->mode = mode;
+            if (mode != UPIPE_FILTER_BLEND_MODE_ADAPTIVE &&
+                upipe_filter_blend->prev != NULL) {
+                ubuf_free(upipe_filter_blend->prev);
+                upipe_filter_blend->prev = NULL;
+            }
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -379,8 +1041,17 @@ static int upipe_filter_blend_control(struct upipe *upipe,
  */
 static void upipe_filter_blend_free(struct upipe *upipe)
 {
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
     upipe_throw_dead(upipe);
 
+    if (upipe_filter_blend->prev != NULL)
+        ubuf_free(upipe_filter_blend->prev);
+    upipe_filter_blend_clean_bands(upipe);
+    pthread_cond_destroy(&upipe_filter_blend->band_done);
+    pthread_cond_destroy(&upipe_filter_blend->band_start);
+    pthread_mutex_destroy(&upipe_filter_blend->band_mutex);
+
     upipe_filter_blend_clean_input(upipe);
     upipe_filter_blend_clean_ubuf_mgr(upipe);
     upipe_filter_blend_clean_output(upipe);
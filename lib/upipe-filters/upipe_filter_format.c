@@ -28,6 +28,7 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_prefix.h>
 #include <upipe/uref.h>
@@ -54,6 +55,9 @@
 #include <string.h>
 #include <assert.h>
 
+/** maximum number of conversion chains kept aside for later reuse */
+#define CACHE_SIZE 4
+
 /** @internal @This is the private context of a ffmt manager. */
 struct upipe_ffmt_mgr {
     /** refcount management structure */
@@ -80,6 +84,22 @@ static bool upipe_ffmt_handle(struct upipe *upipe, struct uref *uref,
 static int upipe_ffmt_check_flow_format(struct upipe *upipe,
                                         struct uref *flow_format);
 
+/** @internal @This is a conversion chain kept aside by a ffmt pipe. */
+struct upipe_ffmt_chain {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** input flow definition the chain was built for */
+    struct uref *flow_def_input;
+    /** flow format the chain was built for */
+    struct uref *flow_def_format;
+    /** first inner pipe of the chain */
+    struct upipe *first_inner;
+    /** last inner pipe of the chain */
+    struct upipe *last_inner;
+};
+
+UBASE_FROM_TO(upipe_ffmt_chain, uchain, uchain, uchain)
+
 /** @internal @This is the private context of a ffmt pipe. */
 struct upipe_ffmt {
     /** real refcount management structure */
@@ -99,6 +119,12 @@ struct upipe_ffmt {
     struct uref *flow_def_input;
     /** flow definition wanted on the output */
     struct uref *flow_def_wanted;
+    /** flow format the current inner pipes were built for */
+    struct uref *flow_def_format;
+    /** list of conversion chains kept aside, most recently used first */
+    struct uchain chains;
+    /** number of conversion chains kept aside */
+    unsigned int nb_chains;
     /** list of input bin requests */
     struct uchain input_request_list;
     /** list of output bin requests */
@@ -162,6 +188,94 @@ static int upipe_ffmt_proxy_probe(struct uprobe *uprobe, struct upipe *inner,
     return upipe_throw_proxy(upipe, inner, event, args);
 }
 
+/** @internal @This frees a conversion chain kept aside.
+ *
+ * @param chain conversion chain
+ */
+static void upipe_ffmt_chain_free(struct upipe_ffmt_chain *chain)
+{
+    ulist_delete(upipe_ffmt_chain_to_uchain(chain));
+    uref_free(chain->flow_def_input);
+    uref_free(chain->flow_def_format);
+    upipe_release(chain->first_inner);
+    upipe_release(chain->last_inner);
+    free(chain);
+}
+
+/** @internal @This keeps the current inner pipes aside, so that they can
+ * be reused if the same input and output formats come back, and detaches
+ * them from the bin.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ffmt_park(struct upipe *upipe)
+{
+    struct upipe_ffmt *upipe_ffmt = upipe_ffmt_from_upipe(upipe);
+    struct upipe_ffmt_chain *chain;
+    if (upipe_ffmt->first_inner == NULL || upipe_ffmt->last_inner == NULL ||
+        upipe_ffmt->flow_def_input == NULL ||
+        upipe_ffmt->flow_def_input->udict == NULL ||
+        upipe_ffmt->flow_def_format == NULL ||
+        upipe_ffmt->flow_def_format->udict == NULL ||
+        (chain = malloc(sizeof(struct upipe_ffmt_chain))) == NULL) {
+        uref_free(upipe_ffmt->flow_def_format);
+        upipe_ffmt->flow_def_format = NULL;
+        upipe_ffmt_store_first_inner(upipe, NULL);
+        upipe_ffmt_store_last_inner(upipe, NULL);
+        return;
+    }
+
+    chain->flow_def_input = upipe_ffmt->flow_def_input;
+    chain->flow_def_format = upipe_ffmt->flow_def_format;
+    chain->first_inner = upipe_use(upipe_ffmt->first_inner);
+    chain->last_inner = upipe_use(upipe_ffmt->last_inner);
+    upipe_ffmt->flow_def_input = NULL;
+    upipe_ffmt->flow_def_format = NULL;
+    upipe_set_output(chain->last_inner, NULL);
+    upipe_ffmt_store_first_inner(upipe, NULL);
+    upipe_ffmt_store_last_inner(upipe, NULL);
+
+    ulist_unshift(&upipe_ffmt->chains, upipe_ffmt_chain_to_uchain(chain));
+    if (++upipe_ffmt->nb_chains > CACHE_SIZE) {
+        upipe_ffmt_chain_free(
+                upipe_ffmt_chain_from_uchain(upipe_ffmt->chains.prev));
+        upipe_ffmt->nb_chains--;
+    }
+}
+
+/** @internal @This looks up a conversion chain kept aside for the current
+ * input flow definition and the given flow format, and if found, makes it
+ * the current inner pipes.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format flow format answered by the request
+ * @return true if a chain was found
+ */
+static bool upipe_ffmt_unpark(struct upipe *upipe, struct uref *flow_format)
+{
+    struct upipe_ffmt *upipe_ffmt = upipe_ffmt_from_upipe(upipe);
+    if (upipe_ffmt->flow_def_input->udict == NULL ||
+        flow_format->udict == NULL)
+        return false;
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ffmt->chains, uchain) {
+        struct upipe_ffmt_chain *chain = upipe_ffmt_chain_from_uchain(uchain);
+        if (udict_cmp(chain->flow_def_input->udict,
+                      upipe_ffmt->flow_def_input->udict) ||
+            udict_cmp(chain->flow_def_format->udict, flow_format->udict))
+            continue;
+
+        upipe_dbg(upipe, "reusing conversion chain");
+        upipe_ffmt_store_first_inner(upipe, upipe_use(chain->first_inner));
+        upipe_ffmt_store_last_inner(upipe, upipe_use(chain->last_inner));
+        upipe_ffmt_chain_free(chain);
+        upipe_ffmt->nb_chains--;
+        return true;
+    }
+    return false;
+}
+
 /** @internal @This allocates a ffmt pipe.
  *
  * @param mgr common management structure
@@ -192,6 +306,9 @@ static struct upipe *upipe_ffmt_alloc(struct upipe_mgr *mgr,
         upipe_ffmt_to_urefcount_real(upipe_ffmt);
     upipe_ffmt->flow_def_input = NULL;
     upipe_ffmt->flow_def_wanted = flow_def;
+    upipe_ffmt->flow_def_format = NULL;
+    ulist_init(&upipe_ffmt->chains);
+    upipe_ffmt->nb_chains = 0;
     upipe_ffmt->sws_flags = 0;
     upipe_throw_ready(upipe);
 
@@ -217,6 +334,7 @@ static bool upipe_ffmt_handle(struct upipe *upipe, struct uref *uref,
             uref_free(uref);
             return true;
         }
+        upipe_ffmt_park(upipe);
         uref_free(upipe_ffmt->flow_def_input);
         upipe_ffmt->flow_def_input = uref_dup(uref);
         if (unlikely(upipe_ffmt->flow_def_input == NULL)) {
@@ -234,8 +352,6 @@ static bool upipe_ffmt_handle(struct upipe *upipe, struct uref *uref,
             free(old_def);
         }
 
-        upipe_ffmt_store_first_inner(upipe, NULL);
-        upipe_ffmt_store_last_inner(upipe, NULL);
         upipe_ffmt_require_flow_format(upipe, uref);
         return true;
     }
@@ -287,6 +403,14 @@ static int upipe_ffmt_check_flow_format(struct upipe *upipe,
     const char *def;
     UBASE_RETURN(uref_flow_get_def(flow_def, &def))
 
+    /* a flow format request may be answered again for the same input */
+    uref_free(upipe_ffmt->flow_def_format);
+    upipe_ffmt->flow_def_format = NULL;
+    upipe_ffmt_store_first_inner(upipe, NULL);
+    upipe_ffmt_store_last_inner(upipe, NULL);
+    bool reused = upipe_ffmt_unpark(upipe, flow_def_dup);
+    upipe_ffmt->flow_def_format = uref_dup(flow_def_dup);
+
     if (!ubase_ncmp(def, "pic.")) {
         /* check aspect ratio */
         struct urational sar, dar;
@@ -312,7 +436,7 @@ static int upipe_ffmt_check_flow_format(struct upipe *upipe,
                         uref_pic_flow_cmp_hsize(flow_def, flow_def_dup) ||
                         uref_pic_flow_cmp_vsize(flow_def, flow_def_dup);
 
-        if (need_deint) {
+        if (!reused && need_deint) {
             struct upipe *input = upipe_void_alloc(ffmt_mgr->deint_mgr,
                     uprobe_pfx_alloc(
                         need_sws ? uprobe_use(&upipe_ffmt->proxy_probe) :
@@ -325,7 +449,7 @@ static int upipe_ffmt_check_flow_format(struct upipe *upipe,
             upipe_ffmt_store_first_inner(upipe, input);
         }
 
-        if (need_sws) {
+        if (!reused && need_sws) {
             struct upipe *sws = upipe_flow_alloc(ffmt_mgr->sws_mgr,
                     uprobe_pfx_alloc(uprobe_use(&upipe_ffmt->last_inner_probe),
                                      UPROBE_LOG_VERBOSE, "sws"),
@@ -342,7 +466,7 @@ static int upipe_ffmt_check_flow_format(struct upipe *upipe,
                 upipe_sws_set_flags(sws, upipe_ffmt->sws_flags);
         }
 
-    } else { /* sound. */
+    } else if (!reused) { /* sound. */
         if (!uref_sound_flow_compare_format(flow_def, flow_def_dup) ||
             uref_sound_flow_cmp_rate(flow_def, flow_def_dup)) {
             struct upipe *input = upipe_flow_alloc(ffmt_mgr->swr_mgr,
@@ -378,6 +502,8 @@ static int upipe_ffmt_check_flow_format(struct upipe *upipe,
     uref_free(flow_def);
 
     if (!ubase_check(err)) {
+        uref_free(upipe_ffmt->flow_def_format);
+        upipe_ffmt->flow_def_format = NULL;
         upipe_ffmt_store_first_inner(upipe, NULL);
         upipe_ffmt_store_last_inner(upipe, NULL);
         return err;
@@ -476,6 +602,7 @@ static void upipe_ffmt_free(struct urefcount *urefcount_real)
     upipe_ffmt_clean_flow_format(upipe);
     uref_free(upipe_ffmt->flow_def_input);
     uref_free(upipe_ffmt->flow_def_wanted);
+    uref_free(upipe_ffmt->flow_def_format);
     uprobe_clean(&upipe_ffmt->proxy_probe);
     uprobe_clean(&upipe_ffmt->last_inner_probe);
     urefcount_clean(urefcount_real);
@@ -490,6 +617,11 @@ static void upipe_ffmt_free(struct urefcount *urefcount_real)
 static void upipe_ffmt_no_ref(struct upipe *upipe)
 {
     struct upipe_ffmt *upipe_ffmt = upipe_ffmt_from_upipe(upipe);
+    /* inner pipes kept aside hold references to our probes */
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_ffmt->chains, uchain, uchain_tmp)
+        upipe_ffmt_chain_free(upipe_ffmt_chain_from_uchain(uchain));
+    upipe_ffmt->nb_chains = 0;
     upipe_ffmt_clean_bin_input(upipe);
     upipe_ffmt_clean_bin_output(upipe);
     urefcount_release(upipe_ffmt_to_urefcount_real(upipe_ffmt));
@@ -53,6 +53,8 @@
 
 #include <bitstream/atsc/a52.h>
 
+#include "upipe_framers_common.h"
+
 /** @internal @This is the private context of an a52f pipe. */
 struct upipe_a52f {
     /** refcount management structure */
@@ -81,6 +83,8 @@ struct upipe_a52f {
     uint64_t duration_residue;
     /** true we have had a discontinuity recently */
     bool got_discontinuity;
+    /** grouping of output frames */
+    struct upipe_framers_batch batch;
     /** sync header */
     uint8_t sync_header[A52_SYNCINFO_SIZE];
 
@@ -118,6 +122,20 @@ UPIPE_HELPER_UREF_STREAM(upipe_a52f, next_uref, next_uref_size, urefs,
 UPIPE_HELPER_OUTPUT(upipe_a52f, output, flow_def, output_state, request_list)
 UPIPE_HELPER_FLOW_DEF(upipe_a52f, flow_def_input, flow_def_attr)
 
+/** @internal @This outputs the current group of frames, if any.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_a52f_flush_batch(struct upipe *upipe,
+                                   struct upump **upump_p)
+{
+    struct upipe_a52f *upipe_a52f = upipe_a52f_from_upipe(upipe);
+    struct uref *uref = upipe_framers_batch_flush(&upipe_a52f->batch);
+    if (uref != NULL)
+        upipe_a52f_output(upipe, uref, upump_p);
+}
+
 /** @internal @This flushes all dates.
  *
  * @param upipe description structure of the pipe
@@ -159,6 +177,7 @@ static struct upipe *upipe_a52f_alloc(struct upipe_mgr *mgr,
     upipe_a52f->input_latency = 0;
     upipe_a52f->samplerate = 0;
     upipe_a52f->got_discontinuity = false;
+    upipe_framers_batch_init(&upipe_a52f->batch);
     upipe_a52f->next_frame_size = -1;
     uref_init(&upipe_a52f->au_uref_s);
     upipe_a52f_flush_dates(upipe);
@@ -302,6 +321,7 @@ static bool upipe_a52f_parse_a52e(struct upipe *upipe)
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return false;
     }
+    upipe_a52f_flush_batch(upipe, NULL);
     upipe_a52f_store_flow_def(upipe, flow_def);
 
     return true;
@@ -370,6 +390,7 @@ static bool upipe_a52f_parse_a52(struct upipe *upipe)
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return false;
     }
+    upipe_a52f_flush_batch(upipe, NULL);
     upipe_a52f_store_flow_def(upipe, flow_def);
 
     return true;
@@ -442,10 +463,15 @@ static void upipe_a52f_output_frame(struct upipe *upipe, struct upump **upump_p)
 
     UBASE_FATAL(upipe, uref_clock_set_duration(uref, duration))
 
-    if (upipe_a52f->got_discontinuity)
+    if (upipe_a52f->got_discontinuity) {
+        upipe_a52f_flush_batch(upipe, upump_p);
         uref_flow_set_discontinuity(uref);
+    }
     upipe_a52f->got_discontinuity = false;
-    upipe_a52f_output(upipe, uref, upump_p);
+    UBASE_FATAL_RETURN(upipe, upipe_framers_batch_add(&upipe_a52f->batch,
+                                                      uref, &uref))
+    if (uref != NULL)
+        upipe_a52f_output(upipe, uref, upump_p);
 }
 
 /** @internal @This is called back by @ref upipe_a52f_append_uref_stream
@@ -523,6 +549,7 @@ static void upipe_a52f_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_a52f *upipe_a52f = upipe_a52f_from_upipe(upipe);
     if (unlikely(uref->ubuf == NULL)) {
+        upipe_a52f_flush_batch(upipe, upump_p);
         upipe_a52f_output(upipe, uref, upump_p);
         return;
     }
@@ -568,11 +595,49 @@ static int upipe_a52f_set_flow_def(struct upipe *upipe, struct uref *flow_def)
                                     upipe_a52f->samplerate))))
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
     flow_def = upipe_a52f_store_flow_def_input(upipe, flow_def_dup);
-    if (flow_def != NULL)
+    if (flow_def != NULL) {
+        upipe_a52f_flush_batch(upipe, NULL);
         upipe_a52f_store_flow_def(upipe, flow_def);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the limits of the groups of output frames.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames_p filled in with the maximum number of frames
+ * @param max_duration_p filled in with the maximum duration
+ * @return an error code
+ */
+static int _upipe_a52f_get_batch(struct upipe *upipe,
+                                 unsigned int *max_frames_p,
+                                 uint64_t *max_duration_p)
+{
+    struct upipe_a52f *upipe_a52f = upipe_a52f_from_upipe(upipe);
+    if (max_frames_p != NULL)
+        *max_frames_p = upipe_a52f->batch.max_frames;
+    if (max_duration_p != NULL)
+        *max_duration_p = upipe_a52f->batch.max_duration;
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the limits of the groups of output frames. The
+ * pending group, if any, is output first.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames maximum number of frames in a group, or 0
+ * @param max_duration maximum duration of a group, or 0
+ * @return an error code
+ */
+static int _upipe_a52f_set_batch(struct upipe *upipe, unsigned int max_frames,
+                                 uint64_t max_duration)
+{
+    struct upipe_a52f *upipe_a52f = upipe_a52f_from_upipe(upipe);
+    upipe_a52f_flush_batch(upipe, NULL);
+    return upipe_framers_batch_set(&upipe_a52f->batch, max_frames,
+                                   max_duration);
+}
+
 /** @internal @This processes control commands on a a52f pipe.
  *
  * @param upipe description structure of the pipe
@@ -607,6 +672,18 @@ static int upipe_a52f_control(struct upipe *upipe, int command, va_list args)
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_a52f_set_output(upipe, output);
         }
+        case UPIPE_A52F_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_A52F_SIGNATURE)
+            unsigned int *max_frames_p = va_arg(args, unsigned int *);
+            uint64_t *max_duration_p = va_arg(args, uint64_t *);
+            return _upipe_a52f_get_batch(upipe, max_frames_p, max_duration_p);
+        }
+        case UPIPE_A52F_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_A52F_SIGNATURE)
+            unsigned int max_frames = va_arg(args, unsigned int);
+            uint64_t max_duration = va_arg(args, uint64_t);
+            return _upipe_a52f_set_batch(upipe, max_frames, max_duration);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -618,6 +695,7 @@ static int upipe_a52f_control(struct upipe *upipe, int command, va_list args)
  */
 static void upipe_a52f_free(struct upipe *upipe)
 {
+    upipe_a52f_flush_batch(upipe, NULL);
     upipe_throw_dead(upipe);
 
     upipe_a52f_clean_uref_stream(upipe);
@@ -149,22 +149,24 @@ static void upipe_dvbsubf_work(struct upipe *upipe, struct upump **upump_p)
         goto upipe_dvbsubf_work_err;
     }
 
+    /* Only the segment headers are read, the payload is output as is. */
     size_t offset = DVBSUB_HEADER_SIZE;
-    while (ubase_check(uref_block_extract(upipe_dvbsubf->next_uref,
-                                          offset, 1, &buffer)) &&
-           buffer == DVBSUBS_SYNC) {
+    for ( ; ; ) {
         uint8_t dvbsubs_buffer[DVBSUBS_HEADER_SIZE];
         const uint8_t *dvbsubs = uref_block_peek(upipe_dvbsubf->next_uref,
                                                  offset, DVBSUBS_HEADER_SIZE,
                                                  dvbsubs_buffer);
         if (unlikely(dvbsubs == NULL))
             break;
+        bool sync = dvbsubs[0] == DVBSUBS_SYNC;
         uint8_t type = dvbsubs_get_type(dvbsubs);
         uint16_t length = dvbsubs_get_length(dvbsubs);
         UBASE_FATAL(upipe, uref_block_peek_unmap(upipe_dvbsubf->next_uref,
                                                  offset, dvbsubs_buffer,
                                                  dvbsubs))
 
+        if (!sync)
+            break;
         if (type == DVBSUBS_DISPLAY_DEFINITION) {
             display_def = true;
             break;
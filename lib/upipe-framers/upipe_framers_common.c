@@ -24,10 +24,20 @@
  * @short Upipe common utils for framers
  */
 
+#include <upipe/ubase.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe-framers/uref_frames.h>
+
 #include <stdint.h>
 
 #include "upipe_framers_common.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /** @This scans for an MPEG-style 3-octet start code in a linear buffer.
  *
  * @param p linear buffer
@@ -49,6 +59,17 @@ const uint8_t *upipe_framers_mpeg_scan(const uint8_t *restrict p,
     }
 
     while (p < end) {
+#ifdef __SSE2__
+        /* a start code ending in the next 16 octets needs a zero octet in
+         * the 16 octets starting at p - 2, so skip them if there is none */
+        const __m128i zero = _mm_setzero_si128();
+        while (p + 14 <= end &&
+               !_mm_movemask_epi8(_mm_cmpeq_epi8(
+                       _mm_loadu_si128((const __m128i *)(p - 2)), zero)))
+            p += 16;
+        if (p >= end)
+            break;
+#endif
         if      (p[-1] > 1      ) p += 3;
         else if (p[-2]          ) p += 2;
         else if (p[-3]|(p[-1]-1)) p++;
@@ -66,3 +87,125 @@ const uint8_t *upipe_framers_mpeg_scan(const uint8_t *restrict p,
 }
 /* End code */
 
+
+/** @This initializes the grouping of frames, which is disabled by default.
+ *
+ * @param batch grouping state
+ */
+void upipe_framers_batch_init(struct upipe_framers_batch *batch)
+{
+    batch->max_frames = 1;
+    batch->max_duration = 0;
+    batch->uref = NULL;
+    batch->nb = 0;
+    batch->duration = 0;
+    batch->size = 0;
+}
+
+/** @This sets the limits of a group of frames. A group is output when it
+ * contains max_frames frames, or when its duration reaches max_duration.
+ * Grouping is disabled if both are 0, or if max_frames is 1.
+ *
+ * @param batch grouping state
+ * @param max_frames maximum number of frames, or 0
+ * @param max_duration maximum duration in 27 MHz units, or 0
+ * @return an error code
+ */
+int upipe_framers_batch_set(struct upipe_framers_batch *batch,
+                            unsigned int max_frames, uint64_t max_duration)
+{
+    if (max_frames > UPIPE_FRAMERS_BATCH_MAX)
+        return UBASE_ERR_INVALID;
+    if (!max_frames && !max_duration)
+        max_frames = 1;
+    batch->max_frames = max_frames;
+    batch->max_duration = max_duration;
+    return UBASE_ERR_NONE;
+}
+
+/** @This adds a frame to the current group. The frame must carry its
+ * duration, and its dates must follow those of the previous frame.
+ *
+ * @param batch grouping state
+ * @param uref frame, which belongs to the callee
+ * @param group_p filled in with a complete group to output, or NULL
+ * @return an error code
+ */
+int upipe_framers_batch_add(struct upipe_framers_batch *batch,
+                            struct uref *uref, struct uref **group_p)
+{
+    *group_p = NULL;
+    if (batch->max_frames == 1) {
+        *group_p = uref;
+        return UBASE_ERR_NONE;
+    }
+
+    size_t size;
+    uint64_t duration = 0;
+    uref_clock_get_duration(uref, &duration);
+    int err = uref_block_size(uref, &size);
+    if (unlikely(!ubase_check(err))) {
+        uref_free(uref);
+        return err;
+    }
+
+    if (batch->uref == NULL)
+        batch->uref = uref;
+    else {
+        struct ubuf *ubuf = uref_detach_ubuf(uref);
+        uref_free(uref);
+        err = uref_block_append(batch->uref, ubuf);
+        if (unlikely(!ubase_check(err))) {
+            ubuf_free(ubuf);
+            return err;
+        }
+    }
+
+    struct uref_frames_frame *frame = &batch->frames[batch->nb++];
+    frame->dts_delay = batch->duration;
+    frame->duration = duration;
+    frame->offset = batch->size;
+    frame->size = size;
+    batch->duration += duration;
+    batch->size += size;
+
+    if (batch->nb == UPIPE_FRAMERS_BATCH_MAX ||
+        batch->nb == batch->max_frames ||
+        (batch->max_duration && batch->duration >= batch->max_duration))
+        *group_p = upipe_framers_batch_flush(batch);
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the current group, however incomplete.
+ *
+ * @param batch grouping state
+ * @return group to output, or NULL if there is none
+ */
+struct uref *upipe_framers_batch_flush(struct upipe_framers_batch *batch)
+{
+    struct uref *uref = batch->uref;
+    if (uref != NULL &&
+        (!ubase_check(uref_clock_set_duration(uref, batch->duration)) ||
+         !ubase_check(uref_frames_set(uref, batch->frames, batch->nb)))) {
+        uref_free(uref);
+        uref = NULL;
+    }
+    batch->uref = NULL;
+    batch->nb = 0;
+    batch->duration = 0;
+    batch->size = 0;
+    return uref;
+}
+
+/** @This releases the current group without outputting it.
+ *
+ * @param batch grouping state
+ */
+void upipe_framers_batch_clean(struct upipe_framers_batch *batch)
+{
+    uref_free(batch->uref);
+    batch->uref = NULL;
+    batch->nb = 0;
+    batch->duration = 0;
+    batch->size = 0;
+}
@@ -23,6 +23,11 @@
  */
 
 #include <upipe/ubuf_block_stream.h>
+#include <upipe/uref.h>
+#include <upipe-framers/uref_frames.h>
+
+#include <stdint.h>
+#include <stdbool.h>
 
 /** @This scans for an MPEG-style 3-octet start code in a linear buffer.
  *
@@ -34,3 +39,67 @@
 const uint8_t *upipe_framers_mpeg_scan(const uint8_t *restrict p,
                                        const uint8_t *end,
                                        uint32_t *restrict state);
+
+/** maximum number of frames grouped in a uref by framers */
+#define UPIPE_FRAMERS_BATCH_MAX 64
+
+/** @This is the state of the grouping of consecutive frames in one uref. */
+struct upipe_framers_batch {
+    /** maximum number of frames in a group, or 0 */
+    unsigned int max_frames;
+    /** maximum duration of a group, or 0 */
+    uint64_t max_duration;
+
+    /** group being built, or NULL */
+    struct uref *uref;
+    /** number of frames in the group */
+    unsigned int nb;
+    /** duration of the group */
+    uint64_t duration;
+    /** size of the group */
+    size_t size;
+    /** descriptions of the frames of the group */
+    struct uref_frames_frame frames[UPIPE_FRAMERS_BATCH_MAX];
+};
+
+/** @This initializes the grouping of frames, which is disabled by default.
+ *
+ * @param batch grouping state
+ */
+void upipe_framers_batch_init(struct upipe_framers_batch *batch);
+
+/** @This sets the limits of a group of frames. A group is output when it
+ * contains max_frames frames, or when its duration reaches max_duration.
+ * Grouping is disabled if both are 0, or if max_frames is 1.
+ *
+ * @param batch grouping state
+ * @param max_frames maximum number of frames, or 0
+ * @param max_duration maximum duration in 27 MHz units, or 0
+ * @return an error code
+ */
+int upipe_framers_batch_set(struct upipe_framers_batch *batch,
+                            unsigned int max_frames, uint64_t max_duration);
+
+/** @This adds a frame to the current group. The frame must carry its
+ * duration, and its dates must follow those of the previous frame.
+ *
+ * @param batch grouping state
+ * @param uref frame, which belongs to the callee
+ * @param group_p filled in with a complete group to output, or NULL
+ * @return an error code
+ */
+int upipe_framers_batch_add(struct upipe_framers_batch *batch,
+                            struct uref *uref, struct uref **group_p);
+
+/** @This returns the current group, however incomplete.
+ *
+ * @param batch grouping state
+ * @return group to output, or NULL if there is none
+ */
+struct uref *upipe_framers_batch_flush(struct upipe_framers_batch *batch);
+
+/** @This releases the current group without outputting it.
+ *
+ * @param batch grouping state
+ */
+void upipe_framers_batch_clean(struct upipe_framers_batch *batch);
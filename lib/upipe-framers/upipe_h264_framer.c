@@ -31,6 +31,7 @@
 #include <upipe/uref_block_flow.h>
 #include <upipe/uref_pic.h>
 #include <upipe/uref_pic_flow.h>
+#include <upipe/uref_priority.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uclock.h>
 #include <upipe/ubuf.h>
@@ -115,6 +116,10 @@ struct upipe_h264f {
     int32_t last_frame_num;
     /** true we have had a discontinuity recently */
     bool got_discontinuity;
+    /** true if slice headers are only parsed for access unit boundaries */
+    bool boundaries_only;
+    /** true if non-reference pictures are dropped */
+    bool drop_nonref;
     /** pointers to sequence parameter sets */
     struct ubuf *sps[H264SPS_ID_MAX];
     /** pointers to sequence parameter set extensions */
@@ -193,6 +198,8 @@ struct upipe_h264f {
     /* octet stream parser stuff */
     /** context of the scan function */
     uint32_t scan_context;
+    /** octet preceding the four octets of the scan context */
+    uint8_t scan_prev;
     /** current size of next access unit (in next_uref) */
     size_t au_size;
     /** last NAL offset in the access unit, or -1 */
@@ -299,10 +306,13 @@ static struct upipe *upipe_h264f_alloc(struct upipe_mgr *mgr,
     upipe_h264f->input_latency = 0;
     upipe_h264f->last_picture_number = 0;
     upipe_h264f->last_frame_num = -1;
+    upipe_h264f->boundaries_only = false;
+    upipe_h264f->drop_nonref = false;
     upipe_h264f->pic_struct = -1;
     upipe_h264f->duration = 0;
     upipe_h264f->got_discontinuity = false;
     upipe_h264f->scan_context = UINT32_MAX;
+    upipe_h264f->scan_prev = UINT8_MAX;
     upipe_h264f->au_size = 0;
     upipe_h264f->au_last_nal_offset = -1;
     upipe_h264f->au_last_nal = UINT8_MAX;
@@ -329,11 +339,13 @@ static struct upipe *upipe_h264f_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** @internal @This finds an MPEG-2 start code and returns its value.
+/** @internal @This finds an MPEG-2 start code and returns its value. The
+ * scan resumes where the previous call stopped, so that each octet is only
+ * read once.
  *
  * @param upipe description structure of the pipe
  * @param start_p filled in with the value of the start code
- * @param prev_p filled in with the value of the previous octet, if applicable
+ * @param prev_p filled in with the value of the octet preceding the start code
  * @return true if a start code was found
  */
 static bool upipe_h264f_find(struct upipe *upipe,
@@ -344,19 +356,21 @@ static bool upipe_h264f_find(struct upipe *upipe,
     int size = -1;
     while (ubase_check(uref_block_read(upipe_h264f->next_uref,
                     upipe_h264f->au_size, &size, &buffer))) {
+        uint32_t context = upipe_h264f->scan_context;
         const uint8_t *p = upipe_framers_mpeg_scan(buffer, buffer + size,
                                                    &upipe_h264f->scan_context);
-        if (p > buffer + 4)
-            *prev_p = p[-4];
+        /* keep the octet preceding the new context, which may come from the
+         * previous context if few octets were scanned */
+        if (p >= buffer + 5)
+            upipe_h264f->scan_prev = p[-5];
+        else
+            upipe_h264f->scan_prev = context >> (8 * (4 - (p - buffer)));
         uref_block_unmap(upipe_h264f->next_uref, upipe_h264f->au_size);
 
         if ((upipe_h264f->scan_context & 0xffffff00) == 0x100) {
             *start_p = upipe_h264f->scan_context & 0xff;
+            *prev_p = upipe_h264f->scan_prev;
             upipe_h264f->au_size += p - buffer;
-            if (p <= buffer + 4 &&
-                !ubase_check(uref_block_extract(upipe_h264f->next_uref,
-                                    upipe_h264f->au_size - 4, 1, prev_p)))
-                *prev_p = 0xff;
             return true;
         }
         upipe_h264f->au_size += size;
@@ -404,13 +418,35 @@ static inline int upipe_h264f_stream_get(struct ubuf_block_stream *s,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This fills the bit stream cache a word at a time, if the
+ * next 8 octets of the block section cannot contain an escape word.
+ *
+ * @param s helper structure
+ */
+static inline void upipe_h264f_stream_fill_word(struct ubuf_block_stream *s)
+{
+    struct upipe_h264f_stream *f =
+        container_of(s, struct upipe_h264f_stream, s);
+    uint64_t word;
+    /* without nul octets, only the first octet may follow two zeros */
+    if ((f->zeros & 3) != 3 && ubuf_block_stream_peek_word(s, &word) &&
+        !ubuf_block_stream_word_has_zero(word)) {
+        unsigned int nb = ubuf_block_stream_load_word(s, word);
+        f->zeros = nb < 8 ? f->zeros << nb : 0;
+    }
+}
+
 /** @This fills the bit stream cache with at least the given number of bits.
  *
  * @param s helper structure
- * @param nb number of bits to ensure
+ * @param nb number of bits to ensure, at most 57
  */
 #define upipe_h264f_stream_fill_bits(s, nb)                                 \
-    ubuf_block_stream_fill_bits_inner(s, upipe_h264f_stream_get, nb)
+    do {                                                                    \
+        if ((s)->available < (nb))                                          \
+            upipe_h264f_stream_fill_word(s);                                \
+        ubuf_block_stream_fill_bits_inner(s, upipe_h264f_stream_get, nb)    \
+    } while (0)
 
 /** @internal @This reads an unsigned exp-golomb code from a stream.
  *
@@ -419,35 +455,25 @@ static inline int upipe_h264f_stream_get(struct ubuf_block_stream *s,
  */
 static uint32_t upipe_h264f_stream_ue(struct ubuf_block_stream *s)
 {
-    int i = 1;
-    while (i < 32) {
-        upipe_h264f_stream_fill_bits(s, 8);
-        uint8_t octet = ubuf_block_stream_show_bits(s, 8);
-        if (likely(octet))
-            break;
-        i += 8;
-        ubuf_block_stream_skip_bits(s, 8);
-    }
-    while (i < 32 && !ubuf_block_stream_show_bits(s, 1)) {
-        i++;
-        ubuf_block_stream_skip_bits(s, 1);
+    upipe_h264f_stream_fill_bits(s, 32);
+    unsigned int zeros = ubuf_block_stream_show_zeros(s);
+    if (unlikely(zeros >= 32)) {
+        /* invalid code */
+        ubuf_block_stream_skip_bits(s, 32);
+        return UINT32_MAX;
     }
 
-    if (likely(i <= 24)) {
-        upipe_h264f_stream_fill_bits(s, i);
-        uint32_t result = ubuf_block_stream_show_bits(s, i);
-        ubuf_block_stream_skip_bits(s, i);
+    if (likely(zeros < 16)) {
+        /* the whole code is in the cache */
+        uint32_t result = ubuf_block_stream_show_bits(s, 2 * zeros + 1);
+        ubuf_block_stream_skip_bits(s, 2 * zeros + 1);
         return result - 1;
     }
 
-    upipe_h264f_stream_fill_bits(s, 8);
-    uint32_t result = ubuf_block_stream_show_bits(s, 8);
-    ubuf_block_stream_skip_bits(s, 8);
-    i -= 8;
-    result <<= i;
-    upipe_h264f_stream_fill_bits(s, i);
-    result += ubuf_block_stream_show_bits(s, i);
-    ubuf_block_stream_skip_bits(s, i);
+    ubuf_block_stream_skip_bits(s, zeros);
+    upipe_h264f_stream_fill_bits(s, zeros + 1);
+    uint32_t result = ubuf_block_stream_show_bits(s, zeros + 1);
+    ubuf_block_stream_skip_bits(s, zeros + 1);
     return result - 1;
 }
 
@@ -1274,11 +1300,17 @@ static void upipe_h264f_output_au(struct upipe *upipe, struct upump **upump_p)
         return;
     }
 
-    uint64_t picture_number = upipe_h264f->last_picture_number +
-        (upipe_h264f->frame_num - upipe_h264f->last_frame_num);
-    if (upipe_h264f->frame_num > upipe_h264f->last_frame_num) {
-        upipe_h264f->last_frame_num = upipe_h264f->frame_num;
-        upipe_h264f->last_picture_number = picture_number;
+    uint64_t picture_number;
+    if (upipe_h264f->boundaries_only)
+        /* frame_num is not parsed, number in decoding order */
+        picture_number = ++upipe_h264f->last_picture_number;
+    else {
+        picture_number = upipe_h264f->last_picture_number +
+            (upipe_h264f->frame_num - upipe_h264f->last_frame_num);
+        if (upipe_h264f->frame_num > upipe_h264f->last_frame_num) {
+            upipe_h264f->last_frame_num = upipe_h264f->frame_num;
+            upipe_h264f->last_picture_number = picture_number;
+        }
     }
     UBASE_FATAL(upipe, uref_pic_set_number(uref, picture_number))
 
@@ -1388,6 +1420,7 @@ static void upipe_h264f_output_au(struct upipe *upipe, struct upump **upump_p)
         UBASE_FATAL(upipe, uref_block_set_header_size(uref,
                                                upipe_h264f->au_vcl_offset))
 
+    bool nonref = !h264nalst_get_ref(upipe_h264f->au_slice_nal);
     upipe_h264f->au_size = 0;
     upipe_h264f->au_vcl_offset = -1;
     upipe_h264f->au_slice = false;
@@ -1399,6 +1432,15 @@ static void upipe_h264f_output_au(struct upipe *upipe, struct upump **upump_p)
         return;
     }
 
+    if (nonref && upipe_h264f->drop_nonref) {
+        /* no other picture refers to it, so it may be skipped */
+        uref_free(uref);
+        return;
+    }
+    if (nonref)
+        UBASE_FATAL(upipe, uref_flow_set_priority(uref,
+                                                  UREF_PRIORITY_DISPOSABLE))
+
     upipe_h264f_output(upipe, uref, upump_p);
 }
 
@@ -1437,7 +1479,7 @@ upipe_h264f_parse_slice_retry:
                 upipe_h264f->au_last_nal_offset +
                 upipe_h264f->au_last_nal_start_size));
 
-    upipe_h264f_stream_ue(s); /* first_mb_in_slice */
+    uint32_t first_mb = upipe_h264f_stream_ue(s);
     uint32_t slice_type = upipe_h264f_stream_ue(s);
     uint32_t pps_id = upipe_h264f_stream_ue(s);
     if (unlikely(pps_id >= H264PPS_ID_MAX)) {
@@ -1457,6 +1499,18 @@ upipe_h264f_parse_slice_retry:
         return;
     }
 
+    if (upipe_h264f->boundaries_only) {
+        /* without arbitrary slice order, a picture starts at macroblock 0 */
+        ubuf_block_stream_clean(s);
+        if (upipe_h264f->au_slice && !first_mb) {
+            upipe_h264f_output_prev_au(upipe, upump_p);
+            goto upipe_h264f_parse_slice_retry;
+        }
+        upipe_h264f->slice_type = slice_type;
+        upipe_h264f->au_slice = true;
+        return;
+    }
+
     if (upipe_h264f->separate_colour_plane) {
         upipe_h264f_stream_fill_bits(s, 2);
         ubuf_block_stream_skip_bits(s, 2);
@@ -1749,6 +1803,94 @@ static int upipe_h264f_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     return UBASE_ERR_NONE;
 }
 
+/** @This returns the current setting for boundaries-only parsing.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static int _upipe_h264f_get_boundaries_only(struct upipe *upipe, int *val_p)
+{
+    struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+    *val_p = upipe_h264f->boundaries_only ? 1 : 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets boundaries-only parsing. When true, slice headers
+ * are only parsed up to the PPS ID, and a new access unit is detected on
+ * the first macroblock, which does not work with arbitrary slice order.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true for boundaries-only parsing
+ * @return an error code
+ */
+static int _upipe_h264f_set_boundaries_only(struct upipe *upipe, int val)
+{
+    struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+    upipe_h264f->boundaries_only = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the current setting for the dropping of non-reference
+ * pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static int _upipe_h264f_get_drop_nonref(struct upipe *upipe, int *val_p)
+{
+    struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+    *val_p = upipe_h264f->drop_nonref ? 1 : 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets the dropping of non-reference pictures. When true,
+ * access units whose slices have a nal_ref_idc of 0 are not output, which
+ * leaves the dates and numbers of the other pictures unchanged.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true to drop non-reference pictures
+ * @return an error code
+ */
+static int _upipe_h264f_set_drop_nonref(struct upipe *upipe, int val)
+{
+    struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+    upipe_h264f->drop_nonref = !!val;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This drops the partial access unit, which is useless after an
+ * idle period, and waits for the next random access point. The parameter
+ * sets are kept so that decoding resumes quickly.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_h264f_hibernate(struct upipe *upipe)
+{
+    struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+    upipe_h264f_clean_uref_stream(upipe);
+    upipe_h264f_init_uref_stream(upipe);
+    upipe_h264f->scan_context = UINT32_MAX;
+    upipe_h264f->scan_prev = UINT8_MAX;
+    upipe_h264f->au_size = 0;
+    upipe_h264f->au_last_nal_offset = -1;
+    upipe_h264f->au_last_nal = UINT8_MAX;
+    upipe_h264f->au_last_nal_start_size = 0;
+    upipe_h264f->au_vcl_offset = -1;
+    upipe_h264f->au_slice = false;
+    upipe_h264f->au_slice_nal = UINT8_MAX;
+    upipe_h264f->pic_struct = -1;
+    upipe_h264f->got_discontinuity = true;
+    upipe_h264f_flush_dates(upipe);
+    upipe_h264f_sync_lost(upipe);
+
+    if (upipe_h264f->output != NULL)
+        upipe_hibernate(upipe_h264f->output);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a h264f pipe.
  *
  * @param upipe description structure of the pipe
@@ -1783,6 +1925,28 @@ static int upipe_h264f_control(struct upipe *upipe, int command, va_list args)
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_h264f_set_output(upipe, output);
         }
+        case UPIPE_H264F_GET_BOUNDARIES_ONLY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H264F_SIGNATURE)
+            int *val_p = va_arg(args, int *);
+            return _upipe_h264f_get_boundaries_only(upipe, val_p);
+        }
+        case UPIPE_H264F_SET_BOUNDARIES_ONLY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H264F_SIGNATURE)
+            int val = va_arg(args, int);
+            return _upipe_h264f_set_boundaries_only(upipe, val);
+        }
+        case UPIPE_H264F_GET_DROP_NONREF: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H264F_SIGNATURE)
+            int *val_p = va_arg(args, int *);
+            return _upipe_h264f_get_drop_nonref(upipe, val_p);
+        }
+        case UPIPE_H264F_SET_DROP_NONREF: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H264F_SIGNATURE)
+            int val = va_arg(args, int);
+            return _upipe_h264f_set_drop_nonref(upipe, val);
+        }
+        case UPIPE_HIBERNATE:
+            return upipe_h264f_hibernate(upipe);
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -0,0 +1,1967 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module building frames from chunks of an ITU-T H.265 annex B
+ * stream
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uclock.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_stream.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_sync.h>
+#include <upipe/upipe_helper_uref_stream.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_flow_def.h>
+#include <upipe-framers/upipe_h265_framer.h>
+#include <upipe-framers/uref_h265_flow.h>
+
+#include "upipe_framers_common.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/* bitstream has no H.265 header yet, so the few syntax elements we need
+ * are defined here (ITU-T H.265 7.3 and 7.4). */
+#define H265NAL_TYPE_TRAIL_N        0
+#define H265NAL_TYPE_RADL_N         6
+#define H265NAL_TYPE_RASL_R         9
+#define H265NAL_TYPE_RSV_VCL_N14    14
+#define H265NAL_TYPE_BLA_W_LP       16
+#define H265NAL_TYPE_IDR_W_RADL     19
+#define H265NAL_TYPE_IDR_N_LP       20
+#define H265NAL_TYPE_CRA            21
+#define H265NAL_TYPE_RSV_IRAP_23    23
+#define H265NAL_TYPE_VPS            32
+#define H265NAL_TYPE_SPS            33
+#define H265NAL_TYPE_PPS            34
+#define H265NAL_TYPE_AUD            35
+#define H265NAL_TYPE_EOS            36
+#define H265NAL_TYPE_EOB            37
+#define H265NAL_TYPE_PREFIX_SEI     39
+#define H265NAL_TYPE_RSV_NVCL41     41
+#define H265NAL_TYPE_RSV_NVCL44     44
+#define H265NAL_TYPE_UNSPEC48       48
+#define H265NAL_TYPE_UNSPEC55       55
+
+#define H265VPS_ID_MAX              16
+#define H265SPS_ID_MAX              16
+#define H265PPS_ID_MAX              64
+#define H265SPS_STRPS_MAX           64
+#define H265SPS_DELTA_POCS_MAX      32
+
+#define H265SPS_CHROMA_MONO         0
+#define H265SPS_CHROMA_420          1
+#define H265SPS_CHROMA_422          2
+#define H265SPS_CHROMA_444          3
+
+#define H265VUI_AR_EXTENDED         255
+
+#define H265SEI_BUFFERING_PERIOD    0
+#define H265SEI_PIC_TIMING          1
+
+#define H265SEI_STRUCT_FRAME        0
+#define H265SEI_STRUCT_TOP          1
+#define H265SEI_STRUCT_BOT          2
+#define H265SEI_STRUCT_TOP_BOT      3
+#define H265SEI_STRUCT_BOT_TOP      4
+#define H265SEI_STRUCT_TOP_BOT_TOP  5
+#define H265SEI_STRUCT_BOT_TOP_BOT  6
+#define H265SEI_STRUCT_DOUBLE       7
+#define H265SEI_STRUCT_TRIPLE       8
+#define H265SEI_STRUCT_TOP_PREV_BOT 9
+#define H265SEI_STRUCT_BOT_PREV_TOP 10
+#define H265SEI_STRUCT_TOP_NEXT_BOT 11
+#define H265SEI_STRUCT_BOT_NEXT_TOP 12
+
+#define H265SLI_TYPE_I              2
+
+/** @internal @This returns the NAL unit type from the first octet of the
+ * NAL unit header.
+ *
+ * @param start first octet of the NAL unit header
+ * @return NAL unit type
+ */
+static inline uint8_t h265nalst_get_type(uint8_t start)
+{
+    return (start >> 1) & 0x3f;
+}
+
+/** @internal @This translates the h265 aspect_ratio_idc to urational */
+static const struct urational sar_from_idc[] = {
+    { .num = 1, .den = 1 }, /* unspecified - treat as square */
+    { .num = 1, .den = 1 },
+    { .num = 12, .den = 11 },
+    { .num = 10, .den = 11 },
+    { .num = 16, .den = 11 },
+    { .num = 40, .den = 33 },
+    { .num = 24, .den = 11 },
+    { .num = 20, .den = 11 },
+    { .num = 32, .den = 11 },
+    { .num = 80, .den = 33 },
+    { .num = 18, .den = 11 },
+    { .num = 15, .den = 11 },
+    { .num = 64, .den = 33 },
+    { .num = 160, .den = 99 },
+    { .num = 4, .den = 3 },
+    { .num = 3, .den = 2 },
+    { .num = 2, .den = 1 },
+};
+
+/** @internal @This is the private context of an h265f pipe. */
+struct upipe_h265f {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /* output stuff */
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+    /** input flow definition packet */
+    struct uref *flow_def_input;
+    /** attributes in the SPS */
+    struct uref *flow_def_attr;
+    /** rap of the last dts */
+    uint64_t dts_rap;
+    /** rap of the last sps */
+    uint64_t sps_rap;
+    /** rap of the last pps */
+    uint64_t pps_rap;
+    /** rap of the last I */
+    uint64_t iframe_rap;
+    /** latency in the input flow */
+    uint64_t input_latency;
+
+    /* picture parsing stuff */
+    /** last output picture number */
+    uint64_t last_picture_number;
+    /** last picture order count, or -1 */
+    int32_t last_poc;
+    /** picture order count of the previous TemporalId 0 picture */
+    int32_t prev_tid0_poc;
+    /** true if the next IRAP starts a new coded video sequence */
+    bool first_irap;
+    /** true we have had a discontinuity recently */
+    bool got_discontinuity;
+    /** pointers to video parameter sets */
+    struct ubuf *vps[H265VPS_ID_MAX];
+    /** active video parameter set, or -1 */
+    int active_vps;
+    /** pointers to sequence parameter sets */
+    struct ubuf *sps[H265SPS_ID_MAX];
+    /** active sequence parameter set, or -1 */
+    int active_sps;
+    /** pointers to picture parameter sets */
+    struct ubuf *pps[H265PPS_ID_MAX];
+    /** active picture parameter set, or -1 */
+    int active_pps;
+
+    /* parsing results - headers */
+    /** separate color plane */
+    bool separate_colour_plane;
+    /** length of poc lsb field */
+    uint32_t log2_max_poc_lsb;
+    /** true if pictures are fields */
+    bool field_seq;
+    /** true if picture structure is present in picture timing SEI */
+    bool frame_field_info_present;
+    /** duration of a picture */
+    uint64_t duration;
+    /** sample aspect ratio */
+    struct urational sar;
+    /** true if pic_output_flag is present in slice headers */
+    bool output_flag_present;
+    /** number of extra bits in slice headers */
+    uint8_t num_extra_slice_header_bits;
+
+    /* parsing results - slice */
+    /** picture structure */
+    int pic_struct;
+    /** slice type */
+    uint32_t slice_type;
+    /** picture order count */
+    int32_t poc;
+
+    /* octet stream stuff */
+    /** next uref to be processed */
+    struct uref *next_uref;
+    /** original size of the next uref */
+    size_t next_uref_size;
+    /** urefs received after next uref */
+    struct uchain urefs;
+
+    /* octet stream parser stuff */
+    /** context of the scan function */
+    uint32_t scan_context;
+    /** octet preceding the four octets of the scan context */
+    uint8_t scan_prev;
+    /** current size of next access unit (in next_uref) */
+    size_t au_size;
+    /** last NAL offset in the access unit, or -1 */
+    ssize_t au_last_nal_offset;
+    /** first octet of the last NAL header in the access unit */
+    uint8_t au_last_nal;
+    /** size of the last NAL start code in the access unit, including the
+     * first octet of the NAL header */
+    size_t au_last_nal_start_size;
+    /** offset of the first VCL NAL in next_uref, or -1 */
+    ssize_t au_vcl_offset;
+    /** true if the first slice segment of the picture was parsed */
+    bool au_slice;
+    /** first octet of the NAL header of the last slice, or UINT8_MAX */
+    uint8_t au_slice_nal;
+    /** pseudo-packet containing date information for the next picture */
+    struct uref au_uref_s;
+    /** true if we have thrown the sync_acquired event (that means we found a
+     * NAL start) */
+    bool acquired;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @hidden */
+static void upipe_h265f_promote_uref(struct upipe *upipe);
+
+UPIPE_HELPER_UPIPE(upipe_h265f, upipe, UPIPE_H265F_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_h265f, urefcount, upipe_h265f_free)
+UPIPE_HELPER_VOID(upipe_h265f)
+UPIPE_HELPER_SYNC(upipe_h265f, acquired)
+UPIPE_HELPER_UREF_STREAM(upipe_h265f, next_uref, next_uref_size, urefs,
+                         upipe_h265f_promote_uref)
+
+UPIPE_HELPER_OUTPUT(upipe_h265f, output, flow_def, output_state, request_list)
+UPIPE_HELPER_FLOW_DEF(upipe_h265f, flow_def_input, flow_def_attr)
+
+/** @internal @This flushes all dates.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_h265f_flush_dates(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    uref_clock_set_date_sys(&upipe_h265f->au_uref_s, UINT64_MAX,
+                            UREF_DATE_NONE);
+    uref_clock_set_date_prog(&upipe_h265f->au_uref_s, UINT64_MAX,
+                             UREF_DATE_NONE);
+    uref_clock_set_date_orig(&upipe_h265f->au_uref_s, UINT64_MAX,
+                             UREF_DATE_NONE);
+    uref_clock_delete_dts_pts_delay(&upipe_h265f->au_uref_s);
+}
+
+/** @internal @This is called back by @ref upipe_h265f_append_uref_stream
+ * whenever a new uref is promoted in next_uref.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_h265f_promote_uref(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    uint64_t date;
+#define SET_DATE(dv)                                                        \
+    if (ubase_check(uref_clock_get_dts_##dv(upipe_h265f->next_uref, &date)))\
+        uref_clock_set_dts_##dv(&upipe_h265f->au_uref_s, date);
+    SET_DATE(sys)
+    SET_DATE(prog)
+    SET_DATE(orig)
+#undef SET_DATE
+
+    if (ubase_check(uref_clock_get_dts_pts_delay(upipe_h265f->next_uref,
+                                                 &date)))
+        uref_clock_set_dts_pts_delay(&upipe_h265f->au_uref_s, date);
+    if (ubase_check(uref_clock_get_dts_prog(upipe_h265f->next_uref, &date)))
+        uref_clock_get_rap_sys(upipe_h265f->next_uref, &upipe_h265f->dts_rap);
+}
+
+/** @internal @This allocates an h265f pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_h265f_alloc(struct upipe_mgr *mgr,
+                                       struct uprobe *uprobe,
+                                       uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_h265f_alloc_void(mgr, uprobe, signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    upipe_h265f_init_urefcount(upipe);
+    upipe_h265f_init_sync(upipe);
+    upipe_h265f_init_uref_stream(upipe);
+    upipe_h265f_init_output(upipe);
+    upipe_h265f_init_flow_def(upipe);
+    upipe_h265f->dts_rap = UINT64_MAX;
+    upipe_h265f->sps_rap = UINT64_MAX;
+    upipe_h265f->pps_rap = UINT64_MAX;
+    upipe_h265f->iframe_rap = UINT64_MAX;
+    upipe_h265f->input_latency = 0;
+    upipe_h265f->last_picture_number = 0;
+    upipe_h265f->last_poc = -1;
+    upipe_h265f->prev_tid0_poc = 0;
+    upipe_h265f->first_irap = true;
+    upipe_h265f->pic_struct = -1;
+    upipe_h265f->duration = 0;
+    upipe_h265f->got_discontinuity = false;
+    upipe_h265f->scan_context = UINT32_MAX;
+    upipe_h265f->scan_prev = UINT8_MAX;
+    upipe_h265f->au_size = 0;
+    upipe_h265f->au_last_nal_offset = -1;
+    upipe_h265f->au_last_nal = UINT8_MAX;
+    upipe_h265f->au_last_nal_start_size = 0;
+    upipe_h265f->au_vcl_offset = -1;
+    upipe_h265f->au_slice = false;
+    upipe_h265f->au_slice_nal = UINT8_MAX;
+    uref_init(&upipe_h265f->au_uref_s);
+    upipe_h265f_flush_dates(upipe);
+
+    int i;
+    for (i = 0; i < H265VPS_ID_MAX; i++)
+        upipe_h265f->vps[i] = NULL;
+    upipe_h265f->active_vps = -1;
+
+    for (i = 0; i < H265SPS_ID_MAX; i++)
+        upipe_h265f->sps[i] = NULL;
+    upipe_h265f->active_sps = -1;
+
+    for (i = 0; i < H265PPS_ID_MAX; i++)
+        upipe_h265f->pps[i] = NULL;
+    upipe_h265f->active_pps = -1;
+
+    upipe_h265f->acquired = false;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This finds an annex B start code and returns the first octet
+ * of the NAL unit header. The scan resumes where the previous call stopped,
+ * so that each octet is only read once.
+ *
+ * @param upipe description structure of the pipe
+ * @param start_p filled in with the first octet of the NAL unit header
+ * @param prev_p filled in with the value of the octet preceding the start code
+ * @return true if a start code was found
+ */
+static bool upipe_h265f_find(struct upipe *upipe,
+                             uint8_t *start_p, uint8_t *prev_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    const uint8_t *buffer;
+    int size = -1;
+    while (ubase_check(uref_block_read(upipe_h265f->next_uref,
+                    upipe_h265f->au_size, &size, &buffer))) {
+        uint32_t context = upipe_h265f->scan_context;
+        const uint8_t *p = upipe_framers_mpeg_scan(buffer, buffer + size,
+                                                   &upipe_h265f->scan_context);
+        /* keep the octet preceding the new context, which may come from the
+         * previous context if few octets were scanned */
+        if (p >= buffer + 5)
+            upipe_h265f->scan_prev = p[-5];
+        else
+            upipe_h265f->scan_prev = context >> (8 * (4 - (p - buffer)));
+        uref_block_unmap(upipe_h265f->next_uref, upipe_h265f->au_size);
+
+        if ((upipe_h265f->scan_context & 0xffffff00) == 0x100) {
+            *start_p = upipe_h265f->scan_context & 0xff;
+            *prev_p = upipe_h265f->scan_prev;
+            upipe_h265f->au_size += p - buffer;
+            return true;
+        }
+        upipe_h265f->au_size += size;
+        size = -1;
+    }
+    return false;
+}
+
+/** @internal @This allows to skip escape words from NAL units. */
+struct upipe_h265f_stream {
+    /** positions of the 0s in the previous octets */
+    uint8_t zeros;
+    /** number of octets returned, escape words excluded */
+    size_t octets;
+    /** standard octet stream */
+    struct ubuf_block_stream s;
+};
+
+/** @internal @This initializes the helper structure for octet stream.
+ *
+ * @param f helper structure
+ */
+static inline void upipe_h265f_stream_init(struct upipe_h265f_stream *f)
+{
+    f->zeros = 0;
+    f->octets = 0;
+}
+
+/** @internal @This gets the next octet in the ubuf while bypassing escape
+ * words.
+ *
+ * @param s helper structure
+ * @param octet_p filled in with the read octet
+ * @return an error code
+ */
+static inline int upipe_h265f_stream_get(struct ubuf_block_stream *s,
+                                         uint8_t *octet_p)
+{
+    UBASE_RETURN(ubuf_block_stream_get(s, octet_p))
+    struct upipe_h265f_stream *f =
+        container_of(s, struct upipe_h265f_stream, s);
+    f->zeros <<= 1;
+    if (unlikely(!*octet_p))
+        f->zeros |= 1;
+    else if (unlikely(*octet_p == 3 && (f->zeros & 6) == 6)) { /* escape */
+        f->zeros = 0;
+        UBASE_RETURN(ubuf_block_stream_get(s, octet_p))
+        if (!*octet_p)
+            f->zeros |= 1;
+    }
+    f->octets++;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This fills the bit stream cache a word at a time, if the
+ * next 8 octets of the block section cannot contain an escape word.
+ *
+ * @param s helper structure
+ */
+static inline void upipe_h265f_stream_fill_word(struct ubuf_block_stream *s)
+{
+    struct upipe_h265f_stream *f =
+        container_of(s, struct upipe_h265f_stream, s);
+    uint64_t word;
+    /* without nul octets, only the first octet may follow two zeros */
+    if ((f->zeros & 3) != 3 && ubuf_block_stream_peek_word(s, &word) &&
+        !ubuf_block_stream_word_has_zero(word)) {
+        unsigned int nb = ubuf_block_stream_load_word(s, word);
+        f->zeros = nb < 8 ? f->zeros << nb : 0;
+        f->octets += nb;
+    }
+}
+
+/** @This fills the bit stream cache with at least the given number of bits.
+ *
+ * @param s helper structure
+ * @param nb number of bits to ensure, at most 57
+ */
+#define upipe_h265f_stream_fill_bits(s, nb)                                 \
+    do {                                                                    \
+        if ((s)->available < (nb))                                          \
+            upipe_h265f_stream_fill_word(s);                                \
+        ubuf_block_stream_fill_bits_inner(s, upipe_h265f_stream_get, nb)    \
+    } while (0)
+
+/** @internal @This returns the position of the stream, in bits read since
+ * the initialization, escape words excluded.
+ *
+ * @param s ubuf block stream
+ * @return number of bits read
+ */
+static inline size_t upipe_h265f_stream_pos(struct ubuf_block_stream *s)
+{
+    struct upipe_h265f_stream *f =
+        container_of(s, struct upipe_h265f_stream, s);
+    return f->octets * 8 - s->available;
+}
+
+/** @internal @This reads a fixed-length field of at most 24 bits.
+ *
+ * @param s ubuf block stream
+ * @param nb number of bits to read
+ * @return field read
+ */
+static uint32_t upipe_h265f_stream_bits(struct ubuf_block_stream *s,
+                                        uint8_t nb)
+{
+    if (!nb)
+        return 0;
+    upipe_h265f_stream_fill_bits(s, nb);
+    uint32_t result = ubuf_block_stream_show_bits(s, nb);
+    ubuf_block_stream_skip_bits(s, nb);
+    return result;
+}
+
+/** @internal @This skips a given number of bits.
+ *
+ * @param s ubuf block stream
+ * @param nb number of bits to skip
+ */
+static void upipe_h265f_stream_skip(struct ubuf_block_stream *s, size_t nb)
+{
+    while (nb > 24) {
+        upipe_h265f_stream_bits(s, 24);
+        nb -= 24;
+    }
+    upipe_h265f_stream_bits(s, nb);
+}
+
+/** @internal @This reads an unsigned exp-golomb code from a stream.
+ *
+ * @param s ubuf block stream
+ * @return code read
+ */
+static uint32_t upipe_h265f_stream_ue(struct ubuf_block_stream *s)
+{
+    upipe_h265f_stream_fill_bits(s, 32);
+    unsigned int zeros = ubuf_block_stream_show_zeros(s);
+    if (unlikely(zeros >= 32)) {
+        /* invalid code */
+        ubuf_block_stream_skip_bits(s, 32);
+        return UINT32_MAX;
+    }
+
+    if (likely(zeros < 16)) {
+        /* the whole code is in the cache */
+        uint32_t result = ubuf_block_stream_show_bits(s, 2 * zeros + 1);
+        ubuf_block_stream_skip_bits(s, 2 * zeros + 1);
+        return result - 1;
+    }
+
+    ubuf_block_stream_skip_bits(s, zeros);
+    upipe_h265f_stream_fill_bits(s, zeros + 1);
+    uint32_t result = ubuf_block_stream_show_bits(s, zeros + 1);
+    ubuf_block_stream_skip_bits(s, zeros + 1);
+    return result - 1;
+}
+
+/** @internal @This reads a signed exp-golomb code from a stream.
+ *
+ * @param s ubuf block stream
+ * @return code read
+ */
+static int32_t upipe_h265f_stream_se(struct ubuf_block_stream *s)
+{
+    uint32_t v = upipe_h265f_stream_ue(s);
+
+    return (v & 1) ? (v + 1) / 2 : -(v / 2);
+}
+
+/** @internal @This skips the sub-layer part of the profile, tier and level
+ * structure.
+ *
+ * @param s ubuf block stream
+ * @param max_sub_layers number of sub-layers minus 1
+ */
+static void upipe_h265f_stream_skip_sub_layers(struct ubuf_block_stream *s,
+                                               uint8_t max_sub_layers)
+{
+    uint8_t i;
+    bool profile_present[8], level_present[8];
+    for (i = 0; i < max_sub_layers; i++) {
+        profile_present[i] = !!upipe_h265f_stream_bits(s, 1);
+        level_present[i] = !!upipe_h265f_stream_bits(s, 1);
+    }
+    if (max_sub_layers > 0)
+        upipe_h265f_stream_skip(s, 2 * (8 - max_sub_layers));
+    for (i = 0; i < max_sub_layers; i++) {
+        if (profile_present[i])
+            upipe_h265f_stream_skip(s, 88);
+        if (level_present[i])
+            upipe_h265f_stream_skip(s, 8);
+    }
+}
+
+/** @internal @This skips scaling list data.
+ *
+ * @param s ubuf block stream
+ */
+static void upipe_h265f_stream_skip_scaling(struct ubuf_block_stream *s)
+{
+    int size_id, matrix_id, i;
+    for (size_id = 0; size_id < 4; size_id++) {
+        for (matrix_id = 0; matrix_id < 6;
+             matrix_id += (size_id == 3) ? 3 : 1) {
+            if (!upipe_h265f_stream_bits(s, 1)) {
+                upipe_h265f_stream_ue(s); /* pred_matrix_id_delta */
+                continue;
+            }
+            int coef_num = 1 << (4 + (size_id << 1));
+            if (coef_num > 64)
+                coef_num = 64;
+            if (size_id > 1)
+                upipe_h265f_stream_se(s); /* dc_coef_minus8 */
+            for (i = 0; i < coef_num; i++)
+                upipe_h265f_stream_se(s); /* delta_coef */
+        }
+    }
+}
+
+/** @internal @This skips the short-term reference picture sets of an SPS.
+ *
+ * @param upipe description structure of the pipe
+ * @param s ubuf block stream
+ * @param nb_sets number of short-term reference picture sets
+ * @return false in case of invalid set
+ */
+static bool upipe_h265f_stream_skip_strps(struct upipe *upipe,
+                                          struct ubuf_block_stream *s,
+                                          uint32_t nb_sets)
+{
+    uint32_t num_delta_pocs[H265SPS_STRPS_MAX];
+    uint32_t i, j;
+    for (i = 0; i < nb_sets; i++) {
+        bool inter_rps_pred = false;
+        if (i)
+            inter_rps_pred = !!upipe_h265f_stream_bits(s, 1);
+
+        if (inter_rps_pred) {
+            upipe_h265f_stream_bits(s, 1); /* delta_rps_sign */
+            upipe_h265f_stream_ue(s); /* abs_delta_rps_minus1 */
+            num_delta_pocs[i] = 0;
+            /* the reference set is the previous one in the SPS */
+            for (j = 0; j <= num_delta_pocs[i - 1]; j++) {
+                bool used = !!upipe_h265f_stream_bits(s, 1);
+                if (used || upipe_h265f_stream_bits(s, 1)) /* use_delta */
+                    num_delta_pocs[i]++;
+            }
+        } else {
+            uint32_t num_negative = upipe_h265f_stream_ue(s);
+            uint32_t num_positive = upipe_h265f_stream_ue(s);
+            if (num_negative > H265SPS_DELTA_POCS_MAX ||
+                num_positive > H265SPS_DELTA_POCS_MAX) {
+                upipe_err_va(upipe, "invalid short-term RPS %"PRIu32, i);
+                return false;
+            }
+            num_delta_pocs[i] = num_negative + num_positive;
+            for (j = 0; j < num_delta_pocs[i]; j++) {
+                upipe_h265f_stream_ue(s); /* delta_poc_minus1 */
+                upipe_h265f_stream_bits(s, 1); /* used_by_curr_pic */
+            }
+        }
+
+        if (num_delta_pocs[i] > H265SPS_DELTA_POCS_MAX) {
+            upipe_err_va(upipe, "invalid short-term RPS %"PRIu32, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/** @internal @This parses the parameters of a sub-layer HRD, and only keeps
+ * the first CPB.
+ *
+ * @param s ubuf block stream
+ * @param cpb_cnt number of CPB specifications
+ * @param sub_pic true if sub-picture parameters are present
+ * @param bitrate_scale scale of the bit rate
+ * @param cpb_size_scale scale of the CPB size
+ * @param octetrate_p filled in with the octet rate
+ * @param cpb_size_p filled in with the CPB buffer size
+ * @return true if the stream is CBR
+ */
+static bool upipe_h265f_stream_parse_sub_hrd(struct ubuf_block_stream *s,
+                                             uint32_t cpb_cnt, bool sub_pic,
+                                             uint8_t bitrate_scale,
+                                             uint8_t cpb_size_scale,
+                                             uint64_t *octetrate_p,
+                                             uint64_t *cpb_size_p)
+{
+    bool ret = false;
+    uint32_t i;
+    for (i = 0; i < cpb_cnt; i++) {
+        uint64_t octetrate =
+            ((uint64_t)upipe_h265f_stream_ue(s) + 1) << (6 + bitrate_scale);
+        uint64_t cpb_size =
+            ((uint64_t)upipe_h265f_stream_ue(s) + 1) << (4 + cpb_size_scale);
+        if (sub_pic) {
+            upipe_h265f_stream_ue(s); /* cpb_size_du_value_minus1 */
+            upipe_h265f_stream_ue(s); /* bit_rate_du_value_minus1 */
+        }
+        if (upipe_h265f_stream_bits(s, 1) && !i) { /* cbr_flag */
+            *octetrate_p = octetrate / 8;
+            *cpb_size_p = cpb_size / 8;
+            ret = true;
+        }
+    }
+    return ret;
+}
+
+/** @internal @This parses hrd parameters.
+ *
+ * @param s ubuf block stream
+ * @param max_sub_layers number of sub-layers minus 1
+ * @param octetrate_p filled in with the octet rate
+ * @param cpb_size_p filled in with the CPB buffer size
+ * @param hrd_p filled in with true if NAL or VCL HRD parameters are present
+ * @return true if the stream is CBR
+ */
+static bool upipe_h265f_stream_parse_hrd(struct ubuf_block_stream *s,
+                                         uint8_t max_sub_layers,
+                                         uint64_t *octetrate_p,
+                                         uint64_t *cpb_size_p, bool *hrd_p)
+{
+    bool nal_hrd = !!upipe_h265f_stream_bits(s, 1);
+    bool vcl_hrd = !!upipe_h265f_stream_bits(s, 1);
+    bool sub_pic = false;
+    uint8_t bitrate_scale = 0, cpb_size_scale = 0;
+    if (nal_hrd || vcl_hrd) {
+        sub_pic = !!upipe_h265f_stream_bits(s, 1);
+        if (sub_pic)
+            upipe_h265f_stream_skip(s, 8 + 5 + 1 + 5);
+        bitrate_scale = upipe_h265f_stream_bits(s, 4);
+        cpb_size_scale = upipe_h265f_stream_bits(s, 4);
+        if (sub_pic)
+            upipe_h265f_stream_skip(s, 4);
+        /* initial_cpb_removal_delay, au_cpb_removal_delay and
+         * dpb_output_delay lengths */
+        upipe_h265f_stream_skip(s, 5 + 5 + 5);
+    }
+    *hrd_p = nal_hrd || vcl_hrd;
+
+    bool ret = false;
+    uint8_t i;
+    for (i = 0; i <= max_sub_layers; i++) {
+        bool fixed_pic_rate = true;
+        if (!upipe_h265f_stream_bits(s, 1)) /* fixed_pic_rate_general */
+            fixed_pic_rate = !!upipe_h265f_stream_bits(s, 1);
+        bool low_delay = false;
+        if (fixed_pic_rate)
+            upipe_h265f_stream_ue(s); /* elemental_duration_in_tc_minus1 */
+        else
+            low_delay = !!upipe_h265f_stream_bits(s, 1);
+        uint32_t cpb_cnt = 1;
+        if (!low_delay)
+            cpb_cnt = upipe_h265f_stream_ue(s) + 1;
+        if (cpb_cnt > 32)
+            return false;
+
+        uint64_t octetrate, cpb_size;
+        if (nal_hrd &&
+            upipe_h265f_stream_parse_sub_hrd(s, cpb_cnt, sub_pic,
+                bitrate_scale, cpb_size_scale, &octetrate, &cpb_size) &&
+            i == max_sub_layers) {
+            *octetrate_p = octetrate;
+            *cpb_size_p = cpb_size;
+            ret = true;
+        }
+        if (vcl_hrd &&
+            upipe_h265f_stream_parse_sub_hrd(s, cpb_cnt, sub_pic,
+                bitrate_scale, cpb_size_scale, &octetrate, &cpb_size) &&
+            i == max_sub_layers && !ret) {
+            *octetrate_p = octetrate;
+            *cpb_size_p = cpb_size;
+            ret = true;
+        }
+    }
+    return ret;
+}
+
+/** @internal @This copies the last NAL unit, starting at the NAL unit
+ * header, so that the buffer of the access unit is not held by parameter
+ * sets.
+ *
+ * @param upipe description structure of the pipe
+ * @return pointer to the copy, or NULL in case of allocation error
+ */
+static struct ubuf *upipe_h265f_extract_nal(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    size_t offset = upipe_h265f->au_last_nal_offset +
+                    upipe_h265f->au_last_nal_start_size - 1;
+    struct ubuf *ubuf = ubuf_block_copy(upipe_h265f->next_uref->ubuf->mgr,
+                                        upipe_h265f->next_uref->ubuf, offset,
+                                        upipe_h265f->au_size - offset);
+    if (unlikely(ubuf == NULL))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+    return ubuf;
+}
+
+/** @internal @This replaces a stored parameter set.
+ *
+ * @param ps_p reference to the stored parameter set
+ * @param ubuf new parameter set
+ * @return true if the content of the parameter set changed
+ */
+static bool upipe_h265f_replace_ps(struct ubuf **ps_p, struct ubuf *ubuf)
+{
+    bool changed = *ps_p == NULL || !ubase_check(ubuf_block_equal(*ps_p, ubuf));
+    if (*ps_p != NULL)
+        ubuf_free(*ps_p);
+    *ps_p = ubuf;
+    return changed;
+}
+
+/** @internal @This handles a video parameter set.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_h265f_handle_vps(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    struct ubuf *ubuf = upipe_h265f_extract_nal(upipe);
+    if (unlikely(ubuf == NULL))
+        return;
+
+    struct upipe_h265f_stream f;
+    upipe_h265f_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    if (!ubase_check(ubuf_block_stream_init(s, ubuf, 2))) {
+        ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uint32_t vps_id = upipe_h265f_stream_bits(s, 4);
+    ubuf_block_stream_clean(s);
+
+    if (upipe_h265f_replace_ps(&upipe_h265f->vps[vps_id], ubuf) &&
+        upipe_h265f->active_vps == vps_id) {
+        /* the whole chain has to be activated again */
+        upipe_h265f->active_vps = -1;
+        upipe_h265f->active_sps = -1;
+        upipe_h265f->active_pps = -1;
+    }
+}
+
+/** @internal @This handles a sequence parameter set.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_h265f_handle_sps(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    upipe_h265f->sps_rap = upipe_h265f->dts_rap;
+
+    struct ubuf *ubuf = upipe_h265f_extract_nal(upipe);
+    if (unlikely(ubuf == NULL))
+        return;
+
+    struct upipe_h265f_stream f;
+    upipe_h265f_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    if (!ubase_check(ubuf_block_stream_init(s, ubuf, 2))) {
+        ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    upipe_h265f_stream_bits(s, 4); /* vps_id */
+    uint8_t max_sub_layers = upipe_h265f_stream_bits(s, 3);
+    upipe_h265f_stream_bits(s, 1); /* temporal_id_nesting */
+    upipe_h265f_stream_skip(s, 96); /* general profile, tier and level */
+    upipe_h265f_stream_skip_sub_layers(s, max_sub_layers);
+    uint32_t sps_id = upipe_h265f_stream_ue(s);
+    ubuf_block_stream_clean(s);
+
+    if (unlikely(sps_id >= H265SPS_ID_MAX)) {
+        upipe_warn_va(upipe, "invalid SPS %"PRIu32, sps_id);
+        ubuf_free(ubuf);
+        return;
+    }
+
+    if (upipe_h265f_replace_ps(&upipe_h265f->sps[sps_id], ubuf) &&
+        upipe_h265f->active_sps == sps_id) {
+        /* the PPS refers to the SPS, so it has to be activated again */
+        upipe_h265f->active_sps = -1;
+        upipe_h265f->active_pps = -1;
+    }
+}
+
+/** @internal @This handles a picture parameter set.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_h265f_handle_pps(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    upipe_h265f->pps_rap = upipe_h265f->sps_rap;
+
+    struct ubuf *ubuf = upipe_h265f_extract_nal(upipe);
+    if (unlikely(ubuf == NULL))
+        return;
+
+    struct upipe_h265f_stream f;
+    upipe_h265f_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    if (!ubase_check(ubuf_block_stream_init(s, ubuf, 2))) {
+        ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uint32_t pps_id = upipe_h265f_stream_ue(s);
+    ubuf_block_stream_clean(s);
+
+    if (unlikely(pps_id >= H265PPS_ID_MAX)) {
+        upipe_warn_va(upipe, "invalid PPS %"PRIu32, pps_id);
+        ubuf_free(ubuf);
+        return;
+    }
+
+    if (upipe_h265f_replace_ps(&upipe_h265f->pps[pps_id], ubuf) &&
+        upipe_h265f->active_pps == pps_id)
+        upipe_h265f->active_pps = -1;
+}
+
+/** @internal @This returns the maximum bit rate and CPB size of a level,
+ * for the Main and Main 10 profiles (ITU-T H.265 A.4.2).
+ *
+ * @param upipe description structure of the pipe
+ * @param level general_level_idc
+ * @param high_tier true for the High tier
+ * @param max_octetrate_p filled in with the maximum octet rate
+ * @param max_bs_p filled in with the maximum buffer size
+ */
+static void upipe_h265f_level_limits(struct upipe *upipe, uint8_t level,
+                                     bool high_tier, uint64_t *max_octetrate_p,
+                                     uint64_t *max_bs_p)
+{
+    /* in kbit/s and kbit, which for these profiles are equal */
+    uint64_t main_tier, high;
+    switch (level) {
+        case 30:
+            *max_octetrate_p = 128000 / 8;
+            *max_bs_p = 350000 / 8;
+            return;
+        case 60: main_tier = high = 1500; break;
+        case 63: main_tier = high = 3000; break;
+        case 90: main_tier = high = 6000; break;
+        case 93: main_tier = high = 10000; break;
+        case 120: main_tier = 12000; high = 30000; break;
+        case 123: main_tier = 20000; high = 50000; break;
+        case 150: main_tier = 25000; high = 100000; break;
+        case 153: main_tier = 40000; high = 160000; break;
+        case 156: main_tier = 60000; high = 240000; break;
+        case 180: main_tier = 60000; high = 240000; break;
+        case 183: main_tier = 120000; high = 480000; break;
+        default:
+            upipe_warn_va(upipe, "unknown level %"PRIu8, level);
+            /* intended fall-through */
+        case 186: main_tier = 240000; high = 800000; break;
+    }
+    *max_octetrate_p = (high_tier ? high : main_tier) * 1000 / 8;
+    *max_bs_p = *max_octetrate_p;
+}
+
+/** @internal @This activates a video parameter set. So far we only check
+ * that it was received.
+ *
+ * @param upipe description structure of the pipe
+ * @param vps_id VPS to activate
+ * @return false if the VPS couldn't be activated
+ */
+static bool upipe_h265f_activate_vps(struct upipe *upipe, uint32_t vps_id)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    if (likely(upipe_h265f->active_vps == vps_id))
+        return true;
+    if (unlikely(upipe_h265f->vps[vps_id] == NULL))
+        return false;
+    upipe_h265f->active_vps = vps_id;
+    return true;
+}
+
+/** @internal @This activates a sequence parameter set.
+ *
+ * @param upipe description structure of the pipe
+ * @param sps_id SPS to activate
+ * @return false if the SPS couldn't be activated
+ */
+static bool upipe_h265f_activate_sps(struct upipe *upipe, uint32_t sps_id)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    if (likely(upipe_h265f->active_sps == sps_id))
+        return true;
+    if (unlikely(upipe_h265f->sps[sps_id] == NULL))
+        return false;
+
+    struct upipe_h265f_stream f;
+    upipe_h265f_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    if (!ubase_check(ubuf_block_stream_init(s, upipe_h265f->sps[sps_id], 2))) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+
+    uint32_t vps_id = upipe_h265f_stream_bits(s, 4);
+    if (!upipe_h265f_activate_vps(upipe, vps_id)) {
+        ubuf_block_stream_clean(s);
+        return false;
+    }
+    uint8_t max_sub_layers = upipe_h265f_stream_bits(s, 3);
+    upipe_h265f_stream_bits(s, 1); /* temporal_id_nesting */
+
+    struct uref *flow_def = upipe_h265f_alloc_flow_def_attr(upipe);
+    if (unlikely(flow_def == NULL)) {
+        ubuf_block_stream_clean(s);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+
+    upipe_h265f_stream_bits(s, 2); /* general_profile_space */
+    bool high_tier = !!upipe_h265f_stream_bits(s, 1);
+    uint8_t profile = upipe_h265f_stream_bits(s, 5);
+    /* compatibility, source and constraint flags */
+    upipe_h265f_stream_skip(s, 32 + 4 + 43 + 1);
+    uint8_t level = upipe_h265f_stream_bits(s, 8);
+    UBASE_FATAL(upipe, uref_h265_flow_set_profile(flow_def, profile))
+    UBASE_FATAL(upipe, uref_h265_flow_set_level(flow_def, level))
+    if (high_tier)
+        UBASE_FATAL(upipe, uref_h265_flow_set_high_tier(flow_def))
+    upipe_h265f_stream_skip_sub_layers(s, max_sub_layers);
+
+    uint64_t max_octetrate, max_bs;
+    upipe_h265f_level_limits(upipe, level, high_tier, &max_octetrate, &max_bs);
+    UBASE_FATAL(upipe, uref_block_flow_set_max_octetrate(flow_def, max_octetrate))
+    UBASE_FATAL(upipe, uref_block_flow_set_max_buffer_size(flow_def, max_bs))
+
+    upipe_h265f_stream_ue(s); /* sps_id */
+    uint32_t chroma_idc = upipe_h265f_stream_ue(s);
+    upipe_h265f->separate_colour_plane = false;
+    if (chroma_idc == H265SPS_CHROMA_444)
+        upipe_h265f->separate_colour_plane = !!upipe_h265f_stream_bits(s, 1);
+
+    uint64_t hsize = upipe_h265f_stream_ue(s);
+    uint64_t vsize = upipe_h265f_stream_ue(s);
+    if (upipe_h265f_stream_bits(s, 1)) { /* conformance_window */
+        uint32_t crop_left = upipe_h265f_stream_ue(s);
+        uint32_t crop_right = upipe_h265f_stream_ue(s);
+        uint32_t crop_top = upipe_h265f_stream_ue(s);
+        uint32_t crop_bottom = upipe_h265f_stream_ue(s);
+        uint8_t sub_width = 1, sub_height = 1;
+        if (!upipe_h265f->separate_colour_plane &&
+            (chroma_idc == H265SPS_CHROMA_420 ||
+             chroma_idc == H265SPS_CHROMA_422))
+            sub_width = 2;
+        if (!upipe_h265f->separate_colour_plane &&
+            chroma_idc == H265SPS_CHROMA_420)
+            sub_height = 2;
+        hsize -= (crop_left + crop_right) * sub_width;
+        vsize -= (crop_top + crop_bottom) * sub_height;
+    }
+    UBASE_FATAL(upipe, uref_pic_flow_set_hsize(flow_def, hsize))
+    UBASE_FATAL(upipe, uref_pic_flow_set_vsize(flow_def, vsize))
+
+    uint8_t luma_depth = 8 + upipe_h265f_stream_ue(s);
+    uint8_t chroma_depth = 8 + upipe_h265f_stream_ue(s);
+    if (upipe_h265f->separate_colour_plane)
+        chroma_depth = luma_depth;
+
+    UBASE_FATAL(upipe, uref_pic_flow_set_macropixel(flow_def, 1))
+    UBASE_FATAL(upipe, uref_pic_flow_set_planes(flow_def, 0))
+    if (luma_depth == 8)
+        UBASE_FATAL(upipe, uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"))
+    else {
+        UBASE_FATAL(upipe, uref_pic_flow_add_plane(flow_def, 1, 1, 2, "y16"))
+        luma_depth = 16;
+    }
+    if (chroma_idc == H265SPS_CHROMA_MONO)
+        UBASE_FATAL(upipe, uref_flow_set_def_va(flow_def,
+                UPIPE_H265F_EXPECTED_FLOW_DEF "pic.planar%"PRIu8"_mono.",
+                luma_depth))
+    else {
+        uint8_t hsub, vsub;
+        const char *chroma;
+        switch (chroma_idc) {
+            case H265SPS_CHROMA_420:
+                hsub = 2;
+                vsub = 2;
+                chroma = "420";
+                break;
+            case H265SPS_CHROMA_422:
+                hsub = 2;
+                vsub = 1;
+                chroma = "422";
+                break;
+            case H265SPS_CHROMA_444:
+                hsub = 1;
+                vsub = 1;
+                chroma = "444";
+                break;
+            default:
+                upipe_err_va(upipe, "invalid chroma format %"PRIu32,
+                             chroma_idc);
+                ubuf_block_stream_clean(s);
+                uref_free(flow_def);
+                return false;
+        }
+        if (chroma_depth == 8) {
+            UBASE_FATAL(upipe, uref_pic_flow_add_plane(flow_def, hsub, vsub, 1, "u8"))
+            UBASE_FATAL(upipe, uref_pic_flow_add_plane(flow_def, hsub, vsub, 1, "v8"))
+            UBASE_FATAL(upipe, uref_flow_set_def_va(flow_def,
+                    UPIPE_H265F_EXPECTED_FLOW_DEF "pic.planar%"PRIu8"_8_%s.",
+                    luma_depth, chroma))
+        } else {
+            UBASE_FATAL(upipe, uref_pic_flow_add_plane(flow_def, hsub, vsub, 2, "u16"))
+            UBASE_FATAL(upipe, uref_pic_flow_add_plane(flow_def, hsub, vsub, 2, "v16"))
+            UBASE_FATAL(upipe, uref_flow_set_def_va(flow_def,
+                    UPIPE_H265F_EXPECTED_FLOW_DEF "pic.planar%"PRIu8"_16_%s.",
+                    luma_depth, chroma))
+        }
+    }
+
+    upipe_h265f->log2_max_poc_lsb = 4 + upipe_h265f_stream_ue(s);
+    if (upipe_h265f->log2_max_poc_lsb > 16) {
+        upipe_err_va(upipe, "invalid log2_max_poc_lsb %"PRIu32,
+                     upipe_h265f->log2_max_poc_lsb);
+        upipe_h265f->log2_max_poc_lsb = 0;
+        ubuf_block_stream_clean(s);
+        uref_free(flow_def);
+        return false;
+    }
+
+    uint8_t i = upipe_h265f_stream_bits(s, 1) ? 0 : max_sub_layers;
+    for ( ; i <= max_sub_layers; i++) {
+        upipe_h265f_stream_ue(s); /* max_dec_pic_buffering_minus1 */
+        upipe_h265f_stream_ue(s); /* max_num_reorder_pics */
+        upipe_h265f_stream_ue(s); /* max_latency_increase_plus1 */
+    }
+
+    upipe_h265f_stream_ue(s); /* log2_min_luma_coding_block_size_minus3 */
+    upipe_h265f_stream_ue(s); /* log2_diff_max_min_luma_coding_block_size */
+    upipe_h265f_stream_ue(s); /* log2_min_luma_transform_block_size_minus2 */
+    upipe_h265f_stream_ue(s); /* log2_diff_max_min_luma_transform_size */
+    upipe_h265f_stream_ue(s); /* max_transform_hierarchy_depth_inter */
+    upipe_h265f_stream_ue(s); /* max_transform_hierarchy_depth_intra */
+    if (upipe_h265f_stream_bits(s, 1) && /* scaling_list_enabled */
+        upipe_h265f_stream_bits(s, 1)) /* sps_scaling_list_data_present */
+        upipe_h265f_stream_skip_scaling(s);
+    upipe_h265f_stream_bits(s, 2); /* amp, sample_adaptive_offset */
+    if (upipe_h265f_stream_bits(s, 1)) { /* pcm_enabled */
+        upipe_h265f_stream_bits(s, 8); /* pcm_sample_bit_depths */
+        upipe_h265f_stream_ue(s); /* log2_min_pcm_luma_coding_block_size */
+        upipe_h265f_stream_ue(s); /* log2_diff_max_min_pcm_luma_coding_b_s */
+        upipe_h265f_stream_bits(s, 1); /* pcm_loop_filter_disabled */
+    }
+
+    uint32_t nb_strps = upipe_h265f_stream_ue(s);
+    if (nb_strps > H265SPS_STRPS_MAX ||
+        !upipe_h265f_stream_skip_strps(upipe, s, nb_strps)) {
+        upipe_err_va(upipe, "invalid short-term RPS in SPS %"PRIu32, sps_id);
+        ubuf_block_stream_clean(s);
+        uref_free(flow_def);
+        return false;
+    }
+
+    if (upipe_h265f_stream_bits(s, 1)) { /* long_term_ref_pics_present */
+        uint32_t nb_ltrp = upipe_h265f_stream_ue(s);
+        if (nb_ltrp > 32) {
+            upipe_err_va(upipe, "invalid num_long_term_ref_pics %"PRIu32,
+                         nb_ltrp);
+            ubuf_block_stream_clean(s);
+            uref_free(flow_def);
+            return false;
+        }
+        while (nb_ltrp > 0) {
+            upipe_h265f_stream_bits(s, upipe_h265f->log2_max_poc_lsb);
+            upipe_h265f_stream_bits(s, 1); /* used_by_curr_pic_lt */
+            nb_ltrp--;
+        }
+    }
+    /* temporal_mvp_enabled, strong_intra_smoothing_enabled */
+    upipe_h265f_stream_bits(s, 2);
+
+    upipe_h265f->sar.den = 0;
+    upipe_h265f->field_seq = false;
+    upipe_h265f->frame_field_info_present = false;
+    upipe_h265f->duration = 0;
+    if (upipe_h265f_stream_bits(s, 1)) { /* vui_parameters_present */
+        if (upipe_h265f_stream_bits(s, 1)) { /* aspect_ratio_info_present */
+            uint8_t ar_idc = upipe_h265f_stream_bits(s, 8);
+            if (ar_idc > 0 &&
+                ar_idc < sizeof(sar_from_idc) / sizeof(struct urational)) {
+                upipe_h265f->sar = sar_from_idc[ar_idc];
+                UBASE_FATAL(upipe, uref_pic_flow_set_sar(flow_def, upipe_h265f->sar))
+            } else if (ar_idc == H265VUI_AR_EXTENDED) {
+                upipe_h265f->sar.num = upipe_h265f_stream_bits(s, 16);
+                upipe_h265f->sar.den = upipe_h265f_stream_bits(s, 16);
+                UBASE_FATAL(upipe, uref_pic_flow_set_sar(flow_def, upipe_h265f->sar))
+            } else
+                upipe_warn_va(upipe, "unknown aspect ratio idc %"PRIu8, ar_idc);
+        }
+
+        if (upipe_h265f_stream_bits(s, 1)) { /* overscan_info_present */
+            if (upipe_h265f_stream_bits(s, 1))
+                UBASE_FATAL(upipe, uref_pic_flow_set_overscan(flow_def))
+        }
+
+        if (upipe_h265f_stream_bits(s, 1)) { /* video_signal_type_present */
+            upipe_h265f_stream_bits(s, 4); /* video_format, full_range */
+            if (upipe_h265f_stream_bits(s, 1)) /* colour_description */
+                upipe_h265f_stream_bits(s, 24);
+        }
+
+        if (upipe_h265f_stream_bits(s, 1)) { /* chroma_loc_info_present */
+            upipe_h265f_stream_ue(s);
+            upipe_h265f_stream_ue(s);
+        }
+
+        upipe_h265f_stream_bits(s, 1); /* neutral_chroma_indication */
+        upipe_h265f->field_seq = !!upipe_h265f_stream_bits(s, 1);
+        upipe_h265f->frame_field_info_present =
+            !!upipe_h265f_stream_bits(s, 1);
+        if (upipe_h265f_stream_bits(s, 1)) { /* default_display_window */
+            upipe_h265f_stream_ue(s);
+            upipe_h265f_stream_ue(s);
+            upipe_h265f_stream_ue(s);
+            upipe_h265f_stream_ue(s);
+        }
+
+        if (upipe_h265f_stream_bits(s, 1)) { /* vui_timing_info_present */
+            uint32_t num_units_in_tick = upipe_h265f_stream_bits(s, 16) << 16;
+            num_units_in_tick |= upipe_h265f_stream_bits(s, 16);
+            uint32_t time_scale = upipe_h265f_stream_bits(s, 16) << 16;
+            time_scale |= upipe_h265f_stream_bits(s, 16);
+            if (num_units_in_tick && time_scale) {
+                /* a tick is a field when pictures are fields */
+                struct urational frame_rate = {
+                    .num = time_scale,
+                    .den = (uint64_t)num_units_in_tick *
+                           (upipe_h265f->field_seq ? 2 : 1)
+                };
+                urational_simplify(&frame_rate);
+                UBASE_FATAL(upipe, uref_pic_flow_set_fps(flow_def, frame_rate))
+                upipe_h265f->duration = (uint64_t)UCLOCK_FREQ *
+                                        num_units_in_tick / time_scale;
+                UBASE_FATAL(upipe, uref_clock_set_latency(flow_def,
+                            upipe_h265f->input_latency +
+                            upipe_h265f->duration))
+            }
+
+            if (upipe_h265f_stream_bits(s, 1)) /* poc_proportional_to_timing */
+                upipe_h265f_stream_ue(s);
+
+            uint64_t octetrate, cpb_size;
+            bool hrd;
+            if (upipe_h265f_stream_bits(s, 1) && /* hrd_parameters_present */
+                upipe_h265f_stream_parse_hrd(s, max_sub_layers, &octetrate,
+                                             &cpb_size, &hrd)) {
+                UBASE_FATAL(upipe, uref_block_flow_set_octetrate(flow_def, octetrate))
+                UBASE_FATAL(upipe, uref_block_flow_set_buffer_size(flow_def, cpb_size))
+            }
+        }
+    }
+
+    if (unlikely(s->overflow)) {
+        upipe_err_va(upipe, "truncated SPS %"PRIu32, sps_id);
+        ubuf_block_stream_clean(s);
+        uref_free(flow_def);
+        return false;
+    }
+
+    upipe_h265f->active_sps = sps_id;
+    ubuf_block_stream_clean(s);
+    flow_def = upipe_h265f_store_flow_def_attr(upipe, flow_def);
+    if (unlikely(flow_def == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+    upipe_h265f_store_flow_def(upipe, flow_def);
+    return true;
+}
+
+/** @internal @This activates a picture parameter set.
+ *
+ * @param upipe description structure of the pipe
+ * @param pps_id PPS to activate
+ * @return false if the PPS couldn't be activated
+ */
+static bool upipe_h265f_activate_pps(struct upipe *upipe, uint32_t pps_id)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    if (likely(upipe_h265f->active_pps == pps_id))
+        return true;
+    if (unlikely(upipe_h265f->pps[pps_id] == NULL))
+        return false;
+
+    struct upipe_h265f_stream f;
+    upipe_h265f_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    if (!ubase_check(ubuf_block_stream_init(s, upipe_h265f->pps[pps_id], 2))) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+
+    upipe_h265f_stream_ue(s); /* pps_id */
+    uint32_t sps_id = upipe_h265f_stream_ue(s);
+    if (unlikely(sps_id >= H265SPS_ID_MAX)) {
+        upipe_warn_va(upipe, "invalid SPS %"PRIu32" in PPS", sps_id);
+        ubuf_block_stream_clean(s);
+        return false;
+    }
+    if (!upipe_h265f_activate_sps(upipe, sps_id)) {
+        ubuf_block_stream_clean(s);
+        return false;
+    }
+
+    upipe_h265f_stream_bits(s, 1); /* dependent_slice_segments_enabled */
+    upipe_h265f->output_flag_present = !!upipe_h265f_stream_bits(s, 1);
+    upipe_h265f->num_extra_slice_header_bits = upipe_h265f_stream_bits(s, 3);
+
+    upipe_h265f->active_pps = pps_id;
+    ubuf_block_stream_clean(s);
+    return true;
+}
+
+/** @internal @This handles the supplemental enhancement information called
+ * buffering period.
+ *
+ * @param upipe description structure of the pipe
+ * @param s block stream parsing structure
+ */
+static void upipe_h265f_handle_sei_buffering_period(struct upipe *upipe,
+                                                    struct ubuf_block_stream *s)
+{
+    uint32_t sps_id = upipe_h265f_stream_ue(s);
+    if (unlikely(sps_id >= H265SPS_ID_MAX)) {
+        upipe_warn_va(upipe, "invalid SPS %"PRIu32" in SEI", sps_id);
+        return;
+    }
+
+    upipe_h265f_activate_sps(upipe, sps_id);
+}
+
+/** @internal @This handles the supplemental enhancement information called
+ * picture timing.
+ *
+ * @param upipe description structure of the pipe
+ * @param s block stream parsing structure
+ */
+static void upipe_h265f_handle_sei_pic_timing(struct upipe *upipe,
+                                              struct ubuf_block_stream *s)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    if (unlikely(upipe_h265f->active_sps == -1))
+        return;
+
+    if (upipe_h265f->frame_field_info_present)
+        upipe_h265f->pic_struct = upipe_h265f_stream_bits(s, 4);
+}
+
+/** @internal @This handles a prefix supplemental enhancement information
+ * NAL, which may contain several messages.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_h265f_handle_sei(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    size_t offset = upipe_h265f->au_last_nal_offset +
+                    upipe_h265f->au_last_nal_start_size + 1;
+    if (unlikely(offset >= upipe_h265f->au_size))
+        return;
+    size_t nal_size = upipe_h265f->au_size - offset;
+
+    struct upipe_h265f_stream f;
+    upipe_h265f_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    UBASE_FATAL_RETURN(upipe, ubuf_block_stream_init(s,
+                upipe_h265f->next_uref->ubuf, offset))
+
+    for ( ; ; ) {
+        uint32_t type = 0, size = 0;
+        uint8_t octet;
+        do {
+            octet = upipe_h265f_stream_bits(s, 8);
+            type += octet;
+        } while (octet == UINT8_MAX && !s->overflow);
+        /* rbsp_trailing_bits */
+        if (type == 0x80)
+            break;
+        do {
+            octet = upipe_h265f_stream_bits(s, 8);
+            size += octet;
+        } while (octet == UINT8_MAX && !s->overflow);
+        if (unlikely(s->overflow || size > nal_size))
+            break;
+
+        size_t end = upipe_h265f_stream_pos(s) + size * 8;
+        switch (type) {
+            case H265SEI_BUFFERING_PERIOD:
+                upipe_h265f_handle_sei_buffering_period(upipe, s);
+                break;
+            case H265SEI_PIC_TIMING:
+                upipe_h265f_handle_sei_pic_timing(upipe, s);
+                break;
+            default:
+                break;
+        }
+
+        size_t pos = upipe_h265f_stream_pos(s);
+        if (unlikely(pos > end || s->overflow))
+            break;
+        upipe_h265f_stream_skip(s, end - pos);
+    }
+
+    ubuf_block_stream_clean(s);
+}
+
+/** @internal @This handles and outputs an access unit.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_h265f_output_au(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    if (!upipe_h265f->au_size)
+        return;
+    if (!upipe_h265f->au_slice ||
+        upipe_h265f->active_sps == -1 || upipe_h265f->active_pps == -1) {
+        upipe_h265f_consume_uref_stream(upipe, upipe_h265f->au_size);
+        upipe_h265f->au_size = 0;
+        upipe_h265f->au_vcl_offset = -1;
+        upipe_h265f->au_slice = false;
+        upipe_h265f->au_slice_nal = UINT8_MAX;
+        upipe_h265f->pic_struct = -1;
+        return;
+    }
+
+    struct uref au_uref_s = upipe_h265f->au_uref_s;
+    /* From now on, PTS declaration only impacts the next frame. */
+    upipe_h265f_flush_dates(upipe);
+
+    struct uref *uref = upipe_h265f_extract_uref_stream(upipe,
+                                                        upipe_h265f->au_size);
+    if (unlikely(uref == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    uint64_t picture_number = upipe_h265f->last_picture_number +
+        (int64_t)(upipe_h265f->poc - upipe_h265f->last_poc);
+    if (upipe_h265f->poc > upipe_h265f->last_poc) {
+        upipe_h265f->last_poc = upipe_h265f->poc;
+        upipe_h265f->last_picture_number = picture_number;
+    }
+    UBASE_FATAL(upipe, uref_pic_set_number(uref, picture_number))
+
+    uint64_t duration = upipe_h265f->duration;
+    if (upipe_h265f->pic_struct == -1)
+        upipe_h265f->pic_struct = upipe_h265f->field_seq ?
+            H265SEI_STRUCT_TOP : H265SEI_STRUCT_FRAME;
+
+    switch (upipe_h265f->pic_struct) {
+        case H265SEI_STRUCT_FRAME:
+            UBASE_FATAL(upipe, uref_pic_set_progressive(uref))
+            break;
+        case H265SEI_STRUCT_TOP:
+        case H265SEI_STRUCT_TOP_PREV_BOT:
+        case H265SEI_STRUCT_TOP_NEXT_BOT:
+            UBASE_FATAL(upipe, uref_pic_set_tf(uref))
+            break;
+        case H265SEI_STRUCT_BOT:
+        case H265SEI_STRUCT_BOT_PREV_TOP:
+        case H265SEI_STRUCT_BOT_NEXT_TOP:
+            UBASE_FATAL(upipe, uref_pic_set_bf(uref))
+            break;
+        case H265SEI_STRUCT_TOP_BOT:
+            UBASE_FATAL(upipe, uref_pic_set_tf(uref))
+            UBASE_FATAL(upipe, uref_pic_set_bf(uref))
+            UBASE_FATAL(upipe, uref_pic_set_tff(uref))
+            break;
+        case H265SEI_STRUCT_BOT_TOP:
+            UBASE_FATAL(upipe, uref_pic_set_tf(uref))
+            UBASE_FATAL(upipe, uref_pic_set_bf(uref))
+            break;
+        case H265SEI_STRUCT_TOP_BOT_TOP:
+            UBASE_FATAL(upipe, uref_pic_set_tf(uref))
+            UBASE_FATAL(upipe, uref_pic_set_bf(uref))
+            UBASE_FATAL(upipe, uref_pic_set_tff(uref))
+            duration = duration * 3 / 2;
+            break;
+        case H265SEI_STRUCT_BOT_TOP_BOT:
+            UBASE_FATAL(upipe, uref_pic_set_tf(uref))
+            UBASE_FATAL(upipe, uref_pic_set_bf(uref))
+            duration = duration * 3 / 2;
+            break;
+        case H265SEI_STRUCT_DOUBLE:
+            UBASE_FATAL(upipe, uref_pic_set_progressive(uref))
+            duration *= 2;
+            break;
+        case H265SEI_STRUCT_TRIPLE:
+            UBASE_FATAL(upipe, uref_pic_set_progressive(uref))
+            duration *= 3;
+            break;
+        default:
+            upipe_warn_va(upipe, "invalid picture structure %"PRId32,
+                          upipe_h265f->pic_struct);
+            break;
+    }
+    if (duration)
+        UBASE_FATAL(upipe, uref_clock_set_duration(uref, duration))
+
+    /* We work on encoded data so in the DTS domain. Rebase on DTS. */
+    uint64_t date;
+#define SET_DATE(dv)                                                        \
+    if (ubase_check(uref_clock_get_dts_##dv(&au_uref_s, &date))) {          \
+        uref_clock_set_dts_##dv(uref, date);                                \
+        if (!ubase_check(uref_clock_get_dts_##dv(&upipe_h265f->au_uref_s,   \
+                                                 NULL)))                    \
+            uref_clock_set_dts_##dv(&upipe_h265f->au_uref_s,                \
+                                    date + duration);                       \
+    } else if (ubase_check(uref_clock_get_dts_##dv(uref, &date)))           \
+        uref_clock_set_date_##dv(uref, UINT64_MAX, UREF_DATE_NONE);
+    SET_DATE(sys)
+    SET_DATE(prog)
+    SET_DATE(orig)
+#undef SET_DATE
+
+    if (ubase_check(uref_clock_get_dts_pts_delay(&au_uref_s, &date)))
+        uref_clock_set_dts_pts_delay(uref, date);
+    else
+        uref_clock_delete_dts_pts_delay(uref);
+
+    if (upipe_h265f->slice_type == H265SLI_TYPE_I) {
+        upipe_h265f->iframe_rap = upipe_h265f->pps_rap;
+        UBASE_FATAL(upipe, uref_pic_set_key(uref))
+    }
+
+    if (upipe_h265f->iframe_rap != UINT64_MAX)
+        if (!ubase_check(uref_clock_set_rap_sys(uref, upipe_h265f->iframe_rap)))
+            upipe_warn_va(upipe, "couldn't set rap_sys");
+    if (upipe_h265f->au_vcl_offset > 0)
+        UBASE_FATAL(upipe, uref_block_set_header_size(uref,
+                                               upipe_h265f->au_vcl_offset))
+
+    upipe_h265f->au_size = 0;
+    upipe_h265f->au_vcl_offset = -1;
+    upipe_h265f->au_slice = false;
+    upipe_h265f->au_slice_nal = UINT8_MAX;
+    upipe_h265f->pic_struct = -1;
+
+    if (unlikely(upipe_h265f->flow_def == NULL)) {
+        uref_free(uref);
+        return;
+    }
+
+    upipe_h265f_output(upipe, uref, upump_p);
+}
+
+/** @internal @This outputs the previous access unit, before the current NAL.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_h265f_output_prev_au(struct upipe *upipe,
+                                       struct upump **upump_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    size_t slice_size = upipe_h265f->au_size -
+                        upipe_h265f->au_last_nal_offset;
+    uint8_t slice_nal = upipe_h265f->au_slice_nal;
+    upipe_h265f->au_size = upipe_h265f->au_last_nal_offset;
+    upipe_h265f_output_au(upipe, upump_p);
+    upipe_h265f->au_size = slice_size;
+    upipe_h265f->au_last_nal_offset = 0;
+    upipe_h265f->au_vcl_offset = 0;
+    upipe_h265f->au_slice_nal = slice_nal;
+}
+
+/** @internal @This parses the header of the first slice segment of a
+ * picture, and outputs the previous access unit if it was not terminated
+ * by a non-VCL NAL.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_h265f_parse_slice(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    uint8_t nal_type = h265nalst_get_type(upipe_h265f->au_last_nal);
+    struct upipe_h265f_stream f;
+    upipe_h265f_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    UBASE_FATAL_RETURN(upipe, ubuf_block_stream_init(s,
+                upipe_h265f->next_uref->ubuf,
+                upipe_h265f->au_last_nal_offset +
+                upipe_h265f->au_last_nal_start_size));
+
+    uint8_t temporal_id = (upipe_h265f_stream_bits(s, 8) & 0x7) - 1;
+    if (!upipe_h265f_stream_bits(s, 1)) {
+        /* not the first slice segment of the picture */
+        ubuf_block_stream_clean(s);
+        return;
+    }
+
+    if (upipe_h265f->au_slice) {
+        ubuf_block_stream_clean(s);
+        upipe_h265f_output_prev_au(upipe, upump_p);
+        UBASE_FATAL_RETURN(upipe, ubuf_block_stream_init(s,
+                    upipe_h265f->next_uref->ubuf,
+                    upipe_h265f->au_last_nal_offset +
+                    upipe_h265f->au_last_nal_start_size));
+        upipe_h265f_stream_bits(s, 8 + 1);
+    }
+
+    bool irap = nal_type >= H265NAL_TYPE_BLA_W_LP &&
+                nal_type <= H265NAL_TYPE_RSV_IRAP_23;
+    if (irap)
+        upipe_h265f_stream_bits(s, 1); /* no_output_of_prior_pics */
+    uint32_t pps_id = upipe_h265f_stream_ue(s);
+    if (unlikely(pps_id >= H265PPS_ID_MAX)) {
+        upipe_warn_va(upipe, "invalid PPS %"PRIu32" in slice", pps_id);
+        ubuf_block_stream_clean(s);
+        return;
+    }
+
+    if (unlikely(!upipe_h265f_activate_pps(upipe, pps_id))) {
+        ubuf_block_stream_clean(s);
+        return;
+    }
+
+    upipe_h265f_stream_bits(s, upipe_h265f->num_extra_slice_header_bits);
+    upipe_h265f->slice_type = upipe_h265f_stream_ue(s);
+    if (upipe_h265f->output_flag_present)
+        upipe_h265f_stream_bits(s, 1); /* pic_output_flag */
+    if (upipe_h265f->separate_colour_plane)
+        upipe_h265f_stream_bits(s, 2); /* colour_plane_id */
+
+    /* ITU-T H.265 8.3.1 */
+    bool no_rasl_output = nal_type == H265NAL_TYPE_IDR_W_RADL ||
+        nal_type == H265NAL_TYPE_IDR_N_LP ||
+        (irap && (nal_type < H265NAL_TYPE_CRA || upipe_h265f->first_irap));
+    int32_t poc = 0;
+    if (nal_type != H265NAL_TYPE_IDR_W_RADL &&
+        nal_type != H265NAL_TYPE_IDR_N_LP) {
+        int32_t max_poc_lsb = 1 << upipe_h265f->log2_max_poc_lsb;
+        int32_t poc_lsb = upipe_h265f_stream_bits(s,
+                upipe_h265f->log2_max_poc_lsb);
+        int32_t prev_poc_lsb = upipe_h265f->prev_tid0_poc & (max_poc_lsb - 1);
+        int32_t poc_msb = upipe_h265f->prev_tid0_poc - prev_poc_lsb;
+        if (irap && no_rasl_output)
+            poc_msb = 0;
+        else if (poc_lsb < prev_poc_lsb &&
+                 prev_poc_lsb - poc_lsb >= max_poc_lsb / 2)
+            poc_msb += max_poc_lsb;
+        else if (poc_lsb > prev_poc_lsb &&
+                 poc_lsb - prev_poc_lsb > max_poc_lsb / 2)
+            poc_msb -= max_poc_lsb;
+        poc = poc_msb + poc_lsb;
+    }
+    ubuf_block_stream_clean(s);
+
+    if (!temporal_id &&
+        (nal_type < H265NAL_TYPE_RADL_N || nal_type > H265NAL_TYPE_RASL_R) &&
+        (nal_type > H265NAL_TYPE_RSV_VCL_N14 || (nal_type & 1)))
+        upipe_h265f->prev_tid0_poc = poc;
+    if (irap && no_rasl_output)
+        upipe_h265f->last_poc = -1;
+    if (irap)
+        upipe_h265f->first_irap = false;
+    upipe_h265f->poc = poc;
+    upipe_h265f->au_slice = true;
+}
+
+/** @internal @This is called when a new NAL starts, to check the previous NAL.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_h265f_nal_end(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    if (unlikely(!upipe_h265f->acquired)) {
+        /* we need to discard previous data */
+        upipe_h265f_consume_uref_stream(upipe, upipe_h265f->au_size);
+        upipe_h265f->au_size = 0;
+        upipe_h265f_sync_acquired(upipe);
+        return;
+    }
+    if (upipe_h265f->au_last_nal_offset == -1)
+        return;
+
+    uint8_t last_nal_type = h265nalst_get_type(upipe_h265f->au_last_nal);
+    if (last_nal_type <= H265NAL_TYPE_CRA) {
+        if (unlikely(upipe_h265f->got_discontinuity))
+            uref_flow_set_error(upipe_h265f->next_uref);
+        else
+            upipe_h265f_parse_slice(upipe, upump_p);
+        if (last_nal_type >= H265NAL_TYPE_BLA_W_LP) {
+            UBASE_FATAL(upipe, uref_flow_set_random(upipe_h265f->next_uref))
+        }
+        return;
+    }
+
+    if (upipe_h265f->got_discontinuity) {
+        uref_flow_set_error(upipe_h265f->next_uref);
+        /* discard the entire NAL */
+        uref_block_delete(upipe_h265f->next_uref,
+                      upipe_h265f->au_last_nal_offset,
+                      upipe_h265f->au_size - upipe_h265f->au_last_nal_offset);
+        return;
+    }
+
+    switch (last_nal_type) {
+        case H265NAL_TYPE_PREFIX_SEI:
+            upipe_h265f_handle_sei(upipe);
+            break;
+        case H265NAL_TYPE_VPS:
+            upipe_h265f_handle_vps(upipe);
+            break;
+        case H265NAL_TYPE_SPS:
+            upipe_h265f_handle_sps(upipe);
+            break;
+        case H265NAL_TYPE_PPS:
+            upipe_h265f_handle_pps(upipe);
+            break;
+        case H265NAL_TYPE_EOS:
+        case H265NAL_TYPE_EOB:
+            /* the NAL header is complete, output everything */
+            upipe_h265f->first_irap = true;
+            upipe_h265f_output_au(upipe, upump_p);
+            upipe_h265f->au_last_nal_offset = -1;
+            break;
+        default:
+            break;
+    }
+}
+
+/** @internal @This is called when a new NAL starts, to check it.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_h265f_nal_begin(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    /* detection of a new access unit - ITU-T H.265 7.4.2.4.4; the start of
+     * a picture without preceding non-VCL NAL is detected in the slice
+     * header */
+    uint8_t nal_type = h265nalst_get_type(upipe_h265f->au_last_nal);
+    switch (nal_type) {
+        case H265NAL_TYPE_VPS:
+        case H265NAL_TYPE_SPS:
+        case H265NAL_TYPE_PPS:
+        case H265NAL_TYPE_AUD:
+        case H265NAL_TYPE_PREFIX_SEI:
+            break;
+
+        default:
+            if (nal_type <= H265NAL_TYPE_CRA) {
+                if (upipe_h265f->au_vcl_offset == -1)
+                    upipe_h265f->au_vcl_offset = upipe_h265f->au_size -
+                        upipe_h265f->au_last_nal_start_size;
+                upipe_h265f->au_slice_nal = upipe_h265f->au_last_nal;
+                return;
+            }
+            if ((nal_type < H265NAL_TYPE_RSV_NVCL41 ||
+                 nal_type > H265NAL_TYPE_RSV_NVCL44) &&
+                (nal_type < H265NAL_TYPE_UNSPEC48 ||
+                 nal_type > H265NAL_TYPE_UNSPEC55))
+                return;
+            break;
+    }
+
+    if (upipe_h265f->au_slice_nal != UINT8_MAX) {
+        upipe_h265f->au_size -= upipe_h265f->au_last_nal_start_size;
+        upipe_h265f_output_au(upipe, upump_p);
+        upipe_h265f->au_size = upipe_h265f->au_last_nal_start_size;
+    }
+    if (nal_type == H265NAL_TYPE_PREFIX_SEI &&
+        upipe_h265f->au_vcl_offset == -1)
+        upipe_h265f->au_vcl_offset = upipe_h265f->au_size -
+                                     upipe_h265f->au_last_nal_start_size;
+}
+
+/** @internal @This tries to output access units from the queue of input
+ * buffers.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_h265f_work(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    while (upipe_h265f->next_uref != NULL) {
+        uint8_t start, prev;
+        if (!upipe_h265f_find(upipe, &start, &prev))
+            return;
+        size_t start_size = !prev ? 5 : 4;
+
+        upipe_h265f->au_size -= start_size;
+        upipe_h265f_nal_end(upipe, upump_p);
+        upipe_h265f->au_size += start_size;
+        upipe_h265f->got_discontinuity = false;
+        upipe_h265f->au_last_nal = start;
+        upipe_h265f->au_last_nal_start_size = start_size;
+        upipe_h265f_nal_begin(upipe, upump_p);
+        upipe_h265f->au_last_nal_offset = upipe_h265f->au_size - start_size;
+    }
+}
+
+/** @internal @This receives data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_h265f_input(struct upipe *upipe, struct uref *uref,
+                              struct upump **upump_p)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+
+    if (unlikely(ubase_check(uref_flow_get_discontinuity(uref))))
+        upipe_h265f->got_discontinuity = true;
+
+    upipe_h265f_append_uref_stream(upipe, uref);
+    upipe_h265f_work(upipe, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_h265f_set_flow_def(struct upipe *upipe, struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, UPIPE_H265F_EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    upipe_h265f->input_latency = 0;
+    uref_clock_get_latency(flow_def, &upipe_h265f->input_latency);
+
+    if (unlikely(upipe_h265f->duration &&
+                 !ubase_check(uref_clock_set_latency(flow_def_dup,
+                                    upipe_h265f->input_latency +
+                                    upipe_h265f->duration))))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+    flow_def = upipe_h265f_store_flow_def_input(upipe, flow_def_dup);
+    if (flow_def != NULL)
+        upipe_h265f_store_flow_def(upipe, flow_def);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a h265f pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_h265f_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_h265f_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_h265f_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_h265f_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_h265f_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_h265f_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_h265f_set_output(upipe, output);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_h265f_free(struct upipe *upipe)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+
+    /* Output any buffered frame. */
+    upipe_h265f_output_au(upipe, NULL);
+    upipe_throw_dead(upipe);
+
+    upipe_h265f_clean_uref_stream(upipe);
+    upipe_h265f_clean_output(upipe);
+    upipe_h265f_clean_flow_def(upipe);
+    upipe_h265f_clean_sync(upipe);
+
+    int i;
+    for (i = 0; i < H265VPS_ID_MAX; i++)
+        if (upipe_h265f->vps[i] != NULL)
+            ubuf_free(upipe_h265f->vps[i]);
+
+    for (i = 0; i < H265SPS_ID_MAX; i++)
+        if (upipe_h265f->sps[i] != NULL)
+            ubuf_free(upipe_h265f->sps[i]);
+
+    for (i = 0; i < H265PPS_ID_MAX; i++)
+        if (upipe_h265f->pps[i] != NULL)
+            ubuf_free(upipe_h265f->pps[i]);
+
+    upipe_h265f_clean_urefcount(upipe);
+    upipe_h265f_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_h265f_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_H265F_SIGNATURE,
+
+    .upipe_alloc = upipe_h265f_alloc,
+    .upipe_input = upipe_h265f_input,
+    .upipe_control = upipe_h265f_control,
+
+    .upipe_mgr_control = NULL
+
+};
+
+/** @This returns the management structure for all h265f pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_h265f_mgr_alloc(void)
+{
+    return &upipe_h265f_mgr;
+}
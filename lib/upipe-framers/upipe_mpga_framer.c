@@ -55,6 +55,8 @@
 #include <bitstream/mpeg/mpga.h>
 #include <bitstream/mpeg/aac.h>
 
+#include "upipe_framers_common.h"
+
 /** @This returns the octetrate / 1000 of an MPEG-1 or 2 audio stream. */
 static const uint8_t mpeg_octetrate_table[2][3][16] = {
     { /* MPEG-1 */
@@ -124,6 +126,8 @@ struct upipe_mpgaf {
     uint64_t duration_residue;
     /** true we have had a discontinuity recently */
     bool got_discontinuity;
+    /** grouping of output frames */
+    struct upipe_framers_batch batch;
     /** sync header */
     uint8_t sync_header[MPGA_HEADER_SIZE + ADTS_HEADER_SIZE]; // to be sure
 
@@ -161,6 +165,20 @@ UPIPE_HELPER_UREF_STREAM(upipe_mpgaf, next_uref, next_uref_size, urefs,
 UPIPE_HELPER_OUTPUT(upipe_mpgaf, output, flow_def, output_state, request_list)
 UPIPE_HELPER_FLOW_DEF(upipe_mpgaf, flow_def_input, flow_def_attr)
 
+/** @internal @This outputs the current group of frames, if any.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_mpgaf_flush_batch(struct upipe *upipe,
+                                    struct upump **upump_p)
+{
+    struct upipe_mpgaf *upipe_mpgaf = upipe_mpgaf_from_upipe(upipe);
+    struct uref *uref = upipe_framers_batch_flush(&upipe_mpgaf->batch);
+    if (uref != NULL)
+        upipe_mpgaf_output(upipe, uref, upump_p);
+}
+
 /** @internal @This flushes all dates.
  *
  * @param upipe description structure of the pipe
@@ -202,6 +220,7 @@ static struct upipe *upipe_mpgaf_alloc(struct upipe_mgr *mgr,
     upipe_mpgaf->input_latency = 0;
     upipe_mpgaf->samplerate = 0;
     upipe_mpgaf->got_discontinuity = false;
+    upipe_framers_batch_init(&upipe_mpgaf->batch);
     upipe_mpgaf->next_frame_size = -1;
     uref_init(&upipe_mpgaf->au_uref_s);
     upipe_mpgaf_flush_dates(upipe);
@@ -374,6 +393,7 @@ static bool upipe_mpgaf_parse_mpeg(struct upipe *upipe)
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return false;
     }
+    upipe_mpgaf_flush_batch(upipe, NULL);
     upipe_mpgaf_store_flow_def(upipe, flow_def);
     upipe_mpgaf->next_frame_size = padding ?
                                    upipe_mpgaf->frame_size_padding :
@@ -459,6 +479,7 @@ static bool upipe_mpgaf_parse_adts(struct upipe *upipe)
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return false;
     }
+    upipe_mpgaf_flush_batch(upipe, NULL);
     upipe_mpgaf_store_flow_def(upipe, flow_def);
 
 upipe_mpgaf_parse_adts_shortcut:
@@ -537,10 +558,15 @@ static void upipe_mpgaf_output_frame(struct upipe *upipe,
 
     UBASE_FATAL(upipe, uref_clock_set_duration(uref, duration))
 
-    if (upipe_mpgaf->got_discontinuity)
+    if (upipe_mpgaf->got_discontinuity) {
+        upipe_mpgaf_flush_batch(upipe, upump_p);
         uref_flow_set_discontinuity(uref);
+    }
     upipe_mpgaf->got_discontinuity = false;
-    upipe_mpgaf_output(upipe, uref, upump_p);
+    UBASE_FATAL_RETURN(upipe, upipe_framers_batch_add(&upipe_mpgaf->batch,
+                                                      uref, &uref))
+    if (uref != NULL)
+        upipe_mpgaf_output(upipe, uref, upump_p);
 }
 
 /** @internal @This is called back by @ref upipe_mpgaf_append_uref_stream
@@ -667,11 +693,50 @@ static int upipe_mpgaf_set_flow_def(struct upipe *upipe, struct uref *flow_def)
                                     upipe_mpgaf->samplerate))))
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
     flow_def = upipe_mpgaf_store_flow_def_input(upipe, flow_def_dup);
-    if (flow_def != NULL)
+    if (flow_def != NULL) {
+        upipe_mpgaf_flush_batch(upipe, NULL);
         upipe_mpgaf_store_flow_def(upipe, flow_def);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the limits of the groups of output frames.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames_p filled in with the maximum number of frames
+ * @param max_duration_p filled in with the maximum duration
+ * @return an error code
+ */
+static int _upipe_mpgaf_get_batch(struct upipe *upipe,
+                                  unsigned int *max_frames_p,
+                                  uint64_t *max_duration_p)
+{
+    struct upipe_mpgaf *upipe_mpgaf = upipe_mpgaf_from_upipe(upipe);
+    if (max_frames_p != NULL)
+        *max_frames_p = upipe_mpgaf->batch.max_frames;
+    if (max_duration_p != NULL)
+        *max_duration_p = upipe_mpgaf->batch.max_duration;
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the limits of the groups of output frames. The
+ * pending group, if any, is output first.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames maximum number of frames in a group, or 0
+ * @param max_duration maximum duration of a group, or 0
+ * @return an error code
+ */
+static int _upipe_mpgaf_set_batch(struct upipe *upipe,
+                                  unsigned int max_frames,
+                                  uint64_t max_duration)
+{
+    struct upipe_mpgaf *upipe_mpgaf = upipe_mpgaf_from_upipe(upipe);
+    upipe_mpgaf_flush_batch(upipe, NULL);
+    return upipe_framers_batch_set(&upipe_mpgaf->batch, max_frames,
+                                   max_duration);
+}
+
 /** @internal @This processes control commands on a mpgaf pipe.
  *
  * @param upipe description structure of the pipe
@@ -706,6 +771,18 @@ static int upipe_mpgaf_control(struct upipe *upipe, int command, va_list args)
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_mpgaf_set_output(upipe, output);
         }
+        case UPIPE_MPGAF_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_MPGAF_SIGNATURE)
+            unsigned int *max_frames_p = va_arg(args, unsigned int *);
+            uint64_t *max_duration_p = va_arg(args, uint64_t *);
+            return _upipe_mpgaf_get_batch(upipe, max_frames_p, max_duration_p);
+        }
+        case UPIPE_MPGAF_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_MPGAF_SIGNATURE)
+            unsigned int max_frames = va_arg(args, unsigned int);
+            uint64_t max_duration = va_arg(args, uint64_t);
+            return _upipe_mpgaf_set_batch(upipe, max_frames, max_duration);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -717,6 +794,7 @@ static int upipe_mpgaf_control(struct upipe *upipe, int command, va_list args)
  */
 static void upipe_mpgaf_free(struct upipe *upipe)
 {
+    upipe_mpgaf_flush_batch(upipe, NULL);
     upipe_throw_dead(upipe);
 
     upipe_mpgaf_clean_uref_stream(upipe);
@@ -31,6 +31,7 @@
 #include <upipe/uref_block_flow.h>
 #include <upipe/uref_pic.h>
 #include <upipe/uref_pic_flow.h>
+#include <upipe/uref_priority.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uclock.h>
 #include <upipe/ubuf.h>
@@ -119,6 +120,8 @@ struct upipe_mpgvf {
     /** true if the user wants us to insert sequence headers before I frames,
      * if it is not already present */
     bool insert_sequence;
+    /** true if B pictures, which are never used as references, are dropped */
+    bool drop_nonref;
     /** pointer to a sequence header */
     struct ubuf *sequence_header;
     /** pointer to a sequence header extension */
@@ -232,6 +235,7 @@ static struct upipe *upipe_mpgvf_alloc(struct upipe_mgr *mgr,
     upipe_mpgvf->got_discontinuity = false;
     upipe_mpgvf->fps.num = 0;
     upipe_mpgvf->insert_sequence = false;
+    upipe_mpgvf->drop_nonref = false;
     upipe_mpgvf->scan_context = UINT32_MAX;
     upipe_mpgvf->next_frame_size = 0;
     upipe_mpgvf->next_frame_sequence = false;
@@ -479,7 +483,8 @@ static bool upipe_mpgvf_parse_sequence(struct upipe *upipe)
     return true;
 }
 
-/** @internal @This extracts the sequence header from a uref.
+/** @internal @This extracts the sequence header from a uref. The header is
+ * copied, so that keeping it doesn't hold the buffer of the whole frame.
  *
  * @param upipe description structure of the pipe
  * @param uref uref containing a frame, beginning with a sequence header
@@ -504,7 +509,8 @@ static struct ubuf *upipe_mpgvf_extract_sequence(struct upipe *upipe,
         sequence_header_size += 64;
     }
 
-    return ubuf_block_splice(uref->ubuf, 0, sequence_header_size);
+    return ubuf_block_copy(uref->ubuf->mgr, uref->ubuf, 0,
+                           sequence_header_size);
 }
 
 /** @internal @This extracts the sequence extension from a uref.
@@ -518,7 +524,8 @@ static struct ubuf *upipe_mpgvf_extract_extension(struct upipe *upipe,
                                                   struct uref *uref,
                                                   size_t offset)
 {
-    return ubuf_block_splice(uref->ubuf, offset, MP2VSEQX_HEADER_SIZE);
+    return ubuf_block_copy(uref->ubuf->mgr, uref->ubuf, offset,
+                           MP2VSEQX_HEADER_SIZE);
 }
 
 /** @internal @This extracts the sequence display extension from a uref.
@@ -534,8 +541,39 @@ static struct ubuf *upipe_mpgvf_extract_display(struct upipe *upipe,
     uint8_t word;
     if (unlikely(!ubase_check(uref_block_extract(uref, offset + 4, 1, &word))))
         return NULL;
-    return ubuf_block_splice(uref->ubuf, offset, MP2VSEQDX_HEADER_SIZE + 
-                                   ((word & 0x1) ? MP2VSEQDX_COLOR_SIZE : 0));
+    return ubuf_block_copy(uref->ubuf->mgr, uref->ubuf, offset,
+                           MP2VSEQDX_HEADER_SIZE +
+                           ((word & 0x1) ? MP2VSEQDX_COLOR_SIZE : 0));
+}
+
+/** @internal @This checks whether the sequence header and extensions of a
+ * uref are identical to the cached ones, by comparing their raw octets. The
+ * sizes of the headers depend on flags carried in the headers themselves,
+ * so matching the cached octets implies matching sizes.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref containing a frame, beginning with a sequence header
+ * @return true if the headers are unchanged
+ */
+static bool upipe_mpgvf_same_sequence(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_mpgvf *upipe_mpgvf = upipe_mpgvf_from_upipe(upipe);
+    ssize_t ext_offset = upipe_mpgvf->next_frame_sequence_ext_offset;
+    ssize_t display_offset = ext_offset == -1 ? -1 :
+        upipe_mpgvf->next_frame_sequence_display_offset;
+
+    return upipe_mpgvf->sequence_header != NULL &&
+           (ext_offset == -1) == (upipe_mpgvf->sequence_ext == NULL) &&
+           (display_offset == -1) ==
+               (upipe_mpgvf->sequence_display == NULL) &&
+           ubase_check(ubuf_block_compare(uref->ubuf, 0,
+                                          upipe_mpgvf->sequence_header)) &&
+           (ext_offset == -1 ||
+            ubase_check(ubuf_block_compare(uref->ubuf, ext_offset,
+                                           upipe_mpgvf->sequence_ext))) &&
+           (display_offset == -1 ||
+            ubase_check(ubuf_block_compare(uref->ubuf, display_offset,
+                                           upipe_mpgvf->sequence_display)));
 }
 
 /** @internal @This handles a uref containing a sequence header.
@@ -547,6 +585,10 @@ static struct ubuf *upipe_mpgvf_extract_display(struct upipe *upipe,
 static bool upipe_mpgvf_handle_sequence(struct upipe *upipe, struct uref *uref)
 {
     struct upipe_mpgvf *upipe_mpgvf = upipe_mpgvf_from_upipe(upipe);
+    /* broadcast streams repeat the same sequence header every GOP */
+    if (likely(upipe_mpgvf_same_sequence(upipe, uref)))
+        return true;
+
     struct ubuf *sequence_ext = NULL;
     struct ubuf *sequence_display = NULL;
     struct ubuf *sequence_header = upipe_mpgvf_extract_sequence(upipe, uref);
@@ -572,32 +614,6 @@ static bool upipe_mpgvf_handle_sequence(struct upipe *upipe, struct uref *uref)
         }
     }
 
-    if (likely(upipe_mpgvf->sequence_header != NULL &&
-               ubase_check(ubuf_block_equal(sequence_header,
-                                  upipe_mpgvf->sequence_header)) &&
-               ((upipe_mpgvf->sequence_ext == NULL && sequence_ext == NULL) ||
-                (upipe_mpgvf->sequence_ext != NULL && sequence_ext != NULL &&
-                 ubase_check(ubuf_block_equal(sequence_ext,
-                                  upipe_mpgvf->sequence_ext)))) &&
-               ((upipe_mpgvf->sequence_display == NULL &&
-                 sequence_display == NULL) ||
-                (upipe_mpgvf->sequence_display != NULL &&
-                 sequence_display != NULL &&
-                 ubase_check(ubuf_block_equal(sequence_display,
-                                  upipe_mpgvf->sequence_display)))))) {
-        /* identical sequence header, extension and display, but we rotate them
-         * to free older buffers */
-        ubuf_free(upipe_mpgvf->sequence_header);
-        if (upipe_mpgvf->sequence_ext != NULL)
-            ubuf_free(upipe_mpgvf->sequence_ext);
-        if (upipe_mpgvf->sequence_display != NULL)
-            ubuf_free(upipe_mpgvf->sequence_display);
-        upipe_mpgvf->sequence_header = sequence_header;
-        upipe_mpgvf->sequence_ext = sequence_ext;
-        upipe_mpgvf->sequence_display = sequence_display;
-        return true;
-    }
-
     if (upipe_mpgvf->sequence_header != NULL)
         ubuf_free(upipe_mpgvf->sequence_header);
     if (upipe_mpgvf->sequence_ext != NULL)
@@ -674,6 +690,9 @@ static bool upipe_mpgvf_parse_picture(struct upipe *upipe, struct uref *uref,
     }
     UBASE_FATAL(upipe, uref_pic_set_number(uref, picture_number))
     UBASE_FATAL(upipe, uref_mpgv_set_type(uref, codingtype))
+    if (codingtype == MP2VPIC_TYPE_B)
+        UBASE_FATAL(upipe, uref_flow_set_priority(uref,
+                                                  UREF_PRIORITY_DISPOSABLE))
 
     *duration_p = UCLOCK_FREQ * upipe_mpgvf->fps.den / upipe_mpgvf->fps.num;
     if (upipe_mpgvf->next_frame_ext_offset != -1) {
@@ -878,6 +897,15 @@ static bool upipe_mpgvf_output_frame(struct upipe *upipe,
     else
         uref_clock_delete_dts_pts_delay(uref);
 
+    uint8_t type;
+    if (upipe_mpgvf->drop_nonref &&
+        ubase_check(uref_mpgv_get_type(uref, &type)) &&
+        type == MP2VPIC_TYPE_B) {
+        /* no other picture refers to it, so it may be skipped */
+        uref_free(uref);
+        return true;
+    }
+
     upipe_mpgvf_output(upipe, uref, upump_p);
     return true;
 }
@@ -922,6 +950,23 @@ static void upipe_mpgvf_reset(struct upipe *upipe)
     upipe_mpgvf->next_frame_slice = false;
 }
 
+/** @internal @This drops the buffered data and looks for the next sequence
+ * header.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_mpgvf_drop(struct upipe *upipe)
+{
+    struct upipe_mpgvf *upipe_mpgvf = upipe_mpgvf_from_upipe(upipe);
+    upipe_mpgvf_clean_uref_stream(upipe);
+    upipe_mpgvf_init_uref_stream(upipe);
+    upipe_mpgvf->got_discontinuity = true;
+    upipe_mpgvf->next_frame_size = 0;
+    upipe_mpgvf->scan_context = UINT32_MAX;
+    upipe_mpgvf_sync_lost(upipe);
+    upipe_mpgvf_reset(upipe);
+}
+
 /** @internal @This tries to output frames from the queue of input buffers.
  *
  * @param upipe description structure of the pipe
@@ -1039,13 +1084,7 @@ static void upipe_mpgvf_input(struct upipe *upipe, struct uref *uref,
         if (!upipe_mpgvf->next_frame_slice) {
             /* we do not want discontinuities in the headers before the first
              * slice header; inside the slices it is less destructive */
-            upipe_mpgvf_clean_uref_stream(upipe);
-            upipe_mpgvf_init_uref_stream(upipe);
-            upipe_mpgvf->got_discontinuity = true;
-            upipe_mpgvf->next_frame_size = 0;
-            upipe_mpgvf->scan_context = UINT32_MAX;
-            upipe_mpgvf_sync_lost(upipe);
-            upipe_mpgvf_reset(upipe);
+            upipe_mpgvf_drop(upipe);
         } else
             uref_flow_set_error(upipe_mpgvf->next_uref);
     }
@@ -1115,6 +1154,35 @@ static int _upipe_mpgvf_set_sequence_insertion(struct upipe *upipe, int val)
     return UBASE_ERR_NONE;
 }
 
+/** @This returns the current setting for the dropping of non-reference
+ * pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param val_p filled with the current setting
+ * @return an error code
+ */
+static int _upipe_mpgvf_get_drop_nonref(struct upipe *upipe, int *val_p)
+{
+    struct upipe_mpgvf *upipe_mpgvf = upipe_mpgvf_from_upipe(upipe);
+    *val_p = upipe_mpgvf->drop_nonref ? 1 : 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets or unsets the dropping of non-reference pictures. When true,
+ * B pictures are not output, which leaves the dates and numbers of the other
+ * pictures unchanged.
+ *
+ * @param upipe description structure of the pipe
+ * @param val true to drop B pictures
+ * @return an error code
+ */
+static int _upipe_mpgvf_set_drop_nonref(struct upipe *upipe, int val)
+{
+    struct upipe_mpgvf *upipe_mpgvf = upipe_mpgvf_from_upipe(upipe);
+    upipe_mpgvf->drop_nonref = !!val;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a mpgvf pipe.
  *
  * @param upipe description structure of the pipe
@@ -1149,6 +1217,15 @@ static int upipe_mpgvf_control(struct upipe *upipe, int command, va_list args)
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_mpgvf_set_output(upipe, output);
         }
+        case UPIPE_HIBERNATE: {
+            /* the partial frame is useless after an idle period */
+            struct upipe_mpgvf *upipe_mpgvf = upipe_mpgvf_from_upipe(upipe);
+            upipe_mpgvf_drop(upipe);
+            upipe_mpgvf_flush_dates(upipe);
+            if (upipe_mpgvf->output != NULL)
+                upipe_hibernate(upipe_mpgvf->output);
+            return UBASE_ERR_NONE;
+        }
 
         case UPIPE_MPGVF_GET_SEQUENCE_INSERTION: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_MPGVF_SIGNATURE)
@@ -1160,6 +1237,16 @@ static int upipe_mpgvf_control(struct upipe *upipe, int command, va_list args)
             int val = va_arg(args, int);
             return _upipe_mpgvf_set_sequence_insertion(upipe, val);
         }
+        case UPIPE_MPGVF_GET_DROP_NONREF: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_MPGVF_SIGNATURE)
+            int *val_p = va_arg(args, int *);
+            return _upipe_mpgvf_get_drop_nonref(upipe, val_p);
+        }
+        case UPIPE_MPGVF_SET_DROP_NONREF: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_MPGVF_SIGNATURE)
+            int val = va_arg(args, int);
+            return _upipe_mpgvf_set_drop_nonref(upipe, val);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -50,6 +50,8 @@
 #include <inttypes.h>
 #include <assert.h>
 
+#include "upipe_framers_common.h"
+
 #define OPUS_TS_HEADER     0x7FE0        // 0x3ff (11 bits)
 #define OPUS_TS_MASK       0xFFE0        // top 11 bits
 
@@ -83,6 +85,8 @@ struct upipe_opusf {
     uint64_t duration_residue;
     /** true we have had a discontinuity recently */
     bool got_discontinuity;
+    /** grouping of output frames */
+    struct upipe_framers_batch batch;
 
     /* octet stream stuff */
     /** next uref to be processed */
@@ -119,6 +123,20 @@ UPIPE_HELPER_UREF_STREAM(upipe_opusf, next_uref, next_uref_size, urefs,
 UPIPE_HELPER_OUTPUT(upipe_opusf, output, flow_def, output_state, request_list)
 UPIPE_HELPER_FLOW_DEF(upipe_opusf, flow_def_input, flow_def_attr)
 
+/** @internal @This outputs the current group of frames, if any.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_opusf_flush_batch(struct upipe *upipe,
+                                    struct upump **upump_p)
+{
+    struct upipe_opusf *upipe_opusf = upipe_opusf_from_upipe(upipe);
+    struct uref *uref = upipe_framers_batch_flush(&upipe_opusf->batch);
+    if (uref != NULL)
+        upipe_opusf_output(upipe, uref, upump_p);
+}
+
 /** @internal @This flushes all dates.
  *
  * @param upipe description structure of the pipe
@@ -160,6 +178,7 @@ static struct upipe *upipe_opusf_alloc(struct upipe_mgr *mgr,
     upipe_opusf->input_latency = 0;
     upipe_opusf->samplerate = 0;
     upipe_opusf->got_discontinuity = false;
+    upipe_framers_batch_init(&upipe_opusf->batch);
     upipe_opusf->next_frame_size = -1;
     uref_init(&upipe_opusf->au_uref_s);
     upipe_opusf_flush_dates(upipe);
@@ -265,6 +284,7 @@ static bool upipe_opusf_parse_header(struct upipe *upipe)
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return false;
     }
+    upipe_opusf_flush_batch(upipe, NULL);
     upipe_opusf_store_flow_def(upipe, flow_def);
 
     return true;
@@ -315,10 +335,15 @@ static void upipe_opusf_output_frame(struct upipe *upipe, struct upump **upump_p
 
     UBASE_FATAL(upipe, uref_clock_set_duration(uref, duration))
 
-    if (upipe_opusf->got_discontinuity)
+    if (upipe_opusf->got_discontinuity) {
+        upipe_opusf_flush_batch(upipe, upump_p);
         uref_flow_set_discontinuity(uref);
+    }
     upipe_opusf->got_discontinuity = false;
-    upipe_opusf_output(upipe, uref, upump_p);
+    UBASE_FATAL_RETURN(upipe, upipe_framers_batch_add(&upipe_opusf->batch,
+                                                      uref, &uref))
+    if (uref != NULL)
+        upipe_opusf_output(upipe, uref, upump_p);
 }
 
 /** @internal @This is called back by @ref upipe_opusf_append_uref_stream
@@ -396,6 +421,7 @@ static void upipe_opusf_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_opusf *upipe_opusf = upipe_opusf_from_upipe(upipe);
     if (unlikely(uref->ubuf == NULL)) {
+        upipe_opusf_flush_batch(upipe, upump_p);
         upipe_opusf_output(upipe, uref, upump_p);
         return;
     }
@@ -441,11 +467,50 @@ static int upipe_opusf_set_flow_def(struct upipe *upipe, struct uref *flow_def)
                                     upipe_opusf->samplerate))))
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
     flow_def = upipe_opusf_store_flow_def_input(upipe, flow_def_dup);
-    if (flow_def != NULL)
+    if (flow_def != NULL) {
+        upipe_opusf_flush_batch(upipe, NULL);
         upipe_opusf_store_flow_def(upipe, flow_def);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the limits of the groups of output frames.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames_p filled in with the maximum number of frames
+ * @param max_duration_p filled in with the maximum duration
+ * @return an error code
+ */
+static int _upipe_opusf_get_batch(struct upipe *upipe,
+                                  unsigned int *max_frames_p,
+                                  uint64_t *max_duration_p)
+{
+    struct upipe_opusf *upipe_opusf = upipe_opusf_from_upipe(upipe);
+    if (max_frames_p != NULL)
+        *max_frames_p = upipe_opusf->batch.max_frames;
+    if (max_duration_p != NULL)
+        *max_duration_p = upipe_opusf->batch.max_duration;
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the limits of the groups of output frames. The
+ * pending group, if any, is output first.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_frames maximum number of frames in a group, or 0
+ * @param max_duration maximum duration of a group, or 0
+ * @return an error code
+ */
+static int _upipe_opusf_set_batch(struct upipe *upipe,
+                                  unsigned int max_frames,
+                                  uint64_t max_duration)
+{
+    struct upipe_opusf *upipe_opusf = upipe_opusf_from_upipe(upipe);
+    upipe_opusf_flush_batch(upipe, NULL);
+    return upipe_framers_batch_set(&upipe_opusf->batch, max_frames,
+                                   max_duration);
+}
+
 /** @internal @This processes control commands on a opusf pipe.
  *
  * @param upipe description structure of the pipe
@@ -480,6 +545,18 @@ static int upipe_opusf_control(struct upipe *upipe, int command, va_list args)
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_opusf_set_output(upipe, output);
         }
+        case UPIPE_OPUSF_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_OPUSF_SIGNATURE)
+            unsigned int *max_frames_p = va_arg(args, unsigned int *);
+            uint64_t *max_duration_p = va_arg(args, uint64_t *);
+            return _upipe_opusf_get_batch(upipe, max_frames_p, max_duration_p);
+        }
+        case UPIPE_OPUSF_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_OPUSF_SIGNATURE)
+            unsigned int max_frames = va_arg(args, unsigned int);
+            uint64_t max_duration = va_arg(args, uint64_t);
+            return _upipe_opusf_set_batch(upipe, max_frames, max_duration);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -491,6 +568,7 @@ static int upipe_opusf_control(struct upipe *upipe, int command, va_list args)
  */
 static void upipe_opusf_free(struct upipe *upipe)
 {
+    upipe_opusf_flush_batch(upipe, NULL);
     upipe_throw_dead(upipe);
 
     upipe_opusf_clean_uref_stream(upipe);
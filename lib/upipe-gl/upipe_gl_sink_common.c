@@ -27,9 +27,35 @@
  * @short Upipe GL - common definitions
  */
 
+#define GL_GLEXT_PROTOTYPES
+
+#include <upipe/ubase.h>
 #include <upipe/uref_pic.h>
 #include <upipe-gl/upipe_gl_sink_common.h>
+
+#include <stdio.h>
+#include <string.h>
+
 #include <GL/gl.h>
+#include <GL/glext.h>
+
+/** chroma of the YUV planes, in texture unit order */
+static const char *upipe_gl_texture_yuv_chromas[] = { "y8", "u8", "v8" };
+/** sampler names of the YUV planes, in texture unit order */
+static const char *upipe_gl_texture_yuv_samplers[] = { "y", "u", "v" };
+
+/** fragment shader converting ITU-R BT.601 limited range YUV to RGB */
+static const char *upipe_gl_texture_yuv_shader =
+    "uniform sampler2D y, u, v;\n"
+    "void main() {\n"
+    "    vec2 pos = gl_TexCoord[0].st;\n"
+    "    float l = 1.164 * (texture2D(y, pos).r - 0.0625);\n"
+    "    float cb = texture2D(u, pos).r - 0.5;\n"
+    "    float cr = texture2D(v, pos).r - 0.5;\n"
+    "    gl_FragColor = vec4(l + 1.596 * cr,\n"
+    "                        l - 0.391 * cb - 0.813 * cr,\n"
+    "                        l + 2.018 * cb, 1.0);\n"
+    "}\n";
 
 /** @This loads a uref picture into the specified texture
  * @param uref uref structure describing the picture
@@ -52,3 +78,245 @@ bool upipe_gl_texture_load_uref(struct uref *uref, GLuint texture)
 
     return true;
 }
+
+/** @internal @This checks the version of the current GL context.
+ *
+ * @param major minimum major version
+ * @param minor minimum minor version
+ * @return true if the context is at least of the given version
+ */
+static bool upipe_gl_check_version(int major, int minor)
+{
+    const char *version = (const char *)glGetString(GL_VERSION);
+    int context_major, context_minor;
+    if (version == NULL ||
+        sscanf(version, "%d.%d", &context_major, &context_minor) != 2)
+        return false;
+    return context_major > major ||
+           (context_major == major && context_minor >= minor);
+}
+
+/** @internal @This builds the shader program converting YUV planes.
+ *
+ * @return program object, or 0 in case of error
+ */
+static GLuint upipe_gl_texture_build_program(void)
+{
+    GLint status;
+    GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+    if (unlikely(!shader))
+        return 0;
+    glShaderSource(shader, 1, &upipe_gl_texture_yuv_shader, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (unlikely(!status)) {
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if (unlikely(!program)) {
+        glDeleteShader(shader);
+        return 0;
+    }
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    /* the shader is actually deleted along with the program */
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (unlikely(!status)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    glUseProgram(program);
+    for (int i = 0; i < UPIPE_GL_TEXTURE_PLANES; i++)
+        glUniform1i(glGetUniformLocation(program,
+                                         upipe_gl_texture_yuv_samplers[i]), i);
+    glUseProgram(0);
+    return program;
+}
+
+/** @This initializes the textures, pixel buffer objects and shader. It must
+ * be called with the GL context current.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_init(struct upipe_gl_texture *texture)
+{
+    memset(texture, 0, sizeof(struct upipe_gl_texture));
+
+    glGenTextures(UPIPE_GL_TEXTURE_PLANES, texture->textures);
+    for (int i = 0; i < UPIPE_GL_TEXTURE_PLANES; i++) {
+        glBindTexture(GL_TEXTURE_2D, texture->textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    /* pixel buffer objects are core since GL 2.1, shaders since GL 2.0 */
+    if (upipe_gl_check_version(2, 1))
+        glGenBuffers(UPIPE_GL_TEXTURE_PLANES * UPIPE_GL_TEXTURE_PBOS,
+                     &texture->pbos[0][0]);
+    if (upipe_gl_check_version(2, 0))
+        texture->program = upipe_gl_texture_build_program();
+}
+
+/** @This releases the GL objects. It must be called with the GL context
+ * current.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_clean(struct upipe_gl_texture *texture)
+{
+    glDeleteTextures(UPIPE_GL_TEXTURE_PLANES, texture->textures);
+    if (texture->pbos[0][0])
+        glDeleteBuffers(UPIPE_GL_TEXTURE_PLANES * UPIPE_GL_TEXTURE_PBOS,
+                        &texture->pbos[0][0]);
+    if (texture->program)
+        glDeleteProgram(texture->program);
+}
+
+/** @internal @This uploads a plane of a picture into a texture.
+ *
+ * @param texture pointer to the texture structure
+ * @param uref uref structure describing the picture
+ * @param plane index of the plane
+ * @param chroma chroma type of the plane
+ * @param format GL format of the texture
+ * @param width width of the picture
+ * @param height height of the picture
+ * @return false in case of error
+ */
+static bool upipe_gl_texture_load_plane(struct upipe_gl_texture *texture,
+                                        struct uref *uref, int plane,
+                                        const char *chroma, GLenum format,
+                                        size_t width, size_t height)
+{
+    size_t stride;
+    uint8_t hsub, vsub, macropixel_size;
+    const uint8_t *data;
+    if (unlikely(!ubase_check(uref_pic_plane_size(uref, chroma, &stride,
+                        &hsub, &vsub, &macropixel_size)) ||
+                 !ubase_check(uref_pic_plane_read(uref, chroma, 0, 0, -1, -1,
+                                                  &data))))
+        return false;
+
+    width /= hsub;
+    height /= vsub;
+    size_t row = width * macropixel_size;
+
+    glBindTexture(GL_TEXTURE_2D, texture->textures[plane]);
+    if (width != texture->widths[plane] || height != texture->heights[plane]) {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
+                     GL_UNSIGNED_BYTE, NULL);
+        texture->widths[plane] = width;
+        texture->heights[plane] = height;
+    }
+
+    GLuint pbo = texture->pbos[plane][texture->pbo];
+    if (pbo) {
+        /* orphan the previous storage so that the driver does not wait for
+         * the pending transfer before handing out the mapping */
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, row * height, NULL,
+                     GL_STREAM_DRAW);
+        uint8_t *buffer = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if (likely(buffer != NULL)) {
+            if (stride == row)
+                memcpy(buffer, data, row * height);
+            else
+                for (size_t y = 0; y < height; y++)
+                    memcpy(buffer + y * row, data + y * stride, row);
+            if (likely(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)))
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format,
+                                GL_UNSIGNED_BYTE, NULL);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else if (!(stride % macropixel_size)) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / macropixel_size);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format,
+                        GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    } else {
+        for (size_t y = 0; y < height; y++)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, 1, format,
+                            GL_UNSIGNED_BYTE, data + y * stride);
+    }
+
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+    return true;
+}
+
+/** @This uploads a r8g8b8 or y8/u8/v8 picture into the textures, through
+ * the pixel buffer objects if available. The textures are only reallocated
+ * when the picture size changes.
+ *
+ * @param texture pointer to the texture structure
+ * @param uref uref structure describing the picture
+ * @return false in case of error
+ */
+bool upipe_gl_texture_load(struct upipe_gl_texture *texture,
+                           struct uref *uref)
+{
+    size_t width, height;
+    if (unlikely(!ubase_check(uref_pic_size(uref, &width, &height, NULL))))
+        return false;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bool ret = true;
+    if (ubase_check(uref_pic_plane_size(uref, "r8g8b8", NULL, NULL, NULL,
+                                        NULL))) {
+        texture->yuv = false;
+        ret = upipe_gl_texture_load_plane(texture, uref, 0, "r8g8b8", GL_RGB,
+                                          width, height);
+    } else {
+        if (unlikely(!texture->program))
+            return false;
+        texture->yuv = true;
+        for (int i = 0; i < UPIPE_GL_TEXTURE_PLANES && ret; i++)
+            ret = upipe_gl_texture_load_plane(texture, uref, i,
+                                              upipe_gl_texture_yuv_chromas[i],
+                                              GL_LUMINANCE, width, height);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    texture->pbo = (texture->pbo + 1) % UPIPE_GL_TEXTURE_PBOS;
+    return ret;
+}
+
+/** @This binds the textures, and the conversion shader if the last loaded
+ * picture was YUV, for drawing with texture unit 0 coordinates.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_bind(struct upipe_gl_texture *texture)
+{
+    if (texture->yuv) {
+        for (int i = UPIPE_GL_TEXTURE_PLANES - 1; i > 0; i--) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, texture->textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glUseProgram(texture->program);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture->textures[0]);
+}
+
+/** @This unbinds what was bound by @ref upipe_gl_texture_bind.
+ *
+ * @param texture pointer to the texture structure
+ */
+void upipe_gl_texture_unbind(struct upipe_gl_texture *texture)
+{
+    if (texture->yuv) {
+        glUseProgram(0);
+        for (int i = UPIPE_GL_TEXTURE_PLANES - 1; i > 0; i--) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
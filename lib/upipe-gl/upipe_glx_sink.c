@@ -473,6 +473,26 @@ static void upipe_glx_sink_input(struct upipe *upipe, struct uref *uref,
     }
 }
 
+/** @internal @This checks if a flow definition is 8-bit planar YUV.
+ *
+ * @param flow_def flow definition packet
+ * @return true if the pictures have y8, u8 and v8 planes
+ */
+static bool upipe_glx_sink_check_yuv(struct uref *flow_def)
+{
+    uint8_t plane, hsub, vsub;
+    return ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 1, "y8")) &&
+           ubase_check(uref_pic_flow_find_chroma(flow_def, "u8", &plane)) &&
+           ubase_check(uref_pic_flow_get_hsubsampling(flow_def, &hsub,
+                                                      plane)) &&
+           ubase_check(uref_pic_flow_get_vsubsampling(flow_def, &vsub,
+                                                      plane)) &&
+           ubase_check(uref_pic_flow_check_chroma(flow_def, hsub, vsub, 1,
+                                                  "u8")) &&
+           ubase_check(uref_pic_flow_check_chroma(flow_def, hsub, vsub, 1,
+                                                  "v8"));
+}
+
 /** @internal @This sets the input flow definition.
  *
  * @param upipe description structure of the pipe
@@ -486,11 +506,13 @@ static int upipe_glx_sink_set_flow_def(struct upipe *upipe,
         return UBASE_ERR_INVALID;
     UBASE_RETURN(uref_flow_match_def(flow_def, "pic."))
 
-    /* for the moment we only support rgb24 */
+    /* we support rgb24 and 8-bit planar yuv, converted by the GL shader */
     uint8_t macropixel;
     if (!ubase_check(uref_pic_flow_get_macropixel(flow_def, &macropixel)) ||
         macropixel != 1 ||
-        !ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 3, "r8g8b8"))) {
+        (!ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 3,
+                                                 "r8g8b8")) &&
+         !upipe_glx_sink_check_yuv(flow_def))) {
         upipe_err(upipe, "incompatible flow definition");
         uref_dump(flow_def, upipe->uprobe);
         return UBASE_ERR_INVALID;
@@ -513,10 +535,15 @@ static int upipe_glx_sink_provide_flow_format(struct upipe *upipe,
 {
     struct uref *flow_format = uref_dup(request->uref);
     UBASE_ALLOC_RETURN(flow_format);
-    uref_pic_flow_clear_format(flow_format);
-    uref_pic_flow_set_macropixel(flow_format, 1);
-    uref_pic_flow_set_planes(flow_format, 0);
-    uref_pic_flow_add_plane(flow_format, 1, 1, 3, "r8g8b8");
+    /* 8-bit planar yuv is converted by the GL shader, keep it */
+    uint8_t macropixel;
+    if (!ubase_check(uref_pic_flow_get_macropixel(flow_format, &macropixel)) ||
+        macropixel != 1 || !upipe_glx_sink_check_yuv(flow_format)) {
+        uref_pic_flow_clear_format(flow_format);
+        uref_pic_flow_set_macropixel(flow_format, 1);
+        uref_pic_flow_set_planes(flow_format, 0);
+        uref_pic_flow_add_plane(flow_format, 1, 1, 3, "r8g8b8");
+    }
     uref_pic_set_progressive(flow_format);
     return urequest_provide_flow_format(request, flow_format);
 }
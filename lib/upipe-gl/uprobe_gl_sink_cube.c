@@ -54,8 +54,8 @@
 struct uprobe_gl_sink_cube {
     /** rotation angle */
     float theta;
-    /** texture */
-    GLuint texture;
+    /** textures */
+    struct upipe_gl_texture texture;
     /** SAR */
     struct urational sar;
 
@@ -111,7 +111,7 @@ static void uprobe_gl_sink_cube_render(struct uprobe *uprobe,
     size_t w = 0, h = 0;
 
     /* load image to texture */
-    if (!upipe_gl_texture_load_uref(uref, cube->texture)) {
+    if (!upipe_gl_texture_load(&cube->texture, uref)) {
         upipe_err(upipe, "Could not map picture plane");
         return;
     }
@@ -122,7 +122,7 @@ static void uprobe_gl_sink_cube_render(struct uprobe *uprobe,
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_TEXTURE_2D);
     glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
-    glBindTexture(GL_TEXTURE_2D, cube->texture);
+    upipe_gl_texture_bind(&cube->texture);
     glLoadIdentity();
     glTranslatef(0, 0, -10);
 
@@ -179,6 +179,7 @@ static void uprobe_gl_sink_cube_render(struct uprobe *uprobe,
     }
     glEnd();
     glPopMatrix();
+    upipe_gl_texture_unbind(&cube->texture);
     glDisable(GL_TEXTURE_2D);
 
     /* Rotate a bit more */
@@ -201,15 +202,7 @@ static void uprobe_gl_sink_cube_init2(struct uprobe *uprobe, struct upipe *upipe
     glShadeModel(GL_FLAT);
     glEnable(GL_DEPTH_TEST);
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    glGenTextures(1, &cube->texture);
-    glBindTexture(GL_TEXTURE_2D, cube->texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    upipe_gl_texture_init(&cube->texture);
 }
 
 /** @internal @This catches events thrown by pipes.
@@ -270,6 +263,7 @@ static struct uprobe *uprobe_gl_sink_cube_init(struct uprobe_gl_sink_cube *cube,
     struct uprobe *uprobe = &cube->uprobe;
 
     cube->theta = 0;
+    memset(&cube->texture, 0, sizeof(cube->texture));
     cube->sar.num = cube->sar.den = 1;
 
     uprobe_init(uprobe, uprobe_gl_sink_cube_throw, next);
@@ -282,7 +276,7 @@ static struct uprobe *uprobe_gl_sink_cube_init(struct uprobe_gl_sink_cube *cube,
  */
 static void uprobe_gl_sink_cube_clean(struct uprobe_gl_sink_cube *cube)
 {
-    glDeleteTextures(1, &cube->texture);
+    upipe_gl_texture_clean(&cube->texture);
     struct uprobe *uprobe = &cube->uprobe;
     uprobe_clean(uprobe);
 }
@@ -25,6 +25,9 @@
 
 /** @file
  * @short Upipe module splitting packed audio to several planar outputs
+ *
+ * Planar input is also accepted, in which case the output buffers point to
+ * the planes of the input buffer whenever possible instead of copying them.
  */
 
 #include <upipe/ubase.h>
@@ -32,6 +35,8 @@
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
 #include <upipe/ubuf.h>
+#include <upipe/umem.h>
+#include <upipe/ubuf_sound_mem.h>
 #include <upipe/upipe.h>
 #include <upipe/uref_sound.h>
 #include <upipe/uref_sound_flow.h>
@@ -286,6 +291,9 @@ static int upipe_audio_split_sub_update_flow(struct upipe *upipe)
     struct uref *flow_def = upipe_audio_split->flow_def;
     UBASE_RETURN(uref_sound_flow_get_sample_size(flow_def, &sample_size));
     UBASE_RETURN(uref_sound_flow_get_channels(flow_def, &channels));
+    UBASE_RETURN(uref_sound_flow_get_planes(flow_def, &planes));
+    if (planes != channels)
+        sample_size /= channels;
     if(upipe_audio_split_sub->ubuf_mgr) {
         ubuf_mgr_release(upipe_audio_split_sub->ubuf_mgr);
         upipe_audio_split_sub->ubuf_mgr = NULL;
@@ -300,6 +308,7 @@ static int upipe_audio_split_sub_update_flow(struct upipe *upipe)
     /* We need to copy planes, channels number, keep input flow definition,
      * and compute new sample size from previous sample size. */
     uref_sound_flow_clear_format(flow_def);
+    planes = 0;
     uref_sound_flow_get_planes(upipe_audio_split_sub->flow_def_params, &planes);
     uref_sound_flow_set_planes(flow_def, planes);
     for (uint8_t plane = 0; plane < planes; plane++) {
@@ -308,7 +317,7 @@ static int upipe_audio_split_sub_update_flow(struct upipe *upipe)
                                     &channel, plane);
         uref_sound_flow_set_channel(flow_def, channel, plane);
     }
-    uref_sound_flow_set_sample_size(flow_def, sample_size / channels);
+    uref_sound_flow_set_sample_size(flow_def, sample_size);
     channels = 0;
     uref_sound_flow_get_channels(upipe_audio_split_sub->flow_def_params,
                                  &channels);
@@ -320,6 +329,41 @@ static int upipe_audio_split_sub_update_flow(struct upipe *upipe)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This allocates an output buffer pointing to the planes of a
+ * planar input buffer.
+ *
+ * @param upipe description structure of the subpipe
+ * @param uref input uref
+ * @return pointer to ubuf, or NULL if the planes cannot be shared
+ */
+static struct ubuf *upipe_audio_split_sub_alias(struct upipe *upipe,
+                                                struct uref *uref)
+{
+    struct upipe_audio_split_sub *split_sub =
+        upipe_audio_split_sub_from_upipe(upipe);
+    struct upipe_audio_split *upipe_audio_split =
+        upipe_audio_split_from_sub_mgr(upipe->mgr);
+    uint8_t planes = 0;
+    uref_sound_flow_get_planes(split_sub->flow_def_params, &planes);
+    if (unlikely(!planes))
+        return NULL;
+
+    const char *channels[planes];
+    for (uint8_t plane = 0; plane < planes; plane++) {
+        const char *channel;
+        uint8_t idx;
+        if (unlikely(!ubase_check(uref_sound_flow_get_channel(
+                        split_sub->flow_def_params, &channel, plane)) ||
+                     !ubase_check(uref_audio_split_get_orig_index(
+                        split_sub->flow_def_params, &idx, channel)) ||
+                     !ubase_check(uref_sound_flow_get_channel(
+                        upipe_audio_split->flow_def, &channels[plane], idx))))
+            return NULL;
+    }
+    return ubuf_sound_mem_alias(split_sub->ubuf_mgr, uref->ubuf,
+                                channels, planes);
+}
+
 /** @internal @This receives data.
  *
  * @param upipe description structure of the pipe
@@ -339,7 +383,7 @@ static void upipe_audio_split_input(struct upipe *upipe, struct uref *uref,
     }
     size_t samples;
     uint8_t sample_size;
-    uint8_t channels = 0;
+    uint8_t channels = 0, planes = 0;
     if (unlikely(!ubase_check(uref_sound_size(uref,
                           &samples, &sample_size)))) {
         upipe_warn(upipe, "invalid sound uref");
@@ -347,10 +391,12 @@ static void upipe_audio_split_input(struct upipe *upipe, struct uref *uref,
         return;
     }
     uref_sound_flow_get_channels(upipe_audio_split->flow_def, &channels);
-    uint8_t out_sample_size = sample_size / channels;
+    uref_sound_flow_get_planes(upipe_audio_split->flow_def, &planes);
+    bool planar = planes == channels;
+    uint8_t out_sample_size = planar ? sample_size : sample_size / channels;
 
-    const uint8_t *in_buf;
-    if (unlikely(!ubase_check(uref_sound_read_uint8_t(uref,
+    const uint8_t *in_buf = NULL;
+    if (!planar && unlikely(!ubase_check(uref_sound_read_uint8_t(uref,
                                         0, -1, &in_buf, 1)))) {
         uref_free(uref);
         return;
@@ -376,8 +422,16 @@ static void upipe_audio_split_input(struct upipe *upipe, struct uref *uref,
                               UBASE_ERR_ALLOC);
             goto err;
         }
-        struct ubuf *ubuf_planar = ubuf_sound_alloc(split_sub->ubuf_mgr,
-                                                    samples);
+        struct ubuf *ubuf_planar = NULL;
+        if (planar)
+            ubuf_planar = upipe_audio_split_sub_alias(upipe_sub, uref);
+        if (ubuf_planar != NULL) {
+            uref_attach_ubuf(uref_planar, ubuf_planar);
+            upipe_audio_split_sub_output(upipe_sub, uref_planar, upump_p);
+            continue;
+        }
+
+        ubuf_planar = ubuf_sound_alloc(split_sub->ubuf_mgr, samples);
         if (unlikely(!ubuf_planar)) {
             upipe_throw_error(upipe_audio_split_sub_to_upipe(split_sub),
                               UBASE_ERR_ALLOC);
@@ -405,6 +459,23 @@ static void upipe_audio_split_input(struct upipe *upipe, struct uref *uref,
                 upipe_warn_va(upipe_sub, "could not map %s", channel);
                 continue;
             }
+            if (planar) {
+                const char *in_channel;
+                const uint8_t *in;
+                if (likely(ubase_check(uref_sound_flow_get_channel(
+                                upipe_audio_split->flow_def, &in_channel,
+                                idx)) &&
+                           ubase_check(uref_sound_plane_read_uint8_t(uref,
+                                in_channel, 0, -1, &in)))) {
+                    memcpy(out, in, samples * out_sample_size);
+                    uref_sound_plane_unmap(uref, in_channel, 0, -1);
+                } else
+                    upipe_warn_va(upipe_sub, "could not map input %"PRIu8,
+                                  idx);
+                uref_sound_plane_unmap(uref_planar, channel, 0, -1);
+                continue;
+            }
+
             const uint8_t *in = in_buf + idx * out_sample_size;
             int i, j;
             for (i=0; i < samples; i++) {
@@ -423,7 +494,8 @@ static void upipe_audio_split_input(struct upipe *upipe, struct uref *uref,
     }
 
 err:
-    uref_sound_unmap(uref, 0, -1, 1);
+    if (!planar)
+        uref_sound_unmap(uref, 0, -1, 1);
     uref_free(uref);
 }
 
@@ -439,7 +511,11 @@ static int upipe_audio_split_set_flow_def(struct upipe *upipe,
     if (flow_def == NULL)
         return UBASE_ERR_INVALID;
     UBASE_RETURN(uref_flow_match_def(flow_def, "sound."))
-    UBASE_RETURN(uref_sound_flow_match_planes(flow_def, 1, 1))
+    uint8_t channels, planes;
+    UBASE_RETURN(uref_sound_flow_get_channels(flow_def, &channels))
+    UBASE_RETURN(uref_sound_flow_get_planes(flow_def, &planes))
+    if (unlikely(!channels || (planes != 1 && planes != channels)))
+        return UBASE_ERR_INVALID;
     struct uref *flow_def_audio_split;
 
     if ((flow_def_audio_split = uref_dup(flow_def)) == NULL) {
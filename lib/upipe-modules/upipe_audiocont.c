@@ -37,6 +37,8 @@
 #include <upipe/ubuf.h>
 #include <upipe/uref_sound.h>
 #include <upipe/uref_sound_flow.h>
+#include <upipe/uref_flow.h>
+#include <upipe/ubuf_sound.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -50,11 +52,28 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /** only accept sound */
 #define EXPECTED_FLOW_DEF "sound."
 
+/** @internal @This lists the sample formats that can be crossfaded. */
+enum upipe_audiocont_format {
+    /** unsupported format, inputs are switched without crossfade */
+    UPIPE_AUDIOCONT_FORMAT_NONE,
+    /** signed 16 bits */
+    UPIPE_AUDIOCONT_FORMAT_S16,
+    /** signed 32 bits */
+    UPIPE_AUDIOCONT_FORMAT_S32,
+    /** 32 bits float */
+    UPIPE_AUDIOCONT_FORMAT_F32
+};
+
 /** @hidden */
 static int upipe_audiocont_check(struct upipe *upipe, struct uref *flow_format);
 
@@ -86,6 +105,10 @@ struct upipe_audiocont {
     uint8_t planes;
     /** samplerate */
     uint64_t samplerate;
+    /** sample format */
+    enum upipe_audiocont_format format;
+    /** number of interleaved channels in a plane */
+    uint8_t plane_channels;
 
     /** list of input subpipes */
     struct uchain subs;
@@ -98,6 +121,15 @@ struct upipe_audiocont {
     /** pts latency */
     uint64_t latency;
 
+    /** crossfade duration on input switches, in 27 MHz units */
+    uint64_t crossfade;
+    /** previous input, faded out during the crossfade */
+    struct upipe *fade_from;
+    /** position in the crossfade, in samples */
+    size_t fade_pos;
+    /** crossfade duration in samples, or 0 if not computed yet */
+    size_t fade_total;
+
     /** manager to create input subpipes */
     struct upipe_mgr sub_mgr;
 
@@ -325,6 +357,8 @@ static void upipe_audiocont_sub_dead(struct upipe *upipe)
         upipe_audiocont_switch_input(upipe_audiocont_to_upipe(upipe_audiocont),
                                      NULL);
     }
+    if (upipe == upipe_audiocont->fade_from)
+        upipe_audiocont->fade_from = NULL;
 
     if (likely(upipe_audiocont_sub->flow_def)) {
         uref_free(upipe_audiocont_sub->flow_def);
@@ -382,7 +416,13 @@ static struct upipe *upipe_audiocont_alloc(struct upipe_mgr *mgr,
     upipe_audiocont->flow_def_uptodate = false;
     upipe_audiocont->planes = 0;
     upipe_audiocont->samplerate = 0;
+    upipe_audiocont->format = UPIPE_AUDIOCONT_FORMAT_NONE;
+    upipe_audiocont->plane_channels = 1;
     upipe_audiocont->latency = 0;
+    upipe_audiocont->crossfade = 0;
+    upipe_audiocont->fade_from = NULL;
+    upipe_audiocont->fade_pos = 0;
+    upipe_audiocont->fade_total = 0;
 
     upipe_throw_ready(upipe);
 
@@ -422,6 +462,21 @@ static enum ubase_err upipe_audiocont_switch_input(struct upipe *upipe,
     struct upipe_audiocont *upipe_audiocont = upipe_audiocont_from_upipe(upipe);
     char *name = upipe_audiocont->input_name ?
                  upipe_audiocont->input_name : "(noname)";
+
+    /* fade out the previous input, if both inputs can be mixed */
+    upipe_audiocont->fade_from = NULL;
+    if (upipe_audiocont->crossfade && upipe_audiocont->input_cur != NULL &&
+        input != NULL && input != upipe_audiocont->input_cur) {
+        struct uref *from_flow = upipe_audiocont_sub_from_upipe(
+                upipe_audiocont->input_cur)->flow_def;
+        struct uref *to_flow = upipe_audiocont_sub_from_upipe(input)->flow_def;
+        if (from_flow != NULL && to_flow != NULL &&
+            uref_sound_flow_compare_format(from_flow, to_flow)) {
+            upipe_audiocont->fade_from = upipe_audiocont->input_cur;
+            upipe_audiocont->fade_pos = 0;
+            upipe_audiocont->fade_total = 0;
+        }
+    }
     upipe_audiocont->input_cur = input;
     upipe_audiocont->flow_def_uptodate = false;
     upipe_notice_va(upipe, "switched to input \"%s\" (%p)", name, input);
@@ -456,6 +511,311 @@ static inline int upipe_audiocont_resize_uref(struct uref *uref, size_t offset,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This mixes a line of signed 16-bit samples of the previous
+ * input into the samples of the new input, with a linear ramp.
+ *
+ * @param out samples of the new input, overwritten with the mix
+ * @param in samples of the previous input
+ * @param frames number of frames
+ * @param channels number of interleaved channels
+ * @param gain gain of the new input for the first frame
+ * @param step gain increment between two frames
+ */
+static void upipe_audiocont_fade_s16(int16_t *out, const int16_t *in,
+                                     size_t frames, uint8_t channels,
+                                     float gain, float step)
+{
+    size_t k = 0;
+#ifdef __SSE2__
+    if (channels == 1) {
+        __m128 g0 = _mm_add_ps(_mm_set1_ps(gain),
+                _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(step)));
+        __m128 g1 = _mm_add_ps(g0, _mm_set1_ps(4 * step));
+        const __m128 inc = _mm_set1_ps(8 * step);
+        for ( ; k + 8 <= frames; k += 8) {
+            __m128i o = _mm_loadu_si128((const __m128i *)(out + k));
+            __m128i i = _mm_loadu_si128((const __m128i *)(in + k));
+            __m128 olo = _mm_cvtepi32_ps(
+                    _mm_srai_epi32(_mm_unpacklo_epi16(o, o), 16));
+            __m128 ohi = _mm_cvtepi32_ps(
+                    _mm_srai_epi32(_mm_unpackhi_epi16(o, o), 16));
+            __m128 ilo = _mm_cvtepi32_ps(
+                    _mm_srai_epi32(_mm_unpacklo_epi16(i, i), 16));
+            __m128 ihi = _mm_cvtepi32_ps(
+                    _mm_srai_epi32(_mm_unpackhi_epi16(i, i), 16));
+            olo = _mm_add_ps(ilo, _mm_mul_ps(_mm_sub_ps(olo, ilo), g0));
+            ohi = _mm_add_ps(ihi, _mm_mul_ps(_mm_sub_ps(ohi, ihi), g1));
+            _mm_storeu_si128((__m128i *)(out + k),
+                    _mm_packs_epi32(_mm_cvtps_epi32(olo),
+                                    _mm_cvtps_epi32(ohi)));
+            g0 = _mm_add_ps(g0, inc);
+            g1 = _mm_add_ps(g1, inc);
+        }
+    }
+#endif
+    for ( ; k < frames; k++) {
+        float g = gain + k * step;
+        for (uint8_t c = 0; c < channels; c++) {
+            size_t j = k * channels + c;
+            out[j] = lrintf(in[j] + (out[j] - in[j]) * g);
+        }
+    }
+}
+
+/** @internal @This mixes a line of signed 32-bit samples of the previous
+ * input into the samples of the new input, with a linear ramp.
+ *
+ * @param out samples of the new input, overwritten with the mix
+ * @param in samples of the previous input
+ * @param frames number of frames
+ * @param channels number of interleaved channels
+ * @param gain gain of the new input for the first frame
+ * @param step gain increment between two frames
+ */
+static void upipe_audiocont_fade_s32(int32_t *out, const int32_t *in,
+                                     size_t frames, uint8_t channels,
+                                     double gain, double step)
+{
+    size_t k = 0;
+#ifdef __SSE2__
+    if (channels == 1) {
+        /* doubles keep the 32 bits of precision */
+        __m128d g0 = _mm_set_pd(gain + step, gain);
+        __m128d g1 = _mm_add_pd(g0, _mm_set1_pd(2 * step));
+        const __m128d inc = _mm_set1_pd(4 * step);
+        for ( ; k + 4 <= frames; k += 4) {
+            __m128i o = _mm_loadu_si128((const __m128i *)(out + k));
+            __m128i i = _mm_loadu_si128((const __m128i *)(in + k));
+            __m128d olo = _mm_cvtepi32_pd(o);
+            __m128d ohi = _mm_cvtepi32_pd(_mm_unpackhi_epi64(o, o));
+            __m128d ilo = _mm_cvtepi32_pd(i);
+            __m128d ihi = _mm_cvtepi32_pd(_mm_unpackhi_epi64(i, i));
+            olo = _mm_add_pd(ilo, _mm_mul_pd(_mm_sub_pd(olo, ilo), g0));
+            ohi = _mm_add_pd(ihi, _mm_mul_pd(_mm_sub_pd(ohi, ihi), g1));
+            _mm_storeu_si128((__m128i *)(out + k),
+                    _mm_unpacklo_epi64(_mm_cvtpd_epi32(olo),
+                                       _mm_cvtpd_epi32(ohi)));
+            g0 = _mm_add_pd(g0, inc);
+            g1 = _mm_add_pd(g1, inc);
+        }
+    }
+#endif
+    for ( ; k < frames; k++) {
+        double g = gain + k * step;
+        for (uint8_t c = 0; c < channels; c++) {
+            size_t j = k * channels + c;
+            out[j] = lrint(in[j] + ((double)out[j] - in[j]) * g);
+        }
+    }
+}
+
+/** @internal @This mixes a line of float samples of the previous input into
+ * the samples of the new input, with a linear ramp.
+ *
+ * @param out samples of the new input, overwritten with the mix
+ * @param in samples of the previous input
+ * @param frames number of frames
+ * @param channels number of interleaved channels
+ * @param gain gain of the new input for the first frame
+ * @param step gain increment between two frames
+ */
+static void upipe_audiocont_fade_f32(float *out, const float *in,
+                                     size_t frames, uint8_t channels,
+                                     float gain, float step)
+{
+    size_t k = 0;
+#ifdef __SSE2__
+    if (channels == 1) {
+        __m128 g = _mm_add_ps(_mm_set1_ps(gain),
+                _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(step)));
+        const __m128 inc = _mm_set1_ps(4 * step);
+        for ( ; k + 4 <= frames; k += 4) {
+            __m128 o = _mm_loadu_ps(out + k);
+            __m128 i = _mm_loadu_ps(in + k);
+            _mm_storeu_ps(out + k,
+                    _mm_add_ps(i, _mm_mul_ps(_mm_sub_ps(o, i), g)));
+            g = _mm_add_ps(g, inc);
+        }
+    }
+#endif
+    for ( ; k < frames; k++) {
+        float g = gain + k * step;
+        for (uint8_t c = 0; c < channels; c++) {
+            size_t j = k * channels + c;
+            out[j] = in[j] + (out[j] - in[j]) * g;
+        }
+    }
+}
+
+/** @internal @This mixes samples of the previous input into the samples of
+ * the new input, at the given position of the crossfade.
+ *
+ * @param upipe description structure of the pipe
+ * @param out samples of the new input, overwritten with the mix
+ * @param in samples of the previous input
+ * @param frames number of frames
+ * @param offset offset of the first frame from the current crossfade position
+ */
+static void upipe_audiocont_fade(struct upipe *upipe, uint8_t *out,
+                                 const uint8_t *in, size_t frames,
+                                 size_t offset)
+{
+    struct upipe_audiocont *upipe_audiocont = upipe_audiocont_from_upipe(upipe);
+    double step = 1. / upipe_audiocont->fade_total;
+    double gain = (upipe_audiocont->fade_pos + offset) * step;
+    uint8_t channels = upipe_audiocont->plane_channels;
+
+    /* the gain saturates at the end of the crossfade */
+    size_t fading = upipe_audiocont->fade_pos + offset <
+                    upipe_audiocont->fade_total ?
+                    upipe_audiocont->fade_total -
+                    upipe_audiocont->fade_pos - offset : 0;
+    if (fading > frames)
+        fading = frames;
+
+    switch (upipe_audiocont->format) {
+        case UPIPE_AUDIOCONT_FORMAT_S16:
+            upipe_audiocont_fade_s16((int16_t *)out, (const int16_t *)in,
+                                     fading, channels, gain, step);
+            break;
+        case UPIPE_AUDIOCONT_FORMAT_S32:
+            upipe_audiocont_fade_s32((int32_t *)out, (const int32_t *)in,
+                                     fading, channels, gain, step);
+            break;
+        case UPIPE_AUDIOCONT_FORMAT_F32:
+            upipe_audiocont_fade_f32((float *)out, (const float *)in,
+                                     fading, channels, gain, step);
+            break;
+        default:
+            break;
+    }
+}
+
+/** @internal @This takes samples of an input to fill a reference buffer.
+ * Samples are copied, or mixed into the buffer if fade is true.
+ *
+ * @param upipe description structure of the pipe
+ * @param input input subpipe
+ * @param ref_buffers mapped planes of the reference buffer
+ * @param ref_size size of the reference buffer, in samples
+ * @param sample_size size of a sample in octets
+ * @param next_pts pts of the reference buffer
+ * @param next_duration duration of the reference buffer
+ * @param fade true to mix the samples into the buffer
+ */
+static void upipe_audiocont_extract(struct upipe *upipe,
+                                    struct upipe_audiocont_sub *input,
+                                    uint8_t **ref_buffers, size_t ref_size,
+                                    uint8_t sample_size, uint64_t next_pts,
+                                    uint64_t next_duration, bool fade)
+{
+    struct upipe_audiocont *upipe_audiocont = upipe_audiocont_from_upipe(upipe);
+    uint8_t planes = upipe_audiocont->planes;
+    size_t offset = 0;
+    while (offset < ref_size) {
+        struct uchain *uchain = ulist_peek(&input->urefs);
+        if (unlikely(!uchain)) {
+            upipe_verbose_va(upipe, "no input samples found (%"PRIu64")",
+            next_pts);
+            break;
+        }
+        struct uref *input_uref = uref_from_uchain(uchain);
+        size_t size;
+        uint64_t pts = 0;
+        uref_clock_get_pts_sys(input_uref, &pts);
+        if (pts + upipe_audiocont->latency > next_pts + next_duration) {
+            /* NOTE : next_duration is needed here because packets
+             * in the future are not mangled */
+            upipe_verbose_va(upipe,
+                "input samples in the future %"PRIu64" > %"PRIu64,
+                pts + upipe_audiocont->latency, next_pts);
+            break;
+        }
+        uref_sound_size(input_uref, &size, NULL);
+
+        size_t extracted = ((ref_size - offset) < size ) ?
+                           (ref_size - offset) : size;
+        upipe_verbose_va(upipe, "%p off %zu ext %zu size %zu ref %zu",
+                         input_uref, offset, extracted, size, ref_size);
+        const uint8_t *in_buffers[planes];
+        if (unlikely(!ubase_check(uref_sound_read_uint8_t(input_uref, 0,
+                                       extracted, in_buffers, planes)))) {
+            upipe_warn(upipe, "invalid input buffer");
+            uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
+            break;
+        }
+        int i;
+        for (i=0; (i < planes) && ref_buffers[i] && in_buffers[i]; i++) {
+            if (fade)
+                upipe_audiocont_fade(upipe,
+                                     ref_buffers[i] + offset * sample_size,
+                                     in_buffers[i], extracted, offset);
+            else
+                memcpy(ref_buffers[i] + offset * sample_size, in_buffers[i],
+                       extracted * sample_size);
+        }
+        uref_sound_unmap(input_uref, 0, extracted, planes);
+
+        offset += extracted;
+        if (extracted == size) {
+            /* input buffer entirely copied */
+            uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
+        } else {
+            /* resize input buffer (drop copied segment) */
+            upipe_audiocont_resize_uref(input_uref, extracted,
+                                        upipe_audiocont->samplerate);
+        }
+    }
+}
+
+/** @internal @This attaches to the reference uref a part of the buffer of
+ * the next input uref, without copying, if it covers the whole reference.
+ *
+ * @param upipe description structure of the pipe
+ * @param input input subpipe
+ * @param uref reference uref
+ * @param ref_size size of the reference buffer, in samples
+ * @param next_pts pts of the reference buffer
+ * @param next_duration duration of the reference buffer
+ * @return true if the buffer was attached
+ */
+static bool upipe_audiocont_splice(struct upipe *upipe,
+                                   struct upipe_audiocont_sub *input,
+                                   struct uref *uref, size_t ref_size,
+                                   uint64_t next_pts, uint64_t next_duration)
+{
+    struct upipe_audiocont *upipe_audiocont = upipe_audiocont_from_upipe(upipe);
+    struct uchain *uchain = ulist_peek(&input->urefs);
+    if (uchain == NULL)
+        return false;
+    struct uref *input_uref = uref_from_uchain(uchain);
+    size_t size;
+    uint64_t pts = 0;
+    uref_clock_get_pts_sys(input_uref, &pts);
+    if (pts + upipe_audiocont->latency > next_pts + next_duration ||
+        !ubase_check(uref_sound_size(input_uref, &size, NULL)) ||
+        size < ref_size)
+        return false;
+
+    struct ubuf *ubuf = ubuf_dup(input_uref->ubuf);
+    if (unlikely(ubuf == NULL))
+        return false;
+    if (unlikely(!ubase_check(ubuf_sound_resize(ubuf, 0, ref_size)))) {
+        ubuf_free(ubuf);
+        return false;
+    }
+    uref_attach_ubuf(uref, ubuf);
+    upipe_verbose_va(upipe, "%p spliced %zu size %zu", input_uref, ref_size,
+                     size);
+
+    if (size == ref_size)
+        uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
+    else
+        upipe_audiocont_resize_uref(input_uref, ref_size,
+                                    upipe_audiocont->samplerate);
+    return true;
+}
+
 /** @internal @This is called when an ubuf manager is provided.
  *
  * @param upipe description structure of the pipe
@@ -514,6 +874,23 @@ static void upipe_audiocont_input(struct upipe *upipe, struct uref *uref,
 
         uref_sound_flow_get_planes(flow_def, &upipe_audiocont->planes);
         uref_sound_flow_get_rate(flow_def, &upipe_audiocont->samplerate);
+
+        const char *def;
+        uint8_t channels;
+        upipe_audiocont->format = UPIPE_AUDIOCONT_FORMAT_NONE;
+        if (ubase_check(uref_flow_get_def(flow_def, &def))) {
+            if (!ubase_ncmp(def, "sound.s16."))
+                upipe_audiocont->format = UPIPE_AUDIOCONT_FORMAT_S16;
+            else if (!ubase_ncmp(def, "sound.s32."))
+                upipe_audiocont->format = UPIPE_AUDIOCONT_FORMAT_S32;
+            else if (!ubase_ncmp(def, "sound.f32."))
+                upipe_audiocont->format = UPIPE_AUDIOCONT_FORMAT_F32;
+        }
+        upipe_audiocont->plane_channels = 1;
+        if (ubase_check(uref_sound_flow_get_channels(flow_def, &channels)) &&
+            upipe_audiocont->planes && channels > upipe_audiocont->planes)
+            upipe_audiocont->plane_channels =
+                channels / upipe_audiocont->planes;
     }
 
     if (unlikely(upipe_audiocont->ubuf_mgr == NULL &&
@@ -605,6 +982,26 @@ static void upipe_audiocont_input(struct upipe *upipe, struct uref *uref,
     struct upipe_audiocont_sub *input =
         upipe_audiocont_sub_from_upipe(upipe_audiocont->input_cur);
 
+    /* previous input being faded out */
+    struct upipe_audiocont_sub *fade_from = NULL;
+    if (upipe_audiocont->fade_from != NULL &&
+        upipe_audiocont->format != UPIPE_AUDIOCONT_FORMAT_NONE) {
+        if (!upipe_audiocont->fade_total)
+            upipe_audiocont->fade_total = upipe_audiocont->crossfade *
+                upipe_audiocont->samplerate / UCLOCK_FREQ;
+        if (upipe_audiocont->fade_pos < upipe_audiocont->fade_total)
+            fade_from = upipe_audiocont_sub_from_upipe(
+                    upipe_audiocont->fade_from);
+    }
+    if (fade_from == NULL)
+        upipe_audiocont->fade_from = NULL;
+
+    /* attach the input buffer as is if no mixing is needed */
+    if (fade_from == NULL &&
+        upipe_audiocont_splice(upipe, input, uref, ref_size,
+                               next_pts, next_duration))
+        goto output;
+
     /* alloc ubuf and attach to reference uref */
     struct ubuf *ubuf = ubuf_sound_alloc(upipe_audiocont->ubuf_mgr, ref_size);
     if (unlikely(!ubuf)) {
@@ -631,55 +1028,13 @@ static void upipe_audiocont_input(struct upipe *upipe, struct uref *uref,
     }
 
     /* copy input sound buffer to output stream */
-    size_t offset = 0;
-    while (offset < ref_size) {
-        struct uchain *uchain = ulist_peek(&input->urefs);
-        if (unlikely(!uchain)) {
-            upipe_verbose_va(upipe, "no input samples found (%"PRIu64")",
-            next_pts);
-            break;
-        }
-        struct uref *input_uref = uref_from_uchain(uchain);
-        size_t size;
-        uint64_t pts = 0;
-        uref_clock_get_pts_sys(input_uref, &pts);
-        if (pts + upipe_audiocont->latency > next_pts + next_duration) {
-            /* NOTE : next_duration is needed here because packets
-             * in the future are not mangled */
-            upipe_verbose_va(upipe,
-                "input samples in the future %"PRIu64" > %"PRIu64,
-                pts + upipe_audiocont->latency, next_pts);
-            break;
-        }
-        uref_sound_size(input_uref, &size, NULL);
-
-        size_t extracted = ((ref_size - offset) < size ) ?
-                           (ref_size - offset) : size;
-        upipe_verbose_va(upipe, "%p off %zu ext %zu size %zu ref %zu",
-                         input_uref, offset, extracted, size, ref_size);
-        const uint8_t *in_buffers[planes];
-        if (unlikely(!ubase_check(uref_sound_read_uint8_t(input_uref, 0,
-                                       extracted, in_buffers, planes)))) {
-            upipe_warn(upipe, "invalid input buffer");
-            uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
-            break;
-        }
-        int i;
-        for (i=0; (i < planes) && ref_buffers[i] && in_buffers[i]; i++) {
-            memcpy(ref_buffers[i] + offset * sample_size, in_buffers[i],
-                   extracted * sample_size);
-        }
-        uref_sound_unmap(input_uref, 0, extracted, planes);
-
-        offset += extracted;
-        if (extracted == size) {
-            /* input buffer entirely copied */
-            uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
-        } else {
-            /* resize input buffer (drop copied segment) */
-            upipe_audiocont_resize_uref(input_uref, extracted,
-                                        upipe_audiocont->samplerate);
-        }
+    upipe_audiocont_extract(upipe, input, ref_buffers, ref_size, sample_size,
+                            next_pts, next_duration, false);
+    if (fade_from != NULL) {
+        /* mix in the previous input */
+        upipe_audiocont_extract(upipe, fade_from, ref_buffers, ref_size,
+                                sample_size, next_pts, next_duration, true);
+        upipe_audiocont->fade_pos += ref_size;
     }
 
     uref_sound_unmap(uref, 0, -1, planes);
@@ -865,6 +1220,16 @@ static int upipe_audiocont_control(struct upipe *upipe,
             *va_arg(args, uint64_t *) = upipe_audiocont->latency;
             return UBASE_ERR_NONE;
         }
+        case UPIPE_AUDIOCONT_SET_CROSSFADE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AUDIOCONT_SIGNATURE)
+            upipe_audiocont->crossfade = va_arg(args, uint64_t);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_AUDIOCONT_GET_CROSSFADE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AUDIOCONT_SIGNATURE)
+            *va_arg(args, uint64_t *) = upipe_audiocont->crossfade;
+            return UBASE_ERR_NONE;
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
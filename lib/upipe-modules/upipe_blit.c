@@ -53,13 +53,36 @@
 #include <assert.h>
 #include <time.h>
 #include <upipe-modules/upipe_blit.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /** only accept pics */
 #define EXPECTED_FLOW_DEF "pic."
+/** maximum number of planes of the background picture */
+#define UPIPE_BLIT_MAX_PLANES 8
 
 /** @file
  * @short Upipe module blit
  */
 
+/** @internal @This describes a mapped plane of the background picture. */
+struct upipe_blit_plane {
+    /** chroma type */
+    const char *chroma;
+    /** mapped buffer */
+    uint8_t *buf;
+    /** stride */
+    size_t stride;
+    /** horizontal subsampling */
+    uint8_t hsub;
+    /** vertical subsampling */
+    uint8_t vsub;
+    /** size of a macropixel in octets */
+    uint8_t macropixel_size;
+};
+
 /** upipe_blit structure to do blit */ 
 struct upipe_blit {
     /** refcount management structure */
@@ -79,6 +102,17 @@ struct upipe_blit {
 
     struct uchain subs;
     struct upipe_mgr sub_mgr;
+
+    /** horizontal size of the background picture */
+    size_t hsize;
+    /** vertical size of the background picture */
+    size_t vsize;
+    /** number of pixels in a macropixel of the background picture */
+    uint8_t macropixel;
+    /** number of mapped planes of the background picture */
+    unsigned int nb_planes;
+    /** mapped planes of the background picture */
+    struct upipe_blit_plane planes[UPIPE_BLIT_MAX_PLANES];
 };
 
 UPIPE_HELPER_UPIPE(upipe_blit, upipe, UPIPE_BLIT_SIGNATURE);
@@ -142,123 +176,183 @@ static struct upipe *upipe_blit_sub_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** @internal @This make the blit.
-*
-* @param hoset horizontal position of the picture to copy
-* @param voset vertical position of the picture to copy
-* @param signature signature of the pipe allocator
-* @param uref uref structure
-* @param urefsub second uref structure containing the picture to copy
-*/
-void copy(int hoset, int voset, struct uref *uref, struct uref *urefsub){
-    int x, y;
-    size_t h, v, h2, v2;
-    uint8_t macropixel, macropixel2;
-    const char* cp = NULL;
-    uint8_t *buf = NULL,  *aout = NULL, *out=NULL;
-    const uint8_t *buf2 = NULL, *asub = NULL;
-    uref_pic_size(uref, &h, &v, &macropixel);
-    uref_pic_size(urefsub, &h2, &v2, &macropixel2);
-    int sh1 = (int)h, sh2 = (int)h2, sv1 = (int)v, sv2 = (int)v2;
-    if ((sh2 + hoset) <= sh1 && (sv2 + voset) <= sv1 &&
-                uref_pic_flow_compare_format(uref, urefsub)) {
-
-        bool transpref = false;
-        while (ubase_check(uref_pic_plane_iterate(uref, &cp)) && cp != NULL) {
-            if (!strcmp(cp,"a8")) {
-                transpref = true;
+/** @internal @This blends a line of a sub-picture over a line of the
+ * background, with out = (in * alpha + out * (255 - alpha)) / 255.
+ *
+ * @param out background line
+ * @param in sub-picture line
+ * @param alpha alpha line of the sub-picture
+ * @param alpha_step distance between the alpha values of two samples
+ * @param samples number of samples
+ */
+static void upipe_blit_blend8(uint8_t *out, const uint8_t *in,
+                              const uint8_t *alpha, size_t alpha_step,
+                              size_t samples)
+{
+    size_t x = 0;
+#ifdef __SSE2__
+    if (alpha_step == 1) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i max = _mm_set1_epi16(255);
+        const __m128i round = _mm_set1_epi16(128);
+        for ( ; x + 16 <= samples; x += 16) {
+            __m128i o = _mm_loadu_si128((const __m128i *)(out + x));
+            __m128i s = _mm_loadu_si128((const __m128i *)(in + x));
+            __m128i a = _mm_loadu_si128((const __m128i *)(alpha + x));
+            __m128i r[2];
+            for (int i = 0; i < 2; i++) {
+                __m128i o16 = i ? _mm_unpackhi_epi8(o, zero) :
+                                  _mm_unpacklo_epi8(o, zero);
+                __m128i s16 = i ? _mm_unpackhi_epi8(s, zero) :
+                                  _mm_unpacklo_epi8(s, zero);
+                __m128i a16 = i ? _mm_unpackhi_epi8(a, zero) :
+                                  _mm_unpacklo_epi8(a, zero);
+                __m128i t = _mm_add_epi16(_mm_add_epi16(
+                        _mm_mullo_epi16(s16, a16),
+                        _mm_mullo_epi16(o16, _mm_sub_epi16(max, a16))),
+                        round);
+                /* exact t / 255 */
+                r[i] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)),
+                                      8);
             }
+            _mm_storeu_si128((__m128i *)(out + x),
+                             _mm_packus_epi16(r[0], r[1]));
         }
-        bool transpsub = false;
-        while (ubase_check(uref_pic_plane_iterate(uref, &cp)) && cp != NULL) {
-            if (!strcmp(cp,"a8")) {
-                transpsub = true;
-            }
-        } 
-        if (!transpref && !transpsub) {
-            while (ubase_check(uref_pic_plane_iterate(urefsub, &cp)) && 
-                    cp != NULL) {
-                size_t stride, stride2;
-                uint8_t hsub, vsub, hsub2, vsub2;
-                uint8_t macropixel_size, macropixel_size2;
-                uref_pic_plane_size(urefsub, cp, &stride2, &hsub2, &vsub2,
-                                        &macropixel_size2);
-                uref_pic_plane_size(uref, cp, &stride, &hsub, &vsub,
-                                        &macropixel_size);
-                int hoctets = h2 * macropixel_size2 / hsub2 / macropixel2;
-                uref_pic_plane_read(urefsub, cp, 0, 0, -1, -1, &buf2);
-                uref_pic_plane_write(uref, cp, hoset, voset, sh2, sv2, &buf);
-                for (y = 0; y < v2 / vsub2; y++) {
-                    for (x = 0; x < hoctets; x++) {
-                        buf[x] = buf2[x];
-                    }
-                    buf += stride;
-                    buf2 += stride2;
-                }
-                uref_pic_plane_unmap(urefsub, cp, 0, 0, -1, -1);
-                uref_pic_plane_unmap(uref, cp, hoset, voset, sh2, sv2);
-                }
-        } else {
-            size_t stridea, stridea2;
-            uint8_t hsuba, vsuba, hsuba2, vsuba2;
-            uint8_t macropixel_sizea, macropixel_sizea2;
-            uref_pic_plane_size(uref, "a8", &stridea, &hsuba, &vsuba,
-                                        &macropixel_sizea);
-            uref_pic_plane_size(urefsub, "a8", &stridea2, &hsuba2, &vsuba2,
-                                        &macropixel_sizea2);
-            uref_pic_plane_write(uref, "a8", hoset, voset, sh2, sv2, &aout);
-            int hoctetsa = h2 * macropixel_sizea2 / hsuba2 / macropixel2;
-            for (y = 0; y < v2 / vsuba2; y++) {
-                for (x = 0; x < hoctetsa; x++) {
-                    aout[x] = 0;
-                }
-                aout += stridea;
-            }
-            uref_pic_plane_unmap(uref, "a8", hoset, voset, sh2, sv2);
-            uref_pic_plane_read(urefsub, "a8", 0, 0, -1, -1, &asub);            
-
-            while (ubase_check(uref_pic_plane_iterate(urefsub, &cp)) && 
-                    cp != NULL) {
-                size_t stride, stride2;
-                int r, b, ha, compteur = 0;
-                int c = strcmp(cp, "a8");
-                if (c){
-                    uint8_t hsub, vsub, hsub2, vsub2;
-                    uint8_t macropixel_size, macropixel_size2;                
-                    uref_pic_plane_size(urefsub, cp, &stride2, &hsub2, &vsub2,
-                                        &macropixel_size2);
-                    uref_pic_plane_size(uref, cp, &stride, &hsub, &vsub,
-                                        &macropixel_size);
-                    int hoctets = h2 * macropixel_size2 / hsub2 / macropixel2;            
-                    uref_pic_plane_read(urefsub, cp, 0, 0, -1, -1, &buf2);
-                    uref_pic_plane_write(uref, cp, hoset, voset, sh2, sv2, &out);
-                    uref_pic_plane_size(uref, "a8", &stridea, &hsuba, &vsuba,
-                                            &macropixel_sizea);
-                    uref_pic_plane_size(urefsub, "a8", &stridea2, &hsuba2, &vsuba2,
-                                            &macropixel_sizea2);
-
-                    int hoctetsa = h2 * macropixel_sizea2 / hsuba2 / macropixel2;
-                    for (y = 0; y < v2 / vsub2; y++) {
-                        for (x = 0; x < hoctets; x++) {
-                            b = 255-asub[x+ha];
-                            r = ((b)*buf2[x]+(1-b)*out[x]);
-                            out[x] = r;
-                            ha = ha + hoctetsa / hoctets;
-                        }
-                        ha = 0;
-                        buf2 += stride2;
-                        out += stride;
-                        asub += vsub2 * stridea2;
-                        compteur += 1;
-                    }
-                    asub -= compteur * vsub2 * stridea2;
-                    uref_pic_plane_unmap(urefsub, cp, 0, 0, -1, -1);
-                    uref_pic_plane_unmap(uref, cp, hoset, voset, sh2, sv2);
+    }
+#endif
+    for ( ; x < samples; x++) {
+        unsigned int a = alpha[x * alpha_step];
+        unsigned int t = in[x] * a + out[x] * (255 - a) + 128;
+        out[x] = (t + (t >> 8)) >> 8;
+    }
+}
+
+/** @internal @This maps the planes of the background picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref background picture
+ * @return an error code
+ */
+static int upipe_blit_map(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_blit *upipe_blit = upipe_blit_from_upipe(upipe);
+    const char *chroma = NULL;
+    upipe_blit->nb_planes = 0;
+    UBASE_RETURN(uref_pic_size(uref, &upipe_blit->hsize, &upipe_blit->vsize,
+                               &upipe_blit->macropixel))
+    while (ubase_check(uref_pic_plane_iterate(uref, &chroma)) &&
+           chroma != NULL) {
+        struct upipe_blit_plane *plane =
+            &upipe_blit->planes[upipe_blit->nb_planes];
+        if (unlikely(upipe_blit->nb_planes >= UPIPE_BLIT_MAX_PLANES))
+            break;
+        if (unlikely(!ubase_check(uref_pic_plane_size(uref, chroma,
+                            &plane->stride, &plane->hsub, &plane->vsub,
+                            &plane->macropixel_size)) ||
+                     !ubase_check(uref_pic_plane_write(uref, chroma,
+                            0, 0, -1, -1, &plane->buf))))
+            break;
+        plane->chroma = chroma;
+        upipe_blit->nb_planes++;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This unmaps the planes of the background picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref background picture
+ */
+static void upipe_blit_unmap(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_blit *upipe_blit = upipe_blit_from_upipe(upipe);
+    for (unsigned int i = 0; i < upipe_blit->nb_planes; i++)
+        uref_pic_plane_unmap(uref, upipe_blit->planes[i].chroma,
+                             0, 0, -1, -1);
+    upipe_blit->nb_planes = 0;
+}
+
+/** @internal @This blits the latest picture of a subpipe into the background.
+ * The sub-picture must fit in the background, and its planes are matched to
+ * the planes of the background by chroma type. If the sub-picture has an "a8"
+ * plane, it is blended over the background with this alpha; otherwise it is
+ * copied.
+ *
+ * @param upipe description structure of the blit pipe
+ * @param sub subpipe
+ */
+static void upipe_blit_sub_blit(struct upipe *upipe,
+                                struct upipe_blit_sub *sub)
+{
+    struct upipe_blit *upipe_blit = upipe_blit_from_upipe(upipe);
+    struct upipe *upipe_sub = upipe_blit_sub_to_upipe(sub);
+    struct uref *urefsub = sub->uref;
+    size_t hsize, vsize;
+    uint8_t macropixel;
+    if (unlikely(!ubase_check(uref_pic_size(urefsub, &hsize, &vsize,
+                                            &macropixel))))
+        return;
+    if (unlikely(sub->H < 0 || sub->V < 0 ||
+                 sub->H + hsize > upipe_blit->hsize ||
+                 sub->V + vsize > upipe_blit->vsize ||
+                 macropixel != upipe_blit->macropixel))
+        return;
+
+    /* full resolution alpha, if any */
+    const uint8_t *alpha = NULL;
+    size_t alpha_stride;
+    uint8_t alpha_hsub, alpha_vsub, alpha_size;
+    if (ubase_check(uref_pic_plane_size(urefsub, "a8", &alpha_stride,
+                        &alpha_hsub, &alpha_vsub, &alpha_size)) &&
+        alpha_hsub == 1 && alpha_vsub == 1 && alpha_size == 1 &&
+        macropixel == 1)
+        uref_pic_plane_read(urefsub, "a8", 0, 0, -1, -1, &alpha);
+
+    for (unsigned int i = 0; i < upipe_blit->nb_planes; i++) {
+        const struct upipe_blit_plane *plane = &upipe_blit->planes[i];
+        size_t stride;
+        uint8_t hsub, vsub, macropixel_size;
+        const uint8_t *in;
+        if (!ubase_check(uref_pic_plane_size(urefsub, plane->chroma, &stride,
+                                &hsub, &vsub, &macropixel_size)))
+            continue;
+        if (unlikely(hsub != plane->hsub || vsub != plane->vsub ||
+                     macropixel_size != plane->macropixel_size ||
+                     sub->H % (hsub * macropixel) || sub->V % vsub)) {
+            upipe_warn_va(upipe_sub, "incompatible plane %s", plane->chroma);
+            continue;
+        }
+        if (unlikely(!ubase_check(uref_pic_plane_read(urefsub, plane->chroma,
+                                        0, 0, -1, -1, &in))))
+            continue;
+
+        size_t octets = hsize / hsub / macropixel * macropixel_size;
+        uint8_t *out = plane->buf + sub->V / vsub * plane->stride +
+                       sub->H / hsub / macropixel * macropixel_size;
+        bool is_alpha = !strcmp(plane->chroma, "a8");
+        for (size_t y = 0; y < vsize / vsub; y++) {
+            if (alpha == NULL)
+                memcpy(out, in, octets);
+            else if (is_alpha) {
+                /* alpha over: a + out * (255 - a) */
+                const uint8_t *a = alpha + y * alpha_stride;
+                for (size_t x = 0; x < octets; x++) {
+                    unsigned int t = 255 * a[x] + out[x] * (255 - a[x]) + 128;
+                    out[x] = (t + (t >> 8)) >> 8;
                 }
-            }
-            uref_pic_plane_unmap(urefsub, "a8", 0, 0, -1, -1);
-        }      
+            } else if (macropixel_size == 1)
+                upipe_blit_blend8(out, in, alpha + y * vsub * alpha_stride,
+                                  hsub, octets);
+            else
+                memcpy(out, in, octets);
+            out += plane->stride;
+            in += stride;
+        }
+        uref_pic_plane_unmap(urefsub, plane->chroma, 0, 0, -1, -1);
     }
+
+    if (alpha != NULL)
+        uref_pic_plane_unmap(urefsub, "a8", 0, 0, -1, -1);
 }
 
 /** @internal @This receives data.
@@ -389,38 +483,46 @@ static void upipe_blit_input(struct upipe *upipe, struct uref *uref,
     struct upipe_blit *upipe_blit = upipe_blit_from_upipe(upipe);
  
     struct uchain *uchain_sub;
+    const char *chroma = NULL;
     uint8_t *buf = NULL;
- 
-    if (unlikely(!ubase_check(uref_pic_plane_write(uref, "b8g8r8a8", 0, 0, 
-                                                -1, -1, &buf)))) {
+
+    if (unlikely(!ubase_check(uref_pic_plane_iterate(uref, &chroma)) ||
+                 chroma == NULL)) {
+        upipe_warn(upipe, "received non-picture packet");
+        uref_free(uref);
+        return;
+    }
+
+    /* make sure the background picture is writable, whatever its format */
+    if (unlikely(!ubase_check(uref_pic_plane_write(uref, chroma, 0, 0,
+                                                   -1, -1, &buf)))) {
         struct ubuf *ubuf = ubuf_pic_copy(uref->ubuf->mgr,
-                                            uref->ubuf,0, 0, -1, -1);
+                                          uref->ubuf, 0, 0, -1, -1);
         if (unlikely(!ubuf)) {
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             uref_free(uref);
-        return;
-
-        }
-        uref_attach_ubuf(uref, ubuf);
-        if (unlikely(!ubase_check(uref_pic_plane_write(uref, "b8g8r8a8", 0, 0, 
-                                             -1, -1, &buf)))) {
-            upipe_warn_va(upipe, "could not map ref packet");
-            uref_free(uref);
             return;
         }
+        uref_attach_ubuf(uref, ubuf);
+    } else
+        uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
 
+    if (unlikely(!ubase_check(upipe_blit_map(upipe, uref)) ||
+                 !upipe_blit->nb_planes)) {
+        upipe_warn_va(upipe, "could not map ref packet");
+        upipe_blit_unmap(upipe, uref);
+        uref_free(uref);
+        return;
     }
 
-    uref_pic_plane_unmap(uref, "b8g8r8a8", 0, 0, -1, -1);
-    ulist_foreach(&upipe_blit->subs, uchain_sub){
-     struct upipe_blit_sub *sub = upipe_blit_sub_from_uchain(uchain_sub);
-     if (likely(sub->uref != NULL)) {
-        copy(sub->H, sub->V, uref, sub->uref);
-        } else {
-            printf("sub->uref=NULL\n");     
-        }
+    /* subpipes are blitted in their creation order */
+    ulist_foreach(&upipe_blit->subs, uchain_sub) {
+        struct upipe_blit_sub *sub = upipe_blit_sub_from_uchain(uchain_sub);
+        if (likely(sub->uref != NULL))
+            upipe_blit_sub_blit(upipe, sub);
     }
 
+    upipe_blit_unmap(upipe, uref);
     upipe_blit_output(upipe, uref, upump_p);
 }
 
@@ -554,6 +656,8 @@ static struct upipe *upipe_blit_alloc(struct upipe_mgr *mgr,
     upipe_blit_init_sub_subs(upipe);
     upipe_blit_init_urefcount(upipe);
     upipe_blit_init_output(upipe);
+    struct upipe_blit *upipe_blit = upipe_blit_from_upipe(upipe);
+    upipe_blit->nb_planes = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
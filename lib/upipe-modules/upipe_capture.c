@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module - generates capture records from urefs
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_input.h>
+#include <upipe-modules/upipe_capture.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+/** @hidden */
+static bool upipe_capture_handle(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p);
+/** @hidden */
+static int upipe_capture_check(struct upipe *upipe, struct uref *flow_format);
+
+/** @internal @This is the private context of a capture pipe. */
+struct upipe_capture {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** temporary uref storage (used during urequest) */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers (used during udeal) */
+    struct uchain blockers;
+
+    /** input flow definition string not yet recorded, or NULL */
+    char *def;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_capture, upipe, UPIPE_CAPTURE_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_capture, urefcount, upipe_capture_free);
+UPIPE_HELPER_VOID(upipe_capture);
+UPIPE_HELPER_OUTPUT(upipe_capture, output, flow_def, output_state,
+                    request_list);
+UPIPE_HELPER_UBUF_MGR(upipe_capture, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      upipe_capture_check,
+                      upipe_capture_register_output_request,
+                      upipe_capture_unregister_output_request)
+UPIPE_HELPER_INPUT(upipe_capture, urefs, nb_urefs, max_urefs, blockers,
+                   upipe_capture_handle)
+
+/** @internal @This allocates a block holding the header of a record,
+ * optionally followed by a copy of its payload.
+ *
+ * @param upipe description structure of the pipe
+ * @param record header of the record
+ * @param payload payload of record->size octets to copy, or NULL
+ * @return pointer to the block, or NULL in case of allocation failure
+ */
+static struct ubuf *upipe_capture_alloc_header(struct upipe *upipe,
+        const struct upipe_capture_record *record, const uint8_t *payload)
+{
+    struct upipe_capture *upipe_capture = upipe_capture_from_upipe(upipe);
+    int total = UPIPE_CAPTURE_HEADER_SIZE;
+    if (payload != NULL)
+        total += record->size;
+    struct ubuf *ubuf = ubuf_block_alloc(upipe_capture->ubuf_mgr, total);
+    if (unlikely(ubuf == NULL))
+        return NULL;
+
+    int size = -1;
+    uint8_t *buf;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &size, &buf)) ||
+                 size < total)) {
+        ubuf_free(ubuf);
+        return NULL;
+    }
+    upipe_capture_write_header(buf, record);
+    if (payload != NULL)
+        memcpy(buf + UPIPE_CAPTURE_HEADER_SIZE, payload, record->size);
+    ubuf_block_unmap(ubuf, 0);
+    return ubuf;
+}
+
+/** @internal @This outputs the record of the pending flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref first uref of the flow
+ * @param date system date of the uref
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_capture_output_def(struct upipe *upipe, struct uref *uref,
+                                     uint64_t date, struct upump **upump_p)
+{
+    struct upipe_capture *upipe_capture = upipe_capture_from_upipe(upipe);
+    char *def = upipe_capture->def;
+    upipe_capture->def = NULL;
+
+    struct upipe_capture_record record;
+    record.date = date;
+    record.size = strlen(def);
+    record.flags = UPIPE_CAPTURE_FLOW_DEF;
+
+    struct uref *output = uref_sibling_alloc(uref);
+    struct ubuf *ubuf = upipe_capture_alloc_header(upipe, &record,
+                                                   (const uint8_t *)def);
+    free(def);
+    if (unlikely(output == NULL || ubuf == NULL)) {
+        if (output != NULL)
+            uref_free(output);
+        if (ubuf != NULL)
+            ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    uref_attach_ubuf(output, ubuf);
+    if (date != UPIPE_CAPTURE_NO_DATE)
+        uref_clock_set_cr_sys(output, date);
+    upipe_capture_output(upipe, output, upump_p);
+}
+
+/** @internal @This handles data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ * @return false if the input must be blocked
+ */
+static bool upipe_capture_handle(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_capture *upipe_capture = upipe_capture_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        free(upipe_capture->def);
+        upipe_capture->def = strdup(def);
+        if (unlikely(upipe_capture->def == NULL ||
+                     !ubase_check(uref_flow_set_def(uref,
+                                                    "block.capture.")))) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return true;
+        }
+        upipe_capture_store_flow_def(upipe, NULL);
+        upipe_capture_require_ubuf_mgr(upipe, uref);
+        return true;
+    }
+
+    if (upipe_capture->flow_def == NULL)
+        return false;
+
+    struct upipe_capture_record record;
+    record.date = UPIPE_CAPTURE_NO_DATE;
+    uref_clock_get_cr_sys(uref, &record.date);
+    if (upipe_capture->def != NULL)
+        upipe_capture_output_def(upipe, uref, record.date, upump_p);
+
+    record.flags = 0;
+    if (ubase_check(uref_flow_get_random(uref)))
+        record.flags |= UPIPE_CAPTURE_RANDOM;
+    if (ubase_check(uref_flow_get_discontinuity(uref)))
+        record.flags |= UPIPE_CAPTURE_DISCONTINUITY;
+    if (ubase_check(uref_flow_get_error(uref)))
+        record.flags |= UPIPE_CAPTURE_ERROR;
+    if (ubase_check(uref_block_get_start(uref)))
+        record.flags |= UPIPE_CAPTURE_START;
+    if (ubase_check(uref_block_get_end(uref)))
+        record.flags |= UPIPE_CAPTURE_END;
+
+    /* only block payloads are recorded, others keep their timing */
+    size_t size = 0;
+    struct ubuf *payload = NULL;
+    if (uref->ubuf != NULL && ubase_check(uref_block_size(uref, &size)) &&
+        size && likely(size <= UINT32_MAX))
+        payload = uref_detach_ubuf(uref);
+    else
+        size = 0;
+    record.size = size;
+
+    struct ubuf *ubuf = upipe_capture_alloc_header(upipe, &record, NULL);
+    if (unlikely(ubuf == NULL ||
+                 (payload != NULL &&
+                  !ubase_check(ubuf_block_append(ubuf, payload))))) {
+        if (ubuf != NULL)
+            ubuf_free(ubuf);
+        if (payload != NULL)
+            ubuf_free(payload);
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return true;
+    }
+    uref_attach_ubuf(uref, ubuf);
+    upipe_capture_output(upipe, uref, upump_p);
+    return true;
+}
+
+/** @internal @This inputs data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_capture_input(struct upipe *upipe, struct uref *uref,
+                                struct upump **upump_p)
+{
+    if (!upipe_capture_check_input(upipe)) {
+        upipe_capture_hold_input(upipe, uref);
+        upipe_capture_block_input(upipe, upump_p);
+    } else if (!upipe_capture_handle(upipe, uref, upump_p)) {
+        upipe_capture_hold_input(upipe, uref);
+        upipe_capture_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This checks if the input may start.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_capture_check(struct upipe *upipe, struct uref *flow_format)
+{
+    struct upipe_capture *upipe_capture = upipe_capture_from_upipe(upipe);
+    if (flow_format != NULL)
+        upipe_capture_store_flow_def(upipe, flow_format);
+
+    if (upipe_capture->flow_def == NULL)
+        return UBASE_ERR_NONE;
+
+    bool was_buffered = !upipe_capture_check_input(upipe);
+    upipe_capture_output_input(upipe);
+    upipe_capture_unblock_input(upipe);
+    if (was_buffered && upipe_capture_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_capture_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_capture_set_flow_def(struct upipe *upipe,
+                                      struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_def, &def))
+    struct uref *flow_def_dup;
+    if ((flow_def_dup = uref_dup(flow_def)) == NULL)
+        return UBASE_ERR_ALLOC;
+    /* the flow definition is recorded in order with the data */
+    upipe_input(upipe, flow_def_dup, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a capture pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_capture_control(struct upipe *upipe,
+                                 int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_capture_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return UBASE_ERR_NONE;
+            return upipe_capture_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_capture_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_capture_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_capture_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_capture_set_output(upipe, output);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This allocates a capture pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_capture_alloc(struct upipe_mgr *mgr,
+                                         struct uprobe *uprobe,
+                                         uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_capture_alloc_void(mgr, uprobe, signature,
+                                                   args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_capture *upipe_capture = upipe_capture_from_upipe(upipe);
+    upipe_capture_init_urefcount(upipe);
+    upipe_capture_init_ubuf_mgr(upipe);
+    upipe_capture_init_output(upipe);
+    upipe_capture_init_input(upipe);
+    upipe_capture->def = NULL;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This frees all resources allocated.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_capture_free(struct upipe *upipe)
+{
+    struct upipe_capture *upipe_capture = upipe_capture_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    free(upipe_capture->def);
+    upipe_capture_clean_input(upipe);
+    upipe_capture_clean_ubuf_mgr(upipe);
+    upipe_capture_clean_output(upipe);
+    upipe_capture_clean_urefcount(upipe);
+    upipe_capture_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_capture_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_CAPTURE_SIGNATURE,
+
+    .upipe_alloc = upipe_capture_alloc,
+    .upipe_input = upipe_capture_input,
+    .upipe_control = upipe_capture_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for capture pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_capture_mgr_alloc(void)
+{
+    return &upipe_capture_mgr;
+}
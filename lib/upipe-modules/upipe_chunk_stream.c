@@ -59,6 +59,10 @@
 
 #define DEFAULT_MTU 1460 /* 1500 - 20 - 8 - 12 (eth - ip - udp - rtp) */
 #define DEFAULT_ALIGN 4 /* 2ch s16 packed audio */
+/** maximum number of chunks per output block (UDP_MAX_SEGMENTS) */
+#define MAX_SEGMENTS 64
+/** maximum size of an output block (maximum UDP payload) */
+#define MAX_SUPER_SIZE 65507
 
 /** upipe_chunk_stream structure */ 
 struct upipe_chunk_stream {
@@ -80,6 +84,8 @@ struct upipe_chunk_stream {
     unsigned int align;
     /** aligned block size */
     unsigned int size;
+    /** number of chunks per output block */
+    unsigned int segments;
 
     /** next uref to be processed */
     struct uref *next_uref;
@@ -98,6 +104,31 @@ UPIPE_HELPER_VOID(upipe_chunk_stream);
 UPIPE_HELPER_OUTPUT(upipe_chunk_stream, output, flow_def, output_state, request_list);
 UPIPE_HELPER_UREF_STREAM(upipe_chunk_stream, next_uref, next_uref_size, urefs, NULL)
 
+/** @internal @This outputs a chunk or a super-chunk.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_chunk_stream_output_chunk(struct upipe *upipe,
+                                            struct uref *uref,
+                                            struct upump **upump_p)
+{
+    struct upipe_chunk_stream *upipe_chunk_stream =
+                       upipe_chunk_stream_from_upipe(upipe);
+    size_t size;
+    if (upipe_chunk_stream->segments > 1 &&
+        ubase_check(uref_block_size(uref, &size)) &&
+        size > upipe_chunk_stream->size &&
+        unlikely(!ubase_check(uref_block_set_segment_size(uref,
+                                upipe_chunk_stream->size)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    upipe_chunk_stream_output(upipe, uref, upump_p);
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -111,19 +142,20 @@ static void upipe_chunk_stream_input(struct upipe *upipe,
                        upipe_chunk_stream_from_upipe(upipe);
     size_t remaining = 0;
 
+    size_t size = upipe_chunk_stream->size * upipe_chunk_stream->segments;
+
     upipe_chunk_stream_append_uref_stream(upipe, uref);
 
     while(upipe_chunk_stream->next_uref
           && ubase_check(uref_block_size(upipe_chunk_stream->next_uref,
                                          &remaining))
-                          && (remaining >= upipe_chunk_stream->size)) {
-        uref = upipe_chunk_stream_extract_uref_stream(upipe, 
-                                    upipe_chunk_stream->size);
+                          && (remaining >= size)) {
+        uref = upipe_chunk_stream_extract_uref_stream(upipe, size);
         if (unlikely(!uref)) {
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             return;
         }
-        upipe_chunk_stream_output(upipe, uref, upump_p);
+        upipe_chunk_stream_output_chunk(upipe, uref, upump_p);
     }
 }
 
@@ -154,6 +186,8 @@ static void upipe_chunk_stream_flush(struct upipe *upipe)
 {
     struct upipe_chunk_stream *upipe_chunk_stream =
                        upipe_chunk_stream_from_upipe(upipe);
+    size_t super_size =
+        upipe_chunk_stream->size * upipe_chunk_stream->segments;
     size_t remaining = 0;
     size_t size = 0;
     struct uref *uref;
@@ -161,8 +195,8 @@ static void upipe_chunk_stream_flush(struct upipe *upipe)
     while(upipe_chunk_stream->next_uref
           && ubase_check(uref_block_size(upipe_chunk_stream->next_uref,
                                          &remaining)) && (remaining > 0)) {
-        size = (remaining >= upipe_chunk_stream->size)
-               ? upipe_chunk_stream->size
+        size = (remaining >= super_size)
+               ? super_size
                : ((remaining / upipe_chunk_stream->align)
                            * upipe_chunk_stream->align);
 
@@ -172,7 +206,7 @@ static void upipe_chunk_stream_flush(struct upipe *upipe)
             return;
         }
         
-        upipe_chunk_stream_output(upipe, uref, NULL);
+        upipe_chunk_stream_output_chunk(upipe, uref, NULL);
     }
     upipe_chunk_stream_clean_uref_stream(upipe);
     upipe_chunk_stream_init_uref_stream(upipe);
@@ -189,7 +223,9 @@ static bool _upipe_chunk_stream_set_mtu(struct upipe *upipe,
 {
     struct upipe_chunk_stream *upipe_chunk_stream =
                        upipe_chunk_stream_from_upipe(upipe);
-    if (unlikely(mtu == 0 || align == 0 || align >= mtu)) {
+    if (unlikely(mtu == 0 || align == 0 || align >= mtu ||
+                 (mtu / align) * align * upipe_chunk_stream->segments >
+                 MAX_SUPER_SIZE)) {
         upipe_warn_va(upipe, "invalid mtu (%u) or alignement (%u)",
                       mtu, align);
         return UBASE_ERR_INVALID;
@@ -221,6 +257,26 @@ static int _upipe_chunk_stream_get_mtu(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @This sets the number of chunks per output block.
+ *
+ * @param upipe description structure of the pipe
+ * @param segments number of chunks per output block
+ * @return an error code
+ */
+static int _upipe_chunk_stream_set_segments(struct upipe *upipe,
+                                            unsigned int segments)
+{
+    struct upipe_chunk_stream *upipe_chunk_stream =
+                       upipe_chunk_stream_from_upipe(upipe);
+    if (unlikely(segments == 0 || segments > MAX_SEGMENTS ||
+                 upipe_chunk_stream->size * segments > MAX_SUPER_SIZE)) {
+        upipe_warn_va(upipe, "invalid number of segments (%u)", segments);
+        return UBASE_ERR_INVALID;
+    }
+    upipe_chunk_stream->segments = segments;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a chunk_stream pipe.
  *
  * @param upipe description structure of the pipe
@@ -269,6 +325,17 @@ static int upipe_chunk_stream_control(struct upipe *upipe,
             unsigned int align = va_arg(args, unsigned int);
             return _upipe_chunk_stream_set_mtu(upipe, mtu, align);
         }
+        case UPIPE_CHUNK_STREAM_GET_SEGMENTS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_CHUNK_STREAM_SIGNATURE)
+            unsigned int *segments_p = va_arg(args, unsigned int *);
+            *segments_p = upipe_chunk_stream_from_upipe(upipe)->segments;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_CHUNK_STREAM_SET_SEGMENTS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_CHUNK_STREAM_SIGNATURE)
+            unsigned int segments = va_arg(args, unsigned int);
+            return _upipe_chunk_stream_set_segments(upipe, segments);
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -292,6 +359,7 @@ static struct upipe *upipe_chunk_stream_alloc(struct upipe_mgr *mgr,
     if (unlikely(upipe == NULL))
         return NULL;
 
+    upipe_chunk_stream_from_upipe(upipe)->segments = 1;
     _upipe_chunk_stream_set_mtu(upipe, DEFAULT_MTU, DEFAULT_ALIGN);
     upipe_chunk_stream_init_urefcount(upipe);
     upipe_chunk_stream_init_output(upipe);
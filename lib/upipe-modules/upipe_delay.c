@@ -25,14 +25,23 @@
 
 /** @file
  * @short Upipe module adding a delay to all dates
+ *
+ * In buffering mode, the urefs are also held in the pipe until a uref
+ * received delay later is input, so that the delay does not have to be
+ * absorbed by the queues of the sinks. The held urefs are bounded in octets,
+ * and the payloads of blocks may be spilled to a memory-mapped file.
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
 #include <upipe/uref.h>
+#include <upipe/uref_block.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uref_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -43,7 +52,15 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/** value of priv marking a held flow definition */
+#define FLOW_DEF_MARKER UINT64_MAX
 
 /** @internal @This is the private context of a delay pipe. */
 struct upipe_delay {
@@ -62,6 +79,24 @@ struct upipe_delay {
     /** delay to set */
     uint64_t delay;
 
+    /** max octets of held urefs, or 0 to only shift dates */
+    uint64_t buffer;
+    /** list of held urefs */
+    struct uchain urefs;
+    /** octets of held urefs */
+    uint64_t held;
+
+    /** file descriptor of the spill file, or -1 */
+    int spill_fd;
+    /** mapping of the spill file */
+    uint8_t *spill;
+    /** read position in the spill file */
+    uint64_t spill_read;
+    /** write position in the spill file */
+    uint64_t spill_write;
+    /** manager to allocate the payloads read back from the spill file */
+    struct ubuf_mgr *ubuf_mgr;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -92,10 +127,207 @@ static struct upipe *upipe_delay_alloc(struct upipe_mgr *mgr,
     upipe_delay_init_urefcount(upipe);
     upipe_delay_init_output(upipe);
     upipe_delay->delay = 0;
+    upipe_delay->buffer = 0;
+    ulist_init(&upipe_delay->urefs);
+    upipe_delay->held = 0;
+    upipe_delay->spill_fd = -1;
+    upipe_delay->spill = NULL;
+    upipe_delay->spill_read = upipe_delay->spill_write = 0;
+    upipe_delay->ubuf_mgr = NULL;
     upipe_throw_ready(upipe);
     return upipe;
 }
 
+/** @internal @This returns the octets accounted for a held uref.
+ *
+ * @param uref uref structure
+ * @return octets
+ */
+static uint64_t upipe_delay_size(struct uref *uref)
+{
+    if (uref->priv != FLOW_DEF_MARKER && uref->priv)
+        return uref->priv;
+    size_t size;
+    if (uref->ubuf == NULL || !ubase_check(uref_block_size(uref, &size)))
+        return 0;
+    return size;
+}
+
+/** @internal @This copies the payload of a block uref to the spill file,
+ * and frees its ubuf.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param size size of the payload
+ */
+static void upipe_delay_spill(struct upipe *upipe, struct uref *uref,
+                              uint64_t size)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    uint64_t first = upipe_delay->buffer - upipe_delay->spill_write;
+    if (first > size)
+        first = size;
+    if (unlikely(!ubase_check(uref_block_extract(uref, 0, first,
+                        upipe_delay->spill + upipe_delay->spill_write)) ||
+                 !ubase_check(uref_block_extract(uref, first, size - first,
+                        upipe_delay->spill)))) {
+        upipe_warn(upipe, "unable to spill buffer");
+        return;
+    }
+
+    if (upipe_delay->ubuf_mgr != uref->ubuf->mgr) {
+        ubuf_mgr_release(upipe_delay->ubuf_mgr);
+        upipe_delay->ubuf_mgr = ubuf_mgr_use(uref->ubuf->mgr);
+    }
+    ubuf_free(uref_detach_ubuf(uref));
+    uref->priv = size;
+    upipe_delay->spill_write = (upipe_delay->spill_write + size) %
+                               upipe_delay->buffer;
+}
+
+/** @internal @This reads the payload of a spilled uref back from the spill
+ * file.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param size size of the payload
+ * @return an error code
+ */
+static int upipe_delay_unspill(struct upipe *upipe, struct uref *uref,
+                               uint64_t size)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    uint64_t read = upipe_delay->spill_read;
+    upipe_delay->spill_read = (read + size) % upipe_delay->buffer;
+    uref->priv = 0;
+
+    struct ubuf *ubuf = ubuf_block_alloc(upipe_delay->ubuf_mgr, size);
+    if (unlikely(ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+    int length = -1;
+    uint8_t *buffer;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &length, &buffer)) ||
+                 (uint64_t)length != size)) {
+        ubuf_free(ubuf);
+        return UBASE_ERR_ALLOC;
+    }
+    uint64_t first = upipe_delay->buffer - read;
+    if (first > size)
+        first = size;
+    memcpy(buffer, upipe_delay->spill + read, first);
+    memcpy(buffer + first, upipe_delay->spill, size - first);
+    ubuf_block_unmap(ubuf, 0);
+    uref_attach_ubuf(uref, ubuf);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This outputs the oldest held uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_delay_release(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    struct uchain *uchain = ulist_pop(&upipe_delay->urefs);
+    struct uref *uref = uref_from_uchain(uchain);
+    if (uref->priv == FLOW_DEF_MARKER) {
+        uref->priv = 0;
+        upipe_delay_store_flow_def(upipe, uref);
+        return;
+    }
+
+    uint64_t size = upipe_delay_size(uref);
+    if (uref->priv) {
+        int err = upipe_delay_unspill(upipe, uref, size);
+        if (unlikely(!ubase_check(err))) {
+            upipe_throw_error(upipe, err);
+            uref_free(uref);
+            uref = NULL;
+        }
+    }
+    upipe_delay->held -= size;
+    if (uref != NULL)
+        upipe_delay_output(upipe, uref, upump_p);
+}
+
+/** @internal @This outputs all held urefs.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_delay_release_all(struct upipe *upipe)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    while (!ulist_empty(&upipe_delay->urefs))
+        upipe_delay_release(upipe, NULL);
+}
+
+/** @internal @This frees all held urefs, but applies the held flow
+ * definitions.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_delay_flush(struct upipe *upipe)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_delay->urefs, uchain, uchain_tmp) {
+        struct uref *uref = uref_from_uchain(uchain);
+        ulist_delete(uchain);
+        if (uref->priv == FLOW_DEF_MARKER) {
+            uref->priv = 0;
+            upipe_delay_store_flow_def(upipe, uref);
+        } else
+            uref_free(uref);
+    }
+    upipe_delay->held = 0;
+    upipe_delay->spill_read = upipe_delay->spill_write;
+}
+
+/** @internal @This holds a uref, and outputs the urefs which were received
+ * delay before it.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure, with dates already shifted
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_delay_hold(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump_p)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    uint64_t now;
+    if (ubase_check(uref_clock_get_cr_sys(uref, &now))) {
+        now -= upipe_delay->delay;
+        struct uchain *uchain;
+        while ((uchain = ulist_peek(&upipe_delay->urefs)) != NULL) {
+            uint64_t cr_sys;
+            if (ubase_check(uref_clock_get_cr_sys(uref_from_uchain(uchain),
+                                                  &cr_sys)) &&
+                cr_sys > now)
+                break;
+            upipe_delay_release(upipe, upump_p);
+        }
+    }
+
+    uref->priv = 0;
+    uint64_t size = upipe_delay_size(uref);
+    if (unlikely(upipe_delay->held + size > upipe_delay->buffer)) {
+        upipe_warn(upipe, "buffer full, releasing urefs early");
+        while (!ulist_empty(&upipe_delay->urefs) &&
+               upipe_delay->held + size > upipe_delay->buffer)
+            upipe_delay_release(upipe, upump_p);
+        if (unlikely(size > upipe_delay->buffer)) {
+            upipe_delay_output(upipe, uref, upump_p);
+            return;
+        }
+    }
+
+    if (upipe_delay->spill != NULL && size)
+        upipe_delay_spill(upipe, uref, size);
+    upipe_delay->held += size;
+    ulist_add(&upipe_delay->urefs, uref_to_uchain(uref));
+}
+
 /** @internal @This receives data.
  *
  * @param upipe description structure of the pipe
@@ -106,20 +338,12 @@ static void upipe_delay_input(struct upipe *upipe, struct uref *uref,
                               struct upump **upump_p)
 {
     struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
-    if (upipe_delay->delay) {
-        int type;
-        uint64_t date;
-        uref_clock_get_date_sys(uref, &date, &type);
-        if (type != UREF_DATE_NONE)
-            uref_clock_set_date_sys(uref, date + upipe_delay->delay, type);
-        uref_clock_get_date_prog(uref, &date, &type);
-        if (type != UREF_DATE_NONE)
-            uref_clock_set_date_prog(uref, date + upipe_delay->delay, type);
-        uref_clock_get_date_orig(uref, &date, &type);
-        if (type != UREF_DATE_NONE)
-            uref_clock_set_date_orig(uref, date + upipe_delay->delay, type);
-    }
-    upipe_delay_output(upipe, uref, upump_p);
+    if (upipe_delay->delay)
+        uref_clock_add_dates(uref, upipe_delay->delay);
+    if (upipe_delay->buffer)
+        upipe_delay_hold(upipe, uref, upump_p);
+    else
+        upipe_delay_output(upipe, uref, upump_p);
 }
 
 /** @internal @This sets the input flow definition.
@@ -135,7 +359,13 @@ static int upipe_delay_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     struct uref *flow_def_dup;
     if ((flow_def_dup = uref_dup(flow_def)) == NULL)
         return UBASE_ERR_ALLOC;
-    upipe_delay_store_flow_def(upipe, flow_def_dup);
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    if (!ulist_empty(&upipe_delay->urefs)) {
+        /* apply it after the held urefs */
+        flow_def_dup->priv = FLOW_DEF_MARKER;
+        ulist_add(&upipe_delay->urefs, uref_to_uchain(flow_def_dup));
+    } else
+        upipe_delay_store_flow_def(upipe, flow_def_dup);
     return UBASE_ERR_NONE;
 }
 
@@ -152,7 +382,8 @@ static int _upipe_delay_get_delay(struct upipe *upipe, uint64_t *delay_p)
     return UBASE_ERR_NONE;
 }
 
-/** @This sets the delay to set into urefs.
+/** @This sets the delay to set into urefs. The held urefs are shifted
+ * as well, so that dates keep increasing at the output.
  *
  * @param upipe description structure of the pipe
  * @param delay delay to set
@@ -161,10 +392,84 @@ static int _upipe_delay_get_delay(struct upipe *upipe, uint64_t *delay_p)
 static int _upipe_delay_set_delay(struct upipe *upipe, uint64_t delay)
 {
     struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    uref_clock_add_dates_list(&upipe_delay->urefs,
+                              (int64_t)delay - (int64_t)upipe_delay->delay);
     upipe_delay->delay = delay;
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This closes the spill file.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_delay_close_spill(struct upipe *upipe)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    if (upipe_delay->spill != NULL)
+        munmap(upipe_delay->spill, upipe_delay->buffer);
+    if (upipe_delay->spill_fd != -1)
+        close(upipe_delay->spill_fd);
+    upipe_delay->spill = NULL;
+    upipe_delay->spill_fd = -1;
+    ubuf_mgr_release(upipe_delay->ubuf_mgr);
+    upipe_delay->ubuf_mgr = NULL;
+}
+
+/** @internal @This returns the max octets of held urefs.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer_p filled with the max octets
+ * @return an error code
+ */
+static int _upipe_delay_get_buffer(struct upipe *upipe, uint64_t *buffer_p)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    *buffer_p = upipe_delay->buffer;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the max octets of held urefs, and the optional file
+ * to spill the payloads to. The urefs currently held are output.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer max octets of held urefs, or 0 to only shift dates
+ * @param path path of the spill file, or NULL to keep payloads in memory
+ * @return an error code
+ */
+static int _upipe_delay_set_buffer(struct upipe *upipe, uint64_t buffer,
+                                   const char *path)
+{
+    struct upipe_delay *upipe_delay = upipe_delay_from_upipe(upipe);
+    upipe_delay_release_all(upipe);
+    upipe_delay_close_spill(upipe);
+    upipe_delay->buffer = buffer;
+    upipe_delay->spill_read = upipe_delay->spill_write = 0;
+    if (!buffer || path == NULL)
+        return UBASE_ERR_NONE;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (unlikely(fd == -1)) {
+        upipe_err_va(upipe, "can't open spill file %s (%m)", path);
+        return UBASE_ERR_EXTERNAL;
+    }
+    if (unlikely(ftruncate(fd, buffer) == -1)) {
+        upipe_err_va(upipe, "can't resize spill file %s (%m)", path);
+        close(fd);
+        return UBASE_ERR_EXTERNAL;
+    }
+    void *spill = mmap(NULL, buffer, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+    if (unlikely(spill == MAP_FAILED)) {
+        upipe_err_va(upipe, "can't map spill file %s (%m)", path);
+        close(fd);
+        return UBASE_ERR_EXTERNAL;
+    }
+    upipe_delay->spill_fd = fd;
+    upipe_delay->spill = spill;
+    upipe_dbg_va(upipe, "spilling %"PRIu64" octets to %s", buffer, path);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a delay pipe.
  *
  * @param upipe description structure of the pipe
@@ -210,6 +515,20 @@ static int upipe_delay_control(struct upipe *upipe, int command, va_list args)
             uint64_t delay = va_arg(args, uint64_t);
             return _upipe_delay_set_delay(upipe, delay);
         }
+        case UPIPE_DELAY_GET_BUFFER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_DELAY_SIGNATURE)
+            uint64_t *buffer_p = va_arg(args, uint64_t *);
+            return _upipe_delay_get_buffer(upipe, buffer_p);
+        }
+        case UPIPE_DELAY_SET_BUFFER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_DELAY_SIGNATURE)
+            uint64_t buffer = va_arg(args, uint64_t);
+            const char *path = va_arg(args, const char *);
+            return _upipe_delay_set_buffer(upipe, buffer, path);
+        }
+        case UPIPE_FLUSH:
+            upipe_delay_flush(upipe);
+            return UBASE_ERR_NONE;
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -223,6 +542,8 @@ static void upipe_delay_free(struct upipe *upipe)
 {
     upipe_throw_dead(upipe);
 
+    upipe_delay_flush(upipe);
+    upipe_delay_close_spill(upipe);
     upipe_delay_clean_output(upipe);
     upipe_delay_clean_urefcount(upipe);
     upipe_delay_free_void(upipe);
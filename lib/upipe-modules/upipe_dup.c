@@ -29,8 +29,11 @@
 
 #include <upipe/ubase.h>
 #include <upipe/ulist.h>
+#include <upipe/urefcount.h>
+#include <upipe/upool.h>
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
+#include <upipe/uref_block.h>
 #include <upipe/ubuf.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
@@ -46,6 +49,30 @@
 #include <string.h>
 #include <assert.h>
 
+/** depth of the pool of shared urefs */
+#define SHARED_POOL_DEPTH 64
+
+/** @internal @This is the manager of the urefs given to the outputs in
+ * shared mode, whose structures come from a pool of the dup pipe. */
+struct upipe_dup_shared_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** manager of the original urefs */
+    struct uref_mgr *uref_mgr;
+    /** pool of uref structures */
+    struct upool shared_pool;
+
+    /** common management structure */
+    struct uref_mgr mgr;
+
+    /** extra space for upool */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(upipe_dup_shared_mgr, uref_mgr, uref_mgr, mgr)
+UBASE_FROM_TO(upipe_dup_shared_mgr, urefcount, urefcount, urefcount)
+UBASE_FROM_TO(upipe_dup_shared_mgr, upool, shared_pool, shared_pool)
+
 /** @internal @This is the private context of a dup pipe. */
 struct upipe_dup {
     /** real refcount management structure */
@@ -57,6 +84,10 @@ struct upipe_dup {
     struct uchain outputs;
     /** flow definition packet */
     struct uref *flow_def;
+    /** true if the outputs share the incoming urefs */
+    bool shared;
+    /** manager of the shared urefs, allocated on the first uref */
+    struct upipe_dup_shared_mgr *shared_mgr;
 
     /** manager to create output subpipes */
     struct upipe_mgr sub_mgr;
@@ -89,6 +120,8 @@ struct upipe_dup_output {
     enum upipe_helper_output_state output_state;
     /** list of output requests */
     struct uchain request_list;
+    /** true if the output writes to the buffers */
+    bool writer;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -101,6 +134,183 @@ UPIPE_HELPER_OUTPUT(upipe_dup_output, output, flow_def, output_state, request_li
 UPIPE_HELPER_SUBPIPE(upipe_dup, upipe_dup_output, output, sub_mgr, outputs,
                      uchain)
 
+/** @internal @This allocates a uref from a manager of shared urefs. The
+ * allocated uref is not shared, and belongs to the manager of the original
+ * urefs.
+ *
+ * @param mgr common management structure
+ * @return pointer to uref or NULL in case of allocation error
+ */
+static struct uref *upipe_dup_shared_alloc(struct uref_mgr *mgr)
+{
+    struct upipe_dup_shared_mgr *shared_mgr =
+        upipe_dup_shared_mgr_from_uref_mgr(mgr);
+    return shared_mgr->uref_mgr->uref_alloc(shared_mgr->uref_mgr);
+}
+
+/** @internal @This allocates a uref with a block ubuf, from a manager of
+ * shared urefs. The allocated uref is not shared.
+ *
+ * @param mgr common management structure
+ * @param ubuf_mgr management structure for ubufs
+ * @param size size of the buffer
+ * @return pointer to uref or NULL in case of allocation error
+ */
+static struct uref *upipe_dup_shared_alloc_block(struct uref_mgr *mgr,
+                                                 struct ubuf_mgr *ubuf_mgr,
+                                                 int size)
+{
+    struct upipe_dup_shared_mgr *shared_mgr =
+        upipe_dup_shared_mgr_from_uref_mgr(mgr);
+    return uref_block_alloc(shared_mgr->uref_mgr, ubuf_mgr, size);
+}
+
+/** @internal @This releases the structure of a uref given to an output,
+ * whose ubuf and udict were already freed.
+ *
+ * @param uref pointer to a uref structure
+ */
+static void upipe_dup_shared_free(struct uref *uref)
+{
+    struct upipe_dup_shared_mgr *shared_mgr =
+        upipe_dup_shared_mgr_from_uref_mgr(uref->mgr);
+    upool_free(&shared_mgr->shared_pool, uref);
+    uref_mgr_release(&shared_mgr->mgr);
+}
+
+/** @internal @This allocates the data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to uref or NULL in case of allocation error
+ */
+static void *upipe_dup_shared_alloc_inner(struct upool *upool)
+{
+    struct upipe_dup_shared_mgr *shared_mgr =
+        upipe_dup_shared_mgr_from_shared_pool(upool);
+    struct uref *uref = malloc(sizeof(struct uref));
+    if (unlikely(uref == NULL))
+        return NULL;
+    uref->mgr = upipe_dup_shared_mgr_to_uref_mgr(shared_mgr);
+    return uref;
+}
+
+/** @internal @This frees a uref structure.
+ *
+ * @param upool pointer to upool
+ * @param obj pointer to uref structure to free
+ */
+static void upipe_dup_shared_free_inner(struct upool *upool, void *obj)
+{
+    free(obj);
+}
+
+/** @internal @This processes control commands on a manager of shared urefs.
+ *
+ * @param mgr pointer to a uref_mgr structure
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_dup_shared_mgr_control(struct uref_mgr *mgr,
+                                        int command, va_list args)
+{
+    struct upipe_dup_shared_mgr *shared_mgr =
+        upipe_dup_shared_mgr_from_uref_mgr(mgr);
+    if (command == UREF_MGR_VACUUM)
+        upool_vacuum(&shared_mgr->shared_pool);
+    if (shared_mgr->uref_mgr->uref_mgr_control == NULL)
+        return command == UREF_MGR_VACUUM ? UBASE_ERR_NONE :
+                                            UBASE_ERR_UNHANDLED;
+    return shared_mgr->uref_mgr->uref_mgr_control(shared_mgr->uref_mgr,
+                                                  command, args);
+}
+
+/** @internal @This frees a manager of shared urefs.
+ *
+ * @param urefcount pointer to a urefcount
+ */
+static void upipe_dup_shared_mgr_free(struct urefcount *urefcount)
+{
+    struct upipe_dup_shared_mgr *shared_mgr =
+        upipe_dup_shared_mgr_from_urefcount(urefcount);
+    upool_clean(&shared_mgr->shared_pool);
+    uref_mgr_release(shared_mgr->uref_mgr);
+
+    urefcount_clean(urefcount);
+    free(shared_mgr);
+}
+
+/** @internal @This allocates a manager of the urefs given to the outputs in
+ * shared mode, duplicating urefs from the given manager.
+ *
+ * @param uref_mgr manager of the original urefs
+ * @return pointer to manager, or NULL in case of error
+ */
+static struct upipe_dup_shared_mgr *
+    upipe_dup_shared_mgr_alloc(struct uref_mgr *uref_mgr)
+{
+    struct upipe_dup_shared_mgr *shared_mgr =
+        malloc(sizeof(struct upipe_dup_shared_mgr) +
+               upool_sizeof(SHARED_POOL_DEPTH));
+    if (unlikely(shared_mgr == NULL))
+        return NULL;
+
+    upool_init(&shared_mgr->shared_pool, SHARED_POOL_DEPTH,
+               shared_mgr->upool_extra, upipe_dup_shared_alloc_inner,
+               upipe_dup_shared_free_inner);
+    shared_mgr->uref_mgr = uref_mgr_use(uref_mgr);
+
+    urefcount_init(upipe_dup_shared_mgr_to_urefcount(shared_mgr),
+                   upipe_dup_shared_mgr_free);
+    shared_mgr->mgr.refcount = upipe_dup_shared_mgr_to_urefcount(shared_mgr);
+    shared_mgr->mgr.control_attr_size = uref_mgr->control_attr_size;
+    shared_mgr->mgr.udict_mgr = uref_mgr->udict_mgr;
+    shared_mgr->mgr.uref_alloc = upipe_dup_shared_alloc;
+    shared_mgr->mgr.uref_free = upipe_dup_shared_free;
+    shared_mgr->mgr.uref_alloc_block = uref_mgr->uref_alloc_block != NULL ?
+                                       upipe_dup_shared_alloc_block : NULL;
+    shared_mgr->mgr.uref_mgr_control = upipe_dup_shared_mgr_control;
+    return shared_mgr;
+}
+
+/** @internal @This duplicates an incoming uref into a structure of the
+ * pool. The duplicate holds its own references to the udict and ubuf, so
+ * that the receiver may modify it as any other uref.
+ *
+ * @param shared_mgr manager of the urefs given to the outputs
+ * @param original incoming uref
+ * @return pointer to duplicated uref, or NULL in case of allocation error
+ */
+static struct uref *upipe_dup_shared_dup(
+        struct upipe_dup_shared_mgr *shared_mgr, struct uref *original)
+{
+    struct uref *uref = upool_alloc(&shared_mgr->shared_pool, struct uref *);
+    if (unlikely(uref == NULL))
+        return NULL;
+    uref_mgr_use(&shared_mgr->mgr);
+    uchain_init(&uref->uchain);
+    uref->ubuf = NULL;
+    uref->udict = NULL;
+    uref->flags = original->flags;
+    uref->date_sys = original->date_sys;
+    uref->date_prog = original->date_prog;
+    uref->date_orig = original->date_orig;
+    uref->dts_pts_delay = original->dts_pts_delay;
+    uref->cr_dts_delay = original->cr_dts_delay;
+    uref->rap_cr_delay = original->rap_cr_delay;
+    uref->date_ingress = original->date_ingress;
+    uref->priv = original->priv;
+
+    if ((original->udict != NULL &&
+         (uref->udict = udict_dup(original->udict)) == NULL) ||
+        (original->ubuf != NULL &&
+         (uref->ubuf = ubuf_dup(original->ubuf)) == NULL)) {
+        uref_free(uref);
+        return NULL;
+    }
+    return uref;
+}
+
 /** @internal @This allocates an output subpipe of a dup pipe.
  *
  * @param mgr common management structure
@@ -134,6 +344,7 @@ static struct upipe *upipe_dup_output_alloc(struct upipe_mgr *mgr,
     upipe_dup_output_init_urefcount(upipe);
     upipe_dup_output_init_output(upipe);
     upipe_dup_output_init_sub(upipe);
+    upipe_dup_output->writer = false;
 
     upipe_dup_output_store_flow_def(upipe, flow_def_dup);
     upipe_throw_ready(upipe);
@@ -168,6 +379,13 @@ static int upipe_dup_output_control(struct upipe *upipe,
             struct upipe **p = va_arg(args, struct upipe **);
             return upipe_dup_output_get_super(upipe, p);
         }
+        case UPIPE_DUP_OUTPUT_SET_WRITER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_DUP_OUTPUT_SIGNATURE)
+            struct upipe_dup_output *upipe_dup_output =
+                upipe_dup_output_from_upipe(upipe);
+            upipe_dup_output->writer = !!va_arg(args, int);
+            return UBASE_ERR_NONE;
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -229,10 +447,83 @@ static struct upipe *upipe_dup_alloc(struct upipe_mgr *mgr,
     upipe_dup_init_sub_mgr(upipe);
     upipe_dup_init_sub_outputs(upipe);
     upipe_dup->flow_def = NULL;
+    upipe_dup->shared = false;
+    upipe_dup->shared_mgr = NULL;
     upipe_throw_ready(upipe);
     return upipe;
 }
 
+/** @internal @This returns the output writing to the buffers, which is
+ * given its uref after the other outputs, or NULL.
+ *
+ * @param upipe description structure of the pipe
+ * @return pointer to the output writing to the buffers, or NULL
+ */
+static struct upipe_dup_output *upipe_dup_find_writer(struct upipe *upipe)
+{
+    struct upipe_dup *upipe_dup = upipe_dup_from_upipe(upipe);
+    struct uchain *uchain;
+    ulist_foreach (&upipe_dup->outputs, uchain) {
+        struct upipe_dup_output *upipe_dup_output =
+            upipe_dup_output_from_uchain(uchain);
+        if (upipe_dup_output->writer)
+            return upipe_dup_output;
+    }
+    return NULL;
+}
+
+/** @internal @This gives duplicates of an incoming uref to all outputs in
+ * shared mode, allocated from the pool of the pipe. The incoming uref itself
+ * is given to the output writing to the buffers, or else to the last output.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ * @return an error code, in which case the uref was not consumed
+ */
+static int upipe_dup_input_shared(struct upipe *upipe, struct uref *uref,
+                                  struct upump **upump_p)
+{
+    struct upipe_dup *upipe_dup = upipe_dup_from_upipe(upipe);
+    if (ulist_depth(&upipe_dup->outputs) < 2)
+        return UBASE_ERR_INVALID;
+
+    if (upipe_dup->shared_mgr == NULL) {
+        upipe_dup->shared_mgr = upipe_dup_shared_mgr_alloc(uref->mgr);
+        UBASE_ALLOC_RETURN(upipe_dup->shared_mgr);
+    }
+    struct upipe_dup_shared_mgr *shared_mgr = upipe_dup->shared_mgr;
+    if (unlikely(shared_mgr->uref_mgr != uref->mgr))
+        return UBASE_ERR_INVALID;
+
+    struct upipe_dup_output *last = upipe_dup_find_writer(upipe);
+    if (last == NULL)
+        last = upipe_dup_output_from_uchain(upipe_dup->outputs.prev);
+    struct upipe *last_upipe = upipe_dup_output_to_upipe(last);
+    upipe_use(last_upipe);
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_dup->outputs, uchain) {
+        struct upipe_dup_output *upipe_dup_output =
+            upipe_dup_output_from_uchain(uchain);
+        if (upipe_dup_output == last)
+            continue;
+        struct uref *new_uref = upipe_dup_shared_dup(shared_mgr, uref);
+        if (unlikely(new_uref == NULL)) {
+            uref_free(uref);
+            upipe_release(last_upipe);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_NONE;
+        }
+        upipe_dup_output_output(upipe_dup_output_to_upipe(upipe_dup_output),
+                                new_uref, upump_p);
+    }
+
+    upipe_dup_output_output(last_upipe, uref, upump_p);
+    upipe_release(last_upipe);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This receives data.
  *
  * @param upipe description structure of the pipe
@@ -243,11 +534,23 @@ static void upipe_dup_input(struct upipe *upipe, struct uref *uref,
                             struct upump **upump_p)
 {
     struct upipe_dup *upipe_dup = upipe_dup_from_upipe(upipe);
+    if (upipe_dup->shared &&
+        ubase_check(upipe_dup_input_shared(upipe, uref, upump_p)))
+        return;
+
+    /* the output writing to the buffers gets the original after the others,
+     * so that it does not have to copy them if they were released */
+    struct upipe_dup_output *writer = upipe_dup_find_writer(upipe);
+    if (writer != NULL)
+        upipe_use(upipe_dup_output_to_upipe(writer));
+
     struct uchain *uchain;
     ulist_foreach (&upipe_dup->outputs, uchain) {
         struct upipe_dup_output *upipe_dup_output =
             upipe_dup_output_from_uchain(uchain);
-        if (ulist_is_last(&upipe_dup->outputs, uchain)) {
+        if (upipe_dup_output == writer)
+            continue;
+        if (writer == NULL && ulist_is_last(&upipe_dup->outputs, uchain)) {
             upipe_dup_output_output(upipe_dup_output_to_upipe(upipe_dup_output),
                                     uref, upump_p);
             uref = NULL;
@@ -255,6 +558,8 @@ static void upipe_dup_input(struct upipe *upipe, struct uref *uref,
             struct uref *new_uref = uref_dup(uref);
             if (unlikely(new_uref == NULL)) {
                 uref_free(uref);
+                if (writer != NULL)
+                    upipe_release(upipe_dup_output_to_upipe(writer));
                 upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
                 return;
             }
@@ -262,6 +567,12 @@ static void upipe_dup_input(struct upipe *upipe, struct uref *uref,
                                     new_uref, upump_p);
         }
     }
+    if (writer != NULL) {
+        struct upipe *writer_upipe = upipe_dup_output_to_upipe(writer);
+        upipe_dup_output_output(writer_upipe, uref, upump_p);
+        upipe_release(writer_upipe);
+        uref = NULL;
+    }
     if (uref != NULL)
         uref_free(uref);
 }
@@ -301,6 +612,19 @@ static int upipe_dup_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the shared mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param shared true if the outputs share the incoming urefs
+ * @return an error code
+ */
+static int _upipe_dup_set_shared(struct upipe *upipe, bool shared)
+{
+    struct upipe_dup *upipe_dup = upipe_dup_from_upipe(upipe);
+    upipe_dup->shared = shared;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a dup pipe.
  *
  * @param upipe description structure of the pipe
@@ -332,6 +656,12 @@ static int upipe_dup_control(struct upipe *upipe, int command, va_list args)
             return upipe_dup_iterate_sub(upipe, p);
         }
 
+        case UPIPE_DUP_SET_SHARED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_DUP_SIGNATURE)
+            bool shared = va_arg(args, int);
+            return _upipe_dup_set_shared(upipe, shared);
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -349,6 +679,8 @@ static void upipe_dup_free(struct urefcount *urefcount_real)
     upipe_dup_clean_sub_outputs(upipe);
     if (upipe_dup->flow_def != NULL)
         uref_free(upipe_dup->flow_def);
+    if (upipe_dup->shared_mgr != NULL)
+        uref_mgr_release(&upipe_dup->shared_mgr->mgr);
     urefcount_clean(urefcount_real);
     upipe_dup_clean_urefcount(upipe);
     upipe_dup_free_void(upipe);
@@ -27,6 +27,8 @@
  * @short Upipe sink module for files
  */
 
+#define _GNU_SOURCE
+
 #include <upipe/ubase.h>
 #include <upipe/ulist.h>
 #include <upipe/uprobe.h>
@@ -52,6 +54,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -59,11 +62,51 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #ifndef O_CLOEXEC
 #   define O_CLOEXEC 0
 #endif
 
+/** alignment of buffers, sizes and offsets in O_DIRECT mode */
+#define DIRECT_ALIGN 4096
+
+/** maximum number of files waiting to be closed by the helper thread */
+#define UPIPE_FSINK_ASYNC_CLOSE 16
+
+/** @internal @This is the context of the helper thread opening and closing
+ * files. */
+struct upipe_fsink_async {
+    /** helper thread */
+    pthread_t thread;
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** condition signalled on new requests and on completion */
+    pthread_cond_t cond;
+
+    /** path of the file to open ahead, or NULL */
+    char *path;
+    /** open() flags of the file to open */
+    int flags;
+    /** opening mode of the file to open */
+    enum upipe_fsink_mode mode;
+    /** size of the O_DIRECT staging buffer */
+    unsigned int direct_size;
+    /** true when the file has been opened */
+    bool done;
+    /** opened file descriptor, or -1 */
+    int fd;
+    /** errno of the opening */
+    int error;
+
+    /** file descriptors to close */
+    int close_fds[UPIPE_FSINK_ASYNC_CLOSE];
+    /** number of file descriptors to close */
+    unsigned int nb_close;
+    /** set to true to ask the thread to exit */
+    bool exit;
+};
+
 /** @hidden */
 static void upipe_fsink_watcher(struct upump *upump);
 /** @hidden */
@@ -91,6 +134,28 @@ struct upipe_fsink {
     int fd;
     /** file path */
     char *path;
+    /** current writing offset in the file */
+    uint64_t offset;
+
+    /** size of the O_DIRECT staging buffer for the next file, or 0 */
+    unsigned int direct_size;
+    /** staging buffer if the file is opened with O_DIRECT, or NULL */
+    uint8_t *direct_buffer;
+    /** number of octets in the staging buffer */
+    size_t direct_level;
+    /** size of the chunks of preallocated space, or 0 */
+    uint64_t prealloc;
+    /** end of the preallocated space */
+    uint64_t prealloc_end;
+    /** number of octets between two syncs, or 0 */
+    uint64_t sync_period;
+    /** offset of the data not yet submitted for writeback */
+    uint64_t sync_offset;
+    /** offset of the data submitted but not yet waited for */
+    uint64_t sync_wait_offset;
+    /** helper thread opening and closing files, or NULL */
+    struct upipe_fsink_async *async;
+
     /** temporary uref storage */
     struct uchain urefs;
     /** nb urefs in storage */
@@ -137,6 +202,16 @@ static struct upipe *upipe_fsink_alloc(struct upipe_mgr *mgr,
     upipe_fsink->latency = 0;
     upipe_fsink->fd = -1;
     upipe_fsink->path = NULL;
+    upipe_fsink->offset = 0;
+    upipe_fsink->direct_size = 0;
+    upipe_fsink->direct_buffer = NULL;
+    upipe_fsink->direct_level = 0;
+    upipe_fsink->prealloc = 0;
+    upipe_fsink->prealloc_end = 0;
+    upipe_fsink->sync_period = 0;
+    upipe_fsink->sync_offset = 0;
+    upipe_fsink->sync_wait_offset = 0;
+    upipe_fsink->async = NULL;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -165,6 +240,154 @@ static void upipe_fsink_poll(struct upipe *upipe)
     }
 }
 
+/** @internal @This preallocates space in the file before writing, so that
+ * the file system keeps the file contiguous. The apparent size of the file
+ * is not changed.
+ *
+ * @param upipe description structure of the pipe
+ * @param size number of octets about to be written
+ */
+static void upipe_fsink_prealloc(struct upipe *upipe, size_t size)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    if (!upipe_fsink->prealloc ||
+        upipe_fsink->offset + size <= upipe_fsink->prealloc_end)
+        return;
+
+    if (upipe_fsink->prealloc_end < upipe_fsink->offset)
+        upipe_fsink->prealloc_end = upipe_fsink->offset;
+    uint64_t length = upipe_fsink->offset + size - upipe_fsink->prealloc_end;
+    length += upipe_fsink->prealloc - 1;
+    length -= length % upipe_fsink->prealloc;
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (unlikely(fallocate(upipe_fsink->fd, FALLOC_FL_KEEP_SIZE,
+                           upipe_fsink->prealloc_end, length) == -1)) {
+        upipe_warn_va(upipe, "can't preallocate %s (%m)", upipe_fsink->path);
+        upipe_fsink->prealloc = 0;
+        return;
+    }
+#endif
+    upipe_fsink->prealloc_end += length;
+}
+
+/** @internal @This accounts for written data, and syncs it to the disk at
+ * the configured cadence. Writeback of the last period is started, and
+ * the previous one is waited for and dropped from the page cache, so that
+ * the disk sees a steady flow of writes.
+ *
+ * @param upipe description structure of the pipe
+ * @param size number of octets that were written
+ */
+static void upipe_fsink_written(struct upipe *upipe, size_t size)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    upipe_fsink->offset += size;
+    if (!upipe_fsink->sync_period ||
+        upipe_fsink->offset - upipe_fsink->sync_offset <
+            upipe_fsink->sync_period)
+        return;
+
+    uint64_t wait_offset = upipe_fsink->sync_wait_offset;
+    uint64_t sync_offset = upipe_fsink->sync_offset;
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(upipe_fsink->fd, sync_offset,
+                    upipe_fsink->offset - sync_offset,
+                    SYNC_FILE_RANGE_WRITE);
+    if (sync_offset > wait_offset)
+        sync_file_range(upipe_fsink->fd, wait_offset,
+                        sync_offset - wait_offset,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+    fdatasync(upipe_fsink->fd);
+    sync_offset = upipe_fsink->offset;
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    if (sync_offset > wait_offset)
+        posix_fadvise(upipe_fsink->fd, wait_offset, sync_offset - wait_offset,
+                      POSIX_FADV_DONTNEED);
+#endif
+    upipe_fsink->sync_wait_offset = sync_offset;
+    upipe_fsink->sync_offset = upipe_fsink->offset;
+}
+
+/** @internal @This writes the staging buffer to the file opened with
+ * O_DIRECT. Only whole buffers may be written, except for the final write,
+ * which is done without O_DIRECT.
+ *
+ * @param upipe description structure of the pipe
+ * @param final true if the file is about to be closed
+ * @return false in case of write error
+ */
+static bool upipe_fsink_direct_flush(struct upipe *upipe, bool final)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    size_t level = upipe_fsink->direct_level;
+    if (!level)
+        return true;
+
+    if (final && level % DIRECT_ALIGN)
+        fcntl(upipe_fsink->fd, F_SETFL,
+              fcntl(upipe_fsink->fd, F_GETFL) & ~O_DIRECT);
+
+    upipe_fsink_prealloc(upipe, level);
+    size_t done = 0;
+    while (done < level) {
+        ssize_t ret = write(upipe_fsink->fd, upipe_fsink->direct_buffer + done,
+                            level - done);
+        if (unlikely(ret == -1)) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        /* a short write would leave an unaligned offset */
+        if (unlikely(!final && ret % DIRECT_ALIGN)) {
+            errno = EIO;
+            return false;
+        }
+        done += ret;
+        upipe_fsink_written(upipe, ret);
+    }
+    upipe_fsink->direct_level = 0;
+    return true;
+}
+
+/** @internal @This copies data to the staging buffer, and writes it when
+ * it is full.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @return false in case of write error
+ */
+static bool upipe_fsink_direct_output(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    size_t uref_size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &uref_size)))) {
+        upipe_warn(upipe, "cannot read ubuf buffer");
+        return true;
+    }
+
+    size_t offset = 0;
+    while (offset < uref_size) {
+        size_t size = upipe_fsink->direct_size - upipe_fsink->direct_level;
+        if (size > uref_size - offset)
+            size = uref_size - offset;
+        if (unlikely(!ubase_check(uref_block_extract(uref, offset, size,
+                upipe_fsink->direct_buffer + upipe_fsink->direct_level)))) {
+            upipe_warn(upipe, "cannot read ubuf buffer");
+            return true;
+        }
+        upipe_fsink->direct_level += size;
+        offset += size;
+
+        if (upipe_fsink->direct_level == upipe_fsink->direct_size &&
+            unlikely(!upipe_fsink_direct_flush(upipe, false)))
+            return false;
+    }
+    return true;
+}
+
 /** @internal @This outputs data to the file sink.
  *
  * @param upipe description structure of the pipe
@@ -209,6 +432,17 @@ static bool upipe_fsink_output(struct upipe *upipe, struct uref *uref,
     }
 
 write_buffer:
+    if (upipe_fsink->direct_buffer != NULL) {
+        bool ret = upipe_fsink_direct_output(upipe, uref);
+        uref_free(uref);
+        if (unlikely(!ret)) {
+            upipe_warn_va(upipe, "write error to %s (%m)", upipe_fsink->path);
+            upipe_fsink_set_upump(upipe, NULL);
+            upipe_throw_sink_end(upipe);
+        }
+        return true;
+    }
+
     for ( ; ; ) {
         int iovec_count = uref_block_iovec_count(uref, 0, -1);
         if (unlikely(iovec_count == -1)) {
@@ -229,6 +463,11 @@ write_buffer:
             break;
         }
 
+        size_t uref_size;
+        if (upipe_fsink->prealloc &&
+            ubase_check(uref_block_size(uref, &uref_size)))
+            upipe_fsink_prealloc(upipe, uref_size);
+
         ssize_t ret = writev(upipe_fsink->fd, iovecs, iovec_count);
         uref_block_iovec_unmap(uref, 0, -1, iovecs);
 
@@ -258,7 +497,7 @@ write_buffer:
             return true;
         }
 
-        size_t uref_size;
+        upipe_fsink_written(upipe, ret);
         if (ubase_check(uref_block_size(uref, &uref_size)) &&
             uref_size == ret) {
             uref_free(uref);
@@ -339,6 +578,175 @@ static int _upipe_fsink_get_path(struct upipe *upipe, const char **path_p)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This translates a file opening mode to open() flags.
+ *
+ * @param mode mode of opening the file
+ * @param flags_p filled in with the flags
+ * @param mode_desc_p filled in with a description of the mode
+ * @return false if the mode is invalid
+ */
+static bool upipe_fsink_mode_flags(enum upipe_fsink_mode mode, int *flags_p,
+                                   const char **mode_desc_p)
+{
+    switch (mode) {
+        case UPIPE_FSINK_NONE:
+            *mode_desc_p = "none";
+            *flags_p = 0;
+            return true;
+        case UPIPE_FSINK_APPEND:
+            *mode_desc_p = "append";
+            *flags_p = O_CREAT;
+            return true;
+        case UPIPE_FSINK_OVERWRITE:
+            *mode_desc_p = "overwrite";
+            *flags_p = O_CREAT | O_TRUNC;
+            return true;
+        case UPIPE_FSINK_CREATE:
+            *mode_desc_p = "create";
+            *flags_p = O_CREAT | O_EXCL;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** @internal @This opens a file for writing. It may be called from the
+ * helper thread, so it doesn't log anything.
+ *
+ * @param path relative or absolute path of the file
+ * @param flags open() flags given by @ref upipe_fsink_mode_flags
+ * @param mode mode of opening the file
+ * @param direct_size size of the O_DIRECT staging buffer, or 0
+ * @return file descriptor, or -1 with errno set
+ */
+static int upipe_fsink_open(const char *path, int flags,
+                            enum upipe_fsink_mode mode,
+                            unsigned int direct_size)
+{
+    int fd = -1;
+#ifdef O_DIRECT
+    if (direct_size)
+        fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC | O_DIRECT | flags,
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1)
+#endif
+    fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC | flags,
+              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (unlikely(fd == -1))
+        return -1;
+
+    /* O_APPEND seeks on each write, so use this instead */
+    if (mode == UPIPE_FSINK_APPEND &&
+        unlikely(lseek(fd, 0, SEEK_END) == -1)) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+/** @internal @This is the main function of the helper thread, which opens
+ * prepared files and closes released ones out of the pipeline thread.
+ *
+ * @param _async pointer to the helper thread context
+ * @return NULL
+ */
+static void *upipe_fsink_async_thread(void *_async)
+{
+    struct upipe_fsink_async *async = (struct upipe_fsink_async *)_async;
+    pthread_mutex_lock(&async->mutex);
+    for ( ; ; ) {
+        bool open_file = async->path != NULL && !async->done;
+        if (!open_file && !async->nb_close) {
+            if (async->exit)
+                break;
+            pthread_cond_wait(&async->cond, &async->mutex);
+            continue;
+        }
+
+        int close_fds[UPIPE_FSINK_ASYNC_CLOSE];
+        unsigned int nb_close = async->nb_close;
+        memcpy(close_fds, async->close_fds, nb_close * sizeof(int));
+        async->nb_close = 0;
+        /* the path is not freed while the file is not opened */
+        const char *path = async->path;
+        int flags = async->flags;
+        enum upipe_fsink_mode mode = async->mode;
+        unsigned int direct_size = async->direct_size;
+        pthread_mutex_unlock(&async->mutex);
+
+        for (unsigned int i = 0; i < nb_close; i++)
+            close(close_fds[i]);
+        int fd = -1, error = 0;
+        if (open_file) {
+            fd = upipe_fsink_open(path, flags, mode, direct_size);
+            error = errno;
+        }
+
+        pthread_mutex_lock(&async->mutex);
+        if (open_file) {
+            async->fd = fd;
+            async->error = error;
+            async->done = true;
+            pthread_cond_broadcast(&async->cond);
+        }
+    }
+
+    /* the prepared file was not used */
+    if (async->path != NULL && async->fd != -1)
+        close(async->fd);
+    free(async->path);
+    async->path = NULL;
+    pthread_mutex_unlock(&async->mutex);
+    return NULL;
+}
+
+/** @internal @This closes a file descriptor, on the helper thread if there
+ * is one.
+ *
+ * @param upipe description structure of the pipe
+ * @param fd file descriptor to close
+ */
+static void upipe_fsink_close_fd(struct upipe *upipe, int fd)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    struct upipe_fsink_async *async = upipe_fsink->async;
+    if (async != NULL) {
+        pthread_mutex_lock(&async->mutex);
+        bool queued = async->nb_close < UPIPE_FSINK_ASYNC_CLOSE;
+        if (queued) {
+            async->close_fds[async->nb_close++] = fd;
+            pthread_cond_broadcast(&async->cond);
+        }
+        pthread_mutex_unlock(&async->mutex);
+        if (likely(queued))
+            return;
+    }
+    close(fd);
+}
+
+/** @internal @This closes the currently opened file, if any, after writing
+ * the remaining contents of the staging buffer.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_fsink_close(struct upipe *upipe)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    if (likely(upipe_fsink->fd != -1)) {
+        if (unlikely(!upipe_fsink_direct_flush(upipe, true)))
+            upipe_warn_va(upipe, "write error to %s (%m)", upipe_fsink->path);
+        if (likely(upipe_fsink->path != NULL))
+            upipe_notice_va(upipe, "closing file %s", upipe_fsink->path);
+        upipe_fsink_close_fd(upipe, upipe_fsink->fd);
+        upipe_fsink->fd = -1;
+    }
+    free(upipe_fsink->direct_buffer);
+    upipe_fsink->direct_buffer = NULL;
+    upipe_fsink->direct_level = 0;
+}
+
 /** @internal @This asks to open the given file.
  *
  * @param upipe description structure of the pipe
@@ -351,11 +759,7 @@ static int _upipe_fsink_set_path(struct upipe *upipe, const char *path,
 {
     struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
 
-    if (unlikely(upipe_fsink->fd != -1)) {
-        if (likely(upipe_fsink->path != NULL))
-            upipe_notice_va(upipe, "closing file %s", upipe_fsink->path);
-        close(upipe_fsink->fd);
-    }
+    upipe_fsink_close(upipe);
     free(upipe_fsink->path);
     upipe_fsink->path = NULL;
     upipe_fsink_set_upump(upipe, NULL);
@@ -368,60 +772,262 @@ static int _upipe_fsink_set_path(struct upipe *upipe, const char *path,
 
     upipe_fsink_check_upump_mgr(upipe);
 
-    const char *mode_desc = NULL; /* hush gcc */
+    const char *mode_desc;
     int flags;
-    switch (mode) {
-        case UPIPE_FSINK_NONE:
-            flags = 0;
-            break;
-        case UPIPE_FSINK_APPEND:
-            mode_desc = "append";
-            flags = O_CREAT;
-            break;
-        case UPIPE_FSINK_OVERWRITE:
-            mode_desc = "overwrite";
-            flags = O_CREAT | O_TRUNC;
-            break;
-        case UPIPE_FSINK_CREATE:
-            mode_desc = "create";
-            flags = O_CREAT | O_EXCL;
-            break;
-        default:
-            upipe_err_va(upipe, "invalid mode %d", mode);
-            return UBASE_ERR_INVALID;
+    if (unlikely(!upipe_fsink_mode_flags(mode, &flags, &mode_desc))) {
+        upipe_err_va(upipe, "invalid mode %d", mode);
+        return UBASE_ERR_INVALID;
     }
-    upipe_fsink->fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC | flags,
-                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    /* use the file opened ahead by the helper thread, if any */
+    bool prepared = false;
+    struct upipe_fsink_async *async = upipe_fsink->async;
+    if (async != NULL) {
+        pthread_mutex_lock(&async->mutex);
+        if (async->path != NULL && async->flags == flags &&
+            async->direct_size == upipe_fsink->direct_size &&
+            !strcmp(async->path, path)) {
+            while (!async->done)
+                pthread_cond_wait(&async->cond, &async->mutex);
+            upipe_fsink->fd = async->fd;
+            errno = async->error;
+            free(async->path);
+            async->path = NULL;
+            prepared = true;
+        }
+        pthread_mutex_unlock(&async->mutex);
+    }
+    if (!prepared)
+        upipe_fsink->fd = upipe_fsink_open(path, flags, mode,
+                                           upipe_fsink->direct_size);
     if (unlikely(upipe_fsink->fd == -1)) {
-        upipe_err_va(upipe, "can't open file %s (%s)", path, mode_desc);
+        upipe_err_va(upipe, "can't open file %s (%s) (%m)", path, mode_desc);
         return UBASE_ERR_EXTERNAL;
     }
-    switch (mode) {
-        /* O_APPEND seeks on each write, so use this instead */
-        case UPIPE_FSINK_APPEND:
-            if (unlikely(lseek(upipe_fsink->fd, 0, SEEK_END) == -1)) {
-                upipe_err_va(upipe, "can't append to file %s (%s)", path, mode_desc);
-                close(upipe_fsink->fd);
-                upipe_fsink->fd = -1;
-                return UBASE_ERR_EXTERNAL;
-            }
-            break;
-        default:
-            break;
+#ifdef O_DIRECT
+    if (upipe_fsink->direct_size &&
+        !(fcntl(upipe_fsink->fd, F_GETFL) & O_DIRECT))
+        upipe_warn_va(upipe, "can't open file %s with O_DIRECT", path);
+#endif
+
+    off_t offset = lseek(upipe_fsink->fd, 0, SEEK_CUR);
+    upipe_fsink->offset = offset != (off_t)-1 ? offset : 0;
+    upipe_fsink->prealloc_end = upipe_fsink->offset;
+    upipe_fsink->sync_offset = upipe_fsink->offset;
+    upipe_fsink->sync_wait_offset = upipe_fsink->offset;
+
+#ifdef O_DIRECT
+    if (fcntl(upipe_fsink->fd, F_GETFL) & O_DIRECT) {
+        if (unlikely(upipe_fsink->offset % DIRECT_ALIGN)) {
+            upipe_warn_va(upipe, "unaligned end of file %s, not using O_DIRECT",
+                          path);
+            fcntl(upipe_fsink->fd, F_SETFL,
+                  fcntl(upipe_fsink->fd, F_GETFL) & ~O_DIRECT);
+        } else if (unlikely(posix_memalign(
+                    (void **)&upipe_fsink->direct_buffer, DIRECT_ALIGN,
+                    upipe_fsink->direct_size) != 0)) {
+            upipe_fsink->direct_buffer = NULL;
+            close(upipe_fsink->fd);
+            upipe_fsink->fd = -1;
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
     }
+#endif
 
     upipe_fsink->path = strdup(path);
     if (unlikely(upipe_fsink->path == NULL)) {
-        close(upipe_fsink->fd);
-        upipe_fsink->fd = -1;
+        upipe_fsink_close(upipe);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return UBASE_ERR_ALLOC;
     }
     if (!upipe_fsink_check_input(upipe))
         /* Use again the pipe that we previously released. */
         upipe_use(upipe);
-    upipe_notice_va(upipe, "opening file %s in %s mode",
-                    upipe_fsink->path, mode_desc);
+    upipe_notice_va(upipe, "opening file %s in %s mode%s",
+                    upipe_fsink->path, mode_desc,
+                    upipe_fsink->direct_buffer != NULL ? " (direct)" : "");
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This asks the helper thread to open the given file ahead of
+ * the call to @ref _upipe_fsink_set_path with the same arguments. The helper
+ * thread is started on the first call.
+ *
+ * @param upipe description structure of the pipe
+ * @param path relative or absolute path of the file
+ * @param mode mode of opening the file
+ * @return an error code
+ */
+static int _upipe_fsink_prepare_path(struct upipe *upipe, const char *path,
+                                     enum upipe_fsink_mode mode)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    const char *mode_desc;
+    int flags;
+    if (unlikely(path == NULL || !upipe_fsink_mode_flags(mode, &flags,
+                                                         &mode_desc)))
+        return UBASE_ERR_INVALID;
+
+    struct upipe_fsink_async *async = upipe_fsink->async;
+    if (async == NULL) {
+        async = malloc(sizeof(struct upipe_fsink_async));
+        UBASE_ALLOC_RETURN(async)
+        async->path = NULL;
+        async->nb_close = 0;
+        async->exit = false;
+        pthread_mutex_init(&async->mutex, NULL);
+        pthread_cond_init(&async->cond, NULL);
+        if (unlikely(pthread_create(&async->thread, NULL,
+                                    upipe_fsink_async_thread, async) != 0)) {
+            pthread_cond_destroy(&async->cond);
+            pthread_mutex_destroy(&async->mutex);
+            free(async);
+            upipe_err(upipe, "can't create helper thread");
+            return UBASE_ERR_EXTERNAL;
+        }
+        upipe_fsink->async = async;
+    }
+
+    char *path_dup = strdup(path);
+    UBASE_ALLOC_RETURN(path_dup)
+    pthread_mutex_lock(&async->mutex);
+    if (async->path != NULL) {
+        /* drop the previous file, once it is opened */
+        while (!async->done)
+            pthread_cond_wait(&async->cond, &async->mutex);
+        if (async->fd != -1 && async->nb_close < UPIPE_FSINK_ASYNC_CLOSE)
+            async->close_fds[async->nb_close++] = async->fd;
+        else if (async->fd != -1)
+            close(async->fd);
+        free(async->path);
+    }
+    async->path = path_dup;
+    async->flags = flags;
+    async->mode = mode;
+    async->direct_size = upipe_fsink->direct_size;
+    async->fd = -1;
+    async->error = 0;
+    async->done = false;
+    pthread_cond_broadcast(&async->cond);
+    pthread_mutex_unlock(&async->mutex);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This stops the helper thread, after it has closed all
+ * released files.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_fsink_clean_async(struct upipe *upipe)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    struct upipe_fsink_async *async = upipe_fsink->async;
+    if (async == NULL)
+        return;
+
+    pthread_mutex_lock(&async->mutex);
+    async->exit = true;
+    pthread_cond_broadcast(&async->cond);
+    pthread_mutex_unlock(&async->mutex);
+    pthread_join(async->thread, NULL);
+    pthread_cond_destroy(&async->cond);
+    pthread_mutex_destroy(&async->mutex);
+    free(async);
+    upipe_fsink->async = NULL;
+}
+
+/** @internal @This returns the size of the O_DIRECT staging buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the buffer, or 0
+ * @return an error code
+ */
+static int _upipe_fsink_get_direct(struct upipe *upipe, unsigned int *size_p)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    assert(size_p != NULL);
+    *size_p = upipe_fsink->direct_size;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the O_DIRECT staging buffer. It is
+ * rounded up to the alignment, and takes effect at the next opening.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the buffer, or 0 to disable O_DIRECT
+ * @return an error code
+ */
+static int _upipe_fsink_set_direct(struct upipe *upipe, unsigned int size)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+#ifndef O_DIRECT
+    if (size)
+        return UBASE_ERR_UNHANDLED;
+#endif
+    if (unlikely(size > UINT_MAX - DIRECT_ALIGN))
+        return UBASE_ERR_INVALID;
+    upipe_fsink->direct_size = (size + DIRECT_ALIGN - 1) / DIRECT_ALIGN *
+                               DIRECT_ALIGN;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the size of the chunks of preallocated space.
+ *
+ * @param upipe description structure of the pipe
+ * @param prealloc_p filled in with the size of the chunks, or 0
+ * @return an error code
+ */
+static int _upipe_fsink_get_prealloc(struct upipe *upipe,
+                                     uint64_t *prealloc_p)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    assert(prealloc_p != NULL);
+    *prealloc_p = upipe_fsink->prealloc;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the chunks of preallocated space.
+ *
+ * @param upipe description structure of the pipe
+ * @param prealloc size of the chunks, or 0 to disable preallocation
+ * @return an error code
+ */
+static int _upipe_fsink_set_prealloc(struct upipe *upipe, uint64_t prealloc)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+#ifndef FALLOC_FL_KEEP_SIZE
+    if (prealloc)
+        return UBASE_ERR_UNHANDLED;
+#endif
+    upipe_fsink->prealloc = prealloc;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the number of octets between two syncs.
+ *
+ * @param upipe description structure of the pipe
+ * @param period_p filled in with the number of octets, or 0
+ * @return an error code
+ */
+static int _upipe_fsink_get_sync(struct upipe *upipe, uint64_t *period_p)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    assert(period_p != NULL);
+    *period_p = upipe_fsink->sync_period;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of octets between two syncs.
+ *
+ * @param upipe description structure of the pipe
+ * @param period number of octets, or 0 to let the kernel write back data
+ * @return an error code
+ */
+static int _upipe_fsink_set_sync(struct upipe *upipe, uint64_t period)
+{
+    struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
+    upipe_fsink->sync_period = period;
     return UBASE_ERR_NONE;
 }
 
@@ -490,6 +1096,42 @@ static int  _upipe_fsink_control(struct upipe *upipe, int command, va_list args)
             enum upipe_fsink_mode mode = va_arg(args, enum upipe_fsink_mode);
             return _upipe_fsink_set_path(upipe, path, mode);
         }
+        case UPIPE_FSINK_PREPARE_PATH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSINK_SIGNATURE)
+            const char *path = va_arg(args, const char *);
+            enum upipe_fsink_mode mode = va_arg(args, enum upipe_fsink_mode);
+            return _upipe_fsink_prepare_path(upipe, path, mode);
+        }
+        case UPIPE_FSINK_GET_DIRECT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSINK_SIGNATURE)
+            unsigned int *size_p = va_arg(args, unsigned int *);
+            return _upipe_fsink_get_direct(upipe, size_p);
+        }
+        case UPIPE_FSINK_SET_DIRECT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSINK_SIGNATURE)
+            unsigned int size = va_arg(args, unsigned int);
+            return _upipe_fsink_set_direct(upipe, size);
+        }
+        case UPIPE_FSINK_GET_PREALLOC: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSINK_SIGNATURE)
+            uint64_t *prealloc_p = va_arg(args, uint64_t *);
+            return _upipe_fsink_get_prealloc(upipe, prealloc_p);
+        }
+        case UPIPE_FSINK_SET_PREALLOC: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSINK_SIGNATURE)
+            uint64_t prealloc = va_arg(args, uint64_t);
+            return _upipe_fsink_set_prealloc(upipe, prealloc);
+        }
+        case UPIPE_FSINK_GET_SYNC: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSINK_SIGNATURE)
+            uint64_t *period_p = va_arg(args, uint64_t *);
+            return _upipe_fsink_get_sync(upipe, period_p);
+        }
+        case UPIPE_FSINK_SET_SYNC: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSINK_SIGNATURE)
+            uint64_t period = va_arg(args, uint64_t);
+            return _upipe_fsink_set_sync(upipe, period);
+        }
         case UPIPE_FLUSH:
             return upipe_fsink_flush(upipe);
         default:
@@ -522,11 +1164,8 @@ static int upipe_fsink_control(struct upipe *upipe, int command, va_list args)
 static void upipe_fsink_free(struct upipe *upipe)
 {
     struct upipe_fsink *upipe_fsink = upipe_fsink_from_upipe(upipe);
-    if (likely(upipe_fsink->fd != -1)) {
-        if (likely(upipe_fsink->path != NULL))
-            upipe_notice_va(upipe, "closing file %s", upipe_fsink->path);
-        close(upipe_fsink->fd);
-    }
+    upipe_fsink_close(upipe);
+    upipe_fsink_clean_async(upipe);
     upipe_throw_dead(upipe);
 
     free(upipe_fsink->path);
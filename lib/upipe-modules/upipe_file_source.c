@@ -27,6 +27,8 @@
  * @short Upipe source module for files
  */
 
+#define _GNU_SOURCE
+
 #include <upipe/ubase.h>
 #include <upipe/uprobe.h>
 #include <upipe/urequest.h>
@@ -37,6 +39,8 @@
 #include <upipe/uref_clock.h>
 #include <upipe/upump.h>
 #include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mmap.h>
+#include <upipe/ueventfd.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -55,6 +59,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -62,6 +67,7 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #ifndef O_CLOEXEC
 #   define O_CLOEXEC 0
@@ -69,6 +75,78 @@
 
 /** default size of buffers when unspecified */
 #define UBUF_DEFAULT_SIZE       32768
+/** depth of the pools of the mmap ubuf manager */
+#define UBUF_MMAP_POOL_DEPTH    32
+/** size of a TS packet, chunks read ahead are a multiple of it */
+#define TS_SIZE                 188
+/** alignment of buffers, sizes and offsets in O_DIRECT mode */
+#define DIRECT_ALIGN            4096
+/** least common multiple of TS_SIZE and DIRECT_ALIGN */
+#define DIRECT_TS_ALIGN         (TS_SIZE * DIRECT_ALIGN / 4)
+
+/** @internal @This is the state of a chunk read ahead. */
+enum upipe_fsrc_chunk_state {
+    /** the chunk is unused */
+    UPIPE_FSRC_CHUNK_FREE,
+    /** the chunk is waiting to be read by the helper thread */
+    UPIPE_FSRC_CHUNK_QUEUED,
+    /** the chunk has been read and may be output */
+    UPIPE_FSRC_CHUNK_DONE
+};
+
+/** @internal @This is a chunk of the file read ahead by the helper thread. */
+struct upipe_fsrc_chunk {
+    /** state of the chunk */
+    enum upipe_fsrc_chunk_state state;
+    /** buffer holding the chunk, allocated by the pipeline thread */
+    struct ubuf *ubuf;
+    /** offset of the (aligned) data in the buffer */
+    size_t head;
+    /** mapped data of the buffer, at offset head */
+    uint8_t *buffer;
+    /** offset of the chunk in the file */
+    uint64_t offset;
+    /** number of octets to read */
+    size_t size;
+    /** number of octets read, or -1 in case of error */
+    ssize_t ret;
+    /** errno of the reading */
+    int error;
+};
+
+/** @internal @This is the context of the thread reading the file ahead of
+ * the pipeline. */
+struct upipe_fsrc_ahead {
+    /** helper thread */
+    pthread_t thread;
+    /** file descriptor used by the helper thread */
+    int fd;
+    /** true if the file descriptor was switched to O_DIRECT */
+    bool direct;
+    /** size of the chunks, in octets */
+    size_t chunk_size;
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** condition signalled on new chunks and on exit */
+    pthread_cond_t cond;
+    /** ring of chunks */
+    struct upipe_fsrc_chunk *chunks;
+    /** number of chunks in the ring */
+    unsigned int depth;
+    /** next chunk to read, for the helper thread */
+    unsigned int read_idx;
+    /** set to true to ask the thread to exit */
+    bool exit;
+    /** event triggered when chunks have been read */
+    struct ueventfd event;
+
+    /** next chunk to output, for the pipeline thread */
+    unsigned int output_idx;
+    /** next chunk to queue, for the pipeline thread */
+    unsigned int queue_idx;
+    /** offset in the file of the next chunk to queue */
+    uint64_t queue_offset;
+};
 
 /** @hidden */
 static int upipe_fsrc_check(struct upipe *upipe, struct uref *flow_format);
@@ -118,6 +196,28 @@ struct upipe_fsrc {
     /** file path */
     char *path;
 
+    /** size of the mapped windows, or 0 to read() the file */
+    uint64_t mmap_window;
+    /** ubuf manager mapping the file */
+    struct ubuf_mgr *mmap_mgr;
+    /** currently mapped window */
+    struct ubuf *mmap_ubuf;
+    /** offset of the mapped window in the file */
+    uint64_t mmap_start;
+    /** reading position in the file, in mmap mode */
+    uint64_t mmap_position;
+
+    /** size of the chunks read ahead, or 0 to read() the file */
+    uint64_t ahead_size;
+    /** number of chunks read ahead */
+    unsigned int ahead_depth;
+    /** true if the chunks are read with O_DIRECT */
+    bool direct;
+    /** helper thread context, or NULL */
+    struct upipe_fsrc_ahead *ahead;
+    /** reading position in the file, in read-ahead mode */
+    uint64_t ahead_position;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -166,6 +266,16 @@ static struct upipe *upipe_fsrc_alloc(struct upipe_mgr *mgr,
     upipe_fsrc_init_read_size(upipe, UBUF_DEFAULT_SIZE);
     upipe_fsrc->fd = -1;
     upipe_fsrc->path = NULL;
+    upipe_fsrc->mmap_window = 0;
+    upipe_fsrc->mmap_mgr = NULL;
+    upipe_fsrc->mmap_ubuf = NULL;
+    upipe_fsrc->mmap_start = 0;
+    upipe_fsrc->mmap_position = 0;
+    upipe_fsrc->ahead_size = 0;
+    upipe_fsrc->ahead_depth = 0;
+    upipe_fsrc->direct = false;
+    upipe_fsrc->ahead = NULL;
+    upipe_fsrc->ahead_position = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -242,6 +352,410 @@ static void upipe_fsrc_worker(struct upump *upump)
     upipe_release(upipe);
 }
 
+/** @internal @This checks if the file is read through mapped windows.
+ *
+ * @param upipe description structure of the pipe
+ * @return true in mmap mode
+ */
+static inline bool upipe_fsrc_mmap_mode(struct upipe *upipe)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    return upipe_fsrc->mmap_window && upipe_fsrc->regular_file;
+}
+
+/** @internal @This releases the currently mapped window.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_fsrc_mmap_flush(struct upipe *upipe)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    if (upipe_fsrc->mmap_ubuf != NULL) {
+        ubuf_free(upipe_fsrc->mmap_ubuf);
+        upipe_fsrc->mmap_ubuf = NULL;
+    }
+}
+
+/** @internal @This outputs data from a window of the file mapped in memory,
+ * without copying it. The window is unmapped when all buffers pointing to
+ * it are released.
+ *
+ * @param upump description structure of the read watcher
+ */
+static void upipe_fsrc_worker_mmap(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    uint64_t systime = 0; /* to keep gcc quiet */
+    if (upipe_fsrc->uclock != NULL)
+        systime = uclock_now(upipe_fsrc->uclock);
+
+    size_t window_size = 0;
+    if (upipe_fsrc->mmap_ubuf != NULL)
+        ubuf_block_size(upipe_fsrc->mmap_ubuf, &window_size);
+    if (upipe_fsrc->mmap_ubuf == NULL ||
+        upipe_fsrc->mmap_position >= upipe_fsrc->mmap_start + window_size) {
+        upipe_fsrc_mmap_flush(upipe);
+
+        struct stat st;
+        if (unlikely(fstat(upipe_fsrc->fd, &st) == -1)) {
+            upipe_err_va(upipe, "can't stat file %s (%m)", upipe_fsrc->path);
+            upipe_fsrc_set_upump(upipe, NULL);
+            upipe_throw_source_end(upipe);
+            return;
+        }
+        if (unlikely(upipe_fsrc->mmap_position >= st.st_size)) {
+            upipe_notice_va(upipe, "end of file %s", upipe_fsrc->path);
+            upipe_fsrc_set_upump(upipe, NULL);
+            upipe_throw_source_end(upipe);
+            return;
+        }
+
+        window_size = upipe_fsrc->mmap_window;
+        if (window_size > st.st_size - upipe_fsrc->mmap_position)
+            window_size = st.st_size - upipe_fsrc->mmap_position;
+        upipe_fsrc->mmap_ubuf = ubuf_block_mmap_alloc(upipe_fsrc->mmap_mgr,
+                upipe_fsrc->fd, upipe_fsrc->mmap_position, window_size);
+        if (unlikely(upipe_fsrc->mmap_ubuf == NULL)) {
+            upipe_err_va(upipe, "can't map file %s (%m)", upipe_fsrc->path);
+            upipe_fsrc_set_upump(upipe, NULL);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        upipe_fsrc->mmap_start = upipe_fsrc->mmap_position;
+    }
+
+    size_t offset = upipe_fsrc->mmap_position - upipe_fsrc->mmap_start;
+    size_t size = window_size - offset;
+    if (size > upipe_fsrc->read_size)
+        size = upipe_fsrc->read_size;
+
+    struct uref *uref = uref_alloc(upipe_fsrc->uref_mgr);
+    struct ubuf *ubuf = ubuf_block_splice(upipe_fsrc->mmap_ubuf, offset, size);
+    if (unlikely(uref == NULL || ubuf == NULL)) {
+        if (uref != NULL)
+            uref_free(uref);
+        if (ubuf != NULL)
+            ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uref_attach_ubuf(uref, ubuf);
+    upipe_fsrc->mmap_position += size;
+
+    if (upipe_fsrc->uclock != NULL)
+        uref_clock_set_cr_sys(uref, systime);
+    upipe_use(upipe);
+    upipe_fsrc_output(upipe, uref, &upipe_fsrc->upump);
+    upipe_release(upipe);
+}
+
+/** @internal @This checks if the file is read by chunks on a helper thread.
+ *
+ * @param upipe description structure of the pipe
+ * @return true in read-ahead mode
+ */
+static inline bool upipe_fsrc_ahead_mode(struct upipe *upipe)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    return upipe_fsrc->ahead_size && upipe_fsrc->regular_file &&
+           !upipe_fsrc_mmap_mode(upipe);
+}
+
+/** @internal @This is the main function of the helper thread. It reads the
+ * queued chunks in the order of the ring, and sleeps when there is none.
+ *
+ * @param _ahead pointer to the helper thread context
+ * @return NULL
+ */
+static void *upipe_fsrc_ahead_thread(void *_ahead)
+{
+    struct upipe_fsrc_ahead *ahead = (struct upipe_fsrc_ahead *)_ahead;
+    pthread_mutex_lock(&ahead->mutex);
+    for ( ; ; ) {
+        if (ahead->exit)
+            break;
+        struct upipe_fsrc_chunk *chunk = &ahead->chunks[ahead->read_idx];
+        if (chunk->state != UPIPE_FSRC_CHUNK_QUEUED) {
+            pthread_cond_wait(&ahead->cond, &ahead->mutex);
+            continue;
+        }
+        /* a queued chunk is not touched by the pipeline thread */
+        pthread_mutex_unlock(&ahead->mutex);
+
+#ifdef POSIX_FADV_WILLNEED
+        if (!ahead->direct)
+            posix_fadvise(ahead->fd, chunk->offset + chunk->size, chunk->size,
+                          POSIX_FADV_WILLNEED);
+#endif
+        ssize_t ret;
+        do
+            ret = pread(ahead->fd, chunk->buffer, chunk->size, chunk->offset);
+        while (ret == -1 && errno == EINTR);
+        int error = errno;
+
+        pthread_mutex_lock(&ahead->mutex);
+        chunk->ret = ret;
+        chunk->error = error;
+        chunk->state = UPIPE_FSRC_CHUNK_DONE;
+        ahead->read_idx = (ahead->read_idx + 1) % ahead->depth;
+        ueventfd_write(&ahead->event);
+    }
+    pthread_mutex_unlock(&ahead->mutex);
+    return NULL;
+}
+
+/** @internal @This allocates buffers for the free chunks of the ring, and
+ * queues them to the helper thread.
+ *
+ * @param upipe description structure of the pipe
+ * @return false in case of allocation error
+ */
+static bool upipe_fsrc_ahead_queue(struct upipe *upipe)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    struct upipe_fsrc_ahead *ahead = upipe_fsrc->ahead;
+    bool ret = true;
+
+    pthread_mutex_lock(&ahead->mutex);
+    for ( ; ; ) {
+        struct upipe_fsrc_chunk *chunk = &ahead->chunks[ahead->queue_idx];
+        if (chunk->state != UPIPE_FSRC_CHUNK_FREE)
+            break;
+
+        struct ubuf *ubuf = ubuf_block_alloc(upipe_fsrc->ubuf_mgr,
+                ahead->chunk_size + (ahead->direct ? DIRECT_ALIGN : 0));
+        uint8_t *buffer;
+        int size = -1;
+        if (unlikely(ubuf == NULL ||
+                     !ubase_check(ubuf_block_write(ubuf, 0, &size,
+                                                   &buffer)))) {
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            ret = false;
+            break;
+        }
+
+        chunk->ubuf = ubuf;
+        chunk->head = ahead->direct ?
+            (-(uintptr_t)buffer) & (DIRECT_ALIGN - 1) : 0;
+        chunk->buffer = buffer + chunk->head;
+        chunk->offset = ahead->queue_offset;
+        chunk->size = ahead->chunk_size;
+        chunk->state = UPIPE_FSRC_CHUNK_QUEUED;
+        ahead->queue_offset += ahead->chunk_size;
+        ahead->queue_idx = (ahead->queue_idx + 1) % ahead->depth;
+    }
+    pthread_cond_signal(&ahead->cond);
+    pthread_mutex_unlock(&ahead->mutex);
+    return ret;
+}
+
+/** @internal @This outputs data from the chunks read by the helper thread,
+ * without copying it. It is called when the event of the helper thread
+ * triggers, and keeps the event readable as long as a chunk is available.
+ *
+ * @param upump description structure of the event watcher
+ */
+static void upipe_fsrc_worker_ahead(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    struct upipe_fsrc_ahead *ahead = upipe_fsrc->ahead;
+    uint64_t systime = 0; /* to keep gcc quiet */
+    if (upipe_fsrc->uclock != NULL)
+        systime = uclock_now(upipe_fsrc->uclock);
+
+    struct upipe_fsrc_chunk *chunk = &ahead->chunks[ahead->output_idx];
+    pthread_mutex_lock(&ahead->mutex);
+    bool done = chunk->state == UPIPE_FSRC_CHUNK_DONE;
+    if (!done)
+        ueventfd_read(&ahead->event);
+    pthread_mutex_unlock(&ahead->mutex);
+    if (!done)
+        return;
+
+    /* a chunk which has been read is not touched by the helper thread */
+    if (chunk->buffer != NULL) {
+        ubuf_block_unmap(chunk->ubuf, 0);
+        chunk->buffer = NULL;
+    }
+    if (unlikely(chunk->ret == -1)) {
+        errno = chunk->error;
+        upipe_err_va(upipe, "read error from %s (%m)", upipe_fsrc->path);
+        upipe_fsrc_set_upump(upipe, NULL);
+        upipe_throw_source_end(upipe);
+        return;
+    }
+
+    uint64_t end = chunk->offset + chunk->ret;
+    struct uref *uref = NULL;
+    if (upipe_fsrc->ahead_position < end) {
+        size_t offset = chunk->head +
+                        (upipe_fsrc->ahead_position - chunk->offset);
+        size_t size = end - upipe_fsrc->ahead_position;
+        if (size > upipe_fsrc->read_size)
+            size = upipe_fsrc->read_size;
+
+        uref = uref_alloc(upipe_fsrc->uref_mgr);
+        struct ubuf *ubuf = ubuf_block_splice(chunk->ubuf, offset, size);
+        if (unlikely(uref == NULL || ubuf == NULL)) {
+            if (uref != NULL)
+                uref_free(uref);
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_attach_ubuf(uref, ubuf);
+        upipe_fsrc->ahead_position += size;
+    }
+
+    if (upipe_fsrc->ahead_position >= end) {
+        if ((size_t)chunk->ret < chunk->size) {
+            /* keep the last chunk to report the end of file */
+            if (uref == NULL) {
+                upipe_notice_va(upipe, "end of file %s", upipe_fsrc->path);
+                upipe_fsrc_set_upump(upipe, NULL);
+                upipe_throw_source_end(upipe);
+                return;
+            }
+        } else {
+            ubuf_free(chunk->ubuf);
+            chunk->ubuf = NULL;
+            pthread_mutex_lock(&ahead->mutex);
+            chunk->state = UPIPE_FSRC_CHUNK_FREE;
+            ahead->output_idx = (ahead->output_idx + 1) % ahead->depth;
+            pthread_mutex_unlock(&ahead->mutex);
+            if (unlikely(!upipe_fsrc_ahead_queue(upipe))) {
+                if (uref != NULL)
+                    uref_free(uref);
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&ahead->mutex);
+    if (ahead->chunks[ahead->output_idx].state != UPIPE_FSRC_CHUNK_DONE)
+        ueventfd_read(&ahead->event);
+    pthread_mutex_unlock(&ahead->mutex);
+
+    if (uref == NULL)
+        return;
+    if (upipe_fsrc->uclock != NULL)
+        uref_clock_set_cr_sys(uref, systime);
+    upipe_use(upipe);
+    upipe_fsrc_output(upipe, uref, &upipe_fsrc->upump);
+    upipe_release(upipe);
+}
+
+/** @internal @This starts the helper thread reading ahead from the current
+ * position, and queues the first chunks.
+ *
+ * @param upipe description structure of the pipe
+ * @return false in case of error
+ */
+static bool upipe_fsrc_ahead_start(struct upipe *upipe)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    struct upipe_fsrc_ahead *ahead = malloc(sizeof(struct upipe_fsrc_ahead));
+    if (unlikely(ahead == NULL))
+        return false;
+    ahead->chunks = calloc(upipe_fsrc->ahead_depth,
+                           sizeof(struct upipe_fsrc_chunk));
+    if (unlikely(ahead->chunks == NULL)) {
+        free(ahead);
+        return false;
+    }
+
+    ahead->fd = upipe_fsrc->fd;
+    ahead->direct = false;
+#ifdef O_DIRECT
+    if (upipe_fsrc->direct) {
+        int flags = fcntl(ahead->fd, F_GETFL);
+        ahead->direct = flags != -1 &&
+                        fcntl(ahead->fd, F_SETFL, flags | O_DIRECT) != -1;
+        if (unlikely(!ahead->direct))
+            upipe_warn_va(upipe, "can't use O_DIRECT on %s (%m)",
+                          upipe_fsrc->path);
+    }
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (!ahead->direct)
+        posix_fadvise(ahead->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    uint64_t align = ahead->direct ? DIRECT_TS_ALIGN : TS_SIZE;
+    ahead->chunk_size = upipe_fsrc->ahead_size - upipe_fsrc->ahead_size % align;
+    if (!ahead->chunk_size)
+        ahead->chunk_size = align;
+    ahead->depth = upipe_fsrc->ahead_depth;
+    ahead->read_idx = ahead->output_idx = ahead->queue_idx = 0;
+    ahead->queue_offset = upipe_fsrc->ahead_position;
+    if (ahead->direct)
+        ahead->queue_offset -= ahead->queue_offset % DIRECT_ALIGN;
+    ahead->exit = false;
+    if (unlikely(!ueventfd_init(&ahead->event, false))) {
+        free(ahead->chunks);
+        free(ahead);
+        return false;
+    }
+    pthread_mutex_init(&ahead->mutex, NULL);
+    pthread_cond_init(&ahead->cond, NULL);
+    if (unlikely(pthread_create(&ahead->thread, NULL,
+                                upipe_fsrc_ahead_thread, ahead) != 0)) {
+        pthread_cond_destroy(&ahead->cond);
+        pthread_mutex_destroy(&ahead->mutex);
+        ueventfd_clean(&ahead->event);
+        free(ahead->chunks);
+        free(ahead);
+        upipe_err(upipe, "can't create helper thread");
+        return false;
+    }
+    upipe_fsrc->ahead = ahead;
+    return upipe_fsrc_ahead_queue(upipe);
+}
+
+/** @internal @This stops the helper thread, if any, and releases the chunks
+ * read ahead. The reading position is kept.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_fsrc_ahead_stop(struct upipe *upipe)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    struct upipe_fsrc_ahead *ahead = upipe_fsrc->ahead;
+    if (ahead == NULL)
+        return;
+
+    upipe_fsrc_set_upump(upipe, NULL);
+    pthread_mutex_lock(&ahead->mutex);
+    ahead->exit = true;
+    pthread_cond_signal(&ahead->cond);
+    pthread_mutex_unlock(&ahead->mutex);
+    pthread_join(ahead->thread, NULL);
+
+    for (unsigned int i = 0; i < ahead->depth; i++) {
+        struct upipe_fsrc_chunk *chunk = &ahead->chunks[i];
+        if (chunk->ubuf == NULL)
+            continue;
+        if (chunk->buffer != NULL)
+            ubuf_block_unmap(chunk->ubuf, 0);
+        ubuf_free(chunk->ubuf);
+    }
+#ifdef O_DIRECT
+    if (ahead->direct)
+        fcntl(ahead->fd, F_SETFL, fcntl(ahead->fd, F_GETFL) & ~O_DIRECT);
+#endif
+    pthread_cond_destroy(&ahead->cond);
+    pthread_mutex_destroy(&ahead->mutex);
+    ueventfd_clean(&ahead->event);
+    free(ahead->chunks);
+    free(ahead);
+    upipe_fsrc->ahead = NULL;
+}
+
 /** @internal @This checks if the pump may be allocated.
  *
  * @param upipe description structure of the pipe
@@ -281,7 +795,21 @@ static int upipe_fsrc_check(struct upipe *upipe, struct uref *flow_format)
 
     if (upipe_fsrc->fd != -1 && upipe_fsrc->upump == NULL) {
         struct upump *upump;
-        if (upipe_fsrc->regular_file)
+        if (upipe_fsrc_mmap_mode(upipe))
+            upump = upump_alloc_idler(upipe_fsrc->upump_mgr,
+                                      upipe_fsrc_worker_mmap, upipe);
+        else if (upipe_fsrc_ahead_mode(upipe)) {
+            if (upipe_fsrc->ahead == NULL &&
+                unlikely(!upipe_fsrc_ahead_start(upipe))) {
+                upipe_fsrc_ahead_stop(upipe);
+                upipe_err(upipe, "can't start read-ahead thread");
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return UBASE_ERR_ALLOC;
+            }
+            upump = ueventfd_upump_alloc(&upipe_fsrc->ahead->event,
+                                         upipe_fsrc->upump_mgr,
+                                         upipe_fsrc_worker_ahead, upipe);
+        } else if (upipe_fsrc->regular_file)
             upump = upump_alloc_idler(upipe_fsrc->upump_mgr,
                                       upipe_fsrc_worker, upipe);
         else
@@ -322,6 +850,7 @@ static int upipe_fsrc_set_uri(struct upipe *upipe, const char *path)
 {
     struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
 
+    upipe_fsrc_ahead_stop(upipe);
     if (unlikely(upipe_fsrc->fd != -1)) {
         if (likely(upipe_fsrc->path != NULL))
             upipe_notice_va(upipe, "closing file %s", upipe_fsrc->path);
@@ -331,6 +860,9 @@ static int upipe_fsrc_set_uri(struct upipe *upipe, const char *path)
     free(upipe_fsrc->path);
     upipe_fsrc->path = NULL;
     upipe_fsrc_set_upump(upipe, NULL);
+    upipe_fsrc_mmap_flush(upipe);
+    upipe_fsrc->mmap_position = 0;
+    upipe_fsrc->ahead_position = 0;
 
     if (unlikely(path == NULL))
         return UBASE_ERR_NONE;
@@ -392,6 +924,14 @@ static int _upipe_fsrc_get_position(struct upipe *upipe,
     assert(position_p != NULL);
     if (unlikely(upipe_fsrc->fd == -1))
         return UBASE_ERR_UNHANDLED;
+    if (upipe_fsrc_mmap_mode(upipe)) {
+        *position_p = upipe_fsrc->mmap_position;
+        return UBASE_ERR_NONE;
+    }
+    if (upipe_fsrc_ahead_mode(upipe)) {
+        *position_p = upipe_fsrc->ahead_position;
+        return UBASE_ERR_NONE;
+    }
     off_t position = lseek(upipe_fsrc->fd, 0, SEEK_CUR);
     if (unlikely(position == (off_t)-1))
         return UBASE_ERR_EXTERNAL;
@@ -410,10 +950,141 @@ static int _upipe_fsrc_set_position(struct upipe *upipe, uint64_t position)
     struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
     if (unlikely(upipe_fsrc->fd == -1))
         return UBASE_ERR_UNHANDLED;
+    if (upipe_fsrc_mmap_mode(upipe)) {
+        upipe_fsrc->mmap_position = position;
+        return UBASE_ERR_NONE;
+    }
+    if (upipe_fsrc_ahead_mode(upipe)) {
+        /* the chunks are read again from the new position */
+        upipe_fsrc_ahead_stop(upipe);
+        upipe_fsrc->ahead_position = position;
+        return UBASE_ERR_NONE;
+    }
     return lseek(upipe_fsrc->fd, position, SEEK_SET) != (off_t)-1 ?
         UBASE_ERR_NONE : UBASE_ERR_EXTERNAL;
 }
 
+/** @internal @This returns the size of the mapped windows.
+ *
+ * @param upipe description structure of the pipe
+ * @param window_p filled in with the size of the windows, in octets
+ * @return an error code
+ */
+static int _upipe_fsrc_get_mmap(struct upipe *upipe, uint64_t *window_p)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    assert(window_p != NULL);
+    *window_p = upipe_fsrc->mmap_window;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the mapped windows, switching between
+ * read() and mmap modes.
+ *
+ * @param upipe description structure of the pipe
+ * @param window size of the windows, in octets, or 0 to disable mmap
+ * @return an error code
+ */
+static int _upipe_fsrc_set_mmap(struct upipe *upipe, uint64_t window)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    if (unlikely(window > INT_MAX))
+        return UBASE_ERR_INVALID;
+    if (window && upipe_fsrc->mmap_mgr == NULL) {
+        upipe_fsrc->mmap_mgr = ubuf_block_mmap_mgr_alloc(UBUF_MMAP_POOL_DEPTH,
+                                                         UBUF_MMAP_POOL_DEPTH);
+        if (unlikely(upipe_fsrc->mmap_mgr == NULL))
+            return UBASE_ERR_ALLOC;
+    }
+
+    /* carry the reading position over to the new mode */
+    uint64_t position = 0;
+    bool seek = upipe_fsrc->fd != -1 &&
+                ubase_check(_upipe_fsrc_get_position(upipe, &position));
+    upipe_fsrc_set_upump(upipe, NULL);
+    upipe_fsrc_ahead_stop(upipe);
+    upipe_fsrc_mmap_flush(upipe);
+    upipe_fsrc->mmap_window = window;
+    if (seek)
+        return _upipe_fsrc_set_position(upipe, position);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the size and number of the chunks read ahead.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the chunks, in octets
+ * @param depth_p filled in with the number of chunks
+ * @return an error code
+ */
+static int _upipe_fsrc_get_read_ahead(struct upipe *upipe, uint64_t *size_p,
+                                      unsigned int *depth_p)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    assert(size_p != NULL);
+    assert(depth_p != NULL);
+    *size_p = upipe_fsrc->ahead_size;
+    *depth_p = upipe_fsrc->ahead_depth;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size and number of the chunks read ahead,
+ * switching between read() and read-ahead modes.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the chunks, in octets, or 0 to disable read-ahead
+ * @param depth number of chunks
+ * @return an error code
+ */
+static int _upipe_fsrc_set_read_ahead(struct upipe *upipe, uint64_t size,
+                                      unsigned int depth)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    if (unlikely(size > INT_MAX - DIRECT_ALIGN || (size && !depth)))
+        return UBASE_ERR_INVALID;
+
+    /* carry the reading position over to the new mode */
+    uint64_t position = 0;
+    bool seek = upipe_fsrc->fd != -1 &&
+                ubase_check(_upipe_fsrc_get_position(upipe, &position));
+    upipe_fsrc_set_upump(upipe, NULL);
+    upipe_fsrc_ahead_stop(upipe);
+    upipe_fsrc->ahead_size = size;
+    upipe_fsrc->ahead_depth = depth;
+    if (seek)
+        return _upipe_fsrc_set_position(upipe, position);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns whether the chunks are read with O_DIRECT.
+ *
+ * @param upipe description structure of the pipe
+ * @param direct_p filled in with true in O_DIRECT mode
+ * @return an error code
+ */
+static int _upipe_fsrc_get_direct(struct upipe *upipe, bool *direct_p)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    assert(direct_p != NULL);
+    *direct_p = upipe_fsrc->direct;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This asks to read the chunks with O_DIRECT. The chunks already
+ * read ahead are dropped.
+ *
+ * @param upipe description structure of the pipe
+ * @param direct true to use O_DIRECT
+ * @return an error code
+ */
+static int _upipe_fsrc_set_direct(struct upipe *upipe, bool direct)
+{
+    struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    upipe_fsrc_ahead_stop(upipe);
+    upipe_fsrc->direct = direct;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a file source pipe.
  *
  * @param upipe description structure of the pipe
@@ -478,6 +1149,38 @@ static int _upipe_fsrc_control(struct upipe *upipe, int command, va_list args)
             uint64_t position = va_arg(args, uint64_t);
             return _upipe_fsrc_set_position(upipe, position);
         }
+        case UPIPE_FSRC_GET_MMAP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSRC_SIGNATURE)
+            uint64_t *window_p = va_arg(args, uint64_t *);
+            return _upipe_fsrc_get_mmap(upipe, window_p);
+        }
+        case UPIPE_FSRC_SET_MMAP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSRC_SIGNATURE)
+            uint64_t window = va_arg(args, uint64_t);
+            return _upipe_fsrc_set_mmap(upipe, window);
+        }
+        case UPIPE_FSRC_GET_READ_AHEAD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSRC_SIGNATURE)
+            uint64_t *size_p = va_arg(args, uint64_t *);
+            unsigned int *depth_p = va_arg(args, unsigned int *);
+            return _upipe_fsrc_get_read_ahead(upipe, size_p, depth_p);
+        }
+        case UPIPE_FSRC_SET_READ_AHEAD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSRC_SIGNATURE)
+            uint64_t size = va_arg(args, uint64_t);
+            unsigned int depth = va_arg(args, unsigned int);
+            return _upipe_fsrc_set_read_ahead(upipe, size, depth);
+        }
+        case UPIPE_FSRC_GET_DIRECT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSRC_SIGNATURE)
+            bool *direct_p = va_arg(args, bool *);
+            return _upipe_fsrc_get_direct(upipe, direct_p);
+        }
+        case UPIPE_FSRC_SET_DIRECT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FSRC_SIGNATURE)
+            bool direct = va_arg(args, int);
+            return _upipe_fsrc_set_direct(upipe, direct);
+        }
         default:
             return UBASE_ERR_NONE;
     }
@@ -505,6 +1208,7 @@ static int upipe_fsrc_control(struct upipe *upipe, int command, va_list args)
 static void upipe_fsrc_free(struct upipe *upipe)
 {
     struct upipe_fsrc *upipe_fsrc = upipe_fsrc_from_upipe(upipe);
+    upipe_fsrc_ahead_stop(upipe);
     if (likely(upipe_fsrc->fd != -1)) {
         if (likely(upipe_fsrc->path != NULL))
             upipe_notice_va(upipe, "closing file %s", upipe_fsrc->path);
@@ -512,6 +1216,8 @@ static void upipe_fsrc_free(struct upipe *upipe)
     }
     upipe_throw_dead(upipe);
 
+    upipe_fsrc_mmap_flush(upipe);
+    ubuf_mgr_release(upipe_fsrc->mmap_mgr);
     free(upipe_fsrc->path);
     upipe_fsrc_clean_read_size(upipe);
     upipe_fsrc_clean_uclock(upipe);
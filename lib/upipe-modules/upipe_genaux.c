@@ -96,6 +96,17 @@ struct upipe_genaux {
     /** get attr */
     int (*getattr) (struct uref *, uint64_t *);
 
+    /** maximum size of a batch, in octets, or 0 */
+    unsigned int batch_size;
+    /** duration of the batch windows, or 0 */
+    uint64_t batch_duration;
+    /** batch being filled, with the attributes of its first uref */
+    struct uref *batch;
+    /** octets of records in the batch */
+    unsigned int batch_offset;
+    /** date of the last record of the batch */
+    uint64_t batch_date;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -110,6 +121,73 @@ UPIPE_HELPER_UBUF_MGR(upipe_genaux, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_genaux_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_genaux, urefs, nb_urefs, max_urefs, blockers, upipe_genaux_handle)
 
+/** @internal @This outputs the pending batch, if any.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_genaux_flush_batch(struct upipe *upipe,
+                                     struct upump **upump_p)
+{
+    struct upipe_genaux *upipe_genaux = upipe_genaux_from_upipe(upipe);
+    struct uref *uref = upipe_genaux->batch;
+    if (uref == NULL)
+        return;
+    upipe_genaux->batch = NULL;
+    uref_block_resize(uref, 0, upipe_genaux->batch_offset);
+    upipe_genaux_output(upipe, uref, upump_p);
+}
+
+/** @internal @This appends the record of a uref to the batch.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param systime value of the record
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_genaux_append(struct upipe *upipe, struct uref *uref,
+                                uint64_t systime, struct upump **upump_p)
+{
+    struct upipe_genaux *upipe_genaux = upipe_genaux_from_upipe(upipe);
+    uint64_t duration = upipe_genaux->batch_duration;
+    if (upipe_genaux->batch != NULL &&
+        (systime < upipe_genaux->batch_date ||
+         (duration && systime / duration !=
+                      upipe_genaux->batch_date / duration)))
+        upipe_genaux_flush_batch(upipe, upump_p);
+
+    if (upipe_genaux->batch == NULL) {
+        struct ubuf *dst = ubuf_block_alloc(upipe_genaux->ubuf_mgr,
+                                            upipe_genaux->batch_size);
+        if (unlikely(dst == NULL)) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_attach_ubuf(uref, dst);
+        upipe_genaux->batch = uref;
+        upipe_genaux->batch_offset = 0;
+    } else
+        uref_free(uref);
+
+    int size = sizeof(uint64_t);
+    uint8_t *aux;
+    if (unlikely(!ubase_check(uref_block_write(upipe_genaux->batch,
+                        upipe_genaux->batch_offset, &size, &aux)) ||
+                 size < (int)sizeof(uint64_t))) {
+        upipe_throw_fatal(upipe, UBASE_ERR_INVALID);
+        return;
+    }
+    upipe_genaux_hton64(aux, systime);
+    uref_block_unmap(upipe_genaux->batch, upipe_genaux->batch_offset);
+    upipe_genaux->batch_offset += sizeof(uint64_t);
+    upipe_genaux->batch_date = systime;
+
+    if (upipe_genaux->batch_offset + sizeof(uint64_t) >
+        upipe_genaux->batch_size)
+        upipe_genaux_flush_batch(upipe, upump_p);
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -123,6 +201,7 @@ static bool upipe_genaux_handle(struct upipe *upipe, struct uref *uref,
     struct upipe_genaux *upipe_genaux = upipe_genaux_from_upipe(upipe);
     const char *def;
     if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_genaux_flush_batch(upipe, upump_p);
         upipe_genaux_store_flow_def(upipe, NULL);
         upipe_genaux_require_ubuf_mgr(upipe, uref);
         return true;
@@ -141,6 +220,11 @@ static bool upipe_genaux_handle(struct upipe *upipe, struct uref *uref,
         return true;
     }
 
+    if (upipe_genaux->batch_size) {
+        upipe_genaux_append(upipe, uref, systime, upump_p);
+        return true;
+    }
+
     size = sizeof(uint64_t);
     dst = ubuf_block_alloc(upipe_genaux->ubuf_mgr, size);
     if (unlikely(dst == NULL)) {
@@ -258,6 +342,41 @@ static inline int _upipe_genaux_get_getattr(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the batch thresholds.
+ *
+ * @param upipe description structure of the pipe
+ * @param size maximum size of a batch in octets, or 0
+ * @param duration duration of the batch windows, or 0
+ * @return an error code
+ */
+static int _upipe_genaux_set_batch(struct upipe *upipe, unsigned int size,
+                                   uint64_t duration)
+{
+    struct upipe_genaux *upipe_genaux = upipe_genaux_from_upipe(upipe);
+    upipe_genaux_flush_batch(upipe, NULL);
+    upipe_genaux->batch_size = size - size % sizeof(uint64_t);
+    upipe_genaux->batch_duration = duration;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This gets the batch thresholds.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the maximum size of a batch in octets
+ * @param duration_p filled in with the duration of the batch windows
+ * @return an error code
+ */
+static int _upipe_genaux_get_batch(struct upipe *upipe, unsigned int *size_p,
+                                   uint64_t *duration_p)
+{
+    struct upipe_genaux *upipe_genaux = upipe_genaux_from_upipe(upipe);
+    if (size_p != NULL)
+        *size_p = upipe_genaux->batch_size;
+    if (duration_p != NULL)
+        *duration_p = upipe_genaux->batch_duration;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a genaux pipe.
  *
  * @param upipe description structure of the pipe
@@ -310,6 +429,18 @@ static int upipe_genaux_control(struct upipe *upipe,
             return _upipe_genaux_get_getattr(upipe,
                    va_arg(args, int (**)(struct uref*, uint64_t*)));
         }
+        case UPIPE_GENAUX_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_GENAUX_SIGNATURE)
+            unsigned int size = va_arg(args, unsigned int);
+            uint64_t duration = va_arg(args, uint64_t);
+            return _upipe_genaux_set_batch(upipe, size, duration);
+        }
+        case UPIPE_GENAUX_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_GENAUX_SIGNATURE)
+            unsigned int *size_p = va_arg(args, unsigned int *);
+            uint64_t *duration_p = va_arg(args, uint64_t *);
+            return _upipe_genaux_get_batch(upipe, size_p, duration_p);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -337,6 +468,11 @@ static struct upipe *upipe_genaux_alloc(struct upipe_mgr *mgr,
     upipe_genaux_init_output(upipe);
     upipe_genaux_init_input(upipe);
     upipe_genaux->getattr = uref_clock_get_cr_sys;
+    upipe_genaux->batch_size = 0;
+    upipe_genaux->batch_duration = 0;
+    upipe_genaux->batch = NULL;
+    upipe_genaux->batch_offset = 0;
+    upipe_genaux->batch_date = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -347,6 +483,7 @@ static struct upipe *upipe_genaux_alloc(struct upipe_mgr *mgr,
  */
 static void upipe_genaux_free(struct upipe *upipe)
 {
+    upipe_genaux_flush_batch(upipe, NULL);
     upipe_throw_dead(upipe);
 
     upipe_genaux_clean_input(upipe);
@@ -0,0 +1,770 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module - HLS segmenter sink
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uclock.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe-modules/upipe_hls_sink.h>
+#include <upipe-modules/upipe_file_sink.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#define EXPECTED_FLOW_DEF "block."
+
+/** maximum number of files waiting to be deleted by the helper thread */
+#define UPIPE_HLS_SINK_ASYNC_UNLINK 16
+
+/** @internal @This is the context of the helper thread writing the
+ * playlist and deleting old segments. */
+struct upipe_hls_sink_async {
+    /** helper thread */
+    pthread_t thread;
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** condition signalled on new requests */
+    pthread_cond_t cond;
+
+    /** path of the playlist */
+    char *path;
+    /** new contents of the playlist, or NULL */
+    char *playlist;
+    /** paths of the files to delete */
+    char *unlink_paths[UPIPE_HLS_SINK_ASYNC_UNLINK];
+    /** number of files to delete */
+    unsigned int nb_unlink;
+    /** set to true to ask the thread to exit */
+    bool exit;
+};
+
+/** @internal @This is a segment described in the playlist. */
+struct upipe_hls_sink_segment {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** sequence number */
+    uint64_t seq;
+    /** duration in 27 MHz units */
+    uint64_t duration;
+};
+
+UBASE_FROM_TO(upipe_hls_sink_segment, uchain, uchain, uchain)
+
+/** upipe_hls_sink structure */
+struct upipe_hls_sink {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** input flow */
+    struct uref *flow_def;
+
+    /** fsink subpipe */
+    struct upipe *fsink;
+    /** fsink manager */
+    struct upipe_mgr *fsink_mgr;
+
+    /** path of the segments before the sequence number */
+    char *prefix;
+    /** path of the segments after the sequence number */
+    char *suffix;
+    /** target duration of segments */
+    uint64_t duration;
+    /** number of segments in the playlist, or 0 */
+    unsigned int window;
+
+    /** true if a segment is being written */
+    bool opened;
+    /** sequence number of the current segment */
+    uint64_t seq;
+    /** system date of the beginning of the current segment */
+    uint64_t start;
+    /** system date of the last uref */
+    uint64_t last_cr;
+    /** system date of the last random access point, or UINT64_MAX */
+    uint64_t last_rap;
+    /** list of segments in the playlist */
+    struct uchain segments;
+    /** number of segments in the list */
+    unsigned int nb_segments;
+
+    /** helper thread, or NULL */
+    struct upipe_hls_sink_async *async;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_hls_sink, upipe, UPIPE_HLS_SINK_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_hls_sink, urefcount, upipe_hls_sink_free)
+UPIPE_HELPER_VOID(upipe_hls_sink)
+
+/** @internal @This writes a file atomically, by renaming a temporary file.
+ * It is called from the helper thread, so it doesn't log anything.
+ *
+ * @param path path of the file
+ * @param contents contents of the file
+ * @return false in case of error
+ */
+static bool upipe_hls_sink_write_file(const char *path, const char *contents)
+{
+    char tmp_path[MAXPATHLEN];
+    snprintf(tmp_path, MAXPATHLEN, "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (unlikely(fd == -1))
+        return false;
+
+    size_t size = strlen(contents);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t ret = write(fd, contents + done, size - done);
+        if (unlikely(ret == -1)) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            unlink(tmp_path);
+            return false;
+        }
+        done += ret;
+    }
+    close(fd);
+    if (unlikely(rename(tmp_path, path) == -1)) {
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+/** @internal @This is the main function of the helper thread, which writes
+ * the playlist and deletes old segments out of the pipeline thread.
+ *
+ * @param _async pointer to the helper thread context
+ * @return NULL
+ */
+static void *upipe_hls_sink_async_thread(void *_async)
+{
+    struct upipe_hls_sink_async *async = (struct upipe_hls_sink_async *)_async;
+    pthread_mutex_lock(&async->mutex);
+    for ( ; ; ) {
+        if (async->playlist == NULL && !async->nb_unlink) {
+            if (async->exit)
+                break;
+            pthread_cond_wait(&async->cond, &async->mutex);
+            continue;
+        }
+
+        char *unlink_paths[UPIPE_HLS_SINK_ASYNC_UNLINK];
+        unsigned int nb_unlink = async->nb_unlink;
+        memcpy(unlink_paths, async->unlink_paths, nb_unlink * sizeof(char *));
+        async->nb_unlink = 0;
+        char *playlist = async->playlist;
+        async->playlist = NULL;
+        pthread_mutex_unlock(&async->mutex);
+
+        /* the playlist no longer references the deleted segments */
+        if (playlist != NULL)
+            upipe_hls_sink_write_file(async->path, playlist);
+        free(playlist);
+        for (unsigned int i = 0; i < nb_unlink; i++) {
+            unlink(unlink_paths[i]);
+            free(unlink_paths[i]);
+        }
+
+        pthread_mutex_lock(&async->mutex);
+    }
+    pthread_mutex_unlock(&async->mutex);
+    return NULL;
+}
+
+/** @internal @This starts the helper thread.
+ *
+ * @param upipe description structure of the pipe
+ * @param path path of the playlist
+ * @return an error code
+ */
+static int upipe_hls_sink_init_async(struct upipe *upipe, const char *path)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    struct upipe_hls_sink_async *async =
+        malloc(sizeof(struct upipe_hls_sink_async));
+    UBASE_ALLOC_RETURN(async)
+    async->path = strdup(path);
+    if (unlikely(async->path == NULL)) {
+        free(async);
+        return UBASE_ERR_ALLOC;
+    }
+    async->playlist = NULL;
+    async->nb_unlink = 0;
+    async->exit = false;
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->cond, NULL);
+    if (unlikely(pthread_create(&async->thread, NULL,
+                                upipe_hls_sink_async_thread, async) != 0)) {
+        pthread_cond_destroy(&async->cond);
+        pthread_mutex_destroy(&async->mutex);
+        free(async->path);
+        free(async);
+        upipe_err(upipe, "can't create helper thread");
+        return UBASE_ERR_EXTERNAL;
+    }
+    upipe_hls_sink->async = async;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This stops the helper thread, after it has written the last
+ * playlist and deleted the pending files.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_sink_clean_async(struct upipe *upipe)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    struct upipe_hls_sink_async *async = upipe_hls_sink->async;
+    if (async == NULL)
+        return;
+
+    pthread_mutex_lock(&async->mutex);
+    async->exit = true;
+    pthread_cond_broadcast(&async->cond);
+    pthread_mutex_unlock(&async->mutex);
+    pthread_join(async->thread, NULL);
+    pthread_cond_destroy(&async->cond);
+    pthread_mutex_destroy(&async->mutex);
+    free(async->path);
+    free(async);
+    upipe_hls_sink->async = NULL;
+}
+
+/** @internal @This builds the path of a segment.
+ *
+ * @param upipe description structure of the pipe
+ * @param path filled in with the path
+ * @param seq sequence number of the segment
+ */
+static void upipe_hls_sink_segment_path(struct upipe *upipe,
+                                        char path[MAXPATHLEN], uint64_t seq)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    snprintf(path, MAXPATHLEN, "%s%"PRIu64"%s", upipe_hls_sink->prefix, seq,
+             upipe_hls_sink->suffix);
+}
+
+/** @internal @This asks the helper thread to delete a segment. If too many
+ * files are pending, the segment is deleted from the pipeline thread.
+ *
+ * @param upipe description structure of the pipe
+ * @param seq sequence number of the segment
+ */
+static void upipe_hls_sink_unlink(struct upipe *upipe, uint64_t seq)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    struct upipe_hls_sink_async *async = upipe_hls_sink->async;
+    char path[MAXPATHLEN];
+    upipe_hls_sink_segment_path(upipe, path, seq);
+
+    char *path_dup = strdup(path);
+    if (likely(path_dup != NULL)) {
+        pthread_mutex_lock(&async->mutex);
+        bool queued = async->nb_unlink < UPIPE_HLS_SINK_ASYNC_UNLINK;
+        if (queued) {
+            async->unlink_paths[async->nb_unlink++] = path_dup;
+            pthread_cond_broadcast(&async->cond);
+        }
+        pthread_mutex_unlock(&async->mutex);
+        if (likely(queued))
+            return;
+        free(path_dup);
+    }
+    unlink(path);
+}
+
+/** @internal @This rounds a duration up to the second.
+ *
+ * @param duration duration in 27 MHz units
+ * @return number of seconds
+ */
+static inline uint64_t upipe_hls_sink_seconds(uint64_t duration)
+{
+    return (duration + UCLOCK_FREQ - 1) / UCLOCK_FREQ;
+}
+
+/** @internal @This builds the playlist and hands it to the helper thread.
+ *
+ * @param upipe description structure of the pipe
+ * @param end true if no segment will be added
+ */
+static void upipe_hls_sink_playlist(struct upipe *upipe, bool end)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    const char *name = strrchr(upipe_hls_sink->prefix, '/');
+    name = name != NULL ? name + 1 : upipe_hls_sink->prefix;
+    size_t entry_size = 64 + strlen(name) + strlen(upipe_hls_sink->suffix);
+    size_t size = 256 + upipe_hls_sink->nb_segments * entry_size;
+    char *playlist = malloc(size);
+    if (unlikely(playlist == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    uint64_t target =
+        upipe_hls_sink_seconds(upipe_hls_sink->duration);
+    uint64_t media_seq = 0;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_hls_sink->segments, uchain) {
+        struct upipe_hls_sink_segment *segment =
+            upipe_hls_sink_segment_from_uchain(uchain);
+        if (uchain == upipe_hls_sink->segments.next)
+            media_seq = segment->seq;
+        uint64_t seconds = upipe_hls_sink_seconds(segment->duration);
+        if (seconds > target)
+            target = seconds;
+    }
+
+    size_t len = snprintf(playlist, size,
+                          "#EXTM3U\n#EXT-X-VERSION:3\n"
+                          "#EXT-X-TARGETDURATION:%"PRIu64"\n"
+                          "#EXT-X-MEDIA-SEQUENCE:%"PRIu64"\n",
+                          target, media_seq);
+    ulist_foreach (&upipe_hls_sink->segments, uchain) {
+        struct upipe_hls_sink_segment *segment =
+            upipe_hls_sink_segment_from_uchain(uchain);
+        len += snprintf(playlist + len, size - len,
+                        "#EXTINF:%"PRIu64".%03"PRIu64",\n%s%"PRIu64"%s\n",
+                        segment->duration / UCLOCK_FREQ,
+                        segment->duration % UCLOCK_FREQ * 1000 / UCLOCK_FREQ,
+                        name, segment->seq, upipe_hls_sink->suffix);
+    }
+    if (end)
+        snprintf(playlist + len, size - len, "#EXT-X-ENDLIST\n");
+
+    struct upipe_hls_sink_async *async = upipe_hls_sink->async;
+    pthread_mutex_lock(&async->mutex);
+    /* only the last version of the playlist matters */
+    free(async->playlist);
+    async->playlist = playlist;
+    pthread_cond_broadcast(&async->cond);
+    pthread_mutex_unlock(&async->mutex);
+}
+
+/** @internal @This adds the current segment to the playlist, and deletes
+ * the segments which have left the playlist for a whole window.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration duration of the current segment
+ * @param end true if no segment will be added
+ */
+static void upipe_hls_sink_close_segment(struct upipe *upipe,
+                                         uint64_t duration, bool end)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    upipe_hls_sink->opened = false;
+
+    struct upipe_hls_sink_segment *segment =
+        malloc(sizeof(struct upipe_hls_sink_segment));
+    if (unlikely(segment == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uchain_init(&segment->uchain);
+    segment->seq = upipe_hls_sink->seq;
+    segment->duration = duration;
+    ulist_add(&upipe_hls_sink->segments, &segment->uchain);
+    upipe_hls_sink->nb_segments++;
+
+    unsigned int window = upipe_hls_sink->window;
+    while (window && upipe_hls_sink->nb_segments > window) {
+        struct uchain *uchain = ulist_pop(&upipe_hls_sink->segments);
+        free(upipe_hls_sink_segment_from_uchain(uchain));
+        upipe_hls_sink->nb_segments--;
+    }
+    if (window && upipe_hls_sink->seq >= 2 * (uint64_t)window)
+        upipe_hls_sink_unlink(upipe, upipe_hls_sink->seq - 2 * window);
+
+    upipe_hls_sink_playlist(upipe, end);
+    upipe_hls_sink->seq++;
+}
+
+/** @internal @This opens the next segment in the embedded file sink, and
+ * prepares the following one on its helper thread.
+ *
+ * @param upipe description structure of the pipe
+ * @param cr_sys system date of the first uref of the segment
+ * @return false in case of error
+ */
+static bool upipe_hls_sink_open_segment(struct upipe *upipe, uint64_t cr_sys)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    char path[MAXPATHLEN];
+    upipe_hls_sink_segment_path(upipe, path, upipe_hls_sink->seq);
+    if (unlikely(!ubase_check(upipe_fsink_set_path(upipe_hls_sink->fsink,
+                    path, UPIPE_FSINK_OVERWRITE))))
+        return false;
+    upipe_hls_sink->opened = true;
+    upipe_hls_sink->start = cr_sys;
+
+    upipe_hls_sink_segment_path(upipe, path, upipe_hls_sink->seq + 1);
+    upipe_fsink_prepare_path(upipe_hls_sink->fsink, path,
+                             UPIPE_FSINK_OVERWRITE);
+    return true;
+}
+
+/** @internal @This handles data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_hls_sink_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    uint64_t cr_sys;
+    if (unlikely(upipe_hls_sink->async == NULL)) {
+        upipe_warn(upipe, "call set_path first !");
+        uref_free(uref);
+        return;
+    }
+    if (unlikely(!ubase_check(uref_clock_get_cr_sys(uref, &cr_sys)))) {
+        upipe_warn(upipe, "uref has no cr_sys, dropping");
+        uref_free(uref);
+        return;
+    }
+
+    /* either flagged by the framer, or a new date from upipe_setrap */
+    bool rap = ubase_check(uref_flow_get_random(uref));
+    uint64_t rap_sys;
+    if (ubase_check(uref_clock_get_rap_sys(uref, &rap_sys))) {
+        if (rap_sys != upipe_hls_sink->last_rap &&
+            upipe_hls_sink->last_rap != UINT64_MAX)
+            rap = true;
+        upipe_hls_sink->last_rap = rap_sys;
+    }
+
+    if (upipe_hls_sink->opened && rap &&
+        cr_sys >= upipe_hls_sink->start + upipe_hls_sink->duration)
+        upipe_hls_sink_close_segment(upipe, cr_sys - upipe_hls_sink->start,
+                                     false);
+
+    if (!upipe_hls_sink->opened) {
+        if (!rap || unlikely(!upipe_hls_sink_open_segment(upipe, cr_sys))) {
+            uref_free(uref);
+            return;
+        }
+    }
+    upipe_hls_sink->last_cr = cr_sys;
+    upipe_input(upipe_hls_sink->fsink, uref, upump_p);
+}
+
+/** @internal @This allocates hls_sink output (fsink)
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_hls_sink_output_alloc(struct upipe *upipe)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    if (!upipe_hls_sink->fsink_mgr) {
+        upipe_err(upipe, "fsink manager required");
+        return UBASE_ERR_UNHANDLED;
+    }
+    struct upipe *fsink = upipe_void_alloc(upipe_hls_sink->fsink_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(upipe->uprobe),
+                                UPROBE_LOG_NOTICE, "fsink"));
+    if (unlikely(!fsink)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_hls_sink->fsink = fsink;
+    if (upipe_hls_sink->flow_def != NULL)
+        return upipe_set_flow_def(fsink, upipe_hls_sink->flow_def);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_hls_sink_set_flow_def(struct upipe *upipe,
+                                       struct uref *flow_def)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL))
+        return UBASE_ERR_ALLOC;
+    uref_free(upipe_hls_sink->flow_def);
+    upipe_hls_sink->flow_def = flow_def_dup;
+    if (upipe_hls_sink->fsink != NULL)
+        return upipe_set_flow_def(upipe_hls_sink->fsink,
+                                  upipe_hls_sink->flow_def);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This closes the current segment and the playlist, and stops
+ * the helper thread.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_sink_close(struct upipe *upipe)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    if (upipe_hls_sink->async == NULL)
+        return;
+
+    if (upipe_hls_sink->opened) {
+        upipe_hls_sink_close_segment(upipe,
+                upipe_hls_sink->last_cr - upipe_hls_sink->start, true);
+        /* take the file prepared ahead so that it can be deleted */
+        char path[MAXPATHLEN];
+        upipe_hls_sink_segment_path(upipe, path, upipe_hls_sink->seq);
+        upipe_fsink_set_path(upipe_hls_sink->fsink, path,
+                             UPIPE_FSINK_OVERWRITE);
+        upipe_fsink_set_path(upipe_hls_sink->fsink, NULL,
+                             UPIPE_FSINK_OVERWRITE);
+        upipe_hls_sink_unlink(upipe, upipe_hls_sink->seq);
+    } else if (upipe_hls_sink->nb_segments)
+        upipe_hls_sink_playlist(upipe, true);
+    upipe_hls_sink_clean_async(upipe);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_hls_sink->segments, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        free(upipe_hls_sink_segment_from_uchain(uchain));
+    }
+    upipe_hls_sink->nb_segments = 0;
+    free(upipe_hls_sink->prefix);
+    free(upipe_hls_sink->suffix);
+    upipe_hls_sink->prefix = NULL;
+    upipe_hls_sink->suffix = NULL;
+}
+
+/** @internal @This sets the paths of the playlist and segments.
+ *
+ * @param upipe description structure of the pipe
+ * @param playlist path of the playlist, or NULL
+ * @param prefix path of the segments before the sequence number
+ * @param suffix path of the segments after the sequence number
+ * @return an error code
+ */
+static int _upipe_hls_sink_set_path(struct upipe *upipe, const char *playlist,
+                                    const char *prefix, const char *suffix)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    if (unlikely(!upipe_hls_sink->fsink))
+        UBASE_RETURN(upipe_hls_sink_output_alloc(upipe))
+
+    upipe_hls_sink_close(upipe);
+    upipe_hls_sink->seq = 0;
+    upipe_hls_sink->last_rap = UINT64_MAX;
+    if (unlikely(playlist == NULL)) {
+        upipe_notice(upipe, "closing playlist");
+        return UBASE_ERR_NONE;
+    }
+    if (unlikely(prefix == NULL || suffix == NULL))
+        return UBASE_ERR_INVALID;
+
+    upipe_hls_sink->prefix = strdup(prefix);
+    upipe_hls_sink->suffix = strdup(suffix);
+    if (unlikely(upipe_hls_sink->prefix == NULL ||
+                 upipe_hls_sink->suffix == NULL)) {
+        free(upipe_hls_sink->prefix);
+        free(upipe_hls_sink->suffix);
+        upipe_hls_sink->prefix = NULL;
+        upipe_hls_sink->suffix = NULL;
+        return UBASE_ERR_ALLOC;
+    }
+    UBASE_RETURN(upipe_hls_sink_init_async(upipe, playlist))
+    upipe_notice_va(upipe, "writing playlist %s (segments %s*%s)",
+                    playlist, prefix, suffix);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a HLS sink pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_hls_sink_control(struct upipe *upipe,
+                                  int command, va_list args)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_hls_sink_set_flow_def(upipe, flow_def);
+        }
+
+        case UPIPE_HLS_SINK_SET_PATH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SINK_SIGNATURE)
+            const char *playlist = va_arg(args, const char *);
+            const char *prefix = va_arg(args, const char *);
+            const char *suffix = va_arg(args, const char *);
+            return _upipe_hls_sink_set_path(upipe, playlist, prefix, suffix);
+        }
+        case UPIPE_HLS_SINK_GET_DURATION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SINK_SIGNATURE)
+            uint64_t *duration_p = va_arg(args, uint64_t *);
+            *duration_p = upipe_hls_sink->duration;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HLS_SINK_SET_DURATION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SINK_SIGNATURE)
+            uint64_t duration = va_arg(args, uint64_t);
+            if (unlikely(!duration))
+                return UBASE_ERR_INVALID;
+            upipe_hls_sink->duration = duration;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HLS_SINK_GET_WINDOW: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SINK_SIGNATURE)
+            unsigned int *window_p = va_arg(args, unsigned int *);
+            *window_p = upipe_hls_sink->window;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HLS_SINK_SET_WINDOW: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SINK_SIGNATURE)
+            upipe_hls_sink->window = va_arg(args, unsigned int);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HLS_SINK_SET_FSINK_MGR: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SINK_SIGNATURE)
+            upipe_hls_sink->fsink_mgr = va_arg(args, struct upipe_mgr *);
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            /* fsink commands and attach requests */
+            if (!upipe_hls_sink->fsink && !upipe_hls_sink->fsink_mgr)
+                return UBASE_ERR_UNHANDLED;
+            if (!upipe_hls_sink->fsink)
+                UBASE_RETURN(upipe_hls_sink_output_alloc(upipe))
+            return upipe_control_va(upipe_hls_sink->fsink, command, args);
+    }
+}
+
+/** @internal @This allocates a hls_sink pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_hls_sink_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_hls_sink_alloc_void(mgr, uprobe, signature,
+                                                    args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    upipe_hls_sink_init_urefcount(upipe);
+    upipe_hls_sink->flow_def = NULL;
+    upipe_hls_sink->fsink = NULL;
+    upipe_hls_sink->fsink_mgr = NULL;
+    upipe_hls_sink->prefix = NULL;
+    upipe_hls_sink->suffix = NULL;
+    upipe_hls_sink->duration = UPIPE_HLS_SINK_DEF_DURATION;
+    upipe_hls_sink->window = UPIPE_HLS_SINK_DEF_WINDOW;
+    upipe_hls_sink->opened = false;
+    upipe_hls_sink->seq = 0;
+    upipe_hls_sink->start = 0;
+    upipe_hls_sink->last_cr = 0;
+    upipe_hls_sink->last_rap = UINT64_MAX;
+    ulist_init(&upipe_hls_sink->segments);
+    upipe_hls_sink->nb_segments = 0;
+    upipe_hls_sink->async = NULL;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This frees all resources allocated.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_sink_free(struct upipe *upipe)
+{
+    struct upipe_hls_sink *upipe_hls_sink = upipe_hls_sink_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    upipe_hls_sink_close(upipe);
+    upipe_release(upipe_hls_sink->fsink);
+    uref_free(upipe_hls_sink->flow_def);
+    upipe_hls_sink_clean_urefcount(upipe);
+    upipe_hls_sink_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_hls_sink_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_HLS_SINK_SIGNATURE,
+
+    .upipe_alloc = upipe_hls_sink_alloc,
+    .upipe_input = upipe_hls_sink_input,
+    .upipe_control = upipe_hls_sink_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for hls_sink pipes
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_hls_sink_mgr_alloc(void)
+{
+    return &upipe_hls_sink_mgr;
+}
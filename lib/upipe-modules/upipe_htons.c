@@ -32,6 +32,7 @@
 #include <upipe/uref.h>
 #include <upipe/upipe.h>
 #include <upipe/uref_block.h>
+#include <upipe/ubuf_block.h>
 #include <upipe/uref_block_flow.h>
 #include <upipe/uref_flow.h>
 #include <upipe/upipe.h>
@@ -48,7 +49,17 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
-#include <arpa/inet.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #define EXPECTED_FLOW_DEF "block."
 
@@ -75,6 +86,107 @@ UPIPE_HELPER_UREFCOUNT(upipe_htons, urefcount, upipe_htons_free)
 UPIPE_HELPER_VOID(upipe_htons);
 UPIPE_HELPER_OUTPUT(upipe_htons, output, flow_def, output_state, request_list);
 
+/** @internal @This swaps the octets of 16-bit words. The source and
+ * destination may be the same buffer, and need not be aligned.
+ *
+ * @param dst destination buffer
+ * @param src source buffer
+ * @param size size of the buffers, rounded down to an even number
+ */
+static void upipe_htons_swap(uint8_t *dst, const uint8_t *src, size_t size)
+{
+#if defined(__AVX2__)
+    const __m256i mask256 = _mm256_setr_epi8(
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for ( ; size >= 32; size -= 32, dst += 32, src += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)src);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_shuffle_epi8(v, mask256));
+    }
+#endif
+#if defined(__SSSE3__)
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                       9, 8, 11, 10, 13, 12, 15, 14);
+    for ( ; size >= 16; size -= 16, dst += 16, src += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(v, mask));
+    }
+#elif defined(__SSE2__)
+    for ( ; size >= 16; size -= 16, dst += 16, src += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dst,
+                         _mm_or_si128(_mm_slli_epi16(v, 8),
+                                      _mm_srli_epi16(v, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for ( ; size >= 16; size -= 16, dst += 16, src += 16)
+        vst1q_u8(dst, vrev16q_u8(vld1q_u8(src)));
+#endif
+
+    for ( ; size >= 2; size -= 2, dst += 2, src += 2) {
+        uint8_t tmp = src[0];
+        dst[0] = src[1];
+        dst[1] = tmp;
+    }
+}
+
+/** @internal @This swaps the words of a uref into a new buffer, in a single
+ * pass over the source segments. A word may straddle two segments.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param size size of the uref
+ * @return an error code
+ */
+static int upipe_htons_copy(struct upipe *upipe, struct uref *uref,
+                            size_t size)
+{
+    struct ubuf *ubuf = ubuf_block_alloc(uref->ubuf->mgr, size);
+    if (unlikely(ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+
+    int bufsize = -1;
+    uint8_t *dst;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &bufsize, &dst)) ||
+                 bufsize != size)) {
+        ubuf_free(ubuf);
+        return UBASE_ERR_ALLOC;
+    }
+
+    size_t offset = 0;
+    bool odd = false;
+    uint8_t last = 0;
+    while (offset < size) {
+        const uint8_t *src;
+        int len = -1;
+        if (unlikely(!ubase_check(uref_block_read(uref, offset, &len,
+                                                  &src)))) {
+            ubuf_block_unmap(ubuf, 0);
+            ubuf_free(ubuf);
+            return UBASE_ERR_INVALID;
+        }
+        int i = 0;
+        if (odd && len > 0) {
+            /* finish the word started in the previous segment */
+            dst[offset - 1] = src[0];
+            dst[offset] = last;
+            i = 1;
+        }
+        upipe_htons_swap(dst + offset + i, src + i, len - i);
+        odd = (len - i) & 1;
+        if (odd) {
+            last = src[len - 1];
+            dst[offset + len - 1] = last;
+        }
+        uref_block_unmap(uref, offset);
+        offset += len;
+    }
+
+    ubuf_block_unmap(ubuf, 0);
+    uref_attach_ubuf(uref, ubuf);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This handles input.
  *
  * @param upipe description structure of the pipe
@@ -84,9 +196,9 @@ UPIPE_HELPER_OUTPUT(upipe_htons, output, flow_def, output_state, request_list);
 static void upipe_htons_input(struct upipe *upipe, struct uref *uref,
                               struct upump **upump_p)
 {
-    struct ubuf *ubuf;
+#ifndef UPIPE_WORDS_BIGENDIAN
     size_t size = 0;
-    int remain, bufsize = -1, offset = 0;
+    int bufsize = -1;
     uint8_t *buf = NULL;
 
     /* block size */
@@ -95,42 +207,24 @@ static void upipe_htons_input(struct upipe *upipe, struct uref *uref,
         uref_free(uref);
         return;
     }
-    /* copy ubuf if shared or not 16b-unaligned or segmented */
-    bufsize = -1;
-    if (!ubase_check(uref_block_write(uref, 0, &bufsize, &buf)) ||
-        ((uintptr_t)buf & 1) || bufsize != size) {
-        ubuf = ubuf_block_copy(uref->ubuf->mgr, uref->ubuf, 0, size);
-        if (unlikely(!ubuf)) {
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            uref_free(uref);
-            return;
-        }
-        uref_attach_ubuf(uref, ubuf);
-    } else {
-        uref_block_unmap(uref, 0);
-    }
 
-    /* process ubuf chunks */
-    while (size > 0) {
-        bufsize = -1;
-        if (unlikely(!ubase_check(uref_block_write(uref, offset, &bufsize,
-                                  &buf)))) {
-            upipe_warn(upipe, "unexpected buffer error");
+    /* swap in place if the ubuf is not shared nor segmented, otherwise
+     * swap while copying */
+    bool mapped = ubase_check(uref_block_write(uref, 0, &bufsize, &buf));
+    if (mapped && bufsize == size) {
+        upipe_htons_swap(buf, buf, size);
+        uref_block_unmap(uref, 0);
+    } else {
+        if (mapped)
+            uref_block_unmap(uref, 0);
+        int err = upipe_htons_copy(upipe, uref, size);
+        if (unlikely(!ubase_check(err))) {
+            upipe_throw_fatal(upipe, err);
             uref_free(uref);
             return;
         }
-        if (unlikely((uintptr_t)buf & 1)) {
-            upipe_warn_va(upipe, "unaligned buffer: %p", buf);
-        }
-        for (remain = bufsize; remain > 1; remain -= 2) {
-            *(uint16_t *)buf = htons(*(uint16_t *)buf);
-            buf += 2;
-        }
-
-        uref_block_unmap(uref, offset);
-        offset += bufsize;
-        size -= bufsize;
     }
+#endif
 
     upipe_htons_output(upipe, uref, upump_p);
 }
@@ -47,6 +47,7 @@
 #include <upipe/upipe_helper_upump.h>
 #include <upipe/upipe_helper_uclock.h>
 #include <upipe/upipe_helper_source_read_size.h>
+#include <upipe/ueventfd.h>
 #include <upipe-modules/upipe_http_source.h>
 
 #include <stdlib.h>
@@ -63,6 +64,7 @@
 #include <netdb.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "http-parser/http_parser.h"
 
@@ -71,13 +73,54 @@
 
 #define MAX_URL_SIZE            2048
 #define USER_AGENT              "upipe_http_src"
-static const char get_request_format[] = 
-    "GET %s HTTP/1.0\n"
-    "User-Agent: %s\n"
-    "\n";
+static const char get_request_format[] =
+    "GET %.*s HTTP/1.1\r\n"
+    "Host: %s%s%s\r\n"
+    "User-Agent: %s\r\n"
+    "\r\n";
 
 /** @hidden */
 static int upipe_http_src_check(struct upipe *upipe, struct uref *flow_format);
+/** @hidden */
+static int upipe_http_src_body_cb(http_parser *parser, const char *at,
+                                  size_t len);
+/** @hidden */
+static int upipe_http_src_message_begin_cb(http_parser *parser);
+/** @hidden */
+static int upipe_http_src_message_complete_cb(http_parser *parser);
+
+/** @internal @This is the state of the connection of a http source pipe. */
+enum upipe_http_src_state {
+    /** no connection */
+    UPIPE_HTTP_SRC_NONE,
+    /** waiting for the resolver thread */
+    UPIPE_HTTP_SRC_RESOLVING,
+    /** waiting for the socket to be connected */
+    UPIPE_HTTP_SRC_CONNECTING,
+    /** reading a response */
+    UPIPE_HTTP_SRC_READING,
+    /** connection kept alive after the end of a response */
+    UPIPE_HTTP_SRC_IDLE
+};
+
+/** @internal @This is the context of a name resolution, shared between the
+ * pipe and the resolver thread. */
+struct upipe_http_src_resolver {
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** number of references (pipe and thread) */
+    unsigned int refcount;
+    /** host to resolve */
+    char *host;
+    /** service to resolve */
+    char *service;
+    /** return value of getaddrinfo */
+    int ret;
+    /** resolved addresses, or NULL */
+    struct addrinfo *info;
+    /** event signalling the end of the resolution */
+    struct ueventfd event;
+};
 
 /** @internal @This is the private context of a http source pipe. */
 struct upipe_http_src {
@@ -121,12 +164,40 @@ struct upipe_http_src {
     int fd;
     /** http url */
     char *url;
+    /** state of the connection */
+    enum upipe_http_src_state state;
+    /** pending name resolution, or NULL */
+    struct upipe_http_src_resolver *resolver;
+    /** resolved addresses */
+    struct addrinfo *info;
+    /** next address to connect to */
+    struct addrinfo *next_addr;
+    /** host of the url */
+    char *host;
+    /** service of the url */
+    char *service;
+    /** host of the connection */
+    char *conn_host;
+    /** service of the connection */
+    char *conn_service;
+    /** true if the connection was kept alive from a previous url */
+    bool reused;
+    /** true if a part of the response was received */
+    bool received;
+    /** true if the response is complete */
+    bool complete;
+    /** true if the connection may be kept alive after the response */
+    bool keep_alive;
 
     /** http parser*/
     http_parser parser;
 
     /** http parser settings */
     http_parser_settings parser_settings;
+    /** uref holding the buffer being parsed, or NULL */
+    struct uref *recv_uref;
+    /** start of the buffer being parsed */
+    const uint8_t *recv_buffer;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -178,6 +249,31 @@ static struct upipe *upipe_http_src_alloc(struct upipe_mgr *mgr,
     upipe_http_src_init_read_size(upipe, UBUF_DEFAULT_SIZE);
     upipe_http_src->fd = -1;
     upipe_http_src->url = NULL;
+    upipe_http_src->state = UPIPE_HTTP_SRC_NONE;
+    upipe_http_src->resolver = NULL;
+    upipe_http_src->info = NULL;
+    upipe_http_src->next_addr = NULL;
+    upipe_http_src->host = NULL;
+    upipe_http_src->service = NULL;
+    upipe_http_src->conn_host = NULL;
+    upipe_http_src->conn_service = NULL;
+    upipe_http_src->reused = false;
+    upipe_http_src->received = false;
+    upipe_http_src->complete = false;
+    upipe_http_src->keep_alive = false;
+    upipe_http_src->recv_uref = NULL;
+    upipe_http_src->recv_buffer = NULL;
+
+    /* init parser settings */
+    http_parser_settings *settings = &upipe_http_src->parser_settings;
+    memset(settings, 0, sizeof(http_parser_settings));
+    settings->on_message_begin = upipe_http_src_message_begin_cb;
+    settings->on_url = NULL;
+    settings->on_header_field = NULL;
+    settings->on_header_value = NULL;
+    settings->on_headers_complete = NULL;
+    settings->on_body = upipe_http_src_body_cb;
+    settings->on_message_complete = upipe_http_src_message_complete_cb;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -191,7 +287,10 @@ static inline struct upipe_http_src *upipe_http_src_from_parser(http_parser *par
     return container_of(parser, struct upipe_http_src, parser);
 }
 
-/** @internal @This is called by http_parser when receiving fragments of body
+/** @internal @This is called by http_parser when receiving fragments of body.
+ * The fragment is output as a reference to the received buffer, without
+ * copying it.
+ *
  * @param parser http parser structure
  * @param at data buffer
  * @param len data length
@@ -203,8 +302,6 @@ static int upipe_http_src_body_cb(http_parser *parser, const char *at, size_t le
     struct upipe *upipe = upipe_http_src_to_upipe(upipe_http_src);
     struct uref *uref;
     uint64_t systime = 0;
-    uint8_t *buf = NULL;
-    int size;
 
     /* fetch systime */
     if (likely(upipe_http_src->uclock)) {
@@ -212,19 +309,17 @@ static int upipe_http_src_body_cb(http_parser *parser, const char *at, size_t le
     }
 
     upipe_dbg_va(upipe, "received %zu bytes of body", len);
+    upipe_http_src->received = true;
+    if (unlikely(upipe_http_src->recv_uref == NULL))
+        return 0;
 
-    /* alloc, map, copy, unmap */
-    uref = uref_block_alloc(upipe_http_src->uref_mgr,
-                            upipe_http_src->ubuf_mgr, len);
+    uref = uref_block_splice(upipe_http_src->recv_uref,
+                             (const uint8_t *)at - upipe_http_src->recv_buffer,
+                             len);
     if (unlikely(!uref)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return 0;
     }
-    size = -1;
-    uref_block_write(uref, 0, &size, &buf);
-    assert(len == size);
-    memcpy(buf, at, len);
-    uref_block_unmap(uref, 0);
 
     uref_clock_set_cr_sys(uref, systime);
     upipe_use(upipe);
@@ -235,6 +330,339 @@ static int upipe_http_src_body_cb(http_parser *parser, const char *at, size_t le
     return 0;
 }
 
+/** @internal @This is called by http_parser when a response begins.
+ *
+ * @param parser http parser structure
+ * @return 0
+ */
+static int upipe_http_src_message_begin_cb(http_parser *parser)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_parser(parser);
+    upipe_http_src->received = true;
+    return 0;
+}
+
+/** @internal @This is called by http_parser when a response is complete.
+ * The end is handled after the parser returns, so that the pipe may be
+ * given a new url from the source end event.
+ *
+ * @param parser http parser structure
+ * @return 0
+ */
+static int upipe_http_src_message_complete_cb(http_parser *parser)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_parser(parser);
+    upipe_http_src->complete = true;
+    upipe_http_src->keep_alive = http_should_keep_alive(parser);
+    return 0;
+}
+
+/** @internal @This releases a name resolution.
+ *
+ * @param resolver pointer to the resolution context
+ */
+static void upipe_http_src_resolver_release(
+        struct upipe_http_src_resolver *resolver)
+{
+    pthread_mutex_lock(&resolver->mutex);
+    bool last = !--resolver->refcount;
+    pthread_mutex_unlock(&resolver->mutex);
+    if (!last)
+        return;
+
+    if (resolver->info != NULL)
+        freeaddrinfo(resolver->info);
+    free(resolver->host);
+    free(resolver->service);
+    ueventfd_clean(&resolver->event);
+    pthread_mutex_destroy(&resolver->mutex);
+    free(resolver);
+}
+
+/** @internal @This is the main function of the resolver thread. The thread
+ * is detached, and the last of the pipe and the thread to release the
+ * context frees it, so that the pipe never waits for the resolution.
+ *
+ * @param _resolver pointer to the resolution context
+ * @return NULL
+ */
+static void *upipe_http_src_resolver_thread(void *_resolver)
+{
+    struct upipe_http_src_resolver *resolver =
+        (struct upipe_http_src_resolver *)_resolver;
+    struct addrinfo hints, *info = NULL;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = 0;
+    int ret = getaddrinfo(resolver->host, resolver->service, &hints, &info);
+
+    pthread_mutex_lock(&resolver->mutex);
+    resolver->ret = ret;
+    resolver->info = ret ? NULL : info;
+    pthread_mutex_unlock(&resolver->mutex);
+    ueventfd_write(&resolver->event);
+    upipe_http_src_resolver_release(resolver);
+    return NULL;
+}
+
+/** @internal @This closes the connection and cancels any pending
+ * operation.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_src_close(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    upipe_http_src_set_upump(upipe, NULL);
+    if (upipe_http_src->resolver != NULL) {
+        upipe_http_src_resolver_release(upipe_http_src->resolver);
+        upipe_http_src->resolver = NULL;
+    }
+    if (upipe_http_src->info != NULL) {
+        freeaddrinfo(upipe_http_src->info);
+        upipe_http_src->info = NULL;
+    }
+    if (upipe_http_src->fd != -1) {
+        if (likely(upipe_http_src->conn_host != NULL))
+            upipe_dbg_va(upipe, "closing connection to %s",
+                         upipe_http_src->conn_host);
+        close(upipe_http_src->fd);
+        upipe_http_src->fd = -1;
+    }
+    free(upipe_http_src->conn_host);
+    free(upipe_http_src->conn_service);
+    upipe_http_src->conn_host = NULL;
+    upipe_http_src->conn_service = NULL;
+    upipe_http_src->state = UPIPE_HTTP_SRC_NONE;
+}
+
+/** @internal @This starts the resolution of the host of the url on a
+ * resolver thread.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_http_src_resolve(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    struct upipe_http_src_resolver *resolver =
+        malloc(sizeof(struct upipe_http_src_resolver));
+    UBASE_ALLOC_RETURN(resolver)
+    resolver->host = strdup(upipe_http_src->host);
+    resolver->service = strdup(upipe_http_src->service);
+    resolver->info = NULL;
+    resolver->ret = 0;
+    if (unlikely(resolver->host == NULL || resolver->service == NULL ||
+                 !ueventfd_init(&resolver->event, false))) {
+        free(resolver->host);
+        free(resolver->service);
+        free(resolver);
+        return UBASE_ERR_ALLOC;
+    }
+    pthread_mutex_init(&resolver->mutex, NULL);
+    resolver->refcount = 2;
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&thread, &attr, upipe_http_src_resolver_thread,
+                             resolver);
+    pthread_attr_destroy(&attr);
+    if (unlikely(ret != 0)) {
+        resolver->refcount = 1;
+        upipe_http_src_resolver_release(resolver);
+        upipe_err(upipe, "can't create resolver thread");
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    upipe_http_src->resolver = resolver;
+    upipe_http_src->state = UPIPE_HTTP_SRC_RESOLVING;
+    upipe_http_src->reused = false;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This ends the current url, either on error or at the end of
+ * the response.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_src_end(struct upipe *upipe)
+{
+    upipe_http_src_set_upump(upipe, NULL);
+    upipe_throw_source_end(upipe);
+}
+
+/** @internal @This builds and sends a GET request
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_http_src_send_request(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    const char *url = upipe_http_src->url;
+    struct http_parser_url parsed_url;
+    const char *target = "/";
+    int target_len = 1;
+    if (http_parser_parse_url(url, strlen(url), 0, &parsed_url) == 0 &&
+        (parsed_url.field_set & (1 << UF_PATH))) {
+        target = url + parsed_url.field_data[UF_PATH].off;
+        target_len = parsed_url.field_data[UF_PATH].len;
+        if (parsed_url.field_set & (1 << UF_QUERY))
+            target_len = parsed_url.field_data[UF_QUERY].off +
+                parsed_url.field_data[UF_QUERY].len -
+                parsed_url.field_data[UF_PATH].off;
+    }
+    bool port = strcmp(upipe_http_src->service, "http");
+    int len, ret;
+    char req[strlen(get_request_format) + target_len +
+             strlen(upipe_http_src->host) + strlen(upipe_http_src->service) +
+             strlen(USER_AGENT) + 1];
+
+    /* build get request */
+    len = snprintf(req, sizeof(req), get_request_format, target_len, target,
+                   upipe_http_src->host, port ? ":" : "",
+                   port ? upipe_http_src->service : "", USER_AGENT);
+
+    ret = send(upipe_http_src->fd, req, len, MSG_NOSIGNAL);
+
+    if (ret < 0) {
+        switch(errno) {
+            case EINTR:
+            case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+            case EWOULDBLOCK:
+#endif
+                /* try again later */
+                return UBASE_ERR_EXTERNAL;
+
+            case EBADF:
+            case EINVAL:
+            default:
+                upipe_err_va(upipe, "error sending request (%s)", strerror(errno));
+                return UBASE_ERR_EXTERNAL;
+        }
+    }
+
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sends the request on the connected socket, and starts
+ * reading the response.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_http_src_request(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    upipe_http_src_set_upump(upipe, NULL);
+    http_parser_init(&upipe_http_src->parser, HTTP_RESPONSE);
+    upipe_http_src->received = false;
+    upipe_http_src->complete = false;
+    upipe_http_src->keep_alive = false;
+    /* FIXME: build write pump */
+    UBASE_RETURN(upipe_http_src_send_request(upipe))
+    upipe_http_src->state = UPIPE_HTTP_SRC_READING;
+    return upipe_http_src_check(upipe, NULL);
+}
+
+/** @internal @This connects to the first working address, starting from
+ * the next untried one.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_src_connect(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    upipe_http_src_set_upump(upipe, NULL);
+
+    struct addrinfo *res;
+    while ((res = upipe_http_src->next_addr) != NULL) {
+        upipe_http_src->next_addr = res->ai_next;
+        int fd = socket(res->ai_family,
+                        res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        res->ai_protocol);
+        if (unlikely(fd < 0))
+            continue;
+        if (connect(fd, res->ai_addr, res->ai_addrlen) == 0 ||
+            errno == EINPROGRESS) {
+            upipe_http_src->fd = fd;
+            upipe_http_src->state = UPIPE_HTTP_SRC_CONNECTING;
+            upipe_http_src_check(upipe, NULL);
+            return;
+        }
+        close(fd);
+    }
+
+    upipe_err(upipe, "could not connect to any ressource");
+    upipe_http_src_close(upipe);
+    upipe_http_src_end(upipe);
+}
+
+/** @internal @This is called when the socket is connected, or failed to.
+ *
+ * @param upump description structure of the write watcher
+ */
+static void upipe_http_src_connected(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (unlikely(getsockopt(upipe_http_src->fd, SOL_SOCKET, SO_ERROR,
+                            &error, &error_len) == -1))
+        error = errno;
+    if (unlikely(error != 0)) {
+        upipe_dbg_va(upipe, "connection failed (%s)", strerror(error));
+        close(upipe_http_src->fd);
+        upipe_http_src->fd = -1;
+        upipe_http_src_connect(upipe);
+        return;
+    }
+
+    freeaddrinfo(upipe_http_src->info);
+    upipe_http_src->info = NULL;
+    upipe_http_src->next_addr = NULL;
+    upipe_http_src->conn_host = strdup(upipe_http_src->host);
+    upipe_http_src->conn_service = strdup(upipe_http_src->service);
+    if (unlikely(!ubase_check(upipe_http_src_request(upipe)))) {
+        upipe_http_src_close(upipe);
+        upipe_http_src_end(upipe);
+    }
+}
+
+/** @internal @This is called when the resolver thread is done.
+ *
+ * @param upump description structure of the event watcher
+ */
+static void upipe_http_src_resolved(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    struct upipe_http_src_resolver *resolver = upipe_http_src->resolver;
+    ueventfd_read(&resolver->event);
+
+    pthread_mutex_lock(&resolver->mutex);
+    int ret = resolver->ret;
+    upipe_http_src->info = resolver->info;
+    resolver->info = NULL;
+    pthread_mutex_unlock(&resolver->mutex);
+    upipe_http_src_resolver_release(resolver);
+    upipe_http_src->resolver = NULL;
+
+    if (unlikely(ret)) {
+        upipe_err_va(upipe, "%s", gai_strerror(ret));
+        upipe_http_src_close(upipe);
+        upipe_http_src_end(upipe);
+        return;
+    }
+    upipe_http_src->next_addr = upipe_http_src->info;
+    upipe_http_src_connect(upipe);
+}
+
 /** @internal @This reads data from the source and outputs it.
  * It is called either when the idler triggers (permanent storage mode) or
  * when data is available on the http descriptor (live stream mode).
@@ -245,14 +673,26 @@ static void upipe_http_src_worker(struct upump *upump)
 {
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
-    char *buffer = malloc(upipe_http_src->read_size); /* FIXME use ubuf/umem */
-    assert(buffer);
-    memset(buffer, 0, upipe_http_src->read_size);
+    struct uref *uref = uref_block_alloc(upipe_http_src->uref_mgr,
+                                         upipe_http_src->ubuf_mgr,
+                                         upipe_http_src->read_size);
+    if (unlikely(uref == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uint8_t *buffer;
+    int size = -1;
+    if (unlikely(!ubase_check(uref_block_write(uref, 0, &size, &buffer)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
 
-    ssize_t len = recv(upipe_http_src->fd, buffer, upipe_http_src->read_size, 0);
+    ssize_t len = recv(upipe_http_src->fd, buffer, size, 0);
+    uref_block_unmap(uref, 0);
 
     if (unlikely(len == -1)) {
-        free(buffer);
+        uref_free(uref);
 
         switch (errno) {
             case EINTR:
@@ -268,24 +708,82 @@ static void upipe_http_src_worker(struct upump *upump)
             default:
                 break;
         }
+        if (upipe_http_src->reused && !upipe_http_src->received) {
+            /* the server closed the kept-alive connection, retry */
+            upipe_dbg_va(upipe, "retrying %s (%m)", upipe_http_src->url);
+            upipe_http_src_close(upipe);
+            if (unlikely(!ubase_check(upipe_http_src_resolve(upipe))))
+                upipe_http_src_end(upipe);
+            else
+                upipe_http_src_check(upipe, NULL);
+            return;
+        }
         upipe_err_va(upipe, "read error from %s (%s)", upipe_http_src->url,
                                                               strerror(errno));
-        upipe_http_src_set_upump(upipe, NULL);
-        upipe_throw_source_end(upipe);
+        upipe_http_src_close(upipe);
+        upipe_http_src_end(upipe);
         return;
     }
     if (unlikely(len == 0)) {
-        free(buffer);
+        uref_free(uref);
+        if (upipe_http_src->reused && !upipe_http_src->received) {
+            /* the server closed the kept-alive connection, retry */
+            upipe_dbg_va(upipe, "retrying %s", upipe_http_src->url);
+            upipe_http_src_close(upipe);
+            if (unlikely(!ubase_check(upipe_http_src_resolve(upipe))))
+                upipe_http_src_end(upipe);
+            else
+                upipe_http_src_check(upipe, NULL);
+            return;
+        }
+        /* signal the end of a response without length */
+        upipe_use(upipe);
+        http_parser_execute(&upipe_http_src->parser,
+                            &upipe_http_src->parser_settings, NULL, 0);
         upipe_notice_va(upipe, "end of %s", upipe_http_src->url);
-        upipe_http_src_set_upump(upipe, NULL);
-        upipe_throw_source_end(upipe);
+        upipe_http_src_close(upipe);
+        upipe_http_src_end(upipe);
+        upipe_release(upipe);
         return;
     }
 
-    /* parse response */
-    http_parser_execute(&upipe_http_src->parser,
-                        &upipe_http_src->parser_settings, buffer, len);
-    free(buffer);
+    /* parse response, body fragments are spliced from the buffer */
+    const uint8_t *read_buffer;
+    size = len;
+    if (unlikely(!ubase_check(uref_block_read(uref, 0, &size,
+                                              &read_buffer)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    upipe_use(upipe);
+    upipe_http_src->recv_uref = uref;
+    upipe_http_src->recv_buffer = read_buffer;
+    size_t parsed = http_parser_execute(&upipe_http_src->parser,
+                                        &upipe_http_src->parser_settings,
+                                        (const char *)read_buffer, size);
+    upipe_http_src->recv_uref = NULL;
+    upipe_http_src->recv_buffer = NULL;
+    uref_block_unmap(uref, 0);
+    uref_free(uref);
+    len = size;
+    if (unlikely(parsed != len && !upipe_http_src->complete)) {
+        upipe_err_va(upipe, "invalid response from %s (%s)",
+                     upipe_http_src->url,
+                     http_errno_description(
+                         HTTP_PARSER_ERRNO(&upipe_http_src->parser)));
+        upipe_http_src_close(upipe);
+        upipe_http_src_end(upipe);
+    } else if (upipe_http_src->complete) {
+        upipe_notice_va(upipe, "end of %s", upipe_http_src->url);
+        if (upipe_http_src->keep_alive) {
+            upipe_http_src_set_upump(upipe, NULL);
+            upipe_http_src->state = UPIPE_HTTP_SRC_IDLE;
+        } else
+            upipe_http_src_close(upipe);
+        upipe_http_src_end(upipe);
+    }
+    upipe_release(upipe);
 }
 
 /** @internal @This checks if the pump may be allocated.
@@ -325,11 +823,27 @@ static int upipe_http_src_check(struct upipe *upipe, struct uref *flow_format)
             != NULL)
         return UBASE_ERR_NONE;
 
-    if (upipe_http_src->fd != -1 && upipe_http_src->upump == NULL) {
+    if (upipe_http_src->upump == NULL) {
         struct upump *upump;
-        upump = upump_alloc_fd_read(upipe_http_src->upump_mgr,
-                                    upipe_http_src_worker, upipe,
-                                    upipe_http_src->fd);
+        switch (upipe_http_src->state) {
+            case UPIPE_HTTP_SRC_RESOLVING:
+                upump = ueventfd_upump_alloc(&upipe_http_src->resolver->event,
+                                             upipe_http_src->upump_mgr,
+                                             upipe_http_src_resolved, upipe);
+                break;
+            case UPIPE_HTTP_SRC_CONNECTING:
+                upump = upump_alloc_fd_write(upipe_http_src->upump_mgr,
+                                             upipe_http_src_connected, upipe,
+                                             upipe_http_src->fd);
+                break;
+            case UPIPE_HTTP_SRC_READING:
+                upump = upump_alloc_fd_read(upipe_http_src->upump_mgr,
+                                            upipe_http_src_worker, upipe,
+                                            upipe_http_src->fd);
+                break;
+            default:
+                return UBASE_ERR_NONE;
+        }
         if (unlikely(upump == NULL)) {
             upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
             return UBASE_ERR_UPUMP;
@@ -354,134 +868,49 @@ static int upipe_http_src_get_uri(struct upipe *upipe, const char **url_p)
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This asks to open the given http (real code here).
+/** @internal @This extracts the host and service of a url.
  *
  * @param upipe description structure of the pipe
  * @param url relative or absolute url of the http
- * @return socket fd or -1 in case of error
+ * @return an error code
  */
-static int upipe_http_src_open_url(struct upipe *upipe, const char *url)
+static int upipe_http_src_parse_url(struct upipe *upipe, const char *url)
 {
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
-    http_parser *parser = &upipe_http_src->parser;
-    http_parser_settings *settings = &upipe_http_src->parser_settings;
     struct http_parser_url parsed_url;
 
-    struct addrinfo *info = NULL, *res;
-    struct addrinfo hints;
-    char *host, *service;
-    int ret, fd = -1;
-
     /* check url size */
     if (unlikely(strnlen(url, MAX_URL_SIZE + 1) > MAX_URL_SIZE)) {
         upipe_err(upipe, "url too large, something's fishy");
-        return -1;
+        return UBASE_ERR_INVALID;
     }
 
-    /* init parser and settings */
-    http_parser_init(parser, HTTP_RESPONSE);
-    settings->on_message_begin = NULL;
-	settings->on_url = NULL;
-	settings->on_header_field = NULL;
-	settings->on_header_value = NULL;
-	settings->on_headers_complete = NULL;
-	settings->on_body = upipe_http_src_body_cb;
-	settings->on_message_complete = NULL;
-
     /* parse url */
-    ret = http_parser_parse_url(url, strlen(url), 0, &parsed_url);
-    if (unlikely(ret != 0)) {
-        return -1;
-    }
-    if (unlikely(!(parsed_url.field_set & (1 << UF_HOST)))) {
-        return -1;
-    }
-    host = strndup(url + parsed_url.field_data[UF_HOST].off,
-                                    parsed_url.field_data[UF_HOST].len);
-
-    if (parsed_url.field_set & (1 <<UF_PORT)) {
-        service = strndup(url + parsed_url.field_data[UF_PORT].off,
-                                    parsed_url.field_data[UF_HOST].len);
-    } else {
-        service = strdup("http");
-    }
-
-    /* get socket information */
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = PF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = 0;
-    ret = getaddrinfo(host, service, &hints, &info);
-    if (unlikely(ret)) {
-        upipe_err_va(upipe, "%s", gai_strerror(ret));
-        free(host);
-        free(service);
-        return -1;
-    }
-    free(host);
-    free(service);
-
-    /* connect to first working ressource */
-    for (res = info; res; res = res->ai_next) {
-        fd = socket(res->ai_family, res->ai_socktype,
-                                          res->ai_protocol);
-        if (likely(fd > 0)) {
-            if (connect(fd, res->ai_addr, res->ai_addrlen) == 0) {
-                break;
-            }
-            close(fd);
-            fd = -1;
-        }
-    }
-    if (fd < 0) {
-        upipe_err(upipe, "could not connect to any ressource");
-        freeaddrinfo(info);
-        return -1;
-    }
-    freeaddrinfo(info);
-
-    return fd;
-}
-
-/** @internal @This builds and sends a GET request
- *
- * @param upipe description structure of the pipe
- * @return an error code
- */
-static int upipe_http_src_send_request(struct upipe *upipe)
-{
-    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
-    const char *url = upipe_http_src->url;
-    int len, ret;
-    char req[strlen(get_request_format)+strlen(url)+strlen(USER_AGENT)+1];
-
-    /* build get request */
-    len = snprintf(req, sizeof(req), get_request_format, url, USER_AGENT); 
-
-    ret = send(upipe_http_src->fd, req, len, 0);
-
-    if (ret < 0) {
-        switch(errno) {
-            case EINTR:
-            case EAGAIN:
-#if EAGAIN != EWOULDBLOCK
-            case EWOULDBLOCK:
-#endif
-                /* try again later */
-                return UBASE_ERR_EXTERNAL;
-
-            case EBADF:
-            case EINVAL:
-            default:
-                upipe_err_va(upipe, "error sending request (%s)", strerror(errno));
-                return UBASE_ERR_EXTERNAL;
-        }
-    }
-    
+    if (unlikely(http_parser_parse_url(url, strlen(url), 0, &parsed_url) != 0))
+        return UBASE_ERR_INVALID;
+    if (unlikely(!(parsed_url.field_set & (1 << UF_HOST))))
+        return UBASE_ERR_INVALID;
+
+    free(upipe_http_src->host);
+    free(upipe_http_src->service);
+    upipe_http_src->host = strndup(url + parsed_url.field_data[UF_HOST].off,
+                                   parsed_url.field_data[UF_HOST].len);
+    if (parsed_url.field_set & (1 << UF_PORT))
+        upipe_http_src->service =
+            strndup(url + parsed_url.field_data[UF_PORT].off,
+                    parsed_url.field_data[UF_PORT].len);
+    else
+        upipe_http_src->service = strdup("http");
+    if (unlikely(upipe_http_src->host == NULL ||
+                 upipe_http_src->service == NULL))
+        return UBASE_ERR_ALLOC;
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This asks to open the given http.
+/** @internal @This asks to open the given http. If the connection of the
+ * previous url was kept alive by the same server, it is reused. Otherwise the
+ * name resolution and connection are done asynchronously, and errors are
+ * reported by a source end event.
  *
  * @param upipe description structure of the pipe
  * @param url relative or absolute url of the http
@@ -491,42 +920,48 @@ static int upipe_http_src_set_uri(struct upipe *upipe, const char *url)
 {
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
 
-    if (unlikely(upipe_http_src->fd != -1)) {
-        if (likely(upipe_http_src->url != NULL))
-            upipe_notice_va(upipe, "closing %s", upipe_http_src->url);
-        close(upipe_http_src->fd);
-        upipe_http_src->fd = -1;
-    }
+    if (likely(upipe_http_src->url != NULL))
+        upipe_notice_va(upipe, "closing %s", upipe_http_src->url);
     free(upipe_http_src->url);
     upipe_http_src->url = NULL;
     upipe_http_src_set_upump(upipe, NULL);
 
-    if (unlikely(url == NULL))
+    if (unlikely(url == NULL)) {
+        upipe_http_src_close(upipe);
         return UBASE_ERR_NONE;
+    }
 
-    /* now call real code */
-    upipe_http_src->fd = upipe_http_src_open_url(upipe ,url);
-    if (unlikely(upipe_http_src->fd < 0)) {
+    int err = upipe_http_src_parse_url(upipe, url);
+    if (unlikely(!ubase_check(err))) {
+        upipe_http_src_close(upipe);
         upipe_err_va(upipe, "can't open url %s", url);
-        return UBASE_ERR_EXTERNAL;
+        return err;
     }
 
     /* keep url in memory */
     upipe_http_src->url = strdup(url);
     if (unlikely(upipe_http_src->url == NULL)) {
-        close(upipe_http_src->fd);
-        upipe_http_src->fd = -1;
+        upipe_http_src_close(upipe);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return UBASE_ERR_ALLOC;
     }
     upipe_notice_va(upipe, "opening url %s", upipe_http_src->url);
 
-    int err;
-    if (unlikely((err = upipe_http_src_send_request(upipe)) !=
-                 UBASE_ERR_NONE)) {
-        /* FIXME: build write pump */
-        close(upipe_http_src->fd);
-        upipe_http_src->fd = -1;
+    upipe_http_src->reused =
+        upipe_http_src->state == UPIPE_HTTP_SRC_IDLE &&
+        !strcmp(upipe_http_src->conn_host, upipe_http_src->host) &&
+        !strcmp(upipe_http_src->conn_service, upipe_http_src->service);
+    if (upipe_http_src->reused) {
+        upipe_dbg_va(upipe, "reusing connection to %s", upipe_http_src->host);
+        if (likely(ubase_check(upipe_http_src_request(upipe))))
+            return UBASE_ERR_NONE;
+        upipe_http_src->reused = false;
+    }
+
+    upipe_http_src_close(upipe);
+    err = upipe_http_src_resolve(upipe);
+    if (unlikely(!ubase_check(err))) {
+        upipe_err_va(upipe, "can't open url %s", url);
         return err;
     }
     return UBASE_ERR_NONE;
@@ -609,14 +1044,14 @@ static int upipe_http_src_control(struct upipe *upipe,
 static void upipe_http_src_free(struct upipe *upipe)
 {
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
-    if (likely(upipe_http_src->fd != -1)) {
-        if (likely(upipe_http_src->url != NULL))
-            upipe_notice_va(upipe, "closing %s", upipe_http_src->url);
-        close(upipe_http_src->fd);
-    }
+    if (likely(upipe_http_src->url != NULL))
+        upipe_notice_va(upipe, "closing %s", upipe_http_src->url);
+    upipe_http_src_close(upipe);
     upipe_throw_dead(upipe);
 
     free(upipe_http_src->url);
+    free(upipe_http_src->host);
+    free(upipe_http_src->service);
     upipe_http_src_clean_read_size(upipe);
     upipe_http_src_clean_uclock(upipe);
     upipe_http_src_clean_upump(upipe);
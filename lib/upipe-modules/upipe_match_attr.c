@@ -32,6 +32,8 @@
 #include <upipe/uref.h>
 #include <upipe/uref.h>
 #include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_attr.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -42,12 +44,15 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
 
 enum upipe_match_attr_type {
     UPIPE_MATCH_ATTR_NONE,
     UPIPE_MATCH_ATTR_UINT8_T,
     UPIPE_MATCH_ATTR_UINT64_T,
+    UPIPE_MATCH_ATTR_KEY_INTERVAL,
+    UPIPE_MATCH_ATTR_PREDICATES,
 };
 
 /** @internal @This is the private context of a match_attr pipe. */
@@ -74,6 +79,14 @@ struct upipe_match_attr {
     uint64_t min;
     /** max */
     uint64_t max;
+    /** minimum interval between random access points */
+    uint64_t interval;
+    /** program date of the last forwarded random access point */
+    uint64_t last_date;
+    /** array of predicates, followed by the copies of their names */
+    struct upipe_match_attr_predicate *predicates;
+    /** number of predicates */
+    unsigned int nb_predicates;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -84,6 +97,103 @@ UPIPE_HELPER_UREFCOUNT(upipe_match_attr, urefcount, upipe_match_attr_free)
 UPIPE_HELPER_VOID(upipe_match_attr)
 UPIPE_HELPER_OUTPUT(upipe_match_attr, output, flow_def, output_state, request_list)
 
+/** @internal @This checks whether a uref is a random access point far enough
+ * from the previously forwarded one.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @return an error code
+ */
+static int upipe_match_attr_key_interval(struct upipe *upipe,
+                                         struct uref *uref)
+{
+    struct upipe_match_attr *upipe_match_attr =
+        upipe_match_attr_from_upipe(upipe);
+    UBASE_RETURN(uref_flow_get_random(uref))
+
+    uint64_t date;
+    if (!ubase_check(uref_clock_get_dts_prog(uref, &date)) &&
+        !ubase_check(uref_clock_get_pts_prog(uref, &date)))
+        return UBASE_ERR_NONE;
+
+    if (upipe_match_attr->last_date != UINT64_MAX &&
+        date >= upipe_match_attr->last_date &&
+        date < upipe_match_attr->last_date + upipe_match_attr->interval)
+        return UBASE_ERR_INVALID;
+
+    upipe_match_attr->last_date = date;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This checks whether a uref matches all predicates.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @return an error code
+ */
+static int upipe_match_attr_check_predicates(struct upipe *upipe,
+                                             struct uref *uref)
+{
+    struct upipe_match_attr *upipe_match_attr =
+        upipe_match_attr_from_upipe(upipe);
+    if (uref->udict == NULL)
+        return upipe_match_attr->nb_predicates ? UBASE_ERR_INVALID :
+                                                 UBASE_ERR_NONE;
+
+    for (unsigned int i = 0; i < upipe_match_attr->nb_predicates; i++) {
+        const struct upipe_match_attr_predicate *predicate =
+            &upipe_match_attr->predicates[i];
+        struct udict *udict = uref->udict;
+        enum udict_type type = predicate->type;
+        const char *name = predicate->name;
+        uint64_t uvalue;
+        int64_t ivalue;
+        bool signed_value = false;
+
+        switch (predicate->value) {
+            case UPIPE_MATCH_ATTR_VALUE_VOID:
+                UBASE_RETURN(udict_get(udict, name, type, NULL, NULL))
+                continue;
+            case UPIPE_MATCH_ATTR_VALUE_BOOL: {
+                bool v;
+                UBASE_RETURN(udict_get_bool(udict, &v, type, name))
+                uvalue = v ? 1 : 0;
+                break;
+            }
+            case UPIPE_MATCH_ATTR_VALUE_SMALL_UNSIGNED: {
+                uint8_t v;
+                UBASE_RETURN(udict_get_small_unsigned(udict, &v, type, name))
+                uvalue = v;
+                break;
+            }
+            case UPIPE_MATCH_ATTR_VALUE_SMALL_INT: {
+                int8_t v;
+                UBASE_RETURN(udict_get_small_int(udict, &v, type, name))
+                ivalue = v;
+                signed_value = true;
+                break;
+            }
+            case UPIPE_MATCH_ATTR_VALUE_UNSIGNED:
+                UBASE_RETURN(udict_get_unsigned(udict, &uvalue, type, name))
+                break;
+            case UPIPE_MATCH_ATTR_VALUE_INT:
+                UBASE_RETURN(udict_get_int(udict, &ivalue, type, name))
+                signed_value = true;
+                break;
+            default:
+                return UBASE_ERR_INVALID;
+        }
+
+        if (signed_value) {
+            if (ivalue < (int64_t)predicate->min ||
+                ivalue > (int64_t)predicate->max)
+                return UBASE_ERR_INVALID;
+        } else if (uvalue < predicate->min || uvalue > predicate->max)
+            return UBASE_ERR_INVALID;
+    }
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This receives data.
  *
  * @param upipe description structure of the pipe
@@ -112,6 +222,12 @@ static void upipe_match_attr_input(struct upipe *upipe, struct uref *uref,
             }
             break;
         }
+        case UPIPE_MATCH_ATTR_KEY_INTERVAL:
+            forward = upipe_match_attr_key_interval(upipe, uref);
+            break;
+        case UPIPE_MATCH_ATTR_PREDICATES:
+            forward = upipe_match_attr_check_predicates(upipe, uref);
+            break;
         case UPIPE_MATCH_ATTR_NONE:
         default:
             break;
@@ -142,6 +258,55 @@ static int upipe_match_attr_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This copies a list of predicates.
+ *
+ * @param upipe description structure of the pipe
+ * @param predicates array of predicates
+ * @param nb number of predicates in the array
+ * @return an error code
+ */
+static int _upipe_match_attr_set_predicates(struct upipe *upipe,
+        const struct upipe_match_attr_predicate *predicates, unsigned int nb)
+{
+    struct upipe_match_attr *upipe_match_attr =
+        upipe_match_attr_from_upipe(upipe);
+    if (unlikely(nb && predicates == NULL))
+        return UBASE_ERR_INVALID;
+
+    size_t size = nb * sizeof(struct upipe_match_attr_predicate);
+    for (unsigned int i = 0; i < nb; i++) {
+        if (predicates[i].value > UPIPE_MATCH_ATTR_VALUE_INT ||
+            (predicates[i].name == NULL &&
+             predicates[i].type <= UDICT_TYPE_SHORTHAND))
+            return UBASE_ERR_INVALID;
+        if (predicates[i].name != NULL)
+            size += strlen(predicates[i].name) + 1;
+    }
+
+    struct upipe_match_attr_predicate *copy = NULL;
+    if (nb) {
+        copy = malloc(size);
+        if (unlikely(copy == NULL))
+            return UBASE_ERR_ALLOC;
+        memcpy(copy, predicates, nb * sizeof(struct upipe_match_attr_predicate));
+        char *names = (char *)(copy + nb);
+        for (unsigned int i = 0; i < nb; i++) {
+            if (copy[i].name == NULL)
+                continue;
+            size_t len = strlen(copy[i].name) + 1;
+            memcpy(names, copy[i].name, len);
+            copy[i].name = names;
+            names += len;
+        }
+    }
+
+    free(upipe_match_attr->predicates);
+    upipe_match_attr->predicates = copy;
+    upipe_match_attr->nb_predicates = nb;
+    upipe_match_attr->mode = UPIPE_MATCH_ATTR_PREDICATES;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a match_attr pipe.
  *
  * @param upipe description structure of the pipe
@@ -199,6 +364,20 @@ static int upipe_match_attr_control(struct upipe *upipe,
             upipe_match_attr->max = va_arg(args, uint64_t);
             return UBASE_ERR_NONE;
         }
+        case UPIPE_MATCH_ATTR_SET_KEY_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_MATCH_ATTR_SIGNATURE)
+            upipe_match_attr->interval = va_arg(args, uint64_t);
+            upipe_match_attr->last_date = UINT64_MAX;
+            upipe_match_attr->mode = UPIPE_MATCH_ATTR_KEY_INTERVAL;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_MATCH_ATTR_SET_PREDICATES: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_MATCH_ATTR_SIGNATURE)
+            const struct upipe_match_attr_predicate *predicates =
+                va_arg(args, const struct upipe_match_attr_predicate *);
+            unsigned int nb = va_arg(args, unsigned int);
+            return _upipe_match_attr_set_predicates(upipe, predicates, nb);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -228,6 +407,10 @@ static struct upipe *upipe_match_attr_alloc(struct upipe_mgr *mgr,
     upipe_match_attr->match_uint8_t = NULL;
     upipe_match_attr->match_uint64_t = NULL;
     upipe_match_attr->mode = UPIPE_MATCH_ATTR_NONE;
+    upipe_match_attr->interval = 0;
+    upipe_match_attr->last_date = UINT64_MAX;
+    upipe_match_attr->predicates = NULL;
+    upipe_match_attr->nb_predicates = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -238,8 +421,12 @@ static struct upipe *upipe_match_attr_alloc(struct upipe_mgr *mgr,
  */
 static void upipe_match_attr_free(struct upipe *upipe)
 {
+    struct upipe_match_attr *upipe_match_attr =
+        upipe_match_attr_from_upipe(upipe);
     upipe_throw_dead(upipe);
 
+    free(upipe_match_attr->predicates);
+
     upipe_match_attr_clean_output(upipe);
     upipe_match_attr_clean_urefcount(upipe);
     upipe_match_attr_free_void(upipe);
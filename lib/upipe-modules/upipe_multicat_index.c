@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe index of multicat archives
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_multicat_index.h>
+#include <upipe-modules/upipe_file_source.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+/** flag set in the offset field of random access points */
+#define RANDOM_FLAG UINT64_C(0x8000000000000000)
+
+/** @internal @This writes a 64-bit big-endian value.
+ *
+ * @param p pointer to the buffer
+ * @param value value to write
+ */
+static inline void upipe_multicat_index_set64(uint8_t *p, uint64_t value)
+{
+    for (int i = 7; i >= 0; i--) {
+        p[i] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+/** @internal @This reads a 64-bit big-endian value.
+ *
+ * @param p pointer to the buffer
+ * @return value read
+ */
+static inline uint64_t upipe_multicat_index_get64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+/** @internal @This reads the entry of the given number.
+ *
+ * @param fd file descriptor of the index
+ * @param nb number of the entry
+ * @param entry_p filled in with the entry
+ * @return an error code
+ */
+static int upipe_multicat_index_read(int fd, uint64_t nb,
+                                     struct upipe_multicat_index_entry *entry_p)
+{
+    uint8_t buffer[UPIPE_MULTICAT_INDEX_SIZE];
+    if (unlikely(pread(fd, buffer, UPIPE_MULTICAT_INDEX_SIZE,
+                       nb * UPIPE_MULTICAT_INDEX_SIZE) !=
+                 UPIPE_MULTICAT_INDEX_SIZE))
+        return UBASE_ERR_EXTERNAL;
+    entry_p->date = upipe_multicat_index_get64(buffer);
+    entry_p->fileidx = upipe_multicat_index_get64(buffer + 8);
+    uint64_t offset = upipe_multicat_index_get64(buffer + 16);
+    entry_p->offset = offset & ~RANDOM_FLAG;
+    entry_p->random = !!(offset & RANDOM_FLAG);
+    return UBASE_ERR_NONE;
+}
+
+/** @This appends an entry to an index file.
+ *
+ * @param fd file descriptor of the index, opened for writing
+ * @param entry entry to write
+ * @return an error code
+ */
+int upipe_multicat_index_write(int fd,
+                               const struct upipe_multicat_index_entry *entry)
+{
+    uint8_t buffer[UPIPE_MULTICAT_INDEX_SIZE];
+    upipe_multicat_index_set64(buffer, entry->date);
+    upipe_multicat_index_set64(buffer + 8, entry->fileidx);
+    upipe_multicat_index_set64(buffer + 16,
+            entry->offset | (entry->random ? RANDOM_FLAG : 0));
+    if (unlikely(write(fd, buffer, UPIPE_MULTICAT_INDEX_SIZE) !=
+                 UPIPE_MULTICAT_INDEX_SIZE))
+        return UBASE_ERR_EXTERNAL;
+    return UBASE_ERR_NONE;
+}
+
+/** @This looks up the last entry of an index file dated before or at the
+ * given date, with a binary search. Random access points are then searched
+ * backwards from there, which only walks the entries written between two
+ * random access points.
+ *
+ * @param fd file descriptor of the index, opened for reading
+ * @param date system date to look up
+ * @param random if true, only return random access points
+ * @param entry_p filled in with the entry found
+ * @return an error code, UBASE_ERR_INVALID if no entry matches
+ */
+int upipe_multicat_index_lookup(int fd, uint64_t date, bool random,
+                                struct upipe_multicat_index_entry *entry_p)
+{
+    struct stat st;
+    if (unlikely(fstat(fd, &st) == -1))
+        return UBASE_ERR_EXTERNAL;
+
+    /* find the first entry dated after date */
+    uint64_t low = 0, high = st.st_size / UPIPE_MULTICAT_INDEX_SIZE;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        UBASE_RETURN(upipe_multicat_index_read(fd, middle, entry_p))
+        if (entry_p->date <= date)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    while (low > 0) {
+        UBASE_RETURN(upipe_multicat_index_read(fd, --low, entry_p))
+        if (!random || entry_p->random)
+            return UBASE_ERR_NONE;
+    }
+    return UBASE_ERR_INVALID;
+}
+
+/** @This opens in a file source the file of a multicat archive containing
+ * the given date, and sets the reading position to the last random access
+ * point before it.
+ *
+ * @param fsrc description structure of the file source pipe
+ * @param index path of the index file
+ * @param dirpath directory path (or prefix) of the archive
+ * @param suffix file suffix of the archive
+ * @param date system date to seek to
+ * @return an error code
+ */
+int upipe_multicat_index_seek(struct upipe *fsrc, const char *index,
+                              const char *dirpath, const char *suffix,
+                              uint64_t date)
+{
+    int fd = open(index, O_RDONLY | O_CLOEXEC);
+    if (unlikely(fd == -1)) {
+        upipe_err_va(fsrc, "can't open index %s (%m)", index);
+        return UBASE_ERR_EXTERNAL;
+    }
+    struct upipe_multicat_index_entry entry;
+    int err = upipe_multicat_index_lookup(fd, date, true, &entry);
+    close(fd);
+    if (unlikely(!ubase_check(err))) {
+        upipe_warn_va(fsrc, "date %"PRIu64" not found in index %s",
+                      date, index);
+        return err;
+    }
+
+    char path[MAXPATHLEN];
+    snprintf(path, MAXPATHLEN, "%s%"PRId64"%s", dirpath, entry.fileidx,
+             suffix);
+    UBASE_RETURN(upipe_set_uri(fsrc, path))
+    return upipe_fsrc_set_position(fsrc, entry.offset);
+}
@@ -43,6 +43,7 @@
 #include <upipe/upipe_helper_void.h>
 #include <upipe-modules/upipe_multicat_sink.h>
 #include <upipe-modules/upipe_file_sink.h>
+#include <upipe-modules/upipe_multicat_index.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -54,7 +55,9 @@
 #include <errno.h>
 #include <math.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <sys/param.h>
+#include <sys/stat.h>
 
 #define EXPECTED_FLOW_DEF "block."
 
@@ -85,6 +88,19 @@ struct upipe_multicat_sink {
     /** file opening mode */
     enum upipe_fsink_mode mode;
 
+    /** path of the index file, or NULL */
+    char *index_path;
+    /** file descriptor of the index file, or -1 */
+    int index_fd;
+    /** maximum interval between two entries of the index, or 0 */
+    uint64_t index_interval;
+    /** date of the last entry of the index, or UINT64_MAX */
+    uint64_t index_date;
+    /** true if the next uref must be indexed */
+    bool index_next;
+    /** offset of the next uref in the current file */
+    uint64_t offset;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -94,7 +110,7 @@ UPIPE_HELPER_UREFCOUNT(upipe_multicat_sink, urefcount, upipe_multicat_sink_free)
 UPIPE_HELPER_VOID(upipe_multicat_sink)
 
 /** @internal @This generates a path from idx and send set_path to the internal
- * (fsink) output
+ * (fsink) output, then prepares the file of the next index
  *
  * @param upipe description structure of the pipe
  * @param idx new file index
@@ -110,7 +126,55 @@ static bool _upipe_multicat_sink_change_file(struct upipe *upipe, int64_t idx)
         return false;
     }
     snprintf(filepath, MAXPATHLEN, "%s%"PRId64"%s", upipe_multicat_sink->dirpath, idx, upipe_multicat_sink->suffix);
-    return ubase_check(upipe_fsink_set_path(upipe_multicat_sink->fsink, filepath, upipe_multicat_sink->mode));
+    if (unlikely(!ubase_check(upipe_fsink_set_path(upipe_multicat_sink->fsink,
+                                      filepath, upipe_multicat_sink->mode))))
+        return false;
+    struct stat st;
+    upipe_multicat_sink->offset = stat(filepath, &st) != -1 ? st.st_size : 0;
+    upipe_multicat_sink->index_next = true;
+
+    /* open the next file ahead of the rotation, off the pipeline thread */
+    snprintf(filepath, MAXPATHLEN, "%s%"PRId64"%s", upipe_multicat_sink->dirpath, idx + 1, upipe_multicat_sink->suffix);
+    upipe_fsink_prepare_path(upipe_multicat_sink->fsink, filepath,
+                             upipe_multicat_sink->mode);
+    return true;
+}
+
+/** @internal @This writes an index entry for the next uref, if it is the
+ * first of a file, a random access point, or if the maximum interval has
+ * elapsed since the last entry.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param systime system date of the uref
+ */
+static void upipe_multicat_sink_index(struct upipe *upipe, struct uref *uref,
+                                      uint64_t systime)
+{
+    struct upipe_multicat_sink *upipe_multicat_sink = upipe_multicat_sink_from_upipe(upipe);
+    bool random = ubase_check(uref_flow_get_random(uref));
+    uint64_t last = upipe_multicat_sink->index_date;
+    if (last != UINT64_MAX && systime < last)
+        /* the index must stay sorted */
+        return;
+    if (!random && !upipe_multicat_sink->index_next &&
+        (!upipe_multicat_sink->index_interval ||
+         systime - last < upipe_multicat_sink->index_interval))
+        return;
+
+    struct upipe_multicat_index_entry entry;
+    entry.date = systime;
+    entry.fileidx = upipe_multicat_sink->fileidx;
+    entry.offset = upipe_multicat_sink->offset;
+    entry.random = random;
+    if (unlikely(!ubase_check(upipe_multicat_index_write(
+                    upipe_multicat_sink->index_fd, &entry)))) {
+        upipe_warn_va(upipe, "can't write index %s (%m)",
+                      upipe_multicat_sink->index_path);
+        return;
+    }
+    upipe_multicat_sink->index_date = systime;
+    upipe_multicat_sink->index_next = false;
 }
 
 /** @internal @This handles data.
@@ -141,6 +205,12 @@ static void upipe_multicat_sink_input(struct upipe *upipe, struct uref *uref,
         upipe_multicat_sink->fileidx = newidx;
     }
 
+    if (upipe_multicat_sink->index_fd != -1)
+        upipe_multicat_sink_index(upipe, uref, systime);
+    size_t size = 0;
+    uref_block_size(uref, &size);
+    upipe_multicat_sink->offset += size;
+
     upipe_input(upipe_multicat_sink->fsink, uref, upump_p);
 }
 
@@ -233,6 +303,48 @@ static int _upipe_multicat_sink_set_path(struct upipe *upipe, const char *path,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This opens the index file.
+ *
+ * @param upipe description structure of the pipe
+ * @param path path of the index file, or NULL to disable the index
+ * @param interval maximum interval between two entries, or 0
+ * @return an error code
+ */
+static int _upipe_multicat_sink_set_index(struct upipe *upipe,
+                                          const char *path, uint64_t interval)
+{
+    struct upipe_multicat_sink *upipe_multicat_sink = upipe_multicat_sink_from_upipe(upipe);
+    if (upipe_multicat_sink->index_fd != -1) {
+        close(upipe_multicat_sink->index_fd);
+        upipe_multicat_sink->index_fd = -1;
+    }
+    free(upipe_multicat_sink->index_path);
+    upipe_multicat_sink->index_path = NULL;
+    upipe_multicat_sink->index_interval = interval;
+    upipe_multicat_sink->index_date = UINT64_MAX;
+    upipe_multicat_sink->index_next = true;
+    if (path == NULL)
+        return UBASE_ERR_NONE;
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    if (upipe_multicat_sink->mode == UPIPE_FSINK_OVERWRITE)
+        flags |= O_TRUNC;
+    upipe_multicat_sink->index_fd = open(path, flags,
+                                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (unlikely(upipe_multicat_sink->index_fd == -1)) {
+        upipe_err_va(upipe, "can't open index %s (%m)", path);
+        return UBASE_ERR_EXTERNAL;
+    }
+    upipe_multicat_sink->index_path = strdup(path);
+    if (unlikely(upipe_multicat_sink->index_path == NULL)) {
+        close(upipe_multicat_sink->index_fd);
+        upipe_multicat_sink->index_fd = -1;
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_notice_va(upipe, "writing index %s", path);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This changes the rotate interval
  *
  * @param upipe description structure of the pipe
@@ -359,12 +471,25 @@ static int upipe_multicat_sink_control(struct upipe *upipe,
             const char *ext = va_arg(args, const char *);
             return _upipe_multicat_sink_set_path(upipe, path, ext);
         }
+        case UPIPE_MULTICAT_SINK_SET_INDEX: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_MULTICAT_SINK_SIGNATURE)
+            const char *path = va_arg(args, const char *);
+            uint64_t interval = va_arg(args, uint64_t);
+            return _upipe_multicat_sink_set_index(upipe, path, interval);
+        }
         case UPIPE_MULTICAT_SINK_GET_PATH: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_MULTICAT_SINK_SIGNATURE)
             return _upipe_multicat_sink_get_path(upipe, va_arg(args, char **), va_arg(args, char **));
         }
         default:
-            return UBASE_ERR_UNHANDLED;
+            /* forward other commands (for instance file sink commands) to
+             * the fsink subpipe */
+            if (!upipe_multicat_sink->fsink) {
+                if (!upipe_multicat_sink->fsink_mgr)
+                    return UBASE_ERR_UNHANDLED;
+                UBASE_RETURN(_upipe_multicat_sink_output_alloc(upipe));
+            }
+            return upipe_control_va(upipe_multicat_sink->fsink, command, args);
     }
 }
 
@@ -397,6 +522,12 @@ static struct upipe *upipe_multicat_sink_alloc(struct upipe_mgr *mgr,
     upipe_multicat_sink->fileidx = -1;
     upipe_multicat_sink->rotate = UPIPE_MULTICAT_SINK_DEF_ROTATE;
     upipe_multicat_sink->mode = UPIPE_FSINK_APPEND;
+    upipe_multicat_sink->index_path = NULL;
+    upipe_multicat_sink->index_fd = -1;
+    upipe_multicat_sink->index_interval = 0;
+    upipe_multicat_sink->index_date = UINT64_MAX;
+    upipe_multicat_sink->index_next = true;
+    upipe_multicat_sink->offset = 0;
     upipe_multicat_sink->flow_def = NULL;
     upipe_throw_ready(upipe);
     return upipe;
@@ -417,6 +548,9 @@ static void upipe_multicat_sink_free(struct upipe *upipe)
     upipe_dbg_va(upipe, "releasing pipe %p", upipe);
     upipe_throw_dead(upipe);
 
+    if (upipe_multicat_sink->index_fd != -1)
+        close(upipe_multicat_sink->index_fd);
+    free(upipe_multicat_sink->index_path);
     free(upipe_multicat_sink->dirpath);
     free(upipe_multicat_sink->suffix);
     upipe_multicat_sink_clean_urefcount(upipe);
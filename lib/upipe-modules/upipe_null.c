@@ -107,6 +107,26 @@ static void upipe_null_input(struct upipe *upipe, struct uref *uref, struct upum
     uref_free(uref);
 }
 
+/** @internal @This sends a list of urefs to devnull.
+ *
+ * @param upipe description structure of the pipe
+ * @param urefs list of urefs
+ * @param upump_p reference to pump that generated the buffers
+ */
+static void upipe_null_input_list(struct upipe *upipe, struct uchain *urefs,
+                                  struct upump **upump_p)
+{
+    struct upipe_null *upipe_null = upipe_null_from_upipe(upipe);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(urefs)) != NULL) {
+        struct uref *uref = uref_from_uchain(uchain);
+        upipe_null->counter++;
+        if (upipe_null->dump)
+            uref_dump(uref, upipe->uprobe);
+        uref_free(uref);
+    }
+}
+
 /** @internal @This processes control commands.
  *
  * @param upipe description structure of the pipe
@@ -159,7 +179,9 @@ static struct upipe_mgr upipe_null_mgr = {
     .upipe_input = upipe_null_input,
     .upipe_control = upipe_null_control,
 
-    .upipe_mgr_control = NULL
+    .upipe_mgr_control = NULL,
+
+    .upipe_input_list = upipe_null_input_list
 };
 
 /** @This returns the management structure for null pipes
@@ -60,6 +60,8 @@ struct upipe_play {
     uint64_t sink_latency;
     /** total latency */
     uint64_t latency;
+    /** true if the latencies of the subpipes are kept separate */
+    bool low_latency;
 
     /** list of subs */
     struct uchain subs;
@@ -84,6 +86,10 @@ struct upipe_play_sub {
 
     /** sink latency request */
     struct urequest latency_request;
+    /** input latency of the subpipe */
+    uint64_t input_latency;
+    /** sink latency of the subpipe */
+    uint64_t sink_latency;
 
     /** pipe acting as output */
     struct upipe *output;
@@ -105,6 +111,8 @@ UPIPE_HELPER_OUTPUT(upipe_play_sub, output, flow_def, output_state, request_list
 
 UPIPE_HELPER_SUBPIPE(upipe_play, upipe_play_sub, sub, sub_mgr, subs, uchain)
 
+/** @hidden */
+static void upipe_play_set_latency(struct upipe *upipe);
 /** @hidden */
 static void upipe_play_set_input_latency(struct upipe *upipe, uint64_t latency);
 /** @hidden */
@@ -120,9 +128,13 @@ static inline int upipe_play_sub_provide_latency(struct urequest *urequest,
 {
     struct upipe *upipe = urequest_get_opaque(urequest, struct upipe *);
     uint64_t latency = va_arg(args, uint64_t);
+    struct upipe_play_sub *upipe_play_sub = upipe_play_sub_from_upipe(upipe);
     struct upipe_play *upipe_play = upipe_play_from_sub_mgr(upipe->mgr);
+    upipe_play_sub->sink_latency = latency;
     if (latency > upipe_play->sink_latency)
         upipe_play_set_sink_latency(upipe_play_to_upipe(upipe_play), latency);
+    else if (upipe_play->low_latency)
+        upipe_play_set_latency(upipe_play_to_upipe(upipe_play));
     return UBASE_ERR_NONE;
 }
 
@@ -147,6 +159,8 @@ static struct upipe *upipe_play_sub_alloc(struct upipe_mgr *mgr,
     upipe_play_sub_init_urefcount(upipe);
     upipe_play_sub_init_output(upipe);
     upipe_play_sub_init_sub(upipe);
+    upipe_play_sub->input_latency = 0;
+    upipe_play_sub->sink_latency = DEFAULT_OUTPUT_LATENCY;
     upipe_throw_ready(upipe);
 
     urequest_init_sink_latency(&upipe_play_sub->latency_request,
@@ -196,11 +210,15 @@ static int upipe_play_sub_set_flow_def(struct upipe *upipe,
 
     uint64_t latency = 0;
     uref_clock_get_latency(flow_def, &latency);
-    /* we never lower latency */
+    struct upipe_play_sub *upipe_play_sub = upipe_play_sub_from_upipe(upipe);
+    upipe_play_sub->input_latency = latency;
+    /* we never lower latency, unless in low-latency mode */
     struct upipe_play *upipe_play =
         upipe_play_from_sub_mgr(upipe->mgr);
     if (latency > upipe_play->input_latency)
         upipe_play_set_input_latency(upipe_play_to_upipe(upipe_play), latency);
+    else if (upipe_play->low_latency)
+        upipe_play_set_latency(upipe_play_to_upipe(upipe_play));
     else
         upipe_play_sub_build_flow_def(upipe);
 
@@ -259,10 +277,13 @@ static int upipe_play_sub_control(struct upipe *upipe,
  */
 static void upipe_play_sub_free(struct upipe *upipe)
 {
+    struct upipe_play *upipe_play = upipe_play_from_sub_mgr(upipe->mgr);
     upipe_throw_dead(upipe);
 
     upipe_play_sub_clean_output(upipe);
     upipe_play_sub_clean_sub(upipe);
+    if (upipe_play->low_latency)
+        upipe_play_set_latency(upipe_play_to_upipe(upipe_play));
     upipe_play_sub_clean_urefcount(upipe);
     upipe_play_sub_free_void(upipe);
 }
@@ -305,6 +326,7 @@ static struct upipe *upipe_play_alloc(struct upipe_mgr *mgr,
     struct upipe_play *upipe_play = upipe_play_from_upipe(upipe);
     upipe_play->input_latency = 0;
     upipe_play->sink_latency = upipe_play->latency = DEFAULT_OUTPUT_LATENCY;
+    upipe_play->low_latency = false;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -316,8 +338,37 @@ static struct upipe *upipe_play_alloc(struct upipe_mgr *mgr,
 static void upipe_play_set_latency(struct upipe *upipe)
 {
     struct upipe_play *upipe_play = upipe_play_from_upipe(upipe);
-    upipe_play->latency = upipe_play->input_latency +
-                          upipe_play->sink_latency;
+    uint64_t input_latency = upipe_play->input_latency;
+    uint64_t sink_latency = upipe_play->sink_latency;
+    struct upipe *sub = NULL;
+
+    if (upipe_play->low_latency) {
+        /* the largest budget of the subpipes */
+        input_latency = 0;
+        sink_latency = DEFAULT_OUTPUT_LATENCY;
+        struct uchain *uchain;
+        ulist_foreach (&upipe_play->subs, uchain) {
+            struct upipe_play_sub *upipe_play_sub =
+                upipe_play_sub_from_uchain(uchain);
+            if (sub == NULL ||
+                upipe_play_sub->input_latency + upipe_play_sub->sink_latency >
+                input_latency + sink_latency) {
+                input_latency = upipe_play_sub->input_latency;
+                sink_latency = upipe_play_sub->sink_latency;
+                sub = upipe_play_sub_to_upipe(upipe_play_sub);
+            }
+        }
+    }
+
+    uint64_t latency = input_latency + sink_latency;
+    if (latency != upipe_play->latency) {
+        upipe_dbg_va(upipe, "setting latency to %"PRIu64" (input %"PRIu64
+                     ", sink %"PRIu64")", latency, input_latency,
+                     sink_latency);
+        upipe_throw(upipe, UPROBE_PLAY_LATENCY, UPIPE_PLAY_SIGNATURE,
+                    latency, input_latency, sink_latency, sub);
+    }
+    upipe_play->latency = latency;
 
     struct uchain *uchain;
     ulist_foreach (&upipe_play->subs, uchain) {
@@ -371,6 +422,20 @@ static int upipe_play_control(struct upipe *upipe, int command, va_list args)
             struct upipe **p = va_arg(args, struct upipe **);
             return upipe_play_iterate_sub(upipe, p);
         }
+        case UPIPE_PLAY_GET_LOW_LATENCY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_PLAY_SIGNATURE)
+            struct upipe_play *upipe_play = upipe_play_from_upipe(upipe);
+            int *val_p = va_arg(args, int *);
+            *val_p = upipe_play->low_latency ? 1 : 0;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_PLAY_SET_LOW_LATENCY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_PLAY_SIGNATURE)
+            struct upipe_play *upipe_play = upipe_play_from_upipe(upipe);
+            upipe_play->low_latency = !!va_arg(args, int);
+            upipe_play_set_latency(upipe);
+            return UBASE_ERR_NONE;
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
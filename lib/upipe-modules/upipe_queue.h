@@ -28,7 +28,11 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/uatomic.h>
 #include <upipe/uqueue.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
 #include <upipe/upipe.h>
 
 #include <assert.h>
@@ -43,6 +47,12 @@ struct upipe_queue {
     struct uqueue downstream_oob;
     /** out of band upstream queue */
     struct uqueue upstream_oob;
+    /** max number of octets in the uref queue, or 0 */
+    unsigned int max_octets;
+    /** number of octets of block urefs in the uref queue */
+    uatomic_uint32_t octets;
+    /** clock stamping the urefs entering the queue, or NULL */
+    struct uclock *uclock;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -59,6 +69,84 @@ static inline struct upipe_queue *upipe_queue(struct upipe *upipe)
     return container_of(upipe, struct upipe_queue, upipe);
 }
 
+/** @internal @This returns the size of a uref for the octet accounting.
+ *
+ * @param uref pointer to uref
+ * @return size of the block in octets, or 0 for other urefs
+ */
+static inline uint32_t upipe_queue_uref_octets(struct uref *uref)
+{
+    size_t size;
+    if (uref->ubuf == NULL || !ubase_check(uref_block_size(uref, &size)))
+        return 0;
+    return size > UINT32_MAX ? UINT32_MAX : size;
+}
+
+/** @internal @This pushes a uref into the queue, from the sink thread. The
+ * queue is considered full if it holds more than max_octets octets, in which
+ * case the push watcher of the uref queue is triggered again as soon as the
+ * source has popped enough octets.
+ *
+ * @param upipe_queue pointer to the upipe_queue structure
+ * @param uref uref to push
+ * @return false if the queue is full and the uref couldn't be queued
+ */
+static inline bool upipe_queue_push(struct upipe_queue *upipe_queue,
+                                    struct uref *uref)
+{
+    if (upipe_queue->max_octets &&
+        uatomic_load(&upipe_queue->octets) >= upipe_queue->max_octets) {
+        /* signal that we are full */
+        ueventfd_read(&upipe_queue->uqueue.event_push);
+
+        /* double-check */
+        if (likely(uatomic_load(&upipe_queue->octets) >=
+                   upipe_queue->max_octets))
+            return false;
+
+        /* signal that we're alright again */
+        ueventfd_write(&upipe_queue->uqueue.event_push);
+    }
+
+    uint32_t octets = upipe_queue_uref_octets(uref);
+    if (upipe_queue->uclock != NULL)
+        uref->priv = uclock_now(upipe_queue->uclock);
+    uatomic_fetch_add(&upipe_queue->octets, octets);
+    if (unlikely(!uqueue_push(&upipe_queue->uqueue, uref_to_uchain(uref)))) {
+        uatomic_fetch_sub(&upipe_queue->octets, octets);
+        return false;
+    }
+    return true;
+}
+
+/** @internal @This pops a uref from the queue, from the source thread.
+ *
+ * @param upipe_queue pointer to the upipe_queue structure
+ * @param queued_p filled in with the time spent in the queue, if a clock is
+ * set (may be NULL)
+ * @return pointer to uref, or NULL if the queue is empty
+ */
+static inline struct uref *upipe_queue_pop(struct upipe_queue *upipe_queue,
+                                           uint64_t *queued_p)
+{
+    struct uref *uref = uqueue_pop(&upipe_queue->uqueue, struct uref *);
+    if (unlikely(uref == NULL))
+        return NULL;
+
+    uint32_t octets = upipe_queue_uref_octets(uref);
+    if (octets) {
+        uint32_t prev = uatomic_fetch_sub(&upipe_queue->octets, octets);
+        if (upipe_queue->max_octets && prev >= upipe_queue->max_octets &&
+            prev - octets < upipe_queue->max_octets)
+            ueventfd_write(&upipe_queue->uqueue.event_push);
+    }
+    if (queued_p != NULL && upipe_queue->uclock != NULL) {
+        uint64_t now = uclock_now(upipe_queue->uclock);
+        *queued_p = now > uref->priv ? now - uref->priv : 0;
+    }
+    return uref;
+}
+
 /** @internal @This is a super-set of @ref urequest. */
 struct upipe_queue_request {
     /** refcount management structure */
@@ -31,7 +31,11 @@
 #include <upipe/ulist.h>
 #include <upipe/uqueue.h>
 #include <upipe/uprobe.h>
+#include <upipe/uclock.h>
 #include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_priority.h>
 #include <upipe/upump.h>
 #include <upipe/upump_blocker.h>
 #include <upipe/upipe.h>
@@ -51,6 +55,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <string.h>
+#include <inttypes.h>
 #include <assert.h>
 
 /** @hidden */
@@ -93,6 +98,11 @@ struct upipe_qsink {
     /** list of blockers */
     struct uchain blockers;
 
+    /** maximum number of held urefs before dropping, or 0 to block */
+    unsigned int overload_depth;
+    /** maximum age of held urefs before dropping, or 0 */
+    uint64_t overload_deadline;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -139,6 +149,8 @@ static struct upipe *_upipe_qsink_alloc(struct upipe_mgr *mgr,
     upipe_qsink->qsrc = NULL;
     upipe_qsink->flow_def = NULL;
     upipe_qsink->flow_def_sent = false;
+    upipe_qsink->overload_depth = 0;
+    upipe_qsink->overload_deadline = 0;
     upipe_qsink->output = NULL;
     ulist_init(&upipe_qsink->request_list);
     upipe_qsink->qsrc = upipe_use(qsrc);
@@ -163,8 +175,7 @@ static bool upipe_qsink_output(struct upipe *upipe, struct uref *uref,
                                struct upump **upump_p)
 {
     struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
-    return uqueue_push(&upipe_queue(upipe_qsink->qsrc)->uqueue,
-                       uref_to_uchain(uref));
+    return upipe_queue_push(upipe_queue(upipe_qsink->qsrc), uref);
 }
 
 /** @internal @This is called when the queue can be written again.
@@ -215,6 +226,83 @@ static bool upipe_qsink_check_watcher(struct upipe *upipe)
     return true;
 }
 
+/** @internal @This checks whether the held urefs exceed the overload
+ * policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param now current date, or UINT64_MAX if the deadline is not checked
+ * @return true if urefs must be dropped
+ */
+static bool upipe_qsink_overloaded(struct upipe *upipe, uint64_t now)
+{
+    struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
+    if (upipe_qsink->nb_urefs > upipe_qsink->overload_depth)
+        return true;
+    if (now == UINT64_MAX)
+        return false;
+
+    struct uchain *uchain = ulist_peek(&upipe_qsink->urefs);
+    uint64_t cr_sys;
+    return uchain != NULL &&
+           ubase_check(uref_clock_get_cr_sys(uref_from_uchain(uchain),
+                                             &cr_sys)) &&
+           now > cr_sys + upipe_qsink->overload_deadline;
+}
+
+/** @internal @This drops the held urefs of lowest priority while the
+ * overload policy is exceeded.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_qsink_check_overload(struct upipe *upipe)
+{
+    struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
+    if (!upipe_qsink->overload_depth)
+        return;
+
+    struct uclock *uclock = upipe_queue(upipe_qsink->qsrc)->uclock;
+    uint64_t now = UINT64_MAX;
+    if (upipe_qsink->overload_deadline && uclock != NULL)
+        now = uclock_now(uclock);
+
+    while (upipe_qsink_overloaded(upipe, now)) {
+        struct uref *uref = uref_priority_find_lowest(&upipe_qsink->urefs);
+        if (uref == NULL)
+            break;
+        ulist_delete(uref_to_uchain(uref));
+        upipe_qsink->nb_urefs--;
+        upipe_verbose_va(upipe, "dropping %s uref on overload",
+                         uref_priority_name(uref->priv));
+        upipe_throw_overload_drop(upipe, uref, uref->priv);
+        uref_free(uref);
+    }
+}
+
+/** @internal @This holds a uref that can't be written to the queue, and
+ * either blocks the source pump or applies the overload policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_qsink_hold(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump_p)
+{
+    struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
+    if (!upipe_qsink->overload_depth) {
+        upipe_qsink_hold_input(upipe, uref);
+        upipe_qsink_block_input(upipe, upump_p);
+        return;
+    }
+
+    const char *def = NULL;
+    if (upipe_qsink->flow_def != NULL)
+        uref_flow_get_def(upipe_qsink->flow_def, &def);
+    uref->priv = uref_priority_classify(uref, def);
+    upipe_qsink_hold_input(upipe, uref);
+    upipe_qsink_check_overload(upipe);
+}
+
 /** @internal @This receives data.
  *
  * @param upipe description structure of the pipe
@@ -241,16 +329,14 @@ static void upipe_qsink_input(struct upipe *upipe, struct uref *uref,
     }
 
     if (!upipe_qsink_check_input(upipe)) {
-        upipe_qsink_hold_input(upipe, uref);
-        upipe_qsink_block_input(upipe, upump_p);
+        upipe_qsink_hold(upipe, uref, upump_p);
     } else if (!upipe_qsink_output(upipe, uref, upump_p)) {
         if (!upipe_qsink_check_watcher(upipe)) {
             upipe_warn(upipe, "unable to spool uref");
             uref_free(uref);
             return;
         }
-        upipe_qsink_hold_input(upipe, uref);
-        upipe_qsink_block_input(upipe, upump_p);
+        upipe_qsink_hold(upipe, uref, upump_p);
         upump_start(upipe_qsink->upump);
     }
 }
@@ -312,6 +398,52 @@ static int upipe_qsink_set_flow_def(struct upipe *upipe, struct uref *uref)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the overload policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth_p filled in with the maximum number of held urefs
+ * @param deadline_p filled in with the maximum age of held urefs
+ * @return an error code
+ */
+static int _upipe_qsink_get_overload(struct upipe *upipe,
+                                     unsigned int *depth_p,
+                                     uint64_t *deadline_p)
+{
+    struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
+    if (depth_p != NULL)
+        *depth_p = upipe_qsink->overload_depth;
+    if (deadline_p != NULL)
+        *deadline_p = upipe_qsink->overload_deadline;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the overload policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth maximum number of held urefs, or 0 to block the sources
+ * @param deadline maximum age of held urefs, or 0
+ * @return an error code
+ */
+static int _upipe_qsink_set_overload(struct upipe *upipe,
+                                     unsigned int depth, uint64_t deadline)
+{
+    struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
+    upipe_qsink->overload_depth = depth;
+    upipe_qsink->overload_deadline = deadline;
+    if (!depth) {
+        upipe_notice(upipe, "disabling overload policy");
+        return UBASE_ERR_NONE;
+    }
+
+    upipe_notice_va(upipe, "dropping urefs beyond %u held urefs or %"PRIu64
+                    " ms", depth, deadline / (UCLOCK_FREQ / 1000));
+    /* the urefs held until now were not classified */
+    struct uchain *uchain;
+    ulist_foreach (&upipe_qsink->urefs, uchain)
+        uref_from_uchain(uchain)->priv = UREF_PRIORITY_CRITICAL;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This flushes all currently held buffers, and unblocks the
  * sources.
  *
@@ -521,6 +653,19 @@ static int _upipe_qsink_control(struct upipe *upipe, int command, va_list args)
 
         case UPIPE_FLUSH:
             return upipe_qsink_flush(upipe);
+
+        case UPIPE_QSINK_GET_OVERLOAD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSINK_SIGNATURE)
+            unsigned int *depth_p = va_arg(args, unsigned int *);
+            uint64_t *deadline_p = va_arg(args, uint64_t *);
+            return _upipe_qsink_get_overload(upipe, depth_p, deadline_p);
+        }
+        case UPIPE_QSINK_SET_OVERLOAD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSINK_SIGNATURE)
+            unsigned int depth = va_arg(args, unsigned int);
+            uint64_t deadline = va_arg(args, uint64_t);
+            return _upipe_qsink_set_overload(upipe, depth, deadline);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -28,6 +28,8 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/uclock.h>
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
 #include <upipe/upump.h>
@@ -72,6 +74,13 @@ struct upipe_qsrc {
     /** list of output requests */
     struct uchain request_list;
 
+    /** highest number of urefs seen in the queue */
+    unsigned int high_water;
+    /** time spent in the queue by the last uref */
+    uint64_t queued;
+    /** highest time spent in the queue by a uref */
+    uint64_t max_queued;
+
     /** structure exported to the sinks */
     struct upipe_queue upipe_queue;
 
@@ -132,6 +141,12 @@ static struct upipe *_upipe_qsrc_alloc(struct upipe_mgr *mgr,
     upipe_qsrc_init_upump(upipe);
     upipe_qsrc_init_upump_oob(upipe);
     upipe_qsrc->upipe_queue.max_length = length;
+    upipe_qsrc->upipe_queue.max_octets = 0;
+    uatomic_init(&upipe_qsrc->upipe_queue.octets, 0);
+    upipe_qsrc->upipe_queue.uclock = NULL;
+    upipe_qsrc->high_water = 0;
+    upipe_qsrc->queued = 0;
+    upipe_qsrc->max_queued = 0;
     upipe_throw_ready(upipe);
 
     return upipe;
@@ -161,6 +176,28 @@ static void upipe_qsrc_input(struct upipe *upipe, struct uref *uref,
     upipe_release(upipe);
 }
 
+/** @internal @This pops a uref from the queue and updates the statistics.
+ *
+ * @param upipe description structure of the pipe
+ * @return pointer to uref, or NULL if the queue is empty
+ */
+static struct uref *upipe_qsrc_pop(struct upipe *upipe)
+{
+    struct upipe_qsrc *upipe_qsrc = upipe_qsrc_from_upipe(upipe);
+    unsigned int length = uqueue_length(&upipe_qsrc->upipe_queue.uqueue);
+    if (unlikely(length > upipe_qsrc->high_water))
+        upipe_qsrc->high_water = length;
+
+    uint64_t queued = UINT64_MAX;
+    struct uref *uref = upipe_queue_pop(&upipe_qsrc->upipe_queue, &queued);
+    if (queued != UINT64_MAX) {
+        upipe_qsrc->queued = queued;
+        if (unlikely(queued > upipe_qsrc->max_queued))
+            upipe_qsrc->max_queued = queued;
+    }
+    return uref;
+}
+
 /** @internal @This reads data from the queue and outputs it.
  *
  * @param upump description structure of the read watcher
@@ -169,7 +206,7 @@ static void upipe_qsrc_worker(struct upump *upump)
 {
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_qsrc *upipe_qsrc = upipe_qsrc_from_upipe(upipe);
-    struct uref *uref = uqueue_pop(&upipe_queue(upipe)->uqueue, struct uref *);
+    struct uref *uref = upipe_qsrc_pop(upipe);
     if (likely(uref != NULL))
         upipe_qsrc_input(upipe, uref, &upipe_qsrc->upump);
 }
@@ -262,8 +299,7 @@ static int upipe_qsrc_unregister_request(struct upipe *upipe,
 static void upipe_qsrc_source_end(struct upipe *upipe)
 {
     struct uref *uref;
-    while ((uref = uqueue_pop(&upipe_queue(upipe)->uqueue,
-                              struct uref *)) != NULL)
+    while ((uref = upipe_qsrc_pop(upipe)) != NULL)
         upipe_qsrc_input(upipe, uref, NULL);
 
     upipe_throw_source_end(upipe);
@@ -277,8 +313,7 @@ static void upipe_qsrc_source_end(struct upipe *upipe)
 static void upipe_qsrc_ref_end(struct upipe *upipe)
 {
     struct uref *uref;
-    while ((uref = uqueue_pop(&upipe_queue(upipe)->uqueue,
-                              struct uref *)) != NULL)
+    while ((uref = upipe_qsrc_pop(upipe)) != NULL)
         upipe_qsrc_input(upipe, uref, NULL);
 
     upipe_notice_va(upipe, "freeing queue %p", upipe);
@@ -302,6 +337,8 @@ static void upipe_qsrc_ref_end(struct upipe *upipe)
     uqueue_clean(&upipe_queue(upipe)->uqueue);
     uqueue_clean(&upipe_queue(upipe)->downstream_oob);
     uqueue_clean(&upipe_queue(upipe)->upstream_oob);
+    uatomic_clean(&upipe_queue(upipe)->octets);
+    uclock_release(upipe_queue(upipe)->uclock);
 
     upipe_qsrc_clean_urefcount(upipe);
     upipe_clean(upipe);
@@ -374,6 +411,70 @@ static int _upipe_qsrc_get_length(struct upipe *upipe, unsigned int *length_p)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the highest number of urefs seen in the queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param high_water_p filled in with the highest length of the queue
+ * @return an error code
+ */
+static int _upipe_qsrc_get_high_water(struct upipe *upipe,
+                                      unsigned int *high_water_p)
+{
+    struct upipe_qsrc *upipe_qsrc = upipe_qsrc_from_upipe(upipe);
+    assert(high_water_p != NULL);
+    unsigned int length = uqueue_length(&upipe_qsrc->upipe_queue.uqueue);
+    if (length > upipe_qsrc->high_water)
+        upipe_qsrc->high_water = length;
+    *high_water_p = upipe_qsrc->high_water;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the maximum number of octets of block urefs in the
+ * queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_octets maximum number of octets, or 0 for no limit
+ * @return an error code
+ */
+static int _upipe_qsrc_set_max_octets(struct upipe *upipe,
+                                      unsigned int max_octets)
+{
+    struct upipe_qsrc *upipe_qsrc = upipe_qsrc_from_upipe(upipe);
+    upipe_qsrc->upipe_queue.max_octets = max_octets;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the length under which the queue sink is unblocked.
+ *
+ * @param upipe description structure of the pipe
+ * @param threshold threshold, between 1 and the maximum length of the queue
+ * @return an error code
+ */
+static int _upipe_qsrc_set_threshold(struct upipe *upipe,
+                                     unsigned int threshold)
+{
+    struct uqueue *uqueue = &upipe_queue(upipe)->uqueue;
+    if (unlikely(!threshold || threshold > uqueue->length))
+        return UBASE_ERR_INVALID;
+    uqueue_set_threshold(uqueue, threshold);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the clock used to measure the time spent in the
+ * queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param uclock pointer to uclock, or NULL to disable the measure
+ * @return an error code
+ */
+static int _upipe_qsrc_set_uclock(struct upipe *upipe, struct uclock *uclock)
+{
+    struct upipe_qsrc *upipe_qsrc = upipe_qsrc_from_upipe(upipe);
+    uclock_release(upipe_qsrc->upipe_queue.uclock);
+    upipe_qsrc->upipe_queue.uclock = uclock_use(uclock);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a queue source pipe.
  *
  * @param upipe description structure of the pipe
@@ -410,6 +511,55 @@ static int _upipe_qsrc_control(struct upipe *upipe, int command, va_list args)
             unsigned int *length_p = va_arg(args, unsigned int *);
             return _upipe_qsrc_get_length(upipe, length_p);
         }
+        case UPIPE_QSRC_GET_HIGH_WATER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            unsigned int *high_water_p = va_arg(args, unsigned int *);
+            return _upipe_qsrc_get_high_water(upipe, high_water_p);
+        }
+        case UPIPE_QSRC_GET_OCTETS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            unsigned int *octets_p = va_arg(args, unsigned int *);
+            *octets_p = uatomic_load(&upipe_queue(upipe)->octets);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_QSRC_GET_MAX_OCTETS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            unsigned int *max_octets_p = va_arg(args, unsigned int *);
+            *max_octets_p = upipe_queue(upipe)->max_octets;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_QSRC_GET_THRESHOLD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            unsigned int *threshold_p = va_arg(args, unsigned int *);
+            *threshold_p = upipe_queue(upipe)->uqueue.threshold;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_QSRC_SET_THRESHOLD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            unsigned int threshold = va_arg(args, unsigned int);
+            return _upipe_qsrc_set_threshold(upipe, threshold);
+        }
+        case UPIPE_QSRC_SET_MAX_OCTETS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            unsigned int max_octets = va_arg(args, unsigned int);
+            return _upipe_qsrc_set_max_octets(upipe, max_octets);
+        }
+        case UPIPE_QSRC_SET_UCLOCK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            struct uclock *uclock = va_arg(args, struct uclock *);
+            return _upipe_qsrc_set_uclock(upipe, uclock);
+        }
+        case UPIPE_QSRC_GET_QUEUED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_QSRC_SIGNATURE)
+            uint64_t *queued_p = va_arg(args, uint64_t *);
+            uint64_t *max_queued_p = va_arg(args, uint64_t *);
+            struct upipe_qsrc *upipe_qsrc = upipe_qsrc_from_upipe(upipe);
+            if (queued_p != NULL)
+                *queued_p = upipe_qsrc->queued;
+            if (max_queued_p != NULL)
+                *max_queued_p = upipe_qsrc->max_queued;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -0,0 +1,637 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module replaying capture files
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upump.h>
+#include <upipe/ubuf.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_uref_mgr.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_uclock.h>
+#include <upipe-modules/upipe_capture.h>
+#include <upipe-modules/upipe_replay_source.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+
+/** maximum number of urefs output at once when they are late */
+#define UPIPE_REPLAYSRC_BURST 64
+
+/** @hidden */
+static int upipe_replaysrc_check(struct upipe *upipe,
+                                 struct uref *flow_format);
+
+/** @internal @This is the private context of a replay source pipe. */
+struct upipe_replaysrc {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** uref manager */
+    struct uref_mgr *uref_mgr;
+    /** uref manager request */
+    struct urequest uref_mgr_request;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** uclock structure */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** read or timer watcher */
+    struct upump *upump;
+
+    /** file descriptor */
+    int fd;
+    /** file path */
+    char *path;
+    /** replay speed */
+    struct urational speed;
+
+    /** uref read from the file and not yet output, or NULL */
+    struct uref *next;
+    /** original system date of the next uref */
+    uint64_t next_date;
+    /** original system date of the first dated uref, or UINT64_MAX */
+    uint64_t origin;
+    /** system date at which the first dated uref was output */
+    uint64_t start;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_replaysrc, upipe, UPIPE_REPLAYSRC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_replaysrc, urefcount, upipe_replaysrc_free)
+UPIPE_HELPER_VOID(upipe_replaysrc)
+
+UPIPE_HELPER_OUTPUT(upipe_replaysrc, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UREF_MGR(upipe_replaysrc, uref_mgr, uref_mgr_request,
+                      upipe_replaysrc_check,
+                      upipe_replaysrc_register_output_request,
+                      upipe_replaysrc_unregister_output_request)
+UPIPE_HELPER_UBUF_MGR(upipe_replaysrc, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      upipe_replaysrc_check,
+                      upipe_replaysrc_register_output_request,
+                      upipe_replaysrc_unregister_output_request)
+UPIPE_HELPER_UCLOCK(upipe_replaysrc, uclock, uclock_request,
+                    upipe_replaysrc_check,
+                    upipe_replaysrc_register_output_request,
+                    upipe_replaysrc_unregister_output_request)
+
+UPIPE_HELPER_UPUMP_MGR(upipe_replaysrc, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_replaysrc, upump, upump_mgr)
+
+/** @internal @This allocates a replay source pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_replaysrc_alloc(struct upipe_mgr *mgr,
+                                           struct uprobe *uprobe,
+                                           uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_replaysrc_alloc_void(mgr, uprobe, signature,
+                                                     args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+    upipe_replaysrc_init_urefcount(upipe);
+    upipe_replaysrc_init_uref_mgr(upipe);
+    upipe_replaysrc_init_ubuf_mgr(upipe);
+    upipe_replaysrc_init_uclock(upipe);
+    upipe_replaysrc_init_output(upipe);
+    upipe_replaysrc_init_upump_mgr(upipe);
+    upipe_replaysrc_init_upump(upipe);
+    upipe_replaysrc->fd = -1;
+    upipe_replaysrc->path = NULL;
+    upipe_replaysrc->speed.num = upipe_replaysrc->speed.den = 1;
+    upipe_replaysrc->next = NULL;
+    upipe_replaysrc->next_date = UPIPE_CAPTURE_NO_DATE;
+    upipe_replaysrc->origin = UINT64_MAX;
+    upipe_replaysrc->start = 0;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This reads a given number of octets from the file.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer destination buffer
+ * @param size number of octets to read
+ * @return the number of octets read, smaller than size at the end of the
+ * file, or -1 in case of error
+ */
+static ssize_t upipe_replaysrc_read(struct upipe *upipe, uint8_t *buffer,
+                                    size_t size)
+{
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t ret = read(upipe_replaysrc->fd, buffer + offset,
+                           size - offset);
+        if (unlikely(ret == -1)) {
+            if (errno == EINTR)
+                continue;
+            upipe_err_va(upipe, "read error from %s (%m)",
+                         upipe_replaysrc->path);
+            return -1;
+        }
+        if (ret == 0)
+            break;
+        offset += ret;
+    }
+    return offset;
+}
+
+/** @internal @This reads the next record of the file into the next uref.
+ * Flow definition records are applied on the way.
+ *
+ * @param upipe description structure of the pipe
+ * @return false at the end of the file or in case of error
+ */
+static bool upipe_replaysrc_read_record(struct upipe *upipe)
+{
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+
+    for ( ; ; ) {
+        uint8_t header[UPIPE_CAPTURE_HEADER_SIZE];
+        ssize_t ret = upipe_replaysrc_read(upipe, header,
+                                           UPIPE_CAPTURE_HEADER_SIZE);
+        if (ret == 0) {
+            upipe_notice_va(upipe, "end of file %s", upipe_replaysrc->path);
+            return false;
+        }
+        if (unlikely(ret != UPIPE_CAPTURE_HEADER_SIZE)) {
+            if (ret != -1)
+                upipe_warn_va(upipe, "truncated record in %s",
+                              upipe_replaysrc->path);
+            return false;
+        }
+
+        struct upipe_capture_record record;
+        upipe_capture_read_header(header, &record);
+
+        if (record.flags & UPIPE_CAPTURE_FLOW_DEF) {
+            char def[record.size + 1];
+            if (unlikely(upipe_replaysrc_read(upipe, (uint8_t *)def,
+                                              record.size) !=
+                         (ssize_t)record.size)) {
+                upipe_warn_va(upipe, "truncated record in %s",
+                              upipe_replaysrc->path);
+                return false;
+            }
+            def[record.size] = '\0';
+
+            struct uref *flow_def =
+                uref_alloc_control(upipe_replaysrc->uref_mgr);
+            if (unlikely(flow_def == NULL ||
+                         !ubase_check(uref_flow_set_def(flow_def, def)))) {
+                if (flow_def != NULL)
+                    uref_free(flow_def);
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return false;
+            }
+            upipe_replaysrc_store_flow_def(upipe, flow_def);
+            continue;
+        }
+
+        struct uref *uref;
+        if (record.size) {
+            uref = uref_block_alloc(upipe_replaysrc->uref_mgr,
+                                    upipe_replaysrc->ubuf_mgr, record.size);
+            uint8_t *buffer;
+            int size = -1;
+            if (unlikely(uref == NULL ||
+                         !ubase_check(uref_block_write(uref, 0, &size,
+                                                       &buffer)))) {
+                if (uref != NULL)
+                    uref_free(uref);
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return false;
+            }
+            assert(size == (int)record.size);
+            ret = upipe_replaysrc_read(upipe, buffer, record.size);
+            uref_block_unmap(uref, 0);
+            if (unlikely(ret != (ssize_t)record.size)) {
+                uref_free(uref);
+                if (ret != -1)
+                    upipe_warn_va(upipe, "truncated record in %s",
+                                  upipe_replaysrc->path);
+                return false;
+            }
+        } else {
+            uref = uref_alloc(upipe_replaysrc->uref_mgr);
+            if (unlikely(uref == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return false;
+            }
+        }
+
+        if (record.flags & UPIPE_CAPTURE_RANDOM)
+            uref_flow_set_random(uref);
+        if (record.flags & UPIPE_CAPTURE_DISCONTINUITY)
+            uref_flow_set_discontinuity(uref);
+        if (record.flags & UPIPE_CAPTURE_ERROR)
+            uref_flow_set_error(uref);
+        if (record.flags & UPIPE_CAPTURE_START)
+            uref_block_set_start(uref);
+        if (record.flags & UPIPE_CAPTURE_END)
+            uref_block_set_end(uref);
+
+        upipe_replaysrc->next = uref;
+        upipe_replaysrc->next_date = record.date;
+        return true;
+    }
+}
+
+/** @internal @This outputs the records of the file which are due, and
+ * waits for the next one.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_replaysrc_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+    struct urational speed = upipe_replaysrc->speed;
+
+    upipe_use(upipe);
+    for (unsigned int i = 0; i < UPIPE_REPLAYSRC_BURST; i++) {
+        if (upipe_replaysrc->next == NULL &&
+            !upipe_replaysrc_read_record(upipe)) {
+            upipe_replaysrc_set_upump(upipe, NULL);
+            upipe_throw_source_end(upipe);
+            upipe_release(upipe);
+            return;
+        }
+
+        uint64_t now = uclock_now(upipe_replaysrc->uclock);
+        uint64_t date = upipe_replaysrc->next_date;
+        uint64_t systime = now;
+        if (date != UPIPE_CAPTURE_NO_DATE && speed.num > 0) {
+            if (upipe_replaysrc->origin == UINT64_MAX ||
+                date < upipe_replaysrc->origin) {
+                /* first date, or dates going backwards */
+                upipe_replaysrc->origin = date;
+                upipe_replaysrc->start = now;
+            }
+            systime = upipe_replaysrc->start +
+                (date - upipe_replaysrc->origin) * speed.den / speed.num;
+            if (systime > now) {
+                upipe_replaysrc_wait_upump(upipe, systime - now,
+                                           upipe_replaysrc_worker);
+                upipe_release(upipe);
+                return;
+            }
+        }
+
+        struct uref *uref = upipe_replaysrc->next;
+        upipe_replaysrc->next = NULL;
+        if (date != UPIPE_CAPTURE_NO_DATE)
+            uref_clock_set_cr_sys(uref, systime);
+        upipe_replaysrc_output(upipe, uref, &upipe_replaysrc->upump);
+        if (upipe_replaysrc->upump == NULL) {
+            /* the pipe was stopped or the file changed */
+            upipe_release(upipe);
+            return;
+        }
+    }
+
+    /* give the other pumps a chance to run */
+    upipe_replaysrc_wait_upump(upipe, 0, upipe_replaysrc_worker);
+    upipe_release(upipe);
+}
+
+/** @internal @This checks if the pump may be allocated.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_replaysrc_check(struct upipe *upipe,
+                                 struct uref *flow_format)
+{
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+    if (flow_format != NULL) {
+        /* the flow definitions are read from the file */
+        uref_free(flow_format);
+    }
+
+    upipe_replaysrc_check_upump_mgr(upipe);
+    if (upipe_replaysrc->upump_mgr == NULL)
+        return UBASE_ERR_NONE;
+
+    if (upipe_replaysrc->uref_mgr == NULL) {
+        upipe_replaysrc_require_uref_mgr(upipe);
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_replaysrc->ubuf_mgr == NULL) {
+        struct uref *flow_format =
+            uref_block_flow_alloc_def(upipe_replaysrc->uref_mgr, NULL);
+        if (unlikely(flow_format == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_replaysrc_require_ubuf_mgr(upipe, flow_format);
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_replaysrc->uclock == NULL) {
+        upipe_replaysrc_require_uclock(upipe);
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_replaysrc->fd != -1 && upipe_replaysrc->upump == NULL) {
+        struct upump *upump = upump_alloc_idler(upipe_replaysrc->upump_mgr,
+                                                upipe_replaysrc_worker,
+                                                upipe);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_replaysrc_set_upump(upipe, upump);
+        upump_start(upump);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the path of the currently opened file.
+ *
+ * @param upipe description structure of the pipe
+ * @param path_p filled in with the path of the file
+ * @return an error code
+ */
+static int upipe_replaysrc_get_uri(struct upipe *upipe, const char **path_p)
+{
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+    assert(path_p != NULL);
+    *path_p = upipe_replaysrc->path;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This asks to open the given file.
+ *
+ * @param upipe description structure of the pipe
+ * @param path relative or absolute path of the file
+ * @return an error code
+ */
+static int upipe_replaysrc_set_uri(struct upipe *upipe, const char *path)
+{
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+
+    if (unlikely(upipe_replaysrc->fd != -1)) {
+        if (likely(upipe_replaysrc->path != NULL))
+            upipe_notice_va(upipe, "closing file %s", upipe_replaysrc->path);
+        close(upipe_replaysrc->fd);
+        upipe_replaysrc->fd = -1;
+    }
+    free(upipe_replaysrc->path);
+    upipe_replaysrc->path = NULL;
+    upipe_replaysrc_set_upump(upipe, NULL);
+    if (upipe_replaysrc->next != NULL) {
+        uref_free(upipe_replaysrc->next);
+        upipe_replaysrc->next = NULL;
+    }
+    upipe_replaysrc->origin = UINT64_MAX;
+
+    if (unlikely(path == NULL))
+        return UBASE_ERR_NONE;
+
+    upipe_replaysrc->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (unlikely(upipe_replaysrc->fd == -1)) {
+        upipe_err_va(upipe, "can't open file %s (%m)", path);
+        return UBASE_ERR_EXTERNAL;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(upipe_replaysrc->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    upipe_replaysrc->path = strdup(path);
+    if (unlikely(upipe_replaysrc->path == NULL)) {
+        close(upipe_replaysrc->fd);
+        upipe_replaysrc->fd = -1;
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_notice_va(upipe, "opening file %s", upipe_replaysrc->path);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the replay speed.
+ *
+ * @param upipe description structure of the pipe
+ * @param speed new speed
+ * @return an error code
+ */
+static int _upipe_replaysrc_set_speed(struct upipe *upipe,
+                                      struct urational speed)
+{
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+    if (unlikely(speed.num < 0 || (speed.num && !speed.den)))
+        return UBASE_ERR_INVALID;
+    upipe_replaysrc->speed = speed;
+    /* the timing restarts from the next record */
+    upipe_replaysrc->origin = UINT64_MAX;
+    if (upipe_replaysrc->upump != NULL)
+        upipe_replaysrc_set_upump(upipe, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a replay source pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_replaysrc_control(struct upipe *upipe,
+                                    int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_replaysrc_set_upump(upipe, NULL);
+            return upipe_replaysrc_attach_upump_mgr(upipe);
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_replaysrc_set_upump(upipe, NULL);
+            upipe_replaysrc_require_uclock(upipe);
+            return UBASE_ERR_NONE;
+
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_replaysrc_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_replaysrc_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_replaysrc_set_output(upipe, output);
+        }
+
+        case UPIPE_GET_URI: {
+            const char **uri_p = va_arg(args, const char **);
+            return upipe_replaysrc_get_uri(upipe, uri_p);
+        }
+        case UPIPE_SET_URI: {
+            const char *uri = va_arg(args, const char *);
+            return upipe_replaysrc_set_uri(upipe, uri);
+        }
+
+        case UPIPE_REPLAYSRC_GET_SPEED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_REPLAYSRC_SIGNATURE)
+            struct urational *speed_p = va_arg(args, struct urational *);
+            *speed_p = upipe_replaysrc_from_upipe(upipe)->speed;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REPLAYSRC_SET_SPEED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_REPLAYSRC_SIGNATURE)
+            struct urational speed = va_arg(args, struct urational);
+            return _upipe_replaysrc_set_speed(upipe, speed);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands on a replay source pipe, and
+ * checks the status of the pipe afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_replaysrc_control(struct upipe *upipe,
+                                   int command, va_list args)
+{
+    UBASE_RETURN(_upipe_replaysrc_control(upipe, command, args))
+
+    return upipe_replaysrc_check(upipe, NULL);
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_replaysrc_free(struct upipe *upipe)
+{
+    struct upipe_replaysrc *upipe_replaysrc =
+        upipe_replaysrc_from_upipe(upipe);
+    if (likely(upipe_replaysrc->fd != -1)) {
+        if (likely(upipe_replaysrc->path != NULL))
+            upipe_notice_va(upipe, "closing file %s", upipe_replaysrc->path);
+        close(upipe_replaysrc->fd);
+    }
+    upipe_throw_dead(upipe);
+
+    if (upipe_replaysrc->next != NULL)
+        uref_free(upipe_replaysrc->next);
+    free(upipe_replaysrc->path);
+    upipe_replaysrc_clean_uclock(upipe);
+    upipe_replaysrc_clean_upump(upipe);
+    upipe_replaysrc_clean_upump_mgr(upipe);
+    upipe_replaysrc_clean_output(upipe);
+    upipe_replaysrc_clean_ubuf_mgr(upipe);
+    upipe_replaysrc_clean_uref_mgr(upipe);
+    upipe_replaysrc_clean_urefcount(upipe);
+    upipe_replaysrc_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_replaysrc_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_REPLAYSRC_SIGNATURE,
+
+    .upipe_alloc = upipe_replaysrc_alloc,
+    .upipe_input = NULL,
+    .upipe_control = upipe_replaysrc_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all replay source pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_replaysrc_mgr_alloc(void)
+{
+    return &upipe_replaysrc_mgr;
+}
@@ -25,12 +25,17 @@
 
 /** @file
  * @short Upipe module decapsulating RTP header from blocks
+ * Packets may optionally be reordered in a ring indexed by sequence number,
+ * with a bounded window, and lost packets recovered from SMPTE 2022-1 FEC
+ * packets fed to subpipes.
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
 #include <upipe/upipe.h>
+#include <upipe/ubuf_block.h>
 #include <upipe/uref_block.h>
 #include <upipe/uref_block_flow.h>
 #include <upipe/uref_flow.h>
@@ -39,6 +44,7 @@
 #include <upipe/upipe_helper_urefcount.h>
 #include <upipe/upipe_helper_void.h>
 #include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
 #include <upipe-modules/upipe_rtp_decaps.h>
 
 #include <stdlib.h>
@@ -55,6 +61,42 @@
 #include <bitstream/ietf/rtp.h>
 
 #define EXPECTED_FLOW_DEF "block."
+/** size of the reorder ring, in packets (power of 2) */
+#define RING_SIZE 1024
+/** maximum size of the history kept for FEC recovery, in packets */
+#define HISTORY_SIZE (RING_SIZE - UPIPE_RTPD_MAX_REORDER)
+/** size of the SMPTE 2022-1 FEC header */
+#define FEC_HEADER_SIZE 16
+/** maximum number of FEC packets kept */
+#define MAX_FEC 64
+/** maximum size of a packet that may be recovered */
+#define MAX_RECOVER_SIZE 4096
+
+/** @internal @This is a slot of the reorder ring. */
+struct upipe_rtpd_slot {
+    /** RTP packet, or NULL */
+    struct uref *uref;
+    /** sequence number of the packet */
+    uint16_t seqnum;
+    /** true if the packet has not been output yet */
+    bool pending;
+};
+
+/** @internal @This is a FEC packet waiting to be used. */
+struct upipe_rtpd_fec_pkt {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** FEC packet */
+    struct uref *uref;
+    /** first protected sequence number */
+    uint16_t snbase;
+    /** interval between protected sequence numbers */
+    uint8_t offset;
+    /** number of protected packets */
+    uint8_t na;
+};
+
+UBASE_FROM_TO(upipe_rtpd_fec_pkt, uchain, uchain, uchain)
 
 /** upipe_rtpd structure */ 
 struct upipe_rtpd {
@@ -77,6 +119,24 @@ struct upipe_rtpd {
     /** list of output requests */
     struct uchain request_list;
 
+    /** reorder window, in packets, or 0 */
+    unsigned int reorder;
+    /** next sequence number to output, or -1 */
+    int next_seqnum;
+    /** highest sequence number received */
+    uint16_t last_seqnum;
+    /** reorder ring, indexed by sequence number */
+    struct upipe_rtpd_slot ring[RING_SIZE];
+
+    /** list of FEC packets */
+    struct uchain fec_pkts;
+    /** number of FEC packets */
+    unsigned int nb_fec_pkts;
+    /** list of FEC subpipes */
+    struct uchain fecs;
+    /** manager to create FEC subpipes */
+    struct upipe_mgr fec_mgr;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -86,41 +146,41 @@ UPIPE_HELPER_UREFCOUNT(upipe_rtpd, urefcount, upipe_rtpd_free);
 UPIPE_HELPER_VOID(upipe_rtpd);
 UPIPE_HELPER_OUTPUT(upipe_rtpd, output, flow_def, output_state, request_list);
 
-/** @internal @This allocates a rtpd pipe.
+/** @internal @This is the private context of a FEC subpipe of a rtpd pipe. */
+struct upipe_rtpd_fec {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtpd_fec, upipe, UPIPE_RTPD_FEC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtpd_fec, urefcount, upipe_rtpd_fec_free)
+UPIPE_HELPER_VOID(upipe_rtpd_fec)
+UPIPE_HELPER_SUBPIPE(upipe_rtpd, upipe_rtpd_fec, fec, fec_mgr, fecs, uchain)
+
+/** @internal @This returns the signed distance between two sequence numbers.
  *
- * @param mgr common management structure
- * @param uprobe structure used to raise events
- * @param signature signature of the pipe allocator
- * @param args optional arguments
- * @return pointer to upipe or NULL in case of allocation error
+ * @param seqnum sequence number
+ * @param ref reference sequence number
+ * @return distance from ref to seqnum
  */
-static struct upipe *upipe_rtpd_alloc(struct upipe_mgr *mgr,
-                                      struct uprobe *uprobe,
-                                      uint32_t signature, va_list args)
+static inline int upipe_rtpd_seqnum_diff(uint16_t seqnum, uint16_t ref)
 {
-    struct upipe *upipe = upipe_rtpd_alloc_void(mgr, uprobe, signature, args);
-    if (unlikely(upipe == NULL))
-        return NULL;
-
-    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
-    upipe_rtpd_init_urefcount(upipe);
-    upipe_rtpd_init_output(upipe);
-    upipe_rtpd->expected_seqnum = -1;
-    upipe_rtpd->type = 0;
-    upipe_rtpd->flow_def_input = NULL;
-
-    upipe_throw_ready(upipe);
-    return upipe;
+    return (int16_t)(seqnum - ref);
 }
 
-/** @internal @This handles data.
+/** @internal @This strips the RTP header of a packet and outputs it.
  *
  * @param upipe description structure of the pipe
  * @param uref uref structure
  * @param upump_p reference to pump that generated the buffer
  */
-static inline void upipe_rtpd_input(struct upipe *upipe, struct uref *uref,
-                                    struct upump **upump_p)
+static void upipe_rtpd_output_packet(struct upipe *upipe, struct uref *uref,
+                                     struct upump **upump_p)
 {
     struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
     uint8_t rtp_buffer[RTP_HEADER_SIZE];
@@ -195,6 +255,468 @@ static inline void upipe_rtpd_input(struct upipe *upipe, struct uref *uref,
     upipe_rtpd_output(upipe, uref, upump_p);
 }
 
+/** @internal @This frees the FEC packets which only protect packets that
+ * were already output.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtpd_prune_fec(struct upipe *upipe)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_rtpd->fec_pkts, uchain, uchain_tmp) {
+        struct upipe_rtpd_fec_pkt *fec = upipe_rtpd_fec_pkt_from_uchain(uchain);
+        uint16_t last = fec->snbase + (fec->na - 1) * fec->offset;
+        if (upipe_rtpd->next_seqnum != -1 &&
+            upipe_rtpd->nb_fec_pkts <= MAX_FEC &&
+            upipe_rtpd_seqnum_diff(last, upipe_rtpd->next_seqnum) >= 0)
+            continue;
+        ulist_delete(uchain);
+        uref_free(fec->uref);
+        free(fec);
+        upipe_rtpd->nb_fec_pkts--;
+    }
+}
+
+/** @internal @This returns the packet of the given sequence number from the
+ * ring, whether it was output or not.
+ *
+ * @param upipe description structure of the pipe
+ * @param seqnum sequence number
+ * @return pointer to the packet, or NULL
+ */
+static inline struct uref *upipe_rtpd_ring_get(struct upipe *upipe,
+                                               uint16_t seqnum)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    struct upipe_rtpd_slot *slot = &upipe_rtpd->ring[seqnum % RING_SIZE];
+    if (slot->uref == NULL || slot->seqnum != seqnum)
+        return NULL;
+    return slot->uref;
+}
+
+/** @internal @This tries to recover a lost packet with a FEC packet, if all
+ * the other packets it protects were received.
+ *
+ * @param upipe description structure of the pipe
+ * @param seqnum sequence number of the lost packet
+ * @return recovered packet, or NULL
+ */
+static struct uref *upipe_rtpd_recover(struct upipe *upipe, uint16_t seqnum)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    struct uchain *uchain;
+    ulist_foreach (&upipe_rtpd->fec_pkts, uchain) {
+        struct upipe_rtpd_fec_pkt *fec = upipe_rtpd_fec_pkt_from_uchain(uchain);
+        int diff = upipe_rtpd_seqnum_diff(seqnum, fec->snbase);
+        if (diff < 0 || diff % fec->offset || diff / fec->offset >= fec->na)
+            continue;
+
+        struct uref *model = NULL;
+        unsigned int i;
+        for (i = 0; i < fec->na; i++) {
+            uint16_t protected = fec->snbase + i * fec->offset;
+            if (protected == seqnum)
+                continue;
+            if ((model = upipe_rtpd_ring_get(upipe, protected)) == NULL)
+                break;
+        }
+        if (i < fec->na || model == NULL)
+            continue;
+
+        /* recovery fields and payload of the FEC packet */
+        size_t fec_size;
+        if (unlikely(!ubase_check(uref_block_size(fec->uref, &fec_size)) ||
+                     fec_size > MAX_RECOVER_SIZE))
+            continue;
+        fec_size -= RTP_HEADER_SIZE + FEC_HEADER_SIZE;
+        uint8_t fec_header[FEC_HEADER_SIZE];
+        uint8_t payload[MAX_RECOVER_SIZE];
+        if (unlikely(!ubase_check(uref_block_extract(fec->uref,
+                            RTP_HEADER_SIZE, FEC_HEADER_SIZE, fec_header)) ||
+                     !ubase_check(uref_block_extract(fec->uref,
+                            RTP_HEADER_SIZE + FEC_HEADER_SIZE, fec_size,
+                            payload))))
+            continue;
+        uint16_t length = (fec_header[2] << 8) | fec_header[3];
+        uint8_t type = fec_header[4] & 0x7f;
+        uint32_t timestamp = (fec_header[8] << 24) | (fec_header[9] << 16) |
+                             (fec_header[10] << 8) | fec_header[11];
+
+        /* XOR the other protected packets */
+        for (i = 0; i < fec->na; i++) {
+            uint16_t protected = fec->snbase + i * fec->offset;
+            if (protected == seqnum)
+                continue;
+            struct uref *uref = upipe_rtpd_ring_get(upipe, protected);
+            size_t size;
+            uint8_t buffer[MAX_RECOVER_SIZE];
+            if (unlikely(!ubase_check(uref_block_size(uref, &size)) ||
+                         size < RTP_HEADER_SIZE || size > MAX_RECOVER_SIZE ||
+                         !ubase_check(uref_block_extract(uref, 0, size,
+                                                         buffer))))
+                break;
+            size -= RTP_HEADER_SIZE;
+            length ^= size;
+            type ^= rtp_get_type(buffer);
+            timestamp ^= rtp_get_timestamp(buffer);
+            for (size_t j = 0; j < size && j < fec_size; j++)
+                payload[j] ^= buffer[RTP_HEADER_SIZE + j];
+        }
+        if (unlikely(i < fec->na || length > fec_size))
+            continue;
+
+        struct uref *uref = uref_dup(model);
+        if (unlikely(uref == NULL))
+            return NULL;
+        struct ubuf *ubuf = ubuf_block_alloc(model->ubuf->mgr,
+                                             RTP_HEADER_SIZE + length);
+        uint8_t *buffer;
+        int size = -1;
+        if (unlikely(ubuf == NULL ||
+                     !ubase_check(ubuf_block_write(ubuf, 0, &size,
+                                                   &buffer)))) {
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return NULL;
+        }
+        memset(buffer, 0, RTP_HEADER_SIZE);
+        rtp_set_hdr(buffer);
+        rtp_set_type(buffer, type);
+        rtp_set_seqnum(buffer, seqnum);
+        rtp_set_timestamp(buffer, timestamp);
+        memcpy(buffer + RTP_HEADER_SIZE, payload, length);
+        ubuf_block_unmap(ubuf, 0);
+        uref_attach_ubuf(uref, ubuf);
+        upipe_dbg_va(upipe, "recovered RTP packet %"PRIu16, seqnum);
+        return uref;
+    }
+    return NULL;
+}
+
+/** @internal @This outputs the packets of the ring, in order, as long as
+ * they are available or the window is exceeded. Lost packets are
+ * recovered from FEC if possible, or skipped.
+ *
+ * @param upipe description structure of the pipe
+ * @param flush true to output all pending packets
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtpd_drain(struct upipe *upipe, bool flush,
+                             struct upump **upump_p)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    if (upipe_rtpd->next_seqnum == -1)
+        return;
+
+    for ( ; ; ) {
+        uint16_t next = upipe_rtpd->next_seqnum;
+        int ahead = upipe_rtpd_seqnum_diff(upipe_rtpd->last_seqnum, next);
+        if (ahead < 0)
+            break;
+        struct upipe_rtpd_slot *slot = &upipe_rtpd->ring[next % RING_SIZE];
+        if (slot->uref == NULL || slot->seqnum != next || !slot->pending) {
+            if (!flush && ahead < upipe_rtpd->reorder)
+                break;
+            /* lost packet */
+            if (slot->uref != NULL)
+                uref_free(slot->uref);
+            slot->uref = upipe_rtpd_recover(upipe, next);
+            slot->seqnum = next;
+            slot->pending = slot->uref != NULL;
+        }
+
+        upipe_rtpd->next_seqnum = (next + 1) & UINT16_MAX;
+        if (slot->pending) {
+            slot->pending = false;
+            struct uref *uref = uref_dup(slot->uref);
+            if (unlikely(uref == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return;
+            }
+            upipe_rtpd_output_packet(upipe, uref, upump_p);
+        }
+
+        /* drop the history beyond what FEC may need */
+        struct upipe_rtpd_slot *old =
+            &upipe_rtpd->ring[(uint16_t)(next - HISTORY_SIZE) % RING_SIZE];
+        if (old->uref != NULL && !old->pending) {
+            uref_free(old->uref);
+            old->uref = NULL;
+        }
+    }
+    upipe_rtpd_prune_fec(upipe);
+}
+
+/** @internal @This frees all packets of the ring.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtpd_clean_ring(struct upipe *upipe)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    for (unsigned int i = 0; i < RING_SIZE; i++) {
+        if (upipe_rtpd->ring[i].uref != NULL) {
+            uref_free(upipe_rtpd->ring[i].uref);
+            upipe_rtpd->ring[i].uref = NULL;
+        }
+        upipe_rtpd->ring[i].pending = false;
+    }
+    upipe_rtpd->next_seqnum = -1;
+}
+
+/** @internal @This handles data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static inline void upipe_rtpd_input(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    if (!upipe_rtpd->reorder) {
+        upipe_rtpd_output_packet(upipe, uref, upump_p);
+        return;
+    }
+
+    uint8_t rtp_buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp_header = uref_block_peek(uref, 0, RTP_HEADER_SIZE,
+                                                rtp_buffer);
+    if (unlikely(rtp_header == NULL)) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return;
+    }
+    bool valid = rtp_check_hdr(rtp_header);
+    uint16_t seqnum = rtp_get_seqnum(rtp_header);
+    uref_block_peek_unmap(uref, 0, rtp_buffer, rtp_header);
+    if (unlikely(!valid)) {
+        upipe_warn(upipe, "invalid RTP header");
+        uref_free(uref);
+        return;
+    }
+
+    upipe_use(upipe);
+    if (upipe_rtpd->next_seqnum != -1) {
+        int diff = upipe_rtpd_seqnum_diff(seqnum, upipe_rtpd->next_seqnum);
+        if (unlikely(diff < -(int)HISTORY_SIZE ||
+                     diff >= (int)(RING_SIZE - HISTORY_SIZE))) {
+            /* too far from the window, start again from this packet */
+            upipe_warn_va(upipe, "RTP sequence jump (%d)", diff);
+            upipe_rtpd_drain(upipe, true, upump_p);
+            upipe_rtpd_clean_ring(upipe);
+        } else if (diff < 0) {
+            upipe_verbose_va(upipe, "dropping late RTP packet %"PRIu16,
+                             seqnum);
+            uref_free(uref);
+            upipe_release(upipe);
+            return;
+        }
+    }
+
+    if (upipe_rtpd->next_seqnum == -1) {
+        upipe_rtpd->next_seqnum = seqnum;
+        upipe_rtpd->last_seqnum = seqnum;
+    }
+    struct upipe_rtpd_slot *slot = &upipe_rtpd->ring[seqnum % RING_SIZE];
+    if (unlikely(slot->uref != NULL && slot->seqnum == seqnum)) {
+        upipe_verbose_va(upipe, "dropping duplicate RTP packet %"PRIu16,
+                         seqnum);
+        uref_free(uref);
+        upipe_release(upipe);
+        return;
+    }
+    if (slot->uref != NULL)
+        uref_free(slot->uref);
+    slot->uref = uref;
+    slot->seqnum = seqnum;
+    slot->pending = true;
+    if (upipe_rtpd_seqnum_diff(seqnum, upipe_rtpd->last_seqnum) > 0)
+        upipe_rtpd->last_seqnum = seqnum;
+
+    upipe_rtpd_drain(upipe, false, upump_p);
+    upipe_release(upipe);
+}
+
+/** @internal @This sets the reorder window.
+ *
+ * @param upipe description structure of the pipe
+ * @param reorder reorder window, in packets, or 0
+ * @return an error code
+ */
+static int _upipe_rtpd_set_reorder(struct upipe *upipe, unsigned int reorder)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    if (unlikely(reorder > UPIPE_RTPD_MAX_REORDER))
+        return UBASE_ERR_INVALID;
+    if (!reorder) {
+        upipe_use(upipe);
+        upipe_rtpd_drain(upipe, true, NULL);
+        upipe_rtpd_clean_ring(upipe);
+        upipe_release(upipe);
+    }
+    upipe_rtpd->reorder = reorder;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This allocates a FEC subpipe of a rtpd pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtpd_fec_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_rtpd_fec_alloc_void(mgr, uprobe, signature,
+                                                    args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    upipe_rtpd_fec_init_urefcount(upipe);
+    upipe_rtpd_fec_init_sub(upipe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This receives SMPTE 2022-1 FEC packets.
+ *
+ * @param upipe description structure of the subpipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtpd_fec_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_fec_mgr(upipe->mgr);
+    uint8_t buffer[RTP_HEADER_SIZE + FEC_HEADER_SIZE];
+    if (unlikely(!ubase_check(uref_block_extract(uref, 0,
+                        RTP_HEADER_SIZE + FEC_HEADER_SIZE, buffer)) ||
+                 !rtp_check_hdr(buffer))) {
+        upipe_warn(upipe, "invalid FEC packet received");
+        uref_free(uref);
+        return;
+    }
+
+    const uint8_t *fec_header = buffer + RTP_HEADER_SIZE;
+    struct upipe_rtpd_fec_pkt *fec = malloc(sizeof(struct upipe_rtpd_fec_pkt));
+    if (unlikely(fec == NULL)) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    fec->uref = uref;
+    fec->snbase = (fec_header[0] << 8) | fec_header[1];
+    fec->offset = fec_header[13];
+    fec->na = fec_header[14];
+    if (unlikely(!fec->offset || !fec->na)) {
+        upipe_warn(upipe, "invalid FEC header");
+        uref_free(uref);
+        free(fec);
+        return;
+    }
+
+    ulist_add(&upipe_rtpd->fec_pkts, upipe_rtpd_fec_pkt_to_uchain(fec));
+    upipe_rtpd->nb_fec_pkts++;
+    upipe_rtpd_prune_fec(upipe_rtpd_to_upipe(upipe_rtpd));
+}
+
+/** @internal @This processes control commands on a FEC subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtpd_fec_control(struct upipe *upipe, int command,
+                                  va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtpd_fec_get_super(upipe, p);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This frees a FEC subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ */
+static void upipe_rtpd_fec_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_rtpd_fec_clean_sub(upipe);
+    upipe_rtpd_fec_clean_urefcount(upipe);
+    upipe_rtpd_fec_free_void(upipe);
+}
+
+/** @internal @This initializes the FEC manager of a rtpd pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtpd_init_fec_mgr(struct upipe *upipe)
+{
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    struct upipe_mgr *fec_mgr = &upipe_rtpd->fec_mgr;
+    fec_mgr->refcount = upipe_rtpd_to_urefcount(upipe_rtpd);
+    fec_mgr->signature = UPIPE_RTPD_FEC_SIGNATURE;
+    fec_mgr->upipe_alloc = upipe_rtpd_fec_alloc;
+    fec_mgr->upipe_input = upipe_rtpd_fec_input;
+    fec_mgr->upipe_control = upipe_rtpd_fec_control;
+    fec_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a rtpd pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtpd_alloc(struct upipe_mgr *mgr,
+                                      struct uprobe *uprobe,
+                                      uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_rtpd_alloc_void(mgr, uprobe, signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_rtpd *upipe_rtpd = upipe_rtpd_from_upipe(upipe);
+    upipe_rtpd_init_urefcount(upipe);
+    upipe_rtpd_init_output(upipe);
+    upipe_rtpd_init_fec_mgr(upipe);
+    upipe_rtpd_init_sub_fecs(upipe);
+    upipe_rtpd->expected_seqnum = -1;
+    upipe_rtpd->type = 0;
+    upipe_rtpd->flow_def_input = NULL;
+    upipe_rtpd->reorder = 0;
+    upipe_rtpd->next_seqnum = -1;
+    upipe_rtpd->last_seqnum = 0;
+    for (unsigned int i = 0; i < RING_SIZE; i++) {
+        upipe_rtpd->ring[i].uref = NULL;
+        upipe_rtpd->ring[i].pending = false;
+    }
+    ulist_init(&upipe_rtpd->fec_pkts);
+    upipe_rtpd->nb_fec_pkts = 0;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
 /** @internal @This sets the input flow definition.
  *
  * @param upipe description structure of the pipe
@@ -249,6 +771,26 @@ static int upipe_rtpd_control(struct upipe *upipe, int command, va_list args)
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_rtpd_set_output(upipe, output);
         }
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_rtpd_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtpd_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_RTPD_GET_REORDER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTPD_SIGNATURE)
+            unsigned int *reorder_p = va_arg(args, unsigned int *);
+            *reorder_p = upipe_rtpd_from_upipe(upipe)->reorder;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTPD_SET_REORDER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTPD_SIGNATURE)
+            unsigned int reorder = va_arg(args, unsigned int);
+            return _upipe_rtpd_set_reorder(upipe, reorder);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -264,7 +806,10 @@ static void upipe_rtpd_free(struct upipe *upipe)
     upipe_dbg_va(upipe, "releasing pipe %p", upipe);
     upipe_throw_dead(upipe);
 
+    upipe_rtpd_clean_ring(upipe);
+    upipe_rtpd_prune_fec(upipe);
     uref_free(upipe_rtpd->flow_def_input);
+    upipe_rtpd_clean_sub_fecs(upipe);
     upipe_rtpd_clean_output(upipe);
     upipe_rtpd_clean_urefcount(upipe);
     upipe_rtpd_free_void(upipe);
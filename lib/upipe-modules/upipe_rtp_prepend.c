@@ -25,6 +25,9 @@
 
 /** @file
  * @short Upipe rtp module to prepend rtp header to uref blocks
+ * Headers are copied from a template where only the sequence number and
+ * timestamp are patched, into slots of a shared slab buffer, so that a
+ * single buffer allocation serves many packets.
  */
 
 #include <upipe/ubase.h>
@@ -63,6 +66,8 @@
 #define OUT_FLOW "block.rtp."
 
 #define DEFAULT_RATE 90000 /* (90kHz, see rfc 2250 and 3551) */
+/** number of headers in a slab */
+#define SLAB_HEADERS 64
 
 /** upipe_rtp_prepend structure */ 
 struct upipe_rtp_prepend {
@@ -84,6 +89,15 @@ struct upipe_rtp_prepend {
     uint32_t clockrate;
     /** rtp type */ 
     uint8_t type;
+    /** header template */
+    uint8_t header[RTP_HEADER_SIZE];
+
+    /** slab of headers, or NULL */
+    struct ubuf *slab;
+    /** mapped buffer of the slab */
+    uint8_t *slab_buffer;
+    /** number of headers already used in the slab */
+    unsigned int slab_used;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -94,6 +108,63 @@ UPIPE_HELPER_UREFCOUNT(upipe_rtp_prepend, urefcount, upipe_rtp_prepend_free)
 UPIPE_HELPER_VOID(upipe_rtp_prepend);
 UPIPE_HELPER_OUTPUT(upipe_rtp_prepend, output, flow_def, output_state, request_list);
 
+/** @internal @This releases the current slab of headers.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_prepend_clean_slab(struct upipe *upipe)
+{
+    struct upipe_rtp_prepend *upipe_rtp_prepend = upipe_rtp_prepend_from_upipe(upipe);
+    if (upipe_rtp_prepend->slab != NULL) {
+        ubuf_block_unmap(upipe_rtp_prepend->slab, 0);
+        ubuf_free(upipe_rtp_prepend->slab);
+        upipe_rtp_prepend->slab = NULL;
+    }
+}
+
+/** @internal @This allocates a header from the current slab, or from a
+ * new slab if it is exhausted. The slab stays mapped: the slots that
+ * were handed out are shared with downstream pipes and never written
+ * again, while the remaining slots are only written before being handed
+ * out, which is why they cannot go through ubuf_block_write().
+ *
+ * @param upipe description structure of the pipe
+ * @param ubuf_mgr manager to allocate slabs from
+ * @param buf_p filled in with a pointer to the header to write
+ * @return pointer to the header ubuf, or NULL in case of error
+ */
+static struct ubuf *upipe_rtp_prepend_alloc_header(struct upipe *upipe,
+                                                   struct ubuf_mgr *ubuf_mgr,
+                                                   uint8_t **buf_p)
+{
+    struct upipe_rtp_prepend *upipe_rtp_prepend = upipe_rtp_prepend_from_upipe(upipe);
+    if (unlikely(upipe_rtp_prepend->slab != NULL &&
+                 (upipe_rtp_prepend->slab_used >= SLAB_HEADERS ||
+                  upipe_rtp_prepend->slab->mgr != ubuf_mgr)))
+        upipe_rtp_prepend_clean_slab(upipe);
+
+    if (unlikely(upipe_rtp_prepend->slab == NULL)) {
+        struct ubuf *slab = ubuf_block_alloc(ubuf_mgr,
+                                             SLAB_HEADERS * RTP_HEADER_SIZE);
+        int size = -1;
+        if (unlikely(slab == NULL))
+            return NULL;
+        if (unlikely(!ubase_check(ubuf_block_write(slab, 0, &size,
+                            &upipe_rtp_prepend->slab_buffer)) ||
+                     size != SLAB_HEADERS * RTP_HEADER_SIZE)) {
+            ubuf_free(slab);
+            return NULL;
+        }
+        upipe_rtp_prepend->slab = slab;
+        upipe_rtp_prepend->slab_used = 0;
+    }
+
+    int offset = upipe_rtp_prepend->slab_used++ * RTP_HEADER_SIZE;
+    *buf_p = upipe_rtp_prepend->slab_buffer + offset;
+    return ubuf_block_splice(upipe_rtp_prepend->slab, offset,
+                             RTP_HEADER_SIZE);
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -109,7 +180,12 @@ static void upipe_rtp_prepend_input(struct upipe *upipe, struct uref *uref,
     uint64_t cr = 0;
     uint32_t ts;
     lldiv_t div;
-    int size = -1;
+
+    if (unlikely(uref->ubuf == NULL)) {
+        upipe_warn(upipe, "received empty packet");
+        uref_free(uref);
+        return;
+    }
 
     /* timestamp (synced to program clock ref, fallback to system clock ref) */
     if (unlikely(!ubase_check(uref_clock_get_cr_prog(uref, &cr)))) {
@@ -120,7 +196,7 @@ static void upipe_rtp_prepend_input(struct upipe *upipe, struct uref *uref,
          + ((uint64_t)div.rem * upipe_rtp_prepend->clockrate)/UCLOCK_FREQ;
     
     /* alloc header */
-    header = ubuf_block_alloc(uref->ubuf->mgr, RTP_HEADER_SIZE);
+    header = upipe_rtp_prepend_alloc_header(upipe, uref->ubuf->mgr, &buf);
     if (unlikely(!header)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         uref_free(uref);
@@ -128,13 +204,9 @@ static void upipe_rtp_prepend_input(struct upipe *upipe, struct uref *uref,
     }
 
     /* write header */
-    ubuf_block_write(header, 0, &size, &buf);
-    memset(buf, 0, RTP_HEADER_SIZE);
-    rtp_set_hdr(buf);
-    rtp_set_type(buf, upipe_rtp_prepend->type);
+    memcpy(buf, upipe_rtp_prepend->header, RTP_HEADER_SIZE);
     rtp_set_seqnum(buf, upipe_rtp_prepend->seqnum);
     rtp_set_timestamp(buf, ts);
-    ubuf_block_unmap(header, 0);
     upipe_rtp_prepend->seqnum++;
 
     /* append payload (current ubuf) to header to form segmented ubuf */
@@ -201,6 +273,10 @@ static int _upipe_rtp_prepend_set_type(struct upipe *upipe,
     }
     upipe_rtp_prepend->clockrate = clockrate;
     upipe_rtp_prepend->type = type;
+
+    memset(upipe_rtp_prepend->header, 0, RTP_HEADER_SIZE);
+    rtp_set_hdr(upipe_rtp_prepend->header);
+    rtp_set_type(upipe_rtp_prepend->header, type);
     return UBASE_ERR_NONE;
 }
 
@@ -304,6 +380,9 @@ static struct upipe *upipe_rtp_prepend_alloc(struct upipe_mgr *mgr,
     upipe_rtp_prepend_init_output(upipe);
 
     upipe_rtp_prepend->seqnum = 0; /* FIXME random init ?*/
+    upipe_rtp_prepend->slab = NULL;
+    upipe_rtp_prepend->slab_buffer = NULL;
+    upipe_rtp_prepend->slab_used = 0;
 
     /* transport TS by default (FIXME) */
     _upipe_rtp_prepend_set_type(upipe, RTP_TYPE_TS, 0);
@@ -320,6 +399,7 @@ static void upipe_rtp_prepend_free(struct upipe *upipe)
 {
     upipe_throw_dead(upipe);
 
+    upipe_rtp_prepend_clean_slab(upipe);
     upipe_rtp_prepend_clean_output(upipe);
     upipe_rtp_prepend_clean_urefcount(upipe);
     upipe_rtp_prepend_free_void(upipe);
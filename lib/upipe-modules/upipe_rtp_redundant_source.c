@@ -0,0 +1,647 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Bin pipe merging redundant RTP streams (SMPTE 2022-7)
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_flow.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe/upipe_helper_bin_output.h>
+#include <upipe-modules/upipe_rtp_redundant_source.h>
+#include <upipe-modules/upipe_udp_source.h>
+#include <upipe-modules/upipe_rtp_decaps.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+/** we only accept blocks */
+#define EXPECTED_FLOW_DEF "block."
+
+/** @internal @This is the private context of a rtpr manager. */
+struct upipe_rtpr_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pointer to udp source manager */
+    struct upipe_mgr *udpsrc_mgr;
+    /** pointer to rtp decaps manager */
+    struct upipe_mgr *rtpd_mgr;
+
+    /** public upipe_mgr structure */
+    struct upipe_mgr mgr;
+};
+
+UBASE_FROM_TO(upipe_rtpr_mgr, upipe_mgr, upipe_mgr, mgr)
+UBASE_FROM_TO(upipe_rtpr_mgr, urefcount, urefcount, urefcount)
+
+/** @internal @This is the private context of a rtpr pipe. */
+struct upipe_rtpr {
+    /** real refcount management structure */
+    struct urefcount urefcount_real;
+    /** refcount management structure exported to the public structure */
+    struct urefcount urefcount;
+
+    /** proxy probe */
+    struct uprobe proxy_probe;
+    /** probe for the last inner pipe */
+    struct uprobe last_inner_probe;
+
+    /** last inner pipe of the bin (rtpd) */
+    struct upipe *last_inner;
+    /** list of output bin requests */
+    struct uchain output_request_list;
+    /** output */
+    struct upipe *output;
+
+    /** number of legs allocated so far */
+    unsigned int nb_legs;
+    /** list of legs */
+    struct uchain legs;
+    /** manager to create legs */
+    struct upipe_mgr leg_mgr;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtpr, upipe, UPIPE_RTPR_SIGNATURE)
+UPIPE_HELPER_VOID(upipe_rtpr)
+UPIPE_HELPER_UREFCOUNT(upipe_rtpr, urefcount, upipe_rtpr_no_ref)
+UPIPE_HELPER_BIN_OUTPUT(upipe_rtpr, last_inner_probe, last_inner, output,
+                        output_request_list)
+
+UBASE_FROM_TO(upipe_rtpr, urefcount, urefcount_real, urefcount_real)
+
+/** @hidden */
+static void upipe_rtpr_free(struct urefcount *urefcount_real);
+
+/** @internal @This is the private context of a leg of a rtpr pipe. */
+struct upipe_rtpr_leg {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** UDP source feeding the leg, or NULL */
+    struct upipe *source;
+    /** true if the source has ended */
+    bool ended;
+
+    /** expected sequence number, or -1 */
+    int expected_seqnum;
+    /** number of packets received */
+    uint64_t received;
+    /** number of packets lost */
+    uint64_t lost;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtpr_leg, upipe, UPIPE_RTPR_LEG_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtpr_leg, urefcount, upipe_rtpr_leg_free)
+UPIPE_HELPER_VOID(upipe_rtpr_leg)
+UPIPE_HELPER_SUBPIPE(upipe_rtpr, upipe_rtpr_leg, leg, leg_mgr, legs, uchain)
+
+/** @internal @This allocates a leg of a rtpr pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtpr_leg_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_rtpr_leg_alloc_void(mgr, uprobe, signature,
+                                                    args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_rtpr_leg *upipe_rtpr_leg = upipe_rtpr_leg_from_upipe(upipe);
+    upipe_rtpr_leg_init_urefcount(upipe);
+    upipe_rtpr_leg_init_sub(upipe);
+    upipe_rtpr_leg->source = NULL;
+    upipe_rtpr_leg->ended = false;
+    upipe_rtpr_leg->expected_seqnum = -1;
+    upipe_rtpr_leg->received = 0;
+    upipe_rtpr_leg->lost = 0;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This counts the packets of a leg and passes them to the
+ * merging rtpd pipe.
+ *
+ * @param upipe description structure of the leg
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtpr_leg_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_rtpr_leg *upipe_rtpr_leg = upipe_rtpr_leg_from_upipe(upipe);
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_leg_mgr(upipe->mgr);
+    uint8_t rtp_buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp_header = uref_block_peek(uref, 0, RTP_HEADER_SIZE,
+                                                rtp_buffer);
+    if (unlikely(rtp_header == NULL)) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return;
+    }
+    bool valid = rtp_check_hdr(rtp_header);
+    uint16_t seqnum = rtp_get_seqnum(rtp_header);
+    uref_block_peek_unmap(uref, 0, rtp_buffer, rtp_header);
+    if (unlikely(!valid)) {
+        upipe_warn(upipe, "invalid RTP header");
+        uref_free(uref);
+        return;
+    }
+
+    upipe_rtpr_leg->received++;
+    int diff = 0;
+    if (upipe_rtpr_leg->expected_seqnum != -1)
+        diff = (int16_t)(seqnum - upipe_rtpr_leg->expected_seqnum);
+    if (unlikely(diff > 0)) {
+        upipe_rtpr_leg->lost += diff;
+        upipe_throw(upipe, UPROBE_RTPR_LEG_LOSS, UPIPE_RTPR_SIGNATURE,
+                    (uint64_t)diff, upipe_rtpr_leg->lost);
+    }
+    if (diff >= 0)
+        upipe_rtpr_leg->expected_seqnum = (seqnum + 1) & UINT16_MAX;
+
+    if (unlikely(upipe_rtpr->last_inner == NULL)) {
+        uref_free(uref);
+        return;
+    }
+    upipe_input(upipe_rtpr->last_inner, uref, upump_p);
+}
+
+/** @internal @This processes control commands on a leg of a rtpr pipe.
+ *
+ * @param upipe description structure of the leg
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtpr_leg_control(struct upipe *upipe, int command,
+                                  va_list args)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_leg_mgr(upipe->mgr);
+
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (upipe_rtpr->last_inner == NULL)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_register_request(upipe_rtpr->last_inner, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (upipe_rtpr->last_inner == NULL)
+                return UBASE_ERR_NONE;
+            return upipe_unregister_request(upipe_rtpr->last_inner, request);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+            if (upipe_rtpr->last_inner == NULL)
+                return UBASE_ERR_NONE;
+            return upipe_set_flow_def(upipe_rtpr->last_inner, flow_def);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtpr_leg_get_super(upipe, p);
+        }
+
+        case UPIPE_RTPR_LEG_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTPR_LEG_SIGNATURE)
+            struct upipe_rtpr_leg *upipe_rtpr_leg =
+                upipe_rtpr_leg_from_upipe(upipe);
+            uint64_t *received_p = va_arg(args, uint64_t *);
+            uint64_t *lost_p = va_arg(args, uint64_t *);
+            if (received_p != NULL)
+                *received_p = upipe_rtpr_leg->received;
+            if (lost_p != NULL)
+                *lost_p = upipe_rtpr_leg->lost;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This frees a leg of a rtpr pipe.
+ *
+ * @param upipe description structure of the leg
+ */
+static void upipe_rtpr_leg_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_rtpr_leg_clean_sub(upipe);
+    upipe_rtpr_leg_clean_urefcount(upipe);
+    upipe_rtpr_leg_free_void(upipe);
+}
+
+/** @internal @This initializes the leg manager of a rtpr pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtpr_init_leg_mgr(struct upipe *upipe)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_upipe(upipe);
+    struct upipe_mgr *leg_mgr = &upipe_rtpr->leg_mgr;
+    leg_mgr->refcount = upipe_rtpr_to_urefcount_real(upipe_rtpr);
+    leg_mgr->signature = UPIPE_RTPR_LEG_SIGNATURE;
+    leg_mgr->upipe_alloc = upipe_rtpr_leg_alloc;
+    leg_mgr->upipe_input = upipe_rtpr_leg_input;
+    leg_mgr->upipe_control = upipe_rtpr_leg_control;
+    leg_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This catches events coming from an inner pipe, and
+ * attaches them to the bin pipe. The end of a source is only reported
+ * when all legs have ended.
+ *
+ * @param uprobe pointer to the probe in upipe_rtpr_alloc
+ * @param inner pointer to the inner pipe
+ * @param event event triggered by the inner pipe
+ * @param args arguments of the event
+ * @return an error code
+ */
+static int upipe_rtpr_proxy_probe(struct uprobe *uprobe, struct upipe *inner,
+                                  int event, va_list args)
+{
+    struct upipe_rtpr *s = container_of(uprobe, struct upipe_rtpr,
+                                        proxy_probe);
+    struct upipe *upipe = upipe_rtpr_to_upipe(s);
+
+    if (event == UPROBE_SOURCE_END) {
+        bool alive = false;
+        struct uchain *uchain;
+        ulist_foreach (&s->legs, uchain) {
+            struct upipe_rtpr_leg *leg = upipe_rtpr_leg_from_uchain(uchain);
+            if (leg->source == inner)
+                leg->ended = true;
+            else if (leg->source != NULL && !leg->ended)
+                alive = true;
+        }
+        if (alive) {
+            upipe_warn(upipe, "leg source ended");
+            return UBASE_ERR_NONE;
+        }
+    }
+    return upipe_throw_proxy(upipe, inner, event, args);
+}
+
+/** @internal @This allocates a rtpr pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtpr_alloc(struct upipe_mgr *mgr,
+                                      struct uprobe *uprobe,
+                                      uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_rtpr_alloc_void(mgr, uprobe, signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_upipe(upipe);
+    upipe_rtpr_init_urefcount(upipe);
+    urefcount_init(upipe_rtpr_to_urefcount_real(upipe_rtpr), upipe_rtpr_free);
+    upipe_rtpr_init_bin_output(upipe,
+            upipe_rtpr_to_urefcount_real(upipe_rtpr));
+    upipe_rtpr_init_leg_mgr(upipe);
+    upipe_rtpr_init_sub_legs(upipe);
+    upipe_rtpr->nb_legs = 0;
+
+    uprobe_init(&upipe_rtpr->proxy_probe, upipe_rtpr_proxy_probe, NULL);
+    upipe_rtpr->proxy_probe.refcount = upipe_rtpr_to_urefcount_real(upipe_rtpr);
+    upipe_throw_ready(upipe);
+
+    struct upipe_rtpr_mgr *rtpr_mgr = upipe_rtpr_mgr_from_upipe_mgr(upipe->mgr);
+    struct upipe *rtpd = upipe_void_alloc(rtpr_mgr->rtpd_mgr,
+            uprobe_pfx_alloc(uprobe_use(&upipe_rtpr->last_inner_probe),
+                             UPROBE_LOG_VERBOSE, "rtpd"));
+    if (unlikely(rtpd == NULL))
+        goto upipe_rtpr_alloc_err;
+    upipe_rtpr_store_last_inner(upipe, rtpd);
+    if (unlikely(!ubase_check(upipe_rtpd_set_reorder(rtpd,
+                                                     UPIPE_RTPR_DEF_WINDOW))))
+        goto upipe_rtpr_alloc_err;
+    return upipe;
+
+upipe_rtpr_alloc_err:
+    upipe_release(upipe);
+    return NULL;
+}
+
+/** @internal @This adds a leg fed by a UDP source.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri URI of the UDP source
+ * @return an error code
+ */
+static int _upipe_rtpr_add_uri(struct upipe *upipe, const char *uri)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_upipe(upipe);
+    struct upipe_rtpr_mgr *rtpr_mgr = upipe_rtpr_mgr_from_upipe_mgr(upipe->mgr);
+    if (unlikely(uri == NULL))
+        return UBASE_ERR_INVALID;
+
+    unsigned int index = upipe_rtpr->nb_legs++;
+    struct upipe *leg = upipe_void_alloc(&upipe_rtpr->leg_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(&upipe_rtpr->proxy_probe),
+                                UPROBE_LOG_VERBOSE, "leg %u", index));
+    if (unlikely(leg == NULL))
+        return UBASE_ERR_ALLOC;
+
+    struct upipe *source = upipe_void_alloc(rtpr_mgr->udpsrc_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(&upipe_rtpr->proxy_probe),
+                                UPROBE_LOG_VERBOSE, "udpsrc %u", index));
+    if (unlikely(source == NULL)) {
+        upipe_release(leg);
+        return UBASE_ERR_ALLOC;
+    }
+    int err = upipe_set_output(source, leg);
+    upipe_release(leg);
+    if (unlikely(!ubase_check(err))) {
+        upipe_release(source);
+        return err;
+    }
+
+    /* the source now holds the leg, which holds the source until the
+     * bin pipe breaks the cycle */
+    upipe_rtpr_leg_from_upipe(leg)->source = source;
+    err = upipe_set_uri(source, uri);
+    if (unlikely(!ubase_check(err))) {
+        upipe_rtpr_leg_from_upipe(leg)->source = NULL;
+        upipe_release(source);
+        return err;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This releases the UDP sources of all legs, which in turn
+ * release their legs.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtpr_clean_sources(struct upipe *upipe)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_upipe(upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_rtpr->legs, uchain, uchain_tmp) {
+        struct upipe_rtpr_leg *leg = upipe_rtpr_leg_from_uchain(uchain);
+        struct upipe *source = leg->source;
+        if (source == NULL)
+            continue;
+        leg->source = NULL;
+        upipe_release(source);
+    }
+}
+
+/** @internal @This forwards a control command to the sources of all legs.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtpr_control_sources(struct upipe *upipe, int command,
+                                      va_list args)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_upipe(upipe);
+    int err = UBASE_ERR_NONE;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_rtpr->legs, uchain) {
+        struct upipe_rtpr_leg *leg = upipe_rtpr_leg_from_uchain(uchain);
+        if (leg->source == NULL)
+            continue;
+        va_list args_copy;
+        va_copy(args_copy, args);
+        int err_leg = upipe_control_va(leg->source, command, args_copy);
+        va_end(args_copy);
+        if (!ubase_check(err_leg))
+            err = err_leg;
+    }
+    return err;
+}
+
+/** @internal @This forwards a control command to the source of the first
+ * leg having one.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtpr_control_first_source(struct upipe *upipe, int command,
+                                           va_list args)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_upipe(upipe);
+    struct uchain *uchain;
+    ulist_foreach (&upipe_rtpr->legs, uchain) {
+        struct upipe_rtpr_leg *leg = upipe_rtpr_leg_from_uchain(uchain);
+        if (leg->source != NULL)
+            return upipe_control_va(leg->source, command, args);
+    }
+    return UBASE_ERR_UNHANDLED;
+}
+
+/** @internal @This processes control commands on a rtpr pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtpr_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_ATTACH_UREF_MGR:
+        case UPIPE_ATTACH_UPUMP_MGR:
+        case UPIPE_ATTACH_UBUF_MGR:
+        case UPIPE_ATTACH_UCLOCK:
+        case UPIPE_SOURCE_SET_READ_SIZE:
+            return upipe_rtpr_control_sources(upipe, command, args);
+        case UPIPE_SOURCE_GET_READ_SIZE:
+        case UPIPE_GET_URI:
+            return upipe_rtpr_control_first_source(upipe, command, args);
+        case UPIPE_SET_URI: {
+            const char *uri = va_arg(args, const char *);
+            upipe_rtpr_clean_sources(upipe);
+            if (uri == NULL)
+                return UBASE_ERR_NONE;
+            return _upipe_rtpr_add_uri(upipe, uri);
+        }
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_rtpr_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtpr_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_RTPR_ADD_URI: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTPR_SIGNATURE)
+            const char *uri = va_arg(args, const char *);
+            return _upipe_rtpr_add_uri(upipe, uri);
+        }
+
+        default:
+            return upipe_rtpr_control_bin_output(upipe, command, args);
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param urefcount_real pointer to urefcount_real structure
+ */
+static void upipe_rtpr_free(struct urefcount *urefcount_real)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_urefcount_real(urefcount_real);
+    struct upipe *upipe = upipe_rtpr_to_upipe(upipe_rtpr);
+    upipe_throw_dead(upipe);
+    upipe_rtpr_clean_sub_legs(upipe);
+    uprobe_clean(&upipe_rtpr->proxy_probe);
+    uprobe_clean(&upipe_rtpr->last_inner_probe);
+    urefcount_clean(urefcount_real);
+    upipe_rtpr_clean_urefcount(upipe);
+    upipe_rtpr_free_void(upipe);
+}
+
+/** @This is called when there is no external reference to the pipe anymore.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtpr_no_ref(struct upipe *upipe)
+{
+    struct upipe_rtpr *upipe_rtpr = upipe_rtpr_from_upipe(upipe);
+    upipe_rtpr_clean_sources(upipe);
+    upipe_rtpr_clean_bin_output(upipe);
+    upipe_rtpr->last_inner = NULL;
+    urefcount_release(upipe_rtpr_to_urefcount_real(upipe_rtpr));
+}
+
+/** @This frees a upipe manager.
+ *
+ * @param urefcount pointer to urefcount structure
+ */
+static void upipe_rtpr_mgr_free(struct urefcount *urefcount)
+{
+    struct upipe_rtpr_mgr *rtpr_mgr = upipe_rtpr_mgr_from_urefcount(urefcount);
+    upipe_mgr_release(rtpr_mgr->udpsrc_mgr);
+    upipe_mgr_release(rtpr_mgr->rtpd_mgr);
+
+    urefcount_clean(urefcount);
+    free(rtpr_mgr);
+}
+
+/** @This processes control commands on a rtpr manager.
+ *
+ * @param mgr pointer to manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtpr_mgr_control(struct upipe_mgr *mgr,
+                                  int command, va_list args)
+{
+    struct upipe_rtpr_mgr *rtpr_mgr = upipe_rtpr_mgr_from_upipe_mgr(mgr);
+
+    switch (command) {
+#define GET_SET_MGR(name, NAME)                                             \
+        case UPIPE_RTPR_MGR_GET_##NAME##_MGR: {                             \
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTPR_SIGNATURE)               \
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);       \
+            *p = rtpr_mgr->name##_mgr;                                      \
+            return UBASE_ERR_NONE;                                          \
+        }                                                                   \
+        case UPIPE_RTPR_MGR_SET_##NAME##_MGR: {                             \
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTPR_SIGNATURE)               \
+            if (!urefcount_single(&rtpr_mgr->urefcount))                    \
+                return UBASE_ERR_BUSY;                                      \
+            struct upipe_mgr *m = va_arg(args, struct upipe_mgr *);         \
+            upipe_mgr_release(rtpr_mgr->name##_mgr);                        \
+            rtpr_mgr->name##_mgr = upipe_mgr_use(m);                        \
+            return UBASE_ERR_NONE;                                          \
+        }
+
+        GET_SET_MGR(udpsrc, UDPSRC)
+        GET_SET_MGR(rtpd, RTPD)
+#undef GET_SET_MGR
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This returns the management structure for all rtpr pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtpr_mgr_alloc(void)
+{
+    struct upipe_rtpr_mgr *rtpr_mgr = malloc(sizeof(struct upipe_rtpr_mgr));
+    if (unlikely(rtpr_mgr == NULL))
+        return NULL;
+
+    rtpr_mgr->udpsrc_mgr = upipe_udpsrc_mgr_alloc();
+    rtpr_mgr->rtpd_mgr = upipe_rtpd_mgr_alloc();
+
+    urefcount_init(upipe_rtpr_mgr_to_urefcount(rtpr_mgr),
+                   upipe_rtpr_mgr_free);
+    rtpr_mgr->mgr.refcount = upipe_rtpr_mgr_to_urefcount(rtpr_mgr);
+    rtpr_mgr->mgr.signature = UPIPE_RTPR_SIGNATURE;
+    rtpr_mgr->mgr.upipe_alloc = upipe_rtpr_alloc;
+    rtpr_mgr->mgr.upipe_input = NULL;
+    rtpr_mgr->mgr.upipe_control = upipe_rtpr_control;
+    rtpr_mgr->mgr.upipe_mgr_control = upipe_rtpr_mgr_control;
+    return upipe_rtpr_mgr_to_upipe_mgr(rtpr_mgr);
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short common definitions for shared-memory sinks and sources
+ *
+ * Each message of the SOCK_SEQPACKET socket carries a header, followed by
+ * the descriptions of the buffers and the serialized attributes. The first
+ * message carries the file descriptor of the arena in ancillary data.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/udict.h>
+#include <upipe/uref.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/** maximum size of a message */
+#define UPIPE_SHM_MSG_SIZE 65536
+/** maximum number of segments of a block, or planes of a picture */
+#define UPIPE_SHM_MAX_BUFFERS 16
+/** maximum size of a chroma name, including the final NUL */
+#define UPIPE_SHM_CHROMA_SIZE 16
+
+/** @internal @This defines the types of messages. */
+enum upipe_shm_msg_type {
+    /** flow definition */
+    UPIPE_SHM_MSG_FLOW_DEF,
+    /** data uref */
+    UPIPE_SHM_MSG_UREF
+};
+
+/** @internal @This defines the types of buffers carried by a uref. */
+enum upipe_shm_ubuf_type {
+    /** no buffer */
+    UPIPE_SHM_UBUF_NONE,
+    /** block buffer, one description per segment */
+    UPIPE_SHM_UBUF_BLOCK,
+    /** picture buffer, one description per plane */
+    UPIPE_SHM_UBUF_PIC
+};
+
+/** @internal @This describes a segment of a block, or a plane of a
+ * picture. */
+struct upipe_shm_buffer {
+    /** offset of the buffer in the arena */
+    uint64_t offset;
+    /** size of the segment, or stride of the plane */
+    uint64_t size;
+    /** chroma of the plane */
+    char chroma[UPIPE_SHM_CHROMA_SIZE];
+};
+
+/** @internal @This is the header of a message. */
+struct upipe_shm_msg {
+    /** type of message (@see upipe_shm_msg_type) */
+    uint32_t type;
+    /** type of buffer (@see upipe_shm_ubuf_type) */
+    uint32_t ubuf_type;
+    /** number of buffer descriptions following the header */
+    uint32_t nb_buffers;
+    /** size of the serialized attributes following the descriptions */
+    uint32_t attr_size;
+    /** horizontal size of the picture */
+    uint64_t hsize;
+    /** vertical size of the picture */
+    uint64_t vsize;
+
+    /** flags of the uref */
+    uint64_t flags;
+    /** dates of the uref */
+    uint64_t date_sys, date_prog, date_orig;
+    /** delays of the uref */
+    uint64_t dts_pts_delay, cr_dts_delay, rap_cr_delay;
+    /** ingress date of the uref */
+    uint64_t date_ingress;
+};
+
+/** @internal @This copies the flags and dates of a uref to a message.
+ *
+ * @param msg pointer to the message header
+ * @param uref pointer to the uref
+ */
+static inline void upipe_shm_msg_from_uref(struct upipe_shm_msg *msg,
+                                           const struct uref *uref)
+{
+    msg->flags = uref->flags;
+    msg->date_sys = uref->date_sys;
+    msg->date_prog = uref->date_prog;
+    msg->date_orig = uref->date_orig;
+    msg->dts_pts_delay = uref->dts_pts_delay;
+    msg->cr_dts_delay = uref->cr_dts_delay;
+    msg->rap_cr_delay = uref->rap_cr_delay;
+    msg->date_ingress = uref->date_ingress;
+}
+
+/** @internal @This copies the flags and dates of a message to a uref.
+ *
+ * @param msg pointer to the message header
+ * @param uref pointer to the uref
+ */
+static inline void upipe_shm_msg_to_uref(const struct upipe_shm_msg *msg,
+                                         struct uref *uref)
+{
+    uref->flags = msg->flags;
+    uref->date_sys = msg->date_sys;
+    uref->date_prog = msg->date_prog;
+    uref->date_orig = msg->date_orig;
+    uref->dts_pts_delay = msg->dts_pts_delay;
+    uref->cr_dts_delay = msg->cr_dts_delay;
+    uref->rap_cr_delay = msg->rap_cr_delay;
+    uref->date_ingress = msg->date_ingress;
+}
+
+/** @internal @This serializes the attributes of a uref. Each attribute is
+ * written as its type (1 octet), the size of its name including the final
+ * NUL, or 0 for shorthands (1 octet), the size of its value (4 octets),
+ * the name and the value.
+ *
+ * @param uref pointer to the uref
+ * @param buffer buffer to write to
+ * @param size size of the buffer
+ * @param size_p filled in with the number of octets written
+ * @return an error code, UBASE_ERR_INVALID if the buffer is too small
+ */
+static inline int upipe_shm_serialize_attrs(struct uref *uref, uint8_t *buffer,
+                                            size_t size, size_t *size_p)
+{
+    size_t offset = 0;
+    if (uref->udict != NULL) {
+        const char *name = NULL;
+        enum udict_type type = UDICT_TYPE_END;
+        while (ubase_check(udict_iterate(uref->udict, &name, &type)) &&
+               type != UDICT_TYPE_END) {
+            size_t value_size;
+            const uint8_t *value = NULL;
+            UBASE_RETURN(udict_get(uref->udict, name, type, &value_size,
+                                   &value))
+            /* registered keys are local to the process, send their name */
+            const char *wire_name = name;
+            enum udict_type wire_type = type;
+            if (type >= UDICT_TYPE_KEY)
+                UBASE_RETURN(udict_key_name(type, &wire_name, &wire_type))
+            size_t name_size = wire_name != NULL ? strlen(wire_name) + 1 : 0;
+            uint32_t value_size32 = value_size;
+            if (unlikely(name_size > UINT8_MAX || value_size > UINT32_MAX ||
+                         offset + 6 + name_size + value_size > size))
+                return UBASE_ERR_INVALID;
+            buffer[offset++] = wire_type;
+            buffer[offset++] = name_size;
+            memcpy(buffer + offset, &value_size32, 4);
+            offset += 4;
+            if (name_size)
+                memcpy(buffer + offset, wire_name, name_size);
+            offset += name_size;
+            memcpy(buffer + offset, value, value_size);
+            offset += value_size;
+        }
+    }
+    *size_p = offset;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This deserializes attributes into a uref.
+ *
+ * @param uref pointer to the uref
+ * @param buffer buffer written by @ref upipe_shm_serialize_attrs
+ * @param size size of the buffer
+ * @return an error code
+ */
+static inline int upipe_shm_deserialize_attrs(struct uref *uref,
+                                              const uint8_t *buffer,
+                                              size_t size)
+{
+    if (size && uref->udict == NULL) {
+        uref->udict = udict_alloc(uref->mgr->udict_mgr, 0);
+        UBASE_ALLOC_RETURN(uref->udict)
+    }
+
+    size_t offset = 0;
+    while (offset < size) {
+        if (unlikely(offset + 6 > size))
+            return UBASE_ERR_INVALID;
+        enum udict_type type = buffer[offset++];
+        size_t name_size = buffer[offset++];
+        uint32_t value_size;
+        memcpy(&value_size, buffer + offset, 4);
+        offset += 4;
+        if (unlikely(type == UDICT_TYPE_END || type >= UDICT_TYPE_KEY ||
+                     (name_size == 0) != (type > UDICT_TYPE_SHORTHAND) ||
+                     offset + name_size + value_size > size ||
+                     (name_size && buffer[offset + name_size - 1] != '\0')))
+            return UBASE_ERR_INVALID;
+        const char *name = name_size ? (const char *)buffer + offset : NULL;
+        offset += name_size;
+        if (name != NULL && ubase_check(udict_key_find(name, type, &type)))
+            name = NULL;
+        uint8_t *value = NULL;
+        UBASE_RETURN(udict_set(uref->udict, name, type, value_size, &value))
+        if (value_size)
+            memcpy(value, buffer + offset, value_size);
+        offset += value_size;
+    }
+    return UBASE_ERR_NONE;
+}
@@ -0,0 +1,703 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe sink module passing urefs to another process through shared
+ * memory
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/umem.h>
+#include <upipe/umem_shm.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/upump.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_mem.h>
+#include <upipe/urequest.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_input.h>
+#include <upipe-modules/upipe_shm_sink.h>
+#include "upipe_shm.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/** we only accept blocks and pictures */
+#define EXPECTED_FLOW_DEF_BLOCK "block."
+/** we only accept blocks and pictures */
+#define EXPECTED_FLOW_DEF_PIC "pic."
+/** depth of the pool of ubufs of the managers allocating in the arena */
+#define UBUF_POOL_DEPTH 5
+/** depth of the pool of shared objects of the managers allocating in the
+ * arena */
+#define UBUF_SHARED_POOL_DEPTH 5
+
+/** @hidden */
+static void upipe_shmsink_watcher(struct upump *upump);
+/** @hidden */
+static bool upipe_shmsink_output(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p);
+
+/** @internal @This is the private context of a shared memory sink pipe. */
+struct upipe_shmsink {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** write watcher */
+    struct upump *upump;
+
+    /** umem shm manager of the arena */
+    struct umem_mgr *umem_mgr;
+    /** ubuf manager allocating copies in the arena, or NULL */
+    struct ubuf_mgr *ubuf_mgr;
+    /** socket */
+    int fd;
+    /** true if the file descriptor of the arena has been sent */
+    bool arena_sent;
+
+    /** temporary uref storage */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers */
+    struct uchain blockers;
+
+    /** message being sent */
+    uint8_t buffer[UPIPE_SHM_MSG_SIZE];
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_shmsink, upipe, UPIPE_SHMSINK_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_shmsink, urefcount, upipe_shmsink_free)
+UPIPE_HELPER_UPUMP_MGR(upipe_shmsink, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_shmsink, upump, upump_mgr)
+UPIPE_HELPER_INPUT(upipe_shmsink, urefs, nb_urefs, max_urefs, blockers, upipe_shmsink_output)
+
+/** @hidden */
+static void upipe_shmsink_free(struct upipe *upipe);
+
+/** @internal @This allocates a shared memory sink pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *_upipe_shmsink_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    if (signature != UPIPE_SHMSINK_SIGNATURE)
+        goto upipe_shmsink_alloc_err;
+    struct umem_mgr *umem_mgr = va_arg(args, struct umem_mgr *);
+    int fd = va_arg(args, int);
+    int arena_fd;
+    if (umem_mgr == NULL ||
+        !ubase_check(umem_shm_mgr_get_fd(umem_mgr, &arena_fd)))
+        goto upipe_shmsink_alloc_err_fd;
+
+    struct upipe_shmsink *upipe_shmsink =
+        malloc(sizeof(struct upipe_shmsink));
+    if (unlikely(upipe_shmsink == NULL))
+        goto upipe_shmsink_alloc_err_fd;
+
+    struct upipe *upipe = upipe_shmsink_to_upipe(upipe_shmsink);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_shmsink_init_urefcount(upipe);
+    upipe_shmsink_init_upump_mgr(upipe);
+    upipe_shmsink_init_upump(upipe);
+    upipe_shmsink_init_input(upipe);
+    upipe_shmsink->umem_mgr = umem_mgr_use(umem_mgr);
+    upipe_shmsink->ubuf_mgr = NULL;
+    upipe_shmsink->fd = fd;
+    upipe_shmsink->arena_sent = false;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+
+upipe_shmsink_alloc_err_fd:
+    if (fd != -1)
+        close(fd);
+upipe_shmsink_alloc_err:
+    uprobe_release(uprobe);
+    return NULL;
+}
+
+/** @This starts the watcher waiting for the sink to unblock.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_shmsink_poll(struct upipe *upipe)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    if (unlikely(!ubase_check(upipe_shmsink_check_upump_mgr(upipe)))) {
+        upipe_err_va(upipe, "can't get upump_mgr");
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return;
+    }
+    struct upump *watcher = upump_alloc_fd_write(upipe_shmsink->upump_mgr,
+                                                 upipe_shmsink_watcher, upipe,
+                                                 upipe_shmsink->fd);
+    if (unlikely(watcher == NULL)) {
+        upipe_err(upipe, "can't create watcher");
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+    } else {
+        upipe_shmsink_set_upump(upipe, watcher);
+        upump_start(watcher);
+    }
+}
+
+/** @internal @This releases the references taken on behalf of the receiver
+ * by @ref upipe_shmsink_export, when the message could not be sent.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffers array of buffer descriptions
+ * @param nb_refs number of references taken
+ */
+static void upipe_shmsink_unexport(struct upipe *upipe,
+                                   const struct upipe_shm_buffer *buffers,
+                                   unsigned int nb_refs)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    for (unsigned int i = 0; i < nb_refs; i++) {
+        struct umem umem;
+        size_t skip;
+        if (ubase_check(umem_shm_mgr_import(upipe_shmsink->umem_mgr,
+                                            buffers[i].offset, &umem, &skip)))
+            umem_free(&umem);
+    }
+}
+
+/** @internal @This describes the segments of a block buffer, taking a
+ * reference to each segment on behalf of the receiver.
+ *
+ * @param upipe description structure of the pipe
+ * @param ubuf pointer to the block buffer
+ * @param msg filled in with the number of segments
+ * @param buffers filled in with the description of the segments
+ * @return an error code, UBASE_ERR_BUSY if the buffer must be copied
+ */
+static int upipe_shmsink_export_block(struct upipe *upipe, struct ubuf *ubuf,
+                                      struct upipe_shm_msg *msg,
+                                      struct upipe_shm_buffer *buffers)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    unsigned int nb = 0;
+    while (ubuf != NULL) {
+        struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
+        int err = UBASE_ERR_BUSY;
+        if (nb < UPIPE_SHM_MAX_BUFFERS && !block->map &&
+            ubase_check(ubuf_control(ubuf, UBUF_SINGLE)))
+            err = umem_shm_mgr_export(upipe_shmsink->umem_mgr,
+                                      block->buffer + block->offset,
+                                      &buffers[nb].offset);
+        if (unlikely(!ubase_check(err))) {
+            upipe_shmsink_unexport(upipe, buffers, nb);
+            return err == UBASE_ERR_INVALID ? UBASE_ERR_BUSY : err;
+        }
+        buffers[nb].size = block->size;
+        memset(buffers[nb].chroma, 0, UPIPE_SHM_CHROMA_SIZE);
+        nb++;
+        ubuf = block->next_ubuf;
+    }
+    msg->ubuf_type = UPIPE_SHM_UBUF_BLOCK;
+    msg->nb_buffers = nb;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This describes the planes of a picture buffer, taking a
+ * reference to the buffer on behalf of the receiver. Only the plane with
+ * the lowest address is exported, other planes are described with respect
+ * to it.
+ *
+ * @param upipe description structure of the pipe
+ * @param ubuf pointer to the picture buffer
+ * @param msg filled in with the size of the picture and the number of planes
+ * @param buffers filled in with the description of the planes
+ * @return an error code, UBASE_ERR_BUSY if the buffer must be copied
+ */
+static int upipe_shmsink_export_pic(struct upipe *upipe, struct ubuf *ubuf,
+                                    struct upipe_shm_msg *msg,
+                                    struct upipe_shm_buffer *buffers)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    size_t hsize, vsize;
+    UBASE_RETURN(ubuf_pic_size(ubuf, &hsize, &vsize, NULL))
+    if (!ubase_check(ubuf_control(ubuf, UBUF_SINGLE)))
+        return UBASE_ERR_BUSY;
+
+    const uint8_t *planes[UPIPE_SHM_MAX_BUFFERS];
+    const uint8_t *base = NULL;
+    unsigned int nb = 0;
+    const char *chroma = NULL;
+    while (ubase_check(ubuf_pic_plane_iterate(ubuf, &chroma)) &&
+           chroma != NULL) {
+        size_t stride;
+        if (unlikely(nb >= UPIPE_SHM_MAX_BUFFERS ||
+                     strlen(chroma) >= UPIPE_SHM_CHROMA_SIZE))
+            return UBASE_ERR_INVALID;
+        UBASE_RETURN(ubuf_pic_plane_size(ubuf, chroma, &stride,
+                                         NULL, NULL, NULL))
+        UBASE_RETURN(ubuf_pic_plane_read(ubuf, chroma, 0, 0, -1, -1,
+                                         &planes[nb]))
+        ubuf_pic_plane_unmap(ubuf, chroma, 0, 0, -1, -1);
+        buffers[nb].size = stride;
+        memset(buffers[nb].chroma, 0, UPIPE_SHM_CHROMA_SIZE);
+        strcpy(buffers[nb].chroma, chroma);
+        if (base == NULL || planes[nb] < base)
+            base = planes[nb];
+        nb++;
+    }
+    if (unlikely(!nb))
+        return UBASE_ERR_INVALID;
+
+    uint64_t offset;
+    int err = umem_shm_mgr_export(upipe_shmsink->umem_mgr, base, &offset);
+    if (unlikely(!ubase_check(err)))
+        return err == UBASE_ERR_INVALID ? UBASE_ERR_BUSY : err;
+    /* the first description carries the exported reference */
+    for (unsigned int i = 0; i < nb; i++)
+        buffers[i].offset = offset + (planes[i] - base);
+    for (unsigned int i = 1; i < nb; i++)
+        if (planes[i] == base) {
+            struct upipe_shm_buffer swap = buffers[0];
+            buffers[0] = buffers[i];
+            buffers[i] = swap;
+            break;
+        }
+    msg->ubuf_type = UPIPE_SHM_UBUF_PIC;
+    msg->nb_buffers = nb;
+    msg->hsize = hsize;
+    msg->vsize = vsize;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This describes the buffer of a uref, copying it into the arena
+ * if it can't be passed by reference.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param msg filled in with the description of the buffer
+ * @param buffers filled in with the description of the segments or planes
+ * @return an error code
+ */
+static int upipe_shmsink_export(struct upipe *upipe, struct uref *uref,
+                                struct upipe_shm_msg *msg,
+                                struct upipe_shm_buffer *buffers)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    msg->ubuf_type = UPIPE_SHM_UBUF_NONE;
+    msg->nb_buffers = 0;
+    if (uref->ubuf == NULL)
+        return UBASE_ERR_NONE;
+
+    bool block = uref->ubuf->mgr->signature == UBUF_ALLOC_BLOCK;
+    if (!block && uref->ubuf->mgr->signature != UBUF_ALLOC_PICTURE)
+        return UBASE_ERR_INVALID;
+
+    int err = block ?
+        upipe_shmsink_export_block(upipe, uref->ubuf, msg, buffers) :
+        upipe_shmsink_export_pic(upipe, uref->ubuf, msg, buffers);
+    if (err != UBASE_ERR_BUSY)
+        return err;
+
+    if (unlikely(upipe_shmsink->ubuf_mgr == NULL))
+        return UBASE_ERR_INVALID;
+    struct ubuf *ubuf = block ?
+        ubuf_block_copy(upipe_shmsink->ubuf_mgr, uref->ubuf, 0, -1) :
+        ubuf_pic_copy(upipe_shmsink->ubuf_mgr, uref->ubuf, 0, 0, -1, -1);
+    UBASE_ALLOC_RETURN(ubuf)
+    uref_attach_ubuf(uref, ubuf);
+
+    return block ?
+        upipe_shmsink_export_block(upipe, uref->ubuf, msg, buffers) :
+        upipe_shmsink_export_pic(upipe, uref->ubuf, msg, buffers);
+}
+
+/** @internal @This receives a new flow definition, and allocates an ubuf
+ * manager for copies in the arena.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ */
+static void upipe_shmsink_new_flow_def(struct upipe *upipe,
+                                       struct uref *flow_def)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    ubuf_mgr_release(upipe_shmsink->ubuf_mgr);
+    upipe_shmsink->ubuf_mgr =
+        ubuf_mem_mgr_alloc_from_flow_def(UBUF_POOL_DEPTH,
+                                         UBUF_SHARED_POOL_DEPTH,
+                                         upipe_shmsink->umem_mgr, flow_def);
+    if (unlikely(upipe_shmsink->ubuf_mgr == NULL))
+        upipe_warn(upipe, "unable to allocate copies in the arena");
+}
+
+/** @internal @This sends a uref to the other process.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ * @return true if the uref was processed
+ */
+static bool upipe_shmsink_output(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    if (unlikely(upipe_shmsink->fd == -1)) {
+        uref_free(uref);
+        return true;
+    }
+
+    struct upipe_shm_msg msg;
+    struct upipe_shm_buffer buffers[UPIPE_SHM_MAX_BUFFERS];
+    memset(&msg, 0, sizeof(msg));
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_shmsink_new_flow_def(upipe, uref);
+        msg.type = UPIPE_SHM_MSG_FLOW_DEF;
+    } else {
+        msg.type = UPIPE_SHM_MSG_UREF;
+        if (unlikely(!ubase_check(upipe_shmsink_export(upipe, uref, &msg,
+                                                       buffers)))) {
+            upipe_warn(upipe, "unable to pass buffer, dropping");
+            uref_free(uref);
+            return true;
+        }
+    }
+
+    upipe_shm_msg_from_uref(&msg, uref);
+    size_t header_size = sizeof(msg) +
+                         msg.nb_buffers * sizeof(struct upipe_shm_buffer);
+    size_t attr_size;
+    if (unlikely(!ubase_check(upipe_shm_serialize_attrs(uref,
+                        upipe_shmsink->buffer + header_size,
+                        UPIPE_SHM_MSG_SIZE - header_size, &attr_size)))) {
+        upipe_warn(upipe, "attributes too large, dropping");
+        upipe_shmsink_unexport(upipe, buffers, msg.nb_buffers);
+        uref_free(uref);
+        return true;
+    }
+    msg.attr_size = attr_size;
+    memcpy(upipe_shmsink->buffer, &msg, sizeof(msg));
+    memcpy(upipe_shmsink->buffer + sizeof(msg), buffers,
+           msg.nb_buffers * sizeof(struct upipe_shm_buffer));
+
+    struct iovec iov;
+    iov.iov_base = upipe_shmsink->buffer;
+    iov.iov_len = header_size + attr_size;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msghdr;
+    memset(&msghdr, 0, sizeof(msghdr));
+    msghdr.msg_iov = &iov;
+    msghdr.msg_iovlen = 1;
+    if (unlikely(!upipe_shmsink->arena_sent)) {
+        /* the first message carries the arena */
+        int arena_fd;
+        umem_shm_mgr_get_fd(upipe_shmsink->umem_mgr, &arena_fd);
+        memset(&control, 0, sizeof(control));
+        msghdr.msg_control = control.buf;
+        msghdr.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msghdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &arena_fd, sizeof(int));
+    }
+
+    for ( ; ; ) {
+        ssize_t ret = sendmsg(upipe_shmsink->fd, &msghdr,
+                              MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (likely(ret != -1))
+            break;
+
+        switch (errno) {
+            case EINTR:
+                continue;
+            case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+            case EWOULDBLOCK:
+#endif
+                /* the uref will be exported again */
+                upipe_shmsink_unexport(upipe, buffers, msg.nb_buffers);
+                upipe_shmsink_poll(upipe);
+                return false;
+            case EPIPE:
+            case ECONNRESET:
+            default:
+                break;
+        }
+        upipe_warn_va(upipe, "write error (%m)");
+        upipe_shmsink_unexport(upipe, buffers, msg.nb_buffers);
+        uref_free(uref);
+        close(upipe_shmsink->fd);
+        upipe_shmsink->fd = -1;
+        upipe_shmsink_set_upump(upipe, NULL);
+        upipe_throw_sink_end(upipe);
+        return true;
+    }
+
+    /* the references of the message now belong to the receiver */
+    upipe_shmsink->arena_sent = true;
+    uref_free(uref);
+    return true;
+}
+
+/** @internal @This is called when the socket can be written again.
+ * Unblock the sink and unqueue all queued buffers.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_shmsink_watcher(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    upipe_shmsink_set_upump(upipe, NULL);
+    upipe_shmsink_output_input(upipe);
+    upipe_shmsink_unblock_input(upipe);
+    if (upipe_shmsink_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_shmsink_input. */
+        upipe_release(upipe);
+    }
+}
+
+/** @internal @This receives data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_shmsink_input(struct upipe *upipe, struct uref *uref,
+                                struct upump **upump_p)
+{
+    if (!upipe_shmsink_check_input(upipe)) {
+        upipe_shmsink_hold_input(upipe, uref);
+        upipe_shmsink_block_input(upipe, upump_p);
+    } else if (!upipe_shmsink_output(upipe, uref, upump_p)) {
+        upipe_shmsink_hold_input(upipe, uref);
+        upipe_shmsink_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_shmsink_set_flow_def(struct upipe *upipe,
+                                      struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    if (!ubase_check(uref_flow_match_def(flow_def,
+                                         EXPECTED_FLOW_DEF_BLOCK)) &&
+        !ubase_check(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF_PIC)))
+        return UBASE_ERR_INVALID;
+    /* the flow definition is sent in order with the data */
+    flow_def = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def)
+    upipe_input(upipe, flow_def, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This provides upstream pipes with ubuf managers allocating
+ * in the arena.
+ *
+ * @param upipe description structure of the pipe
+ * @param request description structure of the request
+ * @return an error code
+ */
+static int upipe_shmsink_provide_request(struct upipe *upipe,
+                                         struct urequest *request)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    if (request->type == UREQUEST_UBUF_MGR && request->uref != NULL) {
+        struct uref *flow_format = uref_dup(request->uref);
+        UBASE_ALLOC_RETURN(flow_format)
+        struct ubuf_mgr *ubuf_mgr =
+            ubuf_mem_mgr_alloc_from_flow_def(UBUF_POOL_DEPTH,
+                                             UBUF_SHARED_POOL_DEPTH,
+                                             upipe_shmsink->umem_mgr,
+                                             flow_format);
+        if (likely(ubuf_mgr != NULL))
+            return urequest_provide_ubuf_mgr(request, ubuf_mgr, flow_format);
+        uref_free(flow_format);
+    }
+    return upipe_throw_provide_request(upipe, request);
+}
+
+/** @internal @This flushes all currently held buffers, and unblocks the
+ * sources.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_shmsink_flush(struct upipe *upipe)
+{
+    if (upipe_shmsink_flush_input(upipe)) {
+        upipe_shmsink_set_upump(upipe, NULL);
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_shmsink_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a shared memory sink pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_shmsink_control(struct upipe *upipe, int command,
+                                  va_list args)
+{
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_shmsink_set_upump(upipe, NULL);
+            return upipe_shmsink_attach_upump_mgr(upipe);
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_shmsink_provide_request(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_shmsink_set_flow_def(upipe, flow_def);
+        }
+
+        case UPIPE_GET_MAX_LENGTH: {
+            unsigned int *p = va_arg(args, unsigned int *);
+            return upipe_shmsink_get_max_length(upipe, p);
+        }
+        case UPIPE_SET_MAX_LENGTH: {
+            unsigned int max_length = va_arg(args, unsigned int);
+            return upipe_shmsink_set_max_length(upipe, max_length);
+        }
+        case UPIPE_FLUSH:
+            return upipe_shmsink_flush(upipe);
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands on a shared memory sink pipe,
+ * and checks the status of the pipe afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_shmsink_control(struct upipe *upipe, int command,
+                                 va_list args)
+{
+    UBASE_RETURN(_upipe_shmsink_control(upipe, command, args));
+
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    if (unlikely(!upipe_shmsink_check_input(upipe) &&
+                 upipe_shmsink->fd != -1))
+        upipe_shmsink_poll(upipe);
+
+    return UBASE_ERR_NONE;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_shmsink_free(struct upipe *upipe)
+{
+    struct upipe_shmsink *upipe_shmsink = upipe_shmsink_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    upipe_shmsink_clean_upump(upipe);
+    upipe_shmsink_clean_upump_mgr(upipe);
+    upipe_shmsink_clean_input(upipe);
+    if (upipe_shmsink->fd != -1)
+        close(upipe_shmsink->fd);
+    ubuf_mgr_release(upipe_shmsink->ubuf_mgr);
+    umem_mgr_release(upipe_shmsink->umem_mgr);
+    upipe_shmsink_clean_urefcount(upipe);
+    upipe_clean(upipe);
+    free(upipe_shmsink);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_shmsink_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_SHMSINK_SIGNATURE,
+
+    .upipe_alloc = _upipe_shmsink_alloc,
+    .upipe_input = upipe_shmsink_input,
+    .upipe_control = upipe_shmsink_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all shared memory sinks.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_shmsink_mgr_alloc(void)
+{
+    return &upipe_shmsink_mgr;
+}
@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module receiving urefs from another process through
+ * shared memory
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/umem.h>
+#include <upipe/umem_shm.h>
+#include <upipe/uref.h>
+#include <upipe/upump.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_uref_mgr.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe-modules/upipe_shm_source.h>
+#include "upipe_shm.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifndef MSG_CMSG_CLOEXEC
+#   define MSG_CMSG_CLOEXEC 0
+#endif
+
+/** @hidden */
+static int upipe_shmsrc_check(struct upipe *upipe, struct uref *flow_format);
+
+/** @internal @This is the private context of a shared memory source pipe. */
+struct upipe_shmsrc {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** uref manager */
+    struct uref_mgr *uref_mgr;
+    /** uref manager request */
+    struct urequest uref_mgr_request;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** read watcher */
+    struct upump *upump;
+
+    /** umem shm manager attached to the arena of the sink, or NULL */
+    struct umem_mgr *umem_mgr;
+    /** socket */
+    int fd;
+
+    /** message being received */
+    uint8_t buffer[UPIPE_SHM_MSG_SIZE];
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_shmsrc, upipe, UPIPE_SHMSRC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_shmsrc, urefcount, upipe_shmsrc_free)
+
+UPIPE_HELPER_OUTPUT(upipe_shmsrc, output, flow_def, output_state, request_list)
+UPIPE_HELPER_UREF_MGR(upipe_shmsrc, uref_mgr, uref_mgr_request,
+                      upipe_shmsrc_check,
+                      upipe_shmsrc_register_output_request,
+                      upipe_shmsrc_unregister_output_request)
+UPIPE_HELPER_UBUF_MGR(upipe_shmsrc, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      upipe_shmsrc_check,
+                      upipe_shmsrc_register_output_request,
+                      upipe_shmsrc_unregister_output_request)
+
+UPIPE_HELPER_UPUMP_MGR(upipe_shmsrc, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_shmsrc, upump, upump_mgr)
+
+/** @hidden */
+static void upipe_shmsrc_free(struct upipe *upipe);
+
+/** @internal @This allocates a shared memory source pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *_upipe_shmsrc_alloc(struct upipe_mgr *mgr,
+                                         struct uprobe *uprobe,
+                                         uint32_t signature, va_list args)
+{
+    if (signature != UPIPE_SHMSRC_SIGNATURE)
+        goto upipe_shmsrc_alloc_err;
+    int fd = va_arg(args, int);
+    if (fd == -1)
+        goto upipe_shmsrc_alloc_err;
+
+    struct upipe_shmsrc *upipe_shmsrc = malloc(sizeof(struct upipe_shmsrc));
+    if (unlikely(upipe_shmsrc == NULL)) {
+        close(fd);
+        goto upipe_shmsrc_alloc_err;
+    }
+
+    struct upipe *upipe = upipe_shmsrc_to_upipe(upipe_shmsrc);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_shmsrc_init_urefcount(upipe);
+    upipe_shmsrc_init_uref_mgr(upipe);
+    upipe_shmsrc_init_ubuf_mgr(upipe);
+    upipe_shmsrc_init_output(upipe);
+    upipe_shmsrc_init_upump_mgr(upipe);
+    upipe_shmsrc_init_upump(upipe);
+    upipe_shmsrc->umem_mgr = NULL;
+    upipe_shmsrc->fd = fd;
+
+    upipe_throw_ready(upipe);
+    upipe_shmsrc_check(upipe, NULL);
+    return upipe;
+
+upipe_shmsrc_alloc_err:
+    uprobe_release(uprobe);
+    return NULL;
+}
+
+/** @internal @This releases the references carried by a message which
+ * couldn't be turned into a uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffers array of buffer descriptions
+ * @param nb_refs number of references carried by the message
+ */
+static void upipe_shmsrc_release(struct upipe *upipe,
+                                 const struct upipe_shm_buffer *buffers,
+                                 unsigned int nb_refs)
+{
+    struct upipe_shmsrc *upipe_shmsrc = upipe_shmsrc_from_upipe(upipe);
+    for (unsigned int i = 0; i < nb_refs; i++) {
+        struct umem umem;
+        size_t skip;
+        if (ubase_check(umem_shm_mgr_import(upipe_shmsrc->umem_mgr,
+                                            buffers[i].offset, &umem, &skip)))
+            umem_free(&umem);
+    }
+}
+
+/** @internal @This builds a block buffer from the segments of a message.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffers array of segment descriptions
+ * @param nb number of segments
+ * @return pointer to the block buffer, or NULL in case of error
+ */
+static struct ubuf *upipe_shmsrc_import_block(struct upipe *upipe,
+        const struct upipe_shm_buffer *buffers, unsigned int nb)
+{
+    struct upipe_shmsrc *upipe_shmsrc = upipe_shmsrc_from_upipe(upipe);
+    struct ubuf *ubuf = NULL;
+    for (unsigned int i = 0; i < nb; i++) {
+        struct umem umem;
+        size_t skip;
+        struct ubuf *segment = NULL;
+        if (ubase_check(umem_shm_mgr_import(upipe_shmsrc->umem_mgr,
+                                            buffers[i].offset, &umem,
+                                            &skip))) {
+            if (skip <= INT_MAX && buffers[i].size <= INT_MAX)
+                segment = ubuf_block_mem_alloc_umem(upipe_shmsrc->ubuf_mgr,
+                        &umem, skip, buffers[i].size);
+            if (unlikely(segment == NULL))
+                umem_free(&umem);
+        }
+        if (unlikely(segment == NULL)) {
+            upipe_shmsrc_release(upipe, buffers + i + 1, nb - i - 1);
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            return NULL;
+        }
+
+        if (ubuf == NULL)
+            ubuf = segment;
+        else
+            ubuf_block_append(ubuf, segment);
+    }
+    return ubuf;
+}
+
+/** @internal @This builds a picture buffer from the planes of a message.
+ * The first plane carries the reference to the buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param msg message header
+ * @param buffers array of plane descriptions
+ * @return pointer to the picture buffer, or NULL in case of error
+ */
+static struct ubuf *upipe_shmsrc_import_pic(struct upipe *upipe,
+        const struct upipe_shm_msg *msg, struct upipe_shm_buffer *buffers)
+{
+    struct upipe_shmsrc *upipe_shmsrc = upipe_shmsrc_from_upipe(upipe);
+    struct umem umem;
+    size_t skip;
+    if (unlikely(!msg->nb_buffers ||
+                 !ubase_check(umem_shm_mgr_import(upipe_shmsrc->umem_mgr,
+                                                  buffers[0].offset, &umem,
+                                                  &skip))))
+        return NULL;
+
+    const char *chromas[msg->nb_buffers];
+    size_t offsets[msg->nb_buffers];
+    size_t strides[msg->nb_buffers];
+    bool valid = msg->hsize <= INT_MAX && msg->vsize <= INT_MAX;
+    for (unsigned int i = 0; i < msg->nb_buffers; i++) {
+        buffers[i].chroma[UPIPE_SHM_CHROMA_SIZE - 1] = '\0';
+        chromas[i] = buffers[i].chroma;
+        if (unlikely(buffers[i].offset < buffers[0].offset))
+            valid = false;
+        offsets[i] = skip + (buffers[i].offset - buffers[0].offset);
+        strides[i] = buffers[i].size;
+    }
+
+    struct ubuf *ubuf = NULL;
+    if (likely(valid))
+        ubuf = ubuf_pic_mem_alloc_umem(upipe_shmsrc->ubuf_mgr, &umem,
+                                       msg->hsize, msg->vsize,
+                                       msg->nb_buffers, chromas,
+                                       offsets, strides);
+    if (unlikely(ubuf == NULL))
+        umem_free(&umem);
+    return ubuf;
+}
+
+/** @internal @This processes a received message.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the message
+ */
+static void upipe_shmsrc_process(struct upipe *upipe, size_t size)
+{
+    struct upipe_shmsrc *upipe_shmsrc = upipe_shmsrc_from_upipe(upipe);
+    struct upipe_shm_msg msg;
+    struct upipe_shm_buffer buffers[UPIPE_SHM_MAX_BUFFERS];
+    if (unlikely(size < sizeof(msg))) {
+        upipe_warn(upipe, "received invalid message");
+        return;
+    }
+    memcpy(&msg, upipe_shmsrc->buffer, sizeof(msg));
+    size_t header_size = sizeof(msg) +
+                         msg.nb_buffers * sizeof(struct upipe_shm_buffer);
+    if (unlikely(msg.nb_buffers > UPIPE_SHM_MAX_BUFFERS ||
+                 header_size + msg.attr_size != size)) {
+        upipe_warn(upipe, "received invalid message");
+        return;
+    }
+    memcpy(buffers, upipe_shmsrc->buffer + sizeof(msg),
+           msg.nb_buffers * sizeof(struct upipe_shm_buffer));
+    unsigned int nb_refs = msg.ubuf_type == UPIPE_SHM_UBUF_BLOCK ?
+                           msg.nb_buffers :
+                           msg.ubuf_type == UPIPE_SHM_UBUF_PIC ? 1 : 0;
+    if (unlikely(nb_refs > msg.nb_buffers)) {
+        upipe_warn(upipe, "received invalid message");
+        return;
+    }
+    if (unlikely(upipe_shmsrc->umem_mgr == NULL)) {
+        upipe_warn(upipe, "received a message before the arena");
+        return;
+    }
+
+    struct uref *uref = msg.type == UPIPE_SHM_MSG_FLOW_DEF ?
+        uref_alloc_control(upipe_shmsrc->uref_mgr) :
+        uref_alloc(upipe_shmsrc->uref_mgr);
+    if (unlikely(uref == NULL)) {
+        upipe_shmsrc_release(upipe, buffers, nb_refs);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    upipe_shm_msg_to_uref(&msg, uref);
+    if (unlikely(!ubase_check(upipe_shm_deserialize_attrs(uref,
+                        upipe_shmsrc->buffer + header_size,
+                        msg.attr_size)))) {
+        upipe_warn(upipe, "received invalid attributes");
+        uref_free(uref);
+        upipe_shmsrc_release(upipe, buffers, nb_refs);
+        return;
+    }
+
+    if (msg.type == UPIPE_SHM_MSG_FLOW_DEF) {
+        upipe_shmsrc_release(upipe, buffers, nb_refs);
+        /* the flow definition is output when the ubuf manager is provided */
+        upipe_shmsrc_require_ubuf_mgr(upipe, uref);
+        if (upipe_shmsrc->ubuf_mgr == NULL)
+            upipe_shmsrc_set_upump(upipe, NULL);
+        return;
+    }
+
+    if (unlikely(upipe_shmsrc->ubuf_mgr == NULL &&
+                 msg.ubuf_type != UPIPE_SHM_UBUF_NONE)) {
+        upipe_warn(upipe, "received a buffer before the flow definition");
+        uref_free(uref);
+        upipe_shmsrc_release(upipe, buffers, nb_refs);
+        return;
+    }
+
+    struct ubuf *ubuf = NULL;
+    switch (msg.ubuf_type) {
+        case UPIPE_SHM_UBUF_NONE:
+            break;
+        case UPIPE_SHM_UBUF_BLOCK:
+            ubuf = upipe_shmsrc_import_block(upipe, buffers, msg.nb_buffers);
+            break;
+        case UPIPE_SHM_UBUF_PIC:
+            ubuf = upipe_shmsrc_import_pic(upipe, &msg, buffers);
+            break;
+        default:
+            break;
+    }
+    if (unlikely(ubuf == NULL && msg.ubuf_type != UPIPE_SHM_UBUF_NONE)) {
+        upipe_warn(upipe, "unable to import buffer, dropping");
+        uref_free(uref);
+        return;
+    }
+    if (ubuf != NULL)
+        uref_attach_ubuf(uref, ubuf);
+    upipe_shmsrc_output(upipe, uref, &upipe_shmsrc->upump);
+}
+
+/** @internal @This reads messages from the socket.
+ *
+ * @param upump description structure of the read watcher
+ */
+static void upipe_shmsrc_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_shmsrc *upipe_shmsrc = upipe_shmsrc_from_upipe(upipe);
+
+    struct iovec iov;
+    iov.iov_base = upipe_shmsrc->buffer;
+    iov.iov_len = UPIPE_SHM_MSG_SIZE;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msghdr;
+    memset(&msghdr, 0, sizeof(msghdr));
+    msghdr.msg_iov = &iov;
+    msghdr.msg_iovlen = 1;
+    msghdr.msg_control = control.buf;
+    msghdr.msg_controllen = sizeof(control.buf);
+
+    ssize_t ret = recvmsg(upipe_shmsrc->fd, &msghdr,
+                          MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (unlikely(ret == -1)) {
+        switch (errno) {
+            case EINTR:
+            case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+            case EWOULDBLOCK:
+#endif
+                /* not an issue, try again later */
+                return;
+            default:
+                break;
+        }
+        upipe_err_va(upipe, "read error (%m)");
+        upipe_shmsrc_set_upump(upipe, NULL);
+        upipe_throw_source_end(upipe);
+        return;
+    }
+    if (unlikely(ret == 0)) {
+        upipe_notice(upipe, "end of shared memory socket");
+        upipe_shmsrc_set_upump(upipe, NULL);
+        upipe_throw_source_end(upipe);
+        return;
+    }
+
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(&msghdr); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msghdr, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+            continue;
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        umem_mgr_release(upipe_shmsrc->umem_mgr);
+        upipe_shmsrc->umem_mgr = umem_shm_mgr_attach(fd);
+        if (unlikely(upipe_shmsrc->umem_mgr == NULL)) {
+            upipe_err(upipe, "unable to attach to the arena");
+            upipe_shmsrc_set_upump(upipe, NULL);
+            upipe_throw_fatal(upipe, UBASE_ERR_EXTERNAL);
+            return;
+        }
+        upipe_dbg(upipe, "attached to the arena");
+    }
+
+    if (unlikely(msghdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        upipe_warn(upipe, "received truncated message");
+        return;
+    }
+    upipe_use(upipe);
+    upipe_shmsrc_process(upipe, ret);
+    upipe_release(upipe);
+}
+
+/** @internal @This checks if the pump may be allocated.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_shmsrc_check(struct upipe *upipe, struct uref *flow_format)
+{
+    struct upipe_shmsrc *upipe_shmsrc = upipe_shmsrc_from_upipe(upipe);
+    if (flow_format != NULL)
+        upipe_shmsrc_store_flow_def(upipe, flow_format);
+
+    upipe_shmsrc_check_upump_mgr(upipe);
+    if (upipe_shmsrc->upump_mgr == NULL)
+        return UBASE_ERR_NONE;
+
+    if (upipe_shmsrc->uref_mgr == NULL) {
+        upipe_shmsrc_require_uref_mgr(upipe);
+        return UBASE_ERR_NONE;
+    }
+
+    /* wait for the ubuf manager of the current flow definition */
+    if (upipe_shmsrc->ubuf_mgr == NULL &&
+        urequest_get_opaque(&upipe_shmsrc->ubuf_mgr_request, struct upipe *)
+            != NULL)
+        return UBASE_ERR_NONE;
+
+    if (upipe_shmsrc->fd != -1 && upipe_shmsrc->upump == NULL) {
+        struct upump *upump = upump_alloc_fd_read(upipe_shmsrc->upump_mgr,
+                                                  upipe_shmsrc_worker, upipe,
+                                                  upipe_shmsrc->fd);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_shmsrc_set_upump(upipe, upump);
+        upump_start(upump);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a shared memory source
+ * pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_shmsrc_control(struct upipe *upipe,
+                                 int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_shmsrc_set_upump(upipe, NULL);
+            return upipe_shmsrc_attach_upump_mgr(upipe);
+
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_shmsrc_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_shmsrc_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_shmsrc_set_output(upipe, output);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands on a shared memory source
+ * pipe, and checks the status of the pipe afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_shmsrc_control(struct upipe *upipe, int command,
+                                va_list args)
+{
+    UBASE_RETURN(_upipe_shmsrc_control(upipe, command, args));
+
+    return upipe_shmsrc_check(upipe, NULL);
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_shmsrc_free(struct upipe *upipe)
+{
+    struct upipe_shmsrc *upipe_shmsrc = upipe_shmsrc_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    upipe_shmsrc_clean_upump(upipe);
+    upipe_shmsrc_clean_upump_mgr(upipe);
+    upipe_shmsrc_clean_output(upipe);
+    upipe_shmsrc_clean_ubuf_mgr(upipe);
+    upipe_shmsrc_clean_uref_mgr(upipe);
+    close(upipe_shmsrc->fd);
+    umem_mgr_release(upipe_shmsrc->umem_mgr);
+    upipe_shmsrc_clean_urefcount(upipe);
+    upipe_clean(upipe);
+    free(upipe_shmsrc);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_shmsrc_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_SHMSRC_SIGNATURE,
+
+    .upipe_alloc = _upipe_shmsrc_alloc,
+    .upipe_input = NULL,
+    .upipe_control = upipe_shmsrc_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all shared memory sources.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_shmsrc_mgr_alloc(void)
+{
+    return &upipe_shmsrc_mgr;
+}
@@ -0,0 +1,523 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module splicing coded elementary streams
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe-modules/upipe_splice.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/** only accept coded streams */
+#define EXPECTED_FLOW_DEF "block."
+
+/** @internal @This is the private context of a splice pipe. */
+struct upipe_splice {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** list of input subpipes */
+    struct uchain subs;
+
+    /** current input */
+    struct upipe *input_cur;
+    /** next input, once the splice time is reached */
+    struct upipe *input_next;
+    /** splice time in the original PTS of the current input */
+    uint64_t splice_pts;
+    /** true if the current input waits for a random access point */
+    bool waiting;
+
+    /** true if a frame has been output */
+    bool last_valid;
+    /** program DTS of the last output frame */
+    uint64_t last_dts_prog;
+    /** duration of the last output frame */
+    uint64_t last_duration;
+    /** difference between the program and system DTS of the last frame */
+    int64_t last_prog_sys;
+
+    /** manager to create input subpipes */
+    struct upipe_mgr sub_mgr;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_splice, upipe, UPIPE_SPLICE_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_splice, urefcount, upipe_splice_free)
+UPIPE_HELPER_VOID(upipe_splice)
+UPIPE_HELPER_OUTPUT(upipe_splice, output, flow_def, output_state, request_list)
+
+/** @internal @This is the private context of an input of a splice pipe. */
+struct upipe_splice_sub {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** input flow definition packet */
+    struct uref *flow_def;
+    /** offset added to the program timestamps */
+    int64_t prog_offset;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_splice_sub, upipe, UPIPE_SPLICE_SUB_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_splice_sub, urefcount, upipe_splice_sub_free)
+UPIPE_HELPER_VOID(upipe_splice_sub)
+
+UPIPE_HELPER_SUBPIPE(upipe_splice, upipe_splice_sub, sub, sub_mgr, subs,
+                     uchain)
+
+/** @internal @This allocates an input subpipe of a splice pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_splice_sub_alloc(struct upipe_mgr *mgr,
+                                            struct uprobe *uprobe,
+                                            uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_splice_sub_alloc_void(mgr, uprobe, signature,
+                                                      args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_splice_sub *upipe_splice_sub =
+        upipe_splice_sub_from_upipe(upipe);
+    upipe_splice_sub_init_urefcount(upipe);
+    upipe_splice_sub_init_sub(upipe);
+    upipe_splice_sub->flow_def = NULL;
+    upipe_splice_sub->prog_offset = 0;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This switches the output to the input which was waiting for
+ * a random access point, and computes the offset of its program timestamps
+ * so that they follow those of the previous input.
+ *
+ * @param upipe description structure of the subpipe
+ * @param uref first frame of the input
+ */
+static void upipe_splice_sub_start(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_splice_sub *upipe_splice_sub =
+        upipe_splice_sub_from_upipe(upipe);
+    struct upipe_splice *upipe_splice = upipe_splice_from_sub_mgr(upipe->mgr);
+    struct upipe *super = upipe_splice_to_upipe(upipe_splice);
+    upipe_splice->waiting = false;
+    upipe_splice_sub->prog_offset = 0;
+
+    uint64_t dts_prog, dts_sys;
+    if (upipe_splice->last_valid &&
+        ubase_check(uref_clock_get_dts_prog(uref, &dts_prog))) {
+        int64_t offset = 0;
+        if (ubase_check(uref_clock_get_dts_sys(uref, &dts_sys)))
+            offset = upipe_splice->last_prog_sys -
+                     ((int64_t)dts_prog - (int64_t)dts_sys);
+        /* never go back in time */
+        uint64_t min_dts = upipe_splice->last_dts_prog +
+                           upipe_splice->last_duration;
+        if ((int64_t)(dts_prog + offset) < (int64_t)min_dts)
+            offset = (int64_t)min_dts - (int64_t)dts_prog;
+        upipe_splice_sub->prog_offset = offset;
+    }
+    upipe_notice_va(super, "spliced to input %p (offset %"PRId64")",
+                    upipe, upipe_splice_sub->prog_offset);
+
+    if (upipe_splice_sub->flow_def != NULL) {
+        struct uref *flow_def = uref_dup(upipe_splice_sub->flow_def);
+        if (unlikely(flow_def == NULL))
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        else
+            upipe_splice_store_flow_def(super, flow_def);
+    }
+}
+
+/** @internal @This receives data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_splice_sub_input(struct upipe *upipe, struct uref *uref,
+                                   struct upump **upump_p)
+{
+    struct upipe_splice_sub *upipe_splice_sub =
+        upipe_splice_sub_from_upipe(upipe);
+    struct upipe_splice *upipe_splice = upipe_splice_from_sub_mgr(upipe->mgr);
+    struct upipe *super = upipe_splice_to_upipe(upipe_splice);
+
+    if (upipe != upipe_splice->input_cur) {
+        uref_free(uref);
+        return;
+    }
+
+    bool rap = ubase_check(uref_flow_get_random(uref));
+    if (upipe_splice->input_next != NULL && rap) {
+        uint64_t pts_orig;
+        if (upipe_splice->splice_pts == 0 ||
+            (ubase_check(uref_clock_get_pts_orig(uref, &pts_orig)) &&
+             pts_orig >= upipe_splice->splice_pts)) {
+            /* out point */
+            upipe_splice->input_cur = upipe_splice->input_next;
+            upipe_splice->input_next = NULL;
+            upipe_splice->waiting = true;
+            uref_free(uref);
+            return;
+        }
+    }
+
+    if (upipe_splice->waiting) {
+        if (!rap) {
+            uref_free(uref);
+            return;
+        }
+        upipe_splice_sub_start(upipe, uref);
+    }
+
+    uref_clock_add_date_prog(uref, upipe_splice_sub->prog_offset);
+
+    uint64_t dts_prog, dts_sys;
+    if (ubase_check(uref_clock_get_dts_prog(uref, &dts_prog))) {
+        upipe_splice->last_valid = true;
+        upipe_splice->last_dts_prog = dts_prog;
+        upipe_splice->last_duration = 0;
+        uref_clock_get_duration(uref, &upipe_splice->last_duration);
+        if (ubase_check(uref_clock_get_dts_sys(uref, &dts_sys)))
+            upipe_splice->last_prog_sys = (int64_t)dts_prog -
+                                          (int64_t)dts_sys;
+    }
+    upipe_splice_output(super, uref, upump_p);
+}
+
+/** @internal @This receives the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_splice_sub_set_flow_def(struct upipe *upipe,
+                                         struct uref *flow_def)
+{
+    struct upipe_splice_sub *upipe_splice_sub =
+        upipe_splice_sub_from_upipe(upipe);
+    struct upipe_splice *upipe_splice = upipe_splice_from_sub_mgr(upipe->mgr);
+
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    uref_free(upipe_splice_sub->flow_def);
+    upipe_splice_sub->flow_def = flow_def_dup;
+
+    if (upipe == upipe_splice->input_cur && !upipe_splice->waiting) {
+        if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_splice_store_flow_def(upipe_splice_to_upipe(upipe_splice),
+                                    flow_def_dup);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This schedules a splice to the given input.
+ *
+ * @param upipe description structure of the subpipe
+ * @param splice_pts splice time in the original PTS of the current input,
+ * or 0 to splice at the next random access point
+ * @return an error code
+ */
+static int _upipe_splice_sub_set_input(struct upipe *upipe,
+                                       uint64_t splice_pts)
+{
+    struct upipe_splice *upipe_splice = upipe_splice_from_sub_mgr(upipe->mgr);
+    if (upipe == upipe_splice->input_cur) {
+        upipe_splice->input_next = NULL;
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_splice->input_cur == NULL) {
+        upipe_splice->input_cur = upipe;
+        upipe_splice->input_next = NULL;
+        upipe_splice->waiting = true;
+        return UBASE_ERR_NONE;
+    }
+
+    upipe_dbg_va(upipe_splice_to_upipe(upipe_splice),
+                 "splice to input %p at %"PRIu64, upipe, splice_pts);
+    upipe_splice->input_next = upipe;
+    upipe_splice->splice_pts = splice_pts;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a subpipe of a splice
+ * pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_splice_sub_control(struct upipe *upipe,
+                                    int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            struct upipe_splice *upipe_splice =
+                upipe_splice_from_sub_mgr(upipe->mgr);
+            return upipe_splice_alloc_output_proxy(
+                    upipe_splice_to_upipe(upipe_splice), request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            struct upipe_splice *upipe_splice =
+                upipe_splice_from_sub_mgr(upipe->mgr);
+            return upipe_splice_free_output_proxy(
+                    upipe_splice_to_upipe(upipe_splice), request);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_splice_sub_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_splice_sub_get_super(upipe, p);
+        }
+
+        case UPIPE_SPLICE_SUB_SET_INPUT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SPLICE_SUB_SIGNATURE)
+            uint64_t splice_pts = va_arg(args, uint64_t);
+            return _upipe_splice_sub_set_input(upipe, splice_pts);
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees an input subpipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_splice_sub_free(struct upipe *upipe)
+{
+    struct upipe_splice_sub *upipe_splice_sub =
+        upipe_splice_sub_from_upipe(upipe);
+    struct upipe_splice *upipe_splice = upipe_splice_from_sub_mgr(upipe->mgr);
+
+    if (upipe == upipe_splice->input_next)
+        upipe_splice->input_next = NULL;
+    if (upipe == upipe_splice->input_cur) {
+        /* the next input, if any, takes over immediately */
+        upipe_splice->input_cur = upipe_splice->input_next;
+        upipe_splice->input_next = NULL;
+        upipe_splice->waiting = true;
+    }
+
+    upipe_throw_dead(upipe);
+    uref_free(upipe_splice_sub->flow_def);
+    upipe_splice_sub_clean_sub(upipe);
+    upipe_splice_sub_clean_urefcount(upipe);
+    upipe_splice_sub_free_void(upipe);
+}
+
+/** @internal @This initializes the input manager for a splice pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_splice_init_sub_mgr(struct upipe *upipe)
+{
+    struct upipe_splice *upipe_splice = upipe_splice_from_upipe(upipe);
+    struct upipe_mgr *sub_mgr = &upipe_splice->sub_mgr;
+    sub_mgr->refcount = upipe_splice_to_urefcount(upipe_splice);
+    sub_mgr->signature = UPIPE_SPLICE_SUB_SIGNATURE;
+    sub_mgr->upipe_alloc = upipe_splice_sub_alloc;
+    sub_mgr->upipe_input = upipe_splice_sub_input;
+    sub_mgr->upipe_control = upipe_splice_sub_control;
+    sub_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a splice pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_splice_alloc(struct upipe_mgr *mgr,
+                                        struct uprobe *uprobe,
+                                        uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_splice_alloc_void(mgr, uprobe, signature,
+                                                  args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    upipe_splice_init_urefcount(upipe);
+    upipe_splice_init_output(upipe);
+    upipe_splice_init_sub_mgr(upipe);
+    upipe_splice_init_sub_subs(upipe);
+
+    struct upipe_splice *upipe_splice = upipe_splice_from_upipe(upipe);
+    upipe_splice->input_cur = NULL;
+    upipe_splice->input_next = NULL;
+    upipe_splice->splice_pts = 0;
+    upipe_splice->waiting = false;
+    upipe_splice->last_valid = false;
+    upipe_splice->last_dts_prog = 0;
+    upipe_splice->last_duration = 0;
+    upipe_splice->last_prog_sys = 0;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This processes control commands on a splice pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_splice_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_splice_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_splice_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_splice_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_splice_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_splice_set_output(upipe, output);
+        }
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_splice_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_splice_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_SPLICE_GET_CURRENT_INPUT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SPLICE_SIGNATURE)
+            struct upipe **input_p = va_arg(args, struct upipe **);
+            *input_p = upipe_splice_from_upipe(upipe)->input_cur;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_splice_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_splice_clean_sub_subs(upipe);
+    upipe_splice_clean_output(upipe);
+    upipe_splice_clean_urefcount(upipe);
+    upipe_splice_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_splice_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_SPLICE_SIGNATURE,
+
+    .upipe_alloc = upipe_splice_alloc,
+    .upipe_input = NULL,
+    .upipe_control = upipe_splice_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all splice pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_splice_mgr_alloc(void)
+{
+    return &upipe_splice_mgr;
+}
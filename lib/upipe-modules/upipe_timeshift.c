@@ -0,0 +1,955 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module keeping a time-shift window of a block flow
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe-modules/upipe_timeshift.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+
+#ifndef O_CLOEXEC
+#   define O_CLOEXEC 0
+#endif
+
+/** size of the chunks written to disk, which is also the alignment of the
+ * rings */
+#define CHUNK_SIZE 65536
+/** alignment of the RAM ring in O_DIRECT mode */
+#define DIRECT_ALIGN 4096
+
+/** @internal @This is an entry of the index of a timeshift pipe. */
+struct upipe_timeshift_entry {
+    /** system date of the uref */
+    uint64_t date;
+    /** absolute offset of the uref in the flow, in octets */
+    uint64_t offset;
+    /** size of the uref, in octets */
+    uint32_t size;
+    /** true if the uref is a random access point */
+    bool random;
+};
+
+/** @internal @This is the private context of a timeshift pipe. */
+struct upipe_timeshift {
+    /** real refcount management structure */
+    struct urefcount urefcount_real;
+    /** refcount management structure exported to the public structure */
+    struct urefcount urefcount;
+
+    /** list of readers */
+    struct uchain subs;
+    /** flow definition packet */
+    struct uref *flow_def;
+    /** uref manager of the input */
+    struct uref_mgr *uref_mgr;
+    /** ubuf manager of the input */
+    struct ubuf_mgr *ubuf_mgr;
+
+    /** ring in RAM, or NULL if the pipe is not open */
+    uint8_t *ram;
+    /** size of the ring in RAM */
+    uint64_t ram_size;
+    /** file descriptor of the ring on disk */
+    int fd;
+    /** read-only mapping of the ring on disk */
+    uint8_t *disk;
+    /** size of the ring on disk */
+    uint64_t disk_size;
+    /** number of octets received */
+    uint64_t written;
+    /** number of octets written to disk */
+    uint64_t flushed;
+    /** octets before this offset were not written to disk */
+    uint64_t disk_valid;
+
+    /** ring of index entries */
+    struct upipe_timeshift_entry *entries;
+    /** size of the ring of index entries */
+    uint64_t nb_entries;
+    /** number of entries ever indexed */
+    uint64_t count;
+    /** absolute number of the oldest available entry */
+    uint64_t first;
+    /** system date of the last received uref, or UINT64_MAX */
+    uint64_t live;
+    /** true if random access flags were received */
+    bool random;
+
+    /** manager to create readers */
+    struct upipe_mgr sub_mgr;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_timeshift, upipe, UPIPE_TIMESHIFT_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_timeshift, urefcount, upipe_timeshift_no_input)
+UPIPE_HELPER_VOID(upipe_timeshift)
+
+UBASE_FROM_TO(upipe_timeshift, urefcount, urefcount_real, urefcount_real)
+
+/** @hidden */
+static void upipe_timeshift_free(struct urefcount *urefcount_real);
+
+/** @internal @This is the private context of a reader of a timeshift pipe. */
+struct upipe_timeshift_sub {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** absolute number of the next entry to output */
+    uint64_t next;
+    /** delay relative to the live flow */
+    uint64_t delay;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_timeshift_sub, upipe, UPIPE_TIMESHIFT_SUB_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_timeshift_sub, urefcount,
+                       upipe_timeshift_sub_free)
+UPIPE_HELPER_OUTPUT(upipe_timeshift_sub, output, flow_def, output_state,
+                    request_list)
+
+UPIPE_HELPER_SUBPIPE(upipe_timeshift, upipe_timeshift_sub, sub, sub_mgr, subs,
+                     uchain)
+
+/** @internal @This allocates a reader of a timeshift pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_timeshift_sub_alloc(struct upipe_mgr *mgr,
+                                               struct uprobe *uprobe,
+                                               uint32_t signature,
+                                               va_list args)
+{
+    if (signature != UPIPE_VOID_SIGNATURE ||
+        mgr->signature != UPIPE_TIMESHIFT_SUB_SIGNATURE)
+        return NULL;
+    struct upipe_timeshift *upipe_timeshift =
+        upipe_timeshift_from_sub_mgr(mgr);
+    struct uref *flow_def_dup = NULL;
+    if (upipe_timeshift->flow_def != NULL &&
+        (flow_def_dup = uref_dup(upipe_timeshift->flow_def)) == NULL)
+        return NULL;
+
+    struct upipe_timeshift_sub *upipe_timeshift_sub =
+        malloc(sizeof(struct upipe_timeshift_sub));
+    if (unlikely(upipe_timeshift_sub == NULL)) {
+        if (flow_def_dup != NULL)
+            uref_free(flow_def_dup);
+        return NULL;
+    }
+    struct upipe *upipe = upipe_timeshift_sub_to_upipe(upipe_timeshift_sub);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_timeshift_sub_init_urefcount(upipe);
+    upipe_timeshift_sub_init_output(upipe);
+    upipe_timeshift_sub_init_sub(upipe);
+    upipe_timeshift_sub->next = upipe_timeshift->count;
+    upipe_timeshift_sub->delay = 0;
+
+    upipe_timeshift_sub_store_flow_def(upipe, flow_def_dup);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This copies octets out of a ring.
+ *
+ * @param buffer destination buffer
+ * @param ring pointer to the ring
+ * @param ring_size size of the ring
+ * @param offset absolute offset of the first octet
+ * @param size number of octets to copy
+ */
+static void upipe_timeshift_copy(uint8_t *buffer, const uint8_t *ring,
+                                 uint64_t ring_size, uint64_t offset,
+                                 uint64_t size)
+{
+    uint64_t pos = offset % ring_size;
+    uint64_t first = ring_size - pos;
+    if (first > size)
+        first = size;
+    memcpy(buffer, ring + pos, first);
+    memcpy(buffer + first, ring, size - first);
+}
+
+/** @internal @This checks if the octets of an entry are still available,
+ * either in RAM or on disk.
+ *
+ * @param upipe description structure of the pipe
+ * @param entry index entry
+ * @param ram_p filled in with true if the octets are in RAM
+ * @return false if the octets were overwritten
+ */
+static bool upipe_timeshift_available(struct upipe *upipe,
+                                      const struct upipe_timeshift_entry *entry,
+                                      bool *ram_p)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    uint64_t ram_start = upipe_timeshift->written > upipe_timeshift->ram_size ?
+        upipe_timeshift->written - upipe_timeshift->ram_size : 0;
+    if (entry->offset >= ram_start) {
+        *ram_p = true;
+        return true;
+    }
+
+    uint64_t disk_start =
+        upipe_timeshift->flushed > upipe_timeshift->disk_size ?
+        upipe_timeshift->flushed - upipe_timeshift->disk_size : 0;
+    if (disk_start < upipe_timeshift->disk_valid)
+        disk_start = upipe_timeshift->disk_valid;
+    *ram_p = false;
+    return entry->offset >= disk_start &&
+           entry->offset + entry->size <= upipe_timeshift->flushed;
+}
+
+/** @internal @This allocates a uref with the octets of an entry.
+ *
+ * @param upipe description structure of the pipe
+ * @param entry index entry
+ * @return pointer to uref, or NULL in case of error
+ */
+static struct uref *upipe_timeshift_read(struct upipe *upipe,
+                                         const struct upipe_timeshift_entry *entry)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    bool ram;
+    if (unlikely(!upipe_timeshift_available(upipe, entry, &ram)))
+        return NULL;
+
+    struct uref *uref = uref_alloc(upipe_timeshift->uref_mgr);
+    if (unlikely(uref == NULL))
+        return NULL;
+    struct ubuf *ubuf = ubuf_block_alloc(upipe_timeshift->ubuf_mgr,
+                                         entry->size);
+    if (unlikely(ubuf == NULL)) {
+        uref_free(uref);
+        return NULL;
+    }
+    int size = -1;
+    uint8_t *buffer;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer)) ||
+                 (uint32_t)size != entry->size)) {
+        ubuf_free(ubuf);
+        uref_free(uref);
+        return NULL;
+    }
+    if (ram)
+        upipe_timeshift_copy(buffer, upipe_timeshift->ram,
+                             upipe_timeshift->ram_size, entry->offset,
+                             entry->size);
+    else
+        upipe_timeshift_copy(buffer, upipe_timeshift->disk,
+                             upipe_timeshift->disk_size, entry->offset,
+                             entry->size);
+    ubuf_block_unmap(ubuf, 0);
+    uref_attach_ubuf(uref, ubuf);
+    if (entry->random)
+        uref_flow_set_random(uref);
+    return uref;
+}
+
+/** @internal @This outputs the entries of a reader which are due.
+ *
+ * @param upipe description structure of the subpipe
+ * @param live uref that was just received
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_timeshift_sub_work(struct upipe *upipe, struct uref *live,
+                                     struct upump **upump_p)
+{
+    struct upipe_timeshift_sub *upipe_timeshift_sub =
+        upipe_timeshift_sub_from_upipe(upipe);
+    struct upipe_timeshift *upipe_timeshift =
+        upipe_timeshift_from_sub_mgr(upipe->mgr);
+
+    if (unlikely(upipe_timeshift_sub->next < upipe_timeshift->first)) {
+        upipe_warn_va(upipe, "reader overrun, skipping %"PRIu64" buffers",
+                      upipe_timeshift->first - upipe_timeshift_sub->next);
+        upipe_timeshift_sub->next = upipe_timeshift->first;
+    }
+
+    while (upipe_timeshift_sub->next < upipe_timeshift->count) {
+        const struct upipe_timeshift_entry *entry =
+            &upipe_timeshift->entries[upipe_timeshift_sub->next %
+                                      upipe_timeshift->nb_entries];
+        if (entry->date + upipe_timeshift_sub->delay > upipe_timeshift->live)
+            break;
+
+        struct uref *uref;
+        if (upipe_timeshift_sub->next == upipe_timeshift->count - 1)
+            uref = uref_dup(live);
+        else
+            uref = upipe_timeshift_read(
+                    upipe_timeshift_to_upipe(upipe_timeshift), entry);
+        upipe_timeshift_sub->next++;
+        if (unlikely(uref == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_clock_set_cr_sys(uref, entry->date + upipe_timeshift_sub->delay);
+        upipe_timeshift_sub_output(upipe, uref, upump_p);
+    }
+}
+
+/** @internal @This looks up the entry to seek a reader to.
+ *
+ * @param upipe description structure of the pipe
+ * @param date system date to seek to
+ * @return absolute number of the entry
+ */
+static uint64_t upipe_timeshift_lookup(struct upipe *upipe, uint64_t date)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    const struct upipe_timeshift_entry *entries = upipe_timeshift->entries;
+    uint64_t nb_entries = upipe_timeshift->nb_entries;
+
+    /* last entry dated at or before date */
+    uint64_t low = upipe_timeshift->first;
+    uint64_t high = upipe_timeshift->count - 1;
+    if (entries[low % nb_entries].date >= date)
+        return low;
+    while (low < high) {
+        uint64_t middle = low + (high - low + 1) / 2;
+        if (entries[middle % nb_entries].date <= date)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    if (upipe_timeshift->random) {
+        uint64_t i = low;
+        while (i > upipe_timeshift->first && !entries[i % nb_entries].random)
+            i--;
+        if (entries[i % nb_entries].random)
+            return i;
+        return low;
+    }
+
+    if (entries[low % nb_entries].date < date &&
+        low + 1 < upipe_timeshift->count)
+        low++;
+    return low;
+}
+
+/** @internal @This moves a reader to the given date.
+ *
+ * @param upipe description structure of the subpipe
+ * @param date system date to seek to
+ * @return an error code
+ */
+static int _upipe_timeshift_sub_seek(struct upipe *upipe, uint64_t date)
+{
+    struct upipe_timeshift_sub *upipe_timeshift_sub =
+        upipe_timeshift_sub_from_upipe(upipe);
+    struct upipe_timeshift *upipe_timeshift =
+        upipe_timeshift_from_sub_mgr(upipe->mgr);
+
+    if (upipe_timeshift->first >= upipe_timeshift->count ||
+        date >= upipe_timeshift->live) {
+        upipe_timeshift_sub->next = upipe_timeshift->count;
+        upipe_timeshift_sub->delay = 0;
+        return UBASE_ERR_NONE;
+    }
+
+    uint64_t next = upipe_timeshift_lookup(
+            upipe_timeshift_to_upipe(upipe_timeshift), date);
+    const struct upipe_timeshift_entry *entry =
+        &upipe_timeshift->entries[next % upipe_timeshift->nb_entries];
+    upipe_timeshift_sub->next = next;
+    upipe_timeshift_sub->delay = upipe_timeshift->live - entry->date;
+    upipe_dbg_va(upipe, "seeking %"PRIu64" buffers back, delay %"PRIu64" ms",
+                 upipe_timeshift->count - next,
+                 upipe_timeshift_sub->delay / (UCLOCK_FREQ / 1000));
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a reader of a timeshift
+ * pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_timeshift_sub_control(struct upipe *upipe,
+                                       int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_timeshift_sub_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_timeshift_sub_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_timeshift_sub_set_output(upipe, output);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_timeshift_sub_get_super(upipe, p);
+        }
+
+        case UPIPE_TIMESHIFT_SUB_SEEK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TIMESHIFT_SUB_SIGNATURE)
+            uint64_t date = va_arg(args, uint64_t);
+            return _upipe_timeshift_sub_seek(upipe, date);
+        }
+        case UPIPE_TIMESHIFT_SUB_GET_DELAY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TIMESHIFT_SUB_SIGNATURE)
+            uint64_t *delay_p = va_arg(args, uint64_t *);
+            *delay_p = upipe_timeshift_sub_from_upipe(upipe)->delay;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a reader.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_timeshift_sub_free(struct upipe *upipe)
+{
+    struct upipe_timeshift_sub *upipe_timeshift_sub =
+        upipe_timeshift_sub_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    upipe_timeshift_sub_clean_output(upipe);
+    upipe_timeshift_sub_clean_sub(upipe);
+    upipe_timeshift_sub_clean_urefcount(upipe);
+    upipe_clean(upipe);
+    free(upipe_timeshift_sub);
+}
+
+/** @internal @This initializes the reader manager for a timeshift pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_timeshift_init_sub_mgr(struct upipe *upipe)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    struct upipe_mgr *sub_mgr = &upipe_timeshift->sub_mgr;
+    sub_mgr->refcount = upipe_timeshift_to_urefcount_real(upipe_timeshift);
+    sub_mgr->signature = UPIPE_TIMESHIFT_SUB_SIGNATURE;
+    sub_mgr->upipe_alloc = upipe_timeshift_sub_alloc;
+    sub_mgr->upipe_input = NULL;
+    sub_mgr->upipe_control = upipe_timeshift_sub_control;
+    sub_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a timeshift pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_timeshift_alloc(struct upipe_mgr *mgr,
+                                           struct uprobe *uprobe,
+                                           uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_timeshift_alloc_void(mgr, uprobe, signature,
+                                                     args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    upipe_timeshift_init_urefcount(upipe);
+    urefcount_init(upipe_timeshift_to_urefcount_real(upipe_timeshift),
+                   upipe_timeshift_free);
+    upipe_timeshift_init_sub_mgr(upipe);
+    upipe_timeshift_init_sub_subs(upipe);
+    upipe_timeshift->flow_def = NULL;
+    upipe_timeshift->uref_mgr = NULL;
+    upipe_timeshift->ubuf_mgr = NULL;
+    upipe_timeshift->ram = NULL;
+    upipe_timeshift->ram_size = 0;
+    upipe_timeshift->fd = -1;
+    upipe_timeshift->disk = NULL;
+    upipe_timeshift->disk_size = 0;
+    upipe_timeshift->entries = NULL;
+    upipe_timeshift->nb_entries = 0;
+    upipe_timeshift->written = upipe_timeshift->flushed = 0;
+    upipe_timeshift->disk_valid = 0;
+    upipe_timeshift->count = upipe_timeshift->first = 0;
+    upipe_timeshift->live = UINT64_MAX;
+    upipe_timeshift->random = false;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This writes the completed chunks of the RAM ring to disk.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_timeshift_flush(struct upipe *upipe)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    while (upipe_timeshift->written - upipe_timeshift->flushed >=
+           CHUNK_SIZE) {
+        uint64_t flushed = upipe_timeshift->flushed;
+        ssize_t ret = pwrite(upipe_timeshift->fd,
+                             upipe_timeshift->ram +
+                                 flushed % upipe_timeshift->ram_size,
+                             CHUNK_SIZE, flushed % upipe_timeshift->disk_size);
+        upipe_timeshift->flushed += CHUNK_SIZE;
+        if (unlikely(ret != CHUNK_SIZE)) {
+            if (ret == -1)
+                upipe_err_va(upipe, "write error (%m)");
+            else
+                upipe_err(upipe, "short write");
+            upipe_timeshift->disk_valid = upipe_timeshift->flushed;
+        }
+    }
+}
+
+/** @internal @This appends a uref to the window.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param date system date of the uref
+ * @param size size of the uref
+ */
+static void upipe_timeshift_append(struct upipe *upipe, struct uref *uref,
+                                   uint64_t date, size_t size)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    uint64_t offset = upipe_timeshift->written;
+    uint64_t pos = offset % upipe_timeshift->ram_size;
+    uint64_t first = upipe_timeshift->ram_size - pos;
+    if (first > size)
+        first = size;
+    uref_block_extract(uref, 0, first, upipe_timeshift->ram + pos);
+    uref_block_extract(uref, first, size - first, upipe_timeshift->ram);
+    upipe_timeshift->written += size;
+    upipe_timeshift_flush(upipe);
+
+    struct upipe_timeshift_entry *entry =
+        &upipe_timeshift->entries[upipe_timeshift->count %
+                                  upipe_timeshift->nb_entries];
+    entry->date = date;
+    entry->offset = offset;
+    entry->size = size;
+    entry->random = ubase_check(uref_flow_get_random(uref));
+    if (entry->random)
+        upipe_timeshift->random = true;
+    upipe_timeshift->count++;
+    upipe_timeshift->live = date;
+
+    /* skip entries which were overwritten */
+    while (upipe_timeshift->first < upipe_timeshift->count) {
+        bool ram;
+        if (upipe_timeshift->count - upipe_timeshift->first <=
+                upipe_timeshift->nb_entries &&
+            upipe_timeshift_available(upipe,
+                &upipe_timeshift->entries[upipe_timeshift->first %
+                                          upipe_timeshift->nb_entries], &ram))
+            break;
+        upipe_timeshift->first++;
+    }
+}
+
+/** @internal @This receives data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_timeshift_input(struct upipe *upipe, struct uref *uref,
+                                  struct upump **upump_p)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    if (unlikely(upipe_timeshift->ram == NULL)) {
+        upipe_warn(upipe, "received a buffer before opening the buffers");
+        uref_free(uref);
+        return;
+    }
+
+    uint64_t date;
+    size_t size;
+    if (unlikely(!ubase_check(uref_clock_get_cr_sys(uref, &date)) ||
+                 !ubase_check(uref_block_size(uref, &size)))) {
+        upipe_warn(upipe, "received non-dated buffer");
+        uref_free(uref);
+        return;
+    }
+    if (unlikely(size > upipe_timeshift->ram_size - CHUNK_SIZE ||
+                 size > UINT32_MAX)) {
+        upipe_warn_va(upipe, "dropping buffer of %zu octets", size);
+        uref_free(uref);
+        return;
+    }
+    if (unlikely(upipe_timeshift->live != UINT64_MAX &&
+                 date < upipe_timeshift->live)) {
+        upipe_warn(upipe, "received a date in the past");
+        date = upipe_timeshift->live;
+    }
+
+    if (upipe_timeshift->uref_mgr != uref->mgr) {
+        uref_mgr_release(upipe_timeshift->uref_mgr);
+        upipe_timeshift->uref_mgr = uref_mgr_use(uref->mgr);
+    }
+    if (upipe_timeshift->ubuf_mgr != uref->ubuf->mgr) {
+        ubuf_mgr_release(upipe_timeshift->ubuf_mgr);
+        upipe_timeshift->ubuf_mgr = ubuf_mgr_use(uref->ubuf->mgr);
+    }
+
+    upipe_timeshift_append(upipe, uref, date, size);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_timeshift->subs, uchain, uchain_tmp) {
+        struct upipe_timeshift_sub *upipe_timeshift_sub =
+            upipe_timeshift_sub_from_uchain(uchain);
+        upipe_timeshift_sub_work(
+                upipe_timeshift_sub_to_upipe(upipe_timeshift_sub),
+                uref, upump_p);
+    }
+    uref_free(uref);
+}
+
+/** @internal @This changes the flow definition on all readers.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def new flow definition
+ * @return an error code
+ */
+static int upipe_timeshift_set_flow_def(struct upipe *upipe,
+                                        struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, "block."))
+    struct uref *flow_def_dup;
+    if ((flow_def_dup = uref_dup(flow_def)) == NULL)
+        return UBASE_ERR_ALLOC;
+
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    if (upipe_timeshift->flow_def != NULL)
+        uref_free(upipe_timeshift->flow_def);
+    upipe_timeshift->flow_def = flow_def_dup;
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_timeshift->subs, uchain) {
+        struct upipe_timeshift_sub *upipe_timeshift_sub =
+            upipe_timeshift_sub_from_uchain(uchain);
+        flow_def_dup = uref_dup(flow_def);
+        if (unlikely(flow_def_dup == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_timeshift_sub_store_flow_def(
+                upipe_timeshift_sub_to_upipe(upipe_timeshift_sub),
+                flow_def_dup);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This closes the buffers, and moves all readers back to live.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_timeshift_close(struct upipe *upipe)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    if (upipe_timeshift->disk != NULL)
+        munmap(upipe_timeshift->disk, upipe_timeshift->disk_size);
+    if (upipe_timeshift->fd != -1)
+        close(upipe_timeshift->fd);
+    free(upipe_timeshift->ram);
+    free(upipe_timeshift->entries);
+    upipe_timeshift->disk = NULL;
+    upipe_timeshift->fd = -1;
+    upipe_timeshift->ram = NULL;
+    upipe_timeshift->entries = NULL;
+    upipe_timeshift->written = upipe_timeshift->flushed = 0;
+    upipe_timeshift->disk_valid = 0;
+    upipe_timeshift->count = upipe_timeshift->first = 0;
+    upipe_timeshift->live = UINT64_MAX;
+    upipe_timeshift->random = false;
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_timeshift->subs, uchain) {
+        struct upipe_timeshift_sub *upipe_timeshift_sub =
+            upipe_timeshift_sub_from_uchain(uchain);
+        upipe_timeshift_sub->next = 0;
+        upipe_timeshift_sub->delay = 0;
+    }
+}
+
+/** @internal @This opens the buffers of a timeshift pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param path path of the disk ring
+ * @param ram_size size of the ring in RAM
+ * @param disk_size size of the ring on disk
+ * @param nb_entries number of urefs in the index
+ * @return an error code
+ */
+static int _upipe_timeshift_open(struct upipe *upipe, const char *path,
+                                 uint64_t ram_size, uint64_t disk_size,
+                                 uint64_t nb_entries)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    upipe_timeshift_close(upipe);
+    if (unlikely(path == NULL || !nb_entries ||
+                 nb_entries > SIZE_MAX / sizeof(struct upipe_timeshift_entry)))
+        return UBASE_ERR_INVALID;
+
+    ram_size = (ram_size + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+    if (ram_size < 2 * CHUNK_SIZE)
+        ram_size = 2 * CHUNK_SIZE;
+    disk_size = (disk_size + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+    if (disk_size < ram_size)
+        disk_size = ram_size;
+    if (unlikely(ram_size > SIZE_MAX || disk_size > SIZE_MAX))
+        return UBASE_ERR_INVALID;
+
+    int fd = -1;
+#ifdef O_DIRECT
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT,
+              S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        upipe_warn_va(upipe, "can't open file %s with O_DIRECT", path);
+#endif
+    if (fd == -1)
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  S_IRUSR | S_IWUSR);
+    if (unlikely(fd == -1)) {
+        upipe_err_va(upipe, "can't open file %s (%m)", path);
+        return UBASE_ERR_EXTERNAL;
+    }
+    upipe_timeshift->fd = fd;
+    if (unlikely(ftruncate(fd, disk_size) == -1)) {
+        upipe_err_va(upipe, "can't resize file %s (%m)", path);
+        upipe_timeshift_close(upipe);
+        return UBASE_ERR_EXTERNAL;
+    }
+    void *disk = mmap(NULL, disk_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (unlikely(disk == MAP_FAILED)) {
+        upipe_err_va(upipe, "can't map file %s (%m)", path);
+        upipe_timeshift_close(upipe);
+        return UBASE_ERR_EXTERNAL;
+    }
+    upipe_timeshift->disk = disk;
+    upipe_timeshift->disk_size = disk_size;
+
+    void *ram;
+    if (unlikely(posix_memalign(&ram, DIRECT_ALIGN, ram_size))) {
+        upipe_timeshift_close(upipe);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_timeshift->ram = ram;
+    upipe_timeshift->entries =
+        malloc(nb_entries * sizeof(struct upipe_timeshift_entry));
+    if (unlikely(upipe_timeshift->entries == NULL)) {
+        upipe_timeshift_close(upipe);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_timeshift->ram_size = ram_size;
+    upipe_timeshift->nb_entries = nb_entries;
+    upipe_notice_va(upipe, "opening file %s (%"PRIu64" KiB in RAM, "
+                    "%"PRIu64" KiB on disk)", path, ram_size / 1024,
+                    disk_size / 1024);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the dates of the window.
+ *
+ * @param upipe description structure of the pipe
+ * @param start_p filled in with the date of the oldest uref
+ * @param end_p filled in with the date of the last uref
+ * @return an error code
+ */
+static int _upipe_timeshift_get_range(struct upipe *upipe, uint64_t *start_p,
+                                      uint64_t *end_p)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    if (upipe_timeshift->first >= upipe_timeshift->count)
+        return UBASE_ERR_INVALID;
+    if (start_p != NULL)
+        *start_p = upipe_timeshift->entries[upipe_timeshift->first %
+                                            upipe_timeshift->nb_entries].date;
+    if (end_p != NULL)
+        *end_p = upipe_timeshift->live;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a timeshift pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_timeshift_control(struct upipe *upipe, int command,
+                                   va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *uref = va_arg(args, struct uref *);
+            return upipe_timeshift_set_flow_def(upipe, uref);
+        }
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_timeshift_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_timeshift_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_TIMESHIFT_OPEN: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TIMESHIFT_SIGNATURE)
+            const char *path = va_arg(args, const char *);
+            uint64_t ram_size = va_arg(args, uint64_t);
+            uint64_t disk_size = va_arg(args, uint64_t);
+            uint64_t nb_entries = va_arg(args, uint64_t);
+            return _upipe_timeshift_open(upipe, path, ram_size, disk_size,
+                                         nb_entries);
+        }
+        case UPIPE_TIMESHIFT_GET_RANGE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TIMESHIFT_SIGNATURE)
+            uint64_t *start_p = va_arg(args, uint64_t *);
+            uint64_t *end_p = va_arg(args, uint64_t *);
+            return _upipe_timeshift_get_range(upipe, start_p, end_p);
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param urefcount_real pointer to urefcount_real structure
+ */
+static void upipe_timeshift_free(struct urefcount *urefcount_real)
+{
+    struct upipe_timeshift *upipe_timeshift =
+        upipe_timeshift_from_urefcount_real(urefcount_real);
+    struct upipe *upipe = upipe_timeshift_to_upipe(upipe_timeshift);
+    upipe_throw_dead(upipe);
+    upipe_timeshift_close(upipe);
+    upipe_timeshift_clean_sub_subs(upipe);
+    if (upipe_timeshift->flow_def != NULL)
+        uref_free(upipe_timeshift->flow_def);
+    uref_mgr_release(upipe_timeshift->uref_mgr);
+    ubuf_mgr_release(upipe_timeshift->ubuf_mgr);
+    urefcount_clean(urefcount_real);
+    upipe_timeshift_clean_urefcount(upipe);
+    upipe_timeshift_free_void(upipe);
+}
+
+/** @This is called when there is no external reference to the pipe anymore.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_timeshift_no_input(struct upipe *upipe)
+{
+    struct upipe_timeshift *upipe_timeshift = upipe_timeshift_from_upipe(upipe);
+    upipe_timeshift_throw_sub_subs(upipe, UPROBE_SOURCE_END);
+    urefcount_release(upipe_timeshift_to_urefcount_real(upipe_timeshift));
+}
+
+/** timeshift module manager static descriptor */
+static struct upipe_mgr upipe_timeshift_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TIMESHIFT_SIGNATURE,
+
+    .upipe_alloc = upipe_timeshift_alloc,
+    .upipe_input = upipe_timeshift_input,
+    .upipe_control = upipe_timeshift_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all timeshift pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_timeshift_mgr_alloc(void)
+{
+    return &upipe_timeshift_mgr;
+}
@@ -53,6 +53,9 @@
 #include <math.h>
 #include <assert.h>
 
+/** maximum number of messages popped at once from a queue */
+#define XFER_BATCH 32
+
 /** @internal @This is the private context of a xfer pipe manager. */
 struct upipe_xfer_mgr {
     /** real refcount management structure */
@@ -360,7 +363,43 @@ upipe_xfer_alloc_err:
     return NULL;
 }
 
+/** @internal @This handles a message received from remote.
+ *
+ * @param upipe description structure of the pipe
+ * @param msg message to handle
+ */
+static void upipe_xfer_handle(struct upipe *upipe, struct upipe_xfer_msg *msg)
+{
+    struct upipe_xfer *upipe_xfer = upipe_xfer_from_upipe(upipe);
+    switch (msg->type) {
+        case UPROBE_DEAD:
+            urefcount_release(upipe_xfer_to_urefcount_real(upipe_xfer));
+            break;
+        case UPROBE_XFER_VOID:
+            if (upipe_xfer->upipe_remote == msg->upipe_remote)
+                upipe_throw(upipe, msg->arg.event);
+            break;
+        case UPROBE_XFER_UINT64_T:
+            if (upipe_xfer->upipe_remote == msg->upipe_remote)
+                upipe_throw(upipe, msg->arg.event, msg->event_arg.u64);
+            break;
+        case UPROBE_XFER_UNSIGNED_LONG_LOCAL:
+            if (upipe_xfer->upipe_remote == msg->upipe_remote)
+                upipe_throw(upipe, msg->arg.event, msg->event_signature,
+                            msg->event_arg.ulong);
+            break;
+        default:
+            /* this should not happen */
+            break;
+    }
+
+    upipe_xfer_msg_free(upipe->mgr, msg);
+    urefcount_release(upipe_xfer_to_urefcount_real(upipe_xfer));
+}
+
 /** @This is called by the local upump manager to receive probes from remote.
+ * Messages are popped in batches, so that the counter of the queue is only
+ * updated once per batch.
  *
  * @param upump description structure of the read watcher
  */
@@ -368,35 +407,13 @@ static void upipe_xfer_worker(struct upump *upump)
 {
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_xfer *upipe_xfer = upipe_xfer_from_upipe(upipe);
-    struct upipe_xfer_msg *msg;
+    void *msgs[XFER_BATCH];
+    unsigned int nb;
     urefcount_use(upipe_xfer_to_urefcount_real(upipe_xfer));
-    while ((msg = uqueue_pop(&upipe_xfer->uqueue,
-                             struct upipe_xfer_msg *)) != NULL) {
-        switch (msg->type) {
-            case UPROBE_DEAD:
-                urefcount_release(upipe_xfer_to_urefcount_real(upipe_xfer));
-                break;
-            case UPROBE_XFER_VOID:
-                if (upipe_xfer->upipe_remote == msg->upipe_remote)
-                    upipe_throw(upipe, msg->arg.event);
-                break;
-            case UPROBE_XFER_UINT64_T:
-                if (upipe_xfer->upipe_remote == msg->upipe_remote)
-                    upipe_throw(upipe, msg->arg.event, msg->event_arg.u64);
-                break;
-            case UPROBE_XFER_UNSIGNED_LONG_LOCAL:
-                if (upipe_xfer->upipe_remote == msg->upipe_remote)
-                    upipe_throw(upipe, msg->arg.event, msg->event_signature,
-                                msg->event_arg.ulong);
-                break;
-            default:
-                /* this should not happen */
-                break;
-        }
-
-        upipe_xfer_msg_free(upipe->mgr, msg);
-        urefcount_release(upipe_xfer_to_urefcount_real(upipe_xfer));
-    }
+    while ((nb = uqueue_pop_batch(&upipe_xfer->uqueue, msgs,
+                                  XFER_BATCH)) > 0)
+        for (unsigned int i = 0; i < nb; i++)
+            upipe_xfer_handle(upipe, msgs[i]);
     urefcount_release(upipe_xfer_to_urefcount_real(upipe_xfer));
 }
 
@@ -517,7 +534,46 @@ static void upipe_xfer_mgr_free(struct upipe_mgr *mgr)
     free(xfer_mgr);
 }
 
+/** @internal @This handles a message received by the remote upump manager.
+ *
+ * @param mgr xfer_mgr structure
+ * @param msg message to handle
+ * @return false if the manager was freed
+ */
+static bool upipe_xfer_mgr_handle(struct upipe_mgr *mgr,
+                                  struct upipe_xfer_msg *msg)
+{
+    switch (msg->type) {
+        case UPIPE_XFER_ATTACH_UPUMP_MGR:
+            upipe_attach_upump_mgr(msg->upipe_remote);
+            break;
+        case UPIPE_XFER_SET_URI:
+            upipe_set_uri(msg->upipe_remote, msg->arg.string);
+            free(msg->arg.string);
+            break;
+        case UPIPE_XFER_SET_OUTPUT:
+            upipe_set_output(msg->upipe_remote, msg->arg.pipe);
+            upipe_release(msg->arg.pipe);
+            break;
+        case UPIPE_XFER_RELEASE:
+            upipe_release(msg->upipe_remote);
+            break;
+        case UPIPE_XFER_DETACH:
+            upipe_xfer_msg_free(mgr, msg);
+            upipe_xfer_mgr_free(mgr);
+            return false;
+        default:
+            /* this should not happen */
+            break;
+    }
+
+    upipe_xfer_msg_free(mgr, msg);
+    return true;
+}
+
 /** @This is called by the remote upump manager to receive messages.
+ * Messages are popped in batches, so that pipes transferred at once only
+ * cost one wake-up and one update of the counter of the queue per batch.
  *
  * @param upump description structure of the read watcher
  */
@@ -525,35 +581,13 @@ static void upipe_xfer_mgr_worker(struct upump *upump)
 {
     struct upipe_mgr *mgr = upump_get_opaque(upump, struct upipe_mgr *);
     struct upipe_xfer_mgr *xfer_mgr = upipe_xfer_mgr_from_upipe_mgr(mgr);
-    struct upipe_xfer_msg *msg;
-    while ((msg = uqueue_pop(&xfer_mgr->uqueue,
-                             struct upipe_xfer_msg *)) != NULL) {
-        switch (msg->type) {
-            case UPIPE_XFER_ATTACH_UPUMP_MGR:
-                upipe_attach_upump_mgr(msg->upipe_remote);
-                break;
-            case UPIPE_XFER_SET_URI:
-                upipe_set_uri(msg->upipe_remote, msg->arg.string);
-                free(msg->arg.string);
-                break;
-            case UPIPE_XFER_SET_OUTPUT:
-                upipe_set_output(msg->upipe_remote, msg->arg.pipe);
-                upipe_release(msg->arg.pipe);
-                break;
-            case UPIPE_XFER_RELEASE:
-                upipe_release(msg->upipe_remote);
-                break;
-            case UPIPE_XFER_DETACH:
-                upipe_xfer_msg_free(mgr, msg);
-                upipe_xfer_mgr_free(mgr);
+    void *msgs[XFER_BATCH];
+    unsigned int nb;
+    while ((nb = uqueue_pop_batch(&xfer_mgr->uqueue, msgs, XFER_BATCH)) > 0)
+        for (unsigned int i = 0; i < nb; i++)
+            /* the detach message is always the last one */
+            if (unlikely(!upipe_xfer_mgr_handle(mgr, msgs[i])))
                 return;
-            default:
-                /* this should not happen */
-                break;
-        }
-
-        upipe_xfer_msg_free(mgr, msg);
-    }
 }
 
 /** @This sends a message to the remote upump manager.
@@ -50,7 +50,8 @@
 #include <assert.h>
 
 /** @hidden */
-static uint64_t upipe_trickp_get_date_sys(struct upipe *upipe, uint64_t ts);
+static uint64_t upipe_trickp_sub_get_date_sys(struct upipe *upipe,
+                                              uint64_t ts);
 /** @hidden */
 static int upipe_trickp_check_start(struct upipe *upipe, struct uref *);
 /** @hidden */
@@ -67,13 +68,10 @@ struct upipe_trickp {
     /** uclock request */
     struct urequest uclock_request;
 
-    /** origins of timestamps */
-    uint64_t ts_origin;
-    /** offset of systimes */
-    uint64_t systime_offset;
-
     /** current rate */
     struct urational rate;
+    /** true if buffers are forwarded without pacing */
+    bool unpaced;
     /** list of subs */
     struct uchain subs;
 
@@ -107,6 +105,12 @@ struct upipe_trickp_sub {
 
     /** type of the flow */
     enum upipe_trickp_sub_type type;
+    /** program the flow belongs to */
+    uint64_t program;
+    /** origin of timestamps of the program */
+    uint64_t ts_origin;
+    /** offset of systimes of the program, or 0 if not started */
+    uint64_t systime_offset;
     /** temporary uref storage */
     struct uchain urefs;
     /** nb urefs in storage */
@@ -162,6 +166,9 @@ static struct upipe *upipe_trickp_sub_alloc(struct upipe_mgr *mgr,
         upipe_trickp_sub_from_upipe(upipe);
     ulist_init(&upipe_trickp_sub->urefs);
     upipe_trickp_sub->type = UPIPE_TRICKP_UNKNOWN;
+    upipe_trickp_sub->program = 0;
+    upipe_trickp_sub->ts_origin = 0;
+    upipe_trickp_sub->systime_offset = 0;
 
     struct upipe_trickp *upipe_trickp = upipe_trickp_from_sub_mgr(upipe->mgr);
     if (upipe_trickp->rate.den)
@@ -191,10 +198,12 @@ static bool upipe_trickp_sub_process(struct upipe *upipe, struct uref *uref,
     uint64_t date;
     int type;
     uref_clock_get_date_prog(uref, &date, &type);
-    if (likely(type != UREF_DATE_NONE)) {
-        uint64_t date_sys =
-                upipe_trickp_get_date_sys(upipe_trickp_to_upipe(upipe_trickp),
-                                          date);
+    if (upipe_trickp->unpaced) {
+        if (upipe_trickp->uclock != NULL && type != UREF_DATE_NONE)
+            uref_clock_set_date_sys(uref, uclock_now(upipe_trickp->uclock),
+                                    type);
+    } else if (likely(type != UREF_DATE_NONE)) {
+        uint64_t date_sys = upipe_trickp_sub_get_date_sys(upipe, date);
         uref_clock_set_date_sys(uref, date_sys, type);
         upipe_verbose_va(upipe, "stamping %"PRIu64" -> %"PRIu64,
                          date, date_sys);
@@ -213,14 +222,17 @@ static bool upipe_trickp_sub_process(struct upipe *upipe, struct uref *uref,
 static void upipe_trickp_sub_input(struct upipe *upipe, struct uref *uref,
                                    struct upump **upump_p)
 {
+    struct upipe_trickp_sub *upipe_trickp_sub =
+        upipe_trickp_sub_from_upipe(upipe);
     struct upipe_trickp *upipe_trickp = upipe_trickp_from_sub_mgr(upipe->mgr);
 
-    if (upipe_trickp->uclock == NULL || upipe_trickp->rate.num == 0 ||
-        upipe_trickp->rate.den == 0) {
+    if ((upipe_trickp->uclock == NULL && !upipe_trickp->unpaced) ||
+        upipe_trickp->rate.num == 0 || upipe_trickp->rate.den == 0) {
         /* pause */
         upipe_trickp_sub_hold_input(upipe, uref);
         upipe_trickp_sub_block_input(upipe, upump_p);
-    } else if (upipe_trickp->systime_offset == 0) {
+    } else if (!upipe_trickp->unpaced &&
+               upipe_trickp_sub->systime_offset == 0) {
         upipe_trickp_sub_hold_input(upipe, uref);
         upipe_trickp_check_start(upipe_trickp_to_upipe(upipe_trickp), NULL);
     } else
@@ -260,6 +272,28 @@ static int upipe_trickp_sub_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the program of the subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param program program of the subpipe
+ * @return an error code
+ */
+static int _upipe_trickp_sub_set_program(struct upipe *upipe,
+                                         uint64_t program)
+{
+    struct upipe_trickp_sub *upipe_trickp_sub =
+        upipe_trickp_sub_from_upipe(upipe);
+    struct upipe_trickp *upipe_trickp = upipe_trickp_from_sub_mgr(upipe->mgr);
+    if (program == upipe_trickp_sub->program)
+        return UBASE_ERR_NONE;
+
+    upipe_dbg_va(upipe, "moving to program %"PRIu64, program);
+    upipe_trickp_sub->program = program;
+    upipe_trickp_sub->ts_origin = 0;
+    upipe_trickp_sub->systime_offset = 0;
+    return upipe_trickp_check_start(upipe_trickp_to_upipe(upipe_trickp), NULL);
+}
+
 /** @internal @This processes control commands on an output subpipe of a
  * trickp pipe.
  *
@@ -310,6 +344,18 @@ static int upipe_trickp_sub_control(struct upipe *upipe,
             return upipe_trickp_sub_set_max_length(upipe, max_length);
         }
 
+        case UPIPE_TRICKP_SUB_GET_PROGRAM: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TRICKP_SUB_SIGNATURE)
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_trickp_sub_from_upipe(upipe)->program;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TRICKP_SUB_SET_PROGRAM: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TRICKP_SUB_SIGNATURE)
+            uint64_t program = va_arg(args, uint64_t);
+            return _upipe_trickp_sub_set_program(upipe, program);
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -367,86 +413,146 @@ static struct upipe *upipe_trickp_alloc(struct upipe_mgr *mgr,
     upipe_trickp_init_sub_subs(upipe);
     upipe_trickp_init_uclock(upipe);
     struct upipe_trickp *upipe_trickp = upipe_trickp_from_upipe(upipe);
-    upipe_trickp->systime_offset = 0;
-    upipe_trickp->ts_origin = 0;
     upipe_trickp->rate.num = upipe_trickp->rate.den = 1;
+    upipe_trickp->unpaced = false;
     upipe_throw_ready(upipe);
     upipe_trickp_require_uclock(upipe);
     return upipe;
 }
 
-/** @internal @This checks if we have got packets on video and audio inputs, so
- * we are ready to output them.
+/** @internal @This checks if we have got packets on video and audio inputs
+ * of a program, so we are ready to output them.
  *
  * @param upipe description structure of the pipe
- * @param uref unused uref
- * @return an error code
+ * @param program program to start
  */
-static int upipe_trickp_check_start(struct upipe *upipe, struct uref *uref)
+static void upipe_trickp_check_start_program(struct upipe *upipe,
+                                             uint64_t program)
 {
     struct upipe_trickp *upipe_trickp = upipe_trickp_from_upipe(upipe);
     uint64_t earliest_ts = UINT64_MAX;
+    uint64_t systime_offset = 0;
     struct uchain *uchain;
+
+    /* a subpipe joining a running program takes over its mapping */
     ulist_foreach (&upipe_trickp->subs, uchain) {
         struct upipe_trickp_sub *upipe_trickp_sub =
             upipe_trickp_sub_from_uchain(uchain);
-        if (upipe_trickp_sub->type == UPIPE_TRICKP_SUBPIC)
-            continue;
-
-        for ( ; ; ) {
-            struct uchain *uchain2;
-            uchain2 = ulist_peek(&upipe_trickp_sub->urefs);
-            if (uchain2 == NULL)
-                return UBASE_ERR_NONE; /* not ready */
-            struct uref *uref = uref_from_uchain(uchain2);
-            uint64_t ts;
-            int type;
-            uref_clock_get_date_prog(uref, &ts, &type);
-            if (unlikely(type == UREF_DATE_NONE)) {
-                upipe_warn(upipe, "non-dated uref");
-                upipe_trickp_sub_pop_input(
-                        upipe_trickp_sub_to_upipe(upipe_trickp_sub));
-                uref_free(uref);
+        if (upipe_trickp_sub->program == program &&
+            upipe_trickp_sub->systime_offset) {
+            earliest_ts = upipe_trickp_sub->ts_origin;
+            systime_offset = upipe_trickp_sub->systime_offset;
+            break;
+        }
+    }
+
+    if (!systime_offset) {
+        ulist_foreach (&upipe_trickp->subs, uchain) {
+            struct upipe_trickp_sub *upipe_trickp_sub =
+                upipe_trickp_sub_from_uchain(uchain);
+            if (upipe_trickp_sub->program != program ||
+                upipe_trickp_sub->type == UPIPE_TRICKP_SUBPIC)
                 continue;
+
+            for ( ; ; ) {
+                struct uchain *uchain2;
+                uchain2 = ulist_peek(&upipe_trickp_sub->urefs);
+                if (uchain2 == NULL)
+                    return; /* not ready */
+                struct uref *uref = uref_from_uchain(uchain2);
+                uint64_t ts;
+                int type;
+                uref_clock_get_date_prog(uref, &ts, &type);
+                if (unlikely(type == UREF_DATE_NONE)) {
+                    upipe_warn(upipe, "non-dated uref");
+                    upipe_trickp_sub_pop_input(
+                            upipe_trickp_sub_to_upipe(upipe_trickp_sub));
+                    uref_free(uref);
+                    continue;
+                }
+                if (ts < earliest_ts)
+                    earliest_ts = ts;
+                break;
             }
-            if (ts < earliest_ts)
-                earliest_ts = ts;
-            break;
         }
+
+        if (earliest_ts == UINT64_MAX)
+            return;
+        systime_offset = uclock_now(upipe_trickp->uclock);
+        upipe_verbose_va(upipe, "setting program %"PRIu64" origin=%"PRIu64
+                         " now=%"PRIu64, program, earliest_ts, systime_offset);
+    }
+
+    ulist_foreach (&upipe_trickp->subs, uchain) {
+        struct upipe_trickp_sub *upipe_trickp_sub =
+            upipe_trickp_sub_from_uchain(uchain);
+        if (upipe_trickp_sub->program == program) {
+            upipe_trickp_sub->ts_origin = earliest_ts;
+            upipe_trickp_sub->systime_offset = systime_offset;
+        }
+    }
+    ulist_foreach (&upipe_trickp->subs, uchain) {
+        struct upipe_trickp_sub *upipe_trickp_sub =
+            upipe_trickp_sub_from_uchain(uchain);
+        if (upipe_trickp_sub->program == program)
+            upipe_trickp_sub_output_input(
+                        upipe_trickp_sub_to_upipe(upipe_trickp_sub));
     }
+}
 
-    if (earliest_ts == UINT64_MAX)
+/** @internal @This checks if we have got packets on video and audio inputs of
+ * the programs which are not started yet, so we are ready to output them.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref unused uref
+ * @return an error code
+ */
+static int upipe_trickp_check_start(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_trickp *upipe_trickp = upipe_trickp_from_upipe(upipe);
+    struct uchain *uchain;
+    if (upipe_trickp->unpaced) {
+        ulist_foreach (&upipe_trickp->subs, uchain) {
+            struct upipe_trickp_sub *upipe_trickp_sub =
+                upipe_trickp_sub_from_uchain(uchain);
+            upipe_trickp_sub_output_input(
+                        upipe_trickp_sub_to_upipe(upipe_trickp_sub));
+        }
+        return UBASE_ERR_NONE;
+    }
+    if (upipe_trickp->uclock == NULL)
         return UBASE_ERR_NONE;
-    upipe_trickp->ts_origin = earliest_ts;
-    upipe_trickp->systime_offset = uclock_now(upipe_trickp->uclock);
-    upipe_verbose_va(upipe, "setting origin=%"PRIu64" now=%"PRIu64,
-                     upipe_trickp->ts_origin, upipe_trickp->systime_offset);
 
     ulist_foreach (&upipe_trickp->subs, uchain) {
         struct upipe_trickp_sub *upipe_trickp_sub =
             upipe_trickp_sub_from_uchain(uchain);
-        upipe_trickp_sub_output_input(
-                    upipe_trickp_sub_to_upipe(upipe_trickp_sub));
+        if (!upipe_trickp_sub->systime_offset)
+            upipe_trickp_check_start_program(upipe,
+                                             upipe_trickp_sub->program);
     }
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This returns a system date converted from a timestamp.
+/** @internal @This returns a system date converted from a timestamp, using
+ * the mapping of the program of the subpipe.
  *
- * @param upipe description structure of the pipe
+ * @param upipe description structure of the subpipe
  * @param ts timestamp
  * @return systime
  */
-static uint64_t upipe_trickp_get_date_sys(struct upipe *upipe, uint64_t ts)
+static uint64_t upipe_trickp_sub_get_date_sys(struct upipe *upipe,
+                                              uint64_t ts)
 {
-    struct upipe_trickp *upipe_trickp = upipe_trickp_from_upipe(upipe);
-    if (unlikely(ts < upipe_trickp->ts_origin)) {
+    struct upipe_trickp_sub *upipe_trickp_sub =
+        upipe_trickp_sub_from_upipe(upipe);
+    struct upipe_trickp *upipe_trickp = upipe_trickp_from_sub_mgr(upipe->mgr);
+    if (unlikely(ts < upipe_trickp_sub->ts_origin)) {
         upipe_warn(upipe, "got a timestamp in the past");
-        ts = upipe_trickp->ts_origin;
+        ts = upipe_trickp_sub->ts_origin;
     }
-    return (ts - upipe_trickp->ts_origin) *
+    return (ts - upipe_trickp_sub->ts_origin) *
                upipe_trickp->rate.den / upipe_trickp->rate.num +
-           upipe_trickp->systime_offset;
+           upipe_trickp_sub->systime_offset;
 }
 
 /** @internal @This resets uclock-related fields.
@@ -456,8 +562,13 @@ static uint64_t upipe_trickp_get_date_sys(struct upipe *upipe, uint64_t ts)
 static void upipe_trickp_reset_uclock(struct upipe *upipe)
 {
     struct upipe_trickp *upipe_trickp = upipe_trickp_from_upipe(upipe);
-    upipe_trickp->systime_offset = 0;
-    upipe_trickp->ts_origin = 0;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_trickp->subs, uchain) {
+        struct upipe_trickp_sub *upipe_trickp_sub =
+            upipe_trickp_sub_from_uchain(uchain);
+        upipe_trickp_sub->systime_offset = 0;
+        upipe_trickp_sub->ts_origin = 0;
+    }
 }
 
 /** @This returns the current playing rate.
@@ -511,6 +622,24 @@ static inline int _upipe_trickp_set_rate(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @This sets the pipe unpaced.
+ *
+ * @param upipe description structure of the pipe
+ * @param unpaced true to forward buffers without pacing
+ * @return an error code
+ */
+static int _upipe_trickp_set_unpaced(struct upipe *upipe, bool unpaced)
+{
+    struct upipe_trickp *upipe_trickp = upipe_trickp_from_upipe(upipe);
+    if (unpaced == upipe_trickp->unpaced)
+        return UBASE_ERR_NONE;
+    upipe_dbg_va(upipe, "%s pacing", unpaced ? "disabling" : "enabling");
+    upipe_trickp->unpaced = unpaced;
+    /* restart timelines from the next buffers when pacing again */
+    upipe_trickp_reset_uclock(upipe);
+    return upipe_trickp_check_start(upipe, NULL);
+}
+
 /** @internal @This processes control commands on a trickp pipe.
  *
  * @param upipe description structure of the pipe
@@ -540,6 +669,17 @@ static int upipe_trickp_control(struct upipe *upipe, int command, va_list args)
             struct urational rate = va_arg(args, struct urational);
             return _upipe_trickp_set_rate(upipe, rate);
         }
+        case UPIPE_TRICKP_GET_UNPACED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TRICKP_SIGNATURE)
+            int *p = va_arg(args, int *);
+            *p = upipe_trickp_from_upipe(upipe)->unpaced;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TRICKP_SET_UNPACED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TRICKP_SIGNATURE)
+            int unpaced = va_arg(args, int);
+            return _upipe_trickp_set_unpaced(upipe, !!unpaced);
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
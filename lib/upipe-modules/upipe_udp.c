@@ -289,6 +289,59 @@ static bool upipe_udp_parse_node_service(struct upipe *upipe,
     return true;
 }
 
+/** @internal @This parses the destination of a socket URI, for datagrams
+ * sent on an already opened socket.
+ *
+ * @param upipe description structure of the pipe
+ * @param _uri socket URI, of the form host:port
+ * @param connect_port default destination port
+ * @param addr filled in with the destination address
+ * @param addr_len_p filled in with the size of the destination address
+ * @return false in case of error
+ */
+bool upipe_udp_parse_destination(struct upipe *upipe, const char *_uri,
+                                 uint16_t connect_port,
+                                 struct sockaddr_storage *addr,
+                                 socklen_t *addr_len_p)
+{
+    union sockaddru connect_addr;
+    char *uri = strdup(_uri);
+    if (unlikely(uri == NULL))
+        return false;
+
+    char *end = strpbrk(uri, ",/");
+    if (end != NULL)
+        *end = '\0';
+    memset(&connect_addr, 0, sizeof(union sockaddru));
+    connect_addr.ss.ss_family = AF_UNSPEC;
+    char *token = uri;
+    if (uri[0] == '\0' || uri[0] == '@' ||
+        !upipe_udp_parse_node_service(upipe, uri, &token, connect_port,
+                                      NULL, &connect_addr.ss) ||
+        *token != '\0') {
+        upipe_warn_va(upipe, "invalid destination %s", _uri);
+        free(uri);
+        return false;
+    }
+    free(uri);
+
+    switch (connect_addr.ss.ss_family) {
+        case AF_INET:
+            memset(&connect_addr.sin.sin_zero, 0,
+                   sizeof(connect_addr.sin.sin_zero));
+            *addr_len_p = sizeof(struct sockaddr_in);
+            break;
+        case AF_INET6:
+            *addr_len_p = sizeof(struct sockaddr_in6);
+            break;
+        default:
+            upipe_warn_va(upipe, "invalid destination %s", _uri);
+            return false;
+    }
+    memcpy(addr, &connect_addr.ss, sizeof(struct sockaddr_storage));
+    return true;
+}
+
 /** @internal @This is a helper for @ref upipe_udp_open_socket.
  *
  * @param psz_string option string
@@ -340,6 +393,7 @@ int upipe_udp_open_socket(struct upipe *upipe, const char *_uri, int ttl,
     in_addr_t src_addr = INADDR_ANY;
     uint16_t src_port = 4242;
     int tos = 0;
+    int busy_poll = 0;
     bool b_tcp;
     bool b_raw;
     int family;
@@ -438,6 +492,8 @@ int upipe_udp_open_socket(struct upipe *upipe, const char *_uri, int ttl,
                 ttl = strtol(ARG_OPTION("ttl="), NULL, 0);
             } else if (IS_OPTION("tos=")) {
                 tos = strtol(ARG_OPTION("tos="), NULL, 0);
+            } else if (IS_OPTION("busy_poll=")) {
+                busy_poll = strtol(ARG_OPTION("busy_poll="), NULL, 0);
             } else if (IS_OPTION("tcp")) {
                 *use_tcp = true;
             } else {
@@ -575,6 +631,15 @@ normal_bind:
         i = 0x80000;
         setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (void *) &i, sizeof(i));
 
+#ifdef SO_BUSY_POLL
+        /* linux specific, busy polls the device queue for the given time
+         * in microseconds before sleeping on the socket */
+        if (busy_poll &&
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                       (void *)&busy_poll, sizeof(busy_poll)) < 0)
+            upipe_warn_va(upipe, "couldn't set busy poll (%m)");
+#endif
+
         /* Join the multicast group if the socket is a multicast address */
         if (bind_addr.ss.ss_family == AF_INET
               && IN_MULTICAST(ntohl(bind_addr.sin.sin_addr.s_addr))) {
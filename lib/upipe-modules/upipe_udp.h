@@ -30,6 +30,7 @@
 
 #include <upipe/upipe.h>
 #include <stdint.h>
+#include <sys/socket.h>
 
 #define IP_HEADER_MINSIZE 20
 #define UDP_HEADER_SIZE 8
@@ -164,5 +165,20 @@ int upipe_udp_open_socket(struct upipe *upipe, const char *_uri, int ttl,
                           unsigned int *weight, bool *use_tcp,
                           bool *use_raw, uint8_t *raw_header);
 
+/** @internal @This parses the destination of a socket URI, for datagrams
+ * sent on an already opened socket.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri socket URI, of the form host:port
+ * @param connect_port default destination port
+ * @param addr filled in with the destination address
+ * @param addr_len_p filled in with the size of the destination address
+ * @return false in case of error
+ */
+bool upipe_udp_parse_destination(struct upipe *upipe, const char *uri,
+                                 uint16_t connect_port,
+                                 struct sockaddr_storage *addr,
+                                 socklen_t *addr_len_p);
+
 void udp_raw_set_len(uint8_t *raw_header, uint16_t len);
 
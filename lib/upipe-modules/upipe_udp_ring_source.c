@@ -0,0 +1,1207 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module receiving udp datagrams from a packet ring
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uatomic.h>
+#include <upipe/urefcount.h>
+#include <upipe/umem.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upump.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_uref_mgr.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_uclock.h>
+#include <upipe-modules/upipe_udp_ring_source.h>
+#include "upipe_udp.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#define UDP_DEFAULT_TTL 0
+#define UDP_DEFAULT_PORT 1234
+/** default number of blocks of the ring */
+#define RINGSRC_DEFAULT_BLOCKS 64
+/** default size of a block of the ring */
+#define RINGSRC_DEFAULT_BLOCK_SIZE (1024 * 1024)
+/** default time after which a block is handed to the pipe, in ms */
+#define RINGSRC_DEFAULT_TIMEOUT 10
+/** nominal size of a frame of the ring, which only matters to the kernel
+ * accounting in TPACKET_V3 */
+#define RINGSRC_FRAME_SIZE 2048
+/** number of buckets of the table of outputs */
+#define RINGSRC_BUCKETS 256
+/** minimum size of an IPv4 header */
+#define RINGSRC_IP_HEADER_MINSIZE 20
+/** size of a udp header */
+#define RINGSRC_UDP_HEADER_SIZE 8
+
+/** @internal @This is the memory-mapped ring of a packet socket. It
+ * outlives the pipe as long as ubufs point to its blocks. */
+struct upipe_ringsrc_ring {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** mapped ring */
+    uint8_t *map;
+    /** size of the mapping */
+    size_t map_size;
+    /** size of a block */
+    size_t block_size;
+    /** number of blocks */
+    unsigned int nb_blocks;
+
+    /** umem manager wrapping the payloads of the ring */
+    struct umem_mgr mgr;
+
+    /** number of references to each block, including the pipe reading it */
+    uatomic_uint32_t refcounts[];
+};
+
+UBASE_FROM_TO(upipe_ringsrc_ring, umem_mgr, umem_mgr, mgr)
+UBASE_FROM_TO(upipe_ringsrc_ring, urefcount, urefcount, urefcount)
+
+/** @hidden */
+static int upipe_ringsrc_check(struct upipe *upipe, struct uref *flow_format);
+
+/** @internal @This is the private context of a udp ring source pipe. */
+struct upipe_ringsrc {
+    /** real refcount management structure */
+    struct urefcount urefcount_real;
+    /** refcount management structure exported to the public structure */
+    struct urefcount urefcount;
+
+    /** uref manager */
+    struct uref_mgr *uref_mgr;
+    /** uref manager request */
+    struct urequest uref_mgr_request;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** uclock structure, if not NULL we are in live mode */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** read watcher */
+    struct upump *upump;
+
+    /** packet socket descriptor */
+    int fd;
+    /** uri of the interface */
+    char *uri;
+    /** ring of the socket */
+    struct upipe_ringsrc_ring *ring;
+    /** next block to read */
+    unsigned int block;
+    /** sequence numbers of the blocks last read */
+    uint64_t *block_seqs;
+
+    /** list of output subpipes */
+    struct uchain outputs;
+    /** outputs by destination address and port */
+    struct uchain buckets[RINGSRC_BUCKETS];
+
+    /** manager to create output subpipes */
+    struct upipe_mgr sub_mgr;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ringsrc, upipe, UPIPE_RINGSRC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ringsrc, urefcount, upipe_ringsrc_no_input)
+UPIPE_HELPER_VOID(upipe_ringsrc)
+
+UPIPE_HELPER_UREF_MGR(upipe_ringsrc, uref_mgr, uref_mgr_request,
+                      upipe_ringsrc_check, upipe_throw_provide_request, NULL)
+UPIPE_HELPER_UBUF_MGR(upipe_ringsrc, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      upipe_ringsrc_check, upipe_throw_provide_request, NULL)
+UPIPE_HELPER_UCLOCK(upipe_ringsrc, uclock, uclock_request, upipe_ringsrc_check,
+                    upipe_throw_provide_request, NULL)
+
+UPIPE_HELPER_UPUMP_MGR(upipe_ringsrc, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_ringsrc, upump, upump_mgr)
+
+UBASE_FROM_TO(upipe_ringsrc, urefcount, urefcount_real, urefcount_real)
+
+/** @hidden */
+static void upipe_ringsrc_free(struct urefcount *urefcount_real);
+
+/** @internal @This is the private context of an output of a udp ring source
+ * pipe. */
+struct upipe_ringsrc_output {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** structure for the list of the bucket */
+    struct uchain bucket_uchain;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** udp socket descriptor joining the group */
+    int fd;
+    /** udp socket uri */
+    char *uri;
+    /** destination address (network order) */
+    uint32_t addr;
+    /** destination port (network order) */
+    uint16_t port;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ringsrc_output, upipe, UPIPE_RINGSRC_OUTPUT_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ringsrc_output, urefcount,
+                       upipe_ringsrc_output_free)
+UPIPE_HELPER_OUTPUT(upipe_ringsrc_output, output, flow_def, output_state,
+                    request_list)
+
+UPIPE_HELPER_SUBPIPE(upipe_ringsrc, upipe_ringsrc_output, output, sub_mgr,
+                     outputs, uchain)
+
+UBASE_FROM_TO(upipe_ringsrc_output, uchain, bucket_uchain, bucket_uchain)
+
+/** @internal @This returns the descriptor of a block of the ring.
+ *
+ * @param ring pointer to ring
+ * @param block index of the block
+ * @return pointer to the block descriptor
+ */
+static inline struct tpacket_block_desc *
+    upipe_ringsrc_ring_desc(struct upipe_ringsrc_ring *ring,
+                            unsigned int block)
+{
+    return (struct tpacket_block_desc *)(ring->map + block * ring->block_size);
+}
+
+/** @internal @This releases a reference to a block of the ring, and gives it
+ * back to the kernel with the last one.
+ *
+ * @param ring pointer to ring
+ * @param block index of the block
+ */
+static void upipe_ringsrc_ring_release_block(struct upipe_ringsrc_ring *ring,
+                                             unsigned int block)
+{
+    /* the atomic operation is a full barrier, so the payloads have been
+     * read when the status is written */
+    if (uatomic_fetch_sub(&ring->refcounts[block], 1) == 1) {
+        struct tpacket_block_desc *desc = upipe_ringsrc_ring_desc(ring, block);
+        *(volatile uint32_t *)&desc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    }
+}
+
+/** @internal @This refuses to allocate a umem, as the memory of the ring is
+ * only filled by the kernel.
+ *
+ * @param mgr management structure
+ * @param umem caller-allocated structure
+ * @param size requested size of the umem
+ * @return false
+ */
+static bool upipe_ringsrc_umem_alloc(struct umem_mgr *mgr, struct umem *umem,
+                                     size_t size)
+{
+    return false;
+}
+
+/** @internal @This resizes a umem pointing to a payload of the ring, which
+ * can only shrink.
+ *
+ * @param umem pointer to umem
+ * @param new_size new requested size of the umem
+ * @return false if the umem can't be resized
+ */
+static bool upipe_ringsrc_umem_realloc(struct umem *umem, size_t new_size)
+{
+    if (unlikely(new_size > umem->real_size))
+        return false;
+    umem->size = new_size;
+    return true;
+}
+
+/** @internal @This frees a umem pointing to a payload of the ring.
+ *
+ * @param umem pointer to umem
+ */
+static void upipe_ringsrc_umem_free(struct umem *umem)
+{
+    struct umem_mgr *mgr = umem->mgr;
+    struct upipe_ringsrc_ring *ring = upipe_ringsrc_ring_from_umem_mgr(mgr);
+    upipe_ringsrc_ring_release_block(ring,
+            (umem->buffer - ring->map) / ring->block_size);
+    umem->buffer = NULL;
+    umem->mgr = NULL;
+    umem_mgr_release(mgr);
+}
+
+/** @internal @This unmaps and frees a ring.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void upipe_ringsrc_ring_free(struct urefcount *urefcount)
+{
+    struct upipe_ringsrc_ring *ring =
+        upipe_ringsrc_ring_from_urefcount(urefcount);
+    for (unsigned int i = 0; i < ring->nb_blocks; i++)
+        uatomic_clean(&ring->refcounts[i]);
+    munmap(ring->map, ring->map_size);
+    urefcount_clean(urefcount);
+    free(ring);
+}
+
+/** @internal @This allocates the structure of a mapped ring. The mapping
+ * belongs to the ring.
+ *
+ * @param map mapped ring
+ * @param block_size size of a block
+ * @param nb_blocks number of blocks
+ * @return pointer to ring, or NULL in case of allocation error
+ */
+static struct upipe_ringsrc_ring *upipe_ringsrc_ring_alloc(uint8_t *map,
+        size_t block_size, unsigned int nb_blocks)
+{
+    struct upipe_ringsrc_ring *ring =
+        malloc(sizeof(struct upipe_ringsrc_ring) +
+               nb_blocks * sizeof(uatomic_uint32_t));
+    if (unlikely(ring == NULL))
+        return NULL;
+    ring->map = map;
+    ring->map_size = block_size * nb_blocks;
+    ring->block_size = block_size;
+    ring->nb_blocks = nb_blocks;
+    for (unsigned int i = 0; i < nb_blocks; i++)
+        uatomic_init(&ring->refcounts[i], 0);
+
+    urefcount_init(upipe_ringsrc_ring_to_urefcount(ring),
+                   upipe_ringsrc_ring_free);
+    ring->mgr.refcount = upipe_ringsrc_ring_to_urefcount(ring);
+    ring->mgr.umem_alloc = upipe_ringsrc_umem_alloc;
+    ring->mgr.umem_realloc = upipe_ringsrc_umem_realloc;
+    ring->mgr.umem_free = upipe_ringsrc_umem_free;
+    ring->mgr.umem_mgr_vacuum = NULL;
+    ring->mgr.umem_mgr_control = NULL;
+    return ring;
+}
+
+/** @internal @This returns the bucket of the outputs of a destination.
+ *
+ * @param upipe_ringsrc private context of the pipe
+ * @param addr destination address (network order)
+ * @param port destination port (network order)
+ * @return pointer to the list of the bucket
+ */
+static inline struct uchain *
+    upipe_ringsrc_bucket(struct upipe_ringsrc *upipe_ringsrc,
+                         uint32_t addr, uint16_t port)
+{
+    uint32_t hash = addr ^ port;
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+    return &upipe_ringsrc->buckets[hash % RINGSRC_BUCKETS];
+}
+
+/** @internal @This looks for the output receiving the datagrams sent to a
+ * destination, falling back to the output bound to the wildcard address.
+ *
+ * @param upipe_ringsrc private context of the pipe
+ * @param addr destination address (network order)
+ * @param port destination port (network order)
+ * @return pointer to the output, or NULL
+ */
+static struct upipe_ringsrc_output *
+    upipe_ringsrc_find_output(struct upipe_ringsrc *upipe_ringsrc,
+                              uint32_t addr, uint16_t port)
+{
+    struct uchain *bucket = upipe_ringsrc_bucket(upipe_ringsrc, addr, port);
+    struct uchain *uchain;
+    ulist_foreach (bucket, uchain) {
+        struct upipe_ringsrc_output *upipe_ringsrc_output =
+            upipe_ringsrc_output_from_bucket_uchain(uchain);
+        if (upipe_ringsrc_output->addr == addr &&
+            upipe_ringsrc_output->port == port)
+            return upipe_ringsrc_output;
+    }
+    if (addr != htonl(INADDR_ANY))
+        return upipe_ringsrc_find_output(upipe_ringsrc, htonl(INADDR_ANY),
+                                         port);
+    return NULL;
+}
+
+/** @internal @This allocates an output subpipe of a udp ring source pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ringsrc_output_alloc(struct upipe_mgr *mgr,
+                                                struct uprobe *uprobe,
+                                                uint32_t signature,
+                                                va_list args)
+{
+    if (signature != UPIPE_VOID_SIGNATURE ||
+        mgr->signature != UPIPE_RINGSRC_OUTPUT_SIGNATURE)
+        goto upipe_ringsrc_output_alloc_err;
+
+    struct upipe_ringsrc_output *upipe_ringsrc_output =
+        malloc(sizeof(struct upipe_ringsrc_output));
+    if (unlikely(upipe_ringsrc_output == NULL))
+        goto upipe_ringsrc_output_alloc_err;
+
+    struct upipe *upipe = upipe_ringsrc_output_to_upipe(upipe_ringsrc_output);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_ringsrc_output_init_urefcount(upipe);
+    upipe_ringsrc_output_init_output(upipe);
+    upipe_ringsrc_output_init_sub(upipe);
+    ulist_init(&upipe_ringsrc_output->bucket_uchain);
+    upipe_ringsrc_output->fd = -1;
+    upipe_ringsrc_output->uri = NULL;
+    upipe_ringsrc_output->addr = htonl(INADDR_ANY);
+    upipe_ringsrc_output->port = 0;
+    upipe_throw_ready(upipe);
+    return upipe;
+
+upipe_ringsrc_output_alloc_err:
+    uprobe_release(uprobe);
+    return NULL;
+}
+
+/** @internal @This returns the uri of the udp socket of an output.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri_p filled in with the uri of the udp socket
+ * @return an error code
+ */
+static int upipe_ringsrc_output_get_uri(struct upipe *upipe,
+                                        const char **uri_p)
+{
+    struct upipe_ringsrc_output *upipe_ringsrc_output =
+        upipe_ringsrc_output_from_upipe(upipe);
+    assert(uri_p != NULL);
+    *uri_p = upipe_ringsrc_output->uri;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This asks to open the given udp socket, and to receive the
+ * datagrams sent to its bound address and port on the output.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri relative or absolute uri of the udp socket
+ * @return an error code
+ */
+static int upipe_ringsrc_output_set_uri(struct upipe *upipe, const char *uri)
+{
+    struct upipe_ringsrc_output *upipe_ringsrc_output =
+        upipe_ringsrc_output_from_upipe(upipe);
+    struct upipe_ringsrc *upipe_ringsrc =
+        upipe_ringsrc_from_sub_mgr(upipe->mgr);
+
+    if (unlikely(upipe_ringsrc_output->fd != -1)) {
+        if (likely(upipe_ringsrc_output->uri != NULL))
+            upipe_notice_va(upipe, "closing udp socket %s",
+                            upipe_ringsrc_output->uri);
+        close(upipe_ringsrc_output->fd);
+        upipe_ringsrc_output->fd = -1;
+    }
+    free(upipe_ringsrc_output->uri);
+    upipe_ringsrc_output->uri = NULL;
+    ulist_delete(&upipe_ringsrc_output->bucket_uchain);
+
+    if (unlikely(uri == NULL))
+        return UBASE_ERR_NONE;
+
+    bool use_tcp = false;
+    int fd = upipe_udp_open_socket(upipe, uri, UDP_DEFAULT_TTL,
+                                   UDP_DEFAULT_PORT, 0, NULL, &use_tcp,
+                                   NULL, NULL);
+    if (unlikely(fd == -1)) {
+        upipe_err_va(upipe, "can't open udp socket %s (%m)", uri);
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (unlikely(use_tcp ||
+                 getsockname(fd, (struct sockaddr *)&addr, &addr_len) == -1 ||
+                 addr.ss_family != AF_INET)) {
+        upipe_err_va(upipe, "unsupported socket %s", uri);
+        close(fd);
+        return UBASE_ERR_INVALID;
+    }
+
+    /* the socket only joins the group, the datagrams are read from the ring */
+    struct sock_filter drop = BPF_STMT(BPF_RET | BPF_K, 0);
+    struct sock_fprog prog = { .len = 1, .filter = &drop };
+    if (unlikely(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                            &prog, sizeof(prog)) == -1))
+        upipe_warn_va(upipe, "can't filter udp socket %s (%m)", uri);
+
+    upipe_ringsrc_output->uri = strdup(uri);
+    if (unlikely(upipe_ringsrc_output->uri == NULL)) {
+        close(fd);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_ringsrc_output->fd = fd;
+
+    struct sockaddr_in *sin = (struct sockaddr_in *)&addr;
+    upipe_ringsrc_output->addr = sin->sin_addr.s_addr;
+    upipe_ringsrc_output->port = sin->sin_port;
+    ulist_add(upipe_ringsrc_bucket(upipe_ringsrc, upipe_ringsrc_output->addr,
+                                   upipe_ringsrc_output->port),
+              &upipe_ringsrc_output->bucket_uchain);
+    upipe_notice_va(upipe, "opening udp socket %s", upipe_ringsrc_output->uri);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on an output subpipe of a udp
+ * ring source pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ringsrc_output_control(struct upipe *upipe,
+                                        int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_ringsrc_output_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ringsrc_output_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_ringsrc_output_set_output(upipe, output);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ringsrc_output_get_super(upipe, p);
+        }
+        case UPIPE_GET_URI: {
+            const char **uri_p = va_arg(args, const char **);
+            return upipe_ringsrc_output_get_uri(upipe, uri_p);
+        }
+        case UPIPE_SET_URI: {
+            const char *uri = va_arg(args, const char *);
+            return upipe_ringsrc_output_set_uri(upipe, uri);
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees an output subpipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ringsrc_output_free(struct upipe *upipe)
+{
+    struct upipe_ringsrc_output *upipe_ringsrc_output =
+        upipe_ringsrc_output_from_upipe(upipe);
+
+    if (likely(upipe_ringsrc_output->fd != -1)) {
+        if (likely(upipe_ringsrc_output->uri != NULL))
+            upipe_notice_va(upipe, "closing udp socket %s",
+                            upipe_ringsrc_output->uri);
+        close(upipe_ringsrc_output->fd);
+    }
+    upipe_throw_dead(upipe);
+
+    free(upipe_ringsrc_output->uri);
+    ulist_delete(&upipe_ringsrc_output->bucket_uchain);
+    upipe_ringsrc_output_clean_output(upipe);
+    upipe_ringsrc_output_clean_sub(upipe);
+    upipe_ringsrc_output_clean_urefcount(upipe);
+    upipe_clean(upipe);
+    free(upipe_ringsrc_output);
+}
+
+/** @internal @This initializes the output manager for a udp ring source
+ * pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ringsrc_init_sub_mgr(struct upipe *upipe)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    struct upipe_mgr *sub_mgr = &upipe_ringsrc->sub_mgr;
+    sub_mgr->refcount = upipe_ringsrc_to_urefcount_real(upipe_ringsrc);
+    sub_mgr->signature = UPIPE_RINGSRC_OUTPUT_SIGNATURE;
+    sub_mgr->upipe_alloc = upipe_ringsrc_output_alloc;
+    sub_mgr->upipe_input = NULL;
+    sub_mgr->upipe_control = upipe_ringsrc_output_control;
+    sub_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a udp ring source pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ringsrc_alloc(struct upipe_mgr *mgr,
+                                         struct uprobe *uprobe,
+                                         uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_ringsrc_alloc_void(mgr, uprobe, signature,
+                                                   args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    upipe_ringsrc_init_urefcount(upipe);
+    urefcount_init(upipe_ringsrc_to_urefcount_real(upipe_ringsrc),
+                   upipe_ringsrc_free);
+    upipe_ringsrc_init_uref_mgr(upipe);
+    upipe_ringsrc_init_ubuf_mgr(upipe);
+    upipe_ringsrc_init_uclock(upipe);
+    upipe_ringsrc_init_upump_mgr(upipe);
+    upipe_ringsrc_init_upump(upipe);
+    upipe_ringsrc_init_sub_mgr(upipe);
+    upipe_ringsrc_init_sub_outputs(upipe);
+    for (unsigned int i = 0; i < RINGSRC_BUCKETS; i++)
+        ulist_init(&upipe_ringsrc->buckets[i]);
+    upipe_ringsrc->fd = -1;
+    upipe_ringsrc->uri = NULL;
+    upipe_ringsrc->ring = NULL;
+    upipe_ringsrc->block = 0;
+    upipe_ringsrc->block_seqs = NULL;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This returns the system real-time clock, which is the time
+ * base of the timestamps of the ring.
+ *
+ * @return real-time clock in 27 MHz ticks
+ */
+static uint64_t upipe_ringsrc_realtime(void)
+{
+    struct timespec ts;
+    if (unlikely(clock_gettime(CLOCK_REALTIME, &ts) == -1))
+        return 0;
+    return ts.tv_sec * UCLOCK_FREQ +
+           ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+}
+
+/** @internal @This outputs the udp payload of a packet of the ring, if an
+ * output receives its destination.
+ *
+ * @param upipe description structure of the pipe
+ * @param block index of the block holding the packet
+ * @param hdr header of the packet
+ * @param systime uclock date of the wake-up
+ * @param realtime real-time clock at the wake-up
+ */
+static void upipe_ringsrc_read_packet(struct upipe *upipe, unsigned int block,
+                                      struct tpacket3_hdr *hdr,
+                                      uint64_t systime, uint64_t realtime)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    struct upipe_ringsrc_ring *ring = upipe_ringsrc->ring;
+    const struct sockaddr_ll *sll = (const struct sockaddr_ll *)
+        ((uint8_t *)hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    if (sll->sll_pkttype == PACKET_OUTGOING ||
+        hdr->tp_snaplen < hdr->tp_net - hdr->tp_mac)
+        return;
+
+    /* datagram sockets deliver the packets from the IP header */
+    uint8_t *ip = (uint8_t *)hdr + hdr->tp_net;
+    size_t size = hdr->tp_snaplen - (hdr->tp_net - hdr->tp_mac);
+    if (size < RINGSRC_IP_HEADER_MINSIZE || (ip[0] >> 4) != 4)
+        return;
+    size_t ip_header_size = (ip[0] & 0xf) * 4;
+    size_t ip_size = (ip[2] << 8) | ip[3];
+    if (ip_header_size < RINGSRC_IP_HEADER_MINSIZE || ip_size > size ||
+        ip_size < ip_header_size + RINGSRC_UDP_HEADER_SIZE ||
+        ip[9] != IPPROTO_UDP)
+        return;
+    /* more fragments flag or fragment offset */
+    if ((ip[6] & 0x3f) || ip[7])
+        return;
+
+    uint8_t *udp = ip + ip_header_size;
+    size_t udp_size = (udp[4] << 8) | udp[5];
+    if (udp_size < RINGSRC_UDP_HEADER_SIZE ||
+        udp_size > ip_size - ip_header_size)
+        return;
+
+    uint32_t addr;
+    uint16_t port;
+    memcpy(&addr, ip + 16, sizeof(addr));
+    memcpy(&port, udp + 2, sizeof(port));
+    struct upipe_ringsrc_output *upipe_ringsrc_output =
+        upipe_ringsrc_find_output(upipe_ringsrc, addr, port);
+    if (upipe_ringsrc_output == NULL)
+        return;
+    struct upipe *output = upipe_ringsrc_output_to_upipe(upipe_ringsrc_output);
+
+    if (unlikely(upipe_ringsrc_output->flow_def == NULL)) {
+        struct uref *flow_def = uref_dup(upipe_ringsrc->flow_format);
+        if (unlikely(flow_def == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        upipe_ringsrc_output_store_flow_def(output, flow_def);
+    }
+
+    struct umem umem;
+    umem.mgr = umem_mgr_use(upipe_ringsrc_ring_to_umem_mgr(ring));
+    umem.buffer = udp + RINGSRC_UDP_HEADER_SIZE;
+    umem.size = umem.real_size = udp_size - RINGSRC_UDP_HEADER_SIZE;
+    uatomic_fetch_add(&ring->refcounts[block], 1);
+    struct ubuf *ubuf = ubuf_block_mem_alloc_umem(upipe_ringsrc->ubuf_mgr,
+                                                  &umem, 0, umem.size);
+    if (unlikely(ubuf == NULL)) {
+        umem_free(&umem);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    struct uref *uref = uref_alloc(upipe_ringsrc->uref_mgr);
+    if (unlikely(uref == NULL)) {
+        ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uref_attach_ubuf(uref, ubuf);
+
+    if (unlikely(upipe_ringsrc->uclock != NULL)) {
+        uint64_t date = (uint64_t)hdr->tp_sec * UCLOCK_FREQ +
+            (uint64_t)hdr->tp_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+        uint64_t cr_sys = systime;
+        if (likely(date && date <= realtime && realtime - date <= systime))
+            cr_sys = systime - (realtime - date);
+        uref_clock_set_cr_sys(uref, cr_sys);
+        uref_clock_set_ingress(uref, cr_sys);
+    }
+    upipe_ringsrc_output_output(output, uref, &upipe_ringsrc->upump);
+}
+
+/** @internal @This reports the packets dropped by the kernel because no
+ * block of the ring was available.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ringsrc_report_drops(struct upipe *upipe)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    struct tpacket_stats_v3 stats;
+    socklen_t stats_len = sizeof(stats);
+    if (getsockopt(upipe_ringsrc->fd, SOL_PACKET, PACKET_STATISTICS,
+                   &stats, &stats_len) == -1 || !stats.tp_drops)
+        return;
+    upipe_warn_va(upipe, "%u packets dropped by the kernel on %s",
+                  stats.tp_drops, upipe_ringsrc->uri);
+}
+
+/** @internal @This reads the blocks of the ring handed over by the kernel,
+ * and outputs their datagrams.
+ *
+ * @param upump description structure of the read watcher
+ */
+static void upipe_ringsrc_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    struct upipe_ringsrc_ring *ring = upipe_ringsrc->ring;
+    uint64_t systime = 0; /* to keep gcc quiet */
+    uint64_t realtime = 0;
+    if (unlikely(upipe_ringsrc->uclock != NULL)) {
+        systime = uclock_now(upipe_ringsrc->uclock);
+        realtime = upipe_ringsrc_realtime();
+    }
+
+    upipe_use(upipe);
+    umem_mgr_use(upipe_ringsrc_ring_to_umem_mgr(ring));
+    for (unsigned int i = 0; i < ring->nb_blocks; i++) {
+        unsigned int block = upipe_ringsrc->block;
+        struct tpacket_block_desc *desc = upipe_ringsrc_ring_desc(ring, block);
+        uint32_t status =
+            *(volatile uint32_t *)&desc->hdr.bh1.block_status;
+        /* a block already read stays to the user while it is referenced */
+        if (!(status & TP_STATUS_USER) ||
+            desc->hdr.bh1.seq_num == upipe_ringsrc->block_seqs[block])
+            break;
+        __sync_synchronize();
+        if (unlikely(status & TP_STATUS_LOSING))
+            upipe_ringsrc_report_drops(upipe);
+
+        upipe_ringsrc->block_seqs[block] = desc->hdr.bh1.seq_num;
+        upipe_ringsrc->block = (block + 1) % ring->nb_blocks;
+        uatomic_store(&ring->refcounts[block], 1);
+        uint8_t *packet = (uint8_t *)desc + desc->hdr.bh1.offset_to_first_pkt;
+        for (uint32_t j = 0; j < desc->hdr.bh1.num_pkts; j++) {
+            struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)packet;
+            upipe_ringsrc_read_packet(upipe, block, hdr, systime, realtime);
+            packet += hdr->tp_next_offset;
+        }
+        upipe_ringsrc_ring_release_block(ring, block);
+
+        /* the uri may have been changed by an output */
+        if (unlikely(upipe_ringsrc->ring != ring))
+            break;
+    }
+    umem_mgr_release(upipe_ringsrc_ring_to_umem_mgr(ring));
+    upipe_release(upipe);
+}
+
+/** @internal @This checks if the pump may be allocated.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_ringsrc_check(struct upipe *upipe, struct uref *flow_format)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    if (flow_format != NULL)
+        uref_free(flow_format);
+
+    upipe_ringsrc_check_upump_mgr(upipe);
+    if (upipe_ringsrc->upump_mgr == NULL)
+        return UBASE_ERR_NONE;
+
+    if (upipe_ringsrc->uref_mgr == NULL) {
+        upipe_ringsrc_require_uref_mgr(upipe);
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_ringsrc->ubuf_mgr == NULL) {
+        struct uref *flow_format =
+            uref_block_flow_alloc_def(upipe_ringsrc->uref_mgr, NULL);
+        if (unlikely(flow_format == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_ringsrc_require_ubuf_mgr(upipe, flow_format);
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_ringsrc->uclock == NULL &&
+        urequest_get_opaque(&upipe_ringsrc->uclock_request, struct upipe *)
+            != NULL)
+        return UBASE_ERR_NONE;
+
+    if (upipe_ringsrc->fd != -1 && upipe_ringsrc->upump == NULL) {
+        struct upump *upump = upump_alloc_fd_read(upipe_ringsrc->upump_mgr,
+                                                  upipe_ringsrc_worker, upipe,
+                                                  upipe_ringsrc->fd);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_ringsrc_set_upump(upipe, upump);
+        upump_start(upump);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This closes the packet socket and releases the ring.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ringsrc_close(struct upipe *upipe)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    upipe_ringsrc_set_upump(upipe, NULL);
+    if (likely(upipe_ringsrc->fd != -1)) {
+        if (likely(upipe_ringsrc->uri != NULL))
+            upipe_notice_va(upipe, "closing ring of %s", upipe_ringsrc->uri);
+        close(upipe_ringsrc->fd);
+        upipe_ringsrc->fd = -1;
+    }
+    if (upipe_ringsrc->ring != NULL) {
+        umem_mgr_release(upipe_ringsrc_ring_to_umem_mgr(upipe_ringsrc->ring));
+        upipe_ringsrc->ring = NULL;
+    }
+    free(upipe_ringsrc->block_seqs);
+    upipe_ringsrc->block_seqs = NULL;
+    upipe_ringsrc->block = 0;
+    free(upipe_ringsrc->uri);
+    upipe_ringsrc->uri = NULL;
+}
+
+/** @internal @This opens a packet socket with a ring on the given interface.
+ *
+ * @param upipe description structure of the pipe
+ * @param ifname name of the interface
+ * @param nb_blocks number of blocks of the ring
+ * @param block_size size of a block
+ * @param timeout time after which a block is handed to the pipe, in ms
+ * @param fanout identifier of the fanout group, or -1
+ * @return an error code
+ */
+static int upipe_ringsrc_open(struct upipe *upipe, const char *ifname,
+                              unsigned int nb_blocks, size_t block_size,
+                              unsigned int timeout, int fanout)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (unlikely(!nb_blocks || block_size < RINGSRC_FRAME_SIZE ||
+                 (page_size > 0 && block_size % page_size) ||
+                 block_size > UINT32_MAX / nb_blocks)) {
+        upipe_err_va(upipe, "invalid ring of %u blocks of %zu octets",
+                     nb_blocks, block_size);
+        return UBASE_ERR_INVALID;
+    }
+
+    unsigned int ifindex = if_nametoindex(ifname);
+    if (unlikely(!ifindex)) {
+        upipe_err_va(upipe, "unknown interface %s", ifname);
+        return UBASE_ERR_INVALID;
+    }
+
+    int fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (unlikely(fd == -1)) {
+        upipe_err_va(upipe, "can't open packet socket (%m)");
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size;
+    req.tp_block_nr = nb_blocks;
+    req.tp_frame_size = RINGSRC_FRAME_SIZE;
+    req.tp_frame_nr = block_size * nb_blocks / RINGSRC_FRAME_SIZE;
+    req.tp_retire_blk_tov = timeout;
+    if (unlikely(setsockopt(fd, SOL_PACKET, PACKET_VERSION,
+                            &version, sizeof(version)) == -1 ||
+                 setsockopt(fd, SOL_PACKET, PACKET_RX_RING,
+                            &req, sizeof(req)) == -1)) {
+        upipe_err_va(upipe, "can't set up the ring of %s (%m)", ifname);
+        close(fd);
+        return UBASE_ERR_EXTERNAL;
+    }
+#ifdef PACKET_IGNORE_OUTGOING
+    int ignore = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING,
+               &ignore, sizeof(ignore));
+#endif
+
+    uint8_t *map = mmap(NULL, block_size * nb_blocks, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (unlikely(map == MAP_FAILED)) {
+        upipe_err_va(upipe, "can't map the ring of %s (%m)", ifname);
+        close(fd);
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    struct upipe_ringsrc_ring *ring =
+        upipe_ringsrc_ring_alloc(map, block_size, nb_blocks);
+    /* the kernel numbers the blocks from 1 */
+    uint64_t *block_seqs = calloc(nb_blocks, sizeof(uint64_t));
+    if (unlikely(ring == NULL || block_seqs == NULL)) {
+        if (ring != NULL)
+            umem_mgr_release(upipe_ringsrc_ring_to_umem_mgr(ring));
+        else
+            munmap(map, block_size * nb_blocks);
+        free(block_seqs);
+        close(fd);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_ringsrc->fd = fd;
+    upipe_ringsrc->ring = ring;
+    upipe_ringsrc->block_seqs = block_seqs;
+    upipe_ringsrc->block = 0;
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ifindex;
+    if (unlikely(bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == -1)) {
+        upipe_err_va(upipe, "can't bind packet socket to %s (%m)", ifname);
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    if (fanout >= 0) {
+#ifdef PACKET_FANOUT_QM
+        int fanout_arg = fanout | (PACKET_FANOUT_QM << 16);
+#else
+        int fanout_arg = fanout | (PACKET_FANOUT_HASH << 16);
+#endif
+        if (unlikely(setsockopt(fd, SOL_PACKET, PACKET_FANOUT,
+                                &fanout_arg, sizeof(fanout_arg)) == -1)) {
+            upipe_err_va(upipe, "can't join fanout group %d (%m)", fanout);
+            return UBASE_ERR_EXTERNAL;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the uri of the interface.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri_p filled in with the uri of the interface
+ * @return an error code
+ */
+static int upipe_ringsrc_get_uri(struct upipe *upipe, const char **uri_p)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    assert(uri_p != NULL);
+    *uri_p = upipe_ringsrc->uri;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This asks to receive the traffic of the given interface.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri name of the interface, followed by options
+ * @return an error code
+ */
+static int upipe_ringsrc_set_uri(struct upipe *upipe, const char *uri)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    upipe_ringsrc_close(upipe);
+
+    if (unlikely(uri == NULL))
+        return UBASE_ERR_NONE;
+
+    char ifname[strlen(uri) + 1];
+    strcpy(ifname, uri);
+    unsigned int nb_blocks = RINGSRC_DEFAULT_BLOCKS;
+    size_t block_size = RINGSRC_DEFAULT_BLOCK_SIZE;
+    unsigned int timeout = RINGSRC_DEFAULT_TIMEOUT;
+    int fanout = -1;
+
+    char *token = strchr(ifname, '/');
+    while (token != NULL) {
+        *token++ = '\0';
+        char *next = strchr(token, '/');
+#define IS_OPTION(option) (!strncasecmp(token, option, strlen(option)))
+#define ARG_OPTION(option) (token + strlen(option))
+        if (IS_OPTION("blocks="))
+            nb_blocks = strtoul(ARG_OPTION("blocks="), NULL, 0);
+        else if (IS_OPTION("block_size="))
+            block_size = strtoul(ARG_OPTION("block_size="), NULL, 0);
+        else if (IS_OPTION("timeout="))
+            timeout = strtoul(ARG_OPTION("timeout="), NULL, 0);
+        else if (IS_OPTION("fanout="))
+            fanout = strtol(ARG_OPTION("fanout="), NULL, 0) & 0xffff;
+        else
+            upipe_warn_va(upipe, "unrecognized option %s", token);
+#undef IS_OPTION
+#undef ARG_OPTION
+        token = next;
+    }
+
+    int err = upipe_ringsrc_open(upipe, ifname, nb_blocks, block_size,
+                                 timeout, fanout);
+    if (unlikely(!ubase_check(err))) {
+        upipe_ringsrc_close(upipe);
+        return err;
+    }
+
+    upipe_ringsrc->uri = strdup(uri);
+    if (unlikely(upipe_ringsrc->uri == NULL)) {
+        upipe_ringsrc_close(upipe);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_notice_va(upipe, "opening ring of %s (%u blocks of %zu octets)",
+                    ifname, nb_blocks, block_size);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a udp ring source pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_ringsrc_control(struct upipe *upipe,
+                                  int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_ringsrc_set_upump(upipe, NULL);
+            return upipe_ringsrc_attach_upump_mgr(upipe);
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_ringsrc_set_upump(upipe, NULL);
+            upipe_ringsrc_require_uclock(upipe);
+            return UBASE_ERR_NONE;
+
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_ringsrc_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ringsrc_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_GET_URI: {
+            const char **uri_p = va_arg(args, const char **);
+            return upipe_ringsrc_get_uri(upipe, uri_p);
+        }
+        case UPIPE_SET_URI: {
+            const char *uri = va_arg(args, const char *);
+            return upipe_ringsrc_set_uri(upipe, uri);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands on a udp ring source pipe,
+ * and checks the status of the pipe afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ringsrc_control(struct upipe *upipe,
+                                 int command, va_list args)
+{
+    UBASE_RETURN(_upipe_ringsrc_control(upipe, command, args));
+
+    return upipe_ringsrc_check(upipe, NULL);
+}
+
+/** @This frees a upipe.
+ *
+ * @param urefcount_real pointer to urefcount_real structure
+ */
+static void upipe_ringsrc_free(struct urefcount *urefcount_real)
+{
+    struct upipe_ringsrc *upipe_ringsrc =
+        upipe_ringsrc_from_urefcount_real(urefcount_real);
+    struct upipe *upipe = upipe_ringsrc_to_upipe(upipe_ringsrc);
+    upipe_ringsrc_close(upipe);
+    upipe_throw_dead(upipe);
+
+    upipe_ringsrc_clean_sub_outputs(upipe);
+    upipe_ringsrc_clean_upump(upipe);
+    upipe_ringsrc_clean_upump_mgr(upipe);
+    upipe_ringsrc_clean_uclock(upipe);
+    upipe_ringsrc_clean_ubuf_mgr(upipe);
+    /* the request was only thrown, so it is not unregistered */
+    if (urequest_get_opaque(&upipe_ringsrc->ubuf_mgr_request,
+                            struct upipe *) != NULL)
+        urequest_clean(&upipe_ringsrc->ubuf_mgr_request);
+    upipe_ringsrc_clean_uref_mgr(upipe);
+    urefcount_clean(urefcount_real);
+    upipe_ringsrc_clean_urefcount(upipe);
+    upipe_ringsrc_free_void(upipe);
+}
+
+/** @This is called when there is no external reference to the pipe anymore.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ringsrc_no_input(struct upipe *upipe)
+{
+    struct upipe_ringsrc *upipe_ringsrc = upipe_ringsrc_from_upipe(upipe);
+    upipe_ringsrc_set_upump(upipe, NULL);
+    upipe_ringsrc_throw_sub_outputs(upipe, UPROBE_SOURCE_END);
+    urefcount_release(upipe_ringsrc_to_urefcount_real(upipe_ringsrc));
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ringsrc_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_RINGSRC_SIGNATURE,
+
+    .upipe_alloc = upipe_ringsrc_alloc,
+    .upipe_input = NULL,
+    .upipe_control = upipe_ringsrc_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all udp ring sources.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ringsrc_mgr_alloc(void)
+{
+    return &upipe_ringsrc_mgr;
+}
@@ -28,6 +28,8 @@
  * @short Upipe sink module for udp
  */
 
+#define _GNU_SOURCE
+
 #include <upipe/ubase.h>
 #include <upipe/ulist.h>
 #include <upipe/uprobe.h>
@@ -35,6 +37,7 @@
 #include <upipe/uref.h>
 #include <upipe/uref_block.h>
 #include <upipe/uref_clock.h>
+#include <upipe/uref_priority.h>
 #include <upipe/upump.h>
 #include <upipe/ubuf.h>
 #include <upipe/upipe.h>
@@ -60,6 +63,21 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <time.h>
+
+#if defined(SO_TXTIME) && defined(UPIPE_HAVE_LINUX_NET_TSTAMP_H)
+#include <linux/net_tstamp.h>
+/** launch times are supported */
+#define UDPSINK_TXTIME
+#endif
+
+#if defined(UDP_SEGMENT) && defined(SOL_UDP)
+/** UDP segmentation offload is supported */
+#define UDPSINK_GSO
+#endif
 
 /** tolerance for late packets */
 #define SYSTIME_TOLERANCE UCLOCK_FREQ
@@ -70,13 +88,33 @@
 
 #define UDP_DEFAULT_TTL 0
 #define UDP_DEFAULT_PORT 1234
+/** maximum number of datagrams sent per system call */
+#define UDP_MAX_BATCH 1024
+/** maximum number of additional destinations */
+#define UDP_MAX_DESTINATIONS 1024
+/** maximum spin margin or launch time horizon */
+#define UDP_MAX_ADVANCE (UCLOCK_FREQ / 10)
+/** maximum busy-wait in spin mode, longer margins are waited with a timer */
+#define UDP_MAX_SPIN (UCLOCK_FREQ / 20000)
 
 /** @hidden */
 static void upipe_udpsink_watcher(struct upump *upump);
 /** @hidden */
+static void upipe_udpsink_batch_watcher(struct upump *upump);
+/** @hidden */
 static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
                                  struct upump **upump_p);
 
+/** @internal @This is an additional destination of a udp sink pipe. */
+struct upipe_udpsink_destination {
+    /** destination uri */
+    char *uri;
+    /** destination address */
+    struct sockaddr_storage addr;
+    /** size of the destination address */
+    socklen_t addr_len;
+};
+
 /** @internal @This is the private context of a udp sink pipe. */
 struct upipe_udpsink {
     /** refcount management structure */
@@ -86,6 +124,8 @@ struct upipe_udpsink {
     struct upump_mgr *upump_mgr;
     /** write watcher */
     struct upump *upump;
+    /** watcher used to send the queued datagrams */
+    struct upump *upump_batch;
 
     /** uclock structure, if not NULL we are in live mode */
     struct uclock *uclock;
@@ -106,7 +146,49 @@ struct upipe_udpsink {
     unsigned int max_urefs;
     /** list of blockers */
     struct uchain blockers;
+    /** maximum number of held datagrams before dropping, or 0 to block */
+    unsigned int overload_depth;
+    /** maximum lateness of held datagrams before dropping, or 0 */
+    uint64_t overload_deadline;
+
+    /** maximum number of datagrams per system call */
+    unsigned int batch;
+    /** maximum advance of a datagram on its date in batch mode */
+    uint64_t batch_tolerance;
+    /** datagrams waiting to be sent */
+    struct uref **batch_urefs;
+    /** number of datagrams waiting to be sent */
+    unsigned int nb_batch_urefs;
+    /** number of destinations the first waiting datagram was sent to */
+    unsigned int batch_sent;
+#ifdef UPIPE_HAVE_SENDMMSG
+    /** message headers for sendmmsg() */
+    struct mmsghdr *batch_msgs;
+#endif
+    /** additional destinations of the datagrams */
+    struct upipe_udpsink_destination *destinations;
+    /** number of additional destinations */
+    unsigned int nb_destinations;
 
+    /** pacing mode */
+    enum upipe_udpsink_pacing pacing;
+    /** spin margin or launch time horizon */
+    uint64_t pacing_advance;
+    /** clock of the launch times */
+    clockid_t txtime_clock;
+    /** date of the previous datagram, or UINT64_MAX */
+    uint64_t jitter_prev_date;
+    /** time at which the previous datagram was sent */
+    uint64_t jitter_prev_sent;
+    /** sum of the jitter measured */
+    uint64_t jitter_sum;
+    /** maximum jitter measured */
+    uint64_t jitter_max;
+    /** number of jitter measurements */
+    uint64_t jitter_nb;
+
+    /** true if the socket supports UDP segmentation offload */
+    bool gso;
     /** RAW sockets */
     bool raw;
     /** RAW header */
@@ -121,6 +203,7 @@ UPIPE_HELPER_UREFCOUNT(upipe_udpsink, urefcount, upipe_udpsink_free)
 UPIPE_HELPER_VOID(upipe_udpsink)
 UPIPE_HELPER_UPUMP_MGR(upipe_udpsink, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_udpsink, upump, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_udpsink, upump_batch, upump_mgr)
 UPIPE_HELPER_INPUT(upipe_udpsink, urefs, nb_urefs, max_urefs, blockers, upipe_udpsink_output)
 UPIPE_HELPER_UCLOCK(upipe_udpsink, uclock, uclock_request, NULL, upipe_throw_provide_request, NULL)
 
@@ -145,12 +228,34 @@ static struct upipe *upipe_udpsink_alloc(struct upipe_mgr *mgr,
     upipe_udpsink_init_urefcount(upipe);
     upipe_udpsink_init_upump_mgr(upipe);
     upipe_udpsink_init_upump(upipe);
+    upipe_udpsink_init_upump_batch(upipe);
     upipe_udpsink_init_input(upipe);
     upipe_udpsink_init_uclock(upipe);
     upipe_udpsink->latency = 0;
     upipe_udpsink->fd = -1;
     upipe_udpsink->uri = NULL;
     upipe_udpsink->raw = false;
+    upipe_udpsink->overload_depth = 0;
+    upipe_udpsink->overload_deadline = 0;
+    upipe_udpsink->gso = false;
+    upipe_udpsink->batch = 1;
+    upipe_udpsink->batch_tolerance = 0;
+    upipe_udpsink->batch_urefs = NULL;
+    upipe_udpsink->nb_batch_urefs = 0;
+    upipe_udpsink->batch_sent = 0;
+#ifdef UPIPE_HAVE_SENDMMSG
+    upipe_udpsink->batch_msgs = NULL;
+#endif
+    upipe_udpsink->destinations = NULL;
+    upipe_udpsink->nb_destinations = 0;
+    upipe_udpsink->pacing = UPIPE_UDPSINK_PACING_TIMER;
+    upipe_udpsink->pacing_advance = 0;
+    upipe_udpsink->txtime_clock = CLOCK_MONOTONIC;
+    upipe_udpsink->jitter_prev_date = UINT64_MAX;
+    upipe_udpsink->jitter_prev_sent = 0;
+    upipe_udpsink->jitter_sum = 0;
+    upipe_udpsink->jitter_max = 0;
+    upipe_udpsink->jitter_nb = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -179,6 +284,452 @@ static void upipe_udpsink_poll(struct upipe *upipe)
     }
 }
 
+/** @internal @This returns the date at which a datagram must be sent.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param date_p filled in with the date, in system time
+ * @return an error code
+ */
+static int upipe_udpsink_get_date(struct upipe *upipe, struct uref *uref,
+                                  uint64_t *date_p)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (upipe_udpsink->uclock == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_clock_get_cr_sys(uref, date_p))
+    *date_p += upipe_udpsink->latency;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This accounts for the inter-packet jitter of a datagram
+ * which was just sent.
+ *
+ * @param upipe description structure of the pipe
+ * @param date date of the datagram
+ * @param sent time at which the datagram was sent
+ */
+static void upipe_udpsink_account(struct upipe *upipe, uint64_t date,
+                                  uint64_t sent)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (upipe_udpsink->pacing == UPIPE_UDPSINK_PACING_TXTIME && sent < date)
+        /* the kernel waits for the launch time */
+        sent = date;
+
+    if (likely(upipe_udpsink->jitter_prev_date != UINT64_MAX)) {
+        int64_t error = (int64_t)(sent - upipe_udpsink->jitter_prev_sent) -
+                        (int64_t)(date - upipe_udpsink->jitter_prev_date);
+        uint64_t jitter = error < 0 ? -error : error;
+        upipe_udpsink->jitter_sum += jitter;
+        upipe_udpsink->jitter_nb++;
+        if (jitter > upipe_udpsink->jitter_max)
+            upipe_udpsink->jitter_max = jitter;
+    }
+    upipe_udpsink->jitter_prev_date = date;
+    upipe_udpsink->jitter_prev_sent = sent;
+}
+
+#ifdef UDPSINK_TXTIME
+/** @internal @This is a control buffer carrying a launch time. */
+union upipe_udpsink_txtime {
+    /** buffer */
+    uint8_t buffer[CMSG_SPACE(sizeof(uint64_t))];
+    /** alignment */
+    struct cmsghdr align;
+};
+
+/** @internal @This returns the offset between the clock of the launch times
+ * and the uclock, so that dates may be converted whatever the time base of
+ * the uclock.
+ *
+ * @param upipe description structure of the pipe
+ * @return offset to add to a date in system time, in 27 MHz ticks
+ */
+static uint64_t upipe_udpsink_txtime_offset(struct upipe *upipe)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    struct timespec ts;
+    uint64_t now = uclock_now(upipe_udpsink->uclock);
+    if (unlikely(clock_gettime(upipe_udpsink->txtime_clock, &ts) == -1))
+        return 0;
+    return ts.tv_sec * UCLOCK_FREQ +
+           ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000) - now;
+}
+
+/** @internal @This attaches the launch time of a datagram to a message.
+ *
+ * @param msg message header
+ * @param control control buffer
+ * @param date date of the datagram, in system time
+ * @param offset offset of the clock of the launch times on the system time
+ */
+static void upipe_udpsink_set_txtime(struct msghdr *msg,
+                                     union upipe_udpsink_txtime *control,
+                                     uint64_t date, uint64_t offset)
+{
+    date += offset;
+    uint64_t txtime = date / UCLOCK_FREQ * UINT64_C(1000000000) +
+                      date % UCLOCK_FREQ * UINT64_C(1000000000) / UCLOCK_FREQ;
+    msg->msg_control = control->buffer;
+    msg->msg_controllen = sizeof(control->buffer);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_TXTIME;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cmsg), &txtime, sizeof(uint64_t));
+}
+#endif
+
+#ifdef UDPSINK_GSO
+/** @internal @This is a control buffer carrying a segment size. */
+union upipe_udpsink_gso {
+    /** buffer */
+    uint8_t buffer[CMSG_SPACE(sizeof(uint16_t))];
+    /** alignment */
+    struct cmsghdr align;
+};
+
+/** @internal @This asks the kernel to split a message into datagrams.
+ *
+ * @param msg message header
+ * @param control control buffer
+ * @param segment_size size of the datagrams
+ */
+static void upipe_udpsink_set_gso(struct msghdr *msg,
+                                  union upipe_udpsink_gso *control,
+                                  uint16_t segment_size)
+{
+    msg->msg_control = control->buffer;
+    msg->msg_controllen = sizeof(control->buffer);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(uint16_t));
+}
+#endif
+
+/** @internal @This checks whether the socket supports UDP segmentation
+ * offload.
+ *
+ * @param upipe description structure of the pipe
+ * @return true if super-chunks may be sent in one message
+ */
+static bool upipe_udpsink_probe_gso(struct upipe *upipe)
+{
+#ifdef UDPSINK_GSO
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    int segment_size = 0;
+    if (upipe_udpsink->raw ||
+        setsockopt(upipe_udpsink->fd, SOL_UDP, UDP_SEGMENT,
+                   &segment_size, sizeof(segment_size)) == -1)
+        return false;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/** @internal @This enables launch times on the socket.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_udpsink_enable_txtime(struct upipe *upipe)
+{
+#ifdef UDPSINK_TXTIME
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    struct sock_txtime config;
+    memset(&config, 0, sizeof(config));
+    config.clockid = upipe_udpsink->txtime_clock;
+    if (unlikely(setsockopt(upipe_udpsink->fd, SOL_SOCKET, SO_TXTIME,
+                            &config, sizeof(config)) == -1)) {
+        upipe_warn_va(upipe, "can't enable launch times (%m)");
+        return UBASE_ERR_EXTERNAL;
+    }
+    return UBASE_ERR_NONE;
+#else
+    upipe_warn(upipe, "launch times are not supported on this platform");
+    return UBASE_ERR_UNHANDLED;
+#endif
+}
+
+/** @internal @This removes datagrams from the head of the batch queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb number of datagrams to remove
+ */
+static void upipe_udpsink_pop_batch(struct upipe *upipe, unsigned int nb)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    assert(nb <= upipe_udpsink->nb_batch_urefs);
+    if (nb == 0)
+        return;
+    for (unsigned int i = 0; i < nb; i++)
+        uref_free(upipe_udpsink->batch_urefs[i]);
+    upipe_udpsink->nb_batch_urefs -= nb;
+    upipe_udpsink->batch_sent = 0;
+    memmove(upipe_udpsink->batch_urefs, upipe_udpsink->batch_urefs + nb,
+            upipe_udpsink->nb_batch_urefs * sizeof(struct uref *));
+}
+
+/** @internal @This removes messages sent from the batch queue, each
+ * datagram being sent once to each destination.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_msgs number of messages sent
+ */
+static void upipe_udpsink_pop_batch_msgs(struct upipe *upipe,
+                                         unsigned int nb_msgs)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    unsigned int nb_dests = 1 + upipe_udpsink->nb_destinations;
+    nb_msgs += upipe_udpsink->batch_sent;
+    unsigned int nb = nb_msgs / nb_dests;
+    upipe_udpsink_pop_batch(upipe, nb);
+    if (upipe_udpsink->nb_batch_urefs)
+        upipe_udpsink->batch_sent = nb_msgs % nb_dests;
+}
+
+/** @internal @This sends the datagrams of the batch queue, with as few
+ * system calls as possible.
+ *
+ * @param upipe description structure of the pipe
+ * @return false if the socket would block
+ */
+static bool upipe_udpsink_flush_batch(struct upipe *upipe)
+{
+#ifdef UPIPE_HAVE_SENDMMSG
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    unsigned int nb_dests = 1 + upipe_udpsink->nb_destinations;
+    while (upipe_udpsink->nb_batch_urefs) {
+        unsigned int nb = upipe_udpsink->nb_batch_urefs;
+        unsigned int raw = upipe_udpsink->raw ? 1 : 0;
+        int iovec_counts[nb];
+        int iovec_total = 0;
+        for (unsigned int i = 0; i < nb; i++) {
+            iovec_counts[i] = uref_block_iovec_count(
+                    upipe_udpsink->batch_urefs[i], 0, -1);
+            iovec_total += iovec_counts[i] + raw;
+        }
+
+        struct iovec iovecs[iovec_total];
+        uint8_t raw_headers[raw ? nb : 1][RAW_HEADER_SIZE];
+        uint64_t dates[nb];
+        /* index of the message following the messages of each datagram */
+        unsigned int ends[nb];
+#ifdef UDPSINK_TXTIME
+        bool txtime = upipe_udpsink->pacing == UPIPE_UDPSINK_PACING_TXTIME &&
+                      upipe_udpsink->uclock != NULL;
+        union upipe_udpsink_txtime controls[txtime ? nb : 1];
+        uint64_t txtime_offset = txtime ?
+                                 upipe_udpsink_txtime_offset(upipe) : 0;
+#endif
+        struct mmsghdr *msgs = upipe_udpsink->batch_msgs;
+        struct iovec *iovec = iovecs;
+        unsigned int nb_msgs = 0;
+        unsigned int mapped;
+        for (mapped = 0; mapped < nb; mapped++) {
+            struct uref *uref = upipe_udpsink->batch_urefs[mapped];
+            unsigned int first_msg = nb_msgs;
+            struct msghdr *msg = &msgs[first_msg].msg_hdr;
+            memset(&msgs[first_msg], 0, sizeof(struct mmsghdr));
+            msg->msg_iov = iovec;
+            msg->msg_iovlen = iovec_counts[mapped] + raw;
+            if (!ubase_check(upipe_udpsink_get_date(upipe, uref,
+                                                    &dates[mapped])))
+                dates[mapped] = UINT64_MAX;
+#ifdef UDPSINK_TXTIME
+            if (txtime && dates[mapped] != UINT64_MAX)
+                upipe_udpsink_set_txtime(msg, &controls[mapped],
+                                         dates[mapped], txtime_offset);
+#endif
+
+            if (raw) {
+                size_t payload_len = 0;
+                uref_block_size(uref, &payload_len);
+                memcpy(raw_headers[mapped], upipe_udpsink->raw_header,
+                       RAW_HEADER_SIZE);
+                udp_raw_set_len(raw_headers[mapped], payload_len);
+                iovec->iov_base = raw_headers[mapped];
+                iovec->iov_len = RAW_HEADER_SIZE;
+                iovec++;
+            }
+
+            if (unlikely(!ubase_check(uref_block_iovec_read(uref, 0, -1,
+                                                            iovec))))
+                break;
+            iovec += iovec_counts[mapped];
+
+            /* the same buffers are sent to the additional destinations */
+            unsigned int dest = mapped ? 0 : upipe_udpsink->batch_sent;
+            for ( ; dest < nb_dests; dest++) {
+                if (nb_msgs != first_msg)
+                    msgs[nb_msgs] = msgs[first_msg];
+                if (dest) {
+                    struct upipe_udpsink_destination *destination =
+                        &upipe_udpsink->destinations[dest - 1];
+                    msgs[nb_msgs].msg_hdr.msg_name = &destination->addr;
+                    msgs[nb_msgs].msg_hdr.msg_namelen = destination->addr_len;
+                }
+                nb_msgs++;
+            }
+            ends[mapped] = nb_msgs;
+        }
+
+        int ret = 0;
+        if (likely(mapped)) {
+            ret = sendmmsg(upipe_udpsink->fd, msgs, nb_msgs, 0);
+            for (unsigned int i = 0; i < mapped; i++)
+                uref_block_iovec_unmap(upipe_udpsink->batch_urefs[i], 0, -1,
+                                       msgs[ends[i] - 1].msg_hdr.msg_iov + raw);
+        }
+
+        if (unlikely(mapped == 0)) {
+            upipe_warn(upipe, "cannot read ubuf buffer");
+            ret = nb_dests - upipe_udpsink->batch_sent;
+        } else if (unlikely(ret == -1)) {
+            switch (errno) {
+                case EINTR:
+                    continue;
+                case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+                case EWOULDBLOCK:
+#endif
+                    return false;
+                case EBADF:
+                case EFBIG:
+                case EINVAL:
+                case EIO:
+                case ENOSPC:
+                case EPIPE:
+                default:
+                    break;
+            }
+            /* Errors at this point come from ICMP messages such as
+             * "port unreachable", and we do not want to kill the application
+             * with transient errors. Skip the offending message. */
+            ret = 1;
+        } else if (upipe_udpsink->uclock != NULL) {
+            uint64_t now = uclock_now(upipe_udpsink->uclock);
+            for (unsigned int i = 0; i < mapped && ends[i] <= (unsigned int)ret;
+                 i++)
+                if (dates[i] != UINT64_MAX)
+                    upipe_udpsink_account(upipe, dates[i], now);
+        }
+        upipe_udpsink_pop_batch_msgs(upipe, ret);
+    }
+#endif
+    return true;
+}
+
+/** @internal @This sends the datagrams of the batch queue if possible, and
+ * drops the remaining ones.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsink_drop_batch(struct upipe *upipe)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink_set_upump_batch(upipe, NULL);
+    if (upipe_udpsink->fd != -1)
+        upipe_udpsink_flush_batch(upipe);
+    if (upipe_udpsink->nb_batch_urefs)
+        upipe_warn_va(upipe, "dropping %u queued datagrams",
+                      upipe_udpsink->nb_batch_urefs);
+    upipe_udpsink_pop_batch(upipe, upipe_udpsink->nb_batch_urefs);
+}
+
+/** @internal @This schedules the sending of the batch queue, either on the
+ * next iteration of the event loop, or when the socket is writable again.
+ *
+ * @param upipe description structure of the pipe
+ * @param blocked true if the socket would block
+ */
+static void upipe_udpsink_schedule_batch(struct upipe *upipe, bool blocked)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (upipe_udpsink->upump_batch != NULL && !blocked)
+        return;
+
+    upipe_udpsink_check_upump_mgr(upipe);
+    if (unlikely(upipe_udpsink->upump_mgr == NULL)) {
+        if (!upipe_udpsink_flush_batch(upipe))
+            upipe_udpsink_pop_batch(upipe, upipe_udpsink->nb_batch_urefs);
+        return;
+    }
+
+    struct upump *watcher;
+    if (blocked)
+        watcher = upump_alloc_fd_write(upipe_udpsink->upump_mgr,
+                                       upipe_udpsink_batch_watcher, upipe,
+                                       upipe_udpsink->fd);
+    else
+        watcher = upump_alloc_timer(upipe_udpsink->upump_mgr,
+                                    upipe_udpsink_batch_watcher, upipe, 0, 0);
+    if (unlikely(watcher == NULL)) {
+        upipe_err_va(upipe, "can't create watcher");
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return;
+    }
+    upipe_udpsink_set_upump_batch(upipe, watcher);
+    upump_start(watcher);
+}
+
+/** @internal @This is called to send the batch queue.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_udpsink_batch_watcher(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    upipe_udpsink_set_upump_batch(upipe, NULL);
+    if (!upipe_udpsink_flush_batch(upipe))
+        upipe_udpsink_schedule_batch(upipe, true);
+}
+
+/** @internal @This queues a datagram in batch mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @return true if the uref was processed
+ */
+static bool upipe_udpsink_queue_batch(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    int iovec_count = uref_block_iovec_count(uref, 0, -1);
+    if (unlikely(iovec_count == -1)) {
+        uref_free(uref);
+        upipe_warn(upipe, "cannot read ubuf buffer");
+        return true;
+    }
+    if (unlikely(iovec_count == 0)) {
+        uref_free(uref);
+        return true;
+    }
+
+    /* in spin mode, datagrams are only queued to reach all destinations */
+    unsigned int batch =
+        upipe_udpsink->pacing == UPIPE_UDPSINK_PACING_SPIN ? 1 :
+        upipe_udpsink->batch;
+    if (upipe_udpsink->nb_batch_urefs >= batch &&
+        !upipe_udpsink_flush_batch(upipe)) {
+        upipe_udpsink_poll(upipe);
+        return false;
+    }
+
+    upipe_udpsink->batch_urefs[upipe_udpsink->nb_batch_urefs++] = uref;
+    if (upipe_udpsink->nb_batch_urefs >= batch) {
+        if (upipe_udpsink_flush_batch(upipe))
+            upipe_udpsink_set_upump_batch(upipe, NULL);
+        else
+            upipe_udpsink_schedule_batch(upipe, true);
+    } else
+        upipe_udpsink_schedule_batch(upipe, false);
+    return true;
+}
+
 /** @internal @This outputs data to the udp sink.
  *
  * @param upipe description structure of the pipe
@@ -190,6 +741,7 @@ static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
                                  struct upump **upump_p)
 {
     struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    uint64_t systime = UINT64_MAX;
     const char *def;
     if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
         uint64_t latency = 0;
@@ -209,20 +761,43 @@ static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
     if (likely(upipe_udpsink->uclock == NULL))
         goto write_buffer;
 
-    uint64_t systime = 0;
-    if (unlikely(!ubase_check(uref_clock_get_cr_sys(uref, &systime)))) {
+    if (unlikely(!ubase_check(upipe_udpsink_get_date(upipe, uref,
+                                                     &systime)))) {
         upipe_warn(upipe, "received non-dated buffer");
+        systime = UINT64_MAX;
         goto write_buffer;
     }
 
     uint64_t now = uclock_now(upipe_udpsink->uclock);
-    systime += upipe_udpsink->latency;
-    if (unlikely(now < systime)) {
+    uint64_t tolerance;
+    switch (upipe_udpsink->pacing) {
+        case UPIPE_UDPSINK_PACING_SPIN:
+            /* after waking up the margin before the date, wait again with
+             * the timer for what exceeds the busy-wait */
+            tolerance = upipe_udpsink->pacing_advance;
+            if (now + tolerance >= systime && tolerance > UDP_MAX_SPIN)
+                tolerance = UDP_MAX_SPIN;
+            break;
+        case UPIPE_UDPSINK_PACING_TXTIME:
+            tolerance = upipe_udpsink->pacing_advance;
+            break;
+        default:
+            tolerance = upipe_udpsink->batch > 1 ?
+                        upipe_udpsink->batch_tolerance : 0;
+            break;
+    }
+    if (unlikely(now + tolerance < systime)) {
         upipe_udpsink_check_upump_mgr(upipe);
         if (likely(upipe_udpsink->upump_mgr != NULL)) {
+            /* send the current burst before sleeping */
+            if (unlikely(!upipe_udpsink_flush_batch(upipe))) {
+                upipe_udpsink_poll(upipe);
+                return false;
+            }
+            upipe_udpsink_set_upump_batch(upipe, NULL);
             upipe_verbose_va(upipe, "sleeping %"PRIu64" (%"PRIu64")",
-                             systime - now, systime);
-            upipe_udpsink_wait_upump(upipe, systime - now,
+                             systime - tolerance - now, systime);
+            upipe_udpsink_wait_upump(upipe, systime - tolerance - now,
                                      upipe_udpsink_watcher);
             return false;
         }
@@ -239,7 +814,19 @@ static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
                       (now - systime) / (UCLOCK_FREQ / 1000),
                       upipe_udpsink->latency / (UCLOCK_FREQ / 1000));
 
+    if (upipe_udpsink->pacing == UPIPE_UDPSINK_PACING_SPIN &&
+        now + UDP_MAX_SPIN >= systime) {
+        /* busy-wait for the remaining margin */
+        while (uclock_now(upipe_udpsink->uclock) < systime)
+            ;
+    }
+
 write_buffer:
+    if (upipe_udpsink->nb_destinations ||
+        (upipe_udpsink->batch > 1 &&
+         upipe_udpsink->pacing != UPIPE_UDPSINK_PACING_SPIN))
+        return upipe_udpsink_queue_batch(upipe, uref);
+
     for ( ; ; ) {
         size_t payload_len = 0;
         if (unlikely(!ubase_check(uref_block_size(uref, &payload_len)))) {
@@ -278,7 +865,35 @@ write_buffer:
             break;
         }
 
-        ssize_t ret = writev(upipe_udpsink->fd, iovecs_s, iovec_count);
+        ssize_t ret;
+#ifdef UDPSINK_GSO
+        uint64_t segment_size;
+        if (upipe_udpsink->gso &&
+            ubase_check(uref_block_get_segment_size(uref, &segment_size)) &&
+            segment_size < payload_len) {
+            union upipe_udpsink_gso control;
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iovecs_s;
+            msg.msg_iovlen = iovec_count;
+            upipe_udpsink_set_gso(&msg, &control, segment_size);
+            ret = sendmsg(upipe_udpsink->fd, &msg, 0);
+        } else
+#endif
+#ifdef UDPSINK_TXTIME
+        if (upipe_udpsink->pacing == UPIPE_UDPSINK_PACING_TXTIME &&
+            systime != UINT64_MAX) {
+            union upipe_udpsink_txtime control;
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iovecs_s;
+            msg.msg_iovlen = iovec_count;
+            upipe_udpsink_set_txtime(&msg, &control, systime,
+                                     upipe_udpsink_txtime_offset(upipe));
+            ret = sendmsg(upipe_udpsink->fd, &msg, 0);
+        } else
+#endif
+            ret = writev(upipe_udpsink->fd, iovecs_s, iovec_count);
         uref_block_iovec_unmap(uref, 0, -1, iovecs);
 
         if (unlikely(ret == -1)) {
@@ -303,7 +918,9 @@ write_buffer:
             /* Errors at this point come from ICMP messages such as
              * "port unreachable", and we do not want to kill the application
              * with transient errors. */
-        }
+        } else if (systime != UINT64_MAX)
+            upipe_udpsink_account(upipe, systime,
+                                  uclock_now(upipe_udpsink->uclock));
 
         uref_free(uref);
         break;
@@ -329,27 +946,144 @@ static void upipe_udpsink_watcher(struct upump *upump)
     }
 }
 
-/** @internal @This receives data.
+/** @internal @This checks whether the held datagrams exceed the overload
+ * policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param now current date, or UINT64_MAX if the deadline is not checked
+ * @return true if datagrams must be dropped
+ */
+static bool upipe_udpsink_overloaded(struct upipe *upipe, uint64_t now)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (upipe_udpsink->nb_urefs > upipe_udpsink->overload_depth)
+        return true;
+    if (now == UINT64_MAX)
+        return false;
+
+    struct uchain *uchain = ulist_peek(&upipe_udpsink->urefs);
+    uint64_t date;
+    return uchain != NULL &&
+           ubase_check(upipe_udpsink_get_date(upipe, uref_from_uchain(uchain),
+                                              &date)) &&
+           now > date + upipe_udpsink->overload_deadline;
+}
+
+/** @internal @This drops the held datagrams of lowest priority while the
+ * overload policy is exceeded. The datagram at the head of the list is
+ * kept, as the watcher is waiting to output it.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsink_check_overload(struct upipe *upipe)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    uint64_t now = UINT64_MAX;
+    if (upipe_udpsink->overload_deadline && upipe_udpsink->uclock != NULL)
+        now = uclock_now(upipe_udpsink->uclock);
+
+    while (upipe_udpsink->nb_urefs > 1 &&
+           upipe_udpsink_overloaded(upipe, now)) {
+        struct uchain *head = ulist_pop(&upipe_udpsink->urefs);
+        struct uref *uref = uref_priority_find_lowest(&upipe_udpsink->urefs);
+        ulist_unshift(&upipe_udpsink->urefs, head);
+        if (uref == NULL)
+            break;
+        ulist_delete(uref_to_uchain(uref));
+        upipe_udpsink->nb_urefs--;
+        upipe_verbose_va(upipe, "dropping %s datagram on overload",
+                         uref_priority_name(uref->priv));
+        upipe_throw_overload_drop(upipe, uref, uref->priv);
+        uref_free(uref);
+    }
+}
+
+/** @internal @This holds a datagram that can't be output immediately, and
+ * either blocks the source pump or applies the overload policy.
  *
  * @param upipe description structure of the pipe
  * @param uref uref structure
  * @param upump_p reference to pump that generated the buffer
  */
-static void upipe_udpsink_input(struct upipe *upipe, struct uref *uref,
-                                struct upump **upump_p)
+static void upipe_udpsink_hold(struct upipe *upipe, struct uref *uref,
+                               struct upump **upump_p)
 {
-    if (!upipe_udpsink_check_input(upipe)) {
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (!upipe_udpsink->overload_depth) {
         upipe_udpsink_hold_input(upipe, uref);
         upipe_udpsink_block_input(upipe, upump_p);
+        return;
+    }
+
+    uref->priv = uref_priority_classify(uref, NULL);
+    upipe_udpsink_hold_input(upipe, uref);
+    upipe_udpsink_check_overload(upipe);
+}
+
+/** @internal @This receives data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_udpsink_input_datagram(struct upipe *upipe,
+                                         struct uref *uref,
+                                         struct upump **upump_p)
+{
+    if (!upipe_udpsink_check_input(upipe)) {
+        upipe_udpsink_hold(upipe, uref, upump_p);
     } else if (!upipe_udpsink_output(upipe, uref, upump_p)) {
-        upipe_udpsink_hold_input(upipe, uref);
-        upipe_udpsink_block_input(upipe, upump_p);
+        upipe_udpsink_hold(upipe, uref, upump_p);
         /* Increment upipe refcount to avoid disappearing before all packets
          * have been sent. */
         upipe_use(upipe);
     }
 }
 
+/** @internal @This receives data. Super-chunks are split into datagrams,
+ * unless they can be sent in one message with segmentation offload.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_udpsink_input(struct upipe *upipe, struct uref *uref,
+                                struct upump **upump_p)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    uint64_t segment_size;
+    size_t size;
+    if (likely(!ubase_check(uref_block_get_segment_size(uref,
+                                                        &segment_size))) ||
+        !ubase_check(uref_block_size(uref, &size)) ||
+        segment_size == 0 || segment_size >= size) {
+        upipe_udpsink_input_datagram(upipe, uref, upump_p);
+        return;
+    }
+
+    if (upipe_udpsink->gso && !upipe_udpsink->nb_destinations &&
+        upipe_udpsink->batch <= 1 &&
+        upipe_udpsink->pacing != UPIPE_UDPSINK_PACING_TXTIME &&
+        segment_size <= UINT16_MAX) {
+        upipe_udpsink_input_datagram(upipe, uref, upump_p);
+        return;
+    }
+
+    uref_block_delete_segment_size(uref);
+    for (size_t offset = 0; offset < size; offset += segment_size) {
+        size_t datagram_size = size - offset < segment_size ?
+                               size - offset : segment_size;
+        struct uref *datagram = uref_block_splice(uref, offset,
+                                                  datagram_size);
+        if (unlikely(datagram == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            break;
+        }
+        upipe_udpsink_input_datagram(upipe, datagram, upump_p);
+    }
+    uref_free(uref);
+}
+
 /** @internal @This sets the input flow definition.
  *
  * @param upipe description structure of the pipe
@@ -395,6 +1129,7 @@ static int _upipe_udpsink_set_uri(struct upipe *upipe, const char *uri,
     struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
     bool use_tcp = false;
 
+    upipe_udpsink_drop_batch(upipe);
     if (unlikely(upipe_udpsink->fd != -1)) {
         if (likely(upipe_udpsink->uri != NULL))
             upipe_notice_va(upipe, "closing socket %s", upipe_udpsink->uri);
@@ -430,6 +1165,15 @@ static int _upipe_udpsink_set_uri(struct upipe *upipe, const char *uri,
         return UBASE_ERR_EXTERNAL;
     }
 
+    if (unlikely(upipe_udpsink->raw && upipe_udpsink->nb_destinations)) {
+        upipe_err(upipe, "multiple destinations are not supported with RAW "
+                  "sockets");
+        close(upipe_udpsink->fd);
+        upipe_udpsink->fd = -1;
+        upipe_udpsink->raw = false;
+        return UBASE_ERR_INVALID;
+    }
+
     upipe_udpsink->uri = strdup(uri);
     if (unlikely(upipe_udpsink->uri == NULL)) {
         close(upipe_udpsink->fd);
@@ -437,6 +1181,10 @@ static int _upipe_udpsink_set_uri(struct upipe *upipe, const char *uri,
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return UBASE_ERR_ALLOC;
     }
+    upipe_udpsink->gso = upipe_udpsink_probe_gso(upipe);
+    if (upipe_udpsink->pacing == UPIPE_UDPSINK_PACING_TXTIME &&
+        !ubase_check(upipe_udpsink_enable_txtime(upipe)))
+        upipe_udpsink->pacing = UPIPE_UDPSINK_PACING_TIMER;
     if (!upipe_udpsink_check_input(upipe))
         /* Use again the pipe that we previously released. */
         upipe_use(upipe);
@@ -453,6 +1201,9 @@ static int _upipe_udpsink_set_uri(struct upipe *upipe, const char *uri,
  */
 static int upipe_udpsink_flush(struct upipe *upipe)
 {
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink_set_upump_batch(upipe, NULL);
+    upipe_udpsink_pop_batch(upipe, upipe_udpsink->nb_batch_urefs);
     if (upipe_udpsink_flush_input(upipe)) {
         upipe_udpsink_set_upump(upipe, NULL);
         /* All packets have been output, release again the pipe that has been
@@ -462,6 +1213,305 @@ static int upipe_udpsink_flush(struct upipe *upipe)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the batching parameters.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch_p filled in with the maximum number of datagrams per system
+ * call
+ * @param tolerance_p filled in with the maximum advance of a datagram on its
+ * date
+ * @return an error code
+ */
+static int _upipe_udpsink_get_batch(struct upipe *upipe,
+                                    unsigned int *batch_p,
+                                    uint64_t *tolerance_p)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (batch_p != NULL)
+        *batch_p = upipe_udpsink->batch;
+    if (tolerance_p != NULL)
+        *tolerance_p = upipe_udpsink->batch_tolerance;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This allocates the batch queue. It must be empty.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch maximum number of datagrams per system call
+ * @param nb_destinations number of additional destinations
+ * @return an error code
+ */
+static int upipe_udpsink_alloc_batch(struct upipe *upipe, unsigned int batch,
+                                     unsigned int nb_destinations)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    assert(!upipe_udpsink->nb_batch_urefs);
+    free(upipe_udpsink->batch_urefs);
+    upipe_udpsink->batch_urefs = NULL;
+#ifdef UPIPE_HAVE_SENDMMSG
+    free(upipe_udpsink->batch_msgs);
+    upipe_udpsink->batch_msgs = NULL;
+#endif
+    upipe_udpsink->batch = 1;
+    if (batch == 1 && !nb_destinations)
+        return UBASE_ERR_NONE;
+
+#ifdef UPIPE_HAVE_SENDMMSG
+    upipe_udpsink->batch_urefs = malloc(batch * sizeof(struct uref *));
+    upipe_udpsink->batch_msgs = malloc(batch * (1 + nb_destinations) *
+                                       sizeof(struct mmsghdr));
+    if (unlikely(upipe_udpsink->batch_urefs == NULL ||
+                 upipe_udpsink->batch_msgs == NULL)) {
+        free(upipe_udpsink->batch_urefs);
+        free(upipe_udpsink->batch_msgs);
+        upipe_udpsink->batch_urefs = NULL;
+        upipe_udpsink->batch_msgs = NULL;
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_udpsink->batch = batch;
+#endif
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the batching parameters.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch maximum number of datagrams per system call
+ * @param tolerance maximum advance of a datagram on its date
+ * @return an error code
+ */
+static int _upipe_udpsink_set_batch(struct upipe *upipe, unsigned int batch,
+                                    uint64_t tolerance)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (unlikely(batch == 0 || batch > UDP_MAX_BATCH))
+        return UBASE_ERR_INVALID;
+#ifndef UPIPE_HAVE_SENDMMSG
+    if (batch > 1) {
+        upipe_warn(upipe, "batched writes are not supported on this platform");
+        return UBASE_ERR_UNHANDLED;
+    }
+#endif
+
+    upipe_udpsink->batch_tolerance = tolerance;
+    if (batch == upipe_udpsink->batch)
+        return UBASE_ERR_NONE;
+
+    upipe_udpsink_drop_batch(upipe);
+    return upipe_udpsink_alloc_batch(upipe, batch,
+                                     upipe_udpsink->nb_destinations);
+}
+
+/** @internal @This adds a destination to which all datagrams are also
+ * sent.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination uri, of the form host:port
+ * @return an error code
+ */
+static int _upipe_udpsink_add_destination(struct upipe *upipe,
+                                          const char *uri)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (unlikely(uri == NULL))
+        return UBASE_ERR_INVALID;
+#ifndef UPIPE_HAVE_SENDMMSG
+    upipe_warn(upipe, "multiple destinations are not supported on this "
+               "platform");
+    return UBASE_ERR_UNHANDLED;
+#else
+    if (unlikely(upipe_udpsink->raw)) {
+        upipe_warn(upipe, "multiple destinations are not supported with RAW "
+                   "sockets");
+        return UBASE_ERR_INVALID;
+    }
+    if (unlikely(upipe_udpsink->nb_destinations >= UDP_MAX_DESTINATIONS))
+        return UBASE_ERR_INVALID;
+
+    struct upipe_udpsink_destination destination;
+    if (unlikely(!upipe_udp_parse_destination(upipe, uri, UDP_DEFAULT_PORT,
+                                              &destination.addr,
+                                              &destination.addr_len)))
+        return UBASE_ERR_INVALID;
+    destination.uri = strdup(uri);
+    UBASE_ALLOC_RETURN(destination.uri)
+
+    struct upipe_udpsink_destination *destinations =
+        realloc(upipe_udpsink->destinations,
+                (upipe_udpsink->nb_destinations + 1) *
+                sizeof(struct upipe_udpsink_destination));
+    if (unlikely(destinations == NULL)) {
+        free(destination.uri);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_udpsink->destinations = destinations;
+
+    upipe_udpsink_drop_batch(upipe);
+    int err = upipe_udpsink_alloc_batch(upipe, upipe_udpsink->batch,
+                                        upipe_udpsink->nb_destinations + 1);
+    if (unlikely(!ubase_check(err))) {
+        free(destination.uri);
+        return err;
+    }
+    destinations[upipe_udpsink->nb_destinations++] = destination;
+    upipe_notice_va(upipe, "adding destination %s", uri);
+    return UBASE_ERR_NONE;
+#endif
+}
+
+/** @internal @This removes a destination previously added.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination uri, as given when it was added
+ * @return an error code
+ */
+static int _upipe_udpsink_del_destination(struct upipe *upipe,
+                                          const char *uri)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (unlikely(uri == NULL))
+        return UBASE_ERR_INVALID;
+    for (unsigned int i = 0; i < upipe_udpsink->nb_destinations; i++) {
+        struct upipe_udpsink_destination *destination =
+            &upipe_udpsink->destinations[i];
+        if (strcmp(destination->uri, uri))
+            continue;
+
+        upipe_udpsink_drop_batch(upipe);
+        upipe_notice_va(upipe, "removing destination %s", uri);
+        free(destination->uri);
+        upipe_udpsink->nb_destinations--;
+        memmove(destination, destination + 1,
+                (upipe_udpsink->nb_destinations - i) *
+                sizeof(struct upipe_udpsink_destination));
+        return upipe_udpsink_alloc_batch(upipe, upipe_udpsink->batch,
+                                         upipe_udpsink->nb_destinations);
+    }
+    return UBASE_ERR_INVALID;
+}
+
+/** @internal @This sets the pacing mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param pacing pacing mode
+ * @param advance spin margin or launch time horizon
+ * @return an error code
+ */
+static int _upipe_udpsink_set_pacing(struct upipe *upipe,
+                                     enum upipe_udpsink_pacing pacing,
+                                     uint64_t advance)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (unlikely(advance > UDP_MAX_ADVANCE))
+        return UBASE_ERR_INVALID;
+    switch (pacing) {
+        case UPIPE_UDPSINK_PACING_TIMER:
+        case UPIPE_UDPSINK_PACING_SPIN:
+            break;
+        case UPIPE_UDPSINK_PACING_TXTIME:
+            if (upipe_udpsink->fd != -1)
+                UBASE_RETURN(upipe_udpsink_enable_txtime(upipe))
+            break;
+        default:
+            return UBASE_ERR_INVALID;
+    }
+    upipe_udpsink->pacing = pacing;
+    upipe_udpsink->pacing_advance = advance;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the clock of the launch times.
+ *
+ * @param upipe description structure of the pipe
+ * @param clock clock of the launch times
+ * @return an error code
+ */
+static int _upipe_udpsink_set_txtime_clock(struct upipe *upipe,
+                                           clockid_t clock)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    struct timespec ts;
+    if (unlikely(clock_gettime(clock, &ts) == -1))
+        return UBASE_ERR_INVALID;
+    clockid_t old = upipe_udpsink->txtime_clock;
+    upipe_udpsink->txtime_clock = clock;
+    if (upipe_udpsink->pacing != UPIPE_UDPSINK_PACING_TXTIME ||
+        upipe_udpsink->fd == -1)
+        return UBASE_ERR_NONE;
+
+    int err = upipe_udpsink_enable_txtime(upipe);
+    if (unlikely(!ubase_check(err))) {
+        upipe_udpsink->txtime_clock = old;
+        upipe_udpsink_enable_txtime(upipe);
+    }
+    return err;
+}
+
+/** @internal @This returns the overload policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth_p filled in with the maximum number of held datagrams
+ * @param deadline_p filled in with the maximum lateness of held datagrams
+ * @return an error code
+ */
+static int _upipe_udpsink_get_overload(struct upipe *upipe,
+                                       unsigned int *depth_p,
+                                       uint64_t *deadline_p)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (depth_p != NULL)
+        *depth_p = upipe_udpsink->overload_depth;
+    if (deadline_p != NULL)
+        *deadline_p = upipe_udpsink->overload_deadline;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the overload policy.
+ *
+ * @param upipe description structure of the pipe
+ * @param depth maximum number of held datagrams, or 0 to block the sources
+ * @param deadline maximum lateness of held datagrams, or 0
+ * @return an error code
+ */
+static int _upipe_udpsink_set_overload(struct upipe *upipe,
+                                       unsigned int depth, uint64_t deadline)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink->overload_depth = depth;
+    upipe_udpsink->overload_deadline = deadline;
+    if (!depth)
+        return UBASE_ERR_NONE;
+
+    /* the datagrams held until now were not classified */
+    struct uchain *uchain;
+    ulist_foreach (&upipe_udpsink->urefs, uchain)
+        uref_from_uchain(uchain)->priv = UREF_PRIORITY_CRITICAL;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns and resets the inter-packet jitter.
+ *
+ * @param upipe description structure of the pipe
+ * @param mean_p filled in with the mean jitter
+ * @param max_p filled in with the maximum jitter
+ * @return an error code
+ */
+static int _upipe_udpsink_get_jitter(struct upipe *upipe, uint64_t *mean_p,
+                                     uint64_t *max_p)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (mean_p != NULL)
+        *mean_p = upipe_udpsink->jitter_nb ?
+            upipe_udpsink->jitter_sum / upipe_udpsink->jitter_nb : 0;
+    if (max_p != NULL)
+        *max_p = upipe_udpsink->jitter_max;
+    upipe_udpsink->jitter_sum = 0;
+    upipe_udpsink->jitter_max = 0;
+    upipe_udpsink->jitter_nb = 0;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a udp sink pipe.
  *
  * @param upipe description structure of the pipe
@@ -520,6 +1570,77 @@ static int _upipe_udpsink_control(struct upipe *upipe,
             enum upipe_udpsink_mode mode = va_arg(args, enum upipe_udpsink_mode);
             return _upipe_udpsink_set_uri(upipe, uri, mode);
         }
+        case UPIPE_UDPSINK_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            unsigned int *batch_p = va_arg(args, unsigned int *);
+            uint64_t *tolerance_p = va_arg(args, uint64_t *);
+            return _upipe_udpsink_get_batch(upipe, batch_p, tolerance_p);
+        }
+        case UPIPE_UDPSINK_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            unsigned int batch = va_arg(args, unsigned int);
+            uint64_t tolerance = va_arg(args, uint64_t);
+            return _upipe_udpsink_set_batch(upipe, batch, tolerance);
+        }
+        case UPIPE_UDPSINK_GET_PACING: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            struct upipe_udpsink *upipe_udpsink =
+                upipe_udpsink_from_upipe(upipe);
+            enum upipe_udpsink_pacing *pacing_p =
+                va_arg(args, enum upipe_udpsink_pacing *);
+            uint64_t *advance_p = va_arg(args, uint64_t *);
+            if (pacing_p != NULL)
+                *pacing_p = upipe_udpsink->pacing;
+            if (advance_p != NULL)
+                *advance_p = upipe_udpsink->pacing_advance;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSINK_SET_PACING: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            enum upipe_udpsink_pacing pacing =
+                va_arg(args, enum upipe_udpsink_pacing);
+            uint64_t advance = va_arg(args, uint64_t);
+            return _upipe_udpsink_set_pacing(upipe, pacing, advance);
+        }
+        case UPIPE_UDPSINK_GET_TXTIME_CLOCK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            clockid_t *clock_p = va_arg(args, clockid_t *);
+            *clock_p = upipe_udpsink_from_upipe(upipe)->txtime_clock;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSINK_SET_TXTIME_CLOCK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            clockid_t clock = va_arg(args, clockid_t);
+            return _upipe_udpsink_set_txtime_clock(upipe, clock);
+        }
+        case UPIPE_UDPSINK_GET_JITTER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            uint64_t *mean_p = va_arg(args, uint64_t *);
+            uint64_t *max_p = va_arg(args, uint64_t *);
+            return _upipe_udpsink_get_jitter(upipe, mean_p, max_p);
+        }
+        case UPIPE_UDPSINK_ADD_DESTINATION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            const char *uri = va_arg(args, const char *);
+            return _upipe_udpsink_add_destination(upipe, uri);
+        }
+        case UPIPE_UDPSINK_DEL_DESTINATION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            const char *uri = va_arg(args, const char *);
+            return _upipe_udpsink_del_destination(upipe, uri);
+        }
+        case UPIPE_UDPSINK_GET_OVERLOAD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            unsigned int *depth_p = va_arg(args, unsigned int *);
+            uint64_t *deadline_p = va_arg(args, uint64_t *);
+            return _upipe_udpsink_get_overload(upipe, depth_p, deadline_p);
+        }
+        case UPIPE_UDPSINK_SET_OVERLOAD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            unsigned int depth = va_arg(args, unsigned int);
+            uint64_t deadline = va_arg(args, uint64_t);
+            return _upipe_udpsink_set_overload(upipe, depth, deadline);
+        }
         case UPIPE_FLUSH:
             return upipe_udpsink_flush(upipe);
         default:
@@ -552,6 +1673,7 @@ static int upipe_udpsink_control(struct upipe *upipe, int command, va_list args)
 static void upipe_udpsink_free(struct upipe *upipe)
 {
     struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink_drop_batch(upipe);
     if (likely(upipe_udpsink->fd != -1)) {
         if (likely(upipe_udpsink->uri != NULL))
             upipe_notice_va(upipe, "closing socket %s", upipe_udpsink->uri);
@@ -560,7 +1682,15 @@ static void upipe_udpsink_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     free(upipe_udpsink->uri);
+    for (unsigned int i = 0; i < upipe_udpsink->nb_destinations; i++)
+        free(upipe_udpsink->destinations[i].uri);
+    free(upipe_udpsink->destinations);
+    free(upipe_udpsink->batch_urefs);
+#ifdef UPIPE_HAVE_SENDMMSG
+    free(upipe_udpsink->batch_msgs);
+#endif
     upipe_udpsink_clean_uclock(upipe);
+    upipe_udpsink_clean_upump_batch(upipe);
     upipe_udpsink_clean_upump(upipe);
     upipe_udpsink_clean_upump_mgr(upipe);
     upipe_udpsink_clean_input(upipe);
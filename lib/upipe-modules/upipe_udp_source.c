@@ -28,7 +28,10 @@
  * @short Upipe source module for udp sockets
  */
 
+#define _GNU_SOURCE
+
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
 #include <upipe/uprobe.h>
 #include <upipe/uclock.h>
 #include <upipe/uref.h>
@@ -63,16 +66,52 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <pthread.h>
+#ifdef UPIPE_HAVE_LINUX_NET_TSTAMP_H
+#include <linux/net_tstamp.h>
+#endif
 
 /** default size of buffers when unspecified */
 #define UBUF_DEFAULT_SIZE       4096
 
 #define UDP_DEFAULT_TTL 0
 #define UDP_DEFAULT_PORT 1234
+/** maximum number of datagrams read per wake-up */
+#define UDP_MAX_BATCH 1024
+/** size of the ancillary data buffer for receive timestamps */
+#define UDP_CMSG_SIZE CMSG_SPACE(3 * sizeof(struct timespec))
 
 /** @hidden */
 static int upipe_udpsrc_check(struct upipe *upipe, struct uref *flow_format);
+/** @hidden */
+static int upipe_udpsrc_set_uri(struct upipe *upipe, const char *uri);
+
+/** @internal @This is a socket shared by the udp sources of an event loop
+ * opened with the same uri. */
+struct upipe_udpsrc_group {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** udp socket uri */
+    char *uri;
+    /** upump manager of the sources */
+    struct upump_mgr *upump_mgr;
+    /** udp socket descriptor */
+    int fd;
+    /** list of sources, the first one reading the socket */
+    struct uchain sources;
+};
+
+UBASE_FROM_TO(upipe_udpsrc_group, uchain, uchain, uchain)
+
+/** lock protecting the list of shared sockets */
+static pthread_mutex_t upipe_udpsrc_groups_lock = PTHREAD_MUTEX_INITIALIZER;
+/** list of shared sockets */
+static struct uchain upipe_udpsrc_groups = {
+    .next = &upipe_udpsrc_groups,
+    .prev = &upipe_udpsrc_groups
+};
 
 /** @internal @This is the private context of a udp socket source pipe. */
 struct upipe_udpsrc {
@@ -109,13 +148,46 @@ struct upipe_udpsrc {
     struct upump_mgr *upump_mgr;
     /** read watcher */
     struct upump *upump;
+    /** idle timer */
+    struct upump *upump_idle;
     /** read size */
     unsigned int read_size;
 
+    /** number of datagrams read per wake-up */
+    unsigned int batch;
+    /** urefs allocated in advance for batched reads */
+    struct uref **batch_urefs;
+    /** buffers of the urefs allocated in advance */
+    uint8_t **batch_buffers;
+#ifdef UPIPE_HAVE_RECVMMSG
+    /** message headers for recvmmsg() */
+    struct mmsghdr *batch_msgs;
+    /** io vectors for recvmmsg() */
+    struct iovec *batch_iovecs;
+    /** ancillary data buffers for recvmmsg() */
+    uint8_t *batch_cmsgs;
+#endif
+
+    /** source of receive timestamps */
+    enum upipe_udpsrc_timestamp timestamp;
+
+    /** time without datagrams after which the pipe hibernates, or 0 */
+    uint64_t idle_timeout;
+    /** true if datagrams were received since the last idle timer tick */
+    bool idle_traffic;
+    /** true if the pipe is hibernating */
+    bool hibernated;
+
     /** udp socket descriptor */
     int fd;
     /** udp socket uri */
     char *uri;
+    /** true if the socket may be shared with other sources */
+    bool shared;
+    /** shared socket, or NULL */
+    struct upipe_udpsrc_group *group;
+    /** structure for the list of sources of the shared socket */
+    struct uchain group_uchain;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -140,8 +212,11 @@ UPIPE_HELPER_UCLOCK(upipe_udpsrc, uclock, uclock_request, upipe_udpsrc_check,
 
 UPIPE_HELPER_UPUMP_MGR(upipe_udpsrc, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_udpsrc, upump, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_udpsrc, upump_idle, upump_mgr)
 UPIPE_HELPER_SOURCE_READ_SIZE(upipe_udpsrc, read_size)
 
+UBASE_FROM_TO(upipe_udpsrc, uchain, group_uchain, group_uchain)
+
 /** @internal @This allocates a udp socket source pipe.
  *
  * @param mgr common management structure
@@ -162,14 +237,138 @@ static struct upipe *upipe_udpsrc_alloc(struct upipe_mgr *mgr,
     upipe_udpsrc_init_output(upipe);
     upipe_udpsrc_init_upump_mgr(upipe);
     upipe_udpsrc_init_upump(upipe);
+    upipe_udpsrc_init_upump_idle(upipe);
     upipe_udpsrc_init_uclock(upipe);
     upipe_udpsrc_init_read_size(upipe, UBUF_DEFAULT_SIZE);
+    upipe_udpsrc->batch = 1;
+    upipe_udpsrc->batch_urefs = NULL;
+    upipe_udpsrc->batch_buffers = NULL;
+#ifdef UPIPE_HAVE_RECVMMSG
+    upipe_udpsrc->batch_msgs = NULL;
+    upipe_udpsrc->batch_iovecs = NULL;
+    upipe_udpsrc->batch_cmsgs = NULL;
+#endif
+    upipe_udpsrc->timestamp = UPIPE_UDPSRC_TIMESTAMP_NONE;
+    upipe_udpsrc->idle_timeout = 0;
+    upipe_udpsrc->idle_traffic = false;
+    upipe_udpsrc->hibernated = false;
     upipe_udpsrc->fd = -1;
     upipe_udpsrc->uri = NULL;
+    upipe_udpsrc->shared = false;
+    upipe_udpsrc->group = NULL;
     upipe_throw_ready(upipe);
     return upipe;
 }
 
+/** @internal @This returns the system real-time clock, which is the time
+ * base of kernel receive timestamps.
+ *
+ * @return real-time clock in 27 MHz ticks
+ */
+static uint64_t upipe_udpsrc_realtime(void)
+{
+    struct timespec ts;
+    if (unlikely(clock_gettime(CLOCK_REALTIME, &ts) == -1))
+        return 0;
+    return ts.tv_sec * UCLOCK_FREQ +
+           ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+}
+
+/** @internal @This converts the receive timestamp found in the ancillary
+ * data of a message to a date in the uclock time base.
+ *
+ * @param msg message header filled in by the kernel
+ * @param systime uclock date of the wake-up
+ * @param realtime real-time clock at the wake-up
+ * @return cr_sys date of the datagram
+ */
+static uint64_t upipe_udpsrc_cmsg_date(struct msghdr *msg, uint64_t systime,
+                                       uint64_t realtime)
+{
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        struct timespec ts[3];
+        if (cmsg->cmsg_level != SOL_SOCKET)
+            continue;
+#ifdef SO_TIMESTAMPNS
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+            memcpy(ts, CMSG_DATA(cmsg), sizeof(struct timespec));
+        else
+#endif
+#ifdef SO_TIMESTAMPING
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            memcpy(ts, CMSG_DATA(cmsg), 3 * sizeof(struct timespec));
+            /* ts[2] is the raw hardware timestamp, ts[0] the software one */
+            if (ts[2].tv_sec || ts[2].tv_nsec)
+                ts[0] = ts[2];
+        } else
+#endif
+            continue;
+
+        uint64_t date = ts[0].tv_sec * UCLOCK_FREQ +
+                        ts[0].tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+        if (unlikely(!date || date > realtime || realtime - date > systime))
+            break;
+        return systime - (realtime - date);
+    }
+    return systime;
+}
+
+/** @internal @This records that a datagram was received, and wakes the
+ * pipe up if it was hibernating.
+ *
+ * @param upipe description structure of the pipe
+ */
+static inline void upipe_udpsrc_wake(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    upipe_udpsrc->idle_traffic = true;
+    if (unlikely(upipe_udpsrc->hibernated)) {
+        upipe_dbg(upipe, "waking up");
+        upipe_udpsrc->hibernated = false;
+    }
+}
+
+/** @internal @This outputs a datagram, and a duplicate of it to the other
+ * sources of the shared socket.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ */
+static void upipe_udpsrc_output_shared(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    struct upipe_udpsrc_group *group = upipe_udpsrc->group;
+    upipe_udpsrc_wake(upipe);
+    if (likely(group == NULL)) {
+        upipe_udpsrc_output(upipe, uref, &upipe_udpsrc->upump);
+        return;
+    }
+
+    /* outputting may free the other sources or change the group */
+    struct upipe *sources[ulist_depth(&group->sources)];
+    unsigned int nb_sources = 0;
+    struct uchain *uchain;
+    ulist_foreach (&group->sources, uchain) {
+        struct upipe_udpsrc *source = upipe_udpsrc_from_group_uchain(uchain);
+        if (source != upipe_udpsrc && source->flow_def != NULL)
+            sources[nb_sources++] = upipe_use(upipe_udpsrc_to_upipe(source));
+    }
+
+    for (unsigned int i = 0; i < nb_sources; i++) {
+        upipe_udpsrc_wake(sources[i]);
+        struct uref *uref_dup_source = uref_dup(uref);
+        if (unlikely(uref_dup_source == NULL))
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        else
+            upipe_udpsrc_output(sources[i], uref_dup_source,
+                                &upipe_udpsrc->upump);
+        upipe_release(sources[i]);
+    }
+    upipe_udpsrc_output(upipe, uref, &upipe_udpsrc->upump);
+}
+
 /** @internal @This reads data from the source and outputs it.
  * It is called either when the idler triggers (permanent storage mode) or
  * when data is available on the udp socket descriptor (live stream mode).
@@ -181,8 +380,15 @@ static void upipe_udpsrc_worker(struct upump *upump)
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
     uint64_t systime = 0; /* to keep gcc quiet */
-    if (unlikely(upipe_udpsrc->uclock != NULL))
+    uint64_t realtime = 0;
+    bool timestamp = false;
+    if (unlikely(upipe_udpsrc->uclock != NULL)) {
         systime = uclock_now(upipe_udpsrc->uclock);
+        if (upipe_udpsrc->timestamp != UPIPE_UDPSRC_TIMESTAMP_NONE) {
+            realtime = upipe_udpsrc_realtime();
+            timestamp = true;
+        }
+    }
 
     struct uref *uref = uref_block_alloc(upipe_udpsrc->uref_mgr,
                                          upipe_udpsrc->ubuf_mgr,
@@ -202,7 +408,22 @@ static void upipe_udpsrc_worker(struct upump *upump)
     }
     assert(read_size == upipe_udpsrc->read_size);
 
-    ssize_t ret = read(upipe_udpsrc->fd, buffer, upipe_udpsrc->read_size);
+    ssize_t ret;
+    uint8_t cmsg_buffer[UDP_CMSG_SIZE];
+    struct iovec iovec;
+    struct msghdr msg;
+    if (likely(!timestamp))
+        ret = read(upipe_udpsrc->fd, buffer, upipe_udpsrc->read_size);
+    else {
+        iovec.iov_base = buffer;
+        iovec.iov_len = upipe_udpsrc->read_size;
+        memset(&msg, 0, sizeof(struct msghdr));
+        msg.msg_iov = &iovec;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsg_buffer;
+        msg.msg_controllen = sizeof(cmsg_buffer);
+        ret = recvmsg(upipe_udpsrc->fd, &msg, 0);
+    }
     uref_block_unmap(uref, 0);
 
     if (unlikely(ret == -1)) {
@@ -235,14 +456,488 @@ static void upipe_udpsrc_worker(struct upump *upump)
         }
         return;
     }
-    if (unlikely(upipe_udpsrc->uclock != NULL))
+    if (unlikely(timestamp))
+        systime = upipe_udpsrc_cmsg_date(&msg, systime, realtime);
+    if (unlikely(upipe_udpsrc->uclock != NULL)) {
         uref_clock_set_cr_sys(uref, systime);
+        uref_clock_set_ingress(uref, systime);
+    }
     if (unlikely(ret != upipe_udpsrc->read_size))
         uref_block_resize(uref, 0, ret);
     upipe_use(upipe);
-    upipe_udpsrc_output(upipe, uref, &upipe_udpsrc->upump);
+    upipe_udpsrc_output_shared(upipe, uref);
+    upipe_release(upipe);
+}
+
+#ifdef UPIPE_HAVE_RECVMMSG
+/** @internal @This reads several datagrams from the socket with a single
+ * system call and outputs them.
+ *
+ * @param upump description structure of the read watcher
+ */
+static void upipe_udpsrc_worker_batch(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    unsigned int batch = upipe_udpsrc->batch;
+    uint64_t systime = 0; /* to keep gcc quiet */
+    uint64_t realtime = 0;
+    bool timestamp = false;
+    if (unlikely(upipe_udpsrc->uclock != NULL)) {
+        systime = uclock_now(upipe_udpsrc->uclock);
+        if (upipe_udpsrc->timestamp != UPIPE_UDPSRC_TIMESTAMP_NONE) {
+            realtime = upipe_udpsrc_realtime();
+            timestamp = true;
+        }
+    }
+
+    /* urefs and buffers left over by the previous wake-up are reused */
+    for (unsigned int i = 0; i < batch; i++) {
+        if (upipe_udpsrc->batch_urefs[i] != NULL)
+            continue;
+
+        struct uref *uref = uref_block_alloc(upipe_udpsrc->uref_mgr,
+                                             upipe_udpsrc->ubuf_mgr,
+                                             upipe_udpsrc->read_size);
+        if (unlikely(uref == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+
+        uint8_t *buffer;
+        int read_size = -1;
+        if (unlikely(!ubase_check(uref_block_write(uref, 0, &read_size,
+                                                   &buffer)))) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        assert(read_size == upipe_udpsrc->read_size);
+        upipe_udpsrc->batch_urefs[i] = uref;
+        upipe_udpsrc->batch_buffers[i] = buffer;
+    }
+
+    for (unsigned int i = 0; i < batch; i++) {
+        struct iovec *iovec = &upipe_udpsrc->batch_iovecs[i];
+        struct mmsghdr *msg = &upipe_udpsrc->batch_msgs[i];
+        iovec->iov_base = upipe_udpsrc->batch_buffers[i];
+        iovec->iov_len = upipe_udpsrc->read_size;
+        memset(msg, 0, sizeof(struct mmsghdr));
+        msg->msg_hdr.msg_iov = iovec;
+        msg->msg_hdr.msg_iovlen = 1;
+        if (timestamp) {
+            msg->msg_hdr.msg_control = upipe_udpsrc->batch_cmsgs +
+                                       i * UDP_CMSG_SIZE;
+            msg->msg_hdr.msg_controllen = UDP_CMSG_SIZE;
+        }
+    }
+
+    int ret = recvmmsg(upipe_udpsrc->fd, upipe_udpsrc->batch_msgs, batch,
+                       MSG_DONTWAIT, NULL);
+    if (unlikely(ret == -1)) {
+        switch (errno) {
+            case EINTR:
+            case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+            case EWOULDBLOCK:
+#endif
+                /* not an issue, try again later */
+                return;
+            case EBADF:
+            case EINVAL:
+            case EIO:
+            default:
+                break;
+        }
+        upipe_err_va(upipe, "read error from %s (%m)", upipe_udpsrc->uri);
+        upipe_udpsrc_set_upump(upipe, NULL);
+        upipe_throw_source_end(upipe);
+        return;
+    }
+    if (unlikely(ret <= 0))
+        return;
+
+    /* detach the received urefs first, as outputting may reenter the pipe */
+    struct uref *urefs[ret];
+    int sizes[ret];
+    uint64_t dates[ret];
+    for (int i = 0; i < ret; i++) {
+        urefs[i] = upipe_udpsrc->batch_urefs[i];
+        sizes[i] = upipe_udpsrc->batch_msgs[i].msg_len;
+        dates[i] = timestamp ?
+            upipe_udpsrc_cmsg_date(&upipe_udpsrc->batch_msgs[i].msg_hdr,
+                                   systime, realtime) : systime;
+        uref_block_unmap(urefs[i], 0);
+    }
+    memmove(upipe_udpsrc->batch_urefs, upipe_udpsrc->batch_urefs + ret,
+            (batch - ret) * sizeof(struct uref *));
+    memmove(upipe_udpsrc->batch_buffers, upipe_udpsrc->batch_buffers + ret,
+            (batch - ret) * sizeof(uint8_t *));
+    for (unsigned int i = batch - ret; i < batch; i++)
+        upipe_udpsrc->batch_urefs[i] = NULL;
+
+    upipe_use(upipe);
+    for (int i = 0; i < ret; i++) {
+        struct uref *uref = urefs[i];
+        if (unlikely(sizes[i] == 0)) {
+            uref_free(uref);
+            continue;
+        }
+        if (unlikely(upipe_udpsrc->uclock != NULL)) {
+            uref_clock_set_cr_sys(uref, dates[i]);
+            uref_clock_set_ingress(uref, dates[i]);
+        }
+        if (unlikely(sizes[i] != upipe_udpsrc->read_size))
+            uref_block_resize(uref, 0, sizes[i]);
+        upipe_udpsrc_output_shared(upipe, uref);
+    }
     upipe_release(upipe);
 }
+#endif
+
+/** @internal @This frees the urefs allocated in advance for batched reads.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsrc_flush_batch(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    if (upipe_udpsrc->batch_urefs == NULL)
+        return;
+
+    for (unsigned int i = 0; i < upipe_udpsrc->batch; i++) {
+        if (upipe_udpsrc->batch_urefs[i] != NULL) {
+            uref_block_unmap(upipe_udpsrc->batch_urefs[i], 0);
+            uref_free(upipe_udpsrc->batch_urefs[i]);
+            upipe_udpsrc->batch_urefs[i] = NULL;
+        }
+    }
+}
+
+/** @internal @This releases the structures used for batched reads.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsrc_clean_batch(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    upipe_udpsrc_flush_batch(upipe);
+    free(upipe_udpsrc->batch_urefs);
+    free(upipe_udpsrc->batch_buffers);
+    upipe_udpsrc->batch_urefs = NULL;
+    upipe_udpsrc->batch_buffers = NULL;
+#ifdef UPIPE_HAVE_RECVMMSG
+    free(upipe_udpsrc->batch_msgs);
+    free(upipe_udpsrc->batch_iovecs);
+    free(upipe_udpsrc->batch_cmsgs);
+    upipe_udpsrc->batch_msgs = NULL;
+    upipe_udpsrc->batch_iovecs = NULL;
+    upipe_udpsrc->batch_cmsgs = NULL;
+#endif
+}
+
+/** @internal @This releases the buffers which are only needed while
+ * datagrams flow, and propagates the command downstream. The buffers are
+ * allocated again on the next datagram.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int _upipe_udpsrc_hibernate(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    upipe_udpsrc_flush_batch(upipe);
+    if (upipe_udpsrc->ubuf_mgr != NULL)
+        ubuf_mgr_vacuum(upipe_udpsrc->ubuf_mgr);
+    if (upipe_udpsrc->uref_mgr != NULL)
+        uref_mgr_vacuum(upipe_udpsrc->uref_mgr);
+    upipe_udpsrc->hibernated = true;
+    upipe_udpsrc->idle_traffic = false;
+    if (upipe_udpsrc->output != NULL)
+        upipe_hibernate(upipe_udpsrc->output);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This is called periodically when an idle timeout is set, and
+ * hibernates the pipe if no datagram was received since the last call.
+ *
+ * @param upump description structure of the idle timer
+ */
+static void upipe_udpsrc_idle(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    if (upipe_udpsrc->idle_traffic) {
+        upipe_udpsrc->idle_traffic = false;
+        return;
+    }
+    if (upipe_udpsrc->hibernated)
+        return;
+
+    upipe_notice_va(upipe, "no datagram for %"PRIu64" ms, hibernating",
+                    upipe_udpsrc->idle_timeout * 1000 / UCLOCK_FREQ);
+    upipe_use(upipe);
+    _upipe_udpsrc_hibernate(upipe);
+    upipe_release(upipe);
+}
+
+/** @internal @This sets the idle timeout.
+ *
+ * @param upipe description structure of the pipe
+ * @param timeout time without datagrams after which the pipe hibernates,
+ * or 0 to disable
+ * @return an error code
+ */
+static int _upipe_udpsrc_set_idle_timeout(struct upipe *upipe,
+                                          uint64_t timeout)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    upipe_udpsrc_set_upump_idle(upipe, NULL);
+    upipe_udpsrc->idle_timeout = timeout;
+    upipe_udpsrc->idle_traffic = false;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of datagrams read per wake-up.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch number of datagrams
+ * @return an error code
+ */
+static int _upipe_udpsrc_set_batch(struct upipe *upipe, unsigned int batch)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    if (unlikely(batch == 0 || batch > UDP_MAX_BATCH))
+        return UBASE_ERR_INVALID;
+#ifndef UPIPE_HAVE_RECVMMSG
+    if (batch > 1) {
+        upipe_warn(upipe, "batched reads are not supported on this platform");
+        return UBASE_ERR_UNHANDLED;
+    }
+#endif
+
+    upipe_udpsrc_set_upump(upipe, NULL);
+    upipe_udpsrc_clean_batch(upipe);
+    upipe_udpsrc->batch = batch;
+    if (batch == 1)
+        return UBASE_ERR_NONE;
+
+#ifdef UPIPE_HAVE_RECVMMSG
+    upipe_udpsrc->batch_urefs = calloc(batch, sizeof(struct uref *));
+    upipe_udpsrc->batch_buffers = calloc(batch, sizeof(uint8_t *));
+    upipe_udpsrc->batch_msgs = calloc(batch, sizeof(struct mmsghdr));
+    upipe_udpsrc->batch_iovecs = calloc(batch, sizeof(struct iovec));
+    upipe_udpsrc->batch_cmsgs = malloc(batch * UDP_CMSG_SIZE);
+    if (unlikely(upipe_udpsrc->batch_urefs == NULL ||
+                 upipe_udpsrc->batch_buffers == NULL ||
+                 upipe_udpsrc->batch_msgs == NULL ||
+                 upipe_udpsrc->batch_iovecs == NULL ||
+                 upipe_udpsrc->batch_cmsgs == NULL)) {
+        upipe_udpsrc_clean_batch(upipe);
+        upipe_udpsrc->batch = 1;
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+#endif
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This configures the socket for the current source of receive
+ * timestamps.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_udpsrc_apply_timestamp(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    if (upipe_udpsrc->fd == -1)
+        return UBASE_ERR_NONE;
+
+    int ret = 0;
+    int val;
+    switch (upipe_udpsrc->timestamp) {
+        case UPIPE_UDPSRC_TIMESTAMP_NONE:
+            val = 0;
+#ifdef SO_TIMESTAMPNS
+            setsockopt(upipe_udpsrc->fd, SOL_SOCKET, SO_TIMESTAMPNS,
+                       &val, sizeof(val));
+#endif
+#ifdef SO_TIMESTAMPING
+            setsockopt(upipe_udpsrc->fd, SOL_SOCKET, SO_TIMESTAMPING,
+                       &val, sizeof(val));
+#endif
+            return UBASE_ERR_NONE;
+
+        case UPIPE_UDPSRC_TIMESTAMP_SOFTWARE:
+#ifdef SO_TIMESTAMPNS
+            val = 1;
+            ret = setsockopt(upipe_udpsrc->fd, SOL_SOCKET, SO_TIMESTAMPNS,
+                             &val, sizeof(val));
+            break;
+#else
+            upipe_warn(upipe, "kernel timestamps are not supported");
+            return UBASE_ERR_UNHANDLED;
+#endif
+
+        case UPIPE_UDPSRC_TIMESTAMP_HARDWARE:
+#if defined(SO_TIMESTAMPING) && defined(UPIPE_HAVE_LINUX_NET_TSTAMP_H)
+            val = SOF_TIMESTAMPING_RX_HARDWARE |
+                  SOF_TIMESTAMPING_RAW_HARDWARE |
+                  SOF_TIMESTAMPING_RX_SOFTWARE |
+                  SOF_TIMESTAMPING_SOFTWARE;
+            ret = setsockopt(upipe_udpsrc->fd, SOL_SOCKET, SO_TIMESTAMPING,
+                             &val, sizeof(val));
+            break;
+#else
+            upipe_warn(upipe, "hardware timestamps are not supported");
+            return UBASE_ERR_UNHANDLED;
+#endif
+
+        default:
+            return UBASE_ERR_INVALID;
+    }
+
+    if (unlikely(ret == -1)) {
+        upipe_warn_va(upipe, "can't enable receive timestamps (%m)");
+        return UBASE_ERR_EXTERNAL;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the source of receive timestamps.
+ *
+ * @param upipe description structure of the pipe
+ * @param timestamp source of receive timestamps
+ * @return an error code
+ */
+static int _upipe_udpsrc_set_timestamp(struct upipe *upipe,
+                                       enum upipe_udpsrc_timestamp timestamp)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    enum upipe_udpsrc_timestamp old = upipe_udpsrc->timestamp;
+    if (timestamp != old && upipe_udpsrc->group != NULL &&
+        ulist_depth(&upipe_udpsrc->group->sources) > 1) {
+        upipe_warn_va(upipe, "can't change the receive timestamps of shared "
+                      "udp socket %s", upipe_udpsrc->uri);
+        return UBASE_ERR_BUSY;
+    }
+    upipe_udpsrc->timestamp = timestamp;
+    int err = upipe_udpsrc_apply_timestamp(upipe);
+    if (unlikely(!ubase_check(err))) {
+        upipe_udpsrc->timestamp = old;
+        upipe_udpsrc_apply_timestamp(upipe);
+    }
+    return err;
+}
+
+/** @internal @This shares the socket of the sources of the same event loop
+ * opened with the same uri, or offers the socket of the pipe for sharing.
+ * The options given in the uri, such as busy polling, are thus the same for
+ * all the sources of a socket, but the sources must also agree on the
+ * receive timestamps, which are set on the socket and parsed by the source
+ * reading it.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_udpsrc_join(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    struct upipe_udpsrc_group *group = NULL;
+    struct uchain *uchain;
+    pthread_mutex_lock(&upipe_udpsrc_groups_lock);
+    ulist_foreach (&upipe_udpsrc_groups, uchain) {
+        struct upipe_udpsrc_group *g = upipe_udpsrc_group_from_uchain(uchain);
+        if (g->upump_mgr == upipe_udpsrc->upump_mgr &&
+            !strcmp(g->uri, upipe_udpsrc->uri)) {
+            group = g;
+            break;
+        }
+    }
+
+    if (group != NULL) {
+        struct upipe_udpsrc *first =
+            upipe_udpsrc_from_group_uchain(ulist_peek(&group->sources));
+        if (unlikely(first->timestamp != upipe_udpsrc->timestamp)) {
+            /* the pipe keeps reading its own socket */
+            pthread_mutex_unlock(&upipe_udpsrc_groups_lock);
+            upipe_warn_va(upipe, "can't share udp socket %s with different "
+                          "receive timestamps", upipe_udpsrc->uri);
+            return UBASE_ERR_INVALID;
+        }
+        close(upipe_udpsrc->fd);
+        upipe_udpsrc->fd = group->fd;
+    } else {
+        group = malloc(sizeof(struct upipe_udpsrc_group));
+        if (unlikely(group == NULL ||
+                     (group->uri = strdup(upipe_udpsrc->uri)) == NULL)) {
+            /* the pipe keeps reading its own socket */
+            pthread_mutex_unlock(&upipe_udpsrc_groups_lock);
+            free(group);
+            return UBASE_ERR_ALLOC;
+        }
+        group->upump_mgr = upipe_udpsrc->upump_mgr;
+        group->fd = upipe_udpsrc->fd;
+        ulist_init(&group->sources);
+        ulist_add(&upipe_udpsrc_groups, &group->uchain);
+    }
+    ulist_add(&group->sources, &upipe_udpsrc->group_uchain);
+    upipe_udpsrc->group = group;
+    pthread_mutex_unlock(&upipe_udpsrc_groups_lock);
+    upipe_dbg_va(upipe, "sharing udp socket %s", upipe_udpsrc->uri);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This leaves the shared socket, which is closed with its last
+ * source. The next source reads the socket if the pipe was the first one.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsrc_leave(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    struct upipe_udpsrc_group *group = upipe_udpsrc->group;
+    struct upipe *next = NULL;
+    upipe_udpsrc_set_upump(upipe, NULL);
+
+    pthread_mutex_lock(&upipe_udpsrc_groups_lock);
+    bool first = ulist_peek(&group->sources) == &upipe_udpsrc->group_uchain;
+    ulist_delete(&upipe_udpsrc->group_uchain);
+    if (ulist_empty(&group->sources)) {
+        ulist_delete(&group->uchain);
+        close(group->fd);
+        free(group->uri);
+        free(group);
+    } else if (first)
+        next = upipe_udpsrc_to_upipe(
+                upipe_udpsrc_from_group_uchain(ulist_peek(&group->sources)));
+    pthread_mutex_unlock(&upipe_udpsrc_groups_lock);
+
+    upipe_udpsrc->group = NULL;
+    upipe_udpsrc->fd = -1;
+    if (next != NULL)
+        upipe_udpsrc_check(next, NULL);
+}
+
+/** @internal @This sets the shared mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param shared true if the socket may be shared with other sources
+ * @return an error code
+ */
+static int _upipe_udpsrc_set_shared(struct upipe *upipe, bool shared)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    upipe_udpsrc->shared = shared;
+    if (shared || upipe_udpsrc->group == NULL)
+        return UBASE_ERR_NONE;
+
+    /* open a socket of our own */
+    char uri[strlen(upipe_udpsrc->uri) + 1];
+    strcpy(uri, upipe_udpsrc->uri);
+    return upipe_udpsrc_set_uri(upipe, uri);
+}
 
 /** @internal @This checks if the pump may be allocated.
  *
@@ -281,17 +976,48 @@ static int upipe_udpsrc_check(struct upipe *upipe, struct uref *flow_format)
             != NULL)
         return UBASE_ERR_NONE;
 
+    if (upipe_udpsrc->fd != -1 && upipe_udpsrc->idle_timeout &&
+        upipe_udpsrc->upump_idle == NULL) {
+        struct upump *upump =
+            upump_alloc_timer(upipe_udpsrc->upump_mgr, upipe_udpsrc_idle,
+                              upipe, upipe_udpsrc->idle_timeout,
+                              upipe_udpsrc->idle_timeout);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_udpsrc_set_upump_idle(upipe, upump);
+        upump_start(upump);
+    }
+
     if (upipe_udpsrc->fd != -1 && upipe_udpsrc->upump == NULL) {
+        int err = UBASE_ERR_NONE;
+        if (upipe_udpsrc->shared && upipe_udpsrc->group == NULL)
+            err = upipe_udpsrc_join(upipe);
+        /* only the first source of a shared socket reads it */
+        if (upipe_udpsrc->group != NULL &&
+            ulist_peek(&upipe_udpsrc->group->sources) !=
+                &upipe_udpsrc->group_uchain)
+            return UBASE_ERR_NONE;
+
         struct upump *upump;
-        upump = upump_alloc_fd_read(upipe_udpsrc->upump_mgr,
-                                    upipe_udpsrc_worker, upipe,
-                                    upipe_udpsrc->fd);
+#ifdef UPIPE_HAVE_RECVMMSG
+        if (upipe_udpsrc->batch > 1)
+            upump = upump_alloc_fd_read(upipe_udpsrc->upump_mgr,
+                                        upipe_udpsrc_worker_batch, upipe,
+                                        upipe_udpsrc->fd);
+        else
+#endif
+            upump = upump_alloc_fd_read(upipe_udpsrc->upump_mgr,
+                                        upipe_udpsrc_worker, upipe,
+                                        upipe_udpsrc->fd);
         if (unlikely(upump == NULL)) {
             upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
             return UBASE_ERR_UPUMP;
         }
         upipe_udpsrc_set_upump(upipe, upump);
         upump_start(upump);
+        return err;
     }
     return UBASE_ERR_NONE;
 }
@@ -321,7 +1047,10 @@ static int upipe_udpsrc_set_uri(struct upipe *upipe, const char *uri)
     bool use_tcp = 0;
     struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
 
-    if (unlikely(upipe_udpsrc->fd != -1)) {
+    if (upipe_udpsrc->group != NULL) {
+        upipe_notice_va(upipe, "leaving udp socket %s", upipe_udpsrc->uri);
+        upipe_udpsrc_leave(upipe);
+    } else if (unlikely(upipe_udpsrc->fd != -1)) {
         if (likely(upipe_udpsrc->uri != NULL)) {
             upipe_notice_va(upipe, "closing udp socket %s", upipe_udpsrc->uri);
         }
@@ -331,6 +1060,8 @@ static int upipe_udpsrc_set_uri(struct upipe *upipe, const char *uri)
     free(upipe_udpsrc->uri);
     upipe_udpsrc->uri = NULL;
     upipe_udpsrc_set_upump(upipe, NULL);
+    upipe_udpsrc_set_upump_idle(upipe, NULL);
+    upipe_udpsrc->hibernated = false;
 
     if (unlikely(uri == NULL))
         return UBASE_ERR_NONE;
@@ -350,6 +1081,8 @@ static int upipe_udpsrc_set_uri(struct upipe *upipe, const char *uri)
         return UBASE_ERR_ALLOC;
     }
     upipe_notice_va(upipe, "opening udp socket %s", upipe_udpsrc->uri);
+    if (upipe_udpsrc->timestamp != UPIPE_UDPSRC_TIMESTAMP_NONE)
+        upipe_udpsrc_apply_timestamp(upipe);
     return UBASE_ERR_NONE;
 }
 
@@ -364,9 +1097,17 @@ static int _upipe_udpsrc_control(struct upipe *upipe,
                                  int command, va_list args)
 {
     switch (command) {
-        case UPIPE_ATTACH_UPUMP_MGR:
+        case UPIPE_ATTACH_UPUMP_MGR: {
+            struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
             upipe_udpsrc_set_upump(upipe, NULL);
+            upipe_udpsrc_set_upump_idle(upipe, NULL);
+            /* sockets are only shared within an event loop */
+            if (upipe_udpsrc->group != NULL) {
+                UBASE_RETURN(_upipe_udpsrc_set_shared(upipe, false))
+                upipe_udpsrc->shared = true;
+            }
             return upipe_udpsrc_attach_upump_mgr(upipe);
+        }
         case UPIPE_ATTACH_UCLOCK:
             upipe_udpsrc_set_upump(upipe, NULL);
             upipe_udpsrc_require_uclock(upipe);
@@ -391,8 +1132,57 @@ static int _upipe_udpsrc_control(struct upipe *upipe,
         }
         case UPIPE_SOURCE_SET_READ_SIZE: {
             unsigned int read_size = va_arg(args, unsigned int);
+            upipe_udpsrc_flush_batch(upipe);
             return upipe_udpsrc_set_read_size(upipe, read_size);
         }
+        case UPIPE_UDPSRC_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = upipe_udpsrc_from_upipe(upipe)->batch;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSRC_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            unsigned int batch = va_arg(args, unsigned int);
+            return _upipe_udpsrc_set_batch(upipe, batch);
+        }
+        case UPIPE_UDPSRC_GET_SHARED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            bool *p = va_arg(args, bool *);
+            *p = upipe_udpsrc_from_upipe(upipe)->shared;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSRC_SET_SHARED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            bool shared = va_arg(args, int);
+            return _upipe_udpsrc_set_shared(upipe, shared);
+        }
+        case UPIPE_UDPSRC_GET_TIMESTAMP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            enum upipe_udpsrc_timestamp *p =
+                va_arg(args, enum upipe_udpsrc_timestamp *);
+            *p = upipe_udpsrc_from_upipe(upipe)->timestamp;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSRC_SET_TIMESTAMP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            enum upipe_udpsrc_timestamp timestamp =
+                va_arg(args, enum upipe_udpsrc_timestamp);
+            return _upipe_udpsrc_set_timestamp(upipe, timestamp);
+        }
+        case UPIPE_UDPSRC_GET_IDLE_TIMEOUT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_udpsrc_from_upipe(upipe)->idle_timeout;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSRC_SET_IDLE_TIMEOUT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            uint64_t timeout = va_arg(args, uint64_t);
+            return _upipe_udpsrc_set_idle_timeout(upipe, timeout);
+        }
+        case UPIPE_HIBERNATE:
+            return _upipe_udpsrc_hibernate(upipe);
 
         case UPIPE_GET_URI: {
             const char **uri_p = va_arg(args, const char **);
@@ -430,7 +1220,10 @@ static void upipe_udpsrc_free(struct upipe *upipe)
 {
     struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
 
-    if (likely(upipe_udpsrc->fd != -1)) {
+    if (upipe_udpsrc->group != NULL) {
+        upipe_notice_va(upipe, "leaving udp socket %s", upipe_udpsrc->uri);
+        upipe_udpsrc_leave(upipe);
+    } else if (likely(upipe_udpsrc->fd != -1)) {
         if (likely(upipe_udpsrc->uri != NULL))
             upipe_notice_va(upipe, "closing udp socket %s", upipe_udpsrc->uri);
         close(upipe_udpsrc->fd);
@@ -439,9 +1232,11 @@ static void upipe_udpsrc_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     free(upipe_udpsrc->uri);
+    upipe_udpsrc_clean_batch(upipe);
     upipe_udpsrc_clean_read_size(upipe);
     upipe_udpsrc_clean_uclock(upipe);
     upipe_udpsrc_clean_upump(upipe);
+    upipe_udpsrc_clean_upump_idle(upipe);
     upipe_udpsrc_clean_upump_mgr(upipe);
     upipe_udpsrc_clean_output(upipe);
     upipe_udpsrc_clean_ubuf_mgr(upipe);
@@ -93,6 +93,10 @@ struct upipe_videocont {
     uint64_t last_pts;
     /** pointer value of last taken uref, for debug purposes */
     struct uref *last_uref;
+    /** true if the last picture is repeated when the input is late */
+    bool freeze;
+    /** last picture taken from the current input, to repeat if frozen */
+    struct uref *freeze_uref;
 
     /** manager to create input subpipes */
     struct upipe_mgr sub_mgr;
@@ -219,8 +223,11 @@ static void upipe_videocont_sub_handle_flow_def(struct upipe *upipe,
     }
     upipe_videocont_sub->flow_def = flow_def;
 
-    if (upipe_videocont->input_cur == upipe)
+    if (upipe_videocont->input_cur == upipe) {
         upipe_videocont->flow_def_uptodate = false;
+        uref_free(upipe_videocont->freeze_uref);
+        upipe_videocont->freeze_uref = NULL;
+    }
 }
 
 /** @internal @This receives the input flow definition.
@@ -406,6 +413,8 @@ static struct upipe *upipe_videocont_alloc(struct upipe_mgr *mgr,
     upipe_videocont->flow_input_format = false;
     upipe_videocont->flow_def_uptodate = false;
     upipe_videocont->last_uref = NULL;
+    upipe_videocont->freeze = false;
+    upipe_videocont->freeze_uref = NULL;
 
     upipe_throw_ready(upipe);
 
@@ -471,11 +480,46 @@ static int upipe_videocont_switch_input(struct upipe *upipe,
     upipe_videocont->input_cur = input;
     upipe_notice_va(upipe, "switched to input \"%s\" (%p)", name, input);
 
+    /* never freeze on a picture of the previous input */
+    uref_free(upipe_videocont->freeze_uref);
+    upipe_videocont->freeze_uref = NULL;
+
     upipe_videocont->flow_def_uptodate = false;
 
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This attaches a duplicate of the picture of a uref to a
+ * reference uref. The picture buffer is shared, never copied.
+ *
+ * @param uref reference uref
+ * @param pic uref carrying the picture
+ */
+static void upipe_videocont_attach_pic(struct uref *uref, struct uref *pic)
+{
+    uref_attach_ubuf(uref, ubuf_dup(pic->ubuf));
+    if (likely(ubase_check(uref_pic_get_progressive(pic)))) {
+        uref_pic_set_progressive(uref);
+    } else {
+        uref_pic_delete_progressive(uref);
+    }
+    if (likely(ubase_check(uref_pic_get_tf(pic)))) {
+        uref_pic_set_tf(uref);
+    } else {
+        uref_pic_delete_tf(uref);
+    }
+    if (likely(ubase_check(uref_pic_get_bf(pic)))) {
+        uref_pic_set_bf(uref);
+    } else {
+        uref_pic_delete_bf(uref);
+    }
+    if (likely(ubase_check(uref_pic_get_tff(pic)))) {
+        uref_pic_set_tff(uref);
+    } else {
+        uref_pic_delete_tff(uref);
+    }
+}
+
 /** @internal @This processes reference ("clock") input.
  *
  * @param upipe description structure of the pipe
@@ -538,7 +582,7 @@ static void upipe_videocont_input(struct upipe *upipe, struct uref *uref,
     struct upipe_videocont_sub *input = 
            upipe_videocont_sub_from_upipe(upipe_videocont->input_cur);
     if (unlikely(ulist_empty(&input->urefs))) {
-        goto output;
+        goto freeze;
     }
 
     struct uref *next_uref = uref_from_uchain(ulist_peek(&input->urefs));
@@ -550,37 +594,33 @@ static void upipe_videocont_input(struct upipe *upipe, struct uref *uref,
             next_pts + upipe_videocont->tolerance) {
         upipe_verbose_va(upipe, "attached ubuf %p (%"PRIu64") next %"PRIu64,
                          next_uref->ubuf, pts, next_pts);
-        uref_attach_ubuf(uref, ubuf_dup(next_uref->ubuf));
-        if (likely(ubase_check(uref_pic_get_progressive(next_uref)))) {
-            uref_pic_set_progressive(uref);
-        } else {
-            uref_pic_delete_progressive(uref);
-        }
-        if (likely(ubase_check(uref_pic_get_tf(next_uref)))) {
-            uref_pic_set_tf(uref);
-        } else {
-            uref_pic_delete_tf(uref);
-        }
-        if (likely(ubase_check(uref_pic_get_bf(next_uref)))) {
-            uref_pic_set_bf(uref);
-        } else {
-            uref_pic_delete_bf(uref);
-        }
-        if (likely(ubase_check(uref_pic_get_tff(next_uref)))) {
-            uref_pic_set_tff(uref);
-        } else {
-            uref_pic_delete_tff(uref);
-        }
+        upipe_videocont_attach_pic(uref, next_uref);
         if (upipe_videocont->last_uref == next_uref) {
             upipe_warn_va(upipe, "reusing the same picture %"PRIu64" %"PRIu64,
                       pts + upipe_videocont->latency, next_pts + upipe_videocont->tolerance);
         }
+        if (upipe_videocont->freeze &&
+            (upipe_videocont->last_uref != next_uref ||
+             upipe_videocont->freeze_uref == NULL)) {
+            /* keep a reference to the picture, which may be deleted from
+             * the list before the input comes back */
+            uref_free(upipe_videocont->freeze_uref);
+            upipe_videocont->freeze_uref = uref_dup(next_uref);
+        }
         upipe_videocont->last_uref = next_uref;
         sub_attached = true;
         next_uref = NULL;
         /* do NOT pop/free from list so that we can dup frame if needed */
     }
 
+freeze:
+    if (!sub_attached && upipe_videocont->freeze_uref != NULL) {
+        upipe_verbose_va(upipe, "input late, repeating ubuf %p",
+                         upipe_videocont->freeze_uref->ubuf);
+        upipe_videocont_attach_pic(uref, upipe_videocont->freeze_uref);
+        sub_attached = true;
+    }
+
 output:
     if (unlikely(!upipe_videocont->flow_def_uptodate
                  || (upipe_videocont->flow_input_format != sub_attached))) {
@@ -771,6 +811,20 @@ static int upipe_videocont_control(struct upipe *upipe,
             *va_arg(args, uint64_t *) = upipe_videocont->latency;
             return UBASE_ERR_NONE;
         }
+        case UPIPE_VIDEOCONT_SET_FREEZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEOCONT_SIGNATURE)
+            upipe_videocont->freeze = !!va_arg(args, int);
+            if (!upipe_videocont->freeze) {
+                uref_free(upipe_videocont->freeze_uref);
+                upipe_videocont->freeze_uref = NULL;
+            }
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_VIDEOCONT_GET_FREEZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEOCONT_SIGNATURE)
+            *va_arg(args, int *) = upipe_videocont->freeze;
+            return UBASE_ERR_NONE;
+        }
         case UPIPE_VIDEOCONT_GET_CURRENT_INPUT: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEOCONT_SIGNATURE)
             const char **name_p = va_arg(args, const char **);
@@ -792,6 +846,7 @@ static void upipe_videocont_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     free(upipe_videocont->input_name);
+    uref_free(upipe_videocont->freeze_uref);
     if (likely(upipe_videocont->flow_def_input)) {
         uref_free(upipe_videocont->flow_def_input);
     }
@@ -41,6 +41,8 @@
 #include <upipe-modules/upipe_queue_source.h>
 #include <upipe-modules/upipe_transfer.h>
 
+#include "upipe_worker_pool.h"
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
@@ -56,8 +58,8 @@ struct upipe_wlin_mgr {
     struct upipe_mgr *qsrc_mgr;
     /** pointer to queue sink manager */
     struct upipe_mgr *qsink_mgr;
-    /** pointer to source xfer manager */
-    struct upipe_mgr *xfer_mgr;
+    /** pool of remote threads */
+    struct upipe_worker_pool pool;
 
     /** public upipe_mgr structure */
     struct upipe_mgr mgr;
@@ -92,6 +94,8 @@ struct upipe_wlin {
     struct upipe *out_qsrc;
     /** output */
     struct upipe *output;
+    /** remote thread running the bin */
+    struct upipe_worker_thread *thread;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -172,7 +176,7 @@ static struct upipe *_upipe_wlin_alloc(struct upipe_mgr *mgr,
 {
     struct upipe_wlin_mgr *wlin_mgr = upipe_wlin_mgr_from_upipe_mgr(mgr);
     if (unlikely(signature != UPIPE_WLIN_SIGNATURE ||
-                 wlin_mgr->xfer_mgr == NULL))
+                 !wlin_mgr->pool.nb))
         goto upipe_wlin_alloc_err;
     struct upipe *remote = va_arg(args, struct upipe *);
     struct uprobe *uprobe_remote = va_arg(args, struct uprobe *);
@@ -193,6 +197,8 @@ static struct upipe *_upipe_wlin_alloc(struct upipe_mgr *mgr,
     urefcount_init(upipe_wlin_to_urefcount_real(upipe_wlin), upipe_wlin_free);
     upipe_wlin_init_bin_input(upipe);
     upipe_wlin_init_bin_output(upipe, upipe_wlin_to_urefcount_real(upipe_wlin));
+    upipe_wlin->thread = upipe_worker_pool_pick(&wlin_mgr->pool);
+    struct upipe_mgr *xfer_mgr = upipe_wlin->thread->xfer_mgr;
 
     uprobe_init(&upipe_wlin->proxy_probe, upipe_wlin_proxy_probe, NULL);
     upipe_wlin->proxy_probe.refcount = upipe_wlin_to_urefcount_real(upipe_wlin);
@@ -237,7 +243,7 @@ static struct upipe *_upipe_wlin_alloc(struct upipe_mgr *mgr,
         upipe_release(last_remote);
         last_remote = tmp;
     }
-    struct upipe *last_remote_xfer = upipe_xfer_alloc(wlin_mgr->xfer_mgr,
+    struct upipe *last_remote_xfer = upipe_xfer_alloc(xfer_mgr,
             uprobe_pfx_alloc(uprobe_use(&upipe_wlin->proxy_probe),
                              UPROBE_LOG_VERBOSE, "lin_last_xfer"), last_remote);
     if (unlikely(last_remote_xfer == NULL)) {
@@ -252,7 +258,7 @@ static struct upipe *_upipe_wlin_alloc(struct upipe_mgr *mgr,
     struct upipe *remote_xfer;
     if (last_remote != remote) {
         upipe_use(remote);
-        remote_xfer = upipe_xfer_alloc(wlin_mgr->xfer_mgr,
+        remote_xfer = upipe_xfer_alloc(xfer_mgr,
                 uprobe_pfx_alloc(uprobe_use(&upipe_wlin->proxy_probe),
                                  UPROBE_LOG_VERBOSE, "lin_xfer"), remote);
         if (unlikely(remote_xfer == NULL)) {
@@ -288,7 +294,7 @@ static struct upipe *_upipe_wlin_alloc(struct upipe_mgr *mgr,
         upipe_set_max_length(upipe_wlin->in_qsink,
                                   in_queue_length - UINT8_MAX);
 
-    struct upipe *in_qsrc_xfer = upipe_xfer_alloc(wlin_mgr->xfer_mgr,
+    struct upipe *in_qsrc_xfer = upipe_xfer_alloc(xfer_mgr,
             uprobe_pfx_alloc(uprobe_use(&upipe_wlin->proxy_probe),
                              UPROBE_LOG_VERBOSE, "in_qsrc_xfer"),
             in_qsrc);
@@ -349,6 +355,7 @@ static void upipe_wlin_free(struct urefcount *urefcount_real)
     uprobe_clean(&upipe_wlin->last_inner_probe);
     uprobe_clean(&upipe_wlin->in_qsrc_probe);
     uprobe_clean(&upipe_wlin->out_qsrc_probe);
+    upipe_worker_pool_leave(upipe_wlin->thread);
     urefcount_clean(urefcount_real);
     upipe_wlin_clean_urefcount(upipe);
     upipe_clean(upipe);
@@ -377,7 +384,7 @@ static void upipe_wlin_mgr_free(struct urefcount *urefcount)
         upipe_wlin_mgr_from_urefcount(urefcount);
     upipe_mgr_release(wlin_mgr->qsrc_mgr);
     upipe_mgr_release(wlin_mgr->qsink_mgr);
-    upipe_mgr_release(wlin_mgr->xfer_mgr);
+    upipe_worker_pool_clean(&wlin_mgr->pool);
 
     urefcount_clean(urefcount);
     free(wlin_mgr);
@@ -417,6 +424,14 @@ static int upipe_wlin_mgr_control(struct upipe_mgr *mgr,
         GET_SET_MGR(qsink, QSINK)
 #undef GET_SET_MGR
 
+        case UPIPE_WLIN_MGR_ADD_XFER_MGR: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_WLIN_SIGNATURE)
+            if (!urefcount_single(&wlin_mgr->urefcount))
+                return UBASE_ERR_BUSY;
+            struct upipe_mgr *m = va_arg(args, struct upipe_mgr *);
+            return upipe_worker_pool_add(&wlin_mgr->pool, m);
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -437,7 +452,14 @@ struct upipe_mgr *upipe_wlin_mgr_alloc(struct upipe_mgr *xfer_mgr)
 
     wlin_mgr->qsrc_mgr = upipe_qsrc_mgr_alloc();
     wlin_mgr->qsink_mgr = upipe_qsink_mgr_alloc();
-    wlin_mgr->xfer_mgr = upipe_mgr_use(xfer_mgr);
+    upipe_worker_pool_init(&wlin_mgr->pool);
+    if (unlikely(!ubase_check(upipe_worker_pool_add(&wlin_mgr->pool,
+                                                    xfer_mgr)))) {
+        upipe_mgr_release(wlin_mgr->qsrc_mgr);
+        upipe_mgr_release(wlin_mgr->qsink_mgr);
+        free(wlin_mgr);
+        return NULL;
+    }
 
     urefcount_init(upipe_wlin_mgr_to_urefcount(wlin_mgr),
                    upipe_wlin_mgr_free);
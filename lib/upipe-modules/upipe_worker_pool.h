@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short common functions to spread worker bins over several threads
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_WORKER_POOL_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_WORKER_POOL_H_
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <assert.h>
+
+/** @internal @This describes a remote thread of a worker pool. */
+struct upipe_worker_thread {
+    /** xfer manager of the remote thread */
+    struct upipe_mgr *xfer_mgr;
+    /** number of bins currently running in the remote thread */
+    uatomic_uint32_t load;
+};
+
+/** @internal @This is a set of remote threads shared by worker bins. A bin
+ * is given to the least loaded thread when it is allocated, and all its
+ * inner pipes stay in that thread, so that urefs keep their order. */
+struct upipe_worker_pool {
+    /** number of remote threads */
+    unsigned int nb;
+    /** array of remote threads */
+    struct upipe_worker_thread *threads;
+};
+
+/** @internal @This initializes a worker pool.
+ *
+ * @param pool pointer to the worker pool
+ */
+static inline void upipe_worker_pool_init(struct upipe_worker_pool *pool)
+{
+    pool->nb = 0;
+    pool->threads = NULL;
+}
+
+/** @internal @This adds a remote thread to a worker pool. This may only be
+ * called when no bin is running.
+ *
+ * @param pool pointer to the worker pool
+ * @param xfer_mgr xfer manager of the remote thread
+ * @return an error code
+ */
+static inline int upipe_worker_pool_add(struct upipe_worker_pool *pool,
+                                        struct upipe_mgr *xfer_mgr)
+{
+    if (unlikely(xfer_mgr == NULL))
+        return UBASE_ERR_INVALID;
+    struct upipe_worker_thread *threads = realloc(pool->threads,
+            (pool->nb + 1) * sizeof(struct upipe_worker_thread));
+    if (unlikely(threads == NULL))
+        return UBASE_ERR_ALLOC;
+    pool->threads = threads;
+    threads[pool->nb].xfer_mgr = upipe_mgr_use(xfer_mgr);
+    uatomic_init(&threads[pool->nb].load, 0);
+    pool->nb++;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This picks the least loaded remote thread of a worker pool
+ * for a new bin.
+ *
+ * @param pool pointer to the worker pool
+ * @return pointer to the remote thread, or NULL if the pool is empty
+ */
+static inline struct upipe_worker_thread *
+    upipe_worker_pool_pick(struct upipe_worker_pool *pool)
+{
+    struct upipe_worker_thread *best = NULL;
+    uint32_t best_load = UINT32_MAX;
+    for (unsigned int i = 0; i < pool->nb; i++) {
+        uint32_t load = uatomic_load(&pool->threads[i].load);
+        if (load < best_load) {
+            best = &pool->threads[i];
+            best_load = load;
+        }
+    }
+    if (best != NULL)
+        uatomic_fetch_add(&best->load, 1);
+    return best;
+}
+
+/** @internal @This signals that a bin no longer runs in a remote thread.
+ * It may be called from any thread.
+ *
+ * @param thread pointer to the remote thread returned by
+ * @ref upipe_worker_pool_pick
+ */
+static inline void upipe_worker_pool_leave(struct upipe_worker_thread *thread)
+{
+    if (thread != NULL)
+        uatomic_fetch_sub(&thread->load, 1);
+}
+
+/** @internal @This cleans up a worker pool.
+ *
+ * @param pool pointer to the worker pool
+ */
+static inline void upipe_worker_pool_clean(struct upipe_worker_pool *pool)
+{
+    for (unsigned int i = 0; i < pool->nb; i++) {
+        upipe_mgr_release(pool->threads[i].xfer_mgr);
+        uatomic_clean(&pool->threads[i].load);
+    }
+    free(pool->threads);
+}
+
+#endif
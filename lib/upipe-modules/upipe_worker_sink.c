@@ -40,6 +40,8 @@
 #include <upipe-modules/upipe_queue_source.h>
 #include <upipe-modules/upipe_transfer.h>
 
+#include "upipe_worker_pool.h"
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
@@ -55,8 +57,8 @@ struct upipe_wsink_mgr {
     struct upipe_mgr *qsrc_mgr;
     /** pointer to queue sink manager */
     struct upipe_mgr *qsink_mgr;
-    /** pointer to source xfer manager */
-    struct upipe_mgr *xfer_mgr;
+    /** pool of remote threads */
+    struct upipe_worker_pool pool;
 
     /** public upipe_mgr structure */
     struct upipe_mgr mgr;
@@ -82,6 +84,8 @@ struct upipe_wsink {
 
     /** input queue sink (first inner pipe of the bin) */
     struct upipe *in_qsink;
+    /** remote thread running the bin */
+    struct upipe_worker_thread *thread;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -144,7 +148,7 @@ static struct upipe *_upipe_wsink_alloc(struct upipe_mgr *mgr,
 {
     struct upipe_wsink_mgr *wsink_mgr = upipe_wsink_mgr_from_upipe_mgr(mgr);
     if (unlikely(signature != UPIPE_WSINK_SIGNATURE ||
-                 wsink_mgr->xfer_mgr == NULL))
+                 !wsink_mgr->pool.nb))
         goto upipe_wsink_alloc_err;
     struct upipe *remote = va_arg(args, struct upipe *);
     struct uprobe *uprobe_remote = va_arg(args, struct uprobe *);
@@ -163,6 +167,8 @@ static struct upipe *_upipe_wsink_alloc(struct upipe_mgr *mgr,
     urefcount_init(upipe_wsink_to_urefcount_real(upipe_wsink),
                    upipe_wsink_free);
     upipe_wsink_init_bin_input(upipe);
+    upipe_wsink->thread = upipe_worker_pool_pick(&wsink_mgr->pool);
+    struct upipe_mgr *xfer_mgr = upipe_wsink->thread->xfer_mgr;
 
     uprobe_init(&upipe_wsink->proxy_probe, upipe_wsink_proxy_probe, NULL);
     upipe_wsink->proxy_probe.refcount =
@@ -175,7 +181,7 @@ static struct upipe *_upipe_wsink_alloc(struct upipe_mgr *mgr,
 
     /* remote */
     upipe_use(remote);
-    struct upipe *remote_xfer = upipe_xfer_alloc(wsink_mgr->xfer_mgr,
+    struct upipe *remote_xfer = upipe_xfer_alloc(xfer_mgr,
             uprobe_pfx_alloc(uprobe_use(&upipe_wsink->proxy_probe),
                              UPROBE_LOG_VERBOSE, "sink_xfer"), remote);
     if (unlikely(remote_xfer == NULL)) {
@@ -204,7 +210,7 @@ static struct upipe *_upipe_wsink_alloc(struct upipe_mgr *mgr,
     if (queue_length > UINT8_MAX)
         upipe_set_max_length(upipe_wsink->in_qsink, queue_length - UINT8_MAX);
 
-    struct upipe *in_qsrc_xfer = upipe_xfer_alloc(wsink_mgr->xfer_mgr,
+    struct upipe *in_qsrc_xfer = upipe_xfer_alloc(xfer_mgr,
             uprobe_pfx_alloc(uprobe_use(&upipe_wsink->proxy_probe),
                              UPROBE_LOG_VERBOSE, "in_qsrc_xfer"),
             in_qsrc);
@@ -243,6 +249,7 @@ static void upipe_wsink_free(struct urefcount *urefcount_real)
     upipe_throw_dead(upipe);
     uprobe_clean(&upipe_wsink->proxy_probe);
     uprobe_clean(&upipe_wsink->in_qsrc_probe);
+    upipe_worker_pool_leave(upipe_wsink->thread);
     urefcount_clean(urefcount_real);
     upipe_wsink_clean_urefcount(upipe);
     upipe_clean(upipe);
@@ -270,7 +277,7 @@ static void upipe_wsink_mgr_free(struct urefcount *urefcount)
         upipe_wsink_mgr_from_urefcount(urefcount);
     upipe_mgr_release(wsink_mgr->qsrc_mgr);
     upipe_mgr_release(wsink_mgr->qsink_mgr);
-    upipe_mgr_release(wsink_mgr->xfer_mgr);
+    upipe_worker_pool_clean(&wsink_mgr->pool);
 
     urefcount_clean(urefcount);
     free(wsink_mgr);
@@ -310,6 +317,14 @@ static int upipe_wsink_mgr_control(struct upipe_mgr *mgr,
         GET_SET_MGR(qsink, QSINK)
 #undef GET_SET_MGR
 
+        case UPIPE_WSINK_MGR_ADD_XFER_MGR: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_WSINK_SIGNATURE)
+            if (!urefcount_single(&wsink_mgr->urefcount))
+                return UBASE_ERR_BUSY;
+            struct upipe_mgr *m = va_arg(args, struct upipe_mgr *);
+            return upipe_worker_pool_add(&wsink_mgr->pool, m);
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -330,7 +345,14 @@ struct upipe_mgr *upipe_wsink_mgr_alloc(struct upipe_mgr *xfer_mgr)
 
     wsink_mgr->qsrc_mgr = upipe_qsrc_mgr_alloc();
     wsink_mgr->qsink_mgr = upipe_qsink_mgr_alloc();
-    wsink_mgr->xfer_mgr = upipe_mgr_use(xfer_mgr);
+    upipe_worker_pool_init(&wsink_mgr->pool);
+    if (unlikely(!ubase_check(upipe_worker_pool_add(&wsink_mgr->pool,
+                                                    xfer_mgr)))) {
+        upipe_mgr_release(wsink_mgr->qsrc_mgr);
+        upipe_mgr_release(wsink_mgr->qsink_mgr);
+        free(wsink_mgr);
+        return NULL;
+    }
 
     urefcount_init(upipe_wsink_mgr_to_urefcount(wsink_mgr),
                    upipe_wsink_mgr_free);
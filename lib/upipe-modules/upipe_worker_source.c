@@ -40,6 +40,8 @@
 #include <upipe-modules/upipe_queue_source.h>
 #include <upipe-modules/upipe_transfer.h>
 
+#include "upipe_worker_pool.h"
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
@@ -55,8 +57,8 @@ struct upipe_wsrc_mgr {
     struct upipe_mgr *qsrc_mgr;
     /** pointer to queue sink manager */
     struct upipe_mgr *qsink_mgr;
-    /** pointer to source xfer manager */
-    struct upipe_mgr *xfer_mgr;
+    /** pool of remote threads */
+    struct upipe_worker_pool pool;
 
     /** public upipe_mgr structure */
     struct upipe_mgr mgr;
@@ -87,6 +89,8 @@ struct upipe_wsrc {
     struct uchain output_request_list;
     /** output */
     struct upipe *output;
+    /** remote thread running the bin */
+    struct upipe_worker_thread *thread;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -150,7 +154,7 @@ static struct upipe *_upipe_wsrc_alloc(struct upipe_mgr *mgr,
 {
     struct upipe_wsrc_mgr *wsrc_mgr = upipe_wsrc_mgr_from_upipe_mgr(mgr);
     if (unlikely(signature != UPIPE_WSRC_SIGNATURE ||
-                 wsrc_mgr->xfer_mgr == NULL))
+                 !wsrc_mgr->pool.nb))
         goto upipe_wsrc_alloc_err;
     struct upipe *remote = va_arg(args, struct upipe *);
     struct uprobe *uprobe_remote = va_arg(args, struct uprobe *);
@@ -169,6 +173,8 @@ static struct upipe *_upipe_wsrc_alloc(struct upipe_mgr *mgr,
     urefcount_init(upipe_wsrc_to_urefcount_real(upipe_wsrc), upipe_wsrc_free);
     upipe_wsrc_init_bin_output(upipe, upipe_wsrc_to_urefcount_real(upipe_wsrc));
     upipe_wsrc->source = NULL;
+    upipe_wsrc->thread = upipe_worker_pool_pick(&wsrc_mgr->pool);
+    struct upipe_mgr *xfer_mgr = upipe_wsrc->thread->xfer_mgr;
 
     uprobe_init(&upipe_wsrc->proxy_probe, upipe_wsrc_proxy_probe, NULL);
     upipe_wsrc->proxy_probe.refcount = upipe_wsrc_to_urefcount_real(upipe_wsrc);
@@ -208,7 +214,7 @@ static struct upipe *_upipe_wsrc_alloc(struct upipe_mgr *mgr,
         upipe_release(last_remote);
         last_remote = tmp;
     }
-    struct upipe *last_remote_xfer = upipe_xfer_alloc(wsrc_mgr->xfer_mgr,
+    struct upipe *last_remote_xfer = upipe_xfer_alloc(xfer_mgr,
             uprobe_pfx_alloc(uprobe_use(&upipe_wsrc->proxy_probe),
                              UPROBE_LOG_VERBOSE, "src_last_xfer"), last_remote);
     if (unlikely(last_remote_xfer == NULL)) {
@@ -221,7 +227,7 @@ static struct upipe *_upipe_wsrc_alloc(struct upipe_mgr *mgr,
 
     /* remote */
     if (last_remote != remote) {
-        upipe_wsrc->source = upipe_xfer_alloc(wsrc_mgr->xfer_mgr,
+        upipe_wsrc->source = upipe_xfer_alloc(xfer_mgr,
                 uprobe_pfx_alloc(uprobe_use(&upipe_wsrc->proxy_probe),
                                  UPROBE_LOG_VERBOSE, "src_xfer"), remote);
         if (unlikely(upipe_wsrc->source == NULL)) {
@@ -261,6 +267,7 @@ static void upipe_wsrc_free(struct urefcount *urefcount_real)
     upipe_throw_dead(upipe);
     uprobe_clean(&upipe_wsrc->proxy_probe);
     uprobe_clean(&upipe_wsrc->last_inner_probe);
+    upipe_worker_pool_leave(upipe_wsrc->thread);
     urefcount_clean(urefcount_real);
     upipe_wsrc_clean_urefcount(upipe);
     upipe_clean(upipe);
@@ -290,7 +297,7 @@ static void upipe_wsrc_mgr_free(struct urefcount *urefcount)
         upipe_wsrc_mgr_from_urefcount(urefcount);
     upipe_mgr_release(wsrc_mgr->qsrc_mgr);
     upipe_mgr_release(wsrc_mgr->qsink_mgr);
-    upipe_mgr_release(wsrc_mgr->xfer_mgr);
+    upipe_worker_pool_clean(&wsrc_mgr->pool);
 
     urefcount_clean(urefcount);
     free(wsrc_mgr);
@@ -330,6 +337,14 @@ static int upipe_wsrc_mgr_control(struct upipe_mgr *mgr,
         GET_SET_MGR(qsink, QSINK)
 #undef GET_SET_MGR
 
+        case UPIPE_WSRC_MGR_ADD_XFER_MGR: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_WSRC_SIGNATURE)
+            if (!urefcount_single(&wsrc_mgr->urefcount))
+                return UBASE_ERR_BUSY;
+            struct upipe_mgr *m = va_arg(args, struct upipe_mgr *);
+            return upipe_worker_pool_add(&wsrc_mgr->pool, m);
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -350,7 +365,14 @@ struct upipe_mgr *upipe_wsrc_mgr_alloc(struct upipe_mgr *xfer_mgr)
 
     wsrc_mgr->qsrc_mgr = upipe_qsrc_mgr_alloc();
     wsrc_mgr->qsink_mgr = upipe_qsink_mgr_alloc();
-    wsrc_mgr->xfer_mgr = upipe_mgr_use(xfer_mgr);
+    upipe_worker_pool_init(&wsrc_mgr->pool);
+    if (unlikely(!ubase_check(upipe_worker_pool_add(&wsrc_mgr->pool,
+                                                    xfer_mgr)))) {
+        upipe_mgr_release(wsrc_mgr->qsrc_mgr);
+        upipe_mgr_release(wsrc_mgr->qsink_mgr);
+        free(wsrc_mgr);
+        return NULL;
+    }
 
     urefcount_init(upipe_wsrc_mgr_to_urefcount(wsrc_mgr),
                    upipe_wsrc_mgr_free);
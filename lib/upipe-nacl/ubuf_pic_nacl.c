@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ubuf manager for picture formats with NaCl image data storage
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/upool.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_pic_common.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe-nacl/ubuf_pic_nacl.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ppapi/c/pp_size.h>
+#include <ppapi/c/ppb_core.h>
+#include <ppapi_simple/ps.h>
+
+/** @This is the structure describing an image data resource, shared by all
+ * ubufs pointing to it. */
+struct ubuf_pic_nacl_image {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** pointer to the manager owning the pool */
+    struct ubuf_mgr *mgr;
+
+    /** handle to the image data resource, or 0 */
+    PP_Resource image;
+    /** size of the image */
+    struct PP_Size size;
+    /** stride of the image in octets */
+    int32_t stride;
+    /** mapped buffer of the image */
+    uint8_t *buffer;
+};
+
+UBASE_FROM_TO(ubuf_pic_nacl_image, urefcount, urefcount, urefcount)
+
+/** @This is a super-set of the @ref ubuf (and @ref ubuf_pic_common)
+ * structure with private fields pointing to shared data. */
+struct ubuf_pic_nacl {
+    /** pointer to shared structure */
+    struct ubuf_pic_nacl_image *shared;
+
+    /** common picture structure */
+    struct ubuf_pic_common ubuf_pic_common;
+};
+
+UBASE_FROM_TO(ubuf_pic_nacl, ubuf, ubuf, ubuf_pic_common.ubuf)
+
+/** @This is a super-set of the ubuf_mgr structure with additional local
+ * members. */
+struct ubuf_pic_nacl_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf pool */
+    struct upool ubuf_pool;
+    /** pool of released images */
+    struct upool image_pool;
+
+    /** pointer to NaCl core interface */
+    PPB_Core *ppb_core_interface;
+    /** pointer to NaCl imagedata interface */
+    PPB_ImageData *ppb_imagedata_interface;
+    /** image data format */
+    PP_ImageDataFormat format;
+
+    /** common picture management structure */
+    struct ubuf_pic_common_mgr common_mgr;
+
+    /** extra space for upools */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(ubuf_pic_nacl_mgr, ubuf_mgr, ubuf_mgr, common_mgr.mgr)
+UBASE_FROM_TO(ubuf_pic_nacl_mgr, urefcount, urefcount, urefcount)
+UBASE_FROM_TO(ubuf_pic_nacl_mgr, upool, ubuf_pool, ubuf_pool)
+UBASE_FROM_TO(ubuf_pic_nacl_mgr, upool, image_pool, image_pool)
+
+/** @internal @This unmaps and releases the resource of an image.
+ *
+ * @param pic_mgr pointer to ubuf_pic_nacl_mgr structure
+ * @param image pointer to image structure
+ */
+static void ubuf_pic_nacl_image_release(struct ubuf_pic_nacl_mgr *pic_mgr,
+                                        struct ubuf_pic_nacl_image *image)
+{
+    if (!image->image)
+        return;
+    pic_mgr->ppb_imagedata_interface->Unmap(image->image);
+    pic_mgr->ppb_core_interface->ReleaseResource(image->image);
+    image->image = 0;
+}
+
+/** @internal @This is called when the last ubuf pointing to an image is
+ * freed, and gives the image back to the pool.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void ubuf_pic_nacl_image_dead(struct urefcount *urefcount)
+{
+    struct ubuf_pic_nacl_image *image =
+        ubuf_pic_nacl_image_from_urefcount(urefcount);
+    struct ubuf_pic_nacl_mgr *pic_mgr =
+        ubuf_pic_nacl_mgr_from_ubuf_mgr(image->mgr);
+    upool_free(&pic_mgr->image_pool, image);
+}
+
+/** @internal @This returns an image of the given size, reusing a pooled
+ * image if it has the right size.
+ *
+ * @param mgr common management structure
+ * @param hsize horizontal size in pixels
+ * @param vsize vertical size in lines
+ * @return pointer to image or NULL in case of allocation error
+ */
+static struct ubuf_pic_nacl_image *
+    ubuf_pic_nacl_image_alloc(struct ubuf_mgr *mgr, int hsize, int vsize)
+{
+    struct ubuf_pic_nacl_mgr *pic_mgr = ubuf_pic_nacl_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_pic_nacl_image *image =
+        upool_alloc(&pic_mgr->image_pool, struct ubuf_pic_nacl_image *);
+    if (unlikely(image == NULL))
+        return NULL;
+
+    /* images of another size are dropped, the pool turns over after
+     * a change of the viewport */
+    if (image->image &&
+        (image->size.width != hsize || image->size.height != vsize))
+        ubuf_pic_nacl_image_release(pic_mgr, image);
+
+    if (!image->image) {
+        image->size.width = hsize;
+        image->size.height = vsize;
+        image->image = pic_mgr->ppb_imagedata_interface->Create(
+                PSGetInstanceId(), pic_mgr->format, &image->size, PP_FALSE);
+        if (unlikely(!image->image)) {
+            upool_free(&pic_mgr->image_pool, image);
+            return NULL;
+        }
+
+        struct PP_ImageDataDesc desc;
+        image->buffer = pic_mgr->ppb_imagedata_interface->Map(image->image);
+        if (unlikely(image->buffer == NULL ||
+                     !pic_mgr->ppb_imagedata_interface->Describe(image->image,
+                                                                 &desc))) {
+            ubuf_pic_nacl_image_release(pic_mgr, image);
+            upool_free(&pic_mgr->image_pool, image);
+            return NULL;
+        }
+        image->stride = desc.stride;
+    }
+
+    urefcount_init(ubuf_pic_nacl_image_to_urefcount(image),
+                   ubuf_pic_nacl_image_dead);
+    return image;
+}
+
+/** @This allocates a ubuf and an image data resource.
+ *
+ * @param mgr common management structure
+ * @param alloc_type must be UBUF_ALLOC_PICTURE (sentinel)
+ * @param args optional arguments (1st = hsize, 2nd = vsize)
+ * @return pointer to ubuf or NULL in case of allocation error
+ */
+static struct ubuf *ubuf_pic_nacl_alloc(struct ubuf_mgr *mgr,
+                                        uint32_t signature, va_list args)
+{
+    if (unlikely(signature != UBUF_ALLOC_PICTURE))
+        return NULL;
+
+    int hsize = va_arg(args, int);
+    int vsize = va_arg(args, int);
+    if (unlikely(!ubase_check(ubuf_pic_common_check_size(mgr, hsize, vsize))))
+        return NULL;
+
+    struct ubuf_pic_nacl_mgr *pic_mgr = ubuf_pic_nacl_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_pic_nacl *pic_nacl = upool_alloc(&pic_mgr->ubuf_pool,
+                                                 struct ubuf_pic_nacl *);
+    if (unlikely(pic_nacl == NULL))
+        return NULL;
+
+    struct ubuf *ubuf = ubuf_pic_nacl_to_ubuf(pic_nacl);
+    pic_nacl->shared = ubuf_pic_nacl_image_alloc(mgr, hsize, vsize);
+    if (unlikely(pic_nacl->shared == NULL)) {
+        upool_free(&pic_mgr->ubuf_pool, pic_nacl);
+        return NULL;
+    }
+
+    ubuf_pic_common_init(ubuf, 0, 0, hsize, 0, 0, vsize);
+    ubuf_pic_common_plane_init(ubuf, 0, pic_nacl->shared->buffer,
+                               pic_nacl->shared->stride);
+
+    ubuf_mgr_use(mgr);
+    return ubuf;
+}
+
+/** @This asks for the creation of a new reference to the same buffer space.
+ *
+ * @param ubuf pointer to ubuf
+ * @param new_ubuf_p reference written with a pointer to the newly allocated
+ * ubuf
+ * @return an error code
+ */
+static int ubuf_pic_nacl_dup(struct ubuf *ubuf, struct ubuf **new_ubuf_p)
+{
+    assert(new_ubuf_p != NULL);
+    struct ubuf_pic_nacl_mgr *pic_mgr =
+        ubuf_pic_nacl_mgr_from_ubuf_mgr(ubuf->mgr);
+    struct ubuf_pic_nacl *new_pic = upool_alloc(&pic_mgr->ubuf_pool,
+                                                struct ubuf_pic_nacl *);
+    if (unlikely(new_pic == NULL))
+        return UBASE_ERR_ALLOC;
+
+    struct ubuf_pic_nacl *pic_nacl = ubuf_pic_nacl_from_ubuf(ubuf);
+    new_pic->shared = pic_nacl->shared;
+    urefcount_use(ubuf_pic_nacl_image_to_urefcount(new_pic->shared));
+    ubuf_mgr_use(ubuf->mgr);
+
+    struct ubuf *new_ubuf = ubuf_pic_nacl_to_ubuf(new_pic);
+    if (unlikely(!ubase_check(ubuf_pic_common_dup(ubuf, new_ubuf)) ||
+                 !ubase_check(ubuf_pic_common_plane_dup(ubuf, new_ubuf, 0)))) {
+        ubuf_free(new_ubuf);
+        return UBASE_ERR_INVALID;
+    }
+    *new_ubuf_p = new_ubuf;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the image data resource of a ubuf covering the
+ * whole image.
+ *
+ * @param ubuf pointer to ubuf
+ * @param image_p filled in with the image data resource
+ * @return an error code
+ */
+static int ubuf_pic_nacl_get_image_internal(struct ubuf *ubuf,
+                                            PP_Resource *image_p)
+{
+    struct ubuf_pic_nacl_mgr *pic_mgr =
+        ubuf_pic_nacl_mgr_from_ubuf_mgr(ubuf->mgr);
+    struct ubuf_pic_nacl *pic_nacl = ubuf_pic_nacl_from_ubuf(ubuf);
+    size_t hsize, vsize;
+    uint8_t *buffer;
+    UBASE_RETURN(ubuf_pic_common_size(ubuf, &hsize, &vsize, NULL))
+    UBASE_RETURN(ubuf_pic_common_plane_map(ubuf,
+                pic_mgr->common_mgr.planes[0]->chroma, 0, 0, -1, -1, &buffer))
+    if (buffer != pic_nacl->shared->buffer ||
+        hsize != (size_t)pic_nacl->shared->size.width ||
+        vsize != (size_t)pic_nacl->shared->size.height)
+        return UBASE_ERR_INVALID;
+    if (image_p != NULL)
+        *image_p = pic_nacl->shared->image;
+    return UBASE_ERR_NONE;
+}
+
+/** @This handles control commands.
+ *
+ * @param ubuf pointer to ubuf
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int ubuf_pic_nacl_control(struct ubuf *ubuf, int command, va_list args)
+{
+    switch (command) {
+        case UBUF_DUP: {
+            struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
+            return ubuf_pic_nacl_dup(ubuf, new_ubuf_p);
+        }
+        case UBUF_SINGLE: {
+            struct ubuf_pic_nacl *pic = ubuf_pic_nacl_from_ubuf(ubuf);
+            return urefcount_single(
+                    ubuf_pic_nacl_image_to_urefcount(pic->shared)) ?
+                   UBASE_ERR_NONE : UBASE_ERR_BUSY;
+        }
+        case UBUF_SIZE_PICTURE: {
+            size_t *hsize_p = va_arg(args, size_t *);
+            size_t *vsize_p = va_arg(args, size_t *);
+            uint8_t *macropixel_p = va_arg(args, uint8_t *);
+            return ubuf_pic_common_size(ubuf, hsize_p, vsize_p, macropixel_p);
+        }
+        case UBUF_ITERATE_PICTURE_PLANE: {
+            const char **chroma_p = va_arg(args, const char **);
+            return ubuf_pic_common_plane_iterate(ubuf, chroma_p);
+        }
+        case UBUF_SIZE_PICTURE_PLANE: {
+            const char *chroma = va_arg(args, const char *);
+            size_t *stride_p = va_arg(args, size_t *);
+            uint8_t *hsub_p = va_arg(args, uint8_t *);
+            uint8_t *vsub_p = va_arg(args, uint8_t *);
+            uint8_t *macropixel_size_p = va_arg(args, uint8_t *);
+            return ubuf_pic_common_plane_size(ubuf, chroma, stride_p,
+                                              hsub_p, vsub_p,
+                                              macropixel_size_p);
+        }
+        case UBUF_READ_PICTURE_PLANE: {
+            const char *chroma = va_arg(args, const char *);
+            int hoffset = va_arg(args, int);
+            int voffset = va_arg(args, int);
+            int hsize = va_arg(args, int);
+            int vsize = va_arg(args, int);
+            uint8_t **buffer_p = va_arg(args, uint8_t **);
+            return ubuf_pic_common_plane_map(ubuf, chroma, hoffset, voffset,
+                                             hsize, vsize, buffer_p);
+        }
+        case UBUF_WRITE_PICTURE_PLANE: {
+            const char *chroma = va_arg(args, const char *);
+            int hoffset = va_arg(args, int);
+            int voffset = va_arg(args, int);
+            int hsize = va_arg(args, int);
+            int vsize = va_arg(args, int);
+            uint8_t **buffer_p = va_arg(args, uint8_t **);
+            /* an image may still be on screen while another ubuf points
+             * to it */
+            struct ubuf_pic_nacl *pic = ubuf_pic_nacl_from_ubuf(ubuf);
+            if (!urefcount_single(
+                        ubuf_pic_nacl_image_to_urefcount(pic->shared)))
+                return UBASE_ERR_BUSY;
+            return ubuf_pic_common_plane_map(ubuf, chroma, hoffset, voffset,
+                                             hsize, vsize, buffer_p);
+        }
+        case UBUF_UNMAP_PICTURE_PLANE: {
+            /* we don't actually care about the parameters */
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_RESIZE_PICTURE: {
+            int hskip = va_arg(args, int);
+            int vskip = va_arg(args, int);
+            int new_hsize = va_arg(args, int);
+            int new_vsize = va_arg(args, int);
+            return ubuf_pic_common_resize(ubuf, hskip, vskip,
+                                          new_hsize, new_vsize);
+        }
+        case UBUF_PIC_NACL_GET_IMAGE: {
+            UBASE_SIGNATURE_CHECK(args, UBUF_PIC_NACL_SIGNATURE)
+            PP_Resource *image_p = va_arg(args, PP_Resource *);
+            return ubuf_pic_nacl_get_image_internal(ubuf, image_p);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This recycles or frees a ubuf.
+ *
+ * @param ubuf pointer to a ubuf structure
+ */
+static void ubuf_pic_nacl_free(struct ubuf *ubuf)
+{
+    struct ubuf_mgr *mgr = ubuf->mgr;
+    struct ubuf_pic_nacl_mgr *pic_mgr = ubuf_pic_nacl_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_pic_nacl *pic_nacl = ubuf_pic_nacl_from_ubuf(ubuf);
+
+    ubuf_pic_common_clean(ubuf);
+    ubuf_pic_common_plane_clean(ubuf, 0);
+
+    urefcount_release(ubuf_pic_nacl_image_to_urefcount(pic_nacl->shared));
+    upool_free(&pic_mgr->ubuf_pool, pic_nacl);
+    ubuf_mgr_release(mgr);
+}
+
+/** @internal @This allocates the data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to ubuf_pic_nacl or NULL in case of allocation error
+ */
+static void *ubuf_pic_nacl_alloc_inner(struct upool *upool)
+{
+    struct ubuf_pic_nacl_mgr *pic_mgr = ubuf_pic_nacl_mgr_from_ubuf_pool(upool);
+    struct ubuf_mgr *mgr = ubuf_pic_nacl_mgr_to_ubuf_mgr(pic_mgr);
+    struct ubuf_pic_nacl *pic_nacl = malloc(sizeof(struct ubuf_pic_nacl) +
+                                            ubuf_pic_common_sizeof(mgr));
+    if (unlikely(pic_nacl == NULL))
+        return NULL;
+    struct ubuf *ubuf = ubuf_pic_nacl_to_ubuf(pic_nacl);
+    ubuf->mgr = mgr;
+    return pic_nacl;
+}
+
+/** @internal @This frees a ubuf_pic_nacl.
+ *
+ * @param upool pointer to upool
+ * @param _pic_nacl pointer to a ubuf_pic_nacl structure to free
+ */
+static void ubuf_pic_nacl_free_inner(struct upool *upool, void *_pic_nacl)
+{
+    struct ubuf_pic_nacl *pic_nacl = (struct ubuf_pic_nacl *)_pic_nacl;
+    free(pic_nacl);
+}
+
+/** @internal @This allocates an image structure, without resource.
+ *
+ * @param upool pointer to upool
+ * @return pointer to ubuf_pic_nacl_image or NULL in case of allocation error
+ */
+static void *ubuf_pic_nacl_image_alloc_inner(struct upool *upool)
+{
+    struct ubuf_pic_nacl_mgr *pic_mgr =
+        ubuf_pic_nacl_mgr_from_image_pool(upool);
+    struct ubuf_pic_nacl_image *image =
+        malloc(sizeof(struct ubuf_pic_nacl_image));
+    if (unlikely(image == NULL))
+        return NULL;
+    image->mgr = ubuf_pic_nacl_mgr_to_ubuf_mgr(pic_mgr);
+    image->image = 0;
+    image->buffer = NULL;
+    return image;
+}
+
+/** @internal @This frees an image structure and its resource.
+ *
+ * @param upool pointer to upool
+ * @param _image pointer to a ubuf_pic_nacl_image structure to free
+ */
+static void ubuf_pic_nacl_image_free_inner(struct upool *upool, void *_image)
+{
+    struct ubuf_pic_nacl_mgr *pic_mgr =
+        ubuf_pic_nacl_mgr_from_image_pool(upool);
+    struct ubuf_pic_nacl_image *image = (struct ubuf_pic_nacl_image *)_image;
+    ubuf_pic_nacl_image_release(pic_mgr, image);
+    free(image);
+}
+
+/** @This checks if the given flow format can be allocated with the manager.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param flow_format flow format to check
+ * @return an error code
+ */
+static int ubuf_pic_nacl_mgr_check(struct ubuf_mgr *mgr,
+                                   struct uref *flow_format)
+{
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_format, &def))
+    if (ubase_ncmp(def, "pic."))
+        return UBASE_ERR_INVALID;
+
+    uint8_t macropixel, planes;
+    uint8_t hmprepend = 0, hmappend = 0, vprepend = 0, vappend = 0;
+    UBASE_RETURN(uref_pic_flow_get_macropixel(flow_format, &macropixel))
+    UBASE_RETURN(uref_pic_flow_get_planes(flow_format, &planes))
+    uref_pic_flow_get_hmprepend(flow_format, &hmprepend);
+    uref_pic_flow_get_hmappend(flow_format, &hmappend);
+    uref_pic_flow_get_vprepend(flow_format, &vprepend);
+    uref_pic_flow_get_vappend(flow_format, &vappend);
+    if (macropixel != 1 || planes != 1 ||
+        hmprepend || hmappend || vprepend || vappend)
+        return UBASE_ERR_INVALID;
+
+    struct ubuf_pic_common_mgr *common_mgr =
+        ubuf_pic_common_mgr_from_ubuf_mgr(mgr);
+    return uref_pic_flow_check_chroma(flow_format, 1, 1, 4,
+                                      common_mgr->planes[0]->chroma);
+}
+
+/** @This handles manager control commands.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int ubuf_pic_nacl_mgr_control(struct ubuf_mgr *mgr,
+                                     int command, va_list args)
+{
+    switch (command) {
+        case UBUF_MGR_CHECK: {
+            struct uref *flow_format = va_arg(args, struct uref *);
+            return ubuf_pic_nacl_mgr_check(mgr, flow_format);
+        }
+        case UBUF_MGR_VACUUM: {
+            struct ubuf_pic_nacl_mgr *pic_mgr =
+                ubuf_pic_nacl_mgr_from_ubuf_mgr(mgr);
+            upool_vacuum(&pic_mgr->ubuf_pool);
+            upool_vacuum(&pic_mgr->image_pool);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a ubuf manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void ubuf_pic_nacl_mgr_free(struct urefcount *urefcount)
+{
+    struct ubuf_pic_nacl_mgr *pic_mgr =
+        ubuf_pic_nacl_mgr_from_urefcount(urefcount);
+    struct ubuf_mgr *mgr = ubuf_pic_nacl_mgr_to_ubuf_mgr(pic_mgr);
+    upool_clean(&pic_mgr->ubuf_pool);
+    upool_clean(&pic_mgr->image_pool);
+
+    ubuf_pic_common_mgr_clean(mgr);
+
+    urefcount_clean(urefcount);
+    free(pic_mgr);
+}
+
+/** @This allocates a new instance of the ubuf manager for picture formats
+ * using NaCl image data.
+ *
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param image_pool_depth maximum number of released images kept for reuse
+ * @param format image data format (normally the native format)
+ * @return pointer to manager, or NULL in case of error
+ */
+struct ubuf_mgr *ubuf_pic_nacl_mgr_alloc(uint16_t ubuf_pool_depth,
+                                         uint16_t image_pool_depth,
+                                         PP_ImageDataFormat format)
+{
+    const char *chroma;
+    switch (format) {
+        case PP_IMAGEDATAFORMAT_BGRA_PREMUL:
+            chroma = "b8g8r8a8";
+            break;
+        case PP_IMAGEDATAFORMAT_RGBA_PREMUL:
+            chroma = "r8g8b8a8";
+            break;
+        default:
+            return NULL;
+    }
+
+    struct ubuf_pic_nacl_mgr *pic_mgr =
+        malloc(sizeof(struct ubuf_pic_nacl_mgr) +
+               upool_sizeof(ubuf_pool_depth) + upool_sizeof(image_pool_depth));
+    if (unlikely(pic_mgr == NULL))
+        return NULL;
+
+    pic_mgr->ppb_core_interface =
+        (PPB_Core *)PSGetInterface(PPB_CORE_INTERFACE);
+    pic_mgr->ppb_imagedata_interface =
+        (PPB_ImageData *)PSGetInterface(PPB_IMAGEDATA_INTERFACE);
+    pic_mgr->format = format;
+    upool_init(&pic_mgr->ubuf_pool, ubuf_pool_depth, pic_mgr->upool_extra,
+               ubuf_pic_nacl_alloc_inner, ubuf_pic_nacl_free_inner);
+    upool_init(&pic_mgr->image_pool, image_pool_depth,
+               pic_mgr->upool_extra + upool_sizeof(ubuf_pool_depth),
+               ubuf_pic_nacl_image_alloc_inner,
+               ubuf_pic_nacl_image_free_inner);
+
+    struct ubuf_mgr *mgr = ubuf_pic_nacl_mgr_to_ubuf_mgr(pic_mgr);
+    ubuf_pic_common_mgr_init(mgr, 1);
+
+    urefcount_init(ubuf_pic_nacl_mgr_to_urefcount(pic_mgr),
+                   ubuf_pic_nacl_mgr_free);
+    pic_mgr->common_mgr.mgr.refcount = ubuf_pic_nacl_mgr_to_urefcount(pic_mgr);
+
+    mgr->signature = UBUF_ALLOC_PICTURE;
+    mgr->ubuf_alloc = ubuf_pic_nacl_alloc;
+    mgr->ubuf_control = ubuf_pic_nacl_control;
+    mgr->ubuf_free = ubuf_pic_nacl_free;
+    mgr->ubuf_mgr_control = ubuf_pic_nacl_mgr_control;
+
+    if (unlikely(!ubase_check(ubuf_pic_common_mgr_add_plane(mgr, chroma,
+                                                            1, 1, 4)))) {
+        ubuf_mgr_release(mgr);
+        return NULL;
+    }
+    return mgr;
+}
@@ -30,6 +30,8 @@
 #include <upipe/ulist.h>
 #include <upipe/uprobe.h>
 #include <upipe/uclock.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
 #include <upipe/uref.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uref_pic.h>
@@ -44,6 +46,7 @@
 #include <upipe/upipe_helper_input.h>
 #include <upipe/upipe_helper_uclock.h>
 #include <upipe-nacl/upipe_nacl_graphics2d.h>
+#include <upipe-nacl/ubuf_pic_nacl.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -64,6 +67,11 @@
 #include <ppapi/c/ppb_instance.h>
 #include <ppapi_simple/ps.h>
 
+/** depth of the pool of ubuf structures */
+#define UBUF_POOL_DEPTH 8
+/** number of released images kept for reuse */
+#define IMAGE_POOL_DEPTH 4
+
 /** @hidden */
 static bool upipe_nacl_g2d_output(struct upipe *upipe, struct uref *uref,
                                   struct upump **upump_p);
@@ -119,6 +127,10 @@ struct upipe_nacl_g2d {
     PP_ImageDataFormat native_imagedata_format;
     /** native chroma format */
     const char *native_chroma;
+    /** ubuf manager allocating pictures in image data */
+    struct ubuf_mgr *ubuf_mgr;
+    /** picture currently replacing the contents of the g2d context */
+    struct ubuf *displayed;
 
     /** upump manager */
     struct upump_mgr *upump_mgr;
@@ -191,6 +203,11 @@ static struct upipe *upipe_nacl_g2d_alloc(struct upipe_mgr *mgr,
             break;
     }
     upipe_nacl_g2d->g2d = 0;
+    upipe_nacl_g2d->displayed = NULL;
+    upipe_nacl_g2d->ubuf_mgr =
+        ubuf_pic_nacl_mgr_alloc(UBUF_POOL_DEPTH, IMAGE_POOL_DEPTH,
+                                upipe_nacl_g2d->native_imagedata_format);
+    assert(upipe_nacl_g2d->ubuf_mgr != NULL);
 
     upipe_throw_ready(upipe);
     upipe_nacl_g2d_check_upump_mgr(upipe);
@@ -198,6 +215,63 @@ static struct upipe *upipe_nacl_g2d_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This copies a picture which was not allocated by our ubuf
+ * manager (or not at the size of the viewport) into image data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @return pointer to a ubuf from our ubuf manager, or NULL in case of error
+ */
+static struct ubuf *upipe_nacl_g2d_copy(struct upipe *upipe,
+                                        struct uref *uref)
+{
+    struct upipe_nacl_g2d *upipe_nacl_g2d = upipe_nacl_g2d_from_upipe(upipe);
+    size_t hsize, vsize, stride;
+    const uint8_t *src = NULL;
+    if (unlikely(!ubase_check(uref_pic_size(uref, &hsize, &vsize, NULL)) ||
+                 !ubase_check(uref_pic_plane_size(uref,
+                        upipe_nacl_g2d->native_chroma, &stride,
+                        NULL, NULL, NULL)) ||
+                 !ubase_check(uref_pic_plane_read(uref,
+                        upipe_nacl_g2d->native_chroma, 0, 0, -1, -1,
+                        &src)))) {
+        upipe_warn(upipe, "unable to map picture plane");
+        return NULL;
+    }
+
+    struct ubuf *ubuf = ubuf_pic_alloc(upipe_nacl_g2d->ubuf_mgr,
+                                       upipe_nacl_g2d->width,
+                                       upipe_nacl_g2d->height);
+    size_t dst_stride;
+    uint8_t *dst;
+    if (unlikely(ubuf == NULL ||
+                 !ubase_check(ubuf_pic_plane_size(ubuf,
+                        upipe_nacl_g2d->native_chroma, &dst_stride,
+                        NULL, NULL, NULL)) ||
+                 !ubase_check(ubuf_pic_plane_write(ubuf,
+                        upipe_nacl_g2d->native_chroma, 0, 0, -1, -1,
+                        &dst)))) {
+        uref_pic_plane_unmap(uref, upipe_nacl_g2d->native_chroma,
+                             0, 0, -1, -1);
+        if (ubuf != NULL)
+            ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return NULL;
+    }
+
+    if (hsize > upipe_nacl_g2d->width)
+        hsize = upipe_nacl_g2d->width;
+    if (vsize > upipe_nacl_g2d->height)
+        vsize = upipe_nacl_g2d->height;
+    for (int y = 0; y < vsize; y++)
+        memcpy(dst + y * dst_stride, src + y * stride, 4 * hsize);
+
+    ubuf_pic_plane_unmap(ubuf, upipe_nacl_g2d->native_chroma, 0, 0, -1, -1);
+    uref_pic_plane_unmap(uref, upipe_nacl_g2d->native_chroma,
+                         0, 0, -1, -1);
+    return ubuf;
+}
+
 /** @internal @This handles input pics.
  *
  * @param upipe description structure of the pipe
@@ -239,42 +313,23 @@ static bool upipe_nacl_g2d_output(struct upipe *upipe, struct uref *uref,
             upipe_warn(upipe, "received non-dated buffer");
     }
 
-    size_t hsize, vsize, stride;
-    const uint8_t *src = NULL;
-    if (unlikely(!ubase_check(uref_pic_size(uref, &hsize, &vsize, NULL)) ||
-                 !ubase_check(uref_pic_plane_size(uref,
-                        upipe_nacl_g2d->native_chroma, &stride,
-                        NULL, NULL, NULL)) ||
-                 !ubase_check(uref_pic_plane_read(uref,
-                        upipe_nacl_g2d->native_chroma, 0, 0, -1, -1,
-                        &src)))) {
-        upipe_warn(upipe, "unable to map picture plane");
-        uref_free(uref);
+    struct ubuf *ubuf;
+    size_t hsize, vsize;
+    if (uref->ubuf != NULL && uref->ubuf->mgr == upipe_nacl_g2d->ubuf_mgr &&
+        ubase_check(ubuf_pic_nacl_get_image(uref->ubuf, NULL)) &&
+        ubase_check(uref_pic_size(uref, &hsize, &vsize, NULL)) &&
+        hsize == upipe_nacl_g2d->width && vsize == upipe_nacl_g2d->height)
+        /* the picture was allocated in image data of the size of the
+         * viewport, display it directly */
+        ubuf = uref_detach_ubuf(uref);
+    else
+        ubuf = upipe_nacl_g2d_copy(upipe, uref);
+    uref_free(uref);
+    if (unlikely(ubuf == NULL))
         return true;
-    }
-
-    struct PP_Size size;
-    size.width = upipe_nacl_g2d->width;
-    size.height = upipe_nacl_g2d->height;
-    PP_Resource image =
-        upipe_nacl_g2d->ppb_imagedata_interface->Create(PSGetInstanceId(),
-            upipe_nacl_g2d->native_imagedata_format, &size, PP_FALSE);
-    assert(image);
-
-    struct PP_ImageDataDesc desc;
-    upipe_nacl_g2d->ppb_imagedata_interface->Describe(image, &desc);
-    uint8_t *dst = upipe_nacl_g2d->ppb_imagedata_interface->Map(image);
-
-    /* TODO: it is possible to avoid this memcpy by creating a ubuf manager
-     * allowing swscale to write directly into the image buffer. However
-     * the best would be to use graphics3d-accelerated YUV transform. */
-    for (int y = 0; y < vsize; y++)
-        memcpy(dst + y * desc.stride, src + y * stride, 4 * hsize);
-
-    upipe_nacl_g2d->ppb_imagedata_interface->Unmap(image);  
-    uref_pic_plane_unmap(uref, upipe_nacl_g2d->native_chroma,
-                         0, 0, -1, -1);
 
+    PP_Resource image;
+    ubase_assert(ubuf_pic_nacl_get_image(ubuf, &image));
     upipe_nacl_g2d->ppb_g2d_interface->ReplaceContents(
             upipe_nacl_g2d->g2d, image);
 
@@ -285,8 +340,11 @@ static bool upipe_nacl_g2d_output(struct upipe *upipe, struct uref *uref,
     if (unlikely(err != PP_OK))
         upipe_warn_va(upipe, "g2d flush returned error %"PRId32, err);
 
-    upipe_nacl_g2d->ppb_core_interface->ReleaseResource(image);
-    uref_free(uref);
+    /* the previous image is no longer on screen once the flush completed,
+     * and may go back to the pool */
+    if (upipe_nacl_g2d->displayed != NULL)
+        ubuf_free(upipe_nacl_g2d->displayed);
+    upipe_nacl_g2d->displayed = ubuf;
     return true;
 }
 
@@ -364,6 +422,10 @@ static int upipe_nacl_g2d_update_size(struct upipe *upipe,
         return UBASE_ERR_NONE;
 
     upipe_nacl_g2d->ppb_core_interface->ReleaseResource(upipe_nacl_g2d->g2d);
+    if (upipe_nacl_g2d->displayed != NULL) {
+        ubuf_free(upipe_nacl_g2d->displayed);
+        upipe_nacl_g2d->displayed = NULL;
+    }
 
     upipe_notice_va(upipe, "configuring for %ux%u", width, height);
     struct PP_Size size;
@@ -448,6 +510,15 @@ static int upipe_nacl_g2d_register_request(struct upipe *upipe,
                                            struct urequest *request)
 {
     struct upipe_nacl_g2d *upipe_nacl_g2d = upipe_nacl_g2d_from_upipe(upipe);
+    if (request->type == UREQUEST_UBUF_MGR && request->uref != NULL &&
+        ubase_check(ubuf_mgr_check(upipe_nacl_g2d->ubuf_mgr,
+                                   request->uref))) {
+        /* have upstream allocate pictures directly in image data */
+        struct uref *flow_format = uref_dup(request->uref);
+        UBASE_ALLOC_RETURN(flow_format)
+        return urequest_provide_ubuf_mgr(request,
+                ubuf_mgr_use(upipe_nacl_g2d->ubuf_mgr), flow_format);
+    }
     if (request->type != UREQUEST_FLOW_FORMAT)
         return upipe_throw_provide_request(upipe, request);
 
@@ -540,6 +611,9 @@ static void upipe_nacl_g2d_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     upipe_nacl_g2d->ppb_core_interface->ReleaseResource(upipe_nacl_g2d->g2d);
+    if (upipe_nacl_g2d->displayed != NULL)
+        ubuf_free(upipe_nacl_g2d->displayed);
+    ubuf_mgr_release(upipe_nacl_g2d->ubuf_mgr);
 
     struct uchain *uchain, *uchain_tmp;
     ulist_delete_foreach (&upipe_nacl_g2d->urequests, uchain, uchain_tmp) {
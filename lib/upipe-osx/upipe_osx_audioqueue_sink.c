@@ -25,23 +25,30 @@
 
 /** @file
  * @short Upipe OSX_AUDIOQUEUE (OpenGL/X11) sink module
+ *
+ * The AudioQueue pulls samples from a fixed ring of preallocated buffers:
+ * each time a buffer has been played, the callback refills it from a
+ * lock-free queue of urefs fed by the pipeline thread, and enqueues it
+ * again. The output latency is thus bounded by the size of the ring.
  */
 
-/* FIXME this pipe does NOT work (port me to latest upipe API please) */
-
 #include <upipe/ubase.h>
 #include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uqueue.h>
 #include <upipe/ubuf.h>
 #include <upipe/uref.h>
 #include <upipe/uref_attr.h>
 #include <upipe/uref_flow.h>
+#include <upipe/uref_sound.h>
 #include <upipe/uref_sound_flow.h>
-#include <upipe/uref_block.h>
 #include <upipe/upump.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
-#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_input.h>
 #include <upipe-osx/upipe_osx_audioqueue_sink.h>
 
 #include <stdlib.h>
@@ -55,24 +62,69 @@
 
 #include <AudioToolbox/AudioToolbox.h>
 
+/** we expect packed s16 sound */
+#define EXPECTED_FLOW_DEF "sound.s16."
+/** maximum length of the queue of urefs between the threads */
+#define MAX_QUEUE_LENGTH 8
+/** number of AudioQueue buffers in the ring */
+#define NB_BUFFERS 3
+/** number of samples per AudioQueue buffer */
+#define BUFFER_SAMPLES 512
+
+/** @internal upipe_osx_audioqueue_sink private structure */
 struct upipe_osx_audioqueue_sink {
     /** refcount management structure */
     struct urefcount urefcount;
 
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** write watcher */
+    struct upump *upump;
+
     /** audioqueue */
     AudioQueueRef queue;
+    /** ring of preallocated audioqueue buffers */
+    AudioQueueBufferRef qbufs[NB_BUFFERS];
     /** sound volume */
     float volume;
+    /** sample rate */
+    uint64_t rate;
+    /** size of a sample in octets */
+    uint8_t sample_size;
+    /** channel type of the plane */
+    char *channel;
+
+    /** uref being played (accessed from the audioqueue thread) */
+    struct uref *uref;
+    /** queue of urefs to play */
+    struct uqueue uqueue;
+
+    /** temporary uref storage */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers */
+    struct uchain blockers;
 
     /** public upipe structure */
     struct upipe upipe;
+
+    /** extra data for the queue structure */
+    uint8_t uqueue_extra[];
 };
 
 UPIPE_HELPER_UPIPE(upipe_osx_audioqueue_sink, upipe, UPIPE_OSX_AUDIOQUEUE_SINK_SIGNATURE);
 UPIPE_HELPER_UREFCOUNT(upipe_osx_audioqueue_sink, urefcount, upipe_osx_audioqueue_sink_free)
-UPIPE_HELPER_VOID(upipe_osx_audioqueue_sink)
+UPIPE_HELPER_UPUMP_MGR(upipe_osx_audioqueue_sink, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_osx_audioqueue_sink, upump, upump_mgr)
+UPIPE_HELPER_INPUT(upipe_osx_audioqueue_sink, urefs, nb_urefs, max_urefs, blockers, NULL)
 
-/** @internal @This is called by AudioQueue after reading a buffer
+/** @internal @This is called by AudioQueue after reading a buffer, and
+ * refills it from the queue of urefs (with silence in case of underflow).
+ * Please note that this function runs in the audioqueue thread.
+ *
  * @param _upipe description structure of the pipe (void)
  * @param queue AudioQueue
  * @param qbuf AudioQueue buffer
@@ -80,13 +132,49 @@ UPIPE_HELPER_VOID(upipe_osx_audioqueue_sink)
 static void upipe_osx_audioqueue_sink_cb(void *_upipe, AudioQueueRef queue,
                                          struct AudioQueueBuffer *qbuf)
 {
-/* TODO uncblock ? */
-#if 0
-    struct upump_mgr *upump_mgr = qbuf->mUserData;
-    upump_mgr_sink_unblock(upump_mgr);
-    upump_mgr_release(upump_mgr);
-#endif
-    AudioQueueFreeBuffer(queue, qbuf);
+    struct upipe *upipe = (struct upipe *)_upipe;
+    struct upipe_osx_audioqueue_sink *osx_audioqueue =
+                 upipe_osx_audioqueue_sink_from_upipe(upipe);
+    uint8_t *buffer = qbuf->mAudioData;
+    size_t samples = qbuf->mAudioDataBytesCapacity /
+                     osx_audioqueue->sample_size;
+
+    while (samples > 0) {
+        if (osx_audioqueue->uref == NULL)
+            osx_audioqueue->uref = uqueue_pop(&osx_audioqueue->uqueue,
+                                              struct uref *);
+        struct uref *uref = osx_audioqueue->uref;
+        if (unlikely(uref == NULL)) {
+            memset(buffer, 0, samples * osx_audioqueue->sample_size);
+            break;
+        }
+
+        size_t size;
+        const uint8_t *uref_buffer;
+        if (unlikely(!ubase_check(uref_sound_size(uref, &size, NULL)) ||
+                     !ubase_check(uref_sound_plane_read_uint8_t(uref,
+                             osx_audioqueue->channel, 0, -1,
+                             &uref_buffer)))) {
+            osx_audioqueue->uref = NULL;
+            uref_free(uref);
+            continue;
+        }
+
+        size_t copied = size < samples ? size : samples;
+        memcpy(buffer, uref_buffer, copied * osx_audioqueue->sample_size);
+        uref_sound_plane_unmap(uref, osx_audioqueue->channel, 0, -1);
+        buffer += copied * osx_audioqueue->sample_size;
+        samples -= copied;
+
+        if (copied == size) {
+            osx_audioqueue->uref = NULL;
+            uref_free(uref);
+        } else
+            uref_sound_resize(uref, copied, -1);
+    }
+
+    qbuf->mAudioDataByteSize = qbuf->mAudioDataBytesCapacity;
+    AudioQueueEnqueueBuffer(queue, qbuf, 0, NULL);
 }
 
 /** @internal @This destroys the current audioqueue
@@ -100,47 +188,80 @@ static void upipe_osx_audioqueue_sink_remove(struct upipe *upipe)
         return;
     }
 
+    /* also frees the buffers of the ring */
     AudioQueueStop(osx_audioqueue->queue, true);
     AudioQueueDispose(osx_audioqueue->queue, true);
     osx_audioqueue->queue = NULL;
+
+    struct uref *uref;
+    while ((uref = uqueue_pop(&osx_audioqueue->uqueue,
+                              struct uref *)) != NULL)
+        uref_free(uref);
+    if (osx_audioqueue->uref != NULL) {
+        uref_free(osx_audioqueue->uref);
+        osx_audioqueue->uref = NULL;
+    }
     upipe_notice(upipe, "audioqueue destroyed");
 }
 
-/** @internal @This handles audio input.
+/** @internal @This is called when the queue can be written again.
+ * Unblock the sink.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_osx_audioqueue_sink_watcher(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    if (upipe_osx_audioqueue_sink_output_input(upipe)) {
+        upump_stop(upump);
+    }
+    upipe_osx_audioqueue_sink_unblock_input(upipe);
+}
+
+/** @internal @This checks and creates the upump watcher to wait for the
+ * availability of the queue.
  *
  * @param upipe description structure of the pipe
- * @param uref uref structure
- * @param upump_p reference to upump structure
+ * @return false in case of error
  */
-static void upipe_osx_audioqueue_sink_input_audio(struct upipe *upipe,
-                                        struct uref *uref, struct upump **upump_p)
+static bool upipe_osx_audioqueue_sink_check_watcher(struct upipe *upipe)
 {
     struct upipe_osx_audioqueue_sink *osx_audioqueue =
                  upipe_osx_audioqueue_sink_from_upipe(upipe);
-    struct AudioQueueBuffer *qbuf;
-    size_t size = 0;
-
-    if (unlikely(!ubase_check(uref_block_size(uref, &size)))) {
-        upipe_warn(upipe, "could not get block size");
-        uref_free(uref);
-        return;
+    if (likely(osx_audioqueue->upump != NULL))
+        return true;
+
+    upipe_osx_audioqueue_sink_check_upump_mgr(upipe);
+    if (osx_audioqueue->upump_mgr == NULL)
+        return false;
+
+    struct upump *upump =
+        uqueue_upump_alloc_push(&osx_audioqueue->uqueue,
+                                osx_audioqueue->upump_mgr,
+                                upipe_osx_audioqueue_sink_watcher, upipe);
+    if (unlikely(upump == NULL)) {
+        upipe_err_va(upipe, "can't create watcher");
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return false;
     }
+    upipe_osx_audioqueue_sink_set_upump(upipe, upump);
+    return true;
+}
 
-    /* TODO block ? */
-    #if 0
-    upump_mgr_use(upump->mgr);
-    upump_mgr_sink_block(upump->mgr);
-    #endif
-
-    /* allocate queue buf, extract block, enqueue
-     * Audioqueue has no support for "external" buffers */
-    AudioQueueAllocateBuffer(osx_audioqueue->queue, size, &qbuf);
-    uref_block_extract(uref, 0, -1, qbuf->mAudioData);
-    qbuf->mAudioDataByteSize = size;
-    qbuf->mUserData = (*upump_p)->mgr;
-    AudioQueueEnqueueBuffer(osx_audioqueue->queue, qbuf, 0, NULL);
-
-    uref_free(uref);
+/** @internal @This handles data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to upump structure
+ * @return true if the uref was handled
+ */
+static bool upipe_osx_audioqueue_sink_handle(struct upipe *upipe,
+                                             struct uref *uref,
+                                             struct upump **upump_p)
+{
+    struct upipe_osx_audioqueue_sink *osx_audioqueue =
+                 upipe_osx_audioqueue_sink_from_upipe(upipe);
+    return uqueue_push(&osx_audioqueue->uqueue, uref);
 }
 
 /** @internal @This handles input.
@@ -168,10 +289,22 @@ static void upipe_osx_audioqueue_sink_input(struct upipe *upipe,
         return;
     }
 
-    upipe_osx_audioqueue_sink_input_audio(upipe, uref, upump_p);
+    if (!upipe_osx_audioqueue_sink_check_input(upipe)) {
+        upipe_osx_audioqueue_sink_hold_input(upipe, uref);
+        upipe_osx_audioqueue_sink_block_input(upipe, upump_p);
+    } else if (!upipe_osx_audioqueue_sink_handle(upipe, uref, upump_p)) {
+        if (!upipe_osx_audioqueue_sink_check_watcher(upipe)) {
+            upipe_warn(upipe, "unable to spool uref");
+            uref_free(uref);
+            return;
+        }
+        upipe_osx_audioqueue_sink_hold_input(upipe, uref);
+        upipe_osx_audioqueue_sink_block_input(upipe, upump_p);
+        upump_start(osx_audioqueue->upump);
+    }
 }
 
-/** @internal @This creates a new audioqueue
+/** @internal @This creates a new audioqueue and its ring of buffers
  * @param upipe description structure of the pipe
  * @param flow description structure of the flow
  * @return an error code
@@ -183,18 +316,37 @@ static int upipe_osx_audioqueue_sink_set_flow_def(struct upipe *upipe,
     uint64_t sample_rate = 0; /* hush gcc */
     uint8_t channels = 0;
     uint8_t sample_size = 0;
+    uint8_t planes = 0;
+    const char *channel;
     struct AudioStreamBasicDescription fmt;
     struct upipe_osx_audioqueue_sink *osx_audioqueue =
                  upipe_osx_audioqueue_sink_from_upipe(upipe);
 
+    if (flow == NULL)
+        return UBASE_ERR_INVALID;
+
+    /* retrieve flow format information */
+    UBASE_RETURN(uref_flow_match_def(flow, EXPECTED_FLOW_DEF))
+    UBASE_RETURN(uref_sound_flow_get_rate(flow, &sample_rate))
+    UBASE_RETURN(uref_sound_flow_get_sample_size(flow, &sample_size))
+    UBASE_RETURN(uref_sound_flow_get_channels(flow, &channels))
+    UBASE_RETURN(uref_sound_flow_get_planes(flow, &planes))
+    UBASE_RETURN(uref_sound_flow_get_channel(flow, &channel, 0))
+    if (unlikely(planes != 1 || !channels || sample_size != 2 * channels)) {
+        upipe_warn(upipe, "only packed s16 sound is supported");
+        return UBASE_ERR_INVALID;
+    }
+
+    char *channel_dup = strdup(channel);
+    UBASE_ALLOC_RETURN(channel_dup)
+
     if (unlikely(osx_audioqueue->queue)) {
         upipe_osx_audioqueue_sink_remove(upipe);
     }
-
-    /* retrieve flow format information */
-    uref_sound_flow_get_rate(flow, &sample_rate);
-    uref_sound_flow_get_sample_size(flow, &sample_size);
-    uref_sound_flow_get_channels(flow, &channels);
+    free(osx_audioqueue->channel);
+    osx_audioqueue->channel = channel_dup;
+    osx_audioqueue->rate = sample_rate;
+    osx_audioqueue->sample_size = sample_size;
 
     /* build format description */
     memset(&fmt, 0, sizeof(struct AudioStreamBasicDescription));
@@ -203,25 +355,40 @@ static int upipe_osx_audioqueue_sink_set_flow_def(struct upipe *upipe,
     fmt.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
     fmt.mFramesPerPacket = 1;
     fmt.mChannelsPerFrame = channels;
-    fmt.mBytesPerPacket = fmt.mBytesPerFrame = sample_size * channels;
-    fmt.mBitsPerChannel = sample_size * 8;
+    fmt.mBytesPerPacket = fmt.mBytesPerFrame = sample_size;
+    fmt.mBitsPerChannel = 16;
 
-    /* create queue */
+    /* create queue, the callback runs in an internal thread */
     status = AudioQueueNewOutput(&fmt, upipe_osx_audioqueue_sink_cb, upipe,
-                       NULL, kCFRunLoopCommonModes, 0, &osx_audioqueue->queue);
-    if (unlikely(status == kAudioFormatUnsupportedDataFormatError)) {
+                                 NULL, NULL, 0, &osx_audioqueue->queue);
+    if (unlikely(status != noErr)) {
         upipe_warn(upipe, "unsupported data format");
+        osx_audioqueue->queue = NULL;
         return UBASE_ERR_EXTERNAL;
     }
 
+    /* preallocate the ring and prime it with silence */
+    for (int i = 0; i < NB_BUFFERS; i++) {
+        status = AudioQueueAllocateBuffer(osx_audioqueue->queue,
+                                          BUFFER_SAMPLES * sample_size,
+                                          &osx_audioqueue->qbufs[i]);
+        if (unlikely(status != noErr)) {
+            upipe_err(upipe, "unable to allocate audioqueue buffers");
+            upipe_osx_audioqueue_sink_remove(upipe);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_osx_audioqueue_sink_cb(upipe, osx_audioqueue->queue,
+                                     osx_audioqueue->qbufs[i]);
+    }
+
     /* change volume */
     AudioQueueSetParameter(osx_audioqueue->queue, kAudioQueueParam_Volume, 
                            osx_audioqueue->volume);
 
     /* start queue ! */
     AudioQueueStart(osx_audioqueue->queue, NULL);
-    upipe_notice_va(upipe, "audioqueue started (%uHz, %hhuch, %db)",
-                        sample_rate, channels, sample_size*8);
+    upipe_notice_va(upipe, "audioqueue started (%"PRIu64"Hz, %"PRIu8"ch)",
+                    sample_rate, channels);
 
     return UBASE_ERR_NONE;
 }
@@ -234,12 +401,23 @@ static int upipe_osx_audioqueue_sink_set_flow_def(struct upipe *upipe,
  * @param args arguments of the command
  * @return an error code
  */
-static int upipe_osx_audioqueue_sink_control(struct upipe *upipe,
-                                             int command, va_list args)
+static int _upipe_osx_audioqueue_sink_control(struct upipe *upipe,
+                                              int command, va_list args)
 {
+    struct upipe_osx_audioqueue_sink *osx_audioqueue =
+                 upipe_osx_audioqueue_sink_from_upipe(upipe);
+
     switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_osx_audioqueue_sink_set_upump(upipe, NULL);
+            return upipe_osx_audioqueue_sink_attach_upump_mgr(upipe);
         case UPIPE_REGISTER_REQUEST: {
             struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_SINK_LATENCY &&
+                osx_audioqueue->rate)
+                return urequest_provide_sink_latency(request,
+                    (uint64_t)NB_BUFFERS * BUFFER_SAMPLES * UCLOCK_FREQ /
+                    osx_audioqueue->rate);
             return upipe_throw_provide_request(upipe, request);
         }
         case UPIPE_UNREGISTER_REQUEST:
@@ -253,6 +431,28 @@ static int upipe_osx_audioqueue_sink_control(struct upipe *upipe,
     }
 }
 
+/** @internal @This processes control commands on the pipe, and restarts
+ * the watcher if the sink is blocked.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_osx_audioqueue_sink_control(struct upipe *upipe,
+                                             int command, va_list args)
+{
+    UBASE_RETURN(_upipe_osx_audioqueue_sink_control(upipe, command, args));
+
+    struct upipe_osx_audioqueue_sink *osx_audioqueue =
+                 upipe_osx_audioqueue_sink_from_upipe(upipe);
+    if (unlikely(!upipe_osx_audioqueue_sink_check_input(upipe)) &&
+        upipe_osx_audioqueue_sink_check_watcher(upipe))
+        upump_start(osx_audioqueue->upump);
+
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This allocates a osx_audioqueue_sink pipe.
  *
  * @param mgr common management structure
@@ -265,16 +465,32 @@ static struct upipe *upipe_osx_audioqueue_sink_alloc(struct upipe_mgr *mgr,
                                         struct uprobe *uprobe,
                                         uint32_t signature, va_list args)
 {
-    struct upipe *upipe = upipe_osx_audioqueue_sink_alloc_void(mgr, uprobe,
-                                        signature, args);
-    if (unlikely(upipe == NULL))
+    if (signature != UPIPE_VOID_SIGNATURE)
         return NULL;
-
     struct upipe_osx_audioqueue_sink *osx_audioqueue =
-        upipe_osx_audioqueue_sink_from_upipe(upipe);
+        malloc(sizeof(struct upipe_osx_audioqueue_sink) +
+               uqueue_sizeof(MAX_QUEUE_LENGTH));
+    if (unlikely(osx_audioqueue == NULL))
+        return NULL;
+
+    if (unlikely(!uqueue_init(&osx_audioqueue->uqueue, MAX_QUEUE_LENGTH,
+                              osx_audioqueue->uqueue_extra))) {
+        free(osx_audioqueue);
+        return NULL;
+    }
+
+    struct upipe *upipe = upipe_osx_audioqueue_sink_to_upipe(osx_audioqueue);
+    upipe_init(upipe, mgr, uprobe);
     upipe_osx_audioqueue_sink_init_urefcount(upipe);
+    upipe_osx_audioqueue_sink_init_upump_mgr(upipe);
+    upipe_osx_audioqueue_sink_init_upump(upipe);
+    upipe_osx_audioqueue_sink_init_input(upipe);
     osx_audioqueue->queue = NULL;
     osx_audioqueue->volume = 1.0;
+    osx_audioqueue->rate = 0;
+    osx_audioqueue->sample_size = 0;
+    osx_audioqueue->channel = NULL;
+    osx_audioqueue->uref = NULL;
 
     upipe_throw_ready(upipe);
     return upipe;
@@ -286,10 +502,18 @@ static struct upipe *upipe_osx_audioqueue_sink_alloc(struct upipe_mgr *mgr,
  */
 static void upipe_osx_audioqueue_sink_free(struct upipe *upipe)
 {
+    struct upipe_osx_audioqueue_sink *osx_audioqueue =
+                 upipe_osx_audioqueue_sink_from_upipe(upipe);
     upipe_osx_audioqueue_sink_remove(upipe);
     upipe_throw_dead(upipe);
+    free(osx_audioqueue->channel);
+    upipe_osx_audioqueue_sink_clean_upump(upipe);
+    upipe_osx_audioqueue_sink_clean_upump_mgr(upipe);
+    upipe_osx_audioqueue_sink_clean_input(upipe);
+    uqueue_clean(&osx_audioqueue->uqueue);
     upipe_osx_audioqueue_sink_clean_urefcount(upipe);
-    upipe_osx_audioqueue_sink_free_void(upipe);
+    upipe_clean(upipe);
+    free(osx_audioqueue);
 }
 
 /** module manager static descriptor */
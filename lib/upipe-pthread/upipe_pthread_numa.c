@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe helpers placing worker threads by NUMA locality
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe-pthread/upipe_pthread_transfer.h>
+#include <upipe-pthread/upipe_pthread_numa.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+/** sysfs directory of the NUMA nodes */
+#define NUMA_NODE_PATH "/sys/devices/system/node"
+/** maximum number of CPUs handled */
+#define NUMA_MAX_CPUS 1024
+
+/** @internal @This is the context of the attributes callback. */
+struct upipe_pthread_numa_attr {
+    /** CPUs of the node */
+    unsigned int cpus[NUMA_MAX_CPUS];
+    /** number of CPUs of the node */
+    unsigned int nb_cpus;
+};
+
+/** @This returns the number of NUMA nodes of the system.
+ *
+ * @param nb_nodes_p filled in with the number of nodes (1 on systems
+ * without NUMA information)
+ * @return an error code
+ */
+int upipe_pthread_numa_get_nb_nodes(unsigned int *nb_nodes_p)
+{
+    unsigned int nb_nodes = 0;
+    for ( ; ; ) {
+        char path[sizeof(NUMA_NODE_PATH) + 32];
+        snprintf(path, sizeof(path), NUMA_NODE_PATH "/node%u/cpulist",
+                 nb_nodes);
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+            break;
+        fclose(file);
+        nb_nodes++;
+    }
+    *nb_nodes_p = nb_nodes ? nb_nodes : 1;
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the CPUs of a NUMA node that the process may run on.
+ *
+ * @param node NUMA node, or -1 for all the CPUs
+ * @param cpus array filled in with the CPU numbers
+ * @param nb_cpus_p reference to the size of the array, filled in with the
+ * number of CPUs
+ * @return an error code
+ */
+int upipe_pthread_numa_get_cpus(int node, unsigned int *cpus,
+                                unsigned int *nb_cpus_p)
+{
+    unsigned int max_cpus = *nb_cpus_p;
+    unsigned int nb_cpus = 0;
+    char path[sizeof(NUMA_NODE_PATH) + 32];
+    if (node < 0)
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/online");
+    else
+        snprintf(path, sizeof(path), NUMA_NODE_PATH "/node%d/cpulist", node);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return UBASE_ERR_EXTERNAL;
+
+#ifdef CPU_ISSET
+    cpu_set_t allowed;
+    bool check_allowed =
+        sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+#endif
+
+    /* the list is of the form 0-3,8-11 */
+    unsigned int first, last;
+    while (fscanf(file, "%u", &first) == 1) {
+        last = first;
+        int c = fgetc(file);
+        if (c == '-') {
+            if (fscanf(file, "%u", &last) != 1)
+                break;
+            c = fgetc(file);
+        }
+        for (unsigned int cpu = first; cpu <= last && nb_cpus < max_cpus;
+             cpu++) {
+#ifdef CPU_ISSET
+            if (check_allowed &&
+                (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)))
+                continue;
+#endif
+            cpus[nb_cpus++] = cpu;
+        }
+        if (c != ',')
+            break;
+    }
+    fclose(file);
+
+    *nb_cpus_p = nb_cpus;
+    return nb_cpus ? UBASE_ERR_NONE : UBASE_ERR_INVALID;
+}
+
+/** @This returns the NUMA node a network interface is attached to.
+ *
+ * @param ifname name of the interface, for instance "eth0"
+ * @param node_p filled in with the node, or -1 if unknown
+ * @return an error code
+ */
+int upipe_pthread_numa_get_if_node(const char *ifname, int *node_p)
+{
+    if (unlikely(ifname == NULL || strchr(ifname, '/') != NULL))
+        return UBASE_ERR_INVALID;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node",
+             ifname);
+    *node_p = -1;
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return UBASE_ERR_EXTERNAL;
+    int node;
+    if (fscanf(file, "%d", &node) == 1)
+        *node_p = node;
+    fclose(file);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This pins the thread of a pool to a CPU of the node.
+ *
+ * @param opaque pointer to struct upipe_pthread_numa_attr
+ * @param index index of the thread in the pool
+ * @param attr attributes of the thread
+ * @return an error code
+ */
+static int upipe_pthread_numa_attr_cb(void *opaque, unsigned int index,
+                                      pthread_attr_t *attr)
+{
+    struct upipe_pthread_numa_attr *numa_attr = opaque;
+    if (!numa_attr->nb_cpus)
+        return UBASE_ERR_NONE;
+
+#ifdef CPU_SET
+    unsigned int cpu = numa_attr->cpus[index % numa_attr->nb_cpus];
+    if (cpu >= CPU_SETSIZE)
+        return UBASE_ERR_NONE;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (unlikely(pthread_attr_setaffinity_np(attr, sizeof(set), &set) != 0))
+        return UBASE_ERR_EXTERNAL;
+#endif
+    return UBASE_ERR_NONE;
+}
+
+/** @This allocates a pool of threads like @ref upipe_pthread_xfer_pool_alloc,
+ * with the threads pinned to distinct CPUs of a NUMA node, in order. If the
+ * node has fewer CPUs than threads, the CPUs are reused from the first one.
+ * If CPU affinity isn't supported, the threads are not pinned.
+ *
+ * @param node NUMA node, or -1 to use all the CPUs of the process
+ * @param nb_threads number of threads to create, for instance
+ * UPIPE_PTHREAD_STAGE_MAX
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr in each thread
+ * @param upump_mgr_alloc callback creating the event loop in a new thread
+ * @param upump_mgr_work callback running the event loop in a new thread
+ * @param upump_mgr_free callback freeing the event loop in a new thread
+ * @return pointer to pool, or NULL in case of error
+ */
+struct upipe_pthread_xfer_pool *upipe_pthread_xfer_pool_alloc_numa(int node,
+        unsigned int nb_threads, uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upipe_pthread_upump_mgr_alloc upump_mgr_alloc,
+        upipe_pthread_upump_mgr_work upump_mgr_work,
+        upipe_pthread_upump_mgr_free upump_mgr_free)
+{
+    struct upipe_pthread_numa_attr *numa_attr =
+        malloc(sizeof(struct upipe_pthread_numa_attr));
+    if (unlikely(numa_attr == NULL)) {
+        uprobe_release(uprobe_pthread_upump_mgr);
+        return NULL;
+    }
+    numa_attr->nb_cpus = NUMA_MAX_CPUS;
+    if (!ubase_check(upipe_pthread_numa_get_cpus(node, numa_attr->cpus,
+                                                 &numa_attr->nb_cpus)))
+        numa_attr->nb_cpus = 0;
+
+    struct upipe_pthread_xfer_pool *pool =
+        upipe_pthread_xfer_pool_alloc_attrs(nb_threads, queue_length,
+                msg_pool_depth, uprobe_pthread_upump_mgr, upump_mgr_alloc,
+                upump_mgr_work, upump_mgr_free, upipe_pthread_numa_attr_cb,
+                numa_attr);
+    free(numa_attr);
+    return pool;
+}
@@ -31,6 +31,7 @@
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
 #include <upipe/ueventfd.h>
+#include <upipe/uclock.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_prefix.h>
 #include <upipe/upump.h>
@@ -48,10 +49,27 @@
 #include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <errno.h>
 #include <math.h>
 #include <assert.h>
 
+/** @internal @This describes a thread of a pool. */
+struct upipe_pthread_xfer_thread {
+    /** xfer manager */
+    struct upipe_mgr *xfer_mgr;
+    /** thread ID */
+    pthread_t pthread_id;
+};
+
+/** @internal @This is the private context of a pool of threads. */
+struct upipe_pthread_xfer_pool {
+    /** number of threads */
+    unsigned int nb_threads;
+    /** threads */
+    struct upipe_pthread_xfer_thread threads[];
+};
+
 /** @internal @This is the private context for pthread. */
 struct upipe_pthread_ctx {
     /** xfer manager */
@@ -66,10 +84,46 @@ struct upipe_pthread_ctx {
     upipe_pthread_upump_mgr_free upump_mgr_free;
     /** thread ID */
     pthread_t pthread_id;
+    /** CPU time consumed by the thread, set when it terminates */
+    uint64_t cpu_time;
     /** eventfd used for thread termination */
     struct ueventfd event;
 };
 
+/** @internal @This converts a timespec to a duration in 27 MHz units.
+ *
+ * @param ts pointer to timespec
+ * @return duration in 27 MHz units
+ */
+static inline uint64_t
+    upipe_pthread_timespec_to_uclock(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * UCLOCK_FREQ +
+           (uint64_t)ts->tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+}
+
+/** @This returns the CPU time consumed so far by a thread. The thread must
+ * not have been joined yet.
+ *
+ * @param pthread_id thread ID
+ * @param cpu_time_p filled in with the CPU time, in 27 MHz units
+ * @return an error code
+ */
+int upipe_pthread_get_cpu_time(pthread_t pthread_id, uint64_t *cpu_time_p)
+{
+#ifdef __MACH__ // OS X does not have pthread_getcpuclockid
+    return UBASE_ERR_UNHANDLED;
+#else
+    clockid_t clock_id;
+    struct timespec ts;
+    if (unlikely(pthread_getcpuclockid(pthread_id, &clock_id) != 0 ||
+                 clock_gettime(clock_id, &ts) == -1))
+        return UBASE_ERR_EXTERNAL;
+    *cpu_time_p = upipe_pthread_timespec_to_uclock(&ts);
+    return UBASE_ERR_NONE;
+#endif
+}
+
 /** @internal @This is the main function of the new thread.
  *
  * @param mgr pointer to a upipe pthread manager
@@ -100,13 +154,16 @@ static void *upipe_pthread_start(void *_pthread_ctx)
         uprobe_err_va(pthread_ctx->uprobe_pthread_upump_mgr, NULL,
                       "unable to attach xfer (%d)", err);
 
-    uprobe_release(pthread_ctx->uprobe_pthread_upump_mgr);
     upipe_mgr_release(pthread_ctx->xfer_mgr);
 
     pthread_ctx->upump_mgr_work(upump_mgr);
     upump_mgr_release(upump_mgr);
     pthread_ctx->upump_mgr_free(upump_mgr);
 
+    if (unlikely(!ubase_check(upipe_pthread_get_cpu_time(pthread_self(),
+                                    &pthread_ctx->cpu_time))))
+        pthread_ctx->cpu_time = UINT64_MAX;
+
     ueventfd_write(&pthread_ctx->event);
     return NULL;
 }
@@ -123,6 +180,11 @@ static void upipe_pthread_stop(struct upump *upump)
     upump_free(upump);
 
     pthread_join(pthread_ctx->pthread_id, NULL);
+    if (pthread_ctx->cpu_time != UINT64_MAX)
+        uprobe_throw(pthread_ctx->uprobe_pthread_upump_mgr, NULL,
+                     UPROBE_PTHREAD_CPU_TIME, UPIPE_PTHREAD_XFER_SIGNATURE,
+                     pthread_ctx->pthread_id, pthread_ctx->cpu_time);
+    uprobe_release(pthread_ctx->uprobe_pthread_upump_mgr);
     ueventfd_clean(&pthread_ctx->event);
     free(pthread_ctx);
 }
@@ -199,3 +261,180 @@ upipe_pthread_xfer_mgr_alloc_err1:
     uprobe_release(uprobe_pthread_upump_mgr);
     return NULL;
 }
+
+/** @This allocates a pool of threads, each running its own event loop, and
+ * the matching management structures for transfer pipes. Pipes are then
+ * assigned to a thread by an affinity key, so that pipes sharing the same
+ * key run in the same thread.
+ *
+ * @param nb_threads number of threads to create
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr in each thread
+ * @param upump_mgr_alloc callback creating the event loop in a new thread
+ * @param upump_mgr_work callback running the event loop in a new thread
+ * @param upump_mgr_free callback freeing the event loop in a new thread
+ * @param attr pthread attributes
+ * @return pointer to pool, or NULL in case of error
+ */
+struct upipe_pthread_xfer_pool *upipe_pthread_xfer_pool_alloc(
+        unsigned int nb_threads, uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upipe_pthread_upump_mgr_alloc upump_mgr_alloc,
+        upipe_pthread_upump_mgr_work upump_mgr_work,
+        upipe_pthread_upump_mgr_free upump_mgr_free,
+        const pthread_attr_t *restrict attr)
+{
+    if (unlikely(!nb_threads))
+        goto upipe_pthread_xfer_pool_alloc_err;
+
+    struct upipe_pthread_xfer_pool *pool =
+        malloc(sizeof(struct upipe_pthread_xfer_pool) +
+               nb_threads * sizeof(struct upipe_pthread_xfer_thread));
+    if (unlikely(pool == NULL))
+        goto upipe_pthread_xfer_pool_alloc_err;
+
+    for (pool->nb_threads = 0; pool->nb_threads < nb_threads;
+         pool->nb_threads++) {
+        struct upipe_pthread_xfer_thread *thread =
+            &pool->threads[pool->nb_threads];
+        thread->xfer_mgr = upipe_pthread_xfer_mgr_alloc(
+                queue_length, msg_pool_depth,
+                uprobe_use(uprobe_pthread_upump_mgr), upump_mgr_alloc,
+                upump_mgr_work, upump_mgr_free, &thread->pthread_id, attr);
+        if (unlikely(thread->xfer_mgr == NULL)) {
+            upipe_pthread_xfer_pool_free(pool);
+            goto upipe_pthread_xfer_pool_alloc_err;
+        }
+    }
+
+    uprobe_release(uprobe_pthread_upump_mgr);
+    return pool;
+
+upipe_pthread_xfer_pool_alloc_err:
+    uprobe_release(uprobe_pthread_upump_mgr);
+    return NULL;
+}
+
+/** @This allocates a pool of threads like @ref upipe_pthread_xfer_pool_alloc,
+ * with a callback setting the attributes of each thread, for instance to
+ * give each thread its own CPU.
+ *
+ * @param nb_threads number of threads to create
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr in each thread
+ * @param upump_mgr_alloc callback creating the event loop in a new thread
+ * @param upump_mgr_work callback running the event loop in a new thread
+ * @param upump_mgr_free callback freeing the event loop in a new thread
+ * @param attr_cb callback setting the attributes of each thread
+ * @param opaque opaque passed to attr_cb
+ * @return pointer to pool, or NULL in case of error
+ */
+struct upipe_pthread_xfer_pool *upipe_pthread_xfer_pool_alloc_attrs(
+        unsigned int nb_threads, uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upipe_pthread_upump_mgr_alloc upump_mgr_alloc,
+        upipe_pthread_upump_mgr_work upump_mgr_work,
+        upipe_pthread_upump_mgr_free upump_mgr_free,
+        upipe_pthread_attr_cb attr_cb, void *opaque)
+{
+    if (unlikely(!nb_threads || attr_cb == NULL))
+        goto upipe_pthread_xfer_pool_alloc_err;
+
+    struct upipe_pthread_xfer_pool *pool =
+        malloc(sizeof(struct upipe_pthread_xfer_pool) +
+               nb_threads * sizeof(struct upipe_pthread_xfer_thread));
+    if (unlikely(pool == NULL))
+        goto upipe_pthread_xfer_pool_alloc_err;
+
+    for (pool->nb_threads = 0; pool->nb_threads < nb_threads;
+         pool->nb_threads++) {
+        struct upipe_pthread_xfer_thread *thread =
+            &pool->threads[pool->nb_threads];
+        pthread_attr_t attr;
+        if (unlikely(pthread_attr_init(&attr) != 0)) {
+            upipe_pthread_xfer_pool_free(pool);
+            goto upipe_pthread_xfer_pool_alloc_err;
+        }
+        if (unlikely(!ubase_check(attr_cb(opaque, pool->nb_threads,
+                                          &attr)))) {
+            pthread_attr_destroy(&attr);
+            upipe_pthread_xfer_pool_free(pool);
+            goto upipe_pthread_xfer_pool_alloc_err;
+        }
+
+        thread->xfer_mgr = upipe_pthread_xfer_mgr_alloc(
+                queue_length, msg_pool_depth,
+                uprobe_use(uprobe_pthread_upump_mgr), upump_mgr_alloc,
+                upump_mgr_work, upump_mgr_free, &thread->pthread_id, &attr);
+        pthread_attr_destroy(&attr);
+        if (unlikely(thread->xfer_mgr == NULL)) {
+            upipe_pthread_xfer_pool_free(pool);
+            goto upipe_pthread_xfer_pool_alloc_err;
+        }
+    }
+
+    uprobe_release(uprobe_pthread_upump_mgr);
+    return pool;
+
+upipe_pthread_xfer_pool_alloc_err:
+    uprobe_release(uprobe_pthread_upump_mgr);
+    return NULL;
+}
+
+/** @This returns the number of threads of a pool.
+ *
+ * @param pool pointer to pool
+ * @return number of threads
+ */
+unsigned int upipe_pthread_xfer_pool_size(
+        struct upipe_pthread_xfer_pool *pool)
+{
+    return pool->nb_threads;
+}
+
+/** @This returns the management structure for transfer pipes of the thread
+ * associated with an affinity key. The structure belongs to the pool, and
+ * must be used by the caller to be kept beyond the life of the pool.
+ *
+ * @param pool pointer to pool
+ * @param key affinity key
+ * @return pointer to xfer manager
+ */
+struct upipe_mgr *upipe_pthread_xfer_pool_get_mgr(
+        struct upipe_pthread_xfer_pool *pool, uint64_t key)
+{
+    return pool->threads[key % pool->nb_threads].xfer_mgr;
+}
+
+/** @This returns the CPU time consumed so far by a thread of a pool.
+ *
+ * @param pool pointer to pool
+ * @param index index of the thread in the pool
+ * @param cpu_time_p filled in with the CPU time, in 27 MHz units
+ * @return an error code
+ */
+int upipe_pthread_xfer_pool_get_cpu_time(struct upipe_pthread_xfer_pool *pool,
+                                         unsigned int index,
+                                         uint64_t *cpu_time_p)
+{
+    if (unlikely(index >= pool->nb_threads))
+        return UBASE_ERR_INVALID;
+    return upipe_pthread_get_cpu_time(pool->threads[index].pthread_id,
+                                      cpu_time_p);
+}
+
+/** @This releases the pool. Each thread terminates when its last transfer
+ * pipe has been released.
+ *
+ * @param pool pointer to pool
+ */
+void upipe_pthread_xfer_pool_free(struct upipe_pthread_xfer_pool *pool)
+{
+    for (unsigned int i = 0; i < pool->nb_threads; i++)
+        upipe_mgr_release(pool->threads[i].xfer_mgr);
+    free(pool);
+}
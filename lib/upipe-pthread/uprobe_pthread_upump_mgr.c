@@ -144,6 +144,9 @@ struct uprobe *uprobe_pthread_upump_mgr_init(
                                     uprobe_pthread_upump_mgr_destr) != 0))
         return NULL;
     uprobe_init(uprobe, uprobe_pthread_upump_mgr_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_NEED_UPUMP_MGR) |
+                      UPROBE_EVENT_MASK(UPROBE_FREEZE_UPUMP_MGR) |
+                      UPROBE_EVENT_MASK(UPROBE_THAW_UPUMP_MGR));
     return uprobe;
 }
 
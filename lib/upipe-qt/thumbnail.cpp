@@ -62,7 +62,8 @@
 #include <upipe-qt/upipe_qt_html.h>
 #include "thumbnail.h"
 
-/** @This is the main constructor of the Thumbnail
+/** @This is the main constructor of the Thumbnail. The page is rendered
+ * offscreen, without any widget, so that it signals its repaints.
  *
  * @param url choosen url
  */
@@ -70,13 +71,32 @@ Thumbnail::Thumbnail(const char *url)
 {
     QUrl qurl;
     this->url = url;
+    this->dirty = true;
+    this->last = NULL;
     if (!strncmp(url,"http",4)) {
         qurl = QUrl(this->url);
     } else {
         qurl = QUrl::fromLocalFile(this->url);
     }
 
-    view.load(qurl);
+    QPalette palette = page.palette();
+    palette.setBrush(QPalette::Base, Qt::transparent);
+    page.setPalette(palette);
+    page.mainFrame()->setScrollBarPolicy(Qt::Horizontal,
+                                         Qt::ScrollBarAlwaysOff);
+    page.mainFrame()->setScrollBarPolicy(Qt::Vertical, Qt::ScrollBarAlwaysOff);
+    QObject::connect(&page, SIGNAL(repaintRequested(const QRect &)),
+                     this, SLOT(damage()));
+    page.mainFrame()->load(qurl);
+}
+
+/** @This is the destructor of the Thumbnail
+ *
+ */
+Thumbnail::~Thumbnail()
+{
+    if (last != NULL)
+        uref_free(last);
 }
 
 /** @This set the uref_mgr of the Thumbnail
@@ -142,9 +162,18 @@ void Thumbnail::setV(int V)
     this->V = V;
 }
 
-/** @This is the rendering function of the Thumbnail
+/** @This marks the page as changed, so that the next tick renders it
  *
  */
+void Thumbnail::damage()
+{
+    dirty = true;
+}
+
+/** @This is the rendering function of the Thumbnail. As long as the page
+ * did not repaint, the last picture is output again by reference. Otherwise
+ * the page is painted directly into the buffer of a new picture.
+ */
 void Thumbnail::render()
 {
     if ((uqueue_pop(uqueue2, void *)) != (void *)0){
@@ -153,34 +182,46 @@ void Thumbnail::render()
         return;
     }
 
+    QSize S = QSize(H, V);
+    if (page.viewportSize() != S) {
+        page.setViewportSize(S);
+        dirty = true;
+    }
+
+    struct uref *uref;
+    if (!dirty && last != NULL) {
+        uref = uref_dup(last);
+        if (uref != NULL && !uqueue_push(uqueue, uref))
+            uref_free(uref);
+        return;
+    }
+
     size_t h, v, stride;
     uint8_t hsub, vsub, macropixel_size, macropixel;
     uint8_t *data;
-    struct uref *uref = uref_pic_alloc(this->uref_mgr, this->ubuf_mgr, H, V);
-    uref_pic_size(uref, &h, &v, &macropixel);
-    uref_pic_plane_size(uref, "b8g8r8a8", &stride, &hsub, &vsub, &macropixel_size);
-    uref_pic_plane_write(uref, "b8g8r8a8", 0, 0, -1, -1, &data);
-    QSize S  = QSize(H, V);
-    view.resize(S);
-
-    QPalette palette = view.palette();
-    palette.setBrush(QPalette::Background, Qt::transparent);
-    view.page()->setPalette(palette);
-    view.setAttribute(Qt::WA_OpaquePaintEvent, false);
-    view.setAttribute(Qt::WA_NoSystemBackground, false);
-    view.setAttribute(Qt::WA_TranslucentBackground, true);
-    view.setAutoFillBackground(false);
+    uref = uref_pic_alloc(this->uref_mgr, this->ubuf_mgr, H, V);
+    if (uref == NULL)
+        return;
+    if (!ubase_check(uref_pic_size(uref, &h, &v, &macropixel)) ||
+        !ubase_check(uref_pic_plane_size(uref, "b8g8r8a8", &stride,
+                                         &hsub, &vsub, &macropixel_size)) ||
+        !ubase_check(uref_pic_plane_write(uref, "b8g8r8a8", 0, 0, -1, -1,
+                                          &data))) {
+        uref_free(uref);
+        return;
+    }
+    dirty = false;
 
     QImage image = QImage (data, h, v, stride, QImage::Format_ARGB32);
     image.fill(Qt::transparent);
     QPainter painter(&image);
-    view.render(&painter);
+    page.mainFrame()->render(&painter);
     painter.end();
 
-#if 0
-    printf("%d %d %d %d \n", data[0], data[1], data[2], data[3]);
-#endif
-
     uref_pic_plane_unmap(uref, "b8g8r8a8", 0, 0, -1, -1);
-    uqueue_push(uqueue, uref);
+    if (last != NULL)
+        uref_free(last);
+    last = uref_dup(uref);
+    if (!uqueue_push(uqueue, uref))
+        uref_free(uref);
 }
@@ -73,6 +73,7 @@ class Thumbnail : public QObject
 
 public:
     Thumbnail(const char *url);
+    ~Thumbnail();
     void seturefmgr(struct uref_mgr *uref_mgr);
     void setubufmgr(struct ubuf_mgr *ubuf_mgr);
     void setuqueue(struct uqueue *uqueue);
@@ -86,9 +87,10 @@ signals:
 
 private slots:
     void render();
+    void damage();
 
 private:
-    QWebView view;
+    QWebPage page;
     const char *url;
     struct uref_mgr *uref_mgr;
     struct ubuf_mgr *ubuf_mgr;
@@ -96,4 +98,8 @@ private:
     struct uqueue *uqueue2;
     int H;
     int V;
+    /** true if the page repainted since the last rendered picture */
+    bool dirty;
+    /** last rendered picture, duplicated while the page is unchanged */
+    struct uref *last;
 };
@@ -54,6 +54,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <libavutil/opt.h>
 #include <libavutil/channel_layout.h>
@@ -114,6 +119,15 @@ struct upipe_swr {
     /** output format */
     enum AVSampleFormat out_fmt;
 
+    /** true if the conversion doesn't need swresample */
+    bool fast_path;
+    /** input format of the fast path */
+    enum AVSampleFormat fast_in_fmt;
+    /** output format of the fast path */
+    enum AVSampleFormat fast_out_fmt;
+    /** channels number of the fast path */
+    uint8_t fast_chan;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -129,6 +143,163 @@ UPIPE_HELPER_UBUF_MGR(upipe_swr, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_swr_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_swr, urefs, nb_urefs, max_urefs, blockers, upipe_swr_handle)
 
+/** @internal @This checks whether a conversion between two sample formats,
+ * at the same rate and with the same channels, may avoid swresample.
+ *
+ * @param in_fmt input sample format
+ * @param out_fmt output sample format
+ * @return true if the fast path handles the conversion
+ */
+static bool upipe_swr_fast_supported(enum AVSampleFormat in_fmt,
+                                     enum AVSampleFormat out_fmt)
+{
+    enum AVSampleFormat in_packed = av_get_packed_sample_fmt(in_fmt);
+    enum AVSampleFormat out_packed = av_get_packed_sample_fmt(out_fmt);
+    if (in_packed == AV_SAMPLE_FMT_NONE || out_packed == AV_SAMPLE_FMT_NONE)
+        return false;
+    return in_packed == out_packed ||
+           (in_packed == AV_SAMPLE_FMT_S16 && out_packed == AV_SAMPLE_FMT_FLT) ||
+           (in_packed == AV_SAMPLE_FMT_FLT && out_packed == AV_SAMPLE_FMT_S16);
+}
+
+/** @internal @This converts signed 16-bit samples to float samples.
+ *
+ * @param out output samples
+ * @param out_stride distance between two output samples
+ * @param in input samples
+ * @param in_stride distance between two input samples
+ * @param samples number of samples
+ */
+static void upipe_swr_s16_to_flt(float *out, size_t out_stride,
+                                 const int16_t *in, size_t in_stride,
+                                 size_t samples)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    if (in_stride == 1 && out_stride == 1) {
+        const __m128 scale = _mm_set1_ps(1.f / (1 << 15));
+        for ( ; i + 8 <= samples; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+    }
+#endif
+    for ( ; i < samples; i++)
+        out[i * out_stride] = in[i * in_stride] * (1.f / (1 << 15));
+}
+
+/** @internal @This converts float samples to signed 16-bit samples, with
+ * rounding and saturation.
+ *
+ * @param out output samples
+ * @param out_stride distance between two output samples
+ * @param in input samples
+ * @param in_stride distance between two input samples
+ * @param samples number of samples
+ */
+static void upipe_swr_flt_to_s16(int16_t *out, size_t out_stride,
+                                 const float *in, size_t in_stride,
+                                 size_t samples)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    if (in_stride == 1 && out_stride == 1) {
+        const __m128 scale = _mm_set1_ps(1 << 15);
+        for ( ; i + 8 <= samples; i += 8) {
+            __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i),
+                                                    scale));
+            __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4),
+                                                    scale));
+            _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+        }
+    }
+#endif
+    for ( ; i < samples; i++) {
+        long sample = lrintf(in[i * in_stride] * (1 << 15));
+        out[i * out_stride] = sample < INT16_MIN ? INT16_MIN :
+                              sample > INT16_MAX ? INT16_MAX : sample;
+    }
+}
+
+/** @internal @This copies samples of a given size between two layouts.
+ *
+ * @param out output samples
+ * @param out_stride distance between two output samples
+ * @param in input samples
+ * @param in_stride distance between two input samples
+ * @param samples number of samples
+ * @param size size of a sample in octets
+ */
+static void upipe_swr_copy(uint8_t *out, size_t out_stride,
+                           const uint8_t *in, size_t in_stride,
+                           size_t samples, int size)
+{
+    size_t i;
+#define UPIPE_SWR_COPY(type)                                                \
+    for (i = 0; i < samples; i++)                                           \
+        ((type *)out)[i * out_stride] = ((const type *)in)[i * in_stride];
+    switch (size) {
+        case 1: UPIPE_SWR_COPY(uint8_t) break;
+        case 2: UPIPE_SWR_COPY(uint16_t) break;
+        case 4: UPIPE_SWR_COPY(uint32_t) break;
+        case 8: UPIPE_SWR_COPY(uint64_t) break;
+        default:
+            for (i = 0; i < samples; i++)
+                memcpy(out + i * out_stride * size, in + i * in_stride * size,
+                       size);
+            break;
+    }
+#undef UPIPE_SWR_COPY
+}
+
+/** @internal @This converts samples without swresample, when only the sample
+ * format or the planar layout differ.
+ *
+ * @param upipe description structure of the pipe
+ * @param out_buf output planes
+ * @param in_buf input planes
+ * @param samples number of samples per channel
+ */
+static void upipe_swr_fast_convert(struct upipe *upipe, uint8_t **out_buf,
+                                   const uint8_t **in_buf, size_t samples)
+{
+    struct upipe_swr *upipe_swr = upipe_swr_from_upipe(upipe);
+    enum AVSampleFormat in_fmt = upipe_swr->fast_in_fmt;
+    enum AVSampleFormat out_fmt = upipe_swr->fast_out_fmt;
+    bool in_planar = av_sample_fmt_is_planar(in_fmt);
+    bool out_planar = av_sample_fmt_is_planar(out_fmt);
+    int in_size = av_get_bytes_per_sample(in_fmt);
+    int out_size = av_get_bytes_per_sample(out_fmt);
+    unsigned int chan = upipe_swr->fast_chan;
+
+    /* packed to packed converts all channels at once */
+    unsigned int runs = chan;
+    if (!in_planar && !out_planar) {
+        samples *= chan;
+        runs = 1;
+    }
+    size_t in_stride = in_planar || runs == 1 ? 1 : chan;
+    size_t out_stride = out_planar || runs == 1 ? 1 : chan;
+
+    for (unsigned int c = 0; c < runs; c++) {
+        const uint8_t *in = in_planar ? in_buf[c] : in_buf[0] + c * in_size;
+        uint8_t *out = out_planar ? out_buf[c] : out_buf[0] + c * out_size;
+        enum AVSampleFormat in_packed = av_get_packed_sample_fmt(in_fmt);
+        enum AVSampleFormat out_packed = av_get_packed_sample_fmt(out_fmt);
+        if (in_packed == out_packed)
+            upipe_swr_copy(out, out_stride, in, in_stride, samples, in_size);
+        else if (in_packed == AV_SAMPLE_FMT_S16)
+            upipe_swr_s16_to_flt((float *)out, out_stride,
+                                 (const int16_t *)in, in_stride, samples);
+        else
+            upipe_swr_flt_to_s16((int16_t *)out, out_stride,
+                                 (const float *)in, in_stride, samples);
+    }
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -171,6 +342,22 @@ static bool upipe_swr_handle(struct upipe *upipe, struct uref *uref,
             av_opt_set_int(upipe_swr->swr, "out_sample_rate", in_rate, 0);
         }
 
+        /* swresample is only needed to resample or remix */
+        enum AVSampleFormat out_fmt = upipe_swr->out_fmt;
+        if (out_fmt == AV_SAMPLE_FMT_NONE)
+            out_fmt = in_fmt;
+        upipe_swr->fast_path =
+            (!upipe_swr->out_chan || upipe_swr->out_chan == in_chan) &&
+            (!upipe_swr->out_rate || upipe_swr->out_rate == in_rate) &&
+            upipe_swr_fast_supported(in_fmt, out_fmt);
+        upipe_swr->fast_in_fmt = in_fmt;
+        upipe_swr->fast_out_fmt = out_fmt;
+        upipe_swr->fast_chan = in_chan;
+        if (upipe_swr->fast_path)
+            upipe_dbg_va(upipe, "converting %s to %s without resampling",
+                         av_get_sample_fmt_name(in_fmt),
+                         av_get_sample_fmt_name(out_fmt));
+
         /* reinit swresample context */
         if (swr_init(upipe_swr->swr) < 0) {
             upipe_err_va(upipe, "failed to init swresample with format %s",
@@ -198,20 +385,31 @@ static bool upipe_swr_handle(struct upipe *upipe, struct uref *uref,
         return true;
     }
 
-    /* conversion sample rates */
-    av_opt_get_int(upipe_swr->swr, "in_sample_rate", 0, &in_rate);
-    av_opt_get_int(upipe_swr->swr, "out_sample_rate", 0, &out_rate);
-
-    /* out samples (needed for resampling) */
-    out_samples = av_rescale_rnd(
-                    swr_get_delay(upipe_swr->swr, in_rate) + in_samples,
-                    out_rate, in_rate, AV_ROUND_UP);
-    //upipe_verbose_va(upipe, "in: %zu out: %"PRIu64, in_samples, out_samples);
+    if (upipe_swr->fast_path &&
+        upipe_swr->fast_in_fmt == upipe_swr->fast_out_fmt) {
+        upipe_swr_output(upipe, uref, upump_p);
+        return true;
+    }
 
-    /* compute pts for next samples (see swresample.h for timebase) */
     uint64_t pts = 0;
-    if (likely(ubase_check(uref_clock_get_pts_sys(uref, &pts)))) {
-        pts -= swr_get_delay(upipe_swr->swr, UCLOCK_FREQ);
+    if (upipe_swr->fast_path) {
+        /* no resampling, hence no delay */
+        out_samples = in_samples;
+    } else {
+        /* conversion sample rates */
+        av_opt_get_int(upipe_swr->swr, "in_sample_rate", 0, &in_rate);
+        av_opt_get_int(upipe_swr->swr, "out_sample_rate", 0, &out_rate);
+
+        /* out samples (needed for resampling) */
+        out_samples = av_rescale_rnd(
+                        swr_get_delay(upipe_swr->swr, in_rate) + in_samples,
+                        out_rate, in_rate, AV_ROUND_UP);
+        //upipe_verbose_va(upipe, "in: %zu out: %"PRIu64, in_samples, out_samples);
+
+        /* compute pts for next samples (see swresample.h for timebase) */
+        if (likely(ubase_check(uref_clock_get_pts_sys(uref, &pts)))) {
+            pts -= swr_get_delay(upipe_swr->swr, UCLOCK_FREQ);
+        }
     }
 
     const uint8_t *in_buf[upipe_swr->in_planes];
@@ -246,8 +444,12 @@ static bool upipe_swr_handle(struct upipe *upipe, struct uref *uref,
     }
 
     /* fire! */
-    ret = swr_convert(upipe_swr->swr, out_buf, out_samples,
-                                      in_buf, in_samples);
+    if (upipe_swr->fast_path) {
+        upipe_swr_fast_convert(upipe, out_buf, in_buf, in_samples);
+        ret = in_samples;
+    } else
+        ret = swr_convert(upipe_swr->swr, out_buf, out_samples,
+                                          in_buf, in_samples);
 
     ubuf_sound_unmap(ubuf, 0, -1, out_planes);
     uref_sound_unmap(uref, 0, -1, upipe_swr->in_planes);
@@ -434,6 +636,7 @@ static struct upipe *upipe_swr_alloc(struct upipe_mgr *mgr,
     upipe_swr->out_chan = 0;
     upipe_swr->out_planes = 0;
     upipe_swr->out_fmt = AV_SAMPLE_FMT_NONE;
+    upipe_swr->fast_path = false;
 
     /* get sample format */
     const char *def = "(none)";
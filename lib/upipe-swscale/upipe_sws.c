@@ -55,6 +55,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/opt.h>
 #include <libswscale/swscale.h>
@@ -65,6 +66,31 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
 /** @hidden */
 static int upipe_sws_check(struct upipe *upipe, struct uref *flow_format);
 
+/** lines of a band are a multiple of this, to respect chroma subsampling */
+#define BAND_ALIGN 4
+
+/** @internal @This describes a horizontal band of the picture, scaled by its
+ * own swscale context. */
+struct upipe_sws_band {
+    /** pointer to the private structure of the pipe */
+    struct upipe_sws *upipe_sws;
+    /** swscale context for the band */
+    struct SwsContext *convert_ctx;
+    /** thread scaling the band (unused for the first band) */
+    pthread_t thread;
+    /** last picture counter seen by the thread */
+    unsigned int generation;
+
+    /** input planes of the band */
+    const uint8_t *input_planes[UPIPE_AV_MAX_PLANES + 1];
+    /** output planes of the band */
+    uint8_t *output_planes[UPIPE_AV_MAX_PLANES + 1];
+    /** number of input lines of the band */
+    int input_vsize;
+    /** return value of sws_scale */
+    int ret;
+};
+
 /** upipe_sws structure with swscale parameters */
 struct upipe_sws {
     /** refcount management structure */
@@ -112,6 +138,27 @@ struct upipe_sws {
     /** output chroma map */
     const char *output_chroma_map[UPIPE_AV_MAX_PLANES];
 
+    /** number of bands scaled in parallel */
+    unsigned int nb_bands;
+    /** array of nb_bands bands, or NULL if there is a single band */
+    struct upipe_sws_band *bands;
+    /** strides of the input planes of the current picture */
+    int band_input_strides[UPIPE_AV_MAX_PLANES + 1];
+    /** strides of the output planes of the current picture */
+    int band_output_strides[UPIPE_AV_MAX_PLANES + 1];
+    /** mutex protecting the band counters */
+    pthread_mutex_t band_mutex;
+    /** signals the band threads that a new picture is available */
+    pthread_cond_t band_start;
+    /** signals the pipe that a band thread has finished */
+    pthread_cond_t band_done;
+    /** picture counter, incremented for each picture given to the threads */
+    unsigned int band_generation;
+    /** number of band threads that haven't finished the current picture */
+    unsigned int band_pending;
+    /** true if the band threads must exit */
+    bool band_exit;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -127,6 +174,216 @@ UPIPE_HELPER_UBUF_MGR(upipe_sws, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_sws_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_sws, urefs, nb_urefs, max_urefs, blockers, upipe_sws_handle)
 
+/** @internal @This scales a band of the current picture.
+ *
+ * @param band description structure of the band
+ */
+static void upipe_sws_band_scale(struct upipe_sws_band *band)
+{
+    struct upipe_sws *upipe_sws = band->upipe_sws;
+    band->ret = sws_scale(band->convert_ctx,
+                          band->input_planes, upipe_sws->band_input_strides,
+                          0, band->input_vsize,
+                          band->output_planes, upipe_sws->band_output_strides);
+}
+
+/** @internal @This is the main loop of the thread scaling a band.
+ *
+ * @param opaque description structure of the band
+ * @return NULL
+ */
+static void *upipe_sws_band_thread(void *opaque)
+{
+    struct upipe_sws_band *band = opaque;
+    struct upipe_sws *upipe_sws = band->upipe_sws;
+
+    pthread_mutex_lock(&upipe_sws->band_mutex);
+    for ( ; ; ) {
+        while (!upipe_sws->band_exit &&
+               upipe_sws->band_generation == band->generation)
+            pthread_cond_wait(&upipe_sws->band_start, &upipe_sws->band_mutex);
+        if (upipe_sws->band_exit)
+            break;
+        band->generation = upipe_sws->band_generation;
+        pthread_mutex_unlock(&upipe_sws->band_mutex);
+
+        upipe_sws_band_scale(band);
+
+        pthread_mutex_lock(&upipe_sws->band_mutex);
+        if (!--upipe_sws->band_pending)
+            pthread_cond_signal(&upipe_sws->band_done);
+    }
+    pthread_mutex_unlock(&upipe_sws->band_mutex);
+    return NULL;
+}
+
+/** @internal @This stops the band threads and frees the bands.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_sws_clean_bands(struct upipe *upipe)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    if (upipe_sws->bands == NULL)
+        return;
+
+    pthread_mutex_lock(&upipe_sws->band_mutex);
+    upipe_sws->band_exit = true;
+    pthread_cond_broadcast(&upipe_sws->band_start);
+    pthread_mutex_unlock(&upipe_sws->band_mutex);
+
+    for (unsigned int i = 0; i < upipe_sws->nb_bands; i++) {
+        struct upipe_sws_band *band = &upipe_sws->bands[i];
+        if (i)
+            pthread_join(band->thread, NULL);
+        if (band->convert_ctx != NULL)
+            sws_freeContext(band->convert_ctx);
+    }
+    free(upipe_sws->bands);
+    upipe_sws->bands = NULL;
+    upipe_sws->band_exit = false;
+}
+
+/** @internal @This allocates the bands and starts their threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands number of bands
+ * @return an error code
+ */
+static int upipe_sws_init_bands(struct upipe *upipe, unsigned int nb_bands)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    upipe_sws->nb_bands = 1;
+    if (nb_bands == 1)
+        return UBASE_ERR_NONE;
+
+    upipe_sws->bands = calloc(nb_bands, sizeof(struct upipe_sws_band));
+    UBASE_ALLOC_RETURN(upipe_sws->bands)
+    for (unsigned int i = 0; i < nb_bands; i++) {
+        struct upipe_sws_band *band = &upipe_sws->bands[i];
+        band->upipe_sws = upipe_sws;
+        band->convert_ctx = NULL;
+        band->generation = upipe_sws->band_generation;
+        if (i && unlikely(pthread_create(&band->thread, NULL,
+                                         upipe_sws_band_thread, band) != 0)) {
+            upipe_err_va(upipe, "unable to create band thread (%m)");
+            upipe_sws->nb_bands = i;
+            upipe_sws_clean_bands(upipe);
+            upipe_sws->nb_bands = 1;
+            return UBASE_ERR_EXTERNAL;
+        }
+        upipe_sws->nb_bands = i + 1;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This scales a progressive picture in parallel bands.
+ *
+ * @param upipe description structure of the pipe
+ * @param input_hsize horizontal size of the input picture
+ * @param input_vsize vertical size of the input picture
+ * @param output_hsize horizontal size of the output picture
+ * @param output_vsize vertical size of the output picture
+ * @param input_planes mapped input planes
+ * @param input_vsub vertical subsampling of the input planes
+ * @param output_planes mapped output planes
+ * @param output_vsub vertical subsampling of the output planes
+ * @return the return value of sws_scale for the first failed band, or a
+ * positive value
+ */
+static int upipe_sws_scale_bands(struct upipe *upipe,
+        size_t input_hsize, size_t input_vsize,
+        size_t output_hsize, size_t output_vsize,
+        const uint8_t **input_planes, const uint8_t *input_vsub,
+        uint8_t **output_planes, const uint8_t *output_vsub)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    unsigned int nb_bands = upipe_sws->nb_bands;
+
+    for (unsigned int i = 0; i < nb_bands; i++) {
+        struct upipe_sws_band *band = &upipe_sws->bands[i];
+        size_t input_y = input_vsize * i / nb_bands / BAND_ALIGN * BAND_ALIGN;
+        size_t input_end = i + 1 == nb_bands ? input_vsize :
+            input_vsize * (i + 1) / nb_bands / BAND_ALIGN * BAND_ALIGN;
+        size_t output_y =
+            output_vsize * i / nb_bands / BAND_ALIGN * BAND_ALIGN;
+        size_t output_end = i + 1 == nb_bands ? output_vsize :
+            output_vsize * (i + 1) / nb_bands / BAND_ALIGN * BAND_ALIGN;
+        if (unlikely(input_end <= input_y || output_end <= output_y))
+            return 0;
+
+        band->convert_ctx = sws_getCachedContext(band->convert_ctx,
+                input_hsize, input_end - input_y, upipe_sws->input_pix_fmt,
+                output_hsize, output_end - output_y, upipe_sws->output_pix_fmt,
+                upipe_sws->flags, NULL, NULL, NULL);
+        if (unlikely(band->convert_ctx == NULL))
+            return 0;
+        band->input_vsize = input_end - input_y;
+
+        int j;
+        for (j = 0; input_planes[j] != NULL; j++)
+            band->input_planes[j] = input_planes[j] +
+                input_y / input_vsub[j] * upipe_sws->band_input_strides[j];
+        band->input_planes[j] = NULL;
+        for (j = 0; output_planes[j] != NULL; j++)
+            band->output_planes[j] = output_planes[j] +
+                output_y / output_vsub[j] * upipe_sws->band_output_strides[j];
+        band->output_planes[j] = NULL;
+    }
+
+    pthread_mutex_lock(&upipe_sws->band_mutex);
+    upipe_sws->band_pending = nb_bands - 1;
+    upipe_sws->band_generation++;
+    pthread_cond_broadcast(&upipe_sws->band_start);
+    pthread_mutex_unlock(&upipe_sws->band_mutex);
+
+    upipe_sws_band_scale(&upipe_sws->bands[0]);
+
+    pthread_mutex_lock(&upipe_sws->band_mutex);
+    while (upipe_sws->band_pending)
+        pthread_cond_wait(&upipe_sws->band_done, &upipe_sws->band_mutex);
+    pthread_mutex_unlock(&upipe_sws->band_mutex);
+
+    for (unsigned int i = 0; i < nb_bands; i++)
+        if (unlikely(upipe_sws->bands[i].ret <= 0))
+            return upipe_sws->bands[i].ret;
+    return 1;
+}
+
+/** @internal @This checks whether the planes of a picture satisfy the
+ * alignment of the output, so that the picture may be output as is.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure describing the picture
+ * @return true if the picture may be output as is
+ */
+static bool upipe_sws_check_alias(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    uint64_t align = 0;
+    uref_pic_flow_get_align(upipe_sws->flow_def, &align);
+
+    for (int i = 0; i < UPIPE_AV_MAX_PLANES &&
+                    upipe_sws->input_chroma_map[i] != NULL; i++) {
+        const uint8_t *data;
+        size_t stride;
+        if (unlikely(!ubase_check(uref_pic_plane_read(uref,
+                                          upipe_sws->input_chroma_map[i],
+                                          0, 0, -1, -1, &data))))
+            return false;
+        bool aligned =
+            ubase_check(uref_pic_plane_size(uref,
+                                            upipe_sws->input_chroma_map[i],
+                                            &stride, NULL, NULL, NULL)) &&
+            (!align || (!((uintptr_t)data % align) && !(stride % align)));
+        uref_pic_plane_unmap(uref, upipe_sws->input_chroma_map[i],
+                             0, 0, -1, -1);
+        if (!aligned)
+            return false;
+    }
+    return true;
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -166,23 +423,40 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
         output_vsize = input_vsize;
     }
 
+    /* same format and size: output the picture as is if it is suitably
+     * aligned, otherwise only copy the lines */
+    if (upipe_sws->input_pix_fmt == upipe_sws->output_pix_fmt &&
+        input_hsize == output_hsize && input_vsize == output_vsize) {
+        if (upipe_sws_check_alias(upipe, uref))
+            goto upipe_sws_handle_output;
+        struct ubuf *ubuf = ubuf_pic_copy(upipe_sws->ubuf_mgr, uref->ubuf,
+                                          0, 0, -1, -1);
+        if (likely(ubuf != NULL)) {
+            uref_attach_ubuf(uref, ubuf);
+            goto upipe_sws_handle_output;
+        }
+        /* the planes of the managers differ, fall back to swscale */
+    }
+
+    /* only build the contexts that are used by this picture */
+    bool bands = progressive && upipe_sws->bands != NULL;
     int i;
-    for (i = 0; i < 3; i++) {
+    for (i = progressive ? 0 : 1; !bands && i < (progressive ? 1 : 3); i++) {
         upipe_sws->convert_ctx[i] = sws_getCachedContext(upipe_sws->convert_ctx[i],
                     input_hsize, input_vsize >> !!i, upipe_sws->input_pix_fmt,
                     output_hsize, output_vsize >> !!i, upipe_sws->output_pix_fmt,
                     upipe_sws->flags, NULL, NULL, NULL);
-    }
-
-    if (unlikely(upipe_sws->convert_ctx == NULL)) {
-        upipe_err(upipe, "sws_getContext failed");
-        uref_free(uref);
-        return true;
+        if (unlikely(upipe_sws->convert_ctx[i] == NULL)) {
+            upipe_err(upipe, "sws_getContext failed");
+            uref_free(uref);
+            return true;
+        }
     }
 
     /* map input */
     const uint8_t *input_planes[UPIPE_AV_MAX_PLANES + 1];
-    int input_strides[UPIPE_AV_MAX_PLANES + 1];
+    int *input_strides = upipe_sws->band_input_strides;
+    uint8_t input_vsub[UPIPE_AV_MAX_PLANES];
     for (i = 0; i < UPIPE_AV_MAX_PLANES &&
                 upipe_sws->input_chroma_map[i] != NULL; i++) {
         const uint8_t *data;
@@ -192,7 +466,8 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
                                           0, 0, -1, -1, &data)) ||
                      !ubase_check(uref_pic_plane_size(uref,
                                           upipe_sws->input_chroma_map[i],
-                                          &stride, NULL, NULL, NULL)))) {
+                                          &stride, NULL, &input_vsub[i],
+                                          NULL)))) {
             upipe_warn(upipe, "invalid buffer received");
             uref_free(uref);
             return true;
@@ -218,7 +493,8 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
 
     /* map output */
     uint8_t *output_planes[UPIPE_AV_MAX_PLANES + 1];
-    int output_strides[UPIPE_AV_MAX_PLANES + 1];
+    int *output_strides = upipe_sws->band_output_strides;
+    uint8_t output_vsub[UPIPE_AV_MAX_PLANES];
     for (i = 0; i < UPIPE_AV_MAX_PLANES &&
                 upipe_sws->output_chroma_map[i] != NULL; i++) {
         uint8_t *data;
@@ -228,7 +504,8 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
                                            0, 0, -1, -1, &data)) ||
                      !ubase_check(ubuf_pic_plane_size(ubuf,
                                           upipe_sws->output_chroma_map[i],
-                                          &stride, NULL, NULL, NULL)))) {
+                                          &stride, NULL, &output_vsub[i],
+                                          NULL)))) {
             upipe_warn(upipe, "invalid buffer received");
             ubuf_free(ubuf);
             uref_free(uref);
@@ -242,7 +519,12 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
 
     /* fire ! */
     int ret = 0, ret2 = 1;
-    if (progressive) {
+    if (bands) {
+        ret = upipe_sws_scale_bands(upipe, input_hsize, input_vsize,
+                                    output_hsize, output_vsize,
+                                    input_planes, input_vsub,
+                                    output_planes, output_vsub);
+    } else if (progressive) {
         ret = sws_scale(upipe_sws->convert_ctx[0],
                         input_planes, input_strides, 0, input_vsize,
                         output_planes, output_strides);
@@ -282,6 +564,8 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
     }
     uref_attach_ubuf(uref, ubuf);
 
+upipe_sws_handle_output:
+    ;
     struct urational sar;
     if (ubase_check(uref_pic_flow_get_sar(upipe_sws->flow_def_attr, &sar)))
         uref_pic_flow_delete_sar(uref);
@@ -459,6 +743,37 @@ static int _upipe_sws_set_flags(struct upipe *upipe, int flags)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This gets the number of bands scaled in parallel.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands_p filled in with the number of bands
+ * @return an error code
+ */
+static int _upipe_sws_get_bands(struct upipe *upipe, unsigned int *nb_bands_p)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    *nb_bands_p = upipe_sws->nb_bands;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of bands scaled in parallel.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_bands number of bands
+ * @return an error code
+ */
+static int _upipe_sws_set_bands(struct upipe *upipe, unsigned int nb_bands)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    if (unlikely(!nb_bands))
+        return UBASE_ERR_INVALID;
+    if (nb_bands == upipe_sws->nb_bands)
+        return UBASE_ERR_NONE;
+    upipe_sws_clean_bands(upipe);
+    upipe_dbg_va(upipe, "scaling in %u bands", nb_bands);
+    return upipe_sws_init_bands(upipe, nb_bands);
+}
+
 /** @internal @This processes control commands on a file source pipe, and
  * checks the status of the pipe afterwards.
  *
@@ -514,6 +829,16 @@ static int upipe_sws_control(struct upipe *upipe, int command, va_list args)
             int flags = va_arg(args, int);
             return _upipe_sws_set_flags(upipe, flags);
         }
+        case UPIPE_SWS_GET_BANDS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_SIGNATURE)
+            unsigned int *nb_bands_p = va_arg(args, unsigned int *);
+            return _upipe_sws_get_bands(upipe, nb_bands_p);
+        }
+        case UPIPE_SWS_SET_BANDS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_SIGNATURE)
+            unsigned int nb_bands = va_arg(args, unsigned int);
+            return _upipe_sws_set_bands(upipe, nb_bands);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -564,6 +889,14 @@ static struct upipe *upipe_sws_alloc(struct upipe_mgr *mgr,
     }
 
     upipe_sws->flags = SWS_FULL_CHR_H_INP | SWS_ACCURATE_RND | SWS_LANCZOS;
+    upipe_sws->nb_bands = 1;
+    upipe_sws->bands = NULL;
+    pthread_mutex_init(&upipe_sws->band_mutex, NULL);
+    pthread_cond_init(&upipe_sws->band_start, NULL);
+    pthread_cond_init(&upipe_sws->band_done, NULL);
+    upipe_sws->band_generation = 0;
+    upipe_sws->band_pending = 0;
+    upipe_sws->band_exit = false;
 
     upipe_throw_ready(upipe);
 
@@ -593,6 +926,10 @@ static void upipe_sws_free(struct upipe *upipe)
             sws_freeContext(upipe_sws->convert_ctx[i]);
         upipe_sws->convert_ctx[i] = NULL;
     }
+    upipe_sws_clean_bands(upipe);
+    pthread_cond_destroy(&upipe_sws->band_done);
+    pthread_cond_destroy(&upipe_sws->band_start);
+    pthread_mutex_destroy(&upipe_sws->band_mutex);
 
     upipe_throw_dead(upipe);
     upipe_sws_clean_input(upipe);
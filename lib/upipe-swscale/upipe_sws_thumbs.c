@@ -124,6 +124,18 @@ struct upipe_sws_thumbs {
 
     /** current thumb gallery */
     struct uref *gallery;
+    /** planes of the current gallery, mapped once for all thumbs */
+    uint8_t *gallery_planes[UPIPE_AV_MAX_PLANES];
+    /** strides of the planes of the current gallery */
+    size_t gallery_strides[UPIPE_AV_MAX_PLANES];
+    /** horizontal subsampling of the planes of the current gallery */
+    uint8_t gallery_hsub[UPIPE_AV_MAX_PLANES];
+    /** vertical subsampling of the planes of the current gallery */
+    uint8_t gallery_vsub[UPIPE_AV_MAX_PLANES];
+    /** macropixel size of the planes of the current gallery */
+    uint8_t gallery_mpixel_size[UPIPE_AV_MAX_PLANES];
+    /** macropixel of the current gallery */
+    uint8_t gallery_mpixel;
     /** thumb counter */
     int counter;
 
@@ -177,6 +189,9 @@ static inline void upipe_sws_thumbs_flush(struct upipe *upipe, struct upump **up
     struct upipe_sws_thumbs *upipe_sws_thumbs = upipe_sws_thumbs_from_upipe(upipe);
     struct uref *gallery = upipe_sws_thumbs->gallery;
     if (likely(gallery)) {
+        const char **planes = upipe_sws_thumbs->output_chroma_map;
+        for (int i = 0; i < UPIPE_AV_MAX_PLANES && planes[i]; i++)
+            uref_pic_plane_unmap(gallery, planes[i], 0, 0, -1, -1);
         upipe_sws_thumbs->counter = 0;
         upipe_sws_thumbs->gallery = NULL;
         upipe_sws_thumbs_output(upipe, gallery, upump_p);
@@ -294,6 +309,22 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
         }
         ubuf_pic_clear(ubuf, 0, 0, -1, -1);
         uref_attach_ubuf(gallery, ubuf);
+
+        /* map the whole gallery until it is output */
+        if (unlikely(!ubase_check(uref_pic_size(gallery, NULL, NULL,
+                                        &upipe_sws_thumbs->gallery_mpixel))))
+            upipe_sws_thumbs->gallery_mpixel = 1;
+        planes = upipe_sws_thumbs->output_chroma_map;
+        for (i=0; i < UPIPE_AV_MAX_PLANES && planes[i]; i++) {
+            upipe_sws_thumbs->gallery_planes[i] = NULL;
+            uref_pic_plane_write(gallery, planes[i], 0, 0, -1, -1,
+                                 &upipe_sws_thumbs->gallery_planes[i]);
+            uref_pic_plane_size(gallery, planes[i],
+                                &upipe_sws_thumbs->gallery_strides[i],
+                                &upipe_sws_thumbs->gallery_hsub[i],
+                                &upipe_sws_thumbs->gallery_vsub[i],
+                                &upipe_sws_thumbs->gallery_mpixel_size[i]);
+        }
     }
 
     /* map input */
@@ -310,11 +341,17 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
     memset(dstrides, 0, sizeof(dstrides));
     planes = upipe_sws_thumbs->output_chroma_map;
     for (i=0; i < UPIPE_AV_MAX_PLANES && planes[i]; i++) {
-        uref_pic_plane_write(gallery, planes[i],
-                         pos.hsize + margins.hsize, pos.vsize + margins.vsize,
-                         surface.hsize, surface.vsize, &dslices[i]);
-        uref_pic_plane_size(gallery, planes[i], &stride, NULL, NULL, NULL);
-        dstrides[i] = stride;
+        uint8_t *plane = upipe_sws_thumbs->gallery_planes[i];
+        if (unlikely(plane == NULL))
+            continue;
+        size_t x = (pos.hsize + margins.hsize) /
+            upipe_sws_thumbs->gallery_hsub[i] /
+            upipe_sws_thumbs->gallery_mpixel;
+        size_t y = (pos.vsize + margins.vsize) /
+            upipe_sws_thumbs->gallery_vsub[i];
+        dstrides[i] = upipe_sws_thumbs->gallery_strides[i];
+        dslices[i] = plane + y * dstrides[i] +
+            x * upipe_sws_thumbs->gallery_mpixel_size[i];
     }
 
     /* fire ! */
@@ -327,10 +364,6 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
     for (i=0; i < 4 && planes[i]; i++) {
         uref_pic_plane_unmap(uref, planes[i], 0, 0, -1, -1);
     }
-    planes = upipe_sws_thumbs->output_chroma_map;
-    for (i=0; i < 4 && planes[i]; i++) {
-        uref_pic_plane_unmap(gallery, planes[i], 0, 0, -1, -1);
-    }
 
     /* clean */
     uref_free(uref);
@@ -39,6 +39,7 @@
 #include <upipe/upipe_helper_output.h>
 #include <upipe-ts/upipe_ts_aggregate.h>
 #include <upipe-ts/upipe_ts_mux.h>
+#include <upipe-ts/upipe_ts_tstd.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -57,6 +58,10 @@
 #define DEFAULT_MTU (7 * TS_SIZE)
 /** Max hole allowed in CBR/Capped VBR streams */
 #define MAX_HOLE UCLOCK_FREQ
+/** number of PIDs */
+#define MAX_PIDS 8192
+/** maximum number of transport buffers modelled */
+#define MAX_TBS 255
 
 /** @internal @This is the private context of a ts_aggregate pipe. */
 struct upipe_ts_agg {
@@ -84,8 +89,10 @@ struct upipe_ts_agg {
     /** MTU */
     size_t mtu;
 
-    /** one TS packet of padding */
+    /** MTU worth of padding packets, shared by all aggregates */
     struct ubuf *padding;
+    /** size of the padding buffer */
+    size_t padding_size;
     /** number of packets dropped since last muxing */
     unsigned int dropped;
 
@@ -102,6 +109,22 @@ struct upipe_ts_agg {
     /** latest departure time of the next_urefs */
     uint64_t next_urefs_dts;
 
+    /** number of aggregates output at once */
+    unsigned int burst;
+    /** completed aggregates waiting to be output */
+    struct uref **burst_urefs;
+    /** number of aggregates in burst_urefs */
+    unsigned int nb_burst_urefs;
+
+    /** true if packets may be sent ahead of time, within the T-STD model */
+    bool tstd;
+    /** index of the transport buffer of each PID in tbs plus one, or 0 */
+    uint8_t *tb_map;
+    /** transport buffers of the PIDs carrying T-STD dates */
+    struct upipe_ts_tstd_buffer *tbs;
+    /** number of transport buffers in tbs */
+    unsigned int nb_tbs;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -136,6 +159,7 @@ static struct upipe *upipe_ts_agg_alloc(struct upipe_mgr *mgr,
     upipe_ts_agg->mode = UPIPE_TS_MUX_MODE_VBR;
     upipe_ts_agg->mtu = DEFAULT_MTU;
     upipe_ts_agg->padding = NULL;
+    upipe_ts_agg->padding_size = 0;
     upipe_ts_agg->dropped = 0;
     upipe_ts_agg->next_cr_sys = UINT64_MAX;
     upipe_ts_agg->last_cr_sys = UINT64_MAX;
@@ -143,11 +167,19 @@ static struct upipe *upipe_ts_agg_alloc(struct upipe_mgr *mgr,
     ulist_init(&upipe_ts_agg->next_urefs);
     upipe_ts_agg->next_urefs_size = 0;
     upipe_ts_agg->next_urefs_dts = UINT64_MAX;
+    upipe_ts_agg->burst = 1;
+    upipe_ts_agg->burst_urefs = NULL;
+    upipe_ts_agg->nb_burst_urefs = 0;
+    upipe_ts_agg->tstd = false;
+    upipe_ts_agg->tb_map = NULL;
+    upipe_ts_agg->tbs = NULL;
+    upipe_ts_agg->nb_tbs = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
 
-/** @internal @This initializes the padding packet.
+/** @internal @This initializes the padding packets. A whole MTU of padding
+ * is prepared once, and aggregates reference the part they need.
  *
  * @param upipe description structure of the pipe
  * @param ubuf_mgr pointer to ubuf manager
@@ -156,8 +188,11 @@ static void upipe_ts_agg_init_padding(struct upipe *upipe,
                                       struct ubuf_mgr *ubuf_mgr)
 {
     struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    if (upipe_ts_agg->padding != NULL)
+        ubuf_free(upipe_ts_agg->padding);
+    upipe_ts_agg->padding_size = 0;
 
-    upipe_ts_agg->padding = ubuf_block_alloc(ubuf_mgr, TS_SIZE);
+    upipe_ts_agg->padding = ubuf_block_alloc(ubuf_mgr, upipe_ts_agg->mtu);
     if (unlikely(upipe_ts_agg->padding == NULL)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return;
@@ -171,9 +206,29 @@ static void upipe_ts_agg_init_padding(struct upipe *upipe,
         upipe_ts_agg->padding = NULL;
         return;
     }
-    assert(size == TS_SIZE);
-    ts_pad(buffer);
+    assert(size == upipe_ts_agg->mtu);
+    for (int i = 0; i < size; i += TS_SIZE)
+        ts_pad(buffer + i);
     ubuf_block_unmap(upipe_ts_agg->padding, 0);
+    upipe_ts_agg->padding_size = upipe_ts_agg->mtu;
+}
+
+/** @internal @This outputs the completed aggregates waiting for a burst.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_agg_flush_burst(struct upipe *upipe,
+                                     struct upump **upump_p)
+{
+    struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    unsigned int nb_urefs = upipe_ts_agg->nb_burst_urefs;
+    upipe_ts_agg->nb_burst_urefs = 0;
+    for (unsigned int i = 0; i < nb_urefs; i++) {
+        struct uref *uref = upipe_ts_agg->burst_urefs[i];
+        upipe_ts_agg->burst_urefs[i] = NULL;
+        upipe_ts_agg_output(upipe, uref, upump_p);
+    }
 }
 
 /** @internal In capped VBR mode, @this checks if the next uref can be skipped
@@ -300,9 +355,12 @@ static void upipe_ts_agg_complete(struct upipe *upipe, struct upump **upump_p)
         }
     }
 
-    unsigned int padding = 0;
-    while (upipe_ts_agg->next_urefs_size + TS_SIZE <= upipe_ts_agg->mtu) {
-        struct ubuf *ubuf = ubuf_dup(upipe_ts_agg->padding);
+    if (upipe_ts_agg->next_urefs_size + TS_SIZE <= upipe_ts_agg->mtu) {
+        size_t padding = upipe_ts_agg->mtu - upipe_ts_agg->next_urefs_size;
+        padding -= padding % TS_SIZE;
+        assert(padding <= upipe_ts_agg->padding_size);
+        struct ubuf *ubuf = ubuf_block_splice(upipe_ts_agg->padding, 0,
+                                              padding);
         if (unlikely(ubuf == NULL)) {
             uref_free(uref);
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
@@ -310,17 +368,104 @@ static void upipe_ts_agg_complete(struct upipe *upipe, struct upump **upump_p)
         }
 
         uref_block_append(uref, ubuf);
-        upipe_ts_agg->next_urefs_size += TS_SIZE;
-        padding++;
+        upipe_verbose_va(upipe, "inserting %zu padding at %"PRIu64,
+                         padding / TS_SIZE, next_cr_sys);
     }
-    if (padding)
-        upipe_verbose_va(upipe, "inserting %u padding at %"PRIu64, padding,
-                         next_cr_sys);
 
     upipe_ts_agg->next_urefs_size = 0;
     upipe_ts_agg->next_urefs_dts = UINT64_MAX;
 
-    upipe_ts_agg_output(upipe, uref, upump_p);
+    if (upipe_ts_agg->burst <= 1) {
+        upipe_ts_agg_output(upipe, uref, upump_p);
+        return;
+    }
+
+    upipe_ts_agg->burst_urefs[upipe_ts_agg->nb_burst_urefs++] = uref;
+    if (upipe_ts_agg->nb_burst_urefs >= upipe_ts_agg->burst)
+        upipe_ts_agg_flush_burst(upipe, upump_p);
+}
+
+/** @internal @This returns the transport buffer of the PID of a packet
+ * carrying T-STD dates.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @return pointer to the transport buffer, or NULL
+ */
+static struct upipe_ts_tstd_buffer *upipe_ts_agg_get_tb(struct upipe *upipe,
+                                                        struct uref *uref)
+{
+    struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    uint64_t tb_rate;
+    uint8_t ts_header[TS_HEADER_SIZE];
+    if (!ubase_check(uref_ts_tstd_get_tb_rate(uref, &tb_rate)) ||
+        !ubase_check(uref_block_extract(uref, 0, TS_HEADER_SIZE, ts_header)))
+        return NULL;
+
+    if (unlikely(upipe_ts_agg->tb_map == NULL)) {
+        upipe_ts_agg->tb_map = calloc(MAX_PIDS, sizeof(uint8_t));
+        upipe_ts_agg->tbs = malloc(MAX_TBS *
+                                   sizeof(struct upipe_ts_tstd_buffer));
+        if (unlikely(upipe_ts_agg->tb_map == NULL ||
+                     upipe_ts_agg->tbs == NULL)) {
+            free(upipe_ts_agg->tb_map);
+            free(upipe_ts_agg->tbs);
+            upipe_ts_agg->tb_map = NULL;
+            upipe_ts_agg->tbs = NULL;
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return NULL;
+        }
+    }
+
+    uint16_t pid = ts_get_pid(ts_header);
+    uint8_t index = upipe_ts_agg->tb_map[pid];
+    if (unlikely(!index)) {
+        if (upipe_ts_agg->nb_tbs >= MAX_TBS)
+            return NULL;
+        index = ++upipe_ts_agg->nb_tbs;
+        upipe_ts_agg->tb_map[pid] = index;
+        upipe_ts_tstd_buffer_init(&upipe_ts_agg->tbs[index - 1],
+                                  UPIPE_TS_TSTD_TB_SIZE, tb_rate);
+    }
+    struct upipe_ts_tstd_buffer *tb = &upipe_ts_agg->tbs[index - 1];
+    tb->rate = tb_rate;
+    return tb;
+}
+
+/** @internal @This returns the date at which a packet appended to the
+ * current aggregate enters the T-STD.
+ *
+ * @param upipe description structure of the pipe
+ * @return system date
+ */
+static uint64_t upipe_ts_agg_arrival(struct upipe *upipe)
+{
+    struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    return upipe_ts_agg->next_cr_sys +
+           (uint64_t)upipe_ts_agg->next_urefs_size * UCLOCK_FREQ /
+           upipe_ts_agg->octetrate;
+}
+
+/** @internal @This checks if a packet may be muxed into the current
+ * aggregate ahead of its date, because its elementary stream buffer has
+ * room for it from its earliest date, and its transport buffer has room
+ * for it now. Packets carrying a PCR are kept at their date.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param tb transport buffer of the PID of the packet
+ * @return true if the packet may be muxed now
+ */
+static bool upipe_ts_agg_check_early(struct upipe *upipe, struct uref *uref,
+                                     const struct upipe_ts_tstd_buffer *tb)
+{
+    uint64_t early;
+    if (ubase_check(uref_clock_get_ref(uref)) ||
+        !ubase_check(uref_ts_tstd_get_early_sys(uref, &early)))
+        return false;
+    uint64_t arrival = upipe_ts_agg_arrival(upipe);
+    return early <= arrival &&
+           upipe_ts_tstd_buffer_next(tb, arrival, TS_SIZE) <= arrival;
 }
 
 /** @internal @This receives data.
@@ -334,7 +479,8 @@ static void upipe_ts_agg_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
 
-    if (unlikely(upipe_ts_agg->padding == NULL))
+    if (unlikely(upipe_ts_agg->padding == NULL ||
+                 upipe_ts_agg->padding_size < upipe_ts_agg->mtu))
         upipe_ts_agg_init_padding(upipe, uref->ubuf->mgr);
     if (unlikely(upipe_ts_agg->padding == NULL)) {
         uref_free(uref);
@@ -372,11 +518,19 @@ static void upipe_ts_agg_input(struct upipe *upipe, struct uref *uref,
     uint64_t delay = 0;
     uref_clock_get_cr_dts_delay(uref, &delay);
 
+    /* packets sent ahead of time make the mux lag behind their dates */
+    uint64_t first_sys = dts_sys - delay;
+    uint64_t early;
+    if (upipe_ts_agg->tstd &&
+        ubase_check(uref_ts_tstd_get_early_sys(uref, &early)) &&
+        early < first_sys)
+        first_sys = early;
+
     if (upipe_ts_agg->mode != UPIPE_TS_MUX_MODE_VBR &&
         upipe_ts_agg->next_cr_sys != UINT64_MAX &&
-        dts_sys - delay > upipe_ts_agg->next_cr_sys + MAX_HOLE) {
+        first_sys > upipe_ts_agg->next_cr_sys + MAX_HOLE) {
         upipe_warn_va(upipe, "skipping hole in the source (%"PRIu64" ms)",
-                      (dts_sys - delay - upipe_ts_agg->next_cr_sys) * 1000 /
+                      (first_sys - upipe_ts_agg->next_cr_sys) * 1000 /
                       UCLOCK_FREQ);
         upipe_ts_agg_complete(upipe, upump_p);
         upipe_ts_agg->next_cr_sys = UINT64_MAX;
@@ -401,17 +555,29 @@ static void upipe_ts_agg_input(struct upipe *upipe, struct uref *uref,
         upipe_ts_agg->dropped = 0;
     }
 
+    struct upipe_ts_tstd_buffer *tb = NULL;
+    if (upipe_ts_agg->tstd && upipe_ts_agg->mode != UPIPE_TS_MUX_MODE_VBR)
+        tb = upipe_ts_agg_get_tb(upipe, uref);
+
     /* packet in the future that would arrive too early if muxed into this
-     * aggregate */
+     * aggregate, unless the T-STD model allows it */
     if (upipe_ts_agg->mode != UPIPE_TS_MUX_MODE_VBR) {
         while (dts_sys - delay >
                upipe_ts_agg->next_cr_sys + upipe_ts_agg->interval) {
+            if (tb != NULL && upipe_ts_agg_check_early(upipe, uref, tb))
+                break;
             if (upipe_ts_agg->mode != UPIPE_TS_MUX_MODE_CAPPED ||
                 !upipe_ts_agg_try_shift(upipe, dts_sys - delay))
                 upipe_ts_agg_complete(upipe, upump_p);
         }
     }
 
+    if (tb != NULL) {
+        upipe_ts_tstd_buffer_leak(tb, upipe_ts_agg_arrival(upipe));
+        if (unlikely(!upipe_ts_tstd_buffer_fill(tb, TS_SIZE)))
+            upipe_verbose(upipe, "T-STD transport buffer overflow");
+    }
+
     if (dts_sys < upipe_ts_agg->next_urefs_dts)
         upipe_ts_agg->next_urefs_dts = dts_sys;
     ulist_add(&upipe_ts_agg->next_urefs, uref_to_uchain(uref));
@@ -435,7 +601,8 @@ static int upipe_ts_agg_build_flow_def(struct upipe *upipe,
 
     if (unlikely(!ubase_check(uref_clock_set_latency(flow_def,
                                 upipe_ts_agg->input_latency +
-                                upipe_ts_agg->interval)) ||
+                                upipe_ts_agg->interval *
+                                upipe_ts_agg->burst)) ||
                  !ubase_check(uref_block_flow_set_octetrate(flow_def,
                                 upipe_ts_agg->octetrate))))
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
@@ -570,12 +737,91 @@ static int upipe_ts_agg_set_mtu(struct upipe *upipe, unsigned int mtu)
     if (mtu < upipe_ts_agg->next_urefs_size + TS_SIZE)
         upipe_ts_agg_complete(upipe, NULL);
     upipe_ts_agg->mtu = mtu;
+    if (upipe_ts_agg->padding != NULL && upipe_ts_agg->padding_size < mtu)
+        upipe_ts_agg_init_padding(upipe, upipe_ts_agg->padding->mgr);
     if (upipe_ts_agg->octetrate)
         upipe_ts_agg->interval = upipe_ts_agg->mtu * UCLOCK_FREQ /
                                  upipe_ts_agg->octetrate;
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the number of aggregates output at once.
+ *
+ * @param upipe description structure of the pipe
+ * @param burst_p filled in with the number of aggregates
+ * @return an error code
+ */
+static int _upipe_ts_agg_get_burst(struct upipe *upipe, unsigned int *burst_p)
+{
+    struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    assert(burst_p != NULL);
+    *burst_p = upipe_ts_agg->burst;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of aggregates output at once.
+ *
+ * @param upipe description structure of the pipe
+ * @param burst number of aggregates
+ * @return an error code
+ */
+static int _upipe_ts_agg_set_burst(struct upipe *upipe, unsigned int burst)
+{
+    struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    if (unlikely(!burst))
+        return UBASE_ERR_INVALID;
+    if (burst == upipe_ts_agg->burst)
+        return UBASE_ERR_NONE;
+
+    struct uref **burst_urefs = NULL;
+    if (burst > 1) {
+        burst_urefs = malloc(sizeof(struct uref *) * burst);
+        if (unlikely(burst_urefs == NULL))
+            return UBASE_ERR_ALLOC;
+    }
+    if (upipe_ts_agg->burst_urefs != NULL) {
+        upipe_ts_agg_flush_burst(upipe, NULL);
+        free(upipe_ts_agg->burst_urefs);
+    }
+    upipe_ts_agg->burst_urefs = burst_urefs;
+    upipe_ts_agg->burst = burst;
+
+    if (upipe_ts_agg->flow_def != NULL) {
+        struct uref *flow_def_dup;
+        if (unlikely((flow_def_dup = uref_dup(upipe_ts_agg->flow_def)) == NULL))
+            return UBASE_ERR_ALLOC;
+        return upipe_ts_agg_build_flow_def(upipe, flow_def_dup);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns whether packets may be sent ahead of time.
+ *
+ * @param upipe description structure of the pipe
+ * @param tstd_p filled in with true if packets may be sent ahead of time
+ * @return an error code
+ */
+static int _upipe_ts_agg_get_tstd(struct upipe *upipe, bool *tstd_p)
+{
+    struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    assert(tstd_p != NULL);
+    *tstd_p = upipe_ts_agg->tstd;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets whether packets may be sent ahead of time.
+ *
+ * @param upipe description structure of the pipe
+ * @param tstd true if packets may be sent ahead of time
+ * @return an error code
+ */
+static int _upipe_ts_agg_set_tstd(struct upipe *upipe, bool tstd)
+{
+    struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
+    upipe_ts_agg->tstd = tstd;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts check pipe.
  *
  * @param upipe description structure of the pipe
@@ -642,6 +888,26 @@ static int upipe_ts_agg_control(struct upipe *upipe, int command, va_list args)
             unsigned int mtu = va_arg(args, unsigned int);
             return upipe_ts_agg_set_mtu(upipe, mtu);
         }
+        case UPIPE_TS_AGG_GET_BURST: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_AGG_SIGNATURE)
+            unsigned int *burst_p = va_arg(args, unsigned int *);
+            return _upipe_ts_agg_get_burst(upipe, burst_p);
+        }
+        case UPIPE_TS_AGG_SET_BURST: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_AGG_SIGNATURE)
+            unsigned int burst = va_arg(args, unsigned int);
+            return _upipe_ts_agg_set_burst(upipe, burst);
+        }
+        case UPIPE_TS_AGG_GET_TSTD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_AGG_SIGNATURE)
+            bool *tstd_p = va_arg(args, bool *);
+            return _upipe_ts_agg_get_tstd(upipe, tstd_p);
+        }
+        case UPIPE_TS_AGG_SET_TSTD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_AGG_SIGNATURE)
+            bool tstd = va_arg(args, int);
+            return _upipe_ts_agg_set_tstd(upipe, tstd);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -656,8 +922,14 @@ static void upipe_ts_agg_free(struct upipe *upipe)
     struct upipe_ts_agg *upipe_ts_agg = upipe_ts_agg_from_upipe(upipe);
     if (unlikely(!ulist_empty(&upipe_ts_agg->next_urefs)))
         upipe_ts_agg_complete(upipe, NULL);
+    if (upipe_ts_agg->burst_urefs != NULL) {
+        upipe_ts_agg_flush_burst(upipe, NULL);
+        free(upipe_ts_agg->burst_urefs);
+    }
 
     upipe_throw_dead(upipe);
+    free(upipe_ts_agg->tb_map);
+    free(upipe_ts_agg->tbs);
     if (likely(upipe_ts_agg->padding))
         ubuf_free(upipe_ts_agg->padding);
     upipe_ts_agg_clean_output(upipe);
@@ -35,6 +35,7 @@
 #include <upipe/upipe_helper_void.h>
 #include <upipe/upipe_helper_output.h>
 #include <upipe-ts/upipe_ts_check.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -51,6 +52,10 @@
 #define OUTPUT_FLOW_DEF "block.mpegts."
 /** TS synchronization word */
 #define TS_SYNC 0x47
+/** number of PIDs */
+#define MAX_PIDS 8192
+/** value of the CC table for PIDs not yet seen */
+#define CC_UNKNOWN 0x10
 
 /** @internal @This is the private context of a ts_check pipe. */
 struct upipe_ts_check {
@@ -68,6 +73,18 @@ struct upipe_ts_check {
 
     /** TS packet size */
     size_t ts_size;
+    /** true if TS bundles are output */
+    bool bundle;
+
+    /** number of packets dropped because of an invalid header */
+    uint64_t invalid;
+    /** number of continuity errors, in bundle mode */
+    uint64_t cc_errors;
+    /** number of packets with the transport error indicator, in bundle
+     * mode */
+    uint64_t tei_errors;
+    /** last continuity counter of each PID, in bundle mode */
+    uint8_t last_cc[MAX_PIDS];
 
     /** public upipe structure */
     struct upipe upipe;
@@ -99,6 +116,12 @@ static struct upipe *upipe_ts_check_alloc(struct upipe_mgr *mgr,
     upipe_ts_check_init_urefcount(upipe);
     upipe_ts_check_init_output(upipe);
     upipe_ts_check->ts_size = TS_SIZE;
+    upipe_ts_check->bundle = false;
+    upipe_ts_check->invalid = 0;
+    upipe_ts_check->cc_errors = 0;
+    upipe_ts_check->tei_errors = 0;
+    memset(upipe_ts_check->last_cc, CC_UNKNOWN,
+           sizeof(upipe_ts_check->last_cc));
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -124,6 +147,9 @@ static bool upipe_ts_check_check(struct upipe *upipe, struct uref *uref,
     word = *buffer;
     uref_block_unmap(uref, 0);
     if (word != TS_SYNC) {
+        struct upipe_ts_check *upipe_ts_check =
+            upipe_ts_check_from_upipe(upipe);
+        upipe_ts_check->invalid++;
         uref_free(uref);
         upipe_warn_va(upipe, "invalid TS sync 0x%"PRIx8, word);
         return false;
@@ -133,6 +159,203 @@ static bool upipe_ts_check_check(struct upipe *upipe, struct uref *uref,
     return true;
 }
 
+/** @internal @This parses the header of a TS packet into a bundle
+ * description, and updates the continuity counter of its PID. Errors are
+ * only counted, so that the cost does not depend on the quality of the
+ * stream.
+ *
+ * @param upipe description structure of the pipe
+ * @param ts_header pointer to the first TS_HEADER_SIZE_PCR octets of the
+ * packet
+ * @param sync_checked true if the sync word is already known to be valid
+ * @param pkt filled in with the description of the packet
+ * @return false if the packet is invalid
+ */
+static bool upipe_ts_check_parse(struct upipe *upipe, const uint8_t *ts_header,
+                                 bool sync_checked,
+                                 struct uref_ts_bundle_pkt *pkt)
+{
+    struct upipe_ts_check *upipe_ts_check = upipe_ts_check_from_upipe(upipe);
+    if (unlikely(!sync_checked && !ts_validate(ts_header)))
+        goto upipe_ts_check_parse_err;
+
+    pkt->pid = ts_get_pid(ts_header);
+    pkt->cc = ts_get_cc(ts_header);
+    pkt->flags = 0;
+    pkt->pcr = 0;
+    pkt->payload = TS_HEADER_SIZE;
+    if (ts_get_unitstart(ts_header))
+        pkt->flags |= UREF_TS_BUNDLE_UNITSTART;
+    if (ts_has_payload(ts_header))
+        pkt->flags |= UREF_TS_BUNDLE_PAYLOAD;
+    if (ts_get_transporterror(ts_header))
+        pkt->flags |= UREF_TS_BUNDLE_ERROR;
+
+    if (ts_has_adaptation(ts_header)) {
+        uint8_t af_length = ts_get_adaptation(ts_header);
+        bool has_payload = pkt->flags & UREF_TS_BUNDLE_PAYLOAD;
+        if (unlikely((!has_payload && af_length != 183) ||
+                     (has_payload && af_length >= 183)))
+            goto upipe_ts_check_parse_err;
+
+        pkt->flags |= UREF_TS_BUNDLE_ADAPTATION;
+        pkt->payload += af_length + 1;
+        if (af_length) {
+            if (tsaf_has_discontinuity(ts_header))
+                pkt->flags |= UREF_TS_BUNDLE_DISCONTINUITY;
+            if (tsaf_has_pcr(ts_header)) {
+                pkt->flags |= UREF_TS_BUNDLE_PCR;
+                pkt->pcr = tsaf_get_pcr(ts_header) * 300 +
+                           tsaf_get_pcrext(ts_header);
+            }
+        }
+    }
+
+    upipe_ts_check->tei_errors += !!(pkt->flags & UREF_TS_BUNDLE_ERROR);
+    if (pkt->pid != MAX_PIDS - 1 && (pkt->flags & UREF_TS_BUNDLE_PAYLOAD)) {
+        uint8_t last_cc = upipe_ts_check->last_cc[pkt->pid];
+        upipe_ts_check->last_cc[pkt->pid] = pkt->cc;
+        upipe_ts_check->cc_errors += last_cc != CC_UNKNOWN &&
+            !(pkt->flags & UREF_TS_BUNDLE_DISCONTINUITY) &&
+            !ts_check_duplicate(pkt->cc, last_cc) &&
+            ts_check_discontinuity(pkt->cc, last_cc);
+    }
+    return true;
+
+upipe_ts_check_parse_err:
+    upipe_ts_check->invalid++;
+    return false;
+}
+
+/** @internal @This describes all packets of a uref in one pass over its
+ * segments. The sync words of the packets lying entirely in a segment are
+ * first checked together at TS_SIZE stride, so that the common case costs
+ * no branch per packet; packets straddling two segments are peeked.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param nb_packets number of packets in the uref
+ * @param pkts filled in with the descriptions of the packets
+ * @param valid filled in with false for invalid packets
+ * @return an error code
+ */
+static int upipe_ts_check_scan(struct upipe *upipe, struct uref *uref,
+                               unsigned int nb_packets,
+                               struct uref_ts_bundle_pkt *pkts, bool *valid)
+{
+    unsigned int i = 0;
+    int offset = 0;
+    while (i < nb_packets) {
+        const uint8_t *buffer;
+        int size = -1;
+        UBASE_RETURN(uref_block_read(uref, offset, &size, &buffer))
+
+        unsigned int nb = size / TS_SIZE;
+        if (nb > nb_packets - i)
+            nb = nb_packets - i;
+        uint8_t diff = 0;
+        for (unsigned int j = 0; j < nb; j++)
+            diff |= buffer[j * TS_SIZE] ^ TS_SYNC;
+        for (unsigned int j = 0; j < nb; j++)
+            valid[i + j] = upipe_ts_check_parse(upipe, buffer + j * TS_SIZE,
+                                                !diff, &pkts[i + j]);
+        UBASE_RETURN(uref_block_unmap(uref, offset))
+        i += nb;
+        offset += nb * TS_SIZE;
+
+        if (i < nb_packets && (unsigned int)size > nb * TS_SIZE) {
+            /* packet straddling two segments */
+            uint8_t header[TS_HEADER_SIZE_PCR];
+            const uint8_t *ts_header = uref_block_peek(uref, offset,
+                                                       TS_HEADER_SIZE_PCR,
+                                                       header);
+            if (unlikely(ts_header == NULL))
+                return UBASE_ERR_ALLOC;
+            valid[i] = upipe_ts_check_parse(upipe, ts_header, false, &pkts[i]);
+            UBASE_RETURN(uref_block_peek_unmap(uref, offset, header,
+                                               ts_header))
+            i++;
+            offset += TS_SIZE;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This outputs a run of packets as a TS bundle.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param first index of the first packet of the run
+ * @param nb number of packets in the run
+ * @param pkts descriptions of the packets of the run
+ * @param upump_p reference to pump that generated the buffer
+ * @return false in case of allocation error
+ */
+static bool upipe_ts_check_output_bundle(struct upipe *upipe,
+                                         struct uref *uref,
+                                         unsigned int first, unsigned int nb,
+                                         const struct uref_ts_bundle_pkt *pkts,
+                                         struct upump **upump_p)
+{
+    if (!nb)
+        return true;
+
+    struct uref *output = uref_block_splice(uref, first * TS_SIZE,
+                                            nb * TS_SIZE);
+    if (unlikely(output == NULL ||
+                 !ubase_check(uref_ts_bundle_set(output, pkts, nb)))) {
+        if (output != NULL)
+            uref_free(output);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+    upipe_ts_check_output(upipe, output, upump_p);
+    return true;
+}
+
+/** @internal @This checks all packets of a uref and outputs them as TS
+ * bundles. Invalid packets are dropped.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param size size of the uref
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_check_input_bundle(struct upipe *upipe,
+                                        struct uref *uref, size_t size,
+                                        struct upump **upump_p)
+{
+    unsigned int nb_packets = size / TS_SIZE;
+    struct uref_ts_bundle_pkt pkts[nb_packets];
+    bool valid[nb_packets];
+    unsigned int first = 0;
+
+    if (unlikely(!ubase_check(upipe_ts_check_scan(upipe, uref, nb_packets,
+                                                  pkts, valid)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    for (unsigned int i = 0; i < nb_packets; i++) {
+        if (valid[i] && i + 1 - first < UREF_TS_BUNDLE_MAX_PKTS)
+            continue;
+
+        /* output the packets before an invalid one, or a full bundle */
+        unsigned int nb = valid[i] ? i + 1 - first : i - first;
+        if (!upipe_ts_check_output_bundle(upipe, uref, first, nb,
+                                          pkts + first, upump_p)) {
+            uref_free(uref);
+            return;
+        }
+        first = i + 1;
+    }
+
+    upipe_ts_check_output_bundle(upipe, uref, first, nb_packets - first,
+                                 pkts + first, upump_p);
+    uref_free(uref);
+}
+
 /** @internal @This tries to find TS packets in the buffered input urefs.
  *
  * @param upipe description structure of the pipe
@@ -150,6 +373,11 @@ static void upipe_ts_check_input(struct upipe *upipe, struct uref *uref,
         return;
     }
 
+    if (upipe_ts_check->bundle && upipe_ts_check->ts_size == TS_SIZE) {
+        upipe_ts_check_input_bundle(upipe, uref, size, upump_p);
+        return;
+    }
+
     while (size > upipe_ts_check->ts_size) {
         struct uref *output = uref_block_splice(uref, 0,
                                                 upipe_ts_check->ts_size);
@@ -230,6 +458,56 @@ static int _upipe_ts_check_set_size(struct upipe *upipe, int size)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns whether the pipe outputs TS bundles.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle_p filled in with true if TS bundles are output
+ * @return an error code
+ */
+static int _upipe_ts_check_get_bundle(struct upipe *upipe, bool *bundle_p)
+{
+    struct upipe_ts_check *upipe_ts_check = upipe_ts_check_from_upipe(upipe);
+    assert(bundle_p != NULL);
+    *bundle_p = upipe_ts_check->bundle;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets whether the pipe outputs TS bundles.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle true to output TS bundles
+ * @return an error code
+ */
+static int _upipe_ts_check_set_bundle(struct upipe *upipe, bool bundle)
+{
+    struct upipe_ts_check *upipe_ts_check = upipe_ts_check_from_upipe(upipe);
+    upipe_ts_check->bundle = bundle;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the error counters of the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param invalid_p filled in with the number of invalid packets
+ * @param cc_errors_p filled in with the number of continuity errors
+ * @param tei_errors_p filled in with the number of packets with the
+ * transport error indicator
+ * @return an error code
+ */
+static int _upipe_ts_check_get_stats(struct upipe *upipe, uint64_t *invalid_p,
+                                     uint64_t *cc_errors_p,
+                                     uint64_t *tei_errors_p)
+{
+    struct upipe_ts_check *upipe_ts_check = upipe_ts_check_from_upipe(upipe);
+    if (invalid_p != NULL)
+        *invalid_p = upipe_ts_check->invalid;
+    if (cc_errors_p != NULL)
+        *cc_errors_p = upipe_ts_check->cc_errors;
+    if (tei_errors_p != NULL)
+        *tei_errors_p = upipe_ts_check->tei_errors;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts check pipe.
  *
  * @param upipe description structure of the pipe
@@ -276,6 +554,24 @@ static int upipe_ts_check_control(struct upipe *upipe,
             int size = va_arg(args, int);
             return _upipe_ts_check_set_size(upipe, size);
         }
+        case UPIPE_TS_CHECK_GET_BUNDLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_CHECK_SIGNATURE)
+            bool *bundle_p = va_arg(args, bool *);
+            return _upipe_ts_check_get_bundle(upipe, bundle_p);
+        }
+        case UPIPE_TS_CHECK_SET_BUNDLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_CHECK_SIGNATURE)
+            bool bundle = va_arg(args, int);
+            return _upipe_ts_check_set_bundle(upipe, bundle);
+        }
+        case UPIPE_TS_CHECK_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_CHECK_SIGNATURE)
+            uint64_t *invalid_p = va_arg(args, uint64_t *);
+            uint64_t *cc_errors_p = va_arg(args, uint64_t *);
+            uint64_t *tei_errors_p = va_arg(args, uint64_t *);
+            return _upipe_ts_check_get_stats(upipe, invalid_p, cc_errors_p,
+                                             tei_errors_p);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
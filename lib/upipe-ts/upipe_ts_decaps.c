@@ -37,6 +37,7 @@
 #include <upipe/upipe_helper_void.h>
 #include <upipe/upipe_helper_output.h>
 #include <upipe-ts/upipe_ts_decaps.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -100,6 +101,131 @@ static struct upipe *upipe_ts_decaps_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This outputs a payload chunk.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param pkt description of the first packet of the chunk
+ * @param discontinuity true if a discontinuity precedes the chunk
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_decaps_output_chunk(struct upipe *upipe,
+                                         struct uref *uref,
+                                         const struct uref_ts_bundle_pkt *pkt,
+                                         bool discontinuity,
+                                         struct upump **upump_p)
+{
+    if (unlikely(discontinuity))
+        uref_flow_set_discontinuity(uref);
+    if (unlikely(pkt->flags & UREF_TS_BUNDLE_UNITSTART))
+        uref_block_set_start(uref);
+    if (unlikely(pkt->flags & UREF_TS_BUNDLE_ERROR))
+        uref_flow_set_error(uref);
+    upipe_ts_decaps_output(upipe, uref, upump_p);
+}
+
+/** @internal @This parses and removes the TS headers of a TS bundle, using
+ * the description of its packets. The payloads of consecutive packets are
+ * output as a single chunk, unless a packet starts a unit, carries a PCR or
+ * follows a discontinuity.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param nb number of packets in the bundle
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_decaps_input_bundle(struct upipe *upipe,
+                                         struct uref *uref, unsigned int nb,
+                                         struct upump **upump_p)
+{
+    struct upipe_ts_decaps *upipe_ts_decaps = upipe_ts_decaps_from_upipe(upipe);
+    struct uref_ts_bundle_pkt pkts[nb];
+    if (unlikely(!ubase_check(uref_ts_bundle_read(uref, 0, nb, pkts)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_INVALID);
+        return;
+    }
+    /* do not propagate the description to the payloads */
+    uref_ts_bundle_delete(uref);
+
+    struct uref *chunk = NULL;
+    struct uref_ts_bundle_pkt *chunk_pkt = NULL;
+    bool chunk_discontinuity = false;
+    for (unsigned int i = 0; i < nb; i++) {
+        struct uref_ts_bundle_pkt *pkt = &pkts[i];
+        bool discontinuity = upipe_ts_decaps->last_cc == -1;
+        if (unlikely(!discontinuity &&
+                     (pkt->flags & UREF_TS_BUNDLE_DISCONTINUITY))) {
+            upipe_warn(upipe, "discontinuity flagged");
+            discontinuity = true;
+        }
+
+        if (unlikely(pkt->flags & UREF_TS_BUNDLE_PCR)) {
+            uint64_t pcrval = pkt->pcr * (UCLOCK_FREQ / 27000000);
+            struct uref *ref = uref_dup(uref);
+            if (unlikely(ref == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                break;
+            }
+            uref_clock_set_ref(ref);
+            upipe_throw_clock_ref(upipe, ref, pcrval, discontinuity ? 1 : 0);
+            uref_free(ref);
+        }
+
+        if (unlikely(ts_check_duplicate(pkt->cc, upipe_ts_decaps->last_cc)))
+            continue;
+
+        if (unlikely(!discontinuity &&
+                     ts_check_discontinuity(pkt->cc,
+                                            upipe_ts_decaps->last_cc))) {
+            upipe_warn_va(upipe, "potentially lost %d packets",
+                          (0x10 + pkt->cc - upipe_ts_decaps->last_cc - 1) &
+                          0xf);
+            discontinuity = true;
+        }
+        upipe_ts_decaps->last_cc = pkt->cc;
+
+        if (unlikely(!(pkt->flags & UREF_TS_BUNDLE_PAYLOAD)))
+            continue;
+
+        struct uref *payload = uref_block_splice(uref,
+                i * UREF_TS_BUNDLE_PKT_SIZE + pkt->payload,
+                UREF_TS_BUNDLE_PKT_SIZE - pkt->payload);
+        if (unlikely(payload == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            break;
+        }
+
+        if (chunk != NULL && !discontinuity &&
+            !(pkt->flags & (UREF_TS_BUNDLE_UNITSTART | UREF_TS_BUNDLE_PCR |
+                            UREF_TS_BUNDLE_ERROR)) &&
+            !(chunk_pkt->flags & UREF_TS_BUNDLE_ERROR)) {
+            struct ubuf *ubuf = uref_detach_ubuf(payload);
+            uref_free(payload);
+            if (unlikely(!ubase_check(uref_block_append(chunk, ubuf)))) {
+                ubuf_free(ubuf);
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                break;
+            }
+            continue;
+        }
+
+        if (chunk != NULL)
+            upipe_ts_decaps_output_chunk(upipe, chunk, chunk_pkt,
+                                         chunk_discontinuity, upump_p);
+        if (unlikely(pkt->flags & UREF_TS_BUNDLE_PCR))
+            uref_clock_set_ref(payload);
+        chunk = payload;
+        chunk_pkt = pkt;
+        chunk_discontinuity = discontinuity;
+    }
+
+    if (chunk != NULL)
+        upipe_ts_decaps_output_chunk(upipe, chunk, chunk_pkt,
+                                     chunk_discontinuity, upump_p);
+    uref_free(uref);
+}
+
 /** @internal @This parses and removes the TS header of a packet.
  *
  * @param upipe description structure of the pipe
@@ -109,6 +235,12 @@ static struct upipe *upipe_ts_decaps_alloc(struct upipe_mgr *mgr,
 static void upipe_ts_decaps_input(struct upipe *upipe, struct uref *uref,
                                   struct upump **upump_p)
 {
+    unsigned int nb;
+    if (unlikely(ubase_check(uref_ts_bundle_get_nb(uref, &nb)))) {
+        upipe_ts_decaps_input_bundle(upipe, uref, nb, upump_p);
+        return;
+    }
+
     struct upipe_ts_decaps *upipe_ts_decaps = upipe_ts_decaps_from_upipe(upipe);
     uint8_t buffer[TS_HEADER_SIZE];
     const uint8_t *ts_header = uref_block_peek(uref, 0, TS_HEADER_SIZE,
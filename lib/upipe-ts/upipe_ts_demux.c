@@ -26,7 +26,7 @@
  * until ts_psi_split
  * @item output source pipe, which is returned to the application, and
  * represents an elementary stream; it sets up the ts_decaps, pes_decaps and
- * framer inner pipes
+ * framer inner pipes, the framer being optionally run in a worker thread
  * @item program split pipe, which is returned to the application, and
  * represents a program; it sets up the ts_split_output and ts_pmtd inner pipes
  * @item demux sink pipe which sets up the ts_split, ts_patd and optional input
@@ -57,6 +57,7 @@
 #include <upipe/upipe_helper_subpipe.h>
 #include <upipe-modules/upipe_null.h>
 #include <upipe-modules/upipe_setrap.h>
+#include <upipe-modules/upipe_worker_linear.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include <upipe-ts/upipe_ts_demux.h>
 #include <upipe-ts/upipe_ts_split.h>
@@ -99,6 +100,8 @@
 #define MAX_DELAY_14496 (UCLOCK_FREQ * 10)
 /** max retention time for still pictures streams (ISO/IEC 13818-1 2.4.2.6) */
 #define MAX_DELAY_STILL (UCLOCK_FREQ * 60)
+/** number of packets in the queues between the demux and its workers */
+#define WORKER_QUEUE_LENGTH 255
 
 /** @internal @This is the private context of a ts_demux manager. */
 struct upipe_ts_demux_mgr {
@@ -143,6 +146,8 @@ struct upipe_ts_demux_mgr {
     struct upipe_mgr *mpgvf_mgr;
     /** pointer to h264f manager */
     struct upipe_mgr *h264f_mgr;
+    /** pointer to h265f manager */
+    struct upipe_mgr *h265f_mgr;
     /** pointer to telxf manager */
     struct upipe_mgr *telxf_mgr;
     /** pointer to dvbsubf manager */
@@ -206,6 +211,18 @@ struct upipe_ts_demux {
     /** current conformance */
     enum upipe_ts_conformance conformance;
 
+    /** output of the PSI in passthrough mode, or NULL */
+    struct upipe *passthrough;
+    /** true if the flow definition was sent to the passthrough output */
+    bool passthrough_flow_def;
+    /** buffer containing the last PAT section sent in passthrough mode */
+    uint8_t passthrough_pat[PSI_MAX_SIZE + PSI_HEADER_SIZE];
+
+    /** true if the input is checked into TS bundles */
+    bool bundle;
+    /** true if the first inner pipe is a ts_check */
+    bool input_check;
+
     /** probe to get new flow events from inner pipes created by psi_pid
      * objects */
     struct uprobe psi_pid_plumber;
@@ -334,6 +351,8 @@ struct upipe_ts_demux_output {
     uint64_t pid;
     /** true if the output is used for PCR */
     bool pcr;
+    /** true if the output passes TS packets through */
+    bool passthrough;
     /** ts_split_output inner pipe */
     struct upipe *split_output;
     /** setrap inner pipe */
@@ -389,6 +408,8 @@ struct upipe_ts_demux_psi_pid {
     struct upipe *psi_split;
     /** pointer to split_output inner pipe */
     struct upipe *split_output;
+    /** continuity counter of the packets sent in passthrough mode */
+    uint8_t cc;
     /** reference count */
     unsigned int refcount;
 };
@@ -457,6 +478,7 @@ static struct upipe_ts_demux_psi_pid *
         return NULL;
     }
 
+    psi_pid->cc = 0;
     psi_pid->refcount = 1;
     uchain_init(upipe_ts_demux_psi_pid_to_uchain(psi_pid));
     ulist_add(&upipe_ts_demux->psi_pids,
@@ -530,6 +552,169 @@ static void upipe_ts_demux_psi_pid_release(struct upipe *upipe,
 }
 
 
+/*
+ * passthrough mode
+ */
+
+/** @internal @This packetizes a PSI section and sends the TS packets to the
+ * passthrough output.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi_pid PID carrying the section
+ * @param uref uref carrying the attributes of the packets
+ * @param section pointer to the section
+ */
+static void upipe_ts_demux_passthrough_section(struct upipe *upipe,
+        struct upipe_ts_demux_psi_pid *psi_pid, struct uref *uref,
+        const uint8_t *section)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    if (unlikely(uref->ubuf == NULL))
+        return;
+
+    if (!upipe_ts_demux->passthrough_flow_def) {
+        struct uref *flow_def = uref_dup(upipe_ts_demux->flow_def_input);
+        if (unlikely(flow_def == NULL ||
+                     !ubase_check(uref_flow_set_def(flow_def,
+                             "block.mpegts.mpegtspsi.")))) {
+            if (flow_def != NULL)
+                uref_free(flow_def);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        upipe_set_flow_def(upipe_ts_demux->passthrough, flow_def);
+        uref_free(flow_def);
+        upipe_ts_demux->passthrough_flow_def = true;
+    }
+
+    size_t section_size = psi_get_length(section) + PSI_HEADER_SIZE;
+    size_t offset = 0;
+    while (offset < section_size) {
+        struct ubuf *ubuf = ubuf_block_alloc(uref->ubuf->mgr, TS_SIZE);
+        struct uref *output = uref_dup(uref);
+        uint8_t *buffer;
+        int size = -1;
+        if (unlikely(ubuf == NULL || output == NULL ||
+                     !ubase_check(ubuf_block_write(ubuf, 0, &size,
+                                                   &buffer)))) {
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            if (output != NULL)
+                uref_free(output);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+
+        ts_init(buffer);
+        ts_set_pid(buffer, psi_pid->pid);
+        ts_set_cc(buffer, psi_pid->cc);
+        ts_set_payload(buffer);
+        psi_pid->cc = (psi_pid->cc + 1) & 0xf;
+        uint8_t *payload = buffer + TS_HEADER_SIZE;
+        if (!offset) {
+            ts_set_unitstart(buffer);
+            /* pointer_field */
+            *payload++ = 0;
+        }
+        size_t payload_size = buffer + TS_SIZE - payload;
+        if (payload_size > section_size - offset)
+            payload_size = section_size - offset;
+        memcpy(payload, section + offset, payload_size);
+        memset(payload + payload_size, 0xff,
+               buffer + TS_SIZE - payload - payload_size);
+        ubuf_block_unmap(ubuf, 0);
+        offset += payload_size;
+
+        uref_attach_ubuf(output, ubuf);
+        upipe_input(upipe_ts_demux->passthrough, output, NULL);
+    }
+}
+
+/** @internal @This sends a PSI section received by a decoder in passthrough
+ * mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi_pid PID carrying the section
+ * @param uref uref carrying the section
+ */
+static void upipe_ts_demux_passthrough_uref(struct upipe *upipe,
+        struct upipe_ts_demux_psi_pid *psi_pid, struct uref *uref)
+{
+    uint8_t section[PSI_MAX_SIZE + PSI_HEADER_SIZE];
+    size_t size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &size)) ||
+                 size < PSI_HEADER_SIZE || size > sizeof(section) ||
+                 !ubase_check(uref_block_extract(uref, 0, size, section)) ||
+                 psi_get_length(section) + PSI_HEADER_SIZE > size)) {
+        upipe_warn(upipe, "invalid passthrough section");
+        return;
+    }
+    upipe_ts_demux_passthrough_section(upipe, psi_pid, uref, section);
+}
+
+/** @internal @This sends a PAT listing the programs having outputs, in
+ * passthrough mode. The version is incremented whenever the list changes.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref carrying the last section of the received PAT
+ */
+static void upipe_ts_demux_passthrough_pat(struct upipe *upipe,
+                                           struct uref *uref)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    uint8_t header_buffer[PAT_HEADER_SIZE];
+    const uint8_t *header = uref_block_peek(uref, 0, PAT_HEADER_SIZE,
+                                            header_buffer);
+    if (unlikely(header == NULL))
+        return;
+    uint16_t tsid = psi_get_tableidext(header);
+    uref_block_peek_unmap(uref, 0, header_buffer, header);
+
+    uint8_t *last = upipe_ts_demux->passthrough_pat;
+    uint8_t buffer[PSI_MAX_SIZE + PSI_HEADER_SIZE];
+    pat_init(buffer);
+    psi_set_length(buffer, PSI_MAX_SIZE);
+    pat_set_tsid(buffer, tsid);
+    psi_set_version(buffer, psi_get_version(last));
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 0);
+
+    unsigned int nb_programs = 0;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_demux->programs, uchain) {
+        struct upipe_ts_demux_program *program =
+            upipe_ts_demux_program_from_uchain(uchain);
+        if (ulist_empty(&program->outputs))
+            continue;
+
+        uint8_t *pat_program = pat_get_program(buffer, nb_programs);
+        if (unlikely(pat_program == NULL)) {
+            upipe_warn(upipe, "too many programs for the passthrough PAT");
+            break;
+        }
+        patn_init(pat_program);
+        patn_set_program(pat_program, program->program);
+        patn_set_pid(pat_program, program->pmt_pid);
+        nb_programs++;
+    }
+    pat_set_length(buffer, nb_programs * PAT_PROGRAM_SIZE);
+    psi_set_crc(buffer);
+
+    size_t size = psi_get_length(buffer) + PSI_HEADER_SIZE;
+    if (memcmp(last, buffer, size)) {
+        if (psi_get_length(last)) {
+            psi_set_version(buffer, (psi_get_version(last) + 1) & 0x1f);
+            psi_set_crc(buffer);
+        }
+        memcpy(last, buffer, size);
+    }
+
+    upipe_ts_demux_passthrough_section(upipe, upipe_ts_demux->psi_pid_pat,
+                                       uref, buffer);
+}
+
+
 /*
  * upipe_ts_demux_output structure handling (derived from upipe structure)
  */
@@ -611,6 +796,65 @@ static int upipe_ts_demux_output_clock_ts(struct upipe *upipe,
     return upipe_throw(upipe, event, uref);
 }
 
+/** @internal @This allocates the framer of an output. If the application
+ * provides a worker when the @ref UPROBE_TS_DEMUX_NEED_WORKER event is thrown,
+ * the framer runs in the remote thread of the worker, fed through queues.
+ *
+ * @param upipe description structure of the pipe
+ * @param inner pointer to the inner pipe needing an output
+ * @param framer_mgr manager of the framer
+ * @param name name of the framer
+ * @return an error code
+ */
+static int upipe_ts_demux_output_alloc_framer(struct upipe *upipe,
+                                              struct upipe *inner,
+                                              struct upipe_mgr *framer_mgr,
+                                              const char *name)
+{
+    struct upipe_ts_demux_output *upipe_ts_demux_output =
+        upipe_ts_demux_output_from_upipe(upipe);
+    struct upipe_mgr *wlin_mgr = NULL;
+    struct uprobe *uprobe_remote = NULL;
+    upipe_throw(upipe, UPROBE_TS_DEMUX_NEED_WORKER, UPIPE_TS_DEMUX_SIGNATURE,
+                &wlin_mgr, &uprobe_remote);
+
+    if (wlin_mgr == NULL || uprobe_remote == NULL) {
+        uprobe_release(uprobe_remote);
+        struct upipe *output =
+            upipe_void_alloc_output(inner, framer_mgr,
+                uprobe_pfx_alloc(
+                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
+                    UPROBE_LOG_VERBOSE, name));
+        if (unlikely(output == NULL))
+            return UBASE_ERR_ALLOC;
+        upipe_ts_demux_output_store_last_inner(upipe, output);
+        return UBASE_ERR_NONE;
+    }
+
+    struct upipe *framer = upipe_void_alloc(framer_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_remote),
+                             UPROBE_LOG_VERBOSE, name));
+    if (unlikely(framer == NULL)) {
+        uprobe_release(uprobe_remote);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct upipe *output = upipe_wlin_alloc(wlin_mgr,
+            uprobe_pfx_alloc_va(
+                uprobe_use(&upipe_ts_demux_output->last_inner_probe),
+                UPROBE_LOG_VERBOSE, "%s worker", name),
+            framer, uprobe_remote, WORKER_QUEUE_LENGTH, WORKER_QUEUE_LENGTH);
+    if (unlikely(output == NULL))
+        return UBASE_ERR_ALLOC;
+    int err = upipe_set_output(inner, output);
+    if (unlikely(!ubase_check(err))) {
+        upipe_release(output);
+        return err;
+    }
+    upipe_ts_demux_output_store_last_inner(upipe, output);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This catches need_output events coming from output inner pipes.
  *
  * @param upipe description structure of the pipe
@@ -637,6 +881,13 @@ static int upipe_ts_demux_output_plumber(struct upipe *upipe,
     if (!uprobe_plumber(event, args, &flow_def, &def))
         return upipe_throw_proxy(upipe, inner, event, args);
 
+    if (!ubase_ncmp(def, "block.mpegts.") &&
+        upipe_ts_demux_output->passthrough) {
+        /* output the TS packets */
+        upipe_ts_demux_output_store_last_inner(upipe, upipe_use(inner));
+        return UBASE_ERR_NONE;
+    }
+
     if (!ubase_ncmp(def, "block.mpegts.")) {
         /* allocate ts_decaps inner */
         struct upipe *output =
@@ -668,101 +919,59 @@ static int upipe_ts_demux_output_plumber(struct upipe *upipe,
          !ubase_ncmp(def, "block.aac.")) &&
         ts_demux_mgr->mpgaf_mgr != NULL) {
         /* allocate mpgaf inner */
-        struct upipe *output =
-            upipe_void_alloc_output(inner, ts_demux_mgr->mpgaf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "mpgaf"));
-        if (unlikely(output == NULL))
-            return UBASE_ERR_ALLOC;
-        upipe_ts_demux_output_store_last_inner(upipe, output);
-        return UBASE_ERR_NONE;
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->mpgaf_mgr, "mpgaf");
     }
 
     if ((!ubase_ncmp(def, "block.ac3.") ||
          !ubase_ncmp(def, "block.eac3.")) &&
         ts_demux_mgr->a52f_mgr != NULL) {
         /* allocate a52f inner */
-        struct upipe *output =
-            upipe_void_alloc_output(inner, ts_demux_mgr->a52f_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "a52f"));
-        if (unlikely(output == NULL))
-            return UBASE_ERR_ALLOC;
-        upipe_ts_demux_output_store_last_inner(upipe, output);
-        return UBASE_ERR_NONE;
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->a52f_mgr, "a52f");
     }
 
     if ((!ubase_ncmp(def, "block.mpeg2video.") ||
          !ubase_ncmp(def, "block.mpeg1video.")) &&
         ts_demux_mgr->mpgvf_mgr != NULL) {
         /* allocate mpgvf inner */
-        struct upipe *output =
-            upipe_void_alloc_output(inner, ts_demux_mgr->mpgvf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "mpgvf"));
-        if (unlikely(output == NULL))
-            return UBASE_ERR_ALLOC;
-        upipe_ts_demux_output_store_last_inner(upipe, output);
-        return UBASE_ERR_NONE;
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->mpgvf_mgr, "mpgvf");
     }
 
     if (!ubase_ncmp(def, "block.h264.") &&
         ts_demux_mgr->h264f_mgr != NULL) {
         /* allocate h264f inner */
-        struct upipe *output =
-            upipe_void_alloc_output(inner, ts_demux_mgr->h264f_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "h264f"));
-        if (unlikely(output == NULL))
-            return UBASE_ERR_ALLOC;
-        upipe_ts_demux_output_store_last_inner(upipe, output);
-        return UBASE_ERR_NONE;
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->h264f_mgr, "h264f");
+    }
+
+    if (!ubase_ncmp(def, "block.hevc.") &&
+        ts_demux_mgr->h265f_mgr != NULL) {
+        /* allocate h265f inner */
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->h265f_mgr, "h265f");
     }
 
     if (!ubase_ncmp(def, "block.dvb_teletext.") &&
         ts_demux_mgr->telxf_mgr != NULL) {
         /* allocate telxf inner */
-        struct upipe *output =
-            upipe_void_alloc_output(inner, ts_demux_mgr->telxf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "telxf"));
-        if (unlikely(output == NULL))
-            return UBASE_ERR_ALLOC;
-        upipe_ts_demux_output_store_last_inner(upipe, output);
-        return UBASE_ERR_NONE;
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->telxf_mgr, "telxf");
     }
 
     if (!ubase_ncmp(def, "block.dvb_subtitle.") &&
         ts_demux_mgr->dvbsubf_mgr != NULL) {
         /* allocate dvbsubf inner */
-        struct upipe *output =
-            upipe_void_alloc_output(inner, ts_demux_mgr->dvbsubf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "dvbsubf"));
-        if (unlikely(output == NULL))
-            return UBASE_ERR_ALLOC;
-        upipe_ts_demux_output_store_last_inner(upipe, output);
-        return UBASE_ERR_NONE;
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->dvbsubf_mgr, "dvbsubf");
     }
 
     if (!ubase_ncmp(def, "block.opus.") &&
         ts_demux_mgr->opusf_mgr != NULL) {
         /* allocate opusf inner */
-        struct upipe *output =
-            upipe_void_alloc_output(inner, ts_demux_mgr->opusf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "opusf"));
-        if (unlikely(output == NULL))
-            return UBASE_ERR_ALLOC;
-        upipe_ts_demux_output_store_last_inner(upipe, output);
-        return UBASE_ERR_NONE;
+        return upipe_ts_demux_output_alloc_framer(upipe, inner,
+                ts_demux_mgr->opusf_mgr, "opusf");
     }
 
     upipe_warn_va(upipe, "unknown output flow definition: %s", def);
@@ -823,6 +1032,7 @@ static struct upipe *upipe_ts_demux_output_alloc(struct upipe_mgr *mgr,
     upipe_ts_demux_output_init_bin_output(upipe,
             upipe_ts_demux_output_to_urefcount_real(upipe_ts_demux_output));
     upipe_ts_demux_output->pcr = false;
+    upipe_ts_demux_output->passthrough = false;
     upipe_ts_demux_output->split_output = NULL;
     upipe_ts_demux_output->setrap = NULL;
     upipe_ts_demux_output->max_delay = MAX_DELAY_STILL;
@@ -852,6 +1062,7 @@ static struct upipe *upipe_ts_demux_output_alloc(struct upipe_mgr *mgr,
                 upipe_ts_demux_program_to_upipe(program)->mgr);
     struct upipe_ts_demux_mgr *ts_demux_mgr =
         upipe_ts_demux_mgr_from_upipe_mgr(upipe_ts_demux_to_upipe(demux)->mgr);
+    upipe_ts_demux_output->passthrough = demux->passthrough != NULL;
     /* set up split_output and set rap inner pipes */
     if (unlikely((upipe_ts_demux_output->split_output =
                     upipe_flow_alloc_sub(
@@ -1142,6 +1353,15 @@ static int upipe_ts_demux_program_pmtd_probe(struct uprobe *uprobe,
             uint64_t pmt_rap;
             if (ubase_check(uref_clock_get_rap_sys(uref, &pmt_rap)))
                 upipe_ts_demux_program->pmt_rap = pmt_rap;
+
+            struct upipe_ts_demux *demux =
+                upipe_ts_demux_from_program_mgr(upipe->mgr);
+            if (demux->passthrough != NULL &&
+                upipe_ts_demux_program->psi_pid != NULL &&
+                !ulist_empty(&upipe_ts_demux_program->outputs))
+                upipe_ts_demux_passthrough_uref(
+                        upipe_ts_demux_to_upipe(demux),
+                        upipe_ts_demux_program->psi_pid, uref);
             return UBASE_ERR_NONE;
         }
         case UPROBE_NEW_FLOW_DEF:
@@ -1233,7 +1453,11 @@ static void upipe_ts_demux_program_handle_pcr(struct upipe *upipe,
 }
 
 /** @internal @This checks whether there is a ts_decaps on the PID
- * carrying the PCR, and otherwise allocates/deallocates one.
+ * carrying the PCR, and otherwise allocates/deallocates one. A program
+ * without any output is not selected by the application, and only keeps
+ * a filter on its PMT PID, so that its elementary streams can still be
+ * listed; the PCR PID is only decapsulated once an output is allocated.
+ * Outputs in passthrough mode have no ts_decaps of their own.
  *
  * @param upipe description structure of the pipe
  */
@@ -1247,13 +1471,15 @@ static void upipe_ts_demux_program_check_pcr(struct upipe *upipe)
     struct upipe_ts_demux *demux = upipe_ts_demux_from_program_mgr(upipe->mgr);
     struct upipe_ts_demux_mgr *ts_demux_mgr =
         upipe_ts_demux_mgr_from_upipe_mgr(upipe_ts_demux_to_upipe(demux)->mgr);
-    bool found = upipe_ts_demux_program->pcr_pid == 8191;
+    bool found = upipe_ts_demux_program->pcr_pid == 8191 ||
+                 ulist_empty(&upipe_ts_demux_program->outputs);
 
     struct uchain *uchain;
     ulist_foreach (&upipe_ts_demux_program->outputs, uchain) {
         struct upipe_ts_demux_output *output =
             upipe_ts_demux_output_from_uchain(uchain);
-        if (output->pid == upipe_ts_demux_program->pcr_pid) {
+        if (output->pid == upipe_ts_demux_program->pcr_pid &&
+            !output->passthrough) {
             output->pcr = !found;
             found = true;
         } else
@@ -1658,6 +1884,10 @@ static int upipe_ts_demux_patd_new_rap(struct upipe *upipe,
     struct uref *uref = va_arg(args, struct uref *);
     assert(uref != NULL);
 
+    if (upipe_ts_demux->passthrough != NULL &&
+        upipe_ts_demux->psi_pid_pat != NULL)
+        upipe_ts_demux_passthrough_pat(upipe, uref);
+
     uint64_t pat_rap;
     UBASE_RETURN(uref_clock_get_rap_sys(uref, &pat_rap))
     return upipe_setrap_set_rap(upipe_ts_demux->setrap, pat_rap);
@@ -1843,6 +2073,12 @@ static struct upipe *upipe_ts_demux_alloc(struct upipe_mgr *mgr,
     upipe_ts_demux->auto_conformance = true;
     upipe_ts_demux->nit_pid = 0;
     upipe_ts_demux->flow_def_input = NULL;
+    upipe_ts_demux->passthrough = NULL;
+    upipe_ts_demux->passthrough_flow_def = false;
+    upipe_ts_demux->bundle = false;
+    upipe_ts_demux->input_check = false;
+    memset(upipe_ts_demux->passthrough_pat, 0,
+           sizeof(upipe_ts_demux->passthrough_pat));
 
     uprobe_init(&upipe_ts_demux->psi_pid_plumber,
                 upipe_ts_demux_psi_pid_plumber, NULL);
@@ -1925,6 +2161,10 @@ static int upipe_ts_demux_set_flow_def(struct upipe *upipe,
         }
         ret = ubase_check(upipe_set_flow_def(input, flow_def));
         assert(ret);
+        upipe_ts_demux->input_check = !ubase_ncmp(def, EXPECTED_FLOW_DEF_CHECK);
+        if (upipe_ts_demux->input_check && upipe_ts_demux->bundle &&
+            !ubase_check(upipe_ts_check_set_bundle(input, true)))
+            upipe_warn(upipe, "unable to check the input into TS bundles");
         upipe_ts_demux_store_first_inner(upipe, input);
 
         upipe_ts_demux->setrap =
@@ -2073,6 +2313,197 @@ static int _upipe_ts_demux_set_conformance(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This compacts the tables of the inner ts_split, and asks the
+ * framers of the outputs to release their pending state.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int _upipe_ts_demux_hibernate(struct upipe *upipe)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    if (upipe_ts_demux->split != NULL)
+        upipe_hibernate(upipe_ts_demux->split);
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_demux->programs, uchain) {
+        struct upipe_ts_demux_program *program =
+            upipe_ts_demux_program_from_uchain(uchain);
+        struct uchain *uchain_output;
+        ulist_foreach (&program->outputs, uchain_output) {
+            struct upipe_ts_demux_output *output =
+                upipe_ts_demux_output_from_uchain(uchain_output);
+            if (output->last_inner != NULL)
+                upipe_hibernate(output->last_inner);
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns a snapshot of the PAT and of the PMTs of the
+ * allocated programs.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref_p filled in with a new uref containing the sections
+ * @return an error code
+ */
+static int _upipe_ts_demux_get_psi(struct upipe *upipe, struct uref **uref_p)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    assert(uref_p != NULL);
+    if (upipe_ts_demux->last_inner == NULL)
+        return UBASE_ERR_INVALID;
+
+    struct uref *uref;
+    UBASE_RETURN(upipe_ts_patd_get_table(upipe_ts_demux->last_inner, &uref))
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_demux->programs, uchain) {
+        struct upipe_ts_demux_program *program =
+            upipe_ts_demux_program_from_uchain(uchain);
+        struct uref *pmt;
+        if (program->last_inner == NULL ||
+            !ubase_check(upipe_ts_pmtd_get_table(program->last_inner, &pmt)))
+            continue;
+
+        int err = uref_block_append(uref, pmt->ubuf);
+        if (unlikely(!ubase_check(err))) {
+            uref_free(pmt);
+            uref_free(uref);
+            return err;
+        }
+        pmt->ubuf = NULL;
+        uref_free(pmt);
+    }
+    *uref_p = uref;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This feeds the sections of a snapshot of the PSI to the PSI
+ * decoders, as if they had been received.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi snapshot of the PSI
+ * @return an error code
+ */
+static int _upipe_ts_demux_set_psi(struct upipe *upipe, struct uref *psi)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    if (upipe_ts_demux->psi_pid_pat == NULL || psi == NULL)
+        return UBASE_ERR_INVALID;
+
+    size_t size;
+    UBASE_RETURN(uref_block_size(psi, &size))
+    size_t offset = 0;
+    while (offset + PSI_HEADER_SIZE_SYNTAX1 <= size) {
+        uint8_t buffer[PSI_HEADER_SIZE_SYNTAX1];
+        const uint8_t *header = uref_block_peek(psi, offset,
+                                                PSI_HEADER_SIZE_SYNTAX1,
+                                                buffer);
+        if (unlikely(header == NULL))
+            return UBASE_ERR_INVALID;
+        uint8_t tableid = psi_get_tableid(header);
+        uint16_t tableidext = psi_get_tableidext(header);
+        size_t section_size = psi_get_length(header) + PSI_HEADER_SIZE;
+        UBASE_RETURN(uref_block_peek_unmap(psi, offset, buffer, header))
+        if (unlikely(offset + section_size > size))
+            break;
+
+        struct upipe *psi_split = NULL;
+        if (tableid == PAT_TABLE_ID)
+            psi_split = upipe_ts_demux->psi_pid_pat->psi_split;
+        else if (tableid == PMT_TABLE_ID) {
+            struct uchain *uchain;
+            ulist_foreach (&upipe_ts_demux->programs, uchain) {
+                struct upipe_ts_demux_program *program =
+                    upipe_ts_demux_program_from_uchain(uchain);
+                if (program->program == tableidext &&
+                    program->psi_pid != NULL) {
+                    psi_split = program->psi_pid->psi_split;
+                    break;
+                }
+            }
+        }
+
+        if (psi_split != NULL) {
+            struct uref *section = uref_block_splice(psi, offset,
+                                                     section_size);
+            if (unlikely(section == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return UBASE_ERR_ALLOC;
+            }
+            /* the programs may be allocated or released meanwhile */
+            upipe_use(psi_split);
+            upipe_input(psi_split, section, NULL);
+            upipe_release(psi_split);
+        }
+        offset += section_size;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the output of the PSI in passthrough mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param output_p filled in with the output
+ * @return an error code
+ */
+static int _upipe_ts_demux_get_passthrough(struct upipe *upipe,
+                                           struct upipe **output_p)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    assert(output_p != NULL);
+    *output_p = upipe_ts_demux->passthrough;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the output of the PSI in passthrough mode. It only
+ * applies to the outputs allocated afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param output output of the PSI, or NULL to disable the passthrough mode
+ * @return an error code
+ */
+static int _upipe_ts_demux_set_passthrough(struct upipe *upipe,
+                                           struct upipe *output)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    upipe_release(upipe_ts_demux->passthrough);
+    upipe_ts_demux->passthrough = upipe_use(output);
+    upipe_ts_demux->passthrough_flow_def = false;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns whether the input is checked into TS bundles.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle_p filled in with true if TS bundles are used
+ * @return an error code
+ */
+static int _upipe_ts_demux_get_bundle(struct upipe *upipe, bool *bundle_p)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    assert(bundle_p != NULL);
+    *bundle_p = upipe_ts_demux->bundle;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets whether the input is checked into TS bundles, and
+ * forwards it to the ts_check inner pipe if it is already allocated.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle true to use TS bundles
+ * @return an error code
+ */
+static int _upipe_ts_demux_set_bundle(struct upipe *upipe, bool bundle)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    if (upipe_ts_demux->input != NULL && upipe_ts_demux->input_check)
+        UBASE_RETURN(upipe_ts_check_set_bundle(upipe_ts_demux->input, bundle))
+    upipe_ts_demux->bundle = bundle;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts_demux pipe.
  *
  * @param upipe description structure of the pipe
@@ -2102,6 +2533,8 @@ static int upipe_ts_demux_control(struct upipe *upipe,
             struct upipe **p = va_arg(args, struct upipe **);
             return upipe_ts_demux_iterate_sub(upipe, p);
         }
+        case UPIPE_HIBERNATE:
+            return _upipe_ts_demux_hibernate(upipe);
 
         case UPIPE_TS_DEMUX_GET_CONFORMANCE: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
@@ -2115,6 +2548,36 @@ static int upipe_ts_demux_control(struct upipe *upipe,
                 va_arg(args, enum upipe_ts_conformance);
             return _upipe_ts_demux_set_conformance(upipe, conformance);
         }
+        case UPIPE_TS_DEMUX_GET_PSI: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct uref **uref_p = va_arg(args, struct uref **);
+            return _upipe_ts_demux_get_psi(upipe, uref_p);
+        }
+        case UPIPE_TS_DEMUX_SET_PSI: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct uref *uref = va_arg(args, struct uref *);
+            return _upipe_ts_demux_set_psi(upipe, uref);
+        }
+        case UPIPE_TS_DEMUX_GET_PASSTHROUGH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe **output_p = va_arg(args, struct upipe **);
+            return _upipe_ts_demux_get_passthrough(upipe, output_p);
+        }
+        case UPIPE_TS_DEMUX_SET_PASSTHROUGH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe *output = va_arg(args, struct upipe *);
+            return _upipe_ts_demux_set_passthrough(upipe, output);
+        }
+        case UPIPE_TS_DEMUX_GET_BUNDLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            bool *bundle_p = va_arg(args, bool *);
+            return _upipe_ts_demux_get_bundle(upipe, bundle_p);
+        }
+        case UPIPE_TS_DEMUX_SET_BUNDLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            bool bundle = va_arg(args, int);
+            return _upipe_ts_demux_set_bundle(upipe, bundle);
+        }
 
         default:
             break;
@@ -2180,6 +2643,8 @@ static void upipe_ts_demux_no_input(struct upipe *upipe)
         upipe_release(upipe_ts_demux->psi_split_output_pat);
     if (upipe_ts_demux->psi_pid_pat != NULL)
         upipe_ts_demux_psi_pid_release(upipe, upipe_ts_demux->psi_pid_pat);
+    upipe_release(upipe_ts_demux->passthrough);
+    upipe_ts_demux->passthrough = NULL;
     upipe_ts_demux_clean_bin_input(upipe);
     upipe_ts_demux_clean_bin_output(upipe);
     urefcount_release(upipe_ts_demux_to_urefcount_real(upipe_ts_demux));
@@ -2223,6 +2688,8 @@ static void upipe_ts_demux_mgr_free(struct urefcount *urefcount)
         upipe_mgr_release(ts_demux_mgr->mpgvf_mgr);
     if (ts_demux_mgr->h264f_mgr != NULL)
         upipe_mgr_release(ts_demux_mgr->h264f_mgr);
+    if (ts_demux_mgr->h265f_mgr != NULL)
+        upipe_mgr_release(ts_demux_mgr->h265f_mgr);
     if (ts_demux_mgr->telxf_mgr != NULL)
         upipe_mgr_release(ts_demux_mgr->telxf_mgr);
     if (ts_demux_mgr->dvbsubf_mgr != NULL)
@@ -2279,6 +2746,7 @@ static int upipe_ts_demux_mgr_control(struct upipe_mgr *mgr,
         GET_SET_MGR(a52f, A52F)
         GET_SET_MGR(mpgvf, MPGVF)
         GET_SET_MGR(h264f, H264F)
+        GET_SET_MGR(h265f, H265F)
         GET_SET_MGR(telxf, TELXF)
         GET_SET_MGR(dvbsubf, DVBSUBF)
         GET_SET_MGR(opusf, OPUSF)
@@ -2317,6 +2785,7 @@ struct upipe_mgr *upipe_ts_demux_mgr_alloc(void)
     ts_demux_mgr->a52f_mgr = NULL;
     ts_demux_mgr->mpgvf_mgr = NULL;
     ts_demux_mgr->h264f_mgr = NULL;
+    ts_demux_mgr->h265f_mgr = NULL;
     ts_demux_mgr->telxf_mgr = NULL;
     ts_demux_mgr->dvbsubf_mgr = NULL;
     ts_demux_mgr->opusf_mgr = NULL;
@@ -41,8 +41,10 @@
 #include <upipe/upipe_helper_output.h>
 #include <upipe/upipe_helper_input.h>
 #include <upipe-ts/upipe_ts_encaps.h>
+#include <upipe-ts/upipe_ts_tstd.h>
 #include <upipe-ts/upipe_ts_mux.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -60,12 +62,17 @@
 #define T_STD_MAX_RETENTION UCLOCK_FREQ
 /** Max hole allowed in CBR/Capped VBR streams */
 #define MAX_HOLE UCLOCK_FREQ
+/** max number of TS packets in an output bundle */
+#define MAX_BUNDLE_PKTS 256
 
 /** @hidden */
 static bool upipe_ts_encaps_handle(struct upipe *upipe, struct uref *uref,
                                    struct upump **upump_p);
 /** @hidden */
 static int upipe_ts_encaps_check(struct upipe *upipe, struct uref *flow_format);
+/** @hidden */
+static int upipe_ts_encaps_set_pcr_interval(struct upipe *upipe,
+                                            uint64_t pcr_interval);
 
 /** @internal @This is the private context of a ts_encaps pipe. */
 struct upipe_ts_encaps {
@@ -83,6 +90,8 @@ struct upipe_ts_encaps {
     struct uref *flow_format;
     /** ubuf manager request */
     struct urequest ubuf_mgr_request;
+    /** TS_SIZE octets of stuffing (0xff), shared by all padding */
+    struct ubuf *stuffing;
 
     /** pipe acting as output */
     struct upipe *output;
@@ -114,6 +123,8 @@ struct upipe_ts_encaps {
     uint64_t max_delay;
     /** true if we chop PSI sections */
     bool psi;
+    /** true if the packets of an access unit are output as a TS bundle */
+    bool bundle;
 
     /** PCR interval (or 0) */
     uint64_t pcr_interval;
@@ -124,6 +135,8 @@ struct upipe_ts_encaps {
     uint8_t last_cc;
     /** muxing date of the next PCR */
     uint64_t next_pcr;
+    /** PCR-only packet of this PID, where only the CC and PCR change */
+    uint8_t pcr_template[TS_SIZE];
 
     /** public upipe structure */
     struct upipe upipe;
@@ -172,15 +185,78 @@ static struct upipe *upipe_ts_encaps_alloc(struct upipe_mgr *mgr,
     upipe_ts_encaps->ts_delay = 0;
     upipe_ts_encaps->max_delay = T_STD_MAX_RETENTION;
     upipe_ts_encaps->psi = false;
+    upipe_ts_encaps->bundle = false;
     upipe_ts_encaps->pcr_interval = 0;
     upipe_ts_encaps->last_cc = 0;
     upipe_ts_encaps->pcr_tolerance = 0;
     upipe_ts_encaps->next_pcr = UINT64_MAX;
+    upipe_ts_encaps->stuffing = NULL;
     upipe_throw_ready(upipe);
     return upipe;
 }
 
+/** @internal @This returns a read-only buffer of stuffing octets (0xff),
+ * referencing a template shared by all padding of the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the stuffing, at most TS_SIZE
+ * @return pointer to ubuf, or NULL in case of allocation error
+ */
+static struct ubuf *upipe_ts_encaps_alloc_stuffing(struct upipe *upipe,
+                                                   int size)
+{
+    struct upipe_ts_encaps *upipe_ts_encaps = upipe_ts_encaps_from_upipe(upipe);
+    assert(size <= TS_SIZE);
+    if (unlikely(upipe_ts_encaps->stuffing != NULL &&
+                 upipe_ts_encaps->stuffing->mgr != upipe_ts_encaps->ubuf_mgr)) {
+        ubuf_free(upipe_ts_encaps->stuffing);
+        upipe_ts_encaps->stuffing = NULL;
+    }
+
+    if (unlikely(upipe_ts_encaps->stuffing == NULL)) {
+        struct ubuf *stuffing = ubuf_block_alloc(upipe_ts_encaps->ubuf_mgr,
+                                                 TS_SIZE);
+        uint8_t *buffer;
+        int stuffing_size = -1;
+        if (unlikely(stuffing == NULL ||
+                     !ubase_check(ubuf_block_write(stuffing, 0, &stuffing_size,
+                                                   &buffer)))) {
+            if (stuffing != NULL)
+                ubuf_free(stuffing);
+            return NULL;
+        }
+        memset(buffer, 0xff, stuffing_size);
+        ubuf_block_unmap(stuffing, 0);
+        upipe_ts_encaps->stuffing = stuffing;
+    }
+
+    return ubuf_block_splice(upipe_ts_encaps->stuffing, 0, size);
+}
+
+/** @internal @This builds the template of the packets containing padding
+ * and a PCR, for the current PID.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_encaps_build_pcr_template(struct upipe *upipe)
+{
+    struct upipe_ts_encaps *upipe_ts_encaps = upipe_ts_encaps_from_upipe(upipe);
+    uint8_t *buffer = upipe_ts_encaps->pcr_template;
+
+    ts_init(buffer);
+    ts_set_pid(buffer, upipe_ts_encaps->pid);
+    ts_set_adaptation(buffer, TS_HEADER_SIZE_PCR - TS_HEADER_SIZE - 1);
+    tsaf_set_pcr(buffer, 0);
+    tsaf_set_pcrext(buffer, 0);
+    /* the adaptation field extends over the stuffing */
+    buffer[4] = TS_SIZE - TS_HEADER_SIZE - 1;
+    memset(buffer + TS_HEADER_SIZE_PCR, 0xff, TS_SIZE - TS_HEADER_SIZE_PCR);
+}
+
 /** @internal @This allocates a TS packet containing padding and a PCR.
+ * The packet is copied from the template, as a single buffer, so that it
+ * only costs one allocation with a flat uref manager, and only the CC and
+ * PCR fields are written.
  *
  * @param upipe description structure of the pipe
  * @param pcr PCR value to encode
@@ -205,11 +281,9 @@ static struct uref *upipe_ts_encaps_pad_pcr(struct upipe *upipe, uint64_t pcr)
         return NULL;
     }
 
-    ts_init(buffer);
-    ts_set_pid(buffer, upipe_ts_encaps->pid);
+    memcpy(buffer, upipe_ts_encaps->pcr_template, TS_SIZE);
     /* Do not increase continuity counter on packets containing no payload */
     ts_set_cc(buffer, upipe_ts_encaps->last_cc);
-    ts_set_adaptation(buffer, TS_SIZE - TS_HEADER_SIZE - 1);
     tsaf_set_pcr(buffer, (pcr / 300) % POW2_33);
     tsaf_set_pcrext(buffer, pcr % 300);
 
@@ -226,12 +300,14 @@ static struct uref *upipe_ts_encaps_pad_pcr(struct upipe *upipe, uint64_t pcr)
  * @param pcr true if the packet must contain a PCR
  * @param random true if the packet is a random access point
  * @param discontinuity true if the packet must have the discontinuity flag
+ * @param pkt filled in with the description of the packet
  * @return allocated TS packet
  */
 static struct uref *upipe_ts_encaps_splice(struct upipe *upipe,
                                            struct uref *uref, bool start,
                                            uint64_t pcr, bool random,
-                                           bool discontinuity)
+                                           bool discontinuity,
+                                           struct uref_ts_bundle_pkt *pkt)
 {
     struct upipe_ts_encaps *upipe_ts_encaps = upipe_ts_encaps_from_upipe(upipe);
     size_t header_size;
@@ -294,6 +370,20 @@ static struct uref *upipe_ts_encaps_splice(struct upipe *upipe,
 
     uref_block_unmap(output, 0);
 
+    pkt->pcr = pcr;
+    pkt->pid = upipe_ts_encaps->pid;
+    pkt->cc = upipe_ts_encaps->last_cc;
+    pkt->flags = UREF_TS_BUNDLE_PAYLOAD;
+    pkt->payload = header_size;
+    if (start)
+        pkt->flags |= UREF_TS_BUNDLE_UNITSTART;
+    if (header_size > TS_HEADER_SIZE)
+        pkt->flags |= UREF_TS_BUNDLE_ADAPTATION;
+    if (discontinuity)
+        pkt->flags |= UREF_TS_BUNDLE_DISCONTINUITY;
+    if (pcr)
+        pkt->flags |= UREF_TS_BUNDLE_PCR;
+
     struct ubuf *payload = ubuf_block_splice(uref->ubuf, 0,
                                          TS_SIZE - header_size - padding_size);
     if (unlikely(payload == NULL ||
@@ -309,20 +399,12 @@ static struct uref *upipe_ts_encaps_splice(struct upipe *upipe,
 
     if (padding_size) {
         /* With PSI, pad with 0xff */
-        struct ubuf *padding = ubuf_block_alloc(upipe_ts_encaps->ubuf_mgr,
-                                                padding_size);
-        size = -1;
+        struct ubuf *padding = upipe_ts_encaps_alloc_stuffing(upipe,
+                                                              padding_size);
         if (unlikely(padding == NULL ||
-                     !ubase_check(ubuf_block_write(padding, 0, &size, &buffer)))) {
-            uref_free(output);
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            return NULL;
-        }
-        memset(buffer, 0xff, size);
-        ubuf_block_unmap(padding, 0);
-
-        if (unlikely(!ubase_check(uref_block_append(output, padding)))) {
-            ubuf_free(padding);
+                     !ubase_check(uref_block_append(output, padding)))) {
+            if (padding != NULL)
+                ubuf_free(padding);
             uref_free(output);
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             return NULL;
@@ -332,6 +414,31 @@ static struct uref *upipe_ts_encaps_splice(struct upipe *upipe,
     return output;
 }
 
+/** @internal @This outputs the TS packets of an access unit gathered in a
+ * bundle.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle uref containing the packets
+ * @param pkts descriptions of the packets
+ * @param dates dates of the packets
+ * @param nb number of packets
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_encaps_output_bundle(struct upipe *upipe,
+                                      struct uref *bundle,
+                                      const struct uref_ts_bundle_pkt *pkts,
+                                      const struct uref_ts_bundle_date *dates,
+                                      unsigned int nb, struct upump **upump_p)
+{
+    if (unlikely(!ubase_check(uref_ts_bundle_set(bundle, pkts, nb)) ||
+                 !ubase_check(uref_ts_bundle_set_dates(bundle, dates, nb)))) {
+        uref_free(bundle);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    upipe_ts_encaps_output(upipe, bundle, upump_p);
+}
+
 /** @internal @This chops the access unit in TS packets and adds TS header.
  *
  * @param upipe description structure of the pipe
@@ -352,6 +459,8 @@ static void upipe_ts_encaps_work(struct upipe *upipe, struct uref *uref,
     }
     uref_clock_get_dts_orig(uref, &dts_orig);
     uref_clock_get_cr_dts_delay(uref, &delay);
+    uint64_t early = UINT64_MAX;
+    uref_ts_tstd_get_early_sys(uref, &early);
 
     if (delay > upipe_ts_encaps->max_delay)
         /* TODO what do we do then ? */
@@ -449,6 +558,10 @@ static void upipe_ts_encaps_work(struct upipe *upipe, struct uref *uref,
         nb_ts = nb_pcr;
 
     /* Outputs the packets */
+    struct uref *bundle = NULL;
+    struct uref_ts_bundle_pkt pkts[MAX_BUNDLE_PKTS];
+    struct uref_ts_bundle_date dates[MAX_BUNDLE_PKTS];
+    unsigned int nb_bundle = 0;
     int i;
     for (i = nb_ts - 1; i >= 0; i--) {
         uint64_t muxdate = end - i * duration / nb_ts;
@@ -458,7 +571,7 @@ static void upipe_ts_encaps_work(struct upipe *upipe, struct uref *uref,
                         upipe_ts_encaps->ts_delay) : 0;
         struct uref *output =
             upipe_ts_encaps_splice(upipe, uref, start, pcr,
-                                   random, discontinuity);
+                                   random, discontinuity, &pkts[nb_bundle]);
         start = false;
         if (unlikely(output == NULL))
             /* This can happen if the last packet was only planned to contain
@@ -503,12 +616,51 @@ static void upipe_ts_encaps_work(struct upipe *upipe, struct uref *uref,
             upipe_ts_encaps->next_pcr += upipe_ts_encaps->pcr_interval;
             nb_pcr--;
         }
-
-        upipe_ts_encaps_output(upipe, output, upump_p);
         random = false;
         discontinuity = false;
+
+        /* packets of a bundle share the attributes of the first one */
+        if (early != UINT64_MAX &&
+            (!upipe_ts_encaps->bundle || bundle == NULL)) {
+            uref_ts_tstd_set_early_sys(output, early);
+            uref_ts_tstd_set_tb_rate(output, upipe_ts_encaps->tb_rate);
+        }
+
+        if (!upipe_ts_encaps->bundle) {
+            upipe_ts_encaps_output(upipe, output, upump_p);
+            continue;
+        }
+
+        /* Gather the packets in a single uref */
+        uref_clock_get_cr_sys(output, &dates[nb_bundle].cr_sys);
+        uref_clock_get_cr_dts_delay(output, &dates[nb_bundle].cr_dts_delay);
+        if (bundle == NULL)
+            bundle = output;
+        else {
+            struct ubuf *ubuf = uref_detach_ubuf(output);
+            uref_free(output);
+            if (unlikely(!ubase_check(uref_block_append(bundle, ubuf)))) {
+                ubuf_free(ubuf);
+                uref_free(bundle);
+                bundle = NULL;
+                nb_bundle = 0;
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                continue;
+            }
+        }
+
+        if (++nb_bundle == MAX_BUNDLE_PKTS) {
+            upipe_ts_encaps_output_bundle(upipe, bundle, pkts, dates,
+                                          nb_bundle, upump_p);
+            bundle = NULL;
+            nb_bundle = 0;
+        }
     }
 
+    if (bundle != NULL)
+        upipe_ts_encaps_output_bundle(upipe, bundle, pkts, dates, nb_bundle,
+                                      upump_p);
+
     if (ubase_check(uref_block_size(uref, &size)) && size)
         upipe_warn_va(upipe, "failed to mux %u octets (pcr=%u)", size, nb_pcr);
     uref_free(uref);
@@ -533,12 +685,17 @@ static bool upipe_ts_encaps_handle(struct upipe *upipe, struct uref *uref,
         uint64_t pid;
         uref_ts_flow_get_pid(uref, &pid);
         upipe_ts_encaps->pid = pid;
+        upipe_ts_encaps_build_pcr_template(upipe);
         upipe_ts_encaps->ts_delay = 0;
         uref_ts_flow_get_ts_delay(uref, &upipe_ts_encaps->ts_delay);
         upipe_ts_encaps->max_delay = T_STD_MAX_RETENTION;
         uref_ts_flow_get_max_delay(uref, &upipe_ts_encaps->max_delay);
         upipe_ts_encaps->pcr_tolerance = (uint64_t)TS_SIZE * UCLOCK_FREQ /
                                          upipe_ts_encaps->octetrate;
+        /* set in-band when the pipe doesn't run in the thread of the mux */
+        uint64_t pcr_interval;
+        if (ubase_check(uref_ts_flow_get_pcr_interval(uref, &pcr_interval)))
+            upipe_ts_encaps_set_pcr_interval(upipe, pcr_interval);
 
         upipe_ts_encaps_store_flow_def(upipe, NULL);
         upipe_ts_encaps_require_ubuf_mgr(upipe, uref);
@@ -696,6 +853,33 @@ static int upipe_ts_encaps_set_pcr_interval(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns whether TS bundles are output.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle_p filled in with true if TS bundles are output
+ * @return an error code
+ */
+static int _upipe_ts_encaps_get_bundle(struct upipe *upipe, bool *bundle_p)
+{
+    struct upipe_ts_encaps *upipe_ts_encaps = upipe_ts_encaps_from_upipe(upipe);
+    assert(bundle_p != NULL);
+    *bundle_p = upipe_ts_encaps->bundle;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets whether TS bundles are output.
+ *
+ * @param upipe description structure of the pipe
+ * @param bundle true to output TS bundles
+ * @return an error code
+ */
+static int _upipe_ts_encaps_set_bundle(struct upipe *upipe, bool bundle)
+{
+    struct upipe_ts_encaps *upipe_ts_encaps = upipe_ts_encaps_from_upipe(upipe);
+    upipe_ts_encaps->bundle = bundle;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts encaps pipe.
  *
  * @param upipe description structure of the pipe
@@ -746,6 +930,16 @@ static int upipe_ts_encaps_control(struct upipe *upipe,
             uint64_t pcr_interval = va_arg(args, uint64_t);
             return upipe_ts_encaps_set_pcr_interval(upipe, pcr_interval);
         }
+        case UPIPE_TS_ENCAPS_GET_BUNDLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_ENCAPS_SIGNATURE)
+            bool *bundle_p = va_arg(args, bool *);
+            return _upipe_ts_encaps_get_bundle(upipe, bundle_p);
+        }
+        case UPIPE_TS_ENCAPS_SET_BUNDLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_ENCAPS_SIGNATURE)
+            bool bundle = va_arg(args, int);
+            return _upipe_ts_encaps_set_bundle(upipe, bundle);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -757,9 +951,12 @@ static int upipe_ts_encaps_control(struct upipe *upipe,
  */
 static void upipe_ts_encaps_free(struct upipe *upipe)
 {
+    struct upipe_ts_encaps *upipe_ts_encaps = upipe_ts_encaps_from_upipe(upipe);
     upipe_throw_dead(upipe);
 
     upipe_ts_encaps_clean_input(upipe);
+    if (upipe_ts_encaps->stuffing != NULL)
+        ubuf_free(upipe_ts_encaps->stuffing);
     upipe_ts_encaps_clean_output(upipe);
     upipe_ts_encaps_clean_ubuf_mgr(upipe);
     upipe_ts_encaps_clean_uref_mgr(upipe);
@@ -24,6 +24,7 @@
 
 #include <upipe/ubase.h>
 #include <upipe/ulist.h>
+#include <upipe/uheap.h>
 #include <upipe/uclock.h>
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
@@ -38,6 +39,7 @@
 #include <upipe/upipe_helper_output.h>
 #include <upipe/upipe_helper_subpipe.h>
 #include <upipe-ts/upipe_ts_join.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -45,7 +47,7 @@
 #include <string.h>
 #include <assert.h>
 
-/** we only accept blocks containing exactly one TS packet */
+/** we only accept blocks containing exactly one TS packet, or TS bundles */
 #define EXPECTED_FLOW_DEF "block.mpegts."
 /** tolerance for the earliness of input packets */
 #define CR_TOLERANCE (UCLOCK_FREQ / 1000)
@@ -79,6 +81,12 @@ struct upipe_ts_join {
 
     /** list of input subpipes */
     struct uchain subs;
+    /** number of input subpipes */
+    unsigned int nb_subs;
+    /** number of non-subpicture inputs without queued packets */
+    unsigned int nb_waiting;
+    /** inputs with queued packets, sorted by the date of their next packet */
+    struct uheap heap;
 
     /** manager to create input subpipes */
     struct upipe_mgr sub_mgr;
@@ -114,6 +122,10 @@ struct upipe_ts_join_sub {
     unsigned int nb_urefs;
     /** maximum number of urefs in storage */
     unsigned int max_urefs;
+    /** index of the next packet if the first uref in storage is a bundle */
+    unsigned int bundle_pos;
+    /** node in the heap of inputs with queued packets */
+    struct uheap_node heap_node;
     /** next date that is supposed to be dequeued */
     uint64_t next_cr;
     /** last date that was dequeued */
@@ -130,9 +142,52 @@ UPIPE_HELPER_VOID(upipe_ts_join_sub)
 UPIPE_HELPER_SUBPIPE(upipe_ts_join, upipe_ts_join_sub, sub, sub_mgr,
                      subs, uchain)
 
+UBASE_FROM_TO(upipe_ts_join_sub, uheap_node, heap_node, heap_node)
+
 /** @hidden */
 static void upipe_ts_join_mux(struct upipe *upipe, struct upump **upump_p);
 
+/** @internal @This makes room in the heap for a new input.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_join_grow_heap(struct upipe *upipe)
+{
+    struct upipe_ts_join *upipe_ts_join = upipe_ts_join_from_upipe(upipe);
+    if (likely(upipe_ts_join->nb_subs < upipe_ts_join->heap.length))
+        return UBASE_ERR_NONE;
+
+    unsigned int length = upipe_ts_join->heap.length ?
+                          upipe_ts_join->heap.length * 2 : 8;
+    void *extra = realloc(upipe_ts_join->heap.nodes, uheap_sizeof(length));
+    if (unlikely(extra == NULL))
+        return UBASE_ERR_ALLOC;
+    uheap_resize(&upipe_ts_join->heap, length, extra);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This frees an input subpipe which has no queued packets.
+ *
+ * @param upipe description structure of the subpipe
+ */
+static void upipe_ts_join_sub_free(struct upipe *upipe)
+{
+    struct upipe_ts_join_sub *upipe_ts_join_sub =
+        upipe_ts_join_sub_from_upipe(upipe);
+    struct upipe_ts_join *upipe_ts_join =
+        upipe_ts_join_from_sub_mgr(upipe->mgr);
+    assert(!uheap_node_queued(&upipe_ts_join_sub->heap_node));
+    if (!upipe_ts_join_sub->subpic)
+        upipe_ts_join->nb_waiting--;
+    upipe_ts_join->nb_subs--;
+
+    upipe_throw_dead(upipe);
+    upipe_ts_join_sub_clean_sub(upipe);
+    upipe_ts_join_sub_clean_urefcount(upipe);
+    upipe_ts_join_sub_free_void(upipe);
+}
+
 /** @internal @This allocates an input subpipe of a ts_join pipe.
  *
  * @param mgr common management structure
@@ -150,13 +205,24 @@ static struct upipe *upipe_ts_join_sub_alloc(struct upipe_mgr *mgr,
     if (unlikely(upipe == NULL))
         return NULL;
 
+    struct upipe_ts_join *upipe_ts_join = upipe_ts_join_from_sub_mgr(mgr);
+    if (unlikely(!ubase_check(upipe_ts_join_grow_heap(
+                    upipe_ts_join_to_upipe(upipe_ts_join))))) {
+        upipe_ts_join_sub_free_void(upipe);
+        return NULL;
+    }
+    upipe_ts_join->nb_subs++;
+    upipe_ts_join->nb_waiting++;
+
     struct upipe_ts_join_sub *upipe_ts_join_sub =
         upipe_ts_join_sub_from_upipe(upipe);
     upipe_ts_join_sub_init_urefcount(upipe);
     upipe_ts_join_sub_init_sub(upipe);
+    uheap_node_init(&upipe_ts_join_sub->heap_node);
     ulist_init(&upipe_ts_join_sub->urefs);
     upipe_ts_join_sub->nb_urefs = 0;
     upipe_ts_join_sub->max_urefs = 0;
+    upipe_ts_join_sub->bundle_pos = 0;
     upipe_ts_join_sub->next_cr = upipe_ts_join_sub->last_cr = UINT64_MAX;
     upipe_ts_join_sub->latency = 0;
     upipe_ts_join_sub->subpic = false;
@@ -191,14 +257,18 @@ static void upipe_ts_join_sub_input(struct upipe *upipe, struct uref *uref,
         return;
     }
 
+    struct upipe_ts_join *upipe_ts_join =
+        upipe_ts_join_from_sub_mgr(upipe->mgr);
     bool was_empty = ulist_empty(&upipe_ts_join_sub->urefs);
     ulist_add(&upipe_ts_join_sub->urefs, uref_to_uchain(uref));
     upipe_ts_join_sub->nb_urefs++;
-    if (was_empty)
+    if (was_empty) {
         upipe_ts_join_sub->next_cr = cr;
+        uheap_push(&upipe_ts_join->heap, &upipe_ts_join_sub->heap_node, cr);
+        if (!upipe_ts_join_sub->subpic)
+            upipe_ts_join->nb_waiting--;
+    }
 
-    struct upipe_ts_join *upipe_ts_join =
-        upipe_ts_join_from_sub_mgr(upipe->mgr);
     upipe_ts_join_mux(upipe_ts_join_to_upipe(upipe_ts_join), upump_p);
 }
 
@@ -220,14 +290,22 @@ static int upipe_ts_join_sub_set_flow_def(struct upipe *upipe,
 
     struct upipe_ts_join_sub *upipe_ts_join_sub =
         upipe_ts_join_sub_from_upipe(upipe);
-    upipe_ts_join_sub->subpic = !!strstr(def, "pic.sub.");
+    struct upipe_ts_join *upipe_ts_join =
+        upipe_ts_join_from_sub_mgr(upipe->mgr);
+    bool subpic = !!strstr(def, "pic.sub.");
+    if (subpic != upipe_ts_join_sub->subpic &&
+        ulist_empty(&upipe_ts_join_sub->urefs)) {
+        if (subpic)
+            upipe_ts_join->nb_waiting--;
+        else
+            upipe_ts_join->nb_waiting++;
+    }
+    upipe_ts_join_sub->subpic = subpic;
     uint64_t latency = 0;
     uref_clock_get_latency(flow_def, &latency);
     /* we never lower latency */
     if (latency > upipe_ts_join_sub->latency) {
         upipe_ts_join_sub->latency = latency;
-        struct upipe_ts_join *upipe_ts_join =
-            upipe_ts_join_from_sub_mgr(upipe->mgr);
         if (latency > upipe_ts_join->latency) {
             upipe_ts_join->latency = latency;
             upipe_ts_join_build_flow_def(upipe_ts_join_to_upipe(upipe_ts_join));
@@ -326,12 +404,8 @@ static void upipe_ts_join_sub_dead(struct upipe *upipe)
     struct upipe_ts_join *upipe_ts_join =
         upipe_ts_join_from_sub_mgr(upipe->mgr);
 
-    if (ulist_empty(&upipe_ts_join_sub->urefs)) {
-        upipe_throw_dead(upipe);
-        upipe_ts_join_sub_clean_sub(upipe);
-        upipe_ts_join_sub_clean_urefcount(upipe);
-        upipe_ts_join_sub_free_void(upipe);
-    }
+    if (ulist_empty(&upipe_ts_join_sub->urefs))
+        upipe_ts_join_sub_free(upipe);
     upipe_ts_join_mux(upipe_ts_join_to_upipe(upipe_ts_join), NULL);
 }
 
@@ -375,6 +449,9 @@ static struct upipe *upipe_ts_join_alloc(struct upipe_mgr *mgr,
     upipe_ts_join_init_sub_subs(upipe);
     struct upipe_ts_join *upipe_ts_join = upipe_ts_join_from_upipe(upipe);
     upipe_ts_join->latency = 0;
+    upipe_ts_join->nb_subs = 0;
+    upipe_ts_join->nb_waiting = 0;
+    uheap_init(&upipe_ts_join->heap, 0, NULL);
 
     upipe_throw_ready(upipe);
 
@@ -382,7 +459,9 @@ static struct upipe *upipe_ts_join_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** @internal @This finds the input with the lowest date.
+/** @internal @This finds the input with the lowest date. Inputs with
+ * queued packets are kept in a heap sorted by the date of their next packet,
+ * so that this doesn't depend on the number of inputs.
  *
  * @param upipe description structure of the pipe
  * @return a pointer to the sub pipe, or NULL if not all inputs have packets
@@ -390,22 +469,58 @@ static struct upipe *upipe_ts_join_alloc(struct upipe_mgr *mgr,
 static struct upipe_ts_join_sub *upipe_ts_join_find_input(struct upipe *upipe)
 {
     struct upipe_ts_join *upipe_ts_join = upipe_ts_join_from_upipe(upipe);
-    struct uchain *uchain;
-    uint64_t earliest_cr = UINT64_MAX;
-    struct upipe_ts_join_sub *earliest_input = NULL;
-    ulist_foreach (&upipe_ts_join->subs, uchain) {
-        struct upipe_ts_join_sub *input = upipe_ts_join_sub_from_uchain(uchain);
-        if (input->next_cr == UINT64_MAX && !input->subpic)
-            return NULL;
-        if (input->next_cr < earliest_cr) {
-            earliest_cr = input->next_cr;
-            earliest_input = input;
-        }
-    }
-    if (earliest_input == NULL)
+    if (upipe_ts_join->nb_waiting)
+        return NULL;
+
+    struct uheap_node *node = uheap_peek(&upipe_ts_join->heap);
+    if (node == NULL)
         return NULL;
+    return upipe_ts_join_sub_from_heap_node(node);
+}
+
+/** @internal @This returns the date of the next packet of an input.
+ *
+ * @param input pointer to the input subpipe, with queued packets
+ * @return date of the next packet
+ */
+static uint64_t upipe_ts_join_sub_next_cr(struct upipe_ts_join_sub *input)
+{
+    struct uref *uref = uref_from_uchain(ulist_peek(&input->urefs));
+    struct uref_ts_bundle_date date;
+    if (input->bundle_pos &&
+        ubase_check(uref_ts_bundle_read_dates(uref, input->bundle_pos, 1,
+                                              &date)))
+        return date.cr_sys;
+
+    uint64_t cr_sys = UINT64_MAX;
+    uref_clock_get_cr_sys(uref, &cr_sys);
+    return cr_sys;
+}
+
+/** @internal @This dequeues the next packet of an input. Packets of TS
+ * bundles are dequeued one at a time.
+ *
+ * @param input pointer to the input subpipe, with queued packets
+ * @return pointer to the packet, or NULL in case of allocation error
+ */
+static struct uref *upipe_ts_join_sub_pop(struct upipe_ts_join_sub *input)
+{
+    struct uref *uref = uref_from_uchain(ulist_peek(&input->urefs));
+    unsigned int nb;
+    if (likely(!ubase_check(uref_ts_bundle_get_nb(uref, &nb)))) {
+        ulist_pop(&input->urefs);
+        input->nb_urefs--;
+        return uref;
+    }
 
-    return earliest_input;
+    struct uref *output = uref_ts_bundle_extract(uref, input->bundle_pos);
+    if (++input->bundle_pos >= nb) {
+        ulist_pop(&input->urefs);
+        input->nb_urefs--;
+        input->bundle_pos = 0;
+        uref_free(uref);
+    }
+    return output;
 }
 
 /** @internal @This muxes TS packets to the output.
@@ -428,25 +543,25 @@ static void upipe_ts_join_mux(struct upipe *upipe, struct upump **upump_p)
                           input->last_cr - input->next_cr, input->next_cr);
         input->last_cr = input->next_cr;
 
-        struct uchain *uchain = ulist_pop(&input->urefs);
-        input->nb_urefs--;
-        struct uref *uref = uref_from_uchain(uchain);
+        struct uref *uref = upipe_ts_join_sub_pop(input);
 
         if (ulist_empty(&input->urefs)) {
-            if (upipe_dead(upipe_ts_join_sub_to_upipe(input))) {
-                upipe_throw_dead(upipe_ts_join_sub_to_upipe(input));
-                upipe_ts_join_sub_clean_sub(upipe_ts_join_sub_to_upipe(input));
-                upipe_ts_join_sub_clean_urefcount(upipe_ts_join_sub_to_upipe(input));
-                upipe_ts_join_sub_free_void(upipe_ts_join_sub_to_upipe(input));
-            } else {
-                input->next_cr = UINT64_MAX;
-            }
+            uheap_remove(&upipe_ts_join->heap, &input->heap_node);
+            input->next_cr = UINT64_MAX;
+            if (!input->subpic)
+                upipe_ts_join->nb_waiting++;
+            if (upipe_dead(upipe_ts_join_sub_to_upipe(input)))
+                upipe_ts_join_sub_free(upipe_ts_join_sub_to_upipe(input));
         } else {
-            uchain = ulist_peek(&input->urefs);
-            struct uref *next_uref = uref_from_uchain(uchain);
-            uref_clock_get_cr_sys(next_uref, &input->next_cr);
+            input->next_cr = upipe_ts_join_sub_next_cr(input);
+            uheap_update(&upipe_ts_join->heap, &input->heap_node,
+                         input->next_cr);
         }
 
+        if (unlikely(uref == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            continue;
+        }
         upipe_ts_join_output(upipe, uref, upump_p);
     }
 }
@@ -552,7 +667,9 @@ static void upipe_ts_join_free(struct upipe *upipe)
 {
     upipe_throw_dead(upipe);
 
+    struct upipe_ts_join *upipe_ts_join = upipe_ts_join_from_upipe(upipe);
     upipe_ts_join_clean_sub_subs(upipe);
+    free(upipe_ts_join->heap.nodes);
     upipe_ts_join_clean_output(upipe);
     upipe_ts_join_clean_uref_mgr(upipe);
     upipe_ts_join_clean_urefcount(upipe);
@@ -36,11 +36,17 @@
 #include <upipe/uref_clock.h>
 #include <upipe/ubuf.h>
 #include <upipe/uclock.h>
+#include <upipe/uatomic.h>
+#include <upipe/ufifo.h>
+#include <upipe/ueventfd.h>
+#include <upipe/upump.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
 #include <upipe/upipe_helper_void.h>
 #include <upipe/upipe_helper_uref_mgr.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
 #include <upipe/upipe_helper_bin_input.h>
 #include <upipe/upipe_helper_bin_output.h>
 #include <upipe/upipe_helper_subpipe.h>
@@ -51,13 +57,16 @@
 #include <upipe-ts/upipe_ts_pes_encaps.h>
 #include <upipe-ts/upipe_ts_psi_generator.h>
 #include <upipe-ts/upipe_ts_psi_inserter.h>
+#include <upipe-ts/upipe_ts_si_generator.h>
 #include <upipe-ts/upipe_ts_aggregate.h>
 #include <upipe-ts/upipe_ts_tstd.h>
+#include <upipe-modules/upipe_worker_linear.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #include <bitstream/mpeg/ts.h>
@@ -104,8 +113,19 @@
 /** fixed PES header size for teletext (ETSI EN 300 472 4.2) */
 #define PES_HEADER_SIZE_TELX 45
 
+#ifndef PMT_STREAMTYPE_VIDEO_HEVC
+/** ITU-T H.265 video stream type, missing from older bitstream */
+#define PMT_STREAMTYPE_VIDEO_HEVC 0x24
+#endif
+
 /** default minimum duration of audio PES */
 #define DEFAULT_AUDIO_PES_MIN_DURATION (UCLOCK_FREQ / 25)
+/** length of the queues between an input and its worker thread */
+#define WORKER_QUEUE_LENGTH 255
+/** max time an input fed from another thread waits for room in its FIFO */
+#define REMOTE_WAIT_MAX (UCLOCK_FREQ / 10)
+/** interval between two attempts to queue a uref in a full FIFO */
+#define REMOTE_WAIT_STEP (UCLOCK_FREQ / 1000)
 /** max interval between PCRs (ISO/IEC 13818-1 2.7.2) */
 #define MAX_PCR_INTERVAL (UCLOCK_FREQ / 10)
 /** default interval between PCRs */
@@ -116,6 +136,12 @@
 #define DEFAULT_PSI_INTERVAL_DVB (UCLOCK_FREQ / 10)
 /** default interval between PATs and PMTs, in ATSC conformance */
 #define DEFAULT_PSI_INTERVAL_ATSC (UCLOCK_FREQ / 10)
+/** default interval between NITs (EN 300 468 5.1.4, max 10 s) */
+#define DEFAULT_NIT_INTERVAL (UCLOCK_FREQ * 10)
+/** default interval between SDTs (EN 300 468 5.1.4, max 2 s) */
+#define DEFAULT_SDT_INTERVAL (UCLOCK_FREQ * 2)
+/** default interval between EITs p/f (EN 300 468 5.1.4, max 2 s) */
+#define DEFAULT_EIT_INTERVAL (UCLOCK_FREQ * 2)
 /** offset between the first PAT and the first PMT */
 #define PAT_OFFSET (UCLOCK_FREQ / 100)
 /** offset between the first PMT and the first ES packet */
@@ -146,6 +172,8 @@ struct upipe_ts_mux_mgr {
     struct upipe_mgr *ts_psig_mgr;
     /** pointer to ts_psii manager */
     struct upipe_mgr *ts_psii_mgr;
+    /** pointer to ts_sig manager */
+    struct upipe_mgr *ts_sig_mgr;
 
     /* ES */
     /** pointer to ts_tstd manager */
@@ -198,6 +226,12 @@ struct upipe_ts_mux {
     struct upipe *psig;
     /** pointer to ts_psii_sub dealing with PAT */
     struct upipe *pat_psii;
+    /** pointer to ts_sig */
+    struct upipe *sig;
+    /** pointers to ts_sig_output for the NIT, SDT and EIT */
+    struct upipe *sig_output[3];
+    /** pointers to ts_psii_sub dealing with NIT, SDT and EIT */
+    struct upipe *sig_psii[3];
 
     /** current conformance */
     enum upipe_ts_conformance conformance;
@@ -224,6 +258,19 @@ struct upipe_ts_mux {
     /** list of programs */
     struct uchain programs;
 
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** watcher draining the remote inputs */
+    struct upump *upump;
+    /** true if some inputs may be fed from other threads */
+    bool remote;
+    /** event triggered when urefs are queued by remote inputs */
+    struct ueventfd remote_event;
+    /** number of urefs queued by remote inputs and not drained yet */
+    uatomic_uint32_t remote_pending;
+    /** number of urefs dropped by remote inputs and not reported yet */
+    uatomic_uint32_t remote_dropped;
+
     /** manager to create programs */
     struct upipe_mgr program_mgr;
 
@@ -237,6 +284,8 @@ UPIPE_HELPER_VOID(upipe_ts_mux)
 UPIPE_HELPER_BIN_INPUT(upipe_ts_mux, psig, input_request_list)
 UPIPE_HELPER_BIN_OUTPUT(upipe_ts_mux, agg_probe_bin, agg, output,
                         output_request_list)
+UPIPE_HELPER_UPUMP_MGR(upipe_ts_mux, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_ts_mux, upump, upump_mgr)
 UPIPE_HELPER_UREF_MGR(upipe_ts_mux, uref_mgr, uref_mgr_request,
                       upipe_ts_mux_check,
                       upipe_ts_mux_register_bin_output_request,
@@ -281,6 +330,8 @@ struct upipe_ts_mux_program {
     struct upipe *psig_program;
     /** pointer to ts_psii_sub dealing with PMT */
     struct upipe *pmt_psii;
+    /** pointer to ts_sig_service */
+    struct upipe *sig_service;
 
     /** start date (system clock), used to bootstrap the PAT */
     uint64_t start_cr_sys;
@@ -364,10 +415,24 @@ struct upipe_ts_mux_input {
     struct upipe *psig_flow;
     /** pointer to ts_tstd */
     struct upipe *tstd;
-    /** pointer to ts_encaps */
+    /** pointer to ts_encaps, or NULL if it runs in a worker thread */
     struct upipe *encaps;
     /** pointer to ts_join */
     struct upipe *join;
+    /** true if the encapsulation runs in a worker thread */
+    bool worker;
+    /** flow definition sent to the T-STD, in worker mode */
+    struct uref *flow_def;
+    /** PCR interval sent in-band to the encapsulation, in worker mode */
+    uint64_t pcr_interval;
+
+    /** length of the FIFO if the input may be fed from other threads,
+     * or 0 */
+    unsigned int remote_length;
+    /** FIFO of urefs queued by other threads */
+    struct ufifo remote_fifo;
+    /** extra space for the FIFO */
+    void *remote_extra;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -413,6 +478,131 @@ static int upipe_ts_mux_input_probe(struct uprobe *uprobe,
     return upipe_throw_proxy(upipe, inner, event, args);
 }
 
+/** @internal @This allocates the PES and TS encapsulation of an input,
+ * between the T-STD and the join. If the application provides a worker
+ * when the @ref UPROBE_TS_MUX_NEED_WORKER event is thrown, the
+ * encapsulation runs in the remote thread of the worker, fed through
+ * queues, and only the interleaving happens in the thread of the mux.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_mux_input_alloc_encaps(struct upipe *upipe)
+{
+    struct upipe_ts_mux_input *upipe_ts_mux_input =
+        upipe_ts_mux_input_from_upipe(upipe);
+    struct upipe_ts_mux_program *program =
+        upipe_ts_mux_program_from_input_mgr(upipe->mgr);
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_program_mgr(
+                upipe_ts_mux_program_to_upipe(program)->mgr);
+    struct upipe_ts_mux_mgr *ts_mux_mgr =
+        upipe_ts_mux_mgr_from_upipe_mgr(upipe_ts_mux_to_upipe(upipe_ts_mux)->mgr);
+    struct upipe_mgr *wlin_mgr = NULL;
+    struct uprobe *uprobe_remote = NULL;
+    upipe_throw(upipe, UPROBE_TS_MUX_NEED_WORKER, UPIPE_TS_MUX_SIGNATURE,
+                &wlin_mgr, &uprobe_remote);
+
+    struct upipe *pes_encaps, *encaps, *last;
+    if (wlin_mgr == NULL || uprobe_remote == NULL) {
+        uprobe_release(uprobe_remote);
+        if (unlikely((pes_encaps =
+                      upipe_void_alloc_output(upipe_ts_mux_input->tstd,
+                             ts_mux_mgr->ts_pese_mgr,
+                             uprobe_pfx_alloc_va(
+                                 uprobe_use(&upipe_ts_mux_input->probe),
+                                 UPROBE_LOG_VERBOSE, "pes encaps"))) == NULL))
+            return UBASE_ERR_ALLOC;
+        encaps = upipe_void_alloc_output(pes_encaps,
+                ts_mux_mgr->ts_encaps_mgr,
+                uprobe_pfx_alloc_va(uprobe_use(&upipe_ts_mux_input->probe),
+                                    UPROBE_LOG_VERBOSE, "encaps"));
+        upipe_release(pes_encaps);
+        if (unlikely(encaps == NULL))
+            return UBASE_ERR_ALLOC;
+
+        /* the join dequeues the packets of each access unit one at a time */
+        upipe_ts_encaps_set_bundle(encaps, true);
+        upipe_ts_mux_input->encaps = encaps;
+        last = encaps;
+
+    } else {
+        if (unlikely((pes_encaps = upipe_void_alloc(ts_mux_mgr->ts_pese_mgr,
+                        uprobe_pfx_alloc(uprobe_use(uprobe_remote),
+                                         UPROBE_LOG_VERBOSE,
+                                         "pes encaps"))) == NULL)) {
+            uprobe_release(uprobe_remote);
+            return UBASE_ERR_ALLOC;
+        }
+        if (unlikely((encaps = upipe_void_alloc_output(pes_encaps,
+                        ts_mux_mgr->ts_encaps_mgr,
+                        uprobe_pfx_alloc(uprobe_use(uprobe_remote),
+                                         UPROBE_LOG_VERBOSE,
+                                         "encaps"))) == NULL)) {
+            upipe_release(pes_encaps);
+            uprobe_release(uprobe_remote);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_ts_encaps_set_bundle(encaps, true);
+        /* the remote pipes must not be touched from this thread anymore */
+        upipe_release(encaps);
+
+        last = upipe_wlin_alloc(wlin_mgr,
+                uprobe_pfx_alloc(uprobe_use(&upipe_ts_mux_input->probe),
+                                 UPROBE_LOG_VERBOSE, "encaps worker"),
+                pes_encaps, uprobe_remote,
+                WORKER_QUEUE_LENGTH, WORKER_QUEUE_LENGTH);
+        if (unlikely(last == NULL))
+            return UBASE_ERR_ALLOC;
+        int err = upipe_set_output(upipe_ts_mux_input->tstd, last);
+        if (unlikely(!ubase_check(err))) {
+            upipe_release(last);
+            return err;
+        }
+        upipe_ts_mux_input->worker = true;
+    }
+
+    upipe_ts_mux_input->join = upipe_void_alloc_output_sub(last,
+            upipe_ts_mux->join,
+            uprobe_pfx_alloc_va(uprobe_use(&upipe_ts_mux_input->probe),
+                                UPROBE_LOG_VERBOSE, "join"));
+    if (upipe_ts_mux_input->worker)
+        upipe_release(last);
+    return upipe_ts_mux_input->join != NULL ? UBASE_ERR_NONE : UBASE_ERR_ALLOC;
+}
+
+/** @internal @This sets the PCR interval of the encapsulation of an input.
+ * In worker mode, the interval is sent in-band along with the flow
+ * definition, so that it is applied in order by the remote thread.
+ *
+ * @param upipe description structure of the pipe
+ * @param pcr_interval PCR interval, or 0 to disable PCRs
+ */
+static void upipe_ts_mux_input_set_pcr_interval(struct upipe *upipe,
+                                                uint64_t pcr_interval)
+{
+    struct upipe_ts_mux_input *upipe_ts_mux_input =
+        upipe_ts_mux_input_from_upipe(upipe);
+    if (!upipe_ts_mux_input->worker) {
+        if (upipe_ts_mux_input->encaps != NULL)
+            upipe_ts_mux_set_pcr_interval(upipe_ts_mux_input->encaps,
+                                          pcr_interval);
+        return;
+    }
+
+    upipe_ts_mux_input->pcr_interval = pcr_interval;
+    if (upipe_ts_mux_input->flow_def == NULL)
+        return;
+
+    struct uref *flow_def = uref_dup(upipe_ts_mux_input->flow_def);
+    if (unlikely(flow_def == NULL ||
+                 !ubase_check(uref_ts_flow_set_pcr_interval(flow_def,
+                                                            pcr_interval)) ||
+                 !ubase_check(upipe_set_flow_def(upipe_ts_mux_input->tstd,
+                                                 flow_def))))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+    uref_free(flow_def);
+}
+
 /** @internal @This allocates an input subpipe of a ts_mux_program subpipe.
  *
  * @param mgr common management structure
@@ -450,6 +640,12 @@ static struct upipe *upipe_ts_mux_input_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux_input->start_cr_sys = UINT64_MAX;
     upipe_ts_mux_input->total_octetrate = 0;
     upipe_ts_mux_input->psig_flow = upipe_ts_mux_input->encaps = NULL;
+    upipe_ts_mux_input->join = NULL;
+    upipe_ts_mux_input->worker = false;
+    upipe_ts_mux_input->flow_def = NULL;
+    upipe_ts_mux_input->pcr_interval = 0;
+    upipe_ts_mux_input->remote_length = 0;
+    upipe_ts_mux_input->remote_extra = NULL;
 
     upipe_ts_mux_input_init_sub(upipe);
     uprobe_init(&upipe_ts_mux_input->probe, upipe_ts_mux_input_probe, NULL);
@@ -459,7 +655,7 @@ static struct upipe *upipe_ts_mux_input_alloc(struct upipe_mgr *mgr,
 
     struct upipe_ts_mux_mgr *ts_mux_mgr =
         upipe_ts_mux_mgr_from_upipe_mgr(upipe_ts_mux_to_upipe(upipe_ts_mux)->mgr);
-    struct upipe *pes_encaps, *tstd;
+    struct upipe *tstd;
     if (unlikely((upipe_ts_mux_input->psig_flow =
                   upipe_void_alloc_sub(program->psig_program,
                          uprobe_pfx_alloc_va(
@@ -469,42 +665,25 @@ static struct upipe *upipe_ts_mux_input_alloc(struct upipe_mgr *mgr,
                   upipe_void_alloc(ts_mux_mgr->ts_tstd_mgr,
                          uprobe_pfx_alloc_va(
                              uprobe_use(&upipe_ts_mux_input->probe),
-                             UPROBE_LOG_VERBOSE, "tstd"))) == NULL ||
-                (pes_encaps =
-                  upipe_void_alloc_output(tstd,
-                         ts_mux_mgr->ts_pese_mgr,
-                         uprobe_pfx_alloc_va(
-                             uprobe_use(&upipe_ts_mux_input->probe),
-                             UPROBE_LOG_VERBOSE, "pes encaps"))) == NULL ||
-                 (upipe_ts_mux_input->encaps =
-                  upipe_void_alloc_output(pes_encaps,
-                         ts_mux_mgr->ts_encaps_mgr,
-                         uprobe_pfx_alloc_va(
-                             uprobe_use(&upipe_ts_mux_input->probe),
-                             UPROBE_LOG_VERBOSE, "encaps"))) == NULL ||
-                 (upipe_ts_mux_input->join =
-                  upipe_void_alloc_output_sub(upipe_ts_mux_input->encaps,
-                         upipe_ts_mux->join,
-                         uprobe_pfx_alloc_va(
-                             uprobe_use(&upipe_ts_mux_input->probe),
-                             UPROBE_LOG_VERBOSE, "join"))) == NULL)) {
+                             UPROBE_LOG_VERBOSE, "tstd"))) == NULL)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return upipe;
     }
-
     upipe_ts_mux_input_store_first_inner(upipe, tstd);
-    upipe_release(pes_encaps);
+
+    if (unlikely(!ubase_check(upipe_ts_mux_input_alloc_encaps(upipe))))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
     return upipe;
 }
 
-/** @internal @This receives data.
+/** @internal @This processes data, in the thread of the mux.
  *
  * @param upipe description structure of the pipe
  * @param uref uref structure
  * @param upump_p reference to pump that generated the buffer
  */
-static void upipe_ts_mux_input_input(struct upipe *upipe, struct uref *uref,
-                                     struct upump **upump_p)
+static void upipe_ts_mux_input_work(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
 {
     struct upipe_ts_mux_input *upipe_ts_mux_input =
         upipe_ts_mux_input_from_upipe(upipe);
@@ -531,6 +710,155 @@ static void upipe_ts_mux_input_input(struct upipe *upipe, struct uref *uref,
     upipe_input(upipe_ts_mux_input->tstd, uref, upump_p);
 }
 
+/** @internal @This receives data. For a remote input, it may be called from
+ * any thread, and only queues the uref for the thread of the mux.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_mux_input_input(struct upipe *upipe, struct uref *uref,
+                                     struct upump **upump_p)
+{
+    struct upipe_ts_mux_input *upipe_ts_mux_input =
+        upipe_ts_mux_input_from_upipe(upipe);
+    if (likely(!upipe_ts_mux_input->remote_length)) {
+        upipe_ts_mux_input_work(upipe, uref, upump_p);
+        return;
+    }
+
+    struct upipe_ts_mux_program *program =
+        upipe_ts_mux_program_from_input_mgr(upipe->mgr);
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_program_mgr(
+                upipe_ts_mux_program_to_upipe(program)->mgr);
+    unsigned int wait = 0;
+    while (unlikely(!ufifo_push(&upipe_ts_mux_input->remote_fifo, uref))) {
+        /* let the thread of the mux drain the FIFO, for a bounded time */
+        if (unlikely(wait >= REMOTE_WAIT_MAX / REMOTE_WAIT_STEP)) {
+            /* the probes may not be thrown from this thread */
+            uref_free(uref);
+            uatomic_fetch_add(&upipe_ts_mux->remote_dropped, 1);
+            return;
+        }
+        struct timespec step = {
+            .tv_sec = 0,
+            .tv_nsec = REMOTE_WAIT_STEP * UINT64_C(1000000000) / UCLOCK_FREQ
+        };
+        nanosleep(&step, NULL);
+        wait++;
+    }
+
+    /* The counter may be transiently negative if the mux popped the uref
+     * before it was accounted for. */
+    if (unlikely((int32_t)uatomic_fetch_add(&upipe_ts_mux->remote_pending,
+                                            1) == 0))
+        ueventfd_write(&upipe_ts_mux->remote_event);
+}
+
+/** @internal @This processes the urefs queued by other threads on a remote
+ * input, at most one FIFO length at a time.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to the pump draining the FIFO
+ * @return number of processed urefs
+ */
+static unsigned int upipe_ts_mux_input_drain(struct upipe *upipe,
+                                             struct upump **upump_p)
+{
+    struct upipe_ts_mux_input *upipe_ts_mux_input =
+        upipe_ts_mux_input_from_upipe(upipe);
+    unsigned int nb = 0;
+    struct uref *uref;
+    while (nb < upipe_ts_mux_input->remote_length &&
+           (uref = ufifo_pop(&upipe_ts_mux_input->remote_fifo,
+                             struct uref *)) != NULL) {
+        upipe_ts_mux_input_work(upipe, uref, upump_p);
+        nb++;
+    }
+    return nb;
+}
+
+/** @hidden */
+static void upipe_ts_mux_remote_done(struct upipe *upipe, unsigned int nb);
+/** @hidden */
+static int upipe_ts_mux_init_remote(struct upipe *upipe);
+
+/** @internal @This returns the length of the FIFO of a remote input.
+ *
+ * @param upipe description structure of the pipe
+ * @param length_p filled in with the length, or 0
+ * @return an error code
+ */
+static int upipe_ts_mux_input_get_remote(struct upipe *upipe,
+                                         unsigned int *length_p)
+{
+    struct upipe_ts_mux_input *upipe_ts_mux_input =
+        upipe_ts_mux_input_from_upipe(upipe);
+    assert(length_p != NULL);
+    *length_p = upipe_ts_mux_input->remote_length;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes the urefs left in the FIFO of a remote input,
+ * and releases the FIFO.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_mux_input_clean_remote(struct upipe *upipe)
+{
+    struct upipe_ts_mux_input *upipe_ts_mux_input =
+        upipe_ts_mux_input_from_upipe(upipe);
+    if (!upipe_ts_mux_input->remote_length)
+        return;
+
+    struct upipe_ts_mux_program *program =
+        upipe_ts_mux_program_from_input_mgr(upipe->mgr);
+    struct upipe *mux = upipe_ts_mux_to_upipe(upipe_ts_mux_from_program_mgr(
+                upipe_ts_mux_program_to_upipe(program)->mgr));
+    unsigned int nb, total = 0;
+    while ((nb = upipe_ts_mux_input_drain(upipe, NULL)))
+        total += nb;
+    upipe_ts_mux_remote_done(mux, total);
+
+    ufifo_clean(&upipe_ts_mux_input->remote_fifo);
+    free(upipe_ts_mux_input->remote_extra);
+    upipe_ts_mux_input->remote_extra = NULL;
+    upipe_ts_mux_input->remote_length = 0;
+}
+
+/** @internal @This lets the input be fed from other threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param length length of the FIFO, or 0 to disable
+ * @return an error code
+ */
+static int upipe_ts_mux_input_set_remote(struct upipe *upipe,
+                                         unsigned int length)
+{
+    struct upipe_ts_mux_input *upipe_ts_mux_input =
+        upipe_ts_mux_input_from_upipe(upipe);
+    if (unlikely(length > UINT8_MAX))
+        return UBASE_ERR_INVALID;
+    if (length == upipe_ts_mux_input->remote_length)
+        return UBASE_ERR_NONE;
+    upipe_ts_mux_input_clean_remote(upipe);
+    if (!length)
+        return UBASE_ERR_NONE;
+
+    struct upipe_ts_mux_program *program =
+        upipe_ts_mux_program_from_input_mgr(upipe->mgr);
+    struct upipe *mux = upipe_ts_mux_to_upipe(upipe_ts_mux_from_program_mgr(
+                upipe_ts_mux_program_to_upipe(program)->mgr));
+    UBASE_RETURN(upipe_ts_mux_init_remote(mux))
+
+    upipe_ts_mux_input->remote_extra = malloc(ufifo_sizeof(length));
+    UBASE_ALLOC_RETURN(upipe_ts_mux_input->remote_extra)
+    ufifo_init(&upipe_ts_mux_input->remote_fifo, length,
+               upipe_ts_mux_input->remote_extra);
+    upipe_ts_mux_input->remote_length = length;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This sets the input flow definition.
  *
  * @param upipe description structure of the pipe
@@ -682,6 +1010,10 @@ static int upipe_ts_mux_input_set_flow_def(struct upipe *upipe,
             UBASE_FATAL(upipe, uref_ts_flow_set_stream_type(flow_def_dup,
                                                 PMT_STREAMTYPE_VIDEO_AVC));
             max_delay = MAX_DELAY_14496;
+        } else if (!ubase_ncmp(def, "block.hevc.")) {
+            UBASE_FATAL(upipe, uref_ts_flow_set_stream_type(flow_def_dup,
+                                                PMT_STREAMTYPE_VIDEO_HEVC));
+            max_delay = MAX_DELAY_14496;
         }
         UBASE_FATAL(upipe, uref_ts_flow_set_pes_id(flow_def_dup,
                                                 PES_STREAM_ID_VIDEO_MPEG));
@@ -869,6 +1201,19 @@ static int upipe_ts_mux_input_set_flow_def(struct upipe *upipe,
     }
     UBASE_FATAL(upipe, uref_ts_flow_set_pid(flow_def_dup, pid));
 
+    if (upipe_ts_mux_input->worker) {
+        struct uref *flow_def_worker = uref_dup(flow_def_dup);
+        if (unlikely(flow_def_worker == NULL)) {
+            uref_free(flow_def_dup);
+            return UBASE_ERR_ALLOC;
+        }
+        if (upipe_ts_mux_input->flow_def != NULL)
+            uref_free(upipe_ts_mux_input->flow_def);
+        upipe_ts_mux_input->flow_def = flow_def_worker;
+        UBASE_FATAL(upipe, uref_ts_flow_set_pcr_interval(flow_def_dup,
+                                        upipe_ts_mux_input->pcr_interval));
+    }
+
     if (!ubase_check(upipe_set_flow_def(upipe_ts_mux_input->tstd,
                                             flow_def_dup)) ||
         !ubase_check(uref_flow_set_def(flow_def_dup, "void.")) ||
@@ -917,6 +1262,16 @@ static int upipe_ts_mux_input_control(struct upipe *upipe,
                 upipe_ts_mux_input_from_upipe(upipe);
             return upipe_control_va(upipe_ts_mux_input->join, command, args);
         }
+        case UPIPE_TS_MUX_GET_REMOTE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            unsigned int *length_p = va_arg(args, unsigned int *);
+            return upipe_ts_mux_input_get_remote(upipe, length_p);
+        }
+        case UPIPE_TS_MUX_SET_REMOTE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            unsigned int length = va_arg(args, unsigned int);
+            return upipe_ts_mux_input_set_remote(upipe, length);
+        }
 
         default:
             break;
@@ -954,12 +1309,15 @@ static void upipe_ts_mux_input_no_input(struct upipe *upipe)
     struct upipe_ts_mux_program *program =
         upipe_ts_mux_program_from_input_mgr(upipe->mgr);
 
+    upipe_ts_mux_input_clean_remote(upipe);
     if (upipe_ts_mux_input->psig_flow != NULL)
         upipe_release(upipe_ts_mux_input->psig_flow);
     if (upipe_ts_mux_input->encaps != NULL)
         upipe_release(upipe_ts_mux_input->encaps);
     if (upipe_ts_mux_input->join != NULL)
         upipe_release(upipe_ts_mux_input->join);
+    if (upipe_ts_mux_input->flow_def != NULL)
+        uref_free(upipe_ts_mux_input->flow_def);
 
     upipe_ts_mux_input_clean_sub(upipe);
     upipe_ts_mux_input_clean_bin_input(upipe);
@@ -1045,6 +1403,7 @@ static struct upipe *upipe_ts_mux_program_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux_program_init_sub_inputs(upipe);
     upipe_ts_mux_program->sid = 0;
     upipe_ts_mux_program->pmt_pid = 8192;
+    upipe_ts_mux_program->pmt_psii = upipe_ts_mux_program->sig_service = NULL;
     upipe_ts_mux_program->start_cr_sys = UINT64_MAX;
     upipe_ts_mux_program->pmt_interval = upipe_ts_mux->pmt_interval;
     upipe_ts_mux_program->pcr_interval = upipe_ts_mux->pcr_interval;
@@ -1076,6 +1435,13 @@ static struct upipe *upipe_ts_mux_program_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux_program_store_first_inner(upipe, psig_program);
     upipe_ts_psii_sub_set_interval(upipe_ts_mux_program->pmt_psii,
                                    upipe_ts_mux_program->pmt_interval);
+
+    if (unlikely((upipe_ts_mux_program->sig_service =
+                  upipe_void_alloc_sub(upipe_ts_mux->sig,
+                         uprobe_pfx_alloc(
+                             uprobe_use(&upipe_ts_mux_program->probe),
+                             UPROBE_LOG_VERBOSE, "sig service"))) == NULL))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
     return upipe;
 }
 
@@ -1143,15 +1509,15 @@ static void upipe_ts_mux_program_change(struct upipe *upipe)
     if (pcr_pid != old_pcr_pid) {
         if (old_pcr_pid != UNDEF_PCR) {
             old_pcr_input->pcr = false;
-            if (old_pcr_input->encaps != NULL)
-                upipe_ts_mux_set_pcr_interval(old_pcr_input->encaps, 0);
+            upipe_ts_mux_input_set_pcr_interval(
+                    upipe_ts_mux_input_to_upipe(old_pcr_input), 0);
         }
 
         if (pcr_pid != UNDEF_PCR) {
             pcr_input->pcr = true;
-            if (pcr_input->encaps != NULL)
-                upipe_ts_mux_set_pcr_interval(pcr_input->encaps,
-                        upipe_ts_mux_program->pcr_interval);
+            upipe_ts_mux_input_set_pcr_interval(
+                    upipe_ts_mux_input_to_upipe(pcr_input),
+                    upipe_ts_mux_program->pcr_interval);
         }
         upipe_ts_psig_program_set_pcr_pid(upipe_ts_mux_program->psig_program,
                                           pcr_pid);
@@ -1274,6 +1640,8 @@ static int upipe_ts_mux_program_set_flow_def(struct upipe *upipe,
         uref_free(flow_def_dup);
         return UBASE_ERR_INVALID;
     }
+    if (upipe_ts_mux_program->sig_service != NULL)
+        upipe_set_flow_def(upipe_ts_mux_program->sig_service, flow_def_dup);
 
     uref_free(flow_def_dup);
     upipe_ts_mux_program->sid = sid;
@@ -1354,8 +1722,9 @@ static int upipe_ts_mux_program_set_pcr_interval(struct upipe *upipe,
     ulist_foreach (&upipe_ts_mux_program->inputs, uchain) {
         struct upipe_ts_mux_input *input =
             upipe_ts_mux_input_from_uchain(uchain);
-        if (input->pcr && input->encaps != NULL)
-            upipe_ts_mux_set_pcr_interval(input->encaps, interval);
+        if (input->pcr)
+            upipe_ts_mux_input_set_pcr_interval(
+                    upipe_ts_mux_input_to_upipe(input), interval);
     }
     upipe_ts_mux_program_update(upipe);
     return UBASE_ERR_NONE;
@@ -1454,6 +1823,8 @@ static void upipe_ts_mux_program_no_input(struct upipe *upipe)
 
     if (upipe_ts_mux_program->pmt_psii != NULL)
         upipe_release(upipe_ts_mux_program->pmt_psii);
+    if (upipe_ts_mux_program->sig_service != NULL)
+        upipe_release(upipe_ts_mux_program->sig_service);
 
     upipe_ts_mux_program_clean_sub_inputs(upipe);
     upipe_ts_mux_program_clean_sub(upipe);
@@ -1548,7 +1919,12 @@ static struct upipe *upipe_ts_mux_alloc(struct upipe_mgr *mgr,
             upipe_ts_mux_to_urefcount_real(upipe_ts_mux));
     upipe_ts_mux_init_program_mgr(upipe);
     upipe_ts_mux_init_sub_programs(upipe);
-    upipe_ts_mux->join = upipe_ts_mux->pat_psii = NULL;
+    upipe_ts_mux_init_upump_mgr(upipe);
+    upipe_ts_mux_init_upump(upipe);
+    upipe_ts_mux->remote = false;
+    upipe_ts_mux->join = upipe_ts_mux->pat_psii = upipe_ts_mux->sig = NULL;
+    for (int i = 0; i < 3; i++)
+        upipe_ts_mux->sig_output[i] = upipe_ts_mux->sig_psii[i] = NULL;
     upipe_ts_mux->conformance = UPIPE_TS_CONFORMANCE_ISO;
     upipe_ts_mux->pat_interval = DEFAULT_PSI_INTERVAL_ISO;
     upipe_ts_mux->pmt_interval = DEFAULT_PSI_INTERVAL_ISO;
@@ -1582,10 +1958,88 @@ static struct upipe *upipe_ts_mux_alloc(struct upipe_mgr *mgr,
         return upipe;
     }
     upipe_ts_mux_store_first_inner(upipe, psig);
+
+    if (unlikely((upipe_ts_mux->sig = upipe_void_alloc(ts_mux_mgr->ts_sig_mgr,
+                         uprobe_pfx_alloc(
+                             uprobe_use(&upipe_ts_mux->probe),
+                             UPROBE_LOG_VERBOSE, "sig"))) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return upipe;
+    }
     upipe_ts_mux_demand_uref_mgr(upipe);
     return upipe;
 }
 
+/** @internal @This releases the inner pipes inserting the DVB SI tables.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_mux_clean_si(struct upipe *upipe)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    for (int i = 0; i < 3; i++) {
+        if (upipe_ts_mux->sig_psii[i] != NULL)
+            upipe_release(upipe_ts_mux->sig_psii[i]);
+        if (upipe_ts_mux->sig_output[i] != NULL)
+            upipe_release(upipe_ts_mux->sig_output[i]);
+        upipe_ts_mux->sig_output[i] = upipe_ts_mux->sig_psii[i] = NULL;
+    }
+}
+
+/** @internal @This allocates the inner pipes inserting the DVB SI tables
+ * (NIT, SDT and EIT p/f), if the conformance requires them.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_mux_init_si(struct upipe *upipe)
+{
+    static const uint16_t pids[3] = { NIT_PID, SDT_PID, EIT_PID };
+    static const uint64_t intervals[3] = {
+        DEFAULT_NIT_INTERVAL, DEFAULT_SDT_INTERVAL, DEFAULT_EIT_INTERVAL
+    };
+    static const char *names[3] = { "nit psii", "sdt psii", "eit psii" };
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    if (upipe_ts_mux->conformance != UPIPE_TS_CONFORMANCE_DVB ||
+        upipe_ts_mux->psii == NULL || upipe_ts_mux->sig == NULL ||
+        upipe_ts_mux->sig_output[0] != NULL)
+        return;
+
+    for (int i = 0; i < 3; i++) {
+        struct uref *flow_def = uref_alloc_control(upipe_ts_mux->uref_mgr);
+        if (unlikely(flow_def == NULL ||
+                     !ubase_check(uref_flow_set_def(flow_def, "void.")) ||
+                     !ubase_check(uref_ts_flow_set_pid(flow_def, pids[i])) ||
+                     !ubase_check(uref_block_flow_set_octetrate(flow_def,
+                                                                TB_RATE_PSI)) ||
+                     !ubase_check(uref_ts_flow_set_tb_rate(flow_def,
+                                                           TB_RATE_PSI)))) {
+            if (flow_def != NULL)
+                uref_free(flow_def);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+
+        upipe_ts_mux->sig_output[i] =
+            upipe_ts_sig_alloc_output(upipe_ts_mux->sig,
+                    uprobe_pfx_alloc(uprobe_use(&upipe_ts_mux->probe),
+                                     UPROBE_LOG_VERBOSE, "sig output"),
+                    flow_def);
+        uref_free(flow_def);
+        if (unlikely(upipe_ts_mux->sig_output[i] == NULL ||
+                     (upipe_ts_mux->sig_psii[i] =
+                      upipe_void_alloc_output_sub(upipe_ts_mux->sig_output[i],
+                             upipe_ts_mux->psii,
+                             uprobe_pfx_alloc(uprobe_use(&upipe_ts_mux->probe),
+                                              UPROBE_LOG_VERBOSE, names[i])))
+                      == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        upipe_ts_psii_sub_set_interval(upipe_ts_mux->sig_psii[i],
+                                       intervals[i]);
+    }
+}
+
 /** @This is called when the uref_mgr is set and the ts_mux can be inited.
  *
  * @param upipe description structure of the pipe
@@ -1638,6 +2092,7 @@ static void upipe_ts_mux_init(struct upipe *upipe)
     }
     upipe_ts_psii_sub_set_interval(upipe_ts_mux->pat_psii,
                                    upipe_ts_mux->pat_interval);
+    upipe_ts_mux_init_si(upipe);
 }
 
 /** @internal @This checks if the input may start.
@@ -1656,6 +2111,107 @@ static int upipe_ts_mux_check(struct upipe *upipe, struct uref *unused)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This accounts for urefs drained from remote inputs, and
+ * triggers the event again if some were queued in the meantime.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb number of drained urefs
+ */
+static void upipe_ts_mux_remote_done(struct upipe *upipe, unsigned int nb)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    if (!nb)
+        return;
+    int32_t counter =
+        (int32_t)uatomic_fetch_sub(&upipe_ts_mux->remote_pending, nb);
+    if (counter > (int32_t)nb)
+        ueventfd_write(&upipe_ts_mux->remote_event);
+}
+
+/** @internal @This drains the FIFOs of all remote inputs. It is called when
+ * the event shared by the remote inputs triggers.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_ts_mux_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    ueventfd_read(&upipe_ts_mux->remote_event);
+
+    upipe_use(upipe);
+    unsigned int nb = 0;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_mux->programs, uchain) {
+        struct upipe_ts_mux_program *program =
+            upipe_ts_mux_program_from_uchain(uchain);
+        struct uchain *uchain_input;
+        ulist_foreach (&program->inputs, uchain_input) {
+            struct upipe_ts_mux_input *input =
+                upipe_ts_mux_input_from_uchain(uchain_input);
+            if (input->remote_length)
+                nb += upipe_ts_mux_input_drain(
+                        upipe_ts_mux_input_to_upipe(input),
+                        &upipe_ts_mux->upump);
+        }
+    }
+    upipe_ts_mux_remote_done(upipe, nb);
+
+    uint32_t dropped = uatomic_load(&upipe_ts_mux->remote_dropped);
+    if (unlikely(dropped)) {
+        uatomic_fetch_sub(&upipe_ts_mux->remote_dropped, dropped);
+        upipe_warn_va(upipe, "dropped %"PRIu32" urefs from full remote inputs",
+                      dropped);
+    }
+    upipe_release(upipe);
+}
+
+/** @internal @This allocates the watcher draining the remote inputs, if
+ * needed.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_mux_check_remote(struct upipe *upipe)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    if (!upipe_ts_mux->remote || upipe_ts_mux->upump != NULL)
+        return UBASE_ERR_NONE;
+
+    upipe_ts_mux_check_upump_mgr(upipe);
+    if (upipe_ts_mux->upump_mgr == NULL)
+        return UBASE_ERR_NONE;
+
+    struct upump *upump = ueventfd_upump_alloc(&upipe_ts_mux->remote_event,
+                                               upipe_ts_mux->upump_mgr,
+                                               upipe_ts_mux_worker, upipe);
+    if (unlikely(upump == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return UBASE_ERR_UPUMP;
+    }
+    upipe_ts_mux_set_upump(upipe, upump);
+    upump_start(upump);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This prepares the mux for inputs fed from other threads.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_mux_init_remote(struct upipe *upipe)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    if (!upipe_ts_mux->remote) {
+        if (unlikely(!ueventfd_init(&upipe_ts_mux->remote_event, false)))
+            return UBASE_ERR_EXTERNAL;
+        uatomic_init(&upipe_ts_mux->remote_pending, 0);
+        uatomic_init(&upipe_ts_mux->remote_dropped, 0);
+        upipe_ts_mux->remote = true;
+    }
+    return upipe_ts_mux_check_remote(upipe);
+}
+
 /** @This calculates the total octetrate used by a stream and updates the
  * aggregate inner pipe.
  *
@@ -1668,13 +2224,25 @@ static void upipe_ts_mux_update(struct upipe *upipe)
         ((UCLOCK_FREQ + upipe_ts_mux->pat_interval - 1) /
          upipe_ts_mux->pat_interval) + upipe_ts_mux->padding_octetrate;
 
+    unsigned int nb_programs = 0;
     struct uchain *uchain;
     ulist_foreach (&upipe_ts_mux->programs, uchain) {
         struct upipe_ts_mux_program *program =
             upipe_ts_mux_program_from_uchain(uchain);
         total_octetrate += program->total_octetrate;
+        nb_programs++;
     }
 
+    if (upipe_ts_mux->sig_psii[0] != NULL)
+        /* one NIT and SDT packet, and two EIT packets per program */
+        total_octetrate += (uint64_t)TS_SIZE *
+            (((UCLOCK_FREQ + DEFAULT_NIT_INTERVAL - 1) /
+              DEFAULT_NIT_INTERVAL) +
+             ((UCLOCK_FREQ + DEFAULT_SDT_INTERVAL - 1) /
+              DEFAULT_SDT_INTERVAL) +
+             2 * nb_programs * ((UCLOCK_FREQ + DEFAULT_EIT_INTERVAL - 1) /
+                                DEFAULT_EIT_INTERVAL));
+
     if (total_octetrate != upipe_ts_mux->total_octetrate) {
         upipe_ts_mux->total_octetrate = total_octetrate;
         if (upipe_ts_mux->octetrate_auto && upipe_ts_mux->agg != NULL)
@@ -1729,7 +2297,11 @@ static void upipe_ts_mux_start(struct upipe *upipe)
          uref_clock_set_cr_dts_delay(uref, PAT_OFFSET);
     }
     /* FIXME in case of deletion PAT will be output too early */
+    struct uref *si_uref = upipe_ts_mux->sig != NULL ? uref_dup(uref) : NULL;
     upipe_input(upipe_ts_mux->psig, uref, NULL);
+    /* the SI tables are only output again if they changed */
+    if (si_uref != NULL)
+        upipe_input(upipe_ts_mux->sig, si_uref, NULL);
 }
 
 /** @internal @This returns whether the given SID already exists.
@@ -1765,6 +2337,9 @@ static bool upipe_ts_mux_find_pid(struct upipe *upipe, uint16_t pid)
     struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
     if (!pid) /* PAT */
         return true;
+    if (upipe_ts_mux->conformance == UPIPE_TS_CONFORMANCE_DVB &&
+        pid >= NIT_PID && pid <= EIT_PID)
+        return true;
 
     struct uchain *uchain;
     ulist_foreach (&upipe_ts_mux->programs, uchain) {
@@ -1812,6 +2387,8 @@ static int upipe_ts_mux_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     UBASE_FATAL(upipe, uref_ts_flow_set_pid(flow_def_dup, 0));
 
     int err = upipe_set_flow_def(upipe_ts_mux->psig, flow_def_dup);
+    if (ubase_check(err) && upipe_ts_mux->sig != NULL)
+        err = upipe_set_flow_def(upipe_ts_mux->sig, flow_def_dup);
     uref_free(flow_def_dup);
     return err;
 }
@@ -1872,6 +2449,12 @@ static int _upipe_ts_mux_set_conformance(struct upipe *upipe,
         if (program->pmt_interval > max_psi_interval)
             program->pmt_interval = max_psi_interval;
     }
+
+    if (upipe_ts_mux->conformance == UPIPE_TS_CONFORMANCE_DVB)
+        upipe_ts_mux_init_si(upipe);
+    else
+        upipe_ts_mux_clean_si(upipe);
+    upipe_ts_mux_update(upipe);
     return UBASE_ERR_NONE;
 }
 
@@ -2056,6 +2639,16 @@ static int upipe_ts_mux_control(struct upipe *upipe, int command, va_list args)
             struct upipe **p = va_arg(args, struct upipe **);
             return upipe_ts_mux_iterate_sub(upipe, p);
         }
+        case UPIPE_ATTACH_UPUMP_MGR: {
+            struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+            if (upipe_ts_mux->remote) {
+                upipe_ts_mux_set_upump(upipe, NULL);
+                upipe_ts_mux_attach_upump_mgr(upipe);
+                upipe_ts_mux_check_remote(upipe);
+            }
+            /* also forwarded to the inner pipes */
+            break;
+        }
 
         case UPIPE_TS_MUX_GET_CONFORMANCE: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
@@ -2145,6 +2738,13 @@ static void upipe_ts_mux_free(struct urefcount *urefcount_real)
     uprobe_clean(&upipe_ts_mux->probe);
     uprobe_clean(&upipe_ts_mux->agg_probe);
     urefcount_clean(urefcount_real);
+    upipe_ts_mux_clean_upump(upipe);
+    upipe_ts_mux_clean_upump_mgr(upipe);
+    if (upipe_ts_mux->remote) {
+        uatomic_clean(&upipe_ts_mux->remote_pending);
+        uatomic_clean(&upipe_ts_mux->remote_dropped);
+        ueventfd_clean(&upipe_ts_mux->remote_event);
+    }
     upipe_ts_mux_clean_uref_mgr(upipe);
     upipe_ts_mux_clean_urefcount(upipe);
     upipe_ts_mux_free_void(upipe);
@@ -2157,12 +2757,16 @@ static void upipe_ts_mux_free(struct urefcount *urefcount_real)
 static void upipe_ts_mux_no_input(struct upipe *upipe)
 {
     struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    upipe_ts_mux_set_upump(upipe, NULL);
     if (upipe_ts_mux->psii != NULL)
         upipe_release(upipe_ts_mux->psii);
     if (upipe_ts_mux->join != NULL)
         upipe_release(upipe_ts_mux->join);
     if (upipe_ts_mux->pat_psii != NULL)
         upipe_release(upipe_ts_mux->pat_psii);
+    upipe_ts_mux_clean_si(upipe);
+    if (upipe_ts_mux->sig != NULL)
+        upipe_release(upipe_ts_mux->sig);
 
     upipe_ts_mux_clean_sub_programs(upipe);
     upipe_ts_mux_clean_bin_input(upipe);
@@ -2192,6 +2796,8 @@ static void upipe_ts_mux_mgr_free(struct urefcount *urefcount)
         upipe_mgr_release(ts_mux_mgr->ts_psig_mgr);
     if (ts_mux_mgr->ts_psii_mgr != NULL)
         upipe_mgr_release(ts_mux_mgr->ts_psii_mgr);
+    if (ts_mux_mgr->ts_sig_mgr != NULL)
+        upipe_mgr_release(ts_mux_mgr->ts_sig_mgr);
 
     urefcount_clean(urefcount);
     free(ts_mux_mgr);
@@ -2233,6 +2839,7 @@ static int upipe_ts_mux_mgr_control(struct upipe_mgr *mgr,
         GET_SET_MGR(ts_pese, TS_PESE)
         GET_SET_MGR(ts_psig, TS_PSIG)
         GET_SET_MGR(ts_psii, TS_PSII)
+        GET_SET_MGR(ts_sig, TS_SIG)
 #undef GET_SET_MGR
 
         default:
@@ -2258,6 +2865,7 @@ struct upipe_mgr *upipe_ts_mux_mgr_alloc(void)
     ts_mux_mgr->ts_pese_mgr = upipe_ts_pese_mgr_alloc();
     ts_mux_mgr->ts_psig_mgr = upipe_ts_psig_mgr_alloc();
     ts_mux_mgr->ts_psii_mgr = upipe_ts_psii_mgr_alloc();
+    ts_mux_mgr->ts_sig_mgr = upipe_ts_sig_mgr_alloc();
 
     urefcount_init(upipe_ts_mux_mgr_to_urefcount(ts_mux_mgr),
                    upipe_ts_mux_mgr_free);
@@ -70,6 +70,10 @@ struct upipe_ts_patd {
     UPIPE_TS_PSID_TABLE_DECLARE(pat);
     /** PAT table being gathered */
     UPIPE_TS_PSID_TABLE_DECLARE(next_pat);
+    /** cache of the sections of the current PAT */
+    struct upipe_ts_psid_cache cache;
+    /** earliest systime of the repeated sections since the last rap */
+    uint64_t cache_rap_sys;
     /** current TSID */
     int tsid;
     /** NIT flow definition */
@@ -109,6 +113,8 @@ static struct upipe *upipe_ts_patd_alloc(struct upipe_mgr *mgr,
     upipe_ts_patd->flow_def_input = NULL;
     upipe_ts_psid_table_init(upipe_ts_patd->pat);
     upipe_ts_psid_table_init(upipe_ts_patd->next_pat);
+    upipe_ts_psid_cache_init(&upipe_ts_patd->cache);
+    upipe_ts_patd->cache_rap_sys = UINT64_MAX;
     upipe_ts_patd->tsid = -1;
     upipe_ts_patd->nit = NULL;
     ulist_init(&upipe_ts_patd->programs);
@@ -217,7 +223,9 @@ static bool upipe_ts_patd_table_validate(struct upipe *upipe)
     struct upipe_ts_patd *upipe_ts_patd = upipe_ts_patd_from_upipe(upipe);
     {
         upipe_ts_psid_table_foreach(upipe_ts_patd->next_pat, section) {
-            if (!upipe_ts_psid_check_crc(section))
+            /* sections unchanged from the current PAT were checked already */
+            if (!upipe_ts_psid_table_contains(upipe_ts_patd->pat, section) &&
+                !upipe_ts_psid_check_crc(section))
                 return false;
         }
     }
@@ -270,6 +278,22 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_ts_patd *upipe_ts_patd = upipe_ts_patd_from_upipe(upipe);
     assert(upipe_ts_patd->flow_def_input != NULL);
+    bool last;
+    if (upipe_ts_psid_cache_check(&upipe_ts_patd->cache, uref, &last)) {
+        /* Identical section of the current PAT. */
+        uint64_t systime;
+        if (ubase_check(uref_clock_get_cr_sys(uref, &systime)) &&
+            systime < upipe_ts_patd->cache_rap_sys)
+            upipe_ts_patd->cache_rap_sys = systime;
+        if (last && upipe_ts_patd->cache_rap_sys != UINT64_MAX) {
+            uref_clock_set_rap_sys(uref, upipe_ts_patd->cache_rap_sys);
+            upipe_throw_new_rap(upipe, uref);
+            upipe_ts_patd->cache_rap_sys = UINT64_MAX;
+        }
+        uref_free(uref);
+        return;
+    }
+
     uint8_t buffer[PAT_HEADER_SIZE];
     const uint8_t *pat_header = uref_block_peek(uref, 0, PAT_HEADER_SIZE,
                                                 buffer);
@@ -396,6 +420,8 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
         upipe_ts_psid_table_clean(upipe_ts_patd->pat);
     upipe_ts_psid_table_copy(upipe_ts_patd->pat, upipe_ts_patd->next_pat);
     upipe_ts_psid_table_init(upipe_ts_patd->next_pat);
+    upipe_ts_psid_cache_store_table(&upipe_ts_patd->cache, upipe_ts_patd->pat);
+    upipe_ts_patd->cache_rap_sys = UINT64_MAX;
 
     upipe_split_throw_update(upipe);
 }
@@ -463,6 +489,22 @@ static int _upipe_ts_patd_get_nit(struct upipe *upipe, struct uref **p)
     return UBASE_ERR_UNHANDLED;
 }
 
+/** @internal @This returns the sections of the current PAT.
+ *
+ * @param upipe description structure of the pipe
+ * @param p filled in with a new uref containing the sections
+ * @return an error code
+ */
+static int _upipe_ts_patd_get_table(struct upipe *upipe, struct uref **p)
+{
+    struct upipe_ts_patd *upipe_ts_patd = upipe_ts_patd_from_upipe(upipe);
+    assert(p != NULL);
+    if (!upipe_ts_psid_table_validate(upipe_ts_patd->pat))
+        return UBASE_ERR_UNHANDLED;
+    *p = upipe_ts_psid_table_dup(upipe_ts_patd->pat);
+    return *p != NULL ? UBASE_ERR_NONE : UBASE_ERR_ALLOC;
+}
+
 /** @internal @This processes control commands.
  *
  * @param upipe description structure of the pipe
@@ -507,6 +549,23 @@ static int upipe_ts_patd_control(struct upipe *upipe, int command, va_list args)
             struct uref **p = va_arg(args, struct uref **);
             return _upipe_ts_patd_get_nit(upipe, p);
         }
+        case UPIPE_TS_PATD_GET_CACHE_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PATD_SIGNATURE)
+            struct upipe_ts_patd *upipe_ts_patd =
+                upipe_ts_patd_from_upipe(upipe);
+            uint64_t *hits_p = va_arg(args, uint64_t *);
+            uint64_t *misses_p = va_arg(args, uint64_t *);
+            if (hits_p != NULL)
+                *hits_p = upipe_ts_patd->cache.hits;
+            if (misses_p != NULL)
+                *misses_p = upipe_ts_patd->cache.misses;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_PATD_GET_TABLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PATD_SIGNATURE)
+            struct uref **p = va_arg(args, struct uref **);
+            return _upipe_ts_patd_get_table(upipe, p);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
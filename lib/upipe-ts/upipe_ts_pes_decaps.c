@@ -76,6 +76,15 @@ struct upipe_ts_pesd {
     /** true if we have thrown the sync_acquired event */
     bool acquired;
 
+    /** true if PES are reassembled in a single buffer */
+    bool reassemble;
+    /** PES being reassembled */
+    struct uref *pes_uref;
+    /** number of octets already copied into the reassembled PES */
+    size_t pes_offset;
+    /** size of the payload of the reassembled PES */
+    size_t pes_payload_size;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -109,6 +118,9 @@ static struct upipe *upipe_ts_pesd_alloc(struct upipe_mgr *mgr,
     upipe_ts_pesd_init_output(upipe);
     upipe_ts_pesd->next_uref = NULL;
     upipe_ts_pesd->next_uref_size = 0;
+    upipe_ts_pesd->reassemble = false;
+    upipe_ts_pesd->pes_uref = NULL;
+    upipe_ts_pesd->pes_offset = upipe_ts_pesd->pes_payload_size = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -125,9 +137,120 @@ static void upipe_ts_pesd_flush(struct upipe *upipe)
         upipe_ts_pesd->next_uref = NULL;
         upipe_ts_pesd->next_uref_size = 0;
     }
+    if (upipe_ts_pesd->pes_uref != NULL) {
+        uref_free(upipe_ts_pesd->pes_uref);
+        upipe_ts_pesd->pes_uref = NULL;
+    }
     upipe_ts_pesd_sync_lost(upipe);
 }
 
+/** @internal @This outputs the PES being reassembled, if any, truncated to
+ * the octets received so far.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_pesd_output_truncated(struct upipe *upipe,
+                                           struct upump **upump_p)
+{
+    struct upipe_ts_pesd *upipe_ts_pesd = upipe_ts_pesd_from_upipe(upipe);
+    struct uref *uref = upipe_ts_pesd->pes_uref;
+    if (uref == NULL)
+        return;
+    upipe_ts_pesd->pes_uref = NULL;
+
+    upipe_warn(upipe, "truncated PES");
+    if (unlikely(!ubase_check(uref_block_resize(uref, 0,
+                                                upipe_ts_pesd->pes_offset)))) {
+        uref_free(uref);
+        return;
+    }
+    upipe_ts_pesd_output(upipe, uref, upump_p);
+}
+
+/** @internal @This copies a PES chunk into the PES being reassembled, and
+ * outputs it once complete. The first chunk of a PES allocates a buffer
+ * large enough for the whole payload.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_pesd_reassemble(struct upipe *upipe,
+                                     struct upump **upump_p)
+{
+    struct upipe_ts_pesd *upipe_ts_pesd = upipe_ts_pesd_from_upipe(upipe);
+    struct uref *uref = upipe_ts_pesd->next_uref;
+    upipe_ts_pesd->next_uref = NULL;
+    size_t size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &size)))) {
+        uref_free(uref);
+        return;
+    }
+
+    if (upipe_ts_pesd->pes_uref == NULL) {
+        /* the header has already been removed from the first chunk */
+        upipe_ts_pesd->pes_payload_size = size +
+            upipe_ts_pesd->next_pes_size - upipe_ts_pesd->next_uref_size;
+        struct ubuf *ubuf = ubuf_block_alloc(uref->ubuf->mgr,
+                                             upipe_ts_pesd->pes_payload_size);
+        if (unlikely(ubuf == NULL)) {
+            uref_free(uref);
+            upipe_ts_pesd_flush(upipe);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        upipe_ts_pesd->pes_uref = uref_dup(uref);
+        if (unlikely(upipe_ts_pesd->pes_uref == NULL)) {
+            ubuf_free(ubuf);
+            uref_free(uref);
+            upipe_ts_pesd_flush(upipe);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_attach_ubuf(upipe_ts_pesd->pes_uref, ubuf);
+        upipe_ts_pesd->pes_offset = 0;
+    }
+
+    size_t remaining = upipe_ts_pesd->pes_payload_size -
+                       upipe_ts_pesd->pes_offset;
+    if (unlikely(size > remaining)) {
+        upipe_warn(upipe, "PES overflow");
+        size = remaining;
+    }
+
+    if (size) {
+        int buffer_size = size;
+        uint8_t *buffer;
+        if (unlikely(!ubase_check(uref_block_write(upipe_ts_pesd->pes_uref,
+                        upipe_ts_pesd->pes_offset, &buffer_size, &buffer)))) {
+            uref_free(uref);
+            upipe_ts_pesd_flush(upipe);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        /* the buffer was allocated in one piece */
+        assert(buffer_size == size);
+        int err = uref_block_extract(uref, 0, size, buffer);
+        uref_block_unmap(upipe_ts_pesd->pes_uref, upipe_ts_pesd->pes_offset);
+        if (unlikely(!ubase_check(err))) {
+            uref_free(uref);
+            upipe_ts_pesd_flush(upipe);
+            upipe_throw_fatal(upipe, err);
+            return;
+        }
+        upipe_ts_pesd->pes_offset += size;
+    }
+    uref_free(uref);
+
+    if (upipe_ts_pesd->pes_offset == upipe_ts_pesd->pes_payload_size) {
+        uref = upipe_ts_pesd->pes_uref;
+        upipe_ts_pesd->pes_uref = NULL;
+        upipe_ts_pesd->next_uref_size = upipe_ts_pesd->next_pes_size = 0;
+        uref_block_set_end(uref);
+        upipe_ts_pesd_output(upipe, uref, upump_p);
+    }
+}
+
 /** @internal @This outputs a PES chunk, and checks if it is the end of the PES.
  *
  * @param upipe description structure of the pipe
@@ -138,6 +261,13 @@ static void upipe_ts_pesd_check_output(struct upipe *upipe,
 {
     struct upipe_ts_pesd *upipe_ts_pesd = upipe_ts_pesd_from_upipe(upipe);
     upipe_ts_pesd_sync_acquired(upipe);
+    if (upipe_ts_pesd->reassemble && upipe_ts_pesd->next_pes_size &&
+        (upipe_ts_pesd->pes_uref != NULL ||
+         ubase_check(uref_block_get_start(upipe_ts_pesd->next_uref)))) {
+        upipe_ts_pesd_reassemble(upipe, upump_p);
+        return;
+    }
+
     if (upipe_ts_pesd->next_uref_size == upipe_ts_pesd->next_pes_size) {
         uref_block_set_end(upipe_ts_pesd->next_uref);
         upipe_ts_pesd->next_uref_size = upipe_ts_pesd->next_pes_size = 0;
@@ -311,6 +441,7 @@ static void upipe_ts_pesd_input(struct upipe *upipe, struct uref *uref,
             upipe_warn(upipe, "truncated PES header");
             uref_free(upipe_ts_pesd->next_uref);
         }
+        upipe_ts_pesd_output_truncated(upipe, upump_p);
         upipe_ts_pesd->next_uref = uref;
         upipe_ts_pesd->next_uref_size = uref_size;
         upipe_ts_pesd_decaps(upipe, upump_p);
@@ -362,6 +493,35 @@ static int upipe_ts_pesd_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns whether PES are reassembled.
+ *
+ * @param upipe description structure of the pipe
+ * @param reassemble_p filled in with true if PES are reassembled
+ * @return an error code
+ */
+static int _upipe_ts_pesd_get_reassemble(struct upipe *upipe,
+                                         bool *reassemble_p)
+{
+    struct upipe_ts_pesd *upipe_ts_pesd = upipe_ts_pesd_from_upipe(upipe);
+    assert(reassemble_p != NULL);
+    *reassemble_p = upipe_ts_pesd->reassemble;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets whether PES are reassembled. The change takes
+ * effect on the next PES.
+ *
+ * @param upipe description structure of the pipe
+ * @param reassemble true to reassemble PES
+ * @return an error code
+ */
+static int _upipe_ts_pesd_set_reassemble(struct upipe *upipe, bool reassemble)
+{
+    struct upipe_ts_pesd *upipe_ts_pesd = upipe_ts_pesd_from_upipe(upipe);
+    upipe_ts_pesd->reassemble = reassemble;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts pesd pipe.
  *
  * @param upipe description structure of the pipe
@@ -396,6 +556,16 @@ static int upipe_ts_pesd_control(struct upipe *upipe, int command, va_list args)
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_ts_pesd_set_output(upipe, output);
         }
+        case UPIPE_TS_PESD_GET_REASSEMBLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PESD_SIGNATURE)
+            bool *reassemble_p = va_arg(args, bool *);
+            return _upipe_ts_pesd_get_reassemble(upipe, reassemble_p);
+        }
+        case UPIPE_TS_PESD_SET_REASSEMBLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PESD_SIGNATURE)
+            bool reassemble = va_arg(args, int);
+            return _upipe_ts_pesd_set_reassemble(upipe, reassemble);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -415,6 +585,8 @@ static void upipe_ts_pesd_free(struct upipe *upipe)
 
     if (upipe_ts_pesd->next_uref != NULL)
         uref_free(upipe_ts_pesd->next_uref);
+    if (upipe_ts_pesd->pes_uref != NULL)
+        uref_free(upipe_ts_pesd->pes_uref);
     upipe_ts_pesd_clean_urefcount(upipe);
     upipe_ts_pesd_free_void(upipe);
 }
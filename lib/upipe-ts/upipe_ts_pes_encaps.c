@@ -40,6 +40,7 @@
 #include <upipe/upipe_helper_input.h>
 #include <upipe-ts/upipe_ts_pes_encaps.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-framers/uref_frames.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -101,6 +102,15 @@ struct upipe_ts_pese {
     /** minimum PES duration */
     uint64_t pes_min_duration;
 
+    /** PES header template, where only the length and timestamps change */
+    uint8_t header_template[UINT8_MAX];
+    /** size of the template, or 0 if there is none */
+    size_t header_template_size;
+    /** true if the template carries a PTS */
+    bool header_template_pts;
+    /** true if the template carries a DTS */
+    bool header_template_dts;
+
     /** buffered incomplete PES */
     struct uchain next_pes;
     /** size of the upcoming PES */
@@ -149,6 +159,7 @@ static struct upipe *upipe_ts_pese_alloc(struct upipe_mgr *mgr,
     upipe_ts_pese->pes_id = 0;
     upipe_ts_pese->pes_header_size = 0;
     upipe_ts_pese->pes_min_duration = 0;
+    upipe_ts_pese->header_template_size = 0;
     ulist_init(&upipe_ts_pese->next_pes);
     upipe_ts_pese->next_pes_size = 0;
     upipe_ts_pese->next_pes_duration = 0;
@@ -156,6 +167,40 @@ static struct upipe *upipe_ts_pese_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This builds the PES header template of the stream, with the
+ * given layout. The new template is used until the layout changes, which
+ * normally only happens at the start of the stream.
+ *
+ * @param upipe description structure of the pipe
+ * @param header_size size of the header
+ * @param has_pts true if the header carries a PTS
+ * @param has_dts true if the header carries a DTS
+ */
+static void upipe_ts_pese_build_template(struct upipe *upipe,
+                                         size_t header_size,
+                                         bool has_pts, bool has_dts)
+{
+    struct upipe_ts_pese *upipe_ts_pese = upipe_ts_pese_from_upipe(upipe);
+    uint8_t *buffer = upipe_ts_pese->header_template;
+
+    memset(buffer, 0, header_size);
+    pes_init(buffer);
+    pes_set_streamid(buffer, upipe_ts_pese->pes_id);
+    if (upipe_ts_pese->pes_id != PES_STREAM_ID_PRIVATE_2) {
+        pes_set_headerlength(buffer, header_size - PES_HEADER_SIZE_NOPTS);
+        pes_set_dataalignment(buffer);
+        if (has_pts) {
+            pes_set_pts(buffer, 0);
+            if (has_dts)
+                pes_set_dts(buffer, 0);
+        }
+    }
+
+    upipe_ts_pese->header_template_size = header_size;
+    upipe_ts_pese->header_template_pts = has_pts;
+    upipe_ts_pese->header_template_dts = has_dts;
+}
+
 /** @internal @This prepends a PES header to a logical unit.
  *
  * @param upipe description structure of the pipe
@@ -168,6 +213,7 @@ static void upipe_ts_pese_work(struct upipe *upipe, struct upump **upump_p)
         return;
 
     uint64_t pts = UINT64_MAX, dts = UINT64_MAX;
+    bool has_pts = false, has_dts = false;
     struct uref *uref = uref_from_uchain(ulist_pop(&upipe_ts_pese->next_pes));
 
     size_t header_size;
@@ -175,12 +221,12 @@ static void upipe_ts_pese_work(struct upipe *upipe, struct upump **upump_p)
         uref_clock_get_pts_prog(uref, &pts);
         uref_clock_get_dts_prog(uref, &dts);
         if (pts != UINT64_MAX) {
-            if (dts != UINT64_MAX &&
-                ((pts / CLOCK_SCALE) % POW2_33) !=
-                    ((dts / CLOCK_SCALE) % POW2_33))
-                header_size = PES_HEADER_SIZE_PTSDTS;
-            else
-                header_size = PES_HEADER_SIZE_PTS;
+            has_pts = true;
+            has_dts = dts != UINT64_MAX &&
+                      ((pts / CLOCK_SCALE) % POW2_33) !=
+                          ((dts / CLOCK_SCALE) % POW2_33);
+            header_size = has_dts ? PES_HEADER_SIZE_PTSDTS :
+                                    PES_HEADER_SIZE_PTS;
         } else
             header_size = PES_HEADER_SIZE_NOPTS;
     } else
@@ -188,6 +234,11 @@ static void upipe_ts_pese_work(struct upipe *upipe, struct upump **upump_p)
     if (header_size < upipe_ts_pese->pes_header_size)
         header_size = upipe_ts_pese->pes_header_size;
 
+    if (unlikely(header_size != upipe_ts_pese->header_template_size ||
+                 has_pts != upipe_ts_pese->header_template_pts ||
+                 has_dts != upipe_ts_pese->header_template_dts))
+        upipe_ts_pese_build_template(upipe, header_size, has_pts, has_dts);
+
     struct ubuf *ubuf = ubuf_block_alloc(upipe_ts_pese->ubuf_mgr, header_size);
     if (unlikely(ubuf == NULL)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
@@ -202,8 +253,7 @@ static void upipe_ts_pese_work(struct upipe *upipe, struct upump **upump_p)
         goto upipe_ts_pese_work_err;
     }
 
-    pes_init(buffer);
-    pes_set_streamid(buffer, upipe_ts_pese->pes_id);
+    memcpy(buffer, upipe_ts_pese->header_template, header_size);
     size_t pes_length = upipe_ts_pese->next_pes_size + header_size -
                         PES_HEADER_SIZE;
     if (pes_length > UINT16_MAX) {
@@ -214,16 +264,10 @@ static void upipe_ts_pese_work(struct upipe *upipe, struct upump **upump_p)
     } else
         pes_set_length(buffer, pes_length);
 
-    if (upipe_ts_pese->pes_id != PES_STREAM_ID_PRIVATE_2) {
-        pes_set_headerlength(buffer, header_size - PES_HEADER_SIZE_NOPTS);
-        pes_set_dataalignment(buffer);
-        if (pts != UINT64_MAX) {
-            pes_set_pts(buffer, (pts / CLOCK_SCALE) % POW2_33);
-            if (dts != UINT64_MAX &&
-                ((pts / CLOCK_SCALE) % POW2_33) !=
-                    ((dts / CLOCK_SCALE) % POW2_33))
-                pes_set_dts(buffer, (dts / CLOCK_SCALE) % POW2_33);
-        }
+    if (has_pts) {
+        pes_set_pts(buffer, (pts / CLOCK_SCALE) % POW2_33);
+        if (has_dts)
+            pes_set_dts(buffer, (dts / CLOCK_SCALE) % POW2_33);
     }
     ubuf_block_unmap(ubuf, 0);
 
@@ -267,6 +311,7 @@ static bool upipe_ts_pese_handle(struct upipe *upipe, struct uref *uref,
         uref_ts_flow_get_pes_id(uref, &upipe_ts_pese->pes_id);
         upipe_ts_pese->pes_header_size = 0;
         uref_ts_flow_get_pes_header(uref, &upipe_ts_pese->pes_header_size);
+        upipe_ts_pese->header_template_size = 0;
         upipe_ts_pese->pes_min_duration = 0;
         uref_ts_flow_get_pes_min_duration(uref,
                                           &upipe_ts_pese->pes_min_duration);
@@ -308,6 +353,10 @@ static bool upipe_ts_pese_handle(struct upipe *upipe, struct uref *uref,
 static void upipe_ts_pese_input(struct upipe *upipe, struct uref *uref,
                                 struct upump **upump_p)
 {
+    /* groups of frames are encapsulated as a whole, and the table of frames
+     * would not survive the concatenation of PES */
+    uref_frames_delete(uref);
+
     if (!upipe_ts_pese_check_input(upipe)) {
         upipe_ts_pese_hold_input(upipe, uref);
         upipe_ts_pese_block_input(upipe, upump_p);
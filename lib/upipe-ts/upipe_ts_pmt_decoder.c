@@ -57,6 +57,11 @@
 /** we only accept TS packets */
 #define EXPECTED_FLOW_DEF "block.mpegtspsi.mpegtspmt."
 
+#ifndef PMT_STREAMTYPE_VIDEO_HEVC
+/** ITU-T H.265 video stream type, missing from older bitstream */
+#define PMT_STREAMTYPE_VIDEO_HEVC 0x24
+#endif
+
 /** @internal @This is the private context of a ts_pmtd pipe. */
 struct upipe_ts_pmtd {
     /** refcount management structure */
@@ -75,6 +80,8 @@ struct upipe_ts_pmtd {
     struct uref *flow_def_input;
     /** currently in effect PMT table */
     struct uref *pmt;
+    /** cache of the section of the current PMT */
+    struct upipe_ts_psid_cache cache;
     /** list of flows */
     struct uchain flows;
 
@@ -109,6 +116,7 @@ static struct upipe *upipe_ts_pmtd_alloc(struct upipe_mgr *mgr,
     upipe_ts_pmtd_init_output(upipe);
     upipe_ts_pmtd->flow_def_input = NULL;
     upipe_ts_pmtd->pmt = NULL;
+    upipe_ts_psid_cache_init(&upipe_ts_pmtd->cache);
     ulist_init(&upipe_ts_pmtd->flows);
     upipe_throw_ready(upipe);
     return upipe;
@@ -358,6 +366,12 @@ static void upipe_ts_pmtd_parse_streamtype(struct upipe *upipe,
                             "block.mpegts.mpegtspes.h264.pic."))
             break;
 
+        case PMT_STREAMTYPE_VIDEO_HEVC:
+            UBASE_FATAL(upipe, uref_flow_set_def(flow_def, "block.hevc.pic."))
+            UBASE_FATAL(upipe, uref_flow_set_raw_def(flow_def,
+                            "block.mpegts.mpegtspes.hevc.pic."))
+            break;
+
         default:
             break;
     }
@@ -591,8 +605,7 @@ static void upipe_ts_pmtd_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_ts_pmtd *upipe_ts_pmtd = upipe_ts_pmtd_from_upipe(upipe);
     assert(upipe_ts_pmtd->flow_def_input != NULL);
-    if (upipe_ts_pmtd->pmt != NULL &&
-        ubase_check(uref_block_equal(upipe_ts_pmtd->pmt, uref))) {
+    if (upipe_ts_psid_cache_check(&upipe_ts_pmtd->cache, uref, NULL)) {
         /* Identical PMT. */
         upipe_throw_new_rap(upipe, uref);
         uref_free(uref);
@@ -672,6 +685,8 @@ static void upipe_ts_pmtd_input(struct upipe *upipe, struct uref *uref,
     if (upipe_ts_pmtd->pmt != NULL)
         uref_free(upipe_ts_pmtd->pmt);
     upipe_ts_pmtd->pmt = uref;
+    upipe_ts_psid_cache_flush(&upipe_ts_pmtd->cache);
+    upipe_ts_psid_cache_store(&upipe_ts_pmtd->cache, uref);
 
     upipe_split_throw_update(upipe);
 }
@@ -762,6 +777,28 @@ static int upipe_ts_pmtd_control(struct upipe *upipe, int command, va_list args)
             return upipe_ts_pmtd_iterate(upipe, p);
         }
 
+        case UPIPE_TS_PMTD_GET_CACHE_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PMTD_SIGNATURE)
+            struct upipe_ts_pmtd *upipe_ts_pmtd =
+                upipe_ts_pmtd_from_upipe(upipe);
+            uint64_t *hits_p = va_arg(args, uint64_t *);
+            uint64_t *misses_p = va_arg(args, uint64_t *);
+            if (hits_p != NULL)
+                *hits_p = upipe_ts_pmtd->cache.hits;
+            if (misses_p != NULL)
+                *misses_p = upipe_ts_pmtd->cache.misses;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_PMTD_GET_TABLE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PMTD_SIGNATURE)
+            struct upipe_ts_pmtd *upipe_ts_pmtd =
+                upipe_ts_pmtd_from_upipe(upipe);
+            struct uref **p = va_arg(args, struct uref **);
+            if (upipe_ts_pmtd->pmt == NULL)
+                return UBASE_ERR_UNHANDLED;
+            *p = uref_dup(upipe_ts_pmtd->pmt);
+            return *p != NULL ? UBASE_ERR_NONE : UBASE_ERR_ALLOC;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
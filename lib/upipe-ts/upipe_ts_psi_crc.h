@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+
+/** @file
+ * @short Upipe utility functions to compute the CRC of PSI sections
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_PSI_CRC_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_PSI_CRC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <bitstream/mpeg/psi.h>
+
+/** @This updates a MPEG-2 CRC32 (polynomial 0x04c11db7, MSB-first) with
+ * the given octets, eight octets at a time.
+ *
+ * @param crc current value of the CRC, 0xffffffff to start a new one
+ * @param buffer octets to add
+ * @param size number of octets
+ * @return updated value of the CRC
+ */
+uint32_t upipe_ts_psi_crc_update(uint32_t crc, const uint8_t *buffer,
+                                 size_t size);
+
+/** @This computes the CRC of a PSI section and writes it at the end of the
+ * section. This is equivalent to psi_set_crc.
+ *
+ * @param section pointer to the PSI section
+ */
+static inline void upipe_ts_psi_crc_set(uint8_t *section)
+{
+    uint16_t size = psi_get_length(section) + PSI_HEADER_SIZE - PSI_CRC_SIZE;
+    uint32_t crc = upipe_ts_psi_crc_update(0xffffffff, section, size);
+    section[size] = crc >> 24;
+    section[size + 1] = (crc >> 16) & 0xff;
+    section[size + 2] = (crc >> 8) & 0xff;
+    section[size + 3] = crc & 0xff;
+}
+
+#endif
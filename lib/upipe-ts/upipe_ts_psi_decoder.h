@@ -29,10 +29,13 @@
 #include <upipe/uref_block.h>
 
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #include <bitstream/mpeg/psi.h>
 
+#include "upipe_ts_psi_crc.h"
+
 /** @This checks the CRC of a PSI section.
  *
  * @param section PSI section
@@ -57,8 +60,7 @@ static inline bool upipe_ts_psid_check_crc(struct uref *section)
         if (unlikely(!ubase_check(uref_block_read(section, offset, &read_size,
                                                   &read_buffer))))
             return false;
-        for (int i = 0; i < read_size; i++)
-            crc = (crc << 8) ^ p_psi_crc_table[(crc >> 24) ^ (read_buffer[i])];
+        crc = upipe_ts_psi_crc_update(crc, read_buffer, read_size);
         if (unlikely(!ubase_check(uref_block_unmap(section, offset))))
             return false;
         size -= read_size;
@@ -109,6 +111,147 @@ static inline bool upipe_ts_psid_equal(struct uref *section1,
     return ubase_check(uref_block_equal(section1, section2));
 }
 
+/** @This identifies the contents of a PSI section in a section cache. */
+struct upipe_ts_psid_cache_key {
+    /** CRC of the section */
+    uint32_t crc;
+    /** table ID extension */
+    uint16_t tableidext;
+    /** length of the section, or 0 if the entry is unused */
+    uint16_t length;
+    /** table ID */
+    uint8_t tableid;
+    /** version number */
+    uint8_t version;
+    /** last section number */
+    uint8_t last_section;
+};
+
+/** @This is a cache of the sections of the PSI table currently in effect,
+ * allowing to drop identical repetitions before parsing them. */
+struct upipe_ts_psid_cache {
+    /** keys of the cached sections, indexed by section number */
+    struct upipe_ts_psid_cache_key keys[PSI_TABLE_MAX_SECTIONS];
+    /** number of sections found in the cache */
+    uint64_t hits;
+    /** number of sections not found in the cache */
+    uint64_t misses;
+};
+
+/** @This initializes a PSI section cache.
+ *
+ * @param cache PSI section cache
+ */
+static inline void upipe_ts_psid_cache_init(struct upipe_ts_psid_cache *cache)
+{
+    memset(cache->keys, 0, sizeof(cache->keys));
+    cache->hits = cache->misses = 0;
+}
+
+/** @This removes all sections from a PSI section cache, keeping the
+ * statistics.
+ *
+ * @param cache PSI section cache
+ */
+static inline void upipe_ts_psid_cache_flush(struct upipe_ts_psid_cache *cache)
+{
+    memset(cache->keys, 0, sizeof(cache->keys));
+}
+
+/** @internal @This reads the cache key of a PSI section, only peeking at its
+ * header and its CRC.
+ *
+ * @param uref PSI section
+ * @param key filled in with the key of the section
+ * @param section_p filled in with the section number
+ * @return false if the section has no syntax or is truncated
+ */
+static inline bool upipe_ts_psid_cache_key(struct uref *uref,
+                                           struct upipe_ts_psid_cache_key *key,
+                                           uint8_t *section_p)
+{
+    uint8_t buffer[PSI_HEADER_SIZE_SYNTAX1];
+    const uint8_t *section_header = uref_block_peek(uref, 0,
+                                                    PSI_HEADER_SIZE_SYNTAX1,
+                                                    buffer);
+    if (unlikely(section_header == NULL))
+        return false;
+    bool syntax = psi_get_syntax(section_header);
+    key->tableid = psi_get_tableid(section_header);
+    key->tableidext = psi_get_tableidext(section_header);
+    key->length = psi_get_length(section_header);
+    key->version = psi_get_version(section_header);
+    key->last_section = psi_get_lastsection(section_header);
+    *section_p = psi_get_section(section_header);
+    int err = uref_block_peek_unmap(uref, 0, buffer, section_header);
+    ubase_assert(err);
+    if (!syntax || key->length < PSI_HEADER_SIZE_SYNTAX1 - PSI_HEADER_SIZE +
+                                 PSI_CRC_SIZE)
+        return false;
+
+    uint8_t buffer2[PSI_CRC_SIZE];
+    int offset = PSI_HEADER_SIZE + key->length - PSI_CRC_SIZE;
+    const uint8_t *crc = uref_block_peek(uref, offset, PSI_CRC_SIZE, buffer2);
+    if (unlikely(crc == NULL))
+        return false;
+    key->crc = ((uint32_t)crc[0] << 24) | (crc[1] << 16) | (crc[2] << 8) |
+               crc[3];
+    err = uref_block_peek_unmap(uref, offset, buffer2, crc);
+    ubase_assert(err);
+    return true;
+}
+
+/** @This checks whether a section is an identical repetition of a section
+ * of the cached table, by comparing table ID, table ID extension, version,
+ * section number, length and CRC.
+ *
+ * @param cache PSI section cache
+ * @param uref PSI section
+ * @param last_p filled in with true if the section is the last one of the
+ * table (may be NULL)
+ * @return true if the section is in the cache
+ */
+static inline bool upipe_ts_psid_cache_check(struct upipe_ts_psid_cache *cache,
+                                             struct uref *uref, bool *last_p)
+{
+    struct upipe_ts_psid_cache_key key;
+    uint8_t section;
+    if (!upipe_ts_psid_cache_key(uref, &key, &section)) {
+        cache->misses++;
+        return false;
+    }
+
+    struct upipe_ts_psid_cache_key *cached = &cache->keys[section];
+    if (cached->length != key.length || cached->crc != key.crc ||
+        cached->tableid != key.tableid ||
+        cached->tableidext != key.tableidext ||
+        cached->version != key.version ||
+        cached->last_section != key.last_section) {
+        cache->misses++;
+        return false;
+    }
+
+    if (last_p != NULL)
+        *last_p = section == key.last_section;
+    cache->hits++;
+    return true;
+}
+
+/** @This adds a section to a PSI section cache. The section must have been
+ * validated.
+ *
+ * @param cache PSI section cache
+ * @param uref PSI section
+ */
+static inline void upipe_ts_psid_cache_store(struct upipe_ts_psid_cache *cache,
+                                             struct uref *uref)
+{
+    struct upipe_ts_psid_cache_key key;
+    uint8_t section;
+    if (upipe_ts_psid_cache_key(uref, &key, &section))
+        cache->keys[section] = key;
+}
+
 /** @This declares a PSI table in a structure.
  *
  * @param table name of the member
@@ -235,6 +378,34 @@ static inline bool upipe_ts_psid_table_section(struct uref **sections,
     return true;
 }
 
+/** @This checks whether a section is already part of a PSI table, with
+ * identical contents. Such a section was validated when the table was
+ * received, so its CRC needs not be checked again.
+ *
+ * @param sections PSI table
+ * @param uref section to look up
+ * @return true if the table contains an identical section
+ */
+static inline bool upipe_ts_psid_table_contains(struct uref **sections,
+                                                struct uref *uref)
+{
+    if (!upipe_ts_psid_table_validate(sections))
+        return false;
+
+    uint8_t buffer[PSI_HEADER_SIZE_SYNTAX1];
+    const uint8_t *section_header = uref_block_peek(uref, 0,
+                                                    PSI_HEADER_SIZE_SYNTAX1,
+                                                    buffer);
+    if (unlikely(section_header == NULL))
+        return false;
+    uint8_t section = psi_get_section(section_header);
+    int err = uref_block_peek_unmap(uref, 0, buffer, section_header);
+    ubase_assert(err);
+
+    return sections[section] != NULL &&
+           upipe_ts_psid_equal(sections[section], uref);
+}
+
 /** @This returns a section from a PSI table.
  *
  * @param sections PSI table
@@ -261,6 +432,48 @@ static inline struct uref *upipe_ts_psid_table_get_section(struct uref **section
          upipe_ts_psid_table_foreach_i++,                                   \
             section = sections[upipe_ts_psid_table_foreach_i])
 
+/** @This returns a new uref containing the sections of a table, one after
+ * the other. The table must have been validated.
+ *
+ * @param sections PSI table
+ * @return pointer to a new uref, or NULL in case of allocation error
+ */
+static inline struct uref *upipe_ts_psid_table_dup(struct uref **sections)
+{
+    struct uref *uref = NULL;
+    upipe_ts_psid_table_foreach(sections, section) {
+        if (uref == NULL) {
+            uref = uref_dup(section);
+            if (unlikely(uref == NULL))
+                return NULL;
+            continue;
+        }
+        struct ubuf *ubuf = ubuf_dup(section->ubuf);
+        if (unlikely(ubuf == NULL ||
+                     !ubase_check(uref_block_append(uref, ubuf)))) {
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            uref_free(uref);
+            return NULL;
+        }
+    }
+    return uref;
+}
+
+/** @This replaces the contents of a PSI section cache with the sections of
+ * a table. The table must have been validated.
+ *
+ * @param cache PSI section cache
+ * @param sections PSI table
+ */
+static inline void upipe_ts_psid_cache_store_table(
+        struct upipe_ts_psid_cache *cache, struct uref **sections)
+{
+    upipe_ts_psid_cache_flush(cache);
+    upipe_ts_psid_table_foreach(sections, section)
+        upipe_ts_psid_cache_store(cache, section);
+}
+
 /** @This compares two PSI tables.
  *
  * @param sections1 PSI table 1
@@ -51,6 +51,8 @@
 #include <bitstream/mpeg/ts.h>
 #include <bitstream/mpeg/psi.h>
 
+#include "upipe_ts_psi_crc.h"
+
 /** @hidden */
 static int upipe_ts_psig_check(struct upipe *upipe, struct uref *flow_format);
 
@@ -79,6 +81,8 @@ struct upipe_ts_psig {
     uint16_t tsid;
     /** PAT version */
     uint8_t pat_version;
+    /** sections of the last generated PAT, empty if it must be regenerated */
+    struct uchain pat_sections;
 
     /** list of program subpipes */
     struct uchain programs;
@@ -127,6 +131,8 @@ struct upipe_ts_psig_program {
     uint8_t *descriptors;
     /** descriptors size */
     size_t descriptors_size;
+    /** last generated PMT section, or NULL if it must be regenerated */
+    struct ubuf *pmt;
 
     /** list of flow subpipes */
     struct uchain flows;
@@ -148,6 +154,32 @@ UPIPE_HELPER_OUTPUT(upipe_ts_psig_program, output, flow_def, output_state, reque
 UPIPE_HELPER_SUBPIPE(upipe_ts_psig, upipe_ts_psig_program, program, program_mgr,
                      programs, uchain)
 
+/** @internal @This drops the cached PAT sections, so that the PAT is
+ * regenerated on the next input.
+ *
+ * @param upipe_ts_psig private context of the ts_psig pipe
+ */
+static void upipe_ts_psig_invalidate(struct upipe_ts_psig *upipe_ts_psig)
+{
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&upipe_ts_psig->pat_sections)) != NULL)
+        ubuf_free(ubuf_from_uchain(uchain));
+}
+
+/** @internal @This drops the cached PMT section of a program, so that it is
+ * regenerated on the next input.
+ *
+ * @param upipe_ts_psig_program private context of the program
+ */
+static void upipe_ts_psig_program_invalidate(
+        struct upipe_ts_psig_program *upipe_ts_psig_program)
+{
+    if (upipe_ts_psig_program->pmt != NULL) {
+        ubuf_free(upipe_ts_psig_program->pmt);
+        upipe_ts_psig_program->pmt = NULL;
+    }
+}
+
 /** @internal @This is the private context of an elementary stream of a
  * ts_psig pipe. */
 struct upipe_ts_psig_flow {
@@ -255,6 +287,7 @@ static int upipe_ts_psig_flow_set_flow_def(struct upipe *upipe,
             upipe_ts_psig_program_from_flow_mgr(upipe->mgr);
         upipe_ts_psig_program->pmt_version++;
         upipe_ts_psig_program->pmt_version &= 0x1f;
+        upipe_ts_psig_program_invalidate(upipe_ts_psig_program);
     } else
         free(descriptors);
     return UBASE_ERR_NONE;
@@ -303,6 +336,7 @@ static void upipe_ts_psig_flow_free(struct upipe *upipe)
     upipe_ts_psig_flow_clean_sub(upipe);
     upipe_ts_psig_program->pmt_version++;
     upipe_ts_psig_program->pmt_version &= 0x1f;
+    upipe_ts_psig_program_invalidate(upipe_ts_psig_program);
     upipe_ts_psig_flow_clean_urefcount(upipe);
     upipe_ts_psig_flow_free_void(upipe);
 }
@@ -355,30 +389,24 @@ static struct upipe *upipe_ts_psig_program_alloc(struct upipe_mgr *mgr,
     upipe_ts_psig_program->pcr_pid = 8191;
     upipe_ts_psig_program->descriptors = NULL;
     upipe_ts_psig_program->descriptors_size = 0;
+    upipe_ts_psig_program->pmt = NULL;
     upipe_ts_psig_program_init_sub(upipe);
 
     upipe_throw_ready(upipe);
     return upipe;
 }
 
-/** @internal @This generates a PMT PSI section, using the uref received.
+/** @internal @This builds the PMT PSI section of a program.
  *
  * @param upipe description structure of the pipe
- * @param uref uref structure
- * @param upump_p reference to pump that generated the buffer
+ * @return pointer to the section, or NULL in case of allocation error
  */
-static void upipe_ts_psig_program_input(struct upipe *upipe, struct uref *uref,
-                                        struct upump **upump_p)
+static struct ubuf *upipe_ts_psig_program_build(struct upipe *upipe)
 {
     struct upipe_ts_psig_program *upipe_ts_psig_program =
         upipe_ts_psig_program_from_upipe(upipe);
     struct upipe_ts_psig *upipe_ts_psig =
         upipe_ts_psig_from_program_mgr(upipe->mgr);
-    if (unlikely(upipe_ts_psig->flow_def == NULL)) {
-        uref_free(uref);
-        return;
-    }
-    uref_block_delete_start(uref);
 
     upipe_notice_va(upipe,
                     "new PMT program=%"PRIu16" version=%"PRIu8" pcrpid=%"PRIu16,
@@ -388,19 +416,14 @@ static void upipe_ts_psig_program_input(struct upipe *upipe, struct uref *uref,
 
     struct ubuf *ubuf = ubuf_block_alloc(upipe_ts_psig->ubuf_mgr,
                                          PSI_MAX_SIZE + PSI_HEADER_SIZE);
-    if (unlikely(ubuf == NULL)) {
-        uref_free(uref);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
-    }
+    if (unlikely(ubuf == NULL))
+        return NULL;
 
     uint8_t *buffer;
     int size = -1;
     if (!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer))) {
         ubuf_free(ubuf);
-        uref_free(uref);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
+        return NULL;
     }
 
     pmt_init(buffer);
@@ -460,16 +483,54 @@ static void upipe_ts_psig_program_input(struct upipe *upipe, struct uref *uref,
     uint8_t *es = pmt_get_es(buffer, j);
     pmt_set_length(buffer, es - buffer - PMT_HEADER_SIZE);
     uint16_t pmt_size = psi_get_length(buffer) + PSI_HEADER_SIZE;
-    psi_set_crc(buffer);
+    upipe_ts_psi_crc_set(buffer);
     ubuf_block_unmap(ubuf, 0);
 
     ubuf_block_resize(ubuf, 0, pmt_size);
+
+    upipe_notice(upipe, "end PMT");
+    return ubuf;
+}
+
+/** @internal @This outputs the PMT PSI section, using the uref received.
+ * The section is only rebuilt if the program changed since the last time.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_psig_program_input(struct upipe *upipe, struct uref *uref,
+                                        struct upump **upump_p)
+{
+    struct upipe_ts_psig_program *upipe_ts_psig_program =
+        upipe_ts_psig_program_from_upipe(upipe);
+    struct upipe_ts_psig *upipe_ts_psig =
+        upipe_ts_psig_from_program_mgr(upipe->mgr);
+    if (unlikely(upipe_ts_psig->flow_def == NULL)) {
+        uref_free(uref);
+        return;
+    }
+    uref_block_delete_start(uref);
+
+    if (upipe_ts_psig_program->pmt == NULL &&
+        (upipe_ts_psig_program->pmt =
+             upipe_ts_psig_program_build(upipe)) == NULL) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    struct ubuf *ubuf = ubuf_dup(upipe_ts_psig_program->pmt);
+    if (unlikely(ubuf == NULL)) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
     uref_attach_ubuf(uref, ubuf);
     uref_block_set_start(uref);
     uref_block_set_end(uref);
     upipe_ts_psig_program_output(upipe, uref, upump_p);
-
-    upipe_notice(upipe, "end PMT");
 }
 
 /** @internal @This sets the input flow definition.
@@ -522,6 +583,8 @@ static int upipe_ts_psig_program_set_flow_def(struct upipe *upipe,
             upipe_ts_psig_from_program_mgr(upipe->mgr);
         upipe_ts_psig->pat_version++;
         upipe_ts_psig->pat_version &= 0x1f;
+        upipe_ts_psig_invalidate(upipe_ts_psig);
+        upipe_ts_psig_program_invalidate(upipe_ts_psig_program);
     } else
         free(descriptors);
     return UBASE_ERR_NONE;
@@ -554,6 +617,8 @@ static int _upipe_ts_psig_program_set_pcr_pid(struct upipe *upipe,
 {
     struct upipe_ts_psig_program *upipe_ts_psig_program =
         upipe_ts_psig_program_from_upipe(upipe);
+    if (pcr_pid != upipe_ts_psig_program->pcr_pid)
+        upipe_ts_psig_program_invalidate(upipe_ts_psig_program);
     upipe_ts_psig_program->pcr_pid = pcr_pid;
     return UBASE_ERR_NONE;
 }
@@ -588,6 +653,7 @@ static int upipe_ts_psig_program_set_version(struct upipe *upipe,
     upipe_dbg_va(upipe, "setting version to %u\n", version);
     upipe_ts_psig_program->pmt_version = version;
     upipe_ts_psig_program->pmt_version &= 0x1f;
+    upipe_ts_psig_program_invalidate(upipe_ts_psig_program);
     return UBASE_ERR_NONE;
 }
 
@@ -687,8 +753,10 @@ static void upipe_ts_psig_program_free(struct upipe *upipe)
     upipe_ts_psig_program_clean_sub(upipe);
     upipe_ts_psig_program_clean_output(upipe);
     free(upipe_ts_psig_program->descriptors);
+    upipe_ts_psig_program_invalidate(upipe_ts_psig_program);
     upipe_ts_psig->pat_version++;
     upipe_ts_psig->pat_version &= 0x1f;
+    upipe_ts_psig_invalidate(upipe_ts_psig);
     upipe_ts_psig_program_clean_urefcount(upipe);
     upipe_ts_psig_program_free_void(upipe);
 }
@@ -733,33 +801,26 @@ static struct upipe *upipe_ts_psig_alloc(struct upipe_mgr *mgr,
     upipe_ts_psig_init_sub_programs(upipe);
     upipe_ts_psig->tsid = 0;
     upipe_ts_psig->pat_version = 0;
+    ulist_init(&upipe_ts_psig->pat_sections);
 
     upipe_throw_ready(upipe);
     return upipe;
 }
 
-/** @internal @This generates a PAT PSI section, using the uref received.
+/** @internal @This builds the PAT PSI sections, and stores them in the
+ * cache.
  *
  * @param upipe description structure of the pipe
- * @param uref uref structure
- * @param upump_p reference to pump that generated the buffer
+ * @return an error code
  */
-static void upipe_ts_psig_input(struct upipe *upipe, struct uref *uref,
-                                struct upump **upump_p)
+static int upipe_ts_psig_build(struct upipe *upipe)
 {
     struct upipe_ts_psig *upipe_ts_psig = upipe_ts_psig_from_upipe(upipe);
-    if (unlikely(upipe_ts_psig->flow_def == NULL)) {
-        uref_free(uref);
-        return;
-    }
-    uref_block_delete_start(uref);
-
     upipe_notice_va(upipe, "new PAT tsid=%"PRIu16" version=%"PRIu8,
                     upipe_ts_psig->tsid, upipe_ts_psig->pat_version);
 
     unsigned int nb_sections = 0;
-    struct uchain sections;
-    ulist_init(&sections);
+    struct uchain *sections = &upipe_ts_psig->pat_sections;
     struct uchain *program_chain = &upipe_ts_psig->programs;
 
     do {
@@ -772,18 +833,16 @@ static void upipe_ts_psig_input(struct upipe *upipe, struct uref *uref,
         struct ubuf *ubuf = ubuf_block_alloc(upipe_ts_psig->ubuf_mgr,
                                              PSI_MAX_SIZE + PSI_HEADER_SIZE);
         if (unlikely(ubuf == NULL)) {
-            uref_free(uref);
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            return;
+            upipe_ts_psig_invalidate(upipe_ts_psig);
+            return UBASE_ERR_ALLOC;
         }
 
         uint8_t *buffer;
         int size = -1;
         if (!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer))) {
             ubuf_free(ubuf);
-            uref_free(uref);
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            return;
+            upipe_ts_psig_invalidate(upipe_ts_psig);
+            return UBASE_ERR_ALLOC;
         }
 
         pat_init(buffer);
@@ -820,31 +879,66 @@ static void upipe_ts_psig_input(struct upipe *upipe, struct uref *uref,
         ubuf_block_unmap(ubuf, 0);
 
         ubuf_block_resize(ubuf, 0, pat_size);
-        ulist_add(&sections, ubuf_to_uchain(ubuf));
+        ulist_add(sections, ubuf_to_uchain(ubuf));
         nb_sections++;
     } while (!ulist_is_last(&upipe_ts_psig->programs, program_chain));
 
     upipe_notice_va(upipe, "end PAT (%u sections)", nb_sections);
 
     struct uchain *section_chain;
-    while ((section_chain = ulist_pop(&sections)) != NULL) {
-        bool last = ulist_empty(&sections);
+    ulist_foreach (sections, section_chain) {
         struct ubuf *ubuf = ubuf_from_uchain(section_chain);
         uint8_t *buffer;
         int size = -1;
         if (!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer))) {
+            upipe_ts_psig_invalidate(upipe_ts_psig);
+            return UBASE_ERR_ALLOC;
+        }
+
+        psi_set_lastsection(buffer, nb_sections - 1);
+        upipe_ts_psi_crc_set(buffer);
+        ubuf_block_unmap(ubuf, 0);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This outputs the PAT PSI sections, using the uref received.
+ * The sections are only rebuilt if the list of programs changed since the
+ * last time.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_psig_input(struct upipe *upipe, struct uref *uref,
+                                struct upump **upump_p)
+{
+    struct upipe_ts_psig *upipe_ts_psig = upipe_ts_psig_from_upipe(upipe);
+    if (unlikely(upipe_ts_psig->flow_def == NULL)) {
+        uref_free(uref);
+        return;
+    }
+    uref_block_delete_start(uref);
+
+    if (ulist_empty(&upipe_ts_psig->pat_sections) &&
+        !ubase_check(upipe_ts_psig_build(upipe))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    struct uchain *section_chain;
+    ulist_foreach (&upipe_ts_psig->pat_sections, section_chain) {
+        bool last = ulist_is_last(&upipe_ts_psig->pat_sections,
+                                  section_chain);
+        struct ubuf *ubuf = ubuf_dup(ubuf_from_uchain(section_chain));
+        if (unlikely(ubuf == NULL)) {
             if (last)
                 uref_free(uref);
-            ubuf_free(ubuf);
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             continue;
         }
 
-        psi_set_lastsection(buffer, nb_sections - 1);
-        psi_set_crc(buffer);
-
-        ubuf_block_unmap(ubuf, 0);
-
         struct uref *output;
         if (last)
             output = uref;
@@ -902,6 +996,8 @@ static int upipe_ts_psig_set_flow_def(struct upipe *upipe,
     upipe_ts_psig_demand_ubuf_mgr(upipe, flow_def_dup);
 
     struct upipe_ts_psig *upipe_ts_psig = upipe_ts_psig_from_upipe(upipe);
+    if (tsid != upipe_ts_psig->tsid)
+        upipe_ts_psig_invalidate(upipe_ts_psig);
     upipe_ts_psig->tsid = tsid;
     return UBASE_ERR_NONE;
 }
@@ -934,6 +1030,7 @@ static int upipe_ts_psig_set_version(struct upipe *upipe,
     upipe_dbg_va(upipe, "setting version to %u\n", version);
     upipe_ts_psig->pat_version = version;
     upipe_ts_psig->pat_version &= 0x1f;
+    upipe_ts_psig_invalidate(upipe_ts_psig);
     return UBASE_ERR_NONE;
 }
 
@@ -1002,7 +1099,9 @@ static int upipe_ts_psig_control(struct upipe *upipe, int command, va_list args)
  */
 static void upipe_ts_psig_free(struct upipe *upipe)
 {
+    struct upipe_ts_psig *upipe_ts_psig = upipe_ts_psig_from_upipe(upipe);
     upipe_throw_dead(upipe);
+    upipe_ts_psig_invalidate(upipe_ts_psig);
     upipe_ts_psig_clean_sub_programs(upipe);
     upipe_ts_psig_clean_output(upipe);
     upipe_ts_psig_clean_ubuf_mgr(upipe);
@@ -47,6 +47,8 @@
 #include <string.h>
 #include <assert.h>
 
+#include <bitstream/mpeg/ts.h>
+
 /** default interval for PSI tables */
 #define DEFAULT_INTERVAL (UCLOCK_FREQ / 10)
 /** default delay for PSI tables */
@@ -83,10 +85,8 @@ struct upipe_ts_psii {
     /** list of output requests */
     struct uchain request_list;
 
-    /** manager of the pseudo inner sink */
+    /** manager of the pseudo inner sinks of the subpipes */
     struct upipe_mgr inner_sink_mgr;
-    /** pseudo inner sink to get urefs from ts_encaps */
-    struct upipe inner_sink;
 
     /** list of input subpipes */
     struct uchain subs;
@@ -103,8 +103,6 @@ UPIPE_HELPER_UREFCOUNT(upipe_ts_psii, urefcount, upipe_ts_psii_free)
 UPIPE_HELPER_VOID(upipe_ts_psii)
 UPIPE_HELPER_OUTPUT(upipe_ts_psii, output, flow_def, output_state, request_list)
 
-UBASE_FROM_TO(upipe_ts_psii, upipe, inner_sink, inner_sink)
-
 /** @internal @This is the private context of a program of a ts_psii pipe. */
 struct upipe_ts_psii_sub {
     /** real refcount management structure */
@@ -124,10 +122,23 @@ struct upipe_ts_psii_sub {
     /** date (in system time) of the next table occurrence */
     uint64_t next_cr_sys;
 
+    /** TS packets of the latest table, as output by ts_encaps */
+    struct uchain packets;
+    /** true if the latest table was given to ts_encaps */
+    bool packetized;
+    /** date (in system time) of the occurrence that was packetized */
+    uint64_t packets_cr_sys;
+    /** cr_dts_delay of the occurrence that was packetized */
+    uint64_t packets_delay;
+    /** last continuity counter */
+    uint8_t last_cc;
+
     /** proxy probe */
     struct uprobe probe;
     /** pointer to ts_encaps pipe */
     struct upipe *encaps;
+    /** pseudo inner sink to get TS packets from ts_encaps */
+    struct upipe inner_sink;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -138,6 +149,7 @@ UPIPE_HELPER_UREFCOUNT(upipe_ts_psii_sub, urefcount, upipe_ts_psii_sub_no_input)
 UPIPE_HELPER_VOID(upipe_ts_psii_sub)
 
 UBASE_FROM_TO(upipe_ts_psii_sub, urefcount, urefcount_real, urefcount_real)
+UBASE_FROM_TO(upipe_ts_psii_sub, upipe, inner_sink, inner_sink)
 
 UPIPE_HELPER_SUBPIPE(upipe_ts_psii, upipe_ts_psii_sub, sub, sub_mgr,
                      subs, uchain)
@@ -190,18 +202,28 @@ static struct upipe *upipe_ts_psii_sub_alloc(struct upipe_mgr *mgr,
     upipe_ts_psii_sub->interval = DEFAULT_INTERVAL;
     ulist_init(&upipe_ts_psii_sub->table);
     upipe_ts_psii_sub->next_cr_sys = UINT64_MAX;
-    ulist_init(&upipe_ts_psii_sub->table);
     upipe_ts_psii_sub->complete = true;
+    ulist_init(&upipe_ts_psii_sub->packets);
+    upipe_ts_psii_sub->packetized = false;
+    upipe_ts_psii_sub->packets_cr_sys = 0;
+    upipe_ts_psii_sub->packets_delay = 0;
+    upipe_ts_psii_sub->last_cc = 0xf;
     upipe_ts_psii_sub->encaps = NULL;
 
     uprobe_init(&upipe_ts_psii_sub->probe, upipe_ts_psii_sub_probe, NULL);
     upipe_ts_psii_sub->probe.refcount =
         upipe_ts_psii_sub_to_urefcount_real(upipe_ts_psii_sub);
 
-    upipe_throw_ready(upipe);
-
     struct upipe_ts_psii *upipe_ts_psii =
         upipe_ts_psii_from_sub_mgr(upipe->mgr);
+    struct upipe *sink = &upipe_ts_psii_sub->inner_sink;
+    sink->refcount = upipe_ts_psii_sub_to_urefcount_real(upipe_ts_psii_sub);
+    upipe_init(sink, &upipe_ts_psii->inner_sink_mgr,
+               uprobe_pfx_alloc(uprobe_use(upipe->uprobe), UPROBE_LOG_VERBOSE,
+                                "inner sink"));
+
+    upipe_throw_ready(upipe);
+
     struct upipe_ts_psii_mgr *ts_psii_mgr =
         upipe_ts_psii_mgr_from_upipe_mgr(upipe_ts_psii_to_upipe(upipe_ts_psii)->mgr);
 
@@ -213,12 +235,28 @@ static struct upipe *upipe_ts_psii_sub_alloc(struct upipe_mgr *mgr,
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return upipe;
     }
-    if (likely(upipe_ts_psii->output != NULL))
-        upipe_set_output(upipe_ts_psii_sub->encaps, &upipe_ts_psii->inner_sink);
+    upipe_set_output(upipe_ts_psii_sub->encaps, sink);
 
     return upipe;
 }
 
+/** @internal @This purges the TS packets of the current table.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_psii_sub_flush(struct upipe *upipe)
+{
+    struct upipe_ts_psii_sub *upipe_ts_psii_sub =
+        upipe_ts_psii_sub_from_upipe(upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_ts_psii_sub->packets, uchain, uchain_tmp) {
+        struct uref *uref = uref_from_uchain(uchain);
+        ulist_delete(uchain);
+        uref_free(uref);
+    }
+    upipe_ts_psii_sub->packetized = false;
+}
+
 /** @internal @This purges the current table.
  *
  * @param upipe description structure of the pipe
@@ -233,6 +271,7 @@ static void upipe_ts_psii_sub_clean(struct upipe *upipe)
         ulist_delete(uchain);
         uref_free(uref);
     }
+    upipe_ts_psii_sub_flush(upipe);
 }
 /** @internal @This receives data.
  *
@@ -257,15 +296,102 @@ static void upipe_ts_psii_sub_input(struct upipe *upipe, struct uref *uref,
         else
             /* Trigger immediate insertion. */
             upipe_ts_psii_sub->next_cr_sys = 0;
-    } else
+    } else {
         upipe_warn(upipe, "large table");
+        /* the table must be packetized again */
+        upipe_ts_psii_sub_flush(upipe);
+    }
 
     ulist_add(&upipe_ts_psii_sub->table, uref_to_uchain(uref));
     if (ubase_check(uref_block_get_end(uref)))
         upipe_ts_psii_sub->complete = true;
 }
 
-/** @internal @This outputs a PSI table.
+/** @internal @This gives the latest table to ts_encaps, which outputs its
+ * TS packets to the inner sink, where they are kept for all occurrences of
+ * this table version.
+ *
+ * @param upipe description structure of the pipe
+ * @param cr_sys date of the occurrence
+ * @param delay cr_dts_delay of the occurrence
+ */
+static void upipe_ts_psii_sub_packetize(struct upipe *upipe, uint64_t cr_sys,
+                                        uint64_t delay)
+{
+    struct upipe_ts_psii_sub *upipe_ts_psii_sub =
+        upipe_ts_psii_sub_from_upipe(upipe);
+    upipe_ts_psii_sub->packetized = true;
+    upipe_ts_psii_sub->packets_cr_sys = cr_sys;
+    upipe_ts_psii_sub->packets_delay = delay;
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_psii_sub->table, uchain) {
+        struct uref *uref = uref_from_uchain(uchain);
+        struct uref *output = uref_dup(uref);
+        if (unlikely(output == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+
+        uref_clock_set_cr_sys(output, cr_sys);
+        uref_clock_set_cr_dts_delay(output, delay);
+        upipe_input(upipe_ts_psii_sub->encaps, output, NULL);
+    }
+}
+
+/** @internal @This returns a new reference to a TS packet of the latest
+ * table, with the next continuity counter. The header is patched in place
+ * if the previous occurrence was already released, otherwise only the
+ * 4-octet header is copied, and the rest of the packet is shared.
+ *
+ * @param upipe description structure of the pipe
+ * @param packet TS packet of the latest table
+ * @return pointer to the new uref, or NULL in case of allocation error
+ */
+static struct uref *upipe_ts_psii_sub_dup_packet(struct upipe *upipe,
+                                                 struct uref *packet)
+{
+    struct upipe_ts_psii_sub *upipe_ts_psii_sub =
+        upipe_ts_psii_sub_from_upipe(upipe);
+    upipe_ts_psii_sub->last_cc = (upipe_ts_psii_sub->last_cc + 1) & 0xf;
+
+    uint8_t *buffer;
+    int size = TS_HEADER_SIZE;
+    if (likely(ubase_check(uref_block_write(packet, 0, &size, &buffer)))) {
+        ts_set_cc(buffer, upipe_ts_psii_sub->last_cc);
+        uref_block_unmap(packet, 0);
+        return uref_dup(packet);
+    }
+
+    struct ubuf *header = ubuf_block_copy(packet->ubuf->mgr, packet->ubuf,
+                                          0, TS_HEADER_SIZE);
+    struct uref *output = uref_dup(packet);
+    size = TS_HEADER_SIZE;
+    if (unlikely(header == NULL || output == NULL ||
+                 !ubase_check(ubuf_block_write(header, 0, &size,
+                                               &buffer)))) {
+        if (header != NULL)
+            ubuf_free(header);
+        if (output != NULL)
+            uref_free(output);
+        return NULL;
+    }
+    ts_set_cc(buffer, upipe_ts_psii_sub->last_cc);
+    ubuf_block_unmap(header, 0);
+
+    if (unlikely(!ubase_check(uref_block_resize(output, TS_HEADER_SIZE,
+                                                -1)) ||
+                 !ubase_check(uref_block_insert(output, 0, header)))) {
+        ubuf_free(header);
+        uref_free(output);
+        return NULL;
+    }
+    return output;
+}
+
+/** @internal @This outputs a PSI table. The table is only packetized once
+ * per version, and its TS packets are then output by reference, with
+ * shifted dates and patched continuity counters.
  *
  * @param upipe description structure of the pipe
  * @param next_uref next uref to mux
@@ -275,30 +401,41 @@ static void upipe_ts_psii_sub_output(struct upipe *upipe,
 {
     struct upipe_ts_psii_sub *upipe_ts_psii_sub =
         upipe_ts_psii_sub_from_upipe(upipe);
+    struct upipe_ts_psii *upipe_ts_psii =
+        upipe_ts_psii_from_sub_mgr(upipe->mgr);
 
     uint64_t cr_sys = upipe_ts_psii_sub->next_cr_sys;
     uint64_t delay = 0;
     uref_clock_get_cr_dts_delay(next_uref, &delay);
+    /* FIXME */
+    if (delay < DEFAULT_DELAY)
+        delay = DEFAULT_DELAY;
 
     if (unlikely(!cr_sys))
         uref_clock_get_cr_sys(next_uref, &cr_sys);
 
     upipe_ts_psii_sub->next_cr_sys = cr_sys + upipe_ts_psii_sub->interval;
 
+    if (!upipe_ts_psii_sub->packetized)
+        upipe_ts_psii_sub_packetize(upipe, cr_sys, delay);
+
+    int64_t shift = cr_sys - upipe_ts_psii_sub->packets_cr_sys;
+    int64_t delay_shift = delay - upipe_ts_psii_sub->packets_delay;
     struct uchain *uchain;
-    ulist_foreach (&upipe_ts_psii_sub->table, uchain) {
-        struct uref *uref = uref_from_uchain(uchain);
-        struct uref *output = uref_dup(uref);
+    ulist_foreach (&upipe_ts_psii_sub->packets, uchain) {
+        struct uref *packet = uref_from_uchain(uchain);
+        struct uref *output = upipe_ts_psii_sub_dup_packet(upipe, packet);
         if (unlikely(output == NULL)) {
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             return;
         }
 
-        uref_clock_set_cr_sys(output, cr_sys);
-        /* FIXME */
-        uref_clock_set_cr_dts_delay(output,
-                delay > DEFAULT_DELAY ? delay : DEFAULT_DELAY);
-        upipe_input(upipe_ts_psii_sub->encaps, output, NULL);
+        uref_clock_add_dates(output, shift);
+        uint64_t packet_delay;
+        if (ubase_check(uref_clock_get_cr_dts_delay(output, &packet_delay)))
+            uref_clock_set_cr_dts_delay(output, packet_delay + delay_shift);
+        upipe_ts_psii_output(upipe_ts_psii_to_upipe(upipe_ts_psii), output,
+                             NULL);
     }
 }
 
@@ -417,6 +554,7 @@ static void upipe_ts_psii_sub_free(struct urefcount *urefcount_real)
 
     upipe_throw_dead(upipe);
 
+    upipe_clean(&upipe_ts_psii_sub->inner_sink);
     uprobe_clean(&upipe_ts_psii_sub->probe);
     urefcount_clean(urefcount_real);
     upipe_ts_psii_sub_clean_urefcount(upipe);
@@ -455,7 +593,8 @@ static void upipe_ts_psii_init_sub_mgr(struct upipe *upipe)
     sub_mgr->upipe_mgr_control = NULL;
 }
 
-/** @internal @This receives data.
+/** @internal @This receives TS packets from ts_encaps, and keeps them
+ * for the following occurrences of the table.
  *
  * @param sink description structure of the pipe
  * @param uref uref structure
@@ -465,9 +604,14 @@ static void upipe_ts_psii_inner_sink_input(struct upipe *sink,
                                            struct uref *uref,
                                            struct upump **upump_p)
 {
-    struct upipe_ts_psii *upipe_ts_psii = upipe_ts_psii_from_inner_sink(sink);
-    struct upipe *upipe = upipe_ts_psii_to_upipe(upipe_ts_psii);
-    upipe_ts_psii_output(upipe, uref, upump_p);
+    struct upipe_ts_psii_sub *upipe_ts_psii_sub =
+        upipe_ts_psii_sub_from_inner_sink(sink);
+    if (unlikely(!upipe_ts_psii_sub->packetized)) {
+        /* table changed while ts_encaps was waiting for a ubuf manager */
+        uref_free(uref);
+        return;
+    }
+    ulist_add(&upipe_ts_psii_sub->packets, uref_to_uchain(uref));
 }
 
 /** @internal @This processes control commands.
@@ -480,7 +624,10 @@ static void upipe_ts_psii_inner_sink_input(struct upipe *sink,
 static int upipe_ts_psii_inner_sink_control(struct upipe *sink,
                                             int command, va_list args)
 {
-    struct upipe_ts_psii *upipe_ts_psii = upipe_ts_psii_from_inner_sink(sink);
+    struct upipe_ts_psii_sub *upipe_ts_psii_sub =
+        upipe_ts_psii_sub_from_inner_sink(sink);
+    struct upipe_ts_psii *upipe_ts_psii =
+        upipe_ts_psii_from_sub_mgr(upipe_ts_psii_sub->upipe.mgr);
     struct upipe *upipe = upipe_ts_psii_to_upipe(upipe_ts_psii);
     switch (command) {
         case UPIPE_REGISTER_REQUEST: {
@@ -499,11 +646,11 @@ static int upipe_ts_psii_inner_sink_control(struct upipe *sink,
     }
 }
 
-/** @internal @This initializes the inner pseudo sink pipe.
+/** @internal @This initializes the manager of the inner pseudo sinks.
  *
  * @param upipe description structure of the pipe
  */
-static void upipe_ts_psii_init_inner_sink(struct upipe *upipe)
+static void upipe_ts_psii_init_inner_sink_mgr(struct upipe *upipe)
 {
     struct upipe_ts_psii *upipe_ts_psii = upipe_ts_psii_from_upipe(upipe);
     struct upipe_mgr *inner_sink_mgr = &upipe_ts_psii->inner_sink_mgr;
@@ -513,23 +660,6 @@ static void upipe_ts_psii_init_inner_sink(struct upipe *upipe)
     inner_sink_mgr->upipe_input = upipe_ts_psii_inner_sink_input;
     inner_sink_mgr->upipe_control = upipe_ts_psii_inner_sink_control;
     inner_sink_mgr->upipe_mgr_control = NULL;
-
-    struct upipe *sink = &upipe_ts_psii->inner_sink;
-    sink->refcount = upipe_ts_psii_to_urefcount(upipe_ts_psii);
-    upipe_init(sink, inner_sink_mgr,
-               uprobe_pfx_alloc(uprobe_use(upipe->uprobe), UPROBE_LOG_VERBOSE,
-                                "inner sink"));
-}
-
-/** @internal @This cleans up the inner pseudo sink pipe.
- *
- * @param upipe description structure of the pipe
- */
-static void upipe_ts_psii_clean_inner_sink(struct upipe *upipe)
-{
-    struct upipe_ts_psii *upipe_ts_psii = upipe_ts_psii_from_upipe(upipe);
-    struct upipe *sink = &upipe_ts_psii->inner_sink;
-    upipe_clean(sink);
 }
 
 /** @internal @This allocates a ts_psii pipe.
@@ -551,7 +681,7 @@ static struct upipe *upipe_ts_psii_alloc(struct upipe_mgr *mgr,
 
     upipe_ts_psii_init_urefcount(upipe);
     upipe_ts_psii_init_output(upipe);
-    upipe_ts_psii_init_inner_sink(upipe);
+    upipe_ts_psii_init_inner_sink_mgr(upipe);
     upipe_ts_psii_init_sub_mgr(upipe);
     upipe_ts_psii_init_sub_subs(upipe);
 
@@ -616,26 +746,6 @@ static int upipe_ts_psii_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This sets the output on a pipe.
- *
- * @param upipe description structure of the pipe
- * @param output new output
- * @return an error code
- */
-static int _upipe_ts_psii_set_output(struct upipe *upipe, struct upipe *output)
-{
-    UBASE_RETURN(upipe_ts_psii_set_output(upipe, output));
-
-    struct upipe_ts_psii *upipe_ts_psii = upipe_ts_psii_from_upipe(upipe);
-    struct uchain *uchain;
-    ulist_foreach (&upipe_ts_psii->subs, uchain) {
-        struct upipe_ts_psii_sub *sub = upipe_ts_psii_sub_from_uchain(uchain);
-        if (likely(sub->encaps != NULL))
-            upipe_set_output(sub->encaps, output);
-    }
-    return UBASE_ERR_NONE;
-}
-
 /** @internal @This processes control commands.
  *
  * @param upipe description structure of the pipe
@@ -669,7 +779,7 @@ static int upipe_ts_psii_control(struct upipe *upipe,
         }
         case UPIPE_SET_OUTPUT: {
             struct upipe *output = va_arg(args, struct upipe *);
-            return _upipe_ts_psii_set_output(upipe, output);
+            return upipe_ts_psii_set_output(upipe, output);
         }
         case UPIPE_GET_SUB_MGR: {
             struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
@@ -693,7 +803,6 @@ static void upipe_ts_psii_free(struct upipe *upipe)
 {
     upipe_throw_dead(upipe);
     upipe_ts_psii_clean_sub_subs(upipe);
-    upipe_ts_psii_clean_inner_sink(upipe);
     upipe_ts_psii_clean_output(upipe);
     upipe_ts_psii_clean_urefcount(upipe);
     upipe_ts_psii_free_void(upipe);
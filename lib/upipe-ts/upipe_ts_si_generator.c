@@ -0,0 +1,1331 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module generating DVB SI tables (NIT, SDT, EIT p/f)
+ * Normative references:
+ *  - ETSI EN 300 468 V1.13.1 (2012-08) (SI in DVB systems)
+ *  - ETSI TR 101 211 V1.9.1 (2009-06) (Guidelines of SI in DVB systems)
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_program_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_flow.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe-ts/upipe_ts_si_generator.h>
+#include <upipe-ts/uref_ts_flow.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
+#include <bitstream/dvb/si.h>
+
+#include "upipe_ts_psi_crc.h"
+
+/** default network ID (temporary private use, ETSI TS 101 162) */
+#define DEFAULT_NID 0xff01
+/** default service type (digital television service) */
+#define DEFAULT_SERVICE_TYPE 0x1
+/** max number of events of a service (present and following) */
+#define MAX_EVENTS 2
+/** max size of the payload of a descriptor */
+#define MAX_DESC_SIZE 255
+/** MJD of the Epoch (1970-01-01) */
+#define MJD_EPOCH 40587
+/** running status of the present event (running) */
+#define RUNNING_PRESENT 4
+/** running status of the following event (not running) */
+#define RUNNING_FOLLOWING 1
+/** ISO 639 language code of the event names (undetermined) */
+#define EVENT_LANGUAGE "und"
+
+/** @internal @This lists the tables generated by ts_sig. */
+enum upipe_ts_sig_table {
+    /** network information table (actual network) */
+    UPIPE_TS_SIG_NIT,
+    /** service description table (actual transport stream) */
+    UPIPE_TS_SIG_SDT,
+    /** present/following event information table (actual transport
+     * stream) */
+    UPIPE_TS_SIG_EIT,
+    /** number of tables */
+    UPIPE_TS_SIG_TABLES
+};
+
+/** @internal @This is the private context of a ts_sig pipe. */
+struct upipe_ts_sig {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** input flow definition, or NULL if not configured */
+    struct uref *flow_def;
+    /** TS ID */
+    uint16_t tsid;
+    /** network ID */
+    uint16_t nid;
+    /** original network ID */
+    uint16_t onid;
+    /** network name, or NULL */
+    char *network_name;
+    /** NIT version */
+    uint8_t nit_version;
+    /** SDT version */
+    uint8_t sdt_version;
+    /** cached sections of each table, empty if it must be regenerated */
+    struct uchain sections[UPIPE_TS_SIG_TABLES];
+
+    /** list of service subpipes */
+    struct uchain services;
+    /** manager to create service subpipes */
+    struct upipe_mgr service_mgr;
+
+    /** list of output subpipes */
+    struct uchain outputs;
+    /** manager to create output subpipes */
+    struct upipe_mgr output_mgr;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_sig, upipe, UPIPE_TS_SIG_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_sig, urefcount, upipe_ts_sig_free)
+UPIPE_HELPER_VOID(upipe_ts_sig)
+UPIPE_HELPER_UBUF_MGR(upipe_ts_sig, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      NULL, upipe_throw_provide_request, NULL)
+
+UBASE_FROM_TO(upipe_ts_sig, upipe_mgr, output_mgr, output_mgr)
+
+/** @internal @This describes an event of a service. */
+struct upipe_ts_sig_event {
+    /** event ID */
+    uint16_t event_id;
+    /** start time, in seconds since the Epoch (UTC) */
+    uint64_t start;
+    /** duration, in seconds */
+    uint64_t duration;
+    /** event name, or NULL */
+    char *name;
+};
+
+/** @internal @This is the private context of a service of a ts_sig pipe. */
+struct upipe_ts_sig_service {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** service ID, or 0 if not configured */
+    uint16_t sid;
+    /** service type */
+    uint8_t service_type;
+    /** service name, or NULL */
+    char *name;
+    /** service provider name, or NULL */
+    char *provider_name;
+    /** number of events */
+    uint8_t nb_events;
+    /** present and following events */
+    struct upipe_ts_sig_event events[MAX_EVENTS];
+    /** EIT version */
+    uint8_t eit_version;
+    /** cached EIT sections, empty if they must be regenerated */
+    struct uchain eit_sections;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_sig_service, upipe, UPIPE_TS_SIG_SERVICE_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_sig_service, urefcount,
+                       upipe_ts_sig_service_free)
+UPIPE_HELPER_VOID(upipe_ts_sig_service)
+
+UPIPE_HELPER_SUBPIPE(upipe_ts_sig, upipe_ts_sig_service, service, service_mgr,
+                     services, uchain)
+
+/** @internal @This is the private context of an output of a ts_sig pipe. */
+struct upipe_ts_sig_output {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** table carried by the output */
+    enum upipe_ts_sig_table table;
+    /** true if the table changed since it was last output */
+    bool dirty;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_sig_output, upipe, UPIPE_TS_SIG_OUTPUT_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_sig_output, urefcount,
+                       upipe_ts_sig_output_free)
+UPIPE_HELPER_FLOW(upipe_ts_sig_output, "void.")
+UPIPE_HELPER_OUTPUT(upipe_ts_sig_output, output, flow_def, output_state,
+                    request_list)
+
+UBASE_FROM_TO(upipe_ts_sig_output, uchain, uchain, uchain)
+
+/** @internal @This replaces a string if it changed.
+ *
+ * @param string_p pointer to the stored string, or NULL
+ * @param value new string, or NULL
+ * @return true if the string changed
+ */
+static bool upipe_ts_sig_update_string(char **string_p, const char *value)
+{
+    if (*string_p == NULL && value == NULL)
+        return false;
+    if (*string_p != NULL && value != NULL && !strcmp(*string_p, value))
+        return false;
+    free(*string_p);
+    *string_p = value != NULL ? strdup(value) : NULL;
+    return true;
+}
+
+/** @internal @This frees a list of sections.
+ *
+ * @param sections list of sections
+ */
+static void upipe_ts_sig_flush(struct uchain *sections)
+{
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(sections)) != NULL)
+        ubuf_free(ubuf_from_uchain(uchain));
+}
+
+/** @internal @This drops the cached sections of a table, so that it is
+ * regenerated and output again on the next input.
+ *
+ * @param upipe_ts_sig private context of the ts_sig pipe
+ * @param table table to invalidate
+ */
+static void upipe_ts_sig_invalidate(struct upipe_ts_sig *upipe_ts_sig,
+                                    enum upipe_ts_sig_table table)
+{
+    upipe_ts_sig_flush(&upipe_ts_sig->sections[table]);
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_sig->outputs, uchain) {
+        struct upipe_ts_sig_output *output =
+            upipe_ts_sig_output_from_uchain(uchain);
+        if (output->table == table)
+            output->dirty = true;
+    }
+}
+
+/** @internal @This bumps the version of the NIT and drops its sections.
+ *
+ * @param upipe_ts_sig private context of the ts_sig pipe
+ */
+static void upipe_ts_sig_change_nit(struct upipe_ts_sig *upipe_ts_sig)
+{
+    upipe_ts_sig->nit_version++;
+    upipe_ts_sig->nit_version &= 0x1f;
+    upipe_ts_sig_invalidate(upipe_ts_sig, UPIPE_TS_SIG_NIT);
+}
+
+/** @internal @This bumps the version of the SDT and drops its sections.
+ *
+ * @param upipe_ts_sig private context of the ts_sig pipe
+ */
+static void upipe_ts_sig_change_sdt(struct upipe_ts_sig *upipe_ts_sig)
+{
+    upipe_ts_sig->sdt_version++;
+    upipe_ts_sig->sdt_version &= 0x1f;
+    upipe_ts_sig_invalidate(upipe_ts_sig, UPIPE_TS_SIG_SDT);
+}
+
+/** @internal @This allocates a service of a ts_sig pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_sig_service_alloc(struct upipe_mgr *mgr,
+                                                struct uprobe *uprobe,
+                                                uint32_t signature,
+                                                va_list args)
+{
+    struct upipe *upipe = upipe_ts_sig_service_alloc_void(mgr, uprobe,
+                                                          signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_sig_service *upipe_ts_sig_service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    upipe_ts_sig_service_init_urefcount(upipe);
+    upipe_ts_sig_service->sid = 0;
+    upipe_ts_sig_service->service_type = DEFAULT_SERVICE_TYPE;
+    upipe_ts_sig_service->name = NULL;
+    upipe_ts_sig_service->provider_name = NULL;
+    upipe_ts_sig_service->nb_events = 0;
+    for (int i = 0; i < MAX_EVENTS; i++) {
+        upipe_ts_sig_service->events[i].event_id = 0;
+        upipe_ts_sig_service->events[i].start = 0;
+        upipe_ts_sig_service->events[i].duration = 0;
+        upipe_ts_sig_service->events[i].name = NULL;
+    }
+    upipe_ts_sig_service->eit_version = 0;
+    ulist_init(&upipe_ts_sig_service->eit_sections);
+    upipe_ts_sig_service_init_sub(upipe);
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This drops the cached EIT sections of a service, and bumps
+ * their version.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_sig_service_invalidate_eit(struct upipe *upipe)
+{
+    struct upipe_ts_sig_service *upipe_ts_sig_service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    struct upipe_ts_sig *upipe_ts_sig =
+        upipe_ts_sig_from_service_mgr(upipe->mgr);
+    upipe_ts_sig_service->eit_version++;
+    upipe_ts_sig_service->eit_version &= 0x1f;
+    upipe_ts_sig_flush(&upipe_ts_sig_service->eit_sections);
+    upipe_ts_sig_invalidate(upipe_ts_sig, UPIPE_TS_SIG_EIT);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_sig_service_set_flow_def(struct upipe *upipe,
+                                             struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    uint64_t sid;
+    UBASE_RETURN(uref_flow_match_def(flow_def, "void."))
+    UBASE_RETURN(uref_flow_get_id(flow_def, &sid))
+    if (unlikely(!sid || sid > UINT16_MAX))
+        return UBASE_ERR_INVALID;
+
+    uint8_t service_type = DEFAULT_SERVICE_TYPE;
+    uref_ts_flow_get_service_type(flow_def, &service_type);
+    const char *name = NULL, *provider_name = NULL;
+    uref_program_flow_get_name(flow_def, &name);
+    uref_ts_flow_get_provider_name(flow_def, &provider_name);
+
+    uint8_t nb_events = 0;
+    uref_ts_flow_get_events(flow_def, &nb_events);
+    if (nb_events > MAX_EVENTS)
+        nb_events = MAX_EVENTS;
+    struct upipe_ts_sig_event events[MAX_EVENTS];
+    const char *event_names[MAX_EVENTS];
+    for (uint8_t i = 0; i < nb_events; i++) {
+        uint64_t event_id;
+        UBASE_RETURN(uref_ts_flow_get_event_id(flow_def, &event_id, i))
+        UBASE_RETURN(uref_ts_flow_get_event_start(flow_def, &events[i].start,
+                                                  i))
+        events[i].event_id = event_id;
+        events[i].duration = 0;
+        uref_ts_flow_get_event_duration(flow_def, &events[i].duration, i);
+        event_names[i] = NULL;
+        uref_ts_flow_get_event_name(flow_def, &event_names[i], i);
+    }
+
+    struct upipe_ts_sig_service *upipe_ts_sig_service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    struct upipe_ts_sig *upipe_ts_sig =
+        upipe_ts_sig_from_service_mgr(upipe->mgr);
+    bool nit_changed = sid != upipe_ts_sig_service->sid ||
+                       service_type != upipe_ts_sig_service->service_type;
+    bool sdt_changed = nit_changed;
+    bool eit_changed = sid != upipe_ts_sig_service->sid ||
+                       nb_events != upipe_ts_sig_service->nb_events;
+    sdt_changed |= upipe_ts_sig_update_string(&upipe_ts_sig_service->name,
+                                              name);
+    sdt_changed |= upipe_ts_sig_update_string(
+            &upipe_ts_sig_service->provider_name, provider_name);
+
+    for (uint8_t i = 0; i < nb_events; i++) {
+        struct upipe_ts_sig_event *event = &upipe_ts_sig_service->events[i];
+        eit_changed |= upipe_ts_sig_update_string(&event->name,
+                                                  event_names[i]);
+        if (event->event_id != events[i].event_id ||
+            event->start != events[i].start ||
+            event->duration != events[i].duration) {
+            event->event_id = events[i].event_id;
+            event->start = events[i].start;
+            event->duration = events[i].duration;
+            eit_changed = true;
+        }
+    }
+    for (uint8_t i = nb_events; i < upipe_ts_sig_service->nb_events; i++)
+        upipe_ts_sig_update_string(&upipe_ts_sig_service->events[i].name,
+                                   NULL);
+
+    upipe_ts_sig_service->sid = sid;
+    upipe_ts_sig_service->service_type = service_type;
+    upipe_ts_sig_service->nb_events = nb_events;
+
+    if (nit_changed)
+        upipe_ts_sig_change_nit(upipe_ts_sig);
+    if (sdt_changed)
+        upipe_ts_sig_change_sdt(upipe_ts_sig);
+    if (eit_changed)
+        upipe_ts_sig_service_invalidate_eit(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_sig_service_control(struct upipe *upipe,
+                                        int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_sig_service_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_sig_service_get_super(upipe, p);
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_sig_service_free(struct upipe *upipe)
+{
+    struct upipe_ts_sig_service *upipe_ts_sig_service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    struct upipe_ts_sig *upipe_ts_sig =
+        upipe_ts_sig_from_service_mgr(upipe->mgr);
+    upipe_throw_dead(upipe);
+
+    upipe_ts_sig_service_clean_sub(upipe);
+    if (upipe_ts_sig_service->sid) {
+        upipe_ts_sig_change_nit(upipe_ts_sig);
+        upipe_ts_sig_change_sdt(upipe_ts_sig);
+        upipe_ts_sig_invalidate(upipe_ts_sig, UPIPE_TS_SIG_EIT);
+    }
+    upipe_ts_sig_flush(&upipe_ts_sig_service->eit_sections);
+    for (int i = 0; i < MAX_EVENTS; i++)
+        free(upipe_ts_sig_service->events[i].name);
+    free(upipe_ts_sig_service->name);
+    free(upipe_ts_sig_service->provider_name);
+    upipe_ts_sig_service_clean_urefcount(upipe);
+    upipe_ts_sig_service_free_void(upipe);
+}
+
+/** @internal @This initializes the service manager for a ts_sig pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_sig_init_service_mgr(struct upipe *upipe)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    struct upipe_mgr *service_mgr = &upipe_ts_sig->service_mgr;
+    service_mgr->refcount = upipe_ts_sig_to_urefcount(upipe_ts_sig);
+    service_mgr->signature = UPIPE_TS_SIG_SERVICE_SIGNATURE;
+    service_mgr->upipe_alloc = upipe_ts_sig_service_alloc;
+    service_mgr->upipe_input = NULL;
+    service_mgr->upipe_control = upipe_ts_sig_service_control;
+    service_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates an output of a ts_sig pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_sig_output_alloc(struct upipe_mgr *mgr,
+                                               struct uprobe *uprobe,
+                                               uint32_t signature,
+                                               va_list args)
+{
+    struct uref *flow_def;
+    struct upipe *upipe = upipe_ts_sig_output_alloc_flow(mgr, uprobe,
+                                                         signature, args,
+                                                         &flow_def);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_sig_output *upipe_ts_sig_output =
+        upipe_ts_sig_output_from_upipe(upipe);
+    const char *def;
+    uint64_t pid = 0;
+    uref_ts_flow_get_pid(flow_def, &pid);
+    switch (pid) {
+        case NIT_PID:
+            upipe_ts_sig_output->table = UPIPE_TS_SIG_NIT;
+            def = "block.mpegtspsi.mpegtsnit.";
+            break;
+        case SDT_PID:
+            upipe_ts_sig_output->table = UPIPE_TS_SIG_SDT;
+            def = "block.mpegtspsi.mpegtssdt.";
+            break;
+        case EIT_PID:
+            upipe_ts_sig_output->table = UPIPE_TS_SIG_EIT;
+            def = "block.mpegtspsi.mpegtseit.";
+            break;
+        default:
+            uref_free(flow_def);
+            upipe_ts_sig_output_free_flow(upipe);
+            return NULL;
+    }
+
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_output_mgr(mgr);
+    upipe_ts_sig_output_init_urefcount(upipe);
+    upipe_ts_sig_output_init_output(upipe);
+    upipe_ts_sig_output->dirty = true;
+    uchain_init(upipe_ts_sig_output_to_uchain(upipe_ts_sig_output));
+    ulist_add(&upipe_ts_sig->outputs,
+              upipe_ts_sig_output_to_uchain(upipe_ts_sig_output));
+
+    upipe_throw_ready(upipe);
+
+    if (unlikely(!ubase_check(uref_flow_set_def(flow_def, def)))) {
+        uref_free(flow_def);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return upipe;
+    }
+    upipe_ts_sig_output_store_flow_def(upipe, flow_def);
+    return upipe;
+}
+
+/** @internal @This processes control commands.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_sig_output_control(struct upipe *upipe,
+                                       int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_sig_output_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_sig_output_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_ts_sig_output_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_sig_output_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            struct upipe_ts_sig_output *upipe_ts_sig_output =
+                upipe_ts_sig_output_from_upipe(upipe);
+            upipe_ts_sig_output->dirty = true;
+            return upipe_ts_sig_output_set_output(upipe, output);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            struct upipe_ts_sig *upipe_ts_sig =
+                upipe_ts_sig_from_output_mgr(upipe->mgr);
+            *p = upipe_ts_sig_to_upipe(upipe_ts_sig);
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_sig_output_free(struct upipe *upipe)
+{
+    struct upipe_ts_sig_output *upipe_ts_sig_output =
+        upipe_ts_sig_output_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    ulist_delete(upipe_ts_sig_output_to_uchain(upipe_ts_sig_output));
+    upipe_ts_sig_output_clean_output(upipe);
+    upipe_ts_sig_output_clean_urefcount(upipe);
+    upipe_ts_sig_output_free_flow(upipe);
+}
+
+/** @internal @This initializes the output manager for a ts_sig pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_sig_init_output_mgr(struct upipe *upipe)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    struct upipe_mgr *output_mgr = &upipe_ts_sig->output_mgr;
+    output_mgr->refcount = upipe_ts_sig_to_urefcount(upipe_ts_sig);
+    output_mgr->signature = UPIPE_TS_SIG_OUTPUT_SIGNATURE;
+    output_mgr->upipe_alloc = upipe_ts_sig_output_alloc;
+    output_mgr->upipe_input = NULL;
+    output_mgr->upipe_control = upipe_ts_sig_output_control;
+    output_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a ts_sig pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_sig_alloc(struct upipe_mgr *mgr,
+                                        struct uprobe *uprobe,
+                                        uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_ts_sig_alloc_void(mgr, uprobe, signature,
+                                                  args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    upipe_ts_sig_init_urefcount(upipe);
+    upipe_ts_sig_init_ubuf_mgr(upipe);
+    upipe_ts_sig_init_service_mgr(upipe);
+    upipe_ts_sig_init_sub_services(upipe);
+    upipe_ts_sig_init_output_mgr(upipe);
+    ulist_init(&upipe_ts_sig->outputs);
+    upipe_ts_sig->flow_def = NULL;
+    upipe_ts_sig->tsid = 0;
+    upipe_ts_sig->nid = DEFAULT_NID;
+    upipe_ts_sig->onid = DEFAULT_NID;
+    upipe_ts_sig->network_name = NULL;
+    upipe_ts_sig->nit_version = 0;
+    upipe_ts_sig->sdt_version = 0;
+    for (int i = 0; i < UPIPE_TS_SIG_TABLES; i++)
+        ulist_init(&upipe_ts_sig->sections[i]);
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This allocates and maps a new section.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer_p filled in with a pointer to the mapped section
+ * @return pointer to the section, or NULL in case of allocation error
+ */
+static struct ubuf *upipe_ts_sig_alloc_section(struct upipe *upipe,
+                                               uint8_t **buffer_p)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    struct ubuf *ubuf = ubuf_block_alloc(upipe_ts_sig->ubuf_mgr,
+                                         PSI_MAX_SIZE + PSI_HEADER_SIZE);
+    if (unlikely(ubuf == NULL))
+        return NULL;
+
+    int size = -1;
+    if (!ubase_check(ubuf_block_write(ubuf, 0, &size, buffer_p))) {
+        ubuf_free(ubuf);
+        return NULL;
+    }
+    return ubuf;
+}
+
+/** @internal @This terminates a section built by @ref
+ * upipe_ts_sig_alloc_section, and adds it to a list.
+ *
+ * @param ubuf section
+ * @param buffer mapped section, with its length set
+ * @param sections list of sections
+ */
+static void upipe_ts_sig_end_section(struct ubuf *ubuf, uint8_t *buffer,
+                                     struct uchain *sections)
+{
+    uint16_t section_size = psi_get_length(buffer) + PSI_HEADER_SIZE;
+    upipe_ts_psi_crc_set(buffer);
+    ubuf_block_unmap(ubuf, 0);
+    ubuf_block_resize(ubuf, 0, section_size);
+    ulist_add(sections, ubuf_to_uchain(ubuf));
+}
+
+/** @internal @This builds the NIT section, and stores it in the cache.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_sig_build_nit(struct upipe *upipe)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    upipe_notice_va(upipe, "new NIT nid=%"PRIu16" version=%"PRIu8,
+                    upipe_ts_sig->nid, upipe_ts_sig->nit_version);
+
+    uint8_t *buffer;
+    struct ubuf *ubuf = upipe_ts_sig_alloc_section(upipe, &buffer);
+    if (unlikely(ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+
+    nit_init(buffer, true);
+    /* set length later */
+    psi_set_length(buffer, PSI_MAX_SIZE);
+    nit_set_nid(buffer, upipe_ts_sig->nid);
+    psi_set_version(buffer, upipe_ts_sig->nit_version);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 0);
+
+    uint8_t *descs = nit_get_descs(buffer);
+    descs_set_length(descs, 0);
+    if (upipe_ts_sig->network_name != NULL) {
+        size_t name_size = strlen(upipe_ts_sig->network_name);
+        if (name_size > MAX_DESC_SIZE)
+            name_size = MAX_DESC_SIZE;
+        descs_set_length(descs, DESC40_HEADER_SIZE + name_size);
+        uint8_t *desc = descs_get_desc(descs, 0);
+        desc40_init(desc);
+        desc40_set_networkname(desc,
+                (const uint8_t *)upipe_ts_sig->network_name, name_size);
+    }
+
+    uint8_t *header2 = nit_get_header2(buffer);
+    nith_init(header2);
+    uint8_t *ts = header2 + NIT_HEADER2_SIZE;
+    nitn_init(ts);
+    nitn_set_tsid(ts, upipe_ts_sig->tsid);
+    nitn_set_onid(ts, upipe_ts_sig->onid);
+
+    unsigned int nb_services = 0;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_sig->services, uchain) {
+        struct upipe_ts_sig_service *service =
+            upipe_ts_sig_service_from_uchain(uchain);
+        if (service->sid)
+            nb_services++;
+    }
+    if (nb_services > MAX_DESC_SIZE / DESC41_SERVICE_SIZE) {
+        upipe_warn(upipe, "too many services for the NIT");
+        nb_services = MAX_DESC_SIZE / DESC41_SERVICE_SIZE;
+    }
+
+    descs = nitn_get_descs(ts);
+    descs_set_length(descs, DESC41_HEADER_SIZE +
+                            nb_services * DESC41_SERVICE_SIZE);
+    uint8_t *desc = descs_get_desc(descs, 0);
+    desc41_init(desc);
+    desc_set_length(desc, nb_services * DESC41_SERVICE_SIZE);
+
+    unsigned int j = 0;
+    ulist_foreach (&upipe_ts_sig->services, uchain) {
+        struct upipe_ts_sig_service *service =
+            upipe_ts_sig_service_from_uchain(uchain);
+        if (!service->sid)
+            continue;
+        if (j >= nb_services)
+            break;
+        upipe_notice_va(upipe, " * service sid=%"PRIu16" type=0x%"PRIx8,
+                        service->sid, service->service_type);
+        uint8_t *service_n = desc41_get_service(desc, j++);
+        desc41n_set_sid(service_n, service->sid);
+        desc41n_set_type(service_n, service->service_type);
+    }
+
+    uint8_t *end = descs + DESCS_HEADER_SIZE + descs_get_length(descs);
+    nith_set_tslength(header2, end - ts);
+    nit_set_length(buffer, end - buffer - NIT_HEADER_SIZE);
+    upipe_ts_sig_end_section(ubuf, buffer,
+                             &upipe_ts_sig->sections[UPIPE_TS_SIG_NIT]);
+
+    upipe_notice(upipe, "end NIT");
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This builds the SDT sections, and stores them in the cache.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_sig_build_sdt(struct upipe *upipe)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    upipe_notice_va(upipe, "new SDT tsid=%"PRIu16" version=%"PRIu8,
+                    upipe_ts_sig->tsid, upipe_ts_sig->sdt_version);
+
+    unsigned int nb_sections = 0;
+    struct uchain *sections = &upipe_ts_sig->sections[UPIPE_TS_SIG_SDT];
+    struct uchain *service_chain = &upipe_ts_sig->services;
+
+    do {
+        if (unlikely(nb_sections >= PSI_TABLE_MAX_SECTIONS)) {
+            upipe_warn(upipe, "SDT too large");
+            upipe_throw_error(upipe, UBASE_ERR_INVALID);
+            break;
+        }
+
+        uint8_t *buffer;
+        struct ubuf *ubuf = upipe_ts_sig_alloc_section(upipe, &buffer);
+        if (unlikely(ubuf == NULL)) {
+            upipe_ts_sig_flush(sections);
+            return UBASE_ERR_ALLOC;
+        }
+
+        sdt_init(buffer, true);
+        /* set length later */
+        psi_set_length(buffer, PSI_MAX_SIZE);
+        sdt_set_tsid(buffer, upipe_ts_sig->tsid);
+        sdt_set_onid(buffer, upipe_ts_sig->onid);
+        psi_set_version(buffer, upipe_ts_sig->sdt_version);
+        psi_set_current(buffer);
+        psi_set_section(buffer, nb_sections);
+        /* set last section in the end */
+
+        uint8_t *service_n = buffer + SDT_HEADER_SIZE;
+        while (!ulist_is_last(&upipe_ts_sig->services, service_chain)) {
+            struct upipe_ts_sig_service *service =
+                upipe_ts_sig_service_from_uchain(service_chain->next);
+            if (!service->sid) {
+                service_chain = service_chain->next;
+                continue;
+            }
+
+            size_t provider_size = service->provider_name != NULL ?
+                                   strlen(service->provider_name) : 0;
+            size_t name_size = service->name != NULL ?
+                               strlen(service->name) : 0;
+            if (provider_size > MAX_DESC_SIZE / 2 - 2)
+                provider_size = MAX_DESC_SIZE / 2 - 2;
+            if (name_size > MAX_DESC_SIZE / 2 - 2)
+                name_size = MAX_DESC_SIZE / 2 - 2;
+            /* service type, and both lengths */
+            size_t desc_size = 3 + provider_size + name_size;
+            if (service_n + SDT_SERVICE_SIZE + DESC_HEADER_SIZE + desc_size >
+                    buffer + PSI_MAX_SIZE + PSI_HEADER_SIZE - PSI_CRC_SIZE)
+                break; /* next section */
+            service_chain = service_chain->next;
+
+            upipe_notice_va(upipe, " * service sid=%"PRIu16" name=\"%s\"",
+                            service->sid,
+                            service->name != NULL ? service->name : "");
+
+            sdtn_init(service_n);
+            sdtn_set_sid(service_n, service->sid);
+            if (service->nb_events)
+                sdtn_set_eitpresent(service_n);
+            sdtn_set_running(service_n, RUNNING_PRESENT);
+            uint8_t *descs = sdtn_get_descs(service_n);
+            descs_set_length(descs, DESC_HEADER_SIZE + desc_size);
+            uint8_t *desc = descs_get_desc(descs, 0);
+            desc48_init(desc);
+            desc_set_length(desc, desc_size);
+            desc48_set_type(desc, service->service_type);
+            desc48_set_provider(desc, (const uint8_t *)service->provider_name,
+                                provider_size);
+            desc48_set_service(desc, (const uint8_t *)service->name,
+                               name_size);
+            service_n = descs + DESCS_HEADER_SIZE + descs_get_length(descs);
+        }
+
+        sdt_set_length(buffer, service_n - buffer - SDT_HEADER_SIZE);
+        uint16_t section_size = psi_get_length(buffer) + PSI_HEADER_SIZE;
+        ubuf_block_unmap(ubuf, 0);
+        ubuf_block_resize(ubuf, 0, section_size);
+        ulist_add(sections, ubuf_to_uchain(ubuf));
+        nb_sections++;
+    } while (!ulist_is_last(&upipe_ts_sig->services, service_chain));
+
+    upipe_notice_va(upipe, "end SDT (%u sections)", nb_sections);
+
+    struct uchain *section_chain;
+    ulist_foreach (sections, section_chain) {
+        struct ubuf *ubuf = ubuf_from_uchain(section_chain);
+        uint8_t *buffer;
+        int size = -1;
+        if (!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer))) {
+            upipe_ts_sig_flush(sections);
+            return UBASE_ERR_ALLOC;
+        }
+
+        psi_set_lastsection(buffer, nb_sections - 1);
+        upipe_ts_psi_crc_set(buffer);
+        ubuf_block_unmap(ubuf, 0);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This encodes a number between 0 and 99 in BCD.
+ *
+ * @param value number to encode
+ * @return BCD value
+ */
+static inline uint8_t upipe_ts_sig_bcd(unsigned int value)
+{
+    return ((value / 10) << 4) | (value % 10);
+}
+
+/** @internal @This encodes a duration as hours, minutes and seconds in
+ * BCD (EN 300 468 annex C).
+ *
+ * @param duration duration in seconds
+ * @return 24-bit BCD value
+ */
+static uint32_t upipe_ts_sig_encode_duration(uint64_t duration)
+{
+    uint64_t hours = duration / 3600;
+    if (hours > 99)
+        return 0x995959;
+    return (upipe_ts_sig_bcd(hours) << 16) |
+           (upipe_ts_sig_bcd((duration / 60) % 60) << 8) |
+           upipe_ts_sig_bcd(duration % 60);
+}
+
+/** @internal @This encodes a UTC time as a modified Julian date followed
+ * by hours, minutes and seconds in BCD (EN 300 468 annex C).
+ *
+ * @param time time in seconds since the Epoch
+ * @return 40-bit value
+ */
+static uint64_t upipe_ts_sig_encode_utc(uint64_t time)
+{
+    uint64_t mjd = MJD_EPOCH + time / 86400;
+    return ((mjd & 0xffff) << 24) | upipe_ts_sig_encode_duration(time % 86400);
+}
+
+/** @internal @This builds the present and following EIT sections of a
+ * service, and stores them in the cache of the service.
+ *
+ * @param upipe description structure of the service
+ * @return an error code
+ */
+static int upipe_ts_sig_service_build_eit(struct upipe *upipe)
+{
+    struct upipe_ts_sig_service *upipe_ts_sig_service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    struct upipe_ts_sig *upipe_ts_sig =
+        upipe_ts_sig_from_service_mgr(upipe->mgr);
+    upipe_notice_va(upipe, "new EIT sid=%"PRIu16" version=%"PRIu8
+                    " events=%"PRIu8, upipe_ts_sig_service->sid,
+                    upipe_ts_sig_service->eit_version,
+                    upipe_ts_sig_service->nb_events);
+
+    for (uint8_t i = 0; i < MAX_EVENTS; i++) {
+        uint8_t *buffer;
+        struct ubuf *ubuf =
+            upipe_ts_sig_alloc_section(upipe_ts_sig_to_upipe(upipe_ts_sig),
+                                       &buffer);
+        if (unlikely(ubuf == NULL)) {
+            upipe_ts_sig_flush(&upipe_ts_sig_service->eit_sections);
+            return UBASE_ERR_ALLOC;
+        }
+
+        eit_init(buffer, true);
+        /* set length later */
+        psi_set_length(buffer, PSI_MAX_SIZE);
+        eit_set_sid(buffer, upipe_ts_sig_service->sid);
+        eit_set_tsid(buffer, upipe_ts_sig->tsid);
+        eit_set_onid(buffer, upipe_ts_sig->onid);
+        psi_set_version(buffer, upipe_ts_sig_service->eit_version);
+        psi_set_current(buffer);
+        psi_set_section(buffer, i);
+        psi_set_lastsection(buffer, MAX_EVENTS - 1);
+        eit_set_segment_last_sec_number(buffer, MAX_EVENTS - 1);
+        eit_set_last_table_id(buffer, EIT_TABLE_ID_PF_ACTUAL);
+
+        uint8_t *event_n = buffer + EIT_HEADER_SIZE;
+        if (i < upipe_ts_sig_service->nb_events) {
+            struct upipe_ts_sig_event *event =
+                &upipe_ts_sig_service->events[i];
+            size_t name_size = event->name != NULL ? strlen(event->name) : 0;
+            /* language, and lengths of the name and the empty text */
+            size_t desc_size = 5 + name_size;
+            if (desc_size > MAX_DESC_SIZE) {
+                desc_size = MAX_DESC_SIZE;
+                name_size = desc_size - 5;
+            }
+
+            eitn_init(event_n);
+            eitn_set_event_id(event_n, event->event_id);
+            eitn_set_start_time(event_n,
+                                upipe_ts_sig_encode_utc(event->start));
+            eitn_set_duration_bcd(event_n,
+                    upipe_ts_sig_encode_duration(event->duration));
+            eitn_set_running(event_n,
+                             i ? RUNNING_FOLLOWING : RUNNING_PRESENT);
+            uint8_t *descs = eitn_get_descs(event_n);
+            descs_set_length(descs, DESC_HEADER_SIZE + desc_size);
+            uint8_t *desc = descs_get_desc(descs, 0);
+            desc4d_init(desc);
+            desc_set_length(desc, desc_size);
+            desc4d_set_lang(desc, (const uint8_t *)EVENT_LANGUAGE);
+            desc4d_set_event_name(desc, (const uint8_t *)event->name,
+                                  name_size);
+            desc4d_set_text(desc, NULL, 0);
+            event_n = descs + DESCS_HEADER_SIZE + descs_get_length(descs);
+        }
+
+        eit_set_length(buffer, event_n - buffer - EIT_HEADER_SIZE);
+        upipe_ts_sig_end_section(ubuf, buffer,
+                                 &upipe_ts_sig_service->eit_sections);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This gathers the EIT sections of all services, building those
+ * which changed, and stores them in the cache.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_sig_build_eit(struct upipe *upipe)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    struct uchain *sections = &upipe_ts_sig->sections[UPIPE_TS_SIG_EIT];
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_sig->services, uchain) {
+        struct upipe_ts_sig_service *service =
+            upipe_ts_sig_service_from_uchain(uchain);
+        if (!service->sid)
+            continue;
+        if (ulist_empty(&service->eit_sections) &&
+            !ubase_check(upipe_ts_sig_service_build_eit(
+                    upipe_ts_sig_service_to_upipe(service)))) {
+            upipe_ts_sig_flush(sections);
+            return UBASE_ERR_ALLOC;
+        }
+
+        struct uchain *section_chain;
+        ulist_foreach (&service->eit_sections, section_chain) {
+            struct ubuf *ubuf = ubuf_dup(ubuf_from_uchain(section_chain));
+            if (unlikely(ubuf == NULL)) {
+                upipe_ts_sig_flush(sections);
+                return UBASE_ERR_ALLOC;
+            }
+            ulist_add(sections, ubuf_to_uchain(ubuf));
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This outputs a table to an output subpipe, using the uref
+ * received. The sections are only rebuilt if the table changed since the
+ * last time, and are shared between all outputs carrying the table.
+ *
+ * @param upipe description structure of the output subpipe
+ * @param uref uref structure, not consumed
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_sig_output_table(struct upipe *upipe, struct uref *uref,
+                                      struct upump **upump_p)
+{
+    struct upipe_ts_sig_output *upipe_ts_sig_output =
+        upipe_ts_sig_output_from_upipe(upipe);
+    struct upipe_ts_sig *upipe_ts_sig =
+        upipe_ts_sig_from_output_mgr(upipe->mgr);
+    struct upipe *super = upipe_ts_sig_to_upipe(upipe_ts_sig);
+    struct uchain *sections =
+        &upipe_ts_sig->sections[upipe_ts_sig_output->table];
+
+    if (ulist_empty(sections)) {
+        int err;
+        switch (upipe_ts_sig_output->table) {
+            case UPIPE_TS_SIG_NIT:
+                err = upipe_ts_sig_build_nit(super);
+                break;
+            case UPIPE_TS_SIG_SDT:
+                err = upipe_ts_sig_build_sdt(super);
+                break;
+            case UPIPE_TS_SIG_EIT:
+                err = upipe_ts_sig_build_eit(super);
+                break;
+            default:
+                err = UBASE_ERR_INVALID;
+                break;
+        }
+        if (unlikely(!ubase_check(err))) {
+            upipe_throw_fatal(upipe, err);
+            return;
+        }
+    }
+    upipe_ts_sig_output->dirty = false;
+
+    struct uchain *section_chain;
+    ulist_foreach (sections, section_chain) {
+        struct ubuf *ubuf = ubuf_dup(ubuf_from_uchain(section_chain));
+        struct uref *output = uref_dup(uref);
+        if (unlikely(ubuf == NULL || output == NULL)) {
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            if (output != NULL)
+                uref_free(output);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+
+        uref_attach_ubuf(output, ubuf);
+        uref_block_set_start(output);
+        if (ulist_is_last(sections, section_chain))
+            uref_block_set_end(output);
+        upipe_ts_sig_output_output(upipe, output, upump_p);
+    }
+}
+
+/** @internal @This outputs the tables which changed since the last time to
+ * the output subpipes, using the uref received.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_sig_input(struct upipe *upipe, struct uref *uref,
+                               struct upump **upump_p)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    if (unlikely(upipe_ts_sig->flow_def == NULL ||
+                 upipe_ts_sig->ubuf_mgr == NULL)) {
+        uref_free(uref);
+        return;
+    }
+    uref_block_delete_start(uref);
+
+    upipe_use(upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_ts_sig->outputs, uchain, uchain_tmp) {
+        struct upipe_ts_sig_output *output =
+            upipe_ts_sig_output_from_uchain(uchain);
+        if (output->dirty)
+            upipe_ts_sig_output_table(upipe_ts_sig_output_to_upipe(output),
+                                      uref, upump_p);
+    }
+    uref_free(uref);
+    upipe_release(upipe);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_sig_set_flow_def(struct upipe *upipe,
+                                     struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    uint64_t tsid;
+    UBASE_RETURN(uref_flow_match_def(flow_def, "void."))
+    UBASE_RETURN(uref_flow_get_id(flow_def, &tsid))
+    uint64_t nid = DEFAULT_NID;
+    uref_ts_flow_get_nid(flow_def, &nid);
+    uint64_t onid = nid;
+    uref_ts_flow_get_onid(flow_def, &onid);
+    const char *network_name = NULL;
+    uref_ts_flow_get_network_name(flow_def, &network_name);
+
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    if (upipe_ts_sig->flow_def == NULL) {
+        struct uref *flow_format = uref_dup(flow_def);
+        if (unlikely(flow_format == NULL ||
+                     !ubase_check(uref_flow_set_def(flow_format,
+                                                    "block.mpegtspsi.")))) {
+            if (flow_format != NULL)
+                uref_free(flow_format);
+            uref_free(flow_def_dup);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_ts_sig_require_ubuf_mgr(upipe, flow_format);
+    } else
+        uref_free(upipe_ts_sig->flow_def);
+    upipe_ts_sig->flow_def = flow_def_dup;
+
+    bool ts_changed = tsid != upipe_ts_sig->tsid ||
+                      onid != upipe_ts_sig->onid;
+    bool nit_changed = ts_changed || nid != upipe_ts_sig->nid;
+    nit_changed |= upipe_ts_sig_update_string(&upipe_ts_sig->network_name,
+                                              network_name);
+    upipe_ts_sig->tsid = tsid;
+    upipe_ts_sig->nid = nid;
+    upipe_ts_sig->onid = onid;
+
+    if (nit_changed)
+        upipe_ts_sig_change_nit(upipe_ts_sig);
+    if (ts_changed) {
+        upipe_ts_sig_change_sdt(upipe_ts_sig);
+
+        struct uchain *uchain;
+        ulist_foreach (&upipe_ts_sig->services, uchain) {
+            struct upipe_ts_sig_service *service =
+                upipe_ts_sig_service_from_uchain(uchain);
+            upipe_ts_sig_service_invalidate_eit(
+                    upipe_ts_sig_service_to_upipe(service));
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_sig_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+            *p = upipe_ts_sig->flow_def;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_sig_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_ts_sig_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_sig_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_TS_SIG_GET_OUTPUT_MGR: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_SIG_SIGNATURE)
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+            *p = upipe_ts_sig_to_output_mgr(upipe_ts_sig);
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_sig_free(struct upipe *upipe)
+{
+    struct upipe_ts_sig *upipe_ts_sig = upipe_ts_sig_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+    for (int i = 0; i < UPIPE_TS_SIG_TABLES; i++)
+        upipe_ts_sig_flush(&upipe_ts_sig->sections[i]);
+    upipe_ts_sig_clean_sub_services(upipe);
+    free(upipe_ts_sig->network_name);
+    if (upipe_ts_sig->flow_def != NULL)
+        uref_free(upipe_ts_sig->flow_def);
+    upipe_ts_sig_clean_ubuf_mgr(upipe);
+    /* the request was only thrown, so it is not unregistered */
+    if (urequest_get_opaque(&upipe_ts_sig->ubuf_mgr_request,
+                            struct upipe *) != NULL)
+        urequest_clean(&upipe_ts_sig->ubuf_mgr_request);
+    upipe_ts_sig_clean_urefcount(upipe);
+    upipe_ts_sig_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_sig_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_SIG_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_sig_alloc,
+    .upipe_input = upipe_ts_sig_input,
+    .upipe_control = upipe_ts_sig_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_sig pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_sig_mgr_alloc(void)
+{
+    return &upipe_ts_sig_mgr;
+}
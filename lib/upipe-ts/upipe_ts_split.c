@@ -36,6 +36,7 @@
 #include <upipe/upipe_helper_output.h>
 #include <upipe/upipe_helper_subpipe.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/uref_ts_bundle.h>
 #include <upipe-ts/upipe_ts_split.h>
 
 #include <stdlib.h>
@@ -46,17 +47,21 @@
 
 #include <bitstream/mpeg/ts.h>
 
-/** we only accept blocks containing exactly one TS packet */
+/** we only accept blocks containing whole TS packets */
 #define EXPECTED_FLOW_DEF "block.mpegts."
 /** maximum number of PIDs */
 #define MAX_PIDS 8192
+/** log2 of the initial size of the table of PIDs */
+#define PID_TABLE_MIN_BITS 4
 
 /** @internal @This keeps internal information about a PID. */
 struct upipe_ts_split_pid {
-    /** subs specific to that PID */
-    struct uchain subs;
+    /** PID */
+    uint16_t pid;
     /** true if we asked for this PID */
     bool set;
+    /** subs specific to that PID */
+    struct uchain subs;
 };
 
 /** @internal @This is the private context of a ts split pipe. */
@@ -69,8 +74,14 @@ struct upipe_ts_split {
     /** list of output subpipes */
     struct uchain subs;
 
-    /** PIDs array */
-    struct upipe_ts_split_pid pids[MAX_PIDS];
+    /** bitmap of the PIDs having subs */
+    uint64_t pid_map[MAX_PIDS / 64];
+    /** open-addressed table of the PIDs having or having had subs */
+    struct upipe_ts_split_pid **pid_table;
+    /** log2 of the size of the table of PIDs */
+    unsigned int pid_table_bits;
+    /** number of PIDs in the table */
+    unsigned int nb_pids;
 
     /** manager to create output subpipes */
     struct upipe_mgr sub_mgr;
@@ -274,15 +285,208 @@ static struct upipe *upipe_ts_split_alloc(struct upipe_mgr *mgr,
     upipe_ts_split_init_sub_mgr(upipe);
     upipe_ts_split_init_sub_subs(upipe);
 
-    int i;
-    for (i = 0; i < MAX_PIDS; i++) {
-        ulist_init(&upipe_ts_split->pids[i].subs);
-        upipe_ts_split->pids[i].set = false;
-    }
+    memset(upipe_ts_split->pid_map, 0, sizeof(upipe_ts_split->pid_map));
+    upipe_ts_split->pid_table = NULL;
+    upipe_ts_split->pid_table_bits = 0;
+    upipe_ts_split->nb_pids = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
 
+/** @internal @This returns true if the given PID has subs. This only reads
+ * the bitmap, so that packets of the other PIDs are dropped without looking
+ * up the table.
+ *
+ * @param upipe_ts_split private context of the pipe
+ * @param pid PID
+ * @return true if the PID has subs
+ */
+static inline bool upipe_ts_split_pid_active(
+        struct upipe_ts_split *upipe_ts_split, uint16_t pid)
+{
+    return upipe_ts_split->pid_map[pid / 64] & (UINT64_C(1) << (pid % 64));
+}
+
+/** @internal @This returns the initial slot of a PID in the table.
+ *
+ * @param upipe_ts_split private context of the pipe
+ * @param pid PID
+ * @return index of the slot
+ */
+static inline unsigned int upipe_ts_split_pid_hash(
+        struct upipe_ts_split *upipe_ts_split, uint16_t pid)
+{
+    return (uint32_t)(pid * UINT32_C(2654435769)) >>
+           (32 - upipe_ts_split->pid_table_bits);
+}
+
+/** @internal @This finds the internal information about a PID.
+ *
+ * @param upipe_ts_split private context of the pipe
+ * @param pid PID
+ * @return pointer to the internal information, or NULL if the PID is unknown
+ */
+static struct upipe_ts_split_pid *upipe_ts_split_pid_find(
+        struct upipe_ts_split *upipe_ts_split, uint16_t pid)
+{
+    if (unlikely(upipe_ts_split->pid_table == NULL))
+        return NULL;
+    unsigned int mask = (1 << upipe_ts_split->pid_table_bits) - 1;
+    unsigned int i = upipe_ts_split_pid_hash(upipe_ts_split, pid);
+    struct upipe_ts_split_pid *entry;
+    while ((entry = upipe_ts_split->pid_table[i]) != NULL) {
+        if (entry->pid == pid)
+            return entry;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/** @internal @This inserts an entry in the table of PIDs, which must have
+ * a free slot.
+ *
+ * @param upipe_ts_split private context of the pipe
+ * @param entry internal information about a PID
+ */
+static void upipe_ts_split_pid_insert(struct upipe_ts_split *upipe_ts_split,
+                                      struct upipe_ts_split_pid *entry)
+{
+    unsigned int mask = (1 << upipe_ts_split->pid_table_bits) - 1;
+    unsigned int i = upipe_ts_split_pid_hash(upipe_ts_split, entry->pid);
+    while (upipe_ts_split->pid_table[i] != NULL)
+        i = (i + 1) & mask;
+    upipe_ts_split->pid_table[i] = entry;
+}
+
+/** @internal @This finds the internal information about a PID, and
+ * allocates it if it does not exist. The table is doubled when it is half
+ * full.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID
+ * @return pointer to the internal information, or NULL in case of
+ * allocation error
+ */
+static struct upipe_ts_split_pid *upipe_ts_split_pid_get(struct upipe *upipe,
+                                                         uint16_t pid)
+{
+    struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
+    struct upipe_ts_split_pid *entry =
+        upipe_ts_split_pid_find(upipe_ts_split, pid);
+    if (entry != NULL)
+        return entry;
+
+    if (upipe_ts_split->pid_table == NULL ||
+        (upipe_ts_split->nb_pids + 1) * 2 >
+            (1U << upipe_ts_split->pid_table_bits)) {
+        unsigned int bits = upipe_ts_split->pid_table == NULL ?
+                            PID_TABLE_MIN_BITS :
+                            upipe_ts_split->pid_table_bits + 1;
+        struct upipe_ts_split_pid **table =
+            calloc(1 << bits, sizeof(struct upipe_ts_split_pid *));
+        if (unlikely(table == NULL))
+            return NULL;
+
+        struct upipe_ts_split_pid **old_table = upipe_ts_split->pid_table;
+        unsigned int old_size = old_table == NULL ? 0 :
+                                1 << upipe_ts_split->pid_table_bits;
+        upipe_ts_split->pid_table = table;
+        upipe_ts_split->pid_table_bits = bits;
+        for (unsigned int i = 0; i < old_size; i++)
+            if (old_table[i] != NULL)
+                upipe_ts_split_pid_insert(upipe_ts_split, old_table[i]);
+        free(old_table);
+    }
+
+    entry = malloc(sizeof(struct upipe_ts_split_pid));
+    if (unlikely(entry == NULL))
+        return NULL;
+    entry->pid = pid;
+    entry->set = false;
+    ulist_init(&entry->subs);
+    upipe_ts_split_pid_insert(upipe_ts_split, entry);
+    upipe_ts_split->nb_pids++;
+    return entry;
+}
+
+/** @internal @This removes an entry from the table of PIDs and frees it.
+ * The following entries of the same cluster are moved back, so that the
+ * lookups do not need tombstones.
+ *
+ * @param upipe description structure of the pipe
+ * @param entry internal information about a PID
+ */
+static void upipe_ts_split_pid_remove(struct upipe *upipe,
+                                      struct upipe_ts_split_pid *entry)
+{
+    struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
+    unsigned int mask = (1 << upipe_ts_split->pid_table_bits) - 1;
+    unsigned int i = upipe_ts_split_pid_hash(upipe_ts_split, entry->pid);
+    while (upipe_ts_split->pid_table[i] != entry)
+        i = (i + 1) & mask;
+
+    unsigned int j = i;
+    for ( ; ; ) {
+        upipe_ts_split->pid_table[i] = NULL;
+        struct upipe_ts_split_pid *next;
+        unsigned int k;
+        do {
+            j = (j + 1) & mask;
+            next = upipe_ts_split->pid_table[j];
+            if (next == NULL)
+                goto removed;
+            k = upipe_ts_split_pid_hash(upipe_ts_split, next->pid);
+            /* keep the entry if its initial slot is cyclically in ]i, j] */
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        upipe_ts_split->pid_table[i] = next;
+        i = j;
+    }
+
+removed:
+    upipe_ts_split->nb_pids--;
+    free(entry);
+}
+
+/** @internal @This shrinks the table of PIDs to the smallest size keeping
+ * it at most half full, as it only grows when PIDs come and go.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_split_pid_compact(struct upipe *upipe)
+{
+    struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
+    struct upipe_ts_split_pid **old_table = upipe_ts_split->pid_table;
+    if (old_table == NULL)
+        return UBASE_ERR_NONE;
+    unsigned int old_size = 1 << upipe_ts_split->pid_table_bits;
+    if (!upipe_ts_split->nb_pids) {
+        free(old_table);
+        upipe_ts_split->pid_table = NULL;
+        upipe_ts_split->pid_table_bits = 0;
+        return UBASE_ERR_NONE;
+    }
+
+    unsigned int bits = PID_TABLE_MIN_BITS;
+    while (upipe_ts_split->nb_pids * 2 > (1U << bits))
+        bits++;
+    if (bits >= upipe_ts_split->pid_table_bits)
+        return UBASE_ERR_NONE;
+
+    struct upipe_ts_split_pid **table =
+        calloc(1 << bits, sizeof(struct upipe_ts_split_pid *));
+    UBASE_ALLOC_RETURN(table)
+    upipe_dbg_va(upipe, "compacting table of PIDs from %u to %u entries",
+                 old_size, 1U << bits);
+    upipe_ts_split->pid_table = table;
+    upipe_ts_split->pid_table_bits = bits;
+    for (unsigned int i = 0; i < old_size; i++)
+        if (old_table[i] != NULL)
+            upipe_ts_split_pid_insert(upipe_ts_split, old_table[i]);
+    free(old_table);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This checks the status of the PID, and sends the split_set_pid
  * or split_unset_pid event if it has not already been sent.
  *
@@ -293,20 +497,31 @@ static void upipe_ts_split_pid_check(struct upipe *upipe, uint16_t pid)
 {
     assert(pid < MAX_PIDS);
     struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
-    if (!ulist_empty(&upipe_ts_split->pids[pid].subs)) {
-        if (!upipe_ts_split->pids[pid].set) {
-            upipe_ts_split->pids[pid].set = true;
+    struct upipe_ts_split_pid *entry =
+        upipe_ts_split_pid_find(upipe_ts_split, pid);
+    if (unlikely(entry == NULL))
+        return;
+
+    if (!ulist_empty(&entry->subs)) {
+        upipe_ts_split->pid_map[pid / 64] |= UINT64_C(1) << (pid % 64);
+        if (!entry->set) {
+            entry->set = true;
             upipe_dbg_va(upipe, "throw ts split add pid %"PRIu16, pid);
             upipe_throw(upipe, UPROBE_TS_SPLIT_ADD_PID,
                         UPIPE_TS_SPLIT_SIGNATURE, (unsigned int)pid);
         }
     } else {
-        if (upipe_ts_split->pids[pid].set) {
-            upipe_ts_split->pids[pid].set = false;
+        upipe_ts_split->pid_map[pid / 64] &= ~(UINT64_C(1) << (pid % 64));
+        if (entry->set) {
+            entry->set = false;
             upipe_dbg_va(upipe, "throw ts split del pid %"PRIu16, pid);
             upipe_throw(upipe, UPROBE_TS_SPLIT_DEL_PID,
                         UPIPE_TS_SPLIT_SIGNATURE, (unsigned int)pid);
         }
+        /* the probes may have changed the subs meanwhile */
+        entry = upipe_ts_split_pid_find(upipe_ts_split, pid);
+        if (entry != NULL && ulist_empty(&entry->subs) && !entry->set)
+            upipe_ts_split_pid_remove(upipe, entry);
     }
 }
 
@@ -320,9 +535,12 @@ static void upipe_ts_split_pid_set(struct upipe *upipe, uint16_t pid,
                                    struct upipe_ts_split_sub *output)
 {
     assert(pid < MAX_PIDS);
-    struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
-    ulist_add(&upipe_ts_split->pids[pid].subs,
-              upipe_ts_split_sub_to_uchain_pid(output));
+    struct upipe_ts_split_pid *entry = upipe_ts_split_pid_get(upipe, pid);
+    if (unlikely(entry == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    ulist_add(&entry->subs, upipe_ts_split_sub_to_uchain_pid(output));
     upipe_ts_split_pid_check(upipe, pid);
 }
 
@@ -335,10 +553,15 @@ static void upipe_ts_split_pid_set(struct upipe *upipe, uint16_t pid,
 static void upipe_ts_split_pid_unset(struct upipe *upipe, uint16_t pid,
                                      struct upipe_ts_split_sub *output)
 {
-    assert(pid < MAX_PIDS);
+    if (unlikely(pid >= MAX_PIDS))
+        return;
     struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
+    struct upipe_ts_split_pid *entry =
+        upipe_ts_split_pid_find(upipe_ts_split, pid);
+    if (unlikely(entry == NULL))
+        return;
     struct uchain *uchain, *uchain_tmp;
-    ulist_delete_foreach (&upipe_ts_split->pids[pid].subs, uchain, uchain_tmp) {
+    ulist_delete_foreach (&entry->subs, uchain, uchain_tmp) {
         if (output == upipe_ts_split_sub_from_uchain_pid(uchain)) {
             ulist_delete(uchain);
         }
@@ -346,29 +569,29 @@ static void upipe_ts_split_pid_unset(struct upipe *upipe, uint16_t pid,
     upipe_ts_split_pid_check(upipe, pid);
 }
 
-/** @internal @This demuxes a TS packet to the appropriate output(s).
+/** @internal @This outputs a uref to all subpipes of a PID.
  *
  * @param upipe description structure of the pipe
+ * @param pid PID of the packets in the uref
  * @param uref uref structure
  * @param upump_p reference to pump that generated the buffer
+ * @return false in case of allocation error
  */
-static void upipe_ts_split_input(struct upipe *upipe, struct uref *uref,
-                                 struct upump **upump_p)
+static bool upipe_ts_split_output_pid(struct upipe *upipe, uint16_t pid,
+                                      struct uref *uref,
+                                      struct upump **upump_p)
 {
     struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
-    uint8_t buffer[TS_HEADER_SIZE];
-    const uint8_t *ts_header = uref_block_peek(uref, 0, TS_HEADER_SIZE,
-                                               buffer);
-    if (unlikely(ts_header == NULL)) {
+    struct upipe_ts_split_pid *entry = NULL;
+    if (upipe_ts_split_pid_active(upipe_ts_split, pid))
+        entry = upipe_ts_split_pid_find(upipe_ts_split, pid);
+    if (entry == NULL) {
         uref_free(uref);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
+        return true;
     }
-    uint16_t pid = ts_get_pid(ts_header);
-    UBASE_FATAL(upipe, uref_block_peek_unmap(uref, 0, buffer, ts_header))
 
     struct uchain *uchain;
-    ulist_foreach (&upipe_ts_split->pids[pid].subs, uchain) {
+    ulist_foreach (&entry->subs, uchain) {
         struct upipe_ts_split_sub *output =
                 upipe_ts_split_sub_from_uchain_pid(uchain);
         if (likely(uchain->next == NULL)) {
@@ -384,12 +607,122 @@ static void upipe_ts_split_input(struct upipe *upipe, struct uref *uref,
             else {
                 uref_free(uref);
                 upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-                return;
+                return false;
             }
         }
     }
     if (uref != NULL)
         uref_free(uref);
+    return true;
+}
+
+/** @internal @This splits a uref containing several TS packets. The PIDs of
+ * all packets are read in one pass, and each run of consecutive packets of
+ * the same PID is output as one uref referencing the original buffer. If the
+ * uref is a TS bundle, the description of the packets is used instead of
+ * their headers, and is split along with the packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param nb_packets number of TS packets in the uref
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_split_input_batch(struct upipe *upipe, struct uref *uref,
+                                       unsigned int nb_packets,
+                                       struct upump **upump_p)
+{
+    struct upipe_ts_split *upipe_ts_split = upipe_ts_split_from_upipe(upipe);
+    uint16_t pids[nb_packets];
+    unsigned int nb_pkts;
+    bool bundle = ubase_check(uref_ts_bundle_get_nb(uref, &nb_pkts)) &&
+                  nb_pkts == nb_packets;
+    for (unsigned int i = 0; i < nb_packets; i++) {
+        if (bundle) {
+            struct uref_ts_bundle_pkt pkt;
+            UBASE_FATAL(upipe, uref_ts_bundle_read(uref, i, 1, &pkt))
+            pids[i] = pkt.pid;
+            continue;
+        }
+
+        uint8_t buffer[TS_HEADER_SIZE];
+        const uint8_t *ts_header = uref_block_peek(uref, i * TS_SIZE,
+                                                   TS_HEADER_SIZE, buffer);
+        if (unlikely(ts_header == NULL)) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        pids[i] = ts_get_pid(ts_header);
+        UBASE_FATAL(upipe, uref_block_peek_unmap(uref, i * TS_SIZE, buffer,
+                                                 ts_header))
+    }
+
+    unsigned int start = 0;
+    for (unsigned int i = 1; i <= nb_packets; i++) {
+        if (i < nb_packets && pids[i] == pids[start])
+            continue;
+
+        uint16_t pid = pids[start];
+        unsigned int first = start;
+        start = i;
+        if (!upipe_ts_split_pid_active(upipe_ts_split, pid))
+            continue;
+
+        struct uref *run;
+        if (first == 0 && i == nb_packets) {
+            run = uref;
+            uref = NULL;
+        } else if (bundle)
+            run = uref_ts_bundle_splice(uref, first, i - first);
+        else
+            run = uref_block_splice(uref, first * TS_SIZE,
+                                    (i - first) * TS_SIZE);
+        if (unlikely(run == NULL)) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        if (unlikely(!upipe_ts_split_output_pid(upipe, pid, run, upump_p))) {
+            uref_free(uref);
+            return;
+        }
+    }
+    if (uref != NULL)
+        uref_free(uref);
+}
+
+/** @internal @This demuxes a TS packet, or a block of several TS packets,
+ * to the appropriate output(s).
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_split_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    size_t size;
+    if (unlikely(ubase_check(uref_block_size(uref, &size)) &&
+                 size > TS_SIZE)) {
+        if (unlikely(size % TS_SIZE))
+            upipe_warn_va(upipe, "dropping %zu trailing octets",
+                          size % TS_SIZE);
+        upipe_ts_split_input_batch(upipe, uref, size / TS_SIZE, upump_p);
+        return;
+    }
+
+    uint8_t buffer[TS_HEADER_SIZE];
+    const uint8_t *ts_header = uref_block_peek(uref, 0, TS_HEADER_SIZE,
+                                               buffer);
+    if (unlikely(ts_header == NULL)) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uint16_t pid = ts_get_pid(ts_header);
+    UBASE_FATAL(upipe, uref_block_peek_unmap(uref, 0, buffer, ts_header))
+
+    upipe_ts_split_output_pid(upipe, pid, uref, upump_p);
 }
 
 /** @internal @This sets the input flow definition.
@@ -429,6 +762,8 @@ static int upipe_ts_split_control(struct upipe *upipe,
             struct upipe **p = va_arg(args, struct upipe **);
             return upipe_ts_split_iterate_sub(upipe, p);
         }
+        case UPIPE_HIBERNATE:
+            return upipe_ts_split_pid_compact(upipe);
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -445,6 +780,11 @@ static void upipe_ts_split_free(struct urefcount *urefcount_real)
         upipe_ts_split_from_urefcount_real(urefcount_real);
     struct upipe *upipe = upipe_ts_split_to_upipe(upipe_ts_split);
     upipe_throw_dead(upipe);
+    if (upipe_ts_split->pid_table != NULL) {
+        for (unsigned int i = 0; i < 1U << upipe_ts_split->pid_table_bits; i++)
+            free(upipe_ts_split->pid_table[i]);
+        free(upipe_ts_split->pid_table);
+    }
     upipe_ts_split_clean_sub_subs(upipe);
     urefcount_clean(urefcount_real);
     upipe_ts_split_clean_urefcount(upipe);
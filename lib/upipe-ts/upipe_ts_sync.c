@@ -45,6 +45,10 @@
 
 #include <bitstream/mpeg/ts.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /** default number of packets to sync with */
 #define DEFAULT_TS_SYNC 2
 /** we only accept blocks */
@@ -124,6 +128,68 @@ static struct upipe *upipe_ts_sync_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This looks for the required number of sync words at the given
+ * stride in a linear buffer.
+ *
+ * @param buffer pointer to the linear buffer
+ * @param size size of the linear buffer
+ * @param ts_size TS packet size
+ * @param ts_sync number of sync words to look for
+ * @param offset_p written with the offset of the first TS packet, or of the
+ * first candidate which couldn't be tested in this buffer
+ * @return false if no TS packet was found
+ */
+static bool upipe_ts_sync_scan(const uint8_t *buffer, size_t size,
+                               size_t ts_size, unsigned int ts_sync,
+                               size_t *offset_p)
+{
+    size_t span = (ts_sync - 1) * ts_size;
+    if (size <= span) {
+        *offset_p = 0;
+        return false;
+    }
+
+    size_t end = size - span;
+    size_t offset = 0;
+#ifdef __SSE2__
+    /* test 16 candidates at once */
+    const __m128i sync = _mm_set1_epi8(TS_SYNC);
+    for ( ; offset + 16 <= end; offset += 16) {
+        __m128i match = _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(buffer + offset)), sync);
+        for (unsigned int i = 1; i < ts_sync && _mm_movemask_epi8(match); i++)
+            match = _mm_and_si128(match, _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(buffer + offset +
+                                                  i * ts_size)), sync));
+        int mask = _mm_movemask_epi8(match);
+        if (mask) {
+            *offset_p = offset + __builtin_ctz(mask);
+            return true;
+        }
+    }
+#endif
+
+    while (offset < end) {
+        const uint8_t *match = memchr(buffer + offset, TS_SYNC, end - offset);
+        if (match == NULL)
+            break;
+        offset = match - buffer;
+
+        unsigned int i;
+        for (i = 1; i < ts_sync; i++)
+            if (buffer[offset + i * ts_size] != TS_SYNC)
+                break;
+        if (i == ts_sync) {
+            *offset_p = offset;
+            return true;
+        }
+        offset++;
+    }
+
+    *offset_p = end;
+    return false;
+}
+
 /** @internal @This checks the presence of the required number of sync words
  * in the working buffer.
  *
@@ -140,6 +206,23 @@ static bool upipe_ts_sync_check(struct upipe *upipe, size_t *offset_p)
                                                   offset_p, TS_SYNC))))
             return false;
 
+        /* fast path if the sync words are in the same segment */
+        const uint8_t *buffer;
+        int size = -1;
+        if (likely(ubase_check(uref_block_read(upipe_ts_sync->next_uref,
+                                               *offset_p, &size, &buffer)))) {
+            size_t offset;
+            bool found = upipe_ts_sync_scan(buffer, size,
+                                            upipe_ts_sync->ts_size,
+                                            upipe_ts_sync->ts_sync, &offset);
+            uref_block_unmap(upipe_ts_sync->next_uref, *offset_p);
+            *offset_p += offset;
+            if (found)
+                return true;
+            if (offset)
+                continue;
+        }
+
         /* first octet at *offset_p is a sync word */
         int ts_sync = upipe_ts_sync->ts_sync - 1;
         for (int offset = *offset_p + upipe_ts_sync->ts_size; ts_sync;
@@ -0,0 +1,1032 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module generating a synthetic TS or ES at a given
+ * octetrate, for load testing
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_flow.h>
+#include <upipe/upipe_helper_uref_mgr.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_uclock.h>
+#include <upipe-ts/upipe_ts_synth.h>
+#include <upipe-ts/upipe_ts_mux.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/pes.h>
+#include <bitstream/mpeg/psi.h>
+
+#include "upipe_ts_psi_crc.h"
+
+/** flow definition generating a TS */
+#define TS_FLOW_DEF "block.mpegts."
+/** 2^33 (max resolution of PCR, PTS and DTS) */
+#define POW2_33 UINT64_C(8589934592)
+/** default octetrate (10 Mbi/s) */
+#define DEFAULT_OCTETRATE 1250000
+/** default MTU */
+#define DEFAULT_MTU (7 * TS_SIZE)
+/** default PCR interval, which is also the PAT and PMT interval */
+#define DEFAULT_PCR_INTERVAL (UCLOCK_FREQ / 25)
+/** default PID of the PMT */
+#define DEFAULT_PMT_PID 256
+/** default PID of the elementary stream */
+#define DEFAULT_ES_PID 257
+/** transport stream ID of the generated TS */
+#define TSID 1
+/** program number of the generated TS */
+#define PROGRAM_NUMBER 1
+/** number of packets output in each PCR interval, besides the cycle */
+#define OVERHEAD_PACKETS 3
+/** number of values of the continuity counter */
+#define CC_VALUES 16
+
+/** @hidden */
+static int upipe_ts_synth_check(struct upipe *upipe, struct uref *flow_format);
+
+/** @internal @This is the private context of a ts_synth pipe. */
+struct upipe_ts_synth {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** uref manager */
+    struct uref_mgr *uref_mgr;
+    /** uref manager request */
+    struct urequest uref_mgr_request;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** uclock, if not NULL the output is paced */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** idler or timer */
+    struct upump *upump;
+
+    /** true if a TS is generated, false if an ES is repeated */
+    bool ts;
+    /** octetrate */
+    uint64_t octetrate;
+    /** MTU */
+    size_t mtu;
+    /** PCR interval */
+    uint64_t pcr_interval;
+    /** PID of the PMT */
+    uint16_t pmt_pid;
+    /** number of elementary streams */
+    unsigned int nb_pids;
+    /** PIDs of the elementary streams */
+    uint16_t pids[UPIPE_TS_SYNTH_MAX_PIDS];
+
+    /** true if the packets below are built */
+    bool built;
+    /** PAT packets, for each value of the continuity counter */
+    struct ubuf *pat[CC_VALUES];
+    /** PMT packets, for each value of the continuity counter */
+    struct ubuf *pmt[CC_VALUES];
+    /** continuity counter of the next PAT and PMT */
+    uint8_t psi_cc;
+    /** stuffing appended to the header of the PCR packets */
+    struct ubuf *stuffing;
+    /** continuity counter of the PCR packets */
+    uint8_t pcr_cc;
+    /** null packet */
+    struct ubuf *null;
+    /** packets of the elementary streams and null packets output in each
+     * PCR interval */
+    struct ubuf *cycle;
+    /** number of packets in cycle */
+    unsigned int cycle_packets;
+    /** remainder of the octetrate calculation */
+    uint64_t remainder;
+
+    /** block repeated in ES mode */
+    struct uref *pattern;
+
+    /** program date of the next uref */
+    uint64_t date;
+    /** system date corresponding to a program date of 0, or UINT64_MAX */
+    uint64_t date_sys;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_synth, upipe, UPIPE_TS_SYNTH_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_synth, urefcount, upipe_ts_synth_free)
+UPIPE_HELPER_FLOW(upipe_ts_synth, "block.")
+
+UPIPE_HELPER_OUTPUT(upipe_ts_synth, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UREF_MGR(upipe_ts_synth, uref_mgr, uref_mgr_request,
+                      upipe_ts_synth_check,
+                      upipe_ts_synth_register_output_request,
+                      upipe_ts_synth_unregister_output_request)
+UPIPE_HELPER_UBUF_MGR(upipe_ts_synth, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      upipe_ts_synth_check,
+                      upipe_ts_synth_register_output_request,
+                      upipe_ts_synth_unregister_output_request)
+UPIPE_HELPER_UCLOCK(upipe_ts_synth, uclock, uclock_request,
+                    upipe_ts_synth_check,
+                    upipe_ts_synth_register_output_request,
+                    upipe_ts_synth_unregister_output_request)
+
+UPIPE_HELPER_UPUMP_MGR(upipe_ts_synth, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_ts_synth, upump, upump_mgr)
+
+/** @internal @This allocates a ts_synth pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_synth_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    struct uref *flow_def;
+    struct upipe *upipe = upipe_ts_synth_alloc_flow(mgr, uprobe, signature,
+                                                    args, &flow_def);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    upipe_ts_synth_init_urefcount(upipe);
+    upipe_ts_synth_init_uref_mgr(upipe);
+    upipe_ts_synth_init_ubuf_mgr(upipe);
+    upipe_ts_synth_init_uclock(upipe);
+    upipe_ts_synth_init_output(upipe);
+    upipe_ts_synth_init_upump_mgr(upipe);
+    upipe_ts_synth_init_upump(upipe);
+
+    const char *def;
+    upipe_ts_synth->ts = ubase_check(uref_flow_get_def(flow_def, &def)) &&
+                         !ubase_ncmp(def, TS_FLOW_DEF);
+    upipe_ts_synth->octetrate = DEFAULT_OCTETRATE;
+    upipe_ts_synth->mtu = DEFAULT_MTU;
+    upipe_ts_synth->pcr_interval = DEFAULT_PCR_INTERVAL;
+    upipe_ts_synth->pmt_pid = DEFAULT_PMT_PID;
+    upipe_ts_synth->nb_pids = 1;
+    upipe_ts_synth->pids[0] = DEFAULT_ES_PID;
+    upipe_ts_synth->built = false;
+    upipe_ts_synth->psi_cc = 0;
+    upipe_ts_synth->remainder = 0;
+    upipe_ts_synth->pattern = NULL;
+    upipe_ts_synth->date = 0;
+    upipe_ts_synth->date_sys = UINT64_MAX;
+    upipe_throw_ready(upipe);
+
+    uref_block_flow_set_octetrate(flow_def, upipe_ts_synth->octetrate);
+    upipe_ts_synth_store_flow_def(upipe, flow_def);
+
+    upipe_ts_synth_check(upipe, NULL);
+    return upipe;
+}
+
+/** @internal @This frees the prebuilt packets.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_synth_flush(struct upipe *upipe)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    if (!upipe_ts_synth->built)
+        return;
+
+    for (int i = 0; i < CC_VALUES; i++) {
+        if (upipe_ts_synth->pat[i] != NULL)
+            ubuf_free(upipe_ts_synth->pat[i]);
+        if (upipe_ts_synth->pmt[i] != NULL)
+            ubuf_free(upipe_ts_synth->pmt[i]);
+    }
+    if (upipe_ts_synth->stuffing != NULL)
+        ubuf_free(upipe_ts_synth->stuffing);
+    if (upipe_ts_synth->null != NULL)
+        ubuf_free(upipe_ts_synth->null);
+    if (upipe_ts_synth->cycle != NULL)
+        ubuf_free(upipe_ts_synth->cycle);
+    upipe_ts_synth->built = false;
+}
+
+/** @internal @This allocates a block and maps it for writing.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the block
+ * @param buffer_p filled in with a pointer to the mapped block
+ * @return pointer to the block, or NULL in case of allocation error
+ */
+static struct ubuf *upipe_ts_synth_alloc_block(struct upipe *upipe,
+                                               size_t size,
+                                               uint8_t **buffer_p)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    struct ubuf *ubuf = ubuf_block_alloc(upipe_ts_synth->ubuf_mgr, size);
+    if (unlikely(ubuf == NULL))
+        return NULL;
+
+    int write_size = -1;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &write_size,
+                                               buffer_p)))) {
+        ubuf_free(ubuf);
+        return NULL;
+    }
+    return ubuf;
+}
+
+/** @internal @This builds a TS packet carrying a PSI section.
+ *
+ * @param upipe description structure of the pipe
+ * @param section PSI section, smaller than a TS packet payload
+ * @param pid PID of the packet
+ * @param cc continuity counter of the packet
+ * @return pointer to the packet, or NULL in case of allocation error
+ */
+static struct ubuf *upipe_ts_synth_build_psi(struct upipe *upipe,
+                                             const uint8_t *section,
+                                             uint16_t pid, uint8_t cc)
+{
+    uint8_t *buffer;
+    struct ubuf *ubuf = upipe_ts_synth_alloc_block(upipe, TS_SIZE, &buffer);
+    if (unlikely(ubuf == NULL))
+        return NULL;
+
+    uint16_t section_size = psi_get_length(section) + PSI_HEADER_SIZE;
+    ts_init(buffer);
+    ts_set_pid(buffer, pid);
+    ts_set_cc(buffer, cc);
+    ts_set_unitstart(buffer);
+    ts_set_payload(buffer);
+    /* pointer_field */
+    buffer[TS_HEADER_SIZE] = 0;
+    memcpy(buffer + TS_HEADER_SIZE + 1, section, section_size);
+    memset(buffer + TS_HEADER_SIZE + 1 + section_size, 0xff,
+           TS_SIZE - TS_HEADER_SIZE - 1 - section_size);
+    ubuf_block_unmap(ubuf, 0);
+    return ubuf;
+}
+
+/** @internal @This builds the cycle of packets of the elementary streams,
+ * interleaved with null packets. Each elementary stream has a multiple of
+ * 16 packets, so that the continuity counters stay continuous when the cycle
+ * is repeated.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_synth_build_cycle(struct upipe *upipe)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    unsigned int nb_pids = upipe_ts_synth->nb_pids;
+    unsigned int cycle_packets = upipe_ts_synth->octetrate *
+        upipe_ts_synth->pcr_interval / (UCLOCK_FREQ * TS_SIZE) -
+        OVERHEAD_PACKETS;
+    unsigned int es_packets =
+        cycle_packets / nb_pids / CC_VALUES * CC_VALUES * nb_pids;
+    if (!es_packets)
+        upipe_warn(upipe, "octetrate too low to carry elementary streams");
+    upipe_notice_va(upipe, "cycle of %u packets (%u ES, %u null)",
+                    cycle_packets, es_packets, cycle_packets - es_packets);
+
+    upipe_ts_synth->cycle_packets = cycle_packets;
+    upipe_ts_synth->cycle = NULL;
+    /* the PCR packets carry no payload and keep the last counter */
+    upipe_ts_synth->pcr_cc = es_packets ? CC_VALUES - 1 : 0;
+    if (!cycle_packets)
+        return UBASE_ERR_NONE;
+
+    uint8_t *buffer;
+    struct ubuf *ubuf = upipe_ts_synth_alloc_block(upipe,
+            cycle_packets * TS_SIZE, &buffer);
+    if (unlikely(ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+
+    unsigned int k = 0;
+    for (unsigned int i = 0; i < cycle_packets; i++) {
+        uint8_t *ts = buffer + i * TS_SIZE;
+        if ((uint64_t)(i + 1) * es_packets / cycle_packets ==
+            (uint64_t)i * es_packets / cycle_packets) {
+            ts_pad(ts);
+            continue;
+        }
+
+        ts_init(ts);
+        ts_set_pid(ts, upipe_ts_synth->pids[k % nb_pids]);
+        ts_set_cc(ts, (k / nb_pids) % CC_VALUES);
+        ts_set_unitstart(ts);
+        ts_set_payload(ts);
+
+        /* one PES per packet, without timestamps */
+        uint8_t *pes = ts + TS_HEADER_SIZE;
+        pes_init(pes);
+        pes_set_streamid(pes, PES_STREAM_ID_PRIVATE_1);
+        pes_set_length(pes, TS_SIZE - TS_HEADER_SIZE - PES_HEADER_SIZE);
+        pes_set_headerlength(pes, 0);
+        pes_set_dataalignment(pes);
+        memset(pes + PES_HEADER_SIZE_NOPTS, 0,
+               TS_SIZE - TS_HEADER_SIZE - PES_HEADER_SIZE_NOPTS);
+        k++;
+    }
+    ubuf_block_unmap(ubuf, 0);
+
+    upipe_ts_synth->cycle = ubuf;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This builds all the packets of the TS.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ts_synth_build(struct upipe *upipe)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    uint8_t section[PSI_MAX_SIZE + PSI_HEADER_SIZE];
+    upipe_ts_synth_flush(upipe);
+
+    pat_init(section);
+    /* set length later */
+    psi_set_length(section, PSI_MAX_SIZE);
+    pat_set_tsid(section, TSID);
+    psi_set_version(section, 0);
+    psi_set_current(section);
+    psi_set_section(section, 0);
+    psi_set_lastsection(section, 0);
+    uint8_t *program = pat_get_program(section, 0);
+    patn_init(program);
+    patn_set_program(program, PROGRAM_NUMBER);
+    patn_set_pid(program, upipe_ts_synth->pmt_pid);
+    program = pat_get_program(section, 1);
+    pat_set_length(section, program - section - PAT_HEADER_SIZE);
+    upipe_ts_psi_crc_set(section);
+    for (int i = 0; i < CC_VALUES; i++)
+        upipe_ts_synth->pat[i] = upipe_ts_synth_build_psi(upipe, section,
+                                                          PAT_PID, i);
+
+    pmt_init(section);
+    /* set length later */
+    psi_set_length(section, PSI_MAX_SIZE);
+    pmt_set_program(section, PROGRAM_NUMBER);
+    psi_set_version(section, 0);
+    psi_set_current(section);
+    pmt_set_pcrpid(section, upipe_ts_synth->pids[0]);
+    descs_set_length(pmt_get_descs(section), 0);
+    for (unsigned int j = 0; j < upipe_ts_synth->nb_pids; j++) {
+        uint8_t *es = pmt_get_es(section, j);
+        pmtn_init(es);
+        pmtn_set_streamtype(es, PMT_STREAMTYPE_PRIVATE_PES);
+        pmtn_set_pid(es, upipe_ts_synth->pids[j]);
+        descs_set_length(pmtn_get_descs(es), 0);
+    }
+    uint8_t *es = pmt_get_es(section, upipe_ts_synth->nb_pids);
+    pmt_set_length(section, es - section - PMT_HEADER_SIZE);
+    upipe_ts_psi_crc_set(section);
+    for (int i = 0; i < CC_VALUES; i++)
+        upipe_ts_synth->pmt[i] = upipe_ts_synth_build_psi(upipe, section,
+                upipe_ts_synth->pmt_pid, i);
+
+    uint8_t *buffer;
+    upipe_ts_synth->stuffing = upipe_ts_synth_alloc_block(upipe,
+            TS_SIZE - TS_HEADER_SIZE_PCR, &buffer);
+    if (upipe_ts_synth->stuffing != NULL) {
+        memset(buffer, 0xff, TS_SIZE - TS_HEADER_SIZE_PCR);
+        ubuf_block_unmap(upipe_ts_synth->stuffing, 0);
+    }
+
+    upipe_ts_synth->null = upipe_ts_synth_alloc_block(upipe, TS_SIZE,
+                                                      &buffer);
+    if (upipe_ts_synth->null != NULL) {
+        ts_pad(buffer);
+        ubuf_block_unmap(upipe_ts_synth->null, 0);
+    }
+
+    upipe_ts_synth->built = true;
+    bool failed = !ubase_check(upipe_ts_synth_build_cycle(upipe)) ||
+                  upipe_ts_synth->stuffing == NULL ||
+                  upipe_ts_synth->null == NULL;
+    for (int i = 0; i < CC_VALUES; i++)
+        failed = failed || upipe_ts_synth->pat[i] == NULL ||
+                 upipe_ts_synth->pmt[i] == NULL;
+    if (unlikely(failed)) {
+        upipe_ts_synth_flush(upipe);
+        return UBASE_ERR_ALLOC;
+    }
+
+    upipe_ts_synth->psi_cc = 0;
+    upipe_ts_synth->remainder = 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This appends a shared block to a uref.
+ *
+ * @param uref uref to append to
+ * @param ubuf block to share
+ * @return an error code
+ */
+static int upipe_ts_synth_append(struct uref *uref, struct ubuf *ubuf)
+{
+    struct ubuf *dup = ubuf_dup(ubuf);
+    if (unlikely(dup == NULL))
+        return UBASE_ERR_ALLOC;
+    if (unlikely(!ubase_check(uref_block_append(uref, dup)))) {
+        ubuf_free(dup);
+        return UBASE_ERR_ALLOC;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This allocates the PCR packet opening a PCR interval. Only the
+ * header is written, the stuffing is shared.
+ *
+ * @param upipe description structure of the pipe
+ * @return pointer to the uref, or NULL in case of allocation error
+ */
+static struct uref *upipe_ts_synth_alloc_pcr(struct upipe *upipe)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    struct uref *uref = uref_block_alloc(upipe_ts_synth->uref_mgr,
+                                         upipe_ts_synth->ubuf_mgr,
+                                         TS_HEADER_SIZE_PCR);
+    if (unlikely(uref == NULL))
+        return NULL;
+
+    uint8_t *buffer;
+    int size = -1;
+    if (unlikely(!ubase_check(uref_block_write(uref, 0, &size, &buffer)))) {
+        uref_free(uref);
+        return NULL;
+    }
+
+    uint64_t pcr = upipe_ts_synth->date;
+    ts_init(buffer);
+    ts_set_pid(buffer, upipe_ts_synth->pids[0]);
+    ts_set_cc(buffer, upipe_ts_synth->pcr_cc);
+    ts_set_adaptation(buffer, TS_HEADER_SIZE_PCR - TS_HEADER_SIZE - 1);
+    tsaf_set_pcr(buffer, (pcr / 300) % POW2_33);
+    tsaf_set_pcrext(buffer, pcr % 300);
+    /* the adaptation field extends over the appended stuffing */
+    buffer[4] = TS_SIZE - TS_HEADER_SIZE - 1;
+    uref_block_unmap(uref, 0);
+
+    if (unlikely(!ubase_check(upipe_ts_synth_append(uref,
+                                    upipe_ts_synth->stuffing)))) {
+        uref_free(uref);
+        return NULL;
+    }
+    return uref;
+}
+
+/** @internal @This outputs a PCR interval worth of TS, in urefs of at most
+ * the MTU.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration_p filled in with the duration of the output
+ * @return an error code
+ */
+static int upipe_ts_synth_work_ts(struct upipe *upipe, uint64_t *duration_p)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    if (unlikely(!upipe_ts_synth->built &&
+                 !ubase_check(upipe_ts_synth_build(upipe))))
+        return UBASE_ERR_ALLOC;
+
+    uint64_t octets = upipe_ts_synth->octetrate *
+                      upipe_ts_synth->pcr_interval + upipe_ts_synth->remainder;
+    unsigned int packets = octets / (UCLOCK_FREQ * TS_SIZE);
+    upipe_ts_synth->remainder = octets % (UCLOCK_FREQ * TS_SIZE);
+
+    struct uref *uref = upipe_ts_synth_alloc_pcr(upipe);
+    uint8_t psi_cc = upipe_ts_synth->psi_cc;
+    int err = uref == NULL ? UBASE_ERR_ALLOC : UBASE_ERR_NONE;
+    if (ubase_check(err))
+        err = upipe_ts_synth_append(uref, upipe_ts_synth->pat[psi_cc]);
+    if (ubase_check(err))
+        err = upipe_ts_synth_append(uref, upipe_ts_synth->pmt[psi_cc]);
+    if (ubase_check(err) && upipe_ts_synth->cycle != NULL)
+        err = upipe_ts_synth_append(uref, upipe_ts_synth->cycle);
+    for (unsigned int i = OVERHEAD_PACKETS + upipe_ts_synth->cycle_packets;
+         i < packets && ubase_check(err); i++)
+        err = upipe_ts_synth_append(uref, upipe_ts_synth->null);
+    if (unlikely(!ubase_check(err))) {
+        if (uref != NULL)
+            uref_free(uref);
+        return err;
+    }
+    upipe_ts_synth->psi_cc = (psi_cc + 1) % CC_VALUES;
+
+    size_t size;
+    uref_block_size(uref, &size);
+    for (size_t offset = 0; offset < size; offset += upipe_ts_synth->mtu) {
+        size_t chunk_size = size - offset;
+        if (chunk_size > upipe_ts_synth->mtu)
+            chunk_size = upipe_ts_synth->mtu;
+
+        struct uref *output = uref;
+        if (chunk_size != size)
+            output = uref_block_splice(uref, offset, chunk_size);
+        if (unlikely(output == NULL)) {
+            uref_free(uref);
+            return UBASE_ERR_ALLOC;
+        }
+
+        uint64_t date = upipe_ts_synth->date +
+                        offset * upipe_ts_synth->pcr_interval / size;
+        uref_clock_set_cr_prog(output, date);
+        if (upipe_ts_synth->date_sys != UINT64_MAX)
+            uref_clock_set_cr_sys(output, upipe_ts_synth->date_sys + date);
+        if (offset == 0)
+            uref_clock_set_ref(output);
+
+        if (output == uref)
+            uref = NULL;
+        upipe_ts_synth_output(upipe, output, &upipe_ts_synth->upump);
+    }
+    if (uref != NULL)
+        uref_free(uref);
+    *duration_p = upipe_ts_synth->pcr_interval;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This outputs the repeated block of an ES.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration_p filled in with the duration of the output
+ * @return an error code
+ */
+static int upipe_ts_synth_work_es(struct upipe *upipe, uint64_t *duration_p)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    if (unlikely(upipe_ts_synth->pattern == NULL)) {
+        struct uref *pattern = uref_block_alloc(upipe_ts_synth->uref_mgr,
+                                                upipe_ts_synth->ubuf_mgr,
+                                                upipe_ts_synth->mtu);
+        uint8_t *buffer;
+        int size = -1;
+        if (unlikely(pattern == NULL ||
+                     !ubase_check(uref_block_write(pattern, 0, &size,
+                                                   &buffer)))) {
+            if (pattern != NULL)
+                uref_free(pattern);
+            return UBASE_ERR_ALLOC;
+        }
+        memset(buffer, 0, size);
+        uref_block_unmap(pattern, 0);
+        upipe_ts_synth->pattern = pattern;
+    }
+
+    struct uref *uref = uref_dup(upipe_ts_synth->pattern);
+    UBASE_ALLOC_RETURN(uref)
+
+    size_t size;
+    uref_block_size(uref, &size);
+    uint64_t octets = size * UCLOCK_FREQ + upipe_ts_synth->remainder;
+    uint64_t duration = octets / upipe_ts_synth->octetrate;
+    upipe_ts_synth->remainder = octets % upipe_ts_synth->octetrate;
+
+    uint64_t date = upipe_ts_synth->date;
+    uref_clock_set_dts_prog(uref, date);
+    if (upipe_ts_synth->date_sys != UINT64_MAX)
+        uref_clock_set_dts_sys(uref, upipe_ts_synth->date_sys + date);
+    uref_clock_set_dts_pts_delay(uref, 0);
+    uref_clock_set_duration(uref, duration);
+
+    upipe_ts_synth_output(upipe, uref, &upipe_ts_synth->upump);
+    *duration_p = duration;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This generates the next urefs, and waits until they are due
+ * if the pipe is paced.
+ *
+ * @param upump description structure of the idler or timer
+ */
+static void upipe_ts_synth_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+
+    if (upipe_ts_synth->uclock != NULL &&
+        upipe_ts_synth->date_sys == UINT64_MAX)
+        upipe_ts_synth->date_sys = uclock_now(upipe_ts_synth->uclock) -
+                                   upipe_ts_synth->date;
+
+    /* the pipe may be released while outputting */
+    upipe_use(upipe);
+
+    uint64_t duration;
+    int err = upipe_ts_synth->ts ? upipe_ts_synth_work_ts(upipe, &duration) :
+                                   upipe_ts_synth_work_es(upipe, &duration);
+    if (unlikely(!ubase_check(err))) {
+        upipe_ts_synth_set_upump(upipe, NULL);
+        upipe_throw_fatal(upipe, err);
+        upipe_release(upipe);
+        return;
+    }
+    upipe_ts_synth->date += duration;
+
+    if (upipe_ts_synth->uclock != NULL && upipe_ts_synth->upump_mgr != NULL) {
+        uint64_t now = uclock_now(upipe_ts_synth->uclock);
+        uint64_t next = upipe_ts_synth->date_sys + upipe_ts_synth->date;
+        /* when late, catch up as fast as possible */
+        upipe_ts_synth_wait_upump(upipe, next > now ? next - now : 0,
+                                  upipe_ts_synth_worker);
+    }
+
+    upipe_release(upipe);
+}
+
+/** @internal @This sets the block repeated in ES mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_synth_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    size_t size;
+    if (unlikely(upipe_ts_synth->ts ||
+                 !ubase_check(uref_block_size(uref, &size)) || !size)) {
+        upipe_warn(upipe, "received invalid pattern");
+        uref_free(uref);
+        return;
+    }
+
+    if (upipe_ts_synth->pattern != NULL)
+        uref_free(upipe_ts_synth->pattern);
+    upipe_ts_synth->pattern = uref;
+}
+
+/** @internal @This checks if the pump may be allocated.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_ts_synth_check(struct upipe *upipe, struct uref *flow_format)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    if (flow_format != NULL) {
+        /* the request may predate the last octetrate change */
+        uref_block_flow_set_octetrate(flow_format, upipe_ts_synth->octetrate);
+        upipe_ts_synth_store_flow_def(upipe, flow_format);
+    }
+
+    upipe_ts_synth_check_upump_mgr(upipe);
+    if (upipe_ts_synth->upump_mgr == NULL)
+        return UBASE_ERR_NONE;
+
+    if (upipe_ts_synth->uref_mgr == NULL) {
+        upipe_ts_synth_require_uref_mgr(upipe);
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_ts_synth->ubuf_mgr == NULL) {
+        upipe_ts_synth_require_ubuf_mgr(upipe,
+                                        uref_dup(upipe_ts_synth->flow_def));
+        return UBASE_ERR_NONE;
+    }
+
+    if (upipe_ts_synth->uclock == NULL &&
+        urequest_get_opaque(&upipe_ts_synth->uclock_request, struct upipe *)
+            != NULL)
+        return UBASE_ERR_NONE;
+
+    if (upipe_ts_synth->upump == NULL) {
+        if (upipe_ts_synth->uclock != NULL) {
+            upipe_ts_synth_wait_upump(upipe, 0, upipe_ts_synth_worker);
+            return UBASE_ERR_NONE;
+        }
+
+        struct upump *upump = upump_alloc_idler(upipe_ts_synth->upump_mgr,
+                                                upipe_ts_synth_worker, upipe);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_ts_synth_set_upump(upipe, upump);
+        upump_start(upump);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This checks that the octetrate gives room for the PSI and the
+ * PCR in each PCR interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate octetrate to check
+ * @param pcr_interval PCR interval to check
+ * @return an error code
+ */
+static int upipe_ts_synth_check_octetrate(struct upipe *upipe,
+                                          uint64_t octetrate,
+                                          uint64_t pcr_interval)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    if (unlikely(!octetrate || !pcr_interval))
+        return UBASE_ERR_INVALID;
+    if (upipe_ts_synth->ts &&
+        octetrate * pcr_interval < OVERHEAD_PACKETS * TS_SIZE * UCLOCK_FREQ) {
+        upipe_warn_va(upipe, "octetrate %"PRIu64" too low", octetrate);
+        return UBASE_ERR_INVALID;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the octetrate of the generated stream.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate new octetrate
+ * @return an error code
+ */
+static int upipe_ts_synth_set_octetrate(struct upipe *upipe,
+                                        uint64_t octetrate)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    UBASE_RETURN(upipe_ts_synth_check_octetrate(upipe, octetrate,
+                                                upipe_ts_synth->pcr_interval))
+    struct uref *flow_def = uref_dup(upipe_ts_synth->flow_def);
+    UBASE_ALLOC_RETURN(flow_def)
+    uref_block_flow_set_octetrate(flow_def, octetrate);
+    upipe_ts_synth_store_flow_def(upipe, flow_def);
+
+    upipe_ts_synth->octetrate = octetrate;
+    upipe_ts_synth_flush(upipe);
+    upipe_ts_synth->remainder = 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the PCR interval, which is also the interval of the
+ * PAT and PMT.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval new interval
+ * @return an error code
+ */
+static int upipe_ts_synth_set_pcr_interval(struct upipe *upipe,
+                                           uint64_t interval)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    UBASE_RETURN(upipe_ts_synth_check_octetrate(upipe,
+                                                upipe_ts_synth->octetrate,
+                                                interval))
+    upipe_ts_synth->pcr_interval = interval;
+    upipe_ts_synth_flush(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the MTU of the output urefs. In TS mode, it is
+ * rounded down to a multiple of the TS packet size.
+ *
+ * @param upipe description structure of the pipe
+ * @param mtu new MTU
+ * @return an error code
+ */
+static int upipe_ts_synth_set_mtu(struct upipe *upipe, unsigned int mtu)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    if (upipe_ts_synth->ts)
+        mtu -= mtu % TS_SIZE;
+    if (unlikely(!mtu))
+        return UBASE_ERR_INVALID;
+    upipe_ts_synth->mtu = mtu;
+    if (!upipe_ts_synth->ts && upipe_ts_synth->pattern != NULL) {
+        /* the zeroed pattern is reallocated with the new size */
+        uref_free(upipe_ts_synth->pattern);
+        upipe_ts_synth->pattern = NULL;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the PID layout of the generated TS.
+ *
+ * @param upipe description structure of the pipe
+ * @param pmt_pid PID of the PMT
+ * @param nb number of elementary streams
+ * @param pids array of nb PIDs of the elementary streams
+ * @return an error code
+ */
+static int _upipe_ts_synth_set_pids(struct upipe *upipe, uint16_t pmt_pid,
+                                    unsigned int nb, const uint16_t *pids)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    /* PIDs 0 to 31 are reserved, 8191 is for null packets */
+    if (unlikely(!nb || nb > UPIPE_TS_SYNTH_MAX_PIDS ||
+                 pmt_pid < 32 || pmt_pid >= 8191))
+        return UBASE_ERR_INVALID;
+    for (unsigned int i = 0; i < nb; i++)
+        if (unlikely(pids[i] < 32 || pids[i] >= 8191 || pids[i] == pmt_pid))
+            return UBASE_ERR_INVALID;
+
+    upipe_ts_synth->pmt_pid = pmt_pid;
+    upipe_ts_synth->nb_pids = nb;
+    memcpy(upipe_ts_synth->pids, pids, nb * sizeof(uint16_t));
+    upipe_ts_synth_flush(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_synth pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_ts_synth_control(struct upipe *upipe, int command,
+                                   va_list args)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_ts_synth_set_upump(upipe, NULL);
+            return upipe_ts_synth_attach_upump_mgr(upipe);
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_ts_synth_set_upump(upipe, NULL);
+            upipe_ts_synth_require_uclock(upipe);
+            return UBASE_ERR_NONE;
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_ts_synth_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_synth_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_ts_synth_set_output(upipe, output);
+        }
+
+        case UPIPE_TS_MUX_GET_OCTETRATE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t *octetrate_p = va_arg(args, uint64_t *);
+            *octetrate_p = upipe_ts_synth->octetrate;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_MUX_SET_OCTETRATE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t octetrate = va_arg(args, uint64_t);
+            return upipe_ts_synth_set_octetrate(upipe, octetrate);
+        }
+        case UPIPE_TS_MUX_GET_PCR_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            *interval_p = upipe_ts_synth->pcr_interval;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_MUX_SET_PCR_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t interval = va_arg(args, uint64_t);
+            return upipe_ts_synth_set_pcr_interval(upipe, interval);
+        }
+        case UPIPE_TS_MUX_GET_MTU: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            unsigned int *mtu_p = va_arg(args, unsigned int *);
+            *mtu_p = upipe_ts_synth->mtu;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_MUX_SET_MTU: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            unsigned int mtu = va_arg(args, unsigned int);
+            return upipe_ts_synth_set_mtu(upipe, mtu);
+        }
+        case UPIPE_TS_SYNTH_SET_PIDS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_SYNTH_SIGNATURE)
+            uint16_t pmt_pid = va_arg(args, unsigned int);
+            unsigned int nb = va_arg(args, unsigned int);
+            const uint16_t *pids = va_arg(args, const uint16_t *);
+            return _upipe_ts_synth_set_pids(upipe, pmt_pid, nb, pids);
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands on a ts_synth pipe, and
+ * checks the status of the pipe afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_synth_control(struct upipe *upipe, int command,
+                                  va_list args)
+{
+    UBASE_RETURN(_upipe_ts_synth_control(upipe, command, args));
+
+    return upipe_ts_synth_check(upipe, NULL);
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_synth_free(struct upipe *upipe)
+{
+    struct upipe_ts_synth *upipe_ts_synth = upipe_ts_synth_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    upipe_ts_synth_flush(upipe);
+    if (upipe_ts_synth->pattern != NULL)
+        uref_free(upipe_ts_synth->pattern);
+
+    upipe_ts_synth_clean_upump(upipe);
+    upipe_ts_synth_clean_upump_mgr(upipe);
+    upipe_ts_synth_clean_output(upipe);
+    upipe_ts_synth_clean_uclock(upipe);
+    upipe_ts_synth_clean_ubuf_mgr(upipe);
+    upipe_ts_synth_clean_uref_mgr(upipe);
+    upipe_ts_synth_clean_urefcount(upipe);
+    upipe_ts_synth_free_flow(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_synth_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_SYNTH_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_synth_alloc,
+    .upipe_input = upipe_ts_synth_input,
+    .upipe_control = upipe_ts_synth_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_synth pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_synth_mgr_alloc(void)
+{
+    return &upipe_ts_synth_mgr;
+}
@@ -38,6 +38,7 @@
 #include <upipe/upipe_helper_void.h>
 #include <upipe/upipe_helper_output.h>
 #include <upipe-ts/upipe_ts_tstd.h>
+#include <upipe-ts/uref_ts_flow.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -46,6 +47,20 @@
 #include <stdarg.h>
 #include <string.h>
 
+/** T-STD max retention time - 1 s */
+#define T_STD_MAX_RETENTION UCLOCK_FREQ
+/** maximum number of access units in the model of earliest dates; above
+ * that, the oldest one is considered decoded, which is conservative */
+#define MAX_AUS 256
+
+/** @internal @This describes an access unit in the buffer. */
+struct upipe_ts_tstd_au {
+    /** DTS in system time */
+    uint64_t dts_sys;
+    /** size, in octets */
+    uint64_t size;
+};
+
 /** upipe_ts_tstd structure */ 
 struct upipe_ts_tstd {
     /** refcount management structure */
@@ -73,6 +88,19 @@ struct upipe_ts_tstd {
     /** previous DTS */
     uint64_t last_dts;
 
+    /** maximum retention time */
+    uint64_t max_delay;
+    /** access units in the buffer if all entered at their earliest dates */
+    struct upipe_ts_tstd_au aus[MAX_AUS];
+    /** index of the oldest access unit in aus */
+    unsigned int first_au;
+    /** number of access units in aus */
+    unsigned int nb_aus;
+    /** total size of the access units in aus, in octets */
+    uint64_t aus_size;
+    /** earliest date of the previous access unit */
+    uint64_t last_early;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -82,6 +110,67 @@ UPIPE_HELPER_UREFCOUNT(upipe_ts_tstd, urefcount, upipe_ts_tstd_free)
 UPIPE_HELPER_VOID(upipe_ts_tstd)
 UPIPE_HELPER_OUTPUT(upipe_ts_tstd, output, flow_def, output_state, request_list)
 
+/** @internal @This computes the earliest date at which an access unit may
+ * enter the buffer, so that neither the buffer overflows nor the data stays
+ * longer than the maximum retention time, and tags the access unit with it.
+ * Access units being removed from the buffer at their DTS only, this is
+ * the DTS of the last access unit which must be decoded to make room.
+ * Each access unit is pushed and popped once, so this is O(1) amortized.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param size size of the access unit, in octets
+ */
+static void upipe_ts_tstd_early(struct upipe *upipe, struct uref *uref,
+                                uint64_t size)
+{
+    struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
+    uint64_t dts_sys;
+    if (!ubase_check(uref_clock_get_dts_sys(uref, &dts_sys)))
+        return;
+    if (unlikely(size > upipe_ts_tstd->bs))
+        return;
+
+    if (upipe_ts_tstd->nb_aus) {
+        unsigned int last = (upipe_ts_tstd->first_au +
+                             upipe_ts_tstd->nb_aus - 1) % MAX_AUS;
+        if (unlikely(dts_sys < upipe_ts_tstd->aus[last].dts_sys)) {
+            /* discontinuity, restart the model */
+            upipe_ts_tstd->nb_aus = 0;
+            upipe_ts_tstd->aus_size = 0;
+            upipe_ts_tstd->last_early = 0;
+        }
+    }
+
+    uint64_t early = dts_sys > upipe_ts_tstd->max_delay ?
+                     dts_sys - upipe_ts_tstd->max_delay : 0;
+    if (early < upipe_ts_tstd->last_early)
+        early = upipe_ts_tstd->last_early;
+
+    while (upipe_ts_tstd->nb_aus) {
+        struct upipe_ts_tstd_au *au =
+            &upipe_ts_tstd->aus[upipe_ts_tstd->first_au];
+        if (au->dts_sys > early &&
+            upipe_ts_tstd->aus_size + size <= upipe_ts_tstd->bs &&
+            upipe_ts_tstd->nb_aus < MAX_AUS)
+            break;
+        if (au->dts_sys > early)
+            early = au->dts_sys;
+        upipe_ts_tstd->aus_size -= au->size;
+        upipe_ts_tstd->first_au = (upipe_ts_tstd->first_au + 1) % MAX_AUS;
+        upipe_ts_tstd->nb_aus--;
+    }
+
+    struct upipe_ts_tstd_au *au = &upipe_ts_tstd->aus[
+        (upipe_ts_tstd->first_au + upipe_ts_tstd->nb_aus) % MAX_AUS];
+    au->dts_sys = dts_sys;
+    au->size = size;
+    upipe_ts_tstd->nb_aus++;
+    upipe_ts_tstd->aus_size += size;
+    upipe_ts_tstd->last_early = early;
+    uref_ts_tstd_set_early_sys(uref, early);
+}
+
 /** @internal @This handles urefs.
  *
  * @param upipe description structure of the pipe
@@ -107,6 +196,7 @@ static void upipe_ts_tstd_input(struct upipe *upipe, struct uref *uref,
     size_t uref_size = 0;
     uref_block_size(uref, &uref_size);
     upipe_ts_tstd->fullness -= uref_size;
+    upipe_ts_tstd_early(upipe, uref, uref_size);
     if (upipe_ts_tstd->fullness < 0) {
         upipe_warn_va(upipe, "T-STD underflow (%"PRId64" octets)",
                       -upipe_ts_tstd->fullness);
@@ -144,6 +234,8 @@ static int upipe_ts_tstd_set_flow_def(struct upipe *upipe,
     upipe_ts_tstd->fullness += bs - upipe_ts_tstd->bs;
     upipe_ts_tstd->bs = bs;
     upipe_ts_tstd->remainder = 0;
+    upipe_ts_tstd->max_delay = T_STD_MAX_RETENTION;
+    uref_ts_flow_get_max_delay(flow_def, &upipe_ts_tstd->max_delay);
 
     uint64_t latency = 0;
     uref_clock_get_latency(flow_def, &latency);
@@ -222,6 +314,10 @@ static struct upipe *upipe_ts_tstd_alloc(struct upipe_mgr *mgr,
     struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
     upipe_ts_tstd->bs = upipe_ts_tstd->fullness = 0;
     upipe_ts_tstd->last_dts = UINT64_MAX;
+    upipe_ts_tstd->max_delay = T_STD_MAX_RETENTION;
+    upipe_ts_tstd->first_au = upipe_ts_tstd->nb_aus = 0;
+    upipe_ts_tstd->aus_size = 0;
+    upipe_ts_tstd->last_early = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
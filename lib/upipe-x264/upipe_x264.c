@@ -59,6 +59,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <math.h>
 
 #include <x264.h>
 
@@ -120,6 +121,12 @@ struct upipe_x264 {
     /** last DTS (systime time) */
     uint64_t last_dts_sys;
 
+    /** sum of the products of the frame sizes by the quantizer steps in the
+     * current group of pictures */
+    double gop_complexity;
+    /** number of frames in the current group of pictures */
+    unsigned int gop_frames;
+
     /** public structure */
     struct upipe upipe;
 };
@@ -300,6 +307,119 @@ static int _upipe_x264_set_sc_latency(struct upipe *upipe, uint64_t sc_latency)
 #endif
 }
 
+/** @internal @This sets the number of threads and sliced threads mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads, or 0 for automatic
+ * @param sliced true for sliced threads
+ * @return an error code
+ */
+static int _upipe_x264_set_threads(struct upipe *upipe, unsigned int threads,
+                                   bool sliced)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    if (unlikely(upipe_x264->encoder != NULL))
+        return UBASE_ERR_BUSY;
+    upipe_x264->params.i_threads = threads ? threads : X264_THREADS_AUTO;
+    upipe_x264->params.b_sliced_threads = sliced ? 1 : 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the latency mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param mode latency mode
+ * @return an error code
+ */
+static int _upipe_x264_set_latency_mode(struct upipe *upipe,
+                                        enum upipe_x264_latency_mode mode)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    x264_param_t *params = &upipe_x264->params;
+    if (unlikely(upipe_x264->encoder != NULL))
+        return UBASE_ERR_BUSY;
+
+    switch (mode) {
+        case UPIPE_X264_LATENCY_THROUGHPUT:
+            params->b_sliced_threads = 0;
+            params->i_sync_lookahead = X264_SYNC_LOOKAHEAD_AUTO;
+            params->b_intra_refresh = 0;
+            break;
+        case UPIPE_X264_LATENCY_LOW:
+            /* same as the zerolatency tune, plus intra refresh */
+            params->b_sliced_threads = 1;
+            params->i_sync_lookahead = 0;
+            params->rc.i_lookahead = 0;
+            params->rc.b_mb_tree = 0;
+            params->i_bframe = 0;
+            params->b_intra_refresh = 1;
+            break;
+        default:
+            return UBASE_ERR_INVALID;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the target octetrate of the rate control.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate_p filled in with the octetrate
+ * @return an error code
+ */
+static int upipe_x264_get_octetrate(struct upipe *upipe,
+                                    uint64_t *octetrate_p)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    assert(octetrate_p != NULL);
+    *octetrate_p = (uint64_t)upipe_x264->params.rc.i_bitrate * 125;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This changes the target octetrate of the rate control, which
+ * must be in ABR mode. In CBR mode, the VBV max rate follows; otherwise it
+ * caps the target. The output flow definition is not updated.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate new octetrate
+ * @return an error code
+ */
+static int upipe_x264_set_octetrate(struct upipe *upipe, uint64_t octetrate)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    x264_param_t *params = &upipe_x264->params;
+    int bitrate = octetrate / 125;
+    if (unlikely(!bitrate || params->rc.i_rc_method != X264_RC_ABR))
+        return UBASE_ERR_INVALID;
+
+    if (params->rc.i_vbv_max_bitrate == params->rc.i_bitrate)
+        params->rc.i_vbv_max_bitrate = bitrate;
+    else if (params->rc.i_vbv_max_bitrate &&
+             bitrate > params->rc.i_vbv_max_bitrate)
+        bitrate = params->rc.i_vbv_max_bitrate;
+    params->rc.i_bitrate = bitrate;
+    if (upipe_x264->encoder == NULL)
+        return UBASE_ERR_NONE;
+    return _upipe_x264_reconfigure(upipe);
+}
+
+/** @internal @This reports the complexity of the last group of pictures,
+ * and starts a new one.
+ *
+ * @param upipe description structure of the pipe
+ * @param params current encoder parameters
+ */
+static void upipe_x264_report_complexity(struct upipe *upipe,
+                                         const x264_param_t *params)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    if (upipe_x264->gop_frames && params->i_fps_den)
+        upipe_throw_encoder_complexity(upipe,
+                upipe_x264->gop_complexity * params->i_fps_num /
+                ((uint64_t)params->i_fps_den * upipe_x264->gop_frames));
+    upipe_x264->gop_complexity = 0;
+    upipe_x264->gop_frames = 0;
+}
+
 /** @internal @This allocates a filter pipe.
  *
  * @param mgr common management structure
@@ -334,6 +454,8 @@ static struct upipe *upipe_x264_alloc(struct upipe_mgr *mgr,
 
     upipe_x264->last_dts = UINT64_MAX;
     upipe_x264->last_dts_sys = UINT64_MAX;
+    upipe_x264->gop_complexity = 0;
+    upipe_x264->gop_frames = 0;
 
     upipe_throw_ready(upipe);
     return upipe;
@@ -618,6 +740,14 @@ static void upipe_x264_input(struct upipe *upipe, struct uref *uref,
         size += nals[i].i_payload;
     }
 
+    /* intra refresh streams have no keyframes */
+    if (pic.b_keyframe ||
+        upipe_x264->gop_frames >= (unsigned int)curparams.i_keyint_max)
+        upipe_x264_report_complexity(upipe, &curparams);
+    /* H.264 quantizer step is 1 at QP 4 and doubles every 6 QPs */
+    upipe_x264->gop_complexity += size * exp2((pic.prop.f_crf_avg - 4) / 6);
+    upipe_x264->gop_frames++;
+
     /* alloc ubuf, map, copy, unmap */
     ubuf_block = ubuf_block_alloc(upipe_x264->ubuf_mgr, size);
     if (unlikely(ubuf_block == NULL)) {
@@ -887,6 +1017,25 @@ static int upipe_x264_control(struct upipe *upipe, int command, va_list args)
             uint64_t sc_latency = va_arg(args, uint64_t);
             return _upipe_x264_set_sc_latency(upipe, sc_latency);
         }
+        case UPIPE_X264_SET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_X264_SIGNATURE)
+            unsigned int threads = va_arg(args, unsigned int);
+            bool sliced = va_arg(args, int);
+            return _upipe_x264_set_threads(upipe, threads, sliced);
+        }
+        case UPIPE_X264_SET_LATENCY_MODE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_X264_SIGNATURE)
+            int mode = va_arg(args, int);
+            return _upipe_x264_set_latency_mode(upipe, mode);
+        }
+        case UPIPE_ENCODER_GET_OCTETRATE: {
+            uint64_t *octetrate_p = va_arg(args, uint64_t *);
+            return upipe_x264_get_octetrate(upipe, octetrate_p);
+        }
+        case UPIPE_ENCODER_SET_OCTETRATE: {
+            uint64_t octetrate = va_arg(args, uint64_t);
+            return upipe_x264_set_octetrate(upipe, octetrate);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -72,11 +72,19 @@ struct ubuf_block_mem_mgr {
     size_t align;
     /** alignment offset */
     int align_offset;
+    /** number of segments past which appended segments are coalesced */
+    unsigned int max_segments;
+    /** maximum size of coalesced segments */
+    unsigned int coalesce_size;
 
     /** ubuf pool */
     struct upool ubuf_pool;
     /** ubuf shared pool */
     struct upool shared_pool;
+    /** cache of the ubuf pool */
+    struct upool_cache ubuf_cache;
+    /** cache of the ubuf shared pool */
+    struct upool_cache shared_cache;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
@@ -91,18 +99,83 @@ UBASE_FROM_TO(ubuf_block_mem_mgr, ubuf_mgr, ubuf_mgr, mgr)
 UBASE_FROM_TO(ubuf_block_mem_mgr, urefcount, urefcount, urefcount)
 UBASE_FROM_TO(ubuf_block_mem_mgr, upool, ubuf_pool, ubuf_pool)
 
-UBUF_MEM_MGR_HELPER_POOL(ubuf_block_mem, ubuf_pool, shared_pool, shared)
+UBUF_MEM_MGR_HELPER_POOL(ubuf_block_mem, ubuf_pool, shared_pool, ubuf_cache,
+                         shared_cache, shared)
+
+/** @internal @This initializes a newly allocated ubuf with the coalescing
+ * policy of the manager.
+ *
+ * @param mgr common management structure
+ * @param ubuf pointer to ubuf
+ */
+static void ubuf_block_mem_init_coalesce(struct ubuf_mgr *mgr,
+                                         struct ubuf *ubuf)
+{
+    struct ubuf_block_mem_mgr *block_mem_mgr =
+        ubuf_block_mem_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
+    block->max_segments = block_mem_mgr->max_segments;
+    block->coalesce_size = block_mem_mgr->coalesce_size;
+}
+
+/** @internal @This allocates a ubuf and a shared structure around an
+ * existing umem.
+ *
+ * @param mgr common management structure
+ * @param umem pointer to the umem, moved to the shared structure
+ * @param offset offset of the data in the umem
+ * @param size size of the data
+ * @return pointer to ubuf or NULL in case of allocation error
+ */
+static struct ubuf *ubuf_block_mem_alloc_umem_internal(struct ubuf_mgr *mgr,
+                                                       struct umem *umem,
+                                                       int offset, int size)
+{
+    if (unlikely(offset < 0 || size < 0 ||
+                 (size_t)offset + size > umem_size(umem)))
+        return NULL;
+
+    struct ubuf_block_mem *block_mem = ubuf_block_mem_alloc_pool(mgr);
+    if (unlikely(block_mem == NULL))
+        return NULL;
+
+    struct ubuf *ubuf = ubuf_block_mem_to_ubuf(block_mem);
+    ubuf_block_common_init(ubuf, false);
+    ubuf_block_mem_init_coalesce(mgr, ubuf);
+
+    block_mem->shared = ubuf_block_mem_shared_alloc_pool(mgr);
+    if (unlikely(block_mem->shared == NULL)) {
+        ubuf_block_mem_free_pool(mgr, block_mem);
+        return NULL;
+    }
+    block_mem->shared->umem = *umem;
+
+    ubuf_block_common_set(ubuf, offset, size);
+    ubuf_block_common_set_buffer(ubuf,
+                                 ubuf_mem_shared_buffer(block_mem->shared));
+
+    ubuf_mgr_use(mgr);
+    return ubuf;
+}
 
 /** @This allocates a ubuf, a shared structure and a umem buffer.
  *
  * @param mgr common management structure
- * @param alloc_type must be UBUF_ALLOC_BLOCK (sentinel)
- * @param args optional arguments (1st = size)
+ * @param alloc_type must be UBUF_ALLOC_BLOCK (sentinel) or
+ * UBUF_ALLOC_BLOCK_UMEM
+ * @param args optional arguments (1st = size, or 1st = umem, 2nd = offset,
+ * 3rd = size)
  * @return pointer to ubuf or NULL in case of allocation error
  */
 static struct ubuf *ubuf_block_mem_alloc(struct ubuf_mgr *mgr,
                                          uint32_t signature, va_list args)
 {
+    if (signature == UBUF_ALLOC_BLOCK_UMEM) {
+        struct umem *umem = va_arg(args, struct umem *);
+        int offset = va_arg(args, int);
+        int size = va_arg(args, int);
+        return ubuf_block_mem_alloc_umem_internal(mgr, umem, offset, size);
+    }
     if (unlikely(signature != UBUF_ALLOC_BLOCK))
         return NULL;
 
@@ -117,6 +190,7 @@ static struct ubuf *ubuf_block_mem_alloc(struct ubuf_mgr *mgr,
 
     struct ubuf *ubuf = ubuf_block_mem_to_ubuf(block_mem);
     ubuf_block_common_init(ubuf, false);
+    ubuf_block_mem_init_coalesce(mgr, ubuf);
 
     block_mem->shared = ubuf_block_mem_shared_alloc_pool(mgr);
     if (unlikely(block_mem->shared == NULL)) {
@@ -338,6 +412,29 @@ static int ubuf_block_mem_mgr_control(struct ubuf_mgr *mgr,
             ubuf_block_mem_mgr_vacuum_pool(mgr);
             return UBASE_ERR_NONE;
         }
+        case UBUF_MGR_GET_POOL_STATS: {
+            struct upool_stats *ubuf_stats_p =
+                va_arg(args, struct upool_stats *);
+            struct upool_stats *shared_stats_p =
+                va_arg(args, struct upool_stats *);
+            ubuf_block_mem_mgr_stats_pool(mgr, ubuf_stats_p, shared_stats_p);
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_MGR_RESIZE_POOL: {
+            unsigned int ubuf_pool_depth = va_arg(args, unsigned int);
+            unsigned int shared_pool_depth = va_arg(args, unsigned int);
+            ubuf_block_mem_mgr_resize_pool(mgr, ubuf_pool_depth,
+                    shared_pool_depth);
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_BLOCK_MEM_MGR_SET_COALESCE: {
+            UBASE_SIGNATURE_CHECK(args, UBUF_ALLOC_BLOCK)
+            struct ubuf_block_mem_mgr *block_mem_mgr =
+                ubuf_block_mem_mgr_from_ubuf_mgr(mgr);
+            block_mem_mgr->max_segments = va_arg(args, unsigned int);
+            block_mem_mgr->coalesce_size = va_arg(args, unsigned int);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -393,6 +490,8 @@ struct ubuf_mgr *ubuf_block_mem_mgr_alloc(uint16_t ubuf_pool_depth,
 
     block_mem_mgr->align = align > 0 ? align : UBUF_DEFAULT_ALIGN;
     block_mem_mgr->align_offset = align_offset;
+    block_mem_mgr->max_segments = UBUF_BLOCK_MEM_DEF_MAX_SEGMENTS;
+    block_mem_mgr->coalesce_size = UBUF_BLOCK_MEM_DEF_COALESCE_SIZE;
 
     urefcount_init(ubuf_block_mem_mgr_to_urefcount(block_mem_mgr),
                    ubuf_block_mem_mgr_free);
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ubuf manager for block formats mapping files in memory
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/urefcount.h>
+#include <upipe/upool.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_common.h>
+#include <upipe/ubuf_block_mmap.h>
+#include <upipe/ubuf_mem_common.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <assert.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#   define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/** @This is a super-set of the @ref ubuf (and @ref ubuf_block)
+ * structure with private fields pointing to shared data. */
+struct ubuf_block_mmap {
+    /** pointer to shared structure (the umem points to the mapping) */
+    struct ubuf_mem_shared *shared;
+
+    /** block structure */
+    struct ubuf_block ubuf_block;
+};
+
+UBASE_FROM_TO(ubuf_block_mmap, ubuf, ubuf, ubuf_block.ubuf)
+
+/** @This is a super-set of the ubuf_mgr structure with additional local
+ * members. */
+struct ubuf_block_mmap_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** size of a page, to which file offsets must be aligned */
+    uint64_t page_size;
+
+    /** ubuf pool */
+    struct upool ubuf_pool;
+    /** ubuf shared pool */
+    struct upool shared_pool;
+    /** cache of the ubuf pool */
+    struct upool_cache ubuf_cache;
+    /** cache of the ubuf shared pool */
+    struct upool_cache shared_cache;
+
+    /** common management structure */
+    struct ubuf_mgr mgr;
+
+    /** extra space for upool */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(ubuf_block_mmap_mgr, ubuf_mgr, ubuf_mgr, mgr)
+UBASE_FROM_TO(ubuf_block_mmap_mgr, urefcount, urefcount, urefcount)
+UBASE_FROM_TO(ubuf_block_mmap_mgr, upool, ubuf_pool, ubuf_pool)
+
+UBUF_MEM_MGR_HELPER_POOL(ubuf_block_mmap, ubuf_pool, shared_pool, ubuf_cache,
+                         shared_cache, shared)
+
+/** @This allocates a ubuf and a shared structure, and maps the buffer.
+ *
+ * @param mgr common management structure
+ * @param alloc_type UBUF_ALLOC_BLOCK_MMAP or UBUF_ALLOC_BLOCK (sentinel)
+ * @param args optional arguments (fd, offset and size, or only size)
+ * @return pointer to ubuf or NULL in case of allocation error
+ */
+static struct ubuf *ubuf_block_mmap_alloc_ubuf(struct ubuf_mgr *mgr,
+                                               uint32_t signature,
+                                               va_list args)
+{
+    struct ubuf_block_mmap_mgr *block_mmap_mgr =
+        ubuf_block_mmap_mgr_from_ubuf_mgr(mgr);
+    int fd = -1;
+    uint64_t offset = 0;
+    int size;
+    switch (signature) {
+        case UBUF_ALLOC_BLOCK_MMAP:
+            fd = va_arg(args, int);
+            offset = va_arg(args, uint64_t);
+            size = va_arg(args, int);
+            if (unlikely(fd == -1 || size <= 0))
+                return NULL;
+            break;
+        case UBUF_ALLOC_BLOCK:
+            size = va_arg(args, int);
+            assert(size >= 0);
+            break;
+        default:
+            return NULL;
+    }
+
+    /* mappings must start on a page boundary */
+    size_t delta = offset % block_mmap_mgr->page_size;
+    size_t length = delta + size;
+    uint8_t *buffer;
+    if (fd != -1)
+        buffer = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                      offset - delta);
+    else {
+        if (!length)
+            length = 1;
+        buffer = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (unlikely(buffer == MAP_FAILED))
+        return NULL;
+
+    if (fd != -1) {
+#ifdef MADV_SEQUENTIAL
+        madvise(buffer, length, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+        madvise(buffer, length, MADV_WILLNEED);
+#endif
+    }
+
+    struct ubuf_block_mmap *block_mmap = ubuf_block_mmap_alloc_pool(mgr);
+    if (unlikely(block_mmap == NULL)) {
+        munmap(buffer, length);
+        return NULL;
+    }
+
+    struct ubuf *ubuf = ubuf_block_mmap_to_ubuf(block_mmap);
+    ubuf_block_common_init(ubuf, false);
+
+    block_mmap->shared = ubuf_block_mmap_shared_alloc_pool(mgr);
+    if (unlikely(block_mmap->shared == NULL)) {
+        ubuf_block_mmap_free_pool(mgr, block_mmap);
+        munmap(buffer, length);
+        return NULL;
+    }
+    block_mmap->shared->umem.mgr = NULL;
+    block_mmap->shared->umem.buffer = buffer;
+    block_mmap->shared->umem.size = length;
+    block_mmap->shared->umem.real_size = length;
+
+    ubuf_block_common_set(ubuf, delta, size);
+    ubuf_block_common_set_buffer(ubuf, buffer);
+
+    ubuf_mgr_use(mgr);
+    return ubuf;
+}
+
+/** @This asks for the creation of a new reference to the same buffer space.
+ *
+ * @param ubuf pointer to ubuf
+ * @param new_ubuf_p reference written with a pointer to the newly allocated
+ * ubuf
+ * @return an error code
+ */
+static int ubuf_block_mmap_dup(struct ubuf *ubuf, struct ubuf **new_ubuf_p)
+{
+    assert(new_ubuf_p != NULL);
+    struct ubuf_block_mmap *new_block = ubuf_block_mmap_alloc_pool(ubuf->mgr);
+    if (unlikely(new_block == NULL))
+        return UBASE_ERR_ALLOC;
+
+    struct ubuf *new_ubuf = ubuf_block_mmap_to_ubuf(new_block);
+    ubuf_block_common_init(new_ubuf, false);
+    if (unlikely(!ubase_check(ubuf_block_common_dup(ubuf, new_ubuf)))) {
+        ubuf_free(new_ubuf);
+        return UBASE_ERR_INVALID;
+    }
+    *new_ubuf_p = new_ubuf;
+
+    struct ubuf_block_mmap *block_mmap = ubuf_block_mmap_from_ubuf(ubuf);
+    new_block->shared = ubuf_mem_shared_use(block_mmap->shared);
+    ubuf_mgr_use(new_ubuf->mgr);
+    return UBASE_ERR_NONE;
+}
+
+/** @This checks whether there is only one reference to the shared buffer.
+ *
+ * @param ubuf pointer to ubuf
+ * @return an error code
+ */
+static int ubuf_block_mmap_single(struct ubuf *ubuf)
+{
+    struct ubuf_block_mmap *block_mmap = ubuf_block_mmap_from_ubuf(ubuf);
+    return ubuf_mem_shared_single(block_mmap->shared) ?
+           UBASE_ERR_NONE : UBASE_ERR_BUSY;
+}
+
+/** @This asks for the creation of a new reference to the same buffer space.
+ *
+ * @param ubuf pointer to ubuf
+ * @param new_ubuf_p reference written with a pointer to the newly allocated
+ * ubuf
+ * @param offset offset in the buffer
+ * @param size final size of the buffer
+ * @return an error code
+ */
+static int ubuf_block_mmap_splice(struct ubuf *ubuf, struct ubuf **new_ubuf_p,
+                                  int offset, int size)
+{
+    assert(new_ubuf_p != NULL);
+    struct ubuf_block_mmap *new_block = ubuf_block_mmap_alloc_pool(ubuf->mgr);
+    if (unlikely(new_block == NULL))
+        return UBASE_ERR_ALLOC;
+
+    struct ubuf *new_ubuf = ubuf_block_mmap_to_ubuf(new_block);
+    ubuf_block_common_init(new_ubuf, false);
+    if (unlikely(!ubase_check(ubuf_block_common_splice(ubuf, new_ubuf,
+                                                       offset, size)))) {
+        ubuf_free(new_ubuf);
+        return UBASE_ERR_INVALID;
+    }
+    *new_ubuf_p = new_ubuf;
+
+    struct ubuf_block_mmap *block_mmap = ubuf_block_mmap_from_ubuf(ubuf);
+    new_block->shared = ubuf_mem_shared_use(block_mmap->shared);
+    ubuf_mgr_use(new_ubuf->mgr);
+    return UBASE_ERR_NONE;
+}
+
+/** @This handles control commands.
+ *
+ * @param ubuf pointer to ubuf
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int ubuf_block_mmap_control(struct ubuf *ubuf, int command,
+                                   va_list args)
+{
+    switch (command) {
+        case UBUF_DUP: {
+            struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
+            return ubuf_block_mmap_dup(ubuf, new_ubuf_p);
+        }
+        case UBUF_SINGLE:
+            return ubuf_block_mmap_single(ubuf);
+
+        case UBUF_SPLICE_BLOCK: {
+            struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
+            int offset = va_arg(args, int);
+            int size = va_arg(args, int);
+            return ubuf_block_mmap_splice(ubuf, new_ubuf_p, offset, size);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This recycles or frees a ubuf, and unmaps the buffer when the last
+ * reference is released.
+ *
+ * @param ubuf pointer to a ubuf structure
+ */
+static void ubuf_block_mmap_free(struct ubuf *ubuf)
+{
+    struct ubuf_mgr *mgr = ubuf->mgr;
+    struct ubuf_block_mmap *block_mmap = ubuf_block_mmap_from_ubuf(ubuf);
+
+    ubuf_block_common_clean(ubuf);
+
+    if (unlikely(ubuf_mem_shared_release(block_mmap->shared))) {
+        munmap(ubuf_mem_shared_buffer(block_mmap->shared),
+               ubuf_mem_shared_size(block_mmap->shared));
+        ubuf_block_mmap_shared_free_pool(mgr, block_mmap->shared);
+    }
+    ubuf_block_mmap_free_pool(mgr, block_mmap);
+    ubuf_mgr_release(mgr);
+}
+
+/** @internal @This allocates the data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to ubuf_block_mmap or NULL in case of allocation error
+ */
+static void *ubuf_block_mmap_alloc_inner(struct upool *upool)
+{
+    struct ubuf_block_mmap_mgr *block_mmap_mgr =
+        ubuf_block_mmap_mgr_from_ubuf_pool(upool);
+    struct ubuf_block_mmap *block_mmap =
+        malloc(sizeof(struct ubuf_block_mmap));
+    struct ubuf_mgr *mgr = ubuf_block_mmap_mgr_to_ubuf_mgr(block_mmap_mgr);
+    if (unlikely(block_mmap == NULL))
+        return NULL;
+    struct ubuf *ubuf = ubuf_block_mmap_to_ubuf(block_mmap);
+    ubuf->mgr = mgr;
+    return block_mmap;
+}
+
+/** @internal @This frees a ubuf_block_mmap.
+ *
+ * @param upool pointer to upool
+ * @param _block_mmap pointer to a ubuf_block_mmap structure to free
+ */
+static void ubuf_block_mmap_free_inner(struct upool *upool, void *_block_mmap)
+{
+    struct ubuf_block_mmap *block_mmap =
+        (struct ubuf_block_mmap *)_block_mmap;
+    free(block_mmap);
+}
+
+/** @This checks if the given flow format can be allocated with the manager.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param flow_format flow format to check
+ * @return an error code
+ */
+static int ubuf_block_mmap_mgr_check(struct ubuf_mgr *mgr,
+                                     struct uref *flow_format)
+{
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_format, &def))
+    if (ubase_ncmp(def, "block."))
+        return UBASE_ERR_INVALID;
+
+    uint64_t align = 0;
+    int64_t align_offset = 0;
+    uref_block_flow_get_align(flow_format, &align);
+    uref_block_flow_get_align_offset(flow_format, &align_offset);
+
+    /* anonymous mappings are page-aligned */
+    struct ubuf_block_mmap_mgr *block_mmap_mgr =
+        ubuf_block_mmap_mgr_from_ubuf_mgr(mgr);
+    if (align && (block_mmap_mgr->page_size % align || align_offset))
+        return UBASE_ERR_INVALID;
+    return UBASE_ERR_NONE;
+}
+
+/** @This handles manager control commands.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int ubuf_block_mmap_mgr_control(struct ubuf_mgr *mgr,
+                                       int command, va_list args)
+{
+    switch (command) {
+        case UBUF_MGR_CHECK: {
+            struct uref *flow_format = va_arg(args, struct uref *);
+            return ubuf_block_mmap_mgr_check(mgr, flow_format);
+        }
+        case UBUF_MGR_VACUUM: {
+            ubuf_block_mmap_mgr_vacuum_pool(mgr);
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_MGR_GET_POOL_STATS: {
+            struct upool_stats *ubuf_stats_p =
+                va_arg(args, struct upool_stats *);
+            struct upool_stats *shared_stats_p =
+                va_arg(args, struct upool_stats *);
+            ubuf_block_mmap_mgr_stats_pool(mgr, ubuf_stats_p, shared_stats_p);
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_MGR_RESIZE_POOL: {
+            unsigned int ubuf_pool_depth = va_arg(args, unsigned int);
+            unsigned int shared_pool_depth = va_arg(args, unsigned int);
+            ubuf_block_mmap_mgr_resize_pool(mgr, ubuf_pool_depth,
+                    shared_pool_depth);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a ubuf manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void ubuf_block_mmap_mgr_free(struct urefcount *urefcount)
+{
+    struct ubuf_block_mmap_mgr *block_mmap_mgr =
+        ubuf_block_mmap_mgr_from_urefcount(urefcount);
+    struct ubuf_mgr *mgr = ubuf_block_mmap_mgr_to_ubuf_mgr(block_mmap_mgr);
+    ubuf_block_mmap_mgr_clean_pool(mgr);
+
+    urefcount_clean(urefcount);
+    free(block_mmap_mgr);
+}
+
+/** @This allocates a new instance of the ubuf manager for block formats
+ * mapping files in memory.
+ *
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param shared_pool_depth maximum number of shared structures in the pool
+ * @return pointer to manager, or NULL in case of error
+ */
+struct ubuf_mgr *ubuf_block_mmap_mgr_alloc(uint16_t ubuf_pool_depth,
+                                           uint16_t shared_pool_depth)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (unlikely(page_size <= 0))
+        return NULL;
+
+    struct ubuf_block_mmap_mgr *block_mmap_mgr =
+        malloc(sizeof(struct ubuf_block_mmap_mgr) +
+               ubuf_block_mmap_mgr_sizeof_pool(ubuf_pool_depth,
+                                               shared_pool_depth));
+    if (unlikely(block_mmap_mgr == NULL))
+        return NULL;
+
+    ubuf_block_mmap_mgr_init_pool(
+            ubuf_block_mmap_mgr_to_ubuf_mgr(block_mmap_mgr),
+            ubuf_pool_depth, shared_pool_depth, block_mmap_mgr->upool_extra,
+            ubuf_block_mmap_alloc_inner, ubuf_block_mmap_free_inner);
+
+    block_mmap_mgr->page_size = page_size;
+
+    urefcount_init(ubuf_block_mmap_mgr_to_urefcount(block_mmap_mgr),
+                   ubuf_block_mmap_mgr_free);
+    block_mmap_mgr->mgr.refcount =
+        ubuf_block_mmap_mgr_to_urefcount(block_mmap_mgr);
+    block_mmap_mgr->mgr.signature = UBUF_ALLOC_BLOCK;
+    block_mmap_mgr->mgr.ubuf_alloc = ubuf_block_mmap_alloc_ubuf;
+    block_mmap_mgr->mgr.ubuf_control = ubuf_block_mmap_control;
+    block_mmap_mgr->mgr.ubuf_free = ubuf_block_mmap_free;
+    block_mmap_mgr->mgr.ubuf_mgr_control = ubuf_block_mmap_mgr_control;
+
+    return ubuf_block_mmap_mgr_to_ubuf_mgr(block_mmap_mgr);
+}
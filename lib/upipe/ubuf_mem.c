@@ -92,6 +92,11 @@ struct ubuf_mgr *ubuf_mem_mgr_alloc_from_flow_def(uint16_t ubuf_pool_depth,
                 vprepend, vappend, align, align_hmoffset);
         if (unlikely(mgr == NULL))
             return NULL;
+        if (ubase_check(uref_pic_flow_get_cache_aligned(flow_def)) &&
+            unlikely(!ubase_check(ubuf_pic_mem_mgr_set_cache_aligned(mgr)))) {
+            ubuf_mgr_release(mgr);
+            return NULL;
+        }
 
         for (uint8_t plane = 0; plane < planes; plane++) {
             const char *chroma;
@@ -129,6 +134,14 @@ struct ubuf_mgr *ubuf_mem_mgr_alloc_from_flow_def(uint16_t ubuf_pool_depth,
                 shared_pool_depth, umem_mgr, sample_size, align);
         if (unlikely(mgr == NULL))
             return NULL;
+        uint64_t vector_size;
+        if (ubase_check(uref_sound_flow_get_vector_size(flow_def,
+                                                        &vector_size)) &&
+            unlikely(!ubase_check(ubuf_sound_mem_mgr_set_vector_size(mgr,
+                                                        vector_size)))) {
+            ubuf_mgr_release(mgr);
+            return NULL;
+        }
 
         for (uint8_t plane = 0; plane < planes; plane++) {
             const char *channel;
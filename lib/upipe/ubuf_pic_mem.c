@@ -57,6 +57,8 @@
 #define UBUF_DEFAULT_VAPPEND        2
 /** default alignment in octets */
 #define UBUF_DEFAULT_ALIGN          0
+/** minimum alignment in octets of the cache-aligned layout */
+#define UBUF_CACHE_LINE             64
 
 /** @This is a super-set of the @ref ubuf (and @ref ubuf_pic_common)
  * structure with private fields pointing to shared data. */
@@ -93,11 +95,17 @@ struct ubuf_pic_mem_mgr {
     size_t align;
     /** horizontal offset for the aligned macropixel */
     int align_hmoffset;
+    /** true if lines and margins are aligned on cache lines */
+    bool cache_aligned;
 
     /** ubuf pool */
     struct upool ubuf_pool;
     /** ubuf shared pool */
     struct upool shared_pool;
+    /** cache of the ubuf pool */
+    struct upool_cache ubuf_cache;
+    /** cache of the ubuf shared pool */
+    struct upool_cache shared_cache;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
@@ -112,18 +120,136 @@ UBASE_FROM_TO(ubuf_pic_mem_mgr, ubuf_mgr, ubuf_mgr, common_mgr.mgr)
 UBASE_FROM_TO(ubuf_pic_mem_mgr, urefcount, urefcount, urefcount)
 UBASE_FROM_TO(ubuf_pic_mem_mgr, upool, ubuf_pool, ubuf_pool)
 
-UBUF_MEM_MGR_HELPER_POOL(ubuf_pic_mem, ubuf_pool, shared_pool, shared)
+UBUF_MEM_MGR_HELPER_POOL(ubuf_pic_mem, ubuf_pool, shared_pool, ubuf_cache,
+                         shared_cache, shared)
+
+/** @internal @This returns the layout of the buffers of a manager, taking
+ * into account the cache-aligned layout.
+ *
+ * @param pic_mgr pointer to a ubuf_pic_mem_mgr structure
+ * @param align_p filled in with the alignment in octets
+ * @param hmprepend_p filled in with the extra macropixels before lines
+ * @param hmappend_p filled in with the extra macropixels after lines
+ */
+static void ubuf_pic_mem_mgr_layout(struct ubuf_pic_mem_mgr *pic_mgr,
+                                    size_t *align_p, size_t *hmprepend_p,
+                                    size_t *hmappend_p)
+{
+    *align_p = pic_mgr->align;
+    *hmprepend_p = pic_mgr->hmprepend;
+    *hmappend_p = pic_mgr->hmappend;
+    if (!pic_mgr->cache_aligned)
+        return;
+
+    size_t align = pic_mgr->align ?
+        pic_mgr->align / ubase_gcd(pic_mgr->align, UBUF_CACHE_LINE) *
+        UBUF_CACHE_LINE : UBUF_CACHE_LINE;
+    /* smallest number of macropixels spanning whole multiples of the
+     * alignment in all planes */
+    size_t hmunit = 1;
+    for (uint8_t plane = 0; plane < pic_mgr->common_mgr.nb_planes; plane++) {
+        struct ubuf_pic_common_mgr_plane *p = pic_mgr->common_mgr.planes[plane];
+        size_t unit = p->hsub * (align / ubase_gcd(align, p->macropixel_size));
+        hmunit = hmunit / ubase_gcd(hmunit, unit) * unit;
+    }
+    *align_p = align;
+    *hmprepend_p = (pic_mgr->hmprepend + hmunit - 1) / hmunit * hmunit;
+    *hmappend_p = (pic_mgr->hmappend + hmunit - 1) / hmunit * hmunit;
+}
+
+/** @internal @This allocates a ubuf and a shared structure around planes
+ * laid out in an existing umem.
+ *
+ * @param mgr common management structure
+ * @param umem pointer to the umem, moved to the shared structure
+ * @param hsize horizontal size in pixels
+ * @param vsize vertical size in lines
+ * @param nb_planes number of planes described
+ * @param chromas chroma type of each plane
+ * @param offsets offset of the first pixel of each plane in the umem
+ * @param strides stride of each plane
+ * @return pointer to ubuf or NULL in case of allocation error
+ */
+static struct ubuf *ubuf_pic_mem_alloc_umem_internal(struct ubuf_mgr *mgr,
+        struct umem *umem, int hsize, int vsize, unsigned int nb_planes,
+        const char * const *chromas, const size_t *offsets,
+        const size_t *strides)
+{
+    struct ubuf_pic_mem_mgr *pic_mgr = ubuf_pic_mem_mgr_from_ubuf_mgr(mgr);
+    if (unlikely(!ubase_check(ubuf_pic_common_check_size(mgr, hsize, vsize)) ||
+                 nb_planes != pic_mgr->common_mgr.nb_planes))
+        return NULL;
+
+    size_t hmsize = hsize / pic_mgr->common_mgr.macropixel;
+    int described[nb_planes];
+    for (uint8_t plane = 0; plane < nb_planes; plane++)
+        described[plane] = -1;
+    for (unsigned int i = 0; i < nb_planes; i++) {
+        int plane = ubuf_pic_common_plane(mgr, chromas[i]);
+        if (unlikely(plane < 0 || described[plane] != -1))
+            return NULL;
+        described[plane] = i;
+
+        struct ubuf_pic_common_mgr_plane *p =
+            pic_mgr->common_mgr.planes[plane];
+        size_t line = hmsize / p->hsub * p->macropixel_size;
+        size_t lines = vsize / p->vsub;
+        if (unlikely(!strides[i] || strides[i] < line ||
+                     offsets[i] > umem_size(umem)))
+            return NULL;
+        size_t room = umem_size(umem) - offsets[i];
+        if (unlikely(lines && (room < line ||
+                               (room - line) / strides[i] < lines - 1)))
+            return NULL;
+    }
+
+    struct ubuf_pic_mem *pic_mem = ubuf_pic_mem_alloc_pool(mgr);
+    if (unlikely(pic_mem == NULL))
+        return NULL;
+
+    struct ubuf *ubuf = ubuf_pic_mem_to_ubuf(pic_mem);
+
+    pic_mem->shared = ubuf_pic_mem_shared_alloc_pool(mgr);
+    if (unlikely(pic_mem->shared == NULL)) {
+        ubuf_pic_mem_free_pool(mgr, pic_mem);
+        return NULL;
+    }
+    pic_mem->shared->umem = *umem;
+
+    ubuf_pic_common_init(ubuf, 0, 0, hmsize, 0, 0, vsize);
+    uint8_t *buffer = ubuf_mem_shared_buffer(pic_mem->shared);
+    for (uint8_t plane = 0; plane < nb_planes; plane++)
+        ubuf_pic_common_plane_init(ubuf, plane,
+                                   buffer + offsets[described[plane]],
+                                   strides[described[plane]]);
+
+    ubuf_mgr_use(mgr);
+    return ubuf;
+}
 
 /** @This allocates a ubuf, a shared structure and a umem buffer.
  *
  * @param mgr common management structure
- * @param alloc_type must be UBUF_ALLOC_PICTURE (sentinel)
- * @param args optional arguments (1st = hsize, 2nd = vsize)
+ * @param alloc_type must be UBUF_ALLOC_PICTURE (sentinel) or
+ * UBUF_ALLOC_PICTURE_UMEM
+ * @param args optional arguments (1st = hsize, 2nd = vsize, or see
+ * @ref ubuf_pic_mem_alloc_umem)
  * @return pointer to ubuf or NULL in case of allocation error
  */
 static struct ubuf *ubuf_pic_mem_alloc(struct ubuf_mgr *mgr,
                                        uint32_t signature, va_list args)
 {
+    if (signature == UBUF_ALLOC_PICTURE_UMEM) {
+        struct umem *umem = va_arg(args, struct umem *);
+        int hsize = va_arg(args, int);
+        int vsize = va_arg(args, int);
+        unsigned int nb_planes = va_arg(args, unsigned int);
+        const char * const *chromas = va_arg(args, const char * const *);
+        const size_t *offsets = va_arg(args, const size_t *);
+        const size_t *strides = va_arg(args, const size_t *);
+        return ubuf_pic_mem_alloc_umem_internal(mgr, umem, hsize, vsize,
+                nb_planes, chromas, offsets, strides);
+    }
     if (unlikely(signature != UBUF_ALLOC_PICTURE))
         return NULL;
 
@@ -146,19 +272,22 @@ static struct ubuf *ubuf_pic_mem_alloc(struct ubuf_mgr *mgr,
         return NULL;
     }
 
+    size_t mgr_align, hmprepend, hmappend;
+    ubuf_pic_mem_mgr_layout(pic_mgr, &mgr_align, &hmprepend, &hmappend);
+
     size_t hmsize = hsize / pic_mgr->common_mgr.macropixel;
     size_t buffer_size = 0;
     size_t plane_sizes[pic_mgr->common_mgr.nb_planes];
     size_t strides[pic_mgr->common_mgr.nb_planes];
     for (uint8_t plane = 0; plane < pic_mgr->common_mgr.nb_planes; plane++) {
         size_t align = 0;
-        if (pic_mgr->align &&
-                ((hmsize + pic_mgr->hmprepend + pic_mgr->hmappend) /
+        if (mgr_align &&
+                ((hmsize + hmprepend + hmappend) /
                     pic_mgr->common_mgr.planes[plane]->hsub *
                     pic_mgr->common_mgr.planes[plane]->macropixel_size) %
-                        pic_mgr->align)
-            align = pic_mgr->align;
-        strides[plane] = (hmsize + pic_mgr->hmprepend + pic_mgr->hmappend) /
+                        mgr_align)
+            align = mgr_align;
+        strides[plane] = (hmsize + hmprepend + hmappend) /
                             pic_mgr->common_mgr.planes[plane]->hsub *
                             pic_mgr->common_mgr.planes[plane]->macropixel_size +
                          align;
@@ -166,7 +295,7 @@ static struct ubuf *ubuf_pic_mem_alloc(struct ubuf_mgr *mgr,
             strides[plane] -= strides[plane] % align;
         plane_sizes[plane] = (vsize + pic_mgr->vprepend + pic_mgr->vappend) /
                                  pic_mgr->common_mgr.planes[plane]->vsub *
-                                 strides[plane] + pic_mgr->align;
+                                 strides[plane] + mgr_align;
         buffer_size += plane_sizes[plane];
     }
 
@@ -176,19 +305,19 @@ static struct ubuf *ubuf_pic_mem_alloc(struct ubuf_mgr *mgr,
         ubuf_pic_mem_free_pool(mgr, pic_mem);
         return NULL;
     }
-    ubuf_pic_common_init(ubuf, pic_mgr->hmprepend, pic_mgr->hmappend, hmsize,
+    ubuf_pic_common_init(ubuf, hmprepend, hmappend, hmsize,
                          pic_mgr->vprepend, pic_mgr->vappend, vsize);
 
     uint8_t *buffer = ubuf_mem_shared_buffer(pic_mem->shared);
     for (uint8_t plane = 0; plane < pic_mgr->common_mgr.nb_planes; plane++) {
-        uint8_t *plane_buffer = buffer + pic_mgr->align;
-        if (pic_mgr->align)
+        uint8_t *plane_buffer = buffer + mgr_align;
+        if (mgr_align)
             plane_buffer -=
                 ((uintptr_t)plane_buffer +
-                 (pic_mgr->align_hmoffset + pic_mgr->hmprepend) /
+                 (pic_mgr->align_hmoffset + hmprepend) /
                     pic_mgr->common_mgr.planes[plane]->hsub *
                     pic_mgr->common_mgr.planes[plane]->macropixel_size) %
-                pic_mgr->align;
+                mgr_align;
         ubuf_pic_common_plane_init(ubuf, plane, plane_buffer, strides[plane]);
         buffer += plane_sizes[plane];
     }
@@ -246,6 +375,11 @@ static int ubuf_pic_mem_control(struct ubuf *ubuf, int command, va_list args)
             struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
             return ubuf_pic_mem_dup(ubuf, new_ubuf_p);
         }
+        case UBUF_SINGLE: {
+            struct ubuf_pic_mem *pic = ubuf_pic_mem_from_ubuf(ubuf);
+            return ubuf_mem_shared_single(pic->shared) ?
+                   UBASE_ERR_NONE : UBASE_ERR_BUSY;
+        }
         case UBUF_SIZE_PICTURE: {
             size_t *hsize_p = va_arg(args, size_t *);
             size_t *vsize_p = va_arg(args, size_t *);
@@ -431,6 +565,9 @@ static int ubuf_pic_mem_mgr_check(struct ubuf_mgr *mgr,
     if (align && (pic_mgr->align % align ||
                   pic_mgr->align_hmoffset != align_hmoffset))
         return UBASE_ERR_INVALID;
+    if (pic_mgr->cache_aligned !=
+            ubase_check(uref_pic_flow_get_cache_aligned(flow_format)))
+        return UBASE_ERR_INVALID;
 
     for (uint8_t i = 0; i < planes; i++) {
         struct ubuf_pic_common_mgr_plane *plane = common_mgr->planes[i];
@@ -469,6 +606,21 @@ static int ubuf_pic_mem_mgr_control(struct ubuf_mgr *mgr,
             ubuf_pic_mem_mgr_vacuum_pool(mgr);
             return UBASE_ERR_NONE;
         }
+        case UBUF_MGR_GET_POOL_STATS: {
+            struct upool_stats *ubuf_stats_p =
+                va_arg(args, struct upool_stats *);
+            struct upool_stats *shared_stats_p =
+                va_arg(args, struct upool_stats *);
+            ubuf_pic_mem_mgr_stats_pool(mgr, ubuf_stats_p, shared_stats_p);
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_MGR_RESIZE_POOL: {
+            unsigned int ubuf_pool_depth = va_arg(args, unsigned int);
+            unsigned int shared_pool_depth = va_arg(args, unsigned int);
+            ubuf_pic_mem_mgr_resize_pool(mgr, ubuf_pool_depth,
+                    shared_pool_depth);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -550,6 +702,7 @@ struct ubuf_mgr *ubuf_pic_mem_mgr_alloc(uint16_t ubuf_pool_depth,
     pic_mgr->vappend = vappend >= 0 ? vappend : UBUF_DEFAULT_VAPPEND;
     pic_mgr->align = align >= 0 ? align : UBUF_DEFAULT_ALIGN;
     pic_mgr->align_hmoffset = align_hmoffset;
+    pic_mgr->cache_aligned = false;
 
     urefcount_init(ubuf_pic_mem_mgr_to_urefcount(pic_mgr),
                    ubuf_pic_mem_mgr_free);
@@ -586,6 +739,26 @@ int ubuf_pic_mem_mgr_add_plane(struct ubuf_mgr *mgr, const char *chroma,
                                          macropixel_size);
 }
 
+/** @This switches a ubuf manager for picture formats using umem to a
+ * cache-aligned layout. It may only be called on initializing the manager,
+ * before any ubuf is allocated.
+ *
+ * @param mgr pointer to a ubuf_mgr structure
+ * @return an error code
+ */
+int ubuf_pic_mem_mgr_set_cache_aligned(struct ubuf_mgr *mgr)
+{
+    assert(mgr != NULL);
+    if (unlikely(mgr->signature != UBUF_ALLOC_PICTURE ||
+                 mgr->ubuf_alloc != ubuf_pic_mem_alloc))
+        return UBASE_ERR_INVALID;
+    ubuf_pic_mem_mgr_vacuum_pool(mgr);
+
+    struct ubuf_pic_mem_mgr *pic_mgr = ubuf_pic_mem_mgr_from_ubuf_mgr(mgr);
+    pic_mgr->cache_aligned = true;
+    return UBASE_ERR_NONE;
+}
+
 /** @This allocates a new instance of the ubuf manager for picture formats
  * using umem, from a fourcc image format.
  *
@@ -75,11 +75,17 @@ struct ubuf_sound_mem_mgr {
 
     /** alignment in octets */
     size_t align;
+    /** size of SIMD vectors in octets, or 0 */
+    size_t vector_size;
 
     /** ubuf pool */
     struct upool ubuf_pool;
     /** ubuf shared pool */
     struct upool shared_pool;
+    /** cache of the ubuf pool */
+    struct upool_cache ubuf_cache;
+    /** cache of the ubuf shared pool */
+    struct upool_cache shared_cache;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
@@ -94,7 +100,8 @@ UBASE_FROM_TO(ubuf_sound_mem_mgr, ubuf_mgr, ubuf_mgr, common_mgr.mgr)
 UBASE_FROM_TO(ubuf_sound_mem_mgr, urefcount, urefcount, urefcount)
 UBASE_FROM_TO(ubuf_sound_mem_mgr, upool, ubuf_pool, ubuf_pool)
 
-UBUF_MEM_MGR_HELPER_POOL(ubuf_sound_mem, ubuf_pool, shared_pool, shared)
+UBUF_MEM_MGR_HELPER_POOL(ubuf_sound_mem, ubuf_pool, shared_pool, ubuf_cache,
+                         shared_cache, shared)
 
 /** @This allocates a ubuf, a shared structure and a umem buffer.
  *
@@ -152,6 +159,14 @@ static struct ubuf *ubuf_sound_mem_alloc(struct ubuf_mgr *mgr,
         uint8_t *plane_buffer = buffer + sound_mgr->align;
         if (sound_mgr->align)
             plane_buffer -= ((uintptr_t)plane_buffer) % sound_mgr->align;
+        if (sound_mgr->vector_size) {
+            /* the last vector may be loaded without remainder loop */
+            size_t data_size = size * sound_mgr->common_mgr.sample_size;
+            size_t padding = (sound_mgr->vector_size -
+                              data_size % sound_mgr->vector_size) %
+                             sound_mgr->vector_size;
+            memset(plane_buffer + data_size, 0, padding);
+        }
         ubuf_sound_common_plane_init(ubuf, plane, plane_buffer);
         buffer += plane_sizes[plane];
     }
@@ -195,6 +210,65 @@ static int ubuf_sound_mem_dup(struct ubuf *ubuf, struct ubuf **new_ubuf_p)
     return UBASE_ERR_NONE;
 }
 
+/** @This allocates a ubuf from the given manager whose planes point to
+ * planes of an existing ubuf, without copying them.
+ *
+ * @param mgr management structure of the new ubuf
+ * @param ubuf pointer to the ubuf holding the buffer space
+ * @param channels array with, for each plane of mgr, the channel type of the
+ * plane of ubuf to point to
+ * @param nb_channels number of elements in channels, which must match the
+ * number of planes of mgr
+ * @return pointer to ubuf or NULL if the planes cannot be shared
+ */
+struct ubuf *ubuf_sound_mem_alias(struct ubuf_mgr *mgr, struct ubuf *ubuf,
+                                  const char *const *channels,
+                                  uint8_t nb_channels)
+{
+    if (unlikely(mgr->ubuf_alloc != ubuf_sound_mem_alloc ||
+                 ubuf->mgr->ubuf_alloc != ubuf_sound_mem_alloc))
+        return NULL;
+
+    struct ubuf_sound_mem_mgr *sound_mgr =
+        ubuf_sound_mem_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_sound_mem_mgr *src_mgr =
+        ubuf_sound_mem_mgr_from_ubuf_mgr(ubuf->mgr);
+    if (nb_channels != sound_mgr->common_mgr.nb_planes ||
+        sound_mgr->umem_mgr != src_mgr->umem_mgr ||
+        sound_mgr->common_mgr.sample_size != src_mgr->common_mgr.sample_size)
+        return NULL;
+    if (sound_mgr->vector_size && (!src_mgr->vector_size ||
+            src_mgr->vector_size % sound_mgr->vector_size))
+        return NULL;
+
+    struct ubuf_sound_common *src_common = ubuf_sound_common_from_ubuf(ubuf);
+    int src_planes[sound_mgr->common_mgr.nb_planes];
+    for (uint8_t plane = 0; plane < sound_mgr->common_mgr.nb_planes; plane++) {
+        src_planes[plane] = ubuf_sound_common_plane(ubuf->mgr,
+                                                    channels[plane]);
+        if (src_planes[plane] < 0)
+            return NULL;
+        uint8_t *buffer = src_common->planes[src_planes[plane]].buffer;
+        if (sound_mgr->align && ((uintptr_t)buffer) % sound_mgr->align)
+            return NULL;
+    }
+
+    struct ubuf_sound_mem *new_sound = ubuf_sound_mem_alloc_pool(mgr);
+    if (unlikely(new_sound == NULL))
+        return NULL;
+
+    struct ubuf *new_ubuf = ubuf_sound_mem_to_ubuf(new_sound);
+    ubuf_sound_common_init(new_ubuf, src_common->size);
+    for (uint8_t plane = 0; plane < sound_mgr->common_mgr.nb_planes; plane++)
+        ubuf_sound_common_plane_init(new_ubuf, plane,
+                src_common->planes[src_planes[plane]].buffer);
+
+    struct ubuf_sound_mem *sound_mem = ubuf_sound_mem_from_ubuf(ubuf);
+    new_sound->shared = ubuf_mem_shared_use(sound_mem->shared);
+    ubuf_mgr_use(mgr);
+    return new_ubuf;
+}
+
 /** @This handles control commands.
  *
  * @param ubuf pointer to ubuf
@@ -349,10 +423,12 @@ static int ubuf_sound_mem_mgr_check(struct ubuf_mgr *mgr,
     uint8_t sample_size;
     uint8_t planes;
     uint64_t align = 0;
+    uint64_t vector_size = 0;
 
     UBASE_RETURN(uref_sound_flow_get_sample_size(flow_format, &sample_size))
     UBASE_RETURN(uref_sound_flow_get_planes(flow_format, &planes))
     uref_sound_flow_get_align(flow_format, &align);
+    uref_sound_flow_get_vector_size(flow_format, &vector_size);
 
     struct ubuf_sound_common_mgr *common_mgr =
         ubuf_sound_common_mgr_from_ubuf_mgr(mgr);
@@ -363,6 +439,9 @@ static int ubuf_sound_mem_mgr_check(struct ubuf_mgr *mgr,
         return UBASE_ERR_INVALID;
     if (align && sound_mgr->align % align)
         return UBASE_ERR_INVALID;
+    if (vector_size && (!sound_mgr->vector_size ||
+                        sound_mgr->vector_size % vector_size))
+        return UBASE_ERR_INVALID;
 
     for (uint8_t i = 0; i < planes; i++) {
         struct ubuf_sound_common_mgr_plane *plane = common_mgr->planes[i];
@@ -394,6 +473,21 @@ static int ubuf_sound_mem_mgr_control(struct ubuf_mgr *mgr,
             ubuf_sound_mem_mgr_vacuum_pool(mgr);
             return UBASE_ERR_NONE;
         }
+        case UBUF_MGR_GET_POOL_STATS: {
+            struct upool_stats *ubuf_stats_p =
+                va_arg(args, struct upool_stats *);
+            struct upool_stats *shared_stats_p =
+                va_arg(args, struct upool_stats *);
+            ubuf_sound_mem_mgr_stats_pool(mgr, ubuf_stats_p, shared_stats_p);
+            return UBASE_ERR_NONE;
+        }
+        case UBUF_MGR_RESIZE_POOL: {
+            unsigned int ubuf_pool_depth = va_arg(args, unsigned int);
+            unsigned int shared_pool_depth = va_arg(args, unsigned int);
+            ubuf_sound_mem_mgr_resize_pool(mgr, ubuf_pool_depth,
+                    shared_pool_depth);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -447,6 +541,7 @@ struct ubuf_mgr *ubuf_sound_mem_mgr_alloc(uint16_t ubuf_pool_depth,
 
     sound_mgr->umem_mgr = umem_mgr;
     sound_mgr->align = align;
+    sound_mgr->vector_size = 0;
     umem_mgr_use(umem_mgr);
 
     struct ubuf_mgr *mgr = ubuf_sound_mem_mgr_to_ubuf_mgr(sound_mgr);
@@ -481,3 +576,30 @@ int ubuf_sound_mem_mgr_add_plane(struct ubuf_mgr *mgr, const char *channel)
     return ubuf_sound_common_mgr_add_plane(mgr, channel);
 }
 
+/** @This sets the size of the SIMD vectors used to process the planes
+ * allocated by a ubuf manager for sound formats using umem. The alignment is
+ * raised to a multiple of the vector size, and planes are padded with zeros
+ * up to a multiple of the vector size, so that vector kernels may process
+ * whole planes without remainder loops. It may only be called on
+ * initializing the manager, before any ubuf is allocated.
+ *
+ * @param mgr pointer to a ubuf_mgr structure
+ * @param vector_size size of SIMD vectors in octets, typically 32 or 64
+ * @return an error code
+ */
+int ubuf_sound_mem_mgr_set_vector_size(struct ubuf_mgr *mgr,
+                                       uint64_t vector_size)
+{
+    assert(mgr != NULL);
+    if (unlikely(mgr->ubuf_alloc != ubuf_sound_mem_alloc || !vector_size))
+        return UBASE_ERR_INVALID;
+
+    struct ubuf_sound_mem_mgr *sound_mgr =
+        ubuf_sound_mem_mgr_from_ubuf_mgr(mgr);
+    ubuf_sound_mem_mgr_vacuum_pool(mgr);
+    sound_mgr->align = sound_mgr->align ?
+        sound_mgr->align / ubase_gcd(sound_mgr->align, vector_size) *
+        vector_size : vector_size;
+    sound_mgr->vector_size = vector_size;
+    return UBASE_ERR_NONE;
+}
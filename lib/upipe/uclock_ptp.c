@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short uclock implementation reading a PTP hardware clock
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/uatomic.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_ptp.h>
+#include <upipe/config.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifdef UPIPE_HAVE_LINUX_PTP_CLOCK_H
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/ptp_clock.h>
+
+/** @hidden */
+#define FD_TO_CLOCKID(fd) ((~(clockid_t)(fd) << 3) | 3)
+
+/** period of the resynchronization with the PHC */
+#define UCLOCK_PTP_PERIOD (UCLOCK_FREQ / 10)
+/** duration of the initial calibration */
+#define UCLOCK_PTP_INIT (UCLOCK_FREQ / 100)
+/** maximum error that is slewed instead of stepped at resynchronization */
+#define UCLOCK_PTP_MAX_SLEW (UCLOCK_FREQ / 100)
+/** number of reads of the PHC per sample, keeping the tightest one */
+#define UCLOCK_PTP_TRIES 3
+
+/** super-set of the uclock structure with additional local members */
+struct uclock_ptp {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** local clock */
+    struct uclock *local;
+    /** file descriptor of the PHC device */
+    int fd;
+    /** clock ID of the PHC */
+    clockid_t clockid;
+
+    /** sequence number of the calibration, odd while it is updated */
+    uatomic_uint32_t seq;
+    /** local time at the anchor point */
+    volatile uint64_t local_base;
+    /** PHC time at the anchor point */
+    volatile uint64_t phc_base;
+    /** PHC ticks per local tick, in 32.32 fixed point */
+    volatile uint64_t mult;
+    /** local time triggering the next resynchronization */
+    volatile uint64_t next;
+    /** local time of the last sample of the PHC */
+    uint64_t sample_local;
+    /** PHC time of the last sample of the PHC */
+    uint64_t sample_phc;
+
+    /** structure exported to modules */
+    struct uclock uclock;
+};
+
+UBASE_FROM_TO(uclock_ptp, uclock, uclock, uclock)
+UBASE_FROM_TO(uclock_ptp, urefcount, urefcount, urefcount)
+
+/** @internal @This samples the PHC along with the local clock, taking the
+ * middle of the local dates read around the tightest of a few reads.
+ *
+ * @param ptp pointer to the uclock_ptp structure
+ * @param local_p filled in with the local time
+ * @param phc_p filled in with the PHC time
+ * @return false in case of error
+ */
+static bool uclock_ptp_sample(struct uclock_ptp *ptp, uint64_t *local_p,
+                              uint64_t *phc_p)
+{
+    uint64_t width = UINT64_MAX;
+    for (int i = 0; i < UCLOCK_PTP_TRIES; i++) {
+        struct timespec ts;
+        uint64_t before = uclock_now(ptp->local);
+        if (unlikely(clock_gettime(ptp->clockid, &ts) == -1))
+            return false;
+        uint64_t after = uclock_now(ptp->local);
+        if (after - before < width) {
+            width = after - before;
+            *local_p = before + width / 2;
+            *phc_p = ts.tv_sec * UCLOCK_FREQ +
+                     ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+        }
+    }
+    return true;
+}
+
+/** @internal @This returns the PHC time extrapolated from the anchor point.
+ *
+ * @param ptp pointer to the uclock_ptp structure
+ * @param local local time
+ * @return PHC time in 27 MHz ticks
+ */
+static inline uint64_t uclock_ptp_extrapolate(struct uclock_ptp *ptp,
+                                              uint64_t local)
+{
+    int64_t delta = local - ptp->local_base;
+    if (unlikely(delta < 0))
+        delta = 0;
+    return ptp->phc_base + (((uint64_t)delta * ptp->mult) >> 32);
+}
+
+/** @internal @This resynchronizes the interpolation with the PHC. As in
+ * uclock_std, the anchor is moved to the extrapolated time and the rate is
+ * set so as to catch up with the PHC at the end of the next period, and
+ * errors larger than UCLOCK_PTP_MAX_SLEW are stepped. The caller must own
+ * the sequence number.
+ *
+ * @param ptp pointer to the uclock_ptp structure
+ */
+static void uclock_ptp_calibrate(struct uclock_ptp *ptp)
+{
+    uint64_t local, phc;
+    if (unlikely(!uclock_ptp_sample(ptp, &local, &phc))) {
+        /* keep extrapolating */
+        ptp->next += UCLOCK_PTP_PERIOD;
+        return;
+    }
+
+    uint64_t now = uclock_ptp_extrapolate(ptp, local);
+    uint64_t mult = ptp->mult;
+    if (likely(local > ptp->sample_local && phc > ptp->sample_phc))
+        mult = ((unsigned __int128)(phc - ptp->sample_phc) << 32) /
+               (local - ptp->sample_local);
+    ptp->sample_local = local;
+    ptp->sample_phc = phc;
+
+    uint64_t period = ((unsigned __int128)UCLOCK_PTP_PERIOD << 32) / mult;
+    int64_t error = phc - now;
+    if (likely(error < UCLOCK_PTP_MAX_SLEW && error > -UCLOCK_PTP_MAX_SLEW))
+        mult = ((unsigned __int128)(UCLOCK_PTP_PERIOD + error) << 32) /
+               period;
+    else
+        now = phc;
+
+    ptp->local_base = local;
+    ptp->phc_base = now;
+    ptp->mult = mult;
+    ptp->next = local + period;
+}
+
+/** @This returns the current PHC time.
+ *
+ * @param uclock utility structure passed to the module
+ * @return current PHC time in 27 MHz ticks
+ */
+static uint64_t uclock_ptp_now(struct uclock *uclock)
+{
+    struct uclock_ptp *ptp = uclock_ptp_from_uclock(uclock);
+
+    for ( ; ; ) {
+        uint32_t seq = uatomic_load(&ptp->seq);
+        if (unlikely(seq & 1))
+            continue;
+
+        uint64_t local = uclock_now(ptp->local);
+        if (unlikely(local >= ptp->next)) {
+            if (uatomic_compare_exchange(&ptp->seq, &seq, seq + 1)) {
+                uclock_ptp_calibrate(ptp);
+                uatomic_store(&ptp->seq, seq + 2);
+            }
+            continue;
+        }
+
+        uint64_t now = uclock_ptp_extrapolate(ptp, local);
+        if (likely(uatomic_load(&ptp->seq) == seq))
+            return now;
+    }
+}
+
+/** @This frees a uclock.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void uclock_ptp_free(struct urefcount *urefcount)
+{
+    struct uclock_ptp *ptp = uclock_ptp_from_urefcount(urefcount);
+    uatomic_clean(&ptp->seq);
+    close(ptp->fd);
+    uclock_release(ptp->local);
+    urefcount_clean(urefcount);
+    free(ptp);
+}
+
+/** @This allocates a new uclock structure reading a PTP hardware clock.
+ *
+ * @param local local uclock used to interpolate between two reads of the PHC
+ * @param device path to the PHC device (/dev/ptpN)
+ * @return pointer to uclock, or NULL in case of error
+ */
+struct uclock *uclock_ptp_alloc(struct uclock *local, const char *device)
+{
+    if (unlikely(local == NULL || device == NULL))
+        return NULL;
+
+    int fd = open(device, O_RDONLY | O_CLOEXEC);
+    if (unlikely(fd == -1))
+        return NULL;
+
+    struct ptp_clock_caps caps;
+    if (unlikely(ioctl(fd, PTP_CLOCK_GETCAPS, &caps) == -1)) {
+        close(fd);
+        return NULL;
+    }
+
+    struct uclock_ptp *ptp = malloc(sizeof(struct uclock_ptp));
+    if (unlikely(ptp == NULL)) {
+        close(fd);
+        return NULL;
+    }
+    ptp->local = local;
+    ptp->fd = fd;
+    ptp->clockid = FD_TO_CLOCKID(fd);
+
+    uint64_t local_now, phc;
+    if (unlikely(!uclock_ptp_sample(ptp, &ptp->sample_local,
+                                    &ptp->sample_phc)))
+        goto uclock_ptp_alloc_err;
+    struct timespec wait = {
+        .tv_sec = 0,
+        .tv_nsec = UCLOCK_PTP_INIT * UINT64_C(1000000000) / UCLOCK_FREQ
+    };
+    nanosleep(&wait, NULL);
+    if (unlikely(!uclock_ptp_sample(ptp, &local_now, &phc) ||
+                 local_now <= ptp->sample_local || phc <= ptp->sample_phc))
+        goto uclock_ptp_alloc_err;
+
+    ptp->mult = ((unsigned __int128)(phc - ptp->sample_phc) << 32) /
+                (local_now - ptp->sample_local);
+    if (unlikely(!ptp->mult))
+        goto uclock_ptp_alloc_err;
+    ptp->sample_local = local_now;
+    ptp->sample_phc = phc;
+    ptp->local_base = local_now;
+    ptp->phc_base = phc;
+    ptp->next = local_now + (((unsigned __int128)UCLOCK_PTP_PERIOD << 32) /
+                             ptp->mult);
+    uatomic_init(&ptp->seq, 0);
+
+    uclock_use(local);
+    urefcount_init(uclock_ptp_to_urefcount(ptp), uclock_ptp_free);
+    ptp->uclock.refcount = uclock_ptp_to_urefcount(ptp);
+    ptp->uclock.uclock_now = uclock_ptp_now;
+    return uclock_ptp_to_uclock(ptp);
+
+uclock_ptp_alloc_err:
+    close(fd);
+    free(ptp);
+    return NULL;
+}
+
+#else /* UPIPE_HAVE_LINUX_PTP_CLOCK_H */
+
+/** @This allocates a new uclock structure reading a PTP hardware clock,
+ * which is not supported on this platform.
+ *
+ * @param local local uclock used to interpolate between two reads of the PHC
+ * @param device path to the PHC device (/dev/ptpN)
+ * @return NULL
+ */
+struct uclock *uclock_ptp_alloc(struct uclock *local, const char *device)
+{
+    return NULL;
+}
+
+#endif
@@ -32,6 +32,7 @@
 #include <upipe/urefcount.h>
 #include <upipe/uclock.h>
 #include <upipe/uclock_std.h>
+#include <upipe/uatomic.h>
 
 #include <stdlib.h>
 #include <time.h>
@@ -42,6 +43,20 @@
 #include <mach/mach.h>
 #endif
 
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__MACH__)
+#include <cpuid.h>
+#include <x86intrin.h>
+/** @hidden */
+#define UCLOCK_STD_TSC
+
+/** period of the recalibration of the TSC against the system clock */
+#define UCLOCK_STD_TSC_PERIOD UCLOCK_FREQ
+/** duration of the initial calibration of the TSC */
+#define UCLOCK_STD_TSC_INIT (UCLOCK_FREQ / 100)
+/** maximum error that is slewed instead of stepped at recalibration */
+#define UCLOCK_STD_TSC_MAX_SLEW (UCLOCK_FREQ / 10)
+#endif
+
 /** super-set of the uclock structure with additional local members */
 struct uclock_std {
     /** refcount management structure */
@@ -53,6 +68,22 @@ struct uclock_std {
     /** mach cclock structure */
     clock_serv_t cclock;
 #endif
+#ifdef UCLOCK_STD_TSC
+    /** sequence number of the calibration, odd while it is updated */
+    uatomic_uint32_t tsc_seq;
+    /** TSC value at the anchor point */
+    volatile uint64_t tsc_base;
+    /** time at the anchor point, in 27 MHz ticks */
+    volatile uint64_t tsc_now;
+    /** 27 MHz ticks per TSC tick, in 32.32 fixed point */
+    volatile uint64_t tsc_mult;
+    /** TSC value triggering the next recalibration */
+    volatile uint64_t tsc_next;
+    /** TSC value of the last sample of the system clock */
+    uint64_t sample_tsc;
+    /** system time of the last sample of the system clock */
+    uint64_t sample_sys;
+#endif
 
     /** structure exported to modules */
     struct uclock uclock;
@@ -61,15 +92,13 @@ struct uclock_std {
 UBASE_FROM_TO(uclock_std, uclock, uclock, uclock)
 UBASE_FROM_TO(uclock_std, urefcount, urefcount, urefcount)
 
-/** @This returns the current system time.
+/** @internal @This reads the system clock.
  *
- * @param uclock utility structure passed to the module
+ * @param std pointer to the uclock_std structure
  * @return current system time in 27 MHz ticks
  */
-static uint64_t uclock_std_now(struct uclock *uclock)
+static inline uint64_t uclock_std_sys(struct uclock_std *std)
 {
-    struct uclock_std *std = uclock_std_from_uclock(uclock);
-
 #ifdef __MACH__ // OS X does not have clock_gettime, use clock_get_time
     mach_timespec_t ts;
     clock_get_time((std->cclock), &ts);
@@ -88,6 +117,169 @@ static uint64_t uclock_std_now(struct uclock *uclock)
     return now;
 }
 
+/** @This returns the current system time.
+ *
+ * @param uclock utility structure passed to the module
+ * @return current system time in 27 MHz ticks
+ */
+static uint64_t uclock_std_now(struct uclock *uclock)
+{
+    return uclock_std_sys(uclock_std_from_uclock(uclock));
+}
+
+#ifdef UCLOCK_STD_TSC
+/** @internal @This checks if the CPU has an invariant TSC, which runs at a
+ * constant rate regardless of frequency scaling and sleep states.
+ *
+ * @return true if the TSC is usable as a clock source
+ */
+static bool uclock_std_tsc_invariant(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) ||
+        eax < 0x80000007)
+        return false;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return false;
+    return !!(edx & (1 << 8));
+}
+
+/** @internal @This samples the system clock along with the TSC, taking the
+ * middle of the TSC values read around the system call.
+ *
+ * @param std pointer to the uclock_std structure
+ * @param tsc_p filled in with the TSC value
+ * @return system time in 27 MHz ticks
+ */
+static uint64_t uclock_std_tsc_sample(struct uclock_std *std, uint64_t *tsc_p)
+{
+    uint64_t before = __rdtsc();
+    uint64_t sys = uclock_std_sys(std);
+    uint64_t after = __rdtsc();
+    *tsc_p = before + (after - before) / 2;
+    return sys;
+}
+
+/** @internal @This returns the time extrapolated from the anchor point.
+ *
+ * @param std pointer to the uclock_std structure
+ * @param tsc TSC value
+ * @return time in 27 MHz ticks
+ */
+static inline uint64_t uclock_std_tsc_extrapolate(struct uclock_std *std,
+                                                  uint64_t tsc)
+{
+    int64_t delta = tsc - std->tsc_base;
+    if (unlikely(delta < 0))
+        /* TSC read out of order with the anchor */
+        delta = 0;
+    return std->tsc_now + (((uint64_t)delta * std->tsc_mult) >> 32);
+}
+
+/** @internal @This recalibrates the TSC against the system clock. To keep
+ * the clock monotonic, the anchor is moved to the extrapolated time, and the
+ * rate is set so as to catch up with the system clock at the end of the next
+ * period. Errors larger than UCLOCK_STD_TSC_MAX_SLEW (typically jumps of a
+ * real-time clock) are stepped instead. The caller must own the sequence
+ * number.
+ *
+ * @param std pointer to the uclock_std structure
+ */
+static void uclock_std_tsc_calibrate(struct uclock_std *std)
+{
+    uint64_t tsc;
+    uint64_t sys = uclock_std_tsc_sample(std, &tsc);
+    uint64_t now = uclock_std_tsc_extrapolate(std, tsc);
+    uint64_t mult = std->tsc_mult;
+    if (likely(tsc > std->sample_tsc && sys > std->sample_sys))
+        mult = ((unsigned __int128)(sys - std->sample_sys) << 32) /
+               (tsc - std->sample_tsc);
+    std->sample_tsc = tsc;
+    std->sample_sys = sys;
+
+    uint64_t period = ((unsigned __int128)UCLOCK_STD_TSC_PERIOD << 32) / mult;
+    int64_t error = sys - now;
+    if (likely(error < UCLOCK_STD_TSC_MAX_SLEW &&
+               error > -UCLOCK_STD_TSC_MAX_SLEW))
+        mult = ((unsigned __int128)(UCLOCK_STD_TSC_PERIOD + error) << 32) /
+               period;
+    else
+        now = sys;
+
+    std->tsc_base = tsc;
+    std->tsc_now = now;
+    std->tsc_mult = mult;
+    std->tsc_next = tsc + period;
+}
+
+/** @This returns the current system time, extrapolated from the TSC.
+ *
+ * @param uclock utility structure passed to the module
+ * @return current system time in 27 MHz ticks
+ */
+static uint64_t uclock_std_tsc_now(struct uclock *uclock)
+{
+    struct uclock_std *std = uclock_std_from_uclock(uclock);
+
+    for ( ; ; ) {
+        uint32_t seq = uatomic_load(&std->tsc_seq);
+        if (unlikely(seq & 1))
+            continue;
+
+        uint64_t tsc = __rdtsc();
+        if (unlikely(tsc >= std->tsc_next)) {
+            if (uatomic_compare_exchange(&std->tsc_seq, &seq, seq + 1)) {
+                uclock_std_tsc_calibrate(std);
+                uatomic_store(&std->tsc_seq, seq + 2);
+            }
+            continue;
+        }
+
+        uint64_t now = uclock_std_tsc_extrapolate(std, tsc);
+        if (likely(uatomic_load(&std->tsc_seq) == seq))
+            return now;
+    }
+}
+
+/** @internal @This initializes the TSC calibration, waiting for
+ * UCLOCK_STD_TSC_INIT to get a first estimate of the rate.
+ *
+ * @param std pointer to the uclock_std structure
+ * @return false if the TSC may not be used
+ */
+static bool uclock_std_tsc_init(struct uclock_std *std)
+{
+    if (!uclock_std_tsc_invariant())
+        return false;
+
+    std->sample_sys = uclock_std_tsc_sample(std, &std->sample_tsc);
+    struct timespec wait = {
+        .tv_sec = 0,
+        .tv_nsec = UCLOCK_STD_TSC_INIT * UINT64_C(1000000000) / UCLOCK_FREQ
+    };
+    nanosleep(&wait, NULL);
+
+    uint64_t tsc;
+    uint64_t sys = uclock_std_tsc_sample(std, &tsc);
+    if (unlikely(tsc <= std->sample_tsc || sys <= std->sample_sys))
+        return false;
+    uint64_t mult = ((unsigned __int128)(sys - std->sample_sys) << 32) /
+                    (tsc - std->sample_tsc);
+    if (unlikely(!mult))
+        return false;
+
+    std->sample_tsc = tsc;
+    std->sample_sys = sys;
+    std->tsc_base = tsc;
+    std->tsc_now = sys;
+    std->tsc_mult = mult;
+    std->tsc_next = tsc + (((unsigned __int128)UCLOCK_STD_TSC_PERIOD << 32) /
+                           mult);
+    uatomic_init(&std->tsc_seq, 0);
+    return true;
+}
+#endif
+
 /** @This frees a uclock.
  *
  * @param urefcount pointer to urefcount
@@ -97,6 +289,10 @@ static void uclock_std_free(struct urefcount *urefcount)
     struct uclock_std *uclock_std = uclock_std_from_urefcount(urefcount);
 #ifdef __MACH__
     mach_port_deallocate(mach_task_self(), uclock_std->cclock);
+#endif
+#ifdef UCLOCK_STD_TSC
+    if (uclock_std->uclock.uclock_now == uclock_std_tsc_now)
+        uatomic_clean(&uclock_std->tsc_seq);
 #endif
     urefcount_clean(urefcount);
     free(uclock_std);
@@ -135,6 +331,10 @@ struct uclock *uclock_std_alloc(enum uclock_std_flags flags)
     uclock_std->uclock.uclock_now = uclock_std_now;
 #ifdef __MACH__
     memcpy(&uclock_std->cclock, &cclock, sizeof(cclock));
+#endif
+#ifdef UCLOCK_STD_TSC
+    if ((flags & UCLOCK_FLAG_TSC) && uclock_std_tsc_init(uclock_std))
+        uclock_std->uclock.uclock_now = uclock_std_tsc_now;
 #endif
     return uclock_std_to_uclock(uclock_std);
 }
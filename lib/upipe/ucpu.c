@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe runtime detection of CPU features and dispatch of kernels
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ucpu.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__linux__) && (defined(__arm__) || defined(__aarch64__))
+#include <sys/auxv.h>
+#endif
+
+/* bits of AT_HWCAP, in case the libc headers are too old */
+#if defined(__aarch64__)
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)
+#endif
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#elif defined(__arm__)
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+#endif
+
+/** true once the features are detected */
+static volatile bool ucpu_detected = false;
+/** detected features */
+static volatile uint32_t ucpu_flags = 0;
+/** mask of features allowed to be used */
+static volatile uint32_t ucpu_mask = UINT32_MAX;
+
+/** @internal @This detects the features of the CPU.
+ *
+ * @return ORed @ref ucpu_flag
+ */
+static uint32_t ucpu_detect(void)
+{
+    uint32_t flags = 0;
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        flags |= UCPU_X86_SSE2;
+    if (__builtin_cpu_supports("ssse3"))
+        flags |= UCPU_X86_SSSE3;
+    if (__builtin_cpu_supports("sse4.1"))
+        flags |= UCPU_X86_SSE4_1;
+    if (__builtin_cpu_supports("sse4.2"))
+        flags |= UCPU_X86_SSE4_2;
+    if (__builtin_cpu_supports("avx"))
+        flags |= UCPU_X86_AVX;
+    if (__builtin_cpu_supports("avx2"))
+        flags |= UCPU_X86_AVX2;
+    if (__builtin_cpu_supports("avx512f"))
+        flags |= UCPU_X86_AVX512F;
+    if (__builtin_cpu_supports("avx512bw"))
+        flags |= UCPU_X86_AVX512BW;
+#elif defined(__aarch64__)
+    /* Advanced SIMD is mandatory in ARMv8-A */
+    flags |= UCPU_ARM_NEON;
+#ifdef __linux__
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    if (hwcap & HWCAP_SVE)
+        flags |= UCPU_ARM_SVE;
+#endif
+#elif defined(__arm__)
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    flags |= UCPU_ARM_NEON;
+#elif defined(__linux__)
+    if (getauxval(AT_HWCAP) & HWCAP_NEON)
+        flags |= UCPU_ARM_NEON;
+#endif
+#endif
+    return flags;
+}
+
+/** @This returns the features of the CPU, detected on the first call and
+ * restricted by @ref ucpu_set_mask.
+ *
+ * @return ORed @ref ucpu_flag
+ */
+uint32_t ucpu_get_flags(void)
+{
+    /* the detection has no side effect, so concurrent first calls only
+     * do it several times */
+    if (unlikely(!ucpu_detected)) {
+        const char *mask = getenv("UPIPE_CPU_MASK");
+        if (mask != NULL)
+            ucpu_mask = strtoul(mask, NULL, 0);
+        ucpu_flags = ucpu_detect();
+        ucpu_detected = true;
+    }
+    return ucpu_flags & ucpu_mask;
+}
+
+/** @This restricts the features returned by @ref ucpu_get_flags to the
+ * given mask.
+ *
+ * @param mask ORed @ref ucpu_flag, or UINT32_MAX for all features
+ */
+void ucpu_set_mask(uint32_t mask)
+{
+    ucpu_get_flags();
+    ucpu_mask = mask;
+}
+
+/** @This returns the first version of a kernel whose required features are
+ * all supported by the CPU.
+ *
+ * @param kernels table of versions, ending with a version requiring no
+ * feature
+ * @return pointer to the function
+ */
+void *ucpu_select(const struct ucpu_kernel *kernels)
+{
+    uint32_t flags = ucpu_get_flags();
+    while ((kernels->flags & flags) != kernels->flags)
+        kernels++;
+    return kernels->function;
+}
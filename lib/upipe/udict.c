@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe registry of dictionary keys
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/udict.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+/** @internal @This describes a registered key. */
+struct udict_key {
+    /** name of the attribute */
+    const char *name;
+    /** base type of the attribute */
+    enum udict_type base_type;
+};
+
+/** registered keys, indexed by key - UDICT_TYPE_KEY; entries are only ever
+ * appended, and written before they are counted in @ref udict_nb_keys */
+static struct udict_key udict_keys[UDICT_KEY_MAX];
+/** number of registered keys, which may be read without the lock */
+static volatile unsigned int udict_nb_keys = 0;
+/** lock protecting registrations */
+static pthread_mutex_t udict_keys_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** number of slots of the hash table of registered keys, a power of 2 at
+ * least twice as large as the number of keys */
+#define UDICT_KEY_SLOTS (2 * UDICT_KEY_MAX)
+/** hash table of registered keys, with linear probing; a slot holds the
+ * index of a key plus one, or 0 if it is free, and is only ever written
+ * once, after the entry of the key */
+static volatile uint8_t udict_key_slots[UDICT_KEY_SLOTS];
+
+/** @internal @This hashes an attribute name and base type (FNV-1a).
+ *
+ * @param name name of the attribute
+ * @param base_type base type of the attribute
+ * @return hash
+ */
+static uint32_t udict_key_hash(const char *name, enum udict_type base_type)
+{
+    uint32_t hash = UINT32_C(2166136261) ^ base_type;
+    while (*name)
+        hash = (hash ^ (uint8_t)*name++) * UINT32_C(16777619);
+    return hash ^ (hash >> 16);
+}
+
+/** @internal @This finds a registered key among the published ones. A
+ * name which isn't registered usually stops at the first free slot.
+ *
+ * @param name name of the attribute
+ * @param base_type base type of the attribute
+ * @param hash hash of the name and base type
+ * @param slot_p filled in with the slot of the key, or the free slot
+ * ending the search
+ * @param type_p filled in with the key of the attribute
+ * @return an error code
+ */
+static int udict_key_find_published(const char *name,
+                                    enum udict_type base_type,
+                                    uint32_t hash, unsigned int *slot_p,
+                                    enum udict_type *type_p)
+{
+    unsigned int slot = hash & (UDICT_KEY_SLOTS - 1);
+    uint8_t index;
+    while ((index = udict_key_slots[slot])) {
+        __sync_synchronize();
+        const struct udict_key *key = &udict_keys[index - 1];
+        if (key->base_type == base_type && !strcmp(key->name, name)) {
+            *slot_p = slot;
+            *type_p = UDICT_TYPE_KEY + index - 1;
+            return UBASE_ERR_NONE;
+        }
+        slot = (slot + 1) & (UDICT_KEY_SLOTS - 1);
+    }
+    *slot_p = slot;
+    return UBASE_ERR_INVALID;
+}
+
+/** @This finds the key of an already registered attribute name. It doesn't
+ * take the lock, and returns immediately if no key was registered, so that
+ * it may be called on every access by name.
+ *
+ * @param name name of the attribute
+ * @param base_type base type of the attribute
+ * @param type_p filled in with the key of the attribute
+ * @return an error code, UBASE_ERR_INVALID if the name is not registered
+ */
+int udict_key_find(const char *name, enum udict_type base_type,
+                   enum udict_type *type_p)
+{
+    if (likely(!udict_nb_keys))
+        return UBASE_ERR_INVALID;
+    unsigned int slot;
+    return udict_key_find_published(name, base_type,
+                                    udict_key_hash(name, base_type),
+                                    &slot, type_p);
+}
+
+/** @This registers an attribute name, and returns a key that may be used
+ * instead of it.
+ *
+ * @param name name of the attribute, which must remain valid for the whole
+ * life of the program
+ * @param base_type base type of the attribute
+ * @param type_p filled in with the key of the attribute
+ * @return an error code
+ */
+int udict_key_register(const char *name, enum udict_type base_type,
+                       enum udict_type *type_p)
+{
+    if (unlikely(name == NULL || base_type == UDICT_TYPE_END ||
+                 base_type > UDICT_TYPE_FLOAT))
+        return UBASE_ERR_INVALID;
+
+    pthread_mutex_lock(&udict_keys_lock);
+    unsigned int slot;
+    int err = udict_key_find_published(name, base_type,
+                                       udict_key_hash(name, base_type),
+                                       &slot, type_p);
+    unsigned int nb_keys = udict_nb_keys;
+    if (!ubase_check(err) && nb_keys < UDICT_KEY_MAX) {
+        udict_keys[nb_keys].name = name;
+        udict_keys[nb_keys].base_type = base_type;
+        __sync_synchronize();
+        udict_key_slots[slot] = nb_keys + 1;
+        udict_nb_keys = nb_keys + 1;
+        *type_p = UDICT_TYPE_KEY + nb_keys;
+        err = UBASE_ERR_NONE;
+    } else if (!ubase_check(err))
+        err = UBASE_ERR_ALLOC;
+    pthread_mutex_unlock(&udict_keys_lock);
+    return err;
+}
+
+/** @This returns the name and base type of a registered key. As the entry
+ * of a key is written before the key is returned by
+ * @ref udict_key_register, it may be read without the lock.
+ *
+ * @param type registered key
+ * @param name_p filled in with the name of the attribute
+ * @param base_type_p filled in with the base type of the attribute
+ * @return an error code
+ */
+int udict_key_name(enum udict_type type, const char **name_p,
+                   enum udict_type *base_type_p)
+{
+    if (unlikely(type < UDICT_TYPE_KEY ||
+                 type >= UDICT_TYPE_KEY + UDICT_KEY_MAX))
+        return UBASE_ERR_INVALID;
+    const struct udict_key *key = &udict_keys[type - UDICT_TYPE_KEY];
+    if (unlikely(key->name == NULL))
+        return UBASE_ERR_INVALID;
+    *name_p = key->name;
+    *base_type_p = key->base_type;
+    return UBASE_ERR_NONE;
+}
@@ -27,11 +27,13 @@
  * @short Upipe inline manager of dictionary of attributes
  * This manager stores all attributes inline inside a single umem block.
  * This is designed in order to minimize calls to memory allocators, and
- * to transmit dictionaries over streams.
+ * to transmit dictionaries over streams. The block is shared between
+ * duplicated dictionaries, and copied on the first write.
  */
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uatomic.h>
 #include <upipe/upool.h>
 #include <upipe/umem.h>
 #include <upipe/udict.h>
@@ -47,6 +49,10 @@
 #define UDICT_MIN_SIZE 128
 /** default extra space added on udict expansion */
 #define UDICT_EXTRA_SIZE 64
+/** number of entries of the lookup index (power of 2) */
+#define UDICT_INDEX_SIZE 16
+/** size of the header holding the refcount at the beginning of the umem */
+#define UDICT_HEADER_SIZE sizeof(uatomic_uint32_t)
 
 /** @internal @This represents a shorthand attribute type. */
 struct inline_shorthand {
@@ -105,6 +111,8 @@ struct udict_inline_mgr {
 
     /** udict pool */
     struct upool udict_pool;
+    /** cache of the udict pool for the thread which allocated the manager */
+    struct upool_cache udict_cache;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
@@ -122,10 +130,14 @@ UBASE_FROM_TO(udict_inline_mgr, upool, udict_pool, udict_pool)
 
 /** super-set of the udict structure with additional local members */
 struct udict_inline {
-    /** umem structure pointing to buffer */
+    /** umem structure pointing to buffer, shared between duplicates and
+     * starting with the number of udicts sharing it */
     struct umem umem;
     /** used size */
     size_t size;
+    /** offsets (plus one) of recently found attributes, indexed by a hash
+     * of their name and type, or 0 */
+    uint16_t index[UDICT_INDEX_SIZE];
 
     /** common structure */
     struct udict udict;
@@ -133,6 +145,62 @@ struct udict_inline {
 
 UBASE_FROM_TO(udict_inline, udict, udict, udict)
 
+/** @internal @This returns the number of udicts sharing the buffer.
+ *
+ * @param inl pointer to the udict_inline
+ * @return pointer to the refcount of the buffer
+ */
+static inline uatomic_uint32_t *udict_inline_refcount(struct udict_inline *inl)
+{
+    return (uatomic_uint32_t *)umem_buffer(&inl->umem);
+}
+
+/** @internal @This returns a pointer to the attributes.
+ *
+ * @param inl pointer to the udict_inline
+ * @return pointer to the first attribute
+ */
+static inline uint8_t *udict_inline_buffer(struct udict_inline *inl)
+{
+    return umem_buffer(&inl->umem) + UDICT_HEADER_SIZE;
+}
+
+/** @internal @This releases the buffer of a udict, and frees it if it is no
+ * longer shared.
+ *
+ * @param inl pointer to the udict_inline
+ */
+static void udict_inline_release_buffer(struct udict_inline *inl)
+{
+    uatomic_uint32_t *refcount = udict_inline_refcount(inl);
+    if (uatomic_fetch_sub(refcount, 1) == 1) {
+        uatomic_clean(refcount);
+        umem_free(&inl->umem);
+    }
+}
+
+/** @internal @This makes sure the buffer of a udict is not shared before it
+ * is written to, by copying it if necessary.
+ *
+ * @param inl pointer to the udict_inline
+ * @return an error code
+ */
+static int udict_inline_unshare(struct udict_inline *inl)
+{
+    if (likely(uatomic_load(udict_inline_refcount(inl)) == 1))
+        return UBASE_ERR_NONE;
+
+    struct umem umem;
+    if (unlikely(!umem_alloc(inl->umem.mgr, &umem, umem_size(&inl->umem))))
+        return UBASE_ERR_ALLOC;
+    memcpy(umem_buffer(&umem) + UDICT_HEADER_SIZE, udict_inline_buffer(inl),
+           inl->size);
+    udict_inline_release_buffer(inl);
+    inl->umem = umem;
+    uatomic_init(udict_inline_refcount(inl), 1);
+    return UBASE_ERR_NONE;
+}
+
 /** @This allocates a udict with attributes space.
  *
  * @param mgr common management structure
@@ -142,20 +210,24 @@ UBASE_FROM_TO(udict_inline, udict, udict, udict)
 static struct udict *udict_inline_alloc(struct udict_mgr *mgr, size_t size)
 {
     struct udict_inline_mgr *inline_mgr = udict_inline_mgr_from_udict_mgr(mgr);
-    struct udict_inline *inl = upool_alloc(&inline_mgr->udict_pool,
+    struct udict_inline *inl = upool_cache_alloc(&inline_mgr->udict_cache,
                                            struct udict_inline *);
     struct udict *udict = udict_inline_to_udict(inl);
 
     if (size < inline_mgr->min_size)
         size = inline_mgr->min_size;
-    if (unlikely(!umem_alloc(inline_mgr->umem_mgr, &inl->umem, size))) {
-        upool_free(&inline_mgr->udict_pool, inl);
+    if (unlikely(!umem_alloc(inline_mgr->umem_mgr, &inl->umem,
+                             size + UDICT_HEADER_SIZE))) {
+        upool_cache_free(&inline_mgr->udict_cache, inl);
         return NULL;
     }
 
-    uint8_t *buffer = umem_buffer(&inl->umem);
+    uatomic_init(udict_inline_refcount(inl), 1);
+    uint8_t *buffer = udict_inline_buffer(inl);
     buffer[0] = UDICT_TYPE_END;
     inl->size = 1;
+    memset(inl->index, 0, sizeof(inl->index));
+    udict->hash = 0;
 
     udict_mgr_use(mgr);
     return udict;
@@ -171,31 +243,43 @@ static struct udict *udict_inline_alloc(struct udict_mgr *mgr, size_t size)
 static int udict_inline_dup(struct udict *udict, struct udict **new_udict_p)
 {
     assert(new_udict_p != NULL);
+    struct udict_inline_mgr *inline_mgr =
+        udict_inline_mgr_from_udict_mgr(udict->mgr);
     struct udict_inline *inl = udict_inline_from_udict(udict);
-    struct udict *new_udict = udict_inline_alloc(udict->mgr, inl->size);
-    if (unlikely(new_udict == NULL))
+    struct udict_inline *new_inl = upool_cache_alloc(&inline_mgr->udict_cache,
+                                               struct udict_inline *);
+    if (unlikely(new_inl == NULL))
         return UBASE_ERR_ALLOC;
 
-    *new_udict_p = new_udict;
-
-    struct udict_inline *new_inl = udict_inline_from_udict(new_udict);
-    memcpy(umem_buffer(&new_inl->umem), umem_buffer(&inl->umem), inl->size);
+    uatomic_fetch_add(udict_inline_refcount(inl), 1);
+    new_inl->umem = inl->umem;
     new_inl->size = inl->size;
+    memcpy(new_inl->index, inl->index, sizeof(inl->index));
+    new_inl->udict.hash = udict->hash;
+
+    udict_mgr_use(udict->mgr);
+    *new_udict_p = udict_inline_to_udict(new_inl);
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This looks up a shorthand attribute in the list of shorthands.
+/** @internal @This looks up a shorthand attribute in the list of shorthands,
+ * or in the registered keys.
  *
  * @param type shorthand attribute
- * @return pointer to the found shorthand entry, or NULL
+ * @param base_type_p filled in with the base type of the attribute
+ * @return false if the shorthand is unknown
  */
-static const struct inline_shorthand *
-    udict_inline_shorthand(enum udict_type type)
+static inline bool udict_inline_shorthand(enum udict_type type,
+                                          enum udict_type *base_type_p)
 {
-    if (unlikely(type > UDICT_TYPE_SHORTHAND + 1 + sizeof(inline_shorthands) /
-                                               sizeof(struct inline_shorthand)))
-        return NULL;
-    return &inline_shorthands[type - UDICT_TYPE_SHORTHAND - 1];
+    if (likely(type < UDICT_TYPE_SHORTHAND + 1 + sizeof(inline_shorthands) /
+                                            sizeof(struct inline_shorthand))) {
+        *base_type_p =
+            inline_shorthands[type - UDICT_TYPE_SHORTHAND - 1].base_type;
+        return true;
+    }
+    const char *name;
+    return ubase_check(udict_key_name(type, &name, base_type_p));
 }
 
 /** @internal @This jumps to the next attribute.
@@ -209,21 +293,37 @@ static uint8_t *udict_inline_next(uint8_t *attr)
         return NULL;
 
     if (likely(*attr > UDICT_TYPE_SHORTHAND)) {
-        const struct inline_shorthand *shorthand =
-            udict_inline_shorthand(*attr);
-        if (unlikely(shorthand == NULL))
+        enum udict_type base_type;
+        if (unlikely(!udict_inline_shorthand(*attr, &base_type)))
             return NULL;
-        if (shorthand->base_type != UDICT_TYPE_OPAQUE &&
-            shorthand->base_type != UDICT_TYPE_STRING)
-            return attr + attr_sizes[shorthand->base_type] + 1;
+        if (base_type != UDICT_TYPE_OPAQUE && base_type != UDICT_TYPE_STRING)
+            return attr + attr_sizes[base_type] + 1;
     }
 
     uint16_t size = (attr[1] << 8) | attr[2];
     return attr + 3 + size;
 }
 
+/** @internal @This returns the entry of the lookup index for an attribute.
+ *
+ * @param name name of the attribute
+ * @param type type of the attribute
+ * @return index of the entry
+ */
+static inline unsigned int udict_inline_hash(const char *name,
+                                             enum udict_type type)
+{
+    unsigned int hash = type;
+    if (type <= UDICT_TYPE_SHORTHAND)
+        while (*name)
+            hash = hash * 31 + (uint8_t)*name++;
+    return hash & (UDICT_INDEX_SIZE - 1);
+}
+
 /** @internal @This finds an attribute (shorthand or not) of the given name
- * and type and returns a pointer to its beginning.
+ * and type and returns a pointer to its beginning. Attributes found by a
+ * walk are remembered in the lookup index, so that subsequent lookups of
+ * the same attribute only cost a hash and a comparison.
  *
  * @param udict pointer to the udict
  * @param name name of the attribute
@@ -235,18 +335,33 @@ static uint8_t *udict_inline_find(struct udict *udict, const char *name,
 {
     struct udict_inline *inl = udict_inline_from_udict(udict);
 #ifdef STATS
-    if (type > UDICT_TYPE_SHORTHAND) {
+    if (type > UDICT_TYPE_SHORTHAND && type < UDICT_TYPE_KEY) {
         struct udict_inline_mgr *inline_mgr =
             udict_inline_mgr_from_udict_mgr(udict->mgr);
         inline_mgr->stats[type - UDICT_TYPE_SHORTHAND - 1]++;
     }
 #endif
-    uint8_t *attr = umem_buffer(&inl->umem);
+    uint8_t *buffer = udict_inline_buffer(inl);
+    if (type == UDICT_TYPE_END)
+        return buffer + inl->size - 1;
+
+    unsigned int hash = udict_inline_hash(name, type);
+    if (likely(inl->index[hash])) {
+        uint8_t *attr = buffer + inl->index[hash] - 1;
+        if (*attr == type && (type > UDICT_TYPE_SHORTHAND ||
+                              !strcmp((const char *)(attr + 3), name)))
+            return attr;
+    }
+
+    uint8_t *attr = buffer;
     while (attr != NULL) {
         if (*attr == type &&
-             (type > UDICT_TYPE_SHORTHAND || type == UDICT_TYPE_END ||
-              !strcmp((const char *)(attr + 3), name)))
+             (type > UDICT_TYPE_SHORTHAND ||
+              !strcmp((const char *)(attr + 3), name))) {
+            if (likely(attr - buffer < UINT16_MAX))
+                inl->index[hash] = attr - buffer + 1;
             return attr;
+        }
         attr = udict_inline_next(attr);
     }
     return NULL;
@@ -274,7 +389,7 @@ static void udict_inline_iterate(struct udict *udict, const char **name_p,
         if (likely(attr != NULL))
             attr = udict_inline_next(attr);
     } else
-        attr = umem_buffer(&inl->umem);
+        attr = udict_inline_buffer(inl);
     if (unlikely(attr == NULL || *attr == UDICT_TYPE_END)) {
         *type_p = UDICT_TYPE_END;
         return;
@@ -301,15 +416,13 @@ static uint8_t *_udict_inline_get(struct udict *udict, const char *name,
         return NULL;
 
     if (likely(type > UDICT_TYPE_SHORTHAND)) {
-        const struct inline_shorthand *shorthand =
-            udict_inline_shorthand(*attr);
-        if (unlikely(shorthand == NULL))
+        enum udict_type base_type;
+        if (unlikely(!udict_inline_shorthand(*attr, &base_type)))
             return NULL;
 
-        if (shorthand->base_type != UDICT_TYPE_OPAQUE &&
-            shorthand->base_type != UDICT_TYPE_STRING) {
+        if (base_type != UDICT_TYPE_OPAQUE && base_type != UDICT_TYPE_STRING) {
             if (likely(size_p != NULL))
-                *size_p = attr_sizes[shorthand->base_type];
+                *size_p = attr_sizes[base_type];
             attr++;
         } else {
             uint16_t size = (attr[1] << 8) | attr[2];
@@ -367,12 +480,38 @@ static int udict_inline_delete(struct udict *udict, const char *name,
     if (unlikely(attr == NULL))
         return UBASE_ERR_INVALID;
 
+    size_t offset = attr - udict_inline_buffer(inl);
+    UBASE_RETURN(udict_inline_unshare(inl))
+    attr = udict_inline_buffer(inl) + offset;
     uint8_t *end = udict_inline_next(attr);
-    memmove(attr, end, umem_buffer(&inl->umem) + inl->size - end);
+    memmove(attr, end, udict_inline_buffer(inl) + inl->size - end);
     inl->size -= end - attr;
+    /* following attributes have moved */
+    memset(inl->index, 0, sizeof(inl->index));
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the other form of a registered attribute, that is
+ * its key if it is given by name, or its name if it is given by key.
+ *
+ * @param name name of the attribute
+ * @param type type of the attribute
+ * @param alias_name_p filled in with the name of the other form
+ * @param alias_type_p filled in with the type of the other form
+ * @return false if the attribute is not registered
+ */
+static inline bool udict_inline_alias(const char *name, enum udict_type type,
+                                      const char **alias_name_p,
+                                      enum udict_type *alias_type_p)
+{
+    if (type >= UDICT_TYPE_KEY)
+        return ubase_check(udict_key_name(type, alias_name_p, alias_type_p));
+    if (type == UDICT_TYPE_END || type > UDICT_TYPE_SHORTHAND)
+        return false;
+    *alias_name_p = NULL;
+    return ubase_check(udict_key_find(name, type, alias_type_p));
+}
+
 /** @internal @This adds or changes an attribute (excluding the value itself).
  *
  * @param udict pointer to the udict
@@ -387,14 +526,12 @@ static int udict_inline_set(struct udict *udict, const char *name,
                             uint8_t **attr_p)
 {
     struct udict_inline *inl = udict_inline_from_udict(udict);
-    const struct inline_shorthand *shorthand = NULL;
+    bool shorthand = type > UDICT_TYPE_SHORTHAND;
     enum udict_type base_type = type;
-    if (likely(type > UDICT_TYPE_SHORTHAND)) {
-        shorthand = udict_inline_shorthand(type);
-        if (unlikely(shorthand == NULL))
-            return UBASE_ERR_INVALID;
-        base_type = shorthand->base_type;
-    }
+    if (likely(shorthand) &&
+        unlikely(!udict_inline_shorthand(type, &base_type)))
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(udict_inline_unshare(inl))
 
     /* check if it already exists */
     size_t current_size;
@@ -421,7 +558,7 @@ static int udict_inline_set(struct udict *udict, const char *name,
     /* calculate header size */
     size_t header_size = 1;
     size_t namelen;
-    if (likely(shorthand != NULL)) {
+    if (likely(shorthand)) {
         if (base_type == UDICT_TYPE_OPAQUE || base_type == UDICT_TYPE_STRING)
             header_size += 2;
     } else {
@@ -430,7 +567,7 @@ static int udict_inline_set(struct udict *udict, const char *name,
     }
 
     /* check total attributes size */
-    attr = umem_buffer(&inl->umem) + inl->size - 1;
+    attr = udict_inline_buffer(inl) + inl->size - 1;
     size_t total_size = (attr - umem_buffer(&inl->umem)) + header_size +
                         attr_size + 1;
     if (unlikely(total_size >= umem_size(&inl->umem))) {
@@ -440,12 +577,15 @@ static int udict_inline_set(struct udict *udict, const char *name,
                                                inline_mgr->extra_size)))
             return UBASE_ERR_ALLOC;
 
-        attr = umem_buffer(&inl->umem) + inl->size - 1;
+        attr = udict_inline_buffer(inl) + inl->size - 1;
     }
     assert(*attr == UDICT_TYPE_END);
+    size_t offset = attr - udict_inline_buffer(inl);
+    if (likely(offset < UINT16_MAX))
+        inl->index[udict_inline_hash(name, type)] = offset + 1;
 
     /* write attribute header */
-    if (unlikely(shorthand == NULL)) {
+    if (unlikely(!shorthand)) {
         assert(namelen + 1 + attr_size <= UINT16_MAX);
         uint16_t size = namelen + 1 + attr_size;
         *attr++ = type;
@@ -453,8 +593,8 @@ static int udict_inline_set(struct udict *udict, const char *name,
         *attr++ = size & 0xff;
         memcpy(attr, name, namelen + 1);
         attr += namelen + 1;
-   } else if (shorthand->base_type == UDICT_TYPE_OPAQUE ||
-              shorthand->base_type == UDICT_TYPE_STRING) {
+   } else if (base_type == UDICT_TYPE_OPAQUE ||
+              base_type == UDICT_TYPE_STRING) {
         assert(attr_size <= UINT16_MAX);
         uint16_t size = attr_size;
         *attr++ = type;
@@ -482,11 +622,14 @@ static int udict_inline_name(enum udict_type type, const char **name_p,
 {
     if (type <= UDICT_TYPE_SHORTHAND)
         return UBASE_ERR_INVALID;
-
-    const struct inline_shorthand *shorthand = udict_inline_shorthand(type);
-    if (unlikely(shorthand == NULL))
+    if (type >= UDICT_TYPE_KEY)
+        return udict_key_name(type, name_p, base_type_p);
+    if (unlikely(type >= UDICT_TYPE_SHORTHAND + 1 + sizeof(inline_shorthands) /
+                                               sizeof(struct inline_shorthand)))
         return UBASE_ERR_INVALID;
 
+    const struct inline_shorthand *shorthand =
+        &inline_shorthands[type - UDICT_TYPE_SHORTHAND - 1];
     *name_p = shorthand->name;
     *base_type_p = shorthand->base_type;
     return UBASE_ERR_NONE;
@@ -517,19 +660,49 @@ static int udict_inline_control(struct udict *udict, int command, va_list args)
             enum udict_type type = va_arg(args, enum udict_type);
             size_t *size_p = va_arg(args, size_t *);
             const uint8_t **attr_p = va_arg(args, const uint8_t **);
-            return udict_inline_get(udict, name, type, size_p, attr_p);
+            const char *alias_name;
+            enum udict_type alias_type;
+            int err = udict_inline_get(udict, name, type, size_p, attr_p);
+            if (unlikely(!ubase_check(err)) &&
+                udict_inline_alias(name, type, &alias_name, &alias_type))
+                err = udict_inline_get(udict, alias_name, alias_type,
+                                       size_p, attr_p);
+            return err;
         }
         case UDICT_SET: {
             const char *name = va_arg(args, const char *);
             enum udict_type type = va_arg(args, enum udict_type);
             size_t size = va_arg(args, size_t);
             uint8_t **attr_p = va_arg(args, uint8_t **);
+            const char *alias_name;
+            enum udict_type alias_type;
+            if (unlikely(udict_inline_alias(name, type, &alias_name,
+                                            &alias_type))) {
+                /* registered attributes are stored under their key */
+                if (type < UDICT_TYPE_KEY) {
+                    const char *key_name = alias_name;
+                    alias_name = name;
+                    name = key_name;
+                    enum udict_type key = alias_type;
+                    alias_type = type;
+                    type = key;
+                }
+                udict_inline_delete(udict, alias_name, alias_type);
+            }
             return udict_inline_set(udict, name, type, size, attr_p);
         }
         case UDICT_DELETE: {
             const char *name = va_arg(args, const char *);
             enum udict_type type = va_arg(args, enum udict_type);
-            return udict_inline_delete(udict, name, type);
+            const char *alias_name;
+            enum udict_type alias_type;
+            int err = udict_inline_delete(udict, name, type);
+            if (unlikely(udict_inline_alias(name, type, &alias_name,
+                                            &alias_type)) &&
+                ubase_check(udict_inline_delete(udict, alias_name,
+                                                alias_type)))
+                err = UBASE_ERR_NONE;
+            return err;
         }
         case UDICT_NAME: {
             enum udict_type type = va_arg(args, enum udict_type);
@@ -552,8 +725,8 @@ static void udict_inline_free(struct udict *udict)
         udict_inline_mgr_from_udict_mgr(udict->mgr);
     struct udict_inline *inl = udict_inline_from_udict(udict);
 
-    umem_free(&inl->umem);
-    upool_free(&inline_mgr->udict_pool, inl);
+    udict_inline_release_buffer(inl);
+    upool_cache_free(&inline_mgr->udict_cache, inl);
     udict_mgr_release(&inline_mgr->mgr);
 }
 
@@ -592,6 +765,7 @@ static void udict_inline_free_inner(struct upool *upool, void *inl)
 static void udict_inline_mgr_vacuum(struct udict_mgr *mgr)
 {
     struct udict_inline_mgr *inline_mgr = udict_inline_mgr_from_udict_mgr(mgr);
+    upool_cache_vacuum(&inline_mgr->udict_cache);
     upool_vacuum(&inline_mgr->udict_pool);
 }
 
@@ -633,6 +807,7 @@ static void udict_inline_mgr_free(struct urefcount *urefcount)
     }
 #endif
 
+    upool_cache_clean(&inline_mgr->udict_cache);
     upool_clean(&inline_mgr->udict_pool);
     umem_mgr_release(inline_mgr->umem_mgr);
 
@@ -654,15 +829,21 @@ struct udict_mgr *udict_inline_mgr_alloc(unsigned int udict_pool_depth,
                                          struct umem_mgr *umem_mgr,
                                          int min_size, int extra_size)
 {
+    unsigned int udict_cache_length = upool_cache_length(udict_pool_depth);
     struct udict_inline_mgr *inline_mgr =
         malloc(sizeof(struct udict_inline_mgr) +
-               upool_sizeof(udict_pool_depth));
+               upool_sizeof(udict_pool_depth) +
+               upool_cache_sizeof(udict_cache_length));
     if (unlikely(inline_mgr == NULL))
         return NULL;
 
     upool_init(&inline_mgr->udict_pool, udict_pool_depth,
                (void *)inline_mgr + sizeof(struct udict_inline_mgr),
                udict_inline_alloc_inner, udict_inline_free_inner);
+    upool_cache_init(&inline_mgr->udict_cache, &inline_mgr->udict_pool,
+                     udict_cache_length,
+                     (void *)inline_mgr + sizeof(struct udict_inline_mgr) +
+                     upool_sizeof(udict_pool_depth));
     inline_mgr->umem_mgr = umem_mgr;
     umem_mgr_use(umem_mgr);
 
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe registration of the threads using ulifo64 counters
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulifo64.h>
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef UATOMIC_HAVE_64
+
+/** @internal lock protecting the allocation of the sets of counters */
+static pthread_mutex_t ulifo64_lock = PTHREAD_MUTEX_INITIALIZER;
+/** @internal bitmap of the sets of counters owned by a thread */
+static uint32_t ulifo64_owned = 0;
+/** @internal key releasing the set of counters of an exiting thread */
+static pthread_key_t ulifo64_key;
+/** @internal true if the key was created */
+static bool ulifo64_key_created = false;
+/** @internal control initializing the key */
+static pthread_once_t ulifo64_once = PTHREAD_ONCE_INIT;
+
+/** set of counters of the calling thread plus one, or 0 if the thread is
+ * not registered yet */
+__thread unsigned int ulifo64_thread = 0;
+
+/** @internal @This releases the set of counters of an exiting thread.
+ *
+ * @param opaque set of counters plus one
+ */
+static void ulifo64_thread_release(void *opaque)
+{
+    unsigned int set = (uintptr_t)opaque - 1;
+    pthread_mutex_lock(&ulifo64_lock);
+    ulifo64_owned &= ~(UINT32_C(1) << set);
+    pthread_mutex_unlock(&ulifo64_lock);
+}
+
+/** @internal @This creates the key releasing the sets of counters. */
+static void ulifo64_key_init(void)
+{
+    ulifo64_key_created =
+        pthread_key_create(&ulifo64_key, ulifo64_thread_release) == 0;
+}
+
+/** @This registers the calling thread, by giving it a set of counters that
+ * no other running thread owns. When all sets are owned, the thread uses
+ * the shared set. The set is released when the thread exits.
+ *
+ * @return set of counters of the thread
+ */
+unsigned int ulifo64_thread_register(void)
+{
+    pthread_once(&ulifo64_once, ulifo64_key_init);
+
+    unsigned int set = ULIFO64_THREADS;
+    pthread_mutex_lock(&ulifo64_lock);
+    if (likely(ulifo64_key_created && ~ulifo64_owned)) {
+        set = __builtin_ctz(~ulifo64_owned);
+        ulifo64_owned |= UINT32_C(1) << set;
+    }
+    pthread_mutex_unlock(&ulifo64_lock);
+
+    if (set != ULIFO64_THREADS &&
+        unlikely(pthread_setspecific(ulifo64_key,
+                                     (void *)(uintptr_t)(set + 1)) != 0)) {
+        ulifo64_thread_release((void *)(uintptr_t)(set + 1));
+        set = ULIFO64_THREADS;
+    }
+    ulifo64_thread = set + 1;
+    return set;
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe umem manager accounting the memory of another manager
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/uatomic.h>
+#include <upipe/umem.h>
+#include <upipe/umem_acct.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/** @This defines the private data structures of the umem accounting
+ * manager. */
+struct umem_acct_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** parent manager */
+    struct umem_mgr *parent;
+    /** octets currently allocated */
+    uatomic_uint32_t live;
+    /** maximum number of octets allocated at the same time */
+    uatomic_uint32_t peak;
+
+    /** common management structure */
+    struct umem_mgr mgr;
+};
+
+UBASE_FROM_TO(umem_acct_mgr, umem_mgr, umem_mgr, mgr)
+UBASE_FROM_TO(umem_acct_mgr, urefcount, urefcount, urefcount)
+
+/** @internal @This adds octets to the live counter, and updates the peak.
+ *
+ * @param acct_mgr pointer to umem accounting manager
+ * @param size number of octets
+ */
+static void umem_acct_add(struct umem_acct_mgr *acct_mgr, size_t size)
+{
+    uint32_t live = uatomic_fetch_add(&acct_mgr->live, size) + size;
+    uint32_t peak = uatomic_load(&acct_mgr->peak);
+    while (unlikely(live > peak) &&
+           !uatomic_compare_exchange(&acct_mgr->peak, &peak, live));
+}
+
+/** @This allocates a new umem buffer space.
+ *
+ * @param mgr management structure
+ * @param umem caller-allocated structure, filled in with the required pointer
+ * and size (previous content is discarded)
+ * @param size requested size of the umem
+ * @return false if the memory couldn't be allocated (umem left untouched)
+ */
+static bool umem_acct_alloc(struct umem_mgr *mgr, struct umem *umem,
+                            size_t size)
+{
+    struct umem_acct_mgr *acct_mgr = umem_acct_mgr_from_umem_mgr(mgr);
+    if (unlikely(!umem_alloc(acct_mgr->parent, umem, size)))
+        return false;
+    /* the parent manager is restored when the umem is freed */
+    umem->mgr = mgr;
+    umem_acct_add(acct_mgr, size);
+    return true;
+}
+
+/** @This resizes a umem.
+ *
+ * @param umem caller-allocated structure, previously successfully passed to
+ * @ref umem_alloc, and filled in with the new pointer and size
+ * @param new_size new requested size of the umem
+ * @return false if the memory couldn't be allocated (umem left untouched)
+ */
+static bool umem_acct_realloc(struct umem *umem, size_t new_size)
+{
+    struct umem_mgr *mgr = umem->mgr;
+    struct umem_acct_mgr *acct_mgr = umem_acct_mgr_from_umem_mgr(mgr);
+    size_t old_size = umem->size;
+    umem->mgr = acct_mgr->parent;
+    bool ret = umem_realloc(umem, new_size);
+    umem->mgr = mgr;
+    if (likely(ret)) {
+        uatomic_fetch_sub(&acct_mgr->live, old_size);
+        umem_acct_add(acct_mgr, new_size);
+    }
+    return ret;
+}
+
+/** @This frees a umem.
+ *
+ * @param umem caller-allocated structure, previously successfully passed to
+ * @ref umem_alloc
+ */
+static void umem_acct_free(struct umem *umem)
+{
+    struct umem_acct_mgr *acct_mgr = umem_acct_mgr_from_umem_mgr(umem->mgr);
+    uatomic_fetch_sub(&acct_mgr->live, umem->size);
+    umem->mgr = acct_mgr->parent;
+    umem_free(umem);
+}
+
+/** @This instructs the parent manager to release all buffers currently kept
+ * in pools.
+ *
+ * @param mgr pointer to umem manager
+ */
+static void umem_acct_mgr_vacuum(struct umem_mgr *mgr)
+{
+    struct umem_acct_mgr *acct_mgr = umem_acct_mgr_from_umem_mgr(mgr);
+    umem_mgr_vacuum(acct_mgr->parent);
+}
+
+/** @This processes control commands on a umem accounting manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int umem_acct_mgr_control(struct umem_mgr *mgr,
+                                 int command, va_list args)
+{
+    struct umem_acct_mgr *acct_mgr = umem_acct_mgr_from_umem_mgr(mgr);
+
+    switch (command) {
+        case UMEM_MGR_GET_USAGE: {
+            struct umem_usage *usage_p = va_arg(args, struct umem_usage *);
+            if (unlikely(usage_p == NULL))
+                return UBASE_ERR_INVALID;
+            /* pools belong to the parent manager */
+            usage_p->live = uatomic_load(&acct_mgr->live);
+            usage_p->pooled = 0;
+            usage_p->peak = uatomic_load(&acct_mgr->peak);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a umem manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void umem_acct_mgr_free(struct urefcount *urefcount)
+{
+    struct umem_acct_mgr *acct_mgr = umem_acct_mgr_from_urefcount(urefcount);
+    umem_mgr_release(acct_mgr->parent);
+    uatomic_clean(&acct_mgr->live);
+    uatomic_clean(&acct_mgr->peak);
+    urefcount_clean(urefcount);
+    free(acct_mgr);
+}
+
+/** @This allocates a new instance of the umem accounting manager.
+ *
+ * @param parent umem manager actually allocating the buffers
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_acct_mgr_alloc(struct umem_mgr *parent)
+{
+    if (unlikely(parent == NULL))
+        return NULL;
+
+    struct umem_acct_mgr *acct_mgr = malloc(sizeof(struct umem_acct_mgr));
+    if (unlikely(acct_mgr == NULL))
+        return NULL;
+
+    acct_mgr->parent = umem_mgr_use(parent);
+    uatomic_init(&acct_mgr->live, 0);
+    uatomic_init(&acct_mgr->peak, 0);
+
+    urefcount_init(umem_acct_mgr_to_urefcount(acct_mgr), umem_acct_mgr_free);
+    acct_mgr->mgr.refcount = umem_acct_mgr_to_urefcount(acct_mgr);
+    acct_mgr->mgr.umem_alloc = umem_acct_alloc;
+    acct_mgr->mgr.umem_realloc = umem_acct_realloc;
+    acct_mgr->mgr.umem_free = umem_acct_free;
+    acct_mgr->mgr.umem_mgr_vacuum = umem_acct_mgr_vacuum;
+    acct_mgr->mgr.umem_mgr_control = umem_acct_mgr_control;
+
+    return umem_acct_mgr_to_umem_mgr(acct_mgr);
+}
@@ -25,6 +25,7 @@
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uatomic.h>
 #include <upipe/ulifo.h>
 #include <upipe/umem.h>
 #include <upipe/umem_pool.h>
@@ -32,6 +33,36 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <unistd.h>
+
+#ifdef UPIPE_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef UPIPE_HAVE_LINUX_MEMPOLICY_H
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+/** size of a hugepage */
+#define UMEM_POOL_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/** @This defines the statistics counters of a pool. */
+struct umem_pool_counters {
+    /** maximum number of buffers kept in the pool */
+    uint16_t depth;
+    /** number of allocations */
+    uatomic_uint32_t allocs;
+    /** number of allocations served from the pool */
+    uatomic_uint32_t hits;
+    /** number of allocations which had to fall back to the system */
+    uatomic_uint32_t fallbacks;
+    /** number of buffers currently allocated */
+    uatomic_uint32_t in_use;
+    /** maximum number of buffers allocated at the same time */
+    uatomic_uint32_t high_water;
+    /** number of buffers currently kept in the pool */
+    uatomic_uint32_t pooled;
+};
 
 /** @This defines the private data structures of the umem pool manager. */
 struct umem_pool_mgr {
@@ -45,6 +76,16 @@ struct umem_pool_mgr {
     size_t pool0_size;
     /** number of pools of buffers */
     size_t nb_pools;
+    /** size of a memory page if buffers are mapped, or 0 for malloc() */
+    size_t page_size;
+    /** NUMA node to bind mapped buffers to, or -1 */
+    int numa_node;
+    /** true if the statistics counters are maintained */
+    bool stats;
+    /** true once buffers were allocated */
+    bool used;
+    /** statistics counters, one per pool */
+    struct umem_pool_counters *counters;
     /** buffer pools */
     struct ulifo pools[];
 };
@@ -75,6 +116,90 @@ static unsigned int umem_pool_find(struct umem_mgr *mgr, size_t wanted,
     return pool;
 }
 
+#ifdef UPIPE_HAVE_SYS_MMAN_H
+/** @internal @This returns the size of the mapping backing a buffer of the
+ * given size, or 0 if the buffer is carved out of malloc().
+ *
+ * @param pool_mgr pointer to umem pool manager
+ * @param size size of the buffer
+ * @return size of the mapping
+ */
+static size_t umem_pool_map_size(struct umem_pool_mgr *pool_mgr, size_t size)
+{
+    if (!pool_mgr->page_size || size < pool_mgr->page_size)
+        return 0;
+    if (size >= UMEM_POOL_HUGEPAGE_SIZE)
+        return (size + UMEM_POOL_HUGEPAGE_SIZE - 1) &
+               ~(size_t)(UMEM_POOL_HUGEPAGE_SIZE - 1);
+    return (size + pool_mgr->page_size - 1) & ~(pool_mgr->page_size - 1);
+}
+#endif
+
+/** @internal @This allocates a buffer from the system, either with malloc()
+ * or with one mapping (backed by hugepages if possible).
+ *
+ * @param pool_mgr pointer to umem pool manager
+ * @param size size of the buffer
+ * @return pointer to the buffer, or NULL in case of error
+ */
+static uint8_t *umem_pool_buffer_alloc(struct umem_pool_mgr *pool_mgr,
+                                       size_t size)
+{
+#ifdef UPIPE_HAVE_SYS_MMAN_H
+    size_t map_size = umem_pool_map_size(pool_mgr, size);
+    if (map_size) {
+        void *buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (map_size >= UMEM_POOL_HUGEPAGE_SIZE)
+            buffer = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (buffer == MAP_FAILED) {
+            /* no reserved hugepages, fall back to transparent hugepages */
+            buffer = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (unlikely(buffer == MAP_FAILED))
+                return NULL;
+#ifdef MADV_HUGEPAGE
+            if (map_size >= UMEM_POOL_HUGEPAGE_SIZE)
+                madvise(buffer, map_size, MADV_HUGEPAGE);
+#endif
+        }
+#ifdef UPIPE_HAVE_LINUX_MEMPOLICY_H
+        if (pool_mgr->numa_node >= 0 &&
+            pool_mgr->numa_node < sizeof(unsigned long) * 8) {
+            /* pages are not faulted in yet, so the policy applies to all */
+            unsigned long nodemask = 1UL << pool_mgr->numa_node;
+            syscall(SYS_mbind, buffer, map_size, MPOL_PREFERRED, &nodemask,
+                    sizeof(nodemask) * 8, 0);
+        }
+#endif
+        return buffer;
+    }
+#endif
+    return malloc(size);
+}
+
+/** @internal @This releases a buffer allocated by
+ * @ref umem_pool_buffer_alloc.
+ *
+ * @param pool_mgr pointer to umem pool manager
+ * @param buffer pointer to the buffer
+ * @param size size of the buffer
+ */
+static void umem_pool_buffer_free(struct umem_pool_mgr *pool_mgr,
+                                  uint8_t *buffer, size_t size)
+{
+#ifdef UPIPE_HAVE_SYS_MMAN_H
+    size_t map_size = umem_pool_map_size(pool_mgr, size);
+    if (map_size) {
+        munmap(buffer, map_size);
+        return;
+    }
+#endif
+    free(buffer);
+}
+
 /** @This allocates a new umem buffer space.
  *
  * @param mgr management structure
@@ -91,13 +216,29 @@ static bool umem_pool_alloc(struct umem_mgr *mgr, struct umem *umem,
     unsigned int pool = umem_pool_find(mgr, size, &real_size);
     uint8_t *buffer = NULL;
 
+    if (unlikely(!pool_mgr->used))
+        pool_mgr->used = true;
     if (likely(pool < pool_mgr->nb_pools))
         buffer = ulifo_pop(&pool_mgr->pools[pool], uint8_t *);
+    bool hit = buffer != NULL;
+    if (hit && unlikely(pool_mgr->stats))
+        uatomic_fetch_sub(&pool_mgr->counters[pool].pooled, 1);
     if (unlikely(buffer == NULL))
-        buffer = malloc(real_size);
+        buffer = umem_pool_buffer_alloc(pool_mgr, real_size);
     if (unlikely(buffer == NULL))
         return false;
 
+    if (unlikely(pool_mgr->stats) && likely(pool < pool_mgr->nb_pools)) {
+        struct umem_pool_counters *counters = &pool_mgr->counters[pool];
+        uatomic_fetch_add(&counters->allocs, 1);
+        uatomic_fetch_add(hit ? &counters->hits : &counters->fallbacks, 1);
+        uint32_t in_use = uatomic_fetch_add(&counters->in_use, 1) + 1;
+        uint32_t high_water = uatomic_load(&counters->high_water);
+        while (unlikely(in_use > high_water) &&
+               !uatomic_compare_exchange(&counters->high_water, &high_water,
+                                         in_use));
+    }
+
     umem->buffer = buffer;
     umem->size = size;
     umem->real_size = real_size;
@@ -117,9 +258,21 @@ static void umem_pool_free(struct umem *umem)
     struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_umem_mgr(umem->mgr);
     unsigned int pool = umem_pool_find(umem->mgr, umem->real_size, NULL);
 
-    if (unlikely(pool >= pool_mgr->nb_pools ||
-                 !ulifo_push(&pool_mgr->pools[pool], umem->buffer)))
-        free(umem->buffer);
+    if (unlikely(pool >= pool_mgr->nb_pools))
+        umem_pool_buffer_free(pool_mgr, umem->buffer, umem->real_size);
+    else if (likely(!pool_mgr->stats)) {
+        if (unlikely(!ulifo_push(&pool_mgr->pools[pool], umem->buffer)))
+            umem_pool_buffer_free(pool_mgr, umem->buffer, umem->real_size);
+    } else {
+        struct umem_pool_counters *counters = &pool_mgr->counters[pool];
+        uatomic_fetch_sub(&counters->in_use, 1);
+        /* count it first so that a concurrent pop never makes it negative */
+        uatomic_fetch_add(&counters->pooled, 1);
+        if (unlikely(!ulifo_push(&pool_mgr->pools[pool], umem->buffer))) {
+            uatomic_fetch_sub(&counters->pooled, 1);
+            umem_pool_buffer_free(pool_mgr, umem->buffer, umem->real_size);
+        }
+    }
     umem->buffer = NULL;
     umem->mgr = NULL;
 }
@@ -160,8 +313,159 @@ static void umem_pool_mgr_vacuum(struct umem_mgr *mgr)
 
     for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
         uint8_t *buffer;
-        while ((buffer = ulifo_pop(&pool_mgr->pools[i], uint8_t *)) != NULL)
-            free(buffer);
+        while ((buffer = ulifo_pop(&pool_mgr->pools[i], uint8_t *)) != NULL) {
+            if (pool_mgr->stats)
+                uatomic_fetch_sub(&pool_mgr->counters[i].pooled, 1);
+            umem_pool_buffer_free(pool_mgr, buffer, pool_mgr->pool0_size << i);
+        }
+    }
+}
+
+/** @internal @This fills each pool with up to nb buffers.
+ *
+ * @param pool_mgr pointer to umem pool manager
+ * @param nb number of buffers to allocate in each pool
+ * @return an error code
+ */
+static int umem_pool_mgr_prealloc_pools(struct umem_pool_mgr *pool_mgr,
+                                        unsigned int nb)
+{
+    pool_mgr->used = true;
+    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
+        size_t size = pool_mgr->pool0_size << i;
+        for (unsigned int j = 0; j < nb; j++) {
+            uint8_t *buffer = umem_pool_buffer_alloc(pool_mgr, size);
+            if (unlikely(buffer == NULL))
+                return UBASE_ERR_ALLOC;
+            if (pool_mgr->stats)
+                uatomic_fetch_add(&pool_mgr->counters[i].pooled, 1);
+            if (!ulifo_push(&pool_mgr->pools[i], buffer)) {
+                /* pool is full */
+                if (pool_mgr->stats)
+                    uatomic_fetch_sub(&pool_mgr->counters[i].pooled, 1);
+                umem_pool_buffer_free(pool_mgr, buffer, size);
+                break;
+            }
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the statistics of a pool.
+ *
+ * @param pool_mgr pointer to umem pool manager
+ * @param pool index of the pool
+ * @param stats_p filled in with the statistics of the pool
+ * @return an error code
+ */
+static int umem_pool_mgr_get_pool_stats(struct umem_pool_mgr *pool_mgr,
+                                        unsigned int pool,
+                                        struct umem_pool_stats *stats_p)
+{
+    if (unlikely(pool >= pool_mgr->nb_pools || stats_p == NULL))
+        return UBASE_ERR_INVALID;
+    if (unlikely(!pool_mgr->stats))
+        return UBASE_ERR_UNHANDLED;
+
+    struct umem_pool_counters *counters = &pool_mgr->counters[pool];
+    stats_p->size = pool_mgr->pool0_size << pool;
+    stats_p->depth = counters->depth;
+    stats_p->allocs = uatomic_load(&counters->allocs);
+    stats_p->hits = uatomic_load(&counters->hits);
+    stats_p->fallbacks = uatomic_load(&counters->fallbacks);
+    stats_p->in_use = uatomic_load(&counters->in_use);
+    stats_p->high_water = uatomic_load(&counters->high_water);
+    stats_p->pooled = uatomic_load(&counters->pooled);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This enables or disables the statistics of the pools.
+ *
+ * @param pool_mgr pointer to umem pool manager
+ * @param enable true to enable the statistics
+ * @return an error code
+ */
+static int umem_pool_mgr_set_pool_stats(struct umem_pool_mgr *pool_mgr,
+                                        bool enable)
+{
+    if (enable == pool_mgr->stats)
+        return UBASE_ERR_NONE;
+    /* counters would be inconsistent with the buffers already allocated */
+    if (unlikely(enable && pool_mgr->used))
+        return UBASE_ERR_BUSY;
+    pool_mgr->stats = enable;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the memory usage of the pools. Allocations larger
+ * than the biggest pool are not accounted, and the peak is the sum of the
+ * peaks of each pool, which may not have happened at the same time.
+ *
+ * @param pool_mgr pointer to umem pool manager
+ * @param usage_p filled in with the memory usage
+ * @return an error code
+ */
+static int umem_pool_mgr_get_usage(struct umem_pool_mgr *pool_mgr,
+                                   struct umem_usage *usage_p)
+{
+    if (unlikely(usage_p == NULL))
+        return UBASE_ERR_INVALID;
+    if (unlikely(!pool_mgr->stats))
+        return UBASE_ERR_UNHANDLED;
+
+    usage_p->live = usage_p->pooled = usage_p->peak = 0;
+    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
+        struct umem_pool_counters *counters = &pool_mgr->counters[i];
+        uint64_t size = pool_mgr->pool0_size << i;
+        usage_p->live += size * uatomic_load(&counters->in_use);
+        usage_p->pooled += size * uatomic_load(&counters->pooled);
+        usage_p->peak += size * uatomic_load(&counters->high_water);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This processes control commands on a umem pool manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int umem_pool_mgr_control(struct umem_mgr *mgr,
+                                 int command, va_list args)
+{
+    struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_umem_mgr(mgr);
+
+    switch (command) {
+        case UMEM_MGR_GET_USAGE: {
+            struct umem_usage *usage_p = va_arg(args, struct umem_usage *);
+            return umem_pool_mgr_get_usage(pool_mgr, usage_p);
+        }
+        case UMEM_POOL_MGR_PREALLOC: {
+            UBASE_SIGNATURE_CHECK(args, UMEM_POOL_SIGNATURE)
+            unsigned int nb = va_arg(args, unsigned int);
+            return umem_pool_mgr_prealloc_pools(pool_mgr, nb);
+        }
+        case UMEM_POOL_MGR_GET_NB_POOLS: {
+            UBASE_SIGNATURE_CHECK(args, UMEM_POOL_SIGNATURE)
+            unsigned int *nb_pools_p = va_arg(args, unsigned int *);
+            *nb_pools_p = pool_mgr->nb_pools;
+            return UBASE_ERR_NONE;
+        }
+        case UMEM_POOL_MGR_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UMEM_POOL_SIGNATURE)
+            unsigned int pool = va_arg(args, unsigned int);
+            struct umem_pool_stats *stats_p =
+                va_arg(args, struct umem_pool_stats *);
+            return umem_pool_mgr_get_pool_stats(pool_mgr, pool, stats_p);
+        }
+        case UMEM_POOL_MGR_SET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UMEM_POOL_SIGNATURE)
+            bool enable = va_arg(args, int);
+            return umem_pool_mgr_set_pool_stats(pool_mgr, enable);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
     }
 }
 
@@ -174,37 +478,45 @@ static void umem_pool_mgr_free(struct urefcount *urefcount)
     struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_urefcount(urefcount);
     umem_pool_mgr_vacuum(umem_pool_mgr_to_umem_mgr(pool_mgr));
 
-    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++)
+    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
+        struct umem_pool_counters *counters = &pool_mgr->counters[i];
         ulifo_clean(&pool_mgr->pools[i]);
+        uatomic_clean(&counters->allocs);
+        uatomic_clean(&counters->hits);
+        uatomic_clean(&counters->fallbacks);
+        uatomic_clean(&counters->in_use);
+        uatomic_clean(&counters->high_water);
+        uatomic_clean(&counters->pooled);
+    }
 
     urefcount_clean(urefcount);
     free(pool_mgr);
 }
 
-/** @This allocates a new instance of the umem pool manager allocating buffers
- * from application memory, using pools in power of 2's.
+/** @internal @This allocates a new instance of the umem pool manager.
  *
  * @param pool0_size size (in octets) of the smallest allocatable buffer; it
  * must be a power of 2
- * @param nb_pools number of buffer pools to maintain, with sizes in power of
- * 2's increments, followed, for each pool, by the maximum number of buffers
- * to keep in the pool (unsigned int); larger buffers will be directly managed
- * with malloc() and free()
+ * @param huge true if buffers larger than a page are to be mapped
+ * @param numa_node NUMA node to bind mapped buffers to, or -1
+ * @param nb_pools number of buffer pools to maintain
+ * @param args list of the maximum number of buffers to keep in each pool
+ * (unsigned int)
  * @return pointer to manager, or NULL in case of error
  */
-struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
+static struct umem_mgr *umem_pool_mgr_alloc_va(size_t pool0_size, bool huge,
+                                               int numa_node, size_t nb_pools,
+                                               va_list args)
 {
     size_t alloc_size = sizeof(struct umem_pool_mgr) +
-                        sizeof(struct ulifo) * nb_pools;
+                        sizeof(struct ulifo) * nb_pools +
+                        sizeof(struct umem_pool_counters) * nb_pools;
     unsigned int pools_depths[nb_pools];
-    va_list args;
-    va_start(args, nb_pools);
     for (unsigned int i = 0; i < nb_pools; i++) {
         pools_depths[i] = va_arg(args, unsigned int);
         assert(pools_depths[i] <= UINT16_MAX);
         alloc_size += ulifo_sizeof(pools_depths[i]);
     }
-    va_end(args);
 
     struct umem_pool_mgr *pool_mgr = malloc(alloc_size);
     if (unlikely(pool_mgr == NULL))
@@ -212,13 +524,34 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
 
     pool_mgr->pool0_size = pool0_size;
     pool_mgr->nb_pools = nb_pools;
+    pool_mgr->page_size = 0;
+    pool_mgr->numa_node = -1;
+    pool_mgr->stats = false;
+    pool_mgr->used = false;
+#ifdef UPIPE_HAVE_SYS_MMAN_H
+    if (huge) {
+        long page_size = sysconf(_SC_PAGESIZE);
+        pool_mgr->page_size = page_size > 0 ? page_size : 4096;
+        pool_mgr->numa_node = numa_node;
+    }
+#endif
 
-    void *extra = (void *)pool_mgr + sizeof(struct umem_pool_mgr) +
-                  sizeof(struct ulifo) * nb_pools;
+    pool_mgr->counters = (void *)pool_mgr + sizeof(struct umem_pool_mgr) +
+                         sizeof(struct ulifo) * nb_pools;
+    void *extra = (void *)pool_mgr->counters +
+                  sizeof(struct umem_pool_counters) * nb_pools;
 
     for (unsigned int i = 0; i < nb_pools; i++) {
+        struct umem_pool_counters *counters = &pool_mgr->counters[i];
         ulifo_init(&pool_mgr->pools[i], pools_depths[i], extra);
         extra += ulifo_sizeof(pools_depths[i]);
+        counters->depth = pools_depths[i];
+        uatomic_init(&counters->allocs, 0);
+        uatomic_init(&counters->hits, 0);
+        uatomic_init(&counters->fallbacks, 0);
+        uatomic_init(&counters->in_use, 0);
+        uatomic_init(&counters->high_water, 0);
+        uatomic_init(&counters->pooled, 0);
     }
 
     urefcount_init(umem_pool_mgr_to_urefcount(pool_mgr), umem_pool_mgr_free);
@@ -227,10 +560,112 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
     pool_mgr->mgr.umem_realloc = umem_pool_realloc;
     pool_mgr->mgr.umem_free = umem_pool_free;
     pool_mgr->mgr.umem_mgr_vacuum = umem_pool_mgr_vacuum;
+    pool_mgr->mgr.umem_mgr_control = umem_pool_mgr_control;
 
     return umem_pool_mgr_to_umem_mgr(pool_mgr);
 }
 
+/** @This allocates a new instance of the umem pool manager allocating buffers
+ * from application memory, using pools in power of 2's.
+ *
+ * @param pool0_size size (in octets) of the smallest allocatable buffer; it
+ * must be a power of 2
+ * @param nb_pools number of buffer pools to maintain, with sizes in power of
+ * 2's increments, followed, for each pool, by the maximum number of buffers
+ * to keep in the pool (unsigned int); larger buffers will be directly managed
+ * with malloc() and free()
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
+{
+    va_list args;
+    va_start(args, nb_pools);
+    struct umem_mgr *mgr = umem_pool_mgr_alloc_va(pool0_size, false, -1,
+                                                  nb_pools, args);
+    va_end(args);
+    return mgr;
+}
+
+/** @This allocates a new instance of the umem pool manager allocating buffers
+ * of one page or more from anonymous mappings, backed by hugepages for
+ * buffers of 2 MiB or more, and optionally bound to a NUMA node. Smaller
+ * buffers are allocated with malloc().
+ *
+ * @param pool0_size size (in octets) of the smallest allocatable buffer; it
+ * must be a power of 2
+ * @param numa_node NUMA node to allocate buffers on, or -1
+ * @param nb_pools number of buffer pools to maintain, with sizes in power of
+ * 2's increments, followed, for each pool, by the maximum number of buffers
+ * to keep in the pool (unsigned int)
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_pool_mgr_alloc_huge(size_t pool0_size, int numa_node,
+                                          size_t nb_pools, ...)
+{
+    va_list args;
+    va_start(args, nb_pools);
+    struct umem_mgr *mgr = umem_pool_mgr_alloc_va(pool0_size, true, numa_node,
+                                                  nb_pools, args);
+    va_end(args);
+    return mgr;
+}
+
+/** @internal @This allocates a new instance of the umem pool manager with
+ * the given options.
+ *
+ * @param pool0_size size (in octets) of the smallest allocatable buffer; it
+ * must be a power of 2
+ * @param huge true if buffers larger than a page are to be mapped
+ * @param numa_node NUMA node to bind mapped buffers to, or -1
+ * @param nb_pools number of buffer pools to maintain, followed, for each
+ * pool, by the maximum number of buffers to keep in the pool (unsigned int)
+ * @return pointer to manager, or NULL in case of error
+ */
+static struct umem_mgr *umem_pool_mgr_alloc_opt(size_t pool0_size, bool huge,
+                                                int numa_node,
+                                                size_t nb_pools, ...)
+{
+    va_list args;
+    va_start(args, nb_pools);
+    struct umem_mgr *mgr = umem_pool_mgr_alloc_va(pool0_size, huge, numa_node,
+                                                  nb_pools, args);
+    va_end(args);
+    return mgr;
+}
+
+/** @internal @This allocates a new instance of the umem pool manager with
+ * the default pool layout.
+ *
+ * @param base_pools_depth number of buffers to keep in the pool for the smaller
+ * buffers; for larger buffers the same number is used, divided by 2, 4, or 8
+ * @param huge true if buffers larger than a page are to be mapped
+ * @param numa_node NUMA node to bind mapped buffers to, or -1
+ * @return pointer to manager, or NULL in case of error
+ */
+static struct umem_mgr *umem_pool_mgr_alloc_default(uint16_t base_pools_depth,
+                                                    bool huge, int numa_node)
+{
+    return umem_pool_mgr_alloc_opt(32, huge, numa_node, 18,
+                                   base_pools_depth, /* 32 */
+                                   base_pools_depth, /* 64 */
+                                   base_pools_depth, /* 128 */
+                                   base_pools_depth, /* 256 */
+                                   base_pools_depth, /* 512 */
+                                   base_pools_depth, /* 1 Ki */
+                                   base_pools_depth, /* 2 Ki */
+                                   base_pools_depth, /* 4 Ki */
+                                   base_pools_depth / 2, /* 8 Ki */
+                                   base_pools_depth / 2, /* 16 Ki */
+                                   base_pools_depth / 2, /* 32 Ki */
+                                   base_pools_depth / 4, /* 64 Ki */
+                                   base_pools_depth / 4, /* 128 Ki */
+                                   base_pools_depth / 4, /* 256 Ki */
+                                   base_pools_depth / 4, /* 512 Ki */
+                                   base_pools_depth / 8, /* 1 Mi */
+                                   base_pools_depth / 8, /* 2 Mi */
+                                   base_pools_depth / 8); /* 4 Mi */
+}
+
 /** @This allocates a new instance of the umem pool manager allocating buffers
  * from application memory, using pools in power of 2's, with a simpler API.
  *
@@ -240,23 +675,21 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
  */
 struct umem_mgr *umem_pool_mgr_alloc_simple(uint16_t base_pools_depth)
 {
-    return umem_pool_mgr_alloc(32, 18,
-                               base_pools_depth, /* 32 */
-                               base_pools_depth, /* 64 */
-                               base_pools_depth, /* 128 */
-                               base_pools_depth, /* 256 */
-                               base_pools_depth, /* 512 */
-                               base_pools_depth, /* 1 Ki */
-                               base_pools_depth, /* 2 Ki */
-                               base_pools_depth, /* 4 Ki */
-                               base_pools_depth / 2, /* 8 Ki */
-                               base_pools_depth / 2, /* 16 Ki */
-                               base_pools_depth / 2, /* 32 Ki */
-                               base_pools_depth / 4, /* 64 Ki */
-                               base_pools_depth / 4, /* 128 Ki */
-                               base_pools_depth / 4, /* 256 Ki */
-                               base_pools_depth / 4, /* 512 Ki */
-                               base_pools_depth / 8, /* 1 Mi */
-                               base_pools_depth / 8, /* 2 Mi */
-                               base_pools_depth / 8); /* 4 Mi */
+    return umem_pool_mgr_alloc_default(base_pools_depth, false, -1);
+}
+
+/** @This allocates a new instance of the umem pool manager allocating buffers
+ * of one page or more from anonymous mappings, backed by hugepages for
+ * buffers of 2 MiB or more, and optionally bound to a NUMA node, with a
+ * simpler API.
+ *
+ * @param base_pools_depth number of buffers to keep in the pool for the smaller
+ * buffers; for larger buffers the same number is used, divided by 2, 4, or 8
+ * @param numa_node NUMA node to allocate buffers on, or -1
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_pool_mgr_alloc_huge_simple(uint16_t base_pools_depth,
+                                                 int numa_node)
+{
+    return umem_pool_mgr_alloc_default(base_pools_depth, true, numa_node);
 }
@@ -0,0 +1,634 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe shared-memory allocator
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/uatomic.h>
+#include <upipe/umem.h>
+#include <upipe/umem_shm.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** magic number at the beginning of an arena */
+#define UMEM_SHM_MAGIC UBASE_FOURCC('u','s','h','m')
+/** alignment of chunks and buffers in the arena */
+#define UMEM_SHM_ALIGN 64
+/** maximum number of pools in an arena */
+#define UMEM_SHM_MAX_POOLS 32
+/** maximum number of chunks in a pool, as indexes + 1 are stored on 32 bits */
+#define UMEM_SHM_MAX_CHUNKS (UINT32_MAX - 1)
+/** @hidden */
+#define UMEM_SHM_TAG (UINT64_C(1) << 32)
+
+/** @This describes a pool of chunks of the arena. */
+struct umem_shm_pool {
+    /** offset of the first chunk in the arena */
+    uint64_t offset;
+    /** number of chunks */
+    uint32_t nb_chunks;
+#ifdef UATOMIC_HAVE_64
+    /** top of the stack of free chunks, as a 32-bit tag (against ABA
+     * problems) followed by the 32-bit index + 1 of the chunk, or 0 if
+     * empty */
+    uatomic_uint64_t free;
+#endif
+};
+
+/** @This is the header of an arena, shared by all processes. */
+struct umem_shm_header {
+    /** magic number */
+    uint32_t magic;
+    /** number of pools */
+    uint32_t nb_pools;
+    /** size (in octets) of the buffers of the first pool */
+    uint64_t pool0_size;
+    /** pools of chunks */
+    struct umem_shm_pool pools[];
+};
+
+/** @This is the header of a chunk, preceding its buffer. */
+struct umem_shm_chunk {
+    /** number of references to the chunk, in all processes */
+    uatomic_uint32_t refcount;
+    /** index + 1 of the next free chunk, or 0 */
+    uint32_t next;
+};
+
+/** @This is the layout of a pool, as checked when the arena was mapped. */
+struct umem_shm_layout {
+    /** offset of the first chunk in the arena */
+    uint64_t offset;
+    /** number of chunks */
+    uint32_t nb_chunks;
+};
+
+/** @This defines the private data structures of the umem shm manager. */
+struct umem_shm_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** common management structure */
+    struct umem_mgr mgr;
+
+    /** file descriptor of the arena */
+    int fd;
+    /** mapping of the arena */
+    uint8_t *base;
+    /** size of the mapping */
+    size_t size;
+    /** size (in octets) of buffers of the first pool */
+    size_t pool0_size;
+    /** number of pools */
+    unsigned int nb_pools;
+    /** layout of the pools (not read from the arena after mapping, since
+     * other processes may write to it) */
+    struct umem_shm_layout layouts[];
+};
+
+UBASE_FROM_TO(umem_shm_mgr, umem_mgr, umem_mgr, mgr)
+UBASE_FROM_TO(umem_shm_mgr, urefcount, urefcount, urefcount)
+
+/** @internal @This returns the distance between two chunks of a pool.
+ *
+ * @param pool0_size size (in octets) of buffers of the first pool
+ * @param pool index of the pool
+ * @return size of a chunk, including its header
+ */
+static size_t umem_shm_stride(size_t pool0_size, unsigned int pool)
+{
+    return (UMEM_SHM_ALIGN + (pool0_size << pool) + UMEM_SHM_ALIGN - 1) &
+           ~(size_t)(UMEM_SHM_ALIGN - 1);
+}
+
+/** @internal @This returns the size of the header of an arena.
+ *
+ * @param nb_pools number of pools
+ * @return size of the header, rounded up to the alignment of chunks
+ */
+static size_t umem_shm_header_size(unsigned int nb_pools)
+{
+    return (sizeof(struct umem_shm_header) +
+            nb_pools * sizeof(struct umem_shm_pool) + UMEM_SHM_ALIGN - 1) &
+           ~(size_t)(UMEM_SHM_ALIGN - 1);
+}
+
+/** @internal @This returns the shared header of the arena.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @return pointer to the header
+ */
+static struct umem_shm_header *umem_shm_header(struct umem_shm_mgr *shm_mgr)
+{
+    return (struct umem_shm_header *)shm_mgr->base;
+}
+
+/** @internal @This returns a chunk of a pool.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @param pool index of the pool
+ * @param index index of the chunk in the pool
+ * @return pointer to the chunk
+ */
+static struct umem_shm_chunk *umem_shm_chunk(struct umem_shm_mgr *shm_mgr,
+                                             unsigned int pool,
+                                             unsigned int index)
+{
+    return (struct umem_shm_chunk *)(shm_mgr->base +
+            shm_mgr->layouts[pool].offset +
+            index * umem_shm_stride(shm_mgr->pool0_size, pool));
+}
+
+/** @internal @This pops a free chunk from a pool.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @param pool index of the pool
+ * @return pointer to the chunk, or NULL if the pool is exhausted
+ */
+static struct umem_shm_chunk *umem_shm_pop(struct umem_shm_mgr *shm_mgr,
+                                           unsigned int pool)
+{
+#ifdef UATOMIC_HAVE_64
+    struct umem_shm_pool *shm_pool = &umem_shm_header(shm_mgr)->pools[pool];
+    uint64_t top = uatomic64_load(&shm_pool->free);
+    struct umem_shm_chunk *chunk;
+    uint64_t next;
+    do {
+        uint32_t index = top & UINT32_MAX;
+        if (index == 0 || index > shm_mgr->layouts[pool].nb_chunks)
+            return NULL;
+        chunk = umem_shm_chunk(shm_mgr, pool, index - 1);
+        next = ((top + UMEM_SHM_TAG) & ~(uint64_t)UINT32_MAX) | chunk->next;
+    } while (!uatomic64_compare_exchange(&shm_pool->free, &top, next));
+    return chunk;
+#else
+    return NULL;
+#endif
+}
+
+/** @internal @This pushes a chunk back to the free chunks of a pool.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @param pool index of the pool
+ * @param index index of the chunk in the pool
+ */
+static void umem_shm_push(struct umem_shm_mgr *shm_mgr, unsigned int pool,
+                          unsigned int index)
+{
+#ifdef UATOMIC_HAVE_64
+    struct umem_shm_pool *shm_pool = &umem_shm_header(shm_mgr)->pools[pool];
+    struct umem_shm_chunk *chunk = umem_shm_chunk(shm_mgr, pool, index);
+    uint64_t top = uatomic64_load(&shm_pool->free);
+    uint64_t next;
+    do {
+        chunk->next = top & UINT32_MAX;
+        next = ((top + UMEM_SHM_TAG) & ~(uint64_t)UINT32_MAX) | (index + 1);
+    } while (!uatomic64_compare_exchange(&shm_pool->free, &top, next));
+#endif
+}
+
+/** @internal @This finds the chunk containing an offset of the arena.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @param offset offset in the arena
+ * @param pool_p filled in with the index of the pool
+ * @param index_p filled in with the index of the chunk
+ * @return false if the offset doesn't point to the buffer of a chunk
+ */
+static bool umem_shm_locate(struct umem_shm_mgr *shm_mgr, uint64_t offset,
+                            unsigned int *pool_p, unsigned int *index_p)
+{
+    for (unsigned int pool = 0; pool < shm_mgr->nb_pools; pool++) {
+        struct umem_shm_layout *layout = &shm_mgr->layouts[pool];
+        size_t stride = umem_shm_stride(shm_mgr->pool0_size, pool);
+        if (offset < layout->offset ||
+            offset >= layout->offset + layout->nb_chunks * stride)
+            continue;
+
+        uint64_t inner = (offset - layout->offset) % stride;
+        if (inner < UMEM_SHM_ALIGN ||
+            inner >= UMEM_SHM_ALIGN + (shm_mgr->pool0_size << pool))
+            return false;
+        *pool_p = pool;
+        *index_p = (offset - layout->offset) / stride;
+        return true;
+    }
+    return false;
+}
+
+/** @internal @This fills in a umem with a chunk.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @param umem caller-allocated structure
+ * @param pool index of the pool
+ * @param chunk pointer to the chunk
+ * @param size requested size of the umem
+ */
+static void umem_shm_init_umem(struct umem_shm_mgr *shm_mgr,
+                               struct umem *umem, unsigned int pool,
+                               struct umem_shm_chunk *chunk, size_t size)
+{
+    umem->buffer = (uint8_t *)chunk + UMEM_SHM_ALIGN;
+    umem->size = size;
+    umem->real_size = shm_mgr->pool0_size << pool;
+    umem->mgr = umem_mgr_use(umem_shm_mgr_to_umem_mgr(shm_mgr));
+}
+
+/** @This allocates a new umem buffer space.
+ *
+ * @param mgr management structure
+ * @param umem caller-allocated structure, filled in with the required pointer
+ * and size (previous content is discarded)
+ * @param size requested size of the umem
+ * @return false if the memory couldn't be allocated (umem left untouched)
+ */
+static bool umem_shm_alloc(struct umem_mgr *mgr, struct umem *umem,
+                           size_t size)
+{
+    struct umem_shm_mgr *shm_mgr = umem_shm_mgr_from_umem_mgr(mgr);
+
+    /* smaller pools first, then larger ones if exhausted */
+    for (unsigned int pool = 0; pool < shm_mgr->nb_pools; pool++) {
+        if (size > (shm_mgr->pool0_size << pool))
+            continue;
+        struct umem_shm_chunk *chunk = umem_shm_pop(shm_mgr, pool);
+        if (chunk == NULL)
+            continue;
+
+        uatomic_store(&chunk->refcount, 1);
+        umem_shm_init_umem(shm_mgr, umem, pool, chunk, size);
+        return true;
+    }
+    return false;
+}
+
+/** @This frees a umem, returning the chunk to its pool when no process
+ * references it anymore.
+ *
+ * @param umem pointer to umem
+ */
+static void umem_shm_free(struct umem *umem)
+{
+    struct umem_mgr *mgr = umem->mgr;
+    struct umem_shm_mgr *shm_mgr = umem_shm_mgr_from_umem_mgr(mgr);
+    unsigned int pool, index;
+    bool found = umem_shm_locate(shm_mgr, umem->buffer - shm_mgr->base,
+                                 &pool, &index);
+    assert(found);
+    if (likely(found)) {
+        struct umem_shm_chunk *chunk = umem_shm_chunk(shm_mgr, pool, index);
+        if (uatomic_fetch_sub(&chunk->refcount, 1) == 1)
+            umem_shm_push(shm_mgr, pool, index);
+    }
+    umem->buffer = NULL;
+    umem->mgr = NULL;
+    umem_mgr_release(mgr);
+}
+
+/** @This resizes a umem, moving it to a larger chunk if needed.
+ *
+ * @param umem caller-allocated structure, previously successfully passed to
+ * @ref umem_alloc, and filled in with the new pointer and size
+ * @param new_size new requested size of the umem
+ * @return false if the memory couldn't be allocated (umem left untouched)
+ */
+static bool umem_shm_realloc(struct umem *umem, size_t new_size)
+{
+    if (likely(new_size <= umem->real_size)) {
+        umem->size = new_size;
+        return true;
+    }
+
+    struct umem new_umem;
+    if (!umem_shm_alloc(umem->mgr, &new_umem, new_size))
+        return false;
+    memcpy(new_umem.buffer, umem->buffer, umem->size);
+    umem_shm_free(umem);
+    *umem = new_umem;
+    return true;
+}
+
+/** @internal @This takes a reference to the chunk containing a buffer.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @param buffer pointer to a buffer of the arena
+ * @param offset_p filled in with the offset of the buffer in the arena
+ * @return an error code
+ */
+static int umem_shm_mgr_export_buffer(struct umem_shm_mgr *shm_mgr,
+                                      const uint8_t *buffer,
+                                      uint64_t *offset_p)
+{
+    unsigned int pool, index;
+    if (unlikely(buffer < shm_mgr->base ||
+                 buffer >= shm_mgr->base + shm_mgr->size ||
+                 !umem_shm_locate(shm_mgr, buffer - shm_mgr->base,
+                                  &pool, &index)))
+        return UBASE_ERR_INVALID;
+
+    struct umem_shm_chunk *chunk = umem_shm_chunk(shm_mgr, pool, index);
+    uatomic_fetch_add(&chunk->refcount, 1);
+    *offset_p = buffer - shm_mgr->base;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This fills in a umem with the chunk containing an offset.
+ *
+ * @param shm_mgr pointer to umem shm manager
+ * @param offset offset of a buffer in the arena
+ * @param umem caller-allocated structure
+ * @param skip_p filled in with the offset of the buffer in the umem
+ * @return an error code
+ */
+static int umem_shm_mgr_import_buffer(struct umem_shm_mgr *shm_mgr,
+                                      uint64_t offset, struct umem *umem,
+                                      size_t *skip_p)
+{
+    unsigned int pool, index;
+    if (unlikely(!umem_shm_locate(shm_mgr, offset, &pool, &index)))
+        return UBASE_ERR_INVALID;
+
+    struct umem_shm_chunk *chunk = umem_shm_chunk(shm_mgr, pool, index);
+    if (unlikely(!uatomic_load(&chunk->refcount)))
+        return UBASE_ERR_INVALID;
+    umem_shm_init_umem(shm_mgr, umem, pool, chunk,
+                       shm_mgr->pool0_size << pool);
+    *skip_p = shm_mgr->base + offset - umem->buffer;
+    return UBASE_ERR_NONE;
+}
+
+/** @This processes control commands on a umem shm manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int umem_shm_mgr_control(struct umem_mgr *mgr,
+                                int command, va_list args)
+{
+    struct umem_shm_mgr *shm_mgr = umem_shm_mgr_from_umem_mgr(mgr);
+
+    switch (command) {
+        case UMEM_SHM_MGR_GET_FD: {
+            UBASE_SIGNATURE_CHECK(args, UMEM_SHM_SIGNATURE)
+            int *fd_p = va_arg(args, int *);
+            *fd_p = shm_mgr->fd;
+            return UBASE_ERR_NONE;
+        }
+        case UMEM_SHM_MGR_EXPORT: {
+            UBASE_SIGNATURE_CHECK(args, UMEM_SHM_SIGNATURE)
+            const uint8_t *buffer = va_arg(args, const uint8_t *);
+            uint64_t *offset_p = va_arg(args, uint64_t *);
+            return umem_shm_mgr_export_buffer(shm_mgr, buffer, offset_p);
+        }
+        case UMEM_SHM_MGR_IMPORT: {
+            UBASE_SIGNATURE_CHECK(args, UMEM_SHM_SIGNATURE)
+            uint64_t offset = va_arg(args, uint64_t);
+            struct umem *umem = va_arg(args, struct umem *);
+            size_t *skip_p = va_arg(args, size_t *);
+            return umem_shm_mgr_import_buffer(shm_mgr, offset, umem, skip_p);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a umem manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void umem_shm_mgr_free(struct urefcount *urefcount)
+{
+    struct umem_shm_mgr *shm_mgr = umem_shm_mgr_from_urefcount(urefcount);
+    munmap(shm_mgr->base, shm_mgr->size);
+    close(shm_mgr->fd);
+    urefcount_clean(urefcount);
+    free(shm_mgr);
+}
+
+/** @internal @This allocates the private structure of a manager, and maps
+ * an arena.
+ *
+ * @param fd file descriptor of the arena
+ * @param size size of the arena
+ * @param nb_pools number of pools
+ * @return pointer to manager, or NULL in case of error
+ */
+static struct umem_shm_mgr *umem_shm_mgr_map(int fd, size_t size,
+                                             unsigned int nb_pools)
+{
+    struct umem_shm_mgr *shm_mgr = malloc(sizeof(struct umem_shm_mgr) +
+            nb_pools * sizeof(struct umem_shm_layout));
+    if (unlikely(shm_mgr == NULL))
+        return NULL;
+
+    shm_mgr->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fd, 0);
+    if (unlikely(shm_mgr->base == MAP_FAILED)) {
+        free(shm_mgr);
+        return NULL;
+    }
+    shm_mgr->fd = fd;
+    shm_mgr->size = size;
+    shm_mgr->nb_pools = nb_pools;
+
+    urefcount_init(umem_shm_mgr_to_urefcount(shm_mgr), umem_shm_mgr_free);
+    shm_mgr->mgr.refcount = umem_shm_mgr_to_urefcount(shm_mgr);
+    shm_mgr->mgr.umem_alloc = umem_shm_alloc;
+    shm_mgr->mgr.umem_realloc = umem_shm_realloc;
+    shm_mgr->mgr.umem_free = umem_shm_free;
+    shm_mgr->mgr.umem_mgr_vacuum = NULL;
+    shm_mgr->mgr.umem_mgr_control = umem_shm_mgr_control;
+    return shm_mgr;
+}
+
+/** @internal @This creates an anonymous shared memory file.
+ *
+ * @return file descriptor, or -1 in case of error
+ */
+static int umem_shm_create_fd(void)
+{
+#ifdef UPIPE_HAVE_MEMFD_CREATE
+    return memfd_create("upipe-umem-shm", MFD_CLOEXEC);
+#else
+    char path[] = "/dev/shm/upipe-umem-shm-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd != -1)
+        unlink(path);
+    return fd;
+#endif
+}
+
+/** @This allocates a new instance of the umem shm manager, creating an
+ * arena of shared memory.
+ *
+ * @param pool0_size size (in octets) of the smallest allocatable buffer; it
+ * must be a power of 2
+ * @param nb_pools number of buffer pools in the arena, with sizes in power of
+ * 2's increments, followed, for each pool, by the number of chunks of the
+ * pool (unsigned int, at most 4294967294)
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_shm_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
+{
+#if !defined(UPIPE_HAVE_ATOMIC_OPS) || !defined(UATOMIC_HAVE_64)
+    /* the fallback atomic variables cannot be shared between processes,
+     * and the free lists need 64-bit atomic operations */
+    return NULL;
+#else
+    if (unlikely(!pool0_size || (pool0_size & (pool0_size - 1)) ||
+                 !nb_pools || nb_pools > UMEM_SHM_MAX_POOLS))
+        return NULL;
+
+    unsigned int nb_chunks[nb_pools];
+    uint64_t offsets[nb_pools];
+    uint64_t size = umem_shm_header_size(nb_pools);
+    va_list args;
+    va_start(args, nb_pools);
+    for (unsigned int i = 0; i < nb_pools; i++) {
+        nb_chunks[i] = va_arg(args, unsigned int);
+        offsets[i] = size;
+        size += (uint64_t)nb_chunks[i] * umem_shm_stride(pool0_size, i);
+    }
+    va_end(args);
+    for (unsigned int i = 0; i < nb_pools; i++)
+        if (unlikely(nb_chunks[i] > UMEM_SHM_MAX_CHUNKS))
+            return NULL;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size > 0)
+        size = (size + page_size - 1) / page_size * page_size;
+    if (unlikely(size > SIZE_MAX))
+        return NULL;
+
+    int fd = umem_shm_create_fd();
+    if (unlikely(fd == -1))
+        return NULL;
+    if (unlikely(ftruncate(fd, size) == -1)) {
+        close(fd);
+        return NULL;
+    }
+
+    struct umem_shm_mgr *shm_mgr = umem_shm_mgr_map(fd, size, nb_pools);
+    if (unlikely(shm_mgr == NULL)) {
+        close(fd);
+        return NULL;
+    }
+    shm_mgr->pool0_size = pool0_size;
+
+    struct umem_shm_header *header = umem_shm_header(shm_mgr);
+    header->nb_pools = nb_pools;
+    header->pool0_size = pool0_size;
+    for (unsigned int i = 0; i < nb_pools; i++) {
+        struct umem_shm_pool *shm_pool = &header->pools[i];
+        shm_mgr->layouts[i].offset = shm_pool->offset = offsets[i];
+        shm_mgr->layouts[i].nb_chunks = shm_pool->nb_chunks = nb_chunks[i];
+        for (unsigned int j = 0; j < nb_chunks[i]; j++) {
+            struct umem_shm_chunk *chunk = umem_shm_chunk(shm_mgr, i, j);
+            uatomic_init(&chunk->refcount, 0);
+            chunk->next = j + 1 < nb_chunks[i] ? j + 2 : 0;
+        }
+        uatomic64_init(&shm_pool->free, nb_chunks[i] ? 1 : 0);
+    }
+    header->magic = UMEM_SHM_MAGIC;
+
+    return umem_shm_mgr_to_umem_mgr(shm_mgr);
+#endif
+}
+
+/** @This allocates a new instance of the umem shm manager, attaching to the
+ * arena of another manager, typically in another process.
+ *
+ * @param fd file descriptor of the arena, as returned by
+ * @ref umem_shm_mgr_get_fd; it belongs to the manager afterwards, even in
+ * case of error
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_shm_mgr_attach(int fd)
+{
+#if !defined(UPIPE_HAVE_ATOMIC_OPS) || !defined(UATOMIC_HAVE_64)
+    close(fd);
+    return NULL;
+#else
+    struct umem_shm_header header;
+    struct stat st;
+    if (unlikely(fstat(fd, &st) == -1 || st.st_size < sizeof(header) ||
+                 st.st_size > SIZE_MAX ||
+                 pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                 header.magic != UMEM_SHM_MAGIC || !header.nb_pools ||
+                 header.nb_pools > UMEM_SHM_MAX_POOLS ||
+                 !header.pool0_size ||
+                 (header.pool0_size & (header.pool0_size - 1)) ||
+                 header.pool0_size > st.st_size ||
+                 umem_shm_header_size(header.nb_pools) > st.st_size)) {
+        close(fd);
+        return NULL;
+    }
+
+    struct umem_shm_mgr *shm_mgr = umem_shm_mgr_map(fd, st.st_size,
+                                                    header.nb_pools);
+    if (unlikely(shm_mgr == NULL)) {
+        close(fd);
+        return NULL;
+    }
+    shm_mgr->pool0_size = header.pool0_size;
+
+    /* check the layout once, as the arena is shared with other processes */
+    struct umem_shm_header *shm_header = umem_shm_header(shm_mgr);
+    uint64_t end = umem_shm_header_size(header.nb_pools);
+    for (unsigned int i = 0; i < header.nb_pools; i++) {
+        struct umem_shm_layout *layout = &shm_mgr->layouts[i];
+        layout->offset = shm_header->pools[i].offset;
+        layout->nb_chunks = shm_header->pools[i].nb_chunks;
+        if (unlikely(layout->offset != end ||
+                     layout->nb_chunks > UMEM_SHM_MAX_CHUNKS)) {
+            umem_mgr_release(umem_shm_mgr_to_umem_mgr(shm_mgr));
+            return NULL;
+        }
+        end += (uint64_t)layout->nb_chunks *
+               umem_shm_stride(header.pool0_size, i);
+    }
+    if (unlikely(end > shm_mgr->size)) {
+        umem_mgr_release(umem_shm_mgr_to_umem_mgr(shm_mgr));
+        return NULL;
+    }
+
+    return umem_shm_mgr_to_umem_mgr(shm_mgr);
+#endif
+}
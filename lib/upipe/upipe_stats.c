@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe optional throughput and latency counters of pipes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/** @internal @This is the private structure holding the statistics. */
+struct upipe_stats_priv {
+    /** clock used to measure durations */
+    struct uclock *uclock;
+    /** public structure */
+    struct upipe_stats stats;
+};
+
+UBASE_FROM_TO(upipe_stats_priv, upipe_stats, stats, stats)
+
+/** @internal time spent in nested inputs of pipes having statistics, for
+ * the input currently executing in this thread */
+static __thread uint64_t *upipe_stats_nested = NULL;
+
+/** @This enables the collection of statistics on a pipe. The counters are
+ * reported with an @ref UPROBE_STATS event every period, if period is not 0,
+ * or when @ref upipe_stats_report is called.
+ *
+ * @param upipe description structure of the pipe
+ * @param period period between automatic reports in 27 MHz units, or 0
+ * @return an error code
+ */
+int upipe_stats_enable(struct upipe *upipe, uint64_t period)
+{
+    assert(upipe != NULL);
+    if (upipe->stats != NULL) {
+        upipe->stats->period = period;
+        return UBASE_ERR_NONE;
+    }
+
+    struct upipe_stats_priv *priv = malloc(sizeof(struct upipe_stats_priv));
+    if (unlikely(priv == NULL))
+        return UBASE_ERR_ALLOC;
+    priv->uclock = uclock_std_alloc(0);
+    if (unlikely(priv->uclock == NULL)) {
+        free(priv);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct upipe_stats *stats = upipe_stats_priv_to_stats(priv);
+    memset(stats, 0, sizeof(struct upipe_stats));
+    stats->period = period;
+    stats->start = uclock_now(priv->uclock);
+    upipe->stats = stats;
+    return UBASE_ERR_NONE;
+}
+
+/** @This disables the collection of statistics on a pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+void upipe_stats_disable(struct upipe *upipe)
+{
+    assert(upipe != NULL);
+    if (upipe->stats == NULL)
+        return;
+
+    struct upipe_stats_priv *priv = upipe_stats_priv_from_stats(upipe->stats);
+    upipe->stats = NULL;
+    uclock_release(priv->uclock);
+    free(priv);
+}
+
+/** @This throws an @ref UPROBE_STATS event with the current counters of a
+ * pipe, and resets them.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+int upipe_stats_report(struct upipe *upipe)
+{
+    assert(upipe != NULL);
+    struct upipe_stats *stats = upipe->stats;
+    if (unlikely(stats == NULL))
+        return UBASE_ERR_INVALID;
+
+    struct upipe_stats_priv *priv = upipe_stats_priv_from_stats(stats);
+    uint64_t now = uclock_now(priv->uclock);
+    struct upipe_stats report = *stats;
+    report.duration = now - stats->start;
+
+    stats->inputs = stats->octets = stats->outputs = 0;
+    stats->time = stats->self_time = stats->max_time = 0;
+    memset(stats->latency, 0, sizeof(stats->latency));
+    stats->latency_sum = 0;
+    stats->start = now;
+    return upipe_throw(upipe, UPROBE_STATS, &report);
+}
+
+/** @internal @This accounts a latency in the histogram.
+ *
+ * @param stats statistics of the pipe
+ * @param latency latency in 27 MHz units
+ */
+static void upipe_stats_latency(struct upipe_stats *stats, uint64_t latency)
+{
+    unsigned int i = 0;
+    uint64_t bound = UCLOCK_FREQ / 1000;
+    while (i < UPIPE_STATS_LATENCY_BUCKETS - 1 && latency > bound) {
+        i++;
+        bound *= 2;
+    }
+    stats->latency[i]++;
+    stats->latency_sum += latency;
+}
+
+/** @internal @This sends an input buffer into a pipe, updating its
+ * statistics.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_stats_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct upipe_stats *stats = upipe->stats;
+    struct upipe_stats_priv *priv = upipe_stats_priv_from_stats(stats);
+    size_t size;
+    stats->inputs++;
+    if (uref != NULL && ubase_check(uref_block_size(uref, &size)))
+        stats->octets += size;
+
+    uint64_t *parent = upipe_stats_nested;
+    uint64_t nested = 0;
+    upipe_stats_nested = &nested;
+    uint64_t begin = uclock_now(priv->uclock);
+    uint64_t ingress;
+    if (uref != NULL && ubase_check(uref_clock_get_ingress(uref, &ingress)) &&
+        begin >= ingress)
+        upipe_stats_latency(stats, begin - ingress);
+    upipe->mgr->upipe_input(upipe, uref, upump_p);
+    uint64_t now = uclock_now(priv->uclock);
+    upipe_stats_nested = parent;
+
+    uint64_t duration = now - begin;
+    if (parent != NULL)
+        *parent += duration;
+
+    /* the pipe may have disabled its statistics in the meantime */
+    stats = upipe->stats;
+    if (unlikely(stats == NULL))
+        return;
+    stats->time += duration;
+    stats->self_time += duration > nested ? duration - nested : 0;
+    if (duration > stats->max_time)
+        stats->max_time = duration;
+    if (stats->period && now - stats->start >= stats->period)
+        upipe_stats_report(upipe);
+}
@@ -43,6 +43,44 @@
 
 /** max allowed jitter */
 #define MAX_JITTER (UCLOCK_FREQ / 10)
+/** max distance from the last reference to apply the drift */
+#define MAX_PREDICTION (UCLOCK_FREQ * 10)
+/** max allowed drift between the stream clock and the system clock */
+#define MAX_DRIFT 0.001
+/** number of references before outliers are rejected */
+#define OUTLIER_MIN_COUNT 4
+/** deviations from the prediction above which a reference is an outlier */
+#define OUTLIER_FACTOR 4
+/** deviation below which a reference is never an outlier */
+#define OUTLIER_MIN_JITTER (UCLOCK_FREQ / 1000)
+/** max number of consecutive outliers before following them */
+#define MAX_OUTLIERS 8
+
+/** @internal @This rounds a double to the nearest integer, without libm.
+ *
+ * @param x value to round
+ * @return rounded value
+ */
+static inline int64_t uprobe_dejitter_round(double x)
+{
+    return x >= 0 ? (int64_t)(x + .5) : (int64_t)(x - .5);
+}
+
+/** @internal @This predicts the offset at the given date in stream clock.
+ *
+ * @param uprobe_dejitter private structure
+ * @param date date in stream clock
+ * @return predicted offset
+ */
+static int64_t uprobe_dejitter_predict(struct uprobe_dejitter *uprobe_dejitter,
+                                       uint64_t date)
+{
+    int64_t delta = date - uprobe_dejitter->last_cr;
+    if (llabs(delta) > MAX_PREDICTION)
+        return uprobe_dejitter->offset;
+    return uprobe_dejitter->offset +
+           uprobe_dejitter_round(uprobe_dejitter->drift * delta);
+}
 
 /** @internal @This catches clock_ref events thrown by pipes.
  *
@@ -69,41 +107,79 @@ static int uprobe_dejitter_clock_ref(struct uprobe *uprobe, struct upipe *upipe,
     }
 
     int64_t offset = sys_ref - clock_ref;
-    lldiv_t q;
-
-    if (unlikely(llabs(offset - uprobe_dejitter->offset) > MAX_JITTER)) {
-        upipe_warn_va(upipe, "[dejitter] max jitter reached (%"PRId64")",
-                     offset - uprobe_dejitter->offset);
-        discontinuity = 1;
+    int64_t delta = clock_ref - uprobe_dejitter->last_cr;
+    int64_t error = 0;
+    if (likely(uprobe_dejitter->offset_count)) {
+        error = offset - uprobe_dejitter_predict(uprobe_dejitter, clock_ref);
+        if (unlikely(llabs(error) > MAX_JITTER)) {
+            upipe_warn_va(upipe, "[dejitter] max jitter reached (%"PRId64")",
+                          error);
+            discontinuity = 1;
+        }
     }
 
     if (unlikely(discontinuity)) {
         upipe_warn(upipe, "[dejitter] discontinuity");
         uprobe_dejitter->offset_count = 0;
-        uprobe_dejitter->offset = 0;
-        uprobe_dejitter->offset_residue = 0;
-        /* but do not reset the deviation */
-    }
+        uprobe_dejitter->outliers = 0;
+        /* but do not reset the drift and the deviation */
+    } else if (uprobe_dejitter->offset_count >= OUTLIER_MIN_COUNT &&
+               llabs(error) > OUTLIER_MIN_JITTER &&
+               (uint64_t)llabs(error) >
+                   uprobe_dejitter->deviation * OUTLIER_FACTOR) {
+        if (++uprobe_dejitter->outliers <= MAX_OUTLIERS) {
+            upipe_verbose_va(upipe, "[dejitter] rejected ref %"PRId64
+                             " (%"PRId64")", offset, error);
+            return UBASE_ERR_NONE;
+        }
+        /* the offset changed, so follow it but keep the drift */
+        upipe_dbg_va(upipe, "[dejitter] following offset change (%"PRId64")",
+                     error);
+        uprobe_dejitter->offset = offset;
+        uprobe_dejitter->last_cr = clock_ref;
+        uprobe_dejitter->outliers = 0;
+        return UBASE_ERR_NONE;
+    } else
+        uprobe_dejitter->outliers = 0;
+
+    if (!uprobe_dejitter->offset_count) {
+        uprobe_dejitter->offset = offset;
+        error = 0;
+    } else {
+        /* gains of the least-squares regression of a line over the last n
+         * references, which stop growing after divider references */
+        double n = uprobe_dejitter->offset_count + 1;
+        double alpha = 2. * (2. * n - 1.) / (n * (n + 1.));
+        double beta = 6. / (n * (n + 1.));
 
-    q = lldiv(uprobe_dejitter->offset * uprobe_dejitter->offset_count +
-              uprobe_dejitter->offset_residue + offset,
-              uprobe_dejitter->offset_count + 1);
-    uprobe_dejitter->offset = q.quot;
-    uprobe_dejitter->offset_residue = q.rem;
+        uprobe_dejitter->offset =
+            uprobe_dejitter_predict(uprobe_dejitter, clock_ref) +
+            uprobe_dejitter_round(alpha * error);
+        if (delta > 0) {
+            double drift = uprobe_dejitter->drift + beta * error / delta;
+            if (drift > MAX_DRIFT)
+                drift = MAX_DRIFT;
+            else if (drift < -MAX_DRIFT)
+                drift = -MAX_DRIFT;
+            uprobe_dejitter->drift = drift;
+        }
+    }
+    uprobe_dejitter->last_cr = clock_ref;
     if (uprobe_dejitter->offset_count < uprobe_dejitter->divider)
         uprobe_dejitter->offset_count++;
 
-    q = lldiv(uprobe_dejitter->deviation * uprobe_dejitter->deviation_count +
-              uprobe_dejitter->deviation_residue +
-              llabs(offset - uprobe_dejitter->offset),
-              uprobe_dejitter->deviation_count + 1);
+    lldiv_t q = lldiv(uprobe_dejitter->deviation *
+                      uprobe_dejitter->deviation_count +
+                      uprobe_dejitter->deviation_residue + llabs(error),
+                      uprobe_dejitter->deviation_count + 1);
     uprobe_dejitter->deviation = q.quot;
     uprobe_dejitter->deviation_residue = q.rem;
     if (uprobe_dejitter->deviation_count < uprobe_dejitter->divider)
         uprobe_dejitter->deviation_count++;
 
-    upipe_verbose_va(upipe, "new ref %"PRId64" %u %"PRId64" %u %"PRIu64, offset,
-                     uprobe_dejitter->offset_count, uprobe_dejitter->offset,
+    upipe_verbose_va(upipe, "new ref %"PRId64" %u %"PRId64" %f %u %"PRIu64,
+                     offset, uprobe_dejitter->offset_count,
+                     uprobe_dejitter->offset, uprobe_dejitter->drift,
                      uprobe_dejitter->deviation_count,
                      uprobe_dejitter->deviation);
     return UBASE_ERR_NONE;
@@ -133,8 +209,8 @@ static int uprobe_dejitter_clock_ts(struct uprobe *uprobe, struct upipe *upipe,
         return UBASE_ERR_INVALID;
 
     uref_clock_set_date_sys(uref,
-            date + uprobe_dejitter->offset + uprobe_dejitter->deviation * 3,
-            type);
+            date + uprobe_dejitter_predict(uprobe_dejitter, date) +
+            uprobe_dejitter->deviation * 3, type);
     return UBASE_ERR_NONE;
 }
 
@@ -178,7 +254,9 @@ void uprobe_dejitter_set(struct uprobe *uprobe, unsigned int divider)
     uprobe_dejitter->divider = divider;
     uprobe_dejitter->offset_count = 0;
     uprobe_dejitter->offset = 0;
-    uprobe_dejitter->offset_residue = 0;
+    uprobe_dejitter->last_cr = 0;
+    uprobe_dejitter->drift = 0;
+    uprobe_dejitter->outliers = 0;
     uprobe_dejitter->deviation_count = 0;
     uprobe_dejitter->deviation = 0;
     uprobe_dejitter->deviation_residue = 0;
@@ -198,6 +276,8 @@ struct uprobe *uprobe_dejitter_init(struct uprobe_dejitter *uprobe_dejitter,
     struct uprobe *uprobe = uprobe_dejitter_to_uprobe(uprobe_dejitter);
     uprobe_dejitter_set(uprobe, divider);
     uprobe_init(uprobe, uprobe_dejitter_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_CLOCK_REF) |
+                      UPROBE_EVENT_MASK(UPROBE_CLOCK_TS));
     return uprobe;
 }
 
@@ -0,0 +1,1164 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe collecting metrics of pipes and exporting them over HTTP
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+#include <upipe/upump.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_metrics.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_dejitter.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/** size of the buffer receiving HTTP requests */
+#define REQUEST_SIZE 2048
+/** listen backlog */
+#define BACKLOG 8
+
+/** @internal @This stores the counters of a pipe. */
+struct uprobe_metrics_pipe {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pointer to the pipe */
+    struct upipe *upipe;
+    /** unique identifier */
+    uint64_t id;
+    /** name of the pipe */
+    char *name;
+
+    /** number of urefs received */
+    uint64_t inputs;
+    /** number of octets received */
+    uint64_t octets;
+    /** number of urefs sent */
+    uint64_t outputs;
+    /** time spent in the input function */
+    uint64_t time;
+    /** time spent in the input function, less downstream pipes */
+    uint64_t self_time;
+    /** maximum time of an input in the last report */
+    uint64_t max_time;
+    /** number of warnings */
+    uint64_t warnings;
+    /** number of errors */
+    uint64_t errors;
+    /** number of synchronization losses */
+    uint64_t sync_lost;
+    /** number of clock discontinuities */
+    uint64_t discontinuities;
+    /** number of urefs dropped on overload */
+    uint64_t overload_drops;
+    /** histogram of end-to-end latencies */
+    uint64_t latency[UPIPE_STATS_LATENCY_BUCKETS];
+    /** sum of end-to-end latencies */
+    uint64_t latency_sum;
+};
+
+UBASE_FROM_TO(uprobe_metrics_pipe, uchain, uchain, uchain)
+
+/** @internal @This describes a metric of a pipe. */
+struct uprobe_metrics_pipe_metric {
+    /** name of the metric */
+    const char *name;
+    /** Prometheus type */
+    const char *type;
+    /** offset of the counter in @ref uprobe_metrics_pipe */
+    size_t offset;
+    /** true if the counter is a duration in 27 MHz units */
+    bool duration;
+};
+
+/** @internal @This lists the metrics of a pipe. */
+static const struct uprobe_metrics_pipe_metric uprobe_metrics_pipe_metrics[] = {
+#define M(name, type, field, duration)                                      \
+    { name, type, offsetof(struct uprobe_metrics_pipe, field), duration }
+    M("upipe_inputs_total", "counter", inputs, false),
+    M("upipe_input_octets_total", "counter", octets, false),
+    M("upipe_outputs_total", "counter", outputs, false),
+    M("upipe_input_seconds_total", "counter", time, true),
+    M("upipe_input_self_seconds_total", "counter", self_time, true),
+    M("upipe_input_max_seconds", "gauge", max_time, true),
+    M("upipe_warnings_total", "counter", warnings, false),
+    M("upipe_errors_total", "counter", errors, false),
+    M("upipe_sync_lost_total", "counter", sync_lost, false),
+    M("upipe_clock_discontinuities_total", "counter", discontinuities, false),
+    M("upipe_overload_drops_total", "counter", overload_drops, false),
+#undef M
+};
+
+/** number of metrics of a pipe */
+#define NB_PIPE_METRICS (sizeof(uprobe_metrics_pipe_metrics) /              \
+                         sizeof(uprobe_metrics_pipe_metrics[0]))
+
+/** @internal @This describes a metric of a umem pool. */
+struct uprobe_metrics_umem_metric {
+    /** name of the metric */
+    const char *name;
+    /** Prometheus type */
+    const char *type;
+    /** offset of the counter in struct umem_pool_stats */
+    size_t offset;
+};
+
+/** @internal @This lists the metrics of a umem pool. */
+static const struct uprobe_metrics_umem_metric uprobe_metrics_umem_metrics[] = {
+#define M(name, type, field)                                                \
+    { name, type, offsetof(struct umem_pool_stats, field) }
+    M("upipe_umem_allocs_total", "counter", allocs),
+    M("upipe_umem_hits_total", "counter", hits),
+    M("upipe_umem_fallbacks_total", "counter", fallbacks),
+    M("upipe_umem_in_use", "gauge", in_use),
+    M("upipe_umem_high_water", "gauge", high_water),
+    M("upipe_umem_pooled", "gauge", pooled),
+#undef M
+};
+
+/** number of metrics of a umem pool */
+#define NB_UMEM_METRICS (sizeof(uprobe_metrics_umem_metrics) /              \
+                         sizeof(uprobe_metrics_umem_metrics[0]))
+
+/** @internal @This defines the types of gauges. */
+enum uprobe_metrics_gauge_type {
+    /** gauge read by a callback */
+    UPROBE_METRICS_GAUGE_CB,
+    /** statistics of a umem pool manager */
+    UPROBE_METRICS_GAUGE_UMEM,
+    /** offset and deviation of a dejitter probe */
+    UPROBE_METRICS_GAUGE_DEJITTER
+};
+
+/** @internal @This stores a registered gauge. */
+struct uprobe_metrics_gauge {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** type of gauge */
+    enum uprobe_metrics_gauge_type type;
+    /** name of the metric, or label of the manager or probe */
+    char *name;
+    /** labels of the metric */
+    char *labels;
+    /** callback */
+    uprobe_metrics_cb cb;
+    /** opaque of the callback */
+    void *opaque;
+    /** umem manager */
+    struct umem_mgr *umem_mgr;
+    /** dejitter probe */
+    struct uprobe_dejitter *uprobe_dejitter;
+};
+
+UBASE_FROM_TO(uprobe_metrics_gauge, uchain, uchain, uchain)
+
+/** @internal @This stores an HTTP client. */
+struct uprobe_metrics_client {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pointer to the probe */
+    struct uprobe_metrics *uprobe_metrics;
+    /** socket */
+    int fd;
+    /** pump reading the request or writing the response */
+    struct upump *upump;
+    /** request */
+    char request[REQUEST_SIZE];
+    /** size of the request */
+    size_t request_size;
+    /** response */
+    char *response;
+    /** size of the response */
+    size_t response_size;
+    /** octets of the response already written */
+    size_t response_offset;
+};
+
+UBASE_FROM_TO(uprobe_metrics_client, uchain, uchain, uchain)
+
+/** @internal @This is a growable text buffer. */
+struct uprobe_metrics_text {
+    /** pointer to the buffer */
+    char *buffer;
+    /** size of the text */
+    size_t size;
+    /** allocated size */
+    size_t allocated;
+    /** true if an allocation failed */
+    bool error;
+};
+
+/** @internal @This appends formatted text to a buffer.
+ *
+ * @param text pointer to the text buffer
+ * @param format printf-style format
+ */
+static void uprobe_metrics_printf(struct uprobe_metrics_text *text,
+                                  const char *format, ...)
+    __attribute__ ((format(printf, 2, 3)));
+
+static void uprobe_metrics_printf(struct uprobe_metrics_text *text,
+                                  const char *format, ...)
+{
+    if (unlikely(text->error))
+        return;
+
+    for ( ; ; ) {
+        va_list args;
+        va_start(args, format);
+        int ret = vsnprintf(text->buffer + text->size,
+                            text->allocated - text->size, format, args);
+        va_end(args);
+        if (unlikely(ret < 0)) {
+            text->error = true;
+            return;
+        }
+        if (text->size + ret < text->allocated) {
+            text->size += ret;
+            return;
+        }
+
+        size_t allocated = (text->allocated + ret + 1) * 2;
+        char *buffer = realloc(text->buffer, allocated);
+        if (unlikely(buffer == NULL)) {
+            text->error = true;
+            return;
+        }
+        text->buffer = buffer;
+        text->allocated = allocated;
+    }
+}
+
+/** @internal @This appends a label value, escaped.
+ *
+ * @param text pointer to the text buffer
+ * @param value label value
+ */
+static void uprobe_metrics_escape(struct uprobe_metrics_text *text,
+                                  const char *value)
+{
+    for ( ; *value; value++) {
+        switch (*value) {
+            case '\\':
+                uprobe_metrics_printf(text, "\\\\");
+                break;
+            case '"':
+                uprobe_metrics_printf(text, "\\\"");
+                break;
+            case '\n':
+                uprobe_metrics_printf(text, "\\n");
+                break;
+            default:
+                uprobe_metrics_printf(text, "%c", *value);
+                break;
+        }
+    }
+}
+
+/** @internal @This appends a duration in seconds.
+ *
+ * @param text pointer to the text buffer
+ * @param duration duration in 27 MHz units
+ */
+static void uprobe_metrics_seconds(struct uprobe_metrics_text *text,
+                                   int64_t duration)
+{
+    uprobe_metrics_printf(text, "%.9f\n", (double)duration / UCLOCK_FREQ);
+}
+
+/** @internal @This returns the counters of a pipe, allocating them if
+ * needed.
+ *
+ * @param uprobe_metrics pointer to probe
+ * @param upipe pointer to pipe
+ * @return pointer to the counters, or NULL in case of allocation error
+ */
+static struct uprobe_metrics_pipe *
+    uprobe_metrics_get_pipe(struct uprobe_metrics *uprobe_metrics,
+                            struct upipe *upipe)
+{
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_metrics->pipes, uchain) {
+        struct uprobe_metrics_pipe *pipe =
+            uprobe_metrics_pipe_from_uchain(uchain);
+        if (pipe->upipe == upipe)
+            return pipe;
+    }
+
+    struct uprobe_metrics_pipe *pipe =
+        calloc(1, sizeof(struct uprobe_metrics_pipe));
+    if (unlikely(pipe == NULL))
+        return NULL;
+    const char *name = uprobe_pfx_get_name(upipe->uprobe);
+    pipe->name = strdup(name != NULL ? name : "unknown");
+    if (unlikely(pipe->name == NULL)) {
+        free(pipe);
+        return NULL;
+    }
+    uchain_init(&pipe->uchain);
+    pipe->upipe = upipe;
+    pipe->id = uprobe_metrics->next_id++;
+    ulist_add(&uprobe_metrics->pipes, &pipe->uchain);
+    return pipe;
+}
+
+/** @internal @This frees the counters of a pipe.
+ *
+ * @param pipe pointer to the counters
+ */
+static void uprobe_metrics_free_pipe(struct uprobe_metrics_pipe *pipe)
+{
+    ulist_delete(&pipe->uchain);
+    free(pipe->name);
+    free(pipe);
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_metrics_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                int event, va_list args)
+{
+    struct uprobe_metrics *uprobe_metrics = uprobe_metrics_from_uprobe(uprobe);
+    if (upipe == NULL)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    switch (event) {
+        case UPROBE_STATS: {
+            const struct upipe_stats *stats =
+                va_arg(args, const struct upipe_stats *);
+            struct uprobe_metrics_pipe *pipe =
+                uprobe_metrics_get_pipe(uprobe_metrics, upipe);
+            if (unlikely(pipe == NULL))
+                return UBASE_ERR_ALLOC;
+            pipe->inputs += stats->inputs;
+            pipe->octets += stats->octets;
+            pipe->outputs += stats->outputs;
+            pipe->time += stats->time;
+            pipe->self_time += stats->self_time;
+            pipe->max_time = stats->max_time;
+            for (unsigned int i = 0; i < UPIPE_STATS_LATENCY_BUCKETS; i++)
+                pipe->latency[i] += stats->latency[i];
+            pipe->latency_sum += stats->latency_sum;
+            return UBASE_ERR_NONE;
+        }
+
+        case UPROBE_LOG: {
+            va_list args_copy;
+            va_copy(args_copy, args);
+            enum uprobe_log_level level =
+                va_arg(args_copy, enum uprobe_log_level);
+            va_end(args_copy);
+            if (level < UPROBE_LOG_WARNING)
+                break;
+            struct uprobe_metrics_pipe *pipe =
+                uprobe_metrics_get_pipe(uprobe_metrics, upipe);
+            if (likely(pipe != NULL)) {
+                if (level == UPROBE_LOG_WARNING)
+                    pipe->warnings++;
+                else
+                    pipe->errors++;
+            }
+            break;
+        }
+
+        case UPROBE_SYNC_LOST: {
+            struct uprobe_metrics_pipe *pipe =
+                uprobe_metrics_get_pipe(uprobe_metrics, upipe);
+            if (likely(pipe != NULL))
+                pipe->sync_lost++;
+            break;
+        }
+
+        case UPROBE_OVERLOAD_DROP: {
+            struct uprobe_metrics_pipe *pipe =
+                uprobe_metrics_get_pipe(uprobe_metrics, upipe);
+            if (likely(pipe != NULL))
+                pipe->overload_drops++;
+            break;
+        }
+
+        case UPROBE_CLOCK_REF: {
+            va_list args_copy;
+            va_copy(args_copy, args);
+            va_arg(args_copy, struct uref *);
+            va_arg(args_copy, uint64_t);
+            int discontinuity = va_arg(args_copy, int);
+            va_end(args_copy);
+            if (!discontinuity)
+                break;
+            struct uprobe_metrics_pipe *pipe =
+                uprobe_metrics_get_pipe(uprobe_metrics, upipe);
+            if (likely(pipe != NULL))
+                pipe->discontinuities++;
+            break;
+        }
+
+        case UPROBE_DEAD: {
+            struct uchain *uchain, *uchain_tmp;
+            ulist_delete_foreach (&uprobe_metrics->pipes, uchain, uchain_tmp) {
+                struct uprobe_metrics_pipe *pipe =
+                    uprobe_metrics_pipe_from_uchain(uchain);
+                if (pipe->upipe == upipe) {
+                    uprobe_metrics_free_pipe(pipe);
+                    break;
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @internal @This formats the metrics of pipes.
+ *
+ * @param uprobe_metrics pointer to probe
+ * @param text pointer to the text buffer
+ */
+static void uprobe_metrics_format_pipes(struct uprobe_metrics *uprobe_metrics,
+                                        struct uprobe_metrics_text *text)
+{
+    if (ulist_empty(&uprobe_metrics->pipes))
+        return;
+
+    for (unsigned int i = 0; i < NB_PIPE_METRICS; i++) {
+        const struct uprobe_metrics_pipe_metric *metric =
+            &uprobe_metrics_pipe_metrics[i];
+        uprobe_metrics_printf(text, "# TYPE %s %s\n",
+                              metric->name, metric->type);
+
+        struct uchain *uchain;
+        ulist_foreach (&uprobe_metrics->pipes, uchain) {
+            struct uprobe_metrics_pipe *pipe =
+                uprobe_metrics_pipe_from_uchain(uchain);
+            uint64_t value =
+                *(uint64_t *)((uint8_t *)pipe + metric->offset);
+            uprobe_metrics_printf(text, "%s{pipe=\"", metric->name);
+            uprobe_metrics_escape(text, pipe->name);
+            uprobe_metrics_printf(text, "\",id=\"%"PRIu64"\"} ", pipe->id);
+            if (metric->duration)
+                uprobe_metrics_seconds(text, value);
+            else
+                uprobe_metrics_printf(text, "%"PRIu64"\n", value);
+        }
+    }
+
+    bool found = false;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_metrics->pipes, uchain) {
+        struct uprobe_metrics_pipe *pipe =
+            uprobe_metrics_pipe_from_uchain(uchain);
+        uint64_t count = 0;
+        for (unsigned int i = 0; i < UPIPE_STATS_LATENCY_BUCKETS; i++)
+            count += pipe->latency[i];
+        if (!count)
+            continue;
+
+        if (!found)
+            uprobe_metrics_printf(text,
+                                  "# TYPE upipe_latency_seconds histogram\n");
+        found = true;
+        uint64_t cumulative = 0;
+        for (unsigned int i = 0; i < UPIPE_STATS_LATENCY_BUCKETS; i++) {
+            cumulative += pipe->latency[i];
+            uprobe_metrics_printf(text, "upipe_latency_seconds_bucket{pipe=\"");
+            uprobe_metrics_escape(text, pipe->name);
+            if (i < UPIPE_STATS_LATENCY_BUCKETS - 1)
+                uprobe_metrics_printf(text, "\",id=\"%"PRIu64"\",le=\"%g\"} "
+                                      "%"PRIu64"\n", pipe->id,
+                                      (double)(1 << i) / 1000, cumulative);
+            else
+                uprobe_metrics_printf(text, "\",id=\"%"PRIu64"\",le=\"+Inf\"} "
+                                      "%"PRIu64"\n", pipe->id, cumulative);
+        }
+        uprobe_metrics_printf(text, "upipe_latency_seconds_sum{pipe=\"");
+        uprobe_metrics_escape(text, pipe->name);
+        uprobe_metrics_printf(text, "\",id=\"%"PRIu64"\"} ", pipe->id);
+        uprobe_metrics_seconds(text, pipe->latency_sum);
+        uprobe_metrics_printf(text, "upipe_latency_seconds_count{pipe=\"");
+        uprobe_metrics_escape(text, pipe->name);
+        uprobe_metrics_printf(text, "\",id=\"%"PRIu64"\"} %"PRIu64"\n",
+                              pipe->id, count);
+    }
+}
+
+/** @internal @This formats the metrics of umem pool managers.
+ *
+ * @param uprobe_metrics pointer to probe
+ * @param text pointer to the text buffer
+ */
+static void uprobe_metrics_format_umem(struct uprobe_metrics *uprobe_metrics,
+                                       struct uprobe_metrics_text *text)
+{
+    bool found = false;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_metrics->gauges, uchain) {
+        struct uprobe_metrics_gauge *gauge =
+            uprobe_metrics_gauge_from_uchain(uchain);
+        if (gauge->type == UPROBE_METRICS_GAUGE_UMEM)
+            found = true;
+    }
+    if (!found)
+        return;
+
+    for (unsigned int i = 0; i < NB_UMEM_METRICS; i++) {
+        const struct uprobe_metrics_umem_metric *metric =
+            &uprobe_metrics_umem_metrics[i];
+        uprobe_metrics_printf(text, "# TYPE %s %s\n",
+                              metric->name, metric->type);
+
+        ulist_foreach (&uprobe_metrics->gauges, uchain) {
+            struct uprobe_metrics_gauge *gauge =
+                uprobe_metrics_gauge_from_uchain(uchain);
+            unsigned int nb_pools;
+            if (gauge->type != UPROBE_METRICS_GAUGE_UMEM ||
+                !ubase_check(umem_pool_mgr_get_nb_pools(gauge->umem_mgr,
+                                                        &nb_pools)))
+                continue;
+
+            for (unsigned int pool = 0; pool < nb_pools; pool++) {
+                struct umem_pool_stats stats;
+                if (!ubase_check(umem_pool_mgr_get_stats(gauge->umem_mgr,
+                                                         pool, &stats)))
+                    continue;
+                uint32_t value =
+                    *(uint32_t *)((uint8_t *)&stats + metric->offset);
+                uprobe_metrics_printf(text, "%s{mem=\"", metric->name);
+                uprobe_metrics_escape(text, gauge->name);
+                uprobe_metrics_printf(text, "\",size=\"%zu\"} %"PRIu32"\n",
+                                      stats.size, value);
+            }
+        }
+    }
+
+    static const struct {
+        const char *name;
+        size_t offset;
+    } usages[] = {
+        { "upipe_umem_live_octets", offsetof(struct umem_usage, live) },
+        { "upipe_umem_pooled_octets", offsetof(struct umem_usage, pooled) },
+        { "upipe_umem_peak_octets", offsetof(struct umem_usage, peak) }
+    };
+    for (unsigned int i = 0; i < sizeof(usages) / sizeof(usages[0]); i++) {
+        uprobe_metrics_printf(text, "# TYPE %s gauge\n", usages[i].name);
+
+        ulist_foreach (&uprobe_metrics->gauges, uchain) {
+            struct uprobe_metrics_gauge *gauge =
+                uprobe_metrics_gauge_from_uchain(uchain);
+            struct umem_usage usage;
+            if (gauge->type != UPROBE_METRICS_GAUGE_UMEM ||
+                !ubase_check(umem_mgr_get_usage(gauge->umem_mgr, &usage)))
+                continue;
+
+            uint64_t value =
+                *(uint64_t *)((uint8_t *)&usage + usages[i].offset);
+            uprobe_metrics_printf(text, "%s{mem=\"", usages[i].name);
+            uprobe_metrics_escape(text, gauge->name);
+            uprobe_metrics_printf(text, "\"} %"PRIu64"\n", value);
+        }
+    }
+}
+
+/** @internal @This formats the metrics of dejitter probes.
+ *
+ * @param uprobe_metrics pointer to probe
+ * @param text pointer to the text buffer
+ */
+static void
+    uprobe_metrics_format_dejitter(struct uprobe_metrics *uprobe_metrics,
+                                   struct uprobe_metrics_text *text)
+{
+    static const char *names[] = {
+        "upipe_dejitter_offset_seconds",
+        "upipe_dejitter_deviation_seconds"
+    };
+    bool found = false;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_metrics->gauges, uchain) {
+        struct uprobe_metrics_gauge *gauge =
+            uprobe_metrics_gauge_from_uchain(uchain);
+        if (gauge->type == UPROBE_METRICS_GAUGE_DEJITTER)
+            found = true;
+    }
+    if (!found)
+        return;
+
+    for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        uprobe_metrics_printf(text, "# TYPE %s gauge\n", names[i]);
+        ulist_foreach (&uprobe_metrics->gauges, uchain) {
+            struct uprobe_metrics_gauge *gauge =
+                uprobe_metrics_gauge_from_uchain(uchain);
+            if (gauge->type != UPROBE_METRICS_GAUGE_DEJITTER)
+                continue;
+            uprobe_metrics_printf(text, "%s{probe=\"", names[i]);
+            uprobe_metrics_escape(text, gauge->name);
+            uprobe_metrics_printf(text, "\"} ");
+            uprobe_metrics_seconds(text, i ?
+                    (int64_t)gauge->uprobe_dejitter->deviation :
+                    gauge->uprobe_dejitter->offset);
+        }
+    }
+}
+
+/** @internal @This formats the gauges read by callbacks.
+ *
+ * @param uprobe_metrics pointer to probe
+ * @param text pointer to the text buffer
+ */
+static void uprobe_metrics_format_cb(struct uprobe_metrics *uprobe_metrics,
+                                     struct uprobe_metrics_text *text)
+{
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_metrics->gauges, uchain) {
+        struct uprobe_metrics_gauge *gauge =
+            uprobe_metrics_gauge_from_uchain(uchain);
+        int64_t value;
+        if (gauge->type != UPROBE_METRICS_GAUGE_CB ||
+            !ubase_check(gauge->cb(gauge->opaque, &value)))
+            continue;
+
+        /* only print the type once per metric name */
+        bool found = false;
+        struct uchain *prev;
+        ulist_foreach (&uprobe_metrics->gauges, prev) {
+            if (prev == uchain)
+                break;
+            struct uprobe_metrics_gauge *prev_gauge =
+                uprobe_metrics_gauge_from_uchain(prev);
+            if (prev_gauge->type == UPROBE_METRICS_GAUGE_CB &&
+                !strcmp(prev_gauge->name, gauge->name))
+                found = true;
+        }
+        if (!found)
+            uprobe_metrics_printf(text, "# TYPE %s gauge\n", gauge->name);
+
+        if (gauge->labels != NULL)
+            uprobe_metrics_printf(text, "%s{%s} %"PRId64"\n",
+                                  gauge->name, gauge->labels, value);
+        else
+            uprobe_metrics_printf(text, "%s %"PRId64"\n", gauge->name, value);
+    }
+}
+
+/** @This formats the metrics in the Prometheus text exposition format.
+ *
+ * @param uprobe pointer to probe
+ * @param buffer_p filled in with a pointer to a buffer to free() by the
+ * caller
+ * @param size_p filled in with the size of the text
+ * @return an error code
+ */
+int uprobe_metrics_format(struct uprobe *uprobe, char **buffer_p,
+                          size_t *size_p)
+{
+    struct uprobe_metrics *uprobe_metrics = uprobe_metrics_from_uprobe(uprobe);
+    struct uprobe_metrics_text text = {
+        .buffer = NULL, .size = 0, .allocated = 0, .error = false
+    };
+    uprobe_metrics_printf(&text, "%s", "");
+    uprobe_metrics_format_pipes(uprobe_metrics, &text);
+    uprobe_metrics_format_umem(uprobe_metrics, &text);
+    uprobe_metrics_format_dejitter(uprobe_metrics, &text);
+    uprobe_metrics_format_cb(uprobe_metrics, &text);
+    if (unlikely(text.error)) {
+        free(text.buffer);
+        return UBASE_ERR_ALLOC;
+    }
+    *buffer_p = text.buffer;
+    *size_p = text.size;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This allocates a gauge and adds it to the list.
+ *
+ * @param uprobe_metrics pointer to probe
+ * @param type type of gauge
+ * @param name name of the metric, or label of the manager or probe
+ * @param labels labels of the metric, or NULL
+ * @return pointer to gauge, or NULL in case of allocation error
+ */
+static struct uprobe_metrics_gauge *
+    uprobe_metrics_alloc_gauge(struct uprobe_metrics *uprobe_metrics,
+                               enum uprobe_metrics_gauge_type type,
+                               const char *name, const char *labels)
+{
+    struct uprobe_metrics_gauge *gauge =
+        calloc(1, sizeof(struct uprobe_metrics_gauge));
+    if (unlikely(gauge == NULL))
+        return NULL;
+    gauge->name = strdup(name);
+    gauge->labels = labels != NULL ? strdup(labels) : NULL;
+    if (unlikely(gauge->name == NULL ||
+                 (labels != NULL && gauge->labels == NULL))) {
+        free(gauge->name);
+        free(gauge->labels);
+        free(gauge);
+        return NULL;
+    }
+    uchain_init(&gauge->uchain);
+    gauge->type = type;
+    ulist_add(&uprobe_metrics->gauges, &gauge->uchain);
+    return gauge;
+}
+
+/** @This registers a gauge read by a callback when the metrics are
+ * formatted.
+ *
+ * @param uprobe pointer to probe
+ * @param name name of the metric
+ * @param labels Prometheus labels of the metric (such as "queue=\"in\""),
+ * or NULL
+ * @param cb callback reading the value of the gauge
+ * @param opaque opaque passed to the callback
+ * @return an error code
+ */
+int uprobe_metrics_add_gauge(struct uprobe *uprobe, const char *name,
+                             const char *labels, uprobe_metrics_cb cb,
+                             void *opaque)
+{
+    struct uprobe_metrics *uprobe_metrics = uprobe_metrics_from_uprobe(uprobe);
+    if (unlikely(name == NULL || cb == NULL))
+        return UBASE_ERR_INVALID;
+    struct uprobe_metrics_gauge *gauge =
+        uprobe_metrics_alloc_gauge(uprobe_metrics, UPROBE_METRICS_GAUGE_CB,
+                                   name, labels);
+    UBASE_ALLOC_RETURN(gauge)
+    gauge->cb = cb;
+    gauge->opaque = opaque;
+    return UBASE_ERR_NONE;
+}
+
+/** @This registers the statistics of a umem pool manager.
+ *
+ * @param uprobe pointer to probe
+ * @param name name of the manager, used as label
+ * @param umem_mgr pointer to umem pool manager
+ * @return an error code
+ */
+int uprobe_metrics_add_umem_mgr(struct uprobe *uprobe, const char *name,
+                                struct umem_mgr *umem_mgr)
+{
+    struct uprobe_metrics *uprobe_metrics = uprobe_metrics_from_uprobe(uprobe);
+    unsigned int nb_pools;
+    struct umem_usage usage;
+    if (unlikely(name == NULL || umem_mgr == NULL))
+        return UBASE_ERR_INVALID;
+    if (!ubase_check(umem_mgr_get_usage(umem_mgr, &usage)))
+        UBASE_RETURN(umem_pool_mgr_get_nb_pools(umem_mgr, &nb_pools))
+    struct uprobe_metrics_gauge *gauge =
+        uprobe_metrics_alloc_gauge(uprobe_metrics, UPROBE_METRICS_GAUGE_UMEM,
+                                   name, NULL);
+    UBASE_ALLOC_RETURN(gauge)
+    gauge->umem_mgr = umem_mgr_use(umem_mgr);
+    return UBASE_ERR_NONE;
+}
+
+/** @This registers the offset and deviation of a dejitter probe.
+ *
+ * @param uprobe pointer to probe
+ * @param name name of the dejitter probe, used as label
+ * @param uprobe_dejitter pointer to dejitter probe
+ * @return an error code
+ */
+int uprobe_metrics_add_dejitter(struct uprobe *uprobe, const char *name,
+                                struct uprobe_dejitter *uprobe_dejitter)
+{
+    struct uprobe_metrics *uprobe_metrics = uprobe_metrics_from_uprobe(uprobe);
+    if (unlikely(name == NULL || uprobe_dejitter == NULL))
+        return UBASE_ERR_INVALID;
+    struct uprobe_metrics_gauge *gauge =
+        uprobe_metrics_alloc_gauge(uprobe_metrics,
+                                   UPROBE_METRICS_GAUGE_DEJITTER, name, NULL);
+    UBASE_ALLOC_RETURN(gauge)
+    gauge->uprobe_dejitter = uprobe_dejitter;
+    uprobe_use(uprobe_dejitter_to_uprobe(uprobe_dejitter));
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This closes the connection of a client.
+ *
+ * @param client pointer to client
+ */
+static void uprobe_metrics_close_client(struct uprobe_metrics_client *client)
+{
+    ulist_delete(&client->uchain);
+    client->uprobe_metrics->nb_clients--;
+    if (client->upump != NULL)
+        upump_free(client->upump);
+    close(client->fd);
+    free(client->response);
+    free(client);
+}
+
+/** @internal @This writes the response to a client.
+ *
+ * @param upump description structure of the write watcher
+ */
+static void uprobe_metrics_client_write(struct upump *upump)
+{
+    struct uprobe_metrics_client *client =
+        upump_get_opaque(upump, struct uprobe_metrics_client *);
+
+    while (client->response_offset < client->response_size) {
+        ssize_t ret = write(client->fd,
+                            client->response + client->response_offset,
+                            client->response_size - client->response_offset);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                uprobe_metrics_close_client(client);
+            return;
+        }
+        client->response_offset += ret;
+    }
+    uprobe_metrics_close_client(client);
+}
+
+/** @internal @This prepares the response to a request.
+ *
+ * @param client pointer to client
+ */
+static void uprobe_metrics_client_respond(struct uprobe_metrics_client *client)
+{
+    struct uprobe *uprobe = uprobe_metrics_to_uprobe(client->uprobe_metrics);
+    const char *status = "404 Not Found";
+    char *body = NULL;
+    size_t body_size = 0;
+
+    if (!strncmp(client->request, "GET /metrics ", strlen("GET /metrics ")) ||
+        !strncmp(client->request, "GET / ", strlen("GET / "))) {
+        if (ubase_check(uprobe_metrics_format(uprobe, &body, &body_size)))
+            status = "200 OK";
+        else
+            status = "500 Internal Server Error";
+    } else if (strncmp(client->request, "GET ", strlen("GET ")))
+        status = "405 Method Not Allowed";
+
+    struct uprobe_metrics_text text = {
+        .buffer = NULL, .size = 0, .allocated = 0, .error = false
+    };
+    uprobe_metrics_printf(&text, "HTTP/1.0 %s\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: close\r\n\r\n", status, body_size);
+    if (body != NULL)
+        uprobe_metrics_printf(&text, "%.*s", (int)body_size, body);
+    free(body);
+    if (unlikely(text.error)) {
+        free(text.buffer);
+        uprobe_metrics_close_client(client);
+        return;
+    }
+
+    client->response = text.buffer;
+    client->response_size = text.size;
+    client->response_offset = 0;
+    upump_free(client->upump);
+    client->upump = upump_alloc_fd_write(client->uprobe_metrics->upump_mgr,
+                                         uprobe_metrics_client_write, client,
+                                         client->fd);
+    if (unlikely(client->upump == NULL)) {
+        uprobe_metrics_close_client(client);
+        return;
+    }
+    upump_start(client->upump);
+}
+
+/** @internal @This reads the request of a client.
+ *
+ * @param upump description structure of the read watcher
+ */
+static void uprobe_metrics_client_read(struct upump *upump)
+{
+    struct uprobe_metrics_client *client =
+        upump_get_opaque(upump, struct uprobe_metrics_client *);
+
+    for ( ; ; ) {
+        ssize_t ret = read(client->fd, client->request + client->request_size,
+                           REQUEST_SIZE - 1 - client->request_size);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                uprobe_metrics_close_client(client);
+            return;
+        }
+        if (ret == 0) {
+            uprobe_metrics_close_client(client);
+            return;
+        }
+        client->request_size += ret;
+        client->request[client->request_size] = '\0';
+
+        if (strstr(client->request, "\r\n\r\n") != NULL ||
+            strstr(client->request, "\n\n") != NULL) {
+            uprobe_metrics_client_respond(client);
+            return;
+        }
+        if (client->request_size >= REQUEST_SIZE - 1) {
+            uprobe_metrics_close_client(client);
+            return;
+        }
+    }
+}
+
+/** @internal @This accepts connections.
+ *
+ * @param upump description structure of the read watcher
+ */
+static void uprobe_metrics_accept(struct upump *upump)
+{
+    struct uprobe_metrics *uprobe_metrics =
+        upump_get_opaque(upump, struct uprobe_metrics *);
+
+    for ( ; ; ) {
+        int fd = accept(uprobe_metrics->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return;
+        }
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0 ||
+            fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            close(fd);
+            continue;
+        }
+
+        /* make room by dropping the oldest client */
+        if (uprobe_metrics->nb_clients >= UPROBE_METRICS_MAX_CLIENTS) {
+            struct uchain *uchain = uprobe_metrics->clients.next;
+            uprobe_metrics_close_client(
+                    uprobe_metrics_client_from_uchain(uchain));
+        }
+
+        struct uprobe_metrics_client *client =
+            malloc(sizeof(struct uprobe_metrics_client));
+        if (unlikely(client == NULL)) {
+            close(fd);
+            continue;
+        }
+        uchain_init(&client->uchain);
+        client->uprobe_metrics = uprobe_metrics;
+        client->fd = fd;
+        client->request_size = 0;
+        client->response = NULL;
+        client->upump = upump_alloc_fd_read(uprobe_metrics->upump_mgr,
+                                            uprobe_metrics_client_read,
+                                            client, fd);
+        if (unlikely(client->upump == NULL)) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        ulist_add(&uprobe_metrics->clients, &client->uchain);
+        uprobe_metrics->nb_clients++;
+        upump_start(client->upump);
+    }
+}
+
+/** @internal @This opens the listening socket.
+ *
+ * @param uprobe_metrics pointer to probe
+ * @param addr address to listen to, or NULL for all addresses
+ * @param port TCP port to listen to
+ * @return an error code
+ */
+static int uprobe_metrics_listen(struct uprobe_metrics *uprobe_metrics,
+                                 const char *addr, unsigned int port)
+{
+    char service[sizeof("65535")];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints, *info, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(addr, service, &hints, &info) != 0)
+        return UBASE_ERR_INVALID;
+
+    int fd = -1;
+    for (res = info; res != NULL; res = res->ai_next) {
+        fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if (fd < 0)
+            continue;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, res->ai_addr, res->ai_addrlen) == 0 &&
+            listen(fd, BACKLOG) == 0 &&
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0 &&
+            fcntl(fd, F_SETFD, FD_CLOEXEC) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(info);
+    if (fd < 0)
+        return UBASE_ERR_EXTERNAL;
+
+    uprobe_metrics->upump = upump_alloc_fd_read(uprobe_metrics->upump_mgr,
+                                                uprobe_metrics_accept,
+                                                uprobe_metrics, fd);
+    if (unlikely(uprobe_metrics->upump == NULL)) {
+        close(fd);
+        return UBASE_ERR_UPUMP;
+    }
+    uprobe_metrics->fd = fd;
+    upump_start(uprobe_metrics->upump);
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the TCP port the HTTP endpoint listens to.
+ *
+ * @param uprobe pointer to probe
+ * @param port_p filled in with the port
+ * @return an error code
+ */
+int uprobe_metrics_get_port(struct uprobe *uprobe, unsigned int *port_p)
+{
+    struct uprobe_metrics *uprobe_metrics = uprobe_metrics_from_uprobe(uprobe);
+    if (uprobe_metrics->fd == -1)
+        return UBASE_ERR_INVALID;
+
+    char host[NI_MAXHOST], service[NI_MAXSERV];
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    if (getsockname(uprobe_metrics->fd, (struct sockaddr *)&addr,
+                    &addrlen) < 0 ||
+        getnameinfo((struct sockaddr *)&addr, addrlen, host, sizeof(host),
+                    service, sizeof(service),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+        return UBASE_ERR_EXTERNAL;
+    *port_p = atoi(service);
+    return UBASE_ERR_NONE;
+}
+
+/** @This initializes an already allocated uprobe_metrics structure.
+ *
+ * @param uprobe_metrics pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param upump_mgr upump manager driving the HTTP endpoint, or NULL
+ * @param addr address to listen to, or NULL for all addresses
+ * @param port TCP port to listen to, or 0 for no HTTP endpoint
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_metrics_init(struct uprobe_metrics *uprobe_metrics,
+                                   struct uprobe *next,
+                                   struct upump_mgr *upump_mgr,
+                                   const char *addr, unsigned int port)
+{
+    assert(uprobe_metrics != NULL);
+    struct uprobe *uprobe = uprobe_metrics_to_uprobe(uprobe_metrics);
+    uprobe_metrics->upump_mgr = NULL;
+    uprobe_metrics->fd = -1;
+    uprobe_metrics->upump = NULL;
+    ulist_init(&uprobe_metrics->clients);
+    uprobe_metrics->nb_clients = 0;
+    ulist_init(&uprobe_metrics->pipes);
+    uprobe_metrics->next_id = 0;
+    ulist_init(&uprobe_metrics->gauges);
+    uprobe_init(uprobe, uprobe_metrics_throw, next);
+
+    if (port) {
+        if (unlikely(upump_mgr == NULL || port > UINT16_MAX)) {
+            uprobe_metrics_clean(uprobe_metrics);
+            return NULL;
+        }
+        uprobe_metrics->upump_mgr = upump_mgr_use(upump_mgr);
+        if (unlikely(!ubase_check(uprobe_metrics_listen(uprobe_metrics,
+                                                        addr, port)))) {
+            uprobe_throw(next, NULL, UPROBE_LOG, UPROBE_LOG_ERROR,
+                         "unable to open metrics endpoint");
+            uprobe_metrics_clean(uprobe_metrics);
+            return NULL;
+        }
+    }
+    return uprobe;
+}
+
+/** @This cleans a uprobe_metrics structure.
+ *
+ * @param uprobe_metrics structure to clean
+ */
+void uprobe_metrics_clean(struct uprobe_metrics *uprobe_metrics)
+{
+    assert(uprobe_metrics != NULL);
+    struct uprobe *uprobe = uprobe_metrics_to_uprobe(uprobe_metrics);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&uprobe_metrics->clients, uchain, uchain_tmp)
+        uprobe_metrics_close_client(uprobe_metrics_client_from_uchain(uchain));
+    if (uprobe_metrics->upump != NULL)
+        upump_free(uprobe_metrics->upump);
+    if (uprobe_metrics->fd != -1)
+        close(uprobe_metrics->fd);
+    upump_mgr_release(uprobe_metrics->upump_mgr);
+
+    ulist_delete_foreach (&uprobe_metrics->pipes, uchain, uchain_tmp)
+        uprobe_metrics_free_pipe(uprobe_metrics_pipe_from_uchain(uchain));
+    ulist_delete_foreach (&uprobe_metrics->gauges, uchain, uchain_tmp) {
+        struct uprobe_metrics_gauge *gauge =
+            uprobe_metrics_gauge_from_uchain(uchain);
+        ulist_delete(uchain);
+        umem_mgr_release(gauge->umem_mgr);
+        if (gauge->uprobe_dejitter != NULL)
+            uprobe_release(uprobe_dejitter_to_uprobe(gauge->uprobe_dejitter));
+        free(gauge->name);
+        free(gauge->labels);
+        free(gauge);
+    }
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, struct upump_mgr *upump_mgr, const char *addr, unsigned int port
+#define ARGS next, upump_mgr, addr, port
+UPROBE_HELPER_ALLOC(uprobe_metrics)
+#undef ARGS
+#undef ARGS_DECL
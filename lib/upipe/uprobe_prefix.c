@@ -32,11 +32,48 @@
 #include <upipe/uprobe_prefix.h>
 #include <upipe/uprobe_helper_alloc.h>
 #include <upipe/upipe.h>
+#include <upipe/uclock.h>
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdarg.h>
+#include <inttypes.h>
 #include <assert.h>
 
+/** @internal @This catches stats events, and prints them as debug messages
+ * if no other probe handles them.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_pfx_throw_stats(struct uprobe *uprobe, struct upipe *upipe,
+                                  int event, va_list args)
+{
+    va_list args_copy;
+    va_copy(args_copy, args);
+    const struct upipe_stats *stats = va_arg(args_copy,
+                                             const struct upipe_stats *);
+    va_end(args_copy);
+
+    int err = uprobe_throw_next(uprobe, upipe, event, args);
+    if (err != UBASE_ERR_UNHANDLED)
+        return err;
+
+    char msg[256];
+    snprintf(msg, sizeof(msg),
+             "stats: %"PRIu64" in (%"PRIu64" octets) %"PRIu64" out in %"PRIu64
+             " ms, time %"PRIu64" us (self %"PRIu64" us, max %"PRIu64" us)",
+             stats->inputs, stats->octets, stats->outputs,
+             stats->duration * 1000 / UCLOCK_FREQ,
+             stats->time * 1000000 / UCLOCK_FREQ,
+             stats->self_time * 1000000 / UCLOCK_FREQ,
+             stats->max_time * 1000000 / UCLOCK_FREQ);
+    return uprobe_throw(uprobe, upipe, UPROBE_LOG, UPROBE_LOG_DEBUG, msg);
+}
+
 /** @internal @This catches events thrown by pipes.
  *
  * @param uprobe pointer to probe
@@ -49,6 +86,8 @@ static int uprobe_pfx_throw(struct uprobe *uprobe, struct upipe *upipe,
                             int event, va_list args)
 {
     struct uprobe_pfx *uprobe_pfx = uprobe_pfx_from_uprobe(uprobe);
+    if (event == UPROBE_STATS)
+        return uprobe_pfx_throw_stats(uprobe, upipe, event, args);
     if (event != UPROBE_LOG)
         return uprobe_throw_next(uprobe, upipe, event, args);
 
@@ -90,6 +129,8 @@ struct uprobe *uprobe_pfx_init(struct uprobe_pfx *uprobe_pfx,
         uprobe_pfx->name = NULL;
     uprobe_pfx->min_level = min_level;
     uprobe_init(uprobe, uprobe_pfx_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_LOG) |
+                      UPROBE_EVENT_MASK(UPROBE_STATS));
     return uprobe;
 }
 
@@ -105,6 +146,24 @@ void uprobe_pfx_clean(struct uprobe_pfx *uprobe_pfx)
     uprobe_clean(uprobe);
 }
 
+/** @This returns the name of the first prefix probe found in a probe
+ * hierarchy.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @return name of the probe, or NULL if there is no named prefix probe
+ */
+const char *uprobe_pfx_get_name(struct uprobe *uprobe)
+{
+    for ( ; uprobe != NULL; uprobe = uprobe->next) {
+        if (uprobe->uprobe_throw != uprobe_pfx_throw)
+            continue;
+        struct uprobe_pfx *uprobe_pfx = uprobe_pfx_from_uprobe(uprobe);
+        if (uprobe_pfx->name != NULL)
+            return uprobe_pfx->name;
+    }
+    return NULL;
+}
+
 #define ARGS_DECL struct uprobe *next, enum uprobe_log_level min_level, const char *name
 #define ARGS next, min_level, name
 UPROBE_HELPER_ALLOC(uprobe_pfx)
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe suppressing repeated log messages
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ratelimit.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <assert.h>
+
+/** @internal @This stores a tracked message. */
+struct uprobe_ratelimit_entry {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pipe throwing the message */
+    struct upipe *upipe;
+    /** hash of the pipe and message */
+    uint32_t hash;
+    /** true if the message is a printf-style format */
+    bool format;
+    /** message or format */
+    char *msg;
+    /** level of the message */
+    enum uprobe_log_level level;
+    /** date of the start of the current period */
+    uint64_t start;
+    /** number of messages let through in the current period */
+    unsigned int count;
+    /** number of messages suppressed in the current period */
+    unsigned int suppressed;
+};
+
+UBASE_FROM_TO(uprobe_ratelimit_entry, uchain, uchain, uchain)
+
+/** @internal @This throws the actual event; only used for pointer
+ * comparison. */
+static int uprobe_ratelimit_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                  int event, va_list args);
+
+/** @internal @This computes the hash of a message.
+ *
+ * @param upipe pipe throwing the message
+ * @param msg message or format
+ * @return hash
+ */
+static uint32_t uprobe_ratelimit_hash(struct upipe *upipe, const char *msg)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261U ^ (uint32_t)(uintptr_t)upipe;
+    for ( ; *msg; msg++)
+        hash = (hash ^ (uint8_t)*msg) * 16777619U;
+    return hash;
+}
+
+/** @internal @This throws the summary of a suppressed message, if any.
+ *
+ * @param uprobe_ratelimit pointer to probe
+ * @param entry tracked message
+ */
+static void uprobe_ratelimit_summary(struct uprobe_ratelimit *uprobe_ratelimit,
+                                     struct uprobe_ratelimit_entry *entry)
+{
+    if (!entry->suppressed)
+        return;
+
+    /* formats are not prefixed yet, unless a prefix probe follows */
+    const char *name = NULL;
+    if (entry->format && entry->upipe != NULL) {
+        name = uprobe_pfx_get_name(entry->upipe->uprobe);
+        if (name == uprobe_pfx_get_name(uprobe_ratelimit->uprobe.next))
+            name = NULL;
+    }
+
+    size_t size = strlen(entry->msg) + (name != NULL ? strlen(name) : 0) +
+                  sizeof("[]  (repeated 4294967295 times)");
+    char msg[size];
+    snprintf(msg, size, "%s%s%s%s (repeated %u times)",
+             name != NULL ? "[" : "", name != NULL ? name : "",
+             name != NULL ? "] " : "", entry->msg, entry->suppressed);
+    entry->suppressed = 0;
+    uprobe_throw(uprobe_ratelimit->uprobe.next, entry->upipe, UPROBE_LOG,
+                 entry->level, msg);
+}
+
+/** @internal @This frees a tracked message, throwing its summary.
+ *
+ * @param uprobe_ratelimit pointer to probe
+ * @param entry tracked message
+ */
+static void uprobe_ratelimit_forget(struct uprobe_ratelimit *uprobe_ratelimit,
+                                    struct uprobe_ratelimit_entry *entry)
+{
+    uprobe_ratelimit_summary(uprobe_ratelimit, entry);
+    ulist_delete(&entry->uchain);
+    uprobe_ratelimit->nb_entries--;
+    free(entry->msg);
+    free(entry);
+}
+
+/** @internal @This frees the tracked messages whose period has elapsed.
+ *
+ * @param uprobe_ratelimit pointer to probe
+ * @param now current date
+ */
+static void uprobe_ratelimit_expire(struct uprobe_ratelimit *uprobe_ratelimit,
+                                    uint64_t now)
+{
+    for (unsigned int i = 0; i < UPROBE_RATELIMIT_BUCKETS; i++) {
+        struct uchain *uchain, *uchain_tmp;
+        ulist_delete_foreach (&uprobe_ratelimit->buckets[i], uchain,
+                              uchain_tmp) {
+            struct uprobe_ratelimit_entry *entry =
+                uprobe_ratelimit_entry_from_uchain(uchain);
+            if (now - entry->start >= uprobe_ratelimit->period)
+                uprobe_ratelimit_forget(uprobe_ratelimit, entry);
+        }
+    }
+}
+
+/** @internal @This checks whether a message is let through.
+ *
+ * @param uprobe_ratelimit pointer to probe
+ * @param upipe pipe throwing the message
+ * @param level level of the message
+ * @param msg message or format
+ * @param format true if msg is a printf-style format
+ * @return false if the message is suppressed
+ */
+static bool uprobe_ratelimit_check(struct uprobe_ratelimit *uprobe_ratelimit,
+                                   struct upipe *upipe,
+                                   enum uprobe_log_level level,
+                                   const char *msg, bool format)
+{
+    if (unlikely(msg == NULL))
+        return true;
+
+    uint32_t hash = uprobe_ratelimit_hash(upipe, msg);
+    struct uchain *bucket =
+        &uprobe_ratelimit->buckets[hash % UPROBE_RATELIMIT_BUCKETS];
+    uint64_t now = uclock_now(uprobe_ratelimit->uclock);
+
+    struct uchain *uchain;
+    ulist_foreach (bucket, uchain) {
+        struct uprobe_ratelimit_entry *entry =
+            uprobe_ratelimit_entry_from_uchain(uchain);
+        if (entry->hash != hash || entry->upipe != upipe ||
+            entry->format != format || strcmp(entry->msg, msg))
+            continue;
+
+        if (now - entry->start >= uprobe_ratelimit->period) {
+            uprobe_ratelimit_summary(uprobe_ratelimit, entry);
+            entry->start = now;
+            entry->count = 0;
+        }
+        if (entry->count >= uprobe_ratelimit->burst) {
+            entry->suppressed++;
+            return false;
+        }
+        entry->count++;
+        return true;
+    }
+
+    if (uprobe_ratelimit->nb_entries >= UPROBE_RATELIMIT_MAX_ENTRIES) {
+        uprobe_ratelimit_expire(uprobe_ratelimit, now);
+        if (uprobe_ratelimit->nb_entries >= UPROBE_RATELIMIT_MAX_ENTRIES)
+            return true;
+    }
+
+    struct uprobe_ratelimit_entry *entry =
+        malloc(sizeof(struct uprobe_ratelimit_entry));
+    if (unlikely(entry == NULL))
+        return true;
+    entry->msg = strdup(msg);
+    if (unlikely(entry->msg == NULL)) {
+        free(entry);
+        return true;
+    }
+    uchain_init(&entry->uchain);
+    entry->upipe = upipe;
+    entry->hash = hash;
+    entry->format = format;
+    entry->level = level;
+    entry->start = now;
+    entry->count = 1;
+    entry->suppressed = 0;
+    ulist_add(bucket, &entry->uchain);
+    uprobe_ratelimit->nb_entries++;
+    return uprobe_ratelimit->burst > 0;
+}
+
+/** @internal @This asks the rate-limiting probes of a hierarchy whether a
+ * log message should be thrown, before its arguments are formatted.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @param upipe description structure of the pipe
+ * @param level level of importance of the message
+ * @param format format of the textual message
+ * @return false if the message is suppressed
+ */
+/** @internal @This ends the filtering of a message, by invalidating the
+ * bypasses set for a pipe by @ref uprobe_log_filter.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @param upipe description structure of the pipe
+ */
+static void uprobe_log_unfilter(struct uprobe *uprobe, struct upipe *upipe)
+{
+    for ( ; uprobe != NULL; uprobe = uprobe->next) {
+        if (uprobe->uprobe_throw != uprobe_ratelimit_throw)
+            continue;
+        struct uprobe_ratelimit *uprobe_ratelimit =
+            uprobe_ratelimit_from_uprobe(uprobe);
+        if (uprobe_ratelimit->bypass == upipe)
+            uprobe_ratelimit->bypassed = false;
+    }
+}
+
+bool uprobe_log_filter(struct uprobe *uprobe, struct upipe *upipe,
+                       enum uprobe_log_level level, const char *format)
+{
+    struct uprobe *first = uprobe;
+    for ( ; uprobe != NULL; uprobe = uprobe->next) {
+        if (uprobe->uprobe_throw != uprobe_ratelimit_throw)
+            continue;
+        struct uprobe_ratelimit *uprobe_ratelimit =
+            uprobe_ratelimit_from_uprobe(uprobe);
+        if (!uprobe_ratelimit_check(uprobe_ratelimit, upipe, level, format,
+                                    true)) {
+            uprobe_log_unfilter(first, upipe);
+            return false;
+        }
+        /* the formatted message must not be accounted again */
+        uprobe_ratelimit->bypass = upipe;
+        uprobe_ratelimit->bypassed = true;
+    }
+    return true;
+}
+
+/** @internal @This throws a log event whose format was accepted by
+ * @ref uprobe_log_filter, and then ends the filtering of the message, even
+ * if a probe of the hierarchy did not forward it.
+ *
+ * @param uprobe pointer to probe hierarchy
+ * @param upipe description structure of the pipe
+ * @param level level of importance of the message
+ * @param msg textual message
+ */
+void uprobe_log_filtered(struct uprobe *uprobe, struct upipe *upipe,
+                         enum uprobe_log_level level, const char *msg)
+{
+    uprobe_log(uprobe, upipe, level, msg);
+    uprobe_log_unfilter(uprobe, upipe);
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_ratelimit_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                  int event, va_list args)
+{
+    struct uprobe_ratelimit *uprobe_ratelimit =
+        uprobe_ratelimit_from_uprobe(uprobe);
+
+    switch (event) {
+        case UPROBE_LOG: {
+            if (uprobe_ratelimit->bypassed &&
+                uprobe_ratelimit->bypass == upipe) {
+                uprobe_ratelimit->bypassed = false;
+                break;
+            }
+            va_list args_copy;
+            va_copy(args_copy, args);
+            enum uprobe_log_level level =
+                va_arg(args_copy, enum uprobe_log_level);
+            const char *msg = va_arg(args_copy, const char *);
+            va_end(args_copy);
+            if (!uprobe_ratelimit_check(uprobe_ratelimit, upipe, level, msg,
+                                        false))
+                return UBASE_ERR_NONE;
+            break;
+        }
+
+        case UPROBE_DEAD: {
+            for (unsigned int i = 0; i < UPROBE_RATELIMIT_BUCKETS; i++) {
+                struct uchain *uchain, *uchain_tmp;
+                ulist_delete_foreach (&uprobe_ratelimit->buckets[i], uchain,
+                                      uchain_tmp) {
+                    struct uprobe_ratelimit_entry *entry =
+                        uprobe_ratelimit_entry_from_uchain(uchain);
+                    if (entry->upipe == upipe)
+                        uprobe_ratelimit_forget(uprobe_ratelimit, entry);
+                }
+            }
+            if (uprobe_ratelimit->bypass == upipe)
+                uprobe_ratelimit->bypassed = false;
+            break;
+        }
+
+        default:
+            break;
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @This initializes an already allocated uprobe_ratelimit structure.
+ *
+ * @param uprobe_ratelimit pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock clock giving the current date, or NULL for the system clock
+ * @param period period in 27 MHz units
+ * @param burst number of identical messages let through per period
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ratelimit_init(struct uprobe_ratelimit *uprobe_ratelimit,
+                                     struct uprobe *next, struct uclock *uclock,
+                                     uint64_t period, unsigned int burst)
+{
+    assert(uprobe_ratelimit != NULL);
+    struct uprobe *uprobe = uprobe_ratelimit_to_uprobe(uprobe_ratelimit);
+    if (uclock != NULL)
+        uprobe_ratelimit->uclock = uclock_use(uclock);
+    else
+        uprobe_ratelimit->uclock = uclock_std_alloc(0);
+    if (unlikely(uprobe_ratelimit->uclock == NULL))
+        return NULL;
+    uprobe_ratelimit->period = period;
+    uprobe_ratelimit->burst = burst;
+    uprobe_ratelimit->bypass = NULL;
+    uprobe_ratelimit->bypassed = false;
+    uprobe_ratelimit->nb_entries = 0;
+    for (unsigned int i = 0; i < UPROBE_RATELIMIT_BUCKETS; i++)
+        ulist_init(&uprobe_ratelimit->buckets[i]);
+    uprobe_init(uprobe, uprobe_ratelimit_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_ratelimit structure.
+ *
+ * @param uprobe_ratelimit structure to clean
+ */
+void uprobe_ratelimit_clean(struct uprobe_ratelimit *uprobe_ratelimit)
+{
+    assert(uprobe_ratelimit != NULL);
+    struct uprobe *uprobe = uprobe_ratelimit_to_uprobe(uprobe_ratelimit);
+    for (unsigned int i = 0; i < UPROBE_RATELIMIT_BUCKETS; i++) {
+        struct uchain *uchain, *uchain_tmp;
+        ulist_delete_foreach (&uprobe_ratelimit->buckets[i], uchain,
+                              uchain_tmp) {
+            struct uprobe_ratelimit_entry *entry =
+                uprobe_ratelimit_entry_from_uchain(uchain);
+            ulist_delete(uchain);
+            free(entry->msg);
+            free(entry);
+        }
+    }
+    uclock_release(uprobe_ratelimit->uclock);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, struct uclock *uclock, uint64_t period, unsigned int burst
+#define ARGS next, uclock, period, burst
+UPROBE_HELPER_ALLOC(uprobe_ratelimit)
+#undef ARGS
+#undef ARGS_DECL
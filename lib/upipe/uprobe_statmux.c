@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe sharing an octetrate between encoders by their complexity
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_statmux.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/** granularity of the allocated octetrates (1 kbit/s) */
+#define OCTETRATE_STEP 125
+
+/** @internal @This describes an encoder sharing the budget. */
+struct uprobe_statmux_encoder {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pointer to the encoder */
+    struct upipe *upipe;
+    /** true if the encoder has reported its complexity */
+    bool reported;
+    /** complexity of the last group of pictures */
+    uint64_t complexity;
+    /** octetrate currently allocated */
+    uint64_t octetrate;
+    /** octetrate being computed */
+    uint64_t target;
+    /** true if the target is bound by a limit */
+    bool bound;
+};
+
+UBASE_FROM_TO(uprobe_statmux_encoder, uchain, uchain, uchain)
+
+/** @internal @This finds the entry of an encoder.
+ *
+ * @param uprobe_statmux private structure
+ * @param upipe description structure of the encoder
+ * @return pointer to the entry, or NULL
+ */
+static struct uprobe_statmux_encoder *
+    uprobe_statmux_find(struct uprobe_statmux *uprobe_statmux,
+                        struct upipe *upipe)
+{
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_statmux->encoders, uchain) {
+        struct uprobe_statmux_encoder *encoder =
+            uprobe_statmux_encoder_from_uchain(uchain);
+        if (encoder->upipe == upipe)
+            return encoder;
+    }
+    return NULL;
+}
+
+/** @internal @This adds an encoder.
+ *
+ * @param uprobe_statmux private structure
+ * @param upipe description structure of the encoder
+ * @param octetrate current octetrate of the encoder
+ * @return pointer to the entry, or NULL
+ */
+static struct uprobe_statmux_encoder *
+    uprobe_statmux_add(struct uprobe_statmux *uprobe_statmux,
+                       struct upipe *upipe, uint64_t octetrate)
+{
+    struct uprobe_statmux_encoder *encoder =
+        malloc(sizeof(struct uprobe_statmux_encoder));
+    if (unlikely(encoder == NULL))
+        return NULL;
+    uchain_init(&encoder->uchain);
+    encoder->upipe = upipe;
+    encoder->reported = false;
+    encoder->complexity = 0;
+    encoder->octetrate = octetrate;
+    encoder->target = octetrate;
+    ulist_add(&uprobe_statmux->encoders,
+              uprobe_statmux_encoder_to_uchain(encoder));
+    return encoder;
+}
+
+/** @internal @This shares the budget between the encoders in proportion to
+ * their complexities. Encoders which have not reported their complexity
+ * yet keep their octetrate out of the budget. Encoders whose share falls
+ * out of the limits are bound to them, and the rest of the budget is
+ * shared again between the others, until no share is out of the limits.
+ *
+ * @param uprobe_statmux private structure
+ */
+static void uprobe_statmux_compute(struct uprobe_statmux *uprobe_statmux)
+{
+    uint64_t min = uprobe_statmux->min_octetrate > OCTETRATE_STEP ?
+                   uprobe_statmux->min_octetrate : OCTETRATE_STEP;
+    uint64_t max = uprobe_statmux->max_octetrate;
+    uint64_t budget = uprobe_statmux->octetrate;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_statmux->encoders, uchain) {
+        struct uprobe_statmux_encoder *encoder =
+            uprobe_statmux_encoder_from_uchain(uchain);
+        encoder->bound = !encoder->reported;
+        if (encoder->bound) {
+            upipe_encoder_get_octetrate(encoder->upipe, &encoder->octetrate);
+            encoder->target = encoder->octetrate;
+            budget = budget > encoder->target ? budget - encoder->target : 0;
+        }
+    }
+
+    bool again = true;
+    while (again) {
+        again = false;
+        uint64_t complexity = 0;
+        unsigned int nb = 0;
+        ulist_foreach (&uprobe_statmux->encoders, uchain) {
+            struct uprobe_statmux_encoder *encoder =
+                uprobe_statmux_encoder_from_uchain(uchain);
+            if (!encoder->bound) {
+                complexity += encoder->complexity;
+                nb++;
+            }
+        }
+        if (!nb)
+            break;
+
+        uint64_t bound = 0;
+        ulist_foreach (&uprobe_statmux->encoders, uchain) {
+            struct uprobe_statmux_encoder *encoder =
+                uprobe_statmux_encoder_from_uchain(uchain);
+            if (encoder->bound)
+                continue;
+            encoder->target = complexity ?
+                (double)budget * encoder->complexity / complexity :
+                budget / nb;
+            if (encoder->target < min)
+                encoder->target = min;
+            else if (max && encoder->target > max)
+                encoder->target = max;
+            else
+                continue;
+            encoder->bound = true;
+            bound += encoder->target;
+            again = true;
+        }
+        budget = budget > bound ? budget - bound : 0;
+    }
+}
+
+/** @internal @This reallocates the budget and sends the new octetrates to
+ * the encoders whose allocation changed.
+ *
+ * @param uprobe_statmux private structure
+ */
+static void uprobe_statmux_allocate(struct uprobe_statmux *uprobe_statmux)
+{
+    uprobe_statmux_compute(uprobe_statmux);
+
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_statmux->encoders, uchain) {
+        struct uprobe_statmux_encoder *encoder =
+            uprobe_statmux_encoder_from_uchain(uchain);
+        if (!encoder->reported)
+            continue;
+        uint64_t octetrate = encoder->target -
+                             encoder->target % OCTETRATE_STEP;
+        if (octetrate == encoder->octetrate)
+            continue;
+        encoder->octetrate = octetrate;
+        upipe_verbose_va(encoder->upipe, "[statmux] allocating %"PRIu64
+                         " bits/s", octetrate * 8);
+        if (!ubase_check(upipe_encoder_set_octetrate(encoder->upipe,
+                                                     octetrate)))
+            upipe_warn(encoder->upipe, "[statmux] unable to set octetrate");
+    }
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_statmux_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                int event, va_list args)
+{
+    struct uprobe_statmux *uprobe_statmux =
+        uprobe_statmux_from_uprobe(uprobe);
+
+    switch (event) {
+        case UPROBE_READY: {
+            /* only encoders answer this command */
+            uint64_t octetrate;
+            if (upipe != NULL &&
+                uprobe_statmux_find(uprobe_statmux, upipe) == NULL &&
+                ubase_check(upipe_encoder_get_octetrate(upipe, &octetrate)))
+                uprobe_statmux_add(uprobe_statmux, upipe, octetrate);
+            break;
+        }
+        case UPROBE_ENCODER_COMPLEXITY: {
+            uint64_t complexity = va_arg(args, uint64_t);
+            if (unlikely(upipe == NULL))
+                return UBASE_ERR_INVALID;
+            struct uprobe_statmux_encoder *encoder =
+                uprobe_statmux_find(uprobe_statmux, upipe);
+            if (encoder == NULL) {
+                uint64_t octetrate = 0;
+                upipe_encoder_get_octetrate(upipe, &octetrate);
+                encoder = uprobe_statmux_add(uprobe_statmux, upipe, octetrate);
+                if (unlikely(encoder == NULL))
+                    return UBASE_ERR_ALLOC;
+            }
+            encoder->reported = true;
+            encoder->complexity = complexity;
+            uprobe_statmux_allocate(uprobe_statmux);
+            return UBASE_ERR_NONE;
+        }
+        case UPROBE_DEAD: {
+            struct uprobe_statmux_encoder *encoder =
+                uprobe_statmux_find(uprobe_statmux, upipe);
+            if (encoder != NULL) {
+                ulist_delete(uprobe_statmux_encoder_to_uchain(encoder));
+                free(encoder);
+                uprobe_statmux_allocate(uprobe_statmux);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @This changes the octetrate shared between the encoders, and
+ * reallocates it immediately.
+ *
+ * @param uprobe pointer to probe
+ * @param octetrate octetrate shared between the encoders
+ */
+void uprobe_statmux_set_octetrate(struct uprobe *uprobe, uint64_t octetrate)
+{
+    struct uprobe_statmux *uprobe_statmux =
+        uprobe_statmux_from_uprobe(uprobe);
+    uprobe_statmux->octetrate = octetrate;
+    uprobe_statmux_allocate(uprobe_statmux);
+}
+
+/** @This sets the bounds of the octetrate of each encoder, and reallocates
+ * the budget immediately.
+ *
+ * @param uprobe pointer to probe
+ * @param min_octetrate minimum octetrate of an encoder
+ * @param max_octetrate maximum octetrate of an encoder, or 0 for no bound
+ */
+void uprobe_statmux_set_limits(struct uprobe *uprobe, uint64_t min_octetrate,
+                               uint64_t max_octetrate)
+{
+    struct uprobe_statmux *uprobe_statmux =
+        uprobe_statmux_from_uprobe(uprobe);
+    uprobe_statmux->min_octetrate = min_octetrate;
+    uprobe_statmux->max_octetrate = max_octetrate;
+    uprobe_statmux_allocate(uprobe_statmux);
+}
+
+/** @This returns the octetrate currently allocated to an encoder.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe description structure of the encoder
+ * @param octetrate_p filled in with the octetrate
+ * @return an error code
+ */
+int uprobe_statmux_get_octetrate(struct uprobe *uprobe, struct upipe *upipe,
+                                 uint64_t *octetrate_p)
+{
+    struct uprobe_statmux *uprobe_statmux =
+        uprobe_statmux_from_uprobe(uprobe);
+    struct uprobe_statmux_encoder *encoder =
+        uprobe_statmux_find(uprobe_statmux, upipe);
+    if (encoder == NULL)
+        return UBASE_ERR_INVALID;
+    if (octetrate_p != NULL)
+        *octetrate_p = encoder->octetrate;
+    return UBASE_ERR_NONE;
+}
+
+/** @This initializes an already allocated uprobe_statmux structure.
+ *
+ * @param uprobe_statmux pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param octetrate octetrate shared between the encoders
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_statmux_init(struct uprobe_statmux *uprobe_statmux,
+                                   struct uprobe *next, uint64_t octetrate)
+{
+    assert(uprobe_statmux != NULL);
+    struct uprobe *uprobe = uprobe_statmux_to_uprobe(uprobe_statmux);
+    uprobe_statmux->octetrate = octetrate;
+    uprobe_statmux->min_octetrate = 0;
+    uprobe_statmux->max_octetrate = 0;
+    ulist_init(&uprobe_statmux->encoders);
+    uprobe_init(uprobe, uprobe_statmux_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_READY) |
+                      UPROBE_EVENT_MASK(UPROBE_ENCODER_COMPLEXITY) |
+                      UPROBE_EVENT_MASK(UPROBE_DEAD));
+    return uprobe;
+}
+
+/** @This cleans a uprobe_statmux structure.
+ *
+ * @param uprobe_statmux structure to clean
+ */
+void uprobe_statmux_clean(struct uprobe_statmux *uprobe_statmux)
+{
+    assert(uprobe_statmux != NULL);
+    struct uprobe *uprobe = uprobe_statmux_to_uprobe(uprobe_statmux);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&uprobe_statmux->encoders)) != NULL)
+        free(uprobe_statmux_encoder_from_uchain(uchain));
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, uint64_t octetrate
+#define ARGS next, octetrate
+UPROBE_HELPER_ALLOC(uprobe_statmux)
+#undef ARGS
+#undef ARGS_DECL
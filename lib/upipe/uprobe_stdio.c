@@ -28,6 +28,10 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/ulifo.h>
+#include <upipe/uqueue.h>
+#include <upipe/ueventfd.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_stdio.h>
 #include <upipe/uprobe_helper_alloc.h>
@@ -37,6 +41,146 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+
+/** @internal @This is a log record queued to the background thread. */
+struct uprobe_stdio_record {
+    /** level of the message */
+    enum uprobe_log_level level;
+    /** message */
+    char msg[UPROBE_STDIO_RECORD_SIZE];
+};
+
+/** @internal @This stores the state of asynchronous logging. */
+struct uprobe_stdio_async {
+    /** stream to write to */
+    FILE *stream;
+    /** preallocated records */
+    struct uprobe_stdio_record *records;
+    /** LIFO of free records */
+    struct ulifo free;
+    /** extra space for the LIFO */
+    void *free_extra;
+    /** queue of records to write */
+    struct uqueue queue;
+    /** extra space for the queue */
+    void *queue_extra;
+    /** number of dropped messages */
+    uatomic_uint32_t overflows;
+    /** set to 1 to stop the thread */
+    uatomic_uint32_t quit;
+    /** background thread */
+    pthread_t thread;
+};
+
+/** @internal @This returns the printable name of a log level.
+ *
+ * @param level level of the message
+ * @return name of the level
+ */
+static const char *uprobe_stdio_level_name(enum uprobe_log_level level)
+{
+    switch (level) {
+        case UPROBE_LOG_VERBOSE: return "verbose";
+        case UPROBE_LOG_DEBUG: return "debug";
+        case UPROBE_LOG_NOTICE: return "notice";
+        case UPROBE_LOG_WARNING: return "warning";
+        case UPROBE_LOG_ERROR: return "error";
+        default: return "unknown";
+    }
+}
+
+/** @internal @This queues a message to the background thread.
+ *
+ * @param async pointer to asynchronous logging state
+ * @param level level of the message
+ * @param msg message
+ */
+static void uprobe_stdio_async_log(struct uprobe_stdio_async *async,
+                                   enum uprobe_log_level level,
+                                   const char *msg)
+{
+    struct uprobe_stdio_record *record =
+        ulifo_pop(&async->free, struct uprobe_stdio_record *);
+    if (unlikely(record == NULL)) {
+        uatomic_fetch_add(&async->overflows, 1);
+        return;
+    }
+
+    record->level = level;
+    size_t size = strlen(msg);
+    if (unlikely(size > UPROBE_STDIO_RECORD_SIZE - 1))
+        size = UPROBE_STDIO_RECORD_SIZE - 1;
+    memcpy(record->msg, msg, size);
+    record->msg[size] = '\0';
+
+    /* there are as many slots in the queue as records */
+    if (unlikely(!uqueue_push(&async->queue, record))) {
+        ulifo_push(&async->free, record);
+        uatomic_fetch_add(&async->overflows, 1);
+    }
+}
+
+/** @internal @This is the main function of the background thread.
+ *
+ * @param _async pointer to asynchronous logging state
+ * @return NULL
+ */
+static void *uprobe_stdio_async_thread(void *_async)
+{
+    struct uprobe_stdio_async *async = (struct uprobe_stdio_async *)_async;
+    uint32_t overflows = 0;
+
+    for ( ; ; ) {
+        struct uprobe_stdio_record *record =
+            uqueue_pop(&async->queue, struct uprobe_stdio_record *);
+        if (record == NULL) {
+            uint32_t new_overflows = uatomic_load(&async->overflows);
+            if (unlikely(new_overflows != overflows)) {
+                fprintf(async->stream, "warning: [uprobe_stdio] %"PRIu32
+                        " messages dropped\n", new_overflows - overflows);
+                overflows = new_overflows;
+            }
+            if (uatomic_load(&async->quit))
+                break;
+
+            struct pollfd pollfd;
+            pollfd.fd = ueventfd_get_fd(&async->queue.event_pop);
+            pollfd.events = POLLIN;
+            poll(&pollfd, 1, -1);
+            continue;
+        }
+
+        fprintf(async->stream, "%s: %s\n",
+                uprobe_stdio_level_name(record->level), record->msg);
+        ulifo_push(&async->free, record);
+    }
+    return NULL;
+}
+
+/** @internal @This stops the background thread and frees the asynchronous
+ * logging state. The queued messages are written first.
+ *
+ * @param async pointer to asynchronous logging state
+ */
+static void uprobe_stdio_async_free(struct uprobe_stdio_async *async)
+{
+    uatomic_store(&async->quit, 1);
+    ueventfd_write(&async->queue.event_pop);
+    pthread_join(async->thread, NULL);
+
+    while (ulifo_pop(&async->free, struct uprobe_stdio_record *) != NULL);
+    ulifo_clean(&async->free);
+    uqueue_clean(&async->queue);
+    uatomic_clean(&async->overflows);
+    uatomic_clean(&async->quit);
+    free(async->free_extra);
+    free(async->queue_extra);
+    free(async->records);
+    free(async);
+}
 
 /** @internal @This catches events thrown by pipes.
  *
@@ -56,18 +200,87 @@ static int uprobe_stdio_throw(struct uprobe *uprobe, struct upipe *upipe,
     enum uprobe_log_level level = va_arg(args, enum uprobe_log_level);
     if (uprobe_stdio->min_level > level)
         return UBASE_ERR_NONE;
-    const char *level_name;
-    switch (level) {
-        case UPROBE_LOG_VERBOSE: level_name = "verbose"; break;
-        case UPROBE_LOG_DEBUG: level_name = "debug"; break;
-        case UPROBE_LOG_NOTICE: level_name = "notice"; break;
-        case UPROBE_LOG_WARNING: level_name = "warning"; break;
-        case UPROBE_LOG_ERROR: level_name = "error"; break;
-        default: level_name = "unknown"; break;
-    }
 
     const char *msg = va_arg(args, const char *);
-    fprintf(uprobe_stdio->stream, "%s: %s\n", level_name, msg);
+    if (uprobe_stdio->async != NULL)
+        uprobe_stdio_async_log(uprobe_stdio->async, level, msg);
+    else
+        fprintf(uprobe_stdio->stream, "%s: %s\n",
+                uprobe_stdio_level_name(level), msg);
+    return UBASE_ERR_NONE;
+}
+
+/** @This switches a uprobe_stdio to asynchronous logging. Messages are
+ * copied to one of depth preallocated records and queued to a background
+ * thread, which formats and writes them to the stream. If no record is
+ * available, the message is dropped and an overflow counter is incremented,
+ * so that the thread throwing the event never blocks. Once it is set, the
+ * stream must not be written to by other means until the probe is cleaned.
+ *
+ * @param uprobe pointer to probe
+ * @param depth number of records, between 1 and 255
+ * @return an error code
+ */
+int uprobe_stdio_set_async(struct uprobe *uprobe, unsigned int depth)
+{
+    struct uprobe_stdio *uprobe_stdio = uprobe_stdio_from_uprobe(uprobe);
+    if (unlikely(uprobe_stdio->async != NULL || !depth || depth > UINT8_MAX))
+        return UBASE_ERR_INVALID;
+
+    struct uprobe_stdio_async *async =
+        malloc(sizeof(struct uprobe_stdio_async));
+    UBASE_ALLOC_RETURN(async)
+    async->stream = uprobe_stdio->stream;
+    async->records = malloc(depth * sizeof(struct uprobe_stdio_record));
+    async->free_extra = malloc(ulifo_sizeof(depth));
+    async->queue_extra = malloc(uqueue_sizeof(depth));
+    if (unlikely(async->records == NULL || async->free_extra == NULL ||
+                 async->queue_extra == NULL))
+        goto uprobe_stdio_set_async_err;
+    if (unlikely(!uqueue_init(&async->queue, depth, async->queue_extra)))
+        goto uprobe_stdio_set_async_err;
+
+    ulifo_init(&async->free, depth, async->free_extra);
+    for (unsigned int i = 0; i < depth; i++)
+        ulifo_push(&async->free, &async->records[i]);
+    uatomic_init(&async->overflows, 0);
+    uatomic_init(&async->quit, 0);
+
+    if (unlikely(pthread_create(&async->thread, NULL,
+                                uprobe_stdio_async_thread, async) != 0)) {
+        while (ulifo_pop(&async->free, struct uprobe_stdio_record *) != NULL);
+        ulifo_clean(&async->free);
+        uqueue_clean(&async->queue);
+        uatomic_clean(&async->overflows);
+        uatomic_clean(&async->quit);
+        goto uprobe_stdio_set_async_err;
+    }
+    fflush(uprobe_stdio->stream);
+    uprobe_stdio->async = async;
+    return UBASE_ERR_NONE;
+
+uprobe_stdio_set_async_err:
+    free(async->records);
+    free(async->free_extra);
+    free(async->queue_extra);
+    free(async);
+    return UBASE_ERR_ALLOC;
+}
+
+/** @This returns the number of messages dropped because the asynchronous
+ * queue was full.
+ *
+ * @param uprobe pointer to probe
+ * @param overflows_p filled in with the number of dropped messages
+ * @return an error code
+ */
+int uprobe_stdio_get_overflows(struct uprobe *uprobe,
+                               uint32_t *overflows_p)
+{
+    struct uprobe_stdio *uprobe_stdio = uprobe_stdio_from_uprobe(uprobe);
+    if (unlikely(uprobe_stdio->async == NULL))
+        return UBASE_ERR_INVALID;
+    *overflows_p = uatomic_load(&uprobe_stdio->async->overflows);
     return UBASE_ERR_NONE;
 }
 
@@ -87,7 +300,9 @@ struct uprobe *uprobe_stdio_init(struct uprobe_stdio *uprobe_stdio,
     struct uprobe *uprobe = uprobe_stdio_to_uprobe(uprobe_stdio);
     uprobe_stdio->stream = stream;
     uprobe_stdio->min_level = min_level;
+    uprobe_stdio->async = NULL;
     uprobe_init(uprobe, uprobe_stdio_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_LOG));
     return uprobe;
 }
 
@@ -99,6 +314,8 @@ void uprobe_stdio_clean(struct uprobe_stdio *uprobe_stdio)
 {
     assert(uprobe_stdio != NULL);
     struct uprobe *uprobe = uprobe_stdio_to_uprobe(uprobe_stdio);
+    if (uprobe_stdio->async != NULL)
+        uprobe_stdio_async_free(uprobe_stdio->async);
     uprobe_clean(uprobe);
 }
 
@@ -29,6 +29,7 @@
 
 #include <upipe/ubase.h>
 #include <upipe/umem.h>
+#include <upipe/upool.h>
 #include <upipe/ubuf.h>
 #include <upipe/ubuf_mem.h>
 #include <upipe/uprobe.h>
@@ -45,10 +46,34 @@
 struct uprobe_ubuf_mem_pool_element {
     /** pointer to ubuf manager */
     struct ubuf_mgr *ubuf_mgr;
+    /** statistics of the ubuf pool at the last tuning */
+    struct upool_stats ubuf_stats;
+    /** statistics of the shared pool at the last tuning */
+    struct upool_stats shared_stats;
     /** pointer to next element */
     uatomic_ptr_t next;
 };
 
+/** @internal @This returns the new depth of a pool from its statistics.
+ *
+ * @param stats current statistics of the pool
+ * @param last statistics of the pool at the last tuning
+ * @return new depth of the pool
+ */
+static uint16_t uprobe_ubuf_mem_pool_tune_depth(const struct upool_stats *stats,
+                                                const struct upool_stats *last)
+{
+    /* structures released because the pool was full and allocated again
+     * because it was empty */
+    uint32_t churn = stats->created - last->created;
+    uint32_t overflows = stats->overflows - last->overflows;
+    if (overflows < churn)
+        churn = overflows;
+    if (churn >= (uint32_t)(stats->length - stats->depth))
+        return stats->length;
+    return stats->depth + churn;
+}
+
 /** @internal @This catches events thrown by pipes.
  *
  * @param uprobe pointer to probe
@@ -100,13 +125,15 @@ static int uprobe_ubuf_mem_pool_throw(struct uprobe *uprobe,
         }
 
         struct ubuf_mgr *ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
-                uprobe_ubuf_mem_pool->ubuf_pool_depth,
-                uprobe_ubuf_mem_pool->shared_pool_depth,
+                uprobe_ubuf_mem_pool->ubuf_max_depth,
+                uprobe_ubuf_mem_pool->shared_max_depth,
                 uprobe_ubuf_mem_pool->umem_mgr, uref);
         if (unlikely(ubuf_mgr == NULL)) {
             uref_free(uref);
             return uprobe_throw_next(uprobe, upipe, event, args);
         }
+        ubuf_mgr_resize_pool(ubuf_mgr, uprobe_ubuf_mem_pool->ubuf_pool_depth,
+                             uprobe_ubuf_mem_pool->shared_pool_depth);
 
         struct uprobe_ubuf_mem_pool_element *new_elem =
             malloc(sizeof(struct uprobe_ubuf_mem_pool_element));
@@ -114,6 +141,10 @@ static int uprobe_ubuf_mem_pool_throw(struct uprobe *uprobe,
             return urequest_provide_ubuf_mgr(urequest, ubuf_mgr, uref);
 
         new_elem->ubuf_mgr = ubuf_mgr;
+        memset(&new_elem->ubuf_stats, 0, sizeof(struct upool_stats));
+        memset(&new_elem->shared_stats, 0, sizeof(struct upool_stats));
+        ubuf_mgr_get_pool_stats(ubuf_mgr, &new_elem->ubuf_stats,
+                                &new_elem->shared_stats);
         uatomic_ptr_init(&new_elem->next, NULL);
         if (likely(uatomic_ptr_compare_exchange_ptr(elem_p, &elem, new_elem)))
             return urequest_provide_ubuf_mgr(urequest, ubuf_mgr_use(ubuf_mgr),
@@ -146,8 +177,11 @@ struct uprobe *
     uprobe_ubuf_mem_pool->umem_mgr = umem_mgr_use(umem_mgr);
     uprobe_ubuf_mem_pool->ubuf_pool_depth = ubuf_pool_depth;
     uprobe_ubuf_mem_pool->shared_pool_depth = shared_pool_depth;
+    uprobe_ubuf_mem_pool->ubuf_max_depth = ubuf_pool_depth;
+    uprobe_ubuf_mem_pool->shared_max_depth = shared_pool_depth;
     uatomic_ptr_init(&uprobe_ubuf_mem_pool->first, NULL);
     uprobe_init(uprobe, uprobe_ubuf_mem_pool_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_PROVIDE_REQUEST));
     return uprobe;
 }
 
@@ -176,6 +210,49 @@ void uprobe_ubuf_mem_pool_vacuum(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_po
     }
 }
 
+/** @This adapts the depths of the pools of the managers to the usage
+ * observed since the last call. Please note that this function is not
+ * thread-safe, and mustn't be called at the same time as
+ * @ref uprobe_ubuf_mem_pool_vacuum.
+ *
+ * @param uprobe_ubuf_mem_pool structure to tune
+ */
+void uprobe_ubuf_mem_pool_tune(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool)
+{
+    struct uprobe_ubuf_mem_pool_element *elem =
+        uatomic_ptr_load_ptr(&uprobe_ubuf_mem_pool->first,
+                             struct uprobe_ubuf_mem_pool_element *);
+
+    while (elem != NULL) {
+        struct ubuf_mgr *ubuf_mgr = elem->ubuf_mgr;
+        if (urefcount_single(ubuf_mgr->refcount))
+            /* only referenced by the probe */
+            ubuf_mgr_vacuum(ubuf_mgr);
+
+        struct upool_stats ubuf_stats, shared_stats;
+        if (ubase_check(ubuf_mgr_get_pool_stats(ubuf_mgr, &ubuf_stats,
+                                                &shared_stats))) {
+            uint16_t ubuf_depth =
+                uprobe_ubuf_mem_pool_tune_depth(&ubuf_stats,
+                                                &elem->ubuf_stats);
+            uint16_t shared_depth =
+                uprobe_ubuf_mem_pool_tune_depth(&shared_stats,
+                                                &elem->shared_stats);
+            if (ubuf_depth != ubuf_stats.depth ||
+                shared_depth != shared_stats.depth) {
+                ubuf_mgr_resize_pool(ubuf_mgr, ubuf_depth, shared_depth);
+                ubuf_mgr_get_pool_stats(ubuf_mgr, &ubuf_stats,
+                                        &shared_stats);
+            }
+            elem->ubuf_stats = ubuf_stats;
+            elem->shared_stats = shared_stats;
+        }
+
+        elem = uatomic_ptr_load_ptr(&elem->next,
+                                    struct uprobe_ubuf_mem_pool_element *);
+    }
+}
+
 /** @This cleans a uprobe_ubuf_mem_pool structure.
  *
  * @param uprobe_ubuf_mem_pool structure to clean
@@ -208,3 +285,24 @@ void uprobe_ubuf_mem_pool_set(struct uprobe *uprobe, struct umem_mgr *umem_mgr)
     umem_mgr_release(uprobe_ubuf_mem_pool->umem_mgr);
     uprobe_ubuf_mem_pool->umem_mgr = umem_mgr_use(umem_mgr);
 }
+
+/** @This sets the depths up to which @ref uprobe_ubuf_mem_pool_tune may
+ * deepen the pools of the managers allocated afterwards.
+ *
+ * @param uprobe pointer to probe
+ * @param ubuf_max_depth maximum number of ubuf structures in the pool
+ * @param shared_max_depth maximum number of shared structures in the pool
+ */
+void uprobe_ubuf_mem_pool_set_max_depth(struct uprobe *uprobe,
+                                        uint16_t ubuf_max_depth,
+                                        uint16_t shared_max_depth)
+{
+    struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool =
+        uprobe_ubuf_mem_pool_from_uprobe(uprobe);
+    if (ubuf_max_depth < uprobe_ubuf_mem_pool->ubuf_pool_depth)
+        ubuf_max_depth = uprobe_ubuf_mem_pool->ubuf_pool_depth;
+    if (shared_max_depth < uprobe_ubuf_mem_pool->shared_pool_depth)
+        shared_max_depth = uprobe_ubuf_mem_pool->shared_pool_depth;
+    uprobe_ubuf_mem_pool->ubuf_max_depth = ubuf_max_depth;
+    uprobe_ubuf_mem_pool->shared_max_depth = shared_max_depth;
+}
@@ -80,6 +80,7 @@ struct uprobe *uprobe_uclock_init(struct uprobe_uclock *uprobe_uclock,
     struct uprobe *uprobe = uprobe_uclock_to_uprobe(uprobe_uclock);
     uprobe_uclock->uclock = uclock_use(uclock);
     uprobe_init(uprobe, uprobe_uclock_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_PROVIDE_REQUEST));
     return uprobe;
 }
 
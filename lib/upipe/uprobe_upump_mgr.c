@@ -88,6 +88,9 @@ struct uprobe *uprobe_upump_mgr_init(struct uprobe_upump_mgr *uprobe_upump_mgr,
     uprobe_upump_mgr->upump_mgr = upump_mgr_use(upump_mgr);
     uprobe_upump_mgr->frozen = false;
     uprobe_init(uprobe, uprobe_upump_mgr_throw, next);
+    uprobe_set_events(uprobe, UPROBE_EVENT_MASK(UPROBE_NEED_UPUMP_MGR) |
+                      UPROBE_EVENT_MASK(UPROBE_FREEZE_UPUMP_MGR) |
+                      UPROBE_EVENT_MASK(UPROBE_THAW_UPUMP_MGR));
     return uprobe;
 }
 
@@ -58,8 +58,8 @@ struct upump_blocker *upump_common_blocker_alloc(struct upump *upump)
     struct upump_common_mgr *common_mgr =
         upump_common_mgr_from_upump_mgr(upump->mgr);
     struct upump_blocker_common *blocker_common =
-        upool_alloc(&common_mgr->upump_blocker_pool,
-                    struct upump_blocker_common *);
+        upool_cache_alloc(&common_mgr->upump_blocker_cache,
+                          struct upump_blocker_common *);
     if (unlikely(blocker_common == NULL))
         return NULL;
     uchain_init(&blocker_common->uchain);
@@ -98,7 +98,7 @@ void upump_common_blocker_free(struct upump_blocker *blocker)
         common_mgr->upump_real_start(blocker->upump);
     }
 
-    upool_free(&common_mgr->upump_blocker_pool, blocker_common);
+    upool_cache_free(&common_mgr->upump_blocker_cache, blocker_common);
 }
 
 /** @internal @This allocates the data structure.
@@ -198,7 +198,8 @@ size_t upump_common_mgr_sizeof(uint16_t upump_pool_depth,
                                uint16_t upump_blocker_pool_depth)
 {
     return upool_sizeof(upump_pool_depth) +
-           upool_sizeof(upump_blocker_pool_depth);
+           upool_sizeof(upump_blocker_pool_depth) +
+           upool_cache_sizeof(upool_cache_length(upump_blocker_pool_depth));
 }
 
 /** @This instructs an existing manager to release all structures
@@ -210,6 +211,7 @@ size_t upump_common_mgr_sizeof(uint16_t upump_pool_depth,
 void upump_common_mgr_vacuum(struct upump_mgr *mgr)
 {
     struct upump_common_mgr *common_mgr = upump_common_mgr_from_upump_mgr(mgr);
+    upool_cache_vacuum(&common_mgr->upump_blocker_cache);
     upool_vacuum(&common_mgr->upump_pool);
     upool_vacuum(&common_mgr->upump_blocker_pool);
 }
@@ -223,6 +225,7 @@ void upump_common_mgr_vacuum(struct upump_mgr *mgr)
 void upump_common_mgr_clean(struct upump_mgr *mgr)
 {
     struct upump_common_mgr *common_mgr = upump_common_mgr_from_upump_mgr(mgr);
+    upool_cache_clean(&common_mgr->upump_blocker_cache);
     upool_clean(&common_mgr->upump_pool);
     upool_clean(&common_mgr->upump_blocker_pool);
 }
@@ -265,4 +268,9 @@ void upump_common_mgr_init(struct upump_mgr *mgr,
                pool_extra + upool_sizeof(upump_pool_depth),
                upump_common_blocker_alloc_inner,
                upump_common_blocker_free_inner);
+    upool_cache_init(&common_mgr->upump_blocker_cache,
+                     &common_mgr->upump_blocker_pool,
+                     upool_cache_length(upump_blocker_pool_depth),
+                     pool_extra + upool_sizeof(upump_pool_depth) +
+                     upool_sizeof(upump_blocker_pool_depth));
 }
@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short implementation of a upump manager multiplexing timers on a wheel
+ *
+ * The first level of the wheel has one slot per tick, the second level one
+ * slot per revolution of the first level, and timers farther away wait in
+ * an overflow list. When the first level wraps around, the next slot of the
+ * second level is cascaded into it, and when the second level wraps around,
+ * the overflow list is cascaded.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/urefcount.h>
+#include <upipe/upump.h>
+#include <upipe/upump_common.h>
+#include <upipe/upump_wheel.h>
+
+#include <stdlib.h>
+
+/** number of bits of a level of the wheel */
+#define WHEEL_BITS 8
+/** number of slots of a level of the wheel */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+/** mask of a level of the wheel */
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+/** @This stores management parameters and local structures.
+ */
+struct upump_wheel_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** underlying upump manager */
+    struct upump_mgr *upump_mgr;
+    /** timer driving the wheel */
+    struct upump *upump;
+    /** duration of a tick, in 27 MHz units */
+    uint64_t tick;
+    /** current tick */
+    uint64_t now;
+    /** number of armed timers */
+    unsigned int nb_timers;
+
+    /** first level, one slot per tick */
+    struct uchain fine[WHEEL_SLOTS];
+    /** second level, one slot per revolution of the first level */
+    struct uchain coarse[WHEEL_SLOTS];
+    /** timers beyond the second level */
+    struct uchain overflow;
+
+    /** common structure */
+    struct upump_common_mgr common_mgr;
+
+    /** extra space for upool */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(upump_wheel_mgr, upump_mgr, upump_mgr, common_mgr.mgr)
+UBASE_FROM_TO(upump_wheel_mgr, urefcount, urefcount, urefcount)
+
+/** @This stores local structures.
+ */
+struct upump_wheel {
+    /** structure for the lists of the wheel */
+    struct uchain uchain;
+    /** timeout of the timer, in ticks */
+    uint64_t after;
+    /** period of the timer, in ticks */
+    uint64_t repeat;
+    /** tick at which the timer expires */
+    uint64_t expires;
+    /** true if the timer is armed */
+    bool active;
+
+    /** common structure */
+    struct upump_common common;
+};
+
+UBASE_FROM_TO(upump_wheel, upump, upump, common.upump)
+UBASE_FROM_TO(upump_wheel, uchain, uchain, uchain)
+
+/** @internal @This moves all elements of a list to an empty list.
+ *
+ * @param to empty list
+ * @param from list to move, empty on return
+ */
+static void upump_wheel_splice(struct uchain *to, struct uchain *from)
+{
+    if (ulist_empty(from)) {
+        ulist_init(to);
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    ulist_init(from);
+}
+
+/** @internal @This converts a duration to a number of ticks, rounded up.
+ *
+ * @param wheel_mgr description structure of the manager
+ * @param duration duration in 27 MHz units
+ * @return number of ticks, at least 1
+ */
+static uint64_t upump_wheel_mgr_ticks(struct upump_wheel_mgr *wheel_mgr,
+                                      uint64_t duration)
+{
+    uint64_t ticks = (duration + wheel_mgr->tick - 1) / wheel_mgr->tick;
+    return ticks ? ticks : 1;
+}
+
+/** @internal @This sorts a timer into the slot of its expiration.
+ *
+ * @param wheel_mgr description structure of the manager
+ * @param upump_wheel description structure of the timer
+ */
+static void upump_wheel_mgr_insert(struct upump_wheel_mgr *wheel_mgr,
+                                   struct upump_wheel *upump_wheel)
+{
+    uint64_t delta = upump_wheel->expires - wheel_mgr->now;
+    struct uchain *ulist;
+    if (delta < WHEEL_SLOTS)
+        ulist = &wheel_mgr->fine[upump_wheel->expires & WHEEL_MASK];
+    else if (delta < WHEEL_SLOTS * WHEEL_SLOTS)
+        ulist = &wheel_mgr->coarse[(upump_wheel->expires >> WHEEL_BITS) &
+                                   WHEEL_MASK];
+    else
+        ulist = &wheel_mgr->overflow;
+    ulist_add(ulist, upump_wheel_to_uchain(upump_wheel));
+}
+
+/** @internal @This sorts again all timers of a list.
+ *
+ * @param wheel_mgr description structure of the manager
+ * @param ulist list to cascade
+ */
+static void upump_wheel_mgr_cascade(struct upump_wheel_mgr *wheel_mgr,
+                                    struct uchain *ulist)
+{
+    struct uchain cascade;
+    upump_wheel_splice(&cascade, ulist);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&cascade)) != NULL)
+        upump_wheel_mgr_insert(wheel_mgr, upump_wheel_from_uchain(uchain));
+}
+
+/** @internal @This is called by the driving timer at every tick, and
+ * dispatches expired timers.
+ *
+ * @param upump description structure of the driving timer
+ */
+static void upump_wheel_mgr_worker(struct upump *upump)
+{
+    struct upump_wheel_mgr *wheel_mgr =
+        upump_get_opaque(upump, struct upump_wheel_mgr *);
+    struct upump_mgr *mgr = upump_wheel_mgr_to_upump_mgr(wheel_mgr);
+
+    wheel_mgr->now++;
+    unsigned int index = wheel_mgr->now & WHEEL_MASK;
+    if (!index) {
+        unsigned int coarse = (wheel_mgr->now >> WHEEL_BITS) & WHEEL_MASK;
+        if (!coarse)
+            upump_wheel_mgr_cascade(wheel_mgr, &wheel_mgr->overflow);
+        upump_wheel_mgr_cascade(wheel_mgr, &wheel_mgr->coarse[coarse]);
+    }
+
+    /* callbacks may stop or free any timer, including expired ones */
+    struct uchain expired;
+    upump_wheel_splice(&expired, &wheel_mgr->fine[index]);
+    if (ulist_empty(&expired))
+        return;
+
+    upump_mgr_use(mgr);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&expired)) != NULL) {
+        struct upump_wheel *upump_wheel = upump_wheel_from_uchain(uchain);
+        uchain_init(uchain);
+        if (upump_wheel->repeat) {
+            upump_wheel->expires = wheel_mgr->now + upump_wheel->repeat;
+            upump_wheel_mgr_insert(wheel_mgr, upump_wheel);
+        } else {
+            /* the timer is automatically stopped */
+            upump_wheel->active = false;
+            if (!--wheel_mgr->nb_timers)
+                upump_stop(wheel_mgr->upump);
+        }
+        upump_common_dispatch(upump_wheel_to_upump(upump_wheel));
+    }
+    upump_mgr_release(mgr);
+}
+
+/** @This allocates a new timer, or a pump of the underlying manager for
+ * other types of events.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_wheel_mgr structure
+ * @param event type of event to watch for
+ * @param args optional parameters depending on event type
+ * @return pointer to allocated pump, or NULL in case of failure
+ */
+static struct upump *upump_wheel_alloc(struct upump_mgr *mgr,
+                                       enum upump_type event, va_list args)
+{
+    struct upump_wheel_mgr *wheel_mgr = upump_wheel_mgr_from_upump_mgr(mgr);
+    if (event != UPUMP_TYPE_TIMER)
+        return wheel_mgr->upump_mgr->upump_alloc(wheel_mgr->upump_mgr,
+                                                 event, args);
+
+    struct upump_wheel *upump_wheel =
+        upool_alloc(&wheel_mgr->common_mgr.upump_pool, struct upump_wheel *);
+    if (unlikely(upump_wheel == NULL))
+        return NULL;
+    struct upump *upump = upump_wheel_to_upump(upump_wheel);
+
+    uchain_init(upump_wheel_to_uchain(upump_wheel));
+    upump_wheel->after =
+        upump_wheel_mgr_ticks(wheel_mgr, va_arg(args, uint64_t));
+    uint64_t repeat = va_arg(args, uint64_t);
+    upump_wheel->repeat =
+        repeat ? upump_wheel_mgr_ticks(wheel_mgr, repeat) : 0;
+    upump_wheel->active = false;
+
+    upump_mgr_use(mgr);
+    upump_common_init(upump);
+
+    return upump;
+}
+
+/** @This arms a timer.
+ *
+ * @param upump description structure of the pump
+ */
+static void upump_wheel_real_start(struct upump *upump)
+{
+    struct upump_wheel *upump_wheel = upump_wheel_from_upump(upump);
+    struct upump_wheel_mgr *wheel_mgr =
+        upump_wheel_mgr_from_upump_mgr(upump->mgr);
+    if (upump_wheel->active)
+        return;
+
+    upump_wheel->active = true;
+    upump_wheel->expires = wheel_mgr->now + upump_wheel->after;
+    upump_wheel_mgr_insert(wheel_mgr, upump_wheel);
+    if (!wheel_mgr->nb_timers++)
+        upump_start(wheel_mgr->upump);
+}
+
+/** @This disarms a timer.
+ *
+ * @param upump description structure of the pump
+ */
+static void upump_wheel_real_stop(struct upump *upump)
+{
+    struct upump_wheel *upump_wheel = upump_wheel_from_upump(upump);
+    struct upump_wheel_mgr *wheel_mgr =
+        upump_wheel_mgr_from_upump_mgr(upump->mgr);
+    if (!upump_wheel->active)
+        return;
+
+    upump_wheel->active = false;
+    ulist_delete(upump_wheel_to_uchain(upump_wheel));
+    if (!--wheel_mgr->nb_timers)
+        upump_stop(wheel_mgr->upump);
+}
+
+/** @This released the memory space previously used by a timer.
+ * Please note that the pump must be stopped before.
+ *
+ * @param upump description structure of the pump
+ */
+static void upump_wheel_free(struct upump *upump)
+{
+    struct upump_wheel_mgr *wheel_mgr =
+        upump_wheel_mgr_from_upump_mgr(upump->mgr);
+    upump_stop(upump);
+    upump_common_clean(upump);
+    struct upump_wheel *upump_wheel = upump_wheel_from_upump(upump);
+    upool_free(&wheel_mgr->common_mgr.upump_pool, upump_wheel);
+    upump_mgr_release(&wheel_mgr->common_mgr.mgr);
+}
+
+/** @internal @This allocates the data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to upump_wheel or NULL in case of allocation error
+ */
+static void *upump_wheel_alloc_inner(struct upool *upool)
+{
+    struct upump_common_mgr *common_mgr =
+        upump_common_mgr_from_upump_pool(upool);
+    struct upump_wheel *upump_wheel = malloc(sizeof(struct upump_wheel));
+    if (unlikely(upump_wheel == NULL))
+        return NULL;
+    struct upump *upump = upump_wheel_to_upump(upump_wheel);
+    upump->mgr = upump_common_mgr_to_upump_mgr(common_mgr);
+    return upump_wheel;
+}
+
+/** @internal @This frees a upump_wheel.
+ *
+ * @param upool pointer to upool
+ * @param upump_wheel pointer to a upump_wheel structure to free
+ */
+static void upump_wheel_free_inner(struct upool *upool, void *upump_wheel)
+{
+    free(upump_wheel);
+}
+
+/** @This processes control commands on a upump_wheel_mgr.
+ *
+ * @param mgr pointer to a upump_mgr structure
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upump_wheel_mgr_control(struct upump_mgr *mgr,
+                                   int command, va_list args)
+{
+    struct upump_wheel_mgr *wheel_mgr = upump_wheel_mgr_from_upump_mgr(mgr);
+    if (command == UPUMP_MGR_VACUUM)
+        upump_common_mgr_vacuum(mgr);
+    /* other commands are handled by the underlying manager */
+    return upump_mgr_control_va(wheel_mgr->upump_mgr, command, args);
+}
+
+/** @This frees a upump manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void upump_wheel_mgr_free(struct urefcount *urefcount)
+{
+    struct upump_wheel_mgr *wheel_mgr =
+        upump_wheel_mgr_from_urefcount(urefcount);
+    upump_free(wheel_mgr->upump);
+    upump_mgr_release(wheel_mgr->upump_mgr);
+    upump_common_mgr_clean(upump_wheel_mgr_to_upump_mgr(wheel_mgr));
+    free(wheel_mgr);
+}
+
+/** @This allocates and initializes a upump_mgr structure multiplexing timers
+ * on a wheel.
+ *
+ * @param upump_mgr underlying upump manager, used for the driving timer and
+ * non-timer pumps
+ * @param tick resolution of the wheel, in 27 MHz units
+ * @param upump_pool_depth maximum number of upump structures in the pool
+ * @param upump_blocker_pool_depth maximum number of upump_blocker structures in
+ * the pool
+ * @return pointer to the wrapped upump_mgr structure
+ */
+struct upump_mgr *upump_wheel_mgr_alloc(struct upump_mgr *upump_mgr,
+                                        uint64_t tick,
+                                        uint16_t upump_pool_depth,
+                                        uint16_t upump_blocker_pool_depth)
+{
+    if (unlikely(upump_mgr == NULL || !tick))
+        return NULL;
+
+    struct upump_wheel_mgr *wheel_mgr =
+        malloc(sizeof(struct upump_wheel_mgr) +
+               upump_common_mgr_sizeof(upump_pool_depth,
+                                       upump_blocker_pool_depth));
+    if (unlikely(wheel_mgr == NULL))
+        return NULL;
+
+    wheel_mgr->upump = upump_alloc_timer(upump_mgr, upump_wheel_mgr_worker,
+                                         wheel_mgr, tick, tick);
+    if (unlikely(wheel_mgr->upump == NULL)) {
+        free(wheel_mgr);
+        return NULL;
+    }
+
+    struct upump_mgr *mgr = upump_wheel_mgr_to_upump_mgr(wheel_mgr);
+    upump_common_mgr_init(mgr, upump_pool_depth, upump_blocker_pool_depth,
+                          wheel_mgr->upool_extra,
+                          upump_wheel_real_start, upump_wheel_real_stop,
+                          upump_wheel_alloc_inner, upump_wheel_free_inner);
+
+    wheel_mgr->upump_mgr = upump_mgr_use(upump_mgr);
+    wheel_mgr->tick = tick;
+    wheel_mgr->now = 0;
+    wheel_mgr->nb_timers = 0;
+    for (unsigned int i = 0; i < WHEEL_SLOTS; i++) {
+        ulist_init(&wheel_mgr->fine[i]);
+        ulist_init(&wheel_mgr->coarse[i]);
+    }
+    ulist_init(&wheel_mgr->overflow);
+
+    urefcount_init(upump_wheel_mgr_to_urefcount(wheel_mgr),
+                   upump_wheel_mgr_free);
+    wheel_mgr->common_mgr.mgr.refcount =
+        upump_wheel_mgr_to_urefcount(wheel_mgr);
+    wheel_mgr->common_mgr.mgr.upump_alloc = upump_wheel_alloc;
+    wheel_mgr->common_mgr.mgr.upump_free = upump_wheel_free;
+    wheel_mgr->common_mgr.mgr.upump_mgr_control = upump_wheel_mgr_control;
+    return mgr;
+}
@@ -0,0 +1,531 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe flat manager of urefs carrying small block buffers
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/urefcount.h>
+#include <upipe/upool.h>
+#include <upipe/udict.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_common.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_flat.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <assert.h>
+
+/** @internal @This is a block ubuf carved from a slab. */
+struct uref_flat_ubuf {
+    /** slab holding the data */
+    struct uref_flat_slab *data;
+
+    /** block structure */
+    struct ubuf_block ubuf_block;
+};
+
+UBASE_FROM_TO(uref_flat_ubuf, ubuf, ubuf, ubuf_block.ubuf)
+
+/** @internal @This is a slab holding a uref, a ubuf and its data. */
+struct uref_flat_slab {
+    /** number of users of the slab: its uref, its ubuf, and the ubufs
+     * pointing to its data */
+    uatomic_uint32_t refcount;
+    /** number of ubufs pointing to the data */
+    uatomic_uint32_t data_refcount;
+
+    /** uref structure */
+    struct uref uref;
+    /** ubuf structure */
+    struct uref_flat_ubuf ubuf;
+
+    /** data */
+    uint8_t data[];
+};
+
+UBASE_FROM_TO(uref_flat_slab, uref, uref, uref)
+UBASE_FROM_TO(uref_flat_slab, uref_flat_ubuf, ubuf, ubuf)
+
+/** @This is a super-set of the uref_mgr structure with additional local
+ * members. */
+struct uref_flat_mgr {
+    /** refcount management structure, shared by both managers */
+    struct urefcount urefcount;
+
+    /** size of the data of a slab */
+    unsigned int data_size;
+    /** ubuf manager for larger buffers */
+    struct ubuf_mgr *fallback_mgr;
+    /** slab pool */
+    struct upool slab_pool;
+
+    /** block ubuf management structure */
+    struct ubuf_mgr ubuf_mgr;
+    /** common management structure */
+    struct uref_mgr mgr;
+
+    /** extra space for upool */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(uref_flat_mgr, uref_mgr, uref_mgr, mgr)
+UBASE_FROM_TO(uref_flat_mgr, ubuf_mgr, ubuf_mgr, ubuf_mgr)
+UBASE_FROM_TO(uref_flat_mgr, urefcount, urefcount, urefcount)
+UBASE_FROM_TO(uref_flat_mgr, upool, slab_pool, slab_pool)
+
+/** @internal @This allocates a slab.
+ *
+ * @param flat_mgr pointer to the flat manager
+ * @param refcount number of users of the slab
+ * @return pointer to the slab, or NULL in case of allocation error
+ */
+static struct uref_flat_slab *uref_flat_slab_alloc(
+        struct uref_flat_mgr *flat_mgr, uint32_t refcount)
+{
+    struct uref_flat_slab *slab = upool_alloc(&flat_mgr->slab_pool,
+                                              struct uref_flat_slab *);
+    if (unlikely(slab == NULL))
+        return NULL;
+    uatomic_store(&slab->refcount, refcount);
+    uatomic_store(&slab->data_refcount, 0);
+    urefcount_use(&flat_mgr->urefcount);
+    return slab;
+}
+
+/** @internal @This releases a user of a slab, and recycles it if it was the
+ * last one.
+ *
+ * @param slab pointer to the slab
+ */
+static void uref_flat_slab_release(struct uref_flat_slab *slab)
+{
+    if (likely(uatomic_fetch_sub(&slab->refcount, 1) != 1))
+        return;
+    struct uref_flat_mgr *flat_mgr =
+        uref_flat_mgr_from_uref_mgr(slab->uref.mgr);
+    upool_free(&flat_mgr->slab_pool, slab);
+    urefcount_release(&flat_mgr->urefcount);
+}
+
+/** @internal @This initializes the ubuf of a slab, pointing to the data of
+ * a slab (possibly the same one), which must already count it as a user.
+ *
+ * @param ubuf_slab slab holding the ubuf
+ * @param data_slab slab holding the data
+ * @return pointer to the ubuf
+ */
+static struct ubuf *uref_flat_ubuf_init(struct uref_flat_slab *ubuf_slab,
+                                        struct uref_flat_slab *data_slab)
+{
+    struct ubuf *ubuf = uref_flat_ubuf_to_ubuf(&ubuf_slab->ubuf);
+    ubuf_block_common_init(ubuf, false);
+    ubuf_slab->ubuf.data = data_slab;
+    uatomic_fetch_add(&data_slab->data_refcount, 1);
+    ubuf_block_common_set_buffer(ubuf, data_slab->data);
+    return ubuf;
+}
+
+/** @This allocates a uref.
+ *
+ * @param mgr common management structure
+ * @return pointer to uref or NULL in case of allocation error
+ */
+static struct uref *uref_flat_alloc(struct uref_mgr *mgr)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_uref_mgr(mgr);
+    struct uref_flat_slab *slab = uref_flat_slab_alloc(flat_mgr, 1);
+    if (unlikely(slab == NULL))
+        return NULL;
+    uchain_init(&slab->uref.uchain);
+    return &slab->uref;
+}
+
+/** @This allocates a uref and a block ubuf. If the ubuf is to be allocated
+ * by the block manager of the flat manager and fits in a slab, both are
+ * carved from the same slab.
+ *
+ * @param mgr common management structure
+ * @param ubuf_mgr block ubuf manager
+ * @param size size of the buffer
+ * @return pointer to uref or NULL in case of allocation error
+ */
+static struct uref *uref_flat_alloc_block(struct uref_mgr *mgr,
+                                          struct ubuf_mgr *ubuf_mgr, int size)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_uref_mgr(mgr);
+    if (unlikely(ubuf_mgr != &flat_mgr->ubuf_mgr || size < 0 ||
+                 (unsigned int)size > flat_mgr->data_size)) {
+        struct uref *uref = uref_alloc(mgr);
+        if (unlikely(uref == NULL))
+            return NULL;
+        struct ubuf *ubuf = ubuf_block_alloc(ubuf_mgr, size);
+        if (unlikely(ubuf == NULL)) {
+            uref_free(uref);
+            return NULL;
+        }
+        uref_attach_ubuf(uref, ubuf);
+        return uref;
+    }
+
+    /* users: the uref, the ubuf and its data */
+    struct uref_flat_slab *slab = uref_flat_slab_alloc(flat_mgr, 3);
+    if (unlikely(slab == NULL))
+        return NULL;
+    struct uref *uref = &slab->uref;
+    uchain_init(&uref->uchain);
+    uref_init(uref);
+    struct ubuf *ubuf = uref_flat_ubuf_init(slab, slab);
+    ubuf_block_common_set(ubuf, 0, size);
+    uref->ubuf = ubuf;
+    return uref;
+}
+
+/** @This recycles a uref.
+ *
+ * @param uref pointer to a uref structure
+ */
+static void uref_flat_free(struct uref *uref)
+{
+    uref_flat_slab_release(uref_flat_slab_from_uref(uref));
+}
+
+/** @This allocates a block ubuf. Buffers larger than a slab, and other
+ * allocation types, are forwarded to the fallback manager.
+ *
+ * @param mgr common management structure
+ * @param signature type of allocation
+ * @param args optional arguments (1st = size)
+ * @return pointer to ubuf or NULL in case of allocation error
+ */
+static struct ubuf *uref_flat_ubuf_alloc(struct ubuf_mgr *mgr,
+                                         uint32_t signature, va_list args)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_ubuf_mgr(mgr);
+    struct ubuf_mgr *fallback_mgr = flat_mgr->fallback_mgr;
+    if (unlikely(signature != UBUF_ALLOC_BLOCK))
+        return fallback_mgr->ubuf_alloc(fallback_mgr, signature, args);
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int size = va_arg(args_copy, int);
+    va_end(args_copy);
+    if (unlikely(size < 0 || (unsigned int)size > flat_mgr->data_size))
+        return fallback_mgr->ubuf_alloc(fallback_mgr, signature, args);
+
+    /* users: the ubuf and its data */
+    struct uref_flat_slab *slab = uref_flat_slab_alloc(flat_mgr, 2);
+    if (unlikely(slab == NULL))
+        return NULL;
+    struct ubuf *ubuf = uref_flat_ubuf_init(slab, slab);
+    ubuf_block_common_set(ubuf, 0, size);
+    return ubuf;
+}
+
+/** @internal @This allocates a ubuf pointing to the data of an existing
+ * ubuf.
+ *
+ * @param ubuf pointer to the existing ubuf
+ * @return pointer to the new ubuf, or NULL in case of allocation error
+ */
+static struct ubuf *uref_flat_ubuf_ref(struct ubuf *ubuf)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_ubuf_mgr(ubuf->mgr);
+    struct uref_flat_slab *data_slab = uref_flat_ubuf_from_ubuf(ubuf)->data;
+    struct uref_flat_slab *slab = uref_flat_slab_alloc(flat_mgr, 1);
+    if (unlikely(slab == NULL))
+        return NULL;
+    uatomic_fetch_add(&data_slab->refcount, 1);
+    return uref_flat_ubuf_init(slab, data_slab);
+}
+
+/** @This asks for the creation of a new reference to the same buffer space.
+ *
+ * @param ubuf pointer to ubuf
+ * @param new_ubuf_p reference written with a pointer to the newly allocated
+ * ubuf
+ * @return an error code
+ */
+static int uref_flat_ubuf_dup(struct ubuf *ubuf, struct ubuf **new_ubuf_p)
+{
+    assert(new_ubuf_p != NULL);
+    struct ubuf *new_ubuf = uref_flat_ubuf_ref(ubuf);
+    if (unlikely(new_ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+    if (unlikely(!ubase_check(ubuf_block_common_dup(ubuf, new_ubuf)))) {
+        ubuf_free(new_ubuf);
+        return UBASE_ERR_INVALID;
+    }
+    *new_ubuf_p = new_ubuf;
+    return UBASE_ERR_NONE;
+}
+
+/** @This asks for the creation of a new reference to part of the same
+ * buffer space.
+ *
+ * @param ubuf pointer to ubuf
+ * @param new_ubuf_p reference written with a pointer to the newly allocated
+ * ubuf
+ * @param offset offset in the buffer
+ * @param size final size of the buffer
+ * @return an error code
+ */
+static int uref_flat_ubuf_splice(struct ubuf *ubuf, struct ubuf **new_ubuf_p,
+                                 int offset, int size)
+{
+    assert(new_ubuf_p != NULL);
+    struct ubuf *new_ubuf = uref_flat_ubuf_ref(ubuf);
+    if (unlikely(new_ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+    if (unlikely(!ubase_check(ubuf_block_common_splice(ubuf, new_ubuf,
+                                                       offset, size)))) {
+        ubuf_free(new_ubuf);
+        return UBASE_ERR_INVALID;
+    }
+    *new_ubuf_p = new_ubuf;
+    return UBASE_ERR_NONE;
+}
+
+/** @This handles control commands.
+ *
+ * @param ubuf pointer to ubuf
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int uref_flat_ubuf_control(struct ubuf *ubuf, int command,
+                                  va_list args)
+{
+    switch (command) {
+        case UBUF_DUP: {
+            struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
+            return uref_flat_ubuf_dup(ubuf, new_ubuf_p);
+        }
+        case UBUF_SINGLE: {
+            struct uref_flat_slab *data_slab =
+                uref_flat_ubuf_from_ubuf(ubuf)->data;
+            return uatomic_load(&data_slab->data_refcount) == 1 ?
+                   UBASE_ERR_NONE : UBASE_ERR_BUSY;
+        }
+        case UBUF_SPLICE_BLOCK: {
+            struct ubuf **new_ubuf_p = va_arg(args, struct ubuf **);
+            int offset = va_arg(args, int);
+            int size = va_arg(args, int);
+            return uref_flat_ubuf_splice(ubuf, new_ubuf_p, offset, size);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This recycles a ubuf, and the slabs it used.
+ *
+ * @param ubuf pointer to a ubuf structure
+ */
+static void uref_flat_ubuf_free(struct ubuf *ubuf)
+{
+    struct uref_flat_ubuf *flat_ubuf = uref_flat_ubuf_from_ubuf(ubuf);
+    struct uref_flat_slab *data_slab = flat_ubuf->data;
+    ubuf_block_common_clean(ubuf);
+
+    uatomic_fetch_sub(&data_slab->data_refcount, 1);
+    uref_flat_slab_release(data_slab);
+    uref_flat_slab_release(uref_flat_slab_from_ubuf(flat_ubuf));
+}
+
+/** @internal @This allocates the data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to the slab or NULL in case of allocation error
+ */
+static void *uref_flat_slab_alloc_inner(struct upool *upool)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_slab_pool(upool);
+    struct uref_flat_slab *slab = malloc(sizeof(struct uref_flat_slab) +
+                                         flat_mgr->data_size);
+    if (unlikely(slab == NULL))
+        return NULL;
+    uatomic_init(&slab->refcount, 0);
+    uatomic_init(&slab->data_refcount, 0);
+    slab->uref.mgr = uref_flat_mgr_to_uref_mgr(flat_mgr);
+    slab->ubuf.ubuf_block.ubuf.mgr = uref_flat_mgr_to_ubuf_mgr(flat_mgr);
+    return slab;
+}
+
+/** @internal @This frees a slab.
+ *
+ * @param upool pointer to upool
+ * @param _slab pointer to the slab to free
+ */
+static void uref_flat_slab_free_inner(struct upool *upool, void *_slab)
+{
+    struct uref_flat_slab *slab = (struct uref_flat_slab *)_slab;
+    uatomic_clean(&slab->refcount);
+    uatomic_clean(&slab->data_refcount);
+    free(slab);
+}
+
+/** @This checks if the given flow format can be allocated with the block
+ * manager.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param flow_format flow format to check
+ * @return an error code
+ */
+static int uref_flat_ubuf_mgr_check(struct ubuf_mgr *mgr,
+                                    struct uref *flow_format)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_ubuf_mgr(mgr);
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_format, &def))
+    if (ubase_ncmp(def, "block."))
+        return UBASE_ERR_INVALID;
+    return ubuf_mgr_check(flat_mgr->fallback_mgr, flow_format);
+}
+
+/** @This handles block manager control commands.
+ *
+ * @param mgr pointer to ubuf manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int uref_flat_ubuf_mgr_control(struct ubuf_mgr *mgr,
+                                      int command, va_list args)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_ubuf_mgr(mgr);
+    switch (command) {
+        case UBUF_MGR_CHECK: {
+            struct uref *flow_format = va_arg(args, struct uref *);
+            return uref_flat_ubuf_mgr_check(mgr, flow_format);
+        }
+        case UBUF_MGR_VACUUM:
+            upool_vacuum(&flat_mgr->slab_pool);
+            ubuf_mgr_vacuum(flat_mgr->fallback_mgr);
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This processes control commands on a uref_flat_mgr.
+ *
+ * @param mgr pointer to a uref_mgr structure
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int uref_flat_mgr_control(struct uref_mgr *mgr, int command,
+                                 va_list args)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_uref_mgr(mgr);
+    switch (command) {
+        case UREF_MGR_VACUUM:
+            upool_vacuum(&flat_mgr->slab_pool);
+            return UBASE_ERR_NONE;
+        case UREF_FLAT_MGR_GET_UBUF_MGR: {
+            UBASE_SIGNATURE_CHECK(args, UREF_FLAT_SIGNATURE)
+            struct ubuf_mgr **ubuf_mgr_p = va_arg(args, struct ubuf_mgr **);
+            *ubuf_mgr_p = uref_flat_mgr_to_ubuf_mgr(flat_mgr);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a flat manager.
+ *
+ * @param urefcount pointer to a urefcount
+ */
+static void uref_flat_mgr_free(struct urefcount *urefcount)
+{
+    struct uref_flat_mgr *flat_mgr = uref_flat_mgr_from_urefcount(urefcount);
+    upool_clean(&flat_mgr->slab_pool);
+    udict_mgr_release(flat_mgr->mgr.udict_mgr);
+    ubuf_mgr_release(flat_mgr->fallback_mgr);
+
+    urefcount_clean(urefcount);
+    free(flat_mgr);
+}
+
+/** @This allocates a new instance of the flat uref manager.
+ *
+ * @param slab_pool_depth maximum number of slabs in the pool
+ * @param udict_mgr udict manager to use to allocate udict structures
+ * @param control_attr_size extra attributes space for control packets
+ * @param data_size size of the data carried by a slab, in octets
+ * @param fallback_mgr block ubuf manager used for larger buffers
+ * @return pointer to manager, or NULL in case of error
+ */
+struct uref_mgr *uref_flat_mgr_alloc(uint16_t slab_pool_depth,
+                                     struct udict_mgr *udict_mgr,
+                                     int control_attr_size,
+                                     unsigned int data_size,
+                                     struct ubuf_mgr *fallback_mgr)
+{
+    assert(udict_mgr != NULL);
+    assert(fallback_mgr != NULL);
+    assert(control_attr_size >= 0);
+    if (unlikely(fallback_mgr->signature != UBUF_ALLOC_BLOCK ||
+                 data_size > INT_MAX))
+        return NULL;
+
+    struct uref_flat_mgr *flat_mgr = malloc(sizeof(struct uref_flat_mgr) +
+                                            upool_sizeof(slab_pool_depth));
+    if (unlikely(flat_mgr == NULL))
+        return NULL;
+
+    flat_mgr->data_size = data_size;
+    upool_init(&flat_mgr->slab_pool, slab_pool_depth, flat_mgr->upool_extra,
+               uref_flat_slab_alloc_inner, uref_flat_slab_free_inner);
+    flat_mgr->fallback_mgr = ubuf_mgr_use(fallback_mgr);
+
+    urefcount_init(uref_flat_mgr_to_urefcount(flat_mgr), uref_flat_mgr_free);
+
+    flat_mgr->ubuf_mgr.refcount = uref_flat_mgr_to_urefcount(flat_mgr);
+    flat_mgr->ubuf_mgr.signature = UBUF_ALLOC_BLOCK;
+    flat_mgr->ubuf_mgr.ubuf_alloc = uref_flat_ubuf_alloc;
+    flat_mgr->ubuf_mgr.ubuf_control = uref_flat_ubuf_control;
+    flat_mgr->ubuf_mgr.ubuf_free = uref_flat_ubuf_free;
+    flat_mgr->ubuf_mgr.ubuf_mgr_control = uref_flat_ubuf_mgr_control;
+
+    flat_mgr->mgr.control_attr_size = control_attr_size;
+    flat_mgr->mgr.udict_mgr = udict_mgr;
+    udict_mgr_use(udict_mgr);
+    flat_mgr->mgr.refcount = uref_flat_mgr_to_urefcount(flat_mgr);
+    flat_mgr->mgr.uref_alloc = uref_flat_alloc;
+    flat_mgr->mgr.uref_free = uref_flat_free;
+    flat_mgr->mgr.uref_alloc_block = uref_flat_alloc_block;
+    flat_mgr->mgr.uref_mgr_control = uref_flat_mgr_control;
+
+    return uref_flat_mgr_to_uref_mgr(flat_mgr);
+}
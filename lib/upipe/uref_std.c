@@ -44,11 +44,13 @@ struct uref_std_mgr {
     struct urefcount urefcount;
     /** uref pool */
     struct upool uref_pool;
+    /** cache of the uref pool for the thread which allocated the manager */
+    struct upool_cache uref_cache;
 
     /** common management structure */
     struct uref_mgr mgr;
 
-    /** extra space for upool */
+    /** extra space for upool and upool_cache */
     uint8_t upool_extra[];
 };
 
@@ -64,7 +66,7 @@ UBASE_FROM_TO(uref_std_mgr, upool, uref_pool, uref_pool)
 static struct uref *uref_std_alloc(struct uref_mgr *mgr)
 {
     struct uref_std_mgr *std_mgr = uref_std_mgr_from_uref_mgr(mgr);
-    struct uref *uref = upool_alloc(&std_mgr->uref_pool, struct uref *);
+    struct uref *uref = upool_cache_alloc(&std_mgr->uref_cache, struct uref *);
     if (unlikely(uref == NULL))
         return NULL;
     uchain_init(&uref->uchain);
@@ -79,7 +81,7 @@ static struct uref *uref_std_alloc(struct uref_mgr *mgr)
 static void uref_std_free(struct uref *uref)
 {
     struct uref_std_mgr *std_mgr = uref_std_mgr_from_uref_mgr(uref->mgr);
-    upool_free(&std_mgr->uref_pool, uref);
+    upool_cache_free(&std_mgr->uref_cache, uref);
     uref_mgr_release(&std_mgr->mgr);
 }
 
@@ -114,6 +116,7 @@ static void uref_std_free_inner(struct upool *upool, void *uref)
 static void uref_std_mgr_vacuum(struct uref_mgr *mgr)
 {
     struct uref_std_mgr *std_mgr = uref_std_mgr_from_uref_mgr(mgr);
+    upool_cache_vacuum(&std_mgr->uref_cache);
     upool_vacuum(&std_mgr->uref_pool);
 }
 
@@ -143,6 +146,7 @@ static void uref_std_mgr_free(struct urefcount *urefcount)
 {
     struct uref_std_mgr *std_mgr = uref_std_mgr_from_urefcount(urefcount);
     struct uref_mgr *mgr = uref_std_mgr_to_uref_mgr(std_mgr);
+    upool_cache_clean(&std_mgr->uref_cache);
     upool_clean(&std_mgr->uref_pool);
     udict_mgr_release(mgr->udict_mgr);
 
@@ -164,13 +168,18 @@ struct uref_mgr *uref_std_mgr_alloc(uint16_t uref_pool_depth,
     assert(udict_mgr != NULL);
     assert(control_attr_size >= 0);
 
-    struct uref_std_mgr *std_mgr = malloc(sizeof(struct uref_std_mgr) +
-                                          upool_sizeof(uref_pool_depth));
+    uint16_t uref_cache_length = upool_cache_length(uref_pool_depth);
+    struct uref_std_mgr *std_mgr =
+        malloc(sizeof(struct uref_std_mgr) + upool_sizeof(uref_pool_depth) +
+               upool_cache_sizeof(uref_cache_length));
     if (unlikely(std_mgr == NULL))
         return NULL;
 
     upool_init(&std_mgr->uref_pool, uref_pool_depth, std_mgr->upool_extra,
                uref_std_alloc_inner, uref_std_free_inner);
+    upool_cache_init(&std_mgr->uref_cache, &std_mgr->uref_pool,
+                     uref_cache_length,
+                     std_mgr->upool_extra + upool_sizeof(uref_pool_depth));
 
     std_mgr->mgr.control_attr_size = control_attr_size;
     std_mgr->mgr.udict_mgr = udict_mgr;
@@ -180,6 +189,7 @@ struct uref_mgr *uref_std_mgr_alloc(uint16_t uref_pool_depth,
     std_mgr->mgr.refcount = uref_std_mgr_to_urefcount(std_mgr);
     std_mgr->mgr.uref_alloc = uref_std_alloc;
     std_mgr->mgr.uref_free = uref_std_free;
+    std_mgr->mgr.uref_alloc_block = NULL;
     std_mgr->mgr.uref_mgr_control = uref_std_mgr_control;
     
     return uref_std_mgr_to_uref_mgr(std_mgr);
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe low-overhead binary tracing of the flow of urefs
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upipe.h>
+#include <upipe/utrace.h>
+#include <upipe/config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef UPIPE_HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+/** @internal @This is the ring buffer of a thread. */
+struct utrace_ring {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** generation of the tracer the ring was allocated for */
+    unsigned int generation;
+    /** index of the thread */
+    uint32_t thread;
+    /** mask giving the position in the ring */
+    uint64_t mask;
+    /** number of records written since the allocation */
+    uint64_t count;
+    /** records */
+    struct utrace_record records[];
+};
+
+UBASE_FROM_TO(utrace_ring, uchain, uchain, uchain)
+
+/** true if tracing is enabled */
+bool utrace_enabled = false;
+
+/** @internal protects the following variables */
+static pthread_mutex_t utrace_lock = PTHREAD_MUTEX_INITIALIZER;
+/** @internal incremented each time the ring buffers are invalidated */
+static unsigned int utrace_generation = 0;
+/** @internal number of records per thread */
+static unsigned int utrace_depth = 0;
+/** @internal number of threads which allocated a ring buffer */
+static uint32_t utrace_threads = 0;
+/** @internal list of ring buffers of all threads */
+static struct uchain utrace_rings = { &utrace_rings, &utrace_rings };
+
+/** @internal ring buffer of the current thread */
+static __thread struct utrace_ring *utrace_ring = NULL;
+/** @internal generation of the ring buffer of the current thread */
+static __thread unsigned int utrace_ring_generation = 0;
+
+/** @This enables tracing. Each thread allocates its ring buffer the first
+ * time it records an event. Events recorded with a former depth are
+ * discarded.
+ *
+ * @param depth number of records kept per thread, rounded up to a power
+ * of 2, or 0 to only fire the USDT probes
+ * @return an error code
+ */
+int utrace_enable(unsigned int depth)
+{
+    unsigned int pow2 = 0;
+    if (depth) {
+        pow2 = 1;
+        while (pow2 < depth) {
+            if (unlikely(pow2 > UINT_MAX / 2))
+                return UBASE_ERR_INVALID;
+            pow2 <<= 1;
+        }
+    }
+
+    pthread_mutex_lock(&utrace_lock);
+    utrace_generation++;
+    utrace_depth = pow2;
+    pthread_mutex_unlock(&utrace_lock);
+    utrace_enabled = true;
+    return UBASE_ERR_NONE;
+}
+
+/** @This disables tracing. The recorded events are kept until
+ * @ref utrace_clean is called.
+ */
+void utrace_disable(void)
+{
+    utrace_enabled = false;
+}
+
+/** @This frees the ring buffers of all threads. It must not be called while
+ * other threads may be recording events.
+ */
+void utrace_clean(void)
+{
+    pthread_mutex_lock(&utrace_lock);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&utrace_rings, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        free(utrace_ring_from_uchain(uchain));
+    }
+    utrace_generation++;
+    utrace_threads = 0;
+    pthread_mutex_unlock(&utrace_lock);
+}
+
+/** @internal @This allocates the ring buffer of the current thread for the
+ * current generation.
+ */
+static void utrace_ring_alloc(void)
+{
+    pthread_mutex_lock(&utrace_lock);
+    utrace_ring_generation = utrace_generation;
+    utrace_ring = NULL;
+    if (utrace_depth) {
+        struct utrace_ring *ring = malloc(sizeof(struct utrace_ring) +
+                utrace_depth * sizeof(struct utrace_record));
+        if (likely(ring != NULL)) {
+            ring->generation = utrace_generation;
+            ring->thread = utrace_threads++;
+            ring->mask = utrace_depth - 1;
+            ring->count = 0;
+            ulist_add(&utrace_rings, &ring->uchain);
+            utrace_ring = ring;
+        }
+    }
+    pthread_mutex_unlock(&utrace_lock);
+}
+
+/** @internal @This records an event.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref received or sent
+ * @param event event to record
+ */
+void utrace_record(struct upipe *upipe, struct uref *uref,
+                   enum utrace_event event)
+{
+    if (unlikely(utrace_ring_generation != utrace_generation))
+        utrace_ring_alloc();
+
+    size_t size;
+    if (uref->ubuf == NULL ||
+        !ubase_check(ubuf_block_size(uref->ubuf, &size)) || size > UINT32_MAX)
+        size = UINT32_MAX;
+    uint64_t date_sys;
+    int type;
+    uref_clock_get_date_sys(uref, &date_sys, &type);
+    if (type == UREF_DATE_NONE)
+        date_sys = UINT64_MAX;
+
+#ifdef UPIPE_HAVE_SYS_SDT_H
+    if (event == UTRACE_INPUT)
+        DTRACE_PROBE4(upipe, input, upipe, uref, size, date_sys);
+    else
+        DTRACE_PROBE4(upipe, output, upipe, uref, size, date_sys);
+#endif
+
+    struct utrace_ring *ring = utrace_ring;
+    if (ring == NULL)
+        return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    struct utrace_record *record = &ring->records[ring->count++ & ring->mask];
+    record->date = ts.tv_sec * UCLOCK_FREQ +
+                   ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+    record->upipe = (uintptr_t)upipe;
+    record->uref = (uintptr_t)uref;
+    record->date_sys = date_sys;
+    record->flags = uref->flags;
+    record->signature = upipe->mgr != NULL ? upipe->mgr->signature : 0;
+    record->size = size;
+    record->event = event;
+    record->thread = ring->thread;
+}
+
+/** @This calls a function on each recorded event, thread by thread, from
+ * the oldest to the most recent. It should be called while no other
+ * thread is recording events, otherwise some records may be torn.
+ *
+ * @param cb function called for each record
+ * @param opaque opaque passed to cb
+ */
+void utrace_iterate(void (*cb)(void *, const struct utrace_record *),
+                    void *opaque)
+{
+    pthread_mutex_lock(&utrace_lock);
+    struct uchain *uchain;
+    ulist_foreach (&utrace_rings, uchain) {
+        struct utrace_ring *ring = utrace_ring_from_uchain(uchain);
+        if (ring->generation != utrace_generation)
+            continue;
+        uint64_t first = ring->count > ring->mask ?
+                         ring->count - ring->mask - 1 : 0;
+        for (uint64_t i = first; i < ring->count; i++)
+            cb(opaque, &ring->records[i & ring->mask]);
+    }
+    pthread_mutex_unlock(&utrace_lock);
+}
+
+/** @internal @This is the state of the Chrome trace writer. */
+struct utrace_chrome {
+    /** stream to write to */
+    FILE *file;
+    /** process ID */
+    int pid;
+    /** true if no event was written yet */
+    bool first;
+};
+
+/** @internal @This writes a record in the Chrome trace event format.
+ *
+ * @param opaque pointer to the utrace_chrome structure
+ * @param record record to write
+ */
+static void utrace_chrome_record(void *opaque,
+                                 const struct utrace_record *record)
+{
+    struct utrace_chrome *chrome = opaque;
+    uint64_t ns = record->date * 1000 / (UCLOCK_FREQ / UINT64_C(1000000));
+    char name[5];
+    /* fourccs are laid out in memory in the order of their characters */
+    memcpy(name, &record->signature, 4);
+    for (int i = 0; i < 4; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9')))
+            name[i] = '_';
+    }
+    name[4] = '\0';
+
+    fprintf(chrome->file, "%s\n{\"name\":\"%s %s\",\"cat\":\"upipe\","
+            "\"ph\":\"i\",\"s\":\"t\",\"ts\":%"PRIu64".%03"PRIu64","
+            "\"pid\":%d,\"tid\":%"PRIu32",\"args\":{\"pipe\":\"0x%"PRIx64"\","
+            "\"uref\":\"0x%"PRIx64"\",\"flags\":\"0x%"PRIx64"\"",
+            chrome->first ? "" : ",", name,
+            record->event == UTRACE_INPUT ? "input" : "output",
+            ns / 1000, ns % 1000,
+            chrome->pid, record->thread, record->upipe, record->uref,
+            record->flags);
+    if (record->size != UINT32_MAX)
+        fprintf(chrome->file, ",\"size\":%"PRIu32, record->size);
+    if (record->date_sys != UINT64_MAX)
+        fprintf(chrome->file, ",\"date_sys\":%"PRIu64, record->date_sys);
+    fprintf(chrome->file, "}}");
+    chrome->first = false;
+}
+
+/** @This writes the recorded events in the Chrome trace event format. It
+ * should be called while no other thread is recording events.
+ *
+ * @param file stream to write to
+ * @return an error code
+ */
+int utrace_dump_chrome(FILE *file)
+{
+    struct utrace_chrome chrome;
+    chrome.file = file;
+    chrome.pid = getpid();
+    chrome.first = true;
+    fprintf(file, "{\"traceEvents\":[");
+    utrace_iterate(utrace_chrome_record, &chrome);
+    fprintf(file, "\n]}\n");
+    return ferror(file) ? UBASE_ERR_EXTERNAL : UBASE_ERR_NONE;
+}
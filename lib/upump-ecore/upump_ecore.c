@@ -30,6 +30,7 @@
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/ulist.h>
 #include <upipe/uclock.h>
 #include <upipe/upump.h>
 #include <upipe/upump_common.h>
@@ -45,6 +46,13 @@ struct upump_ecore_mgr {
     /** refcount management structure */
     struct urefcount urefcount;
 
+    /** true if read events are coalesced to the display refresh rate */
+    bool frame_sync;
+    /** animator dispatching the pending read pumps, or NULL */
+    Ecore_Animator *animator;
+    /** list of read pumps waiting for the next frame */
+    struct uchain pending;
+
     /** common structure */
     struct upump_common_mgr common_mgr;
 
@@ -70,11 +78,40 @@ struct upump_ecore {
     uint64_t repeat;
     bool repeated;
 
+    /** structure for the list of pending pumps */
+    struct uchain uchain;
+    /** true if the pump is in the list of pending pumps */
+    bool pending;
+
     /** common structure */
     struct upump_common common;
 };
 
 UBASE_FROM_TO(upump_ecore, upump, upump, common.upump)
+UBASE_FROM_TO(upump_ecore, uchain, uchain, uchain)
+
+/** @This dispatches the pending read pumps, once per frame.
+ *
+ * @param _ecore_mgr upump_ecore_mgr private structure pointer
+ * @return EINA_FALSE to delete the animator once all pumps are dispatched
+ */
+static Eina_Bool upump_ecore_dispatch_frame(void *_ecore_mgr)
+{
+    struct upump_ecore_mgr *ecore_mgr = _ecore_mgr;
+    struct uchain *uchain;
+
+    /* pumps are popped one by one as a callback may stop or free any of
+     * them; rearmed pumps only fire again in the next main loop iteration */
+    while ((uchain = ulist_pop(&ecore_mgr->pending)) != NULL) {
+        struct upump_ecore *upump_ecore = upump_ecore_from_uchain(uchain);
+        upump_ecore->pending = false;
+        ecore_main_fd_handler_active_set(upump_ecore->io, ECORE_FD_READ);
+        upump_common_dispatch(upump_ecore_to_upump(upump_ecore));
+    }
+
+    ecore_mgr->animator = NULL;
+    return EINA_FALSE;
+}
 
 /** @This dispatches an event to a pump for type Ecore_Fd_Handler.
  *
@@ -86,6 +123,20 @@ static Eina_Bool upump_ecore_dispatch_fd(void *_upump_ecore, Ecore_Fd_Handler *f
 {
     struct upump_ecore *upump_ecore = _upump_ecore;
     struct upump *upump = upump_ecore_to_upump(upump_ecore);
+    struct upump_ecore_mgr *ecore_mgr =
+        upump_ecore_mgr_from_upump_mgr(upump->mgr);
+
+    if (ecore_mgr->frame_sync && upump_ecore->event == UPUMP_TYPE_FD_READ) {
+        /* wait for the next frame, without polling the fd meanwhile */
+        ecore_main_fd_handler_active_set(upump_ecore->io, 0);
+        ulist_add(&ecore_mgr->pending, upump_ecore_to_uchain(upump_ecore));
+        upump_ecore->pending = true;
+        if (ecore_mgr->animator == NULL)
+            ecore_mgr->animator =
+                ecore_animator_add(upump_ecore_dispatch_frame, ecore_mgr);
+        return EINA_TRUE;
+    }
+
     upump_common_dispatch(upump);
     return EINA_TRUE;
 }
@@ -181,6 +232,8 @@ static struct upump *upump_ecore_alloc(struct upump_mgr *mgr,
             return NULL;
     }
     upump_ecore->event = event;
+    uchain_init(upump_ecore_to_uchain(upump_ecore));
+    upump_ecore->pending = false;
 
     upump_mgr_use(mgr);
     upump_common_init(upump);
@@ -234,6 +287,11 @@ static void upump_ecore_real_stop(struct upump *upump)
             ecore_timer_freeze(upump_ecore->timer);
             break;
         case UPUMP_TYPE_FD_READ:
+            if (upump_ecore->pending) {
+                ulist_delete(upump_ecore_to_uchain(upump_ecore));
+                upump_ecore->pending = false;
+            }
+            /* fall through */
         case UPUMP_TYPE_FD_WRITE:
             ecore_main_fd_handler_active_set(upump_ecore->io, 0);
             break;
@@ -294,10 +352,23 @@ static void upump_ecore_free_inner(struct upool *upool, void *upump_ecore)
 static int upump_ecore_mgr_control(struct upump_mgr *mgr,
                                 int command, va_list args)
 {
+    struct upump_ecore_mgr *ecore_mgr = upump_ecore_mgr_from_upump_mgr(mgr);
     switch (command) {
         case UPUMP_MGR_VACUUM:
             upump_common_mgr_vacuum(mgr);
             return UBASE_ERR_NONE;
+        case UPUMP_ECORE_MGR_GET_FRAME_SYNC: {
+            UBASE_SIGNATURE_CHECK(args, UPUMP_ECORE_SIGNATURE)
+            bool *frame_sync_p = va_arg(args, bool *);
+            *frame_sync_p = ecore_mgr->frame_sync;
+            return UBASE_ERR_NONE;
+        }
+        case UPUMP_ECORE_MGR_SET_FRAME_SYNC: {
+            UBASE_SIGNATURE_CHECK(args, UPUMP_ECORE_SIGNATURE)
+            /* pumps already pending are dispatched on the next frame */
+            ecore_mgr->frame_sync = !!va_arg(args, int);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -310,6 +381,8 @@ static int upump_ecore_mgr_control(struct upump_mgr *mgr,
 static void upump_ecore_mgr_free(struct urefcount *urefcount)
 {
     struct upump_ecore_mgr *ecore_mgr = upump_ecore_mgr_from_urefcount(urefcount);
+    if (ecore_mgr->animator != NULL)
+        ecore_animator_del(ecore_mgr->animator);
     upump_common_mgr_clean(upump_ecore_mgr_to_upump_mgr(ecore_mgr));
     free(ecore_mgr);
 }
@@ -337,6 +410,10 @@ struct upump_mgr *upump_ecore_mgr_alloc(uint16_t upump_pool_depth,
                           upump_ecore_real_start, upump_ecore_real_stop,
                           upump_ecore_alloc_inner, upump_ecore_free_inner);
 
+    ecore_mgr->frame_sync = false;
+    ecore_mgr->animator = NULL;
+    ulist_init(&ecore_mgr->pending);
+
     urefcount_init(upump_ecore_mgr_to_urefcount(ecore_mgr), upump_ecore_mgr_free);
     ecore_mgr->common_mgr.mgr.refcount = upump_ecore_mgr_to_urefcount(ecore_mgr);
     ecore_mgr->common_mgr.mgr.upump_alloc = upump_ecore_alloc;
@@ -0,0 +1,721 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short implementation of a Upipe event loop using Linux io_uring
+ *
+ * File descriptors are watched with one-shot poll requests, which are
+ * rearmed before the pump is dispatched, and timers with timeout requests.
+ * Requests of stopped pumps are cancelled asynchronously, and a pump freed
+ * while one of its requests is in flight is only released when the
+ * completion of the request is reaped.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/urefcount.h>
+#include <upipe/uclock.h>
+#include <upipe/upump.h>
+#include <upipe/upump_common.h>
+#include <upump-uring/upump_uring.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/** default number of entries of the submission ring */
+#define URING_ENTRIES 256
+
+/** @This stores management parameters and local structures.
+ */
+struct upump_uring_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** io_uring file descriptor */
+    int fd;
+    /** mapping of the submission ring */
+    void *sq_ptr;
+    /** size of the mapping of the submission ring */
+    size_t sq_size;
+    /** mapping of the completion ring (may be sq_ptr) */
+    void *cq_ptr;
+    /** size of the mapping of the completion ring */
+    size_t cq_size;
+    /** array of submission entries */
+    struct io_uring_sqe *sqes;
+    /** size of the array of submission entries */
+    size_t sqes_size;
+
+    /** head of the submission ring (written by the kernel) */
+    unsigned int *sq_head;
+    /** tail of the submission ring */
+    unsigned int *sq_tail;
+    /** mask of the submission ring */
+    unsigned int sq_mask;
+    /** number of entries of the submission ring */
+    unsigned int sq_entries;
+    /** indirection array of the submission ring */
+    unsigned int *sq_array;
+    /** number of entries not yet submitted to the kernel */
+    unsigned int to_submit;
+
+    /** head of the completion ring */
+    unsigned int *cq_head;
+    /** tail of the completion ring (written by the kernel) */
+    unsigned int *cq_tail;
+    /** mask of the completion ring */
+    unsigned int cq_mask;
+    /** array of completion entries */
+    struct io_uring_cqe *cqes;
+
+    /** busy-poll duration, in 27 MHz units */
+    uint64_t busy_poll;
+
+    /** number of started pumps */
+    unsigned int nb_active;
+    /** number of pumps with a request in flight */
+    unsigned int nb_inflight;
+    /** list of started idlers */
+    struct uchain idlers;
+
+    /** common structure */
+    struct upump_common_mgr common_mgr;
+
+    /** extra space for upool */
+    uint8_t upool_extra[];
+};
+
+UBASE_FROM_TO(upump_uring_mgr, upump_mgr, upump_mgr, common_mgr.mgr)
+UBASE_FROM_TO(upump_uring_mgr, urefcount, urefcount, urefcount)
+
+/** @This stores local structures.
+ */
+struct upump_uring {
+    /** type of event to watch */
+    enum upump_type event;
+    /** structure for the list of idlers */
+    struct uchain uchain;
+
+    /** file descriptor to watch */
+    int fd;
+    /** timeout of the timer, in 27 MHz units */
+    uint64_t after;
+    /** period of the timer, in 27 MHz units */
+    uint64_t repeat;
+    /** timeout of the pending timeout request */
+    struct __kernel_timespec ts;
+
+    /** true if the pump is started */
+    bool active;
+    /** true if a request is in flight */
+    bool armed;
+    /** true if the request in flight is being cancelled */
+    bool cancelling;
+    /** true if the pump was freed while a request was in flight */
+    bool dead;
+
+    /** common structure */
+    struct upump_common common;
+};
+
+UBASE_FROM_TO(upump_uring, upump, upump, common.upump)
+UBASE_FROM_TO(upump_uring, uchain, uchain, uchain)
+
+/** @internal @This submits pending entries, and optionally waits for
+ * completions.
+ *
+ * @param uring_mgr description structure of the manager
+ * @param wait true if the call may wait for a completion
+ * @return an error code
+ */
+static int upump_uring_mgr_enter(struct upump_uring_mgr *uring_mgr, bool wait)
+{
+    if (!wait && !uring_mgr->to_submit)
+        return UBASE_ERR_NONE;
+
+    for ( ; ; ) {
+        int ret = syscall(__NR_io_uring_enter, uring_mgr->fd,
+                          uring_mgr->to_submit, wait ? 1 : 0,
+                          wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (likely(ret >= 0)) {
+            uring_mgr->to_submit -= ret;
+            return UBASE_ERR_NONE;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EBUSY)
+            /* the completion ring must be reaped first */
+            return UBASE_ERR_NONE;
+        return UBASE_ERR_EXTERNAL;
+    }
+}
+
+/** @internal @This returns a new submission entry, flushing the submission
+ * ring if it is full.
+ *
+ * @param uring_mgr description structure of the manager
+ * @param opcode operation to submit
+ * @param upump_uring pump the request belongs to, or NULL
+ * @return pointer to the submission entry
+ */
+static struct io_uring_sqe *
+    upump_uring_mgr_get_sqe(struct upump_uring_mgr *uring_mgr,
+                            uint8_t opcode, struct upump_uring *upump_uring)
+{
+    unsigned int tail = *uring_mgr->sq_tail;
+    if (unlikely(tail - __atomic_load_n(uring_mgr->sq_head, __ATOMIC_ACQUIRE)
+                 >= uring_mgr->sq_entries)) {
+        upump_uring_mgr_enter(uring_mgr, false);
+        assert(tail - __atomic_load_n(uring_mgr->sq_head, __ATOMIC_ACQUIRE) <
+               uring_mgr->sq_entries);
+    }
+
+    unsigned int index = tail & uring_mgr->sq_mask;
+    struct io_uring_sqe *sqe = &uring_mgr->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = -1;
+    sqe->user_data = (uintptr_t)upump_uring;
+    uring_mgr->sq_array[index] = index;
+    __atomic_store_n(uring_mgr->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring_mgr->to_submit++;
+    return sqe;
+}
+
+/** @internal @This submits the request of a pump.
+ *
+ * @param upump_uring description structure of the pump
+ * @param timeout timeout of the request, for timers
+ */
+static void upump_uring_arm(struct upump_uring *upump_uring, uint64_t timeout)
+{
+    struct upump *upump = upump_uring_to_upump(upump_uring);
+    struct upump_uring_mgr *uring_mgr =
+        upump_uring_mgr_from_upump_mgr(upump->mgr);
+    struct io_uring_sqe *sqe;
+
+    switch (upump_uring->event) {
+        case UPUMP_TYPE_TIMER:
+            upump_uring->ts.tv_sec = timeout / UCLOCK_FREQ;
+            upump_uring->ts.tv_nsec = (timeout % UCLOCK_FREQ) * 1000 / 27;
+            sqe = upump_uring_mgr_get_sqe(uring_mgr, IORING_OP_TIMEOUT,
+                                          upump_uring);
+            sqe->addr = (uintptr_t)&upump_uring->ts;
+            sqe->len = 1;
+            break;
+        case UPUMP_TYPE_FD_READ:
+        case UPUMP_TYPE_FD_WRITE: {
+            uint32_t events =
+                upump_uring->event == UPUMP_TYPE_FD_READ ? POLLIN : POLLOUT;
+#if __BYTE_ORDER == __BIG_ENDIAN
+            events = (events << 16) | (events >> 16);
+#endif
+            sqe = upump_uring_mgr_get_sqe(uring_mgr, IORING_OP_POLL_ADD,
+                                          upump_uring);
+            sqe->fd = upump_uring->fd;
+            sqe->poll32_events = events;
+            break;
+        }
+        default:
+            return;
+    }
+    upump_uring->armed = true;
+    uring_mgr->nb_inflight++;
+}
+
+/** @internal @This cancels the request in flight of a pump.
+ *
+ * @param upump_uring description structure of the pump
+ */
+static void upump_uring_cancel(struct upump_uring *upump_uring)
+{
+    if (!upump_uring->armed || upump_uring->cancelling)
+        return;
+
+    struct upump *upump = upump_uring_to_upump(upump_uring);
+    struct upump_uring_mgr *uring_mgr =
+        upump_uring_mgr_from_upump_mgr(upump->mgr);
+    struct io_uring_sqe *sqe =
+        upump_uring_mgr_get_sqe(uring_mgr, IORING_OP_ASYNC_CANCEL, NULL);
+    sqe->addr = (uintptr_t)upump_uring;
+    upump_uring->cancelling = true;
+}
+
+/** @internal @This releases the memory space of a pump.
+ *
+ * @param upump_uring description structure of the pump
+ */
+static void upump_uring_release(struct upump_uring *upump_uring)
+{
+    struct upump *upump = upump_uring_to_upump(upump_uring);
+    struct upump_uring_mgr *uring_mgr =
+        upump_uring_mgr_from_upump_mgr(upump->mgr);
+    upool_free(&uring_mgr->common_mgr.upump_pool, upump_uring);
+    upump_mgr_release(&uring_mgr->common_mgr.mgr);
+}
+
+/** @internal @This processes a completion entry.
+ *
+ * @param upump_uring description structure of the pump
+ * @param res result of the request
+ */
+static void upump_uring_complete(struct upump_uring *upump_uring, int res)
+{
+    struct upump *upump = upump_uring_to_upump(upump_uring);
+    struct upump_uring_mgr *uring_mgr =
+        upump_uring_mgr_from_upump_mgr(upump->mgr);
+    uring_mgr->nb_inflight--;
+    upump_uring->armed = false;
+    upump_uring->cancelling = false;
+
+    if (unlikely(upump_uring->dead)) {
+        upump_uring_release(upump_uring);
+        return;
+    }
+    if (!upump_uring->active)
+        return;
+
+    if (res == -ECANCELED) {
+        /* the pump was restarted while being cancelled */
+        upump_uring_arm(upump_uring, upump_uring->after);
+        return;
+    }
+
+    /* rearm first, as the pump may be stopped or freed by the callback */
+    if (upump_uring->event != UPUMP_TYPE_TIMER)
+        upump_uring_arm(upump_uring, 0);
+    else if (upump_uring->repeat)
+        upump_uring_arm(upump_uring, upump_uring->repeat);
+    else {
+        /* the timer is automatically stopped */
+        upump_uring->active = false;
+        uring_mgr->nb_active--;
+    }
+    upump_common_dispatch(upump);
+}
+
+/** @internal @This reaps the completion ring.
+ *
+ * @param uring_mgr description structure of the manager
+ * @return number of completions reaped
+ */
+static unsigned int upump_uring_mgr_reap(struct upump_uring_mgr *uring_mgr)
+{
+    unsigned int nb = 0;
+    unsigned int head = *uring_mgr->cq_head;
+    while (head != __atomic_load_n(uring_mgr->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &uring_mgr->cqes[head & uring_mgr->cq_mask];
+        struct upump_uring *upump_uring =
+            (struct upump_uring *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(uring_mgr->cq_head, ++head, __ATOMIC_RELEASE);
+        nb++;
+
+        /* completions of cancellations are ignored */
+        if (upump_uring != NULL)
+            upump_uring_complete(upump_uring, res);
+    }
+    return nb;
+}
+
+/** @internal @This dispatches all started idlers once. Like in libev, idlers
+ * are only dispatched by iterations that did not reap any completion.
+ *
+ * @param uring_mgr description structure of the manager
+ */
+static void upump_uring_mgr_idle(struct upump_uring_mgr *uring_mgr)
+{
+    /* idlers are rotated, as callbacks may stop or free any of them */
+    unsigned int nb = ulist_depth(&uring_mgr->idlers);
+    struct uchain *uchain;
+    while (nb-- && (uchain = ulist_pop(&uring_mgr->idlers)) != NULL) {
+        ulist_add(&uring_mgr->idlers, uchain);
+        upump_common_dispatch(
+                upump_uring_to_upump(upump_uring_from_uchain(uchain)));
+    }
+}
+
+/** @This allocates a new upump_uring.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_uring_mgr structure
+ * @param event type of event to watch for
+ * @param args optional parameters depending on event type
+ * @return pointer to allocated pump, or NULL in case of failure
+ */
+static struct upump *upump_uring_alloc(struct upump_mgr *mgr,
+                                       enum upump_type event, va_list args)
+{
+    struct upump_uring_mgr *uring_mgr = upump_uring_mgr_from_upump_mgr(mgr);
+    struct upump_uring *upump_uring =
+        upool_alloc(&uring_mgr->common_mgr.upump_pool, struct upump_uring *);
+    if (unlikely(upump_uring == NULL))
+        return NULL;
+    struct upump *upump = upump_uring_to_upump(upump_uring);
+
+    upump_uring->fd = -1;
+    upump_uring->after = upump_uring->repeat = 0;
+    switch (event) {
+        case UPUMP_TYPE_IDLER:
+            break;
+        case UPUMP_TYPE_TIMER:
+            upump_uring->after = va_arg(args, uint64_t);
+            upump_uring->repeat = va_arg(args, uint64_t);
+            break;
+        case UPUMP_TYPE_FD_READ:
+        case UPUMP_TYPE_FD_WRITE:
+            upump_uring->fd = va_arg(args, int);
+            break;
+        default:
+            upool_free(&uring_mgr->common_mgr.upump_pool, upump_uring);
+            return NULL;
+    }
+    upump_uring->event = event;
+    uchain_init(&upump_uring->uchain);
+    upump_uring->active = false;
+    upump_uring->armed = false;
+    upump_uring->cancelling = false;
+    upump_uring->dead = false;
+
+    upump_mgr_use(mgr);
+    upump_common_init(upump);
+
+    return upump;
+}
+
+/** @This starts a pump.
+ *
+ * @param upump description structure of the pump
+ */
+static void upump_uring_real_start(struct upump *upump)
+{
+    struct upump_uring *upump_uring = upump_uring_from_upump(upump);
+    struct upump_uring_mgr *uring_mgr =
+        upump_uring_mgr_from_upump_mgr(upump->mgr);
+    if (upump_uring->active)
+        return;
+    upump_uring->active = true;
+    uring_mgr->nb_active++;
+
+    if (upump_uring->event == UPUMP_TYPE_IDLER)
+        ulist_add(&uring_mgr->idlers, upump_uring_to_uchain(upump_uring));
+    else if (!upump_uring->armed)
+        upump_uring_arm(upump_uring, upump_uring->after);
+    /* otherwise the request is rearmed when the cancellation completes */
+}
+
+/** @This stops a pump.
+ *
+ * @param upump description structure of the pump
+ */
+static void upump_uring_real_stop(struct upump *upump)
+{
+    struct upump_uring *upump_uring = upump_uring_from_upump(upump);
+    struct upump_uring_mgr *uring_mgr =
+        upump_uring_mgr_from_upump_mgr(upump->mgr);
+    if (!upump_uring->active)
+        return;
+    upump_uring->active = false;
+    uring_mgr->nb_active--;
+
+    if (upump_uring->event == UPUMP_TYPE_IDLER)
+        ulist_delete(upump_uring_to_uchain(upump_uring));
+    else
+        upump_uring_cancel(upump_uring);
+}
+
+/** @This released the memory space previously used by a pump.
+ * Please note that the pump must be stopped before.
+ *
+ * @param upump description structure of the pump
+ */
+static void upump_uring_free(struct upump *upump)
+{
+    struct upump_uring *upump_uring = upump_uring_from_upump(upump);
+    upump_stop(upump);
+    upump_common_clean(upump);
+    if (upump_uring->armed) {
+        /* released when the cancellation completes */
+        upump_uring_cancel(upump_uring);
+        upump_uring->dead = true;
+        return;
+    }
+    upump_uring_release(upump_uring);
+}
+
+/** @internal @This allocates the data structure.
+ *
+ * @param upool pointer to upool
+ * @return pointer to upump_uring or NULL in case of allocation error
+ */
+static void *upump_uring_alloc_inner(struct upool *upool)
+{
+    struct upump_common_mgr *common_mgr =
+        upump_common_mgr_from_upump_pool(upool);
+    struct upump_uring *upump_uring = malloc(sizeof(struct upump_uring));
+    if (unlikely(upump_uring == NULL))
+        return NULL;
+    struct upump *upump = upump_uring_to_upump(upump_uring);
+    upump->mgr = upump_common_mgr_to_upump_mgr(common_mgr);
+    return upump_uring;
+}
+
+/** @internal @This frees a upump_uring.
+ *
+ * @param upool pointer to upool
+ * @param upump_uring pointer to a upump_uring structure to free
+ */
+static void upump_uring_free_inner(struct upool *upool, void *upump_uring)
+{
+    free(upump_uring);
+}
+
+/** @internal @This returns the time of a monotonic clock. It is read from
+ * the vDSO, without a system call.
+ *
+ * @return current time, in 27 MHz units
+ */
+static uint64_t upump_uring_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UCLOCK_FREQ +
+           (uint64_t)ts.tv_nsec * 27 / 1000;
+}
+
+/** @This runs the event loop of a upump_uring_mgr, until no pump is
+ * active anymore.
+ *
+ * @param mgr pointer to a upump_mgr structure wrapped into a
+ * upump_uring_mgr structure
+ * @return an error code
+ */
+int upump_uring_mgr_run(struct upump_mgr *mgr)
+{
+    struct upump_uring_mgr *uring_mgr = upump_uring_mgr_from_upump_mgr(mgr);
+    int err = UBASE_ERR_NONE;
+    uint64_t last_event = 0;
+    upump_mgr_use(mgr);
+
+    while (uring_mgr->nb_active || uring_mgr->nb_inflight) {
+        bool idle = !ulist_empty(&uring_mgr->idlers);
+        bool wait = !idle;
+        if (wait && uring_mgr->busy_poll) {
+            uint64_t now = upump_uring_now();
+            if (!last_event)
+                last_event = now;
+            wait = now - last_event >= uring_mgr->busy_poll;
+        }
+
+        err = upump_uring_mgr_enter(uring_mgr, wait);
+        if (unlikely(!ubase_check(err)))
+            break;
+        if (upump_uring_mgr_reap(uring_mgr)) {
+            if (uring_mgr->busy_poll)
+                last_event = upump_uring_now();
+        } else if (idle)
+            upump_uring_mgr_idle(uring_mgr);
+    }
+
+    upump_mgr_release(mgr);
+    return err;
+}
+
+/** @This processes control commands on a upump_uring_mgr.
+ *
+ * @param mgr pointer to a upump_mgr structure
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upump_uring_mgr_control(struct upump_mgr *mgr,
+                                   int command, va_list args)
+{
+    struct upump_uring_mgr *uring_mgr = upump_uring_mgr_from_upump_mgr(mgr);
+    switch (command) {
+        case UPUMP_MGR_VACUUM:
+            upump_common_mgr_vacuum(mgr);
+            return UBASE_ERR_NONE;
+        case UPUMP_URING_MGR_GET_BUSY_POLL: {
+            UBASE_SIGNATURE_CHECK(args, UPUMP_URING_SIGNATURE)
+            uint64_t *busy_poll_p = va_arg(args, uint64_t *);
+            *busy_poll_p = uring_mgr->busy_poll;
+            return UBASE_ERR_NONE;
+        }
+        case UPUMP_URING_MGR_SET_BUSY_POLL: {
+            UBASE_SIGNATURE_CHECK(args, UPUMP_URING_SIGNATURE)
+            uring_mgr->busy_poll = va_arg(args, uint64_t);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This unmaps the rings and closes the io_uring.
+ *
+ * @param uring_mgr description structure of the manager
+ */
+static void upump_uring_mgr_close(struct upump_uring_mgr *uring_mgr)
+{
+    if (uring_mgr->sqes != MAP_FAILED)
+        munmap(uring_mgr->sqes, uring_mgr->sqes_size);
+    if (uring_mgr->cq_ptr != MAP_FAILED &&
+        uring_mgr->cq_ptr != uring_mgr->sq_ptr)
+        munmap(uring_mgr->cq_ptr, uring_mgr->cq_size);
+    if (uring_mgr->sq_ptr != MAP_FAILED)
+        munmap(uring_mgr->sq_ptr, uring_mgr->sq_size);
+    close(uring_mgr->fd);
+}
+
+/** @internal @This sets up the io_uring and maps its rings.
+ *
+ * @param uring_mgr description structure of the manager
+ * @param entries number of entries of the submission ring
+ * @return false in case of error
+ */
+static bool upump_uring_mgr_open(struct upump_uring_mgr *uring_mgr,
+                                 unsigned int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    uring_mgr->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (unlikely(uring_mgr->fd == -1))
+        return false;
+
+    uring_mgr->sq_size = params.sq_off.array +
+                         params.sq_entries * sizeof(unsigned int);
+    uring_mgr->cq_size = params.cq_off.cqes +
+                         params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring_mgr->cq_size > uring_mgr->sq_size)
+            uring_mgr->sq_size = uring_mgr->cq_size;
+        uring_mgr->cq_size = uring_mgr->sq_size;
+    }
+    uring_mgr->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    uring_mgr->sq_ptr = mmap(NULL, uring_mgr->sq_size,
+                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             uring_mgr->fd, IORING_OFF_SQ_RING);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        uring_mgr->cq_ptr = uring_mgr->sq_ptr;
+    else
+        uring_mgr->cq_ptr = mmap(NULL, uring_mgr->cq_size,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE,
+                                 uring_mgr->fd, IORING_OFF_CQ_RING);
+    uring_mgr->sqes = mmap(NULL, uring_mgr->sqes_size,
+                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           uring_mgr->fd, IORING_OFF_SQES);
+    if (unlikely(uring_mgr->sq_ptr == MAP_FAILED ||
+                 uring_mgr->cq_ptr == MAP_FAILED ||
+                 uring_mgr->sqes == MAP_FAILED)) {
+        upump_uring_mgr_close(uring_mgr);
+        return false;
+    }
+
+    uint8_t *sq = uring_mgr->sq_ptr;
+    uring_mgr->sq_head = (unsigned int *)(sq + params.sq_off.head);
+    uring_mgr->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    uring_mgr->sq_mask = *(unsigned int *)(sq + params.sq_off.ring_mask);
+    uring_mgr->sq_entries = *(unsigned int *)(sq + params.sq_off.ring_entries);
+    uring_mgr->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    uring_mgr->to_submit = 0;
+
+    uint8_t *cq = uring_mgr->cq_ptr;
+    uring_mgr->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    uring_mgr->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    uring_mgr->cq_mask = *(unsigned int *)(cq + params.cq_off.ring_mask);
+    uring_mgr->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+/** @This frees a upump manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void upump_uring_mgr_free(struct urefcount *urefcount)
+{
+    struct upump_uring_mgr *uring_mgr =
+        upump_uring_mgr_from_urefcount(urefcount);
+    upump_common_mgr_clean(upump_uring_mgr_to_upump_mgr(uring_mgr));
+    upump_uring_mgr_close(uring_mgr);
+    free(uring_mgr);
+}
+
+/** @This allocates and initializes a upump_uring_mgr structure.
+ *
+ * @param entries number of entries of the submission ring (rounded up to
+ * a power of 2 by the kernel)
+ * @param upump_pool_depth maximum number of upump structures in the pool
+ * @param upump_blocker_pool_depth maximum number of upump_blocker structures in
+ * the pool
+ * @return pointer to the wrapped upump_mgr structure, or NULL if io_uring is
+ * not supported by the kernel
+ */
+struct upump_mgr *upump_uring_mgr_alloc(unsigned int entries,
+                                        uint16_t upump_pool_depth,
+                                        uint16_t upump_blocker_pool_depth)
+{
+    struct upump_uring_mgr *uring_mgr =
+        malloc(sizeof(struct upump_uring_mgr) +
+               upump_common_mgr_sizeof(upump_pool_depth,
+                                       upump_blocker_pool_depth));
+    if (unlikely(uring_mgr == NULL))
+        return NULL;
+
+    if (unlikely(!upump_uring_mgr_open(uring_mgr,
+                                       entries ? entries : URING_ENTRIES))) {
+        free(uring_mgr);
+        return NULL;
+    }
+
+    struct upump_mgr *mgr = upump_uring_mgr_to_upump_mgr(uring_mgr);
+    upump_common_mgr_init(mgr, upump_pool_depth, upump_blocker_pool_depth,
+                          uring_mgr->upool_extra,
+                          upump_uring_real_start, upump_uring_real_stop,
+                          upump_uring_alloc_inner, upump_uring_free_inner);
+
+    uring_mgr->busy_poll = 0;
+    uring_mgr->nb_active = 0;
+    uring_mgr->nb_inflight = 0;
+    ulist_init(&uring_mgr->idlers);
+    urefcount_init(upump_uring_mgr_to_urefcount(uring_mgr),
+                   upump_uring_mgr_free);
+    uring_mgr->common_mgr.mgr.refcount =
+        upump_uring_mgr_to_urefcount(uring_mgr);
+    uring_mgr->common_mgr.mgr.upump_alloc = upump_uring_alloc;
+    uring_mgr->common_mgr.mgr.upump_free = upump_uring_free;
+    uring_mgr->common_mgr.mgr.upump_mgr_control = upump_uring_mgr_control;
+    return mgr;
+}
@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short microbenchmarks of core primitives
+ *
+ * Each benchmark runs a fixed number of iterations several times, and the
+ * median run is reported, in nanoseconds per operation and operations per
+ * second. An optional argument only runs the benchmarks whose name contains
+ * it, -i and -r change the number of iterations and runs (for instance to
+ * run under callgrind), and -l lists the benchmarks. Threads yield the CPU when a queue is full or empty, so that the
+ * multi-threaded benchmarks also complete on a single core.
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/ulifo.h>
+#include <upipe/ufifo.h>
+#include <upipe/uqueue.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_std.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+
+#define RUNS                5
+#define ITERATIONS          1000000
+#define UMEM_POOL_DEPTH     64
+#define UDICT_POOL_DEPTH    64
+#define UREF_POOL_DEPTH     64
+#define UBUF_POOL_DEPTH     64
+#define UBUF_SIZE           1316
+#define TS_SIZE             188
+#define QUEUE_LENGTH        255
+
+static struct umem_mgr *umem_mgr;
+static struct udict_mgr *udict_mgr;
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+
+/** returns the monotonic time in nanoseconds */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** returns a block uref of UBUF_SIZE octets */
+static struct uref *block_alloc(void)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, UBUF_SIZE);
+    assert(uref != NULL);
+    return uref;
+}
+
+static void bench_uref_alloc(uint64_t iterations)
+{
+    for (uint64_t i = 0; i < iterations; i++) {
+        struct uref *uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        uref_free(uref);
+    }
+}
+
+static void bench_uref_dup(uint64_t iterations)
+{
+    struct uref *uref = block_alloc();
+    uref_attr_set_unsigned(uref, 42, UDICT_TYPE_UNSIGNED, "x.bench");
+    for (uint64_t i = 0; i < iterations; i++) {
+        struct uref *dup = uref_dup(uref);
+        assert(dup != NULL);
+        uref_free(dup);
+    }
+    uref_free(uref);
+}
+
+static void bench_block_splice(uint64_t iterations)
+{
+    struct uref *uref = block_alloc();
+    for (uint64_t i = 0; i < iterations; i++) {
+        struct uref *splice = uref_block_splice(uref, TS_SIZE, TS_SIZE);
+        assert(splice != NULL);
+        uref_free(splice);
+    }
+    uref_free(uref);
+}
+
+static void bench_block_append(uint64_t iterations)
+{
+    struct uref *uref = block_alloc();
+    struct uref *append = block_alloc();
+    for (uint64_t i = 0; i < iterations; i++) {
+        struct uref *dup = uref_dup(uref);
+        struct ubuf *ubuf = ubuf_dup(append->ubuf);
+        assert(dup != NULL && ubuf != NULL);
+        ubase_assert(uref_block_append(dup, ubuf));
+        uref_free(dup);
+    }
+    uref_free(append);
+    uref_free(uref);
+}
+
+static void bench_block_peek(uint64_t iterations)
+{
+    struct uref *uref = block_alloc();
+    uint8_t buffer[TS_SIZE];
+    for (uint64_t i = 0; i < iterations; i++) {
+        const uint8_t *p = uref_block_peek(uref, TS_SIZE, TS_SIZE, buffer);
+        assert(p != NULL);
+        ubase_assert(uref_block_peek_unmap(uref, TS_SIZE, buffer, p));
+    }
+    uref_free(uref);
+}
+
+static void bench_block_peek_split(uint64_t iterations)
+{
+    /* the peeked area spans two segments, so it is copied */
+    struct uref *uref = block_alloc();
+    struct uref *append = block_alloc();
+    ubase_assert(uref_block_append(uref, ubuf_dup(append->ubuf)));
+    uref_free(append);
+    uint8_t buffer[TS_SIZE];
+    for (uint64_t i = 0; i < iterations; i++) {
+        const uint8_t *p = uref_block_peek(uref, UBUF_SIZE - TS_SIZE / 2,
+                                           TS_SIZE, buffer);
+        assert(p != NULL);
+        ubase_assert(uref_block_peek_unmap(uref, UBUF_SIZE - TS_SIZE / 2,
+                                           buffer, p));
+    }
+    uref_free(uref);
+}
+
+static void bench_udict_set(uint64_t iterations)
+{
+    struct uref *uref = uref_alloc_control(uref_mgr);
+    assert(uref != NULL);
+    for (uint64_t i = 0; i < iterations; i++)
+        ubase_assert(uref_attr_set_unsigned(uref, i, UDICT_TYPE_UNSIGNED,
+                                            "x.bench"));
+    uref_free(uref);
+}
+
+static void bench_udict_get(uint64_t iterations)
+{
+    struct uref *uref = uref_alloc_control(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_attr_set_string(uref, "foo", UDICT_TYPE_STRING,
+                                      "x.first"));
+    ubase_assert(uref_attr_set_unsigned(uref, 42, UDICT_TYPE_UNSIGNED,
+                                        "x.bench"));
+    uint64_t value;
+    for (uint64_t i = 0; i < iterations; i++)
+        ubase_assert(uref_attr_get_unsigned(uref, &value, UDICT_TYPE_UNSIGNED,
+                                            "x.bench"));
+    uref_free(uref);
+}
+
+static void bench_umem_pool(uint64_t iterations)
+{
+    struct umem umem;
+    for (uint64_t i = 0; i < iterations; i++) {
+        assert(umem_alloc(umem_mgr, &umem, UBUF_SIZE));
+        umem_free(&umem);
+    }
+}
+
+static void bench_ulifo(uint64_t iterations)
+{
+    struct ulifo ulifo;
+    uint8_t extra[ulifo_sizeof(QUEUE_LENGTH)];
+    ulifo_init(&ulifo, QUEUE_LENGTH, extra);
+    for (uint64_t i = 0; i < iterations; i++) {
+        assert(ulifo_push(&ulifo, &ulifo));
+        assert(ulifo_pop(&ulifo, void *) != NULL);
+    }
+    ulifo_clean(&ulifo);
+}
+
+static void bench_ufifo(uint64_t iterations)
+{
+    struct ufifo ufifo;
+    uint8_t extra[ufifo_sizeof(QUEUE_LENGTH)];
+    ufifo_init(&ufifo, QUEUE_LENGTH, extra);
+    for (uint64_t i = 0; i < iterations; i++) {
+        assert(ufifo_push(&ufifo, &ufifo));
+        assert(ufifo_pop(&ufifo, void *) != NULL);
+    }
+    ufifo_clean(&ufifo);
+}
+
+static void bench_uqueue(uint64_t iterations)
+{
+    struct uqueue uqueue;
+    uint8_t extra[uqueue_sizeof(QUEUE_LENGTH)];
+    assert(uqueue_init(&uqueue, QUEUE_LENGTH, extra));
+    for (uint64_t i = 0; i < iterations; i++) {
+        assert(uqueue_push(&uqueue, &uqueue));
+        assert(uqueue_pop(&uqueue, void *) != NULL);
+    }
+    uqueue_clean(&uqueue);
+}
+
+/** arguments of the producer thread */
+struct producer {
+    /** ufifo to push to, or NULL */
+    struct ufifo *ufifo;
+    /** uqueue to push to, or NULL */
+    struct uqueue *uqueue;
+    /** number of elements to push */
+    uint64_t iterations;
+};
+
+static void *producer_entry(void *arg)
+{
+    struct producer *producer = arg;
+    for (uint64_t i = 0; i < producer->iterations; i++) {
+        void *element = (void *)(uintptr_t)(i + 1);
+        if (producer->ufifo != NULL)
+            while (!ufifo_push(producer->ufifo, element))
+                sched_yield();
+        else
+            while (!uqueue_push(producer->uqueue, element))
+                sched_yield();
+    }
+    return NULL;
+}
+
+static void bench_ufifo_mt(uint64_t iterations)
+{
+    struct ufifo ufifo;
+    uint8_t extra[ufifo_sizeof(QUEUE_LENGTH)];
+    ufifo_init(&ufifo, QUEUE_LENGTH, extra);
+    struct producer producer = { &ufifo, NULL, iterations };
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, producer_entry, &producer) == 0);
+    for (uint64_t i = 0; i < iterations; ) {
+        void *element = ufifo_pop(&ufifo, void *);
+        if (element != NULL)
+            i++;
+        else
+            sched_yield();
+    }
+    assert(pthread_join(thread, NULL) == 0);
+    ufifo_clean(&ufifo);
+}
+
+static void bench_uqueue_mt(uint64_t iterations)
+{
+    struct uqueue uqueue;
+    uint8_t extra[uqueue_sizeof(QUEUE_LENGTH)];
+    assert(uqueue_init(&uqueue, QUEUE_LENGTH, extra));
+    struct producer producer = { NULL, &uqueue, iterations };
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, producer_entry, &producer) == 0);
+    /* elements are popped in order */
+    for (uint64_t i = 0; i < iterations; ) {
+        void *element = uqueue_pop(&uqueue, void *);
+        if (element != NULL) {
+            assert(element == (void *)(uintptr_t)(i + 1));
+            i++;
+        } else
+            sched_yield();
+    }
+    assert(pthread_join(thread, NULL) == 0);
+    uqueue_clean(&uqueue);
+}
+
+/** description of a benchmark */
+struct bench {
+    /** name of the benchmark */
+    const char *name;
+    /** function running the given number of operations */
+    void (*run)(uint64_t);
+    /** number of operations per run */
+    uint64_t iterations;
+};
+
+static const struct bench benches[] = {
+    { "uref_alloc_free", bench_uref_alloc, ITERATIONS },
+    { "uref_dup_free", bench_uref_dup, ITERATIONS },
+    { "ubuf_block_splice", bench_block_splice, ITERATIONS },
+    { "ubuf_block_dup_append", bench_block_append, ITERATIONS },
+    { "ubuf_block_peek", bench_block_peek, ITERATIONS },
+    { "ubuf_block_peek_split", bench_block_peek_split, ITERATIONS },
+    { "udict_set_unsigned", bench_udict_set, ITERATIONS },
+    { "udict_get_unsigned", bench_udict_get, ITERATIONS },
+    { "umem_pool_alloc_free", bench_umem_pool, ITERATIONS },
+    { "ulifo_push_pop", bench_ulifo, ITERATIONS },
+    { "ufifo_push_pop", bench_ufifo, ITERATIONS },
+    { "uqueue_push_pop", bench_uqueue, ITERATIONS },
+    { "ufifo_2_threads", bench_ufifo_mt, ITERATIONS },
+    { "uqueue_2_threads", bench_uqueue_mt, ITERATIONS },
+};
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-l] [-i <iterations>] [-r <runs>] [<filter>]\n",
+            argv0);
+    fprintf(stderr, "   -l: list the benchmarks\n");
+    fprintf(stderr, "   -i: number of operations per run\n");
+    fprintf(stderr, "   -r: number of runs (default %u)\n", RUNS);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t iterations = 0;
+    unsigned int runs = RUNS;
+    bool list = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "li:r:")) != -1) {
+        switch (opt) {
+            case 'l':
+                list = true;
+                break;
+            case 'i':
+                iterations = strtoull(optarg, NULL, 0);
+                break;
+            case 'r':
+                runs = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (runs == 0 || argc - optind > 1)
+        usage(argv[0]);
+    const char *filter = optind < argc ? argv[optind] : NULL;
+
+    if (list) {
+        for (unsigned int i = 0; i < sizeof(benches) / sizeof(benches[0]);
+             i++)
+            if (filter == NULL || strstr(benches[i].name, filter) != NULL)
+                printf("%s\n", benches[i].name);
+        return 0;
+    }
+
+    umem_mgr = umem_pool_mgr_alloc_simple(UMEM_POOL_DEPTH);
+    assert(umem_mgr != NULL);
+    udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH, umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, 0, 0);
+    assert(ubuf_mgr != NULL);
+
+    for (unsigned int i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        const struct bench *bench = &benches[i];
+        if (filter != NULL && strstr(bench->name, filter) == NULL)
+            continue;
+
+        uint64_t nb = iterations ? iterations : bench->iterations;
+
+        /* warm up the pools and caches */
+        bench->run(nb / 10);
+
+        uint64_t durations[runs];
+        for (unsigned int run = 0; run < runs; run++) {
+            uint64_t begin = now_ns();
+            bench->run(nb);
+            durations[run] = now_ns() - begin;
+        }
+        qsort(durations, runs, sizeof(uint64_t), compare_u64);
+        double ns = (double)durations[runs / 2] / nb;
+        printf("%-24s %10.1f ns/op %14.0f ops/s\n", bench->name, ns,
+               1e9 / ns);
+    }
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
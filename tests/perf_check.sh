@@ -0,0 +1,121 @@
+#!/bin/sh
+#
+# Runs the benchmarks and compares their results with a stored baseline.
+#
+# Usage: perf_check.sh <baseline> <core_bench> [<ts_bench> <file.ts>]
+#
+# Environment:
+#   PERF_MODE=time|callgrind  measure the time per operation (default), or
+#       the number of instructions per operation with callgrind, which is
+#       deterministic and may be compared across machines
+#   PERF_TOLERANCE=<percent>  allowed regression (default 30)
+#   PERF_UPDATE=1             store the results as the new baseline
+#
+# The baseline is created on the first run. Smaller values are better.
+
+BASELINE="$1"
+CORE_BENCH="$2"
+TS_BENCH="$3"
+BENCH_TS="$4"
+MODE="${PERF_MODE:-time}"
+TOLERANCE="${PERF_TOLERANCE:-30}"
+# number of operations per benchmark under callgrind
+CALLGRIND_ITERATIONS=10000
+
+if test -z "$BASELINE" -o -z "$CORE_BENCH"; then
+	echo "Usage: $0 <baseline> <core_bench> [<ts_bench> <file.ts>]" >&2
+	exit 1
+fi
+
+case "$MODE" in
+time)
+	;;
+callgrind)
+	if ! which valgrind >/dev/null 2>&1; then
+		echo "#### Please install valgrind for callgrind measurements" >&2
+		exit 1
+	fi
+	;;
+*)
+	echo "unknown PERF_MODE $MODE" >&2
+	exit 1
+	;;
+esac
+
+RESULTS="`mktemp perf.XXXXXXXXXX`"
+LOG="`mktemp perf.XXXXXXXXXX`"
+
+# prints the number of instructions executed by a command
+callgrind() {
+	libtool --mode=execute valgrind --tool=callgrind \
+		--callgrind-out-file=/dev/null "$@" > /dev/null 2> "$LOG" ||
+		return 1
+	sed -n 's/.*Collected : *\([0-9]*\).*/\1/p' "$LOG"
+}
+
+fail() {
+	echo "$1" >&2
+	test -s "$LOG" && cat "$LOG" >&2
+	rm -f "$RESULTS" "$LOG"
+	exit 1
+}
+
+# core primitives, "<name> <ns or instructions per operation>"
+if test "$MODE" = time; then
+	"$CORE_BENCH" > "$LOG" || fail "$CORE_BENCH failed"
+	awk '{ print $1, $2 }' "$LOG" >> "$RESULTS"
+else
+	for bench in `"$CORE_BENCH" -l`; do
+		IR=`callgrind "$CORE_BENCH" -r 1 -i $CALLGRIND_ITERATIONS "$bench"` ||
+			fail "$CORE_BENCH $bench failed"
+		echo "$bench $IR $CALLGRIND_ITERATIONS" |
+			awk '{ printf "%s %.1f\n", $1, $2 / $3 }' >> "$RESULTS"
+	done
+fi
+
+# pipelines, "<name> <% of a core per Mbps or instructions per file>"
+if test -n "$TS_BENCH" -a -n "$BENCH_TS" -a -x "$TS_BENCH"; then
+	for mode in demux remux; do
+		FLAGS=
+		test $mode = demux && FLAGS=-d
+		if test "$MODE" = time; then
+			"$TS_BENCH" $FLAGS "$BENCH_TS" > "$LOG" ||
+				fail "$TS_BENCH $FLAGS failed"
+			sed -n "s/^cpu per Mbps: \([0-9.]*\).*/ts_bench_$mode \1/p" \
+				"$LOG" >> "$RESULTS"
+		else
+			IR=`callgrind "$TS_BENCH" $FLAGS -n 1 "$BENCH_TS"` ||
+				fail "$TS_BENCH $FLAGS failed"
+			echo "ts_bench_$mode $IR" >> "$RESULTS"
+		fi
+	done
+fi
+
+if test "$PERF_UPDATE" = 1 -o ! -f "$BASELINE"; then
+	echo "storing $MODE baseline in $BASELINE"
+	cat "$RESULTS"
+	mv "$RESULTS" "$BASELINE"
+	rm -f "$LOG"
+	exit 0
+fi
+
+awk -v tolerance="$TOLERANCE" '
+	NR == FNR { baseline[$1] = $2; next }
+	!($1 in baseline) || baseline[$1] <= 0 {
+		printf "%-24s %12s -> %12s  new\n", $1, "-", $2
+		next
+	}
+	{
+		change = ($2 / baseline[$1] - 1) * 100
+		status = "ok"
+		if (change > tolerance) {
+			status = "REGRESSION"
+			ret = 1
+		}
+		printf "%-24s %12s -> %12s  %+6.1f %%  %s\n", $1, baseline[$1],
+		       $2, change, status
+	}
+	END { exit ret }' "$BASELINE" "$RESULTS"
+RET=$?
+rm -f "$RESULTS" "$LOG"
+exit $RET
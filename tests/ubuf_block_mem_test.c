@@ -261,6 +261,15 @@ int main(int argc, char **argv)
     }
     ubuf_block_stream_clean(&s);
 
+    ubuf_block_stream_init(&s, ubuf1, 0);
+    ubuf_block_stream_fill_bits(&s, 32);
+    assert(ubuf_block_stream_show_zeros(&s) == 15);
+    assert(ubuf_block_stream_show_bits(&s, 32) == 0x00010203);
+    ubuf_block_stream_skip_bits(&s, 20);
+    ubuf_block_stream_fill_bits(&s, 32);
+    assert(ubuf_block_stream_show_bits(&s, 32) == 0x20304050);
+    ubuf_block_stream_clean(&s);
+
     /* test ubuf_block_delete */
     ubase_assert(ubuf_block_delete(ubuf1, 8, 32));
     uint8_t buf[33];
@@ -271,6 +280,50 @@ int main(int argc, char **argv)
         assert(buf[i] == i + 32);
     ubuf_free(ubuf1);
 
+    /* test coalescing of appended segments */
+    ubase_assert(ubuf_block_mem_mgr_set_coalesce(mgr, 8, 16));
+    ubuf1 = ubuf_block_alloc(mgr, 0);
+    assert(ubuf1 != NULL);
+    for (int i = 0; i < 100; i++) {
+        ubuf2 = ubuf_block_alloc(mgr, i == 50 ? 32 : 3);
+        assert(ubuf2 != NULL);
+        wanted = -1;
+        ubase_assert(ubuf_block_write(ubuf2, 0, &wanted, &w));
+        memset(w, i, wanted);
+        ubase_assert(ubuf_block_unmap(ubuf2, 0));
+        ubase_assert(ubuf_block_append(ubuf1, ubuf2));
+    }
+    /* coalesced by runs of 5 small segments */
+    assert(ubuf_block_from_ubuf(ubuf1)->segments < 100 / 2);
+    unsigned int segments = 0;
+    for (struct ubuf *segment = ubuf1; segment != NULL;
+         segment = ubuf_block_from_ubuf(segment)->next_ubuf)
+        segments++;
+    assert(segments == ubuf_block_from_ubuf(ubuf1)->segments);
+    ubase_assert(ubuf_block_size(ubuf1, &size));
+    assert(size == 99 * 3 + 32);
+    uint8_t coalesced[99 * 3 + 32];
+    ubase_assert(ubuf_block_extract(ubuf1, 0, -1, coalesced));
+    for (int i = 0, offset = 0; i < 100; i++)
+        for (int j = 0; j < (i == 50 ? 32 : 3); j++)
+            assert(coalesced[offset++] == i);
+
+    /* alternate reads between two areas of the chain */
+    for (int i = 0; i < 10; i++) {
+        int offset = i % 2 ? 0 : 99 * 3 + 32 - 1 - i;
+        wanted = 1;
+        ubase_assert(ubuf_block_read(ubuf1, offset, &wanted, &r));
+        assert(wanted == 1);
+        assert(r[0] == coalesced[offset]);
+        ubase_assert(ubuf_block_unmap(ubuf1, offset));
+    }
+    ubase_assert(ubuf_block_delete(ubuf1, 0, 3));
+    wanted = 1;
+    ubase_assert(ubuf_block_read(ubuf1, 250, &wanted, &r));
+    assert(r[0] == coalesced[253]);
+    ubase_assert(ubuf_block_unmap(ubuf1, 250));
+    ubuf_free(ubuf1);
+
     ubuf_mgr_release(mgr);
     umem_mgr_release(umem_mgr);
     return 0;
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for ubuf manager for block formats mapping files
+ */
+
+#undef NDEBUG
+
+#include <upipe/upool.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mmap.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define UBUF_POOL_DEPTH     1
+#define FILE_SIZE           65536
+#define UBUF_OFFSET         4097
+#define UBUF_SIZE           16384
+
+int main(int argc, char **argv)
+{
+    char path[] = "ubuf_block_mmap_test.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    unlink(path);
+    uint8_t data[FILE_SIZE];
+    for (int i = 0; i < FILE_SIZE; i++)
+        data[i] = i % 251;
+    assert(write(fd, data, FILE_SIZE) == FILE_SIZE);
+
+    struct ubuf_mgr *mgr = ubuf_block_mmap_mgr_alloc(UBUF_POOL_DEPTH,
+                                                     UBUF_POOL_DEPTH);
+    assert(mgr != NULL);
+
+    /* map an unaligned region of the file */
+    struct ubuf *ubuf1 = ubuf_block_mmap_alloc(mgr, fd, UBUF_OFFSET,
+                                               UBUF_SIZE);
+    assert(ubuf1 != NULL);
+    size_t size;
+    ubase_assert(ubuf_block_size(ubuf1, &size));
+    assert(size == UBUF_SIZE);
+
+    const uint8_t *r;
+    int wanted = -1;
+    ubase_assert(ubuf_block_read(ubuf1, 0, &wanted, &r));
+    assert(wanted == UBUF_SIZE);
+    assert(!memcmp(r, data + UBUF_OFFSET, UBUF_SIZE));
+    ubase_assert(ubuf_block_unmap(ubuf1, 0));
+
+    /* splices share the mapping, which outlives the original ubuf */
+    struct ubuf *ubuf2 = ubuf_block_splice(ubuf1, 188, 188);
+    assert(ubuf2 != NULL);
+    ubuf_free(ubuf1);
+    wanted = -1;
+    ubase_assert(ubuf_block_read(ubuf2, 0, &wanted, &r));
+    assert(wanted == 188);
+    assert(!memcmp(r, data + UBUF_OFFSET + 188, 188));
+    ubase_assert(ubuf_block_unmap(ubuf2, 0));
+
+    /* the mapping is private */
+    uint8_t *w;
+    wanted = 1;
+    ubase_assert(ubuf_block_write(ubuf2, 0, &wanted, &w));
+    w[0] = ~w[0];
+    ubase_assert(ubuf_block_unmap(ubuf2, 0));
+    uint8_t c;
+    assert(pread(fd, &c, 1, UBUF_OFFSET + 188) == 1);
+    assert(c == data[UBUF_OFFSET + 188]);
+    ubuf_free(ubuf2);
+
+    /* anonymous mappings */
+    ubuf1 = ubuf_block_alloc(mgr, UBUF_SIZE);
+    assert(ubuf1 != NULL);
+    wanted = -1;
+    ubase_assert(ubuf_block_write(ubuf1, 0, &wanted, &w));
+    assert(wanted == UBUF_SIZE);
+    memset(w, 0x47, UBUF_SIZE);
+    ubase_assert(ubuf_block_unmap(ubuf1, 0));
+    ubuf2 = ubuf_block_mmap_alloc(mgr, fd, 0, 188);
+    assert(ubuf2 != NULL);
+    ubase_assert(ubuf_block_append(ubuf1, ubuf2));
+    ubase_assert(ubuf_block_size(ubuf1, &size));
+    assert(size == UBUF_SIZE + 188);
+    uint8_t buf[189];
+    ubase_assert(ubuf_block_extract(ubuf1, UBUF_SIZE - 1, 189, buf));
+    assert(buf[0] == 0x47);
+    assert(!memcmp(buf + 1, data, 188));
+    ubuf_free(ubuf1);
+
+    /* pools */
+    struct upool_stats ubuf_stats, shared_stats;
+    ubase_assert(ubuf_mgr_get_pool_stats(mgr, &ubuf_stats, &shared_stats));
+    assert(ubuf_stats.length == UBUF_POOL_DEPTH);
+    assert(ubuf_stats.depth == UBUF_POOL_DEPTH);
+    assert(shared_stats.depth == UBUF_POOL_DEPTH);
+    ubase_assert(ubuf_mgr_resize_pool(mgr, 0, 0));
+    ubase_assert(ubuf_mgr_get_pool_stats(mgr, &ubuf_stats, &shared_stats));
+    assert(ubuf_stats.depth == 0);
+    assert(shared_stats.depth == 0);
+    ubuf_mgr_vacuum(mgr);
+
+    ubuf_mgr_release(mgr);
+    close(fd);
+    return 0;
+}
@@ -44,6 +44,7 @@
 #define UBUF_APPEND         2
 #define UBUF_ALIGN          16
 #define UBUF_ALIGN_HOFFSET  0
+#define UBUF_CACHE_LINE     64
 
 static void fill_in(struct ubuf *ubuf)
 {
@@ -144,6 +145,39 @@ int main(int argc, char **argv)
     ubase_nassert(ubuf_pic_plane_write(ubuf1, "y8", 0, 0, -1, -1, &w));
     ubuf_free(ubuf2);
 
+    /* views */
+    assert(ubuf_pic_splice(ubuf1, 1, 0, -1, -1) == NULL);
+    assert(ubuf_pic_splice(ubuf1, 20, 0, 16, -1) == NULL);
+    assert(ubuf_pic_splice(ubuf1, -2, 0, -1, -1) == NULL);
+    ubuf2 = ubuf_pic_splice(ubuf1, 4, 2, 16, 8);
+    assert(ubuf2 != NULL);
+    ubase_assert(ubuf_pic_size(ubuf2, &hsize, &vsize, &macropixel));
+    assert(hsize == 16);
+    assert(vsize == 8);
+    ubase_assert(ubuf_pic_plane_read(ubuf2, "y8", 0, 0, -1, -1, &r));
+    assert(r[0] == 1 + 2 * 32 + 4);
+    ubase_assert(ubuf_pic_plane_unmap(ubuf2, "y8", 0, 0, -1, -1));
+    ubase_assert(ubuf_pic_plane_read(ubuf2, "u8", 0, 0, -1, -1, &r));
+    assert(r[0] == 1 + 16 + 2);
+    ubase_assert(ubuf_pic_plane_unmap(ubuf2, "u8", 0, 0, -1, -1));
+    ubase_nassert(ubuf_pic_plane_write(ubuf2, "y8", 0, 0, -1, -1, &w));
+    ubase_nassert(ubuf_pic_plane_write(ubuf1, "y8", 0, 0, -1, -1, &w));
+    ubuf_free(ubuf2);
+
+    /* a view outlives its parent */
+    struct ubuf *ubuf3 = ubuf_pic_copy(mgr, ubuf1, 0, 0, -1, -1);
+    assert(ubuf3 != NULL);
+    ubuf2 = ubuf_pic_splice(ubuf3, 0, 4, -1, -1);
+    assert(ubuf2 != NULL);
+    ubuf_free(ubuf3);
+    ubase_assert(ubuf_pic_size(ubuf2, &hsize, &vsize, &macropixel));
+    assert(hsize == 32);
+    assert(vsize == 28);
+    ubase_assert(ubuf_pic_plane_write(ubuf2, "y8", 0, 0, -1, -1, &w));
+    assert(w[0] == 1 + 4 * 32);
+    ubase_assert(ubuf_pic_plane_unmap(ubuf2, "y8", 0, 0, -1, -1));
+    ubuf_free(ubuf2);
+
     ubase_nassert(ubuf_pic_resize(ubuf1, 1, 0, 31, 32));
     ubase_nassert(ubuf_pic_resize(ubuf1, -1, 0, 33, 32));
     ubase_nassert(ubuf_pic_resize(ubuf1, 0, 1, 32, 31));
@@ -266,6 +300,41 @@ int main(int argc, char **argv)
 
     ubuf_free(ubuf1);
 
+    ubuf_mgr_release(mgr);
+
+    /* cache-aligned planar I420 */
+    mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr, 1,
+                                 UBUF_PREPEND, UBUF_APPEND,
+                                 UBUF_PREPEND, UBUF_APPEND,
+                                 UBUF_ALIGN, UBUF_ALIGN_HOFFSET);
+    assert(mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_set_cache_aligned(mgr));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(mgr, "u8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(mgr, "v8", 2, 2, 1));
+
+    ubuf1 = ubuf_pic_alloc(mgr, 32, 32);
+    assert(ubuf1 != NULL);
+    /* margins are rounded up to a cache line in the chroma planes */
+    ubase_assert(ubuf_pic_resize(ubuf1, -UBUF_CACHE_LINE * 2, 0, -1, -1));
+    ubase_nassert(ubuf_pic_resize(ubuf1, -2, 0, -1, -1));
+
+    chroma = NULL;
+    while (ubase_check(ubuf_pic_plane_iterate(ubuf1, &chroma)) &&
+           chroma != NULL) {
+        size_t stride;
+        ubase_assert(ubuf_pic_plane_size(ubuf1, chroma, &stride, NULL, NULL,
+                                         NULL));
+        assert(!(stride % UBUF_CACHE_LINE));
+        ubase_assert(ubuf_pic_plane_read(ubuf1, chroma, 0, 0, -1, -1, &r));
+        assert(!((uintptr_t)r % UBUF_CACHE_LINE));
+        ubase_assert(ubuf_pic_plane_unmap(ubuf1, chroma, 0, 0, -1, -1));
+        ubase_assert(ubuf_pic_plane_read(ubuf1, chroma, 0, 2, -1, -1, &r));
+        assert(!((uintptr_t)r % UBUF_CACHE_LINE));
+        ubase_assert(ubuf_pic_plane_unmap(ubuf1, chroma, 0, 2, -1, -1));
+    }
+    ubuf_free(ubuf1);
+
     ubuf_mgr_release(mgr);
     umem_mgr_release(umem_mgr);
     return 0;
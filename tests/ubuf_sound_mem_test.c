@@ -203,6 +203,30 @@ int main(int argc, char **argv)
 
     ubuf_free(ubuf1);
 
+    ubuf_mgr_release(mgr);
+
+    /* planes padded to whole SIMD vectors */
+    mgr = ubuf_sound_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr,
+                                   2, 16);
+    assert(mgr != NULL);
+    ubase_assert(ubuf_sound_mem_mgr_set_vector_size(mgr, 64));
+    ubase_assert(ubuf_sound_mem_mgr_add_plane(mgr, "l"));
+    ubase_assert(ubuf_sound_mem_mgr_add_plane(mgr, "r"));
+
+    ubuf1 = ubuf_sound_alloc(mgr, 33);
+    assert(ubuf1 != NULL);
+    ubase_assert(ubuf_sound_plane_read_uint8_t(ubuf1, "l", 0, -1, &r));
+    assert(!((uintptr_t)r % 64));
+    for (int i = 66; i < 128; i++)
+        assert(r[i] == 0);
+    ubase_assert(ubuf_sound_plane_unmap(ubuf1, "l", 0, -1));
+    ubase_assert(ubuf_sound_plane_read_uint8_t(ubuf1, "r", 0, -1, &r));
+    assert(!((uintptr_t)r % 64));
+    for (int i = 66; i < 128; i++)
+        assert(r[i] == 0);
+    ubase_assert(ubuf_sound_plane_unmap(ubuf1, "r", 0, -1));
+    ubuf_free(ubuf1);
+
     ubuf_mgr_release(mgr);
     umem_mgr_release(umem_mgr);
     return 0;
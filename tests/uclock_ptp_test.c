@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uclock_ptp implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/uclock_ptp.h>
+#include <upipe/config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#ifdef UPIPE_HAVE_LINUX_PTP_CLOCK_H
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/ptp_clock.h>
+
+/* The calls of uclock_ptp to ioctl and clock_gettime are redirected here,
+ * so that a regular file plays the part of a PHC whose time is a function
+ * of the fake local clock. */
+
+/** number of 27 MHz ticks the fake local clock advances at each read */
+#define FAKE_STEP 1000
+/** maximum difference between the PHC and its interpolation */
+#define FAKE_TOLERANCE ((int64_t)UCLOCK_FREQ / 1000)
+
+static struct stat fake_stat;
+static int fake_fd = -1;
+static bool fake_fail = false;
+static uint64_t fake_local = UCLOCK_FREQ;
+static uint64_t fake_offset = 42 * UCLOCK_FREQ;
+
+/* the PHC runs 100 ppm faster than the local clock */
+static uint64_t fake_phc(void)
+{
+    return fake_offset + fake_local + fake_local / 10000;
+}
+
+static uint64_t fake_now(struct uclock *uclock)
+{
+    fake_local += FAKE_STEP;
+    return fake_local;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+
+    struct stat st;
+    if (request == PTP_CLOCK_GETCAPS && fstat(fd, &st) == 0 &&
+        st.st_dev == fake_stat.st_dev && st.st_ino == fake_stat.st_ino) {
+        memset(arg, 0, sizeof(struct ptp_clock_caps));
+        fake_fd = fd;
+        return 0;
+    }
+    return syscall(SYS_ioctl, fd, request, arg);
+}
+
+int clock_gettime(clockid_t clockid, struct timespec *ts)
+{
+    if (fake_fd != -1 && clockid == ((~(clockid_t)fake_fd << 3) | 3)) {
+        if (fake_fail)
+            return -1;
+        uint64_t phc = fake_phc();
+        ts->tv_sec = phc / UCLOCK_FREQ;
+        ts->tv_nsec = (phc % UCLOCK_FREQ) * UINT64_C(1000000000) /
+                      UCLOCK_FREQ;
+        return 0;
+    }
+    return syscall(SYS_clock_gettime, clockid, ts);
+}
+
+/* checks the interpolation against the fake PHC during a given local time */
+static void fake_check(struct uclock *uclock, uint64_t duration)
+{
+    uint64_t end = fake_local + duration;
+    uint64_t last = uclock_now(uclock);
+    while (fake_local < end) {
+        uint64_t now = uclock_now(uclock);
+        assert(now >= last);
+        int64_t error = now - fake_phc();
+        assert(error < FAKE_TOLERANCE && error > -FAKE_TOLERANCE);
+        last = now;
+    }
+}
+
+static void fake_test(void)
+{
+    struct uclock local;
+    local.refcount = NULL;
+    local.uclock_now = fake_now;
+
+    char path[] = "/tmp/uclock_ptp_test.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    assert(fstat(fd, &fake_stat) == 0);
+
+    /* a read error during the calibration */
+    fake_fail = true;
+    assert(uclock_ptp_alloc(&local, path) == NULL);
+    fake_fail = false;
+
+    struct uclock *uclock = uclock_ptp_alloc(&local, path);
+    assert(uclock != NULL);
+    fake_check(uclock, 10 * UCLOCK_FREQ);
+    printf("PHC interpolation\n");
+
+    /* the PHC jumps, and is followed at the next resynchronization */
+    fake_offset += UCLOCK_FREQ;
+    uint64_t before = uclock_now(uclock);
+    int64_t error = before - fake_phc();
+    assert(error < -FAKE_TOLERANCE);
+    uint64_t end = fake_local + UCLOCK_FREQ;
+    while (fake_local < end)
+        uclock_now(uclock);
+    fake_check(uclock, UCLOCK_FREQ);
+    printf("PHC step\n");
+
+    /* the PHC cannot be read, the dates keep being extrapolated */
+    fake_fail = true;
+    fake_check(uclock, UCLOCK_FREQ);
+    fake_fail = false;
+    fake_check(uclock, UCLOCK_FREQ);
+    printf("PHC read error\n");
+
+    uclock_release(uclock);
+    fake_fd = -1;
+    close(fd);
+    unlink(path);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef UPIPE_HAVE_LINUX_PTP_CLOCK_H
+    fake_test();
+#endif
+
+    struct uclock *local = uclock_std_alloc(UCLOCK_FLAG_TSC);
+    assert(local);
+
+    assert(uclock_ptp_alloc(local, "/nonexistent/ptp") == NULL);
+    /* not a PHC */
+    assert(uclock_ptp_alloc(local, "/dev/null") == NULL);
+
+    const char *device = argc > 1 ? argv[1] : "/dev/ptp0";
+    struct uclock *uclock = uclock_ptp_alloc(local, device);
+    if (uclock == NULL) {
+        printf("no PHC on %s, skipping\n", device);
+        uclock_release(local);
+        return 0;
+    }
+
+    uint64_t last = uclock_now(uclock);
+    for (int i = 0; i < 1000000; i++) {
+        uint64_t now = uclock_now(uclock);
+        assert(now >= last);
+        last = now;
+    }
+    printf("PHC: %"PRIu64"\n", last);
+
+    uclock_release(uclock);
+    uclock_release(local);
+    return 0;
+}
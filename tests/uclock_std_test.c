@@ -34,6 +34,7 @@
 #include <inttypes.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #define UREF_POOL_DEPTH 1
 
@@ -50,6 +51,30 @@ int main(int argc, char **argv)
     assert(now_cal);
     printf("Now: %"PRIu64"\n", now);
     printf("Cal: %"PRIu64"\n", now_cal);
+
+    /* TSC-based clock must stay monotonic and close to the system clock,
+     * across recalibrations */
+    struct uclock *uclock_tsc = uclock_std_alloc(UCLOCK_FLAG_TSC);
+    assert(uclock_tsc);
+    for (int j = 0; j < 4; j++) {
+        uint64_t last = uclock_now(uclock_tsc);
+        for (int i = 0; i < 100000; i++) {
+            uint64_t now_tsc = uclock_now(uclock_tsc);
+            assert(now_tsc >= last);
+            last = now_tsc;
+        }
+        now = uclock_now(uclock);
+        uint64_t now_tsc = uclock_now(uclock_tsc);
+        printf("TSC: %"PRIu64" (%"PRId64")\n", now_tsc,
+               (int64_t)(now_tsc - now));
+        assert(now_tsc + UCLOCK_FREQ / 100 > now);
+        assert(now_tsc < now + UCLOCK_FREQ / 100);
+
+        struct timespec wait = { .tv_sec = 0, .tv_nsec = 400000000 };
+        nanosleep(&wait, NULL);
+    }
+
     uclock_release(uclock);
     uclock_release(uclock_cal);
+    uclock_release(uclock_tsc);
 }
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for ucpu
+ */
+
+#undef NDEBUG
+
+#include <upipe/ucpu.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/** kernel type under test */
+typedef unsigned int (*sum_func)(const uint8_t *, unsigned int);
+
+/** portable version */
+static unsigned int sum_c(const uint8_t *p, unsigned int size)
+{
+    unsigned int sum = 0;
+    while (size--)
+        sum += *p++;
+    return sum;
+}
+
+/** version compiled for a newer instruction set */
+UCPU_TARGET("avx2")
+static unsigned int sum_avx2(const uint8_t *p, unsigned int size)
+{
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < size; i++)
+        sum += p[i];
+    return sum;
+}
+
+/** version requiring a feature which is never detected together with the
+ * others */
+static unsigned int sum_impossible(const uint8_t *p, unsigned int size)
+{
+    assert(0);
+    return 0;
+}
+
+static const struct ucpu_kernel sum_kernels[] = {
+    { UCPU_X86_AVX2 | UCPU_ARM_NEON, sum_impossible },
+    { UCPU_X86_AVX2, sum_avx2 },
+    { 0, sum_c }
+};
+
+int main(int argc, char **argv)
+{
+    uint8_t buffer[1000];
+    for (unsigned int i = 0; i < sizeof(buffer); i++)
+        buffer[i] = i;
+    unsigned int expected = sum_c(buffer, sizeof(buffer));
+
+    uint32_t flags = ucpu_get_flags();
+    printf("CPU flags: 0x%"PRIx32"\n", flags);
+#ifdef __x86_64__
+    assert(flags & UCPU_X86_SSE2);
+#endif
+#ifdef __aarch64__
+    assert(flags & UCPU_ARM_NEON);
+#endif
+    assert(!((flags & UCPU_X86_AVX2) && (flags & UCPU_ARM_NEON)));
+
+    sum_func sum = ucpu_select(sum_kernels);
+    assert(sum == ((flags & UCPU_X86_AVX2) ? sum_avx2 : sum_c));
+    assert(sum(buffer, sizeof(buffer)) == expected);
+
+    /* restricted features */
+    ucpu_set_mask(0);
+    assert(ucpu_get_flags() == 0);
+    sum = ucpu_select(sum_kernels);
+    assert(sum == sum_c);
+
+    ucpu_set_mask(UCPU_X86_AVX2);
+    assert(ucpu_get_flags() == (flags & UCPU_X86_AVX2));
+
+    ucpu_set_mask(UINT32_MAX);
+    assert(ucpu_get_flags() == flags);
+    return 0;
+}
@@ -125,6 +125,16 @@ static void *test_thread(void *_thread)
     return NULL;
 }
 
+static void *test_blocking_thread(void *unused)
+{
+    for (unsigned int i = 0; i < nb_loops / 2; i++) {
+        udeal_wait(&udeal);
+        counter++;
+        udeal_release(&udeal);
+    }
+    return NULL;
+}
+
 int main(int argc, char **argv)
 {
     if (argc > 1)
@@ -133,15 +143,18 @@ int main(int argc, char **argv)
     assert(udeal_init(&udeal));
 
     struct thread threads[2];
+    pthread_t blocking;
     threads[0].thread = 0;
     threads[1].thread = 1;
     assert(pthread_create(&threads[0].id, NULL, test_thread, &threads[0]) == 0);
     assert(pthread_create(&threads[1].id, NULL, test_thread, &threads[1]) == 0);
+    assert(pthread_create(&blocking, NULL, test_blocking_thread, NULL) == 0);
 
     assert(!pthread_join(threads[0].id, NULL));
     assert(!pthread_join(threads[1].id, NULL));
+    assert(!pthread_join(blocking, NULL));
 
-    assert(counter == nb_loops);
+    assert(counter == nb_loops + nb_loops / 2);
     udeal_clean(&udeal);
 
     return 0;
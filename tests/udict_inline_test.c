@@ -110,18 +110,153 @@ int main(int argc, char **argv)
     ubase_assert(udict_get_rational(udict1, &r, UDICT_TYPE_RATIONAL, "x.ar"));
     assert(r.num == 64 && r.den == 45);
 
+    /* lookups served by the index after a deletion */
+    ubase_assert(udict_delete(udict1, UDICT_TYPE_RATIONAL, "x.ar"));
+    ubase_nassert(udict_get_rational(udict1, &r, UDICT_TYPE_RATIONAL, "x.ar"));
+    ubase_assert(udict_get_bool(udict1, &b, UDICT_TYPE_BOOL, "x.truc"));
+    assert(b);
+    ubase_assert(udict_get_int(udict1, &d, UDICT_TYPE_INT, "x.date"));
+    assert(d == INT64_MAX);
+    ubase_assert(udict_get_int(udict1, &d, UDICT_TYPE_INT, "x.date"));
+    assert(d == INT64_MAX);
+    ubase_nassert(udict_get_int(udict1, &d, UDICT_TYPE_INT, "x.dote"));
+    ubase_assert(udict_set_rational(udict1, rational, UDICT_TYPE_RATIONAL, "x.ar"));
+    ubase_assert(udict_get_rational(udict1, &r, UDICT_TYPE_RATIONAL, "x.ar"));
+    assert(r.num == 64 && r.den == 45);
+
     udict_dump(udict1, uprobe);
 
     struct udict *udict2 = udict_dup(udict1);
     assert(udict2 != NULL);
     udict_dump(udict2, uprobe);
+    assert(udict_hash(udict1) != 0);
+    assert(udict_hash(udict2) == udict_hash(udict1));
+    assert(!udict_cmp(udict1, udict2));
+
+    /* writing to a duplicate doesn't affect the original */
+    ubase_assert(udict_set_bool(udict2, false, UDICT_TYPE_BOOL, "x.truc"));
+    assert(udict_cmp(udict1, udict2));
+    ubase_assert(udict_delete(udict2, UDICT_TYPE_INT, "x.date"));
+    ubase_assert(udict_get_bool(udict2, &b, UDICT_TYPE_BOOL, "x.truc"));
+    assert(!b);
+    ubase_nassert(udict_get_int(udict2, &d, UDICT_TYPE_INT, "x.date"));
+    ubase_assert(udict_get_bool(udict1, &b, UDICT_TYPE_BOOL, "x.truc"));
+    assert(b);
+    ubase_assert(udict_get_int(udict1, &d, UDICT_TYPE_INT, "x.date"));
+    assert(d == INT64_MAX);
     udict_free(udict2);
 
     udict2 = udict_copy(mgr, udict1);
     assert(udict2 != NULL);
     udict_dump(udict2, uprobe);
+    assert(!udict_cmp(udict1, udict2));
     udict_free(udict2);
 
+    /* the hash doesn't depend on the order of the attributes */
+    udict2 = udict_alloc(mgr, 0);
+    struct udict *udict3 = udict_alloc(mgr, 0);
+    assert(udict2 != NULL && udict3 != NULL);
+    ubase_assert(udict_set_unsigned(udict2, 1, UDICT_TYPE_UNSIGNED, "x.a"));
+    ubase_assert(udict_set_unsigned(udict2, 2, UDICT_TYPE_UNSIGNED, "x.b"));
+    ubase_assert(udict_set_unsigned(udict3, 2, UDICT_TYPE_UNSIGNED, "x.b"));
+    ubase_assert(udict_set_unsigned(udict3, 1, UDICT_TYPE_UNSIGNED, "x.a"));
+    assert(!udict_cmp(udict2, udict3));
+    ubase_assert(udict_set_unsigned(udict3, 3, UDICT_TYPE_UNSIGNED, "x.a"));
+    assert(udict_cmp(udict2, udict3));
+    ubase_assert(udict_delete(udict3, UDICT_TYPE_UNSIGNED, "x.a"));
+    assert(udict_cmp(udict2, udict3));
+    ubase_assert(udict_set_unsigned(udict3, 1, UDICT_TYPE_UNSIGNED, "x.a"));
+    assert(!udict_cmp(udict2, udict3));
+
+    /* equal hashes are not enough, as in case of a collision */
+    ubase_assert(udict_set_unsigned(udict3, 3, UDICT_TYPE_UNSIGNED, "x.a"));
+    udict2->hash = udict3->hash = 42;
+    assert(udict_cmp(udict2, udict3));
+    udict_free(udict3);
+    udict_free(udict2);
+
+    /* registered keys */
+    enum udict_type key1, key2, key3;
+    udict3 = udict_alloc(mgr, 0);
+    assert(udict3 != NULL);
+    ubase_assert(udict_set_unsigned(udict3, 41, UDICT_TYPE_UNSIGNED,
+                                    "x.counter"));
+    ubase_assert(udict_key_register("x.counter", UDICT_TYPE_UNSIGNED, &key1));
+    ubase_assert(udict_key_register("x.label", UDICT_TYPE_STRING, &key2));
+    ubase_assert(udict_key_register("x.counter", UDICT_TYPE_UNSIGNED, &key3));
+    assert(key1 >= UDICT_TYPE_KEY);
+    assert(key1 != key2);
+    assert(key1 == key3);
+    ubase_assert(udict_key_find("x.label", UDICT_TYPE_STRING, &key3));
+    assert(key3 == key2);
+    ubase_nassert(udict_key_find("x.label", UDICT_TYPE_INT, &key3));
+    ubase_nassert(udict_key_register(NULL, UDICT_TYPE_INT, &key3));
+
+    udict2 = udict_alloc(mgr, 0);
+    assert(udict2 != NULL);
+    ubase_assert(udict_set_unsigned(udict2, 42, key1, NULL));
+    ubase_assert(udict_set_string(udict2, SALUTATION, key2, NULL));
+    ubase_assert(udict_set_bool(udict2, true, UDICT_TYPE_BOOL, "x.truc"));
+    ubase_assert(udict_get_unsigned(udict2, &u, key1, NULL));
+    assert(u == 42);
+    ubase_assert(udict_get_string(udict2, &string, key2, NULL));
+    assert(!strcmp(string, SALUTATION));
+    ubase_assert(udict_get_unsigned(udict2, &u, UDICT_TYPE_UNSIGNED,
+                                    "x.counter"));
+    assert(u == 42);
+    ubase_assert(udict_set_string(udict2, "bar", UDICT_TYPE_STRING,
+                                  "x.label"));
+    ubase_assert(udict_get_string(udict2, &string, key2, NULL));
+    assert(!strcmp(string, "bar"));
+    ubase_assert(udict_set_string(udict2, SALUTATION, key2, NULL));
+
+    /* an entry set by name before the registration is found by its key,
+     * and replaced by a single keyed entry */
+    ubase_assert(udict_get_unsigned(udict3, &u, key1, NULL));
+    assert(u == 41);
+    ubase_assert(udict_set_unsigned(udict3, 43, key1, NULL));
+    ubase_assert(udict_get_unsigned(udict3, &u, UDICT_TYPE_UNSIGNED,
+                                    "x.counter"));
+    assert(u == 43);
+    ubase_assert(udict_delete(udict3, UDICT_TYPE_UNSIGNED, "x.counter"));
+    ubase_nassert(udict_get_unsigned(udict3, &u, key1, NULL));
+    ubase_nassert(udict_get_unsigned(udict3, &u, UDICT_TYPE_UNSIGNED,
+                                     "x.counter"));
+    udict_free(udict3);
+
+    const char *name;
+    enum udict_type base_type;
+    ubase_assert(udict_name(udict2, key2, &name, &base_type));
+    assert(!strcmp(name, "x.label"));
+    assert(base_type == UDICT_TYPE_STRING);
+    ubase_assert(udict_delete(udict2, key1, NULL));
+    ubase_nassert(udict_get_unsigned(udict2, &u, key1, NULL));
+    ubase_nassert(udict_get_unsigned(udict2, &u, UDICT_TYPE_UNSIGNED,
+                                     "x.counter"));
+    ubase_assert(udict_get_bool(udict2, &b, UDICT_TYPE_BOOL, "x.truc"));
+    ubase_nassert(udict_set_unsigned(udict2, 42, UDICT_TYPE_KEY + 100, NULL));
+    udict_free(udict2);
+
+    /* fill the registry, every key stays found by name */
+    static char names[UDICT_KEY_MAX][16];
+    unsigned int nb_names;
+    for (nb_names = 0; nb_names < UDICT_KEY_MAX; nb_names++) {
+        snprintf(names[nb_names], sizeof(names[nb_names]), "y.%u", nb_names);
+        if (!ubase_check(udict_key_register(names[nb_names],
+                                            UDICT_TYPE_UNSIGNED, &key3)))
+            break;
+    }
+    assert(nb_names == UDICT_KEY_MAX - 2);
+    for (unsigned int i = 0; i < nb_names; i++) {
+        ubase_assert(udict_key_find(names[i], UDICT_TYPE_UNSIGNED, &key3));
+        ubase_assert(udict_key_name(key3, &name, &base_type));
+        assert(name == names[i]);
+    }
+    ubase_assert(udict_key_find("x.counter", UDICT_TYPE_UNSIGNED, &key3));
+    assert(key3 == key1);
+    ubase_nassert(udict_key_find("y.counter", UDICT_TYPE_UNSIGNED, &key3));
+    ubase_nassert(udict_key_find("y.0", UDICT_TYPE_STRING, &key3));
+
     udict_free(udict1);
     udict_mgr_release(mgr);
 
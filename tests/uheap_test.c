@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short unit tests for uheap (binary min-heap)
+ *
+ * When run with an argument, it also prints the cost of selecting the
+ * earliest of n inputs, as done by the TS join, for various values of n.
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uheap.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#define MAX_NODES 1024
+#define BENCH_ITERATIONS 1000000
+
+struct elem {
+    struct uheap_node node;
+    unsigned int id;
+};
+
+static struct elem elems[MAX_NODES];
+static uint8_t extra[uheap_sizeof(MAX_NODES)];
+
+UBASE_FROM_TO(elem, uheap_node, node, node)
+
+static void check_sorted(struct uheap *uheap, unsigned int count)
+{
+    uint64_t last = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        struct uheap_node *node = uheap_pop(uheap);
+        assert(node != NULL);
+        assert(!uheap_node_queued(node));
+        assert(node->key >= last);
+        last = node->key;
+    }
+    assert(uheap_pop(uheap) == NULL);
+    assert(uheap_count(uheap) == 0);
+}
+
+static void bench(unsigned int n)
+{
+    struct uheap uheap;
+    uheap_init(&uheap, n, extra);
+    uint64_t date = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        uheap_node_init(&elems[i].node);
+        assert(uheap_push(&uheap, &elems[i].node, date + rand() % 1000));
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        struct uheap_node *node = uheap_peek(&uheap);
+        date = node->key;
+        uheap_update(&uheap, node, date + rand() % 1000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uint64_t ns = (end.tv_sec - start.tv_sec) * UINT64_C(1000000000) +
+                  end.tv_nsec - start.tv_nsec;
+    printf("%4u inputs: %.1f ns per packet\n", n,
+           (double)ns / BENCH_ITERATIONS);
+}
+
+int main(int argc, char **argv)
+{
+    struct uheap uheap;
+    uheap_init(&uheap, MAX_NODES, extra);
+    assert(uheap_peek(&uheap) == NULL);
+
+    for (unsigned int i = 0; i < MAX_NODES; i++) {
+        uheap_node_init(&elems[i].node);
+        elems[i].id = i;
+        assert(!uheap_node_queued(&elems[i].node));
+    }
+
+    /* push in random order, pop in key order */
+    for (unsigned int i = 0; i < MAX_NODES; i++)
+        assert(uheap_push(&uheap, &elems[i].node, rand() % 4096));
+    assert(uheap_count(&uheap) == MAX_NODES);
+    struct uheap_node node;
+    uheap_node_init(&node);
+    assert(!uheap_push(&uheap, &node, 0));
+    check_sorted(&uheap, MAX_NODES);
+
+    /* peek always returns the lowest key */
+    assert(uheap_push(&uheap, &elems[0].node, 10));
+    assert(uheap_push(&uheap, &elems[1].node, 5));
+    assert(uheap_push(&uheap, &elems[2].node, 20));
+    assert(elem_from_node(uheap_peek(&uheap))->id == 1);
+
+    /* updates move nodes both ways */
+    uheap_update(&uheap, &elems[1].node, 30);
+    assert(elem_from_node(uheap_peek(&uheap))->id == 0);
+    uheap_update(&uheap, &elems[2].node, 1);
+    assert(elem_from_node(uheap_peek(&uheap))->id == 2);
+
+    /* removal from the middle */
+    uheap_remove(&uheap, &elems[0].node);
+    assert(!uheap_node_queued(&elems[0].node));
+    assert(uheap_count(&uheap) == 2);
+    assert(elem_from_node(uheap_pop(&uheap))->id == 2);
+    assert(elem_from_node(uheap_pop(&uheap))->id == 1);
+    assert(uheap_pop(&uheap) == NULL);
+
+    /* random mix of operations */
+    for (unsigned int i = 0; i < MAX_NODES; i++)
+        assert(uheap_push(&uheap, &elems[i].node, rand() % 4096));
+    for (unsigned int i = 0; i < MAX_NODES; i += 3)
+        uheap_remove(&uheap, &elems[i].node);
+    for (unsigned int i = 1; i < MAX_NODES; i += 3)
+        uheap_update(&uheap, &elems[i].node, rand() % 4096);
+    check_sorted(&uheap, MAX_NODES - (MAX_NODES + 2) / 3);
+
+    /* resize keeps the contents */
+    static uint8_t extra2[uheap_sizeof(2 * MAX_NODES)];
+    uheap_init(&uheap, 2, extra2);
+    assert(uheap_push(&uheap, &elems[0].node, 2));
+    assert(uheap_push(&uheap, &elems[1].node, 1));
+    assert(!uheap_push(&uheap, &elems[2].node, 0));
+    uheap_resize(&uheap, 3, extra2);
+    assert(uheap_push(&uheap, &elems[2].node, 0));
+    check_sorted(&uheap, 3);
+
+    if (argc > 1)
+        for (unsigned int n = 8; n <= MAX_NODES; n *= 2)
+            bench(n);
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for ulifo64
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/ulifo64.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <assert.h>
+
+/* deeper than a ulifo may be */
+#define ULIFO64_DEPTH 100000
+#define NB_THREADS 4
+#define NB_LOOPS 200000
+/** more threads than there are sets of counters */
+#define NB_MANY_THREADS (ULIFO64_THREADS + 4)
+
+static struct ulifo64 ulifo;
+static pthread_barrier_t barrier;
+
+static void *thread(void *unused)
+{
+    for (unsigned int i = 0; i < NB_LOOPS; i++) {
+        void *opaque = ulifo64_pop(&ulifo, void *);
+        assert(opaque != NULL);
+        assert(ulifo64_push(&ulifo, opaque));
+    }
+    return NULL;
+}
+
+static void *many_thread(void *set_p)
+{
+    void *opaque = ulifo64_pop(&ulifo, void *);
+    assert(opaque != NULL);
+    assert(ulifo64_push(&ulifo, opaque));
+    *(unsigned int *)set_p = ulifo64_thread - 1;
+    /* keep the set owned until all threads are registered */
+    pthread_barrier_wait(&barrier);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct ulifo64_stats stats;
+    uint8_t *extra = malloc(ulifo64_sizeof(ULIFO64_DEPTH));
+    uint32_t *elems = malloc(sizeof(uint32_t) * ULIFO64_DEPTH);
+    assert(extra != NULL);
+    assert(elems != NULL);
+    ulifo64_init(&ulifo, ULIFO64_DEPTH, extra);
+    assert((uintptr_t)ulifo.counters % ULIFO64_CACHE_LINE == 0);
+
+    assert(ulifo64_pop(&ulifo, uint32_t *) == NULL);
+    for (uint32_t i = 0; i < ULIFO64_DEPTH; i++) {
+        elems[i] = i;
+        assert(ulifo64_push(&ulifo, &elems[i]));
+    }
+    assert(!ulifo64_push(&ulifo, &elems[0]));
+
+    assert(ulifo64_pop(&ulifo, uint32_t *) == &elems[ULIFO64_DEPTH - 1]);
+    assert(ulifo64_shrink(&ulifo));
+    assert(!ulifo64_push(&ulifo, &elems[ULIFO64_DEPTH - 1]));
+    assert(ulifo64_grow(&ulifo));
+    assert(!ulifo64_grow(&ulifo));
+    assert(ulifo64_push(&ulifo, &elems[ULIFO64_DEPTH - 1]));
+
+    ulifo64_get_stats(&ulifo, &stats);
+    assert(stats.pushes == ULIFO64_DEPTH + 1);
+    assert(stats.pops == 1);
+    assert(stats.misses == 1);
+    assert(stats.overflows == 2);
+
+    pthread_t threads[NB_THREADS];
+    for (unsigned int i = 0; i < NB_THREADS; i++)
+        assert(pthread_create(&threads[i], NULL, thread, NULL) == 0);
+    for (unsigned int i = 0; i < NB_THREADS; i++)
+        assert(pthread_join(threads[i], NULL) == 0);
+
+    ulifo64_get_stats(&ulifo, &stats);
+    printf("pushes %"PRIu64" pops %"PRIu64"\n", stats.pushes, stats.pops);
+    assert(stats.pushes == ULIFO64_DEPTH + 1 + NB_THREADS * NB_LOOPS);
+    assert(stats.pops == 1 + NB_THREADS * NB_LOOPS);
+
+    /* the main thread owns a set, the others are given the remaining sets
+     * or share the last one */
+    unsigned int sets[NB_MANY_THREADS];
+    pthread_t many_threads[NB_MANY_THREADS];
+    assert(pthread_barrier_init(&barrier, NULL, NB_MANY_THREADS) == 0);
+    for (unsigned int i = 0; i < NB_MANY_THREADS; i++)
+        assert(pthread_create(&many_threads[i], NULL, many_thread,
+                              &sets[i]) == 0);
+    for (unsigned int i = 0; i < NB_MANY_THREADS; i++)
+        assert(pthread_join(many_threads[i], NULL) == 0);
+    assert(pthread_barrier_destroy(&barrier) == 0);
+    unsigned int nb_shared = 0;
+    for (unsigned int i = 0; i < NB_MANY_THREADS; i++) {
+        assert(sets[i] <= ULIFO64_THREADS);
+        assert(sets[i] != ulifo64_thread - 1);
+        if (sets[i] == ULIFO64_THREADS) {
+            nb_shared++;
+            continue;
+        }
+        for (unsigned int j = 0; j < i; j++)
+            assert(sets[j] != sets[i]);
+    }
+    assert(nb_shared == NB_MANY_THREADS - (ULIFO64_THREADS - 1));
+    ulifo64_get_stats(&ulifo, &stats);
+    assert(stats.pushes ==
+           ULIFO64_DEPTH + 1 + NB_THREADS * NB_LOOPS + NB_MANY_THREADS);
+    assert(stats.pops == 1 + NB_THREADS * NB_LOOPS + NB_MANY_THREADS);
+
+    /* the sets of the exited threads are given again */
+    assert(pthread_barrier_init(&barrier, NULL, 1) == 0);
+    assert(pthread_create(&many_threads[0], NULL, many_thread, &sets[0]) == 0);
+    assert(pthread_join(many_threads[0], NULL) == 0);
+    assert(pthread_barrier_destroy(&barrier) == 0);
+    assert(sets[0] < ULIFO64_THREADS);
+
+    /* every element is still there exactly once */
+    uint8_t *seen = calloc(ULIFO64_DEPTH, 1);
+    assert(seen != NULL);
+    uint32_t *elem;
+    unsigned int count = 0;
+    while ((elem = ulifo64_pop(&ulifo, uint32_t *)) != NULL) {
+        assert(!seen[*elem]);
+        seen[*elem] = 1;
+        count++;
+    }
+    assert(count == ULIFO64_DEPTH);
+
+    ulifo64_clean(&ulifo);
+    free(seen);
+    free(elems);
+    free(extra);
+    return 0;
+}
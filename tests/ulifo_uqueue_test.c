@@ -51,6 +51,7 @@
 
 #define ULIFO_MAX_DEPTH 10
 #define UQUEUE_MAX_DEPTH 6
+#define UQUEUE_BATCH 4
 #define UPUMP_POOL 1
 #define UPUMP_BLOCKER_POOL 1
 #define NB_LOOPS 1000
@@ -76,7 +77,7 @@ static struct ulifo ulifo;
 static struct uqueue uqueue;
 struct elem elems[ULIFO_MAX_DEPTH];
 static unsigned int nb_loops = NB_LOOPS;
-static unsigned int loop[2] = {0, 0};
+static unsigned int loop_nb[2] = {0, 0};
 
 static void push_ready(struct upump *upump)
 {
@@ -138,21 +139,38 @@ static void *push_thread(void *_thread)
     return NULL;
 }
 
+static void pop_elem(struct uchain *uchain)
+{
+    struct elem *elem = container_of(uchain, struct elem, uchain);
+    assert(elem->loop == loop_nb[elem->thread]);
+    loop_nb[elem->thread] = elem->loop + 1;
+    if (likely(elem->timeout.tv_nsec))
+        assert(!nanosleep(&elem->timeout, NULL));
+    ulifo_push(&ulifo, uchain);
+}
+
 static void pop(struct upump *upump)
 {
     struct uchain *uchain = uqueue_pop(&uqueue, struct uchain *);
-    if (likely(uchain != NULL)) {
-        struct elem *elem = container_of(uchain, struct elem, uchain);
-        assert(elem->loop == loop[elem->thread]);
-        loop[elem->thread] = elem->loop + 1;
-        if (likely(elem->timeout.tv_nsec))
-            assert(!nanosleep(&elem->timeout, NULL));
-        ulifo_push(&ulifo, uchain);
-    } else if (likely(uatomic_load(&refcount) == 1))
+    if (likely(uchain != NULL))
+        pop_elem(uchain);
+    else if (likely(uatomic_load(&refcount) == 1))
         upump_stop(upump);
 }
 
-int main(int argc, char **argv)
+static void pop_batch(struct upump *upump)
+{
+    void *elements[UQUEUE_BATCH];
+    unsigned int nb = uqueue_pop_batch(&uqueue, elements, UQUEUE_BATCH);
+    assert(nb <= UQUEUE_BATCH);
+    for (unsigned int i = 0; i < nb; i++)
+        pop_elem((struct uchain *)elements[i]);
+    if (nb == 0 && likely(uatomic_load(&refcount) == 1))
+        upump_stop(upump);
+}
+
+static void run(struct ev_loop *loop, struct upump_mgr *upump_mgr,
+                upump_cb cb)
 {
     static const long nsec_timeouts[ULIFO_MAX_DEPTH] = {
         0, 1000000, 5000000, 0, 50000, 0, 0, 10000000, 5000, 0
@@ -160,15 +178,8 @@ int main(int argc, char **argv)
     uint8_t ulifo_buffer[ulifo_sizeof(ULIFO_MAX_DEPTH)];
     uint8_t uqueue_buffer[uqueue_sizeof(UQUEUE_MAX_DEPTH)];
 
-    if (argc > 1)
-        nb_loops = atoi(argv[1]);
-
-    struct ev_loop *loop = ev_default_loop(0);
-    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc(loop, UPUMP_POOL,
-                                                     UPUMP_BLOCKER_POOL);
-    assert(upump_mgr != NULL);
-
     uatomic_init(&refcount, 1);
+    loop_nb[0] = loop_nb[1] = 0;
 
     ulifo_init(&ulifo, ULIFO_MAX_DEPTH, ulifo_buffer);
     for (int i = 0; i < ULIFO_MAX_DEPTH; i++) {
@@ -178,7 +189,7 @@ int main(int argc, char **argv)
     }
 
     assert(uqueue_init(&uqueue, UQUEUE_MAX_DEPTH, uqueue_buffer));
-    struct upump *upump = uqueue_upump_alloc_pop(&uqueue, upump_mgr, pop, NULL);
+    struct upump *upump = uqueue_upump_alloc_pop(&uqueue, upump_mgr, cb, NULL);
     assert(upump != NULL);
 
     struct thread threads[2];
@@ -193,8 +204,6 @@ int main(int argc, char **argv)
     ev_loop(loop, 0);
 
     upump_free(upump);
-    upump_mgr_release(upump_mgr);
-    ev_default_destroy();
 
     ulifo_clean(&ulifo);
     uqueue_clean(&uqueue);
@@ -203,6 +212,22 @@ int main(int argc, char **argv)
 
     assert(!pthread_join(threads[0].id, NULL));
     assert(!pthread_join(threads[1].id, NULL));
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        nb_loops = atoi(argv[1]);
 
+    struct ev_loop *loop = ev_default_loop(0);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc(loop, UPUMP_POOL,
+                                                     UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+
+    run(loop, upump_mgr, pop);
+    run(loop, upump_mgr, pop_batch);
+
+    upump_mgr_release(upump_mgr);
+    ev_default_destroy();
     return 0;
 }
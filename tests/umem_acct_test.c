@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for umem_acct manager
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+#include <upipe/umem_acct.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 1
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *pool_mgr = umem_pool_mgr_alloc_simple(2);
+    assert(pool_mgr != NULL);
+    ubase_assert(umem_pool_mgr_set_stats(pool_mgr, true));
+    struct umem_mgr *mgr1 = umem_acct_mgr_alloc(pool_mgr);
+    assert(mgr1 != NULL);
+    struct umem_mgr *mgr2 = umem_acct_mgr_alloc(pool_mgr);
+    assert(mgr2 != NULL);
+
+    struct umem_usage usage;
+    ubase_assert(umem_mgr_get_usage(mgr1, &usage));
+    assert(usage.live == 0 && usage.pooled == 0 && usage.peak == 0);
+
+    /* allocations are attributed to their manager */
+    struct umem umem1, umem2, umem3;
+    assert(umem_alloc(mgr1, &umem1, 100));
+    memset(umem_buffer(&umem1), 0x42, 100);
+    assert(umem_alloc(mgr1, &umem2, 1000));
+    assert(umem_alloc(mgr2, &umem3, 10));
+    ubase_assert(umem_mgr_get_usage(mgr1, &usage));
+    assert(usage.live == 1100);
+    assert(usage.peak == 1100);
+    ubase_assert(umem_mgr_get_usage(mgr2, &usage));
+    assert(usage.live == 10);
+
+    assert(umem_realloc(&umem1, 5000));
+    assert(umem_buffer(&umem1)[99] == 0x42);
+    ubase_assert(umem_mgr_get_usage(mgr1, &usage));
+    assert(usage.live == 6000);
+    assert(usage.peak == 6000);
+
+    umem_free(&umem2);
+    ubase_assert(umem_mgr_get_usage(mgr1, &usage));
+    assert(usage.live == 5000);
+    assert(usage.peak == 6000);
+    umem_free(&umem1);
+    umem_free(&umem3);
+    ubase_assert(umem_mgr_get_usage(mgr1, &usage));
+    assert(usage.live == 0);
+    ubase_assert(umem_mgr_get_usage(mgr2, &usage));
+    assert(usage.live == 0 && usage.peak == 10);
+
+    /* freed buffers were kept in the pools of the parent */
+    ubase_assert(umem_mgr_get_usage(pool_mgr, &usage));
+    assert(usage.live == 0);
+    assert(usage.pooled > 0);
+    assert(usage.peak >= 6000);
+    umem_mgr_vacuum(mgr1);
+    ubase_assert(umem_mgr_get_usage(pool_mgr, &usage));
+    assert(usage.pooled == 0);
+
+    /* managers built on top of it are accounted too */
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         mgr1, -1, -1);
+    assert(udict_mgr != NULL);
+    struct udict *udict = udict_alloc(udict_mgr, 0);
+    assert(udict != NULL);
+    ubase_assert(umem_mgr_get_usage(mgr1, &usage));
+    assert(usage.live > 0);
+    udict_free(udict);
+    udict_mgr_release(udict_mgr);
+    ubase_assert(umem_mgr_get_usage(mgr1, &usage));
+    assert(usage.live == 0);
+
+    umem_mgr_release(mgr1);
+    umem_mgr_release(mgr2);
+    umem_mgr_release(pool_mgr);
+    return 0;
+}
@@ -29,6 +29,7 @@
 
 #undef NDEBUG
 
+#include <upipe/ubase.h>
 #include <upipe/umem.h>
 #include <upipe/umem_pool.h>
 
@@ -41,6 +42,11 @@ int main(int argc, char **argv)
 {
     struct umem_mgr *mgr = umem_pool_mgr_alloc_simple(32);
     assert(mgr != NULL);
+    struct umem_pool_stats stats;
+    struct umem_usage usage;
+    assert(!ubase_check(umem_pool_mgr_get_stats(mgr, 1, &stats)));
+    assert(!ubase_check(umem_mgr_get_usage(mgr, &usage)));
+    ubase_assert(umem_pool_mgr_set_stats(mgr, true));
 
     struct umem umem;
     assert(umem_alloc(mgr, &umem, 42));
@@ -87,6 +93,60 @@ int main(int argc, char **argv)
     umem_free(&umem);
     printf("Passed 6\n");
 
+    unsigned int nb_pools;
+    ubase_assert(umem_pool_mgr_get_nb_pools(mgr, &nb_pools));
+    assert(nb_pools == 18);
+    ubase_assert(umem_pool_mgr_get_stats(mgr, 1, &stats));
+    assert(stats.size == 64);
+    assert(stats.allocs == 1);
+    assert(stats.hits == 0);
+    assert(stats.fallbacks == 1);
+    assert(stats.in_use == 0);
+    assert(stats.high_water == 1);
+    ubase_assert(umem_pool_mgr_get_stats(mgr, 8, &stats));
+    assert(stats.size == 8192);
+    assert(stats.allocs == 2);
+    assert(stats.hits == 1);
+    assert(stats.high_water == 1);
+    assert(!ubase_check(umem_pool_mgr_get_stats(mgr, 18, &stats)));
+    printf("Passed 7\n");
+
+    ubase_assert(umem_pool_mgr_prealloc(mgr, 2));
+    assert(umem_alloc(mgr, &umem, 200));
+    struct umem umem2;
+    assert(umem_alloc(mgr, &umem2, 200));
+    ubase_assert(umem_pool_mgr_get_stats(mgr, 3, &stats));
+    assert(stats.allocs == 2);
+    assert(stats.hits == 2);
+    assert(stats.in_use == 2);
+    assert(stats.high_water == 2);
+    umem_free(&umem);
+    umem_free(&umem2);
+
+    /* the counters can't be restarted once buffers were allocated */
+    ubase_assert(umem_pool_mgr_set_stats(mgr, true));
+    assert(umem_pool_mgr_set_stats(mgr, false) == UBASE_ERR_NONE);
+    assert(umem_pool_mgr_set_stats(mgr, true) == UBASE_ERR_BUSY);
+    assert(!ubase_check(umem_pool_mgr_get_stats(mgr, 3, &stats)));
+    printf("Passed 8\n");
+
+    umem_mgr_release(mgr);
+
+    mgr = umem_pool_mgr_alloc_huge_simple(32, 0);
+    assert(mgr != NULL);
+    assert(umem_alloc(mgr, &umem, 42));
+    memset(umem_buffer(&umem), 0x42, 42);
+    assert(umem_realloc(&umem, 3 * 1024 * 1024));
+    p = umem_buffer(&umem);
+    assert(p != NULL);
+    assert(p[41] == 0x42);
+    memset(p, 0x43, 3 * 1024 * 1024);
+    umem_free(&umem);
+    assert(umem_alloc(mgr, &umem, 4 * 1024 * 1024));
+    assert(umem_buffer(&umem) == p);
+    umem_free(&umem);
+    printf("Passed 9\n");
+
     umem_mgr_release(mgr);
     return 0;
 }
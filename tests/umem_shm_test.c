@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for umem shm manager
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/umem.h>
+#include <upipe/umem_shm.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_pic_mem.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <assert.h>
+
+#define UBUF_POOL_DEPTH     1
+#define STRESS_PROCESSES    4
+#define STRESS_HELD         4
+#define STRESS_ITERATIONS   100000
+
+/** concurrently allocates and frees chunks, checking that no chunk is
+ * handed out twice */
+static void stress(struct umem_mgr *mgr, uint32_t id)
+{
+    struct umem umems[STRESS_HELD];
+    unsigned int held = 0;
+    for (unsigned int i = 0; i < STRESS_ITERATIONS; i++) {
+        if (held < STRESS_HELD && (i % 3)) {
+            assert(umem_alloc(mgr, &umems[held], 200));
+            uint32_t *p = (uint32_t *)umem_buffer(&umems[held]);
+            *p = id;
+            held++;
+        } else if (held) {
+            held--;
+            uint32_t *p = (uint32_t *)umem_buffer(&umems[held]);
+            assert(*p == id);
+            *p = 0;
+            umem_free(&umems[held]);
+        }
+    }
+    while (held)
+        umem_free(&umems[--held]);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *mgr = umem_shm_mgr_alloc(256, 2, 2, 1);
+    assert(mgr != NULL);
+    int fd;
+    ubase_assert(umem_shm_mgr_get_fd(mgr, &fd));
+    assert(fd != -1);
+
+    struct umem umem1, umem2, umem3, umem4;
+    assert(umem_alloc(mgr, &umem1, 100));
+    assert(umem_alloc(mgr, &umem2, 200));
+    assert(umem_alloc(mgr, &umem3, 256));
+    assert(!umem_alloc(mgr, &umem4, 100));
+    memset(umem_buffer(&umem1), 0x42, 100);
+    printf("Passed 1\n");
+
+    uint8_t *p = umem_buffer(&umem1);
+    assert(!umem_realloc(&umem1, 300));
+    assert(umem_buffer(&umem1) == p);
+    umem_free(&umem3);
+    assert(umem_realloc(&umem1, 300));
+    p = umem_buffer(&umem1);
+    assert(p[0] == 0x42);
+    assert(p[99] == 0x42);
+    printf("Passed 2\n");
+
+    uint64_t offset;
+    uint8_t stack[16];
+    assert(!ubase_check(umem_shm_mgr_export(mgr, stack, &offset)));
+    memset(umem_buffer(&umem2), 0x43, 200);
+    ubase_assert(umem_shm_mgr_export(mgr, umem_buffer(&umem2) + 10, &offset));
+    printf("Passed 3\n");
+
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (!pid) {
+        struct umem_mgr *child_mgr = umem_shm_mgr_attach(dup(fd));
+        assert(child_mgr != NULL);
+        struct umem umem;
+        size_t skip;
+        assert(!ubase_check(umem_shm_mgr_import(child_mgr, 1, &umem, &skip)));
+        ubase_assert(umem_shm_mgr_import(child_mgr, offset, &umem, &skip));
+        assert(skip == 10);
+        assert(umem_buffer(&umem)[skip] == 0x43);
+        umem_buffer(&umem)[skip] = 0x44;
+        umem_free(&umem);
+        umem_mgr_release(child_mgr);
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    assert(umem_buffer(&umem2)[10] == 0x44);
+    printf("Passed 4\n");
+
+    /* the reference of the child was released, so the chunk is free again */
+    p = umem_buffer(&umem2);
+    umem_free(&umem2);
+    assert(umem_alloc(mgr, &umem2, 200));
+    assert(umem_buffer(&umem2) == p);
+    umem_free(&umem2);
+    umem_free(&umem1);
+    printf("Passed 5\n");
+
+    struct umem_mgr *attached_mgr = umem_shm_mgr_attach(dup(fd));
+    assert(attached_mgr != NULL);
+    struct ubuf_mgr *block_mgr =
+        ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                 attached_mgr, -1, 0);
+    assert(block_mgr != NULL);
+
+    assert(umem_alloc(mgr, &umem1, 100));
+    memset(umem_buffer(&umem1), 0x45, 100);
+    ubase_assert(umem_shm_mgr_export(mgr, umem_buffer(&umem1) + 20, &offset));
+    size_t skip;
+    ubase_assert(umem_shm_mgr_import(attached_mgr, offset, &umem3, &skip));
+    assert(ubuf_block_mem_alloc_umem(block_mgr, &umem3, skip,
+                                     umem_size(&umem3)) == NULL);
+    struct ubuf *ubuf = ubuf_block_mem_alloc_umem(block_mgr, &umem3, skip, 50);
+    assert(ubuf != NULL);
+    size_t size;
+    ubase_assert(ubuf_block_size(ubuf, &size));
+    assert(size == 50);
+    int read_size = -1;
+    const uint8_t *r;
+    ubase_assert(ubuf_block_read(ubuf, 0, &read_size, &r));
+    assert(read_size == 50);
+    assert(r != umem_buffer(&umem1) + 20);
+    assert(r[0] == 0x45 && r[49] == 0x45);
+    ubase_assert(ubuf_block_unmap(ubuf, 0));
+    ubuf_free(ubuf);
+    p = umem_buffer(&umem1);
+    umem_free(&umem1);
+    assert(umem_alloc(mgr, &umem1, 100));
+    assert(umem_buffer(&umem1) == p);
+    ubuf_mgr_release(block_mgr);
+    printf("Passed 6\n");
+
+    struct ubuf_mgr *pic_mgr =
+        ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                               attached_mgr, 1, 0, 0, 0, 0, 0, 0);
+    assert(pic_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "u8", 2, 2, 1));
+
+    memset(umem_buffer(&umem1), 0x46, 100);
+    ubase_assert(umem_shm_mgr_export(mgr, umem_buffer(&umem1), &offset));
+    ubase_assert(umem_shm_mgr_import(attached_mgr, offset, &umem3, &skip));
+    assert(skip == 0);
+    const char *chromas[] = { "u8", "y8" };
+    size_t offsets[] = { 200, 32 };
+    size_t strides[] = { 8, 16 };
+    size_t short_strides[] = { 8, 7 };
+    const char *dup_chromas[] = { "y8", "y8" };
+    assert(ubuf_pic_mem_alloc_umem(pic_mgr, &umem3, 8, 4, 2, chromas,
+                                   offsets, short_strides) == NULL);
+    assert(ubuf_pic_mem_alloc_umem(pic_mgr, &umem3, 8, 4, 2, dup_chromas,
+                                   offsets, strides) == NULL);
+    assert(ubuf_pic_mem_alloc_umem(pic_mgr, &umem3, 8, 4, 1, chromas,
+                                   offsets, strides) == NULL);
+    offsets[0] = umem_size(&umem3) - 4;
+    assert(ubuf_pic_mem_alloc_umem(pic_mgr, &umem3, 8, 4, 2, chromas,
+                                   offsets, strides) == NULL);
+    offsets[0] = umem_size(&umem3) - 12;
+    ubuf = ubuf_pic_mem_alloc_umem(pic_mgr, &umem3, 8, 4, 2, chromas,
+                                   offsets, strides);
+    assert(ubuf != NULL);
+    size_t hsize, vsize, stride;
+    uint8_t macropixel;
+    ubase_assert(ubuf_pic_size(ubuf, &hsize, &vsize, &macropixel));
+    assert(hsize == 8 && vsize == 4 && macropixel == 1);
+    ubase_assert(ubuf_pic_plane_size(ubuf, "y8", &stride, NULL, NULL, NULL));
+    assert(stride == 16);
+    ubase_assert(ubuf_pic_plane_read(ubuf, "y8", 0, 0, -1, -1, &r));
+    assert(r[0] == 0x46 && r[3 * 16 + 7] == 0x46);
+    ubase_assert(ubuf_pic_plane_unmap(ubuf, "y8", 0, 0, -1, -1));
+    uint8_t *w;
+    ubase_assert(ubuf_pic_plane_write(ubuf, "u8", 0, 0, -1, -1, &w));
+    w[8 + 3] = 0x47;
+    ubase_assert(ubuf_pic_plane_unmap(ubuf, "u8", 0, 0, -1, -1));
+    assert(umem_buffer(&umem1)[umem_size(&umem3) - 12 + 8 + 3] == 0x47);
+    ubuf_free(ubuf);
+    umem_free(&umem1);
+    ubuf_mgr_release(pic_mgr);
+    printf("Passed 7\n");
+
+    umem_mgr_release(attached_mgr);
+    umem_mgr_release(mgr);
+
+    /* all processes hammer the free list of a single pool */
+    struct umem umems[STRESS_PROCESSES * STRESS_HELD];
+    mgr = umem_shm_mgr_alloc(256, 1, STRESS_PROCESSES * STRESS_HELD);
+    assert(mgr != NULL);
+    ubase_assert(umem_shm_mgr_get_fd(mgr, &fd));
+    for (uint32_t i = 1; i < STRESS_PROCESSES; i++) {
+        pid = fork();
+        assert(pid != -1);
+        if (!pid) {
+            struct umem_mgr *child_mgr = umem_shm_mgr_attach(dup(fd));
+            assert(child_mgr != NULL);
+            stress(child_mgr, i + 1);
+            umem_mgr_release(child_mgr);
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    stress(mgr, 1);
+    while ((pid = wait(&status)) != -1)
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    for (unsigned int i = 0; i < STRESS_PROCESSES * STRESS_HELD; i++)
+        assert(umem_alloc(mgr, &umems[i], 200));
+    assert(!umem_alloc(mgr, &umem1, 200));
+    for (unsigned int i = 0; i < STRESS_PROCESSES * STRESS_HELD; i++)
+        umem_free(&umems[i]);
+    umem_mgr_release(mgr);
+    printf("Passed 8\n");
+    return 0;
+}
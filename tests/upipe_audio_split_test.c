@@ -57,6 +57,7 @@
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
 
 static int counter = 0;
+static const uint8_t *expected_buffer = NULL;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -92,6 +93,18 @@ static void test_input(struct upipe *upipe, struct uref *uref,
 {
     assert(uref != NULL);
     counter++;
+
+    const uint8_t *buffer;
+    if (expected_buffer != NULL &&
+        ubase_check(uref_sound_plane_read_uint8_t(uref, "l", 0, -1,
+                                                  &buffer))) {
+        /* planar input must not be copied */
+        assert(buffer == expected_buffer);
+        const int16_t *samples = (const int16_t *)buffer;
+        for (int i = 0; i < SAMPLES; i++)
+            assert(samples[i] == i);
+        uref_sound_plane_unmap(uref, "l", 0, -1);
+    }
     uref_free(uref);
 }
 
@@ -215,8 +228,34 @@ int main(int argc, char *argv[])
     assert(uref != NULL);
     upipe_input(upipe_audio_split, uref, NULL);
     assert(counter == 2);
+    counter = 0;
+
+    /* planar input flow definition */
+    flow = uref_sound_flow_alloc_def(uref_mgr, "s16.", 2, 2);
+    assert(flow != NULL);
+    ubase_assert(uref_sound_flow_add_plane(flow, "l"));
+    ubase_assert(uref_sound_flow_add_plane(flow, "r"));
+    struct ubuf_mgr *planar_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+                 UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr, flow);
+    assert(planar_mgr);
+    ubase_assert(upipe_set_flow_def(upipe_audio_split, flow));
+    uref_free(flow);
+
+    /* feed planar samples */
+    uref = uref_sound_alloc(uref_mgr, planar_mgr, SAMPLES);
+    assert(uref != NULL);
+    int16_t *l;
+    ubase_assert(uref_sound_plane_write_int16_t(uref, "l", 0, -1, &l));
+    for (int i = 0; i < SAMPLES; i++)
+        l[i] = i;
+    expected_buffer = (const uint8_t *)l;
+    ubase_assert(uref_sound_plane_unmap(uref, "l", 0, -1));
+    upipe_input(upipe_audio_split, uref, NULL);
+    assert(counter == 2);
+    expected_buffer = NULL;
 
     /* clean */
+    ubuf_mgr_release(planar_mgr);
     ubuf_mgr_release(sound_mgr);
     upipe_release(upipe_audio_split);
     upipe_release(upipe_audio_split_output0);
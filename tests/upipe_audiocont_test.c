@@ -60,6 +60,8 @@
 #define DURATION            SAMPLES * UCLOCK_FREQ / INPUT_RATE
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
 
+static int nb_packets = -1;
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
@@ -76,6 +78,85 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe: checks the crossfade from input 1 to input 2 */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    const float *buf;
+    size_t size;
+    assert(uref != NULL);
+    ubase_assert(uref_sound_size(uref, &size, NULL));
+    assert(size == SAMPLES);
+    ubase_assert(uref_sound_plane_read_float(uref, "c", 0, -1, &buf));
+    for (int k = 0; k < SAMPLES; k++) {
+        float expected = nb_packets < 2 ? 2. : nb_packets > 2 ? 3. :
+                         2. + (float)k / SAMPLES;
+        assert(buf[k] > expected - 1e-4 && buf[k] < expected + 1e-4);
+    }
+    uref_sound_plane_unmap(uref, "c", 0, -1);
+    nb_packets++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr audiocont_test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper function to allocate a sound buffer filled with a value */
+static struct uref *alloc_sound(struct uref_mgr *uref_mgr,
+                                struct ubuf_mgr *ubuf_mgr, float value,
+                                uint64_t pts)
+{
+    float *buf;
+    struct uref *uref = uref_sound_alloc(uref_mgr, ubuf_mgr, SAMPLES);
+    assert(uref != NULL);
+    ubase_assert(uref_sound_plane_write_float(uref, "c", 0, -1, &buf));
+    for (int k = 0; k < SAMPLES; k++)
+        buf[k] = value;
+    uref_sound_plane_unmap(uref, "c", 0, -1);
+    uref_clock_set_pts_sys(uref, pts);
+    uref_clock_set_duration(uref, DURATION);
+    return uref;
+}
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
@@ -205,6 +286,36 @@ int main(int argc, char **argv)
         if (dup) uref_free(dup);
     }
 
+    /* crossfade from input 1 to input 2 during one reference packet */
+    uint64_t crossfade;
+    ubase_assert(upipe_audiocont_get_crossfade(audiocont, &crossfade));
+    assert(crossfade == 0);
+    ubase_assert(upipe_audiocont_set_crossfade(audiocont, DURATION));
+    ubase_assert(upipe_audiocont_get_crossfade(audiocont, &crossfade));
+    assert(crossfade == DURATION);
+
+    struct upipe *sink = upipe_void_alloc(&audiocont_test_mgr,
+                                          uprobe_use(logger));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(audiocont, sink));
+    nb_packets = 0;
+    const uint64_t start = 10 * UCLOCK_FREQ;
+    for (i=0; i < ITERATIONS; i++) {
+        upipe_input(subpipe[1], alloc_sound(uref_mgr, in_sound_mgr, 2.,
+                                            start + i * DURATION), NULL);
+        upipe_input(subpipe[2], alloc_sound(uref_mgr, in_sound_mgr, 3.,
+                                            start + i * DURATION), NULL);
+    }
+    for (i=0; i < ITERATIONS; i++) {
+        if (i == 2)
+            ubase_assert(upipe_audiocont_sub_set_input(subpipe[2]));
+        struct uref *uref = uref_sound_alloc(uref_mgr, ref_sound_mgr, SAMPLES);
+        uref_clock_set_pts_sys(uref, start + i * DURATION);
+        uref_clock_set_duration(uref, DURATION);
+        upipe_input(audiocont, uref, NULL);
+    }
+    assert(nb_packets == ITERATIONS);
+
     ubuf_mgr_release(ref_sound_mgr);
     ubuf_mgr_release(in_sound_mgr);
 
@@ -214,6 +325,7 @@ int main(int argc, char **argv)
 
     /* release pipe */
     upipe_release(audiocont);
+    test_free(sink);
 
     /* release managers */
     upipe_mgr_release(upipe_audiocont_mgr); // no-op
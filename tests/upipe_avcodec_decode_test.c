@@ -300,7 +300,7 @@ static void *test_thread(void *_thread)
 }
 
 static void usage(const char *argv0) {
-    fprintf(stdout, "Usage: %s [-n threads] <source file> [pgmprefix]\n", argv0);
+    fprintf(stdout, "Usage: %s [-n threads] [-w] <source file> [pgmprefix]\n", argv0);
     exit(EXIT_FAILURE);
 }
 
@@ -309,11 +309,15 @@ int main (int argc, char **argv)
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
     int opt;
     int thread_num = THREAD_NUM;
-    while ((opt = getopt(argc, argv, "n:")) != -1) {
+    bool worker = false;
+    while ((opt = getopt(argc, argv, "n:w")) != -1) {
         switch(opt) {
             case 'n':
                 thread_num = strtod(optarg, NULL);
                 break;
+            case 'w':
+                worker = true;
+                break;
             default:
                 usage(argv[0]);
         }
@@ -460,6 +464,9 @@ int main (int argc, char **argv)
                     uprobe_pfx_alloc(uprobe_use(logger),
                                      UPROBE_LOG_LEVEL, "audiodec"), NULL));
         assert(mainthread.audiodec);
+        if (worker)
+            ubase_assert(upipe_avcdec_set_worker_pool(mainthread.audiodec,
+                                                      true));
         ubase_assert(upipe_set_flow_def(mainthread.audiodec, flowdef));
         uref_free(flowdef);
         ubase_assert(upipe_set_output(mainthread.audiodec, nullpipe));
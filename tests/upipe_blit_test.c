@@ -62,6 +62,10 @@
 #define ITERATIONS          5
 #define TOLERANCE           UCLOCK_FREQ / 1000
 #define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+#define WIDTH               64
+#define HEIGHT              32
+
+static unsigned int nb_packets = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list args)
@@ -78,6 +82,93 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list
     return UBASE_ERR_NONE;
 }
 
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    const uint8_t *buf;
+    size_t stride;
+    assert(uref != NULL);
+    ubase_assert(uref_pic_plane_size(uref, "y8", &stride, NULL, NULL, NULL));
+    ubase_assert(uref_pic_plane_read(uref, "y8", 0, 0, -1, -1, &buf));
+    /* blended sub at (0, 0) with alpha 128 */
+    assert(buf[0] == 50);
+    assert(buf[3 * stride + 15] == 50);
+    assert(buf[4 * stride] == 100);
+    /* opaque sub at (20, 20) */
+    assert(buf[20 * stride + 20] == 200);
+    assert(buf[27 * stride + 27] == 200);
+    assert(buf[28 * stride + 28] == 100);
+    assert(buf[10 * stride + 40] == 100);
+    uref_pic_plane_unmap(uref, "y8", 0, 0, -1, -1);
+    nb_packets++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr blit_test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper function to allocate a picture filled with the given values */
+static struct uref *alloc_pic(struct uref_mgr *uref_mgr,
+                              struct ubuf_mgr *ubuf_mgr,
+                              int hsize, int vsize, uint8_t y, uint8_t a)
+{
+    struct uref *uref = uref_pic_alloc(uref_mgr, ubuf_mgr, hsize, vsize);
+    assert(uref != NULL);
+    const char *chroma = NULL;
+    while (ubase_check(uref_pic_plane_iterate(uref, &chroma)) &&
+           chroma != NULL) {
+        uint8_t *buf;
+        size_t stride;
+        ubase_assert(uref_pic_plane_size(uref, chroma, &stride,
+                                         NULL, NULL, NULL));
+        ubase_assert(uref_pic_plane_write(uref, chroma, 0, 0, -1, -1, &buf));
+        for (int i = 0; i < vsize; i++)
+            memset(buf + i * stride, strcmp(chroma, "a8") ? y : a, hsize);
+        uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+    }
+    return uref;
+}
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
@@ -96,6 +187,13 @@ int main(int argc, char **argv)
     assert(pic_mgr != NULL);
     ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "y8", 1, 1, 1));
 
+    /* Y and alpha */
+    struct ubuf_mgr *alpha_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                        UBUF_POOL_DEPTH, umem_mgr, 1, 0, 0, 0, 0, 0, 0);
+    assert(alpha_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(alpha_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(alpha_mgr, "a8", 1, 1, 1));
+
     /* uprobe stuff */
     struct uprobe uprobe;
     uprobe_init(&uprobe, catch, NULL);
@@ -134,15 +232,29 @@ int main(int argc, char **argv)
     upipe_release(null);
     upipe_null_dump_dict(null, true);
 
+    /* blit an opaque and a translucent picture */
+    struct upipe *sink = upipe_void_alloc(&blit_test_mgr,
+                                          uprobe_use(logger));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(blit, sink));
+    upipe_input(subpipe1, alloc_pic(uref_mgr, pic_mgr, 8, 8, 200, 0), NULL);
+    upipe_input(subpipe2, alloc_pic(uref_mgr, alpha_mgr, 16, 4, 0, 128),
+                NULL);
+    upipe_input(blit, alloc_pic(uref_mgr, pic_mgr, WIDTH, HEIGHT, 100, 0),
+                NULL);
+    assert(nb_packets == 1);
+
     /* release blit pipe and subpipes */
     upipe_release(subpipe1);
     upipe_release(subpipe2);
     upipe_release(subpipe3);
     upipe_release(blit);
+    test_free(sink);
 
     /* release managers */
     upipe_mgr_release(upipe_blit_mgr); // no-op
     ubuf_mgr_release(pic_mgr);
+    ubuf_mgr_release(alpha_mgr);
     uref_mgr_release(uref_mgr);
     umem_mgr_release(umem_mgr);
     udict_mgr_release(udict_mgr);
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for capture pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe-modules/upipe_capture.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+struct capture_test {
+    struct uref *prev;
+    struct uref *entry;
+    unsigned int nb_entries;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+UPIPE_HELPER_UPIPE(capture_test, upipe, 0);
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct capture_test *capture_test = malloc(sizeof(struct capture_test));
+    assert(capture_test != NULL);
+    upipe_init(&capture_test->upipe, mgr, uprobe);
+    capture_test->prev = NULL;
+    capture_test->entry = NULL;
+    capture_test->nb_entries = 0;
+    return &capture_test->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct capture_test *capture_test = capture_test_from_upipe(upipe);
+    assert(uref != NULL);
+    if (capture_test->prev)
+        uref_free(capture_test->prev);
+    capture_test->prev = capture_test->entry;
+    capture_test->entry = uref;
+    capture_test->nb_entries++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            const char *def;
+            ubase_assert(uref_flow_get_def(flow_def, &def));
+            assert(!strcmp(def, "block.capture."));
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    struct capture_test *capture_test = capture_test_from_upipe(upipe);
+    if (capture_test->prev)
+        uref_free(capture_test->prev);
+    if (capture_test->entry)
+        uref_free(capture_test->entry);
+    upipe_clean(upipe);
+    free(capture_test);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr capture_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** checks a received record */
+static void test_check_uref(struct uref *uref, uint64_t date, uint32_t flags,
+                            const char *payload)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == UPIPE_CAPTURE_HEADER_SIZE + strlen(payload));
+
+    uint8_t buf[size];
+    ubase_assert(uref_block_extract(uref, 0, size, buf));
+    struct upipe_capture_record record;
+    upipe_capture_read_header(buf, &record);
+    assert(record.date == date);
+    assert(record.flags == flags);
+    assert(record.size == strlen(payload));
+    assert(!memcmp(buf + UPIPE_CAPTURE_HEADER_SIZE, payload, record.size));
+}
+
+/** checks the last received record */
+static void test_check(struct upipe *upipe, unsigned int nb_entries,
+                       uint64_t date, uint32_t flags, const char *payload)
+{
+    struct capture_test *capture_test = capture_test_from_upipe(upipe);
+    assert(capture_test->nb_entries == nb_entries);
+    test_check_uref(capture_test->entry, date, flags, payload);
+}
+
+/** checks the flow definition record preceding the last record */
+static void test_check_def(struct upipe *upipe, uint64_t date,
+                           const char *def)
+{
+    struct capture_test *capture_test = capture_test_from_upipe(upipe);
+    assert(capture_test->prev != NULL);
+    test_check_uref(capture_test->prev, date, UPIPE_CAPTURE_FLOW_DEF, def);
+}
+
+/** allocates a block uref with the given payload */
+static struct uref *test_alloc_block(struct uref_mgr *uref_mgr,
+                                     struct ubuf_mgr *ubuf_mgr,
+                                     const char *payload)
+{
+    int size = strlen(payload);
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, size);
+    assert(uref != NULL);
+    uint8_t *buf;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    assert(size == (int)strlen(payload));
+    memcpy(buf, payload, size);
+    ubase_assert(uref_block_unmap(uref, 0));
+    return uref;
+}
+
+/** sends a block uref */
+static void test_send(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                      struct ubuf_mgr *ubuf_mgr, uint64_t date,
+                      const char *payload)
+{
+    struct uref *uref;
+    if (payload != NULL)
+        uref = test_alloc_block(uref_mgr, ubuf_mgr, payload);
+    else {
+        uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+    }
+    if (date != UPIPE_CAPTURE_NO_DATE)
+        uref_clock_set_cr_sys(uref, date);
+    upipe_input(upipe, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
+
+    /* uref and mem management */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    /* uprobe stuff */
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct upipe *capture_test = upipe_void_alloc(&capture_test_mgr,
+                                                  uprobe_use(logger));
+    assert(capture_test != NULL);
+
+    struct upipe_mgr *upipe_capture_mgr = upipe_capture_mgr_alloc();
+    assert(upipe_capture_mgr != NULL);
+    struct upipe *capture = upipe_void_alloc(upipe_capture_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "capture"));
+    assert(capture != NULL);
+    ubase_assert(upipe_set_output(capture, capture_test));
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "foo.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(capture, uref));
+    uref_free(uref);
+
+    /* the flow definition is recorded before the first uref */
+    test_send(capture, uref_mgr, ubuf_mgr, 27000000, "hello");
+    test_check(capture_test, 2, 27000000, 0, "hello");
+    test_check_def(capture_test, 27000000, "block.foo.");
+
+    /* flags */
+    uref = test_alloc_block(uref_mgr, ubuf_mgr, "abc");
+    uref_clock_set_cr_sys(uref, 27000042);
+    uref_flow_set_random(uref);
+    uref_flow_set_discontinuity(uref);
+    uref_block_set_start(uref);
+    upipe_input(capture, uref, NULL);
+    test_check(capture_test, 3, 27000042, UPIPE_CAPTURE_RANDOM |
+               UPIPE_CAPTURE_DISCONTINUITY | UPIPE_CAPTURE_START, "abc");
+
+    /* urefs without date or payload */
+    test_send(capture, uref_mgr, ubuf_mgr, UPIPE_CAPTURE_NO_DATE, "x");
+    test_check(capture_test, 4, UPIPE_CAPTURE_NO_DATE, 0, "x");
+    test_send(capture, uref_mgr, ubuf_mgr, 27000100, NULL);
+    test_check(capture_test, 5, 27000100, 0, "");
+
+    /* new flow definition */
+    uref = uref_block_flow_alloc_def(uref_mgr, "bar.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(capture, uref));
+    uref_free(uref);
+    test_send(capture, uref_mgr, ubuf_mgr, 27000200, "world");
+    test_check(capture_test, 7, 27000200, 0, "world");
+    test_check_def(capture_test, 27000200, "block.bar.");
+
+    upipe_release(capture);
+    test_free(capture_test);
+
+    /* release managers */
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -67,6 +67,7 @@
 #define REAL_MTU ((MTU / ALIGN) * ALIGN)
 
 unsigned int nb_packets = 0;
+unsigned int segments = 1;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -106,8 +107,14 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     upipe_dbg_va(upipe, "received packet of size %zu", size);
     nb_packets--;
     if (nb_packets) {
-        assert(size == REAL_MTU);
+        assert(size == REAL_MTU * segments);
     }
+    uint64_t segment_size;
+    if (segments > 1 && size > REAL_MTU) {
+        ubase_assert(uref_block_get_segment_size(uref, &segment_size));
+        assert(segment_size == REAL_MTU);
+    } else
+        ubase_nassert(uref_block_get_segment_size(uref, &segment_size));
 
     while (size > 0) {
         ubase_assert(uref_block_read(uref, pos, &len, &buffer));
@@ -214,6 +221,37 @@ int main(int argc, char *argv[])
     printf("nb_packets: %u\n", nb_packets);
     assert(!nb_packets);
 
+    /* super-chunks */
+    segments = 4;
+    upipe_chunk_stream = upipe_void_alloc(upipe_chunk_stream_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "chunk"));
+    assert(upipe_chunk_stream != NULL);
+    uref = uref_block_flow_alloc_def(uref_mgr, "foo.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_chunk_stream, uref));
+    ubase_assert(upipe_set_output(upipe_chunk_stream, upipe_sink));
+    uref_free(uref);
+    ubase_assert(upipe_chunk_stream_set_mtu(upipe_chunk_stream, MTU, ALIGN));
+    ubase_nassert(upipe_chunk_stream_set_segments(upipe_chunk_stream, 65));
+    ubase_assert(upipe_chunk_stream_set_segments(upipe_chunk_stream,
+                                                 segments));
+    unsigned int segments_got = 0;
+    ubase_assert(upipe_chunk_stream_get_segments(upipe_chunk_stream,
+                                                 &segments_got));
+    assert(segments_got == segments);
+
+    nb_packets = (PACKET_SIZE * PACKETS_NUM * PACKETS_NUM +
+                  REAL_MTU * segments - 1) / (REAL_MTU * segments);
+    for (i = 0; i < PACKETS_NUM; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, PACKET_SIZE * PACKETS_NUM);
+        assert(uref != NULL);
+        upipe_input(upipe_chunk_stream, uref, NULL);
+    }
+    upipe_release(upipe_chunk_stream);
+    printf("nb_packets: %u\n", nb_packets);
+    assert(!nb_packets);
+
     /* release everything */
     upipe_mgr_release(upipe_chunk_stream_mgr); // nop
 
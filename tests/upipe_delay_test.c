@@ -40,12 +40,17 @@
 #include <upipe/uref_flow.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
 #include <upipe/upipe.h>
 #include <upipe-modules/upipe_delay.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <inttypes.h>
 #include <assert.h>
 
@@ -56,6 +61,7 @@
 
 static uint64_t delay = 0;
 static unsigned int nb_packets = 0;
+static unsigned int nb_blocks = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -106,6 +112,25 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     nb_packets++;
 }
 
+/** helper phony pipe */
+static void test_block_input(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump_p)
+{
+    assert(uref != NULL);
+    uint64_t cr_sys;
+    ubase_assert(uref_clock_get_cr_sys(uref, &cr_sys));
+    assert(cr_sys == nb_blocks * 30 + delay);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == 100);
+    uint8_t buffer[100];
+    ubase_assert(uref_block_extract(uref, 0, 100, buffer));
+    for (int i = 0; i < 100; i++)
+        assert(buffer[i] == (uint8_t)(nb_blocks + i));
+    uref_free(uref);
+    nb_blocks++;
+}
+
 /** helper phony pipe */
 static int test_control(struct upipe *upipe, int command, va_list args)
 {
@@ -133,6 +158,34 @@ static struct upipe_mgr test_mgr = {
     .upipe_control = test_control
 };
 
+/** helper phony pipe */
+static struct upipe_mgr test_block_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_block_input,
+    .upipe_control = test_control
+};
+
+/** sends blocks to a delay pipe */
+static void test_send(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                      struct ubuf_mgr *ubuf_mgr, unsigned int from,
+                      unsigned int to)
+{
+    for (unsigned int i = from; i < to; i++) {
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, 100);
+        assert(uref != NULL);
+        uint8_t *buffer;
+        int size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        assert(size == 100);
+        for (int j = 0; j < 100; j++)
+            buffer[j] = i + j;
+        ubase_assert(uref_block_unmap(uref, 0));
+        uref_clock_set_cr_sys(uref, i * 30);
+        upipe_input(upipe, uref, NULL);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -143,6 +196,10 @@ int main(int argc, char *argv[])
     struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
                                                    0);
     assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0);
+    assert(ubuf_mgr != NULL);
     struct uprobe uprobe;
     uprobe_init(&uprobe, catch, NULL);
     struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
@@ -183,12 +240,59 @@ int main(int argc, char *argv[])
     assert(uref != NULL);
     upipe_input(upipe_delay, uref, NULL);
     assert(nb_packets == 1);
+    upipe_release(upipe_delay);
+
+    /* buffering mode */
+    struct upipe *upipe_block_sink = upipe_void_alloc(&test_block_mgr,
+                                                      uprobe_use(uprobe_stdio));
+    assert(upipe_block_sink != NULL);
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "block."));
+    upipe_delay = upipe_void_alloc(upipe_delay_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "delay"));
+    assert(upipe_delay != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_delay, uref));
+    ubase_assert(upipe_set_output(upipe_delay, upipe_block_sink));
+    uref_free(uref);
+
+    delay = 100;
+    ubase_assert(upipe_delay_set_delay(upipe_delay, delay));
+    ubase_assert(upipe_delay_set_buffer(upipe_delay, 1000, NULL));
+    uint64_t buffer;
+    ubase_assert(upipe_delay_get_buffer(upipe_delay, &buffer));
+    assert(buffer == 1000);
+    test_send(upipe_delay, uref_mgr, ubuf_mgr, 0, 10);
+    /* blocks received 100 before the last one */
+    assert(nb_blocks == 6);
+
+    /* the buffer is full */
+    ubase_assert(upipe_delay_set_buffer(upipe_delay, 250, NULL));
+    assert(nb_blocks == 10);
+    test_send(upipe_delay, uref_mgr, ubuf_mgr, 10, 20);
+    assert(nb_blocks == 18);
+
+    /* spill to a file */
+    char path[] = "upipe_delay_test.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+    ubase_assert(upipe_delay_set_buffer(upipe_delay, 250, path));
+    assert(nb_blocks == 20);
+    test_send(upipe_delay, uref_mgr, ubuf_mgr, 20, 40);
+    assert(nb_blocks == 38);
+    ubase_assert(upipe_delay_set_buffer(upipe_delay, 0, NULL));
+    assert(nb_blocks == 40);
+    unlink(path);
 
     upipe_release(upipe_delay);
     upipe_mgr_release(upipe_delay_mgr); // nop
 
     test_free(upipe_sink);
+    test_free(upipe_block_sink);
 
+    ubuf_mgr_release(ubuf_mgr);
     uref_mgr_release(uref_mgr);
     udict_mgr_release(udict_mgr);
     umem_mgr_release(umem_mgr);
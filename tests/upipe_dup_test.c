@@ -36,8 +36,12 @@
 #include <upipe/umem_alloc.h>
 #include <upipe/udict.h>
 #include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
 #include <upipe/uref.h>
 #include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
 #include <upipe/uref_flow.h>
 #include <upipe/uref_block_flow.h>
 #include <upipe/upipe.h>
@@ -45,13 +49,20 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #define UDICT_POOL_DEPTH 0
 #define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define BUF_SIZE 188
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
 static int counter = 0;
+static bool shared = false;
+static struct uref *kept = NULL;
+static struct upipe *writer = NULL;
+static struct ubuf_mgr *ubuf_mgr;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -86,6 +97,48 @@ static void test_input(struct upipe *upipe, struct uref *uref,
 {
     assert(uref != NULL);
     counter++;
+    if (upipe == writer) {
+        /* the other output has released its reference */
+        uint8_t *buffer;
+        int size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        assert(size == BUF_SIZE);
+        uref_block_unmap(uref, 0);
+        uref_free(uref);
+        return;
+    }
+    if (!shared) {
+        uref_free(uref);
+        return;
+    }
+
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == BUF_SIZE);
+    uint8_t buffer[BUF_SIZE];
+    ubase_assert(uref_block_extract(uref, 0, BUF_SIZE, buffer));
+    for (int i = 0; i < BUF_SIZE; i++)
+        assert(buffer[i] == i);
+    uint64_t date;
+    ubase_assert(uref_clock_get_cr_sys(uref, &date));
+    assert(date == 42);
+    ubase_nassert(uref_flow_get_random(uref));
+
+    if (kept == NULL) {
+        kept = uref;
+        return;
+    }
+    /* modify the attributes, the dates and the buffer of this output only */
+    ubase_assert(uref_flow_set_random(uref));
+    uref_clock_set_cr_sys(uref, 43);
+    ubase_assert(uref_block_resize(uref, 1, -1));
+    ubase_assert(uref_block_merge(uref, ubuf_mgr, 0, -1));
+    uint8_t *w;
+    int w_size = -1;
+    ubase_assert(uref_block_write(uref, 0, &w_size, &w));
+    assert(w_size == BUF_SIZE - 1);
+    memset(w, 0xff, w_size);
+    ubase_assert(uref_block_unmap(uref, 0));
     uref_free(uref);
 }
 
@@ -126,6 +179,10 @@ int main(int argc, char *argv[])
     struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
                                                    0);
     assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
     struct uref *uref;
     struct uprobe uprobe;
     uprobe_init(&uprobe, catch, NULL);
@@ -175,16 +232,68 @@ int main(int argc, char *argv[])
     assert(uref != NULL);
     upipe_input(upipe_dup, uref, NULL);
     assert(counter == 2);
+    counter = 0;
+
+    ubase_assert(upipe_dup_set_shared(upipe_dup, true));
+    shared = true;
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, BUF_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == BUF_SIZE);
+    for (int i = 0; i < BUF_SIZE; i++)
+        buffer[i] = i;
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, 42);
+    upipe_input(upipe_dup, uref, NULL);
+    assert(counter == 2);
+    assert(kept != NULL);
+    /* the uref of the other output was not modified */
+    size_t kept_size;
+    ubase_assert(uref_block_size(kept, &kept_size));
+    assert(kept_size == BUF_SIZE);
+    uint8_t kept_buffer[BUF_SIZE];
+    ubase_assert(uref_block_extract(kept, 0, BUF_SIZE, kept_buffer));
+    for (int i = 0; i < BUF_SIZE; i++)
+        assert(kept_buffer[i] == i);
+    ubase_nassert(uref_flow_get_random(kept));
+    uint64_t kept_date;
+    ubase_assert(uref_clock_get_cr_sys(kept, &kept_date));
+    assert(kept_date == 42);
+
+    /* the writer is given its uref last, in both modes */
+    ubase_assert(upipe_dup_output_set_writer(upipe_dup_output0, true));
+    writer = upipe_sink0;
+    for (int i = 0; i < 2; i++) {
+        shared = !i;
+        ubase_assert(upipe_dup_set_shared(upipe_dup, shared));
+        counter = 0;
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, BUF_SIZE);
+        assert(uref != NULL);
+        size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        assert(size == BUF_SIZE);
+        for (int j = 0; j < BUF_SIZE; j++)
+            buffer[j] = j;
+        uref_block_unmap(uref, 0);
+        uref_clock_set_cr_sys(uref, 42);
+        upipe_input(upipe_dup, uref, NULL);
+        assert(counter == 2);
+    }
 
     upipe_release(upipe_dup);
     upipe_release(upipe_dup_output0);
     upipe_release(upipe_dup_output1);
+    /* the uref outlives the dup pipe */
+    uref_free(kept);
     upipe_mgr_release(upipe_dup_mgr); // nop
 
     test_free(upipe_sink0);
     test_free(upipe_sink1);
 
     uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
     udict_mgr_release(udict_mgr);
     umem_mgr_release(umem_mgr);
 
@@ -68,10 +68,15 @@
 #define UPUMP_POOL 0
 #define UPUMP_BLOCKER_POOL 0
 #define READ_SIZE 4096
+#define READ_AHEAD_DEPTH 4
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
 static void usage(const char *argv0) {
-    fprintf(stdout, "Usage: %s [-d <delay>] [-a|-o] <source file> <sink file>\n", argv0);
+    fprintf(stdout, "Usage: %s [-d <delay>] [-m <window>] [-r <size> [-O]] [-D <size>] [-a|-o] <source file> <sink file>\n", argv0);
+    fprintf(stdout, "-m : map the source file by windows of the given size\n");
+    fprintf(stdout, "-r : read the source file ahead by chunks of the given size\n");
+    fprintf(stdout, "-O : read ahead with O_DIRECT\n");
+    fprintf(stdout, "-D : write with O_DIRECT by buffers of the given size\n");
     fprintf(stdout, "-a : append\n");
     fprintf(stdout, "-o : overwrite\n");
     exit(EXIT_FAILURE);
@@ -98,13 +103,29 @@ int main(int argc, char *argv[])
 {
     const char *src_file, *sink_file;
     uint64_t delay = 0;
+    uint64_t window = 0;
+    uint64_t ahead = 0;
+    bool ahead_direct = false;
+    unsigned int direct = 0;
     enum upipe_fsink_mode mode = UPIPE_FSINK_CREATE;
     int opt;
-    while ((opt = getopt(argc, argv, "d:ao")) != -1) {
+    while ((opt = getopt(argc, argv, "d:m:r:OD:ao")) != -1) {
         switch (opt) {
             case 'd':
                 delay = atoi(optarg);
                 break;
+            case 'm':
+                window = atoi(optarg);
+                break;
+            case 'r':
+                ahead = atoi(optarg);
+                break;
+            case 'O':
+                ahead_direct = true;
+                break;
+            case 'D':
+                direct = atoi(optarg);
+                break;
             case 'a':
                 mode = UPIPE_FSINK_APPEND;
                 break;
@@ -158,6 +179,13 @@ int main(int argc, char *argv[])
                              UPROBE_LOG_LEVEL, "file source"));
     assert(upipe_fsrc != NULL);
     ubase_assert(upipe_source_set_read_size(upipe_fsrc, READ_SIZE));
+    if (window)
+        ubase_assert(upipe_fsrc_set_mmap(upipe_fsrc, window));
+    if (ahead) {
+        ubase_assert(upipe_fsrc_set_read_ahead(upipe_fsrc, ahead,
+                                               READ_AHEAD_DEPTH));
+        ubase_assert(upipe_fsrc_set_direct(upipe_fsrc, ahead_direct));
+    }
     if (delay)
         ubase_assert(upipe_attach_uclock(upipe_fsrc));
     ubase_assert(upipe_set_uri(upipe_fsrc, src_file));
@@ -178,6 +206,11 @@ int main(int argc, char *argv[])
         ubase_assert(upipe_attach_uclock(upipe_fsink));
         ubase_assert(upipe_sink_set_delay(upipe_fsink, delay));
     }
+    if (direct) {
+        ubase_assert(upipe_fsink_set_direct(upipe_fsink, direct));
+        ubase_assert(upipe_fsink_set_prealloc(upipe_fsink, 4 * direct));
+        ubase_assert(upipe_fsink_set_sync(upipe_fsink, 2 * direct));
+    }
     ubase_assert(upipe_fsink_set_path(upipe_fsink, sink_file, mode));
 
     ev_loop(loop, 0);
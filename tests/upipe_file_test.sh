@@ -11,6 +11,38 @@ if ! cmp --quiet "$TMP"/test Makefile; then
 	rm -rf "$TMP"
 	exit 2
 fi
+if ! ./upipe_file_test -m 10000 Makefile "$TMP"/test_mmap; then
+	rm -rf "$TMP"
+	exit 1
+fi
+if ! cmp --quiet "$TMP"/test_mmap Makefile; then
+	rm -rf "$TMP"
+	exit 2
+fi
+if ! ./upipe_file_test -D 8192 Makefile "$TMP"/test_direct; then
+	rm -rf "$TMP"
+	exit 1
+fi
+if ! cmp --quiet "$TMP"/test_direct Makefile; then
+	rm -rf "$TMP"
+	exit 2
+fi
+if ! ./upipe_file_test -r 4000 Makefile "$TMP"/test_ahead; then
+	rm -rf "$TMP"
+	exit 1
+fi
+if ! cmp --quiet "$TMP"/test_ahead Makefile; then
+	rm -rf "$TMP"
+	exit 2
+fi
+if ! ./upipe_file_test -r 8192 -O Makefile "$TMP"/test_ahead_direct; then
+	rm -rf "$TMP"
+	exit 1
+fi
+if ! cmp --quiet "$TMP"/test_ahead_direct Makefile; then
+	rm -rf "$TMP"
+	exit 2
+fi
 
 if ! which valgrind >/dev/null 2>&1; then
 	echo "#### Please install valgrind for unit tests"
@@ -153,12 +153,61 @@ int main(int argc, char **argv)
         upipe_input(filter_blend, pic, NULL);
     }
 
+    /* 10-bit 4:2:2 in adaptive mode */
+    struct ubuf_mgr *ubuf_mgr10 = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1, UBUF_PREPEND, UBUF_APPEND,
+            UBUF_PREPEND, UBUF_APPEND, UBUF_ALIGN, UBUF_ALIGN_HOFFSET);
+    assert(ubuf_mgr10);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr10, "y10l", 1, 1, 2));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr10, "u10l", 2, 1, 2));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr10, "v10l", 2, 1, 2));
+
+    uref = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(uref);
+    ubase_assert(uref_pic_flow_add_plane(uref, 1, 1, 2, "y10l"));
+    ubase_assert(uref_pic_flow_add_plane(uref, 2, 1, 2, "u10l"));
+    ubase_assert(uref_pic_flow_add_plane(uref, 2, 1, 2, "v10l"));
+    ubase_assert(upipe_set_flow_def(filter_blend, uref));
+    uref_free(uref);
+
+    int mode;
+    ubase_assert(upipe_filter_blend_set_mode(filter_blend,
+                                    UPIPE_FILTER_BLEND_MODE_ADAPTIVE));
+    ubase_assert(upipe_filter_blend_get_mode(filter_blend, &mode));
+    assert(mode == UPIPE_FILTER_BLEND_MODE_ADAPTIVE);
+
+    unsigned int nb_bands;
+    ubase_assert(upipe_filter_blend_set_bands(filter_blend, 3));
+    ubase_assert(upipe_filter_blend_get_bands(filter_blend, &nb_bands));
+    assert(nb_bands == 3);
+
+    for (counter=0; counter < 4; counter++) {
+        printf("Sending 10-bit pic %d\n", counter);
+        pic = uref_pic_alloc(uref_mgr, ubuf_mgr10, WIDTH, HEIGHT);
+        assert(pic);
+        const char *chroma = NULL;
+        while (ubase_check(uref_pic_plane_iterate(pic, &chroma)) && chroma) {
+            uint8_t hsub;
+            ubase_assert(uref_pic_plane_write(pic, chroma, 0, 0, -1, -1, &buf));
+            ubase_assert(uref_pic_plane_size(pic, chroma, &stride, &hsub,
+                                             NULL, NULL));
+            for (y=0; y < HEIGHT; y++) {
+                uint16_t *line = (uint16_t *)(buf + y * stride);
+                for (x=0; x < WIDTH / hsub; x++)
+                    line[x] = (x + y + counter * (x & 1) * 30) & 1023;
+            }
+            uref_pic_plane_unmap(pic, chroma, 0, 0, -1, -1);
+        }
+        upipe_input(filter_blend, pic, NULL);
+    }
+
     // Clean - release
     upipe_release(filter_blend);
 
     upipe_mgr_release(blend_mgr); // noop
     upipe_mgr_release(null_mgr); // noop
     ubuf_mgr_release(ubuf_mgr);
+    ubuf_mgr_release(ubuf_mgr10);
     uref_mgr_release(uref_mgr);
     uprobe_release(logger);
     uprobe_clean(&uprobe);
@@ -75,6 +75,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list
 /** helper phony pipe */
 struct genaux_test {
     struct uref *entry;
+    unsigned int nb_entries;
     struct upipe upipe;
 };
 
@@ -89,6 +90,7 @@ static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
     assert(genaux_test != NULL);
     upipe_init(&genaux_test->upipe, mgr, uprobe);
     genaux_test->entry = NULL;
+    genaux_test->nb_entries = 0;
     return &genaux_test->upipe;
 }
 
@@ -105,6 +107,7 @@ static void test_input(struct upipe *upipe, struct uref *uref,
         uref_free(genaux_test->entry);
     }
     genaux_test->entry = uref;
+    genaux_test->nb_entries++;
     // FIXME peek into buffer
 }
 
@@ -147,6 +150,33 @@ static struct upipe_mgr genaux_test_mgr = {
     .upipe_control = test_control
 };
 
+/** checks the records of the last received block */
+static void test_check(struct upipe *upipe, unsigned int nb_entries,
+                       const uint64_t *records, unsigned int nb_records)
+{
+    struct genaux_test *genaux_test = genaux_test_from_upipe(upipe);
+    uint8_t buf[8];
+    size_t size;
+    assert(genaux_test->nb_entries == nb_entries);
+    ubase_assert(uref_block_size(genaux_test->entry, &size));
+    assert(size == nb_records * sizeof(uint64_t));
+    for (unsigned int i = 0; i < nb_records; i++) {
+        ubase_assert(uref_block_extract(genaux_test->entry,
+                    i * sizeof(uint64_t), sizeof(uint64_t), buf));
+        assert(upipe_genaux_ntoh64(buf) == records[i]);
+    }
+}
+
+/** sends a uref with the given pts_prog */
+static void test_send(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                      uint64_t date)
+{
+    struct uref *uref = uref_alloc(uref_mgr);
+    assert(uref);
+    uref_clock_set_pts_prog(uref, date);
+    upipe_input(upipe, uref, NULL);
+}
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
@@ -220,7 +250,32 @@ int main(int argc, char **argv)
     uprobe_dbg_va(logger, NULL, "original: %"PRIu64" \t result: %"PRIu64, opaque, result);
     assert(opaque == result);
 
+    /* test batches, of 3 records and windows of 1000 */
+    unsigned int batch_size;
+    uint64_t batch_duration;
+    ubase_assert(upipe_genaux_set_batch(genaux, 28, 1000));
+    ubase_assert(upipe_genaux_get_batch(genaux, &batch_size, &batch_duration));
+    assert(batch_size == 24);
+    assert(batch_duration == 1000);
+
+    test_send(genaux, uref_mgr, 10);
+    test_send(genaux, uref_mgr, 20);
+    assert(genaux_test_from_upipe(genaux_test)->nb_entries == 2);
+    test_send(genaux, uref_mgr, 30);
+    test_check(genaux_test, 3, (uint64_t[]){ 10, 20, 30 }, 3);
+
+    /* new window */
+    test_send(genaux, uref_mgr, 40);
+    test_send(genaux, uref_mgr, 1010);
+    test_check(genaux_test, 4, (uint64_t[]){ 40 }, 1);
+
+    /* dates going backwards */
+    test_send(genaux, uref_mgr, 1005);
+    test_check(genaux_test, 5, (uint64_t[]){ 1010 }, 1);
+
+    /* the last batch is output on release */
     upipe_release(genaux);
+    test_check(genaux_test, 6, (uint64_t[]){ 1005 }, 1);
     test_free(genaux_test);
 
     /* release managers */
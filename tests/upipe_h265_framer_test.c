@@ -0,0 +1,518 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for H.265 video framer module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_dump.h>
+#include <upipe/upipe.h>
+#include <upipe-framers/upipe_h265_framer.h>
+#include <upipe-framers/uref_h265_flow.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static unsigned int nb_packets = 0;
+static size_t au_sizes[2];
+static bool got_flow_def = false;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_SYNC_ACQUIRED:
+        case UPROBE_SYNC_LOST:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    upipe_dbg_va(upipe, "frame: %u", nb_packets);
+    uref_dump(uref, upipe->uprobe);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    uint64_t systime_rap = UINT64_MAX, dts_orig = UINT64_MAX;
+    uint64_t duration = UINT64_MAX;
+    uref_clock_get_rap_sys(uref, &systime_rap);
+    uref_clock_get_dts_orig(uref, &dts_orig);
+    uref_clock_get_duration(uref, &duration);
+    assert(nb_packets < 2);
+    assert(size == au_sizes[nb_packets]);
+    assert(systime_rap == 42);
+    assert(duration == UCLOCK_FREQ / 25);
+    ubase_assert(uref_pic_get_progressive(uref));
+    switch (nb_packets) {
+        case 0:
+            ubase_assert(uref_pic_get_key(uref));
+            ubase_assert(uref_flow_get_random(uref));
+            assert(dts_orig == 27000000);
+            break;
+        case 1:
+            assert(!ubase_check(uref_pic_get_key(uref)));
+            assert(dts_orig == 27000000 + UCLOCK_FREQ / 25);
+            break;
+    }
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            uref_dump(flow_def, upipe->uprobe);
+            ubase_assert(uref_flow_match_def(flow_def,
+                        "block.hevc.pic.planar8_8_420."));
+            uint64_t hsize, vsize, octetrate, buffer_size;
+            uint8_t profile, level;
+            struct urational fps;
+            ubase_assert(uref_pic_flow_get_hsize(flow_def, &hsize));
+            ubase_assert(uref_pic_flow_get_vsize(flow_def, &vsize));
+            ubase_assert(uref_pic_flow_get_fps(flow_def, &fps));
+            ubase_assert(uref_block_flow_get_octetrate(flow_def, &octetrate));
+            ubase_assert(uref_block_flow_get_buffer_size(flow_def,
+                                                         &buffer_size));
+            ubase_assert(uref_h265_flow_get_profile(flow_def, &profile));
+            ubase_assert(uref_h265_flow_get_level(flow_def, &level));
+            assert(hsize == 1920);
+            assert(vsize == 1080);
+            assert(fps.num == 25 && fps.den == 1);
+            assert(octetrate == 4000000 / 8);
+            assert(buffer_size == 4000000 / 8);
+            assert(profile == 1);
+            assert(level == 120);
+            got_flow_def = true;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper structure to write RBSP */
+struct rbsp {
+    uint8_t buffer[256];
+    size_t bits;
+};
+
+/** helper function to write a fixed-length field */
+static void rbsp_put(struct rbsp *r, uint32_t value, uint8_t nb)
+{
+    while (nb--) {
+        size_t octet = r->bits / 8;
+        assert(octet < sizeof(r->buffer));
+        if (!(r->bits % 8))
+            r->buffer[octet] = 0;
+        if ((value >> nb) & 1)
+            r->buffer[octet] |= 0x80 >> (r->bits % 8);
+        r->bits++;
+    }
+}
+
+/** helper function to write an unsigned exp-golomb code */
+static void rbsp_put_ue(struct rbsp *r, uint32_t value)
+{
+    uint64_t code = (uint64_t)value + 1;
+    uint8_t nb = 0;
+    while (code >> (nb + 1))
+        nb++;
+    rbsp_put(r, 0, nb);
+    if (nb >= 16) {
+        rbsp_put(r, code >> 16, nb + 1 - 16);
+        rbsp_put(r, code & 0xffff, 16);
+    } else
+        rbsp_put(r, code, nb + 1);
+}
+
+/** helper function to write rbsp_trailing_bits */
+static void rbsp_trail(struct rbsp *r)
+{
+    rbsp_put(r, 1, 1);
+    while (r->bits % 8)
+        rbsp_put(r, 0, 1);
+}
+
+/** helper function to write a NAL unit with a four-octet start code and
+ * emulation prevention */
+static uint8_t *write_nal(uint8_t *p, uint8_t type, struct rbsp *r)
+{
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 1;
+    *p++ = type << 1;
+    *p++ = 1; /* TemporalId 0 */
+    unsigned int zeros = 0;
+    size_t i;
+    for (i = 0; r != NULL && i < r->bits / 8; i++) {
+        if (zeros >= 2 && r->buffer[i] <= 3) {
+            *p++ = 3;
+            zeros = 0;
+        }
+        *p++ = r->buffer[i];
+        zeros = r->buffer[i] ? 0 : zeros + 1;
+    }
+    return p;
+}
+
+/** helper function to write a profile, tier and level structure */
+static void write_ptl(struct rbsp *r)
+{
+    rbsp_put(r, 0, 2); /* general_profile_space */
+    rbsp_put(r, 0, 1); /* general_tier_flag */
+    rbsp_put(r, 1, 5); /* general_profile_idc */
+    rbsp_put(r, 0x6000, 16); /* general_profile_compatibility_flag */
+    rbsp_put(r, 0, 16);
+    rbsp_put(r, 0x9, 4); /* progressive, interlaced, non packed, frame only */
+    rbsp_put(r, 0, 22);
+    rbsp_put(r, 0, 22);
+    rbsp_put(r, 120, 8); /* general_level_idc */
+}
+
+/** helper function to write an SEI message, the payload of which is already
+ * byte-aligned */
+static void write_sei_message(struct rbsp *r, uint8_t type, struct rbsp *m)
+{
+    assert(!(m->bits % 8));
+    rbsp_put(r, type, 8);
+    rbsp_put(r, m->bits / 8, 8);
+    size_t i;
+    for (i = 0; i < m->bits / 8; i++)
+        rbsp_put(r, m->buffer[i], 8);
+}
+
+/** helper function to write a prefix SEI NAL unit */
+static uint8_t *write_sei(uint8_t *p, bool buffering_period)
+{
+    struct rbsp r = { .bits = 0 };
+    struct rbsp m = { .bits = 0 };
+    if (buffering_period) {
+        rbsp_put_ue(&m, 0); /* bp_seq_parameter_set_id */
+        rbsp_put(&m, 0, 1); /* irap_cpb_params_present_flag */
+        rbsp_put(&m, 0, 1); /* concatenation_flag */
+        rbsp_put(&m, 0, 23); /* au_cpb_removal_delay_delta_minus1 */
+        rbsp_put(&m, 90000, 23); /* nal_initial_cpb_removal_delay */
+        rbsp_put(&m, 0, 23); /* nal_initial_cpb_removal_offset */
+        rbsp_trail(&m);
+        write_sei_message(&r, 0, &m);
+        m.bits = 0;
+    }
+    rbsp_put(&m, 0, 4); /* pic_struct */
+    rbsp_put(&m, 1, 2); /* source_scan_type */
+    rbsp_put(&m, 0, 1); /* duplicate_flag */
+    rbsp_put(&m, 0, 23); /* au_cpb_removal_delay_minus1 */
+    rbsp_put(&m, 0, 23); /* pic_dpb_output_delay */
+    rbsp_trail(&m);
+    write_sei_message(&r, 1, &m);
+    rbsp_trail(&r);
+    return write_nal(p, 39, &r);
+}
+
+/** helper function to write a slice segment */
+static uint8_t *write_slice(uint8_t *p, uint8_t type, bool first,
+                            uint8_t slice_type, uint8_t poc_lsb)
+{
+    struct rbsp r = { .bits = 0 };
+    rbsp_put(&r, first ? 1 : 0, 1); /* first_slice_segment_in_pic_flag */
+    if (type >= 16 && type <= 23)
+        rbsp_put(&r, 0, 1); /* no_output_of_prior_pics_flag */
+    rbsp_put_ue(&r, 0); /* slice_pic_parameter_set_id */
+    if (first) {
+        rbsp_put_ue(&r, slice_type);
+        if (type != 19 && type != 20)
+            rbsp_put(&r, poc_lsb, 8); /* slice_pic_order_cnt_lsb */
+    } else
+        rbsp_put(&r, 1, 14); /* slice_segment_address */
+    /* fake slice data, which requires emulation prevention */
+    rbsp_put(&r, 0, 24);
+    rbsp_put(&r, 0x1020304, 24);
+    rbsp_trail(&r);
+    return write_nal(p, type, &r);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct uref *uref;
+    uref = uref_block_flow_alloc_def(uref_mgr, "hevc.pic.");
+    assert(uref != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(upipe_sink != NULL);
+
+    struct upipe_mgr *upipe_h265f_mgr = upipe_h265f_mgr_alloc();
+    assert(upipe_h265f_mgr != NULL);
+    struct upipe *upipe_h265f = upipe_void_alloc(upipe_h265f_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "h265f"));
+    assert(upipe_h265f != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_h265f, uref));
+    ubase_assert(upipe_set_output(upipe_h265f, upipe_sink));
+    uref_free(uref);
+
+    uint8_t stream[1024];
+    uint8_t *p = stream;
+    struct rbsp r;
+
+    /* junk preceding the first start code */
+    *p++ = 0xff;
+    *p++ = 0xff;
+    uint8_t *au = p;
+
+    r.bits = 0;
+    rbsp_put(&r, 0, 4); /* vps_video_parameter_set_id */
+    rbsp_put(&r, 3, 2); /* base layer internal and available */
+    rbsp_put(&r, 0, 6); /* vps_max_layers_minus1 */
+    rbsp_put(&r, 0, 3); /* vps_max_sub_layers_minus1 */
+    rbsp_put(&r, 1, 1); /* vps_temporal_id_nesting_flag */
+    rbsp_put(&r, 0xffff, 16);
+    write_ptl(&r);
+    rbsp_trail(&r);
+    p = write_nal(p, 32, &r);
+
+    r.bits = 0;
+    rbsp_put(&r, 0, 4); /* sps_video_parameter_set_id */
+    rbsp_put(&r, 0, 3); /* sps_max_sub_layers_minus1 */
+    rbsp_put(&r, 1, 1); /* sps_temporal_id_nesting_flag */
+    write_ptl(&r);
+    rbsp_put_ue(&r, 0); /* sps_seq_parameter_set_id */
+    rbsp_put_ue(&r, 1); /* chroma_format_idc */
+    rbsp_put_ue(&r, 1920); /* pic_width_in_luma_samples */
+    rbsp_put_ue(&r, 1088); /* pic_height_in_luma_samples */
+    rbsp_put(&r, 1, 1); /* conformance_window_flag */
+    rbsp_put_ue(&r, 0);
+    rbsp_put_ue(&r, 0);
+    rbsp_put_ue(&r, 0);
+    rbsp_put_ue(&r, 4); /* conf_win_bottom_offset */
+    rbsp_put_ue(&r, 0); /* bit_depth_luma_minus8 */
+    rbsp_put_ue(&r, 0); /* bit_depth_chroma_minus8 */
+    rbsp_put_ue(&r, 4); /* log2_max_pic_order_cnt_lsb_minus4 */
+    rbsp_put(&r, 1, 1); /* sps_sub_layer_ordering_info_present_flag */
+    rbsp_put_ue(&r, 4);
+    rbsp_put_ue(&r, 2);
+    rbsp_put_ue(&r, 0);
+    rbsp_put_ue(&r, 0); /* log2_min_luma_coding_block_size_minus3 */
+    rbsp_put_ue(&r, 3);
+    rbsp_put_ue(&r, 0);
+    rbsp_put_ue(&r, 3);
+    rbsp_put_ue(&r, 0);
+    rbsp_put_ue(&r, 0);
+    rbsp_put(&r, 0, 1); /* scaling_list_enabled_flag */
+    rbsp_put(&r, 3, 2); /* amp and sample adaptive offset */
+    rbsp_put(&r, 0, 1); /* pcm_enabled_flag */
+    rbsp_put_ue(&r, 2); /* num_short_term_ref_pic_sets */
+    rbsp_put_ue(&r, 1); /* num_negative_pics */
+    rbsp_put_ue(&r, 0); /* num_positive_pics */
+    rbsp_put_ue(&r, 0); /* delta_poc_s0_minus1 */
+    rbsp_put(&r, 1, 1); /* used_by_curr_pic_s0_flag */
+    rbsp_put(&r, 1, 1); /* inter_ref_pic_set_prediction_flag */
+    rbsp_put(&r, 0, 1); /* delta_rps_sign */
+    rbsp_put_ue(&r, 0); /* abs_delta_rps_minus1 */
+    rbsp_put(&r, 3, 2); /* used_by_curr_pic_flag */
+    rbsp_put(&r, 0, 1); /* long_term_ref_pics_present_flag */
+    rbsp_put(&r, 3, 2); /* temporal mvp and strong intra smoothing */
+    rbsp_put(&r, 1, 1); /* vui_parameters_present_flag */
+    rbsp_put(&r, 1, 1); /* aspect_ratio_info_present_flag */
+    rbsp_put(&r, 1, 8); /* aspect_ratio_idc */
+    rbsp_put(&r, 0, 3); /* overscan, video signal, chroma loc */
+    rbsp_put(&r, 0, 2); /* neutral chroma, field_seq */
+    rbsp_put(&r, 1, 1); /* frame_field_info_present_flag */
+    rbsp_put(&r, 0, 1); /* default_display_window_flag */
+    rbsp_put(&r, 1, 1); /* vui_timing_info_present_flag */
+    rbsp_put(&r, 0, 16);
+    rbsp_put(&r, 1, 16); /* vui_num_units_in_tick */
+    rbsp_put(&r, 0, 16);
+    rbsp_put(&r, 25, 16); /* vui_time_scale */
+    rbsp_put(&r, 0, 1); /* vui_poc_proportional_to_timing_flag */
+    rbsp_put(&r, 1, 1); /* vui_hrd_parameters_present_flag */
+    rbsp_put(&r, 1, 1); /* nal_hrd_parameters_present_flag */
+    rbsp_put(&r, 0, 1); /* vcl_hrd_parameters_present_flag */
+    rbsp_put(&r, 0, 1); /* sub_pic_hrd_params_present_flag */
+    rbsp_put(&r, 0, 4); /* bit_rate_scale */
+    rbsp_put(&r, 0, 4); /* cpb_size_scale */
+    rbsp_put(&r, 22, 5); /* initial_cpb_removal_delay_length_minus1 */
+    rbsp_put(&r, 22, 5); /* au_cpb_removal_delay_length_minus1 */
+    rbsp_put(&r, 22, 5); /* dpb_output_delay_length_minus1 */
+    rbsp_put(&r, 1, 1); /* fixed_pic_rate_general_flag */
+    rbsp_put_ue(&r, 0); /* elemental_duration_in_tc_minus1 */
+    rbsp_put_ue(&r, 0); /* cpb_cnt_minus1 */
+    rbsp_put_ue(&r, 4000000 / 64 - 1); /* bit_rate_value_minus1 */
+    rbsp_put_ue(&r, 4000000 / 16 - 1); /* cpb_size_value_minus1 */
+    rbsp_put(&r, 1, 1); /* cbr_flag */
+    rbsp_put(&r, 0, 1); /* bitstream_restriction_flag */
+    rbsp_put(&r, 0, 1); /* sps_extension_present_flag */
+    rbsp_trail(&r);
+    p = write_nal(p, 33, &r);
+
+    r.bits = 0;
+    rbsp_put_ue(&r, 0); /* pps_pic_parameter_set_id */
+    rbsp_put_ue(&r, 0); /* pps_seq_parameter_set_id */
+    rbsp_put(&r, 0, 1); /* dependent_slice_segments_enabled_flag */
+    rbsp_put(&r, 0, 1); /* output_flag_present_flag */
+    rbsp_put(&r, 0, 3); /* num_extra_slice_header_bits */
+    rbsp_put(&r, 0, 2); /* sign data hiding, cabac init present */
+    rbsp_put_ue(&r, 0);
+    rbsp_put_ue(&r, 0);
+    rbsp_trail(&r);
+    p = write_nal(p, 34, &r);
+
+    p = write_sei(p, true);
+    p = write_slice(p, 19, true, 2, 0);
+    p = write_slice(p, 19, false, 2, 0);
+    au_sizes[0] = p - au;
+    au = p;
+
+    r.bits = 0;
+    rbsp_put(&r, 1, 3); /* pic_type */
+    rbsp_trail(&r);
+    p = write_nal(p, 35, &r);
+    p = write_sei(p, false);
+    p = write_slice(p, 1, true, 1, 1);
+    p = write_nal(p, 36, NULL);
+    au_sizes[1] = p - au;
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, p - stream);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == p - stream);
+    memcpy(buffer, stream, size);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_dts_orig(uref, 27000000);
+    uref_clock_set_dts_prog(uref, 27000000);
+    uref_clock_set_dts_pts_delay(uref, 0);
+    uref_clock_set_cr_sys(uref, 84);
+    uref_clock_set_rap_sys(uref, 42);
+    upipe_input(upipe_h265f, uref, NULL);
+    assert(nb_packets == 1);
+    assert(got_flow_def);
+
+    /* the last access unit is flushed when the pipe is released */
+    upipe_release(upipe_h265f);
+    assert(nb_packets == 2);
+    upipe_mgr_release(upipe_h265f_mgr);
+
+    test_free(upipe_sink);
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for HLS sink pipe
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_file_sink.h>
+#include <upipe-modules/upipe_hls_sink.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define PERIOD (UCLOCK_FREQ / 2)
+#define NB_UREFS 40
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEED_UPUMP_MGR:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** checks the size of a segment, or that it does not exist */
+static void check_segment(const char *dir, unsigned int seq, off_t size)
+{
+    char path[MAXPATHLEN];
+    struct stat st;
+    snprintf(path, MAXPATHLEN, "%s/seg%u.ts", dir, seq);
+    if (size == -1) {
+        assert(stat(path, &st) == -1);
+        return;
+    }
+    assert(stat(path, &st) != -1);
+    assert(st.st_size == size);
+    unlink(path);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    char dir[] = "tmp.hls.XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    char playlist[MAXPATHLEN], prefix[MAXPATHLEN];
+    snprintf(playlist, MAXPATHLEN, "%s/live.m3u8", dir);
+    snprintf(prefix, MAXPATHLEN, "%s/seg", dir);
+
+    struct upipe_mgr *upipe_fsink_mgr = upipe_fsink_mgr_alloc();
+    assert(upipe_fsink_mgr != NULL);
+    struct upipe_mgr *upipe_hls_sink_mgr = upipe_hls_sink_mgr_alloc();
+    assert(upipe_hls_sink_mgr != NULL);
+    struct upipe *upipe_hls_sink = upipe_void_alloc(upipe_hls_sink_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "hls sink"));
+    assert(upipe_hls_sink != NULL);
+    ubase_assert(upipe_hls_sink_set_fsink_mgr(upipe_hls_sink,
+                                              upipe_fsink_mgr));
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_hls_sink, uref));
+    uref_free(uref);
+
+    ubase_assert(upipe_hls_sink_set_duration(upipe_hls_sink,
+                                             2 * UCLOCK_FREQ));
+    ubase_assert(upipe_hls_sink_set_window(upipe_hls_sink, 2));
+    ubase_assert(upipe_hls_sink_set_path(upipe_hls_sink, playlist, prefix,
+                                         ".ts"));
+
+    /* one random access point per second, 4 urefs per segment */
+    for (unsigned int i = 0; i < NB_UREFS; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, sizeof(uint64_t));
+        assert(uref != NULL);
+        uint64_t cr_sys = PERIOD * (i + 1);
+        int size = -1;
+        uint8_t *buf;
+        ubase_assert(uref_block_write(uref, 0, &size, &buf));
+        assert(size == sizeof(uint64_t));
+        memcpy(buf, &cr_sys, sizeof(uint64_t));
+        ubase_assert(uref_block_unmap(uref, 0));
+        uref_clock_set_cr_sys(uref, cr_sys);
+        if (i % 2)
+            uref_flow_set_random(uref);
+        upipe_input(upipe_hls_sink, uref, NULL);
+    }
+
+    upipe_release(upipe_hls_sink);
+    upipe_mgr_release(upipe_hls_sink_mgr); // nop
+    upipe_mgr_release(upipe_fsink_mgr); // nop
+
+    /* the first uref is not a random access point, and the last segment
+     * is shorter */
+    FILE *file = fopen(playlist, "r");
+    assert(file != NULL);
+    char buffer[1024];
+    size_t size = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[size] = '\0';
+    printf("%s", buffer);
+    assert(!strcmp(buffer, "#EXTM3U\n#EXT-X-VERSION:3\n"
+                           "#EXT-X-TARGETDURATION:2\n"
+                           "#EXT-X-MEDIA-SEQUENCE:8\n"
+                           "#EXTINF:2.000,\nseg8.ts\n"
+                           "#EXTINF:1.000,\nseg9.ts\n"
+                           "#EXT-X-ENDLIST\n"));
+    unlink(playlist);
+
+    for (unsigned int i = 0; i < 6; i++)
+        check_segment(dir, i, -1);
+    check_segment(dir, 6, 4 * sizeof(uint64_t));
+    check_segment(dir, 7, 4 * sizeof(uint64_t));
+    check_segment(dir, 8, 4 * sizeof(uint64_t));
+    check_segment(dir, 9, 3 * sizeof(uint64_t));
+    check_segment(dir, 10, -1);
+    assert(rmdir(dir) != -1);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -50,6 +50,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <arpa/inet.h>
@@ -145,6 +146,17 @@ static struct upipe_mgr htons_test_mgr = {
     .upipe_control = test_control
 };
 
+/** fills a packet with the expected pattern */
+static void test_fill(uint8_t *buffer, int size)
+{
+    int remain = size;
+    while (remain > 1) {
+        *(uint16_t*)buffer = nb_packets*PACKET_SIZE+remain;
+        buffer += 2;
+        remain -= 2;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -193,15 +205,51 @@ int main(int argc, char *argv[])
         size = -1;
         uref_block_write(uref, 0, &size, &buffer);
         assert(size == PACKET_SIZE);
-        while (size > 1) {
-            *(uint16_t*)buffer = nb_packets*PACKET_SIZE+size;
-            buffer += 2;
-            size -= 2;
-        }
+        test_fill(buffer, size);
         uref_block_unmap(uref, 0);
         upipe_input(upipe_htons, uref, NULL);
     }
-    /* TODO test segmented, shared, unaligned ubufs */
+    assert(nb_packets == 0);
+
+    /* shared ubuf: the swap must not modify the other reference */
+    nb_packets = 1;
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, PACKET_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    test_fill(buffer, size);
+    uref_block_unmap(uref, 0);
+    struct uref *dup = uref_dup(uref);
+    assert(dup != NULL);
+    upipe_input(upipe_htons, uref, NULL);
+    assert(nb_packets == 0);
+    const uint8_t *r;
+    size = -1;
+    ubase_assert(uref_block_read(dup, 0, &size, &r));
+    for (i = 0; i < PACKET_SIZE; i += 2)
+        assert(*(const uint16_t *)(r + i) == 1 * PACKET_SIZE + PACKET_SIZE - i);
+    uref_block_unmap(dup, 0);
+    uref_free(dup);
+
+    /* segmented ubuf, with a word straddling the segments */
+    nb_packets = 1;
+    uint8_t flat[PACKET_SIZE];
+    test_fill(flat, PACKET_SIZE);
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, PACKET_SIZE / 2 + 1);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    memcpy(buffer, flat, size);
+    uref_block_unmap(uref, 0);
+    struct ubuf *ubuf = ubuf_block_alloc(ubuf_mgr, PACKET_SIZE / 2 - 1);
+    assert(ubuf != NULL);
+    size = -1;
+    ubase_assert(ubuf_block_write(ubuf, 0, &size, &buffer));
+    memcpy(buffer, flat + PACKET_SIZE / 2 + 1, size);
+    ubuf_block_unmap(ubuf, 0);
+    uref_block_append(uref, ubuf);
+    upipe_input(upipe_htons, uref, NULL);
+    assert(nb_packets == 0);
 
     /* flush */
     upipe_release(upipe_htons);
@@ -69,6 +69,11 @@
 #define READ_SIZE 4096
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
+/** urls to open after the first one */
+static char **next_urls;
+/** number of urls to open after the first one */
+static int nb_next_urls;
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
@@ -79,7 +84,14 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
             break;
         case UPROBE_READY:
         case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
         case UPROBE_SOURCE_END:
+            /* reuse the connection for the next url, if possible */
+            if (nb_next_urls) {
+                nb_next_urls--;
+                ubase_assert(upipe_set_uri(upipe, *next_urls++));
+            }
             break;
     }
     return UBASE_ERR_NONE;
@@ -90,10 +102,12 @@ int main(int argc, char *argv[])
     const char *url;
 
     if (argc < 2) {
-        fprintf(stdout, "Usage: %s <url>\n", argv[0]);
+        fprintf(stdout, "Usage: %s <url> [<url>...]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
     url = argv[1];
+    next_urls = argv + 2;
+    nb_next_urls = argc - 2;
 
     struct ev_loop *loop = ev_default_loop(0);
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -133,9 +147,9 @@ int main(int argc, char *argv[])
             uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
                              "http"));
     assert(upipe_http_src != NULL);
-    assert(upipe_source_set_read_size(upipe_http_src, READ_SIZE));
-    assert(upipe_set_uri(upipe_http_src, url));
-    assert(upipe_set_output(upipe_http_src, upipe_null));
+    ubase_assert(upipe_source_set_read_size(upipe_http_src, READ_SIZE));
+    ubase_assert(upipe_set_uri(upipe_http_src, url));
+    ubase_assert(upipe_set_output(upipe_http_src, upipe_null));
     upipe_release(upipe_null);
 
     ev_loop(loop, 0);
@@ -38,6 +38,7 @@
 #include <upipe/udict_inline.h>
 #include <upipe/uref.h>
 #include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
 #include <upipe/uref_std.h>
 #include <upipe/upipe.h>
 #include <upipe-modules/upipe_match_attr.h>
@@ -56,6 +57,7 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
 UREF_ATTR_UNSIGNED(test, foo, "x.test_foo", test foo)
+UREF_ATTR_INT(test, bar, "x.test_bar", test bar)
 
 static unsigned int nb_packets = 0;
 
@@ -175,6 +177,71 @@ int main(int argc, char *argv[])
 
     assert(nb_packets == 1);
 
+    /* random access points spaced by at least 100 */
+    ubase_assert(upipe_match_attr_set_key_interval(upipe_match_attr, 100));
+    static const struct {
+        uint64_t date;
+        bool random;
+    } keys[] = {
+        { 0, true }, { 50, false }, { 50, true }, { 100, true }, { 150, true },
+        { 250, false }, { 260, true }
+    };
+    for (int i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        uref_test_set_foo(uref, 36);
+        uref_clock_set_dts_prog(uref, keys[i].date);
+        if (keys[i].random)
+            ubase_assert(uref_flow_set_random(uref));
+        upipe_input(upipe_match_attr, uref, NULL);
+    }
+    assert(nb_packets == 4);
+
+    /* predicates on a named, a shorthand and a signed attribute */
+    const struct upipe_match_attr_predicate predicates[] = {
+        { UPIPE_MATCH_ATTR_VALUE_UNSIGNED, UDICT_TYPE_UNSIGNED, "x.test_foo",
+          MIN, MAX },
+        { UPIPE_MATCH_ATTR_VALUE_VOID, UDICT_TYPE_FLOW_RANDOM, NULL, 0, 0 },
+        { UPIPE_MATCH_ATTR_VALUE_INT, UDICT_TYPE_INT, "x.test_bar",
+          (uint64_t)-10, 10 },
+    };
+    ubase_assert(upipe_match_attr_set_predicates(upipe_match_attr,
+                predicates, sizeof(predicates) / sizeof(predicates[0])));
+    static const struct {
+        uint64_t foo;
+        bool random;
+        int64_t bar;
+        bool forward;
+    } preds[] = {
+        { 36, true, -5, true }, { 36, false, -5, false },
+        { 100, true, -5, false }, { 36, true, -11, false },
+        { 12, true, 10, true }, { 42, true, 0, true }
+    };
+    for (int i = 0; i < sizeof(preds) / sizeof(preds[0]); i++) {
+        uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        uref_test_set_foo(uref, preds[i].foo);
+        uref_test_set_bar(uref, preds[i].bar);
+        if (preds[i].random)
+            ubase_assert(uref_flow_set_random(uref));
+        unsigned int before = nb_packets;
+        upipe_input(upipe_match_attr, uref, NULL);
+        assert(nb_packets == before + (preds[i].forward ? 1 : 0));
+    }
+    assert(nb_packets == 7);
+
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    upipe_input(upipe_match_attr, uref, NULL);
+    assert(nb_packets == 7);
+
+    ubase_assert(upipe_match_attr_set_predicates(upipe_match_attr, NULL, 0));
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_test_set_foo(uref, 36);
+    upipe_input(upipe_match_attr, uref, NULL);
+    assert(nb_packets == 8);
+
     upipe_release(upipe_match_attr);
     upipe_mgr_release(upipe_match_attr_mgr); // nop
 
@@ -50,6 +50,7 @@
 #include <upipe/upipe.h>
 #include <upipe-modules/upipe_file_sink.h>
 #include <upipe-modules/upipe_multicat_sink.h>
+#include <upipe-modules/upipe_multicat_index.h>
 
 #include <string.h>
 #include <stdbool.h>
@@ -73,6 +74,7 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 #define UREF_PER_SLICE 10
 #define SLICES_NUM 10
+#define RANDOM_PERIOD 4
 
 struct uref_mgr *uref_mgr;
 struct ubuf_mgr *ubuf_mgr;
@@ -124,6 +126,8 @@ static void genpacket_idler(struct upump *upump)
 
 	memcpy(buf, &systime, sizeof(uint64_t));
 	uref_clock_set_cr_sys(uref, systime);
+	if (!((systime / (rotate/UREF_PER_SLICE)) % RANDOM_PERIOD))
+		uref_flow_set_random(uref);
 
 	uref_block_unmap(uref, 0);
 	upipe_input(multicat_sink, uref, NULL);
@@ -135,7 +139,7 @@ int main(int argc, char *argv[])
     const char *dirpath, *suffix;
 	struct uref *flow;
 	uint64_t systime = 0, val;
-	char filepath[MAXPATHLEN];
+	char filepath[MAXPATHLEN], indexpath[MAXPATHLEN];
     int i, j, fd, ret, opt;
 
     signal (SIGINT, sig_handler);
@@ -201,6 +205,8 @@ int main(int argc, char *argv[])
     ubase_assert(upipe_set_flow_def(multicat_sink, flow));
     uref_free(flow);
     ubase_assert(upipe_multicat_sink_set_fsink_mgr(multicat_sink, upipe_fsink_mgr));
+    /* forwarded to the fsink subpipe */
+    ubase_assert(upipe_fsink_set_direct(multicat_sink, 65536));
     if (rotate) {
         ubase_assert(upipe_multicat_sink_set_rotate(multicat_sink, rotate));
     } else {
@@ -208,6 +214,9 @@ int main(int argc, char *argv[])
 	}
 	ubase_assert(upipe_multicat_sink_set_mode(multicat_sink, UPIPE_FSINK_OVERWRITE));
     ubase_assert(upipe_multicat_sink_set_path(multicat_sink, dirpath, suffix));
+	snprintf(indexpath, MAXPATHLEN, "%sindex", dirpath);
+    ubase_assert(upipe_multicat_sink_set_index(multicat_sink, indexpath,
+                                               2 * rotate/UREF_PER_SLICE));
 
 	// idler - packet generator
 	idler = upump_alloc_idler(upump_mgr, genpacket_idler, NULL);	
@@ -251,5 +260,26 @@ int main(int argc, char *argv[])
 		close(fd);
 	}
 
+	// check the index
+	struct upipe_multicat_index_entry entry;
+	uint64_t period = rotate/UREF_PER_SLICE;
+	fd = open(indexpath, O_RDONLY);
+	assert(fd != -1);
+	for (systime = 0; systime < SLICES_NUM * rotate; systime += period / 2) {
+		ubase_assert(upipe_multicat_index_lookup(fd, systime, false, &entry));
+		assert(entry.date <= systime);
+		assert(systime - entry.date <= 2 * period);
+		assert(entry.fileidx == entry.date / rotate);
+		assert(entry.offset ==
+		       (entry.date % rotate) / period * sizeof(uint64_t));
+
+		ubase_assert(upipe_multicat_index_lookup(fd, systime, true, &entry));
+		assert(entry.random);
+		assert(entry.date ==
+		       systime / (RANDOM_PERIOD * period) * RANDOM_PERIOD * period);
+		assert(entry.fileidx == entry.date / rotate);
+	}
+	close(fd);
+
     return 0;
 }
@@ -93,6 +93,16 @@ int main(int argc, char **argv)
     for (i=0; i < ITERATIONS; i++) {
         upipe_input(nullpipe, uref_alloc(uref_mgr), NULL);
     }
+    /* Same in a single batch */
+    struct uchain urefs;
+    ulist_init(&urefs);
+    for (i=0; i < ITERATIONS; i++) {
+        struct uref *uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        ulist_add(&urefs, uref_to_uchain(uref));
+    }
+    upipe_input_list(nullpipe, &urefs, NULL);
+    assert(ulist_empty(&urefs));
     /* Same with dump */
     upipe_null_dump_dict(nullpipe, true);
     for (i=0; i < ITERATIONS; i++) {
@@ -55,6 +55,8 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
 static struct urequest *request;
+static uint64_t play_latency = 0;
+static struct upipe *play_sub = NULL;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -70,6 +72,15 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_SOURCE_END:
         case UPROBE_PROVIDE_REQUEST:
             break;
+        case UPROBE_PLAY_LATENCY: {
+            assert(va_arg(args, uint32_t) == UPIPE_PLAY_SIGNATURE);
+            play_latency = va_arg(args, uint64_t);
+            uint64_t input_latency = va_arg(args, uint64_t);
+            uint64_t sink_latency = va_arg(args, uint64_t);
+            assert(input_latency + sink_latency == play_latency);
+            play_sub = va_arg(args, struct upipe *);
+            break;
+        }
     }
     return UBASE_ERR_NONE;
 }
@@ -181,6 +192,63 @@ int main(int argc, char *argv[])
     ubase_assert(upipe_get_flow_def(upipe_play2, &output_flow_def));
     ubase_assert(uref_clock_get_latency(output_flow_def, &latency));
     assert(latency == UCLOCK_FREQ * 3);
+    assert(play_latency == UCLOCK_FREQ * 3);
+    assert(play_sub == NULL);
+
+    upipe_release(upipe_play);
+    upipe_release(upipe_play1);
+    upipe_release(upipe_play2);
+
+    test_free(test_sink1);
+    test_free(test_sink2);
+
+    /* low-latency mode */
+    upipe_play = upipe_void_alloc(upipe_play_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "play"));
+    assert(upipe_play != NULL);
+    ubase_assert(upipe_play_set_low_latency(upipe_play, true));
+    bool low_latency;
+    ubase_assert(upipe_play_get_low_latency(upipe_play, &low_latency));
+    assert(low_latency);
+
+    upipe_play1 = upipe_void_alloc_sub(upipe_play,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "play 1"));
+    assert(upipe_play1 != NULL);
+    test_sink1 = upipe_void_alloc_output(upipe_play1, &test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "sink 1"));
+    assert(test_sink1 != NULL);
+    struct urequest *request1 = request;
+
+    upipe_play2 = upipe_void_alloc_sub(upipe_play,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "play 2"));
+    assert(upipe_play2 != NULL);
+    test_sink2 = upipe_void_alloc_output(upipe_play2, &test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "sink 2"));
+    assert(test_sink2 != NULL);
+    struct urequest *request2 = request;
+
+    ubase_assert(uref_clock_set_latency(input_flow_def, UCLOCK_FREQ));
+    ubase_assert(upipe_set_flow_def(upipe_play1, input_flow_def));
+    ubase_assert(urequest_provide_sink_latency(request1, 0));
+    ubase_assert(uref_clock_set_latency(input_flow_def, UCLOCK_FREQ / 10));
+    ubase_assert(upipe_set_flow_def(upipe_play2, input_flow_def));
+    ubase_assert(urequest_provide_sink_latency(request2, UCLOCK_FREQ / 2));
+
+    /* the budgets are not added */
+    ubase_assert(upipe_get_flow_def(upipe_play2, &output_flow_def));
+    ubase_assert(uref_clock_get_latency(output_flow_def, &latency));
+    assert(latency == UCLOCK_FREQ);
+    assert(play_latency == UCLOCK_FREQ);
+    assert(play_sub == upipe_play1);
+
+    /* and the latency may be lowered */
+    ubase_assert(uref_clock_set_latency(input_flow_def, UCLOCK_FREQ / 5));
+    ubase_assert(upipe_set_flow_def(upipe_play1, input_flow_def));
+    ubase_assert(upipe_get_flow_def(upipe_play1, &output_flow_def));
+    ubase_assert(uref_clock_get_latency(output_flow_def, &latency));
+    assert(latency == UCLOCK_FREQ / 10 + UCLOCK_FREQ / 2);
+    assert(play_latency == latency);
+    assert(play_sub == upipe_play2);
 
     uref_free(input_flow_def);
 
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for the NUMA placement helpers
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe-pthread/upipe_pthread_numa.h>
+
+#include <stdio.h>
+#include <assert.h>
+
+#define MAX_CPUS 1024
+
+int main(int argc, char **argv)
+{
+    unsigned int nb_nodes;
+    ubase_assert(upipe_pthread_numa_get_nb_nodes(&nb_nodes));
+    assert(nb_nodes >= 1);
+
+    unsigned int cpus[MAX_CPUS];
+    unsigned int nb_cpus = MAX_CPUS;
+    if (ubase_check(upipe_pthread_numa_get_cpus(-1, cpus, &nb_cpus))) {
+        assert(nb_cpus >= 1 && nb_cpus <= MAX_CPUS);
+        for (unsigned int i = 1; i < nb_cpus; i++)
+            assert(cpus[i] > cpus[i - 1]);
+
+        /* the array is never overflowed */
+        unsigned int one_cpu = 0;
+        nb_cpus = 1;
+        ubase_assert(upipe_pthread_numa_get_cpus(-1, &one_cpu, &nb_cpus));
+        assert(nb_cpus == 1 && one_cpu == cpus[0]);
+    }
+
+    nb_cpus = MAX_CPUS;
+    ubase_nassert(upipe_pthread_numa_get_cpus(nb_nodes + 1000, cpus,
+                                              &nb_cpus));
+
+    int node;
+    ubase_nassert(upipe_pthread_numa_get_if_node("../lo", &node));
+    if (ubase_check(upipe_pthread_numa_get_if_node("lo", &node)))
+        assert(node >= -1);
+    return 0;
+}
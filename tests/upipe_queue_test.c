@@ -42,6 +42,7 @@
 #include <upipe/uref_std.h>
 #include <upipe/uref_flow.h>
 #include <upipe/uref_block_flow.h>
+#include <upipe/uref_priority.h>
 #include <upipe/upump.h>
 #include <upump-ev/upump_ev.h>
 #include <upipe/upipe.h>
@@ -70,6 +71,8 @@ static uint8_t counter = 0;
 static struct uref_mgr *uref_mgr;
 static struct urequest request;
 static bool request_was_unregistered = false;
+static unsigned int nb_drops = 0;
+static unsigned int max_drop_priority = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -86,6 +89,16 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_SOURCE_END:
             upipe_release(upipe);
             break;
+        case UPROBE_OVERLOAD_DROP: {
+            struct uref *uref = va_arg(args, struct uref *);
+            unsigned int priority = va_arg(args, unsigned int);
+            assert(uref != NULL);
+            assert(priority < UREF_PRIORITY_CRITICAL);
+            if (priority > max_drop_priority)
+                max_drop_priority = priority;
+            nb_drops++;
+            break;
+        }
     }
     return UBASE_ERR_NONE;
 }
@@ -232,6 +245,10 @@ int main(int argc, char *argv[])
     unsigned int length;
     ubase_assert(upipe_qsrc_get_length(upipe_qsrc, &length));
     assert(length == 3);
+    ubase_assert(upipe_qsrc_get_high_water(upipe_qsrc, &length));
+    assert(length == 3);
+    ubase_assert(upipe_qsrc_get_octets(upipe_qsrc, &length));
+    assert(length == 0);
 
     urequest_init_uref_mgr(&request, provide_request, NULL);
     upipe_register_request(upipe_qsink, &request);
@@ -246,6 +263,13 @@ int main(int argc, char *argv[])
             uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
                              "queue source"), QUEUE_LENGTH);
     assert(upipe_qsrc != NULL);
+    ubase_assert(upipe_qsrc_set_max_octets(upipe_qsrc, 1000));
+    ubase_assert(upipe_qsrc_get_max_octets(upipe_qsrc, &length));
+    assert(length == 1000);
+    ubase_nassert(upipe_qsrc_set_threshold(upipe_qsrc, QUEUE_LENGTH + 1));
+    ubase_assert(upipe_qsrc_set_threshold(upipe_qsrc, QUEUE_LENGTH / 2));
+    ubase_assert(upipe_qsrc_get_threshold(upipe_qsrc, &length));
+    assert(length == QUEUE_LENGTH / 2);
 
     upipe_qsink = upipe_qsink_alloc(upipe_qsink_mgr,
             uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
@@ -255,6 +279,59 @@ int main(int argc, char *argv[])
     upipe_release(upipe_qsrc);
     upipe_release(upipe_qsink);
 
+    /* check that held urefs are dropped by priority on overload */
+    upipe_qsrc = upipe_qsrc_alloc(upipe_qsrc_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "queue source"), QUEUE_LENGTH);
+    assert(upipe_qsrc != NULL);
+    upipe_qsink = upipe_qsink_alloc(upipe_qsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "queue sink"),
+            upipe_qsrc);
+    assert(upipe_qsink != NULL);
+    unsigned int depth;
+    uint64_t deadline;
+    ubase_assert(upipe_qsink_get_overload(upipe_qsink, &depth, &deadline));
+    assert(depth == 0);
+    ubase_assert(upipe_qsink_set_overload(upipe_qsink, 2, 0));
+    ubase_assert(upipe_qsink_get_overload(upipe_qsink, &depth, &deadline));
+    assert(depth == 2);
+    assert(deadline == 0);
+
+    for (unsigned int i = 0; i < QUEUE_LENGTH; i++) {
+        uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        upipe_input(upipe_qsink, uref, NULL);
+    }
+    ubase_assert(upipe_qsrc_get_length(upipe_qsrc, &length));
+    assert(length == QUEUE_LENGTH);
+
+    /* the queue is full: hold high, disposable, normal and disposable */
+    const enum uref_priority priorities[] = {
+        UREF_PRIORITY_HIGH, UREF_PRIORITY_DISPOSABLE,
+        UREF_PRIORITY_NORMAL, UREF_PRIORITY_DISPOSABLE
+    };
+    for (unsigned int i = 0; i < 4; i++) {
+        uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        ubase_assert(uref_flow_set_priority(uref, priorities[i]));
+        upipe_input(upipe_qsink, uref, NULL);
+    }
+    assert(nb_drops == 2);
+    assert(max_drop_priority == UREF_PRIORITY_DISPOSABLE);
+
+    /* a third uref of normal priority evicts the held normal uref */
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_priority(uref, UREF_PRIORITY_NORMAL));
+    upipe_input(upipe_qsink, uref, NULL);
+    assert(nb_drops == 3);
+    assert(max_drop_priority == UREF_PRIORITY_NORMAL);
+
+    ubase_assert(upipe_flush(upipe_qsink));
+    upipe_release(upipe_qsrc);
+    upipe_release(upipe_qsink);
+
     upipe_mgr_release(upipe_qsink_mgr); // nop
     upipe_mgr_release(upipe_qsrc_mgr); // nop
 
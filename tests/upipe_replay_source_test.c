@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for upipe replay source
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe-modules/upipe_capture.h>
+#include <upipe-modules/upipe_replay_source.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <ev.h>
+
+#define UPUMP_POOL          1
+#define UPUMP_BLOCKER_POOL  1
+#define UDICT_POOL_DEPTH    5
+#define UREF_POOL_DEPTH     5
+#define UBUF_POOL_DEPTH     5
+#define NB_RECORDS          5
+#define INTERVAL            (UCLOCK_FREQ / 100)
+#define ORIGIN              (UINT64_C(42) * UCLOCK_FREQ)
+#define UPROBE_LOG_LEVEL    UPROBE_LOG_DEBUG
+
+/** clock used by the test */
+static struct uclock *uclock;
+/** speed of the current run */
+static struct urational speed;
+
+/** phony pipe to test upipe_replaysrc */
+struct replaysrc_test {
+    unsigned int counter;
+    uint64_t first_systime;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+UPIPE_HELPER_UPIPE(replaysrc_test, upipe, 0);
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct replaysrc_test *replaysrc_test =
+        malloc(sizeof(struct replaysrc_test));
+    assert(replaysrc_test != NULL);
+    upipe_init(&replaysrc_test->upipe, mgr, uprobe);
+    replaysrc_test->counter = 0;
+    replaysrc_test->first_systime = 0;
+    return &replaysrc_test->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct replaysrc_test *replaysrc_test =
+        replaysrc_test_from_upipe(upipe);
+    unsigned int i = replaysrc_test->counter++;
+    assert(i < NB_RECORDS);
+
+    char payload[16];
+    snprintf(payload, sizeof(payload), "record %u", i);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == strlen(payload));
+    uint8_t buf[size];
+    ubase_assert(uref_block_extract(uref, 0, size, buf));
+    assert(!memcmp(buf, payload, size));
+
+    assert(ubase_check(uref_flow_get_random(uref)) == !i);
+    assert(ubase_check(uref_block_get_end(uref)) == (i == NB_RECORDS - 1));
+
+    uint64_t systime;
+    ubase_assert(uref_clock_get_cr_sys(uref, &systime));
+    assert(systime <= uclock_now(uclock));
+    if (!i)
+        replaysrc_test->first_systime = systime;
+    else if (speed.num)
+        assert(systime - replaysrc_test->first_systime ==
+               i * INTERVAL * speed.den / speed.num);
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            const char *def;
+            ubase_assert(uref_flow_get_def(flow_def, &def));
+            assert(!strcmp(def, "block.foo."));
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    struct replaysrc_test *replaysrc_test =
+        replaysrc_test_from_upipe(upipe);
+    assert(replaysrc_test->counter == NB_RECORDS);
+    upipe_clean(upipe);
+    free(replaysrc_test);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr replaysrc_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_SOURCE_END:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** writes a record to the capture file */
+static void write_record(int fd, uint64_t date, uint32_t flags,
+                         const char *payload)
+{
+    uint8_t header[UPIPE_CAPTURE_HEADER_SIZE];
+    struct upipe_capture_record record;
+    record.date = date;
+    record.size = strlen(payload);
+    record.flags = flags;
+    upipe_capture_write_header(header, &record);
+    assert(write(fd, header, sizeof(header)) == sizeof(header));
+    assert(write(fd, payload, record.size) == record.size);
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s (%s)\n", __DATE__, __TIME__, __FILE__);
+
+    /* capture file */
+    char path[] = "/tmp/upipe_replay_source_test.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    write_record(fd, ORIGIN, UPIPE_CAPTURE_FLOW_DEF, "block.foo.");
+    for (unsigned int i = 0; i < NB_RECORDS; i++) {
+        char payload[16];
+        snprintf(payload, sizeof(payload), "record %u", i);
+        uint32_t flags = 0;
+        if (!i)
+            flags |= UPIPE_CAPTURE_RANDOM;
+        if (i == NB_RECORDS - 1)
+            flags |= UPIPE_CAPTURE_END;
+        write_record(fd, ORIGIN + i * INTERVAL, flags, payload);
+    }
+    close(fd);
+
+    struct ev_loop *loop = ev_default_loop(0);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc(loop,
+                                    UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+
+    /* upipe env */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+
+    uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_uclock_alloc(logger, uclock);
+    assert(logger != NULL);
+
+    struct upipe_mgr *upipe_replaysrc_mgr = upipe_replaysrc_mgr_alloc();
+    assert(upipe_replaysrc_mgr != NULL);
+
+    /* original timing, twice as fast, as fast as possible */
+    const struct urational speeds[] = {
+        { .num = 1, .den = 1 }, { .num = 2, .den = 1 }, { .num = 0, .den = 1 }
+    };
+    for (unsigned int i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        speed = speeds[i];
+        struct upipe *replaysrc = upipe_void_alloc(upipe_replaysrc_mgr,
+                uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                 "replaysrc"));
+        assert(replaysrc != NULL);
+        struct urational current;
+        ubase_assert(upipe_replaysrc_get_speed(replaysrc, &current));
+        assert(current.num == 1 && current.den == 1);
+        ubase_assert(upipe_replaysrc_set_speed(replaysrc, speed));
+        ubase_assert(upipe_replaysrc_get_speed(replaysrc, &current));
+        assert(current.num == speed.num && current.den == speed.den);
+
+        struct upipe *replaysrc_test = upipe_void_alloc(&replaysrc_test_mgr,
+                uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                 "replaysrc_test"));
+        assert(replaysrc_test != NULL);
+        ubase_assert(upipe_set_output(replaysrc, replaysrc_test));
+        ubase_assert(upipe_set_uri(replaysrc, path));
+
+        ev_loop(loop, 0);
+
+        upipe_release(replaysrc);
+        test_free(replaysrc_test);
+    }
+
+    unlink(path);
+
+    /* clean everything */
+    upipe_mgr_release(upipe_replaysrc_mgr); // noop
+    uref_mgr_release(uref_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    upump_mgr_release(upump_mgr);
+    uclock_release(uclock);
+
+    ev_default_destroy();
+    return 0;
+}
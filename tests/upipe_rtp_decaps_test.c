@@ -62,6 +62,7 @@
 
 static unsigned int nb_packets = 0;
 static bool expect_discontinuity = false;
+static int expect_seqnum = -1;
 
 /** helper phony pipe */
 static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
@@ -84,6 +85,11 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     size = -1;
     ubase_assert(uref_block_read(uref, 0, &size, &buf));
     assert(size == SIZE - RTP_HEADER_SIZE);
+    if (expect_seqnum != -1) {
+        for (int i = 0; i < size; i++)
+            assert(buf[i] == (uint8_t)expect_seqnum);
+        expect_seqnum++;
+    }
     uref_block_unmap(uref, 0);
     assert(ubase_check(uref_flow_get_discontinuity(uref)) ==
            expect_discontinuity);
@@ -131,6 +137,24 @@ static struct upipe_mgr rtpd_test_mgr = {
     .upipe_control = test_control
 };
 
+/** sends a RTP packet filled with its sequence number */
+static void send_packet(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                        struct ubuf_mgr *block_mgr, uint16_t seqnum)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, RTP_TYPE_TS);
+    rtp_set_seqnum(buf, seqnum);
+    rtp_set_timestamp(buf, seqnum * 10);
+    memset(buf + RTP_HEADER_SIZE, seqnum, SIZE - RTP_HEADER_SIZE);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list args)
 {
@@ -222,6 +246,68 @@ int main(int argc, char **argv)
     upipe_input(rtpd, uref, NULL);
     assert(!nb_packets);
 
+    /* reorder */
+    ubase_assert(upipe_rtpd_set_reorder(rtpd, 4));
+    unsigned int reorder;
+    ubase_assert(upipe_rtpd_get_reorder(rtpd, &reorder));
+    assert(reorder == 4);
+    expect_discontinuity = true;
+    expect_seqnum = 100;
+    nb_packets = 1;
+    send_packet(rtpd, uref_mgr, block_mgr, 100);
+    assert(!nb_packets);
+    expect_discontinuity = false;
+    nb_packets = 2;
+    send_packet(rtpd, uref_mgr, block_mgr, 102);
+    assert(nb_packets == 2);
+    send_packet(rtpd, uref_mgr, block_mgr, 101);
+    assert(!nb_packets);
+    /* duplicate and late packets */
+    send_packet(rtpd, uref_mgr, block_mgr, 102);
+    send_packet(rtpd, uref_mgr, block_mgr, 99);
+
+    /* FEC recovery of 104 from 103 */
+    struct upipe *fec = upipe_void_alloc_sub(rtpd,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "rtpd fec"));
+    assert(fec != NULL);
+    uref = uref_block_alloc(uref_mgr, block_mgr, SIZE + 16);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, RTP_HEADER_SIZE + 16);
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, 96);
+    uint8_t *fec_header = buf + RTP_HEADER_SIZE;
+    fec_header[0] = 0;
+    fec_header[1] = 103;
+    uint32_t ts_recovery = (103 * 10) ^ (104 * 10);
+    fec_header[10] = ts_recovery >> 8;
+    fec_header[11] = ts_recovery;
+    fec_header[13] = 1;
+    fec_header[14] = 2;
+    memset(fec_header + 16, 103 ^ 104, SIZE - RTP_HEADER_SIZE);
+    uref_block_unmap(uref, 0);
+    upipe_input(fec, uref, NULL);
+
+    nb_packets = 1;
+    send_packet(rtpd, uref_mgr, block_mgr, 103);
+    assert(!nb_packets);
+    nb_packets = 5;
+    for (uint16_t seqnum = 105; seqnum < 109; seqnum++)
+        send_packet(rtpd, uref_mgr, block_mgr, seqnum);
+    assert(!nb_packets);
+    assert(expect_seqnum == 109);
+
+    /* flush */
+    nb_packets = 1;
+    send_packet(rtpd, uref_mgr, block_mgr, 110);
+    assert(nb_packets == 1);
+    expect_seqnum = 110;
+    expect_discontinuity = true;
+    ubase_assert(upipe_rtpd_set_reorder(rtpd, 0));
+    assert(!nb_packets);
+    upipe_release(fec);
+
     /* release pipe */
     upipe_release(rtpd);
     test_free(rtpd_test);
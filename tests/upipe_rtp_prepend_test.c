@@ -63,7 +63,7 @@
 #define UBUF_ALIGN_OFFSET   0
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
-#define PACKET_NUM 42
+#define PACKET_NUM 142
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -131,6 +131,8 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     size = RTP_HEADER_SIZE;
     uref_block_read(uref, 0, &size, &buf);
     assert(size == RTP_HEADER_SIZE);
+    assert(rtp_check_hdr(buf));
+    assert(rtp_get_type(buf) == RTP_TYPE_TS);
 
     /* seqnum */
     seqnum = rtp_get_seqnum(buf);
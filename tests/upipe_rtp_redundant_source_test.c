@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for rtpr pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_rtp_decaps.h>
+#include <upipe-modules/upipe_rtp_redundant_source.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define UBUF_ALIGN          32
+#define UBUF_ALIGN_OFFSET   0
+#define SIZE                1328
+#define NB_PACKETS          10
+
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+
+static unsigned int expect_seqnum = 0;
+static unsigned int nb_losses = 0;
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    const uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_read(uref, 0, &size, &buf));
+    assert(size == SIZE - RTP_HEADER_SIZE);
+    assert(buf[0] == expect_seqnum);
+    uref_block_unmap(uref, 0);
+    assert(!ubase_check(uref_flow_get_discontinuity(uref)));
+    expect_seqnum++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr rtpr_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_RTPR_LEG_LOSS: {
+            assert(va_arg(args, unsigned int) == UPIPE_RTPR_SIGNATURE);
+            uint64_t lost = va_arg(args, uint64_t);
+            uint64_t total = va_arg(args, uint64_t);
+            assert(lost == 1);
+            assert(total == 1);
+            nb_losses++;
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** sends a RTP packet filled with its sequence number to a leg */
+static void send_packet(struct upipe *leg, struct uref_mgr *uref_mgr,
+                        struct ubuf_mgr *block_mgr, uint16_t seqnum)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, RTP_TYPE_TS);
+    rtp_set_seqnum(buf, seqnum);
+    rtp_set_timestamp(buf, seqnum);
+    memset(buf + RTP_HEADER_SIZE, seqnum, SIZE - RTP_HEADER_SIZE);
+    uref_block_unmap(uref, 0);
+    upipe_input(leg, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *block_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, UBUF_ALIGN, UBUF_ALIGN_OFFSET);
+    assert(block_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_DEBUG);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe_mgr *upipe_rtpr_mgr = upipe_rtpr_mgr_alloc();
+    assert(upipe_rtpr_mgr != NULL);
+    struct upipe *rtpr = upipe_void_alloc(upipe_rtpr_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "rtpr"));
+    assert(rtpr != NULL);
+    ubase_assert(upipe_rtpd_set_reorder(rtpr, 4));
+
+    struct upipe *rtpr_test = upipe_void_alloc(&rtpr_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "rtpr test"));
+    assert(rtpr_test != NULL);
+    ubase_assert(upipe_set_output(rtpr, rtpr_test));
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(flow_def != NULL);
+    struct upipe *legs[2];
+    for (int i = 0; i < 2; i++) {
+        legs[i] = upipe_void_alloc_sub(rtpr,
+                uprobe_pfx_alloc_va(uprobe_use(uprobe_stdio),
+                                    UPROBE_LOG_LEVEL, "leg %d", i));
+        assert(legs[i] != NULL);
+        ubase_assert(upipe_set_flow_def(legs[i], flow_def));
+    }
+    uref_free(flow_def);
+
+    /* leg 0 loses packet 3, leg 1 loses packet 1 */
+    for (uint16_t seqnum = 0; seqnum < NB_PACKETS; seqnum++) {
+        if (seqnum != 3)
+            send_packet(legs[0], uref_mgr, block_mgr, seqnum);
+        if (seqnum != 1)
+            send_packet(legs[1], uref_mgr, block_mgr, seqnum);
+    }
+    assert(expect_seqnum == NB_PACKETS);
+    assert(nb_losses == 2);
+
+    for (int i = 0; i < 2; i++) {
+        uint64_t received, lost;
+        ubase_assert(upipe_rtpr_leg_get_stats(legs[i], &received, &lost));
+        assert(received == NB_PACKETS - 1);
+        assert(lost == 1);
+        upipe_release(legs[i]);
+    }
+
+    upipe_release(rtpr);
+    test_free(rtpr_test);
+
+    upipe_mgr_release(upipe_rtpr_mgr);
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(block_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
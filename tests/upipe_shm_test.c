@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for shared memory sink and source pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/umem_shm.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe/urequest.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_shm_sink.h>
+#include <upipe-modules/upipe_shm_source.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <ev.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPUMP_POOL 0
+#define UPUMP_BLOCKER_POOL 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static unsigned int nb_blocks = 0;
+static unsigned int nb_pics = 0;
+static unsigned int nb_flow_defs = 0;
+static unsigned int nb_ends = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_SOURCE_END:
+            nb_ends++;
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    assert(uref->ubuf != NULL);
+    uint64_t duration;
+    ubase_assert(uref_clock_get_duration(uref, &duration));
+
+    if (uref->ubuf->mgr->signature == UBUF_ALLOC_BLOCK) {
+        static const char *contents[] = { "hello", "world", "abcd" };
+        assert(nb_blocks < 3);
+        assert(duration == nb_blocks);
+        size_t size;
+        ubase_assert(uref_block_size(uref, &size));
+        assert(size == strlen(contents[nb_blocks]));
+        uint8_t buffer[size];
+        ubase_assert(uref_block_extract(uref, 0, size, buffer));
+        assert(!memcmp(buffer, contents[nb_blocks], size));
+        /* buffers point to the shared memory, and are writable */
+        int write_size = -1;
+        uint8_t *w;
+        ubase_assert(uref_block_write(uref, 0, &write_size, &w));
+        uref_block_unmap(uref, 0);
+        nb_blocks++;
+    } else {
+        assert(duration == 42);
+        size_t hsize, vsize;
+        ubase_assert(uref_pic_size(uref, &hsize, &vsize, NULL));
+        assert(hsize == 16);
+        assert(vsize == 8);
+        const char *chromas[] = { "y8", "u8", "v8" };
+        for (int i = 0; i < 3; i++) {
+            const uint8_t *r;
+            size_t stride;
+            uint8_t vsub;
+            ubase_assert(uref_pic_plane_size(uref, chromas[i], &stride,
+                                             NULL, &vsub, NULL));
+            ubase_assert(uref_pic_plane_read(uref, chromas[i], 0, 0, -1, -1,
+                                             &r));
+            for (int y = 0; y < 8 / vsub; y++)
+                assert(r[y * stride] == i * 16 + y);
+            uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
+        }
+        nb_pics++;
+    }
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            const char *def;
+            ubase_assert(uref_flow_get_def(flow_def, &def));
+            assert(!strcmp(def, "block.foo.") || !strcmp(def, "pic."));
+            nb_flow_defs++;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+static struct ubuf_mgr *provided_mgr = NULL;
+
+/** answer of the sink to our ubuf manager request */
+static int provide_ubuf_mgr(struct urequest *urequest, va_list args)
+{
+    struct ubuf_mgr *ubuf_mgr = va_arg(args, struct ubuf_mgr *);
+    struct uref *flow_format = va_arg(args, struct uref *);
+    assert(ubuf_mgr != NULL);
+    ubuf_mgr_release(provided_mgr);
+    provided_mgr = ubuf_mgr;
+    uref_free(flow_format);
+    return UBASE_ERR_NONE;
+}
+
+/** requests a ubuf manager allocating in the arena from the sink */
+static void request_ubuf_mgr(struct upipe *shmsink, struct uref *flow_def)
+{
+    struct urequest request;
+    urequest_init_ubuf_mgr(&request, uref_dup(flow_def), provide_ubuf_mgr,
+                           NULL);
+    ubase_assert(upipe_register_request(shmsink, &request));
+    ubase_assert(upipe_unregister_request(shmsink, &request));
+    urequest_clean(&request);
+    assert(provided_mgr != NULL);
+}
+
+static struct uref *alloc_block(struct uref_mgr *uref_mgr,
+                                struct ubuf_mgr *ubuf_mgr,
+                                const char *content, uint64_t duration)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, strlen(content));
+    assert(uref != NULL);
+    int size = -1;
+    uint8_t *w;
+    ubase_assert(uref_block_write(uref, 0, &size, &w));
+    memcpy(w, content, size);
+    uref_block_unmap(uref, 0);
+    ubase_assert(uref_clock_set_duration(uref, duration));
+    return uref;
+}
+
+int main(int argc, char *argv[])
+{
+    struct ev_loop *loop = ev_default_loop(0);
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc(loop, UPUMP_POOL,
+                                                     UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    struct umem_mgr *shm_mgr = umem_shm_mgr_alloc(256, 4, 16, 16, 16, 16);
+    assert(shm_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct upipe *test = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(test != NULL);
+
+    struct upipe_mgr *upipe_shmsink_mgr = upipe_shmsink_mgr_alloc();
+    assert(upipe_shmsink_mgr != NULL);
+    struct upipe_mgr *upipe_shmsrc_mgr = upipe_shmsrc_mgr_alloc();
+    assert(upipe_shmsrc_mgr != NULL);
+
+    /* blocks */
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+    struct upipe *shmsrc = upipe_shmsrc_alloc(upipe_shmsrc_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "shmsrc block"), fds[1]);
+    assert(shmsrc != NULL);
+    ubase_assert(upipe_set_output(shmsrc, test));
+    struct upipe *shmsink = upipe_shmsink_alloc(upipe_shmsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "shmsink block"), shm_mgr, fds[0]);
+    assert(shmsink != NULL);
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "foo.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(shmsink, flow_def));
+    struct uref *sound_flow_def = uref_sibling_alloc_control(flow_def);
+    assert(sound_flow_def != NULL);
+    ubase_assert(uref_flow_set_def(sound_flow_def, "sound.s16."));
+    ubase_nassert(upipe_set_flow_def(shmsink, sound_flow_def));
+    uref_free(sound_flow_def);
+    request_ubuf_mgr(shmsink, flow_def);
+    uref_free(flow_def);
+
+    /* passed by reference */
+    upipe_input(shmsink, alloc_block(uref_mgr, provided_mgr, "hello", 0),
+                NULL);
+    /* copied */
+    upipe_input(shmsink, alloc_block(uref_mgr, ubuf_mgr, "world", 1), NULL);
+    /* two segments passed by reference */
+    struct uref *uref = alloc_block(uref_mgr, provided_mgr, "ab", 2);
+    struct uref *uref2 = alloc_block(uref_mgr, provided_mgr, "cd", 2);
+    uref_block_append(uref, uref_detach_ubuf(uref2));
+    uref_free(uref2);
+    upipe_input(shmsink, uref, NULL);
+    upipe_release(shmsink);
+    ubuf_mgr_release(provided_mgr);
+    provided_mgr = NULL;
+
+    /* pictures */
+    assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+    struct upipe *shmsrc_pic = upipe_shmsrc_alloc(upipe_shmsrc_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "shmsrc pic"), fds[1]);
+    assert(shmsrc_pic != NULL);
+    ubase_assert(upipe_set_output(shmsrc_pic, test));
+    shmsink = upipe_shmsink_alloc(upipe_shmsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "shmsink pic"), shm_mgr, fds[0]);
+    assert(shmsink != NULL);
+
+    flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
+    ubase_assert(upipe_set_flow_def(shmsink, flow_def));
+    request_ubuf_mgr(shmsink, flow_def);
+    uref_free(flow_def);
+
+    uref = uref_pic_alloc(uref_mgr, provided_mgr, 16, 8);
+    assert(uref != NULL);
+    const char *chromas[] = { "y8", "u8", "v8" };
+    for (int i = 0; i < 3; i++) {
+        uint8_t *w;
+        size_t stride;
+        uint8_t vsub;
+        ubase_assert(uref_pic_plane_size(uref, chromas[i], &stride,
+                                         NULL, &vsub, NULL));
+        ubase_assert(uref_pic_plane_write(uref, chromas[i], 0, 0, -1, -1,
+                                          &w));
+        for (int y = 0; y < 8 / vsub; y++)
+            w[y * stride] = i * 16 + y;
+        uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
+    }
+    ubase_assert(uref_clock_set_duration(uref, 42));
+    upipe_input(shmsink, uref, NULL);
+    upipe_release(shmsink);
+    ubuf_mgr_release(provided_mgr);
+
+    ev_loop(loop, 0);
+
+    assert(nb_flow_defs == 2);
+    assert(nb_blocks == 3);
+    assert(nb_pics == 1);
+    assert(nb_ends == 2);
+
+    upipe_release(shmsrc);
+    upipe_release(shmsrc_pic);
+    test_free(test);
+
+    /* all chunks went back to the arena */
+    struct umem umems[16];
+    for (int i = 0; i < 16; i++)
+        assert(umem_alloc(shm_mgr, &umems[i], 256));
+    for (int i = 0; i < 16; i++)
+        umem_free(&umems[i]);
+
+    umem_mgr_release(shm_mgr);
+    upump_mgr_release(upump_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    ev_default_destroy();
+    return 0;
+}
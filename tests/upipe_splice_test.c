@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for splice pipe
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_splice.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define DURATION (UCLOCK_FREQ / 25)
+#define PROG_A 1000
+#define PROG_B UINT32_MAX
+#define SYS 5000
+
+static unsigned int nb_packets = 0;
+static uint64_t next_dts = PROG_A;
+static const char *expected_def = "block.a.";
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    uint64_t dts, dts_sys;
+    ubase_assert(uref_clock_get_dts_prog(uref, &dts));
+    ubase_assert(uref_clock_get_dts_sys(uref, &dts_sys));
+    /* the program clock of a keeps running across splices */
+    assert(dts == dts_sys - SYS + PROG_A);
+    assert(dts >= next_dts);
+    next_dts = dts + DURATION;
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            const char *def;
+            ubase_assert(uref_flow_get_def(flow_def, &def));
+            assert(!strcmp(def, expected_def));
+            return UBASE_ERR_NONE;
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** sends frame n of a source, with a random access point every 3 frames */
+static void send_frame(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                       uint64_t prog, unsigned int n)
+{
+    struct uref *uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    if (!(n % 3))
+        ubase_assert(uref_flow_set_random(uref));
+    uref_clock_set_pts_orig(uref, n * DURATION);
+    uref_clock_set_dts_prog(uref, prog + n * DURATION);
+    uref_clock_set_dts_sys(uref, SYS + n * DURATION);
+    uref_clock_set_duration(uref, DURATION);
+    upipe_input(upipe, uref, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(upipe_sink != NULL);
+
+    struct upipe_mgr *upipe_splice_mgr = upipe_splice_mgr_alloc();
+    assert(upipe_splice_mgr != NULL);
+    struct upipe *upipe_splice = upipe_void_alloc(upipe_splice_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "splice"));
+    assert(upipe_splice != NULL);
+    ubase_assert(upipe_set_output(upipe_splice, upipe_sink));
+
+    struct upipe *upipe_a = upipe_void_alloc_sub(upipe_splice,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "splice a"));
+    assert(upipe_a != NULL);
+    struct upipe *upipe_b = upipe_void_alloc_sub(upipe_splice,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "splice b"));
+    assert(upipe_b != NULL);
+
+    struct uref *uref;
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "block.a."));
+    ubase_assert(upipe_set_flow_def(upipe_a, uref));
+    ubase_assert(uref_flow_set_def(uref, "block.b."));
+    ubase_assert(upipe_set_flow_def(upipe_b, uref));
+    ubase_assert(uref_flow_set_def(uref, "pic."));
+    ubase_nassert(upipe_set_flow_def(upipe_b, uref));
+    uref_free(uref);
+
+    struct upipe *current;
+    ubase_assert(upipe_splice_get_current_input(upipe_splice, &current));
+    assert(current == NULL);
+
+    ubase_assert(upipe_splice_sub_set_input(upipe_a, 0));
+    ubase_assert(upipe_splice_get_current_input(upipe_splice, &current));
+    assert(current == upipe_a);
+
+    unsigned int n;
+    for (n = 0; n < 6; n++) {
+        send_frame(upipe_a, uref_mgr, PROG_A, n);
+        send_frame(upipe_b, uref_mgr, PROG_B, n);
+    }
+    assert(nb_packets == 6);
+
+    /* frame 9 is the first random access point after the splice time */
+    ubase_assert(upipe_splice_sub_set_input(upipe_b, 7 * DURATION));
+    expected_def = "block.b.";
+    for ( ; n < 12; n++) {
+        send_frame(upipe_a, uref_mgr, PROG_A, n);
+        send_frame(upipe_b, uref_mgr, PROG_B, n);
+    }
+    ubase_assert(upipe_splice_get_current_input(upipe_splice, &current));
+    assert(current == upipe_b);
+    assert(nb_packets == 12);
+
+    /* back to a at the next random access point of b, frame 12, and
+     * output from the next random access point of a, frame 15 */
+    ubase_assert(upipe_splice_sub_set_input(upipe_a, 0));
+    expected_def = "block.a.";
+    for ( ; n < 18; n++) {
+        send_frame(upipe_a, uref_mgr, PROG_A, n);
+        send_frame(upipe_b, uref_mgr, PROG_B, n);
+    }
+    ubase_assert(upipe_splice_get_current_input(upipe_splice, &current));
+    assert(current == upipe_a);
+    assert(nb_packets == 15);
+
+    upipe_release(upipe_a);
+    upipe_release(upipe_b);
+    upipe_release(upipe_splice);
+    upipe_mgr_release(upipe_splice_mgr); // nop
+
+    test_free(upipe_sink);
+
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
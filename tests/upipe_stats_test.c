@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for pipe statistics
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_skip.h>
+#include <upipe-modules/upipe_null.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    5
+#define UREF_POOL_DEPTH     5
+#define UBUF_POOL_DEPTH     5
+#define UBUF_ALIGN          32
+#define UBUF_ALIGN_OFFSET   0
+
+#define ITERATIONS  50
+#define SIZE        1024
+#define OFFSET      8
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static struct upipe *skip = NULL;
+static struct upipe *null = NULL;
+static struct upipe_stats skip_stats;
+static struct upipe_stats null_stats;
+static unsigned int nb_stats = 0;
+static bool handle_stats = true;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_STATS: {
+            const struct upipe_stats *stats =
+                va_arg(args, const struct upipe_stats *);
+            if (!handle_stats)
+                return UBASE_ERR_UNHANDLED;
+            if (upipe == skip)
+                skip_stats = *stats;
+            else if (upipe == null)
+                null_stats = *stats;
+            else
+                assert(0);
+            nb_stats++;
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
+    int i;
+
+    /* uref and mem management */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH, umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *block_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr,
+            UBUF_ALIGN,
+            UBUF_ALIGN_OFFSET);
+    assert(block_mgr);
+
+    /* uprobe stuff */
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_DEBUG);
+    assert(uprobe_stdio != NULL);
+
+    /* build pipes */
+    struct upipe_mgr *upipe_skip_mgr = upipe_skip_mgr_alloc();
+    assert(upipe_skip_mgr);
+    skip = upipe_void_alloc(upipe_skip_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "skip"));
+    assert(skip);
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "foo.");
+    assert(uref);
+    ubase_assert(upipe_set_flow_def(skip, uref));
+    uref_free(uref);
+    ubase_assert(upipe_skip_set_offset(skip, OFFSET));
+
+    struct upipe_mgr *upipe_null_mgr = upipe_null_mgr_alloc();
+    assert(upipe_null_mgr);
+    null = upipe_void_alloc(upipe_null_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "null"));
+    assert(null);
+    ubase_assert(upipe_set_output(skip, null));
+
+    assert(skip->stats == NULL);
+    ubase_nassert(upipe_stats_report(skip));
+    ubase_assert(upipe_stats_enable(skip, 0));
+    ubase_assert(upipe_stats_enable(null, 0));
+
+    /* urefs have entered the pipeline 3 ms ago */
+    struct uclock *uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+    uint64_t ingress = uclock_now(uclock) - UCLOCK_FREQ * 3 / 1000;
+    uclock_release(uclock);
+    for (i = 0; i < ITERATIONS; i++) {
+        uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+        assert(uref != NULL);
+        uref_clock_set_ingress(uref, ingress);
+        upipe_input(skip, uref, NULL);
+    }
+    /* no automatic report without a period */
+    assert(nb_stats == 0);
+
+    ubase_assert(upipe_stats_report(skip));
+    ubase_assert(upipe_stats_report(null));
+    assert(nb_stats == 2);
+
+    assert(skip_stats.inputs == ITERATIONS);
+    assert(skip_stats.octets == ITERATIONS * SIZE);
+    assert(skip_stats.outputs == ITERATIONS);
+    assert(skip_stats.max_time <= skip_stats.time);
+    assert(skip_stats.self_time <= skip_stats.time);
+    assert(skip_stats.time <= skip_stats.duration);
+
+    assert(null_stats.inputs == ITERATIONS);
+    assert(null_stats.octets == ITERATIONS * (SIZE - OFFSET));
+    assert(null_stats.outputs == 0);
+    assert(null_stats.self_time == null_stats.time);
+    /* latencies of more than 2 ms are not in the first buckets */
+    uint64_t count = 0;
+    for (i = 0; i < UPIPE_STATS_LATENCY_BUCKETS; i++)
+        count += null_stats.latency[i];
+    assert(count == ITERATIONS);
+    assert(null_stats.latency[0] == 0);
+    assert(null_stats.latency[1] == 0);
+    assert(null_stats.latency_sum >= ITERATIONS * UCLOCK_FREQ * 3 / 1000);
+    /* time spent in the null pipe is not accounted to skip */
+    assert(skip_stats.self_time + null_stats.time <= skip_stats.time);
+
+    /* counters are reset after a report */
+    ubase_assert(upipe_stats_report(skip));
+    assert(nb_stats == 3);
+    assert(skip_stats.inputs == 0);
+    assert(skip_stats.octets == 0);
+    assert(skip_stats.time == 0);
+    assert(skip_stats.latency[2] == 0);
+    assert(skip_stats.latency_sum == 0);
+
+    /* automatic reports */
+    ubase_assert(upipe_stats_enable(null, 1));
+    uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    upipe_input(skip, uref, NULL);
+    assert(nb_stats == 4);
+    assert(null_stats.inputs == 1);
+
+    /* unhandled reports are printed by uprobe_pfx */
+    handle_stats = false;
+    ubase_assert(upipe_stats_report(skip));
+    assert(nb_stats == 4);
+
+    upipe_stats_disable(null);
+    assert(null->stats == NULL);
+    uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    upipe_input(skip, uref, NULL);
+    assert(nb_stats == 4);
+
+    upipe_release(skip);
+    upipe_release(null);
+
+    upipe_mgr_release(upipe_skip_mgr); // no-op
+    upipe_mgr_release(upipe_null_mgr); // no-op
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(block_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
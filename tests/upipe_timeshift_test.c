@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for timeshift pipe
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_timeshift.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define BLOCK_SIZE 1316
+#define PERIOD 1000
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_SOURCE_END:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** phony pipe checking the received blocks */
+struct test_pipe {
+    /** number of the next expected block */
+    unsigned int next;
+    /** expected delay */
+    uint64_t delay;
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    test_pipe->next = 0;
+    test_pipe->delay = 0;
+    upipe_init(&test_pipe->upipe, mgr, uprobe);
+    return &test_pipe->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    assert(uref != NULL);
+    uint64_t cr_sys;
+    ubase_assert(uref_clock_get_cr_sys(uref, &cr_sys));
+    assert(cr_sys == test_pipe->next * PERIOD + test_pipe->delay);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == BLOCK_SIZE);
+    uint8_t buffer[BLOCK_SIZE];
+    ubase_assert(uref_block_extract(uref, 0, BLOCK_SIZE, buffer));
+    for (int i = 0; i < BLOCK_SIZE; i++)
+        assert(buffer[i] == (uint8_t)(test_pipe->next + i));
+    uref_free(uref);
+    test_pipe->next++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    upipe_clean(upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** sends blocks to a timeshift pipe */
+static void test_send(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                      struct ubuf_mgr *ubuf_mgr, unsigned int from,
+                      unsigned int to)
+{
+    for (unsigned int i = from; i < to; i++) {
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, BLOCK_SIZE);
+        assert(uref != NULL);
+        uint8_t *buffer;
+        int size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        assert(size == BLOCK_SIZE);
+        for (int j = 0; j < BLOCK_SIZE; j++)
+            buffer[j] = i + j;
+        ubase_assert(uref_block_unmap(uref, 0));
+        uref_clock_set_cr_sys(uref, i * PERIOD);
+        upipe_input(upipe, uref, NULL);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe *sink_live = upipe_void_alloc(&test_mgr,
+                                               uprobe_use(uprobe_stdio));
+    assert(sink_live != NULL);
+    struct upipe *sink_disk = upipe_void_alloc(&test_mgr,
+                                               uprobe_use(uprobe_stdio));
+    assert(sink_disk != NULL);
+    struct upipe *sink_ram = upipe_void_alloc(&test_mgr,
+                                              uprobe_use(uprobe_stdio));
+    assert(sink_ram != NULL);
+
+    struct upipe_mgr *upipe_timeshift_mgr = upipe_timeshift_mgr_alloc();
+    assert(upipe_timeshift_mgr != NULL);
+    struct upipe *upipe_timeshift = upipe_void_alloc(upipe_timeshift_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "timeshift"));
+    assert(upipe_timeshift != NULL);
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_timeshift, uref));
+    uref_free(uref);
+
+    char path[] = "upipe_timeshift_test.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+    ubase_assert(upipe_timeshift_open(upipe_timeshift, path, 128 * 1024,
+                                      1024 * 1024, 4096));
+
+    struct upipe *live = upipe_void_alloc_sub(upipe_timeshift,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "live"));
+    assert(live != NULL);
+    ubase_assert(upipe_set_output(live, sink_live));
+    struct upipe *disk = upipe_void_alloc_sub(upipe_timeshift,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "disk"));
+    assert(disk != NULL);
+    ubase_assert(upipe_set_output(disk, sink_disk));
+    struct upipe *ram = upipe_void_alloc_sub(upipe_timeshift,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ram"));
+    assert(ram != NULL);
+    ubase_assert(upipe_set_output(ram, sink_ram));
+
+    struct test_pipe *test_live = container_of(sink_live, struct test_pipe,
+                                               upipe);
+    struct test_pipe *test_disk = container_of(sink_disk, struct test_pipe,
+                                               upipe);
+    struct test_pipe *test_ram = container_of(sink_ram, struct test_pipe,
+                                              upipe);
+
+    /* all readers follow the live flow */
+    test_send(upipe_timeshift, uref_mgr, ubuf_mgr, 0, 600);
+    assert(test_live->next == 600);
+    assert(test_disk->next == 600);
+    assert(test_ram->next == 600);
+    uint64_t start, end;
+    ubase_assert(upipe_timeshift_get_range(upipe_timeshift, &start, &end));
+    assert(start == 0);
+    assert(end == 599 * PERIOD);
+
+    /* seek back out of the RAM window, and inside it */
+    ubase_assert(upipe_timeshift_sub_seek(disk, 100 * PERIOD));
+    uint64_t delay;
+    ubase_assert(upipe_timeshift_sub_get_delay(disk, &delay));
+    assert(delay == 499 * PERIOD);
+    test_disk->next = 100;
+    test_disk->delay = delay;
+    ubase_assert(upipe_timeshift_sub_seek(ram, 550 * PERIOD + 1));
+    ubase_assert(upipe_timeshift_sub_get_delay(ram, &delay));
+    assert(delay == 48 * PERIOD);
+    test_ram->next = 551;
+    test_ram->delay = delay;
+
+    test_send(upipe_timeshift, uref_mgr, ubuf_mgr, 600, 800);
+    assert(test_live->next == 800);
+    assert(test_disk->next == 301);
+    assert(test_ram->next == 752);
+
+    /* back to live */
+    ubase_assert(upipe_timeshift_sub_seek(disk, UINT64_MAX));
+    ubase_assert(upipe_timeshift_sub_get_delay(disk, &delay));
+    assert(delay == 0);
+    test_disk->next = 800;
+    test_disk->delay = 0;
+    test_send(upipe_timeshift, uref_mgr, ubuf_mgr, 800, 810);
+    assert(test_live->next == 810);
+    assert(test_disk->next == 810);
+    assert(test_ram->next == 762);
+    unlink(path);
+
+    upipe_release(live);
+    upipe_release(disk);
+    upipe_release(ram);
+    upipe_release(upipe_timeshift);
+    upipe_mgr_release(upipe_timeshift_mgr); // nop
+
+    test_free(sink_live);
+    test_free(sink_disk);
+    test_free(sink_ram);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
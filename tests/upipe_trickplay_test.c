@@ -263,6 +263,66 @@ int main(int argc, char *argv[])
     assert(count_subpic == 0);
     count_pic = 0;
 
+    /* second program with its own timeline */
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "pic."));
+
+    struct upipe *upipe_sink_pic2 = upipe_flow_alloc(&trickp_test_mgr,
+                                                     uprobe_use(logger), uref);
+    assert(upipe_sink_pic2 != NULL);
+
+    struct upipe *upipe_trickp_pic2 = upipe_void_alloc_sub(upipe_trickp,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "trickp pic2"));
+    assert(upipe_trickp_pic2 != NULL);
+    ubase_assert(upipe_trickp_sub_set_program(upipe_trickp_pic2, 2));
+    uint64_t program;
+    ubase_assert(upipe_trickp_sub_get_program(upipe_trickp_pic2, &program));
+    assert(program == 2);
+    ubase_assert(upipe_set_flow_def(upipe_trickp_pic2, uref));
+    uref_free(uref);
+    ubase_assert(upipe_set_output(upipe_trickp_pic2, upipe_sink_pic2));
+
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_pts_prog(uref, 1000);
+    upipe_input(upipe_trickp_pic2, uref, NULL);
+    assert(count_pic == 42);
+    count_pic = 0;
+
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_pts_prog(uref, 1005);
+    upipe_input(upipe_trickp_pic2, uref, NULL);
+    assert(count_pic == 47);
+    count_pic = 0;
+
+    /* the first program keeps its own timeline */
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_pts_prog(uref, (uint64_t)UINT32_MAX + 3);
+    upipe_input(upipe_trickp_sound, uref, NULL);
+    assert(count_pic == 0);
+    assert(count_sound == 45);
+    count_sound = 0;
+
+    /* unpaced mode stamps buffers with the current time */
+    ubase_assert(upipe_trickp_set_unpaced(upipe_trickp, true));
+    int unpaced;
+    ubase_assert(upipe_trickp_get_unpaced(upipe_trickp, &unpaced));
+    assert(unpaced);
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_pts_prog(uref, (uint64_t)UINT32_MAX + 100);
+    upipe_input(upipe_trickp_pic, uref, NULL);
+    assert(count_pic == 42);
+    count_pic = 0;
+    ubase_assert(upipe_trickp_set_unpaced(upipe_trickp, false));
+
+    upipe_release(upipe_trickp_pic2);
+    test_free(upipe_sink_pic2);
+
     upipe_release(upipe_trickp);
     upipe_release(upipe_trickp_pic);
     upipe_release(upipe_trickp_sound);
@@ -50,6 +50,7 @@
 #include <upipe/uref_std.h>
 #include <upipe/upipe.h>
 #include <upipe-ts/upipe_ts_aggregate.h>
+#include <upipe-ts/upipe_ts_tstd.h>
 #include <upipe-ts/upipe_ts_mux.h>
 
 #include <stdbool.h>
@@ -71,6 +72,8 @@
 
 static unsigned int nb_packets = 0;
 static unsigned int nb_padding = 0;
+static unsigned int nb_aggregates = 0;
+static uint64_t last_cr_sys = UINT64_MAX;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -105,15 +108,18 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(uref != NULL);
     const uint8_t *buffer;
     size_t size = 0;
-    int pos = 0, len = -1;
+    int pos = 0, len;
     ubase_assert(uref_block_size(uref, &size));
     upipe_dbg_va(upipe, "received packet of size %zu", size);
+    assert(size % TS_SIZE == 0);
 
     while (size > 0) {
+        len = TS_SIZE;
         ubase_assert(uref_block_read(uref, pos, &len, &buffer));
+        assert(len == TS_SIZE);
         assert(ts_validate(buffer));
         bool padding = ts_get_pid(buffer) == 8191;
-        uref_block_unmap(uref, 0);
+        uref_block_unmap(uref, pos);
         size -= len;
         pos += len;
         if (padding)
@@ -121,7 +127,13 @@ static void test_input(struct upipe *upipe, struct uref *uref,
         else
             nb_packets--;
     }
+    uint64_t cr_sys;
+    if (ubase_check(uref_clock_get_cr_sys(uref, &cr_sys))) {
+        assert(last_cr_sys == UINT64_MAX || cr_sys > last_cr_sys);
+        last_cr_sys = cr_sys;
+    }
     uref_free(uref);
+    nb_aggregates++;
     upipe_dbg_va(upipe, "nb_packets %u padding %u", nb_packets, nb_padding);
 }
 
@@ -205,6 +217,7 @@ int main(int argc, char *argv[])
 
     /* valid TS packets */
     nb_packets = PACKETS_NUM;
+    last_cr_sys = UINT64_MAX;
     nb_padding = ((PACKETS_NUM + TS_PER_PACKET - 1) / TS_PER_PACKET) * TS_PER_PACKET - PACKETS_NUM;
     for (i = 0; i < PACKETS_NUM; i++) {
         uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
@@ -239,6 +252,7 @@ int main(int argc, char *argv[])
 
     /* valid TS packets */
     nb_packets = PACKETS_NUM;
+    last_cr_sys = UINT64_MAX;
     nb_padding = (PACKETS_NUM - 1) * (TS_PER_PACKET - 1) - 1;
     for (i = 0; i < PACKETS_NUM; i++) {
         uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
@@ -275,6 +289,7 @@ int main(int argc, char *argv[])
 
     /* valid TS packets */
     nb_packets = PACKETS_NUM;
+    last_cr_sys = UINT64_MAX;
     nb_padding = ((PACKETS_NUM + TS_PER_PACKET - 1) / TS_PER_PACKET) * TS_PER_PACKET - PACKETS_NUM;
     for (i = 0; i < PACKETS_NUM; i++) {
         uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
@@ -297,6 +312,97 @@ int main(int argc, char *argv[])
     assert(!nb_packets);
     assert(!nb_padding);
 
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+
+    upipe_ts_agg = upipe_void_alloc(upipe_ts_agg_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "aggregate"));
+    assert(upipe_ts_agg != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_agg, uref));
+    ubase_assert(upipe_set_output(upipe_ts_agg, upipe_sink));
+    uref_free(uref);
+    ubase_assert(upipe_ts_mux_set_mode(upipe_ts_agg, UPIPE_TS_MUX_MODE_CBR));
+    ubase_assert(upipe_ts_mux_set_octetrate(upipe_ts_agg, TS_SIZE * TS_PER_PACKET * 10));
+    ubase_nassert(upipe_ts_agg_set_burst(upipe_ts_agg, 0));
+    ubase_assert(upipe_ts_agg_set_burst(upipe_ts_agg, 4));
+    unsigned int burst;
+    ubase_assert(upipe_ts_agg_get_burst(upipe_ts_agg, &burst));
+    assert(burst == 4);
+
+    /* same as above, output in bursts of 4 aggregates */
+    nb_packets = PACKETS_NUM;
+    nb_padding = (PACKETS_NUM - 1) * (TS_PER_PACKET - 1) - 1;
+    nb_aggregates = 0;
+    last_cr_sys = UINT64_MAX;
+    for (i = 0; i < PACKETS_NUM; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+        size = -1;
+        uref_block_write(uref, 0, &size, &buffer);
+        assert(size == TS_SIZE);
+        ts_pad(buffer);
+        ts_set_pid(buffer, 8190);
+        uref_block_unmap(uref, 0);
+        uref_clock_set_dts_sys(uref, (UCLOCK_FREQ / 10) + (UCLOCK_FREQ / 10) * i);
+        uref_clock_set_dts_prog(uref, (UCLOCK_FREQ / 10) + (UCLOCK_FREQ / 10) * i);
+        upipe_input(upipe_ts_agg, uref, NULL);
+        assert(nb_aggregates % 4 == 0);
+    }
+
+    /* flush */
+    upipe_release(upipe_ts_agg);
+
+    printf("nb_packets: %u %u\n", nb_packets, nb_padding);
+    assert(!nb_packets);
+    assert(!nb_padding);
+
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+
+    upipe_ts_agg = upipe_void_alloc(upipe_ts_agg_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "aggregate"));
+    assert(upipe_ts_agg != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_agg, uref));
+    ubase_assert(upipe_set_output(upipe_ts_agg, upipe_sink));
+    uref_free(uref);
+    ubase_assert(upipe_ts_mux_set_mode(upipe_ts_agg, UPIPE_TS_MUX_MODE_CBR));
+    ubase_assert(upipe_ts_mux_set_octetrate(upipe_ts_agg, TS_SIZE * TS_PER_PACKET * 10));
+    bool tstd;
+    ubase_assert(upipe_ts_agg_get_tstd(upipe_ts_agg, &tstd));
+    assert(!tstd);
+    ubase_assert(upipe_ts_agg_set_tstd(upipe_ts_agg, true));
+    ubase_assert(upipe_ts_agg_get_tstd(upipe_ts_agg, &tstd));
+    assert(tstd);
+
+    /* same as above, but the T-STD allows sending the packets right away,
+     * so that they fill the aggregates instead of padding */
+    nb_packets = PACKETS_NUM;
+    nb_padding = ((PACKETS_NUM + TS_PER_PACKET - 1) / TS_PER_PACKET) * TS_PER_PACKET - PACKETS_NUM;
+    last_cr_sys = UINT64_MAX;
+    for (i = 0; i < PACKETS_NUM; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+        size = -1;
+        uref_block_write(uref, 0, &size, &buffer);
+        assert(size == TS_SIZE);
+        ts_pad(buffer);
+        ts_set_pid(buffer, 8190);
+        uref_block_unmap(uref, 0);
+        uref_clock_set_dts_sys(uref, (UCLOCK_FREQ / 10) + (UCLOCK_FREQ / 10) * i);
+        uref_clock_set_dts_prog(uref, (UCLOCK_FREQ / 10) + (UCLOCK_FREQ / 10) * i);
+        ubase_assert(uref_ts_tstd_set_early_sys(uref, 0));
+        ubase_assert(uref_ts_tstd_set_tb_rate(uref,
+                                              TS_SIZE * TS_PER_PACKET * 20));
+        upipe_input(upipe_ts_agg, uref, NULL);
+    }
+
+    /* flush */
+    upipe_release(upipe_ts_agg);
+
+    printf("nb_packets: %u %u\n", nb_packets, nb_padding);
+    assert(!nb_packets);
+    assert(!nb_padding);
+
     /* release everything */
     upipe_mgr_release(upipe_ts_agg_mgr); // nop
 
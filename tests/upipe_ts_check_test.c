@@ -46,10 +46,12 @@
 #include <upipe/uref_std.h>
 #include <upipe/upipe.h>
 #include <upipe-ts/upipe_ts_check.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <assert.h>
@@ -96,7 +98,17 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(uref != NULL);
     size_t size;
     ubase_assert(uref_block_size(uref, &size));
-    assert(size == TS_SIZE);
+    unsigned int nb = 1;
+    if (ubase_check(uref_ts_bundle_get_nb(uref, &nb))) {
+        struct uref_ts_bundle_pkt pkts[nb];
+        ubase_assert(uref_ts_bundle_read(uref, 0, nb, pkts));
+        for (unsigned int i = 0; i < nb; i++) {
+            assert(pkts[i].pid == 8191 || pkts[i].pid == 68);
+            assert(pkts[i].payload == TS_HEADER_SIZE);
+        }
+    }
+    assert(size == nb * TS_SIZE);
+    assert(nb <= nb_packets);
 
     const uint8_t *buffer;
     int rsize = 1;
@@ -105,7 +117,7 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(ts_validate(buffer));
     uref_block_unmap(uref, 0);
     uref_free(uref);
-    nb_packets--;
+    nb_packets -= nb;
 }
 
 /** helper phony pipe */
@@ -215,6 +227,69 @@ int main(int argc, char *argv[])
     upipe_input(upipe_ts_check, uref, NULL);
     assert(!nb_packets);
 
+    bool bundle;
+    ubase_assert(upipe_ts_check_get_bundle(upipe_ts_check, &bundle));
+    assert(!bundle);
+    ubase_assert(upipe_ts_check_set_bundle(upipe_ts_check, true));
+    ubase_assert(upipe_ts_check_get_bundle(upipe_ts_check, &bundle));
+    assert(bundle);
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 7 * TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == 7 * TS_SIZE);
+    for (i = 0; i < 7; i++)
+        ts_pad(buffer + i * TS_SIZE);
+    buffer[3 * TS_SIZE] = 0xff;
+    uref_block_unmap(uref, 0);
+    nb_packets = 6;
+    upipe_input(upipe_ts_check, uref, NULL);
+    assert(!nb_packets);
+
+    uint64_t invalid, cc_errors, tei_errors;
+    ubase_assert(upipe_ts_check_get_stats(upipe_ts_check, &invalid,
+                                          &cc_errors, &tei_errors));
+    assert(invalid == 3);
+    assert(!cc_errors);
+    assert(!tei_errors);
+
+    /* continuity and transport errors, over two segments with a packet
+     * straddling them */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 4 * TS_SIZE + 100);
+    assert(uref != NULL);
+    struct uref *uref2 = uref_block_alloc(uref_mgr, ubuf_mgr,
+                                          4 * TS_SIZE - 100);
+    assert(uref2 != NULL);
+    uint8_t packets[8 * TS_SIZE];
+    static const uint8_t ccs[8] = { 0, 1, 1, 2, 4, 5, 6, 8 };
+    for (i = 0; i < 8; i++) {
+        uint8_t *ts = packets + i * TS_SIZE;
+        ts_pad(ts);
+        ts_set_pid(ts, 68);
+        ts_set_cc(ts, ccs[i]);
+    }
+    ts_set_transporterror(packets + 5 * TS_SIZE);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    memcpy(buffer, packets, size);
+    uref_block_unmap(uref, 0);
+    size = -1;
+    ubase_assert(uref_block_write(uref2, 0, &size, &buffer));
+    memcpy(buffer, packets + 4 * TS_SIZE + 100, size);
+    uref_block_unmap(uref2, 0);
+    ubase_assert(uref_block_append(uref, uref_detach_ubuf(uref2)));
+    uref_free(uref2);
+    nb_packets = 8;
+    upipe_input(upipe_ts_check, uref, NULL);
+    assert(!nb_packets);
+
+    ubase_assert(upipe_ts_check_get_stats(upipe_ts_check, &invalid,
+                                          &cc_errors, &tei_errors));
+    assert(invalid == 3);
+    assert(cc_errors == 2);
+    assert(tei_errors == 1);
+
     upipe_release(upipe_ts_check);
     upipe_mgr_release(upipe_ts_check_mgr); // nop
 
@@ -47,6 +47,7 @@
 #include <upipe/uref_std.h>
 #include <upipe/upipe.h>
 #include <upipe-ts/upipe_ts_decaps.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -115,6 +116,8 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(transporterror == uref_flow_get_error(uref));
     assert(discontinuity == uref_flow_get_discontinuity(uref));
     assert(start == uref_block_get_start(uref));
+    unsigned int nb;
+    ubase_nassert(uref_ts_bundle_get_nb(uref, &nb));
     uref_free(uref);
     nb_packets--;
 }
@@ -240,6 +243,34 @@ int main(int argc, char *argv[])
     assert(!nb_packets);
     assert(!pcr);
 
+    /* the payloads of a bundle are coalesced into one chunk */
+    struct uref_ts_bundle_pkt pkts[3];
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 3 * TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == 3 * TS_SIZE);
+    for (int i = 0; i < 3; i++) {
+        ts_init(buffer + i * TS_SIZE);
+        ts_set_cc(buffer + i * TS_SIZE, 4 + i);
+        ts_set_payload(buffer + i * TS_SIZE);
+        pkts[i].pcr = 0;
+        pkts[i].pid = 0;
+        pkts[i].cc = 4 + i;
+        pkts[i].flags = UREF_TS_BUNDLE_PAYLOAD;
+        pkts[i].payload = TS_HEADER_SIZE;
+    }
+    ts_set_unitstart(buffer);
+    pkts[0].flags |= UREF_TS_BUNDLE_UNITSTART;
+    uref_block_unmap(uref, 0);
+    ubase_assert(uref_ts_bundle_set(uref, pkts, 3));
+    start = UBASE_ERR_NONE;
+    discontinuity = UBASE_ERR_INVALID;
+    payload_size = 3 * (TS_SIZE - TS_HEADER_SIZE);
+    nb_packets++;
+    upipe_input(upipe_ts_decaps, uref, NULL);
+    assert(!nb_packets);
+
     upipe_release(upipe_ts_decaps);
     upipe_mgr_release(upipe_ts_decaps_mgr); // nop
 
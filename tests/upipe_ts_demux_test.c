@@ -92,6 +92,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_CLOCK_TS:
         case UPROBE_TS_SPLIT_ADD_PID:
         case UPROBE_TS_SPLIT_DEL_PID:
+        case UPROBE_TS_DEMUX_NEED_WORKER:
         case UPROBE_NEW_FLOW_DEF:
         case UPROBE_SOURCE_END:
             break;
@@ -141,6 +142,64 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** writes a PAT announcing a program, followed by a null packet */
+static void write_pat_bundle(uint8_t *buffer, uint16_t program)
+{
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 0);
+    ts_set_cc(buffer, 0);
+    ts_set_payload(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pat_init(payload);
+    pat_set_length(payload, PAT_PROGRAM_SIZE);
+    pat_set_tsid(payload, 42);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    uint8_t *pat_program = pat_get_program(payload, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, program);
+    patn_set_pid(pat_program, 42);
+    psi_set_crc(payload);
+    payload += PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE;
+    memset(payload, 0xff, buffer + TS_SIZE - payload);
+    ts_pad(buffer + TS_SIZE);
+}
+
+/** writes the PMT of a program with a video stream, followed by a null
+ * packet */
+static void write_pmt_bundle(uint8_t *buffer, uint16_t program)
+{
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 42);
+    ts_set_cc(buffer, 0);
+    ts_set_payload(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pmt_init(payload);
+    pmt_set_length(payload, PMT_ES_SIZE);
+    pmt_set_program(payload, program);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    pmt_set_pcrpid(payload, 43);
+    pmt_set_desclength(payload, 0);
+    uint8_t *pmt_es = pmt_get_es(payload, 0);
+    pmtn_init(pmt_es);
+    pmtn_set_pid(pmt_es, 43);
+    pmtn_set_streamtype(pmt_es, 2);
+    pmtn_set_desclength(pmt_es, 0);
+    psi_set_crc(payload);
+    payload += PMT_HEADER_SIZE + PMT_ES_SIZE + PSI_CRC_SIZE;
+    memset(payload, 0xff, buffer + TS_SIZE - payload);
+    ts_pad(buffer + TS_SIZE);
+}
+
 int main(int argc, char *argv[])
 {
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -384,6 +443,54 @@ int main(int argc, char *argv[])
     upipe_input(upipe_ts_demux, uref, NULL);
     assert(!expect_new_flow_def);
 
+    upipe_release(upipe_ts_demux_output_video);
+    upipe_release(upipe_ts_demux_output_pmt);
+    upipe_release(upipe_ts_demux);
+    upipe_ts_demux_output_video = NULL;
+    upipe_ts_demux_output_pmt = NULL;
+
+    /* aligned input checked into TS bundles of two packets */
+    upipe_ts_demux = upipe_void_alloc(upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "ts demux"));
+    assert(upipe_ts_demux != NULL);
+    bool bundle;
+    ubase_assert(upipe_ts_demux_get_bundle(upipe_ts_demux, &bundle));
+    assert(!bundle);
+    ubase_assert(upipe_ts_demux_set_bundle(upipe_ts_demux, true));
+    ubase_assert(upipe_ts_demux_get_bundle(upipe_ts_demux, &bundle));
+    assert(bundle);
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegtsaligned.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_demux, uref));
+    uref_free(uref);
+    ubase_assert(upipe_ts_demux_set_bundle(upipe_ts_demux, true));
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 2 * TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == 2 * TS_SIZE);
+    write_pat_bundle(buffer, 14);
+    uref_block_unmap(uref, 0);
+    wanted_flow_id = 14;
+    expect_new_flow_def = true;
+    upipe_input(upipe_ts_demux, uref, NULL);
+    assert(!expect_new_flow_def);
+    assert(upipe_ts_demux_output_pmt != NULL);
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 2 * TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == 2 * TS_SIZE);
+    write_pmt_bundle(buffer, 14);
+    uref_block_unmap(uref, 0);
+    wanted_flow_id = 43;
+    expect_new_flow_def = true;
+    upipe_input(upipe_ts_demux, uref, NULL);
+    assert(!expect_new_flow_def);
+    assert(upipe_ts_demux_output_video != NULL);
+
     upipe_release(upipe_ts_demux_output_video);
     upipe_release(upipe_ts_demux_output_pmt);
     upipe_release(upipe_ts_demux);
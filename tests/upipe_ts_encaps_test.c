@@ -53,6 +53,7 @@
 #include <upipe-ts/upipe_ts_encaps.h>
 #include <upipe-ts/upipe_ts_mux.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -78,6 +79,7 @@ static uint64_t next_pcr = UINT64_MAX;
 static uint64_t pcr_tolerance = 0;
 static bool psi = false;
 static bool psi_first = false;
+static unsigned int nb_bundles = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -110,6 +112,19 @@ static void test_input(struct upipe *upipe, struct uref *uref,
                        struct upump **upump_p)
 {
     assert(uref != NULL);
+    unsigned int nb;
+    if (ubase_check(uref_ts_bundle_get_nb(uref, &nb))) {
+        /* check the packets of a bundle one by one */
+        nb_bundles++;
+        for (unsigned int i = 0; i < nb; i++) {
+            struct uref *packet = uref_ts_bundle_extract(uref, i);
+            assert(packet != NULL);
+            test_input(upipe, packet, upump_p);
+        }
+        uref_free(uref);
+        return;
+    }
+
     /* check attributes */
     uint64_t uref_dts, uref_dts_sys, vbv_delay = 0;
     ubase_assert(uref_clock_get_dts_prog(uref, &uref_dts));
@@ -379,6 +394,58 @@ int main(int argc, char *argv[])
     assert(nb_ts == 0);
     upipe_release(upipe_ts_encaps);
 
+    /* same with PCRs, in bundle mode */
+    total_size = 0;
+    cc = 0;
+    randomaccess = true;
+    discontinuity = true;
+    next_pcr = 0;
+    uref = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(uref != NULL);
+    ubase_assert(uref_block_flow_set_octetrate(uref, 2048));
+    ubase_assert(uref_ts_flow_set_tb_rate(uref, 2048));
+    ubase_assert(uref_ts_flow_set_pid(uref, 68));
+    /* PCR interval set in-band, as done by ts_mux in worker mode */
+    ubase_assert(uref_ts_flow_set_pcr_interval(uref, UCLOCK_FREQ / 5));
+
+    upipe_ts_encaps = upipe_void_alloc(upipe_ts_encaps_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                   "ts encaps"));
+    assert(upipe_ts_encaps != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_encaps, uref));
+    uref_free(uref);
+    uint64_t pcr_interval;
+    ubase_assert(upipe_ts_mux_get_pcr_interval(upipe_ts_encaps, &pcr_interval));
+    assert(pcr_interval == UCLOCK_FREQ / 5);
+    ubase_assert(upipe_ts_encaps_set_bundle(upipe_ts_encaps, true));
+    bool bundle;
+    ubase_assert(upipe_ts_encaps_get_bundle(upipe_ts_encaps, &bundle));
+    assert(bundle);
+    ubase_assert(upipe_set_output(upipe_ts_encaps, upipe_sink));
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 2048);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == 2048);
+    for (i = 0; i < 2048; i++)
+        buffer[i] = i % 256;
+    uref_block_unmap(uref, 0);
+    uref_clock_set_dts_prog(uref, 27000000);
+    uref_clock_set_dts_sys(uref, 270000000);
+    uref_block_set_start(uref);
+    uref_flow_set_discontinuity(uref);
+    ubase_assert(uref_flow_set_random(uref));
+    dts = 27000000;
+    dts_sys = 270000000;
+    nb_ts = 2048 / (TS_SIZE - TS_HEADER_SIZE) + 1;
+    dts_step = 27000000 / nb_ts;
+    upipe_input(upipe_ts_encaps, uref, NULL);
+    assert(total_size == 2048);
+    assert(nb_ts == 0);
+    assert(nb_bundles == 1);
+    upipe_release(upipe_ts_encaps);
+
     upipe_mgr_release(upipe_ts_encaps_mgr); // nop
 
     test_free(upipe_sink);
@@ -49,10 +49,12 @@
 #include <upipe/upipe.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include <upipe-ts/upipe_ts_join.h>
+#include <upipe-ts/uref_ts_bundle.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <assert.h>
@@ -65,6 +67,7 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 
 static uint64_t received_pids = 0;
+static uint64_t last_cr_sys = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -104,6 +107,15 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(ts_validate(buffer));
     received_pids += ts_get_pid(buffer);
     uref_block_unmap(uref, 0);
+    unsigned int nb;
+    ubase_nassert(uref_ts_bundle_get_nb(uref, &nb));
+    uint64_t cr_sys, cr_prog;
+    ubase_assert(uref_clock_get_cr_sys(uref, &cr_sys));
+    ubase_assert(uref_clock_get_cr_prog(uref, &cr_prog));
+    assert(cr_sys >= last_cr_sys);
+    last_cr_sys = cr_sys;
+    if (cr_sys >= 10)
+        assert(cr_prog == cr_sys + 100);
     uref_free(uref);
 }
 
@@ -235,11 +247,51 @@ int main(int argc, char *argv[])
     assert(received_pids == 68);
     received_pids = 0;
 
+    /* bundle of 3 packets with their own dates */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE * 3);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE * 3);
+    struct uref_ts_bundle_pkt pkts[3];
+    struct uref_ts_bundle_date dates[3];
+    for (int i = 0; i < 3; i++) {
+        ts_pad(buffer + i * TS_SIZE);
+        ts_set_pid(buffer + i * TS_SIZE, 68);
+        memset(&pkts[i], 0, sizeof(pkts[i]));
+        pkts[i].pid = 68;
+        dates[i].cr_sys = 10 * (i + 1);
+        dates[i].cr_dts_delay = 0;
+    }
+    uref_block_unmap(uref, 0);
+    ubase_assert(uref_ts_bundle_set(uref, pkts, 3));
+    ubase_assert(uref_ts_bundle_set_dates(uref, dates, 3));
+    uref_clock_set_cr_sys(uref, 10);
+    uref_clock_set_cr_prog(uref, 110);
+    upipe_input(upipe_ts_join_input68, uref, NULL);
+    assert(received_pids == 69);
+    received_pids = 0;
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_pad(buffer);
+    ts_set_pid(buffer, 69);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, 25);
+    uref_clock_set_cr_prog(uref, 125);
+    upipe_input(upipe_ts_join_input69, uref, NULL);
+    assert(received_pids == 68 * 2 + 69);
+    received_pids = 0;
+
     upipe_release(upipe_ts_join_input69);
-    assert(!received_pids);
+    assert(received_pids == 68);
+    received_pids = 0;
 
     upipe_release(upipe_ts_join_input68);
-    assert(received_pids == 69);
+    assert(!received_pids);
 
     upipe_release(upipe_ts_join);
     upipe_mgr_release(upipe_ts_join_mgr); // nop
@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for the inputs of TS mux fed from other threads
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uatomic.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/uclock.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_sound_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upump-uring/upump_uring.h>
+#include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/upipe_ts_mux.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/pes.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPUMP_POOL 0
+#define UPUMP_BLOCKER_POOL 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+/** number of inputs fed from their own thread */
+#define NB_THREADS 2
+/** number of frames sent by each thread */
+#define NB_FRAMES 200
+/** size of an MPEG audio frame at 128 kbits/s and 48 kHz */
+#define FRAME_SIZE 384
+#define FRAME_DURATION (UCLOCK_FREQ * 1152 / 48000)
+/** length of the FIFO of the inputs fed from the threads, shorter than
+ * NB_FRAMES so that the threads wait for the mux */
+#define REMOTE_LENGTH 8
+/** first PID of the inputs */
+#define FIRST_PID 257
+/** index of the input used to check the urefs dropped when the FIFO stays
+ * full */
+#define DROP_INPUT NB_THREADS
+#define NB_INPUTS (NB_THREADS + 1)
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static struct upump_mgr *upump_mgr;
+
+/** input subpipes of the mux */
+static struct upipe *inputs[NB_INPUTS];
+/** urefs allocated before starting the threads */
+static struct uref *frames[NB_INPUTS][NB_FRAMES];
+/** number of threads which sent all their frames */
+static uatomic_uint32_t nb_done;
+static pthread_t threads[NB_THREADS];
+static struct upipe *upipe_ts_mux;
+static struct upipe *upipe_ts_mux_program;
+static bool dropped = false;
+
+/** payload received on each input PID, and number of complete frames */
+static uint8_t payload[NB_INPUTS][FRAME_SIZE];
+static size_t payload_size[NB_INPUTS];
+static unsigned int nb_frames[NB_INPUTS];
+static uint8_t last_cc[NB_INPUTS];
+static bool started[NB_INPUTS];
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_TS_MUX_NEED_WORKER:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** probe catching the warning about dropped urefs */
+static int catch_mux(struct uprobe *uprobe, struct upipe *upipe,
+                     int event, va_list args)
+{
+    if (event == UPROBE_LOG) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        enum uprobe_log_level level = va_arg(args_copy,
+                                             enum uprobe_log_level);
+        const char *msg = va_arg(args_copy, const char *);
+        if (level == UPROBE_LOG_WARNING && strstr(msg, "dropped") != NULL) {
+            assert(!dropped);
+            dropped = true;
+        }
+        va_end(args_copy);
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper checking the payload of a frame */
+static void check_frame(unsigned int input)
+{
+    unsigned int seq = (payload[input][0] << 24) | (payload[input][1] << 16) |
+                       (payload[input][2] << 8) | payload[input][3];
+    assert(seq == nb_frames[input]);
+    for (unsigned int i = 4; i < FRAME_SIZE; i++)
+        assert(payload[input][i] == (uint8_t)(seq + input));
+    nb_frames[input]++;
+    payload_size[input] = 0;
+}
+
+/** helper phony pipe, reassembling the frames of the inputs */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size % TS_SIZE == 0);
+    for (size_t offset = 0; offset < size; offset += TS_SIZE) {
+        uint8_t buffer[TS_SIZE];
+        ubase_assert(uref_block_extract(uref, offset, TS_SIZE, buffer));
+        assert(ts_validate(buffer));
+        uint16_t pid = ts_get_pid(buffer);
+        if (pid < FIRST_PID || pid >= FIRST_PID + NB_INPUTS ||
+            !ts_has_payload(buffer))
+            continue;
+        unsigned int input = pid - FIRST_PID;
+        if (started[input])
+            assert(!ts_check_discontinuity(ts_get_cc(buffer),
+                                           last_cc[input]));
+        last_cc[input] = ts_get_cc(buffer);
+
+        uint8_t *p = ts_payload(buffer);
+        if (ts_get_unitstart(buffer)) {
+            /* frames are not split across PES */
+            assert(payload_size[input] == 0);
+            assert(pes_validate(p));
+            assert(pes_get_streamid(p) == PES_STREAM_ID_AUDIO_MPEG);
+            p = pes_payload(p);
+            started[input] = true;
+        } else
+            assert(started[input]);
+
+        while (p < buffer + TS_SIZE) {
+            size_t chunk = buffer + TS_SIZE - p;
+            if (chunk > FRAME_SIZE - payload_size[input])
+                chunk = FRAME_SIZE - payload_size[input];
+            memcpy(payload[input] + payload_size[input], p, chunk);
+            payload_size[input] += chunk;
+            p += chunk;
+            if (payload_size[input] == FRAME_SIZE)
+                check_frame(input);
+        }
+    }
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            ubase_assert(uref_flow_match_def(flow_def, "block.mpegts"));
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr ts_test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper allocating the frames of an input */
+static void alloc_frames(unsigned int input)
+{
+    for (unsigned int i = 0; i < NB_FRAMES; i++) {
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, FRAME_SIZE);
+        assert(uref != NULL);
+        uint8_t *buffer;
+        int size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        assert(size == FRAME_SIZE);
+        buffer[0] = i >> 24;
+        buffer[1] = i >> 16;
+        buffer[2] = i >> 8;
+        buffer[3] = i;
+        memset(buffer + 4, (uint8_t)(i + input), FRAME_SIZE - 4);
+        ubase_assert(uref_block_unmap(uref, 0));
+
+        uint64_t date = UCLOCK_FREQ + i * FRAME_DURATION;
+        uref_clock_set_dts_sys(uref, date);
+        uref_clock_set_dts_prog(uref, date);
+        uref_clock_set_dts_pts_delay(uref, 0);
+        uref_clock_set_duration(uref, FRAME_DURATION);
+        frames[input][i] = uref;
+    }
+}
+
+/** thread feeding an input of the mux */
+static void *thread_input(void *_input)
+{
+    unsigned int input = (uintptr_t)_input;
+    unsigned int nb = input == DROP_INPUT ? 2 : NB_FRAMES;
+    for (unsigned int i = 0; i < nb; i++) {
+        upipe_input(inputs[input], frames[input][i], NULL);
+        frames[input][i] = NULL;
+    }
+    uatomic_fetch_add(&nb_done, 1);
+    return NULL;
+}
+
+/** timer waiting for the threads in the thread of the mux */
+static void timer_cb(struct upump *upump)
+{
+    if (uatomic_load(&nb_done) < NB_THREADS)
+        return;
+
+    for (unsigned int i = 0; i < NB_THREADS; i++)
+        assert(!pthread_join(threads[i], NULL));
+    /* the last urefs still queued are processed on release */
+    for (unsigned int i = 0; i < NB_INPUTS; i++)
+        upipe_release(inputs[i]);
+    upipe_release(upipe_ts_mux_program);
+    upipe_release(upipe_ts_mux);
+    upump_stop(upump);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    upump_mgr = upump_uring_mgr_alloc(64, UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+    struct uprobe uprobe_mux;
+    uprobe_init(&uprobe_mux, catch_mux, uprobe_use(logger));
+
+    struct upipe_mgr *upipe_ts_mux_mgr = upipe_ts_mux_mgr_alloc();
+    assert(upipe_ts_mux_mgr != NULL);
+    struct uref *uref = uref_alloc_control(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "void."));
+    upipe_ts_mux = upipe_void_alloc(upipe_ts_mux_mgr,
+            uprobe_pfx_alloc(uprobe_use(&uprobe_mux), UPROBE_LOG_LEVEL,
+                             "ts mux"));
+    assert(upipe_ts_mux != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_mux, uref));
+    /* the frames are not paced, do not drop them as late */
+    ubase_assert(upipe_ts_mux_set_mode(upipe_ts_mux, UPIPE_TS_MUX_MODE_VBR));
+
+    struct upipe *upipe_sink = upipe_void_alloc(&ts_test_mgr,
+                                                uprobe_use(logger));
+    assert(upipe_sink != NULL);
+    ubase_assert(upipe_set_output(upipe_ts_mux, upipe_sink));
+
+    ubase_assert(uref_flow_set_id(uref, 1));
+    upipe_ts_mux_program = upipe_void_alloc_sub(upipe_ts_mux,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts mux program"));
+    assert(upipe_ts_mux_program != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_mux_program, uref));
+    uref_free(uref);
+
+    for (unsigned int i = 0; i < NB_INPUTS; i++) {
+        uref = uref_block_flow_alloc_def(uref_mgr, "mp2.sound.");
+        assert(uref != NULL);
+        ubase_assert(uref_block_flow_set_octetrate(uref,
+                    FRAME_SIZE * UCLOCK_FREQ / FRAME_DURATION));
+        ubase_assert(uref_sound_flow_set_rate(uref, 48000));
+        ubase_assert(uref_sound_flow_set_samples(uref, 1152));
+        ubase_assert(uref_ts_flow_set_pid(uref, FIRST_PID + i));
+        inputs[i] = upipe_void_alloc_sub(upipe_ts_mux_program,
+                uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                    "ts mux input %u", i));
+        assert(inputs[i] != NULL);
+        ubase_assert(upipe_set_flow_def(inputs[i], uref));
+        uref_free(uref);
+
+        unsigned int length;
+        ubase_assert(upipe_ts_mux_get_remote(inputs[i], &length));
+        assert(length == 0);
+        ubase_assert(upipe_ts_mux_set_remote(inputs[i],
+                    i == DROP_INPUT ? 1 : REMOTE_LENGTH));
+        ubase_assert(upipe_ts_mux_get_remote(inputs[i], &length));
+        assert(length == (i == DROP_INPUT ? 1 : REMOTE_LENGTH));
+        alloc_frames(i);
+    }
+    ubase_nassert(upipe_ts_mux_set_remote(inputs[0], 256));
+
+    /* the thread of the mux does not run yet, so the second uref does not
+     * fit in the FIFO and is dropped after a bounded wait */
+    uatomic_init(&nb_done, 0);
+    thread_input((void *)(uintptr_t)DROP_INPUT);
+    uatomic_store(&nb_done, 0);
+    assert(frames[DROP_INPUT][1] == NULL);
+
+    for (unsigned int i = 0; i < NB_THREADS; i++)
+        assert(!pthread_create(&threads[i], NULL, thread_input,
+                               (void *)(uintptr_t)i));
+
+    struct upump *timer = upump_alloc_timer(upump_mgr, timer_cb, NULL,
+                                            UCLOCK_FREQ / 1000,
+                                            UCLOCK_FREQ / 1000);
+    assert(timer != NULL);
+    upump_start(timer);
+
+    upump_uring_mgr_run(upump_mgr);
+    upump_free(timer);
+
+    assert(dropped);
+    for (unsigned int i = 0; i < NB_INPUTS; i++) {
+        assert(nb_frames[i] == (i == DROP_INPUT ? 1 : NB_FRAMES));
+        assert(payload_size[i] == 0);
+        for (unsigned int j = i == DROP_INPUT ? 2 : NB_FRAMES; j < NB_FRAMES;
+             j++)
+            uref_free(frames[i][j]);
+    }
+    uatomic_clean(&nb_done);
+
+    upipe_mgr_release(upipe_ts_mux_mgr);
+    test_free(upipe_sink);
+
+    upump_mgr_release(upump_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_clean(&uprobe_mux);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
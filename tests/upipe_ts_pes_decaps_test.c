@@ -70,6 +70,7 @@ static int end = UBASE_ERR_NONE;
 static size_t payload_size = 12;
 static bool expect_lost = false;
 static bool expect_acquired = true;
+static bool contiguous = false;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -126,6 +127,15 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(size == payload_size);
     assert(dataalignment == uref_flow_get_random(uref));
     assert(end == uref_block_get_end(uref));
+    if (contiguous) {
+        const uint8_t *buffer;
+        int read_size = -1;
+        ubase_assert(uref_block_read(uref, 0, &read_size, &buffer));
+        assert(read_size == payload_size);
+        for (int i = 0; i < read_size; i++)
+            assert(buffer[i] == i);
+        uref_block_unmap(uref, 0);
+    }
     uref_free(uref);
     nb_packets--;
 }
@@ -337,6 +347,48 @@ int main(int argc, char *argv[])
     assert(!nb_packets);
     assert(!expect_lost);
 
+    /* reassemble a PES received in three chunks */
+    bool reassemble;
+    ubase_assert(upipe_ts_pesd_get_reassemble(upipe_ts_pesd, &reassemble));
+    assert(!reassemble);
+    ubase_assert(upipe_ts_pesd_set_reassemble(upipe_ts_pesd, true));
+    ubase_assert(upipe_ts_pesd_get_reassemble(upipe_ts_pesd, &reassemble));
+    assert(reassemble);
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, PES_HEADER_SIZE_NOPTS + 30);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == PES_HEADER_SIZE_NOPTS + 30);
+    pes_init(buffer);
+    pes_set_streamid(buffer, PES_STREAM_ID_VIDEO_MPEG);
+    pes_set_length(buffer, PES_HEADER_SIZE_NOPTS + 30 - PES_HEADER_SIZE);
+    pes_set_headerlength(buffer, 0);
+    pes_set_dataalignment(buffer);
+    for (int i = 0; i < 30; i++)
+        buffer[PES_HEADER_SIZE_NOPTS + i] = i;
+    uref_block_unmap(uref, 0);
+    payload_size = 30;
+    dataalignment = UBASE_ERR_NONE;
+    end = UBASE_ERR_NONE;
+    contiguous = true;
+    nb_packets++;
+    for (int i = 0; i < 3; i++) {
+        struct uref *dup = uref_dup(uref);
+        assert(dup != NULL);
+        if (!i) {
+            ubase_assert(uref_block_resize(dup, 0,
+                                           PES_HEADER_SIZE_NOPTS + 10));
+            uref_block_set_start(dup);
+        } else
+            ubase_assert(uref_block_resize(dup,
+                                           PES_HEADER_SIZE_NOPTS + i * 10, 10));
+        upipe_input(upipe_ts_pesd, dup, NULL);
+        assert(nb_packets == (i < 2 ? 1 : 0));
+    }
+    uref_free(uref);
+    contiguous = false;
+
     upipe_release(upipe_ts_pesd);
     upipe_mgr_release(upipe_ts_pesd_mgr); // nop
 
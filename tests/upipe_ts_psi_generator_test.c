@@ -49,6 +49,7 @@
 #include <upipe/upipe.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include <upipe-ts/upipe_ts_psi_generator.h>
+#include <upipe-ts/upipe_ts_mux.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -66,6 +67,8 @@
 
 static bool pat = true;
 static uint8_t program = 0;
+static unsigned int pmt_version = 0;
+static const uint8_t *pmt_buffer = NULL;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -122,6 +125,8 @@ static void test_input(struct upipe *upipe, struct uref *uref,
         pat = false;
     } else {
         assert(pmt_validate(buffer));
+        pmt_version = psi_get_version(buffer);
+        pmt_buffer = buffer;
         if (program == 1) {
             assert(cr == UCLOCK_FREQ * 2);
             assert(pmt_get_pcrpid(buffer) == 67);
@@ -337,6 +342,45 @@ int main(int argc, char *argv[])
     program = 2;
     upipe_input(upipe_ts_psig_program2, uref, NULL);
     assert(program == 0);
+    const uint8_t *pmt2_buffer = pmt_buffer;
+
+    /* unchanged program: the cached section is output again */
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_cr_sys(uref, UCLOCK_FREQ * 2);
+    program = 1;
+    upipe_input(upipe_ts_psig_program1, uref, NULL);
+    assert(program == 0);
+    const uint8_t *pmt1_buffer = pmt_buffer;
+    unsigned int pmt1_version = pmt_version;
+
+    ubase_assert(upipe_ts_psig_program_set_pcr_pid(upipe_ts_psig_program1, 67));
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_cr_sys(uref, UCLOCK_FREQ * 2);
+    program = 1;
+    upipe_input(upipe_ts_psig_program1, uref, NULL);
+    assert(program == 0);
+    assert(pmt_buffer == pmt1_buffer);
+
+    /* a new version of program 1 doesn't touch program 2 */
+    ubase_assert(upipe_ts_mux_set_version(upipe_ts_psig_program1,
+                                          pmt1_version + 1));
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_cr_sys(uref, UCLOCK_FREQ * 2);
+    program = 1;
+    upipe_input(upipe_ts_psig_program1, uref, NULL);
+    assert(program == 0);
+    assert(pmt_version == pmt1_version + 1);
+
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_cr_sys(uref, UCLOCK_FREQ * 3);
+    program = 2;
+    upipe_input(upipe_ts_psig_program2, uref, NULL);
+    assert(program == 0);
+    assert(pmt_buffer == pmt2_buffer);
 
     upipe_release(upipe_ts_psig_flow67);
     upipe_release(upipe_ts_psig_flow68);
@@ -59,6 +59,8 @@
 #include <inttypes.h>
 #include <assert.h>
 
+#include <bitstream/mpeg/ts.h>
+
 #define UDICT_POOL_DEPTH 0
 #define UREF_POOL_DEPTH 0
 #define UBUF_POOL_DEPTH 0
@@ -66,6 +68,9 @@
 
 static unsigned int nb_packets = 0;
 static bool expect_flow_def = true;
+static uint8_t next_cc = 0;
+static uint64_t last_cr_sys = 0;
+static struct uref *held = NULL;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -99,6 +104,30 @@ static void test_input(struct upipe *upipe, struct uref *uref,
 {
     assert(uref != NULL);
     nb_packets++;
+
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    if (size == TS_SIZE) {
+        /* PSI packet: continuity counter and dates follow the occurrence */
+        uint8_t buffer[TS_HEADER_SIZE];
+        const uint8_t *ts_header = uref_block_peek(uref, 0, TS_HEADER_SIZE,
+                                                   buffer);
+        assert(ts_header != NULL);
+        assert(ts_get_pid(ts_header) == 0);
+        assert(ts_get_cc(ts_header) == next_cc);
+        next_cc = (next_cc + 1) & 0xf;
+        ubase_assert(uref_block_peek_unmap(uref, 0, buffer, ts_header));
+
+        uint64_t cr_sys;
+        ubase_assert(uref_clock_get_cr_sys(uref, &cr_sys));
+        assert(cr_sys > last_cr_sys);
+        last_cr_sys = cr_sys;
+        if (held == NULL) {
+            /* keep the first occurrence in use during the next one */
+            held = uref;
+            return;
+        }
+    }
     uref_free(uref);
 }
 
@@ -227,6 +256,17 @@ int main(int argc, char *argv[])
     assert(nb_packets == 1);
     nb_packets = 0;
 
+    /* the first occurrence was not modified by the following ones */
+    assert(held != NULL);
+    uint8_t buffer[TS_HEADER_SIZE];
+    const uint8_t *ts_header = uref_block_peek(held, 0, TS_HEADER_SIZE,
+                                               buffer);
+    assert(ts_header != NULL);
+    assert(ts_get_cc(ts_header) == 0);
+    ubase_assert(uref_block_peek_unmap(held, 0, buffer, ts_header));
+    uref_free(held);
+    assert(next_cc == 2);
+
     upipe_release(upipe_ts_psii_sub);
     upipe_release(upipe_ts_psii);
 
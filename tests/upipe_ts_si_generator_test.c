@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS sig module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/uclock.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_program_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/upipe_ts_si_generator.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/psi.h>
+#include <bitstream/dvb/si.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static unsigned int nb_nit = 0;
+static unsigned int nb_sdt = 0;
+static unsigned int nb_eit = 0;
+static unsigned int sdt_version = 0;
+static const uint8_t *sdt_buffer = NULL;
+static const char *service_name = "Service 1";
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    uint64_t cr;
+    ubase_assert(uref_clock_get_cr_sys(uref, &cr));
+    assert(cr == UCLOCK_FREQ);
+    ubase_assert(uref_block_get_start(uref));
+    const uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_read(uref, 0, &size, &buffer));
+    assert(psi_get_length(buffer) + PSI_HEADER_SIZE == size);
+    /* only the last section of a table ends it */
+    assert(ubase_check(uref_block_get_end(uref)) ==
+           (psi_get_section(buffer) == psi_get_lastsection(buffer)));
+    assert(psi_validate(buffer));
+    assert(psi_check_crc(buffer));
+
+    switch (psi_get_tableid(buffer)) {
+        case NIT_TABLE_ID_ACTUAL: {
+            assert(nit_validate(buffer));
+            assert(nit_get_nid(buffer) == 0xff01);
+            const uint8_t *ts = nit_get_ts((uint8_t *)buffer, 0);
+            assert(ts != NULL);
+            assert(nitn_get_tsid(ts) == 42);
+            assert(nitn_get_onid(ts) == 0xff01);
+            assert(nit_get_ts((uint8_t *)buffer, 1) == NULL);
+            nb_nit++;
+            break;
+        }
+        case SDT_TABLE_ID_ACTUAL: {
+            assert(sdt_validate(buffer));
+            assert(sdt_get_tsid(buffer) == 42);
+            const uint8_t *service = sdt_get_service((uint8_t *)buffer, 0);
+            assert(service != NULL);
+            assert(sdtn_get_sid(service) == 1);
+            assert(sdtn_get_eitpresent(service));
+            const uint8_t *desc =
+                descs_get_desc(sdtn_get_descs((uint8_t *)service), 0);
+            assert(desc != NULL);
+            assert(desc48_validate(desc));
+            uint8_t length;
+            const uint8_t *name = desc48_get_service(desc, &length);
+            assert(length == strlen(service_name));
+            assert(!strncmp((const char *)name, service_name, length));
+            assert(sdt_get_service((uint8_t *)buffer, 1) == NULL);
+            if (nb_sdt % 2) {
+                /* both SDT outputs share the same section */
+                assert(buffer == sdt_buffer);
+                assert(psi_get_version(buffer) == sdt_version);
+            }
+            sdt_version = psi_get_version(buffer);
+            sdt_buffer = buffer;
+            nb_sdt++;
+            break;
+        }
+        case EIT_TABLE_ID_PF_ACTUAL: {
+            assert(eit_validate(buffer));
+            assert(eit_get_sid(buffer) == 1);
+            const uint8_t *event = eit_get_event((uint8_t *)buffer, 0);
+            assert(event != NULL);
+            assert(eitn_get_event_id(event) ==
+                   (psi_get_section(buffer) ? 1001 : 1000));
+            nb_eit++;
+            break;
+        }
+        default:
+            assert(0);
+    }
+    uref_block_unmap(uref, 0);
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr ts_test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper allocating an output of the sig pipe */
+static struct upipe *alloc_output(struct upipe *upipe_ts_sig,
+                                  struct uprobe *logger,
+                                  struct uref_mgr *uref_mgr,
+                                  struct upipe *upipe_sink, uint16_t pid)
+{
+    struct uref *uref = uref_alloc_control(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "void."));
+    ubase_assert(uref_ts_flow_set_pid(uref, pid));
+    struct upipe *output = upipe_ts_sig_alloc_output(upipe_ts_sig,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts sig output"), uref);
+    assert(output != NULL);
+    uref_free(uref);
+    ubase_assert(upipe_set_output(output, upipe_sink));
+    return output;
+}
+
+/** helper sending a tick to the sig pipe */
+static void tick(struct upipe *upipe_ts_sig, struct uref_mgr *uref_mgr)
+{
+    struct uref *uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_cr_sys(uref, UCLOCK_FREQ);
+    upipe_input(upipe_ts_sig, uref, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct upipe_mgr *upipe_ts_sig_mgr = upipe_ts_sig_mgr_alloc();
+    assert(upipe_ts_sig_mgr != NULL);
+    struct upipe *upipe_ts_sig = upipe_void_alloc(upipe_ts_sig_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts sig"));
+    assert(upipe_ts_sig != NULL);
+
+    struct uref *uref;
+    uref = uref_alloc_control(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "void."));
+    ubase_assert(uref_flow_set_id(uref, 42));
+    ubase_assert(uref_ts_flow_set_network_name(uref, "Network"));
+    ubase_assert(upipe_set_flow_def(upipe_ts_sig, uref));
+    uref_free(uref);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&ts_test_mgr,
+                                                uprobe_use(logger));
+    assert(upipe_sink != NULL);
+    struct upipe *nit = alloc_output(upipe_ts_sig, logger, uref_mgr,
+                                     upipe_sink, NIT_PID);
+    struct upipe *sdt1 = alloc_output(upipe_ts_sig, logger, uref_mgr,
+                                      upipe_sink, SDT_PID);
+    struct upipe *sdt2 = alloc_output(upipe_ts_sig, logger, uref_mgr,
+                                      upipe_sink, SDT_PID);
+    struct upipe *eit = alloc_output(upipe_ts_sig, logger, uref_mgr,
+                                     upipe_sink, EIT_PID);
+
+    /* service */
+    uref = uref_alloc_control(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "void."));
+    ubase_assert(uref_flow_set_id(uref, 1));
+    ubase_assert(uref_program_flow_set_name(uref, service_name));
+    ubase_assert(uref_ts_flow_set_provider_name(uref, "Provider"));
+    ubase_assert(uref_ts_flow_set_events(uref, 2));
+    ubase_assert(uref_ts_flow_set_event_id(uref, 1000, 0));
+    ubase_assert(uref_ts_flow_set_event_start(uref, 1420070400, 0));
+    ubase_assert(uref_ts_flow_set_event_duration(uref, 3600, 0));
+    ubase_assert(uref_ts_flow_set_event_name(uref, "News", 0));
+    ubase_assert(uref_ts_flow_set_event_id(uref, 1001, 1));
+    ubase_assert(uref_ts_flow_set_event_start(uref, 1420074000, 1));
+    ubase_assert(uref_ts_flow_set_event_duration(uref, 1800, 1));
+    ubase_assert(uref_ts_flow_set_event_name(uref, "Weather", 1));
+    struct upipe *upipe_ts_sig_service = upipe_void_alloc_sub(upipe_ts_sig,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts sig service"));
+    assert(upipe_ts_sig_service != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_sig_service, uref));
+
+    tick(upipe_ts_sig, uref_mgr);
+    assert(nb_nit == 1);
+    assert(nb_sdt == 2);
+    assert(nb_eit == 2);
+    unsigned int sdt1_version = sdt_version;
+
+    /* unchanged tables are not output again */
+    ubase_assert(upipe_set_flow_def(upipe_ts_sig_service, uref));
+    tick(upipe_ts_sig, uref_mgr);
+    assert(nb_nit == 1);
+    assert(nb_sdt == 2);
+    assert(nb_eit == 2);
+
+    /* a new service name only changes the SDT, shared by both outputs */
+    service_name = "Service 2";
+    ubase_assert(uref_program_flow_set_name(uref, service_name));
+    ubase_assert(upipe_set_flow_def(upipe_ts_sig_service, uref));
+    uref_free(uref);
+    tick(upipe_ts_sig, uref_mgr);
+    assert(nb_nit == 1);
+    assert(nb_sdt == 4);
+    assert(nb_eit == 2);
+    assert(sdt_version == ((sdt1_version + 1) & 0x1f));
+
+    upipe_release(upipe_ts_sig_service);
+    upipe_release(nit);
+    upipe_release(sdt1);
+    upipe_release(sdt2);
+    upipe_release(eit);
+
+    upipe_release(upipe_ts_sig);
+    upipe_mgr_release(upipe_ts_sig_mgr); // nop
+
+    test_free(upipe_sink);
+
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -95,6 +95,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
 struct test {
     uint16_t pid;
     bool got_packet;
+    unsigned int nb_packets;
     struct upipe upipe;
 };
 
@@ -109,6 +110,7 @@ static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
     assert(test != NULL);
     upipe_init(&test->upipe, mgr, uprobe);
     test->got_packet = false;
+    test->nb_packets = 0;
     test->pid = pid;
     return &test->upipe;
 }
@@ -120,13 +122,19 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     struct test *test = container_of(upipe, struct test, upipe);
     assert(uref != NULL);
     test->got_packet = true;
-    const uint8_t *buffer;
-    int size = -1;
-    ubase_assert(uref_block_read(uref, 0, &size, &buffer));
-    assert(size == TS_SIZE); //because of the way we allocated it
-    assert(ts_validate(buffer));
-    assert(ts_get_pid(buffer) == test->pid);
-    uref_block_unmap(uref, 0);
+    size_t total_size;
+    ubase_assert(uref_block_size(uref, &total_size));
+    assert(total_size && !(total_size % TS_SIZE));
+    for (int offset = 0; offset < total_size; offset += TS_SIZE) {
+        const uint8_t *buffer;
+        int size = TS_SIZE;
+        ubase_assert(uref_block_read(uref, offset, &size, &buffer));
+        assert(size == TS_SIZE); //because of the way we allocated it
+        assert(ts_validate(buffer));
+        assert(ts_get_pid(buffer) == test->pid);
+        uref_block_unmap(uref, offset);
+        test->nb_packets++;
+    }
     uref_free(uref);
 }
 
@@ -236,7 +244,43 @@ int main(int argc, char *argv[])
     uref_block_unmap(uref, 0);
     upipe_input(upipe_ts_split, uref, NULL);
 
+    /* aggregate of several packets */
+    static const uint16_t pids[] = { 68, 68, 69, 68, 70 };
+    unsigned int nb_pids = sizeof(pids) / sizeof(pids[0]);
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE * nb_pids);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE * nb_pids);
+    for (int i = 0; i < nb_pids; i++) {
+        ts_pad(buffer + i * TS_SIZE);
+        ts_set_pid(buffer + i * TS_SIZE, pids[i]);
+    }
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_split, uref, NULL);
+
+    struct test *test68 = container_of(upipe_sink68, struct test, upipe);
+    struct test *test69 = container_of(upipe_sink69, struct test, upipe);
+    assert(test68->nb_packets == 4);
+    assert(test69->nb_packets == 2);
+
+    /* the remaining PIDs are still split after compacting the table */
     upipe_release(upipe_ts_split_output68);
+    ubase_assert(upipe_hibernate(upipe_ts_split));
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE * nb_pids);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE * nb_pids);
+    for (int i = 0; i < nb_pids; i++) {
+        ts_pad(buffer + i * TS_SIZE);
+        ts_set_pid(buffer + i * TS_SIZE, pids[i]);
+    }
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_split, uref, NULL);
+    assert(test68->nb_packets == 4);
+    assert(test69->nb_packets == 3);
+
     upipe_release(upipe_ts_split_output69);
     upipe_release(upipe_ts_split);
     upipe_mgr_release(upipe_ts_split_mgr); // nop
@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS synth module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe-ts/upipe_ts_synth.h>
+#include <upipe-ts/upipe_ts_mux.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <ev.h>
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
+
+#include "../lib/upipe-ts/upipe_ts_psi_crc.h"
+
+#define UPUMP_POOL          1
+#define UPUMP_BLOCKER_POOL  1
+#define UDICT_POOL_DEPTH    5
+#define UREF_POOL_DEPTH     5
+#define UBUF_POOL_DEPTH     5
+#define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
+/** 100 packets per PCR interval of 40 ms */
+#define OCTETRATE           (188 * 100 * 25)
+#define PMT_PID             66
+#define NB_PIDS             2
+#define PATTERN_SIZE        1000
+#define ES_OCTETRATE        100000
+#define LIMIT               10
+
+/** synth pipe */
+static struct upipe *ts_synth;
+/** uclock, if the test is paced */
+static struct uclock *uclock;
+/** PIDs of the elementary streams */
+static const uint16_t pids[NB_PIDS] = { 68, 69 };
+/** number of TS packets received, per type */
+static unsigned int nb_pat, nb_pmt, nb_pcr, nb_es, nb_null;
+/** number of urefs received */
+static unsigned int nb_urefs;
+/** last continuity counter, per PID */
+static int last_cc[8192];
+/** date of the next uref */
+static uint64_t next_date;
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input_ts(struct upipe *upipe, struct uref *uref,
+                          struct upump **upump_p)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size && size <= 7 * TS_SIZE && !(size % TS_SIZE));
+    uint64_t cr_prog;
+    ubase_assert(uref_clock_get_cr_prog(uref, &cr_prog));
+    assert(cr_prog >= next_date);
+    next_date = cr_prog;
+    if (uclock != NULL) {
+        uint64_t cr_sys;
+        ubase_assert(uref_clock_get_cr_sys(uref, &cr_sys));
+    }
+
+    for (size_t offset = 0; offset < size; offset += TS_SIZE) {
+        uint8_t buffer[TS_SIZE];
+        const uint8_t *ts = uref_block_peek(uref, offset, TS_SIZE, buffer);
+        assert(ts != NULL);
+        assert(ts_validate(ts));
+        uint16_t pid = ts_get_pid(ts);
+
+        if (ts_has_payload(ts) && pid != 8191) {
+            if (last_cc[pid] != -1)
+                assert(!ts_check_discontinuity(ts_get_cc(ts), last_cc[pid]));
+            last_cc[pid] = ts_get_cc(ts);
+        }
+
+        if (pid == 8191) {
+            nb_null++;
+        } else if (pid == 0 || pid == PMT_PID) {
+            assert(ts_get_unitstart(ts));
+            const uint8_t *section = ts + TS_HEADER_SIZE + 1;
+            assert(section[0] == (pid ? 2 : 0));
+            /* the CRC of a section including its CRC is 0 */
+            assert(!upipe_ts_psi_crc_update(0xffffffff, section,
+                        psi_get_length(section) + PSI_HEADER_SIZE));
+            if (pid)
+                nb_pmt++;
+            else
+                nb_pat++;
+        } else if (!ts_has_payload(ts)) {
+            assert(pid == pids[0]);
+            assert(offset == 0);
+            assert(ts_has_adaptation(ts) && tsaf_has_pcr(ts));
+            assert(tsaf_get_pcr(ts) * 300 + tsaf_get_pcrext(ts) == cr_prog);
+            ubase_assert(uref_clock_get_ref(uref));
+            nb_pcr++;
+        } else {
+            assert(pid == pids[0] || pid == pids[1]);
+            assert(ts_get_unitstart(ts));
+            nb_es++;
+        }
+        uref_block_peek_unmap(uref, offset, buffer, ts);
+    }
+    uref_free(uref);
+
+    if (nb_pcr == LIMIT && ts_synth != NULL) {
+        upipe_release(ts_synth);
+        ts_synth = NULL;
+    }
+}
+
+/** helper phony pipe */
+static void test_input_es(struct upipe *upipe, struct uref *uref,
+                          struct upump **upump_p)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == PATTERN_SIZE);
+    uint64_t dts_prog, duration;
+    ubase_assert(uref_clock_get_dts_prog(uref, &dts_prog));
+    ubase_assert(uref_clock_get_duration(uref, &duration));
+    assert(dts_prog == next_date);
+    assert(duration == PATTERN_SIZE * UCLOCK_FREQ / ES_OCTETRATE);
+    next_date += duration;
+
+    uint8_t buffer[PATTERN_SIZE];
+    ubase_assert(uref_block_extract(uref, 0, -1, buffer));
+    for (int i = 0; i < PATTERN_SIZE; i++)
+        assert(buffer[i] == (uint8_t)i);
+    uref_free(uref);
+
+    if (++nb_urefs == LIMIT) {
+        upipe_release(ts_synth);
+        ts_synth = NULL;
+    }
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr ts_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input_ts,
+    .upipe_control = test_control
+};
+
+/** helper phony pipe */
+static struct upipe_mgr es_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input_es,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** runs the TS test, paced or not */
+static void run_ts(struct ev_loop *loop, struct upipe_mgr *upipe_ts_synth_mgr,
+                   struct uref_mgr *uref_mgr, struct uprobe *logger)
+{
+    nb_pat = nb_pmt = nb_pcr = nb_es = nb_null = 0;
+    next_date = 0;
+    for (int i = 0; i < 8192; i++)
+        last_cc[i] = -1;
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(flow_def != NULL);
+    ts_synth = upipe_flow_alloc(upipe_ts_synth_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts synth"), flow_def);
+    assert(ts_synth != NULL);
+    uref_free(flow_def);
+
+    ubase_nassert(upipe_ts_mux_set_octetrate(ts_synth, 100));
+    ubase_assert(upipe_ts_mux_set_octetrate(ts_synth, OCTETRATE));
+    ubase_assert(upipe_ts_mux_set_mtu(ts_synth, 7 * TS_SIZE + 42));
+    unsigned int mtu;
+    ubase_assert(upipe_ts_mux_get_mtu(ts_synth, &mtu));
+    assert(mtu == 7 * TS_SIZE);
+    ubase_nassert(upipe_ts_synth_set_pids(ts_synth, PMT_PID, 0, pids));
+    ubase_assert(upipe_ts_synth_set_pids(ts_synth, PMT_PID, NB_PIDS, pids));
+    if (uclock != NULL)
+        ubase_assert(upipe_attach_uclock(ts_synth));
+
+    struct uref *flow_def_out;
+    ubase_assert(upipe_get_flow_def(ts_synth, &flow_def_out));
+    uint64_t octetrate;
+    ubase_assert(uref_block_flow_get_octetrate(flow_def_out, &octetrate));
+    assert(octetrate == OCTETRATE);
+
+    struct upipe *ts_test = upipe_void_alloc(&ts_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "ts test"));
+    assert(ts_test != NULL);
+    ubase_assert(upipe_set_output(ts_synth, ts_test));
+
+    uint64_t start = uclock != NULL ? uclock_now(uclock) : 0;
+    ev_loop(loop, 0);
+    assert(ts_synth == NULL);
+    if (uclock != NULL)
+        assert(uclock_now(uclock) - start >= (LIMIT - 1) * UCLOCK_FREQ / 25);
+
+    /* 100 packets per interval: PCR, PAT, PMT, 2 * 48 ES and 1 null */
+    assert(nb_pat == LIMIT);
+    assert(nb_pmt == LIMIT);
+    assert(nb_es == LIMIT * 96);
+    assert(nb_null == LIMIT);
+    test_free(ts_test);
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s (%s)\n", __DATE__, __TIME__, __FILE__);
+
+    struct ev_loop *loop = ev_default_loop(0);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc(loop,
+                                    UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uclock *uclock_std = uclock_std_alloc(0);
+    assert(uclock_std != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_uclock_alloc(logger, uclock_std);
+    assert(logger != NULL);
+
+    struct upipe_mgr *upipe_ts_synth_mgr = upipe_ts_synth_mgr_alloc();
+    assert(upipe_ts_synth_mgr != NULL);
+
+    /* unpaced, then paced TS */
+    uclock = NULL;
+    run_ts(loop, upipe_ts_synth_mgr, uref_mgr, logger);
+    uclock = uclock_std;
+    run_ts(loop, upipe_ts_synth_mgr, uref_mgr, logger);
+    uclock = NULL;
+
+    /* unpaced ES repeating a pattern */
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "test.");
+    assert(flow_def != NULL);
+    ts_synth = upipe_flow_alloc(upipe_ts_synth_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "es synth"), flow_def);
+    assert(ts_synth != NULL);
+    uref_free(flow_def);
+    ubase_assert(upipe_ts_mux_set_octetrate(ts_synth, ES_OCTETRATE));
+
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 0, 0);
+    assert(ubuf_mgr != NULL);
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, PATTERN_SIZE);
+    assert(uref != NULL);
+    ubuf_mgr_release(ubuf_mgr);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == PATTERN_SIZE);
+    for (int i = 0; i < PATTERN_SIZE; i++)
+        buffer[i] = i;
+    uref_block_unmap(uref, 0);
+    upipe_input(ts_synth, uref, NULL);
+
+    struct upipe *es_test = upipe_void_alloc(&es_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "es test"));
+    assert(es_test != NULL);
+    next_date = 0;
+    ubase_assert(upipe_set_output(ts_synth, es_test));
+    ev_loop(loop, 0);
+    assert(nb_urefs == LIMIT);
+    test_free(es_test);
+
+    upipe_mgr_release(upipe_ts_synth_mgr); // nop
+    uref_mgr_release(uref_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    upump_mgr_release(upump_mgr);
+    uclock_release(uclock_std);
+
+    ev_default_destroy();
+    return 0;
+}
@@ -109,6 +109,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_CLOCK_TS:
         case UPROBE_TS_SPLIT_ADD_PID:
         case UPROBE_TS_SPLIT_DEL_PID:
+        case UPROBE_TS_DEMUX_NEED_WORKER: /* also UPROBE_TS_MUX_NEED_WORKER */
         case UPROBE_SOURCE_END:
         case UPROBE_NEW_FLOW_DEF:
             break;
@@ -64,6 +64,7 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
 
 static uint64_t cr_dts_delay = UINT64_MAX;
+static uint64_t early = UINT64_MAX;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -100,6 +101,8 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(uref != NULL);
     ubase_assert(uref_clock_get_cr_dts_delay(uref, &cr_dts_delay));
     upipe_dbg_va(upipe, "delay: %"PRIu64, cr_dts_delay);
+    early = UINT64_MAX;
+    uref_ts_tstd_get_early_sys(uref, &early);
     uref_free(uref);
 }
 
@@ -136,6 +139,17 @@ static struct upipe_mgr test_mgr = {
     .upipe_control = test_control
 };
 
+/** sends an access unit dated in system time */
+static void test_send(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                      struct ubuf_mgr *ubuf_mgr, int size, uint64_t dts)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, size);
+    assert(uref != NULL);
+    uref_clock_set_dts_prog(uref, dts);
+    uref_clock_set_dts_sys(uref, dts);
+    upipe_input(upipe, uref, NULL);
+}
+
 int main(int argc, char *argv[])
 {
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -225,6 +239,41 @@ int main(int argc, char *argv[])
     cr_dts_delay = UINT64_MAX;
     upipe_input(upipe_ts_tstd, uref, NULL);
     assert(cr_dts_delay == UCLOCK_FREQ / 5);
+    /* no system date */
+    assert(early == UINT64_MAX);
+
+    upipe_release(upipe_ts_tstd);
+
+    /* earliest dates */
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpeg2video.pic.");
+    assert(uref != NULL);
+    ubase_assert(uref_block_flow_set_octetrate(uref, 100));
+    ubase_assert(uref_block_flow_set_buffer_size(uref, 100));
+    upipe_ts_tstd = upipe_void_alloc(upipe_ts_tstd_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "tstd"));
+    assert(upipe_ts_tstd != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_tstd, uref));
+    ubase_assert(upipe_set_output(upipe_ts_tstd, upipe_sink));
+    uref_free(uref);
+
+    /* bounded by the maximum retention time */
+    test_send(upipe_ts_tstd, uref_mgr, ubuf_mgr, 60, 10 * UCLOCK_FREQ);
+    assert(early == 9 * UCLOCK_FREQ);
+    test_send(upipe_ts_tstd, uref_mgr, ubuf_mgr, 30,
+              10 * UCLOCK_FREQ + UCLOCK_FREQ / 10);
+    assert(early == 9 * UCLOCK_FREQ + UCLOCK_FREQ / 10);
+    /* must wait for the first access unit to be decoded */
+    test_send(upipe_ts_tstd, uref_mgr, ubuf_mgr, 50,
+              10 * UCLOCK_FREQ + UCLOCK_FREQ / 5);
+    assert(early == 10 * UCLOCK_FREQ);
+    /* never earlier than the previous access unit */
+    test_send(upipe_ts_tstd, uref_mgr, ubuf_mgr, 10,
+              10 * UCLOCK_FREQ + 3 * UCLOCK_FREQ / 10);
+    assert(early == 10 * UCLOCK_FREQ);
+    /* discontinuity */
+    test_send(upipe_ts_tstd, uref_mgr, ubuf_mgr, 10, 5 * UCLOCK_FREQ);
+    assert(early == 4 * UCLOCK_FREQ);
 
     upipe_release(upipe_ts_tstd);
     upipe_mgr_release(upipe_ts_tstd_mgr);
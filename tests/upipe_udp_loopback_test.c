@@ -0,0 +1,740 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for udp source and sink pipes on the loopback interface
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upump-uring/upump_uring.h>
+#include <upipe-modules/upipe_udp_source.h>
+#include <upipe-modules/upipe_udp_sink.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPUMP_POOL 0
+#define UPUMP_BLOCKER_POOL 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define READ_SIZE 2048
+/** number of datagrams read per wake-up in batch mode */
+#define BATCH 8
+/** number of datagrams sent in batch mode, more than one batch holds */
+#define NB_BATCH_DATAGRAMS (3 * BATCH + 5)
+/** number of datagrams sent in batch mode by the sink */
+#define NB_SINK_DATAGRAMS (2 * BATCH + 3)
+/** index of the datagram too large to be sent, which stops sendmmsg() in the
+ * middle of a batch */
+#define OVERSIZED_DATAGRAM 5
+#define OVERSIZED_SIZE 70000
+/** number of datagrams sent to two destinations */
+#define NB_DESTINATION_DATAGRAMS 12
+/** number of datagrams received by two sources sharing a socket */
+#define NB_SHARED_DATAGRAMS 10
+/** number of datagrams dated with their receive time */
+#define NB_DATED_DATAGRAMS (2 * BATCH)
+/** time between the reception of the datagrams and their reading */
+#define READ_DELAY (UCLOCK_FREQ / 20)
+/** number of datagrams paced by the sink */
+#define NB_PACED_DATAGRAMS 8
+/** interval between the dates of the paced datagrams */
+#define PACING_INTERVAL (UCLOCK_FREQ / 100)
+/** spin margin of the pacing test, longer than the busy-wait */
+#define PACING_ADVANCE (UCLOCK_FREQ / 200)
+/** idle timeout of the hibernation test */
+#define IDLE_TIMEOUT (UCLOCK_FREQ / 50)
+/** time after which a test is considered to have failed */
+#define TEST_TIMEOUT (UCLOCK_FREQ * 2)
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static struct upump_mgr *upump_mgr;
+static struct uclock *uclock;
+static struct uprobe *logger;
+
+/** sources closed when all the expected datagrams are received */
+static struct upipe *sources[2];
+static unsigned int nb_sources;
+/** number of datagrams expected by the current test */
+static unsigned int nb_expected;
+/** number of datagrams received by the current test */
+static unsigned int nb_received;
+/** number of ticks of the current test */
+static uint64_t nb_ticks;
+/** function called on each tick of the current test, or NULL */
+static void (*tick)(void);
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the size of the given datagram. */
+static size_t datagram_size(unsigned int seq)
+{
+    return 64 + seq * 37 % (READ_SIZE - 64);
+}
+
+/** helper phony pipe */
+struct udp_test {
+    /** sequence number of the next datagram */
+    unsigned int seq;
+    /** date of the previous datagram, or 0 */
+    uint64_t date;
+    /** number of dated datagrams */
+    unsigned int nb_dated;
+    /** number of hibernations */
+    unsigned int nb_hibernations;
+    /** date of the last datagram or hibernation */
+    uint64_t event_date;
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+UPIPE_HELPER_UPIPE(udp_test, upipe, 0);
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct udp_test *udp_test = malloc(sizeof(struct udp_test));
+    assert(udp_test != NULL);
+    udp_test->seq = 0;
+    udp_test->date = 0;
+    udp_test->nb_dated = 0;
+    udp_test->nb_hibernations = 0;
+    udp_test->event_date = 0;
+    upipe_init(&udp_test->upipe, mgr, uprobe);
+    upipe_throw_ready(&udp_test->upipe);
+    return &udp_test->upipe;
+}
+
+/** helper checking the size and the payload of a datagram */
+static void check_datagram(struct uref *uref, unsigned int seq)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == datagram_size(seq));
+    uint8_t buffer[READ_SIZE];
+    ubase_assert(uref_block_extract(uref, 0, size, buffer));
+    assert(buffer[0] == (uint8_t)(seq >> 8));
+    assert(buffer[1] == (uint8_t)seq);
+    for (size_t i = 2; i < size; i++)
+        assert(buffer[i] == (uint8_t)(seq + i));
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct udp_test *udp_test = udp_test_from_upipe(upipe);
+    check_datagram(uref, udp_test->seq);
+    uint64_t date;
+    if (ubase_check(uref_clock_get_cr_sys(uref, &date))) {
+        /* the kernel dated the datagram when it was received, before our
+         * delayed read */
+        assert(date + READ_DELAY / 2 <= uclock_now(uclock));
+        assert(date >= udp_test->date);
+        udp_test->date = date;
+        udp_test->nb_dated++;
+    }
+    upipe_dbg_va(upipe, "received datagram %u", udp_test->seq);
+    udp_test->event_date = uclock_now(uclock);
+    udp_test->seq++;
+    nb_received++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_HIBERNATE: {
+            struct udp_test *udp_test = udp_test_from_upipe(upipe);
+            uint64_t now = uclock_now(uclock);
+            /* the source hibernates after a full timeout without traffic */
+            assert(now >= udp_test->event_date + IDLE_TIMEOUT);
+            udp_test->event_date = now;
+            udp_test->nb_hibernations++;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    struct udp_test *udp_test = udp_test_from_upipe(upipe);
+    upipe_clean(upipe);
+    free(udp_test);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr udp_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper opening a socket bound to a free port of the loopback interface */
+static int open_socket(struct sockaddr_in *addr)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd != -1);
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(fd, (struct sockaddr *)addr, sizeof(struct sockaddr_in)) == 0);
+    socklen_t len = sizeof(struct sockaddr_in);
+    assert(getsockname(fd, (struct sockaddr *)addr, &len) == 0);
+    return fd;
+}
+
+/** helper returning the uri of a free port of the loopback interface */
+static void free_uri(char *uri, size_t size)
+{
+    struct sockaddr_in addr;
+    close(open_socket(&addr));
+    snprintf(uri, size, "127.0.0.1:%u", ntohs(addr.sin_port));
+}
+
+/** helper sending datagrams to a port of the loopback interface */
+static void send_datagrams(const char *uri, unsigned int first,
+                           unsigned int nb)
+{
+    struct sockaddr_in addr;
+    int fd = open_socket(&addr);
+    addr.sin_port = htons(atoi(strchr(uri, ':') + 1));
+    for (unsigned int seq = first; seq < first + nb; seq++) {
+        uint8_t buffer[READ_SIZE];
+        size_t size = datagram_size(seq);
+        buffer[0] = seq >> 8;
+        buffer[1] = seq;
+        for (size_t i = 2; i < size; i++)
+            buffer[i] = seq + i;
+        assert(sendto(fd, buffer, size, 0, (struct sockaddr *)&addr,
+                      sizeof(addr)) == size);
+    }
+    close(fd);
+}
+
+/** helper allocating a datagram */
+static struct uref *alloc_datagram(unsigned int seq)
+{
+    size_t size = datagram_size(seq);
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, size);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int write_size = -1;
+    ubase_assert(uref_block_write(uref, 0, &write_size, &buffer));
+    assert(write_size == size);
+    buffer[0] = seq >> 8;
+    buffer[1] = seq;
+    for (size_t i = 2; i < size; i++)
+        buffer[i] = seq + i;
+    ubase_assert(uref_block_unmap(uref, 0));
+    return uref;
+}
+
+/** helper allocating a udp source reading the given uri */
+static struct upipe *alloc_source(const char *name, struct upipe *output)
+{
+    struct upipe_mgr *upipe_udpsrc_mgr = upipe_udpsrc_mgr_alloc();
+    assert(upipe_udpsrc_mgr != NULL);
+    struct upipe *upipe_udpsrc = upipe_void_alloc(upipe_udpsrc_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, name));
+    assert(upipe_udpsrc != NULL);
+    upipe_mgr_release(upipe_udpsrc_mgr);
+    ubase_assert(upipe_set_output(upipe_udpsrc, output));
+    ubase_assert(upipe_source_set_read_size(upipe_udpsrc, READ_SIZE));
+    return upipe_udpsrc;
+}
+
+/** timer ending the event loop once all the datagrams are received */
+static void timer_cb(struct upump *upump)
+{
+    nb_ticks++;
+    assert(nb_ticks * UCLOCK_FREQ / 1000 < TEST_TIMEOUT);
+    if (tick != NULL)
+        tick();
+    if (nb_received < nb_expected)
+        return;
+    assert(nb_received == nb_expected);
+
+    for (unsigned int i = 0; i < nb_sources; i++)
+        ubase_assert(upipe_set_uri(sources[i], NULL));
+    upump_stop(upump);
+}
+
+/** helper running the event loop until the expected datagrams are
+ * received */
+static void run(unsigned int expected)
+{
+    nb_expected = expected;
+    nb_received = 0;
+    nb_ticks = 0;
+    struct upump *timer = upump_alloc_timer(upump_mgr, timer_cb, NULL,
+                                            UCLOCK_FREQ / 1000,
+                                            UCLOCK_FREQ / 1000);
+    assert(timer != NULL);
+    upump_start(timer);
+    upump_uring_mgr_run(upump_mgr);
+    upump_free(timer);
+}
+
+/** receives more datagrams than one batch holds */
+static void test_batch(void)
+{
+    struct upipe *output = upipe_void_alloc(&udp_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "batch output"));
+    assert(output != NULL);
+    struct upipe *upipe_udpsrc = alloc_source("batch source", output);
+    unsigned int batch;
+    ubase_assert(upipe_udpsrc_get_batch(upipe_udpsrc, &batch));
+    assert(batch == 1);
+    ubase_nassert(upipe_udpsrc_set_batch(upipe_udpsrc, 0));
+    ubase_assert(upipe_udpsrc_set_batch(upipe_udpsrc, BATCH));
+    ubase_assert(upipe_udpsrc_get_batch(upipe_udpsrc, &batch));
+    assert(batch == BATCH);
+
+    char uri[64];
+    free_uri(uri + 1, sizeof(uri) - 1);
+    uri[0] = '@';
+    ubase_assert(upipe_set_uri(upipe_udpsrc, uri));
+    send_datagrams(uri + 1, 0, NB_BATCH_DATAGRAMS);
+
+    sources[0] = upipe_udpsrc;
+    nb_sources = 1;
+    run(NB_BATCH_DATAGRAMS);
+    assert(udp_test_from_upipe(output)->seq == NB_BATCH_DATAGRAMS);
+
+    upipe_release(upipe_udpsrc);
+    test_free(output);
+}
+
+/** helper allocating a udp sink sending to the given uri */
+static struct upipe *alloc_sink(const char *name, const char *uri)
+{
+    struct upipe_mgr *upipe_udpsink_mgr = upipe_udpsink_mgr_alloc();
+    assert(upipe_udpsink_mgr != NULL);
+    struct upipe *upipe_udpsink = upipe_void_alloc(upipe_udpsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, name));
+    assert(upipe_udpsink != NULL);
+    upipe_mgr_release(upipe_udpsink_mgr);
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_udpsink, flow_def));
+    uref_free(flow_def);
+    ubase_assert(upipe_udpsink_set_uri(upipe_udpsink, uri, 0));
+    return upipe_udpsink;
+}
+
+/** sends several batches of datagrams, one of which is sent in two system
+ * calls */
+static void test_sink_batch(void)
+{
+    struct upipe *output = upipe_void_alloc(&udp_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "sink batch output"));
+    assert(output != NULL);
+    struct upipe *upipe_udpsrc = alloc_source("sink batch source", output);
+    char uri[64];
+    free_uri(uri + 1, sizeof(uri) - 1);
+    uri[0] = '@';
+    ubase_assert(upipe_set_uri(upipe_udpsrc, uri));
+
+    struct upipe *upipe_udpsink = alloc_sink("batch sink", uri + 1);
+    unsigned int batch;
+    uint64_t tolerance;
+    ubase_assert(upipe_udpsink_set_batch(upipe_udpsink, BATCH, 0));
+    ubase_assert(upipe_udpsink_get_batch(upipe_udpsink, &batch, &tolerance));
+    assert(batch == BATCH);
+    assert(tolerance == 0);
+
+    /* the kernel rejects the oversized datagram, so sendmmsg() only sends
+     * the datagrams before it, and the sink skips it on the next call */
+    unsigned int seq = 0;
+    for (unsigned int i = 0; i < NB_SINK_DATAGRAMS + 1; i++) {
+        if (i != OVERSIZED_DATAGRAM) {
+            upipe_input(upipe_udpsink, alloc_datagram(seq++), NULL);
+            continue;
+        }
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                                             OVERSIZED_SIZE);
+        assert(uref != NULL);
+        upipe_input(upipe_udpsink, uref, NULL);
+    }
+
+    sources[0] = upipe_udpsrc;
+    nb_sources = 1;
+    run(NB_SINK_DATAGRAMS);
+    assert(udp_test_from_upipe(output)->seq == NB_SINK_DATAGRAMS);
+
+    upipe_release(upipe_udpsink);
+    upipe_release(upipe_udpsrc);
+    test_free(output);
+}
+
+/** sends datagrams to two receivers */
+static void test_destinations(void)
+{
+    struct upipe *outputs[2];
+    char uris[2][64];
+    for (unsigned int i = 0; i < 2; i++) {
+        outputs[i] = upipe_void_alloc(&udp_test_mgr,
+                uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                    "destination output %u", i));
+        assert(outputs[i] != NULL);
+        sources[i] = alloc_source("destination source", outputs[i]);
+        free_uri(uris[i] + 1, sizeof(uris[i]) - 1);
+        uris[i][0] = '@';
+        ubase_assert(upipe_set_uri(sources[i], uris[i]));
+    }
+    nb_sources = 2;
+
+    /* the datagrams are sent to the uri of the sink and to the additional
+     * destination with one sendmmsg() */
+    struct upipe *upipe_udpsink = alloc_sink("destination sink", uris[0] + 1);
+    ubase_nassert(upipe_udpsink_del_destination(upipe_udpsink,
+                                                uris[1] + 1));
+    ubase_assert(upipe_udpsink_add_destination(upipe_udpsink, uris[1] + 1));
+    for (unsigned int seq = 0; seq < NB_DESTINATION_DATAGRAMS; seq++)
+        upipe_input(upipe_udpsink, alloc_datagram(seq), NULL);
+
+    run(2 * NB_DESTINATION_DATAGRAMS);
+    for (unsigned int i = 0; i < 2; i++)
+        assert(udp_test_from_upipe(outputs[i])->seq ==
+               NB_DESTINATION_DATAGRAMS);
+
+    ubase_assert(upipe_udpsink_del_destination(upipe_udpsink, uris[1] + 1));
+    ubase_nassert(upipe_udpsink_del_destination(upipe_udpsink,
+                                                uris[1] + 1));
+    upipe_release(upipe_udpsink);
+    for (unsigned int i = 0; i < 2; i++) {
+        upipe_release(sources[i]);
+        test_free(outputs[i]);
+    }
+}
+
+/** receives datagrams with two sources sharing a socket */
+static void test_shared(void)
+{
+    struct upipe *outputs[2];
+    char uri[64];
+    free_uri(uri + 1, sizeof(uri) - 1);
+    uri[0] = '@';
+    for (unsigned int i = 0; i < 2; i++) {
+        outputs[i] = upipe_void_alloc(&udp_test_mgr,
+                uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                    "shared output %u", i));
+        assert(outputs[i] != NULL);
+        sources[i] = alloc_source("shared source", outputs[i]);
+        bool shared;
+        ubase_assert(upipe_udpsrc_get_shared(sources[i], &shared));
+        assert(!shared);
+        ubase_assert(upipe_udpsrc_set_shared(sources[i], true));
+        ubase_assert(upipe_udpsrc_get_shared(sources[i], &shared));
+        assert(shared);
+        ubase_assert(upipe_set_uri(sources[i], uri));
+    }
+    nb_sources = 2;
+
+    /* a source asking for other receive timestamps can't share the socket,
+     * and the timestamps of the shared socket can't be changed */
+    struct upipe *upipe_udpsrc = alloc_source("timestamp source", outputs[0]);
+    ubase_assert(upipe_udpsrc_set_shared(upipe_udpsrc, true));
+    ubase_assert(upipe_udpsrc_set_timestamp(upipe_udpsrc,
+                                            UPIPE_UDPSRC_TIMESTAMP_SOFTWARE));
+    ubase_nassert(upipe_set_uri(upipe_udpsrc, uri));
+    upipe_release(upipe_udpsrc);
+    ubase_nassert(upipe_udpsrc_set_timestamp(sources[1],
+                                             UPIPE_UDPSRC_TIMESTAMP_SOFTWARE));
+    enum upipe_udpsrc_timestamp timestamp;
+    ubase_assert(upipe_udpsrc_get_timestamp(sources[1], &timestamp));
+    assert(timestamp == UPIPE_UDPSRC_TIMESTAMP_NONE);
+
+    /* the first source reads the socket and outputs each datagram to both */
+    send_datagrams(uri + 1, 0, NB_SHARED_DATAGRAMS);
+    run(2 * NB_SHARED_DATAGRAMS);
+    for (unsigned int i = 0; i < 2; i++) {
+        assert(udp_test_from_upipe(outputs[i])->seq == NB_SHARED_DATAGRAMS);
+        upipe_release(sources[i]);
+        test_free(outputs[i]);
+    }
+}
+
+/** dates datagrams with their kernel receive time */
+static void test_timestamp(unsigned int batch)
+{
+    struct upipe *output = upipe_void_alloc(&udp_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "timestamp output"));
+    assert(output != NULL);
+    struct upipe *upipe_udpsrc = alloc_source("timestamp source", output);
+    ubase_assert(upipe_attach_uclock(upipe_udpsrc));
+    ubase_assert(upipe_udpsrc_set_batch(upipe_udpsrc, batch));
+    enum upipe_udpsrc_timestamp timestamp;
+    ubase_assert(upipe_udpsrc_get_timestamp(upipe_udpsrc, &timestamp));
+    assert(timestamp == UPIPE_UDPSRC_TIMESTAMP_NONE);
+    ubase_assert(upipe_udpsrc_set_timestamp(upipe_udpsrc,
+                                            UPIPE_UDPSRC_TIMESTAMP_SOFTWARE));
+    ubase_assert(upipe_udpsrc_get_timestamp(upipe_udpsrc, &timestamp));
+    assert(timestamp == UPIPE_UDPSRC_TIMESTAMP_SOFTWARE);
+
+    char uri[64];
+    free_uri(uri + 1, sizeof(uri) - 1);
+    uri[0] = '@';
+    ubase_assert(upipe_set_uri(upipe_udpsrc, uri));
+    send_datagrams(uri + 1, 0, NB_DATED_DATAGRAMS);
+    usleep(READ_DELAY * 1000000 / UCLOCK_FREQ);
+
+    sources[0] = upipe_udpsrc;
+    nb_sources = 1;
+    run(NB_DATED_DATAGRAMS);
+    assert(udp_test_from_upipe(output)->seq == NB_DATED_DATAGRAMS);
+    assert(udp_test_from_upipe(output)->nb_dated == NB_DATED_DATAGRAMS);
+
+    upipe_release(upipe_udpsrc);
+    test_free(output);
+}
+
+/** paces datagrams in spin mode, with a margin waited with the timer */
+static void test_pacing(void)
+{
+    struct upipe *output = upipe_void_alloc(&udp_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "pacing output"));
+    assert(output != NULL);
+    struct upipe *upipe_udpsrc = alloc_source("pacing source", output);
+    char uri[64];
+    free_uri(uri + 1, sizeof(uri) - 1);
+    uri[0] = '@';
+    ubase_assert(upipe_set_uri(upipe_udpsrc, uri));
+
+    struct upipe *upipe_udpsink = alloc_sink("pacing sink", uri + 1);
+    ubase_assert(upipe_attach_uclock(upipe_udpsink));
+    clockid_t clock;
+    ubase_assert(upipe_udpsink_get_txtime_clock(upipe_udpsink, &clock));
+    assert(clock == CLOCK_MONOTONIC);
+    ubase_nassert(upipe_udpsink_set_txtime_clock(upipe_udpsink, 1000));
+    ubase_assert(upipe_udpsink_set_txtime_clock(upipe_udpsink, CLOCK_TAI));
+    ubase_assert(upipe_udpsink_get_txtime_clock(upipe_udpsink, &clock));
+    assert(clock == CLOCK_TAI);
+    ubase_assert(upipe_udpsink_set_txtime_clock(upipe_udpsink,
+                                                CLOCK_MONOTONIC));
+    ubase_assert(upipe_udpsink_set_pacing(upipe_udpsink,
+                UPIPE_UDPSINK_PACING_SPIN, PACING_ADVANCE));
+
+    uint64_t date = uclock_now(uclock) + PACING_INTERVAL;
+    for (unsigned int seq = 0; seq < NB_PACED_DATAGRAMS; seq++) {
+        struct uref *uref = alloc_datagram(seq);
+        uref_clock_set_cr_sys(uref, date + seq * PACING_INTERVAL);
+        upipe_input(upipe_udpsink, uref, NULL);
+    }
+
+    sources[0] = upipe_udpsrc;
+    nb_sources = 1;
+    run(NB_PACED_DATAGRAMS);
+    assert(udp_test_from_upipe(output)->seq == NB_PACED_DATAGRAMS);
+    /* the last datagram was not sent before its date */
+    assert(uclock_now(uclock) >=
+           date + (NB_PACED_DATAGRAMS - 1) * PACING_INTERVAL);
+
+    upipe_release(upipe_udpsink);
+    upipe_release(upipe_udpsrc);
+    test_free(output);
+}
+
+/** output and uri of the hibernation test */
+static struct upipe *hibernate_output;
+static char hibernate_uri[64];
+/** true if the datagram waking the source up was sent */
+static bool hibernate_sent = false;
+
+/** sends a datagram once the source hibernated */
+static void hibernate_tick(void)
+{
+    struct udp_test *udp_test = udp_test_from_upipe(hibernate_output);
+    if (!hibernate_sent && udp_test->nb_hibernations == 1) {
+        assert(udp_test->seq == 1);
+        send_datagrams(hibernate_uri + 1, 1, 1);
+        hibernate_sent = true;
+    }
+}
+
+/** hibernates a source without traffic, and wakes it up */
+static void test_hibernate(void)
+{
+    hibernate_output = upipe_void_alloc(&udp_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "hibernate output"));
+    assert(hibernate_output != NULL);
+    struct upipe *upipe_udpsrc = alloc_source("hibernate source",
+                                              hibernate_output);
+    ubase_assert(upipe_udpsrc_set_batch(upipe_udpsrc, BATCH));
+    uint64_t timeout;
+    ubase_assert(upipe_udpsrc_get_idle_timeout(upipe_udpsrc, &timeout));
+    assert(timeout == 0);
+    ubase_assert(upipe_udpsrc_set_idle_timeout(upipe_udpsrc, IDLE_TIMEOUT));
+    ubase_assert(upipe_udpsrc_get_idle_timeout(upipe_udpsrc, &timeout));
+    assert(timeout == IDLE_TIMEOUT);
+
+    free_uri(hibernate_uri + 1, sizeof(hibernate_uri) - 1);
+    hibernate_uri[0] = '@';
+    ubase_assert(upipe_set_uri(upipe_udpsrc, hibernate_uri));
+    send_datagrams(hibernate_uri + 1, 0, 1);
+    udp_test_from_upipe(hibernate_output)->event_date = uclock_now(uclock);
+
+    sources[0] = upipe_udpsrc;
+    nb_sources = 1;
+    tick = hibernate_tick;
+    run(2);
+    tick = NULL;
+    /* the second datagram was received after the hibernation */
+    struct udp_test *udp_test = udp_test_from_upipe(hibernate_output);
+    assert(hibernate_sent);
+    assert(udp_test->seq == 2);
+    assert(udp_test->nb_hibernations == 1);
+
+    upipe_release(upipe_udpsrc);
+    test_free(hibernate_output);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    upump_mgr = upump_uring_mgr_alloc(64, UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    logger = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_uclock_alloc(logger, uclock);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    test_batch();
+    test_sink_batch();
+    test_destinations();
+    test_shared();
+    test_timestamp(1);
+    test_timestamp(BATCH);
+    test_hibernate();
+    test_pacing();
+
+    upump_mgr_release(upump_mgr);
+    uclock_release(uclock);
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -91,6 +91,7 @@
     fprintf(stdout, " /ifaddr=XXX.XXX.XXX.XXX (binds to a specific network interface, by address)\n");
     fprintf(stdout, " /ttl=XX (time-to-live of the UDP packet)\n");
     fprintf(stdout, " /tos=XX (sets the IPv4 Type Of Service option)\n");
+    fprintf(stdout, " /busy_poll=XX (busy polls the device for XX microseconds)\n");
     fprintf(stdout, " /tcp (binds a TCP socket instead of UDP)\n");
 
     exit(EXIT_FAILURE);
@@ -154,6 +155,9 @@ static void test_input(struct upipe *upipe, struct uref *uref,
 	struct udpsrc_test *udpsrc_test = udpsrc_test_from_upipe(upipe);
     assert(uref != NULL);
 
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == BUF_SIZE);
     if ((rbuf = uref_block_peek(uref, 0, -1, buf))) {
         upipe_dbg_va(upipe, "Received string: %s", rbuf);
         snprintf((char *)str, sizeof(str), FORMAT, udpsrc_test->counter);
@@ -237,15 +241,20 @@ static void genpackets2(struct upump *upump)
 		return;
 	}
 
-	for (i=0; i < 10; i++) {
-        uref = uref_block_alloc(uref_mgr, ubuf_mgr, BUF_SIZE);
+	for (i=0; i < 10; i += 2) {
+        /* super-chunks of two datagrams */
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, 2 * BUF_SIZE);
         uref_block_write(uref, 0, &size, &buf);
-        assert(size == BUF_SIZE);
+        assert(size == 2 * BUF_SIZE);
         memset(buf, 0, size);
 		snprintf((char *)buf, BUF_SIZE, FORMAT, counter);
-        uref_block_unmap(uref, 0);
 		counter++;
+		snprintf((char *)buf + BUF_SIZE, BUF_SIZE, FORMAT, counter);
+		counter++;
+        uref_block_unmap(uref, 0);
+        ubase_assert(uref_block_set_segment_size(uref, BUF_SIZE));
         upipe_input(upipe_udpsink, uref, NULL);
+        size = -1;
 	}
 }
 
@@ -365,6 +374,17 @@ int main(int argc, char *argv[])
 	assert(ret);
     ubase_assert(upipe_udpsink_set_uri(upipe_udpsink, udp_uri+1, 0));
 
+    /* pacing parameters (the sink is not live, they are not used) */
+    enum upipe_udpsink_pacing pacing;
+    uint64_t advance;
+    ubase_nassert(upipe_udpsink_set_pacing(upipe_udpsink,
+                UPIPE_UDPSINK_PACING_SPIN, UCLOCK_FREQ));
+    ubase_assert(upipe_udpsink_set_pacing(upipe_udpsink,
+                UPIPE_UDPSINK_PACING_SPIN, UCLOCK_FREQ / 1000));
+    ubase_assert(upipe_udpsink_get_pacing(upipe_udpsink, &pacing, &advance));
+    assert(pacing == UPIPE_UDPSINK_PACING_SPIN);
+    assert(advance == UCLOCK_FREQ / 1000);
+
     /* redefine write pump */
     write_pump = upump_alloc_idler(upump_mgr, genpackets2, NULL);
     assert(write_pump);
@@ -373,6 +393,12 @@ int main(int argc, char *argv[])
     /* fire again */
     ev_loop(loop, 0);
 
+    uint64_t jitter_mean, jitter_max;
+    ubase_assert(upipe_udpsink_get_jitter(upipe_udpsink, &jitter_mean,
+                                          &jitter_max));
+    assert(jitter_mean == 0 && jitter_max == 0);
+    assert(udpsrc_test_from_upipe(udpsrc_test)->counter == 210);
+
 	/* release */
     upump_free(write_pump);
     upipe_release(upipe_udpsrc);
@@ -57,6 +57,9 @@
 #define TOLERANCE           UCLOCK_FREQ / 1000
 #define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
 
+static unsigned int nb_packets = 0;
+static bool expect_pic = false;
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list args)
 {
@@ -72,6 +75,58 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list
     return UBASE_ERR_NONE;
 }
 
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    assert((uref->ubuf != NULL) == expect_pic);
+    nb_packets++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr videocont_test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
@@ -166,6 +221,13 @@ int main(int argc, char **argv)
         }
     }
 
+    int freeze;
+    ubase_assert(upipe_videocont_get_freeze(videocont, &freeze));
+    assert(!freeze);
+    ubase_assert(upipe_videocont_set_freeze(videocont, 1));
+    ubase_assert(upipe_videocont_get_freeze(videocont, &freeze));
+    assert(freeze);
+
     /* now send reference urefs */
     for (i=0; i < ITERATIONS; i++) {
         struct uref *uref = uref_alloc(uref_mgr);
@@ -173,12 +235,34 @@ int main(int argc, char **argv)
         upipe_input(videocont, uref, NULL);
     }
 
+    /* input lost: the last picture is repeated */
+    struct upipe *sink = upipe_void_alloc(&videocont_test_mgr,
+                                          uprobe_use(logger));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(videocont, sink));
+    expect_pic = true;
+    for (i=0; i < ITERATIONS; i++) {
+        struct uref *uref = uref_alloc(uref_mgr);
+        uref_clock_set_pts_sys(uref, 10 * UCLOCK_FREQ + i * TOLERANCE * 10);
+        upipe_input(videocont, uref, NULL);
+    }
+    assert(nb_packets == ITERATIONS);
+
+    /* no freeze: reference packets are output as is */
+    ubase_assert(upipe_videocont_set_freeze(videocont, 0));
+    expect_pic = false;
+    struct uref *uref = uref_alloc(uref_mgr);
+    uref_clock_set_pts_sys(uref, 20 * UCLOCK_FREQ);
+    upipe_input(videocont, uref, NULL);
+    assert(nb_packets == ITERATIONS + 1);
+
     for (i=0; i < INPUT_NUM; i++) {
         upipe_release(subpipe[i]);
     }
 
     /* release pipe */
     upipe_release(videocont);
+    test_free(sink);
 
     /* release managers */
     upipe_mgr_release(upipe_videocont_mgr); // no-op
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for upool and upool_cache
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/upool.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define UPOOL_DEPTH 8
+#define UPOOL_CACHE_DEPTH 4
+#define NB_ELEMS (UPOOL_DEPTH + UPOOL_CACHE_DEPTH)
+
+static int allocated = 0;
+
+static void *elem_alloc(struct upool *upool)
+{
+    allocated++;
+    return malloc(1);
+}
+
+static void elem_free(struct upool *upool, void *obj)
+{
+    allocated--;
+    free(obj);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t upool_extra[upool_sizeof(UPOOL_DEPTH)];
+    uint8_t cache_extra[upool_cache_sizeof(UPOOL_CACHE_DEPTH)];
+    void *elems[NB_ELEMS + 1];
+    struct upool upool;
+    struct upool_cache cache;
+    int i;
+
+    upool_init(&upool, UPOOL_DEPTH, upool_extra, elem_alloc, elem_free);
+    upool_cache_init(&cache, &upool, UPOOL_CACHE_DEPTH, cache_extra);
+
+    for (i = 0; i < NB_ELEMS; i++) {
+        elems[i] = upool_cache_alloc(&cache, void *);
+        assert(elems[i] != NULL);
+    }
+    assert(allocated == NB_ELEMS);
+    printf("Passed 1\n");
+
+    /* the cache and the shared pool retain everything */
+    for (i = 0; i < NB_ELEMS; i++)
+        upool_cache_free(&cache, elems[i]);
+    assert(allocated == NB_ELEMS);
+    assert(cache.count == UPOOL_CACHE_DEPTH);
+    printf("Passed 2\n");
+
+    /* the cache is refilled from the shared pool */
+    for (i = 0; i < NB_ELEMS; i++) {
+        elems[i] = upool_cache_alloc(&cache, void *);
+        assert(elems[i] != NULL);
+    }
+    assert(allocated == NB_ELEMS);
+    assert(cache.count == 0);
+    printf("Passed 3\n");
+
+    /* overflowing both the cache and the pool releases elements */
+    elems[NB_ELEMS] = upool_cache_alloc(&cache, void *);
+    assert(elems[NB_ELEMS] != NULL);
+    assert(allocated == NB_ELEMS + 1);
+    for (i = 0; i <= NB_ELEMS; i++)
+        upool_cache_free(&cache, elems[i]);
+    assert(allocated == cache.count + UPOOL_DEPTH);
+    printf("Passed 4\n");
+
+    upool_cache_clean(&cache);
+    assert(cache.count == 0);
+    assert(allocated == UPOOL_DEPTH);
+    struct upool_stats stats;
+    upool_get_stats(&upool, &stats);
+    assert(stats.length == UPOOL_DEPTH);
+    assert(stats.depth == UPOOL_DEPTH);
+    assert(stats.created - stats.destroyed == allocated);
+    uint32_t overflows = stats.overflows;
+    printf("Passed 5\n");
+
+    /* shrinking the pool releases the elements in excess */
+    upool_resize(&upool, UPOOL_DEPTH / 2);
+    assert(allocated == UPOOL_DEPTH / 2);
+    for (i = 0; i < UPOOL_DEPTH; i++) {
+        elems[i] = upool_alloc(&upool, void *);
+        assert(elems[i] != NULL);
+    }
+    assert(allocated == UPOOL_DEPTH);
+    for (i = 0; i < UPOOL_DEPTH; i++)
+        upool_free(&upool, elems[i]);
+    assert(allocated == UPOOL_DEPTH / 2);
+    upool_get_stats(&upool, &stats);
+    assert(stats.depth == UPOOL_DEPTH / 2);
+    assert(stats.overflows == overflows + UPOOL_DEPTH / 2);
+    assert(stats.created - stats.destroyed == allocated);
+    printf("Passed 6\n");
+
+    /* growing the pool is capped to its initial length */
+    upool_resize(&upool, UPOOL_DEPTH * 2);
+    upool_get_stats(&upool, &stats);
+    assert(stats.depth == UPOOL_DEPTH);
+    for (i = 0; i <= UPOOL_DEPTH; i++) {
+        elems[i] = upool_alloc(&upool, void *);
+        assert(elems[i] != NULL);
+    }
+    for (i = 0; i <= UPOOL_DEPTH; i++)
+        upool_free(&upool, elems[i]);
+    assert(allocated == UPOOL_DEPTH);
+    printf("Passed 7\n");
+
+    /* other threads and disabled caches use the shared pool directly */
+    struct upool_cache disabled;
+    upool_cache_init(&disabled, &upool, 1, NULL);
+    upool_cache_init(&cache, &upool, UPOOL_CACHE_DEPTH, cache_extra);
+    cache.owner = NULL;
+    for (i = 0; i < UPOOL_DEPTH; i++) {
+        elems[i] = i % 2 ? upool_cache_alloc(&cache, void *) :
+                           upool_cache_alloc(&disabled, void *);
+        assert(elems[i] != NULL);
+    }
+    assert(allocated == UPOOL_DEPTH);
+    for (i = 0; i < UPOOL_DEPTH; i++) {
+        if (i % 2)
+            upool_cache_free(&cache, elems[i]);
+        else
+            upool_cache_free(&disabled, elems[i]);
+    }
+    assert(cache.count == 0);
+    assert(disabled.count == 0);
+    upool_cache_vacuum(&cache);
+    assert(allocated == UPOOL_DEPTH);
+    printf("Passed 8\n");
+
+    upool_clean(&upool);
+    assert(allocated == 0);
+    printf("Passed 9\n");
+    return 0;
+}
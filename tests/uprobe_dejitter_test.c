@@ -34,6 +34,7 @@
 #include <upipe/uprobe_stdio.h>
 #include <upipe/uprobe_dejitter.h>
 #include <upipe/upipe.h>
+#include <upipe/uclock.h>
 #include <upipe/umem.h>
 #include <upipe/umem_alloc.h>
 #include <upipe/udict.h>
@@ -87,7 +88,7 @@ int main(int argc, char **argv)
                                                            10);
     assert(uprobe_dejitter != NULL);
 
-    struct upipe test_pipe;
+    struct upipe test_pipe = { 0 };
     test_pipe.uprobe = uprobe_dejitter;
     struct upipe *upipe = &test_pipe;
 
@@ -113,7 +114,43 @@ int main(int argc, char **argv)
     uref_clock_set_pts_prog(uref, clock);
     upipe_throw_clock_ts(upipe, uref);
     ubase_assert(uref_clock_get_pts_sys(uref, &pts));
-    assert(pts == systime + 2500);
+    assert(pts == systime + 3000);
+    uprobe_release(uprobe_dejitter);
+
+    /* jittery references with a drift of 40 ppm */
+    uprobe_dejitter = uprobe_dejitter_alloc(uprobe_use(logger), 100);
+    assert(uprobe_dejitter != NULL);
+    test_pipe.uprobe = uprobe_dejitter;
+    struct uprobe_dejitter *dejitter =
+        uprobe_dejitter_from_uprobe(uprobe_dejitter);
+    uint32_t seed = 42;
+    int64_t base = UINT32_MAX;
+    clock = 0;
+    for (int i = 0; i < 1000; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint64_t jitter = (seed >> 8) % (UCLOCK_FREQ / 500);
+        /* a few late packets */
+        if (i % 100 == 50)
+            jitter += UCLOCK_FREQ / 20;
+        clock += UCLOCK_FREQ / 25;
+        systime = base + clock + clock / 25000 + jitter;
+        uref_clock_set_cr_sys(uref, systime);
+        upipe_throw_clock_ref(upipe, uref, clock, i == 0);
+        if (i % 100 == 50)
+            assert(dejitter->outliers == 1);
+    }
+    /* the estimate tracks the average jitter */
+    int64_t expected = base + clock / 25000 + UCLOCK_FREQ / 1000;
+    assert(llabs(dejitter->offset - expected) < UCLOCK_FREQ / 2000);
+    assert(dejitter->deviation < UCLOCK_FREQ / 1000);
+    assert(dejitter->drift > 0 && dejitter->drift < 0.0001);
+
+    uref_clock_set_pts_prog(uref, clock + UCLOCK_FREQ);
+    upipe_throw_clock_ts(upipe, uref);
+    ubase_assert(uref_clock_get_pts_sys(uref, &pts));
+    expected += clock + UCLOCK_FREQ + UCLOCK_FREQ / 25000;
+    assert(llabs(pts - dejitter->deviation * 3 - expected) <
+           UCLOCK_FREQ / 2000);
 
     uref_free(uref);
     uprobe_release(uprobe_dejitter);
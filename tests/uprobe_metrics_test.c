@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_metrics implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/urefcount.h>
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_dejitter.h>
+#include <upipe/uprobe_metrics.h>
+#include <upipe/upipe.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/umem_pool.h>
+#include <upipe/umem_acct.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_SYNC_LOST:
+        case UPROBE_OVERLOAD_DROP:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** gauge callback */
+static int get_depth(void *opaque, int64_t *value_p)
+{
+    *value_p = *(int *)opaque;
+    return UBASE_ERR_NONE;
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_pool_mgr_alloc_simple(1);
+    assert(umem_mgr != NULL);
+    ubase_assert(umem_pool_mgr_set_stats(umem_mgr, true));
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_DEBUG);
+    assert(logger != NULL);
+    struct uprobe *uprobe_dejitter = uprobe_dejitter_alloc(uprobe_use(logger),
+                                                           10);
+    assert(uprobe_dejitter != NULL);
+
+    assert(uprobe_metrics_alloc(uprobe_use(uprobe_dejitter), NULL, NULL,
+                                9100) == NULL);
+    struct uprobe *uprobe_metrics =
+        uprobe_metrics_alloc(uprobe_use(uprobe_dejitter), NULL, NULL, 0);
+    assert(uprobe_metrics != NULL);
+    unsigned int port;
+    ubase_nassert(uprobe_metrics_get_port(uprobe_metrics, &port));
+
+    struct upipe test_pipe = { 0 };
+    test_pipe.uprobe = uprobe_pfx_alloc(uprobe_use(uprobe_metrics),
+                                        UPROBE_LOG_DEBUG, "te\"st");
+    assert(test_pipe.uprobe != NULL);
+    struct upipe *upipe = &test_pipe;
+    assert(!strcmp(uprobe_pfx_get_name(upipe->uprobe), "te\"st"));
+    assert(uprobe_pfx_get_name(uprobe_metrics) == NULL);
+
+    char *buffer;
+    size_t size;
+    ubase_assert(uprobe_metrics_format(uprobe_metrics, &buffer, &size));
+    assert(size == 0);
+    free(buffer);
+
+    struct upipe_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.inputs = 10;
+    stats.octets = 1880;
+    stats.outputs = 9;
+    stats.time = UCLOCK_FREQ;
+    stats.self_time = UCLOCK_FREQ / 2;
+    stats.max_time = UCLOCK_FREQ / 10;
+    stats.latency[0] = 1;
+    stats.latency[2] = 2;
+    stats.latency_sum = UCLOCK_FREQ / 100;
+    ubase_assert(upipe_throw(upipe, UPROBE_STATS, &stats));
+    ubase_assert(upipe_throw(upipe, UPROBE_STATS, &stats));
+
+    upipe_warn(upipe, "cc error");
+    upipe_warn(upipe, "cc error");
+    upipe_err(upipe, "error");
+    upipe_dbg(upipe, "debug");
+    upipe_throw_sync_lost(upipe);
+
+    struct uref *uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_clock_set_cr_sys(uref, UINT32_MAX);
+    upipe_throw_clock_ref(upipe, uref, 0, 1);
+    uref_clock_set_cr_sys(uref, (uint64_t)UINT32_MAX + 8000);
+    upipe_throw_clock_ref(upipe, uref, 10000, 0);
+    upipe_throw_overload_drop(upipe, uref, 0);
+    uref_free(uref);
+
+    int depth = 42;
+    ubase_assert(uprobe_metrics_add_gauge(uprobe_metrics, "queue_depth",
+                                          "queue=\"in\"", get_depth, &depth));
+    ubase_assert(uprobe_metrics_add_umem_mgr(uprobe_metrics, "pool",
+                                             umem_mgr));
+    struct umem_mgr *acct_mgr = umem_acct_mgr_alloc(umem_mgr);
+    assert(acct_mgr != NULL);
+    struct umem umem;
+    assert(umem_alloc(acct_mgr, &umem, 100));
+    ubase_assert(uprobe_metrics_add_umem_mgr(uprobe_metrics, "acct",
+                                             acct_mgr));
+    ubase_assert(uprobe_metrics_add_dejitter(uprobe_metrics, "dejitter",
+                uprobe_dejitter_from_uprobe(uprobe_dejitter)));
+
+    ubase_assert(uprobe_metrics_format(uprobe_metrics, &buffer, &size));
+    assert(strlen(buffer) == size);
+    printf("%s", buffer);
+    assert(strstr(buffer, "# TYPE upipe_inputs_total counter\n") != NULL);
+    assert(strstr(buffer,
+                  "upipe_inputs_total{pipe=\"te\\\"st\",id=\"0\"} 20\n"));
+    assert(strstr(buffer, "upipe_input_octets_total{pipe=\"te\\\"st\","
+                          "id=\"0\"} 3760\n"));
+    assert(strstr(buffer, "upipe_outputs_total{pipe=\"te\\\"st\","
+                          "id=\"0\"} 18\n"));
+    assert(strstr(buffer, "upipe_input_seconds_total{pipe=\"te\\\"st\","
+                          "id=\"0\"} 2.000000000\n"));
+    assert(strstr(buffer, "upipe_input_max_seconds{pipe=\"te\\\"st\","
+                          "id=\"0\"} 0.100000000\n"));
+    /* the dejitter probe also warns about the discontinuity */
+    assert(strstr(buffer, "upipe_warnings_total{pipe=\"te\\\"st\","
+                          "id=\"0\"} 3\n"));
+    assert(strstr(buffer, "upipe_errors_total{pipe=\"te\\\"st\","
+                          "id=\"0\"} 1\n"));
+    assert(strstr(buffer, "upipe_sync_lost_total{pipe=\"te\\\"st\","
+                          "id=\"0\"} 1\n"));
+    assert(strstr(buffer, "upipe_clock_discontinuities_total"
+                          "{pipe=\"te\\\"st\",id=\"0\"} 1\n"));
+    assert(strstr(buffer, "upipe_overload_drops_total"
+                          "{pipe=\"te\\\"st\",id=\"0\"} 1\n"));
+    assert(strstr(buffer, "# TYPE upipe_latency_seconds histogram\n"
+                          "upipe_latency_seconds_bucket{pipe=\"te\\\"st\","
+                          "id=\"0\",le=\"0.001\"} 2\n"));
+    assert(strstr(buffer, "upipe_latency_seconds_bucket{pipe=\"te\\\"st\","
+                          "id=\"0\",le=\"0.004\"} 6\n"));
+    assert(strstr(buffer, "upipe_latency_seconds_bucket{pipe=\"te\\\"st\","
+                          "id=\"0\",le=\"+Inf\"} 6\n"));
+    assert(strstr(buffer, "upipe_latency_seconds_sum{pipe=\"te\\\"st\","
+                          "id=\"0\"} 0.020000000\n"));
+    assert(strstr(buffer, "upipe_latency_seconds_count{pipe=\"te\\\"st\","
+                          "id=\"0\"} 6\n"));
+    assert(strstr(buffer, "# TYPE queue_depth gauge\n"
+                          "queue_depth{queue=\"in\"} 42\n"));
+    assert(strstr(buffer, "# TYPE upipe_umem_allocs_total counter\n"));
+    assert(strstr(buffer, "upipe_umem_in_use{mem=\"pool\",size=\"32\"}"));
+    assert(strstr(buffer, "# TYPE upipe_umem_live_octets gauge\n"));
+    assert(strstr(buffer, "upipe_umem_live_octets{mem=\"acct\"} 100\n"));
+    assert(strstr(buffer, "upipe_umem_peak_octets{mem=\"acct\"} 100\n"));
+    assert(strstr(buffer, "upipe_dejitter_offset_seconds{probe=\"dejitter\"}"));
+    free(buffer);
+
+    /* dead pipes are forgotten */
+    upipe_throw_dead(upipe);
+    ubase_assert(uprobe_metrics_format(uprobe_metrics, &buffer, &size));
+    assert(strstr(buffer, "upipe_inputs_total") == NULL);
+    assert(strstr(buffer, "queue_depth") != NULL);
+    free(buffer);
+
+    uprobe_release(test_pipe.uprobe);
+    uprobe_release(uprobe_metrics);
+    umem_free(&umem);
+    umem_mgr_release(acct_mgr);
+    uprobe_release(uprobe_dejitter);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
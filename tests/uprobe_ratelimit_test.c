@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_ratelimit implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ratelimit.h>
+#include <upipe/upipe.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+static uint64_t now = 0;
+static unsigned int nb_logs = 0;
+static char last_msg[256];
+
+/** fake clock */
+static uint64_t fake_now(struct uclock *uclock)
+{
+    return now;
+}
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_LOG: {
+            enum uprobe_log_level level = va_arg(args, enum uprobe_log_level);
+            const char *msg = va_arg(args, const char *);
+            if (level != UPROBE_LOG_WARNING)
+                break;
+            snprintf(last_msg, sizeof(last_msg), "%s", msg);
+            printf("%s\n", msg);
+            nb_logs++;
+            break;
+        }
+        case UPROBE_DEAD:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+int main(int argc, char **argv)
+{
+    struct uclock uclock;
+    uclock.refcount = NULL;
+    uclock.uclock_now = fake_now;
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_ratelimit =
+        uprobe_ratelimit_alloc(uprobe_use(&uprobe), &uclock, 10, 2);
+    assert(uprobe_ratelimit != NULL);
+
+    struct upipe test_pipe = { 0 };
+    test_pipe.uprobe = uprobe_pfx_alloc(uprobe_use(uprobe_ratelimit),
+                                        UPROBE_LOG_DEBUG, "test");
+    assert(test_pipe.uprobe != NULL);
+    struct upipe *upipe = &test_pipe;
+
+    struct upipe test_pipe2 = { 0 };
+    test_pipe2.uprobe = uprobe_pfx_alloc(uprobe_use(uprobe_ratelimit),
+                                         UPROBE_LOG_DEBUG, "test2");
+    assert(test_pipe2.uprobe != NULL);
+    struct upipe *upipe2 = &test_pipe2;
+
+    /* formatted messages are checked by their format */
+    for (int i = 0; i < 100; i++)
+        upipe_warn_va(upipe, "cc error %d", i);
+    assert(nb_logs == 2);
+    assert(!strcmp(last_msg, "[test] cc error 1"));
+
+    /* other pipes and messages are accounted separately */
+    upipe_warn_va(upipe2, "cc error %d", 0);
+    assert(nb_logs == 3);
+    upipe_warn(upipe, "plain");
+    upipe_warn(upipe, "plain");
+    upipe_warn(upipe, "plain");
+    assert(nb_logs == 5);
+    assert(!strcmp(last_msg, "[test] plain"));
+
+    /* the summary comes with the next occurrence after the period */
+    now = 10;
+    upipe_warn_va(upipe, "cc error %d", 100);
+    assert(nb_logs == 7);
+    assert(!strcmp(last_msg, "[test] cc error 100"));
+    upipe_warn_va(upipe, "cc error %d", 101);
+    upipe_warn_va(upipe, "cc error %d", 102);
+    assert(nb_logs == 8);
+
+    /* or at the latest when the pipe dies */
+    nb_logs = 0;
+    upipe_throw_dead(upipe);
+    assert(nb_logs == 2);
+    upipe_throw_dead(upipe2);
+    assert(nb_logs == 2);
+
+    /* a formatted message dropped before the rate-limiting probe does not
+     * exempt the next message */
+    struct upipe test_pipe3 = { 0 };
+    test_pipe3.uprobe = uprobe_pfx_alloc(uprobe_use(uprobe_ratelimit),
+                                         UPROBE_LOG_WARNING, "test3");
+    assert(test_pipe3.uprobe != NULL);
+    struct upipe *upipe3 = &test_pipe3;
+    nb_logs = 0;
+    upipe_dbg_va(upipe3, "dropped %d", 0);
+    assert(nb_logs == 0);
+    upipe_warn(upipe3, "plain");
+    upipe_warn(upipe3, "plain");
+    upipe_warn(upipe3, "plain");
+    assert(nb_logs == 2);
+    upipe_throw_dead(upipe3);
+    uprobe_release(test_pipe3.uprobe);
+
+    uprobe_release(test_pipe.uprobe);
+    uprobe_release(test_pipe2.uprobe);
+    uprobe_release(uprobe_ratelimit);
+    uprobe_clean(&uprobe);
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_statmux implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_statmux.h>
+#include <upipe/upipe.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#define NB_ENCODERS 3
+
+/** fake encoder */
+struct test_encoder {
+    uint64_t octetrate;
+    unsigned int nb_sets;
+    struct upipe upipe;
+};
+
+UBASE_FROM_TO(test_encoder, upipe, upipe, upipe)
+
+static unsigned int nb_dead = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_LOG:
+            break;
+        case UPROBE_DEAD:
+            nb_dead++;
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** control of the fake encoders */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    struct test_encoder *encoder = test_encoder_from_upipe(upipe);
+    switch (command) {
+        case UPIPE_ENCODER_GET_OCTETRATE: {
+            uint64_t *octetrate_p = va_arg(args, uint64_t *);
+            *octetrate_p = encoder->octetrate;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_ENCODER_SET_OCTETRATE:
+            encoder->octetrate = va_arg(args, uint64_t);
+            encoder->nb_sets++;
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = NULL,
+    .upipe_input = NULL,
+    .upipe_control = test_control,
+    .upipe_mgr_control = NULL
+};
+
+static struct upipe_mgr other_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = NULL,
+    .upipe_input = NULL,
+    .upipe_control = NULL,
+    .upipe_mgr_control = NULL
+};
+
+int main(int argc, char **argv)
+{
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_VERBOSE);
+    assert(logger != NULL);
+
+    struct uprobe *uprobe_statmux = uprobe_statmux_alloc(uprobe_use(logger),
+                                                         900000);
+    assert(uprobe_statmux != NULL);
+
+    struct test_encoder encoders[NB_ENCODERS];
+    for (int i = 0; i < NB_ENCODERS; i++) {
+        memset(&encoders[i], 0, sizeof(encoders[i]));
+        encoders[i].octetrate = 300000;
+        encoders[i].upipe.mgr = &test_mgr;
+        encoders[i].upipe.uprobe = uprobe_statmux;
+        upipe_throw_ready(&encoders[i].upipe);
+    }
+    struct upipe other = { 0 };
+    other.mgr = &other_mgr;
+    other.uprobe = uprobe_statmux;
+    upipe_throw_ready(&other);
+    ubase_nassert(uprobe_statmux_get_octetrate(uprobe_statmux, &other, NULL));
+
+    /* the encoders which have not reported keep their octetrate */
+    upipe_throw_encoder_complexity(&encoders[0].upipe, 100);
+    assert(encoders[0].octetrate == 300000);
+    assert(!encoders[0].nb_sets);
+
+    upipe_throw_encoder_complexity(&encoders[1].upipe, 300);
+    assert(encoders[0].octetrate == 150000);
+    assert(encoders[1].octetrate == 450000);
+    assert(encoders[2].octetrate == 300000);
+    assert(!encoders[2].nb_sets);
+
+    upipe_throw_encoder_complexity(&encoders[2].upipe, 200);
+    assert(encoders[0].octetrate == 150000);
+    assert(encoders[1].octetrate == 450000);
+    assert(encoders[2].octetrate == 300000);
+    assert(encoders[0].nb_sets == 1);
+    assert(encoders[1].nb_sets == 1);
+    assert(encoders[2].nb_sets == 0);
+
+    upipe_throw_encoder_complexity(&encoders[0].upipe, 400);
+    assert(encoders[0].octetrate == 400000);
+    assert(encoders[1].octetrate == 300000);
+    assert(encoders[2].octetrate == 200000);
+
+    uint64_t octetrate;
+    ubase_assert(uprobe_statmux_get_octetrate(uprobe_statmux,
+                                              &encoders[2].upipe, &octetrate));
+    assert(octetrate == 200000);
+
+    /* shares are rounded down to 1 kbit/s */
+    uprobe_statmux_set_limits(uprobe_statmux, 250000, 0);
+    assert(encoders[0].octetrate == 371375);
+    assert(encoders[1].octetrate == 278500);
+    assert(encoders[2].octetrate == 250000);
+
+    uprobe_statmux_set_limits(uprobe_statmux, 250000, 350000);
+    assert(encoders[0].octetrate == 350000);
+    assert(encoders[1].octetrate == 300000);
+    assert(encoders[2].octetrate == 250000);
+
+    /* the budget of a dead encoder is shared */
+    upipe_throw_dead(&encoders[2].upipe);
+    assert(nb_dead == 1);
+    assert(encoders[0].octetrate == 350000);
+    assert(encoders[1].octetrate == 350000);
+    ubase_nassert(uprobe_statmux_get_octetrate(uprobe_statmux,
+                                               &encoders[2].upipe, NULL));
+
+    uprobe_statmux_set_limits(uprobe_statmux, 0, 0);
+    uprobe_statmux_set_octetrate(uprobe_statmux, 700000);
+    assert(encoders[0].octetrate == 400000);
+    assert(encoders[1].octetrate == 300000);
+
+    uprobe_release(uprobe_statmux);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    return 0;
+}
@@ -53,5 +53,32 @@ int main(int argc, char **argv)
     uprobe_err_va(uprobe2, NULL, "This is another error with %d", 0x43);
     uprobe_warn(uprobe2, NULL, "This is a warning that you shouldn't see");
     uprobe_release(uprobe2);
+
+    struct uprobe *uprobe3 = uprobe_stdio_alloc(NULL, stdout, UPROBE_LOG_DEBUG);
+    assert(uprobe3 != NULL);
+    uint32_t overflows;
+    ubase_nassert(uprobe_stdio_get_overflows(uprobe3, &overflows));
+    ubase_nassert(uprobe_stdio_set_async(uprobe3, 0));
+    ubase_assert(uprobe_stdio_set_async(uprobe3, 16));
+    ubase_nassert(uprobe_stdio_set_async(uprobe3, 16));
+    uprobe_err(uprobe3, NULL, "This is an asynchronous error");
+    uprobe_notice_va(uprobe3, NULL, "This is an asynchronous notice with %d",
+                     0x44);
+    ubase_assert(uprobe_stdio_get_overflows(uprobe3, &overflows));
+    assert(overflows == 0);
+    uprobe_release(uprobe3);
+
+    /* messages are dropped rather than blocking */
+    FILE *null = fopen("/dev/null", "w");
+    assert(null != NULL);
+    struct uprobe *uprobe4 = uprobe_stdio_alloc(NULL, null, UPROBE_LOG_DEBUG);
+    assert(uprobe4 != NULL);
+    ubase_assert(uprobe_stdio_set_async(uprobe4, 1));
+    for (int i = 0; i < 10000; i++)
+        uprobe_warn(uprobe4, NULL, "This is a burst of warnings");
+    ubase_assert(uprobe_stdio_get_overflows(uprobe4, &overflows));
+    assert(overflows < 10000);
+    uprobe_release(uprobe4);
+    fclose(null);
     return 0;
 }
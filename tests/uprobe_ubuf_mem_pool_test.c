@@ -39,8 +39,11 @@
 #include <upipe/uref.h>
 #include <upipe/uref_std.h>
 #include <upipe/uref_pic_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/upool.h>
 #include <upipe/ubuf.h>
 #include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_block.h>
 #include <upipe/urequest.h>
 
 #include <stdio.h>
@@ -51,10 +54,14 @@
 #define UDICT_POOL_DEPTH 0
 #define UREF_POOL_DEPTH 0
 #define UBUF_POOL_DEPTH 0
+#define UBUF_TUNE_DEPTH 2
+#define UBUF_TUNE_MAX_DEPTH 8
+#define UBUF_TUNE_NB 6
 
 static struct uref *flow_def;
 static void (*test_mgr)(struct ubuf_mgr *);
 static struct ubuf_mgr *previous_ubuf_mgr = NULL;
+static struct ubuf_mgr *tune_ubuf_mgr = NULL;
 
 static void test_I420(struct ubuf_mgr *mgr)
 {
@@ -162,6 +169,22 @@ static void test_YUYV(struct ubuf_mgr *mgr)
     ubuf_free(ubuf);
 }
 
+static void test_tune(struct ubuf_mgr *mgr)
+{
+    tune_ubuf_mgr = ubuf_mgr_use(mgr);
+}
+
+static void test_churn(struct ubuf_mgr *mgr)
+{
+    struct ubuf *ubufs[UBUF_TUNE_NB];
+    for (int i = 0; i < UBUF_TUNE_NB; i++) {
+        ubufs[i] = ubuf_block_alloc(mgr, 16);
+        assert(ubufs[i] != NULL);
+    }
+    for (int i = 0; i < UBUF_TUNE_NB; i++)
+        ubuf_free(ubufs[i]);
+}
+
 /** helper phony pipe to test uprobe_ubuf_mem_pool */
 static int uprobe_test_provide_ubuf_mgr(struct urequest *urequest, va_list args)
 {
@@ -186,8 +209,10 @@ static struct upipe *uprobe_test_alloc(struct upipe_mgr *mgr,
     assert(upipe != NULL);
     upipe_init(upipe, mgr, uprobe);
     struct urequest request;
-    urequest_init_ubuf_mgr(&request, flow_def, uprobe_test_provide_ubuf_mgr,
-                           NULL);
+    urequest_init_ubuf_mgr(&request, uref_dup(flow_def),
+                           uprobe_test_provide_ubuf_mgr, NULL);
+    ubase_assert(upipe_throw_provide_request(upipe, &request));
+    urequest_clean(&request);
     return upipe;
 }
 
@@ -263,6 +288,63 @@ int main(int argc, char **argv)
     uref_free(flow_def);
     previous_ubuf_mgr = NULL;
 
+    uprobe_release(uprobe);
+
+    /* pool tuning */
+    uprobe = uprobe_ubuf_mem_pool_alloc(NULL, umem_mgr,
+            UBUF_TUNE_DEPTH, UBUF_TUNE_DEPTH);
+    assert(uprobe != NULL);
+    uprobe_ubuf_mem_pool_set_max_depth(uprobe, UBUF_TUNE_MAX_DEPTH,
+                                       UBUF_TUNE_MAX_DEPTH);
+    struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool =
+        uprobe_ubuf_mem_pool_from_uprobe(uprobe);
+
+    test_mgr = test_tune;
+    flow_def = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(flow_def != NULL);
+    upipe = upipe_void_alloc(&uprobe_test_mgr, uprobe_use(uprobe));
+    uprobe_test_free(upipe);
+    uref_free(flow_def);
+    assert(tune_ubuf_mgr != NULL);
+
+    struct upool_stats ubuf_stats, shared_stats;
+    ubase_assert(ubuf_mgr_get_pool_stats(tune_ubuf_mgr, &ubuf_stats,
+                                         &shared_stats));
+    assert(ubuf_stats.length == UBUF_TUNE_MAX_DEPTH);
+    assert(ubuf_stats.depth == UBUF_TUNE_DEPTH);
+    assert(shared_stats.depth == UBUF_TUNE_DEPTH);
+
+    /* the pool is too small and is deepened */
+    test_churn(tune_ubuf_mgr);
+    test_churn(tune_ubuf_mgr);
+    uprobe_ubuf_mem_pool_tune(uprobe_ubuf_mem_pool);
+    ubase_assert(ubuf_mgr_get_pool_stats(tune_ubuf_mgr, &ubuf_stats,
+                                         &shared_stats));
+    assert(ubuf_stats.depth == UBUF_TUNE_MAX_DEPTH);
+    assert(shared_stats.depth == UBUF_TUNE_MAX_DEPTH);
+
+    /* the deepened pool no longer releases structures */
+    uint32_t overflows = ubuf_stats.overflows;
+    test_churn(tune_ubuf_mgr);
+    ubase_assert(ubuf_mgr_get_pool_stats(tune_ubuf_mgr, &ubuf_stats,
+                                         &shared_stats));
+    assert(ubuf_stats.overflows == overflows);
+    uprobe_ubuf_mem_pool_tune(uprobe_ubuf_mem_pool);
+    ubase_assert(ubuf_mgr_get_pool_stats(tune_ubuf_mgr, &ubuf_stats,
+                                         &shared_stats));
+    assert(ubuf_stats.depth == UBUF_TUNE_MAX_DEPTH);
+    assert(ubuf_stats.created != ubuf_stats.destroyed);
+
+    /* the unused manager is trimmed but keeps its depth */
+    struct ubuf_mgr *ubuf_mgr = tune_ubuf_mgr;
+    ubuf_mgr_release(tune_ubuf_mgr);
+    uprobe_ubuf_mem_pool_tune(uprobe_ubuf_mem_pool);
+    ubase_assert(ubuf_mgr_get_pool_stats(ubuf_mgr, &ubuf_stats,
+                                         &shared_stats));
+    assert(ubuf_stats.created == ubuf_stats.destroyed);
+    assert(shared_stats.created == shared_stats.destroyed);
+    assert(ubuf_stats.depth == UBUF_TUNE_MAX_DEPTH);
+
     uprobe_release(uprobe);
     uref_mgr_release(uref_mgr);
     udict_mgr_release(udict_mgr);
@@ -42,6 +42,15 @@
 #include <assert.h>
 
 static struct uclock *uclock;
+static unsigned int nb_events = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    nb_events++;
+    return UBASE_ERR_NONE;
+}
 
 /** helper phony pipe to test uprobe_ubuf_mem */
 static int uprobe_test_provide_uclock(struct urequest *urequest, va_list args)
@@ -91,6 +100,37 @@ int main(int argc, char **argv)
     struct upipe *upipe = upipe_void_alloc(&uprobe_test_mgr, uprobe);
     uprobe_test_free(upipe);
 
+    struct uprobe uprobe_catch;
+    uprobe_init(&uprobe_catch, catch, NULL);
+    uprobe = uprobe_uclock_alloc(&uprobe_catch, uclock);
+    assert(uprobe != NULL);
+    upipe = upipe_void_alloc(&uprobe_test_mgr, uprobe);
+    assert(upipe_throw(upipe, UPROBE_SINK_END) == UBASE_ERR_NONE);
+    assert(nb_events == 1);
+    uprobe_test_free(upipe);
+
+    uprobe_set_events(&uprobe_catch, UPROBE_EVENT_MASK(UPROBE_SOURCE_END));
+    uprobe = uprobe_uclock_alloc(&uprobe_catch, uclock);
+    assert(uprobe != NULL);
+    upipe = upipe_void_alloc(&uprobe_test_mgr, uprobe);
+    assert(upipe_throw(upipe, UPROBE_SINK_END) == UBASE_ERR_UNHANDLED);
+    assert(nb_events == 1);
+    assert(upipe_throw(upipe, UPROBE_SOURCE_END) == UBASE_ERR_NONE);
+    assert(nb_events == 2);
+    assert(upipe_throw(upipe, UPROBE_LOCAL, UBASE_FOURCC('t','e','s','t')) ==
+           UBASE_ERR_NONE);
+    assert(nb_events == 3);
+
+    /* the pipe notices changes of the events of its probes */
+    uprobe_set_events(&uprobe_catch, UPROBE_EVENTS_ALL);
+    assert(upipe_throw(upipe, UPROBE_SINK_END) == UBASE_ERR_NONE);
+    assert(nb_events == 4);
+    uprobe_set_events(&uprobe_catch, 0);
+    assert(upipe_throw(upipe, UPROBE_SOURCE_END) == UBASE_ERR_UNHANDLED);
+    assert(nb_events == 4);
+    uprobe_test_free(upipe);
+    uprobe_clean(&uprobe_catch);
+
     uclock_release(uclock);
     return 0;
 }
@@ -119,6 +119,14 @@ int main(int argc, char **argv)
     mgr = upump_ecore_mgr_alloc(UPUMP_POOL, UPUMP_BLOCKER_POOL);
     assert(mgr != NULL);
 
+    bool frame_sync;
+    assert(ubase_check(upump_ecore_mgr_get_frame_sync(mgr, &frame_sync)));
+    assert(!frame_sync);
+    assert(ubase_check(upump_ecore_mgr_set_frame_sync(mgr, true)));
+    assert(ubase_check(upump_ecore_mgr_get_frame_sync(mgr, &frame_sync)));
+    assert(frame_sync);
+    assert(ubase_check(upump_ecore_mgr_set_frame_sync(mgr, false)));
+
     /* Create a pipe with non-blocking write */
     assert(pipe(pipefd) != -1);
     flags = fcntl(pipefd[1], F_GETFL);
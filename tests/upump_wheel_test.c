@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2014-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for upump manager multiplexing timers on a wheel
+ */
+
+#undef NDEBUG
+
+#include <upipe/upump.h>
+#include <upipe/upump_wheel.h>
+#include <upump-uring/upump_uring.h>
+
+#include <stdio.h>
+#include <assert.h>
+
+#define UPUMP_POOL 1
+#define UPUMP_BLOCKER_POOL 1
+/* 1 us, so that the overflow list is cascaded in a short time */
+#define TICK 27
+#define NB_TIMERS 300
+#define OVERFLOW_TICKS 70000
+#define REPEAT_TICKS 10
+#define NB_REPEATS 5
+
+static struct upump *timers[NB_TIMERS];
+static struct upump *stopped_timer;
+static unsigned int last_timer = 0;
+static unsigned int nb_timers = 0;
+static unsigned int nb_repeats = 0;
+static bool overflow_passed = false;
+
+static void timer_cb(struct upump *upump)
+{
+    unsigned int i = upump_get_opaque(upump, uintptr_t);
+    /* timers expire in order, whatever the level they were sorted into */
+    assert(i >= last_timer);
+    last_timer = i;
+    nb_timers++;
+    if (i == NB_TIMERS / 2)
+        upump_stop(stopped_timer);
+}
+
+static void stopped_timer_cb(struct upump *upump)
+{
+    assert(0);
+}
+
+static void repeat_timer_cb(struct upump *upump)
+{
+    if (++nb_repeats == NB_REPEATS)
+        upump_free(upump);
+}
+
+static void overflow_timer_cb(struct upump *upump)
+{
+    printf("overflow timer passed\n");
+    assert(nb_timers == NB_TIMERS);
+    assert(nb_repeats == NB_REPEATS);
+    overflow_passed = true;
+}
+
+int main(int argc, char **argv)
+{
+    struct upump_mgr *uring_mgr =
+        upump_uring_mgr_alloc(0, UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(uring_mgr != NULL);
+    struct upump_mgr *mgr = upump_wheel_mgr_alloc(uring_mgr, TICK,
+            UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(mgr != NULL);
+
+    /* timers in the first and second levels of the wheel, in reverse order */
+    for (int i = NB_TIMERS - 1; i >= 0; i--) {
+        timers[i] = upump_alloc_timer(mgr, timer_cb, (void *)(uintptr_t)i,
+                                      (i + 1) * TICK, 0);
+        assert(timers[i] != NULL);
+        upump_start(timers[i]);
+    }
+    stopped_timer = upump_alloc_timer(mgr, stopped_timer_cb, NULL,
+                                      (NB_TIMERS + 1) * TICK, 0);
+    assert(stopped_timer != NULL);
+    upump_start(stopped_timer);
+
+    struct upump *repeat_timer = upump_alloc_timer(mgr, repeat_timer_cb, NULL,
+            REPEAT_TICKS * TICK, REPEAT_TICKS * TICK);
+    assert(repeat_timer != NULL);
+    upump_start(repeat_timer);
+
+    struct upump *overflow_timer = upump_alloc_timer(mgr, overflow_timer_cb,
+            NULL, OVERFLOW_TICKS * TICK, 0);
+    assert(overflow_timer != NULL);
+    upump_start(overflow_timer);
+
+    ubase_assert(upump_uring_mgr_run(uring_mgr));
+    assert(overflow_passed);
+
+    for (int i = 0; i < NB_TIMERS; i++)
+        upump_free(timers[i]);
+    upump_free(stopped_timer);
+    upump_free(overflow_timer);
+    upump_mgr_release(mgr);
+    upump_mgr_release(uring_mgr);
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2012 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for flat uref manager
+ */
+
+#undef NDEBUG
+
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flat.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 1
+#define UBUF_POOL_DEPTH 1
+#define SLAB_POOL_DEPTH 4
+#define DATA_SIZE 188
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct ubuf_mgr *fallback_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, -1, 0);
+    assert(fallback_mgr != NULL);
+    struct uref_mgr *mgr = uref_flat_mgr_alloc(SLAB_POOL_DEPTH, udict_mgr, 0,
+                                               DATA_SIZE, fallback_mgr);
+    assert(mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr;
+    ubase_assert(uref_flat_mgr_get_ubuf_mgr(mgr, &ubuf_mgr));
+    assert(ubuf_mgr != NULL && ubuf_mgr != fallback_mgr);
+
+    /* packet carved from a single slab */
+    struct uref *uref1 = uref_block_alloc(mgr, ubuf_mgr, DATA_SIZE);
+    assert(uref1 != NULL);
+    assert(uref1->ubuf != NULL && uref1->ubuf->mgr == ubuf_mgr);
+    ubase_nassert(uref_clock_get_ingress(uref1, NULL));
+    uref_clock_set_ingress(uref1, 42);
+    size_t size;
+    ubase_assert(uref_block_size(uref1, &size));
+    assert(size == DATA_SIZE);
+    int wanted = -1;
+    uint8_t *w;
+    ubase_assert(uref_block_write(uref1, 0, &wanted, &w));
+    assert(wanted == DATA_SIZE);
+    memset(w, 0x47, DATA_SIZE);
+    ubase_assert(uref_block_unmap(uref1, 0));
+    ubase_assert(ubuf_control(uref1->ubuf, UBUF_SINGLE));
+
+    /* duplicates share the data */
+    struct uref *uref2 = uref_dup(uref1);
+    assert(uref2 != NULL);
+    assert(uref2->ubuf != uref1->ubuf);
+    ubase_nassert(ubuf_control(uref1->ubuf, UBUF_SINGLE));
+    uint64_t ingress;
+    ubase_assert(uref_clock_get_ingress(uref2, &ingress));
+    assert(ingress == 42);
+    struct uref *uref3 = uref_block_splice(uref1, 4, 10);
+    assert(uref3 != NULL);
+    ubase_assert(uref_block_size(uref3, &size));
+    assert(size == 10);
+
+    /* the data outlives the uref and the ubuf it was allocated with */
+    uref_free(uref1);
+    uref_free(uref2);
+    ubase_assert(uref_block_match(uref3, (const uint8_t *)"\x47\x47",
+                                  (const uint8_t *)"\xff\xff", 2));
+    ubase_assert(ubuf_control(uref3->ubuf, UBUF_SINGLE));
+    uref_free(uref3);
+
+    /* larger packets use the fallback manager */
+    uref1 = uref_block_alloc(mgr, ubuf_mgr, DATA_SIZE + 1);
+    assert(uref1 != NULL);
+    assert(uref1->ubuf->mgr == fallback_mgr);
+    uref_free(uref1);
+
+    /* standalone ubuf, and uref without ubuf */
+    struct ubuf *ubuf = ubuf_block_alloc(ubuf_mgr, 7);
+    assert(ubuf != NULL && ubuf->mgr == ubuf_mgr);
+    uref1 = uref_alloc(mgr);
+    assert(uref1 != NULL);
+    uref_attach_ubuf(uref1, ubuf);
+    ubase_assert(uref_block_size(uref1, &size));
+    assert(size == 7);
+    uref_free(uref1);
+
+    uref_mgr_release(mgr);
+    ubuf_mgr_release(fallback_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uref drop priorities
+ */
+
+#undef NDEBUG
+
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_priority.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 1
+#define UREF_POOL_DEPTH 1
+#define NB_UREFS 5
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(mgr != NULL);
+
+    /* classification */
+    struct uref *uref = uref_alloc(mgr);
+    assert(uref != NULL);
+    assert(uref_priority_classify(uref, NULL) == UREF_PRIORITY_NORMAL);
+    assert(uref_priority_classify(uref, "block.h264.pic.") ==
+           UREF_PRIORITY_NORMAL);
+    assert(uref_priority_classify(uref, "pic.yuv420p.") ==
+           UREF_PRIORITY_NORMAL);
+    assert(uref_priority_classify(uref, "block.mp2.sound.") ==
+           UREF_PRIORITY_HIGH);
+    assert(uref_priority_classify(uref, "sound.s16.") == UREF_PRIORITY_HIGH);
+    assert(uref_priority_classify(uref, "block.dvb_subtitle.pic.sub.") ==
+           UREF_PRIORITY_HIGH);
+    assert(uref_priority_classify(uref, "block.mpegtspsi.mpegtspat.") ==
+           UREF_PRIORITY_CRITICAL);
+    assert(uref_priority_classify(uref, "block.mpegts.mpegtspsi.") ==
+           UREF_PRIORITY_CRITICAL);
+    assert(uref_priority_classify(uref, "void.") == UREF_PRIORITY_NORMAL);
+
+    ubase_assert(uref_pic_set_key(uref));
+    assert(uref_priority_classify(uref, "block.h264.pic.") ==
+           UREF_PRIORITY_RANDOM);
+    assert(uref_priority_classify(uref, "block.mp2.sound.") ==
+           UREF_PRIORITY_HIGH);
+    ubase_assert(uref_pic_delete_key(uref));
+    ubase_assert(uref_flow_set_random(uref));
+    assert(uref_priority_classify(uref, NULL) == UREF_PRIORITY_RANDOM);
+    assert(uref_priority_classify(uref, "block.mpeg2video.pic.") ==
+           UREF_PRIORITY_RANDOM);
+    ubase_assert(uref_flow_delete_random(uref));
+
+    /* explicit priorities set by the framers or upstream pipes */
+    ubase_assert(uref_flow_set_priority(uref, UREF_PRIORITY_DISPOSABLE));
+    assert(uref_priority_classify(uref, "block.h264.pic.") ==
+           UREF_PRIORITY_DISPOSABLE);
+    ubase_assert(uref_flow_set_priority(uref, UINT8_MAX));
+    assert(uref_priority_classify(uref, NULL) == UREF_PRIORITY_CRITICAL);
+    ubase_assert(uref_flow_delete_priority(uref));
+
+    ubase_assert(uref_flow_set_def(uref, "block.h264.pic."));
+    assert(uref_priority_classify(uref, "block.h264.pic.") ==
+           UREF_PRIORITY_CRITICAL);
+    uref_free(uref);
+
+    /* lowest priority first, oldest first, never critical */
+    const enum uref_priority priorities[NB_UREFS] = {
+        UREF_PRIORITY_CRITICAL, UREF_PRIORITY_HIGH, UREF_PRIORITY_NORMAL,
+        UREF_PRIORITY_RANDOM, UREF_PRIORITY_NORMAL
+    };
+    struct uref *urefs[NB_UREFS];
+    struct uchain list;
+    ulist_init(&list);
+    assert(uref_priority_find_lowest(&list) == NULL);
+    for (unsigned int i = 0; i < NB_UREFS; i++) {
+        urefs[i] = uref_alloc(mgr);
+        assert(urefs[i] != NULL);
+        urefs[i]->priv = priorities[i];
+        ulist_add(&list, uref_to_uchain(urefs[i]));
+    }
+
+    const unsigned int order[NB_UREFS - 1] = { 2, 4, 3, 1 };
+    for (unsigned int i = 0; i < NB_UREFS - 1; i++) {
+        uref = uref_priority_find_lowest(&list);
+        assert(uref == urefs[order[i]]);
+        ulist_delete(uref_to_uchain(uref));
+        uref_free(uref);
+    }
+    assert(uref_priority_find_lowest(&list) == NULL);
+    ulist_delete(uref_to_uchain(urefs[0]));
+    uref_free(urefs[0]);
+
+    assert(!strcmp(uref_priority_name(UREF_PRIORITY_DISPOSABLE),
+                   "disposable"));
+
+    uref_mgr_release(mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
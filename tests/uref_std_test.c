@@ -35,6 +35,7 @@
 #include <upipe/udict_inline.h>
 #include <upipe/uref.h>
 #include <upipe/uref_std.h>
+#include <upipe/uref_clock.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -56,9 +57,15 @@ int main(int argc, char **argv)
     struct uref *uref1 = uref_alloc(mgr);
     assert(uref1 != NULL);
 
+    ubase_nassert(uref_clock_get_ingress(uref1, NULL));
+    uref_clock_set_ingress(uref1, 42);
+
     struct uref *uref2 = uref_dup(uref1);
     assert(uref2 != NULL);
     assert(uref2 != uref1);
+    uint64_t ingress;
+    ubase_assert(uref_clock_get_ingress(uref2, &ingress));
+    assert(ingress == 42);
     uref_free(uref1);
     uref_free(uref2);
 
@@ -67,6 +74,27 @@ int main(int argc, char **argv)
     assert(uref1 == uref2); // because the pool is 1 packet deep
     uref_free(uref2);
 
+    uref1 = uref_alloc(mgr);
+    assert(uref1 != NULL);
+    uint64_t cr, dts, pts;
+    ubase_nassert(uref_clock_get_dates_sys(uref1, &cr, &dts, &pts));
+    uref_clock_set_cr_prog(uref1, 100);
+    uref_clock_set_dts_prog(uref1, 110);
+    uref_clock_set_pts_orig(uref1, 1000);
+    ubase_assert(uref_clock_get_dates_prog(uref1, &cr, &dts, &pts));
+    assert(cr == 100 && dts == 110 && pts == UINT64_MAX);
+    uref_clock_set_pts_prog(uref1, 130);
+    uref_clock_add_dates(uref1, 10);
+    ubase_assert(uref_clock_get_dates_prog(uref1, &cr, &dts, &pts));
+    assert(cr == 110 && dts == 120 && pts == 140);
+    ubase_assert(uref_clock_get_dates_orig(uref1, &cr, &dts, &pts));
+    assert(cr == 980 && dts == 990 && pts == 1010);
+    ubase_nassert(uref_clock_get_dates_sys(uref1, NULL, NULL, NULL));
+    uref_clock_add_date_orig(uref1, -10);
+    ubase_assert(uref_clock_get_pts_orig(uref1, &pts));
+    assert(pts == 1000);
+    uref_free(uref1);
+
     uref1 = uref_alloc_control(mgr);
     assert(uref1 != NULL);
     uref_free(uref1);
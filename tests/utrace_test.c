@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for utrace implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe/utrace.h>
+#include <upipe-modules/upipe_skip.h>
+#include <upipe-modules/upipe_null.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    5
+#define UREF_POOL_DEPTH     5
+#define UBUF_POOL_DEPTH     5
+#define UBUF_ALIGN          32
+#define UBUF_ALIGN_OFFSET   0
+
+#define DEPTH       8
+#define ITERATIONS  5
+#define SIZE        1024
+#define OFFSET      8
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static struct upipe *skip = NULL;
+static struct upipe *null = NULL;
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *block_mgr;
+static unsigned int nb_records[2];
+static uint64_t last_date = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe, int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** records callback */
+static void check_record(void *opaque, const struct utrace_record *record)
+{
+    assert(record->thread < 2);
+    nb_records[record->thread]++;
+    if (record->thread == 0) {
+        /* records of a thread are in order */
+        assert(record->date >= last_date);
+        last_date = record->date;
+    }
+    if (record->upipe == (uintptr_t)skip) {
+        assert(record->signature == UPIPE_SKIP_SIGNATURE);
+        assert(record->size == (record->event == UTRACE_INPUT ?
+                                SIZE : SIZE - OFFSET));
+        assert(record->date_sys == UINT64_MAX);
+    } else {
+        assert(record->upipe == (uintptr_t)null);
+        assert(record->signature == UPIPE_NULL_SIGNATURE);
+        assert(record->event == UTRACE_INPUT);
+    }
+}
+
+/** thread feeding the null pipe */
+static void *thread_entry(void *arg)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    uref_clock_set_cr_sys(uref, 42);
+    upipe_input(null, uref, NULL);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
+    int i;
+
+    /* uref and mem management */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH, umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    block_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr,
+            UBUF_ALIGN,
+            UBUF_ALIGN_OFFSET);
+    assert(block_mgr);
+
+    /* uprobe stuff */
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_DEBUG);
+    assert(uprobe_stdio != NULL);
+
+    /* build pipes */
+    struct upipe_mgr *upipe_skip_mgr = upipe_skip_mgr_alloc();
+    assert(upipe_skip_mgr);
+    skip = upipe_void_alloc(upipe_skip_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "skip"));
+    assert(skip);
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "foo.");
+    assert(uref);
+    ubase_assert(upipe_set_flow_def(skip, uref));
+    uref_free(uref);
+    ubase_assert(upipe_skip_set_offset(skip, OFFSET));
+
+    struct upipe_mgr *upipe_null_mgr = upipe_null_mgr_alloc();
+    assert(upipe_null_mgr);
+    null = upipe_void_alloc(upipe_null_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "null"));
+    assert(null);
+    ubase_assert(upipe_set_output(skip, null));
+
+    /* nothing is recorded while disabled */
+    uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    upipe_input(skip, uref, NULL);
+    utrace_iterate(check_record, NULL);
+    assert(nb_records[0] == 0);
+
+    ubase_nassert(utrace_enable(UINT_MAX));
+    ubase_assert(utrace_enable(DEPTH - 1));
+    for (i = 0; i < ITERATIONS; i++) {
+        uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+        assert(uref != NULL);
+        upipe_input(skip, uref, NULL);
+    }
+
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, thread_entry, NULL) == 0);
+    assert(pthread_join(thread, NULL) == 0);
+    utrace_disable();
+
+    /* older records are overwritten */
+    utrace_iterate(check_record, NULL);
+    assert(nb_records[0] == DEPTH);
+    assert(nb_records[1] == 1);
+
+    char *buffer;
+    size_t size;
+    FILE *file = open_memstream(&buffer, &size);
+    assert(file != NULL);
+    ubase_assert(utrace_dump_chrome(file));
+    fclose(file);
+    printf("%s", buffer);
+    assert(!strncmp(buffer, "{\"traceEvents\":[", 16));
+    assert(strstr(buffer, "\"name\":\"skip output\"") != NULL);
+    assert(strstr(buffer, "\"name\":\"null input\"") != NULL);
+    assert(strstr(buffer, ",\"size\":1016") != NULL);
+    assert(strstr(buffer, ",\"date_sys\":42") != NULL);
+    assert(strstr(buffer, "\"tid\":1,") != NULL);
+    free(buffer);
+
+    /* enabling again discards previous records */
+    ubase_assert(utrace_enable(DEPTH));
+    memset(nb_records, 0, sizeof(nb_records));
+    utrace_iterate(check_record, NULL);
+    assert(nb_records[0] == 0);
+    utrace_disable();
+    utrace_clean();
+
+    upipe_release(skip);
+    upipe_release(null);
+
+    upipe_mgr_release(upipe_skip_mgr); // no-op
+    upipe_mgr_release(upipe_null_mgr); // no-op
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(block_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}